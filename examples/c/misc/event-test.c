@@ -738,6 +738,21 @@ myStoragePoolEventRefreshCallback(virConnectPtr conn G_GNUC_UNUSED,
 }
 
 
+static int
+myStoragePoolEventThresholdCallback(virConnectPtr conn G_GNUC_UNUSED,
+                                    virStoragePoolPtr pool,
+                                    const char *volume,
+                                    unsigned long long threshold,
+                                    unsigned long long excess,
+                                    void *opaque G_GNUC_UNUSED)
+{
+    printf("%s EVENT: Storage pool %s volume %s threshold %llu exceeded by %llu\n",
+           __func__, virStoragePoolGetName(pool), NULLSTR(volume),
+           threshold, excess);
+    return 0;
+}
+
+
 static int
 myNodeDeviceEventCallback(virConnectPtr conn G_GNUC_UNUSED,
                           virNodeDevicePtr dev,
@@ -1037,6 +1052,22 @@ myDomainEventMetadataChangeCallback(virConnectPtr conn G_GNUC_UNUSED,
 }
 
 
+static int
+myDomainEventMonitorSlowCallback(virConnectPtr conn G_GNUC_UNUSED,
+                                 virDomainPtr dom,
+                                 const char *command,
+                                 unsigned long long elapsed,
+                                 void *opaque G_GNUC_UNUSED)
+{
+    /* Casts to uint64_t to work around mingw not knowing %lld */
+    printf("%s EVENT: Domain %s(%d) monitor command '%s' waiting for "
+           "%" PRIu64 " ms\n",
+           __func__, virDomainGetName(dom), virDomainGetID(dom),
+           command, (uint64_t)elapsed);
+    return 0;
+}
+
+
 
 static void
 myFreeFunc(void *opaque)
@@ -1093,6 +1124,7 @@ struct domainEventData domainEvents[] = {
     DOMAIN_EVENT(VIR_DOMAIN_EVENT_ID_DEVICE_REMOVAL_FAILED, myDomainEventDeviceRemovalFailedCallback),
     DOMAIN_EVENT(VIR_DOMAIN_EVENT_ID_METADATA_CHANGE, myDomainEventMetadataChangeCallback),
     DOMAIN_EVENT(VIR_DOMAIN_EVENT_ID_BLOCK_THRESHOLD, myDomainEventBlockThresholdCallback),
+    DOMAIN_EVENT(VIR_DOMAIN_EVENT_ID_MONITOR_SLOW, myDomainEventMonitorSlowCallback),
 };
 
 struct storagePoolEventData {
@@ -1108,6 +1140,7 @@ struct storagePoolEventData {
 struct storagePoolEventData storagePoolEvents[] = {
     STORAGE_POOL_EVENT(VIR_STORAGE_POOL_EVENT_ID_LIFECYCLE, myStoragePoolEventCallback),
     STORAGE_POOL_EVENT(VIR_STORAGE_POOL_EVENT_ID_REFRESH, myStoragePoolEventRefreshCallback),
+    STORAGE_POOL_EVENT(VIR_STORAGE_POOL_EVENT_ID_THRESHOLD, myStoragePoolEventThresholdCallback),
 };
 
 struct nodeDeviceEventData {
@@ -187,6 +187,32 @@ virAdmServerPtr virAdmConnectLookupServer(virAdmConnectPtr conn,
 
 # define VIR_THREADPOOL_JOB_QUEUE_DEPTH "jobQueueDepth"
 
+/**
+ * VIR_THREADPOOL_CLIENT_WORKERS_MAX:
+ * Macro for the threadpool maxClientWorkers limit: represents the upper
+ * limit to number of workers processing requests of a single client at the
+ * same time, as VIR_TYPED_PARAM_UINT. High priority requests are not
+ * subject to this limit. Requests of clients with fewer requests in progress
+ * are always preferred. 0 means no limit.
+ */
+
+# define VIR_THREADPOOL_CLIENT_WORKERS_MAX "maxClientWorkers"
+
+/**
+ * VIR_THREADPOOL_EVENT_THREADS:
+ * Macro for the threadpool eventThreads attribute: represents the number
+ * of threads dispatching I/O of clients besides the main event loop, as
+ * VIR_TYPED_PARAM_UINT. For every such thread, the average and maximum
+ * time in microseconds its loop was late dispatching events are reported
+ * as "eventThread.<num>.latencyAvg" and "eventThread.<num>.latencyMax"
+ * respectively, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_THREADPOOL_EVENT_THREADS "eventThreads"
+
 /* Tunables for a server workerpool */
 int virAdmServerGetThreadPoolParameters(virAdmServerPtr srv,
                                         virTypedParameterPtr *params,
@@ -343,6 +369,156 @@ virAdmServerLookupClient(virAdmServerPtr srv,
 
 # define VIR_CLIENT_INFO_SELINUX_CONTEXT "selinux_context"
 
+/**
+ * VIR_CLIENT_INFO_COMPRESSION_TX_RAW:
+ * Macro represents the number of bytes the daemon sent to the client before
+ * compression, if compression is enabled on the connection, as
+ * VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_CLIENT_INFO_COMPRESSION_TX_RAW "compression_tx_raw"
+
+/**
+ * VIR_CLIENT_INFO_COMPRESSION_TX_WIRE:
+ * Macro represents the number of bytes the daemon sent to the client after
+ * compression, if compression is enabled on the connection, as
+ * VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_CLIENT_INFO_COMPRESSION_TX_WIRE "compression_tx_wire"
+
+/**
+ * VIR_CLIENT_INFO_COMPRESSION_RX_WIRE:
+ * Macro represents the number of compressed bytes the daemon received from
+ * the client, if compression is enabled on the connection, as
+ * VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_CLIENT_INFO_COMPRESSION_RX_WIRE "compression_rx_wire"
+
+/**
+ * VIR_CLIENT_INFO_COMPRESSION_RX_RAW:
+ * Macro represents the number of bytes the daemon received from the client
+ * after decompression, if compression is enabled on the connection, as
+ * VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_CLIENT_INFO_COMPRESSION_RX_RAW "compression_rx_raw"
+
+/**
+ * VIR_CLIENT_INFO_EVENTS_DROPPED:
+ * Macro represents the number of events the daemon dropped because too many
+ * were waiting to be sent to the client, if an event delivery policy is
+ * configured, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_CLIENT_INFO_EVENTS_DROPPED "events_dropped"
+
+/**
+ * VIR_CLIENT_INFO_EVENTS_COALESCED:
+ * Macro represents the number of events the daemon didn't send to the client
+ * because newer events superseded them, if an event delivery policy is
+ * configured, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_CLIENT_INFO_EVENTS_COALESCED "events_coalesced"
+
+/**
+ * VIR_CLIENT_INFO_KEEPALIVE_REQUESTS:
+ * Macro represents the number of keepalive requests the daemon sent to the
+ * client, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_CLIENT_INFO_KEEPALIVE_REQUESTS "keepalive_requests"
+
+/**
+ * VIR_CLIENT_INFO_KEEPALIVE_RESPONSES:
+ * Macro represents the number of keepalive requests the client answered,
+ * as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_CLIENT_INFO_KEEPALIVE_RESPONSES "keepalive_responses"
+
+/**
+ * VIR_CLIENT_INFO_KEEPALIVE_RTT:
+ * Macro represents the round trip time of the last answered keepalive
+ * request in microseconds, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_CLIENT_INFO_KEEPALIVE_RTT "keepalive_rtt"
+
+/**
+ * VIR_CLIENT_INFO_KEEPALIVE_RTT_AVG:
+ * Macro represents the average round trip time of keepalive requests in
+ * microseconds, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_CLIENT_INFO_KEEPALIVE_RTT_AVG "keepalive_rtt_avg"
+
+/**
+ * VIR_CLIENT_INFO_KEEPALIVE_RTT_MAX:
+ * Macro represents the longest round trip time of keepalive requests in
+ * microseconds, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_CLIENT_INFO_KEEPALIVE_RTT_MAX "keepalive_rtt_max"
+
+/**
+ * VIR_CLIENT_INFO_TLS_HANDSHAKE_TIME:
+ * Macro represents the time the TLS handshake with the client took in
+ * microseconds, including waiting for the client, as
+ * VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_CLIENT_INFO_TLS_HANDSHAKE_TIME "tls_handshake_time"
+
+/**
+ * VIR_CLIENT_INFO_TLS_SESSION_RESUMED:
+ * Macro represents whether the client resumed a previous TLS session
+ * instead of doing a full handshake, as VIR_TYPED_PARAM_BOOLEAN.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_CLIENT_INFO_TLS_SESSION_RESUMED "tls_session_resumed"
+
 int virAdmClientGetInfo(virAdmClientPtr client,
                         virTypedParameterPtr *params,
                         int *nparams,
@@ -405,6 +581,11 @@ int virAdmServerSetClientLimits(virAdmServerPtr srv,
 int virAdmServerUpdateTlsFiles(virAdmServerPtr srv,
                                unsigned int flags);
 
+int virAdmServerGetProcedureStats(virAdmServerPtr srv,
+                                  virTypedParameterPtr *params,
+                                  int *nparams,
+                                  unsigned int flags);
+
 int virAdmConnectGetLoggingOutputs(virAdmConnectPtr conn,
                                    char **outputs,
                                    unsigned int flags);
@@ -421,6 +602,36 @@ int virAdmConnectSetLoggingFilters(virAdmConnectPtr conn,
                                    const char *filters,
                                    unsigned int flags);
 
+int virAdmConnectGetLockStats(virAdmConnectPtr conn,
+                              virTypedParameterPtr *params,
+                              int *nparams,
+                              unsigned int flags);
+
+int virAdmConnectGetObjectStats(virAdmConnectPtr conn,
+                                virTypedParameterPtr *params,
+                                int *nparams,
+                                unsigned int flags);
+
+int virAdmConnectGetLogFileStats(virAdmConnectPtr conn,
+                                 virTypedParameterPtr *params,
+                                 int *nparams,
+                                 unsigned int flags);
+
+int virAdmConnectGetLeaseStats(virAdmConnectPtr conn,
+                               virTypedParameterPtr *params,
+                               int *nparams,
+                               unsigned int flags);
+
+int virAdmServerGetStats(virAdmServerPtr srv,
+                         virTypedParameterPtr *params,
+                         int *nparams,
+                         unsigned int flags);
+
+int virAdmConnectStartProfiler(virAdmConnectPtr conn,
+                               unsigned int duration,
+                               char **file,
+                               unsigned int flags);
+
 # ifdef __cplusplus
 }
 # endif
@@ -80,6 +80,12 @@ virDomainSnapshotPtr virDomainSnapshotCreateXML(virDomainPtr domain,
                                                 const char *xmlDesc,
                                                 unsigned int flags);
 
+/* Take snapshots of the current state of several VMs at once */
+int virDomainListSnapshotCreateXML(virDomainPtr *doms,
+                                   const char **xmlDescs,
+                                   virDomainSnapshotPtr **snaps,
+                                   unsigned int flags);
+
 typedef enum {
     VIR_DOMAIN_SNAPSHOT_XML_SECURE         = VIR_DOMAIN_XML_SECURE, /* dump security sensitive information too */
 } virDomainSnapshotXMLFlags;
@@ -981,6 +981,18 @@ typedef enum {
  */
 # define VIR_MIGRATE_PARAM_DISKS_PORT    "disks_port"
 
+/**
+ * VIR_MIGRATE_PARAM_DISKS_CONCURRENCY:
+ *
+ * virDomainMigrate* params field: the maximum number of disks copied at the
+ * same time during storage migration. As VIR_TYPED_PARAM_INT. Disks are
+ * started from the largest one and another disk is started whenever one of
+ * them finishes its initial copy. When set together with a bandwidth limit,
+ * the limit is shared by the disks copied at the same time rather than
+ * applied to each of them.
+ */
+# define VIR_MIGRATE_PARAM_DISKS_CONCURRENCY    "disks_concurrency"
+
 /**
  * VIR_MIGRATE_PARAM_COMPRESSION:
  *
@@ -1047,7 +1059,8 @@ typedef enum {
  * VIR_MIGRATE_PARAM_PARALLEL_CONNECTIONS:
  *
  * virDomainMigrate* params field: number of connections used during parallel
- * migration. As VIR_TYPED_PARAM_INT.
+ * migration. As VIR_TYPED_PARAM_INT. If omitted, the hypervisor driver may
+ * choose the number based on the host it runs on.
  */
 # define VIR_MIGRATE_PARAM_PARALLEL_CONNECTIONS     "parallel.connections"
 
@@ -1065,6 +1078,41 @@ typedef enum {
  */
 # define VIR_MIGRATE_PARAM_TLS_DESTINATION          "tls.destination"
 
+/**
+ * VIR_MIGRATE_PARAM_DOWNTIME_TARGET:
+ *
+ * virDomainMigrate* params field: the downtime in milliseconds the migration
+ * should be able to finish with. As VIR_TYPED_PARAM_ULLONG. When set, the
+ * hypervisor driver watches the progress of a live migration and whenever
+ * the projected downtime stays above the target it increases CPU throttling
+ * (with VIR_MIGRATE_AUTO_CONVERGE) or switches the migration to post-copy
+ * (with VIR_MIGRATE_POSTCOPY) once throttling cannot be raised any further.
+ */
+# define VIR_MIGRATE_PARAM_DOWNTIME_TARGET          "downtime.target"
+
+/**
+ * VIR_MIGRATE_PARAM_DOWNTIME_ITERATIONS:
+ *
+ * virDomainMigrate* params field: the number of consecutive memory
+ * iterations the projected downtime has to exceed
+ * VIR_MIGRATE_PARAM_DOWNTIME_TARGET before the hypervisor driver acts on
+ * it. As VIR_TYPED_PARAM_INT. Migrations which cannot converge at all are
+ * acted on right away.
+ */
+# define VIR_MIGRATE_PARAM_DOWNTIME_ITERATIONS      "downtime.iterations"
+
+/**
+ * VIR_MIGRATE_PARAM_PREALLOC_THREADS:
+ *
+ * virDomainMigrate* params field: the number of threads the hypervisor on
+ * the destination host uses for preallocating each block of guest memory
+ * which needs to be preallocated, e.g., memory backed by huge pages. As
+ * VIR_TYPED_PARAM_INT. If set to 0, the number is derived from the CPUs of
+ * the host NUMA nodes the memory is bound to. If omitted, the hypervisor
+ * default is used.
+ */
+# define VIR_MIGRATE_PARAM_PREALLOC_THREADS         "prealloc.threads"
+
 /* Domain migration. */
 virDomainPtr virDomainMigrate (virDomainPtr domain, virConnectPtr dconn,
                                unsigned long flags, const char *dname,
@@ -1299,6 +1347,14 @@ int                 virDomainCoreDumpWithFormat (virDomainPtr domain,
                                                  unsigned int dumpformat,
                                                  unsigned int flags);
 
+/*
+ * Domain core dump streamed to the client
+ */
+int                 virDomainCoreDumpStream     (virDomainPtr domain,
+                                                 virStreamPtr stream,
+                                                 unsigned int dumpformat,
+                                                 unsigned int flags);
+
 /*
  * Screenshot of current domain console
  */
@@ -1483,6 +1539,16 @@ int     virDomainGetBlkioParameters(virDomainPtr domain,
 
 # define VIR_DOMAIN_MEMORY_SWAP_HARD_LIMIT "swap_hard_limit"
 
+/**
+ * VIR_DOMAIN_MEMORY_SHARE_PAGES:
+ *
+ * Macro for the memory tunable share_pages: it represents whether the host
+ * may merge identical pages of guest memory (KSM), as a boolean. It is the
+ * opposite of <nosharepages/> in the domain XML.
+ */
+
+# define VIR_DOMAIN_MEMORY_SHARE_PAGES "share_pages"
+
 /* Set memory tunables for the domain */
 int     virDomainSetMemoryParameters(virDomainPtr domain,
                                      virTypedParameterPtr params,
@@ -2134,6 +2200,9 @@ typedef enum {
     /* Additionally, these flags may be bitwise-OR'd in.  */
     VIR_DOMAIN_DEVICE_MODIFY_FORCE = (1 << 2), /* Forcibly modify device
                                                   (ex. force eject a cdrom) */
+    VIR_DOMAIN_DEVICE_MODIFY_ASYNC = (1 << 3), /* Don't wait for the guest
+                                                  to release a detached
+                                                  device */
 } virDomainDeviceModifyFlags;
 
 int virDomainAttachDevice(virDomainPtr domain, const char *xml);
@@ -2141,6 +2210,10 @@ int virDomainDetachDevice(virDomainPtr domain, const char *xml);
 
 int virDomainAttachDeviceFlags(virDomainPtr domain,
                                const char *xml, unsigned int flags);
+int virDomainAttachDevices(virDomainPtr domain,
+                           const char **xmls,
+                           unsigned int nxmls,
+                           unsigned int flags);
 int virDomainDetachDeviceFlags(virDomainPtr domain,
                                const char *xml, unsigned int flags);
 int virDomainUpdateDeviceFlags(virDomainPtr domain,
@@ -2167,6 +2240,15 @@ typedef enum {
     VIR_DOMAIN_STATS_PERF = (1 << 6), /* return domain perf event info */
     VIR_DOMAIN_STATS_IOTHREAD = (1 << 7), /* return iothread poll info */
     VIR_DOMAIN_STATS_MEMORY = (1 << 8), /* return domain memory info */
+    VIR_DOMAIN_STATS_DIRTYRATE = (1 << 9), /* return domain dirty rate info */
+    VIR_DOMAIN_STATS_PRESSURE = (1 << 10), /* return domain pressure stall
+                                              information */
+    VIR_DOMAIN_STATS_NUMA = (1 << 11), /* return domain memory residency on
+                                          host NUMA nodes */
+    VIR_DOMAIN_STATS_MEMORY_HOST = (1 << 12), /* return host backing of domain
+                                                 memory */
+    VIR_DOMAIN_STATS_MONITOR = (1 << 13), /* return latency of hypervisor
+                                             monitor commands */
 } virDomainStatsTypes;
 
 typedef enum {
@@ -2181,6 +2263,8 @@ typedef enum {
     VIR_CONNECT_GET_ALL_DOMAINS_STATS_SHUTOFF = VIR_CONNECT_LIST_DOMAINS_SHUTOFF,
     VIR_CONNECT_GET_ALL_DOMAINS_STATS_OTHER = VIR_CONNECT_LIST_DOMAINS_OTHER,
 
+    VIR_CONNECT_GET_ALL_DOMAINS_STATS_CACHED = 1 << 28, /* allow statistics cached
+                                                           by the daemon */
     VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT = 1 << 29, /* report statistics that can be obtained
                                                            immediately without any blocking */
     VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING = 1 << 30, /* include backing chain for block stats */
@@ -2199,6 +2283,25 @@ int virDomainListGetStats(virDomainPtr *doms,
 
 void virDomainStatsRecordListFree(virDomainStatsRecordPtr *stats);
 
+typedef struct _virDomainXMLDescRecord virDomainXMLDescRecord;
+typedef virDomainXMLDescRecord *virDomainXMLDescRecordPtr;
+struct _virDomainXMLDescRecord {
+    virDomainPtr dom;
+    char *xml;
+};
+
+int virConnectGetAllDomainXMLDesc(virConnectPtr conn,
+                                  unsigned int xmlflags,
+                                  virDomainXMLDescRecordPtr **retDescs,
+                                  unsigned int flags);
+
+int virDomainListGetXMLDesc(virDomainPtr *doms,
+                            unsigned int xmlflags,
+                            virDomainXMLDescRecordPtr **retDescs,
+                            unsigned int flags);
+
+void virDomainXMLDescRecordListFree(virDomainXMLDescRecordPtr *descs);
+
 /*
  * Perf Event API
  */
@@ -2523,6 +2626,8 @@ int virDomainGetBlockJobInfo(virDomainPtr dom, const char *disk,
 typedef enum {
     VIR_DOMAIN_BLOCK_JOB_SPEED_BANDWIDTH_BYTES = 1 << 0, /* bandwidth in bytes/s
                                                             instead of MiB/s */
+    VIR_DOMAIN_BLOCK_JOB_SPEED_ADAPTIVE = 1 << 1, /* adapt the speed to guest
+                                                     I/O latency */
 } virDomainBlockJobSetSpeedFlags;
 
 int virDomainBlockJobSetSpeed(virDomainPtr dom, const char *disk,
@@ -3513,6 +3618,241 @@ typedef enum {
  */
 # define VIR_DOMAIN_JOB_MEMORY_POSTCOPY_REQS     "memory_postcopy_requests"
 
+/**
+ * VIR_DOMAIN_JOB_MEMORY_PARALLEL_CONNECTIONS:
+ *
+ * virDomainGetJobStats field: number of connections used for transferring
+ * memory during parallel migration (see VIR_MIGRATE_PARALLEL), as
+ * VIR_TYPED_PARAM_INT. Only reported when the number is known to libvirt.
+ */
+# define VIR_DOMAIN_JOB_MEMORY_PARALLEL_CONNECTIONS "memory_parallel_connections"
+
+/**
+ * VIR_DOMAIN_JOB_MEMORY_PARALLEL_BYTES:
+ *
+ * virDomainGetJobStats field: number of bytes transferred over all
+ * connections of a parallel migration, as VIR_TYPED_PARAM_ULLONG. Reported
+ * together with VIR_DOMAIN_JOB_MEMORY_PARALLEL_CONNECTIONS, which allows
+ * computing the average amount of data sent per connection.
+ */
+# define VIR_DOMAIN_JOB_MEMORY_PARALLEL_BYTES    "memory_parallel_bytes"
+
+/**
+ * VIR_DOMAIN_JOB_TUNNEL_RAW:
+ *
+ * virDomainGetJobStats field: number of bytes of the migration stream the
+ * hypervisor passed to the tunnel of a tunnelled migration, as
+ * VIR_TYPED_PARAM_ULLONG.
+ */
+# define VIR_DOMAIN_JOB_TUNNEL_RAW               "tunnel_raw"
+
+/**
+ * VIR_DOMAIN_JOB_TUNNEL_SENT:
+ *
+ * virDomainGetJobStats field: number of bytes the tunnel of a tunnelled
+ * migration sent to the destination, as VIR_TYPED_PARAM_ULLONG. It is
+ * smaller than VIR_DOMAIN_JOB_TUNNEL_RAW if the tunnel compresses data,
+ * the ratio of the two fields is the compression ratio.
+ */
+# define VIR_DOMAIN_JOB_TUNNEL_SENT              "tunnel_sent"
+
+/**
+ * VIR_DOMAIN_JOB_TUNNEL_BPS:
+ *
+ * virDomainGetJobStats field: effective throughput of the tunnel of a
+ * tunnelled migration in bytes per second, as VIR_TYPED_PARAM_ULLONG. This
+ * is the amount of VIR_DOMAIN_JOB_TUNNEL_RAW data per second of the job.
+ */
+# define VIR_DOMAIN_JOB_TUNNEL_BPS               "tunnel_bps"
+
+/**
+ * VIR_DOMAIN_JOB_LOCK_ACQUIRES:
+ *
+ * virDomainGetJobStats field: number of times the job asked the lock
+ * manager to acquire leases of the domain, as VIR_TYPED_PARAM_ULLONG.
+ */
+# define VIR_DOMAIN_JOB_LOCK_ACQUIRES            "lock_acquires"
+
+/**
+ * VIR_DOMAIN_JOB_LOCK_ACQUIRE_FAILED:
+ *
+ * virDomainGetJobStats field: number of lease acquisitions counted by
+ * VIR_DOMAIN_JOB_LOCK_ACQUIRES which failed, as VIR_TYPED_PARAM_ULLONG.
+ */
+# define VIR_DOMAIN_JOB_LOCK_ACQUIRE_FAILED      "lock_acquire_failed"
+
+/**
+ * VIR_DOMAIN_JOB_LOCK_ACQUIRE_BUSY:
+ *
+ * virDomainGetJobStats field: number of lease acquisitions counted by
+ * VIR_DOMAIN_JOB_LOCK_ACQUIRE_FAILED which failed because a lease was held
+ * by someone else, as VIR_TYPED_PARAM_ULLONG.
+ */
+# define VIR_DOMAIN_JOB_LOCK_ACQUIRE_BUSY        "lock_acquire_busy"
+
+/**
+ * VIR_DOMAIN_JOB_LOCK_ACQUIRE_TIME:
+ *
+ * virDomainGetJobStats field: time in microseconds the job spent waiting
+ * for the lock manager to acquire leases, as VIR_TYPED_PARAM_ULLONG.
+ */
+# define VIR_DOMAIN_JOB_LOCK_ACQUIRE_TIME        "lock_acquire_time"
+
+/**
+ * VIR_DOMAIN_JOB_LOCK_RELEASES:
+ *
+ * virDomainGetJobStats field: number of times the job asked the lock
+ * manager to release leases of the domain, as VIR_TYPED_PARAM_ULLONG.
+ */
+# define VIR_DOMAIN_JOB_LOCK_RELEASES            "lock_releases"
+
+/**
+ * VIR_DOMAIN_JOB_LOCK_RELEASE_TIME:
+ *
+ * virDomainGetJobStats field: time in microseconds the job spent waiting
+ * for the lock manager to release leases, as VIR_TYPED_PARAM_ULLONG.
+ */
+# define VIR_DOMAIN_JOB_LOCK_RELEASE_TIME        "lock_release_time"
+
+/**
+ * VIR_DOMAIN_JOB_START_TIME_INIT:
+ *
+ * virDomainGetJobStats field: time in microseconds the start of a domain
+ * spent initializing the domain object and its private data, as
+ * VIR_TYPED_PARAM_ULLONG. Only reported for completed jobs starting a
+ * domain.
+ */
+# define VIR_DOMAIN_JOB_START_TIME_INIT          "start_time_init"
+
+/**
+ * VIR_DOMAIN_JOB_START_TIME_PREPARE:
+ *
+ * virDomainGetJobStats field: time in microseconds the start of a domain
+ * spent preparing the domain definition, e.g. assigning aliases and PCI
+ * addresses, as VIR_TYPED_PARAM_ULLONG. Only reported for completed jobs
+ * starting a domain.
+ */
+# define VIR_DOMAIN_JOB_START_TIME_PREPARE       "start_time_prepare"
+
+/**
+ * VIR_DOMAIN_JOB_START_TIME_HOST:
+ *
+ * virDomainGetJobStats field: time in microseconds the start of a domain
+ * spent preparing the host, except for network and storage, as
+ * VIR_TYPED_PARAM_ULLONG. Only reported for completed jobs starting a
+ * domain.
+ */
+# define VIR_DOMAIN_JOB_START_TIME_HOST          "start_time_host"
+
+/**
+ * VIR_DOMAIN_JOB_START_TIME_NETWORK:
+ *
+ * virDomainGetJobStats field: time in microseconds the start of a domain
+ * spent preparing host network devices, as VIR_TYPED_PARAM_ULLONG. Only
+ * reported for completed jobs starting a domain.
+ */
+# define VIR_DOMAIN_JOB_START_TIME_NETWORK       "start_time_network"
+
+/**
+ * VIR_DOMAIN_JOB_START_TIME_STORAGE:
+ *
+ * virDomainGetJobStats field: time in microseconds the start of a domain
+ * spent preparing host storage, e.g. opening disks and their backing
+ * chains, as VIR_TYPED_PARAM_ULLONG. Only reported for completed jobs
+ * starting a domain.
+ */
+# define VIR_DOMAIN_JOB_START_TIME_STORAGE       "start_time_storage"
+
+/**
+ * VIR_DOMAIN_JOB_START_TIME_EXT_DEVICES:
+ *
+ * virDomainGetJobStats field: time in microseconds the start of a domain
+ * spent starting external device helpers, e.g. swtpm or virtiofsd, as
+ * VIR_TYPED_PARAM_ULLONG. Only reported for completed jobs starting a
+ * domain.
+ */
+# define VIR_DOMAIN_JOB_START_TIME_EXT_DEVICES   "start_time_ext_devices"
+
+/**
+ * VIR_DOMAIN_JOB_START_TIME_CMDLINE:
+ *
+ * virDomainGetJobStats field: time in microseconds the start of a domain
+ * spent building the QEMU command line, including creating tap devices, as
+ * VIR_TYPED_PARAM_ULLONG. Only reported for completed jobs starting a
+ * domain.
+ */
+# define VIR_DOMAIN_JOB_START_TIME_CMDLINE       "start_time_cmdline"
+
+/**
+ * VIR_DOMAIN_JOB_START_TIME_EXEC:
+ *
+ * virDomainGetJobStats field: time in microseconds the start of a domain
+ * spent running the QEMU binary until it is ready to be configured, as
+ * VIR_TYPED_PARAM_ULLONG. Only reported for completed jobs starting a
+ * domain.
+ */
+# define VIR_DOMAIN_JOB_START_TIME_EXEC          "start_time_exec"
+
+/**
+ * VIR_DOMAIN_JOB_START_TIME_CGROUP:
+ *
+ * virDomainGetJobStats field: time in microseconds the start of a domain
+ * spent placing the QEMU process into cgroups and namespaces, as
+ * VIR_TYPED_PARAM_ULLONG. Only reported for completed jobs starting a
+ * domain.
+ */
+# define VIR_DOMAIN_JOB_START_TIME_CGROUP        "start_time_cgroup"
+
+/**
+ * VIR_DOMAIN_JOB_START_TIME_SECURITY:
+ *
+ * virDomainGetJobStats field: time in microseconds the start of a domain
+ * spent labelling resources of the domain by security drivers, as
+ * VIR_TYPED_PARAM_ULLONG. Only reported for completed jobs starting a
+ * domain.
+ */
+# define VIR_DOMAIN_JOB_START_TIME_SECURITY      "start_time_security"
+
+/**
+ * VIR_DOMAIN_JOB_START_TIME_MONITOR:
+ *
+ * virDomainGetJobStats field: time in microseconds the start of a domain
+ * spent connecting to the QEMU monitor and guest agent, as
+ * VIR_TYPED_PARAM_ULLONG. Only reported for completed jobs starting a
+ * domain.
+ */
+# define VIR_DOMAIN_JOB_START_TIME_MONITOR       "start_time_monitor"
+
+/**
+ * VIR_DOMAIN_JOB_START_TIME_PREALLOC:
+ *
+ * virDomainGetJobStats field: time in microseconds the start of a domain
+ * spent waiting for QEMU to preallocate guest memory before it answered
+ * on its monitor, as VIR_TYPED_PARAM_ULLONG. Only reported for completed
+ * jobs starting a domain with preallocated memory.
+ */
+# define VIR_DOMAIN_JOB_START_TIME_PREALLOC      "start_time_prealloc"
+
+/**
+ * VIR_DOMAIN_JOB_START_TIME_QMP_INIT:
+ *
+ * virDomainGetJobStats field: time in microseconds the start of a domain
+ * spent configuring the domain through the QEMU monitor, as
+ * VIR_TYPED_PARAM_ULLONG. Only reported for completed jobs starting a
+ * domain.
+ */
+# define VIR_DOMAIN_JOB_START_TIME_QMP_INIT      "start_time_qmp_init"
+
+/**
+ * VIR_DOMAIN_JOB_START_TIME_FINISH:
+ *
+ * virDomainGetJobStats field: time in microseconds the start of a domain
+ * spent finishing the start, e.g. resuming vCPUs, as
+ * VIR_TYPED_PARAM_ULLONG. Only reported for completed jobs starting a
+ * domain.
+ */
+# define VIR_DOMAIN_JOB_START_TIME_FINISH        "start_time_finish"
+
 /**
  * VIR_DOMAIN_JOB_DISK_TOTAL:
  *
@@ -3551,6 +3891,49 @@ typedef enum {
  */
 # define VIR_DOMAIN_JOB_DISK_BPS                 "disk_bps"
 
+/**
+ * VIR_DOMAIN_JOB_MIRROR_COUNT:
+ *
+ * virDomainGetJobStats field: number of disks copied by storage migration
+ * for which per-disk progress is reported, as VIR_TYPED_PARAM_UINT. Progress
+ * of each disk is reported in fields composed of VIR_DOMAIN_JOB_MIRROR_PREFIX,
+ * the index of the disk (starting from 0), and one of the
+ * VIR_DOMAIN_JOB_MIRROR_SUFFIX_* suffixes, e.g., "mirror.0.processed".
+ */
+# define VIR_DOMAIN_JOB_MIRROR_COUNT             "mirror.count"
+
+/**
+ * VIR_DOMAIN_JOB_MIRROR_PREFIX:
+ *
+ * Prefix of virDomainGetJobStats fields reporting progress of a single disk
+ * copied by storage migration.
+ */
+# define VIR_DOMAIN_JOB_MIRROR_PREFIX            "mirror."
+
+/**
+ * VIR_DOMAIN_JOB_MIRROR_SUFFIX_NAME:
+ *
+ * Suffix of the virDomainGetJobStats field containing the target name of
+ * the disk, as VIR_TYPED_PARAM_STRING.
+ */
+# define VIR_DOMAIN_JOB_MIRROR_SUFFIX_NAME       ".name"
+
+/**
+ * VIR_DOMAIN_JOB_MIRROR_SUFFIX_TOTAL:
+ *
+ * Suffix of the virDomainGetJobStats field containing the number of bytes
+ * which need to be copied for the disk, as VIR_TYPED_PARAM_ULLONG.
+ */
+# define VIR_DOMAIN_JOB_MIRROR_SUFFIX_TOTAL      ".total"
+
+/**
+ * VIR_DOMAIN_JOB_MIRROR_SUFFIX_PROCESSED:
+ *
+ * Suffix of the virDomainGetJobStats field containing the number of bytes
+ * already copied for the disk, as VIR_TYPED_PARAM_ULLONG.
+ */
+# define VIR_DOMAIN_JOB_MIRROR_SUFFIX_PROCESSED  ".processed"
+
 /**
  * VIR_DOMAIN_JOB_COMPRESSION_CACHE:
  *
@@ -4455,6 +4838,14 @@ typedef void (*virConnectDomainEventJobCompletedCallback)(virConnectPtr conn,
  */
 # define VIR_DOMAIN_TUNABLE_BLKDEV_WRITE_IOPS_SEC_MAX_LENGTH "blkdeviotune.write_iops_sec_max_length"
 
+/**
+ * VIR_DOMAIN_TUNABLE_NUMA_MEMORY_NODESET:
+ *
+ * Macro represents the host NUMA nodes the memory of the domain may be
+ * allocated from, as VIR_TYPED_PARAM_STRING.
+ */
+# define VIR_DOMAIN_TUNABLE_NUMA_MEMORY_NODESET "numatune.memory_nodeset"
+
 /**
  * virConnectDomainEventTunableCallback:
  * @conn: connection object
@@ -4551,6 +4942,31 @@ typedef void (*virConnectDomainEventBlockThresholdCallback)(virConnectPtr conn,
                                                             unsigned long long excess,
                                                             void *opaque);
 
+
+/**
+ * virConnectDomainEventMonitorSlowCallback:
+ * @conn: connection object
+ * @dom: domain on which the event occurred
+ * @command: name of the monitor command
+ * @elapsed: time in milliseconds the command has been waiting so far
+ * @opaque: application specified data
+ *
+ * The callback occurs when a command sent to the hypervisor monitor of the
+ * domain did not get its reply within the threshold configured on the
+ * host. The command is still running when the event is emitted and the
+ * event is emitted at most once per command. Slow monitor commands usually
+ * mean the hypervisor is stuck, e.g. on I/O, and jobs on the domain are
+ * likely to time out.
+ *
+ * The callback signature to use when registering for an event of type
+ * VIR_DOMAIN_EVENT_ID_MONITOR_SLOW with virConnectDomainEventRegisterAny()
+ */
+typedef void (*virConnectDomainEventMonitorSlowCallback)(virConnectPtr conn,
+                                                         virDomainPtr dom,
+                                                         const char *command,
+                                                         unsigned long long elapsed,
+                                                         void *opaque);
+
 /**
  * VIR_DOMAIN_EVENT_CALLBACK:
  *
@@ -4593,6 +5009,7 @@ typedef enum {
     VIR_DOMAIN_EVENT_ID_DEVICE_REMOVAL_FAILED = 22, /* virConnectDomainEventDeviceRemovalFailedCallback */
     VIR_DOMAIN_EVENT_ID_METADATA_CHANGE = 23, /* virConnectDomainEventMetadataChangeCallback */
     VIR_DOMAIN_EVENT_ID_BLOCK_THRESHOLD = 24, /* virConnectDomainEventBlockThresholdCallback */
+    VIR_DOMAIN_EVENT_ID_MONITOR_SLOW = 25,  /* virConnectDomainEventMonitorSlowCallback */
 
 # ifdef VIR_ENUM_SENTINELS
     VIR_DOMAIN_EVENT_ID_LAST
@@ -4682,6 +5099,57 @@ int virDomainFSThaw(virDomainPtr dom,
                     unsigned int nmountpoints,
                     unsigned int flags);
 
+typedef struct _virDomainFSFreezeRecord virDomainFSFreezeRecord;
+typedef virDomainFSFreezeRecord *virDomainFSFreezeRecordPtr;
+struct _virDomainFSFreezeRecord {
+    virDomainPtr dom;
+    int nfilesystems; /* number of frozen or thawed file systems,
+                         -1 if the operation failed */
+    char *error; /* description of the failure if @nfilesystems is -1 */
+};
+
+int virDomainListFSFreeze(virDomainPtr *doms,
+                          int timeout,
+                          virDomainFSFreezeRecordPtr **retResults,
+                          unsigned int flags);
+
+int virDomainListFSThaw(virDomainPtr *doms,
+                        int timeout,
+                        virDomainFSFreezeRecordPtr **retResults,
+                        unsigned int flags);
+
+void virDomainFSFreezeRecordListFree(virDomainFSFreezeRecordPtr *results);
+
+/**
+ * virDomainListStopFlags:
+ *
+ * Flags for virDomainListStop(). Without any of the
+ * VIR_DOMAIN_LIST_STOP_MANAGED_SAVE and VIR_DOMAIN_LIST_STOP_SUSPEND
+ * flags the domains are shut down.
+ */
+typedef enum {
+    VIR_DOMAIN_LIST_STOP_MANAGED_SAVE = (1 << 0), /* managed save the domains */
+    VIR_DOMAIN_LIST_STOP_SUSPEND      = (1 << 1), /* suspend the domains */
+    VIR_DOMAIN_LIST_STOP_BYPASS_CACHE = (1 << 2), /* avoid file system cache
+                                                     pollution when saving */
+} virDomainListStopFlags;
+
+typedef struct _virDomainStopRecord virDomainStopRecord;
+typedef virDomainStopRecord *virDomainStopRecordPtr;
+struct _virDomainStopRecord {
+    virDomainPtr dom;
+    int result; /* 0 if the domain was stopped, -1 if the operation failed */
+    char *error; /* description of the failure if @result is -1 */
+};
+
+int virDomainListStop(virDomainPtr *doms,
+                      unsigned int parallel,
+                      int timeout,
+                      virDomainStopRecordPtr **retResults,
+                      unsigned int flags);
+
+void virDomainStopRecordListFree(virDomainStopRecordPtr *results);
+
 /**
  * virDomainFSInfo:
  *
@@ -4999,4 +5467,26 @@ int virDomainBackupBegin(virDomainPtr domain,
 char *virDomainBackupGetXMLDesc(virDomainPtr domain,
                                 unsigned int flags);
 
+/**
+ * virDomainDirtyRateStatus:
+ *
+ * Details on the cause of a dirty rate calculation status.
+ */
+typedef enum {
+    VIR_DOMAIN_DIRTYRATE_UNSTARTED = 0, /* the dirtyrate calculation has
+                                           not been started */
+    VIR_DOMAIN_DIRTYRATE_MEASURING = 1, /* the dirtyrate calculation is
+                                           measuring */
+    VIR_DOMAIN_DIRTYRATE_MEASURED = 2, /* the dirtyrate calculation is
+                                          completed */
+
+# ifdef VIR_ENUM_SENTINELS
+    VIR_DOMAIN_DIRTYRATE_LAST
+# endif
+} virDomainDirtyRateStatus;
+
+int virDomainStartDirtyRateCalc(virDomainPtr domain,
+                                int seconds,
+                                unsigned int flags);
+
 #endif /* LIBVIRT_DOMAIN_H */
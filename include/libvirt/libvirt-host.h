@@ -820,5 +820,38 @@ int virNodeAllocPages(virConnectPtr conn,
                       unsigned int cellCount,
                       unsigned int flags);
 
+/**
+ * VIR_NODE_PAGES_LAYOUT_COUNT:
+ *
+ * Number of pages of one size in the pool of one host NUMA node, as
+ * VIR_TYPED_PARAM_ULLONG. The field name is formatted with the NUMA node
+ * and the page size in KiB, e.g. "cell.0.page.2048.count".
+ */
+# define VIR_NODE_PAGES_LAYOUT_COUNT "cell.%u.page.%u.count"
+
+typedef enum {
+    VIR_NODE_SET_PAGES_LAYOUT_STRICT = (1 << 0), /* Fail unless all the pools
+                                                    were resized as requested */
+} virNodeSetPagesLayoutFlags;
+
+int virNodeSetPagesLayout(virConnectPtr conn,
+                          virTypedParameterPtr params,
+                          int nparams,
+                          virTypedParameterPtr *result,
+                          int *nresult,
+                          unsigned int flags);
+
+typedef enum {
+    VIR_NODE_GET_ALL_CPU_STATS_FREQUENCY = (1 << 0), /* Report the current
+                                                        frequency of each CPU */
+    VIR_NODE_GET_ALL_CPU_STATS_IDLE_STATES = (1 << 1), /* Report the time spent
+                                                          in each idle state */
+} virNodeGetAllCPUStatsFlags;
+
+int virNodeGetAllCPUStats(virConnectPtr conn,
+                          virTypedParameterPtr *params,
+                          int *nparams,
+                          unsigned int flags);
+
 
 #endif /* LIBVIRT_HOST_H */
@@ -86,6 +86,11 @@ typedef enum {
     VIR_STORAGE_POOL_CREATE_WITH_BUILD_NO_OVERWRITE = 1 << 2,
 } virStoragePoolCreateFlags;
 
+typedef enum {
+    /* Only probe volumes which changed since the previous refresh */
+    VIR_STORAGE_POOL_REFRESH_INCREMENTAL = 1 << 0,
+} virStoragePoolRefreshFlags;
+
 typedef struct _virStoragePoolInfo virStoragePoolInfo;
 
 struct _virStoragePoolInfo {
@@ -132,6 +137,7 @@ typedef enum {
     VIR_STORAGE_VOL_DELETE_NORMAL = 0, /* Delete metadata only    (fast) */
     VIR_STORAGE_VOL_DELETE_ZEROED = 1 << 0,  /* Clear all data to zeros (slow) */
     VIR_STORAGE_VOL_DELETE_WITH_SNAPSHOTS = 1 << 1, /* Force removal of volume, even if in use */
+    VIR_STORAGE_VOL_DELETE_ASYNC = 1 << 2, /* return once the job started */
 } virStorageVolDeleteFlags;
 
 typedef enum {
@@ -184,6 +190,33 @@ struct _virStorageVolInfo {
 
 typedef virStorageVolInfo *virStorageVolInfoPtr;
 
+/**
+ * virStorageVolJobType:
+ *
+ * Long running operation on a storage volume
+ */
+typedef enum {
+    VIR_STORAGE_VOL_JOB_NONE = 0,   /* No job is active */
+    VIR_STORAGE_VOL_JOB_CREATE = 1, /* Volume is being allocated */
+    VIR_STORAGE_VOL_JOB_CLONE = 2,  /* Volume is being copied from another */
+    VIR_STORAGE_VOL_JOB_WIPE = 3,   /* Volume is being wiped */
+    VIR_STORAGE_VOL_JOB_DELETE = 4, /* Volume is being deleted */
+
+# ifdef VIR_ENUM_SENTINELS
+    VIR_STORAGE_VOL_JOB_LAST
+# endif
+} virStorageVolJobType;
+
+typedef struct _virStorageVolJobInfo virStorageVolJobInfo;
+
+struct _virStorageVolJobInfo {
+    int type;                      /* virStorageVolJobType */
+    unsigned long long total;      /* Bytes the job has to process */
+    unsigned long long done;       /* Bytes processed so far */
+};
+
+typedef virStorageVolJobInfo *virStorageVolJobInfoPtr;
+
 typedef enum {
     VIR_STORAGE_XML_INACTIVE    = (1 << 0), /* dump inactive pool/volume information */
 } virStorageXMLFlags;
@@ -343,6 +376,9 @@ const char*             virStorageVolGetKey             (virStorageVolPtr vol);
 typedef enum {
     VIR_STORAGE_VOL_CREATE_PREALLOC_METADATA = 1 << 0,
     VIR_STORAGE_VOL_CREATE_REFLINK = 1 << 1, /* perform a btrfs lightweight copy */
+    VIR_STORAGE_VOL_CREATE_ASYNC = 1 << 2, /* return once the job started */
+    VIR_STORAGE_VOL_CREATE_FLATTEN = 1 << 3, /* detach a copy-on-write clone
+                                                from its parent */
 } virStorageVolCreateFlags;
 
 virStorageVolPtr        virStorageVolCreateXML          (virStoragePoolPtr pool,
@@ -373,6 +409,10 @@ int                     virStorageVolUpload             (virStorageVolPtr vol,
                                                          unsigned int flags);
 int                     virStorageVolDelete             (virStorageVolPtr vol,
                                                          unsigned int flags);
+typedef enum {
+    VIR_STORAGE_VOL_WIPE_ASYNC = 1 << 0, /* return once the job started */
+} virStorageVolWipeFlags;
+
 int                     virStorageVolWipe               (virStorageVolPtr vol,
                                                          unsigned int flags);
 int                     virStorageVolWipePattern        (virStorageVolPtr vol,
@@ -389,6 +429,12 @@ int                     virStorageVolGetInfoFlags       (virStorageVolPtr vol,
 char *                  virStorageVolGetXMLDesc         (virStorageVolPtr pool,
                                                          unsigned int flags);
 
+int                     virStorageVolGetJobInfo         (virStorageVolPtr vol,
+                                                         virStorageVolJobInfoPtr info,
+                                                         unsigned int flags);
+int                     virStorageVolAbortJob           (virStorageVolPtr vol,
+                                                         unsigned int flags);
+
 char *                  virStorageVolGetPath            (virStorageVolPtr vol);
 
 typedef enum {
@@ -422,6 +468,7 @@ int virStoragePoolIsPersistent(virStoragePoolPtr pool);
 typedef enum {
     VIR_STORAGE_POOL_EVENT_ID_LIFECYCLE = 0, /* virConnectStoragePoolEventLifecycleCallback */
     VIR_STORAGE_POOL_EVENT_ID_REFRESH = 1, /* virConnectStoragePoolEventGenericCallback */
+    VIR_STORAGE_POOL_EVENT_ID_THRESHOLD = 2, /* virConnectStoragePoolEventThresholdCallback */
 
 # ifdef VIR_ENUM_SENTINELS
     VIR_STORAGE_POOL_EVENT_ID_LAST
@@ -500,4 +547,30 @@ typedef void (*virConnectStoragePoolEventLifecycleCallback)(virConnectPtr conn,
                                                             int detail,
                                                             void *opaque);
 
+/**
+ * virConnectStoragePoolEventThresholdCallback:
+ * @conn: connection object
+ * @pool: pool on which the event occurred
+ * @volume: name of the volume which crossed its watermark, or NULL if
+ *          the event concerns the whole pool
+ * @threshold: the watermark in bytes
+ * @excess: number of bytes allocated beyond @threshold
+ * @opaque: application specified data
+ *
+ * This callback is called when the allocation of a pool or of one of
+ * its volumes crosses the watermark configured by the <watermark>
+ * element of the pool XML. The event fires once per crossing; it is
+ * re-armed when the allocation drops below the watermark again.
+ *
+ * The callback signature to use when registering for an event of type
+ * VIR_STORAGE_POOL_EVENT_ID_THRESHOLD with
+ * virConnectStoragePoolEventRegisterAny()
+ */
+typedef void (*virConnectStoragePoolEventThresholdCallback)(virConnectPtr conn,
+                                                            virStoragePoolPtr pool,
+                                                            const char *volume,
+                                                            unsigned long long threshold,
+                                                            unsigned long long excess,
+                                                            void *opaque);
+
 #endif /* LIBVIRT_STORAGE_H */
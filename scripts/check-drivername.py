@@ -74,6 +74,7 @@ for drvfile in drvfiles:
                     "virDrvDomainMigrateFinish3",
                     "virDrvDomainMigrateFinish3Params",
                     "virDrvStreamInData",
+                    "virDrvConnectSecretGetValues",
                 ]
                 if drv in skip:
                     continue
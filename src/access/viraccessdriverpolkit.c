@@ -22,12 +22,18 @@
 
 #include "viraccessdriverpolkit.h"
 #include "viralloc.h"
+#include "virbuffer.h"
 #include "vircommand.h"
+#include "virdbus.h"
+#include "virhash.h"
 #include "virlog.h"
 #include "virprocess.h"
 #include "virerror.h"
 #include "virpolkit.h"
+#include "virstatsprovider.h"
 #include "virstring.h"
+#include "virthread.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_ACCESS
 
@@ -39,16 +45,181 @@ VIR_LOG_INIT("access.accessdriverpolkit");
 
 #define VIR_ACCESS_DRIVER_POLKIT_ACTION_PREFIX "org.libvirt.api"
 
+#define VIR_ACCESS_DRIVER_POLKIT_AUTHORITY "org.freedesktop.PolicyKit1"
+#define VIR_ACCESS_DRIVER_POLKIT_AUTHORITY_INTERFACE \
+    "org.freedesktop.PolicyKit1.Authority"
+
+/* Decisions of polkitd are reused for this many milliseconds unless
+ * polkitd announces a change of its policy sooner */
+#define VIR_ACCESS_DRIVER_POLKIT_CACHE_TTL (5 * 1000)
+
+/* The cache is flushed whenever it grows past this many decisions */
+#define VIR_ACCESS_DRIVER_POLKIT_CACHE_MAX 16384
+
 typedef struct _virAccessDriverPolkitPrivate virAccessDriverPolkitPrivate;
 typedef virAccessDriverPolkitPrivate *virAccessDriverPolkitPrivatePtr;
 
 struct _virAccessDriverPolkitPrivate {
     bool ignore;
+
+    /* Decisions keyed by the caller, action and object attributes. The
+     * cache is only used while polkitd's Changed signal is watched. */
+    virMutex lock;
+    virHashTablePtr cache;
+    bool watching;
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long flushes;
+};
+
+typedef struct _virAccessDriverPolkitDecision virAccessDriverPolkitDecision;
+typedef virAccessDriverPolkitDecision *virAccessDriverPolkitDecisionPtr;
+struct _virAccessDriverPolkitDecision {
+    bool allowed;
+    unsigned long long expires;
 };
 
 
-static void virAccessDriverPolkitCleanup(virAccessManagerPtr manager G_GNUC_UNUSED)
+static void
+virAccessDriverPolkitCacheFlush(virAccessDriverPolkitPrivatePtr priv)
+{
+    virMutexLock(&priv->lock);
+    if (virHashSize(priv->cache) > 0) {
+        virHashRemoveAll(priv->cache);
+        priv->flushes++;
+    }
+    virMutexUnlock(&priv->lock);
+}
+
+
+static DBusHandlerResult
+virAccessDriverPolkitDBusFilter(DBusConnection *connection G_GNUC_UNUSED,
+                                DBusMessage *message,
+                                void *opaque)
 {
+    virAccessManagerPtr manager = opaque;
+    virAccessDriverPolkitPrivatePtr priv = virAccessManagerGetPrivateData(manager);
+
+    if (dbus_message_is_signal(message,
+                               VIR_ACCESS_DRIVER_POLKIT_AUTHORITY_INTERFACE,
+                               "Changed")) {
+        VIR_DEBUG("polkit authority changed, flushing decision cache");
+        virAccessDriverPolkitCacheFlush(priv);
+    } else if (dbus_message_is_signal(message,
+                                      DBUS_INTERFACE_DBUS,
+                                      "NameOwnerChanged")) {
+        g_autofree char *name = NULL;
+        g_autofree char *oldOwner = NULL;
+        g_autofree char *newOwner = NULL;
+
+        if (virDBusMessageDecode(message, "sss",
+                                 &name, &oldOwner, &newOwner) < 0) {
+            VIR_WARN("Failed to decode DBus NameOwnerChanged message");
+            virResetLastError();
+        } else if (STREQ_NULLABLE(name, VIR_ACCESS_DRIVER_POLKIT_AUTHORITY)) {
+            VIR_DEBUG("polkit authority restarted, flushing decision cache");
+            virAccessDriverPolkitCacheFlush(priv);
+        }
+    }
+
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+
+static int
+virAccessDriverPolkitGetStats(virTypedParamListPtr params,
+                              const char *prefix,
+                              void *opaque)
+{
+    virAccessManagerPtr manager = opaque;
+    virAccessDriverPolkitPrivatePtr priv = virAccessManagerGetPrivateData(manager);
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long flushes;
+    size_t size;
+
+    virMutexLock(&priv->lock);
+    hits = priv->hits;
+    misses = priv->misses;
+    flushes = priv->flushes;
+    size = virHashSize(priv->cache);
+    virMutexUnlock(&priv->lock);
+
+    if (virTypedParamListAddULLong(params, hits,
+                                   "%scache.hits", prefix) < 0 ||
+        virTypedParamListAddULLong(params, misses,
+                                   "%scache.misses", prefix) < 0 ||
+        virTypedParamListAddULLong(params, flushes,
+                                   "%scache.flushes", prefix) < 0 ||
+        virTypedParamListAddULLong(params, size,
+                                   "%scache.size", prefix) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+virAccessDriverPolkitSetup(virAccessManagerPtr manager)
+{
+    virAccessDriverPolkitPrivatePtr priv = virAccessManagerGetPrivateData(manager);
+    DBusConnection *sysbus;
+
+    if (virMutexInit(&priv->lock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot initialize mutex"));
+        return -1;
+    }
+
+    priv->cache = virHashNew(g_free);
+
+    /* Without notifications about policy changes cached decisions could
+     * outlive a change for the whole TTL, so don't cache at all then */
+    if (!(sysbus = virDBusGetSystemBus())) {
+        VIR_WARN("DBus not available, disabling polkit decision cache: %s",
+                 virGetLastErrorMessage());
+        virResetLastError();
+    } else {
+        dbus_bus_add_match(sysbus,
+                           "type='signal'"
+                           ",interface='"VIR_ACCESS_DRIVER_POLKIT_AUTHORITY_INTERFACE"'"
+                           ",member='Changed'",
+                           NULL);
+        dbus_bus_add_match(sysbus,
+                           "type='signal'"
+                           ",interface='"DBUS_INTERFACE_DBUS"'"
+                           ",member='NameOwnerChanged'"
+                           ",arg0='"VIR_ACCESS_DRIVER_POLKIT_AUTHORITY"'",
+                           NULL);
+        if (dbus_connection_add_filter(sysbus, virAccessDriverPolkitDBusFilter,
+                                       manager, NULL))
+            priv->watching = true;
+    }
+
+    virStatsProviderRegister("polkit", virAccessDriverPolkitGetStats, manager);
+
+    return 0;
+}
+
+
+static void virAccessDriverPolkitCleanup(virAccessManagerPtr manager)
+{
+    virAccessDriverPolkitPrivatePtr priv = virAccessManagerGetPrivateData(manager);
+    DBusConnection *sysbus;
+
+    /* setup failed before the cache was created */
+    if (!priv->cache)
+        return;
+
+    virStatsProviderUnregister("polkit");
+
+    if (priv->watching &&
+        (sysbus = virDBusGetSystemBus()))
+        dbus_connection_remove_filter(sysbus, virAccessDriverPolkitDBusFilter,
+                                      manager);
+
+    virHashFree(priv->cache);
+    virMutexDestroy(&priv->lock);
 }
 
 
@@ -117,16 +288,92 @@ virAccessDriverPolkitGetCaller(const char *actionid,
 }
 
 
+static char *
+virAccessDriverPolkitCacheKey(const char *actionid,
+                              pid_t pid,
+                              unsigned long long startTime,
+                              uid_t uid,
+                              const char **attrs)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    size_t i;
+
+    virBufferAsprintf(&buf, "%lld:%llu:%d\n%s",
+                      (long long)pid, startTime, (int)uid, actionid);
+
+    for (i = 0; attrs[i]; i += 2)
+        virBufferAsprintf(&buf, "\n%s=%s", attrs[i], NULLSTR(attrs[i + 1]));
+
+    return virBufferContentAndReset(&buf);
+}
+
+
+/* Returns 1 if allowed, 0 if denied and -1 on a cache miss */
+static int
+virAccessDriverPolkitCacheLookup(virAccessDriverPolkitPrivatePtr priv,
+                                 const char *key,
+                                 unsigned long long now)
+{
+    virAccessDriverPolkitDecisionPtr decision;
+    int ret = -1;
+
+    virMutexLock(&priv->lock);
+    if ((decision = virHashLookup(priv->cache, key))) {
+        if (decision->expires > now) {
+            ret = decision->allowed ? 1 : 0;
+        } else {
+            virHashRemoveEntry(priv->cache, key);
+        }
+    }
+
+    if (ret < 0)
+        priv->misses++;
+    else
+        priv->hits++;
+    virMutexUnlock(&priv->lock);
+
+    return ret;
+}
+
+
+static void
+virAccessDriverPolkitCacheStore(virAccessDriverPolkitPrivatePtr priv,
+                                const char *key,
+                                bool allowed,
+                                unsigned long long now)
+{
+    virAccessDriverPolkitDecisionPtr decision = g_new0(virAccessDriverPolkitDecision, 1);
+
+    decision->allowed = allowed;
+    decision->expires = now + VIR_ACCESS_DRIVER_POLKIT_CACHE_TTL;
+
+    virMutexLock(&priv->lock);
+    if (virHashSize(priv->cache) >= VIR_ACCESS_DRIVER_POLKIT_CACHE_MAX) {
+        virHashRemoveAll(priv->cache);
+        priv->flushes++;
+    }
+
+    if (virHashUpdateEntry(priv->cache, key, decision) < 0) {
+        virResetLastError();
+        g_free(decision);
+    }
+    virMutexUnlock(&priv->lock);
+}
+
+
 static int
-virAccessDriverPolkitCheck(virAccessManagerPtr manager G_GNUC_UNUSED,
+virAccessDriverPolkitCheck(virAccessManagerPtr manager,
                            const char *typename,
                            const char *permname,
                            const char **attrs)
 {
+    virAccessDriverPolkitPrivatePtr priv = virAccessManagerGetPrivateData(manager);
     g_autofree char *actionid = NULL;
+    g_autofree char *key = NULL;
     pid_t pid;
     uid_t uid;
     unsigned long long startTime;
+    unsigned long long now = 0;
     int rv;
 
     if (!(actionid = virAccessDriverPolkitFormatAction(typename, permname)))
@@ -138,6 +385,21 @@ virAccessDriverPolkitCheck(virAccessManagerPtr manager G_GNUC_UNUSED,
                                        &uid) < 0)
         return -1;
 
+    if (priv->watching && virTimeMillisNow(&now) == 0) {
+        key = virAccessDriverPolkitCacheKey(actionid, pid, startTime,
+                                            uid, attrs);
+
+        switch (virAccessDriverPolkitCacheLookup(priv, key, now)) {
+        case 1:
+            return 1;
+        case 0:
+            virReportErrorHelper(VIR_FROM_POLKIT, VIR_ERR_AUTH_FAILED,
+                                 __FILE__, __FUNCTION__, __LINE__,
+                                 "%s", _("access denied by policy"));
+            return 0;
+        }
+    }
+
     VIR_DEBUG("Check action '%s' for process '%lld' time %lld uid %d",
               actionid, (long long)pid, startTime, uid);
 
@@ -149,9 +411,15 @@ virAccessDriverPolkitCheck(virAccessManagerPtr manager G_GNUC_UNUSED,
                             false);
 
     if (rv == 0) {
+        if (key)
+            virAccessDriverPolkitCacheStore(priv, key, true, now);
         return 1; /* Allowed */
     } else {
         if (rv == -2) {
+            /* Only plain denials are cached, the outcome of a challenge
+             * depends on whether the client authenticated meanwhile */
+            if (key && virGetLastErrorCode() == VIR_ERR_AUTH_FAILED)
+                virAccessDriverPolkitCacheStore(priv, key, false, now);
             return 0; /* Denied */
         } else {
             return -1; /* Error */
@@ -447,6 +715,7 @@ virAccessDriverPolkitCheckStorageVol(virAccessManagerPtr manager,
 virAccessDriver accessDriverPolkit = {
     .privateDataLen = sizeof(virAccessDriverPolkitPrivate),
     .name = "polkit",
+    .setup = virAccessDriverPolkitSetup,
     .cleanup = virAccessDriverPolkitCleanup,
     .checkConnect = virAccessDriverPolkitCheckConnect,
     .checkDomain = virAccessDriverPolkitCheckDomain,
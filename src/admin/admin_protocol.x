@@ -46,6 +46,24 @@ const ADMIN_CLIENT_INFO_PARAMETERS_MAX = 64;
 /* Upper limit on number of client processing controls */
 const ADMIN_SERVER_CLIENT_LIMITS_MAX = 32;
 
+/* Upper limit on number of procedure statistics parameters */
+const ADMIN_SERVER_PROCEDURE_STATS_MAX = 65536;
+
+/* Upper limit on number of lock statistics parameters */
+const ADMIN_CONNECT_LOCK_STATS_MAX = 65536;
+
+/* Upper limit on number of object statistics parameters */
+const ADMIN_CONNECT_OBJECT_STATS_MAX = 16384;
+
+/* Upper limit on number of log file statistics parameters */
+const ADMIN_CONNECT_LOG_FILE_STATS_MAX = 65536;
+
+/* Upper limit on number of lease statistics parameters */
+const ADMIN_CONNECT_LEASE_STATS_MAX = 1024;
+
+/* Upper limit on number of server statistics parameters */
+const ADMIN_SERVER_STATS_MAX = 65536;
+
 /* A long string, which may NOT be NULL. */
 typedef string admin_nonnull_string<ADMIN_STRING_MAX>;
 
@@ -186,6 +204,15 @@ struct admin_server_update_tls_files_args {
     unsigned int flags;
 };
 
+struct admin_server_get_procedure_stats_args {
+    admin_nonnull_server srv;
+    unsigned int flags;
+};
+
+struct admin_server_get_procedure_stats_ret {
+    admin_typed_param params<ADMIN_SERVER_PROCEDURE_STATS_MAX>;
+};
+
 struct admin_connect_get_logging_outputs_args {
     unsigned int flags;
 };
@@ -214,6 +241,56 @@ struct admin_connect_set_logging_filters_args {
     unsigned int flags;
 };
 
+struct admin_connect_get_lock_stats_args {
+    unsigned int flags;
+};
+
+struct admin_connect_get_lock_stats_ret {
+    admin_typed_param params<ADMIN_CONNECT_LOCK_STATS_MAX>;
+};
+
+struct admin_connect_get_object_stats_args {
+    unsigned int flags;
+};
+
+struct admin_connect_get_object_stats_ret {
+    admin_typed_param params<ADMIN_CONNECT_OBJECT_STATS_MAX>;
+};
+
+struct admin_connect_get_log_file_stats_args {
+    unsigned int flags;
+};
+
+struct admin_connect_get_log_file_stats_ret {
+    admin_typed_param params<ADMIN_CONNECT_LOG_FILE_STATS_MAX>;
+};
+
+struct admin_connect_get_lease_stats_args {
+    unsigned int flags;
+};
+
+struct admin_connect_get_lease_stats_ret {
+    admin_typed_param params<ADMIN_CONNECT_LEASE_STATS_MAX>;
+};
+
+struct admin_server_get_stats_args {
+    admin_nonnull_server srv;
+    unsigned int flags;
+};
+
+struct admin_server_get_stats_ret {
+    admin_typed_param params<ADMIN_SERVER_STATS_MAX>;
+};
+
+struct admin_connect_start_profiler_args {
+    unsigned int duration;
+    unsigned int flags;
+};
+
+struct admin_connect_start_profiler_ret {
+    admin_nonnull_string file;
+};
+
 /* Define the program number, protocol version and procedure numbers here. */
 const ADMIN_PROGRAM = 0x06900690;
 const ADMIN_PROTOCOL_VERSION = 1;
@@ -324,5 +401,40 @@ enum admin_procedure {
     /**
      * @generate: both
      */
-    ADMIN_PROC_SERVER_UPDATE_TLS_FILES = 18
+    ADMIN_PROC_SERVER_UPDATE_TLS_FILES = 18,
+
+    /**
+     * @generate: none
+     */
+    ADMIN_PROC_SERVER_GET_PROCEDURE_STATS = 19,
+
+    /**
+     * @generate: none
+     */
+    ADMIN_PROC_CONNECT_GET_LOCK_STATS = 20,
+
+    /**
+     * @generate: none
+     */
+    ADMIN_PROC_CONNECT_GET_OBJECT_STATS = 21,
+
+    /**
+     * @generate: none
+     */
+    ADMIN_PROC_CONNECT_GET_LOG_FILE_STATS = 22,
+
+    /**
+     * @generate: none
+     */
+    ADMIN_PROC_CONNECT_GET_LEASE_STATS = 23,
+
+    /**
+     * @generate: none
+     */
+    ADMIN_PROC_SERVER_GET_STATS = 24,
+
+    /**
+     * @generate: none
+     */
+    ADMIN_PROC_CONNECT_START_PROFILER = 25
 };
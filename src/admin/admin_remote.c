@@ -426,6 +426,272 @@ remoteAdminServerSetClientLimits(virAdmServerPtr srv,
     return rv;
 }
 
+static int
+remoteAdminServerGetProcedureStats(virAdmServerPtr srv,
+                                   virTypedParameterPtr *params,
+                                   int *nparams,
+                                   unsigned int flags)
+{
+    int rv = -1;
+    admin_server_get_procedure_stats_args args;
+    admin_server_get_procedure_stats_ret ret;
+    remoteAdminPrivPtr priv = srv->conn->privateData;
+    args.flags = flags;
+    make_nonnull_server(&args.srv, srv);
+
+    memset(&ret, 0, sizeof(ret));
+    virObjectLock(priv);
+
+    if (call(srv->conn, 0, ADMIN_PROC_SERVER_GET_PROCEDURE_STATS,
+             (xdrproc_t) xdr_admin_server_get_procedure_stats_args,
+             (char *) &args,
+             (xdrproc_t) xdr_admin_server_get_procedure_stats_ret,
+             (char *) &ret) == -1)
+        goto cleanup;
+
+    if (virTypedParamsDeserialize((virTypedParameterRemotePtr) ret.params.params_val,
+                                  ret.params.params_len,
+                                  ADMIN_SERVER_PROCEDURE_STATS_MAX,
+                                  params,
+                                  nparams) < 0)
+        goto cleanup;
+
+    rv = 0;
+    xdr_free((xdrproc_t) xdr_admin_server_get_procedure_stats_ret,
+             (char *) &ret);
+
+ cleanup:
+    virObjectUnlock(priv);
+    return rv;
+}
+
+static int
+remoteAdminConnectGetLockStats(virAdmConnectPtr conn,
+                               virTypedParameterPtr *params,
+                               int *nparams,
+                               unsigned int flags)
+{
+    int rv = -1;
+    admin_connect_get_lock_stats_args args;
+    admin_connect_get_lock_stats_ret ret;
+    remoteAdminPrivPtr priv = conn->privateData;
+    args.flags = flags;
+
+    memset(&ret, 0, sizeof(ret));
+    virObjectLock(priv);
+
+    if (call(conn, 0, ADMIN_PROC_CONNECT_GET_LOCK_STATS,
+             (xdrproc_t) xdr_admin_connect_get_lock_stats_args,
+             (char *) &args,
+             (xdrproc_t) xdr_admin_connect_get_lock_stats_ret,
+             (char *) &ret) == -1)
+        goto cleanup;
+
+    if (virTypedParamsDeserialize((virTypedParameterRemotePtr) ret.params.params_val,
+                                  ret.params.params_len,
+                                  ADMIN_CONNECT_LOCK_STATS_MAX,
+                                  params,
+                                  nparams) < 0)
+        goto cleanup;
+
+    rv = 0;
+    xdr_free((xdrproc_t) xdr_admin_connect_get_lock_stats_ret,
+             (char *) &ret);
+
+ cleanup:
+    virObjectUnlock(priv);
+    return rv;
+}
+
+static int
+remoteAdminConnectGetObjectStats(virAdmConnectPtr conn,
+                                 virTypedParameterPtr *params,
+                                 int *nparams,
+                                 unsigned int flags)
+{
+    int rv = -1;
+    admin_connect_get_object_stats_args args;
+    admin_connect_get_object_stats_ret ret;
+    remoteAdminPrivPtr priv = conn->privateData;
+    args.flags = flags;
+
+    memset(&ret, 0, sizeof(ret));
+    virObjectLock(priv);
+
+    if (call(conn, 0, ADMIN_PROC_CONNECT_GET_OBJECT_STATS,
+             (xdrproc_t) xdr_admin_connect_get_object_stats_args,
+             (char *) &args,
+             (xdrproc_t) xdr_admin_connect_get_object_stats_ret,
+             (char *) &ret) == -1)
+        goto cleanup;
+
+    if (virTypedParamsDeserialize((virTypedParameterRemotePtr) ret.params.params_val,
+                                  ret.params.params_len,
+                                  ADMIN_CONNECT_OBJECT_STATS_MAX,
+                                  params,
+                                  nparams) < 0)
+        goto cleanup;
+
+    rv = 0;
+    xdr_free((xdrproc_t) xdr_admin_connect_get_object_stats_ret,
+             (char *) &ret);
+
+ cleanup:
+    virObjectUnlock(priv);
+    return rv;
+}
+
+static int
+remoteAdminConnectGetLogFileStats(virAdmConnectPtr conn,
+                                  virTypedParameterPtr *params,
+                                  int *nparams,
+                                  unsigned int flags)
+{
+    int rv = -1;
+    admin_connect_get_log_file_stats_args args;
+    admin_connect_get_log_file_stats_ret ret;
+    remoteAdminPrivPtr priv = conn->privateData;
+    args.flags = flags;
+
+    memset(&ret, 0, sizeof(ret));
+    virObjectLock(priv);
+
+    if (call(conn, 0, ADMIN_PROC_CONNECT_GET_LOG_FILE_STATS,
+             (xdrproc_t) xdr_admin_connect_get_log_file_stats_args,
+             (char *) &args,
+             (xdrproc_t) xdr_admin_connect_get_log_file_stats_ret,
+             (char *) &ret) == -1)
+        goto cleanup;
+
+    if (virTypedParamsDeserialize((virTypedParameterRemotePtr) ret.params.params_val,
+                                  ret.params.params_len,
+                                  ADMIN_CONNECT_LOG_FILE_STATS_MAX,
+                                  params,
+                                  nparams) < 0)
+        goto cleanup;
+
+    rv = 0;
+    xdr_free((xdrproc_t) xdr_admin_connect_get_log_file_stats_ret,
+             (char *) &ret);
+
+ cleanup:
+    virObjectUnlock(priv);
+    return rv;
+}
+
+static int
+remoteAdminConnectGetLeaseStats(virAdmConnectPtr conn,
+                                virTypedParameterPtr *params,
+                                int *nparams,
+                                unsigned int flags)
+{
+    int rv = -1;
+    admin_connect_get_lease_stats_args args;
+    admin_connect_get_lease_stats_ret ret;
+    remoteAdminPrivPtr priv = conn->privateData;
+    args.flags = flags;
+
+    memset(&ret, 0, sizeof(ret));
+    virObjectLock(priv);
+
+    if (call(conn, 0, ADMIN_PROC_CONNECT_GET_LEASE_STATS,
+             (xdrproc_t) xdr_admin_connect_get_lease_stats_args,
+             (char *) &args,
+             (xdrproc_t) xdr_admin_connect_get_lease_stats_ret,
+             (char *) &ret) == -1)
+        goto cleanup;
+
+    if (virTypedParamsDeserialize((virTypedParameterRemotePtr) ret.params.params_val,
+                                  ret.params.params_len,
+                                  ADMIN_CONNECT_LEASE_STATS_MAX,
+                                  params,
+                                  nparams) < 0)
+        goto cleanup;
+
+    rv = 0;
+    xdr_free((xdrproc_t) xdr_admin_connect_get_lease_stats_ret,
+             (char *) &ret);
+
+ cleanup:
+    virObjectUnlock(priv);
+    return rv;
+}
+
+static int
+remoteAdminServerGetStats(virAdmServerPtr srv,
+                          virTypedParameterPtr *params,
+                          int *nparams,
+                          unsigned int flags)
+{
+    int rv = -1;
+    admin_server_get_stats_args args;
+    admin_server_get_stats_ret ret;
+    remoteAdminPrivPtr priv = srv->conn->privateData;
+    args.flags = flags;
+    make_nonnull_server(&args.srv, srv);
+
+    memset(&ret, 0, sizeof(ret));
+    virObjectLock(priv);
+
+    if (call(srv->conn, 0, ADMIN_PROC_SERVER_GET_STATS,
+             (xdrproc_t) xdr_admin_server_get_stats_args,
+             (char *) &args,
+             (xdrproc_t) xdr_admin_server_get_stats_ret,
+             (char *) &ret) == -1)
+        goto cleanup;
+
+    if (virTypedParamsDeserialize((virTypedParameterRemotePtr) ret.params.params_val,
+                                  ret.params.params_len,
+                                  ADMIN_SERVER_STATS_MAX,
+                                  params,
+                                  nparams) < 0)
+        goto cleanup;
+
+    rv = 0;
+    xdr_free((xdrproc_t) xdr_admin_server_get_stats_ret,
+             (char *) &ret);
+
+ cleanup:
+    virObjectUnlock(priv);
+    return rv;
+}
+
+static int
+remoteAdminConnectStartProfiler(virAdmConnectPtr conn,
+                                unsigned int duration,
+                                char **file,
+                                unsigned int flags)
+{
+    int rv = -1;
+    remoteAdminPrivPtr priv = conn->privateData;
+    admin_connect_start_profiler_args args;
+    admin_connect_start_profiler_ret ret;
+
+    args.duration = duration;
+    args.flags = flags;
+
+    memset(&ret, 0, sizeof(ret));
+    virObjectLock(priv);
+
+    if (call(conn,
+             0,
+             ADMIN_PROC_CONNECT_START_PROFILER,
+             (xdrproc_t) xdr_admin_connect_start_profiler_args,
+             (char *) &args,
+             (xdrproc_t) xdr_admin_connect_start_profiler_ret,
+             (char *) &ret) == -1)
+        goto done;
+
+    *file = g_steal_pointer(&ret.file);
+
+    rv = 0;
+    xdr_free((xdrproc_t) xdr_admin_connect_start_profiler_ret, (char *) &ret);
+
+ done:
+    virObjectUnlock(priv);
+    return rv;
+}
+
 static int
 remoteAdminConnectGetLoggingOutputs(virAdmConnectPtr conn,
                                     char **outputs,
@@ -20,14 +20,20 @@
 
 #include <config.h>
 
+#ifdef HAVE_MALLINFO2
+# include <malloc.h>
+#endif
+
 #include "admin_server.h"
 #include "datatypes.h"
 #include "viralloc.h"
 #include "virerror.h"
+#include "vireventthread.h"
 #include "viridentity.h"
 #include "virlog.h"
 #include "rpc/virnetdaemon.h"
 #include "rpc/virnetserver.h"
+#include "virstatsprovider.h"
 #include "virstring.h"
 #include "virthreadpool.h"
 #include "virtypedparam.h"
@@ -81,6 +87,10 @@ adminServerGetThreadPoolParameters(virNetServerPtr srv,
     size_t freeWorkers;
     size_t nPrioWorkers;
     size_t jobQueueDepth;
+    size_t maxClientWorkers;
+    g_autofree virEventThreadLatency *latency = NULL;
+    size_t nlatency = 0;
+    size_t i;
     g_autoptr(virTypedParamList) paramlist = g_new0(virTypedParamList, 1);
 
     virCheckFlags(0, -1);
@@ -88,7 +98,8 @@ adminServerGetThreadPoolParameters(virNetServerPtr srv,
     if (virNetServerGetThreadPoolParameters(srv, &minWorkers, &maxWorkers,
                                             &nWorkers, &freeWorkers,
                                             &nPrioWorkers,
-                                            &jobQueueDepth) < 0) {
+                                            &jobQueueDepth,
+                                            &maxClientWorkers) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("Unable to retrieve threadpool parameters"));
         return -1;
@@ -118,6 +129,25 @@ adminServerGetThreadPoolParameters(virNetServerPtr srv,
                                  "%s", VIR_THREADPOOL_JOB_QUEUE_DEPTH) < 0)
         return -1;
 
+    if (virTypedParamListAddUInt(paramlist, maxClientWorkers,
+                                 "%s", VIR_THREADPOOL_CLIENT_WORKERS_MAX) < 0)
+        return -1;
+
+    if (virNetServerGetEventThreadLatency(srv, &latency, &nlatency) < 0)
+        return -1;
+
+    if (virTypedParamListAddUInt(paramlist, nlatency,
+                                 "%s", VIR_THREADPOOL_EVENT_THREADS) < 0)
+        return -1;
+
+    for (i = 0; i < nlatency; i++) {
+        if (virTypedParamListAddULLong(paramlist, latency[i].avg,
+                                       "eventThread.%zu.latencyAvg", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, latency[i].max,
+                                       "eventThread.%zu.latencyMax", i) < 0)
+            return -1;
+    }
+
     *nparams = virTypedParamListStealParams(paramlist, params);
 
     return 0;
@@ -132,6 +162,7 @@ adminServerSetThreadPoolParameters(virNetServerPtr srv,
     long long int minWorkers = -1;
     long long int maxWorkers = -1;
     long long int prioWorkers = -1;
+    long long int maxClientWorkers = -1;
     virTypedParameterPtr param = NULL;
 
     virCheckFlags(0, -1);
@@ -143,6 +174,8 @@ adminServerSetThreadPoolParameters(virNetServerPtr srv,
                                VIR_TYPED_PARAM_UINT,
                                VIR_THREADPOOL_WORKERS_PRIORITY,
                                VIR_TYPED_PARAM_UINT,
+                               VIR_THREADPOOL_CLIENT_WORKERS_MAX,
+                               VIR_TYPED_PARAM_UINT,
                                NULL) < 0)
         return -1;
 
@@ -158,8 +191,13 @@ adminServerSetThreadPoolParameters(virNetServerPtr srv,
                                    VIR_THREADPOOL_WORKERS_PRIORITY)))
         prioWorkers = param->value.ui;
 
+    if ((param = virTypedParamsGet(params, nparams,
+                                   VIR_THREADPOOL_CLIENT_WORKERS_MAX)))
+        maxClientWorkers = param->value.ui;
+
     if (virNetServerSetThreadPoolParameters(srv, minWorkers,
-                                            maxWorkers, prioWorkers) < 0)
+                                            maxWorkers, prioWorkers,
+                                            maxClientWorkers) < 0)
         return -1;
 
     return 0;
@@ -208,6 +246,12 @@ adminClientGetInfo(virNetServerClientPtr client,
     const char *attr = NULL;
     g_autoptr(virTypedParamList) paramlist = g_new0(virTypedParamList, 1);
     g_autoptr(virIdentity) identity = NULL;
+    virNetSocketCompressionStats compStats;
+    unsigned long long eventsDropped;
+    unsigned long long eventsCoalesced;
+    virKeepAliveStats kaStats;
+    unsigned long long tlsHandshakeTime;
+    bool tlsResumed;
     int rc;
 
     virCheckFlags(0, -1);
@@ -285,6 +329,50 @@ adminClientGetInfo(virNetServerClientPtr client,
                                    "%s", VIR_CLIENT_INFO_SELINUX_CONTEXT) < 0)
         return -1;
 
+    if (virNetServerClientGetCompressionStats(client, &compStats)) {
+        if (virTypedParamListAddULLong(paramlist, compStats.txRaw,
+                                       "%s", VIR_CLIENT_INFO_COMPRESSION_TX_RAW) < 0 ||
+            virTypedParamListAddULLong(paramlist, compStats.txWire,
+                                       "%s", VIR_CLIENT_INFO_COMPRESSION_TX_WIRE) < 0 ||
+            virTypedParamListAddULLong(paramlist, compStats.rxWire,
+                                       "%s", VIR_CLIENT_INFO_COMPRESSION_RX_WIRE) < 0 ||
+            virTypedParamListAddULLong(paramlist, compStats.rxRaw,
+                                       "%s", VIR_CLIENT_INFO_COMPRESSION_RX_RAW) < 0)
+            return -1;
+    }
+
+    if (virNetServerClientGetEventStats(client, &eventsDropped,
+                                        &eventsCoalesced)) {
+        if (virTypedParamListAddULLong(paramlist, eventsDropped,
+                                       "%s", VIR_CLIENT_INFO_EVENTS_DROPPED) < 0 ||
+            virTypedParamListAddULLong(paramlist, eventsCoalesced,
+                                       "%s", VIR_CLIENT_INFO_EVENTS_COALESCED) < 0)
+            return -1;
+    }
+
+    if (virNetServerClientGetKeepAliveStats(client, &kaStats)) {
+        if (virTypedParamListAddULLong(paramlist, kaStats.pings,
+                                       "%s", VIR_CLIENT_INFO_KEEPALIVE_REQUESTS) < 0 ||
+            virTypedParamListAddULLong(paramlist, kaStats.pongs,
+                                       "%s", VIR_CLIENT_INFO_KEEPALIVE_RESPONSES) < 0 ||
+            virTypedParamListAddULLong(paramlist, kaStats.rttLast,
+                                       "%s", VIR_CLIENT_INFO_KEEPALIVE_RTT) < 0 ||
+            virTypedParamListAddULLong(paramlist, kaStats.rttAvg,
+                                       "%s", VIR_CLIENT_INFO_KEEPALIVE_RTT_AVG) < 0 ||
+            virTypedParamListAddULLong(paramlist, kaStats.rttMax,
+                                       "%s", VIR_CLIENT_INFO_KEEPALIVE_RTT_MAX) < 0)
+            return -1;
+    }
+
+    if (virNetServerClientGetTLSHandshakeStats(client, &tlsHandshakeTime,
+                                               &tlsResumed)) {
+        if (virTypedParamListAddULLong(paramlist, tlsHandshakeTime,
+                                       "%s", VIR_CLIENT_INFO_TLS_HANDSHAKE_TIME) < 0 ||
+            virTypedParamListAddBoolean(paramlist, tlsResumed,
+                                        "%s", VIR_CLIENT_INFO_TLS_SESSION_RESUMED) < 0)
+            return -1;
+    }
+
     *nparams = virTypedParamListStealParams(paramlist, params);
     return 0;
 }
@@ -376,3 +464,212 @@ adminServerUpdateTlsFiles(virNetServerPtr srv,
 
     return virNetServerUpdateTlsFiles(srv);
 }
+
+int
+adminServerGetProcedureStats(virNetServerPtr srv,
+                             virTypedParameterPtr *params,
+                             int *nparams,
+                             unsigned int flags)
+{
+    g_autoptr(virTypedParamList) paramlist = g_new0(virTypedParamList, 1);
+
+    virCheckFlags(0, -1);
+
+    if (virNetServerGetProcedureStats(srv, paramlist) < 0)
+        return -1;
+
+    *nparams = virTypedParamListStealParams(paramlist, params);
+
+    return 0;
+}
+
+static int
+adminServerGetLoopStats(virNetServerPtr srv,
+                        virTypedParamListPtr paramlist)
+{
+    virEventThreadLatency latency;
+    g_autofree virEventThreadLatency *threads = NULL;
+    size_t nthreads = 0;
+    size_t i;
+
+    /* Only measured once the daemon runs its main loop */
+    if (virEventThreadGetDefaultLatency(&latency) < 0) {
+        virResetLastError();
+    } else if (virTypedParamListAddULLong(paramlist, latency.avg,
+                                          "eventloop.latency.avg") < 0 ||
+               virTypedParamListAddULLong(paramlist, latency.max,
+                                          "eventloop.latency.max") < 0) {
+        return -1;
+    }
+
+    if (virNetServerGetEventThreadLatency(srv, &threads, &nthreads) < 0)
+        return -1;
+
+    if (virTypedParamListAddUInt(paramlist, nthreads,
+                                 "eventthread.count") < 0)
+        return -1;
+
+    for (i = 0; i < nthreads; i++) {
+        if (virTypedParamListAddULLong(paramlist, threads[i].avg,
+                                       "eventthread.%zu.latency.avg", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, threads[i].max,
+                                       "eventthread.%zu.latency.max", i) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+static int
+adminServerAddPoolStats(virTypedParamListPtr paramlist,
+                        virThreadPoolStatsPtr stats,
+                        const char *prefix)
+{
+    if (virTypedParamListAddUInt(paramlist, stats->jobQueueDepth,
+                                 "%s.queue.depth", prefix) < 0 ||
+        virTypedParamListAddUInt(paramlist, stats->workers,
+                                 "%s.workers", prefix) < 0 ||
+        virTypedParamListAddUInt(paramlist, stats->freeWorkers,
+                                 "%s.workers.free", prefix) < 0 ||
+        virTypedParamListAddULLong(paramlist, stats->jobs,
+                                   "%s.jobs", prefix) < 0 ||
+        virTypedParamListAddULLong(paramlist, stats->jobWaitAvg,
+                                   "%s.wait.avg", prefix) < 0 ||
+        virTypedParamListAddULLong(paramlist, stats->jobWaitMax,
+                                   "%s.wait.max", prefix) < 0)
+        return -1;
+
+    return 0;
+}
+
+static int
+adminServerGetPoolStats(virNetServerPtr srv,
+                        virTypedParamListPtr paramlist)
+{
+    virThreadPoolStats workers = { 0 };
+    virThreadPoolStatsPtr pools = NULL;
+    size_t npools;
+    size_t i;
+    int ret = -1;
+
+    virNetServerGetWorkerStats(srv, &workers);
+    if (adminServerAddPoolStats(paramlist, &workers, "workers") < 0)
+        goto cleanup;
+
+    /* Pools of the hypervisor and other drivers in the daemon */
+    npools = virThreadPoolGetAllStats(&pools);
+
+    if (virTypedParamListAddUInt(paramlist, npools, "pool.count") < 0)
+        goto cleanup;
+
+    for (i = 0; i < npools; i++) {
+        g_autofree char *prefix = g_strdup_printf("pool.%zu", i);
+
+        if (virTypedParamListAddString(paramlist, pools[i].name,
+                                       "%s.name", prefix) < 0 ||
+            adminServerAddPoolStats(paramlist, &pools[i], prefix) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    g_free(workers.name);
+    virThreadPoolStatsFree(pools, npools);
+    return ret;
+}
+
+static int
+adminServerGetClientStats(virNetServerPtr srv,
+                          virTypedParamListPtr paramlist)
+{
+    virNetServerClientPtr *clients = NULL;
+    int nclients;
+    size_t i;
+    int ret = -1;
+
+    if ((nclients = virNetServerGetClients(srv, &clients)) < 0)
+        return -1;
+
+    if (virTypedParamListAddUInt(paramlist, nclients, "client.count") < 0)
+        goto cleanup;
+
+    for (i = 0; i < nclients; i++) {
+        unsigned long long bytesRx;
+        unsigned long long bytesTx;
+        unsigned long long messagesRx;
+        unsigned long long messagesTx;
+
+        virNetServerClientGetTrafficStats(clients[i], &bytesRx, &bytesTx,
+                                          &messagesRx, &messagesTx);
+
+        if (virTypedParamListAddULLong(paramlist,
+                                       virNetServerClientGetID(clients[i]),
+                                       "client.%zu.id", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, bytesRx,
+                                       "client.%zu.bytes.received", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, bytesTx,
+                                       "client.%zu.bytes.sent", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, messagesRx,
+                                       "client.%zu.messages.received", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, messagesTx,
+                                       "client.%zu.messages.sent", i) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virObjectListFreeCount(clients, nclients);
+    return ret;
+}
+
+#ifdef HAVE_MALLINFO2
+static int
+adminServerGetMemoryStats(virTypedParamListPtr paramlist)
+{
+    struct mallinfo2 info = mallinfo2();
+
+    if (virTypedParamListAddULLong(paramlist, info.arena,
+                                   "memory.heap.arena") < 0 ||
+        virTypedParamListAddULLong(paramlist, info.hblkhd,
+                                   "memory.heap.mmap") < 0 ||
+        virTypedParamListAddULLong(paramlist, info.uordblks,
+                                   "memory.heap.used") < 0 ||
+        virTypedParamListAddULLong(paramlist, info.fordblks,
+                                   "memory.heap.free") < 0 ||
+        virTypedParamListAddULLong(paramlist, info.keepcost,
+                                   "memory.heap.releasable") < 0)
+        return -1;
+
+    return 0;
+}
+#else /* !HAVE_MALLINFO2 */
+static int
+adminServerGetMemoryStats(virTypedParamListPtr paramlist G_GNUC_UNUSED)
+{
+    return 0;
+}
+#endif /* !HAVE_MALLINFO2 */
+
+int
+adminServerGetStats(virNetServerPtr srv,
+                    virTypedParameterPtr *params,
+                    int *nparams,
+                    unsigned int flags)
+{
+    g_autoptr(virTypedParamList) paramlist = g_new0(virTypedParamList, 1);
+
+    virCheckFlags(0, -1);
+
+    if (adminServerGetLoopStats(srv, paramlist) < 0 ||
+        adminServerGetPoolStats(srv, paramlist) < 0 ||
+        adminServerGetClientStats(srv, paramlist) < 0 ||
+        adminServerGetMemoryStats(paramlist) < 0 ||
+        virStatsProviderCollect(paramlist, "driver.") < 0)
+        return -1;
+
+    *nparams = virTypedParamListStealParams(paramlist, params);
+
+    return 0;
+}
@@ -20,15 +20,21 @@
 
 #include <config.h>
 
+#include <unistd.h>
+
 #include "internal.h"
 #include "libvirt_internal.h"
 
 #include "admin_server_dispatch.h"
 #include "admin_server.h"
+#include "configmake.h"
 #include "datatypes.h"
+#include "locking/domain_lock.h"
 #include "viralloc.h"
 #include "virerror.h"
 #include "virlog.h"
+#include "virprofiler.h"
+#include "virrotatingfile.h"
 #include "rpc/virnetdaemon.h"
 #include "rpc/virnetserver.h"
 #include "virstring.h"
@@ -418,6 +424,80 @@ adminDispatchServerSetClientLimits(virNetServerPtr server G_GNUC_UNUSED,
     return rv;
 }
 
+static int
+adminDispatchServerGetStats(virNetServerPtr server G_GNUC_UNUSED,
+                            virNetServerClientPtr client,
+                            virNetMessagePtr msg G_GNUC_UNUSED,
+                            virNetMessageErrorPtr rerr G_GNUC_UNUSED,
+                            admin_server_get_stats_args *args,
+                            admin_server_get_stats_ret *ret)
+{
+    int rv = -1;
+    virNetServerPtr srv = NULL;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    struct daemonAdmClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+
+    if (!(srv = virNetDaemonGetServer(priv->dmn, args->srv.name)))
+        goto cleanup;
+
+    if (adminServerGetStats(srv, &params, &nparams, args->flags) < 0)
+        goto cleanup;
+
+    if (virTypedParamsSerialize(params, nparams,
+                                ADMIN_SERVER_STATS_MAX,
+                                (virTypedParameterRemotePtr *) &ret->params.params_val,
+                                &ret->params.params_len, 0) < 0)
+        goto cleanup;
+
+    rv = 0;
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+
+    virTypedParamsFree(params, nparams);
+    virObjectUnref(srv);
+    return rv;
+}
+
+static int
+adminDispatchServerGetProcedureStats(virNetServerPtr server G_GNUC_UNUSED,
+                                     virNetServerClientPtr client,
+                                     virNetMessagePtr msg G_GNUC_UNUSED,
+                                     virNetMessageErrorPtr rerr G_GNUC_UNUSED,
+                                     admin_server_get_procedure_stats_args *args,
+                                     admin_server_get_procedure_stats_ret *ret)
+{
+    int rv = -1;
+    virNetServerPtr srv = NULL;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    struct daemonAdmClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+
+    if (!(srv = virNetDaemonGetServer(priv->dmn, args->srv.name)))
+        goto cleanup;
+
+    if (adminServerGetProcedureStats(srv, &params, &nparams, args->flags) < 0)
+        goto cleanup;
+
+    if (virTypedParamsSerialize(params, nparams,
+                                ADMIN_SERVER_PROCEDURE_STATS_MAX,
+                                (virTypedParameterRemotePtr *) &ret->params.params_val,
+                                &ret->params.params_len, 0) < 0)
+        goto cleanup;
+
+    rv = 0;
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+
+    virTypedParamsFree(params, nparams);
+    virObjectUnref(srv);
+    return rv;
+}
+
 /* Returns the number of outputs stored in @outputs */
 static int
 adminConnectGetLoggingOutputs(char **outputs, unsigned int flags)
@@ -469,6 +549,359 @@ adminConnectSetLoggingFilters(virNetDaemonPtr dmn G_GNUC_UNUSED,
     return virLogSetFilters(filters);
 }
 
+static int
+adminConnectGetLockStats(virTypedParameterPtr *params,
+                         int *nparams,
+                         unsigned int flags)
+{
+    g_autoptr(virTypedParamList) paramlist = g_new0(virTypedParamList, 1);
+    virMutexProfileEntryPtr entries = NULL;
+    size_t nentries;
+    size_t i;
+    int ret = -1;
+
+    virCheckFlags(0, -1);
+
+    nentries = virMutexProfileGet(&entries);
+
+    if (virTypedParamListAddUInt(paramlist, nentries, "lock.count") < 0)
+        goto cleanup;
+
+    for (i = 0; i < nentries; i++) {
+        virMutexProfileEntryPtr entry = &entries[i];
+
+        if (virTypedParamListAddString(paramlist, entry->name,
+                                       "lock.%zu.class", i) < 0 ||
+            virTypedParamListAddString(paramlist, entry->site,
+                                       "lock.%zu.site", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, entry->acquisitions,
+                                       "lock.%zu.acquisitions", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, entry->contended,
+                                       "lock.%zu.contended", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, entry->waitTotal,
+                                       "lock.%zu.wait.total", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, entry->waitMax,
+                                       "lock.%zu.wait.max", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, entry->holdTotal,
+                                       "lock.%zu.hold.total", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, entry->holdMax,
+                                       "lock.%zu.hold.max", i) < 0)
+            goto cleanup;
+    }
+
+    *nparams = virTypedParamListStealParams(paramlist, params);
+    ret = 0;
+
+ cleanup:
+    virMutexProfileEntriesFree(entries, nentries);
+    return ret;
+}
+
+static int
+adminDispatchConnectGetLockStats(virNetServerPtr server G_GNUC_UNUSED,
+                                 virNetServerClientPtr client G_GNUC_UNUSED,
+                                 virNetMessagePtr msg G_GNUC_UNUSED,
+                                 virNetMessageErrorPtr rerr,
+                                 admin_connect_get_lock_stats_args *args,
+                                 admin_connect_get_lock_stats_ret *ret)
+{
+    int rv = -1;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+
+    if (adminConnectGetLockStats(&params, &nparams, args->flags) < 0)
+        goto cleanup;
+
+    if (virTypedParamsSerialize(params, nparams,
+                                ADMIN_CONNECT_LOCK_STATS_MAX,
+                                (virTypedParameterRemotePtr *) &ret->params.params_val,
+                                &ret->params.params_len, 0) < 0)
+        goto cleanup;
+
+    rv = 0;
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+
+    virTypedParamsFree(params, nparams);
+    return rv;
+}
+
+static int
+adminConnectGetObjectStats(virTypedParameterPtr *params,
+                           int *nparams,
+                           unsigned int flags)
+{
+    g_autoptr(virTypedParamList) paramlist = g_new0(virTypedParamList, 1);
+    virClassStatsPtr stats = NULL;
+    size_t nstats;
+    size_t nreported = 0;
+    size_t i;
+    int ret = -1;
+
+    virCheckFlags(0, -1);
+
+    nstats = virClassGetStats(&stats);
+
+    for (i = 0; i < nstats; i++) {
+        virClassStatsPtr entry = &stats[i];
+
+        /* abstract classes and ones not used by this daemon */
+        if (entry->live == 0 && entry->pooled == 0)
+            continue;
+
+        if (virTypedParamListAddString(paramlist, entry->name,
+                                       "class.%zu.name", nreported) < 0 ||
+            virTypedParamListAddULLong(paramlist, entry->live,
+                                       "class.%zu.live", nreported) < 0 ||
+            virTypedParamListAddULLong(paramlist, entry->pooled,
+                                       "class.%zu.pooled", nreported) < 0 ||
+            virTypedParamListAddULLong(paramlist, entry->poolMax,
+                                       "class.%zu.pool.max", nreported) < 0 ||
+            virTypedParamListAddULLong(paramlist, entry->reused,
+                                       "class.%zu.reused", nreported) < 0)
+            goto cleanup;
+
+        nreported++;
+    }
+
+    if (virTypedParamListAddUInt(paramlist, nreported, "class.count") < 0)
+        goto cleanup;
+
+    *nparams = virTypedParamListStealParams(paramlist, params);
+    ret = 0;
+
+ cleanup:
+    virClassStatsFree(stats, nstats);
+    return ret;
+}
+
+static int
+adminDispatchConnectGetObjectStats(virNetServerPtr server G_GNUC_UNUSED,
+                                   virNetServerClientPtr client G_GNUC_UNUSED,
+                                   virNetMessagePtr msg G_GNUC_UNUSED,
+                                   virNetMessageErrorPtr rerr,
+                                   admin_connect_get_object_stats_args *args,
+                                   admin_connect_get_object_stats_ret *ret)
+{
+    int rv = -1;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+
+    if (adminConnectGetObjectStats(&params, &nparams, args->flags) < 0)
+        goto cleanup;
+
+    if (virTypedParamsSerialize(params, nparams,
+                                ADMIN_CONNECT_OBJECT_STATS_MAX,
+                                (virTypedParameterRemotePtr *) &ret->params.params_val,
+                                &ret->params.params_len, 0) < 0)
+        goto cleanup;
+
+    rv = 0;
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+
+    virTypedParamsFree(params, nparams);
+    return rv;
+}
+
+static int
+adminConnectGetLogFileStats(virTypedParameterPtr *params,
+                            int *nparams,
+                            unsigned int flags)
+{
+    g_autoptr(virTypedParamList) paramlist = g_new0(virTypedParamList, 1);
+    virRotatingFileWriterStatsPtr stats = NULL;
+    size_t nstats;
+    size_t i;
+    int ret = -1;
+
+    virCheckFlags(0, -1);
+
+    nstats = virRotatingFileWriterGetStats(&stats);
+
+    if (virTypedParamListAddUInt(paramlist, nstats, "file.count") < 0)
+        goto cleanup;
+
+    for (i = 0; i < nstats; i++) {
+        virRotatingFileWriterStatsPtr entry = &stats[i];
+
+        if (virTypedParamListAddString(paramlist, entry->path,
+                                       "file.%zu.path", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, entry->bytes,
+                                       "file.%zu.bytes", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, entry->writes,
+                                       "file.%zu.writes", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, entry->spliced,
+                                       "file.%zu.spliced", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, entry->backlog,
+                                       "file.%zu.backlog", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, entry->backlogMax,
+                                       "file.%zu.backlog.max", i) < 0)
+            goto cleanup;
+    }
+
+    *nparams = virTypedParamListStealParams(paramlist, params);
+    ret = 0;
+
+ cleanup:
+    virRotatingFileWriterStatsFree(stats, nstats);
+    return ret;
+}
+
+static int
+adminDispatchConnectGetLogFileStats(virNetServerPtr server G_GNUC_UNUSED,
+                                    virNetServerClientPtr client G_GNUC_UNUSED,
+                                    virNetMessagePtr msg G_GNUC_UNUSED,
+                                    virNetMessageErrorPtr rerr,
+                                    admin_connect_get_log_file_stats_args *args,
+                                    admin_connect_get_log_file_stats_ret *ret)
+{
+    int rv = -1;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+
+    if (adminConnectGetLogFileStats(&params, &nparams, args->flags) < 0)
+        goto cleanup;
+
+    if (virTypedParamsSerialize(params, nparams,
+                                ADMIN_CONNECT_LOG_FILE_STATS_MAX,
+                                (virTypedParameterRemotePtr *) &ret->params.params_val,
+                                &ret->params.params_len, 0) < 0)
+        goto cleanup;
+
+    rv = 0;
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+
+    virTypedParamsFree(params, nparams);
+    return rv;
+}
+
+static int
+adminConnectGetLeaseStats(virTypedParameterPtr *params,
+                          int *nparams,
+                          unsigned int flags)
+{
+    g_autoptr(virTypedParamList) paramlist = g_new0(virTypedParamList, 1);
+    virDomainLockDriverStatsPtr stats = NULL;
+    size_t nstats;
+    size_t i;
+    int ret = -1;
+
+    virCheckFlags(0, -1);
+
+    nstats = virDomainLockGetStats(&stats);
+
+    if (virTypedParamListAddUInt(paramlist, nstats, "driver.count") < 0)
+        goto cleanup;
+
+    for (i = 0; i < nstats; i++) {
+        virDomainLockStatsPtr entry = &stats[i].stats;
+
+        if (virTypedParamListAddString(paramlist, stats[i].driver,
+                                       "driver.%zu.name", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, entry->acquires,
+                                       "driver.%zu.acquires", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, entry->acquireFailed,
+                                       "driver.%zu.acquire.failed", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, entry->acquireBusy,
+                                       "driver.%zu.acquire.busy", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, entry->acquireTime,
+                                       "driver.%zu.acquire.time", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, entry->acquireTimeMax,
+                                       "driver.%zu.acquire.time.max", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, entry->releases,
+                                       "driver.%zu.releases", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, entry->releaseFailed,
+                                       "driver.%zu.release.failed", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, entry->releaseTime,
+                                       "driver.%zu.release.time", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, entry->releaseTimeMax,
+                                       "driver.%zu.release.time.max", i) < 0)
+            goto cleanup;
+    }
+
+    *nparams = virTypedParamListStealParams(paramlist, params);
+    ret = 0;
+
+ cleanup:
+    virDomainLockDriverStatsFree(stats, nstats);
+    return ret;
+}
+
+static int
+adminDispatchConnectGetLeaseStats(virNetServerPtr server G_GNUC_UNUSED,
+                                  virNetServerClientPtr client G_GNUC_UNUSED,
+                                  virNetMessagePtr msg G_GNUC_UNUSED,
+                                  virNetMessageErrorPtr rerr,
+                                  admin_connect_get_lease_stats_args *args,
+                                  admin_connect_get_lease_stats_ret *ret)
+{
+    int rv = -1;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+
+    if (adminConnectGetLeaseStats(&params, &nparams, args->flags) < 0)
+        goto cleanup;
+
+    if (virTypedParamsSerialize(params, nparams,
+                                ADMIN_CONNECT_LEASE_STATS_MAX,
+                                (virTypedParameterRemotePtr *) &ret->params.params_val,
+                                &ret->params.params_len, 0) < 0)
+        goto cleanup;
+
+    rv = 0;
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+
+    virTypedParamsFree(params, nparams);
+    return rv;
+}
+
+static int
+adminConnectStartProfiler(unsigned int duration,
+                          char **file,
+                          unsigned int flags)
+{
+    g_autofree char *rundir = NULL;
+    g_autofree char *dir = NULL;
+
+    virCheckFlags(0, -1);
+
+    if (geteuid() == 0)
+        rundir = g_strdup(RUNSTATEDIR "/libvirt");
+    else
+        rundir = virGetUserRuntimeDirectory();
+
+    dir = g_strdup_printf("%s/profiles", rundir);
+
+    return virProfilerStart(dir, duration, file);
+}
+
+static int
+adminDispatchConnectStartProfiler(virNetServerPtr server G_GNUC_UNUSED,
+                                  virNetServerClientPtr client G_GNUC_UNUSED,
+                                  virNetMessagePtr msg G_GNUC_UNUSED,
+                                  virNetMessageErrorPtr rerr,
+                                  admin_connect_start_profiler_args *args,
+                                  admin_connect_start_profiler_ret *ret)
+{
+    char *file = NULL;
+
+    if (adminConnectStartProfiler(args->duration, &file, args->flags) < 0) {
+        virNetMessageSaveError(rerr);
+        return -1;
+    }
+
+    ret->file = file;
+
+    return 0;
+}
+
 static int
 adminDispatchConnectGetLoggingOutputs(virNetServerPtr server G_GNUC_UNUSED,
                                       virNetServerClientPtr client G_GNUC_UNUSED,
@@ -1109,6 +1109,76 @@ virAdmServerUpdateTlsFiles(virAdmServerPtr srv,
     return ret;
 }
 
+/**
+ * virAdmServerGetProcedureStats:
+ * @srv: a valid server object reference
+ * @params: pointer to statistics object
+ *          (return value, allocated automatically)
+ * @nparams: pointer to number of parameters returned in @params
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Retrieve per-procedure RPC statistics of server @srv, collected since the
+ * daemon started. Only procedures which were called at least once are
+ * reported. Latencies are split into the time a call spent queued waiting
+ * for a worker thread and the time it took to execute, both in
+ * microseconds, and are counted in histograms sharing the same buckets.
+ *
+ * The following parameters are returned:
+ *
+ *  "bucket.count" - number of histogram buckets as unsigned int
+ *  "bucket.<num>.limit" - upper limit of histogram bucket <num> in
+ *                         microseconds as unsigned long long; the last
+ *                         bucket has no limit and counts all slower calls
+ *  "procedure.count" - number of procedures reported as unsigned int
+ *  "procedure.<num>.program" - RPC program of the procedure as unsigned int
+ *  "procedure.<num>.number" - procedure number within the program as int
+ *  "procedure.<num>.calls" - number of calls as unsigned long long
+ *  "procedure.<num>.errors" - number of calls which failed as
+ *                             unsigned long long
+ *  "procedure.<num>.wait.total" - total time spent waiting for a worker as
+ *                                 unsigned long long
+ *  "procedure.<num>.wait.max" - longest wait for a worker as
+ *                               unsigned long long
+ *  "procedure.<num>.wait.bucket.<bucket>" - number of calls whose wait
+ *                                           fell into histogram bucket
+ *                                           <bucket> as unsigned long long
+ *  "procedure.<num>.exec.total" - total execution time as
+ *                                 unsigned long long
+ *  "procedure.<num>.exec.max" - longest execution time as
+ *                               unsigned long long
+ *  "procedure.<num>.exec.bucket.<bucket>" - number of calls whose execution
+ *                                           time fell into histogram bucket
+ *                                           <bucket> as unsigned long long
+ *
+ * Returns 0 on success, allocating @params to size returned in @nparams, or
+ * -1 in case of an error. Caller is responsible for deallocating @params.
+ */
+int
+virAdmServerGetProcedureStats(virAdmServerPtr srv,
+                              virTypedParameterPtr *params,
+                              int *nparams,
+                              unsigned int flags)
+{
+    int ret = -1;
+
+    VIR_DEBUG("srv=%p, params=%p, nparams=%p, flags=0x%x",
+              srv, params, nparams, flags);
+    virResetLastError();
+
+    virCheckAdmServerGoto(srv, error);
+    virCheckNonNullArgGoto(params, error);
+    virCheckNonNullArgGoto(nparams, error);
+
+    if ((ret = remoteAdminServerGetProcedureStats(srv, params,
+                                                  nparams, flags)) < 0)
+        goto error;
+
+    return ret;
+ error:
+    virDispatchError(NULL);
+    return -1;
+}
+
 /**
  * virAdmConnectGetLoggingOutputs:
  * @conn: pointer to an active admin connection
@@ -1266,3 +1336,440 @@ virAdmConnectSetLoggingFilters(virAdmConnectPtr conn,
     virDispatchError(NULL);
     return -1;
 }
+
+/**
+ * virAdmConnectGetLockStats:
+ * @conn: pointer to an active admin connection
+ * @params: pointer to statistics object
+ *          (return value, allocated automatically)
+ * @nparams: pointer to number of parameters returned in @params
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Retrieve lock contention statistics of the daemon. They are only
+ * gathered while the 'lock_profiling' option is enabled in the daemon's
+ * configuration file, otherwise no locks are reported. Statistics are
+ * aggregated per lock class, which is the object class for locks of
+ * objects, and per call site acquiring the lock. All times are in
+ * nanoseconds.
+ *
+ * The following parameters are returned:
+ *
+ *  "lock.count" - number of entries reported as unsigned int
+ *  "lock.<num>.class" - class of the lock as string
+ *  "lock.<num>.site" - code acquiring the lock as string, a symbol or
+ *                      binary name and an offset if it can be resolved
+ *  "lock.<num>.acquisitions" - number of times the lock was acquired as
+ *                              unsigned long long
+ *  "lock.<num>.contended" - number of acquisitions which had to wait
+ *                           for the lock as unsigned long long
+ *  "lock.<num>.wait.total" - total time spent waiting for the lock as
+ *                            unsigned long long
+ *  "lock.<num>.wait.max" - longest wait for the lock as unsigned long long
+ *  "lock.<num>.hold.total" - total time the lock was held as
+ *                            unsigned long long
+ *  "lock.<num>.hold.max" - longest time the lock was held as
+ *                          unsigned long long
+ *
+ * Returns 0 on success, allocating @params to size returned in @nparams, or
+ * -1 in case of an error. Caller is responsible for deallocating @params.
+ */
+int
+virAdmConnectGetLockStats(virAdmConnectPtr conn,
+                          virTypedParameterPtr *params,
+                          int *nparams,
+                          unsigned int flags)
+{
+    int ret = -1;
+
+    VIR_DEBUG("conn=%p, params=%p, nparams=%p, flags=0x%x",
+              conn, params, nparams, flags);
+
+    virResetLastError();
+    virCheckAdmConnectReturn(conn, -1);
+    virCheckNonNullArgGoto(params, error);
+    virCheckNonNullArgGoto(nparams, error);
+
+    if ((ret = remoteAdminConnectGetLockStats(conn, params,
+                                              nparams, flags)) < 0)
+        goto error;
+
+    return ret;
+ error:
+    virDispatchError(NULL);
+    return -1;
+}
+
+/**
+ * virAdmConnectGetObjectStats:
+ * @conn: pointer to an active admin connection
+ * @params: pointer to statistics object
+ *          (return value, allocated automatically)
+ * @nparams: pointer to number of parameters returned in @params
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Retrieve the number of object instances the daemon has per object
+ * class, for classes with at least one instance. Some classes with
+ * frequently created instances keep instances which are no longer
+ * used in a pool for reuse, which is reported as well.
+ *
+ * The following parameters are returned:
+ *
+ *  "class.count" - number of classes reported as unsigned int
+ *  "class.<num>.name" - name of the class as string
+ *  "class.<num>.live" - number of instances in use as unsigned long long
+ *  "class.<num>.pooled" - number of instances kept for reuse as
+ *                         unsigned long long
+ *  "class.<num>.pool.max" - maximum number of instances kept for reuse,
+ *                           0 if the class does not pool instances, as
+ *                           unsigned long long
+ *  "class.<num>.reused" - number of instances taken from the pool instead
+ *                         of being allocated as unsigned long long
+ *
+ * Returns 0 on success, allocating @params to size returned in @nparams, or
+ * -1 in case of an error. Caller is responsible for deallocating @params.
+ */
+int
+virAdmConnectGetObjectStats(virAdmConnectPtr conn,
+                            virTypedParameterPtr *params,
+                            int *nparams,
+                            unsigned int flags)
+{
+    int ret = -1;
+
+    VIR_DEBUG("conn=%p, params=%p, nparams=%p, flags=0x%x",
+              conn, params, nparams, flags);
+
+    virResetLastError();
+    virCheckAdmConnectReturn(conn, -1);
+    virCheckNonNullArgGoto(params, error);
+    virCheckNonNullArgGoto(nparams, error);
+
+    if ((ret = remoteAdminConnectGetObjectStats(conn, params,
+                                                nparams, flags)) < 0)
+        goto error;
+
+    return ret;
+ error:
+    virDispatchError(NULL);
+    return -1;
+}
+
+/**
+ * virAdmConnectGetLogFileStats:
+ * @conn: pointer to an active admin connection
+ * @params: pointer to statistics object
+ *          (return value, allocated automatically)
+ * @nparams: pointer to number of parameters returned in @params
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Retrieve statistics about the rotated log files the daemon
+ * writes, which are the domain log files in case of virtlogd. Dividing
+ * the amount of data written by the interval between two calls gives
+ * the throughput, the backlog shows whether the daemon keeps up.
+ *
+ * The following parameters are returned:
+ *
+ *  "file.count" - number of files reported as unsigned int
+ *  "file.<num>.path" - path of the file as string
+ *  "file.<num>.bytes" - number of bytes written as unsigned long long
+ *  "file.<num>.writes" - number of write operations as unsigned long long
+ *  "file.<num>.spliced" - number of bytes moved to the file without being
+ *                         copied through the daemon as unsigned long long
+ *  "file.<num>.backlog" - number of bytes waiting to be written the last
+ *                         time the daemon looked as unsigned long long
+ *  "file.<num>.backlog.max" - largest backlog seen as unsigned long long
+ *
+ * Returns 0 on success, allocating @params to size returned in @nparams, or
+ * -1 in case of an error. Caller is responsible for deallocating @params.
+ */
+int
+virAdmConnectGetLogFileStats(virAdmConnectPtr conn,
+                             virTypedParameterPtr *params,
+                             int *nparams,
+                             unsigned int flags)
+{
+    int ret = -1;
+
+    VIR_DEBUG("conn=%p, params=%p, nparams=%p, flags=0x%x",
+              conn, params, nparams, flags);
+
+    virResetLastError();
+    virCheckAdmConnectReturn(conn, -1);
+    virCheckNonNullArgGoto(params, error);
+    virCheckNonNullArgGoto(nparams, error);
+
+    if ((ret = remoteAdminConnectGetLogFileStats(conn, params,
+                                                 nparams, flags)) < 0)
+        goto error;
+
+    return ret;
+ error:
+    virDispatchError(NULL);
+    return -1;
+}
+
+/**
+ * virAdmConnectGetLeaseStats:
+ * @conn: pointer to an active admin connection
+ * @params: pointer to statistics object
+ *          (return value, allocated automatically)
+ * @nparams: pointer to number of parameters returned in @params
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Retrieve statistics about the requests the daemon's hypervisor drivers
+ * made to their lock manager, e.g. sanlock or virtlockd, to acquire and
+ * release the leases of domains. The statistics are summed up over all
+ * domains since the daemon started, one entry per lock driver.
+ *
+ * The following parameters are returned:
+ *
+ *  "driver.count" - number of lock drivers reported as unsigned int
+ *  "driver.<num>.name" - name of the lock driver as string
+ *  "driver.<num>.acquires" - number of acquire requests as
+ *                            unsigned long long
+ *  "driver.<num>.acquire.failed" - number of failed acquire requests as
+ *                                  unsigned long long
+ *  "driver.<num>.acquire.busy" - number of acquire requests which failed
+ *                                because a lease was held elsewhere as
+ *                                unsigned long long
+ *  "driver.<num>.acquire.time" - total time spent acquiring leases in
+ *                                microseconds as unsigned long long
+ *  "driver.<num>.acquire.time.max" - longest acquire request in
+ *                                    microseconds as unsigned long long
+ *  "driver.<num>.releases" - number of release requests as
+ *                            unsigned long long
+ *  "driver.<num>.release.failed" - number of failed release requests as
+ *                                  unsigned long long
+ *  "driver.<num>.release.time" - total time spent releasing leases in
+ *                                microseconds as unsigned long long
+ *  "driver.<num>.release.time.max" - longest release request in
+ *                                    microseconds as unsigned long long
+ *
+ * Returns 0 on success, allocating @params to size returned in @nparams, or
+ * -1 in case of an error. Caller is responsible for deallocating @params.
+ */
+int
+virAdmConnectGetLeaseStats(virAdmConnectPtr conn,
+                           virTypedParameterPtr *params,
+                           int *nparams,
+                           unsigned int flags)
+{
+    int ret = -1;
+
+    VIR_DEBUG("conn=%p, params=%p, nparams=%p, flags=0x%x",
+              conn, params, nparams, flags);
+
+    virResetLastError();
+    virCheckAdmConnectReturn(conn, -1);
+    virCheckNonNullArgGoto(params, error);
+    virCheckNonNullArgGoto(nparams, error);
+
+    if ((ret = remoteAdminConnectGetLeaseStats(conn, params,
+                                               nparams, flags)) < 0)
+        goto error;
+
+    return ret;
+ error:
+    virDispatchError(NULL);
+    return -1;
+}
+
+/**
+ * virAdmServerGetStats:
+ * @srv: a valid server object reference
+ * @params: pointer to statistics object
+ *          (return value, allocated automatically)
+ * @nparams: pointer to number of parameters returned in @params
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Retrieve a snapshot of performance counters of the daemon running
+ * server @srv in a single call, meant to be polled periodically by
+ * monitoring tools. Counters are cumulative since the daemon started,
+ * times are in microseconds and sizes in bytes.
+ *
+ * The following parameters are returned:
+ *
+ *  "eventloop.latency.avg" - average delay of the main event loop in
+ *                            dispatching a ready event as
+ *                            unsigned long long
+ *  "eventloop.latency.max" - longest such delay as unsigned long long
+ *  "eventthread.count" - number of I/O event threads of @srv as
+ *                        unsigned int
+ *  "eventthread.<num>.latency.avg" - average dispatch delay of event
+ *                                    thread <num> as unsigned long long
+ *  "eventthread.<num>.latency.max" - longest dispatch delay of event
+ *                                    thread <num> as unsigned long long
+ *  "workers.queue.depth" - number of calls waiting for a worker of @srv
+ *                          as unsigned int
+ *  "workers.workers" - number of workers of @srv as unsigned int
+ *  "workers.workers.free" - number of idle workers of @srv as
+ *                           unsigned int
+ *  "workers.jobs" - number of calls picked up by workers as
+ *                   unsigned long long
+ *  "workers.wait.avg" - average time a call was queued as
+ *                       unsigned long long
+ *  "workers.wait.max" - longest time a call was queued as
+ *                       unsigned long long
+ *  "pool.count" - number of thread pools in the daemon, including the
+ *                 ones of all servers and drivers, as unsigned int
+ *  "pool.<num>.name" - name of the pool as string
+ *  "pool.<num>.queue.depth", "pool.<num>.workers",
+ *  "pool.<num>.workers.free", "pool.<num>.jobs", "pool.<num>.wait.avg",
+ *  "pool.<num>.wait.max" - same as the "workers." fields above
+ *  "client.count" - number of clients connected to @srv as unsigned int
+ *  "client.<num>.id" - ID of the client as unsigned long long
+ *  "client.<num>.bytes.received" - bytes received from the client as
+ *                                  unsigned long long
+ *  "client.<num>.bytes.sent" - bytes sent to the client as
+ *                              unsigned long long
+ *  "client.<num>.messages.received" - messages received from the client
+ *                                     as unsigned long long
+ *  "client.<num>.messages.sent" - messages sent to the client as
+ *                                 unsigned long long
+ *  "memory.heap.arena" - memory allocated by malloc from the system with
+ *                        sbrk as unsigned long long
+ *  "memory.heap.mmap" - memory allocated by malloc with mmap as
+ *                       unsigned long long
+ *  "memory.heap.used" - memory in use by allocations as
+ *                       unsigned long long
+ *  "memory.heap.free" - memory malloc keeps for reuse as
+ *                       unsigned long long
+ *  "memory.heap.releasable" - memory malloc could return to the system
+ *                             as unsigned long long
+ *
+ * The "memory.heap." fields are only reported if the daemon was built
+ * against a C library providing mallinfo2(). Hypervisor drivers loaded
+ * into the daemon add fields prefixed with "driver.<name>.", e.g. the
+ * QEMU driver reports
+ *
+ *  "driver.qemu.monitor.commands" - number of monitor commands as
+ *                                   unsigned long long
+ *  "driver.qemu.monitor.failed" - number of failed monitor commands as
+ *                                 unsigned long long
+ *  "driver.qemu.monitor.time.avg" - average time a monitor command took
+ *                                   as unsigned long long
+ *  "driver.qemu.monitor.time.max" - longest time a monitor command took
+ *                                   as unsigned long long
+ *  "driver.qemu.job.queued" - number of API calls waiting to get a job of
+ *                             a domain as unsigned long long
+ *  "driver.qemu.job.<job>.wait.count" - number of jobs started as unsigned
+ *                                       long long
+ *  "driver.qemu.job.<job>.wait.time.avg" - average time a job waited for
+ *                                          other jobs in microseconds as
+ *                                          unsigned long long
+ *  "driver.qemu.job.<job>.wait.time.max" - longest time a job waited for
+ *                                          other jobs in microseconds as
+ *                                          unsigned long long
+ *  "driver.qemu.start.count" - number of successful domain starts as
+ *                              unsigned long long
+ *  "driver.qemu.start.bucket.count" - number of histogram buckets as
+ *                                     unsigned int
+ *  "driver.qemu.start.bucket.<num>.limit" - upper limit of a bucket in
+ *                                           microseconds as unsigned long
+ *                                           long; the last bucket has no
+ *                                           limit
+ *  "driver.qemu.start.<phase>.time.total" - time spent in a phase by all
+ *                                           starts in microseconds as
+ *                                           unsigned long long
+ *  "driver.qemu.start.<phase>.time.avg" - average time spent in a phase in
+ *                                         microseconds as unsigned long long
+ *  "driver.qemu.start.<phase>.time.max" - longest time spent in a phase in
+ *                                         microseconds as unsigned long long
+ *  "driver.qemu.start.<phase>.bucket.<num>" - number of starts whose phase
+ *                                             fell into a bucket as
+ *                                             unsigned long long
+ *  "driver.polkit.cache.hits" - number of access checks answered from the
+ *                               cache of polkit decisions as unsigned long long
+ *  "driver.polkit.cache.misses" - number of access checks which had to ask
+ *                                 polkit as unsigned long long
+ *  "driver.polkit.cache.flushes" - number of times the cache was emptied,
+ *                                  e.g. because polkit policy changed, as
+ *                                  unsigned long long
+ *  "driver.polkit.cache.size" - number of cached decisions as
+ *                               unsigned long long
+ *
+ * where <job> is one of "query", "destroy", "suspend", "modify", "abort",
+ * "migration_op", "async", "async_nested" or "concurrent_query", the last
+ * one being monitor queries which don't wait for other jobs of a domain,
+ * e.g. gathering domain statistics, and <phase> is one of the phases
+ * reported by virDomainGetJobStats as VIR_DOMAIN_JOB_START_TIME_*, e.g.
+ * "storage" or "qmp_init".
+ *
+ * Returns 0 on success, allocating @params to size returned in @nparams, or
+ * -1 in case of an error. Caller is responsible for deallocating @params.
+ */
+int
+virAdmServerGetStats(virAdmServerPtr srv,
+                     virTypedParameterPtr *params,
+                     int *nparams,
+                     unsigned int flags)
+{
+    int ret = -1;
+
+    VIR_DEBUG("srv=%p, params=%p, nparams=%p, flags=0x%x",
+              srv, params, nparams, flags);
+    virResetLastError();
+
+    virCheckAdmServerGoto(srv, error);
+    virCheckNonNullArgGoto(params, error);
+    virCheckNonNullArgGoto(nparams, error);
+
+    if ((ret = remoteAdminServerGetStats(srv, params, nparams, flags)) < 0)
+        goto error;
+
+    return ret;
+ error:
+    virDispatchError(NULL);
+    return -1;
+}
+
+/**
+ * virAdmConnectStartProfiler:
+ * @conn: pointer to an active admin connection
+ * @duration: how long to profile the daemon, in seconds
+ * @file: filled with the path of the profile on the daemon's host
+ *        (allocated automatically)
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Starts sampling the stacks of the daemon's threads for @duration
+ * seconds, at most 300. Stacks are sampled 99 times per second of CPU
+ * time the daemon uses, so idle threads are not recorded. The API
+ * returns right away, the profile is written once the run is over to a
+ * new file in the "profiles" subdirectory of the daemon's runtime
+ * directory, whose path is stored into @file.
+ *
+ * The profile contains one line per distinct stack, starting with the
+ * name of the thread, e.g. "rpc-worker", followed by the functions from
+ * the outermost one, all separated by ';', and the number of samples.
+ * This is the format flame graph tools consume.
+ *
+ * Only one profiler run can be in progress at a time. Profiling is only
+ * supported on Linux.
+ *
+ * Returns 0 on success, -1 in case of an error. The caller is responsible
+ * for freeing @file.
+ */
+int
+virAdmConnectStartProfiler(virAdmConnectPtr conn,
+                           unsigned int duration,
+                           char **file,
+                           unsigned int flags)
+{
+    int ret = -1;
+
+    VIR_DEBUG("conn=%p, duration=%u, file=%p, flags=0x%x",
+              conn, duration, file, flags);
+
+    virResetLastError();
+    virCheckAdmConnectReturn(conn, -1);
+    virCheckNonNullArgGoto(file, error);
+
+    if ((ret = remoteAdminConnectStartProfiler(conn, duration,
+                                               file, flags)) < 0)
+        goto error;
+
+    return ret;
+ error:
+    virDispatchError(NULL);
+    return -1;
+}
@@ -207,7 +207,7 @@ virBhyveProcessStartImpl(bhyveConnPtr driver,
         goto cleanup;
     }
 
-    vm->def->id = vm->pid;
+    virDomainObjListSetID(driver->domains, vm, vm->pid);
     virDomainObjSetState(vm, VIR_DOMAIN_RUNNING, reason);
     priv->mon = bhyveMonitorOpen(vm, driver);
 
@@ -322,7 +322,7 @@ virBhyveProcessStop(bhyveConnPtr driver,
 
     virDomainObjSetState(vm, VIR_DOMAIN_SHUTOFF, reason);
     vm->pid = -1;
-    vm->def->id = -1;
+    virDomainObjListSetID(driver->domains, vm, -1);
 
     bhyveProcessStopHook(vm, VIR_HOOK_BHYVE_OP_RELEASE);
 
@@ -460,7 +460,7 @@ virBhyveProcessReconnect(virDomainObjPtr vm,
          * its PID, then we clear information about the PID and
          * set state to 'shutdown' */
         vm->pid = 0;
-        vm->def->id = -1;
+        virDomainObjListSetID(data->driver->domains, vm, -1);
         virDomainObjSetState(vm, VIR_DOMAIN_SHUTOFF,
                              VIR_DOMAIN_SHUTOFF_UNKNOWN);
         ignore_value(virDomainObjSave(vm, data->driver->xmlopt,
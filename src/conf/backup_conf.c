@@ -107,6 +107,7 @@ virDomainBackupDiskDefParseXML(xmlNodePtr node,
     g_autofree char *driver = NULL;
     g_autofree char *backup = NULL;
     g_autofree char *state = NULL;
+    g_autofree char *queued = NULL;
     g_autofree char *backupmode = NULL;
     int tmp;
     xmlNodePtr srcNode;
@@ -167,6 +168,14 @@ virDomainBackupDiskDefParseXML(xmlNodePtr node,
         }
 
         def->state = tmp;
+
+        if ((queued = virXMLPropString(node, "queued")) &&
+            virStrToLong_uip(queued, NULL, 10, &def->queued) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("invalid queue position '%s' of disk '%s'"),
+                           queued, def->name);
+            return -1;
+        }
     }
 
     if (!(def->store = virStorageSourceNew()))
@@ -393,6 +402,8 @@ virDomainBackupDiskDefFormat(virBufferPtr buf,
     virBufferAsprintf(&attrBuf, " backup='%s'", virTristateBoolTypeToString(disk->backup));
     if (internal && disk->state != VIR_DOMAIN_BACKUP_DISK_STATE_NONE)
         virBufferAsprintf(&attrBuf, " state='%s'", virDomainBackupDiskStateTypeToString(disk->state));
+    if (internal && disk->queued > 0)
+        virBufferAsprintf(&attrBuf, " queued='%u'", disk->queued);
 
     if (disk->backup == VIR_TRISTATE_BOOL_YES) {
         virBufferAsprintf(&attrBuf, " type='%s'", virStorageTypeToString(disk->store->type));
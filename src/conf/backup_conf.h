@@ -71,6 +71,8 @@ struct _virDomainBackupDiskDef {
 
     /* internal data */
     virDomainBackupDiskState state;
+    unsigned int queued; /* position in the queue of paused jobs, 0 if the
+                            job isn't queued */
 };
 
 /* Stores the complete backup metadata */
@@ -598,28 +598,71 @@ virDomainPCIAddressBusSetModel(virDomainPCIAddressBusPtr bus,
 bool
 virDomainPCIAddressBusIsFullyReserved(virDomainPCIAddressBusPtr bus)
 {
-    size_t i;
-
-    for (i = bus->minSlot; i <= bus->maxSlot; i++) {
-        if (!bus->slot[i].functions)
-            return false;
-    }
-
-    return true;
+    return bus->nusedSlots > bus->maxSlot - bus->minSlot;
 }
 
 
 static bool ATTRIBUTE_NONNULL(1)
 virDomainPCIAddressBusIsEmpty(virDomainPCIAddressBusPtr bus)
 {
-    size_t i;
+    return bus->nusedSlots == 0;
+}
 
-    for (i = bus->minSlot; i <= bus->maxSlot; i++) {
-        if (bus->slot[i].functions)
-            return false;
+
+/*
+ * Update the bookkeeping of used slots after the first function of
+ * a slot was reserved or the last one released.
+ */
+static void
+virDomainPCIAddressSetSlotChanged(virDomainPCIAddressSetPtr addrs,
+                                  virPCIDeviceAddressPtr addr)
+{
+    virDomainPCIAddressBusPtr bus = &addrs->buses[addr->bus];
+
+    if (bus->slot[addr->slot].functions) {
+        bus->nusedSlots++;
+
+        if (bus->freeSlotHint < bus->minSlot)
+            bus->freeSlotHint = bus->minSlot;
+        while (bus->freeSlotHint <= bus->maxSlot &&
+               bus->slot[bus->freeSlotHint].functions)
+            bus->freeSlotHint++;
+
+        if (virDomainPCIAddressBusIsFullyReserved(bus))
+            ignore_value(virBitmapSetBitExpand(addrs->fullBuses, addr->bus));
+    } else {
+        bus->nusedSlots--;
+
+        if (addr->slot < bus->freeSlotHint)
+            bus->freeSlotHint = addr->slot;
+
+        ignore_value(virBitmapClearBit(addrs->fullBuses, addr->bus));
     }
+}
 
-    return true;
+
+/*
+ * Returns the index of the first bus starting from @busIdx which is
+ * worth looking at for a device with connect @flags, or addrs->nbuses
+ * if there is none. Fully reserved buses are skipped unless the device
+ * can share a slot with other devices.
+ */
+static unsigned int
+virDomainPCIAddressSetNextBus(virDomainPCIAddressSetPtr addrs,
+                              unsigned int busIdx,
+                              virDomainPCIConnectFlags flags)
+{
+    ssize_t next;
+
+    if (!(flags & VIR_PCI_CONNECT_AGGREGATE_SLOT)) {
+        /* buses beyond the end of the bitmap were never full */
+        next = virBitmapNextClearBit(addrs->fullBuses, (ssize_t) busIdx - 1);
+        if (next < 0)
+            next = virBitmapSize(addrs->fullBuses);
+        busIdx = MAX(busIdx, next);
+    }
+
+    return MIN(busIdx, addrs->nbuses);
 }
 
 
@@ -877,6 +920,8 @@ virDomainPCIAddressReserveAddrInternal(virDomainPCIAddressSetPtr addrs,
 
     /* mark the requested function as reserved */
     bus->slot[addr->slot].functions |= (1 << addr->function);
+    if (bus->slot[addr->slot].functions == (1 << addr->function))
+        virDomainPCIAddressSetSlotChanged(addrs, addr);
     VIR_DEBUG("Reserving PCI address %s (aggregate='%s')", addrStr,
               bus->slot[addr->slot].aggregate ? "true" : "false");
 
@@ -961,7 +1006,14 @@ void
 virDomainPCIAddressReleaseAddr(virDomainPCIAddressSetPtr addrs,
                                virPCIDeviceAddressPtr addr)
 {
-    addrs->buses[addr->bus].slot[addr->slot].functions &= ~(1 << addr->function);
+    virDomainPCIAddressSlot *slot = &addrs->buses[addr->bus].slot[addr->slot];
+
+    if (!(slot->functions & (1 << addr->function)))
+        return;
+
+    slot->functions &= ~(1 << addr->function);
+    if (!slot->functions)
+        virDomainPCIAddressSetSlotChanged(addrs, addr);
 }
 
 
@@ -1061,6 +1113,7 @@ virDomainPCIAddressSetAlloc(unsigned int nbuses,
         goto error;
 
     addrs->nbuses = nbuses;
+    addrs->fullBuses = virBitmapNewEmpty();
 
     if (virDomainPCIAddressSetExtensionAlloc(addrs, extFlags) < 0)
         goto error;
@@ -1080,6 +1133,7 @@ virDomainPCIAddressSetFree(virDomainPCIAddressSetPtr addrs)
         return;
 
     virDomainPCIAddressSetExtensionFree(addrs);
+    virBitmapFree(addrs->fullBuses);
     VIR_FREE(addrs->buses);
     VIR_FREE(addrs);
 }
@@ -1092,18 +1146,20 @@ virDomainPCIAddressFindUnusedFunctionOnBus(virDomainPCIAddressBusPtr bus,
                                            virDomainPCIConnectFlags flags,
                                            bool *found)
 {
-    g_autofree char *addrStr = NULL;
-
     *found = false;
 
-    if (!(addrStr = virPCIDeviceAddressAsString(searchAddr)))
-        return -1;
-
-    if (!virDomainPCIAddressFlagsCompatible(searchAddr, addrStr, bus->flags,
+    /* the address string is used for error reporting only */
+    if (!virDomainPCIAddressFlagsCompatible(searchAddr, NULL, bus->flags,
                                             flags, false, false)) {
         VIR_DEBUG("PCI bus %04x:%02x is not compatible with the device",
                   searchAddr->domain, searchAddr->bus);
     } else {
+        /* unless the device can share a slot, only completely unused
+         * slots will do and there are none before the hint */
+        if (!(flags & VIR_PCI_CONNECT_AGGREGATE_SLOT) &&
+            searchAddr->slot < bus->freeSlotHint)
+            searchAddr->slot = bus->freeSlotHint;
+
         while (searchAddr->slot <= bus->maxSlot) {
             if (bus->slot[searchAddr->slot].functions == 0) {
                 *found = true;
@@ -1171,7 +1227,9 @@ virDomainPCIAddressGetNextAddr(virDomainPCIAddressSetPtr addrs,
      * very strict and ignoring all those where the isolation groups
      * don't match. This ensures all devices sharing the same isolation
      * group will end up on the same bus */
-    for (a.bus = 0; a.bus < addrs->nbuses; a.bus++) {
+    for (a.bus = virDomainPCIAddressSetNextBus(addrs, 0, flags);
+         a.bus < addrs->nbuses;
+         a.bus = virDomainPCIAddressSetNextBus(addrs, a.bus + 1, flags)) {
         virDomainPCIAddressBusPtr bus = &addrs->buses[a.bus];
         bool found = false;
 
@@ -1192,7 +1250,9 @@ virDomainPCIAddressGetNextAddr(virDomainPCIAddressSetPtr addrs,
     /* We haven't been able to find a perfectly matching bus, but we
      * might still be able to make this work by altering the isolation
      * group for a bus that's currently empty. So let's try that */
-    for (a.bus = 0; a.bus < addrs->nbuses; a.bus++) {
+    for (a.bus = virDomainPCIAddressSetNextBus(addrs, 0, flags);
+         a.bus < addrs->nbuses;
+         a.bus = virDomainPCIAddressSetNextBus(addrs, a.bus + 1, flags)) {
         virDomainPCIAddressBusPtr bus = &addrs->buses[a.bus];
         bool found = false;
 
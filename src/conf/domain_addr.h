@@ -106,6 +106,13 @@ typedef struct {
      */
     virDomainPCIAddressSlot slot[VIR_PCI_ADDRESS_SLOT_LAST + 1];
 
+    /* number of slots with at least one function in use */
+    size_t nusedSlots;
+    /* all slots from minSlot up to (but not including) this one have
+     * at least one function in use, searching for a completely unused
+     * slot can start here */
+    size_t freeSlotHint;
+
     /* See virDomainDeviceInfo::isolationGroup */
     unsigned int isolationGroup;
 
@@ -123,6 +130,8 @@ typedef virDomainZPCIAddressIds *virDomainZPCIAddressIdsPtr;
 struct _virDomainPCIAddressSet {
     virDomainPCIAddressBus *buses;
     size_t nbuses;
+    /* buses which have no completely unused slot left */
+    virBitmapPtr fullBuses;
     bool dryRun;          /* on a dry run, new buses are auto-added
                              and addresses aren't saved in device infos */
     /* If true, the guest can have multiple pci-root controllers */
@@ -54,6 +54,7 @@
 #include "virtpm.h"
 #include "virsecret.h"
 #include "virstring.h"
+#include "virstringintern.h"
 #include "virnetdev.h"
 #include "virnetdevtap.h"
 #include "virnetdevmacvlan.h"
@@ -62,6 +63,7 @@
 #include "virdomainsnapshotobjlist.h"
 #include "virdomaincheckpointobjlist.h"
 #include "virutil.h"
+#include "virthreadpool.h"
 
 #define VIR_FROM_THIS VIR_FROM_DOMAIN
 
@@ -1144,6 +1146,7 @@ VIR_ENUM_IMPL(virDomainCpuPlacementMode,
               VIR_DOMAIN_CPU_PLACEMENT_MODE_LAST,
               "static",
               "auto",
+              "topology",
 );
 
 VIR_ENUM_IMPL(virDomainDiskTray,
@@ -1217,6 +1220,14 @@ VIR_ENUM_IMPL(virDomainDiskDetectZeroes,
               "unmap",
 );
 
+VIR_ENUM_IMPL(virDomainDiskLatencyHistogram,
+              VIR_DOMAIN_DISK_LATENCY_HISTOGRAM_LAST,
+              "default",
+              "read",
+              "write",
+              "flush",
+);
+
 VIR_ENUM_IMPL(virDomainDiskModel,
               VIR_DOMAIN_DISK_MODEL_LAST,
               "default",
@@ -1339,8 +1350,10 @@ VIR_ENUM_IMPL(virDomainLaunchSecurity,
 );
 
 static virClassPtr virDomainObjClass;
+static virClassPtr virDomainObjSummaryClass;
 static virClassPtr virDomainXMLOptionClass;
 static void virDomainObjDispose(void *obj);
+static void virDomainObjSummaryDispose(void *obj);
 static void virDomainXMLOptionDispose(void *obj);
 
 static int virDomainObjOnceInit(void)
@@ -1348,6 +1361,9 @@ static int virDomainObjOnceInit(void)
     if (!VIR_CLASS_NEW(virDomainObj, virClassForObjectLockable()))
         return -1;
 
+    if (!VIR_CLASS_NEW(virDomainObjSummary, virClassForObject()))
+        return -1;
+
     if (!VIR_CLASS_NEW(virDomainXMLOption, virClassForObject()))
         return -1;
 
@@ -2195,6 +2211,8 @@ virDomainDiskDefNew(virDomainXMLOptionPtr xmlopt)
 void
 virDomainDiskDefFree(virDomainDiskDefPtr def)
 {
+    size_t i;
+
     if (!def)
         return;
 
@@ -2203,12 +2221,14 @@ virDomainDiskDefFree(virDomainDiskDefPtr def)
     VIR_FREE(def->dst);
     virObjectUnref(def->mirror);
     VIR_FREE(def->wwn);
-    VIR_FREE(def->driverName);
+    virStringInternRelease(def->driverName);
     VIR_FREE(def->vendor);
     VIR_FREE(def->product);
     VIR_FREE(def->domain_name);
     VIR_FREE(def->blkdeviotune.group_name);
     VIR_FREE(def->virtio);
+    for (i = 0; i < VIR_DOMAIN_DISK_LATENCY_HISTOGRAM_LAST; i++)
+        VIR_FREE(def->latencyHistograms[i].bins);
     virDomainDeviceInfoClear(&def->info);
     virObjectUnref(def->privateData);
 
@@ -2270,8 +2290,8 @@ virDomainDiskGetDriver(const virDomainDiskDef *def)
 int
 virDomainDiskSetDriver(virDomainDiskDefPtr def, const char *name)
 {
-    char *tmp = g_strdup(name);
-    g_free(def->driverName);
+    char *tmp = virStringIntern(name);
+    virStringInternRelease(def->driverName);
     def->driverName = tmp;
     return 0;
 }
@@ -3384,6 +3404,7 @@ virDomainResctrlDefFree(virDomainResctrlDefPtr resctrl)
     virObjectUnref(resctrl->alloc);
     virBitmapFree(resctrl->vcpus);
     VIR_FREE(resctrl->monitors);
+    VIR_FREE(resctrl->targets);
     VIR_FREE(resctrl);
 }
 
@@ -3509,7 +3530,7 @@ void virDomainDefFree(virDomainDefPtr def)
     VIR_FREE(def->idmap.uidmap);
     VIR_FREE(def->idmap.gidmap);
 
-    VIR_FREE(def->os.machine);
+    virStringInternRelease(def->os.machine);
     VIR_FREE(def->os.init);
     for (i = 0; def->os.initargv && def->os.initargv[i]; i++)
         VIR_FREE(def->os.initargv[i]);
@@ -3537,7 +3558,7 @@ void virDomainDefFree(virDomainDefPtr def)
 
     VIR_FREE(def->name);
     virBitmapFree(def->cpumask);
-    VIR_FREE(def->emulator);
+    virStringInternRelease(def->emulator);
     VIR_FREE(def->description);
     VIR_FREE(def->title);
     VIR_FREE(def->hyperv_vendor_id);
@@ -3565,6 +3586,7 @@ void virDomainDefFree(virDomainDefPtr def)
     virDomainIOThreadIDDefArrayFree(def->iothreadids, def->niothreadids);
 
     virBitmapFree(def->cputune.emulatorpin);
+    virBitmapFree(def->cputune.helperpin);
     VIR_FREE(def->cputune.emulatorsched);
 
     virDomainNumaFree(def->numa);
@@ -3601,6 +3623,8 @@ static void virDomainObjDispose(void *obj)
 
     VIR_DEBUG("obj=%p", dom);
     virCondDestroy(&dom->cond);
+    virObjectUnref(dom->summary);
+    virRWLockDestroy(&dom->summaryLock);
     virDomainDefFree(dom->def);
     virDomainDefFree(dom->newDef);
 
@@ -3628,6 +3652,12 @@ virDomainObjNew(virDomainXMLOptionPtr xmlopt)
         goto error;
     }
 
+    if (virRWLockInit(&domain->summaryLock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("failed to initialize domain summary lock"));
+        goto error;
+    }
+
     if (xmlopt->privateData.alloc) {
         domain->privateData = (xmlopt->privateData.alloc)(xmlopt->config.priv);
         if (!domain->privateData)
@@ -3641,6 +3671,8 @@ virDomainObjNew(virDomainXMLOptionPtr xmlopt)
     if (!(domain->checkpoints = virDomainCheckpointObjListNew()))
         goto error;
 
+    domain->indexedID = -1;
+
     virObjectLock(domain);
     virDomainObjSetState(domain, VIR_DOMAIN_SHUTOFF,
                                  VIR_DOMAIN_SHUTOFF_UNKNOWN);
@@ -3706,6 +3738,8 @@ void virDomainObjAssignDef(virDomainObjPtr domain,
             domain->def = def;
         }
     }
+
+    virDomainObjUpdateSummary(domain);
 }
 
 
@@ -7455,16 +7489,16 @@ virDomainVirtioOptionsFormat(virBufferPtr buf,
         return;
 
     if (virtio->iommu != VIR_TRISTATE_SWITCH_ABSENT) {
-        virBufferAsprintf(buf, " iommu='%s'",
-                          virTristateSwitchTypeToString(virtio->iommu));
+        virBufferAddAttr(buf, "iommu",
+                         virTristateSwitchTypeToString(virtio->iommu));
     }
     if (virtio->ats != VIR_TRISTATE_SWITCH_ABSENT) {
-        virBufferAsprintf(buf, " ats='%s'",
-                          virTristateSwitchTypeToString(virtio->ats));
+        virBufferAddAttr(buf, "ats",
+                         virTristateSwitchTypeToString(virtio->ats));
     }
     if (virtio->packed != VIR_TRISTATE_SWITCH_ABSENT) {
-        virBufferAsprintf(buf, " packed='%s'",
-                          virTristateSwitchTypeToString(virtio->packed));
+        virBufferAddAttr(buf, "packed",
+                         virTristateSwitchTypeToString(virtio->packed));
     }
 }
 
@@ -7478,20 +7512,22 @@ virDomainDeviceInfoFormat(virBufferPtr buf,
     g_auto(virBuffer) childBuf = VIR_BUFFER_INIT_CHILD(buf);
 
     if ((flags & VIR_DOMAIN_DEF_FORMAT_ALLOW_BOOT) && info->bootIndex) {
-        virBufferAsprintf(buf, "<boot order='%u'", info->bootIndex);
-
-        if (info->loadparm)
-            virBufferAsprintf(buf, " loadparm='%s'", info->loadparm);
-
+        virBufferAddLit(buf, "<boot");
+        virBufferAddAttrULLong(buf, "order", info->bootIndex);
+        virBufferAddAttr(buf, "loadparm", info->loadparm);
         virBufferAddLit(buf, "/>\n");
     }
 
-    if (info->alias)
-        virBufferAsprintf(buf, "<alias name='%s'/>\n", info->alias);
+    if (info->alias) {
+        virBufferAddLit(buf, "<alias");
+        virBufferAddAttr(buf, "name", info->alias);
+        virBufferAddLit(buf, "/>\n");
+    }
 
     if (info->mastertype == VIR_DOMAIN_CONTROLLER_MASTER_USB) {
-        virBufferAsprintf(buf, "<master startport='%d'/>\n",
-                          info->master.usb.startport);
+        virBufferAddLit(buf, "<master");
+        virBufferAddAttrULLong(buf, "startport", info->master.usb.startport);
+        virBufferAddLit(buf, "/>\n");
     }
 
     if ((flags & VIR_DOMAIN_DEF_FORMAT_ALLOW_ROM) &&
@@ -7501,19 +7537,14 @@ virDomainDeviceInfoFormat(virBufferPtr buf,
 
         virBufferAddLit(buf, "<rom");
         if (info->romenabled != VIR_TRISTATE_BOOL_ABSENT) {
-            const char *romenabled = virTristateBoolTypeToString(info->romenabled);
-
-            if (romenabled)
-                virBufferAsprintf(buf, " enabled='%s'", romenabled);
+            virBufferAddAttr(buf, "enabled",
+                             virTristateBoolTypeToString(info->romenabled));
         }
         if (info->rombar != VIR_TRISTATE_SWITCH_ABSENT) {
-            const char *rombar = virTristateSwitchTypeToString(info->rombar);
-
-            if (rombar)
-                virBufferAsprintf(buf, " bar='%s'", rombar);
+            virBufferAddAttr(buf, "bar",
+                             virTristateSwitchTypeToString(info->rombar));
         }
-        if (info->romfile)
-            virBufferEscapeString(buf, " file='%s'", info->romfile);
+        virBufferEscapeAttr(buf, "file", info->romfile);
         virBufferAddLit(buf, "/>\n");
     }
 
@@ -7522,8 +7553,8 @@ virDomainDeviceInfoFormat(virBufferPtr buf,
         /* We're done here */
         return 0;
 
-    virBufferAsprintf(&attrBuf, " type='%s'",
-                      virDomainDeviceAddressTypeToString(info->type));
+    virBufferAddAttr(&attrBuf, "type",
+                     virDomainDeviceAddressTypeToString(info->type));
 
     switch ((virDomainDeviceAddressType) info->type) {
     case VIR_DOMAIN_DEVICE_ADDRESS_TYPE_PCI:
@@ -7536,8 +7567,8 @@ virDomainDeviceInfoFormat(virBufferPtr buf,
                               info->addr.pci.function);
         }
         if (info->addr.pci.multi) {
-            virBufferAsprintf(&attrBuf, " multifunction='%s'",
-                              virTristateSwitchTypeToString(info->addr.pci.multi));
+            virBufferAddAttr(&attrBuf, "multifunction",
+                             virTristateSwitchTypeToString(info->addr.pci.multi));
         }
 
         if (virZPCIDeviceAddressIsPresent(&info->addr.pci.zpci)) {
@@ -7549,28 +7580,28 @@ virDomainDeviceInfoFormat(virBufferPtr buf,
         break;
 
     case VIR_DOMAIN_DEVICE_ADDRESS_TYPE_DRIVE:
-        virBufferAsprintf(&attrBuf, " controller='%d' bus='%d' target='%d' unit='%d'",
-                          info->addr.drive.controller,
-                          info->addr.drive.bus,
-                          info->addr.drive.target,
-                          info->addr.drive.unit);
+        virBufferAddAttrULLong(&attrBuf, "controller",
+                               info->addr.drive.controller);
+        virBufferAddAttrULLong(&attrBuf, "bus", info->addr.drive.bus);
+        virBufferAddAttrULLong(&attrBuf, "target", info->addr.drive.target);
+        virBufferAddAttrULLong(&attrBuf, "unit", info->addr.drive.unit);
         break;
 
     case VIR_DOMAIN_DEVICE_ADDRESS_TYPE_VIRTIO_SERIAL:
-        virBufferAsprintf(&attrBuf, " controller='%d' bus='%d' port='%d'",
-                          info->addr.vioserial.controller,
-                          info->addr.vioserial.bus,
-                          info->addr.vioserial.port);
+        virBufferAddAttrULLong(&attrBuf, "controller",
+                               info->addr.vioserial.controller);
+        virBufferAddAttrULLong(&attrBuf, "bus", info->addr.vioserial.bus);
+        virBufferAddAttrULLong(&attrBuf, "port", info->addr.vioserial.port);
         break;
 
     case VIR_DOMAIN_DEVICE_ADDRESS_TYPE_CCID:
-        virBufferAsprintf(&attrBuf, " controller='%d' slot='%d'",
-                          info->addr.ccid.controller,
-                          info->addr.ccid.slot);
+        virBufferAddAttrULLong(&attrBuf, "controller",
+                               info->addr.ccid.controller);
+        virBufferAddAttrULLong(&attrBuf, "slot", info->addr.ccid.slot);
         break;
 
     case VIR_DOMAIN_DEVICE_ADDRESS_TYPE_USB:
-        virBufferAsprintf(&attrBuf, " bus='%d'", info->addr.usb.bus);
+        virBufferAddAttrULLong(&attrBuf, "bus", info->addr.usb.bus);
         if (virDomainUSBAddressPortIsValid(info->addr.usb.port)) {
             virBufferAddLit(&attrBuf, " port='");
             virDomainUSBAddressPortFormatBuf(&attrBuf, info->addr.usb.port);
@@ -7601,7 +7632,7 @@ virDomainDeviceInfoFormat(virBufferPtr buf,
         break;
 
     case VIR_DOMAIN_DEVICE_ADDRESS_TYPE_DIMM:
-        virBufferAsprintf(&attrBuf, " slot='%u'", info->addr.dimm.slot);
+        virBufferAddAttrULLong(&attrBuf, "slot", info->addr.dimm.slot);
         if (info->addr.dimm.base)
             virBufferAsprintf(&attrBuf, " base='0x%llx'", info->addr.dimm.base);
 
@@ -9427,7 +9458,7 @@ virDomainDiskSourcePoolDefParse(xmlNodePtr node,
     if (VIR_ALLOC(source) < 0)
         return -1;
 
-    source->pool = virXMLPropString(node, "pool");
+    source->pool = virStringInternTake(virXMLPropString(node, "pool"));
     source->volume = virXMLPropString(node, "volume");
     mode = virXMLPropString(node, "mode");
 
@@ -10291,13 +10322,99 @@ virDomainDiskDefParseValidate(const virDomainDiskDef *def)
 }
 
 
+static int
+virDomainDiskLatencyHistogramParseXML(virDomainDiskDefPtr def,
+                                      xmlNodePtr node)
+{
+    g_autofree char *type = virXMLPropString(node, "type");
+    virDomainDiskLatencyHistogramPtr hist;
+    xmlNodePtr cur;
+    int histtype = VIR_DOMAIN_DISK_LATENCY_HISTOGRAM_DEFAULT;
+
+    if (type &&
+        (histtype = virDomainDiskLatencyHistogramTypeFromString(type)) <= 0) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                       _("unknown latency histogram type '%s'"), type);
+        return -1;
+    }
+
+    hist = def->latencyHistograms + histtype;
+
+    if (hist->nbins > 0) {
+        virReportError(VIR_ERR_XML_ERROR,
+                       _("latency histogram of type '%s' specified more than once"),
+                       virDomainDiskLatencyHistogramTypeToString(histtype));
+        return -1;
+    }
+
+    for (cur = node->children; cur; cur = cur->next) {
+        g_autofree char *start = NULL;
+        unsigned long long val;
+
+        if (!virXMLNodeNameEqual(cur, "bin"))
+            continue;
+
+        if (!(start = virXMLPropString(cur, "start")) ||
+            virStrToLong_ullp(start, NULL, 10, &val) < 0) {
+            virReportError(VIR_ERR_XML_ERROR,
+                           _("invalid or missing latency histogram bin start '%s'"),
+                           NULLSTR(start));
+            return -1;
+        }
+
+        if (hist->nbins == VIR_DOMAIN_DISK_LATENCY_HISTOGRAM_BINS_MAX) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                           _("latency histogram can't have more than %d bins"),
+                           VIR_DOMAIN_DISK_LATENCY_HISTOGRAM_BINS_MAX);
+            return -1;
+        }
+
+        if ((hist->nbins == 0 && val != 0) ||
+            (hist->nbins > 0 && val <= hist->bins[hist->nbins - 1])) {
+            virReportError(VIR_ERR_XML_ERROR, "%s",
+                           _("latency histogram bins must start at 0 and be "
+                             "in increasing order"));
+            return -1;
+        }
+
+        if (VIR_APPEND_ELEMENT(hist->bins, hist->nbins, val) < 0)
+            return -1;
+    }
+
+    if (hist->nbins < 2) {
+        virReportError(VIR_ERR_XML_ERROR, "%s",
+                       _("latency histogram needs at least two bins"));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+virDomainDiskDefDriverStatisticsParseXML(virDomainDiskDefPtr def,
+                                         xmlNodePtr node)
+{
+    xmlNodePtr cur;
+
+    for (cur = node->children; cur; cur = cur->next) {
+        if (virXMLNodeNameEqual(cur, "latency-histogram") &&
+            virDomainDiskLatencyHistogramParseXML(def, cur) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 virDomainDiskDefDriverParseXML(virDomainDiskDefPtr def,
                                xmlNodePtr cur)
 {
     g_autofree char *tmp = NULL;
+    xmlNodePtr child;
 
-    def->driverName = virXMLPropString(cur, "name");
+    def->driverName = virStringInternTake(virXMLPropString(cur, "name"));
 
     if ((tmp = virXMLPropString(cur, "cache")) &&
         (def->cachemode = virDomainDiskCacheTypeFromString(tmp)) < 0) {
@@ -10405,6 +10522,12 @@ virDomainDiskDefDriverParseXML(virDomainDiskDefPtr def,
         return -1;
     }
 
+    for (child = cur->children; child; child = child->next) {
+        if (virXMLNodeNameEqual(child, "statistics") &&
+            virDomainDiskDefDriverStatisticsParseXML(def, child) < 0)
+            return -1;
+    }
+
     return 0;
 }
 
@@ -11968,6 +12091,8 @@ virDomainNetDefParseXML(virDomainXMLOptionPtr xmlopt,
     g_autofree char *queues = NULL;
     g_autofree char *rx_queue_size = NULL;
     g_autofree char *tx_queue_size = NULL;
+    g_autofree char *rss = NULL;
+    g_autofree char *rss_hash_report = NULL;
     g_autofree char *str = NULL;
     g_autofree char *filter = NULL;
     g_autofree char *internal = NULL;
@@ -12146,6 +12271,8 @@ virDomainNetDefParseXML(virDomainXMLOptionPtr xmlopt,
                 queues = virXMLPropString(cur, "queues");
                 rx_queue_size = virXMLPropString(cur, "rx_queue_size");
                 tx_queue_size = virXMLPropString(cur, "tx_queue_size");
+                rss = virXMLPropString(cur, "rss");
+                rss_hash_report = virXMLPropString(cur, "rss_hash_report");
 
                 if (virDomainVirtioOptionsParseXML(cur, &def->virtio) < 0)
                     goto error;
@@ -12572,6 +12699,24 @@ virDomainNetDefParseXML(virDomainXMLOptionPtr xmlopt,
             }
             def->driver.virtio.tx_queue_size = q;
         }
+        if (rss) {
+            if ((val = virTristateSwitchTypeFromString(rss)) <= 0) {
+                virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                               _("unknown interface rss mode '%s'"),
+                               rss);
+                goto error;
+            }
+            def->driver.virtio.rss = val;
+        }
+        if (rss_hash_report) {
+            if ((val = virTristateSwitchTypeFromString(rss_hash_report)) <= 0) {
+                virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                               _("unknown interface rss_hash_report mode '%s'"),
+                               rss_hash_report);
+                goto error;
+            }
+            def->driver.virtio.rss_hash_report = val;
+        }
 
         if ((tmpNode = virXPathNode("./driver/host", ctxt))) {
             if ((str = virXMLPropString(tmpNode, "csum"))) {
@@ -15270,6 +15415,7 @@ virDomainMemballoonDefParseXML(virDomainXMLOptionPtr xmlopt,
     unsigned int period = 0;
     g_autofree char *model = NULL;
     g_autofree char *deflate = NULL;
+    g_autofree char *reporting = NULL;
 
     if (VIR_ALLOC(def) < 0)
         return NULL;
@@ -15294,6 +15440,14 @@ virDomainMemballoonDefParseXML(virDomainXMLOptionPtr xmlopt,
         goto error;
     }
 
+    if ((reporting = virXMLPropString(node, "freePageReporting")) &&
+        (def->free_page_reporting = virTristateSwitchTypeFromString(reporting)) <= 0) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                       _("invalid freePageReporting attribute value '%s'"),
+                       reporting);
+        goto error;
+    }
+
     ctxt->node = node;
     if (virXPathUInt("string(./stats/@period)", ctxt, &period) < -1) {
         virReportError(VIR_ERR_XML_ERROR, "%s",
@@ -15305,6 +15459,31 @@ virDomainMemballoonDefParseXML(virDomainXMLOptionPtr xmlopt,
     if (def->period < 0)
         def->period = 0;
 
+    if (virXPathNode("./overcommit", ctxt)) {
+        def->overcommit = true;
+
+        if (virDomainParseMemory("./overcommit/@min", "./overcommit/@unit",
+                                 ctxt, &def->overcommit_min, false, true) < 0 ||
+            virDomainParseMemory("./overcommit/@max", "./overcommit/@unit",
+                                 ctxt, &def->overcommit_max, false, true) < 0)
+            goto error;
+
+        if (virXPathUInt("string(./overcommit/@priority)", ctxt,
+                         &def->overcommit_priority) < -1) {
+            virReportError(VIR_ERR_XML_ERROR, "%s",
+                           _("invalid memory overcommit priority"));
+            goto error;
+        }
+
+        if (def->overcommit_max &&
+            def->overcommit_min > def->overcommit_max) {
+            virReportError(VIR_ERR_XML_ERROR, "%s",
+                           _("minimum memory of overcommit can't be larger "
+                             "than its maximum"));
+            goto error;
+        }
+    }
+
     if (def->model == VIR_DOMAIN_MEMBALLOON_MODEL_NONE)
         VIR_DEBUG("Ignoring device address for none model Memballoon");
     else if (virDomainDeviceInfoParseXML(xmlopt, node,
@@ -18728,20 +18907,18 @@ virDomainVsockDefEquals(const virDomainVsockDef *a,
 }
 
 
+/* The returned string is interned, see virStringIntern */
 char *
 virDomainDefGetDefaultEmulator(virDomainDefPtr def,
                                virCapsPtr caps)
 {
-    char *retemu;
     g_autofree virCapsDomainDataPtr capsdata = NULL;
 
     if (!(capsdata = virCapabilitiesDomainDataLookup(caps, def->os.type,
             def->os.arch, def->virtType, NULL, NULL)))
         return NULL;
 
-    retemu = g_strdup(capsdata->emulator);
-
-    return retemu;
+    return virStringIntern(capsdata->emulator);
 }
 
 static int
@@ -19102,7 +19279,7 @@ virDomainIOThreadPinDefParseXML(xmlNodePtr node,
 }
 
 
-/* Parse the XML definition for emulatorpin.
+/* Parse the XML definition for emulatorpin or helperpin.
  * emulatorpin has the form of
  *   <emulatorpin cpuset='0'/>
  */
@@ -19113,8 +19290,8 @@ virDomainEmulatorPinDefParseXML(xmlNodePtr node)
     g_autoptr(virBitmap) def = NULL;
 
     if (!(tmp = virXMLPropString(node, "cpuset"))) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("missing cpuset for emulatorpin"));
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("missing cpuset for %s"), (const char *) node->name);
         return NULL;
     }
 
@@ -20855,8 +21032,10 @@ virDomainDefParseCaps(virDomainDefPtr def,
 
     def->os.bootloader = virXPathString("string(./bootloader)", ctxt);
     def->os.bootloaderArgs = virXPathString("string(./bootloader_args)", ctxt);
-    def->os.machine = virXPathString("string(./os/type[1]/@machine)", ctxt);
-    def->emulator = virXPathString("string(./devices/emulator[1])", ctxt);
+    def->os.machine = virStringInternTake(
+        virXPathString("string(./os/type[1]/@machine)", ctxt));
+    def->emulator = virStringInternTake(
+        virXPathString("string(./devices/emulator[1])", ctxt));
 
     if (!virttype) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
@@ -20915,12 +21094,17 @@ virDomainDefParseCaps(virDomainDefPtr def,
 static int
 virDomainMemorytuneDefParseMemory(xmlXPathContextPtr ctxt,
                                   xmlNodePtr node,
-                                  virResctrlAllocPtr alloc)
+                                  virResctrlAllocPtr alloc,
+                                  virDomainMemorytuneTargetPtr *targets,
+                                  size_t *ntargets)
 {
     VIR_XPATH_NODE_AUTORESTORE(ctxt);
+    virDomainMemorytuneTarget target = { 0 };
     unsigned int id;
     unsigned int bandwidth;
     g_autofree char *tmp = NULL;
+    g_autofree char *min = NULL;
+    g_autofree char *max = NULL;
 
     ctxt->node = node;
 
@@ -20952,6 +21136,57 @@ virDomainMemorytuneDefParseMemory(xmlXPathContextPtr ctxt,
     }
     if (virResctrlAllocSetMemoryBandwidth(alloc, id, bandwidth) < 0)
         return -1;
+    VIR_FREE(tmp);
+
+    tmp = virXMLPropString(node, "target");
+    min = virXMLPropString(node, "min");
+    max = virXMLPropString(node, "max");
+
+    if (!tmp) {
+        if (min || max) {
+            virReportError(VIR_ERR_XML_ERROR, "%s",
+                           _("memorytune attributes 'min' and 'max' "
+                             "require 'target'"));
+            return -1;
+        }
+        return 0;
+    }
+
+    target.id = id;
+    target.max = 100;
+
+    if (virStrToLong_ullp(tmp, NULL, 10, &target.target) < 0 ||
+        target.target == 0) {
+        virReportError(VIR_ERR_XML_ERROR,
+                       _("Invalid memorytune attribute 'target' value '%s'"),
+                       tmp);
+        return -1;
+    }
+
+    if (min && virStrToLong_uip(min, NULL, 10, &target.min) < 0) {
+        virReportError(VIR_ERR_XML_ERROR,
+                       _("Invalid memorytune attribute 'min' value '%s'"),
+                       min);
+        return -1;
+    }
+
+    if (max && virStrToLong_uip(max, NULL, 10, &target.max) < 0) {
+        virReportError(VIR_ERR_XML_ERROR,
+                       _("Invalid memorytune attribute 'max' value '%s'"),
+                       max);
+        return -1;
+    }
+
+    if (target.max > 100 || target.min > target.max ||
+        bandwidth < target.min || bandwidth > target.max) {
+        virReportError(VIR_ERR_XML_ERROR,
+                       _("memorytune bandwidth range for node %u must "
+                         "satisfy min <= bandwidth <= max <= 100"), id);
+        return -1;
+    }
+
+    if (VIR_APPEND_ELEMENT(*targets, *ntargets, target) < 0)
+        return -1;
 
     return 0;
 }
@@ -20969,7 +21204,10 @@ virDomainMemorytuneDefParse(virDomainDefPtr def,
     g_autoptr(virBitmap) vcpus = NULL;
     g_autofree xmlNodePtr *nodes = NULL;
     g_autoptr(virResctrlAlloc) alloc = NULL;
+    g_autofree virDomainMemorytuneTargetPtr targets = NULL;
+    size_t ntargets = 0;
     ssize_t i = 0;
+    size_t j;
     size_t nmons = 0;
     size_t ret = -1;
 
@@ -21001,7 +21239,8 @@ virDomainMemorytuneDefParse(virDomainDefPtr def,
 
     /* First, parse <memorytune/node> element if any <node> element exists */
     for (i = 0; i < n; i++) {
-        if (virDomainMemorytuneDefParseMemory(ctxt, nodes[i], alloc) < 0)
+        if (virDomainMemorytuneDefParseMemory(ctxt, nodes[i], alloc,
+                                              &targets, &ntargets) < 0)
             return -1;
     }
 
@@ -21024,6 +21263,29 @@ virDomainMemorytuneDefParse(virDomainDefPtr def,
         goto cleanup;
 
     nmons = resctrl->nmonitors - nmons;
+
+    /* The feedback controller samples a monitor of the whole allocation */
+    if (ntargets > 0) {
+        for (j = 0; j < resctrl->nmonitors; j++) {
+            if (resctrl->monitors[j]->tag == VIR_RESCTRL_MONITOR_TYPE_MEMBW &&
+                virBitmapEqual(resctrl->monitors[j]->vcpus, resctrl->vcpus))
+                break;
+        }
+
+        if (j == resctrl->nmonitors) {
+            virReportError(VIR_ERR_XML_ERROR, "%s",
+                           _("memorytune attribute 'target' requires a "
+                             "monitor of all vcpus of the memorytune"));
+            goto cleanup;
+        }
+
+        for (j = 0; j < ntargets; j++) {
+            if (VIR_APPEND_ELEMENT_COPY(resctrl->targets, resctrl->ntargets,
+                                        targets[j]) < 0)
+                goto cleanup;
+        }
+    }
+
     /* Now @nmons contains the new <monitor> element number found in current
      * <memorytune> element, and @n holds the number of new <node> element,
      * only append the new @newresctrl object to domain if any of them is
@@ -21212,6 +21474,14 @@ virDomainDefParseXML(xmlDocPtr xml,
         VIR_FREE(tmp);
     }
 
+    if ((n = virXPathUInt("string(./memoryBacking/allocation/@threads)", ctxt,
+                          &def->mem.allocation_threads)) == -2 ||
+        (n == 0 && def->mem.allocation_threads == 0)) {
+        virReportError(VIR_ERR_XML_ERROR, "%s",
+                       _("memoryBacking/allocation/threads must be a positive integer"));
+        goto error;
+    }
+
     if (virXPathNode("./memoryBacking/hugepages", ctxt)) {
         /* hugepages will be used */
         if ((n = virXPathNodeSet("./memoryBacking/hugepages/page", ctxt, &nodes)) < 0) {
@@ -21398,6 +21668,22 @@ virDomainDefParseXML(xmlDocPtr xml,
     }
     VIR_FREE(nodes);
 
+    if ((n = virXPathNodeSet("./cputune/helperpin", ctxt, &nodes)) < 0)
+        goto error;
+
+    if (n) {
+        if (n > 1) {
+            virReportError(VIR_ERR_XML_ERROR, "%s",
+                           _("only one helperpin is supported"));
+            VIR_FREE(nodes);
+            goto error;
+        }
+
+        if (!(def->cputune.helperpin = virDomainEmulatorPinDefParseXML(nodes[0])))
+            goto error;
+    }
+    VIR_FREE(nodes);
+
 
     if ((n = virXPathNodeSet("./cputune/iothreadpin", ctxt, &nodes)) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
@@ -21498,14 +21784,15 @@ virDomainDefParseXML(xmlDocPtr xml,
     }
 
     if (virDomainNumatuneParseXML(def->numa,
-                                  def->placement_mode ==
-                                  VIR_DOMAIN_CPU_PLACEMENT_MODE_STATIC,
+                                  def->placement_mode !=
+                                  VIR_DOMAIN_CPU_PLACEMENT_MODE_AUTO,
                                   ctxt) < 0)
         goto error;
 
     if (virDomainNumatuneHasPlacementAuto(def->numa) &&
         !def->cpumask && !virDomainDefHasVcpuPin(def) &&
         !def->cputune.emulatorpin &&
+        !def->cputune.helperpin &&
         !virDomainIOThreadIDArrayHasPin(def))
         def->placement_mode = VIR_DOMAIN_CPU_PLACEMENT_MODE_AUTO;
 
@@ -23327,6 +23614,15 @@ virDomainMemballoonDefCheckABIStability(virDomainMemballoonDefPtr src,
         return false;
     }
 
+    if (src->free_page_reporting != dst->free_page_reporting) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                       _("Target balloon freePageReporting attribute value "
+                         "'%s' does not match source '%s'"),
+                       virTristateSwitchTypeToString(dst->free_page_reporting),
+                       virTristateSwitchTypeToString(src->free_page_reporting));
+        return false;
+    }
+
     if (src->virtio && dst->virtio &&
         !virDomainVirtioOptionsCheckABIStability(src->virtio, dst->virtio))
         return false;
@@ -25396,11 +25692,44 @@ virDomainDiskDefFormatIotune(virBufferPtr buf,
 #undef FORMAT_IOTUNE
 
 
+static void
+virDomainDiskDefFormatDriverStatistics(virBufferPtr buf,
+                                       virDomainDiskDefPtr disk)
+{
+    g_auto(virBuffer) childBuf = VIR_BUFFER_INIT_CHILD(buf);
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < VIR_DOMAIN_DISK_LATENCY_HISTOGRAM_LAST; i++) {
+        virDomainDiskLatencyHistogramPtr hist = disk->latencyHistograms + i;
+        g_auto(virBuffer) histAttrBuf = VIR_BUFFER_INITIALIZER;
+        g_auto(virBuffer) histChildBuf = VIR_BUFFER_INIT_CHILD(&childBuf);
+
+        if (hist->nbins == 0)
+            continue;
+
+        if (i != VIR_DOMAIN_DISK_LATENCY_HISTOGRAM_DEFAULT)
+            virBufferAsprintf(&histAttrBuf, " type='%s'",
+                              virDomainDiskLatencyHistogramTypeToString(i));
+
+        for (j = 0; j < hist->nbins; j++)
+            virBufferAsprintf(&histChildBuf, "<bin start='%llu'/>\n",
+                              hist->bins[j]);
+
+        virXMLFormatElement(&childBuf, "latency-histogram",
+                            &histAttrBuf, &histChildBuf);
+    }
+
+    virXMLFormatElement(buf, "statistics", NULL, &childBuf);
+}
+
+
 static int
 virDomainDiskDefFormatDriver(virBufferPtr buf,
                              virDomainDiskDefPtr disk)
 {
     g_auto(virBuffer) driverBuf = VIR_BUFFER_INITIALIZER;
+    g_auto(virBuffer) childBuf = VIR_BUFFER_INIT_CHILD(buf);
 
     virBufferEscapeString(&driverBuf, " name='%s'", virDomainDiskGetDriver(disk));
 
@@ -25452,7 +25781,9 @@ virDomainDiskDefFormatDriver(virBufferPtr buf,
 
     virDomainVirtioOptionsFormat(&driverBuf, disk->virtio);
 
-    virXMLFormatElement(buf, "driver", &driverBuf, NULL);
+    virDomainDiskDefFormatDriverStatistics(&childBuf, disk);
+
+    virXMLFormatElement(buf, "driver", &driverBuf, &childBuf);
     return 0;
 }
 
@@ -26536,6 +26867,14 @@ virDomainVirtioNetDriverFormat(char **outstr,
     if (def->driver.virtio.tx_queue_size)
         virBufferAsprintf(&buf, " tx_queue_size='%u'",
                           def->driver.virtio.tx_queue_size);
+    if (def->driver.virtio.rss) {
+        virBufferAsprintf(&buf, " rss='%s'",
+                          virTristateSwitchTypeToString(def->driver.virtio.rss));
+    }
+    if (def->driver.virtio.rss_hash_report) {
+        virBufferAsprintf(&buf, " rss_hash_report='%s'",
+                          virTristateSwitchTypeToString(def->driver.virtio.rss_hash_report));
+    }
 
     virDomainVirtioOptionsFormat(&buf, def->virtio);
 
@@ -27381,9 +27720,27 @@ virDomainMemballoonDefFormat(virBufferPtr buf,
         virBufferAsprintf(&attrBuf, " autodeflate='%s'",
                           virTristateSwitchTypeToString(def->autodeflate));
 
+    if (def->free_page_reporting != VIR_TRISTATE_SWITCH_ABSENT)
+        virBufferAsprintf(&attrBuf, " freePageReporting='%s'",
+                          virTristateSwitchTypeToString(def->free_page_reporting));
+
     if (def->period)
         virBufferAsprintf(&childrenBuf, "<stats period='%i'/>\n", def->period);
 
+    if (def->overcommit) {
+        virBufferAddLit(&childrenBuf, "<overcommit");
+        if (def->overcommit_min)
+            virBufferAsprintf(&childrenBuf, " min='%llu'", def->overcommit_min);
+        if (def->overcommit_max)
+            virBufferAsprintf(&childrenBuf, " max='%llu'", def->overcommit_max);
+        if (def->overcommit_min || def->overcommit_max)
+            virBufferAddLit(&childrenBuf, " unit='KiB'");
+        if (def->overcommit_priority)
+            virBufferAsprintf(&childrenBuf, " priority='%u'",
+                              def->overcommit_priority);
+        virBufferAddLit(&childrenBuf, "/>\n");
+    }
+
     if (virDomainDeviceInfoFormat(&childrenBuf, &def->info, flags) < 0)
         return -1;
 
@@ -28846,16 +29203,36 @@ virDomainCachetuneDefFormat(virBufferPtr buf,
 }
 
 
+typedef struct _virDomainMemorytuneFormatData virDomainMemorytuneFormatData;
+struct _virDomainMemorytuneFormatData {
+    virBufferPtr buf;
+    virDomainResctrlDefPtr resctrl;
+};
+
+
 static int
 virDomainMemorytuneDefFormatHelper(unsigned int id,
                                    unsigned int bandwidth,
                                    void *opaque)
 {
-    virBufferPtr buf = opaque;
+    virDomainMemorytuneFormatData *data = opaque;
+    virBufferPtr buf = data->buf;
+    size_t i;
 
-    virBufferAsprintf(buf,
-                      "<node id='%u' bandwidth='%u'/>\n",
-                      id, bandwidth);
+    virBufferAsprintf(buf, "<node id='%u' bandwidth='%u'", id, bandwidth);
+
+    for (i = 0; i < data->resctrl->ntargets; i++) {
+        virDomainMemorytuneTargetPtr target = &data->resctrl->targets[i];
+
+        if (target->id != id)
+            continue;
+
+        virBufferAsprintf(buf, " target='%llu' min='%u' max='%u'",
+                          target->target, target->min, target->max);
+        break;
+    }
+
+    virBufferAddLit(buf, "/>\n");
     return 0;
 }
 
@@ -28866,12 +29243,13 @@ virDomainMemorytuneDefFormat(virBufferPtr buf,
                             unsigned int flags)
 {
     g_auto(virBuffer) childrenBuf = VIR_BUFFER_INIT_CHILD(buf);
+    virDomainMemorytuneFormatData data = { &childrenBuf, resctrl };
     g_autofree char *vcpus = NULL;
     size_t i = 0;
 
     if (virResctrlAllocForeachMemory(resctrl->alloc,
                                      virDomainMemorytuneDefFormatHelper,
-                                     &childrenBuf) < 0)
+                                     &data) < 0)
         return -1;
 
     for (i = 0; i< resctrl->nmonitors; i++) {
@@ -28977,6 +29355,15 @@ virDomainCputuneDefFormat(virBufferPtr buf,
         VIR_FREE(cpumask);
     }
 
+    if (def->cputune.helperpin) {
+        g_autofree char *cpumask = NULL;
+
+        if (!(cpumask = virBitmapFormat(def->cputune.helperpin)))
+            return -1;
+
+        virBufferAsprintf(&childrenBuf, "<helperpin cpuset='%s'/>\n", cpumask);
+    }
+
     for (i = 0; i < def->niothreadids; i++) {
         char *cpumask;
 
@@ -29176,9 +29563,15 @@ virDomainMemorybackingFormat(virBufferPtr buf,
     if (mem->access)
         virBufferAsprintf(&childBuf, "<access mode='%s'/>\n",
                           virDomainMemoryAccessTypeToString(mem->access));
-    if (mem->allocation)
-        virBufferAsprintf(&childBuf, "<allocation mode='%s'/>\n",
-                          virDomainMemoryAllocationTypeToString(mem->allocation));
+    if (mem->allocation || mem->allocation_threads) {
+        virBufferAddLit(&childBuf, "<allocation");
+        if (mem->allocation)
+            virBufferAsprintf(&childBuf, " mode='%s'",
+                              virDomainMemoryAllocationTypeToString(mem->allocation));
+        if (mem->allocation_threads)
+            virBufferAsprintf(&childBuf, " threads='%u'", mem->allocation_threads);
+        virBufferAddLit(&childBuf, "/>\n");
+    }
     if (mem->discard)
         virBufferAddLit(&childBuf, "<discard/>\n");
 
@@ -29637,9 +30030,11 @@ virDomainDefFormatInternalSetRootName(virDomainDefPtr def,
     if (def->id == -1)
         flags |= VIR_DOMAIN_DEF_FORMAT_INACTIVE;
 
-    virBufferAsprintf(buf, "<%s type='%s'", rootname, type);
+    virBufferAddChar(buf, '<');
+    virBufferAdd(buf, rootname, -1);
+    virBufferAddAttr(buf, "type", type);
     if (!(flags & VIR_DOMAIN_DEF_FORMAT_INACTIVE))
-        virBufferAsprintf(buf, " id='%d'", def->id);
+        virBufferAddAttrLLong(buf, "id", def->id);
     if (def->namespaceData && def->ns.format)
         virXMLNamespaceFormatNS(buf, &def->ns);
     virBufferAddLit(buf, ">\n");
@@ -29689,20 +30084,24 @@ virDomainDefFormatInternalSetRootName(virDomainDefPtr def,
     }
 
     if (virDomainDefHasMemoryHotplug(def)) {
-        virBufferAsprintf(buf,
-                          "<maxMemory slots='%u' unit='KiB'>%llu</maxMemory>\n",
-                          def->mem.memory_slots, def->mem.max_memory);
+        virBufferAddLit(buf, "<maxMemory");
+        virBufferAddAttrULLong(buf, "slots", def->mem.memory_slots);
+        virBufferAddLit(buf, " unit='KiB'>");
+        virBufferAddULLong(buf, def->mem.max_memory);
+        virBufferAddLit(buf, "</maxMemory>\n");
     }
 
     virBufferAddLit(buf, "<memory");
     if (def->mem.dump_core)
-        virBufferAsprintf(buf, " dumpCore='%s'",
-                          virTristateSwitchTypeToString(def->mem.dump_core));
-    virBufferAsprintf(buf, " unit='KiB'>%llu</memory>\n",
-                      virDomainDefGetMemoryTotal(def));
+        virBufferAddAttr(buf, "dumpCore",
+                         virTristateSwitchTypeToString(def->mem.dump_core));
+    virBufferAddLit(buf, " unit='KiB'>");
+    virBufferAddULLong(buf, virDomainDefGetMemoryTotal(def));
+    virBufferAddLit(buf, "</memory>\n");
 
-    virBufferAsprintf(buf, "<currentMemory unit='KiB'>%llu</currentMemory>\n",
-                      def->mem.cur_balloon);
+    virBufferAddLit(buf, "<currentMemory unit='KiB'>");
+    virBufferAddULLong(buf, def->mem.cur_balloon);
+    virBufferAddLit(buf, "</currentMemory>\n");
 
     if (virDomainDefFormatBlkiotune(buf, def) < 0)
         return -1;
@@ -29714,14 +30113,17 @@ virDomainDefFormatInternalSetRootName(virDomainDefPtr def,
         return -1;
 
     if (def->niothreadids > 0) {
-        virBufferAsprintf(buf, "<iothreads>%zu</iothreads>\n",
-                          def->niothreadids);
+        virBufferAddLit(buf, "<iothreads>");
+        virBufferAddULLong(buf, def->niothreadids);
+        virBufferAddLit(buf, "</iothreads>\n");
         if (virDomainDefIothreadShouldFormat(def)) {
             virBufferAddLit(buf, "<iothreadids>\n");
             virBufferAdjustIndent(buf, 2);
             for (i = 0; i < def->niothreadids; i++) {
-                virBufferAsprintf(buf, "<iothread id='%u'/>\n",
-                                  def->iothreadids[i]->iothread_id);
+                virBufferAddLit(buf, "<iothread");
+                virBufferAddAttrULLong(buf, "id",
+                                       def->iothreadids[i]->iothread_id);
+                virBufferAddLit(buf, "/>\n");
             }
             virBufferAdjustIndent(buf, -2);
             virBufferAddLit(buf, "</iothreadids>\n");
@@ -29752,15 +30154,14 @@ virDomainDefFormatInternalSetRootName(virDomainDefPtr def,
 
     virBufferAddLit(buf, "<os");
     if (def->os.firmware)
-        virBufferAsprintf(buf, " firmware='%s'",
-                          virDomainOsDefFirmwareTypeToString(def->os.firmware));
+        virBufferAddAttr(buf, "firmware",
+                         virDomainOsDefFirmwareTypeToString(def->os.firmware));
     virBufferAddLit(buf, ">\n");
     virBufferAdjustIndent(buf, 2);
     virBufferAddLit(buf, "<type");
     if (def->os.arch)
-        virBufferAsprintf(buf, " arch='%s'", virArchToString(def->os.arch));
-    if (def->os.machine)
-        virBufferAsprintf(buf, " machine='%s'", def->os.machine);
+        virBufferAddAttr(buf, "arch", virArchToString(def->os.arch));
+    virBufferAddAttr(buf, "machine", def->os.machine);
     /*
      * HACK: For xen driver we previously used bogus 'linux' as the
      * os type for paravirt, whereas capabilities declare it to
@@ -30373,10 +30774,120 @@ virDomainObjSave(virDomainObjPtr obj,
     if (!(xml = virDomainObjFormat(obj, xmlopt, flags)))
         return -1;
 
+    obj->saveDeferred = false;
+
     return virDomainDefSaveXML(obj->def, statusDir, xml);
 }
 
 
+typedef struct _virDomainObjSaveJob virDomainObjSaveJob;
+struct _virDomainObjSaveJob {
+    virDomainObjPtr obj;
+    virDomainXMLOptionPtr xmlopt;
+    char *statusDir;
+};
+
+static virThreadPoolPtr virDomainObjSavePool;
+
+static void
+virDomainObjSaveWorker(void *jobdata,
+                       void *opaque G_GNUC_UNUSED)
+{
+    virDomainObjSaveJob *job = jobdata;
+    virDomainObjPtr obj = job->obj;
+
+    virObjectLock(obj);
+
+    /* Either a synchronous save already wrote the current state or the
+     * save was cancelled in the meantime */
+    if (obj->saveDeferred &&
+        virDomainObjSave(obj, job->xmlopt, job->statusDir) < 0)
+        VIR_WARN("Failed to save status on vm %s", obj->def->name);
+
+    virObjectUnlock(obj);
+
+    virObjectUnref(obj);
+    virObjectUnref(job->xmlopt);
+    g_free(job->statusDir);
+    g_free(job);
+}
+
+
+static int
+virDomainObjSavePoolOnceInit(void)
+{
+    if (!(virDomainObjSavePool = virThreadPoolNew(0, 1, 0,
+                                                  virDomainObjSaveWorker,
+                                                  NULL)))
+        return -1;
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virDomainObjSavePool);
+
+
+/**
+ * virDomainObjSaveDeferred:
+ * @obj: domain object, must be locked
+ * @xmlopt: XML parser/formatter options
+ * @statusDir: directory to save the status XML to
+ *
+ * Marks the status XML of @obj as outdated and lets a background worker
+ * write it once the caller releases the lock of @obj. Any number of
+ * deferred saves issued before the worker gets to @obj result in a single
+ * write. A later call to virDomainObjSave serves as a barrier, it writes
+ * the current state synchronously and drops the pending deferred save.
+ *
+ * Falls back to a synchronous save if the job cannot be queued.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virDomainObjSaveDeferred(virDomainObjPtr obj,
+                         virDomainXMLOptionPtr xmlopt,
+                         const char *statusDir)
+{
+    virDomainObjSaveJob *job;
+
+    if (obj->saveDeferred)
+        return 0;
+
+    if (virDomainObjSavePoolInitialize() < 0)
+        return virDomainObjSave(obj, xmlopt, statusDir);
+
+    job = g_new0(virDomainObjSaveJob, 1);
+    job->obj = virObjectRef(obj);
+    job->xmlopt = virObjectRef(xmlopt);
+    job->statusDir = g_strdup(statusDir);
+
+    if (virThreadPoolSendJob(virDomainObjSavePool, 0, job) < 0) {
+        virObjectUnref(job->obj);
+        virObjectUnref(job->xmlopt);
+        g_free(job->statusDir);
+        g_free(job);
+        return virDomainObjSave(obj, xmlopt, statusDir);
+    }
+
+    obj->saveDeferred = true;
+    return 0;
+}
+
+
+/**
+ * virDomainObjSaveCancel:
+ * @obj: domain object, must be locked
+ *
+ * Drops a pending deferred save of @obj, e.g. when its status XML is
+ * about to be removed.
+ */
+void
+virDomainObjSaveCancel(virDomainObjPtr obj)
+{
+    obj->saveDeferred = false;
+}
+
+
 int
 virDomainDeleteConfig(const char *configDir,
                       const char *autostartDir,
@@ -30740,6 +31251,78 @@ virDomainObjSetState(virDomainObjPtr dom, virDomainState state, int reason)
         dom->state.reason = reason;
     else
         dom->state.reason = 0;
+
+    virDomainObjUpdateSummary(dom);
+}
+
+
+static void
+virDomainObjSummaryDispose(void *obj)
+{
+    virDomainObjSummaryPtr summary = obj;
+
+    virDomainDefFree(summary->def);
+}
+
+
+/**
+ * virDomainObjUpdateSummary:
+ * @dom: locked domain object
+ *
+ * Publish a new summary of @dom for readers which don't lock the object.
+ * It has to be called whenever the name, UUID, state or the removal status
+ * of @dom changes. Objects without a definition have no summary.
+ */
+void
+virDomainObjUpdateSummary(virDomainObjPtr dom)
+{
+    virDomainObjSummaryPtr summary = NULL;
+    virDomainObjSummaryPtr old;
+
+    if (dom->def &&
+        (summary = virObjectNew(virDomainObjSummaryClass))) {
+        if (!(summary->def = virDomainDefNew())) {
+            virObjectUnref(summary);
+            summary = NULL;
+        } else {
+            summary->def->name = g_strdup(dom->def->name);
+            memcpy(summary->def->uuid, dom->def->uuid, VIR_UUID_BUFLEN);
+            summary->def->id = -1;
+            if (dom->state.state != VIR_DOMAIN_SHUTOFF)
+                summary->def->id = dom->def->id;
+            summary->state = dom->state;
+            summary->removing = dom->removing;
+        }
+    }
+
+    /* readers fall back to locking the object if there's no summary */
+    virRWLockWrite(&dom->summaryLock);
+    old = dom->summary;
+    dom->summary = summary;
+    virRWLockUnlock(&dom->summaryLock);
+
+    virObjectUnref(old);
+}
+
+
+/**
+ * virDomainObjGetSummary:
+ * @dom: domain object, doesn't need to be locked
+ *
+ * Returns a reference to the most recent summary of @dom or NULL if there's
+ * none. The summary may briefly lag behind changes done by a thread which
+ * still holds the lock on @dom.
+ */
+virDomainObjSummaryPtr
+virDomainObjGetSummary(virDomainObjPtr dom)
+{
+    virDomainObjSummaryPtr ret;
+
+    virRWLockRead(&dom->summaryLock);
+    ret = virObjectRef(dom->summary);
+    virRWLockUnlock(&dom->summaryLock);
+
+    return ret;
 }
 
 
@@ -31138,6 +31721,266 @@ virDomainNetFindByName(virDomainDefPtr def,
  *
  * Returns a pointer to copied @src or NULL in case of error.
  */
+/* Copies the parts of @src which survive a round-trip through the
+ * inactive XML, runtime-only data such as automatic aliases is left out */
+static void
+virDomainDeviceInfoCopyInactive(virDomainDeviceInfoPtr dst,
+                                const virDomainDeviceInfo *src,
+                                virDomainXMLOptionPtr xmlopt)
+{
+    if (xmlopt &&
+        xmlopt->config.features & VIR_DOMAIN_DEF_FEATURE_USER_ALIAS &&
+        virDomainDeviceAliasIsUserAlias(src->alias))
+        dst->alias = g_strdup(src->alias);
+
+    dst->type = src->type;
+    dst->addr = src->addr;
+    dst->mastertype = src->mastertype;
+    dst->master = src->master;
+    dst->romenabled = src->romenabled;
+    dst->rombar = src->rombar;
+    dst->romfile = g_strdup(src->romfile);
+    dst->bootIndex = src->bootIndex;
+    dst->loadparm = g_strdup(src->loadparm);
+}
+
+
+/**
+ * virDomainDiskDefCopy:
+ * @src: disk definition to copy
+ * @xmlopt: XML parser configuration
+ *
+ * Creates a deep copy of @src with the same contents as formatting it
+ * into inactive XML and parsing it back would produce, without paying
+ * for the round-trip. Runtime-only data, like the backing chain or the
+ * mirror of a running block job, is not copied.
+ *
+ * Returns the new disk definition or NULL on error.
+ */
+virDomainDiskDefPtr
+virDomainDiskDefCopy(const virDomainDiskDef *src,
+                     virDomainXMLOptionPtr xmlopt)
+{
+    virDomainDiskDefPtr def;
+    size_t i;
+
+    if (!(def = virDomainDiskDefNew(xmlopt)))
+        return NULL;
+
+    virObjectUnref(def->src);
+    if (!(def->src = virStorageSourceCopy(src->src, false)))
+        goto error;
+
+    /* only ever valid for a running domain */
+    def->src->id = 0;
+    VIR_FREE(def->src->nodeformat);
+    VIR_FREE(def->src->nodestorage);
+
+    def->device = src->device;
+    def->bus = src->bus;
+    def->dst = g_strdup(src->dst);
+    def->tray_status = src->tray_status;
+    def->removable = src->removable;
+    def->geometry = src->geometry;
+    def->blockio = src->blockio;
+    virDomainBlockIoTuneInfoCopy(&src->blkdeviotune, &def->blkdeviotune);
+    def->driverName = virStringIntern(src->driverName);
+    def->serial = g_strdup(src->serial);
+    def->wwn = g_strdup(src->wwn);
+    def->vendor = g_strdup(src->vendor);
+    def->product = g_strdup(src->product);
+    def->cachemode = src->cachemode;
+    def->error_policy = src->error_policy;
+    def->rerror_policy = src->rerror_policy;
+    def->iomode = src->iomode;
+    def->ioeventfd = src->ioeventfd;
+    def->event_idx = src->event_idx;
+    def->copy_on_read = src->copy_on_read;
+    def->snapshot = src->snapshot;
+    def->startupPolicy = src->startupPolicy;
+    def->transient = src->transient;
+    virDomainDeviceInfoCopyInactive(&def->info, &src->info, xmlopt);
+    def->rawio = src->rawio;
+    def->sgio = src->sgio;
+    def->discard = src->discard;
+    def->iothread = src->iothread;
+    def->detect_zeroes = src->detect_zeroes;
+    def->domain_name = g_strdup(src->domain_name);
+    def->queues = src->queues;
+    def->model = src->model;
+    if (src->virtio) {
+        def->virtio = g_new0(virDomainVirtioOptions, 1);
+        *def->virtio = *src->virtio;
+    }
+    for (i = 0; i < VIR_DOMAIN_DISK_LATENCY_HISTOGRAM_LAST; i++) {
+        const virDomainDiskLatencyHistogram *hist = src->latencyHistograms + i;
+
+        if (hist->nbins == 0)
+            continue;
+
+        def->latencyHistograms[i].bins = g_new0(unsigned long long, hist->nbins);
+        memcpy(def->latencyHistograms[i].bins, hist->bins,
+               hist->nbins * sizeof(*hist->bins));
+        def->latencyHistograms[i].nbins = hist->nbins;
+    }
+    def->diskElementAuth = src->diskElementAuth;
+    def->diskElementEnc = src->diskElementEnc;
+
+    return def;
+
+ error:
+    virDomainDiskDefFree(def);
+    return NULL;
+}
+
+
+/**
+ * virDomainNetDefCopy:
+ * @src: network interface definition to copy
+ * @xmlopt: XML parser configuration
+ *
+ * Creates a deep copy of @src with the same contents as formatting it
+ * into inactive XML and parsing it back would produce, without paying
+ * for the round-trip. Runtime-only data, like the actual network
+ * connection or automatically generated tap device names, is not
+ * copied. Interfaces of type 'hostdev' are not supported.
+ *
+ * Returns the new interface definition or NULL on error.
+ */
+virDomainNetDefPtr
+virDomainNetDefCopy(const virDomainNetDef *src,
+                    virDomainXMLOptionPtr xmlopt)
+{
+    virDomainNetDefPtr def;
+    const char *prefix = xmlopt ? xmlopt->config.netPrefix : NULL;
+
+    if (src->type == VIR_DOMAIN_NET_TYPE_HOSTDEV) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("copying interfaces of type 'hostdev' "
+                         "is not supported"));
+        return NULL;
+    }
+
+    if (!(def = virDomainNetDefNew(xmlopt)))
+        return NULL;
+
+    def->type = src->type;
+    def->mac = src->mac;
+    def->mac_type = src->mac_type;
+    def->mac_check = src->mac_check;
+    def->model = src->model;
+    def->modelstr = g_strdup(src->modelstr);
+    def->driver = src->driver;
+    def->backend.tap = g_strdup(src->backend.tap);
+    def->backend.vhost = g_strdup(src->backend.vhost);
+    def->teaming.type = src->teaming.type;
+    def->teaming.persistent = g_strdup(src->teaming.persistent);
+
+    switch (src->type) {
+    case VIR_DOMAIN_NET_TYPE_VHOSTUSER:
+        if (!(def->data.vhostuser = virDomainChrSourceDefNew(xmlopt)) ||
+            virDomainChrSourceDefCopy(def->data.vhostuser,
+                                      src->data.vhostuser) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_NET_TYPE_SERVER:
+    case VIR_DOMAIN_NET_TYPE_CLIENT:
+    case VIR_DOMAIN_NET_TYPE_MCAST:
+    case VIR_DOMAIN_NET_TYPE_UDP:
+        def->data.socket.address = g_strdup(src->data.socket.address);
+        def->data.socket.port = src->data.socket.port;
+        def->data.socket.localaddr = g_strdup(src->data.socket.localaddr);
+        def->data.socket.localport = src->data.socket.localport;
+        break;
+
+    case VIR_DOMAIN_NET_TYPE_NETWORK:
+        /* the port and the actual connection are only valid while
+         * the domain is running */
+        def->data.network.name = g_strdup(src->data.network.name);
+        def->data.network.portgroup = g_strdup(src->data.network.portgroup);
+        break;
+
+    case VIR_DOMAIN_NET_TYPE_BRIDGE:
+        def->data.bridge.brname = g_strdup(src->data.bridge.brname);
+        break;
+
+    case VIR_DOMAIN_NET_TYPE_INTERNAL:
+        def->data.internal.name = g_strdup(src->data.internal.name);
+        break;
+
+    case VIR_DOMAIN_NET_TYPE_DIRECT:
+        def->data.direct.linkdev = g_strdup(src->data.direct.linkdev);
+        def->data.direct.mode = src->data.direct.mode;
+        break;
+
+    case VIR_DOMAIN_NET_TYPE_ETHERNET:
+    case VIR_DOMAIN_NET_TYPE_USER:
+    case VIR_DOMAIN_NET_TYPE_HOSTDEV:
+    case VIR_DOMAIN_NET_TYPE_LAST:
+        break;
+    }
+
+    if (virNetDevVPortProfileCopy(&def->virtPortProfile,
+                                  src->virtPortProfile) < 0)
+        goto error;
+
+    def->tune = src->tune;
+    def->script = g_strdup(src->script);
+    def->downscript = g_strdup(src->downscript);
+    def->domain_name = g_strdup(src->domain_name);
+
+    /* Skip auto-generated target names, same as the inactive XML does */
+    if (src->ifname &&
+        (src->managed_tap == VIR_TRISTATE_BOOL_NO ||
+         !(STRPREFIX(src->ifname, VIR_NET_GENERATED_TAP_PREFIX) ||
+           (prefix && STRPREFIX(src->ifname, prefix)))))
+        def->ifname = g_strdup(src->ifname);
+
+    def->managed_tap = src->managed_tap;
+    virNetDevIPInfoCopy(&def->hostIP, &src->hostIP);
+    def->ifname_guest_actual = g_strdup(src->ifname_guest_actual);
+    def->ifname_guest = g_strdup(src->ifname_guest);
+    virNetDevIPInfoCopy(&def->guestIP, &src->guestIP);
+    virDomainDeviceInfoCopyInactive(&def->info, &src->info, xmlopt);
+
+    if (src->filter) {
+        def->filter = g_strdup(src->filter);
+
+        if (src->filterparams &&
+            (!(def->filterparams = virNWFilterHashTableCreate(0)) ||
+             virNWFilterHashTablePutAll(src->filterparams,
+                                        def->filterparams) < 0))
+            goto error;
+    }
+
+    if (virNetDevBandwidthCopy(&def->bandwidth, src->bandwidth) < 0 ||
+        virNetDevVlanCopy(&def->vlan, &src->vlan) < 0)
+        goto error;
+
+    def->trustGuestRxFilters = src->trustGuestRxFilters;
+    def->isolatedPort = src->isolatedPort;
+    def->linkstate = src->linkstate;
+    def->mtu = src->mtu;
+
+    if (src->coalesce) {
+        def->coalesce = g_new0(virNetDevCoalesce, 1);
+        *def->coalesce = *src->coalesce;
+    }
+
+    if (src->virtio) {
+        def->virtio = g_new0(virDomainVirtioOptions, 1);
+        *def->virtio = *src->virtio;
+    }
+
+    return def;
+
+ error:
+    virDomainNetDefFree(def);
+    return NULL;
+}
+
+
 virDomainDeviceDefPtr
 virDomainDeviceDefCopy(virDomainDeviceDefPtr src,
                        const virDomainDef *def,
@@ -31149,6 +31992,27 @@ virDomainDeviceDefCopy(virDomainDeviceDefPtr src,
     int rc = -1;
     g_autofree char *xmlStr = NULL;
 
+    /* Disks and interfaces are the bulk of large definitions, copy them
+     * directly instead of going through XML */
+    if (src->type == VIR_DOMAIN_DEVICE_DISK ||
+        (src->type == VIR_DOMAIN_DEVICE_NET &&
+         src->data.net->type != VIR_DOMAIN_NET_TYPE_HOSTDEV)) {
+        g_autoptr(virDomainDeviceDef) copy = g_new0(virDomainDeviceDef, 1);
+
+        copy->type = src->type;
+        if (src->type == VIR_DOMAIN_DEVICE_DISK) {
+            if (!(copy->data.disk = virDomainDiskDefCopy(src->data.disk,
+                                                         xmlopt)))
+                return NULL;
+        } else {
+            if (!(copy->data.net = virDomainNetDefCopy(src->data.net,
+                                                       xmlopt)))
+                return NULL;
+        }
+
+        return g_steal_pointer(&copy);
+    }
+
     switch ((virDomainDeviceType) src->type) {
     case VIR_DOMAIN_DEVICE_DISK:
         rc = virDomainDiskDefFormat(&buf, src->data.disk, flags, xmlopt);
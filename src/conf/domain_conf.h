@@ -470,6 +470,27 @@ typedef enum {
     VIR_DOMAIN_DISK_MODEL_LAST
 } virDomainDiskModel;
 
+typedef enum {
+    VIR_DOMAIN_DISK_LATENCY_HISTOGRAM_DEFAULT = 0, /* all operations */
+    VIR_DOMAIN_DISK_LATENCY_HISTOGRAM_READ,
+    VIR_DOMAIN_DISK_LATENCY_HISTOGRAM_WRITE,
+    VIR_DOMAIN_DISK_LATENCY_HISTOGRAM_FLUSH,
+
+    VIR_DOMAIN_DISK_LATENCY_HISTOGRAM_LAST
+} virDomainDiskLatencyHistogramType;
+
+/* maximum number of bins of a disk latency histogram */
+#define VIR_DOMAIN_DISK_LATENCY_HISTOGRAM_BINS_MAX 16
+
+typedef struct _virDomainDiskLatencyHistogram virDomainDiskLatencyHistogram;
+typedef virDomainDiskLatencyHistogram *virDomainDiskLatencyHistogramPtr;
+struct _virDomainDiskLatencyHistogram {
+    /* start of each bin in nanoseconds, the first one is always 0;
+     * nbins is 0 if the histogram isn't configured */
+    unsigned long long *bins;
+    size_t nbins;
+};
+
 struct _virDomainBlockIoTuneInfo {
     unsigned long long total_bytes_sec;
     unsigned long long read_bytes_sec;
@@ -553,7 +574,7 @@ struct _virDomainDiskDef {
 
     virDomainBlockIoTuneInfo blkdeviotune;
 
-    char *driverName;
+    char *driverName; /* interned, see virStringIntern */
 
     char *serial;
     char *wwn;
@@ -580,6 +601,9 @@ struct _virDomainDiskDef {
     int model; /* enum virDomainDiskModel */
     virDomainVirtioOptionsPtr virtio;
 
+    /* indexed by virDomainDiskLatencyHistogramType */
+    virDomainDiskLatencyHistogram latencyHistograms[VIR_DOMAIN_DISK_LATENCY_HISTOGRAM_LAST];
+
     bool diskElementAuth;
     bool diskElementEnc;
 };
@@ -994,6 +1018,8 @@ struct _virDomainNetDef {
             unsigned int queues; /* Multiqueue virtio-net */
             unsigned int rx_queue_size;
             unsigned int tx_queue_size;
+            virTristateSwitch rss;
+            virTristateSwitch rss_hash_report;
             struct {
                 virTristateSwitch csum;
                 virTristateSwitch gso;
@@ -1757,6 +1783,12 @@ struct _virDomainMemballoonDef {
     virDomainDeviceInfo info;
     int period; /* seconds between collections */
     int autodeflate; /* enum virTristateSwitch */
+    int free_page_reporting; /* enum virTristateSwitch */
+    /* <overcommit/>, the balloon is resized by the memory manager */
+    bool overcommit;
+    unsigned long long overcommit_min; /* in KiB */
+    unsigned long long overcommit_max; /* in KiB, 0 for the current maximum */
+    unsigned int overcommit_priority;
     virDomainVirtioOptionsPtr virtio;
 };
 
@@ -2072,7 +2104,7 @@ struct _virDomainOSDef {
     int type;
     virDomainOsDefFirmware firmware;
     virArch arch;
-    char *machine;
+    char *machine; /* interned, see virStringIntern */
     size_t nBootDevs;
     int bootDevs[VIR_DOMAIN_BOOT_LAST];
     int bootmenu; /* enum virTristateBool */
@@ -2141,6 +2173,7 @@ typedef enum {
 typedef enum {
     VIR_DOMAIN_CPU_PLACEMENT_MODE_STATIC = 0,
     VIR_DOMAIN_CPU_PLACEMENT_MODE_AUTO,
+    VIR_DOMAIN_CPU_PLACEMENT_MODE_TOPOLOGY,
 
     VIR_DOMAIN_CPU_PLACEMENT_MODE_LAST
 } virDomainCpuPlacementMode;
@@ -2362,6 +2395,7 @@ struct _virDomainCputune {
     long long iothread_quota;
     virBitmapPtr emulatorpin;
     virDomainThreadSchedParamPtr emulatorsched;
+    virBitmapPtr helperpin;
 };
 
 
@@ -2371,12 +2405,27 @@ struct _virDomainResctrlMonDef {
     virResctrlMonitorPtr instance;
 };
 
+struct _virDomainMemorytuneTarget {
+    unsigned int id;            /* memory bandwidth controller id */
+    unsigned long long target;  /* bandwidth to steer towards, in MiB/s */
+    unsigned int min;           /* lowest limit to apply, in percent */
+    unsigned int max;           /* highest limit to apply, in percent */
+
+    /* Live only, previous sample of the monitor counter */
+    unsigned long long lastBytes;
+    unsigned long long lastTime; /* in ms */
+};
+
 struct _virDomainResctrlDef {
     virBitmapPtr vcpus;
     virResctrlAllocPtr alloc;
 
     virDomainResctrlMonDefPtr *monitors;
     size_t nmonitors;
+
+    /* memory bandwidth feedback control, <memorytune> only */
+    virDomainMemorytuneTargetPtr targets;
+    size_t ntargets;
 };
 
 
@@ -2424,6 +2473,7 @@ struct _virDomainMemtune {
     int source; /* enum virDomainMemorySource */
     int access; /* enum virDomainMemoryAccess */
     int allocation; /* enum virDomainMemoryAllocation */
+    unsigned int allocation_threads; /* 0 if unset */
 
     virTristateBool discard;
 };
@@ -2556,7 +2606,7 @@ struct _virDomainDef {
     virDomainPerfDef perf;
 
     virDomainOSDef os;
-    char *emulator;
+    char *emulator; /* interned, see virStringIntern */
     /* Most {caps_,hyperv_,kvm_,}feature options utilize a virTristateSwitch
      * to handle support. A few assign specific data values to the option.
      * See virDomainDefFeaturesCheckABIStability() for details. */
@@ -2717,10 +2767,44 @@ struct _virDomainStateReason {
     int reason;
 };
 
+/* Lock manager activity, times are in microseconds */
+typedef struct _virDomainLockStats virDomainLockStats;
+typedef virDomainLockStats *virDomainLockStatsPtr;
+struct _virDomainLockStats {
+    unsigned long long acquires;
+    unsigned long long acquireFailed;
+    unsigned long long acquireBusy; /* failed because a lease was held elsewhere */
+    unsigned long long acquireTime;
+    unsigned long long acquireTimeMax;
+    unsigned long long releases;
+    unsigned long long releaseFailed;
+    unsigned long long releaseTime;
+    unsigned long long releaseTimeMax;
+};
+
+/* Immutable copy of the identity and state of a domain object which
+ * can be read without locking the object, see virDomainObjGetSummary */
+typedef struct _virDomainObjSummary virDomainObjSummary;
+typedef virDomainObjSummary *virDomainObjSummaryPtr;
+struct _virDomainObjSummary {
+    virObject parent;
+
+    virDomainDefPtr def; /* only name, uuid and id are filled in */
+    virDomainStateReason state;
+    bool removing;
+};
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(virDomainObjSummary, virObjectUnref);
+
 struct _virDomainObj {
     virObjectLockable parent;
     virCond cond;
 
+    /* The summary is replaced by virDomainObjUpdateSummary while the object
+     * is locked, but readers only need summaryLock */
+    virRWLock summaryLock;
+    virDomainObjSummaryPtr summary;
+
     pid_t pid;
     virDomainStateReason state;
 
@@ -2728,6 +2812,7 @@ struct _virDomainObj {
     unsigned int persistent : 1;
     unsigned int updated : 1;
     unsigned int removing : 1;
+    unsigned int saveDeferred : 1; /* status XML write pending in background */
 
     virDomainDefPtr def; /* The current definition */
     virDomainDefPtr newDef; /* New definition to activate at shutdown */
@@ -2745,6 +2830,11 @@ struct _virDomainObj {
 
     unsigned long long original_memlock; /* Original RLIMIT_MEMLOCK, zero if no
                                           * restore will be required later */
+
+    virDomainLockStats lockStats; /* updated by virDomainLock* APIs */
+
+    int indexedID; /* ID under which the domain is in the ID index of its
+                    * domain list, -1 if it isn't there */
 };
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(virDomainObj, virObjectUnref);
@@ -2990,6 +3080,8 @@ void virDomainGraphicsDefFree(virDomainGraphicsDefPtr def);
 const char *virDomainInputDefGetPath(virDomainInputDefPtr input);
 void virDomainInputDefFree(virDomainInputDefPtr def);
 virDomainDiskDefPtr virDomainDiskDefNew(virDomainXMLOptionPtr xmlopt);
+virDomainDiskDefPtr virDomainDiskDefCopy(const virDomainDiskDef *src,
+                                         virDomainXMLOptionPtr xmlopt);
 void virDomainDiskDefFree(virDomainDiskDefPtr def);
 void virDomainLeaseDefFree(virDomainLeaseDefPtr def);
 int virDomainDiskGetType(virDomainDiskDefPtr def);
@@ -3082,6 +3174,10 @@ virDomainGraphicsDefNew(virDomainXMLOptionPtr xmlopt);
 virDomainNetDefPtr
 virDomainNetDefNew(virDomainXMLOptionPtr xmlopt);
 
+virDomainNetDefPtr
+virDomainNetDefCopy(const virDomainNetDef *src,
+                    virDomainXMLOptionPtr xmlopt);
+
 virDomainDefPtr virDomainDefNew(void);
 
 void virDomainObjAssignDef(virDomainObjPtr domain,
@@ -3447,6 +3543,14 @@ int virDomainObjSave(virDomainObjPtr obj,
     G_GNUC_WARN_UNUSED_RESULT
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2)
     ATTRIBUTE_NONNULL(3);
+int virDomainObjSaveDeferred(virDomainObjPtr obj,
+                             virDomainXMLOptionPtr xmlopt,
+                             const char *statusDir)
+    G_GNUC_WARN_UNUSED_RESULT
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2)
+    ATTRIBUTE_NONNULL(3);
+void virDomainObjSaveCancel(virDomainObjPtr obj)
+    ATTRIBUTE_NONNULL(1);
 
 typedef void (*virDomainLoadConfigNotify)(virDomainObjPtr dom,
                                           int newDomain,
@@ -3503,6 +3607,12 @@ virDomainObjSetState(virDomainObjPtr obj, virDomainState state, int reason)
 virDomainState
 virDomainObjGetState(virDomainObjPtr obj, int *reason)
         ATTRIBUTE_NONNULL(1);
+void
+virDomainObjUpdateSummary(virDomainObjPtr obj)
+        ATTRIBUTE_NONNULL(1);
+virDomainObjSummaryPtr
+virDomainObjGetSummary(virDomainObjPtr obj)
+        ATTRIBUTE_NONNULL(1);
 
 virSecurityLabelDefPtr
 virDomainDefGetSecurityLabelDef(virDomainDefPtr def, const char *model);
@@ -3559,6 +3669,7 @@ VIR_ENUM_DECL(virDomainDiskTray);
 VIR_ENUM_DECL(virDomainDiskDiscard);
 VIR_ENUM_DECL(virDomainDiskDetectZeroes);
 VIR_ENUM_DECL(virDomainDiskModel);
+VIR_ENUM_DECL(virDomainDiskLatencyHistogram);
 VIR_ENUM_DECL(virDomainDiskMirrorState);
 VIR_ENUM_DECL(virDomainController);
 VIR_ENUM_DECL(virDomainControllerModelPCI);
@@ -57,6 +57,7 @@ static virClassPtr virDomainEventJobCompletedClass;
 static virClassPtr virDomainEventDeviceRemovalFailedClass;
 static virClassPtr virDomainEventMetadataChangeClass;
 static virClassPtr virDomainEventBlockThresholdClass;
+static virClassPtr virDomainEventMonitorSlowClass;
 
 static void virDomainEventDispose(void *obj);
 static void virDomainEventLifecycleDispose(void *obj);
@@ -79,6 +80,7 @@ static void virDomainEventJobCompletedDispose(void *obj);
 static void virDomainEventDeviceRemovalFailedDispose(void *obj);
 static void virDomainEventMetadataChangeDispose(void *obj);
 static void virDomainEventBlockThresholdDispose(void *obj);
+static void virDomainEventMonitorSlowDispose(void *obj);
 
 static void
 virDomainEventDispatchDefaultFunc(virConnectPtr conn,
@@ -287,6 +289,18 @@ struct _virDomainEventBlockThreshold {
 typedef struct _virDomainEventBlockThreshold virDomainEventBlockThreshold;
 typedef virDomainEventBlockThreshold *virDomainEventBlockThresholdPtr;
 
+struct _virDomainEventMonitorSlow {
+    virDomainEvent parent;
+
+    char *command;
+    unsigned long long elapsed;
+};
+typedef struct _virDomainEventMonitorSlow virDomainEventMonitorSlow;
+typedef virDomainEventMonitorSlow *virDomainEventMonitorSlowPtr;
+
+
+/* Number of freed instances of frequent event classes kept for reuse */
+#define VIR_DOMAIN_EVENT_POOL_SIZE 64
 
 static int
 virDomainEventsOnceInit(void)
@@ -333,6 +347,18 @@ virDomainEventsOnceInit(void)
         return -1;
     if (!VIR_CLASS_NEW(virDomainEventBlockThreshold, virDomainEventClass))
         return -1;
+    if (!VIR_CLASS_NEW(virDomainEventMonitorSlow, virDomainEventClass))
+        return -1;
+
+    /* Event storms create and free these at high rates */
+    virClassEnablePool(virDomainEventLifecycleClass, VIR_DOMAIN_EVENT_POOL_SIZE);
+    virClassEnablePool(virDomainEventIOErrorClass, VIR_DOMAIN_EVENT_POOL_SIZE);
+    virClassEnablePool(virDomainEventBlockJobClass, VIR_DOMAIN_EVENT_POOL_SIZE);
+    virClassEnablePool(virDomainEventBalloonChangeClass, VIR_DOMAIN_EVENT_POOL_SIZE);
+    virClassEnablePool(virDomainQemuMonitorEventClass, VIR_DOMAIN_EVENT_POOL_SIZE);
+    virClassEnablePool(virDomainEventTunableClass, VIR_DOMAIN_EVENT_POOL_SIZE);
+    virClassEnablePool(virDomainEventMigrationIterationClass, VIR_DOMAIN_EVENT_POOL_SIZE);
+    virClassEnablePool(virDomainEventBlockThresholdClass, VIR_DOMAIN_EVENT_POOL_SIZE);
     return 0;
 }
 
@@ -542,6 +568,16 @@ virDomainEventBlockThresholdDispose(void *obj)
 }
 
 
+static void
+virDomainEventMonitorSlowDispose(void *obj)
+{
+    virDomainEventMonitorSlowPtr event = obj;
+    VIR_DEBUG("obj=%p", event);
+
+    VIR_FREE(event->command);
+}
+
+
 static void *
 virDomainEventNew(virClassPtr klass,
                   int eventID,
@@ -1619,6 +1655,48 @@ virDomainEventBlockThresholdNewFromDom(virDomainPtr dom,
 }
 
 
+static virObjectEventPtr
+virDomainEventMonitorSlowNew(int id,
+                             const char *name,
+                             unsigned char *uuid,
+                             const char *command,
+                             unsigned long long elapsed)
+{
+    virDomainEventMonitorSlowPtr ev;
+
+    if (virDomainEventsInitialize() < 0)
+        return NULL;
+
+    if (!(ev = virDomainEventNew(virDomainEventMonitorSlowClass,
+                                 VIR_DOMAIN_EVENT_ID_MONITOR_SLOW,
+                                 id, name, uuid)))
+        return NULL;
+
+    ev->command = g_strdup(command);
+    ev->elapsed = elapsed;
+
+    return (virObjectEventPtr)ev;
+}
+
+virObjectEventPtr
+virDomainEventMonitorSlowNewFromObj(virDomainObjPtr obj,
+                                    const char *command,
+                                    unsigned long long elapsed)
+{
+    return virDomainEventMonitorSlowNew(obj->def->id, obj->def->name,
+                                        obj->def->uuid, command, elapsed);
+}
+
+virObjectEventPtr
+virDomainEventMonitorSlowNewFromDom(virDomainPtr dom,
+                                    const char *command,
+                                    unsigned long long elapsed)
+{
+    return virDomainEventMonitorSlowNew(dom->id, dom->name, dom->uuid,
+                                        command, elapsed);
+}
+
+
 static void
 virDomainEventDispatchDefaultFunc(virConnectPtr conn,
                                   virObjectEventPtr event,
@@ -1902,6 +1980,18 @@ virDomainEventDispatchDefaultFunc(virConnectPtr conn,
                                                               cbopaque);
             goto cleanup;
         }
+
+    case VIR_DOMAIN_EVENT_ID_MONITOR_SLOW:
+        {
+            virDomainEventMonitorSlowPtr monitorSlowEvent;
+
+            monitorSlowEvent = (virDomainEventMonitorSlowPtr)event;
+            ((virConnectDomainEventMonitorSlowCallback)cb)(conn, dom,
+                                                           monitorSlowEvent->command,
+                                                           monitorSlowEvent->elapsed,
+                                                           cbopaque);
+            goto cleanup;
+        }
     case VIR_DOMAIN_EVENT_ID_LAST:
         break;
     }
@@ -255,6 +255,16 @@ virDomainEventBlockThresholdNewFromDom(virDomainPtr dom,
                                        unsigned long long threshold,
                                        unsigned long long excess);
 
+virObjectEventPtr
+virDomainEventMonitorSlowNewFromObj(virDomainObjPtr obj,
+                                    const char *command,
+                                    unsigned long long elapsed);
+
+virObjectEventPtr
+virDomainEventMonitorSlowNewFromDom(virDomainPtr dom,
+                                    const char *command,
+                                    unsigned long long elapsed);
+
 int
 virDomainEventStateRegister(virConnectPtr conn,
                             virObjectEventStatePtr state,
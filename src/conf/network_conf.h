@@ -216,6 +216,11 @@ struct _virNetworkForwardIfDef {
         char *dev;      /* name of device */
     }device;
     int connections; /* how many guest interfaces are connected to this device? */
+
+    /* PF of a VF in a hostdev pool, looked up on first allocation */
+    bool pfKnown;
+    bool hasPF;
+    virPCIDeviceAddress pf;
 };
 
 typedef struct _virNetworkForwardPfDef virNetworkForwardPfDef;
@@ -3030,6 +3030,32 @@ virNWFilterRuleDefFormat(virBufferPtr buf,
 }
 
 
+/**
+ * virNWFilterRuleDefEqual:
+ * @a: a rule
+ * @b: another rule
+ *
+ * Returns true if both rules are the same, comparing them as they would
+ * be written out in the XML of their filters.
+ */
+bool
+virNWFilterRuleDefEqual(virNWFilterRuleDefPtr a,
+                        virNWFilterRuleDefPtr b)
+{
+    g_auto(virBuffer) bufa = VIR_BUFFER_INITIALIZER;
+    g_auto(virBuffer) bufb = VIR_BUFFER_INITIALIZER;
+
+    if (a == b)
+        return true;
+
+    virNWFilterRuleDefFormat(&bufa, a);
+    virNWFilterRuleDefFormat(&bufb, b);
+
+    return STREQ_NULLABLE(virBufferCurrentContent(&bufa),
+                          virBufferCurrentContent(&bufb));
+}
+
+
 static int
 virNWFilterEntryFormat(virBufferPtr buf,
                        virNWFilterEntryPtr entry)
@@ -606,6 +606,10 @@ virNWFilterRuleIsProtocolIPv6(virNWFilterRuleDefPtr rule);
 bool
 virNWFilterRuleIsProtocolEthernet(virNWFilterRuleDefPtr rule);
 
+bool
+virNWFilterRuleDefEqual(virNWFilterRuleDefPtr a,
+                        virNWFilterRuleDefPtr b);
+
 
 VIR_ENUM_DECL(virNWFilterRuleAction);
 VIR_ENUM_DECL(virNWFilterRuleDirection);
@@ -30,6 +30,7 @@
 #include "datatypes.h"
 #include "viralloc.h"
 #include "virerror.h"
+#include "virhash.h"
 #include "virobject.h"
 #include "virstring.h"
 
@@ -56,10 +57,24 @@ struct _virObjectEventCallback {
 typedef struct _virObjectEventCallback virObjectEventCallback;
 typedef virObjectEventCallback *virObjectEventCallbackPtr;
 
+/* Callbacks sharing an index key, ordered by callbackID */
+struct _virObjectEventCallbackBucket {
+    size_t count;
+    virObjectEventCallbackPtr *callbacks;
+};
+typedef struct _virObjectEventCallbackBucket virObjectEventCallbackBucket;
+typedef virObjectEventCallbackBucket *virObjectEventCallbackBucketPtr;
+
 struct _virObjectEventCallbackList {
     unsigned int nextID;
     size_t count;
     virObjectEventCallbackPtr *callbacks;
+
+    /* The callbacks indexed by event ID and the key of the object they
+     * filter on, callbacks for all objects are indexed by event ID only.
+     * This lets dispatching an event only look at callbacks which may
+     * match it. */
+    virHashTablePtr index;
 };
 
 struct _virObjectEventQueue {
@@ -144,6 +159,125 @@ virObjectEventCallbackFree(virObjectEventCallbackPtr cb)
     VIR_FREE(cb);
 }
 
+static void
+virObjectEventCallbackBucketFree(void *opaque)
+{
+    virObjectEventCallbackBucketPtr bucket = opaque;
+
+    g_free(bucket->callbacks);
+    g_free(bucket);
+}
+
+
+static char *
+virObjectEventCallbackIndexKey(int eventID,
+                               const char *key)
+{
+    if (key)
+        return g_strdup_printf("%d:%s", eventID, key);
+    return g_strdup_printf("%d", eventID);
+}
+
+
+static int
+virObjectEventCallbackIndexAdd(virObjectEventCallbackListPtr cbList,
+                               virObjectEventCallbackPtr cb)
+{
+    g_autofree char *name = NULL;
+    virObjectEventCallbackBucketPtr bucket;
+
+    name = virObjectEventCallbackIndexKey(cb->eventID,
+                                          cb->key_filter ? cb->key : NULL);
+
+    if (!(bucket = virHashLookup(cbList->index, name))) {
+        bucket = g_new0(virObjectEventCallbackBucket, 1);
+        if (virHashAddEntry(cbList->index, name, bucket) < 0) {
+            virObjectEventCallbackBucketFree(bucket);
+            return -1;
+        }
+    }
+
+    /* callback IDs are increasing, so appending keeps the order */
+    return VIR_APPEND_ELEMENT_COPY(bucket->callbacks, bucket->count, cb);
+}
+
+
+static void
+virObjectEventCallbackIndexRemove(virObjectEventCallbackListPtr cbList,
+                                  virObjectEventCallbackPtr cb)
+{
+    g_autofree char *name = NULL;
+    virObjectEventCallbackBucketPtr bucket;
+    size_t i;
+
+    name = virObjectEventCallbackIndexKey(cb->eventID,
+                                          cb->key_filter ? cb->key : NULL);
+
+    if (!(bucket = virHashLookup(cbList->index, name)))
+        return;
+
+    for (i = 0; i < bucket->count; i++) {
+        if (bucket->callbacks[i] == cb) {
+            VIR_DELETE_ELEMENT(bucket->callbacks, i, bucket->count);
+            break;
+        }
+    }
+
+    if (bucket->count == 0)
+        virHashRemoveEntry(cbList->index, name);
+}
+
+
+/*
+ * Fills @matches with the callbacks which may match @event, in the order
+ * they were registered. Whether they really do has to be checked by
+ * virObjectEventDispatchMatchCallback.
+ *
+ * Returns the number of callbacks in @matches.
+ */
+static size_t
+virObjectEventCallbackListFind(virObjectEventCallbackListPtr cbList,
+                               virObjectEventPtr event,
+                               virObjectEventCallbackPtr **matches)
+{
+    g_autofree char *anyName = NULL;
+    g_autofree char *keyName = NULL;
+    virObjectEventCallbackBucketPtr any;
+    virObjectEventCallbackBucketPtr keyed = NULL;
+    size_t nany;
+    size_t nkeyed;
+    size_t i = 0;
+    size_t j = 0;
+    size_t n = 0;
+
+    anyName = virObjectEventCallbackIndexKey(event->eventID, NULL);
+    any = virHashLookup(cbList->index, anyName);
+
+    if (event->meta.key) {
+        keyName = virObjectEventCallbackIndexKey(event->eventID,
+                                                 event->meta.key);
+        keyed = virHashLookup(cbList->index, keyName);
+    }
+
+    nany = any ? any->count : 0;
+    nkeyed = keyed ? keyed->count : 0;
+
+    *matches = g_new0(virObjectEventCallbackPtr, nany + nkeyed);
+
+    /* merge both buckets, to dispatch in the order of registration */
+    while (i < nany || j < nkeyed) {
+        if (j == nkeyed ||
+            (i < nany &&
+             any->callbacks[i]->callbackID < keyed->callbacks[j]->callbackID))
+            (*matches)[n++] = any->callbacks[i++];
+        else
+            (*matches)[n++] = keyed->callbacks[j++];
+    }
+
+    return n;
+}
+
+
 /**
  * virObjectEventCallbackListFree:
  * @list: event callback list head
@@ -164,6 +298,7 @@ virObjectEventCallbackListFree(virObjectEventCallbackListPtr list)
         VIR_FREE(list->callbacks[i]);
     }
     VIR_FREE(list->callbacks);
+    virHashFree(list->index);
     VIR_FREE(list);
 }
 
@@ -253,6 +388,7 @@ virObjectEventCallbackListRemoveID(virConnectPtr conn,
              * function won't end up with a double free error */
             if (doFreeCb && cb->freecb)
                 (*cb->freecb)(cb->opaque);
+            virObjectEventCallbackIndexRemove(cbList, cb);
             virObjectEventCallbackFree(cb);
             VIR_DELETE_ELEMENT(cbList->callbacks, i, cbList->count);
             return ret;
@@ -302,6 +438,7 @@ virObjectEventCallbackListPurgeMarked(virObjectEventCallbackListPtr cbList)
             virFreeCallback freecb = cbList->callbacks[n]->freecb;
             if (freecb)
                 (*freecb)(cbList->callbacks[n]->opaque);
+            virObjectEventCallbackIndexRemove(cbList, cbList->callbacks[n]);
             virObjectEventCallbackFree(cbList->callbacks[n]);
 
             VIR_DELETE_ELEMENT(cbList->callbacks, n, cbList->count);
@@ -443,9 +580,14 @@ virObjectEventCallbackListAddID(virConnectPtr conn,
     cb->filter_opaque = filter_opaque;
     cb->legacy = legacy;
 
-    if (VIR_APPEND_ELEMENT(cbList->callbacks, cbList->count, cb) < 0)
+    if (virObjectEventCallbackIndexAdd(cbList, cb) < 0)
         goto cleanup;
 
+    if (VIR_APPEND_ELEMENT(cbList->callbacks, cbList->count, cb) < 0) {
+        virObjectEventCallbackIndexRemove(cbList, cb);
+        goto cleanup;
+    }
+
     /* When additional filtering is being done, every client callback
      * is matched to exactly one server callback.  */
     if (filter) {
@@ -569,6 +711,9 @@ virObjectEventStateNew(void)
     if (VIR_ALLOC(state->callbacks) < 0)
         goto error;
 
+    if (!(state->callbacks->index = virHashNew(virObjectEventCallbackBucketFree)))
+        goto error;
+
     if (!(state->queue = virObjectEventQueueNew()))
         goto error;
 
@@ -684,14 +829,16 @@ virObjectEventStateDispatchCallbacks(virObjectEventStatePtr state,
                                      virObjectEventPtr event,
                                      virObjectEventCallbackListPtr callbacks)
 {
+    g_autofree virObjectEventCallbackPtr *matches = NULL;
     size_t i;
-    /* Cache this now, since we may be dropping the lock,
+    /* Collect candidates now, since we may be dropping the lock,
        and have more callbacks added. We're guaranteed not
        to have any removed */
-    size_t cbCount = callbacks->count;
+    size_t cbCount = virObjectEventCallbackListFind(callbacks, event,
+                                                    &matches);
 
     for (i = 0; i < cbCount; i++) {
-        virObjectEventCallbackPtr cb = callbacks->callbacks[i];
+        virObjectEventCallbackPtr cb = matches[i];
 
         if (!virObjectEventDispatchMatchCallback(event, cb))
             continue;
@@ -460,6 +460,95 @@ virStorageVolDefFree(virStorageVolDefPtr def)
 }
 
 
+virStorageVolJobPtr
+virStorageVolJobNew(int type,
+                    unsigned long long total)
+{
+    virStorageVolJobPtr job = g_new0(virStorageVolJob, 1);
+
+    if (virMutexInit(&job->lock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot initialize mutex"));
+        VIR_FREE(job);
+        return NULL;
+    }
+
+    job->type = type;
+    job->total = total;
+
+    return job;
+}
+
+
+void
+virStorageVolJobFree(virStorageVolJobPtr job)
+{
+    if (!job)
+        return;
+
+    virMutexDestroy(&job->lock);
+    VIR_FREE(job);
+}
+
+
+/**
+ * virStorageVolJobUpdate:
+ * @job: job to update, may be NULL
+ * @done: bytes processed since the last update
+ *
+ * Records progress of @job. Returns 0 to continue, or -1 with an error
+ * reported if the job was asked to stop.
+ */
+int
+virStorageVolJobUpdate(virStorageVolJobPtr job,
+                       unsigned long long done)
+{
+    bool abort;
+
+    if (!job)
+        return 0;
+
+    virMutexLock(&job->lock);
+    job->done += done;
+    abort = job->abort;
+    virMutexUnlock(&job->lock);
+
+    if (abort) {
+        virReportError(VIR_ERR_OPERATION_ABORTED, "%s",
+                       _("volume job was cancelled by client"));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+void
+virStorageVolJobAbort(virStorageVolJobPtr job)
+{
+    virMutexLock(&job->lock);
+    job->abort = true;
+    virMutexUnlock(&job->lock);
+}
+
+
+void
+virStorageVolJobGetInfo(virStorageVolJobPtr job,
+                        virStorageVolJobInfoPtr info)
+{
+    memset(info, 0, sizeof(*info));
+
+    if (!job)
+        return;
+
+    virMutexLock(&job->lock);
+    info->type = job->type;
+    info->total = job->total;
+    info->done = MIN(job->done, job->total);
+    virMutexUnlock(&job->lock);
+}
+
+
 void
 virStoragePoolSourceDeviceClear(virStoragePoolSourceDevicePtr dev)
 {
@@ -514,6 +603,7 @@ virStoragePoolDefFree(virStoragePoolDefPtr def)
     VIR_FREE(def->target.path);
     VIR_FREE(def->target.perms.label);
     VIR_FREE(def->refresh);
+    VIR_FREE(def->watermark);
     if (def->namespaceData && def->ns.free)
         (def->ns.free)(def->namespaceData);
     VIR_FREE(def);
@@ -823,6 +913,87 @@ virStoragePoolDefRefreshParse(xmlXPathContextPtr ctxt,
 }
 
 
+static int
+virStoragePoolDefWatermarkParsePercent(xmlXPathContextPtr ctxt,
+                                       const char *xpath,
+                                       unsigned int *percent)
+{
+    int rc;
+
+    if ((rc = virXPathUInt(xpath, ctxt, percent)) == -1)
+        return 0;
+
+    if (rc < 0 || *percent == 0 || *percent > 100) {
+        virReportError(VIR_ERR_XML_ERROR,
+                       _("invalid storage pool watermark percentage in '%s'"),
+                       xpath);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+virStoragePoolDefWatermarkParse(xmlXPathContextPtr ctxt,
+                                virStoragePoolDefPtr def)
+{
+    g_autofree virStoragePoolDefWatermarkPtr watermark = NULL;
+
+    if (!virXPathBoolean("boolean(./watermark)", ctxt))
+        return 0;
+
+    if (VIR_ALLOC(watermark) < 0)
+        return -1;
+
+    if (virStoragePoolDefWatermarkParsePercent(ctxt,
+                                               "string(./watermark/pool/@percent)",
+                                               &watermark->pool) < 0 ||
+        virStoragePoolDefWatermarkParsePercent(ctxt,
+                                               "string(./watermark/volume/@percent)",
+                                               &watermark->volume) < 0 ||
+        virStoragePoolDefWatermarkParsePercent(ctxt,
+                                               "string(./watermark/volume/@extend)",
+                                               &watermark->extend) < 0)
+        return -1;
+
+    if (watermark->extend && !watermark->volume) {
+        virReportError(VIR_ERR_XML_ERROR, "%s",
+                       _("storage pool watermark 'extend' requires a volume "
+                         "'percent'"));
+        return -1;
+    }
+
+    if (!watermark->pool && !watermark->volume)
+        return 0;
+
+    def->watermark = g_steal_pointer(&watermark);
+    return 0;
+}
+
+
+static void
+virStoragePoolDefWatermarkFormat(virBufferPtr buf,
+                                 virStoragePoolDefWatermarkPtr watermark)
+{
+    if (!watermark)
+        return;
+
+    virBufferAddLit(buf, "<watermark>\n");
+    virBufferAdjustIndent(buf, 2);
+    if (watermark->pool)
+        virBufferAsprintf(buf, "<pool percent='%u'/>\n", watermark->pool);
+    if (watermark->volume) {
+        virBufferAsprintf(buf, "<volume percent='%u'", watermark->volume);
+        if (watermark->extend)
+            virBufferAsprintf(buf, " extend='%u'", watermark->extend);
+        virBufferAddLit(buf, "/>\n");
+    }
+    virBufferAdjustIndent(buf, -2);
+    virBufferAddLit(buf, "</watermark>\n");
+}
+
+
 static void
 virStoragePoolDefRefreshFormat(virBufferPtr buf,
                                virStoragePoolDefRefreshPtr refresh)
@@ -1009,6 +1180,9 @@ virStoragePoolDefParseXML(xmlXPathContextPtr ctxt)
     if (virStoragePoolDefRefreshParse(ctxt, def) < 0)
         return NULL;
 
+    if (virStoragePoolDefWatermarkParse(ctxt, def) < 0)
+        return NULL;
+
     /* Make a copy of all the callback pointers here for easier use,
      * especially during the virStoragePoolSourceClear method */
     def->ns = options->ns;
@@ -1256,6 +1430,7 @@ virStoragePoolDefFormatBuf(virBufferPtr buf,
     }
 
     virStoragePoolDefRefreshFormat(buf, def->refresh);
+    virStoragePoolDefWatermarkFormat(buf, def->watermark);
 
     if (def->namespaceData && def->ns.format) {
         if ((def->ns.format)(buf, def->namespaceData) < 0)
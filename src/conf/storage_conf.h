@@ -76,6 +76,29 @@ typedef enum {
 
 VIR_ENUM_DECL(virStorageVolDefRefreshAllocation);
 
+/* Identity of the file behind a volume when it was last probed */
+typedef struct _virStorageVolStamp virStorageVolStamp;
+typedef virStorageVolStamp *virStorageVolStampPtr;
+struct _virStorageVolStamp {
+    unsigned long long dev;
+    unsigned long long ino;
+    unsigned long long size;
+    struct timespec mtime;
+    struct timespec ctime;
+};
+
+/* Progress of a long running operation on a volume, updated by the
+ * backend doing the work and read by the storage driver */
+typedef struct _virStorageVolJob virStorageVolJob;
+typedef virStorageVolJob *virStorageVolJobPtr;
+struct _virStorageVolJob {
+    virMutex lock;
+    int type; /* virStorageVolJobType */
+    unsigned long long total;
+    unsigned long long done;
+    bool abort;
+};
+
 typedef struct _virStorageVolDef virStorageVolDef;
 typedef virStorageVolDef *virStorageVolDefPtr;
 struct _virStorageVolDef {
@@ -85,9 +108,13 @@ struct _virStorageVolDef {
 
     bool building;
     unsigned int in_use;
+    virStorageVolJobPtr job; /* active job, owned by the storage driver */
 
     virStorageVolSource source;
     virStorageSource target;
+
+    virStorageVolStamp stamp; /* filled in by local pool refresh */
+    bool watermark; /* allocation is above the pool's volume watermark */
 };
 
 typedef struct _virStorageVolDefList virStorageVolDefList;
@@ -250,6 +277,17 @@ struct _virStoragePoolDefRefresh {
 };
 
 
+typedef struct _virStoragePoolDefWatermark virStoragePoolDefWatermark;
+typedef virStoragePoolDefWatermark *virStoragePoolDefWatermarkPtr;
+struct _virStoragePoolDefWatermark {
+    unsigned int pool; /* percent of the pool capacity, 0 if unset */
+    unsigned int volume; /* percent of the volume limit, 0 if unset */
+    unsigned int extend; /* percent sparse volumes grow by, 0 if unset */
+
+    bool crossed; /* runtime only, pool allocation is above the watermark */
+};
+
+
 typedef struct _virStoragePoolDef virStoragePoolDef;
 typedef virStoragePoolDef *virStoragePoolDefPtr;
 struct _virStoragePoolDef {
@@ -258,6 +296,7 @@ struct _virStoragePoolDef {
     int type; /* virStoragePoolType */
 
     virStoragePoolDefRefreshPtr refresh;
+    virStoragePoolDefWatermarkPtr watermark;
 
     unsigned long long allocation; /* bytes */
     unsigned long long capacity; /* bytes */
@@ -334,6 +373,25 @@ virStoragePoolSaveConfig(const char *configFile,
 void
 virStorageVolDefFree(virStorageVolDefPtr def);
 
+virStorageVolJobPtr
+virStorageVolJobNew(int type,
+                    unsigned long long total);
+
+void
+virStorageVolJobFree(virStorageVolJobPtr job);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(virStorageVolJob, virStorageVolJobFree);
+
+int
+virStorageVolJobUpdate(virStorageVolJobPtr job,
+                       unsigned long long done);
+
+void
+virStorageVolJobAbort(virStorageVolJobPtr job);
+
+void
+virStorageVolJobGetInfo(virStorageVolJobPtr job,
+                        virStorageVolJobInfoPtr info);
+
 void
 virStoragePoolSourceClear(virStoragePoolSourcePtr source);
 
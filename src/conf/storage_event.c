@@ -56,12 +56,24 @@ struct _virStoragePoolEventRefresh {
 typedef struct _virStoragePoolEventRefresh virStoragePoolEventRefresh;
 typedef virStoragePoolEventRefresh *virStoragePoolEventRefreshPtr;
 
+struct _virStoragePoolEventThreshold {
+    virStoragePoolEvent parent;
+
+    char *volume;
+    unsigned long long threshold;
+    unsigned long long excess;
+};
+typedef struct _virStoragePoolEventThreshold virStoragePoolEventThreshold;
+typedef virStoragePoolEventThreshold *virStoragePoolEventThresholdPtr;
+
 static virClassPtr virStoragePoolEventClass;
 static virClassPtr virStoragePoolEventLifecycleClass;
 static virClassPtr virStoragePoolEventRefreshClass;
+static virClassPtr virStoragePoolEventThresholdClass;
 static void virStoragePoolEventDispose(void *obj);
 static void virStoragePoolEventLifecycleDispose(void *obj);
 static void virStoragePoolEventRefreshDispose(void *obj);
+static void virStoragePoolEventThresholdDispose(void *obj);
 
 static int
 virStoragePoolEventsOnceInit(void)
@@ -75,6 +87,9 @@ virStoragePoolEventsOnceInit(void)
     if (!VIR_CLASS_NEW(virStoragePoolEventRefresh, virStoragePoolEventClass))
         return -1;
 
+    if (!VIR_CLASS_NEW(virStoragePoolEventThreshold, virStoragePoolEventClass))
+        return -1;
+
     return 0;
 }
 
@@ -104,6 +119,16 @@ virStoragePoolEventRefreshDispose(void *obj)
 }
 
 
+static void
+virStoragePoolEventThresholdDispose(void *obj)
+{
+    virStoragePoolEventThresholdPtr event = obj;
+    VIR_DEBUG("obj=%p", event);
+
+    g_free(event->volume);
+}
+
+
 static void
 virStoragePoolEventDispatchDefaultFunc(virConnectPtr conn,
                                        virObjectEventPtr event,
@@ -137,6 +162,19 @@ virStoragePoolEventDispatchDefaultFunc(virConnectPtr conn,
             goto cleanup;
         }
 
+    case VIR_STORAGE_POOL_EVENT_ID_THRESHOLD:
+        {
+            virStoragePoolEventThresholdPtr thresholdEvent;
+
+            thresholdEvent = (virStoragePoolEventThresholdPtr)event;
+            ((virConnectStoragePoolEventThresholdCallback)cb)(conn, pool,
+                                                              thresholdEvent->volume,
+                                                              thresholdEvent->threshold,
+                                                              thresholdEvent->excess,
+                                                              cbopaque);
+            goto cleanup;
+        }
+
     case VIR_STORAGE_POOL_EVENT_ID_LAST:
         break;
     }
@@ -295,3 +333,41 @@ virStoragePoolEventRefreshNew(const char *name,
 
     return (virObjectEventPtr)event;
 }
+
+
+/**
+ * virStoragePoolEventThresholdNew:
+ * @name: name of the storage pool object the event describes
+ * @uuid: uuid of the storage pool object the event describes
+ * @volume: name of the volume which crossed its watermark, NULL for the pool
+ * @threshold: the watermark in bytes
+ * @excess: bytes allocated beyond @threshold
+ *
+ * Create a new storage pool allocation threshold event.
+ */
+virObjectEventPtr
+virStoragePoolEventThresholdNew(const char *name,
+                                const unsigned char *uuid,
+                                const char *volume,
+                                unsigned long long threshold,
+                                unsigned long long excess)
+{
+    virStoragePoolEventThresholdPtr event;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+
+    if (virStoragePoolEventsInitialize() < 0)
+        return NULL;
+
+    virUUIDFormat(uuid, uuidstr);
+    if (!(event = virObjectEventNew(virStoragePoolEventThresholdClass,
+                                    virStoragePoolEventDispatchDefaultFunc,
+                                    VIR_STORAGE_POOL_EVENT_ID_THRESHOLD,
+                                    0, name, uuid, uuidstr)))
+        return NULL;
+
+    event->volume = g_strdup(volume);
+    event->threshold = threshold;
+    event->excess = excess;
+
+    return (virObjectEventPtr)event;
+}
@@ -59,3 +59,10 @@ virStoragePoolEventLifecycleNew(const char *name,
 virObjectEventPtr
 virStoragePoolEventRefreshNew(const char *name,
                               const unsigned char *uuid);
+
+virObjectEventPtr
+virStoragePoolEventThresholdNew(const char *name,
+                                const unsigned char *uuid,
+                                const char *volume,
+                                unsigned long long threshold,
+                                unsigned long long excess);
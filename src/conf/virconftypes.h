@@ -228,6 +228,9 @@ typedef virDomainMemballoonDef *virDomainMemballoonDefPtr;
 typedef struct _virDomainMemoryDef virDomainMemoryDef;
 typedef virDomainMemoryDef *virDomainMemoryDefPtr;
 
+typedef struct _virDomainMemorytuneTarget virDomainMemorytuneTarget;
+typedef virDomainMemorytuneTarget *virDomainMemorytuneTargetPtr;
+
 typedef struct _virDomainMemtune virDomainMemtune;
 typedef virDomainMemtune *virDomainMemtunePtr;
 
@@ -119,25 +119,22 @@ virDomainMomentForEachDescendant(virDomainMomentObjPtr moment,
 void
 virDomainMomentDropParent(virDomainMomentObjPtr moment)
 {
-    virDomainMomentObjPtr prev = NULL;
-    virDomainMomentObjPtr curr = NULL;
+    if (!moment->prev_sibling &&
+        moment->parent->first_child != moment) {
+        VIR_WARN("inconsistent moment relations");
+        return;
+    }
 
     moment->parent->nchildren--;
-    curr = moment->parent->first_child;
-    while (curr != moment) {
-        if (!curr) {
-            VIR_WARN("inconsistent moment relations");
-            return;
-        }
-        prev = curr;
-        curr = curr->sibling;
-    }
-    if (prev)
-        prev->sibling = moment->sibling;
+    if (moment->prev_sibling)
+        moment->prev_sibling->sibling = moment->sibling;
     else
         moment->parent->first_child = moment->sibling;
+    if (moment->sibling)
+        moment->sibling->prev_sibling = moment->prev_sibling;
     moment->parent = NULL;
     moment->sibling = NULL;
+    moment->prev_sibling = NULL;
 }
 
 
@@ -158,6 +155,9 @@ virDomainMomentSetParent(virDomainMomentObjPtr moment,
     moment->parent = parent;
     parent->nchildren++;
     moment->sibling = parent->first_child;
+    moment->prev_sibling = NULL;
+    if (parent->first_child)
+        parent->first_child->prev_sibling = moment;
     parent->first_child = moment;
 }
 
@@ -196,6 +196,8 @@ virDomainMomentMoveChildren(virDomainMomentObjPtr from,
         child->parent = to;
         if (!child->sibling) {
             child->sibling = to->first_child;
+            if (to->first_child)
+                to->first_child->prev_sibling = child;
             break;
         }
         child = child->sibling;
@@ -35,8 +35,8 @@ typedef bool (*virDomainMomentObjListFilter)(virDomainMomentObjPtr obj,
  * virDomainMomentObjList then maintains both a hash of these structs
  * (for quick lookup by name) and a metaroot (which is the parent of
  * all user-visible roots), so that all other objects always have a
- * valid parent object; the tree structure is currently maintained via
- * a linked list. */
+ * valid parent object; the children of each object form a doubly
+ * linked list so that any of them can be unlinked in O(1). */
 struct _virDomainMomentObj {
     /* Public field */
     virDomainMomentDefPtr def; /* non-NULL except for metaroot */
@@ -46,6 +46,7 @@ struct _virDomainMomentObj {
                                      virDomainMomentUpdateRelations, or
                                      after virDomainMomentDropParent */
     virDomainMomentObjPtr sibling; /* NULL if last child of parent */
+    virDomainMomentObjPtr prev_sibling; /* NULL if first child of parent */
     size_t nchildren;
     virDomainMomentObjPtr first_child; /* NULL if no children */
 };
@@ -31,6 +31,8 @@
 #include "virfile.h"
 #include "virlog.h"
 #include "virstring.h"
+#include "virhostcpu.h"
+#include "virthreadpool.h"
 #include "virdomainsnapshotobjlist.h"
 #include "virdomaincheckpointobjlist.h"
 
@@ -39,7 +41,21 @@
 VIR_LOG_INIT("conf.virdomainobjlist");
 
 static virClassPtr virDomainObjListClass;
+static virClassPtr virDomainObjListSnapshotClass;
 static void virDomainObjListDispose(void *obj);
+static void virDomainObjListSnapshotDispose(void *obj);
+
+
+/* Immutable array of all the domain objects of a list at one point in
+ * time, each holding a reference. */
+typedef struct _virDomainObjListSnapshot virDomainObjListSnapshot;
+typedef virDomainObjListSnapshot *virDomainObjListSnapshotPtr;
+struct _virDomainObjListSnapshot {
+    virObject parent;
+
+    virDomainObjPtr *vms;
+    size_t nvms;
+};
 
 
 struct _virDomainObjList {
@@ -52,6 +68,19 @@ struct _virDomainObjList {
     /* name -> virDomainObj mapping for O(1),
      * lockless lookup-by-name */
     virHashTable *objsName;
+
+    /* id string -> virDomainObj mapping for O(1) lookup-by-id. Drivers
+     * change IDs of domains via virDomainObjListSetID while holding just
+     * the domain lock, so the table has its own lock, which is never held
+     * while acquiring any other lock. */
+    virMutex idLock;
+    virHashTable *objsID;
+
+    /* Snapshot of @objs for readers which don't want to hold the list
+     * lock while walking the domains. Built on demand by readers and
+     * dropped by writers whenever a domain is added or removed. Read
+     * under the read lock, replaced atomically. */
+    virDomainObjListSnapshotPtr snapshot;
 };
 
 
@@ -60,6 +89,9 @@ static int virDomainObjListOnceInit(void)
     if (!VIR_CLASS_NEW(virDomainObjList, virClassForObjectRWLockable()))
         return -1;
 
+    if (!VIR_CLASS_NEW(virDomainObjListSnapshot, virClassForObject()))
+        return -1;
+
     return 0;
 }
 
@@ -75,8 +107,19 @@ virDomainObjListPtr virDomainObjListNew(void)
     if (!(doms = virObjectRWLockableNew(virDomainObjListClass)))
         return NULL;
 
-    if (!(doms->objs = virHashCreate(50, virObjectFreeHashData)) ||
-        !(doms->objsName = virHashCreate(50, virObjectFreeHashData))) {
+    if (virMutexInit(&doms->idLock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot initialize domain ID index mutex"));
+        virObjectUnref(doms);
+        return NULL;
+    }
+
+    if (!(doms->objs = virHashNewFlags(virObjectFreeHashData,
+                                       VIR_HASH_OPEN_ADDRESSING)) ||
+        !(doms->objsName = virHashNewFlags(virObjectFreeHashData,
+                                           VIR_HASH_OPEN_ADDRESSING)) ||
+        !(doms->objsID = virHashNewFlags(virObjectFreeHashData,
+                                         VIR_HASH_OPEN_ADDRESSING))) {
         virObjectUnref(doms);
         return NULL;
     }
@@ -91,23 +134,144 @@ static void virDomainObjListDispose(void *obj)
 
     virHashFree(doms->objs);
     virHashFree(doms->objsName);
+    virHashFree(doms->objsID);
+    virMutexDestroy(&doms->idLock);
+    virObjectUnref(doms->snapshot);
 }
 
 
-static int virDomainObjListSearchID(const void *payload,
-                                    const void *name G_GNUC_UNUSED,
-                                    const void *data)
+static void
+virDomainObjListSnapshotDispose(void *obj)
 {
-    virDomainObjPtr obj = (virDomainObjPtr)payload;
-    const int *id = data;
-    int want = 0;
+    virDomainObjListSnapshotPtr snapshot = obj;
 
-    virObjectLock(obj);
-    if (virDomainObjIsActive(obj) &&
-        obj->def->id == *id)
-        want = 1;
-    virObjectUnlock(obj);
-    return want;
+    virObjectListFreeCount(snapshot->vms, snapshot->nvms);
+}
+
+
+static int
+virDomainObjListSnapshotIterator(void *payload,
+                                 const void *name G_GNUC_UNUSED,
+                                 void *opaque)
+{
+    virDomainObjListSnapshotPtr snapshot = opaque;
+
+    snapshot->vms[snapshot->nvms++] = virObjectRef(payload);
+    return 0;
+}
+
+
+/**
+ * virDomainObjListGetSnapshot:
+ * @doms: domain object list
+ *
+ * Returns a referenced snapshot of all the domains in @doms. The list
+ * lock is held only while the current snapshot is looked up, or while
+ * a new one is built if a writer dropped it, so callers don't contend
+ * with each other or with writers while processing the domains.
+ */
+static virDomainObjListSnapshotPtr
+virDomainObjListGetSnapshot(virDomainObjListPtr doms)
+{
+    virDomainObjListSnapshotPtr snapshot;
+
+    virObjectRWLockRead(doms);
+
+    if (!(snapshot = virObjectRef(g_atomic_pointer_get(&doms->snapshot)))) {
+        if (!(snapshot = virObjectNew(virDomainObjListSnapshotClass))) {
+            virObjectRWUnlock(doms);
+            return NULL;
+        }
+
+        snapshot->vms = g_new0(virDomainObjPtr, virHashSize(doms->objs));
+        virHashForEach(doms->objs, virDomainObjListSnapshotIterator, snapshot);
+
+        /* another reader might have published its snapshot meanwhile;
+         * both are equal as writers are excluded by the read lock */
+        if (g_atomic_pointer_compare_and_exchange(&doms->snapshot, NULL,
+                                                  snapshot))
+            virObjectRef(snapshot);
+    }
+
+    virObjectRWUnlock(doms);
+    return snapshot;
+}
+
+
+/* The caller must hold a write lock on @doms. */
+static void
+virDomainObjListDropSnapshotLocked(virDomainObjListPtr doms)
+{
+    virObjectUnref(g_atomic_pointer_get(&doms->snapshot));
+    g_atomic_pointer_set(&doms->snapshot, NULL);
+}
+
+
+/* The caller must hold a lock on @obj. Removes @obj from the ID index
+ * of @doms if it's there. */
+static void
+virDomainObjListUnindexID(virDomainObjListPtr doms,
+                          virDomainObjPtr obj)
+{
+    char idstr[VIR_INT64_STR_BUFLEN];
+
+    if (obj->indexedID < 0)
+        return;
+
+    g_snprintf(idstr, sizeof(idstr), "%d", obj->indexedID);
+    obj->indexedID = -1;
+
+    virMutexLock(&doms->idLock);
+    /* the entry may belong to another domain which took over the ID */
+    if (virHashLookup(doms->objsID, idstr) == obj)
+        virHashRemoveEntry(doms->objsID, idstr);
+    virMutexUnlock(&doms->idLock);
+}
+
+
+/* The caller must hold a lock on @obj. Makes the ID index of @doms
+ * match the current ID of @obj. */
+static void
+virDomainObjListIndexID(virDomainObjListPtr doms,
+                        virDomainObjPtr obj)
+{
+    char idstr[VIR_INT64_STR_BUFLEN];
+
+    if (obj->indexedID == obj->def->id)
+        return;
+
+    virDomainObjListUnindexID(doms, obj);
+
+    if (!virDomainObjIsActive(obj))
+        return;
+
+    g_snprintf(idstr, sizeof(idstr), "%d", obj->def->id);
+
+    virMutexLock(&doms->idLock);
+    if (virHashUpdateEntry(doms->objsID, idstr, obj) == 0) {
+        virObjectRef(obj);
+        obj->indexedID = obj->def->id;
+    }
+    virMutexUnlock(&doms->idLock);
+}
+
+
+/**
+ * virDomainObjListSetID:
+ * @doms: Domain object list
+ * @obj: locked domain object in @doms
+ * @id: new ID of the domain, -1 once it's inactive
+ *
+ * Sets the ID of @obj when it starts or stops and updates the ID index
+ * of @doms so that virDomainObjListFindByID finds @obj by its new ID.
+ */
+void
+virDomainObjListSetID(virDomainObjListPtr doms,
+                      virDomainObjPtr obj,
+                      int id)
+{
+    obj->def->id = id;
+    virDomainObjListIndexID(doms, obj);
 }
 
 
@@ -115,19 +279,23 @@ virDomainObjPtr
 virDomainObjListFindByID(virDomainObjListPtr doms,
                          int id)
 {
+    char idstr[VIR_INT64_STR_BUFLEN];
     virDomainObjPtr obj;
 
-    virObjectRWLockRead(doms);
-    obj = virHashSearch(doms->objs, virDomainObjListSearchID, &id, NULL);
-    virObjectRef(obj);
-    virObjectRWUnlock(doms);
-    if (obj) {
-        virObjectLock(obj);
-        if (obj->removing) {
-            virObjectUnlock(obj);
-            virObjectUnref(obj);
-            obj = NULL;
-        }
+    g_snprintf(idstr, sizeof(idstr), "%d", id);
+
+    virMutexLock(&doms->idLock);
+    obj = virObjectRef(virHashLookup(doms->objsID, idstr));
+    virMutexUnlock(&doms->idLock);
+
+    if (!obj)
+        return NULL;
+
+    virObjectLock(obj);
+    if (obj->def->id != id || obj->removing) {
+        virObjectUnlock(obj);
+        virObjectUnref(obj);
+        return NULL;
     }
 
     return obj;
@@ -179,6 +347,44 @@ virDomainObjListFindByUUID(virDomainObjListPtr doms,
 }
 
 
+/**
+ * virDomainObjListFindSummaryByUUID:
+ * @doms: Domain object list
+ * @uuid: UUID to search the doms->objs table
+ *
+ * Lookup the @uuid in the doms->objs hash table and return a reference
+ * to the summary of the domain object without locking the object itself.
+ * Readers which only need the identity or the state of a domain don't have
+ * to wait for threads holding the lock on the domain object this way.
+ *
+ * Returns the summary or NULL if the domain doesn't exist, is being
+ * removed or has no summary, in which case callers should fall back
+ * to virDomainObjListFindByUUID for proper error reporting.
+ */
+virDomainObjSummaryPtr
+virDomainObjListFindSummaryByUUID(virDomainObjListPtr doms,
+                                  const unsigned char *uuid)
+{
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    virDomainObjPtr obj;
+    virDomainObjSummaryPtr summary = NULL;
+
+    virUUIDFormat(uuid, uuidstr);
+
+    virObjectRWLockRead(doms);
+    if ((obj = virHashLookup(doms->objs, uuidstr)))
+        summary = virDomainObjGetSummary(obj);
+    virObjectRWUnlock(doms);
+
+    if (summary && summary->removing) {
+        virObjectUnref(summary);
+        summary = NULL;
+    }
+
+    return summary;
+}
+
+
 static virDomainObjPtr
 virDomainObjListFindByNameLocked(virDomainObjListPtr doms,
                                  const char *name)
@@ -247,7 +453,9 @@ virDomainObjListAddObjLocked(virDomainObjListPtr doms,
     virUUIDFormat(vm->def->uuid, uuidstr);
     if (virHashAddEntry(doms->objs, uuidstr, vm) < 0)
         return -1;
+    virDomainObjUpdateSummary(vm);
     virObjectRef(vm);
+    virDomainObjListDropSnapshotLocked(doms);
 
     if (virHashAddEntry(doms->objsName, vm->def->name, vm) < 0) {
         virHashRemoveEntry(doms->objs, uuidstr);
@@ -255,6 +463,8 @@ virDomainObjListAddObjLocked(virDomainObjListPtr doms,
     }
     virObjectRef(vm);
 
+    virDomainObjListIndexID(doms, vm);
+
     return 0;
 }
 
@@ -323,6 +533,8 @@ virDomainObjListAddLocked(virDomainObjListPtr doms,
                               def,
                               !!(flags & VIR_DOMAIN_OBJ_LIST_ADD_LIVE),
                               oldDef);
+
+        virDomainObjListIndexID(doms, vm);
     } else {
         /* UUID does not match, but if a name matches, refuse it */
         if ((vm = virDomainObjListFindByNameLocked(doms, def->name))) {
@@ -382,6 +594,8 @@ virDomainObjListRemoveLocked(virDomainObjListPtr doms,
 
     virHashRemoveEntry(doms->objs, uuidstr);
     virHashRemoveEntry(doms->objsName, dom->def->name);
+    virDomainObjListUnindexID(doms, dom);
+    virDomainObjListDropSnapshotLocked(doms);
 }
 
 
@@ -403,6 +617,7 @@ virDomainObjListRemove(virDomainObjListPtr doms,
                        virDomainObjPtr dom)
 {
     dom->removing = true;
+    virDomainObjUpdateSummary(dom);
     virObjectRef(dom);
     virObjectUnlock(dom);
     virObjectRWLockWrite(doms);
@@ -473,6 +688,8 @@ virDomainObjListRename(virDomainObjListPtr doms,
     if (rc < 0)
         goto cleanup;
 
+    virDomainObjUpdateSummary(dom);
+
     ret = 0;
  cleanup:
     virObjectRWUnlock(doms);
@@ -481,101 +698,244 @@ virDomainObjListRename(virDomainObjListPtr doms,
 }
 
 
+/* Per file state of virDomainObjListLoadAllConfigs */
+typedef struct _virDomainObjListLoadData virDomainObjListLoadData;
+struct _virDomainObjListLoadData {
+    char *name;
+    virDomainDefPtr def;    /* parsed persistent config */
+    virDomainObjPtr obj;    /* parsed live status */
+    int autostart;
+};
+
+typedef struct _virDomainObjListLoadCtx virDomainObjListLoadCtx;
+struct _virDomainObjListLoadCtx {
+    virMutex lock;
+    virCond cond;
+    size_t pending;
+
+    const char *configDir;
+    const char *autostartDir;
+    bool liveStatus;
+    virDomainXMLOptionPtr xmlopt;
+};
+
+
+/* Minimum number of files for which parsing is spread over worker threads */
+#define VIR_DOMAIN_OBJ_LIST_LOAD_PARALLEL_MIN 4
+
+
+static int
+virDomainObjListParseConfig(virDomainObjListLoadCtx *ctx,
+                            virDomainObjListLoadData *data)
+{
+    g_autofree char *configFile = NULL;
+    g_autofree char *autostartLink = NULL;
+
+    if ((configFile = virDomainConfigFile(ctx->configDir, data->name)) == NULL)
+        return -1;
+    if (!(data->def = virDomainDefParseFile(configFile, ctx->xmlopt, NULL,
+                                            VIR_DOMAIN_DEF_PARSE_INACTIVE |
+                                            VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE |
+                                            VIR_DOMAIN_DEF_PARSE_ALLOW_POST_PARSE_FAIL)))
+        return -1;
+
+    if ((autostartLink = virDomainConfigFile(ctx->autostartDir, data->name)) == NULL)
+        return -1;
+
+    if ((data->autostart = virFileLinkPointsTo(autostartLink, configFile)) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+virDomainObjListParseStatus(virDomainObjListLoadCtx *ctx,
+                            virDomainObjListLoadData *data)
+{
+    g_autofree char *statusFile = NULL;
+
+    if ((statusFile = virDomainConfigFile(ctx->configDir, data->name)) == NULL)
+        return -1;
+
+    if (!(data->obj = virDomainObjParseFile(statusFile, ctx->xmlopt,
+                                            VIR_DOMAIN_DEF_PARSE_STATUS |
+                                            VIR_DOMAIN_DEF_PARSE_ACTUAL_NET |
+                                            VIR_DOMAIN_DEF_PARSE_PCI_ORIG_STATES |
+                                            VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE |
+                                            VIR_DOMAIN_DEF_PARSE_ALLOW_POST_PARSE_FAIL)))
+        return -1;
+
+    /* the object is added to the list from a different thread */
+    virObjectUnlock(data->obj);
+    return 0;
+}
+
+
+static void
+virDomainObjListParseFile(virDomainObjListLoadCtx *ctx,
+                          virDomainObjListLoadData *data)
+{
+    int rc;
+
+    VIR_INFO("Loading config file '%s.xml'", data->name);
+
+    if (ctx->liveStatus)
+        rc = virDomainObjListParseStatus(ctx, data);
+    else
+        rc = virDomainObjListParseConfig(ctx, data);
+
+    if (rc < 0) {
+        virDomainDefFree(data->def);
+        data->def = NULL;
+        virObjectUnref(data->obj);
+        data->obj = NULL;
+    }
+}
+
+
+static void
+virDomainObjListParseWorker(void *jobdata,
+                            void *opaque)
+{
+    virDomainObjListLoadCtx *ctx = opaque;
+
+    virDomainObjListParseFile(ctx, jobdata);
+
+    /* errors were logged when reported, don't leak them to the next job */
+    virResetLastError();
+
+    virMutexLock(&ctx->lock);
+    if (--ctx->pending == 0)
+        virCondSignal(&ctx->cond);
+    virMutexUnlock(&ctx->lock);
+}
+
+
+/*
+ * Parses all files described by @data. The parsing is independent for every
+ * file and CPU bound, so if there are enough files it's spread over a pool
+ * of worker threads sized by the number of host CPUs.
+ */
+static void
+virDomainObjListParseAll(virDomainObjListLoadCtx *ctx,
+                         virDomainObjListLoadData *data,
+                         size_t ndata)
+{
+    virThreadPoolPtr pool = NULL;
+    int ncpus = 1;
+    size_t i = 0;
+
+    if (ndata >= VIR_DOMAIN_OBJ_LIST_LOAD_PARALLEL_MIN &&
+        (ncpus = virHostCPUGetCount()) < 0) {
+        virResetLastError();
+        ncpus = 1;
+    }
+
+    if (ncpus > 1) {
+        if (virMutexInit(&ctx->lock) < 0)
+            goto sequential;
+
+        if (virCondInit(&ctx->cond) < 0) {
+            virMutexDestroy(&ctx->lock);
+            goto sequential;
+        }
+
+        if (!(pool = virThreadPoolNew(0, MIN(ncpus, ndata), 0,
+                                      virDomainObjListParseWorker, ctx))) {
+            virResetLastError();
+            virCondDestroy(&ctx->cond);
+            virMutexDestroy(&ctx->lock);
+            goto sequential;
+        }
+
+        virMutexLock(&ctx->lock);
+        for (; i < ndata; i++) {
+            if (virThreadPoolSendJob(pool, 0, &data[i]) < 0)
+                break;
+            ctx->pending++;
+        }
+
+        while (ctx->pending > 0)
+            ignore_value(virCondWait(&ctx->cond, &ctx->lock));
+        virMutexUnlock(&ctx->lock);
+
+        virThreadPoolFree(pool);
+        virCondDestroy(&ctx->cond);
+        virMutexDestroy(&ctx->lock);
+    }
+
+ sequential:
+    /* whatever wasn't handed over to the pool is parsed here */
+    for (; i < ndata; i++)
+        virDomainObjListParseFile(ctx, &data[i]);
+}
+
+
 static virDomainObjPtr
 virDomainObjListLoadConfig(virDomainObjListPtr doms,
                            virDomainXMLOptionPtr xmlopt,
-                           const char *configDir,
-                           const char *autostartDir,
-                           const char *name,
+                           virDomainObjListLoadData *data,
                            virDomainLoadConfigNotify notify,
                            void *opaque)
 {
-    char *configFile = NULL, *autostartLink = NULL;
-    virDomainDefPtr def = NULL;
     virDomainObjPtr dom;
-    int autostart;
     virDomainDefPtr oldDef = NULL;
 
-    if ((configFile = virDomainConfigFile(configDir, name)) == NULL)
-        goto error;
-    if (!(def = virDomainDefParseFile(configFile, xmlopt, NULL,
-                                      VIR_DOMAIN_DEF_PARSE_INACTIVE |
-                                      VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE |
-                                      VIR_DOMAIN_DEF_PARSE_ALLOW_POST_PARSE_FAIL)))
-        goto error;
-
-    if ((autostartLink = virDomainConfigFile(autostartDir, name)) == NULL)
-        goto error;
-
-    if ((autostart = virFileLinkPointsTo(autostartLink, configFile)) < 0)
-        goto error;
-
-    if (!(dom = virDomainObjListAddLocked(doms, def, xmlopt, 0, &oldDef)))
-        goto error;
+    if (!(dom = virDomainObjListAddLocked(doms, data->def, xmlopt, 0, &oldDef)))
+        return NULL;
+    data->def = NULL;
 
-    dom->autostart = autostart;
+    dom->autostart = data->autostart;
 
     if (notify)
         (*notify)(dom, oldDef == NULL, opaque);
 
     virDomainDefFree(oldDef);
-    VIR_FREE(configFile);
-    VIR_FREE(autostartLink);
     return dom;
-
- error:
-    VIR_FREE(configFile);
-    VIR_FREE(autostartLink);
-    virDomainDefFree(def);
-    return NULL;
 }
 
 
 static virDomainObjPtr
 virDomainObjListLoadStatus(virDomainObjListPtr doms,
-                           const char *statusDir,
-                           const char *name,
-                           virDomainXMLOptionPtr xmlopt,
+                           virDomainObjListLoadData *data,
                            virDomainLoadConfigNotify notify,
                            void *opaque)
 {
-    char *statusFile = NULL;
-    virDomainObjPtr obj = NULL;
+    virDomainObjPtr obj = data->obj;
     char uuidstr[VIR_UUID_STRING_BUFLEN];
 
-    if ((statusFile = virDomainConfigFile(statusDir, name)) == NULL)
-        goto error;
-
-    if (!(obj = virDomainObjParseFile(statusFile, xmlopt,
-                                      VIR_DOMAIN_DEF_PARSE_STATUS |
-                                      VIR_DOMAIN_DEF_PARSE_ACTUAL_NET |
-                                      VIR_DOMAIN_DEF_PARSE_PCI_ORIG_STATES |
-                                      VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE |
-                                      VIR_DOMAIN_DEF_PARSE_ALLOW_POST_PARSE_FAIL)))
-        goto error;
-
     virUUIDFormat(obj->def->uuid, uuidstr);
 
     if (virHashLookup(doms->objs, uuidstr) != NULL) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("unexpected domain %s already exists"),
                        obj->def->name);
-        goto error;
+        return NULL;
     }
 
-    if (virDomainObjListAddObjLocked(doms, obj) < 0)
-        goto error;
+    virObjectLock(obj);
+    if (virDomainObjListAddObjLocked(doms, obj) < 0) {
+        virObjectUnlock(obj);
+        return NULL;
+    }
+    data->obj = NULL;
 
     if (notify)
         (*notify)(obj, 1, opaque);
 
-    VIR_FREE(statusFile);
     return obj;
+}
 
- error:
-    virDomainObjEndAPI(&obj);
-    VIR_FREE(statusFile);
-    return NULL;
+
+static int
+virDomainObjListLoadDataCompare(const void *a,
+                                const void *b)
+{
+    const virDomainObjListLoadData *da = a;
+    const virDomainObjListLoadData *db = b;
+
+    return strcmp(da->name, db->name);
 }
 
 
@@ -588,53 +948,78 @@ virDomainObjListLoadAllConfigs(virDomainObjListPtr doms,
                                virDomainLoadConfigNotify notify,
                                void *opaque)
 {
+    virDomainObjListLoadCtx ctx = {
+        .configDir = configDir,
+        .autostartDir = autostartDir,
+        .liveStatus = liveStatus,
+        .xmlopt = xmlopt,
+    };
+    virDomainObjListLoadData *data = NULL;
+    size_t ndata = 0;
     DIR *dir;
     struct dirent *entry;
     int ret = -1;
     int rc;
+    size_t i;
 
     VIR_INFO("Scanning for configs in %s", configDir);
 
     if ((rc = virDirOpenIfExists(&dir, configDir)) <= 0)
         return rc;
 
-    virObjectRWLockWrite(doms);
-
     while ((ret = virDirRead(dir, &entry, configDir)) > 0) {
-        virDomainObjPtr dom;
-
         if (!virStringStripSuffix(entry->d_name, ".xml"))
             continue;
 
+        if (VIR_EXPAND_N(data, ndata, 1) < 0) {
+            ret = -1;
+            break;
+        }
+        data[ndata - 1].name = g_strdup(entry->d_name);
+    }
+
+    VIR_DIR_CLOSE(dir);
+
+    /* Files are parsed in parallel but added in the order of their names,
+     * so that the outcome for duplicate names or UUIDs doesn't depend on
+     * the directory order or on timing */
+    if (ndata > 0)
+        qsort(data, ndata, sizeof(*data), virDomainObjListLoadDataCompare);
+
+    if (ret == 0)
+        virDomainObjListParseAll(&ctx, data, ndata);
+
+    virObjectRWLockWrite(doms);
+
+    for (i = 0; i < ndata && ret == 0; i++) {
+        virDomainObjPtr dom = NULL;
+
         /* NB: ignoring errors, so one malformed config doesn't
            kill the whole process */
-        VIR_INFO("Loading config file '%s.xml'", entry->d_name);
-        if (liveStatus)
-            dom = virDomainObjListLoadStatus(doms,
-                                             configDir,
-                                             entry->d_name,
-                                             xmlopt,
-                                             notify,
-                                             opaque);
-        else
-            dom = virDomainObjListLoadConfig(doms,
-                                             xmlopt,
-                                             configDir,
-                                             autostartDir,
-                                             entry->d_name,
-                                             notify,
-                                             opaque);
+        if (liveStatus && data[i].obj)
+            dom = virDomainObjListLoadStatus(doms, &data[i], notify, opaque);
+        else if (!liveStatus && data[i].def)
+            dom = virDomainObjListLoadConfig(doms, xmlopt, &data[i],
+                                             notify, opaque);
+
         if (dom) {
             if (!liveStatus)
                 dom->persistent = 1;
             virDomainObjEndAPI(&dom);
         } else {
-            VIR_ERROR(_("Failed to load config for domain '%s'"), entry->d_name);
+            VIR_ERROR(_("Failed to load config for domain '%s'"), data[i].name);
         }
     }
 
-    VIR_DIR_CLOSE(dir);
     virObjectRWUnlock(doms);
+
+    for (i = 0; i < ndata; i++) {
+        g_free(data[i].name);
+        virDomainDefFree(data[i].def);
+        virObjectUnref(data[i].obj);
+    }
+    VIR_FREE(data);
+
     return ret;
 }
 
@@ -846,28 +1231,18 @@ virDomainObjListForEach(virDomainObjListPtr doms,
 
 #define MATCH(FLAG) (filter & (FLAG))
 static bool
-virDomainObjMatchFilter(virDomainObjPtr vm,
-                        unsigned int filter)
+virDomainObjMatchStateFilter(bool active,
+                             int st,
+                             unsigned int filter)
 {
     /* filter by active state */
     if (MATCH(VIR_CONNECT_LIST_DOMAINS_FILTERS_ACTIVE) &&
-        !((MATCH(VIR_CONNECT_LIST_DOMAINS_ACTIVE) &&
-           virDomainObjIsActive(vm)) ||
-          (MATCH(VIR_CONNECT_LIST_DOMAINS_INACTIVE) &&
-           !virDomainObjIsActive(vm))))
-        return false;
-
-    /* filter by persistence */
-    if (MATCH(VIR_CONNECT_LIST_DOMAINS_FILTERS_PERSISTENT) &&
-        !((MATCH(VIR_CONNECT_LIST_DOMAINS_PERSISTENT) &&
-           vm->persistent) ||
-          (MATCH(VIR_CONNECT_LIST_DOMAINS_TRANSIENT) &&
-           !vm->persistent)))
+        !((MATCH(VIR_CONNECT_LIST_DOMAINS_ACTIVE) && active) ||
+          (MATCH(VIR_CONNECT_LIST_DOMAINS_INACTIVE) && !active)))
         return false;
 
     /* filter by domain state */
     if (MATCH(VIR_CONNECT_LIST_DOMAINS_FILTERS_STATE)) {
-        int st = virDomainObjGetState(vm, NULL);
         if (!((MATCH(VIR_CONNECT_LIST_DOMAINS_RUNNING) &&
                st == VIR_DOMAIN_RUNNING) ||
               (MATCH(VIR_CONNECT_LIST_DOMAINS_PAUSED) &&
@@ -881,6 +1256,27 @@ virDomainObjMatchFilter(virDomainObjPtr vm,
             return false;
     }
 
+    return true;
+}
+
+
+static bool
+virDomainObjMatchFilter(virDomainObjPtr vm,
+                        unsigned int filter)
+{
+    if (!virDomainObjMatchStateFilter(virDomainObjIsActive(vm),
+                                      virDomainObjGetState(vm, NULL),
+                                      filter))
+        return false;
+
+    /* filter by persistence */
+    if (MATCH(VIR_CONNECT_LIST_DOMAINS_FILTERS_PERSISTENT) &&
+        !((MATCH(VIR_CONNECT_LIST_DOMAINS_PERSISTENT) &&
+           vm->persistent) ||
+          (MATCH(VIR_CONNECT_LIST_DOMAINS_TRANSIENT) &&
+           !vm->persistent)))
+        return false;
+
     /* filter by existence of managed save state */
     if (MATCH(VIR_CONNECT_LIST_DOMAINS_FILTERS_MANAGEDSAVE) &&
         !((MATCH(VIR_CONNECT_LIST_DOMAINS_MANAGEDSAVE) &&
@@ -917,24 +1313,6 @@ virDomainObjMatchFilter(virDomainObjPtr vm,
 #undef MATCH
 
 
-struct virDomainListData {
-    virDomainObjPtr *vms;
-    size_t nvms;
-};
-
-
-static int
-virDomainObjListCollectIterator(void *payload,
-                                const void *name G_GNUC_UNUSED,
-                                void *opaque)
-{
-    struct virDomainListData *data = opaque;
-
-    data->vms[data->nvms++] = virObjectRef(payload);
-    return 0;
-}
-
-
 static void
 virDomainObjListFilter(virDomainObjPtr **list,
                        size_t *nvms,
@@ -942,10 +1320,33 @@ virDomainObjListFilter(virDomainObjPtr **list,
                        virDomainObjListACLFilter filter,
                        unsigned int flags)
 {
+    /* filters which can be evaluated from the summary of a domain */
+    unsigned int summaryFilters = VIR_CONNECT_LIST_DOMAINS_FILTERS_ACTIVE |
+                                  VIR_CONNECT_LIST_DOMAINS_FILTERS_STATE;
+    bool useSummary = !(flags & VIR_CONNECT_LIST_DOMAINS_FILTERS_ALL &
+                        ~summaryFilters);
     size_t i = 0;
 
     while (i < *nvms) {
         virDomainObjPtr vm = (*list)[i];
+        g_autoptr(virDomainObjSummary) summary = NULL;
+
+        /* pollers listing domains don't need to wait for threads which
+         * hold the lock on a domain object for a long time */
+        if (useSummary && (summary = virDomainObjGetSummary(vm))) {
+            if (summary->removing ||
+                (filter && !filter(conn, summary->def)) ||
+                !virDomainObjMatchStateFilter(summary->def->id != -1,
+                                              summary->state.state,
+                                              flags)) {
+                virObjectUnref(vm);
+                VIR_DELETE_ELEMENT(*list, i, *nvms);
+                continue;
+            }
+
+            i++;
+            continue;
+        }
 
         virObjectLock(vm);
 
@@ -977,22 +1378,25 @@ virDomainObjListCollect(virDomainObjListPtr domlist,
                         virDomainObjListACLFilter filter,
                         unsigned int flags)
 {
-    struct virDomainListData data = { NULL, 0 };
+    virDomainObjListSnapshotPtr snapshot;
+    virDomainObjPtr *list;
+    size_t nlist;
+    size_t i;
 
-    virObjectRWLockRead(domlist);
-    sa_assert(domlist->objs);
-    if (VIR_ALLOC_N(data.vms, virHashSize(domlist->objs)) < 0) {
-        virObjectRWUnlock(domlist);
+    if (!(snapshot = virDomainObjListGetSnapshot(domlist)))
         return -1;
-    }
 
-    virHashForEach(domlist->objs, virDomainObjListCollectIterator, &data);
-    virObjectRWUnlock(domlist);
+    nlist = snapshot->nvms;
+    list = g_new0(virDomainObjPtr, nlist);
+    for (i = 0; i < nlist; i++)
+        list[i] = virObjectRef(snapshot->vms[i]);
 
-    virDomainObjListFilter(&data.vms, &data.nvms, conn, filter, flags);
+    virObjectUnref(snapshot);
 
-    *nvms = data.nvms;
-    *vms = data.vms;
+    virDomainObjListFilter(&list, &nlist, conn, filter, flags);
+
+    *nvms = nlist;
+    *vms = list;
 
     return 0;
 }
@@ -1079,10 +1483,17 @@ virDomainObjListExport(virDomainObjListPtr domlist,
 
         for (i = 0; i < nvms; i++) {
             virDomainObjPtr vm = vms[i];
-
-            virObjectLock(vm);
-            doms[i] = virGetDomain(conn, vm->def->name, vm->def->uuid, vm->def->id);
-            virObjectUnlock(vm);
+            g_autoptr(virDomainObjSummary) summary = NULL;
+
+            if ((summary = virDomainObjGetSummary(vm))) {
+                doms[i] = virGetDomain(conn, summary->def->name,
+                                       summary->def->uuid, summary->def->id);
+            } else {
+                virObjectLock(vm);
+                doms[i] = virGetDomain(conn, vm->def->name, vm->def->uuid,
+                                       vm->def->id);
+                virObjectUnlock(vm);
+            }
 
             if (!doms[i])
                 goto cleanup;
@@ -35,6 +35,9 @@ virDomainObjPtr virDomainObjListFindByUUID(virDomainObjListPtr doms,
                                            const unsigned char *uuid);
 virDomainObjPtr virDomainObjListFindByName(virDomainObjListPtr doms,
                                            const char *name);
+virDomainObjSummaryPtr
+virDomainObjListFindSummaryByUUID(virDomainObjListPtr doms,
+                                  const unsigned char *uuid);
 
 enum {
     VIR_DOMAIN_OBJ_LIST_ADD_LIVE = (1 << 0),
@@ -62,6 +65,10 @@ void virDomainObjListRemove(virDomainObjListPtr doms,
 void virDomainObjListRemoveLocked(virDomainObjListPtr doms,
                                   virDomainObjPtr dom);
 
+void virDomainObjListSetID(virDomainObjListPtr doms,
+                           virDomainObjPtr dom,
+                           int id);
+
 int virDomainObjListLoadAllConfigs(virDomainObjListPtr doms,
                                    const char *configDir,
                                    const char *autostartDir,
@@ -29,6 +29,7 @@
 #include "virhash.h"
 #include "virlog.h"
 #include "virstring.h"
+#include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_NETWORK
 
@@ -39,6 +40,11 @@ VIR_LOG_INIT("conf.virnetworkobj");
  * that big. */
 #define INIT_CLASS_ID_BITMAP_SIZE (1<<4)
 
+/* Port status files of a network are parsed by up to this many threads
+ * when there are at least VIR_NETWORK_OBJ_PORT_LOAD_PARALLEL_MIN of them */
+#define VIR_NETWORK_OBJ_PORT_LOAD_THREADS_MAX 8
+#define VIR_NETWORK_OBJ_PORT_LOAD_PARALLEL_MIN 64
+
 struct _virNetworkObj {
     virObjectLockable parent;
 
@@ -1861,6 +1867,74 @@ virNetworkObjPortForEach(virNetworkObjPtr obj,
 }
 
 
+typedef struct _virNetworkObjPortLoadEntry virNetworkObjPortLoadEntry;
+struct _virNetworkObjPortLoadEntry {
+    char *file;
+    virNetworkPortDefPtr portdef;
+};
+
+typedef struct _virNetworkObjPortLoadData virNetworkObjPortLoadData;
+struct _virNetworkObjPortLoadData {
+    virNetworkObjPortLoadEntry *entries;
+    size_t nentries;
+    int next; /* atomic, index of the next entry to parse */
+};
+
+
+static void
+virNetworkObjPortLoadWorker(void *opaque)
+{
+    virNetworkObjPortLoadData *data = opaque;
+    int i;
+
+    while ((i = g_atomic_int_add(&data->next, 1)) < (int) data->nentries) {
+        virNetworkObjPortLoadEntry *entry = &data->entries[i];
+
+        if (!(entry->portdef = virNetworkPortDefParseFile(entry->file))) {
+            VIR_WARN("Cannot parse port %s", entry->file);
+            virResetLastError();
+        }
+    }
+}
+
+
+/*
+ * Parses all port status files collected in @data. The files are
+ * independent of each other, so with many of them the parsing is spread
+ * over several threads. The calling thread does the rest of the work if
+ * no thread could be started.
+ */
+static void
+virNetworkObjPortLoadParse(virNetworkObjPortLoadData *data)
+{
+    g_autofree virThread *threads = NULL;
+    size_t nthreads = 0;
+    size_t nstarted = 0;
+    size_t i;
+
+    if (data->nentries >= VIR_NETWORK_OBJ_PORT_LOAD_PARALLEL_MIN)
+        nthreads = MIN(g_get_num_processors(), VIR_NETWORK_OBJ_PORT_LOAD_THREADS_MAX);
+
+    threads = g_new0(virThread, nthreads);
+
+    for (i = 0; i < nthreads; i++) {
+        if (virThreadCreateFull(&threads[nstarted], true,
+                                virNetworkObjPortLoadWorker,
+                                "net-port-load", false, data) < 0) {
+            VIR_WARN("failed to create network port load worker");
+            virResetLastError();
+            break;
+        }
+        nstarted++;
+    }
+
+    virNetworkObjPortLoadWorker(data);
+
+    for (i = 0; i < nstarted; i++)
+        virThreadJoin(&threads[i]);
+}
+
+
 static int
 virNetworkObjLoadAllPorts(virNetworkObjPtr net,
                           const char *stateDir)
@@ -1871,7 +1945,8 @@ virNetworkObjLoadAllPorts(virNetworkObjPtr net,
     int ret = -1;
     int rc;
     char uuidstr[VIR_UUID_STRING_BUFLEN];
-    g_autoptr(virNetworkPortDef) portdef = NULL;
+    virNetworkObjPortLoadData data = { 0 };
+    size_t i;
 
     if (!(dir = virNetworkObjGetPortStatusDir(net, stateDir)))
         goto cleanup;
@@ -1882,28 +1957,39 @@ virNetworkObjLoadAllPorts(virNetworkObjPtr net,
     }
 
     while ((rc = virDirRead(dh, &de, dir)) > 0) {
-        g_autofree char *file = NULL;
+        virNetworkObjPortLoadEntry entry = { 0 };
 
         if (!virStringStripSuffix(de->d_name, ".xml"))
             continue;
 
-        file = g_strdup_printf("%s/%s.xml", dir, de->d_name);
+        entry.file = g_strdup_printf("%s/%s.xml", dir, de->d_name);
+
+        if (VIR_APPEND_ELEMENT(data.entries, data.nentries, entry) < 0)
+            goto cleanup;
+    }
+
+    virNetworkObjPortLoadParse(&data);
+
+    for (i = 0; i < data.nentries; i++) {
+        virNetworkObjPortLoadEntry *entry = &data.entries[i];
 
-        portdef = virNetworkPortDefParseFile(file);
-        if (!portdef) {
-            VIR_WARN("Cannot parse port %s", file);
+        if (!entry->portdef)
             continue;
-        }
 
-        virUUIDFormat(portdef->uuid, uuidstr);
-        if (virHashAddEntry(net->ports, uuidstr, portdef) < 0)
+        virUUIDFormat(entry->portdef->uuid, uuidstr);
+        if (virHashAddEntry(net->ports, uuidstr, entry->portdef) < 0)
             goto cleanup;
 
-        portdef = NULL;
+        entry->portdef = NULL;
     }
 
     ret = 0;
  cleanup:
+    for (i = 0; i < data.nentries; i++) {
+        g_free(data.entries[i].file);
+        virNetworkPortDefFree(data.entries[i].portdef);
+    }
+    g_free(data.entries);
     VIR_DIR_CLOSE(dh);
     return ret;
 }
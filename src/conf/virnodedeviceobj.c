@@ -501,6 +501,68 @@ virNodeDeviceObjListAssignDef(virNodeDeviceObjListPtr devs,
 }
 
 
+/**
+ * virNodeDeviceObjListAssignDefs:
+ * @devs: list of node devices
+ * @defs: definitions to assign
+ * @ndefs: number of @defs
+ * @created: filled with true for each definition which added a new device
+ *
+ * Assigns all of @defs like virNodeDeviceObjListAssignDef does, but takes
+ * the list lock only once. The list takes ownership of the assigned
+ * definitions, definitions which can't be assigned are left in @defs,
+ * the others are cleared.
+ *
+ * Returns the number of assigned definitions.
+ */
+size_t
+virNodeDeviceObjListAssignDefs(virNodeDeviceObjListPtr devs,
+                               virNodeDeviceDefPtr *defs,
+                               size_t ndefs,
+                               bool *created)
+{
+    size_t nassigned = 0;
+    size_t i;
+
+    virObjectRWLockWrite(devs);
+
+    for (i = 0; i < ndefs; i++) {
+        virNodeDeviceDefPtr def = defs[i];
+        virNodeDeviceObjPtr obj;
+
+        created[i] = false;
+
+        if (!def)
+            continue;
+
+        if ((obj = virNodeDeviceObjListFindByNameLocked(devs, def->name))) {
+            virObjectLock(obj);
+            virNodeDeviceDefFree(obj->def);
+            obj->def = def;
+            virNodeDeviceObjEndAPI(&obj);
+        } else {
+            if (!(obj = virNodeDeviceObjNew()))
+                continue;
+
+            if (virHashAddEntry(devs->objs, def->name, obj) < 0) {
+                virNodeDeviceObjEndAPI(&obj);
+                continue;
+            }
+
+            obj->def = def;
+            virObjectUnlock(obj);
+            created[i] = true;
+        }
+
+        defs[i] = NULL;
+        nassigned++;
+    }
+
+    virObjectRWUnlock(devs);
+    return nassigned;
+}
+
+
 void
 virNodeDeviceObjListRemove(virNodeDeviceObjListPtr devs,
                            virNodeDeviceObjPtr obj)
@@ -76,6 +76,12 @@ virNodeDeviceObjPtr
 virNodeDeviceObjListAssignDef(virNodeDeviceObjListPtr devs,
                               virNodeDeviceDefPtr def);
 
+size_t
+virNodeDeviceObjListAssignDefs(virNodeDeviceObjListPtr devs,
+                               virNodeDeviceDefPtr *defs,
+                               size_t ndefs,
+                               bool *created);
+
 void
 virNodeDeviceObjListRemove(virNodeDeviceObjListPtr devs,
                            virNodeDeviceObjPtr dev);
@@ -431,6 +431,33 @@ virNWFilterObjListGetNames(virNWFilterObjListPtr nwfilters,
 }
 
 
+/**
+ * virNWFilterObjListGetChangedNames:
+ * @nwfilters: the filter list
+ *
+ * Returns a NULL terminated list with the names of the filters being
+ * redefined or removed, which bindings are rebuilt for.
+ */
+char **
+virNWFilterObjListGetChangedNames(virNWFilterObjListPtr nwfilters)
+{
+    VIR_AUTOSTRINGLIST names = g_new0(char *, nwfilters->count + 1);
+    size_t nnames = 0;
+    size_t i;
+
+    for (i = 0; i < nwfilters->count; i++) {
+        virNWFilterObjPtr obj = nwfilters->objs[i];
+
+        virNWFilterObjLock(obj);
+        if (obj->newDef || obj->wantRemoved)
+            names[nnames++] = g_strdup(obj->def->name);
+        virNWFilterObjUnlock(obj);
+    }
+
+    return g_steal_pointer(&names);
+}
+
+
 int
 virNWFilterObjListExport(virConnectPtr conn,
                          virNWFilterObjListPtr nwfilters,
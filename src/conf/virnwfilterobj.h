@@ -46,6 +46,9 @@ struct _virNWFilterDriverState {
     char *stateDir;
     char *configDir;
     char *bindingDir;
+
+    /* name of the tech driver instantiating the filters */
+    char *firewallBackend;
 };
 
 virNWFilterDefPtr
@@ -102,6 +105,9 @@ virNWFilterObjListGetNames(virNWFilterObjListPtr nwfilters,
                            char **const names,
                            int maxnames);
 
+char **
+virNWFilterObjListGetChangedNames(virNWFilterObjListPtr nwfilters);
+
 int
 virNWFilterObjListExport(virConnectPtr conn,
                          virNWFilterObjListPtr nwfilters,
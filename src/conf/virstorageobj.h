@@ -24,6 +24,7 @@
 #include "storage_conf.h"
 
 #include "capabilities.h"
+#include "virthreadpool.h"
 
 typedef struct _virStoragePoolObj virStoragePoolObj;
 typedef virStoragePoolObj *virStoragePoolObjPtr;
@@ -52,6 +53,17 @@ struct _virStorageDriverState {
 
     /* Immutable pointer, read only after initialized */
     virCapsPtr caps;
+
+    /* Immutable pointer, self-locking APIs. Runs asynchronous volume
+     * jobs */
+    virThreadPoolPtr volJobPool;
+
+    /* Checks allocation watermarks periodically, the flags and
+     * condition are protected by @lock */
+    virThread watermarkThread;
+    virCond watermarkCond;
+    bool watermarkThreadActive;
+    bool watermarkQuit;
 };
 
 typedef bool
@@ -30,6 +30,7 @@
 #include "virendian.h"
 #include "virstring.h"
 #include "virhostcpu.h"
+#include "virhash.h"
 
 #define VIR_FROM_THIS VIR_FROM_CPU
 
@@ -52,6 +53,7 @@ struct _virCPUx86Feature {
     char *name;
     virCPUx86Data data;
     bool migratable;
+    size_t index; /* position in virCPUx86Map features */
 };
 
 
@@ -146,6 +148,15 @@ struct _virCPUx86Model {
     virCPUx86Data data;
 };
 
+/* Features using a single CPUID leaf or MSR */
+typedef struct _virCPUx86FeatureIndex virCPUx86FeatureIndex;
+typedef virCPUx86FeatureIndex *virCPUx86FeatureIndexPtr;
+struct _virCPUx86FeatureIndex {
+    virCPUx86DataItem leaf; /* only the type and input registers are used */
+    virBitmapPtr features; /* indexes to virCPUx86Map features */
+    size_t offset; /* first word of the leaf in feature bit vectors */
+};
+
 typedef struct _virCPUx86Map virCPUx86Map;
 typedef virCPUx86Map *virCPUx86MapPtr;
 struct _virCPUx86Map {
@@ -157,6 +168,21 @@ struct _virCPUx86Map {
     virCPUx86ModelPtr *models;
     size_t nblockers;
     virCPUx86FeaturePtr *migrate_blockers;
+
+    /* lookup tables pointing to the lists above */
+    virHashTablePtr featuresByName;
+    virHashTablePtr modelsByName;
+    /* sorted by leaf, built once the whole map is loaded */
+    size_t nfeatureIndex;
+    virCPUx86FeatureIndexPtr featureIndex;
+
+    /* Registers of all CPUID leaves and MSRs used by features packed
+     * into bit vectors of nwords 64 bit words, see x86DataToBits.
+     * featureBits and modelBits contain a vector for each feature and
+     * model in the map. */
+    size_t nwords;
+    uint64_t *featureBits;
+    uint64_t *modelBits;
 };
 
 static virCPUx86MapPtr cpuMap;
@@ -364,14 +390,7 @@ static virCPUx86FeaturePtr
 x86FeatureFind(virCPUx86MapPtr map,
                const char *name)
 {
-    size_t i;
-
-    for (i = 0; i < map->nfeatures; i++) {
-        if (STREQ(map->features[i]->name, name))
-            return map->features[i];
-    }
-
-    return NULL;
+    return virHashLookup(map->featuresByName, name);
 }
 
 
@@ -431,13 +450,6 @@ virCPUx86DataSorter(const void *a, const void *b)
     return 0;
 }
 
-static int
-virCPUx86DataItemCmp(const virCPUx86DataItem *item1,
-                     const virCPUx86DataItem *item2)
-{
-    return virCPUx86DataSorter(item1, item2);
-}
-
 
 /* skips all zero CPUID leaves */
 static virCPUx86DataItemPtr
@@ -460,19 +472,16 @@ virCPUx86DataNext(virCPUx86DataIteratorPtr iterator)
 }
 
 
+/* items in virCPUx86Data are kept sorted by virCPUx86DataAddItem */
 static virCPUx86DataItemPtr
 virCPUx86DataGet(const virCPUx86Data *data,
                  const virCPUx86DataItem *item)
 {
-    size_t i;
-
-    for (i = 0; i < data->len; i++) {
-        virCPUx86DataItemPtr di = data->items + i;
-        if (virCPUx86DataItemCmp(di, item) == 0)
-            return di;
-    }
+    if (data->len == 0)
+        return NULL;
 
-    return NULL;
+    return bsearch(item, data->items, data->len,
+                   sizeof(virCPUx86DataItem), virCPUx86DataSorter);
 }
 
 static void
@@ -612,6 +621,143 @@ x86DataIsSubset(const virCPUx86Data *data,
 }
 
 
+static int
+virCPUx86FeatureIndexSorter(const void *a, const void *b)
+{
+    const virCPUx86FeatureIndex *ia = a;
+    const virCPUx86FeatureIndex *ib = b;
+
+    return virCPUx86DataSorter(&ia->leaf, &ib->leaf);
+}
+
+
+/*
+ * Returns indexes of features in @map which use any of the CPUID leaves
+ * or MSRs present in @data. Features not listed can't be contained in
+ * @data, which spares checking all of them.
+ */
+static virBitmapPtr
+x86DataFeatureCandidates(const virCPUx86Data *data,
+                         virCPUx86MapPtr map)
+{
+    virBitmapPtr candidates = virBitmapNew(map->nfeatures);
+    virCPUx86DataIterator iter;
+    virCPUx86DataItemPtr item;
+
+    virCPUx86DataIteratorInit(&iter, data);
+    while ((item = virCPUx86DataNext(&iter))) {
+        virCPUx86FeatureIndex key = { .leaf = *item };
+        virCPUx86FeatureIndexPtr idx;
+
+        if ((idx = bsearch(&key, map->featureIndex, map->nfeatureIndex,
+                           sizeof(virCPUx86FeatureIndex),
+                           virCPUx86FeatureIndexSorter)))
+            ignore_value(virBitmapUnion(candidates, idx->features));
+    }
+
+    return candidates;
+}
+
+
+/*
+ * Converts @data into a bit vector. Each CPUID leaf used by any feature
+ * in @map takes two words, one for EAX and EBX and one for ECX and EDX,
+ * and each MSR takes one word for EAX and EDX. Leaves unknown to @map
+ * are ignored as they can't contain any feature.
+ */
+static void
+x86DataToBits(const virCPUx86Data *data,
+              virCPUx86MapPtr map,
+              uint64_t *bits)
+{
+    virCPUx86DataIterator iter;
+    virCPUx86DataItemPtr item;
+
+    memset(bits, 0, map->nwords * sizeof(*bits));
+
+    virCPUx86DataIteratorInit(&iter, data);
+    while ((item = virCPUx86DataNext(&iter))) {
+        virCPUx86FeatureIndex key = { .leaf = *item };
+        virCPUx86FeatureIndexPtr idx;
+
+        if (!(idx = bsearch(&key, map->featureIndex, map->nfeatureIndex,
+                            sizeof(virCPUx86FeatureIndex),
+                            virCPUx86FeatureIndexSorter)))
+            continue;
+
+        switch (item->type) {
+        case VIR_CPU_X86_DATA_CPUID:
+            bits[idx->offset] |= item->data.cpuid.eax |
+                                 (uint64_t) item->data.cpuid.ebx << 32;
+            bits[idx->offset + 1] |= item->data.cpuid.ecx |
+                                     (uint64_t) item->data.cpuid.edx << 32;
+            break;
+
+        case VIR_CPU_X86_DATA_MSR:
+            bits[idx->offset] |= item->data.msr.eax |
+                                 (uint64_t) item->data.msr.edx << 32;
+            break;
+
+        case VIR_CPU_X86_DATA_NONE:
+        default:
+            break;
+        }
+    }
+}
+
+
+static bool
+x86BitsIsSubset(const uint64_t *bits,
+                const uint64_t *subset,
+                size_t nwords)
+{
+    size_t i;
+
+    for (i = 0; i < nwords; i++) {
+        if (subset[i] & ~bits[i])
+            return false;
+    }
+
+    return true;
+}
+
+
+static void
+x86BitsSubtract(uint64_t *bits,
+                const uint64_t *subtrahend,
+                size_t nwords)
+{
+    size_t i;
+
+    for (i = 0; i < nwords; i++)
+        bits[i] &= ~subtrahend[i];
+}
+
+
+/*
+ * Counts the features x86DataToCPUFeatures would find in @bits, which
+ * are cleared in the process.
+ */
+static size_t
+x86BitsCountFeatures(uint64_t *bits,
+                     virCPUx86MapPtr map)
+{
+    size_t count = 0;
+    size_t i;
+
+    for (i = 0; i < map->nfeatures; i++) {
+        const uint64_t *feature = map->featureBits + i * map->nwords;
+
+        if (x86BitsIsSubset(bits, feature, map->nwords)) {
+            x86BitsSubtract(bits, feature, map->nwords);
+            count++;
+        }
+    }
+
+    return count;
+}
+
+
 /* also removes all detected features from data */
 static int
 x86DataToCPUFeatures(virCPUDefPtr cpu,
@@ -619,9 +765,10 @@ x86DataToCPUFeatures(virCPUDefPtr cpu,
                      virCPUx86Data *data,
                      virCPUx86MapPtr map)
 {
-    size_t i;
+    g_autoptr(virBitmap) candidates = x86DataFeatureCandidates(data, map);
+    ssize_t i = -1;
 
-    for (i = 0; i < map->nfeatures; i++) {
+    while ((i = virBitmapNextSetBit(candidates, i)) >= 0) {
         virCPUx86FeaturePtr feature = map->features[i];
         if (x86DataIsSubset(data, &feature->data)) {
             x86DataSubtract(data, &feature->data);
@@ -956,14 +1103,9 @@ x86FeatureIsMigratable(const char *name,
                        void *cpu_map)
 {
     virCPUx86MapPtr map = cpu_map;
-    size_t i;
+    virCPUx86FeaturePtr feature = x86FeatureFind(map, name);
 
-    for (i = 0; i < map->nblockers; i++) {
-        if (STREQ(name, map->migrate_blockers[i]->name))
-            return false;
-    }
-
-    return true;
+    return !feature || feature->migratable;
 }
 
 
@@ -973,12 +1115,13 @@ x86FeatureNames(virCPUx86MapPtr map,
                 virCPUx86Data *data)
 {
     g_auto(virBuffer) ret = VIR_BUFFER_INITIALIZER;
+    g_autoptr(virBitmap) candidates = x86DataFeatureCandidates(data, map);
     bool first = true;
-    size_t i;
+    ssize_t i = -1;
 
     virBufferAdd(&ret, "", 0);
 
-    for (i = 0; i < map->nfeatures; i++) {
+    while ((i = virBitmapNextSetBit(candidates, i)) >= 0) {
         virCPUx86FeaturePtr feature = map->features[i];
         if (x86DataIsSubset(data, &feature->data)) {
             if (!first)
@@ -1121,6 +1264,10 @@ x86FeatureParse(xmlXPathContextPtr ctxt,
                                 feature) < 0)
         return -1;
 
+    if (virHashAddEntry(map->featuresByName, feature->name, feature) < 0)
+        return -1;
+
+    feature->index = map->nfeatures;
     if (VIR_APPEND_ELEMENT(map->features, map->nfeatures, feature) < 0)
         return -1;
 
@@ -1265,14 +1412,7 @@ static virCPUx86ModelPtr
 x86ModelFind(virCPUx86MapPtr map,
              const char *name)
 {
-    size_t i;
-
-    for (i = 0; i < map->nmodels; i++) {
-        if (STREQ(map->models[i]->name, name))
-            return map->models[i];
-    }
-
-    return NULL;
+    return virHashLookup(map->modelsByName, name);
 }
 
 
@@ -1631,6 +1771,9 @@ x86ModelParse(xmlXPathContextPtr ctxt,
     if (x86ModelParseFeatures(model, ctxt, map) < 0)
         return -1;
 
+    if (virHashAddEntry(map->modelsByName, model->name, model) < 0)
+        return -1;
+
     if (VIR_APPEND_ELEMENT(map->models, map->nmodels, model) < 0)
         return -1;
 
@@ -1646,6 +1789,15 @@ x86MapFree(virCPUx86MapPtr map)
     if (!map)
         return;
 
+    virHashFree(map->featuresByName);
+    virHashFree(map->modelsByName);
+
+    for (i = 0; i < map->nfeatureIndex; i++)
+        virBitmapFree(map->featureIndex[i].features);
+    g_free(map->featureIndex);
+    g_free(map->featureBits);
+    g_free(map->modelBits);
+
     for (i = 0; i < map->nfeatures; i++)
         x86FeatureFree(map->features[i]);
     g_free(map->features);
@@ -1668,6 +1820,66 @@ x86MapFree(virCPUx86MapPtr map)
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(virCPUx86Map, x86MapFree);
 
 
+static int
+x86MapIndexFeatures(virCPUx86MapPtr map)
+{
+    size_t i;
+
+    for (i = 0; i < map->nfeatures; i++) {
+        virCPUx86DataIterator iter;
+        virCPUx86DataItemPtr item;
+
+        virCPUx86DataIteratorInit(&iter, &map->features[i]->data);
+        while ((item = virCPUx86DataNext(&iter))) {
+            virCPUx86FeatureIndex key = { .leaf = *item };
+            virCPUx86FeatureIndexPtr idx;
+
+            if (!(idx = bsearch(&key, map->featureIndex, map->nfeatureIndex,
+                                sizeof(virCPUx86FeatureIndex),
+                                virCPUx86FeatureIndexSorter))) {
+                key.features = virBitmapNew(map->nfeatures);
+
+                if (VIR_APPEND_ELEMENT_COPY(map->featureIndex,
+                                            map->nfeatureIndex, key) < 0) {
+                    virBitmapFree(key.features);
+                    return -1;
+                }
+
+                qsort(map->featureIndex, map->nfeatureIndex,
+                      sizeof(virCPUx86FeatureIndex),
+                      virCPUx86FeatureIndexSorter);
+
+                idx = bsearch(&key, map->featureIndex, map->nfeatureIndex,
+                              sizeof(virCPUx86FeatureIndex),
+                              virCPUx86FeatureIndexSorter);
+            }
+
+            ignore_value(virBitmapSetBit(idx->features, i));
+        }
+    }
+
+    for (i = 0; i < map->nfeatureIndex; i++) {
+        map->featureIndex[i].offset = map->nwords;
+        if (map->featureIndex[i].leaf.type == VIR_CPU_X86_DATA_CPUID)
+            map->nwords += 2;
+        else
+            map->nwords += 1;
+    }
+
+    map->featureBits = g_new0(uint64_t, map->nfeatures * map->nwords);
+    for (i = 0; i < map->nfeatures; i++)
+        x86DataToBits(&map->features[i]->data, map,
+                      map->featureBits + i * map->nwords);
+
+    map->modelBits = g_new0(uint64_t, map->nmodels * map->nwords);
+    for (i = 0; i < map->nmodels; i++)
+        x86DataToBits(&map->models[i]->data, map,
+                      map->modelBits + i * map->nwords);
+
+    return 0;
+}
+
+
 static virCPUx86MapPtr
 virCPUx86LoadMap(void)
 {
@@ -1675,9 +1887,16 @@ virCPUx86LoadMap(void)
 
     map = g_new0(virCPUx86Map, 1);
 
+    if (!(map->featuresByName = virHashNew(NULL)) ||
+        !(map->modelsByName = virHashNew(NULL)))
+        return NULL;
+
     if (cpuMapLoad("x86", x86VendorParse, x86FeatureParse, x86ModelParse, map) < 0)
         return NULL;
 
+    if (x86MapIndexFeatures(map) < 0)
+        return NULL;
+
     return g_steal_pointer(&map);
 }
 
@@ -1997,42 +2216,38 @@ virCPUx86Compare(virCPUDefPtr host,
  */
 static int
 x86DecodeUseCandidate(virCPUx86ModelPtr current,
-                      virCPUDefPtr cpuCurrent,
+                      size_t nfeaturesCurrent,
                       virCPUx86ModelPtr candidate,
-                      virCPUDefPtr cpuCandidate,
+                      size_t nfeaturesCandidate,
+                      size_t ndisabledCandidate,
+                      virCPUType type,
                       uint32_t signature,
                       const char *preferred)
 {
-    if (cpuCandidate->type == VIR_CPU_TYPE_HOST &&
+    if (type == VIR_CPU_TYPE_HOST &&
         !candidate->decodeHost) {
         VIR_DEBUG("%s is not supposed to be used for host CPU definition",
-                  cpuCandidate->model);
+                  candidate->name);
         return 0;
     }
 
-    if (cpuCandidate->type == VIR_CPU_TYPE_GUEST &&
+    if (type == VIR_CPU_TYPE_GUEST &&
         !candidate->decodeGuest) {
         VIR_DEBUG("%s is not supposed to be used for guest CPU definition",
-                  cpuCandidate->model);
+                  candidate->name);
         return 0;
     }
 
-    if (cpuCandidate->type == VIR_CPU_TYPE_HOST) {
-        size_t i;
-        for (i = 0; i < cpuCandidate->nfeatures; i++) {
-            if (cpuCandidate->features[i].policy == VIR_CPU_FEATURE_DISABLE)
-                return 0;
-            cpuCandidate->features[i].policy = -1;
-        }
-    }
+    if (type == VIR_CPU_TYPE_HOST && ndisabledCandidate > 0)
+        return 0;
 
-    if (preferred && STREQ(cpuCandidate->model, preferred)) {
-        VIR_DEBUG("%s is the preferred model", cpuCandidate->model);
+    if (preferred && STREQ(candidate->name, preferred)) {
+        VIR_DEBUG("%s is the preferred model", candidate->name);
         return 2;
     }
 
-    if (!cpuCurrent) {
-        VIR_DEBUG("%s is better than nothing", cpuCandidate->model);
+    if (!current) {
+        VIR_DEBUG("%s is better than nothing", candidate->name);
         return 1;
     }
 
@@ -2044,13 +2259,13 @@ x86DecodeUseCandidate(virCPUx86ModelPtr current,
         virCPUx86SignaturesMatch(current->signatures, signature) &&
         !virCPUx86SignaturesMatch(candidate->signatures, signature)) {
         VIR_DEBUG("%s differs in signature from matching %s",
-                  cpuCandidate->model, cpuCurrent->model);
+                  candidate->name, current->name);
         return 0;
     }
 
-    if (cpuCurrent->nfeatures > cpuCandidate->nfeatures) {
+    if (nfeaturesCurrent > nfeaturesCandidate) {
         VIR_DEBUG("%s results in shorter feature list than %s",
-                  cpuCandidate->model, cpuCurrent->model);
+                  candidate->name, current->name);
         return 1;
     }
 
@@ -2060,12 +2275,12 @@ x86DecodeUseCandidate(virCPUx86ModelPtr current,
     if (signature &&
         virCPUx86SignaturesMatch(candidate->signatures, signature) &&
         !virCPUx86SignaturesMatch(current->signatures, signature)) {
-        VIR_DEBUG("%s provides matching signature", cpuCandidate->model);
+        VIR_DEBUG("%s provides matching signature", candidate->name);
         return 1;
     }
 
     VIR_DEBUG("%s does not result in shorter feature list than %s",
-              cpuCandidate->model, cpuCurrent->model);
+              candidate->name, current->name);
     return 0;
 }
 
@@ -2114,12 +2329,16 @@ x86Decode(virCPUDefPtr cpu,
 {
     virCPUx86MapPtr map;
     virCPUx86ModelPtr candidate;
-    virCPUDefPtr cpuCandidate;
     virCPUx86ModelPtr model = NULL;
+    size_t nfeatures = 0;
     g_autoptr(virCPUDef) cpuModel = NULL;
     g_auto(virCPUx86Data) data = VIR_CPU_X86_DATA_INIT;
+    g_autofree uint64_t *dataBits = NULL;
+    g_autofree uint64_t *added = NULL;
+    g_autofree uint64_t *removed = NULL;
     virCPUx86VendorPtr vendor;
     virDomainCapsCPUModelPtr hvModel = NULL;
+    virDomainCapsCPUModelPtr modelHvModel = NULL;
     g_autofree char *sigs = NULL;
     uint32_t signature;
     unsigned int sigFamily;
@@ -2142,10 +2361,25 @@ x86Decode(virCPUDefPtr cpu,
 
     x86DataFilterTSX(&data, vendor, map);
 
+    /* Candidate models are compared using the number of features they
+     * would need to be added or removed to match the data. The counts
+     * are computed on bit vectors and the CPU definition is only built
+     * for the selected model.
+     */
+    dataBits = g_new0(uint64_t, map->nwords);
+    added = g_new0(uint64_t, map->nwords);
+    removed = g_new0(uint64_t, map->nwords);
+    x86DataToBits(&data, map, dataBits);
+
     /* Walk through the CPU models in reverse order to check newest
      * models first.
      */
     for (i = map->nmodels - 1; i >= 0; i--) {
+        const uint64_t *modelBits = map->modelBits + i * map->nwords;
+        size_t nadded;
+        size_t nremoved;
+        size_t j;
+
         candidate = map->models[i];
         if (models &&
             !(hvModel = virDomainCapsCPUModelsGet(models, candidate->name))) {
@@ -2176,29 +2410,59 @@ x86Decode(virCPUDefPtr cpu,
             continue;
         }
 
-        if (!(cpuCandidate = x86DataToCPU(&data, candidate, map, hvModel)))
-            return -1;
-        cpuCandidate->type = cpu->type;
+        /* the same as x86DataToCPU does with virCPUx86Data */
+        for (j = 0; j < map->nwords; j++) {
+            added[j] = dataBits[j] & ~modelBits[j];
+            removed[j] = modelBits[j] & ~dataBits[j];
+        }
+
+        if (hvModel && hvModel->blockers) {
+            char **blocker;
+            virCPUx86FeaturePtr feature;
+
+            for (blocker = hvModel->blockers; *blocker; blocker++) {
+                const uint64_t *featureBits;
+
+                if (!(feature = x86FeatureFind(map, *blocker)))
+                    continue;
 
-        if ((rc = x86DecodeUseCandidate(model, cpuModel,
-                                        candidate, cpuCandidate,
-                                        signature, preferred))) {
-            virCPUDefFree(cpuModel);
-            cpuModel = cpuCandidate;
+                featureBits = map->featureBits + feature->index * map->nwords;
+                if (!x86BitsIsSubset(added, featureBits, map->nwords)) {
+                    for (j = 0; j < map->nwords; j++)
+                        removed[j] |= featureBits[j];
+                }
+            }
+        }
+
+        nadded = x86BitsCountFeatures(added, map);
+        nremoved = x86BitsCountFeatures(removed, map);
+
+        if ((rc = x86DecodeUseCandidate(model, nfeatures,
+                                        candidate, nadded + nremoved, nremoved,
+                                        cpu->type, signature, preferred))) {
             model = candidate;
+            nfeatures = nadded + nremoved;
+            modelHvModel = hvModel;
             if (rc == 2)
                 break;
-        } else {
-            virCPUDefFree(cpuCandidate);
         }
     }
 
-    if (!cpuModel) {
+    if (!model) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        "%s", _("Cannot find suitable CPU model for given data"));
         return -1;
     }
 
+    if (!(cpuModel = x86DataToCPU(&data, model, map, modelHvModel)))
+        return -1;
+
+    /* feature policy is ignored for host CPU */
+    if (cpu->type == VIR_CPU_TYPE_HOST) {
+        for (i = 0; i < cpuModel->nfeatures; i++)
+            cpuModel->features[i].policy = -1;
+    }
+
     /* Remove non-migratable features if requested
      * Note: this only works as long as no CPU model contains non-migratable
      * features directly */
@@ -272,6 +272,12 @@ typedef int
                                   unsigned int dumpformat,
                                   unsigned int flags);
 
+typedef int
+(*virDrvDomainCoreDumpStream)(virDomainPtr domain,
+                              virStreamPtr stream,
+                              unsigned int dumpformat,
+                              unsigned int flags);
+
 typedef char *
 (*virDrvDomainScreenshot)(virDomainPtr domain,
                           virStreamPtr stream,
@@ -439,6 +445,37 @@ typedef int
                                  const char *xml,
                                  unsigned int flags);
 
+typedef int
+(*virDrvDomainAttachDevices)(virDomainPtr domain,
+                             const char **xmls,
+                             unsigned int nxmls,
+                             unsigned int flags);
+
+typedef int
+(*virDrvDomainListFSFreeze)(virConnectPtr conn,
+                            virDomainPtr *doms,
+                            unsigned int ndoms,
+                            int timeout,
+                            virDomainFSFreezeRecordPtr **retResults,
+                            unsigned int flags);
+
+typedef int
+(*virDrvDomainListFSThaw)(virConnectPtr conn,
+                          virDomainPtr *doms,
+                          unsigned int ndoms,
+                          int timeout,
+                          virDomainFSFreezeRecordPtr **retResults,
+                          unsigned int flags);
+
+typedef int
+(*virDrvDomainListStop)(virConnectPtr conn,
+                        virDomainPtr *doms,
+                        unsigned int ndoms,
+                        unsigned int parallel,
+                        int timeout,
+                        virDomainStopRecordPtr **retResults,
+                        unsigned int flags);
+
 typedef int
 (*virDrvDomainDetachDevice)(virDomainPtr domain,
                             const char *xml);
@@ -802,6 +839,14 @@ typedef virDomainSnapshotPtr
                                  const char *xmlDesc,
                                  unsigned int flags);
 
+typedef int
+(*virDrvDomainListSnapshotCreateXML)(virConnectPtr conn,
+                                     virDomainPtr *doms,
+                                     unsigned int ndoms,
+                                     const char **xmlDescs,
+                                     virDomainSnapshotPtr **snaps,
+                                     unsigned int flags);
+
 typedef char *
 (*virDrvDomainSnapshotGetXMLDesc)(virDomainSnapshotPtr snapshot,
                                   unsigned int flags);
@@ -1387,6 +1432,33 @@ typedef char *
 (*virDrvDomainBackupGetXMLDesc)(virDomainPtr domain,
                                 unsigned int flags);
 
+typedef int
+(*virDrvConnectGetAllDomainXMLDesc)(virConnectPtr conn,
+                                    virDomainPtr *doms,
+                                    unsigned int ndoms,
+                                    unsigned int xmlflags,
+                                    virDomainXMLDescRecordPtr **retDescs,
+                                    unsigned int flags);
+
+typedef int
+(*virDrvDomainStartDirtyRateCalc)(virDomainPtr domain,
+                                  int seconds,
+                                  unsigned int flags);
+
+typedef int
+(*virDrvNodeSetPagesLayout)(virConnectPtr conn,
+                            virTypedParameterPtr params,
+                            int nparams,
+                            virTypedParameterPtr *result,
+                            int *nresult,
+                            unsigned int flags);
+
+typedef int
+(*virDrvNodeGetAllCPUStats)(virConnectPtr conn,
+                            virTypedParameterPtr *params,
+                            int *nparams,
+                            unsigned int flags);
+
 typedef struct _virHypervisorDriver virHypervisorDriver;
 typedef virHypervisorDriver *virHypervisorDriverPtr;
 
@@ -1650,4 +1722,14 @@ struct _virHypervisorDriver {
     virDrvDomainAgentSetResponseTimeout domainAgentSetResponseTimeout;
     virDrvDomainBackupBegin domainBackupBegin;
     virDrvDomainBackupGetXMLDesc domainBackupGetXMLDesc;
+    virDrvConnectGetAllDomainXMLDesc connectGetAllDomainXMLDesc;
+    virDrvDomainStartDirtyRateCalc domainStartDirtyRateCalc;
+    virDrvNodeSetPagesLayout nodeSetPagesLayout;
+    virDrvNodeGetAllCPUStats nodeGetAllCPUStats;
+    virDrvDomainAttachDevices domainAttachDevices;
+    virDrvDomainListFSFreeze domainListFSFreeze;
+    virDrvDomainListFSThaw domainListFSThaw;
+    virDrvDomainListSnapshotCreateXML domainListSnapshotCreateXML;
+    virDrvDomainListStop domainListStop;
+    virDrvDomainCoreDumpStream domainCoreDumpStream;
 };
@@ -60,6 +60,13 @@ typedef unsigned char *
                         unsigned int flags,
                         unsigned int internalFlags);
 
+typedef int
+(*virDrvConnectSecretGetValues)(virConnectPtr conn,
+                                virSecretValueLookupPtr lookups,
+                                size_t nlookups,
+                                unsigned int flags,
+                                unsigned int internalFlags);
+
 typedef int
 (*virDrvSecretUndefine)(virSecretPtr secret);
 
@@ -111,4 +118,5 @@ struct _virSecretDriver {
     virDrvSecretUndefine secretUndefine;
     virDrvConnectSecretEventRegisterAny connectSecretEventRegisterAny;
     virDrvConnectSecretEventDeregisterAny connectSecretEventDeregisterAny;
+    virDrvConnectSecretGetValues connectSecretGetValues;
 };
@@ -202,6 +202,15 @@ typedef int
                           unsigned long long capacity,
                           unsigned int flags);
 
+typedef int
+(*virDrvStorageVolGetJobInfo)(virStorageVolPtr vol,
+                              virStorageVolJobInfoPtr info,
+                              unsigned int flags);
+
+typedef int
+(*virDrvStorageVolAbortJob)(virStorageVolPtr vol,
+                            unsigned int flags);
+
 typedef int
 (*virDrvStoragePoolIsActive)(virStoragePoolPtr pool);
 
@@ -277,4 +286,6 @@ struct _virStorageDriver {
     virDrvStorageVolResize storageVolResize;
     virDrvStoragePoolIsActive storagePoolIsActive;
     virDrvStoragePoolIsPersistent storagePoolIsPersistent;
+    virDrvStorageVolGetJobInfo storageVolGetJobInfo;
+    virDrvStorageVolAbortJob storageVolAbortJob;
 };
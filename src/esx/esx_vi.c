@@ -342,6 +342,16 @@ esxVI_CURL_Connect(esxVI_CURL *curl, esxUtil_ParsedUri *parsedUri)
     curl_easy_setopt(curl->handle, CURLOPT_WRITEFUNCTION,
                      esxVI_CURL_WriteBuffer);
     curl_easy_setopt(curl->handle, CURLOPT_ERRORBUFFER, curl->error);
+#if LIBCURL_VERSION_NUM >= 0x071900 /* 7.25.0 */
+    /*
+     * The handle keeps its connection open between calls. Probe it while
+     * idle so that a connection dropped by a firewall is noticed before the
+     * next call is sent over it.
+     */
+    curl_easy_setopt(curl->handle, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl->handle, CURLOPT_TCP_KEEPIDLE, 60L);
+    curl_easy_setopt(curl->handle, CURLOPT_TCP_KEEPINTVL, 30L);
+#endif
 #if ESX_VI__CURL__ENABLE_DEBUG_OUTPUT
     curl_easy_setopt(curl->handle, CURLOPT_DEBUGFUNCTION, esxVI_CURL_Debug);
     curl_easy_setopt(curl->handle, CURLOPT_VERBOSE, 1);
@@ -793,6 +803,522 @@ esxVI_MultiCURL_CheckFirstMessage(esxVI_MultiCURL *multi, long *responseCode,
 
 
 
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * PropertyCache
+ *
+ * Keeps frequently used properties of all virtual machines of the host
+ * system in memory. The cache has its own property collector with a
+ * filter on these properties, so refreshing it before a lookup costs a
+ * single WaitForUpdatesEx call returning just what has changed since the
+ * last one, instead of a FindByUuid and a RetrieveProperties call or a
+ * RetrieveProperties call transferring the properties of all virtual
+ * machines. Lookups the cache can't serve are sent to the server as
+ * before.
+ */
+
+static const char *esxVI_VirtualMachineCacheProperties[] = {
+    "configStatus",
+    "name",
+    "config.uuid",
+    "config.files.vmPathName",
+    "config.hardware.memoryMB",
+    "config.hardware.numCPU",
+    "config.memoryAllocation.limit",
+    "runtime.powerState",
+};
+
+struct _esxVI_PropertyCache {
+    virMutex lock;
+    esxVI_ManagedObjectReference *propertyCollector;
+    char *sessionKey; /* of the session the collector belongs to */
+    char *version;
+    esxVI_ObjectContent *objectContentList;
+};
+
+static int
+esxVI_PropertyCache_Alloc(esxVI_PropertyCache **cache)
+{
+    if (VIR_ALLOC(*cache) < 0)
+        return -1;
+
+    if (virMutexInit(&(*cache)->lock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Could not initialize property cache mutex"));
+        VIR_FREE(*cache);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void
+esxVI_PropertyCache_Clear(esxVI_PropertyCache *cache)
+{
+    esxVI_ManagedObjectReference_Free(&cache->propertyCollector);
+    VIR_FREE(cache->sessionKey);
+    VIR_FREE(cache->version);
+    esxVI_ObjectContent_Free(&cache->objectContentList);
+}
+
+static void
+esxVI_PropertyCache_Free(esxVI_PropertyCache **cache)
+{
+    if (!*cache)
+        return;
+
+    /* The collector goes away with the session on the server side */
+    esxVI_PropertyCache_Clear(*cache);
+    virMutexDestroy(&(*cache)->lock);
+    VIR_FREE(*cache);
+}
+
+static void
+esxVI_PropertyCache_Reset(esxVI_Context *ctx, esxVI_PropertyCache *cache)
+{
+    virErrorPtr orig_err;
+
+    if (cache->propertyCollector) {
+        virErrorPreserveLast(&orig_err);
+
+        if (esxVI_DestroyPropertyCollector(ctx, cache->propertyCollector) < 0)
+            VIR_DEBUG("DestroyPropertyCollector failed");
+
+        virErrorRestore(&orig_err);
+    }
+
+    esxVI_PropertyCache_Clear(cache);
+}
+
+static bool
+esxVI_PropertyCache_IsCached(const char *propertyName)
+{
+    size_t i;
+
+    for (i = 0; i < G_N_ELEMENTS(esxVI_VirtualMachineCacheProperties); i++) {
+        if (STREQ(esxVI_VirtualMachineCacheProperties[i], propertyName))
+            return true;
+    }
+
+    return false;
+}
+
+static int
+esxVI_PropertyCache_CreateFilter(esxVI_Context *ctx,
+                                 esxVI_PropertyCache *cache)
+{
+    int result = -1;
+    esxVI_ObjectSpec *objectSpec = NULL;
+    bool objectSpec_isAppended = false;
+    esxVI_PropertySpec *propertySpec = NULL;
+    bool propertySpec_isAppended = false;
+    esxVI_PropertyFilterSpec *propertyFilterSpec = NULL;
+    esxVI_ManagedObjectReference *propertyFilter = NULL;
+    size_t i;
+
+    if (esxVI_ObjectSpec_Alloc(&objectSpec) < 0)
+        goto cleanup;
+
+    /* Same as esxVI_LookupVirtualMachineList */
+    objectSpec->obj = ctx->hostSystem->_reference;
+    objectSpec->skip = esxVI_Boolean_False;
+    objectSpec->selectSet = ctx->selectSet_hostSystemToVm;
+
+    if (esxVI_PropertySpec_Alloc(&propertySpec) < 0)
+        goto cleanup;
+
+    propertySpec->type = (char *)"VirtualMachine";
+
+    for (i = 0; i < G_N_ELEMENTS(esxVI_VirtualMachineCacheProperties); i++) {
+        if (esxVI_String_AppendValueToList(&propertySpec->pathSet,
+                                           esxVI_VirtualMachineCacheProperties[i]) < 0)
+            goto cleanup;
+    }
+
+    if (esxVI_PropertyFilterSpec_Alloc(&propertyFilterSpec) < 0 ||
+        esxVI_PropertySpec_AppendToList(&propertyFilterSpec->propSet,
+                                        propertySpec) < 0) {
+        goto cleanup;
+    }
+
+    propertySpec_isAppended = true;
+
+    if (esxVI_ObjectSpec_AppendToList(&propertyFilterSpec->objectSet,
+                                      objectSpec) < 0) {
+        goto cleanup;
+    }
+
+    objectSpec_isAppended = true;
+
+    if (esxVI_CreatePropertyCollector(ctx, &cache->propertyCollector) < 0 ||
+        esxVI_CreateFilter(ctx, cache->propertyCollector, propertyFilterSpec,
+                           esxVI_Boolean_False, &propertyFilter) < 0) {
+        goto cleanup;
+    }
+
+    result = 0;
+
+ cleanup:
+    /*
+     * Remove values borrowed from the context from the data structures to
+     * prevent them from being freed by esxVI_PropertyFilterSpec_Free().
+     */
+    if (objectSpec) {
+        objectSpec->obj = NULL;
+        objectSpec->selectSet = NULL;
+    }
+
+    if (propertySpec)
+        propertySpec->type = NULL;
+
+    if (!objectSpec_isAppended)
+        esxVI_ObjectSpec_Free(&objectSpec);
+
+    if (!propertySpec_isAppended)
+        esxVI_PropertySpec_Free(&propertySpec);
+
+    esxVI_PropertyFilterSpec_Free(&propertyFilterSpec);
+    esxVI_ManagedObjectReference_Free(&propertyFilter);
+
+    return result;
+}
+
+static esxVI_ObjectContent *
+esxVI_PropertyCache_Find(esxVI_PropertyCache *cache,
+                         esxVI_ManagedObjectReference *obj)
+{
+    esxVI_ObjectContent *objectContent;
+
+    for (objectContent = cache->objectContentList; objectContent;
+         objectContent = objectContent->_next) {
+        if (STREQ(objectContent->obj->value, obj->value))
+            return objectContent;
+    }
+
+    return NULL;
+}
+
+static int
+esxVI_PropertyCache_ApplyChange(esxVI_ObjectContent *objectContent,
+                                esxVI_PropertyChange *propertyChange)
+{
+    esxVI_DynamicProperty **next;
+    esxVI_DynamicProperty *dynamicProperty = NULL;
+
+    /*
+     * Only the exact paths of the filter are cached, a change reported for
+     * any other path means the cache can't follow the server anymore.
+     */
+    if (!esxVI_PropertyCache_IsCached(propertyChange->name)) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unexpected change of property '%s'"),
+                       propertyChange->name);
+        return -1;
+    }
+
+    for (next = &objectContent->propSet; *next; next = &(*next)->_next) {
+        if (STREQ((*next)->name, propertyChange->name)) {
+            dynamicProperty = *next;
+            *next = dynamicProperty->_next;
+            dynamicProperty->_next = NULL;
+            esxVI_DynamicProperty_Free(&dynamicProperty);
+            break;
+        }
+    }
+
+    /* RetrieveProperties doesn't report unset properties either */
+    if ((propertyChange->op != esxVI_PropertyChangeOp_Add &&
+         propertyChange->op != esxVI_PropertyChangeOp_Assign) ||
+        !propertyChange->val) {
+        return 0;
+    }
+
+    if (esxVI_DynamicProperty_Alloc(&dynamicProperty) < 0)
+        return -1;
+
+    dynamicProperty->name = g_strdup(propertyChange->name);
+
+    if (esxVI_AnyType_DeepCopy(&dynamicProperty->val,
+                               propertyChange->val) < 0 ||
+        esxVI_DynamicProperty_AppendToList(&objectContent->propSet,
+                                           dynamicProperty) < 0) {
+        esxVI_DynamicProperty_Free(&dynamicProperty);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int
+esxVI_PropertyCache_Apply(esxVI_PropertyCache *cache,
+                          esxVI_UpdateSet *updateSet)
+{
+    esxVI_PropertyFilterUpdate *propertyFilterUpdate;
+    esxVI_ObjectUpdate *objectUpdate;
+    esxVI_PropertyChange *propertyChange;
+    esxVI_ObjectContent *objectContent;
+    esxVI_ObjectContent **next;
+
+    for (propertyFilterUpdate = updateSet->filterSet; propertyFilterUpdate;
+         propertyFilterUpdate = propertyFilterUpdate->_next) {
+        for (objectUpdate = propertyFilterUpdate->objectSet; objectUpdate;
+             objectUpdate = objectUpdate->_next) {
+            objectContent = esxVI_PropertyCache_Find(cache, objectUpdate->obj);
+
+            switch (objectUpdate->kind) {
+              case esxVI_ObjectUpdateKind_Enter:
+                if (!objectContent) {
+                    if (esxVI_ObjectContent_Alloc(&objectContent) < 0)
+                        return -1;
+
+                    if (esxVI_ManagedObjectReference_DeepCopy
+                          (&objectContent->obj, objectUpdate->obj) < 0 ||
+                        esxVI_ObjectContent_AppendToList
+                          (&cache->objectContentList, objectContent) < 0) {
+                        esxVI_ObjectContent_Free(&objectContent);
+                        return -1;
+                    }
+                }
+
+                G_GNUC_FALLTHROUGH;
+
+              case esxVI_ObjectUpdateKind_Modify:
+                if (!objectContent) {
+                    virReportError(VIR_ERR_INTERNAL_ERROR,
+                                   _("Update of unknown object '%s'"),
+                                   objectUpdate->obj->value);
+                    return -1;
+                }
+
+                for (propertyChange = objectUpdate->changeSet; propertyChange;
+                     propertyChange = propertyChange->_next) {
+                    if (esxVI_PropertyCache_ApplyChange(objectContent,
+                                                        propertyChange) < 0)
+                        return -1;
+                }
+
+                break;
+
+              case esxVI_ObjectUpdateKind_Leave:
+                for (next = &cache->objectContentList; *next;
+                     next = &(*next)->_next) {
+                    if (*next == objectContent) {
+                        *next = objectContent->_next;
+                        objectContent->_next = NULL;
+                        esxVI_ObjectContent_Free(&objectContent);
+                        break;
+                    }
+                }
+
+                break;
+
+              case esxVI_ObjectUpdateKind_Undefined:
+              default:
+                virReportEnumRangeError(esxVI_ObjectUpdateKind,
+                                        objectUpdate->kind);
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Brings the cache up to date with the server. Must be called with the
+ * cache locked. On failure the cache is emptied.
+ */
+static int
+esxVI_PropertyCache_Update(esxVI_Context *ctx, esxVI_PropertyCache *cache)
+{
+    int result = -1;
+    char *sessionKey = NULL;
+    esxVI_WaitOptions *waitOptions = NULL;
+    esxVI_UpdateSet *updateSet = NULL;
+
+    virMutexLock(ctx->sessionLock);
+    if (ctx->session)
+        sessionKey = g_strdup(ctx->session->key);
+    virMutexUnlock(ctx->sessionLock);
+
+    if (!sessionKey) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _("Invalid call, no session"));
+        goto cleanup;
+    }
+
+    /* The collector went away with the session it was created in */
+    if (cache->propertyCollector && STRNEQ(cache->sessionKey, sessionKey))
+        esxVI_PropertyCache_Clear(cache);
+
+    if (!cache->propertyCollector) {
+        if (esxVI_PropertyCache_CreateFilter(ctx, cache) < 0)
+            goto cleanup;
+
+        cache->sessionKey = g_steal_pointer(&sessionKey);
+    }
+
+    if (esxVI_WaitOptions_Alloc(&waitOptions) < 0 ||
+        esxVI_Int_Alloc(&waitOptions->maxWaitSeconds) < 0) {
+        goto cleanup;
+    }
+
+    /* Don't wait for changes, just collect the pending ones */
+    waitOptions->maxWaitSeconds->value = 0;
+
+    do {
+        esxVI_UpdateSet_Free(&updateSet);
+
+        if (esxVI_WaitForUpdatesEx(ctx, cache->propertyCollector,
+                                   cache->version, waitOptions,
+                                   &updateSet) < 0) {
+            goto cleanup;
+        }
+
+        /* nothing has changed */
+        if (!updateSet)
+            break;
+
+        if (esxVI_PropertyCache_Apply(cache, updateSet) < 0)
+            goto cleanup;
+
+        VIR_FREE(cache->version);
+        cache->version = g_strdup(updateSet->version);
+    } while (updateSet->truncated == esxVI_Boolean_True);
+
+    result = 0;
+
+ cleanup:
+    if (result < 0)
+        esxVI_PropertyCache_Reset(ctx, cache);
+
+    VIR_FREE(sessionKey);
+    esxVI_WaitOptions_Free(&waitOptions);
+    esxVI_UpdateSet_Free(&updateSet);
+
+    return result;
+}
+
+static int
+esxVI_PropertyCache_CopyObjectContent(esxVI_ObjectContent **dest,
+                                      esxVI_ObjectContent *src,
+                                      esxVI_String *propertyNameList)
+{
+    esxVI_DynamicProperty *dynamicProperty;
+    esxVI_DynamicProperty *copy = NULL;
+
+    if (esxVI_ObjectContent_Alloc(dest) < 0 ||
+        esxVI_ManagedObjectReference_DeepCopy(&(*dest)->obj, src->obj) < 0) {
+        goto failure;
+    }
+
+    /* Callers don't expect properties they haven't asked for */
+    for (dynamicProperty = src->propSet; dynamicProperty;
+         dynamicProperty = dynamicProperty->_next) {
+        if (!esxVI_String_ListContainsValue(propertyNameList,
+                                            dynamicProperty->name)) {
+            continue;
+        }
+
+        if (esxVI_DynamicProperty_DeepCopy(&copy, dynamicProperty) < 0 ||
+            esxVI_DynamicProperty_AppendToList(&(*dest)->propSet, copy) < 0) {
+            esxVI_DynamicProperty_Free(&copy);
+            goto failure;
+        }
+
+        copy = NULL;
+    }
+
+    return 0;
+
+ failure:
+    esxVI_ObjectContent_Free(dest);
+
+    return -1;
+}
+
+/*
+ * Looks up the virtual machines of the host system, or just the one with
+ * the given @uuid, from the property cache of @ctx.
+ *
+ * Returns 1 if the lookup was served from the cache, 0 if it has to be
+ * sent to the server and -1 on error.
+ */
+static int
+esxVI_PropertyCache_LookupVirtualMachines(esxVI_Context *ctx,
+                                          const char *uuid,
+                                          esxVI_String *propertyNameList,
+                                          esxVI_ObjectContent **virtualMachineList)
+{
+    esxVI_PropertyCache *cache = ctx->virtualMachineCache;
+    esxVI_String *propertyName;
+    esxVI_ObjectContent *objectContent;
+    esxVI_ObjectContent *copy = NULL;
+    char *uuid_candidate = NULL;
+    int result = -1;
+
+    if (!cache || !ctx->hostSystem || !propertyNameList)
+        return 0;
+
+    for (propertyName = propertyNameList; propertyName;
+         propertyName = propertyName->_next) {
+        if (!esxVI_PropertyCache_IsCached(propertyName->value))
+            return 0;
+    }
+
+    virMutexLock(&cache->lock);
+
+    if (esxVI_PropertyCache_Update(ctx, cache) < 0) {
+        VIR_WARN("Could not update property cache: %s",
+                 virGetLastErrorMessage());
+        virResetLastError();
+        result = 0;
+        goto cleanup;
+    }
+
+    for (objectContent = cache->objectContentList; objectContent;
+         objectContent = objectContent->_next) {
+        if (uuid) {
+            uuid_candidate = NULL;
+
+            if (esxVI_GetStringValue(objectContent, "config.uuid",
+                                     &uuid_candidate,
+                                     esxVI_Occurrence_OptionalItem) < 0) {
+                goto cleanup;
+            }
+
+            if (!uuid_candidate || STRCASENEQ(uuid, uuid_candidate))
+                continue;
+        }
+
+        if (esxVI_PropertyCache_CopyObjectContent(&copy, objectContent,
+                                                  propertyNameList) < 0 ||
+            esxVI_ObjectContent_AppendToList(virtualMachineList, copy) < 0) {
+            esxVI_ObjectContent_Free(&copy);
+            goto cleanup;
+        }
+
+        copy = NULL;
+
+        if (uuid)
+            break;
+    }
+
+    /*
+     * A virtual machine which isn't in the cache might still be found on
+     * another host system of the datacenter.
+     */
+    result = (uuid && !*virtualMachineList) ? 0 : 1;
+
+ cleanup:
+    virMutexUnlock(&cache->lock);
+
+    if (result < 0)
+        esxVI_ObjectContent_Free(virtualMachineList);
+
+    return result;
+}
+
+
+
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
  * Context
  */
@@ -827,6 +1353,7 @@ ESX_VI__TEMPLATE__FREE(Context,
     esxVI_SelectionSpec_Free(&item->selectSet_computeResourceToHost);
     esxVI_SelectionSpec_Free(&item->selectSet_computeResourceToParentToParent);
     esxVI_SelectionSpec_Free(&item->selectSet_datacenterToNetwork);
+    esxVI_PropertyCache_Free(&item->virtualMachineCache);
 })
 
 int
@@ -965,6 +1492,12 @@ esxVI_Context_Connect(esxVI_Context *ctx, const char *url,
         goto cleanup;
     }
 
+    /* WaitForUpdatesEx was added in 4.1 */
+    if (ctx->apiVersion >= 1000000 * 4 + 1000 * 1 /* 4.1 */ &&
+        esxVI_PropertyCache_Alloc(&ctx->virtualMachineCache) < 0) {
+        goto cleanup;
+    }
+
     result = 0;
 
  cleanup:
@@ -2703,6 +3236,16 @@ esxVI_LookupVirtualMachineList(esxVI_Context *ctx,
                                esxVI_String *propertyNameList,
                                esxVI_ObjectContent **virtualMachineList)
 {
+    int rc;
+
+    ESX_VI_CHECK_ARG_LIST(virtualMachineList);
+
+    if ((rc = esxVI_PropertyCache_LookupVirtualMachines(ctx, NULL,
+                                                        propertyNameList,
+                                                        virtualMachineList)) != 0) {
+        return rc < 0 ? -1 : 0;
+    }
+
     /* FIXME: Switch from ctx->hostSystem to ctx->computeResource->resourcePool
      *        for cluster support */
     return esxVI_LookupObjectContentByType(ctx, ctx->hostSystem->_reference,
@@ -2722,11 +3265,18 @@ esxVI_LookupVirtualMachineByUuid(esxVI_Context *ctx, const unsigned char *uuid,
     int result = -1;
     esxVI_ManagedObjectReference *managedObjectReference = NULL;
     char uuid_string[VIR_UUID_STRING_BUFLEN] = "";
+    int rc;
 
     ESX_VI_CHECK_ARG_LIST(virtualMachine);
 
     virUUIDFormat(uuid, uuid_string);
 
+    if ((rc = esxVI_PropertyCache_LookupVirtualMachines(ctx, uuid_string,
+                                                        propertyNameList,
+                                                        virtualMachine)) != 0) {
+        return rc < 0 ? -1 : 0;
+    }
+
     if (esxVI_FindByUuid(ctx, ctx->datacenter->_reference, uuid_string,
                          esxVI_Boolean_True, esxVI_Boolean_Undefined,
                          &managedObjectReference) < 0) {
@@ -4267,7 +4817,8 @@ esxVI_WaitForTaskCompletion(esxVI_Context *ctx,
 
     objectSpec_isAppended = true;
 
-    if (esxVI_CreateFilter(ctx, propertyFilterSpec, esxVI_Boolean_True,
+    if (esxVI_CreateFilter(ctx, ctx->service->propertyCollector,
+                           propertyFilterSpec, esxVI_Boolean_True,
                            &propertyFilter) < 0) {
         goto cleanup;
     }
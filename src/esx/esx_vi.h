@@ -77,6 +77,7 @@ typedef struct _esxVI_CURL esxVI_CURL;
 typedef struct _esxVI_SharedCURL esxVI_SharedCURL;
 typedef struct _esxVI_MultiCURL esxVI_MultiCURL;
 typedef struct _esxVI_Context esxVI_Context;
+typedef struct _esxVI_PropertyCache esxVI_PropertyCache;
 typedef struct _esxVI_Response esxVI_Response;
 typedef struct _esxVI_Enumeration esxVI_Enumeration;
 typedef struct _esxVI_EnumerationValue esxVI_EnumerationValue;
@@ -200,6 +201,7 @@ struct _esxVI_Context {
     esxVI_SelectionSpec *selectSet_datacenterToNetwork;
     bool hasQueryVirtualDiskUuid;
     bool hasSessionIsActive;
+    esxVI_PropertyCache *virtualMachineCache; /* has its own mutex */
 };
 
 int esxVI_Context_Alloc(esxVI_Context **ctx);
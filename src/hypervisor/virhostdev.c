@@ -34,6 +34,7 @@
 #include "virlog.h"
 #include "virutil.h"
 #include "virnetdev.h"
+#include "virthread.h"
 #include "configmake.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
@@ -617,31 +618,219 @@ virHostdevRestoreNetConfig(virDomainHostdevDefPtr hostdev,
     }
 }
 
+typedef int (*virHostdevPCIDeviceFunc)(virHostdevManagerPtr mgr,
+                                       virPCIDevicePtr pci);
+
+typedef struct _virHostdevPCIJob virHostdevPCIJob;
+struct _virHostdevPCIJob {
+    virHostdevManagerPtr mgr;
+    virPCIDeviceListPtr pcidevs;
+    virHostdevPCIDeviceFunc func;
+    size_t *idx; /* indexes into @pcidevs of the devices to process */
+    size_t nidx;
+    int *results; /* shared by all jobs, indexed the same as @pcidevs */
+    virErrorPtr err;
+};
+
+
+static void
+virHostdevPCIJobRun(void *opaque)
+{
+    virHostdevPCIJob *job = opaque;
+    size_t i;
+
+    for (i = 0; i < job->nidx; i++) {
+        virPCIDevicePtr pci = virPCIDeviceListGet(job->pcidevs, job->idx[i]);
+
+        job->results[job->idx[i]] = job->func(job->mgr, pci);
+
+        if (job->results[job->idx[i]] < 0 && !job->err)
+            virErrorPreserveLast(&job->err);
+    }
+}
+
+
+/*
+ * Devices on the same bus may be reset all at once by a secondary bus
+ * reset and devices in the same IOMMU group are not isolated from each
+ * other, so neither may be processed concurrently.
+ */
+static bool
+virHostdevPCIDevicesDepend(virPCIDevicePtr a,
+                           int agroup,
+                           virPCIDevicePtr b,
+                           int bgroup)
+{
+    virPCIDeviceAddressPtr aaddr = virPCIDeviceGetAddress(a);
+    virPCIDeviceAddressPtr baddr = virPCIDeviceGetAddress(b);
+
+    if (aaddr->domain == baddr->domain && aaddr->bus == baddr->bus)
+        return true;
+
+    return agroup >= 0 && agroup == bgroup;
+}
+
+
+/*
+ * Calls @func on every device in @pcidevs storing what it returns into
+ * @results. Independent devices are processed in parallel, the rest in
+ * the order they appear in @pcidevs. Since the device lists of @mgr are
+ * locked by the caller, @func may look them up but must not modify them.
+ *
+ * Returns 0 if @func succeeded for all devices, -1 otherwise with the
+ * error of the first failing job set.
+ */
 static int
-virHostdevResetAllPCIDevices(virHostdevManagerPtr mgr,
-                             virPCIDeviceListPtr pcidevs)
+virHostdevForEachPCIDevice(virHostdevManagerPtr mgr,
+                           virPCIDeviceListPtr pcidevs,
+                           virHostdevPCIDeviceFunc func,
+                           int *results)
 {
+    size_t count = virPCIDeviceListCount(pcidevs);
+    g_autofree int *iommuGroups = g_new0(int, count);
+    g_autofree size_t *deps = g_new0(size_t, count);
+    g_autofree virHostdevPCIJob *jobs = g_new0(virHostdevPCIJob, count);
+    g_autofree virThread *threads = g_new0(virThread, count);
+    g_autofree bool *started = g_new0(bool, count);
+    size_t njobs = 0;
     int ret = 0;
     size_t i;
+    size_t j;
+    size_t k;
 
-    for (i = 0; i < virPCIDeviceListCount(pcidevs); i++) {
+    /* Split the devices into sets of dependent ones, @deps[i] being the
+     * lowest index of a device the i-th one (transitively) depends on */
+    for (i = 0; i < count; i++) {
         virPCIDevicePtr pci = virPCIDeviceListGet(pcidevs, i);
 
-        /* We can avoid looking up the actual device here, because performing
-         * a PCI reset on a device doesn't require any information other than
-         * the address, which 'pci' already contains */
-        VIR_DEBUG("Resetting PCI device %s", virPCIDeviceGetName(pci));
-        if (virPCIDeviceReset(pci, mgr->activePCIHostdevs,
-                              mgr->inactivePCIHostdevs) < 0) {
-            VIR_ERROR(_("Failed to reset PCI device: %s"),
-                      virGetLastErrorMessage());
+        iommuGroups[i] = virPCIDeviceAddressGetIOMMUGroupNum(virPCIDeviceGetAddress(pci));
+        if (iommuGroups[i] == -1)
+            virResetLastError();
+
+        deps[i] = i;
+        for (j = 0; j < i; j++) {
+            size_t from;
+
+            if (deps[j] == deps[i] ||
+                !virHostdevPCIDevicesDepend(virPCIDeviceListGet(pcidevs, j),
+                                            iommuGroups[j],
+                                            pci, iommuGroups[i]))
+                continue;
+
+            /* merge the set of the i-th device into the set of the j-th */
+            from = deps[i];
+            for (k = 0; k <= i; k++) {
+                if (deps[k] == from)
+                    deps[k] = deps[j];
+            }
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        virHostdevPCIJob *job = NULL;
+
+        for (j = 0; j < njobs; j++) {
+            if (deps[jobs[j].idx[0]] == deps[i]) {
+                job = &jobs[j];
+                break;
+            }
+        }
+
+        if (!job) {
+            job = &jobs[njobs++];
+            job->mgr = mgr;
+            job->pcidevs = pcidevs;
+            job->func = func;
+            job->results = results;
+            job->idx = g_new0(size_t, count);
+        }
+
+        job->idx[job->nidx++] = i;
+    }
+
+    for (i = 0; i < njobs; i++) {
+        /* the last job runs in this thread */
+        if (i == njobs - 1 ||
+            virThreadCreateFull(&threads[i], true, virHostdevPCIJobRun,
+                                "hostdev-pci", false, &jobs[i]) < 0) {
+            virResetLastError();
+            virHostdevPCIJobRun(&jobs[i]);
+            continue;
+        }
+
+        started[i] = true;
+    }
+
+    for (i = 0; i < njobs; i++) {
+        if (started[i])
+            virThreadJoin(&threads[i]);
+    }
+
+    for (i = 0; i < njobs; i++) {
+        if (jobs[i].err) {
+            if (ret == 0)
+                virErrorRestore(&jobs[i].err);
+            else
+                virFreeError(jobs[i].err);
             ret = -1;
         }
+        g_free(jobs[i].idx);
     }
 
     return ret;
 }
 
+
+static int
+virHostdevResetOnePCIDevice(virHostdevManagerPtr mgr,
+                            virPCIDevicePtr pci)
+{
+    /* We can avoid looking up the actual device here, because performing
+     * a PCI reset on a device doesn't require any information other than
+     * the address, which 'pci' already contains */
+    VIR_DEBUG("Resetting PCI device %s", virPCIDeviceGetName(pci));
+    if (virPCIDeviceReset(pci, mgr->activePCIHostdevs,
+                          mgr->inactivePCIHostdevs) < 0) {
+        VIR_ERROR(_("Failed to reset PCI device: %s"),
+                  virGetLastErrorMessage());
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+virHostdevResetAllPCIDevices(virHostdevManagerPtr mgr,
+                             virPCIDeviceListPtr pcidevs)
+{
+    g_autofree int *results = g_new0(int, virPCIDeviceListCount(pcidevs));
+
+    /* Resets, secondary bus resets in particular, involve waiting for
+     * the device to settle. Do them in parallel where possible. */
+    return virHostdevForEachPCIDevice(mgr, pcidevs,
+                                      virHostdevResetOnePCIDevice,
+                                      results);
+}
+
+
+/*
+ * Binds a managed device to its stub driver. Unlike virPCIDeviceDetach()
+ * called with the inactive list, this doesn't add the device to the list
+ * and thus may run in parallel for different devices.
+ */
+static int
+virHostdevDetachOnePCIDevice(virHostdevManagerPtr mgr,
+                             virPCIDevicePtr pci)
+{
+    if (!virPCIDeviceGetManaged(pci))
+        return 0;
+
+    VIR_DEBUG("Detaching managed PCI device %s", virPCIDeviceGetName(pci));
+
+    return virPCIDeviceDetach(pci, mgr->activePCIHostdevs, NULL);
+}
+
 static void
 virHostdevReattachAllPCIDevices(virHostdevManagerPtr mgr,
                                 virPCIDeviceListPtr pcidevs)
@@ -688,6 +877,8 @@ virHostdevPreparePCIDevicesImpl(virHostdevManagerPtr mgr,
     size_t i;
     int ret = -1;
     virPCIDeviceAddressPtr devAddr = NULL;
+    g_autofree int *detachResults = NULL;
+    bool detachFailed = false;
 
     virObjectLock(mgr->activePCIHostdevs);
     virObjectLock(mgr->inactivePCIHostdevs);
@@ -750,72 +941,89 @@ virHostdevPreparePCIDevicesImpl(virHostdevManagerPtr mgr,
             goto cleanup;
     }
 
-    /* Step 2: detach managed devices and make sure unmanaged devices
-     *         have already been taken care of */
+    /* Step 2: make sure unmanaged devices have already been taken care
+     *         of and detach managed devices */
     for (i = 0; i < virPCIDeviceListCount(pcidevs); i++) {
         virPCIDevicePtr pci = virPCIDeviceListGet(pcidevs, i);
+        g_autofree char *driverPath = NULL;
+        g_autofree char *driverName = NULL;
+        int stub;
 
-        if (virPCIDeviceGetManaged(pci)) {
+        if (virPCIDeviceGetManaged(pci))
+            continue;
 
-            /* We can't look up the actual device because it has not been
-             * created yet: virPCIDeviceDetach() will insert a copy of 'pci'
-             * into the list of inactive devices, and that copy will be the
-             * actual device going forward */
-            VIR_DEBUG("Detaching managed PCI device %s",
+        /* Unmanaged devices should already have been marked as
+         * inactive: if that's the case, we can simply move on */
+        if (virPCIDeviceListFind(mgr->inactivePCIHostdevs, pci)) {
+            VIR_DEBUG("Not detaching unmanaged PCI device %s",
                       virPCIDeviceGetName(pci));
-            if (virPCIDeviceDetach(pci,
-                                   mgr->activePCIHostdevs,
-                                   mgr->inactivePCIHostdevs) < 0)
-                goto reattachdevs;
-        } else {
-            g_autofree char *driverPath = NULL;
-            g_autofree char *driverName = NULL;
-            int stub;
-
-            /* Unmanaged devices should already have been marked as
-             * inactive: if that's the case, we can simply move on */
-            if (virPCIDeviceListFind(mgr->inactivePCIHostdevs, pci)) {
-                VIR_DEBUG("Not detaching unmanaged PCI device %s",
-                          virPCIDeviceGetName(pci));
-                continue;
-            }
+            continue;
+        }
 
-            /* If that's not the case, though, it might be because the
-             * daemon has been restarted, causing us to lose track of the
-             * device. Try and recover by marking the device as inactive
-             * if it happens to be bound to a known stub driver.
-             *
-             * FIXME Get rid of this once a proper way to keep track of
-             *       information about active / inactive device across
-             *       daemon restarts has been implemented */
-
-            if (virPCIDeviceGetDriverPathAndName(pci,
-                                                 &driverPath, &driverName) < 0)
-                goto reattachdevs;
+        /* If that's not the case, though, it might be because the
+         * daemon has been restarted, causing us to lose track of the
+         * device. Try and recover by marking the device as inactive
+         * if it happens to be bound to a known stub driver.
+         *
+         * FIXME Get rid of this once a proper way to keep track of
+         *       information about active / inactive device across
+         *       daemon restarts has been implemented */
 
-            stub = virPCIStubDriverTypeFromString(driverName);
+        if (virPCIDeviceGetDriverPathAndName(pci,
+                                             &driverPath, &driverName) < 0)
+            goto reattachdevs;
 
-            if (stub > VIR_PCI_STUB_DRIVER_NONE &&
-                stub < VIR_PCI_STUB_DRIVER_LAST) {
+        stub = virPCIStubDriverTypeFromString(driverName);
 
-                /* The device is bound to a known stub driver: store this
-                 * information and add a copy to the inactive list */
-                virPCIDeviceSetStubDriver(pci, stub);
+        if (stub > VIR_PCI_STUB_DRIVER_NONE &&
+            stub < VIR_PCI_STUB_DRIVER_LAST) {
 
-                VIR_DEBUG("Adding PCI device %s to inactive list",
-                          virPCIDeviceGetName(pci));
-                if (virPCIDeviceListAddCopy(mgr->inactivePCIHostdevs, pci) < 0)
-                    goto reattachdevs;
-            } else {
-                virReportError(VIR_ERR_OPERATION_INVALID,
-                               _("Unmanaged PCI device %s must be manually "
-                                 "detached from the host"),
-                               virPCIDeviceGetName(pci));
+            /* The device is bound to a known stub driver: store this
+             * information and add a copy to the inactive list */
+            virPCIDeviceSetStubDriver(pci, stub);
+
+            VIR_DEBUG("Adding PCI device %s to inactive list",
+                      virPCIDeviceGetName(pci));
+            if (virPCIDeviceListAddCopy(mgr->inactivePCIHostdevs, pci) < 0)
                 goto reattachdevs;
-            }
+        } else {
+            virReportError(VIR_ERR_OPERATION_INVALID,
+                           _("Unmanaged PCI device %s must be manually "
+                             "detached from the host"),
+                           virPCIDeviceGetName(pci));
+            goto reattachdevs;
         }
     }
 
+    /* Binding to the stub driver may take a while, do it in parallel
+     * and only then add the devices to the inactive list. We can't look
+     * up the actual device before because it has not been created yet:
+     * the copy of 'pci' inserted into the list of inactive devices will
+     * be the actual device going forward */
+    detachResults = g_new0(int, virPCIDeviceListCount(pcidevs));
+    if (virHostdevForEachPCIDevice(mgr, pcidevs,
+                                   virHostdevDetachOnePCIDevice,
+                                   detachResults) < 0)
+        detachFailed = true;
+
+    for (i = 0; i < virPCIDeviceListCount(pcidevs); i++) {
+        virPCIDevicePtr pci = virPCIDeviceListGet(pcidevs, i);
+
+        /* even if some devices failed, the detached ones have to be on
+         * the inactive list to be reattached below */
+        if (!virPCIDeviceGetManaged(pci) || detachResults[i] < 0 ||
+            virPCIDeviceListFind(mgr->inactivePCIHostdevs, pci))
+            continue;
+
+        VIR_DEBUG("Adding PCI device %s to inactive list",
+                  virPCIDeviceGetName(pci));
+        if (virPCIDeviceListAddCopy(mgr->inactivePCIHostdevs, pci) < 0)
+            detachFailed = true;
+    }
+
+    if (detachFailed)
+        goto reattachdevs;
+
     /* At this point, all devices are attached to the stub driver and have
      * been marked as inactive */
 
@@ -254,6 +254,110 @@ virDomainSnapshotCreateXML(virDomainPtr domain,
 }
 
 
+/**
+ * virDomainListSnapshotCreateXML:
+ * @doms: NULL terminated array of domains
+ * @xmlDescs: array of snapshot XML descriptions, one for each domain in @doms
+ * @snaps: pointer filled with a NULL terminated array of the new snapshots
+ * @flags: bitwise-OR of virDomainSnapshotCreateFlags
+ *
+ * Creates a snapshot of each of the domains in @doms at a single point in
+ * time, as if virDomainSnapshotCreateXML was called with @xmlDescs[i] for
+ * @doms[i] while none of the domains was running. This makes it possible
+ * to take a crash consistent snapshot of an application spread over
+ * several domains. All domains in @doms must share the same connection.
+ *
+ * Only disk snapshots of running domains are supported, @flags must
+ * contain VIR_DOMAIN_SNAPSHOT_CREATE_DISK_ONLY. The hypervisor prepares
+ * the snapshot images of all domains first, then pauses all of the
+ * domains, switches them over to the new images and resumes them, so
+ * the domains stay paused for a short time regardless of the size of
+ * their disks. Domains which were paused before the call stay paused.
+ *
+ * VIR_DOMAIN_SNAPSHOT_CREATE_NO_METADATA, VIR_DOMAIN_SNAPSHOT_CREATE_REUSE_EXT,
+ * VIR_DOMAIN_SNAPSHOT_CREATE_ATOMIC and VIR_DOMAIN_SNAPSHOT_CREATE_VALIDATE
+ * have the same meaning as for virDomainSnapshotCreateXML and apply to
+ * all of the domains. Quiescing the file systems of the guests is not
+ * supported by this API, use virDomainListFSFreeze and virDomainListFSThaw
+ * around the call instead.
+ *
+ * Failures to prepare the snapshot of any domain leave all of the domains
+ * unaltered. However, the snapshot of a domain may still fail once the
+ * snapshots of other domains were already taken, which are then kept.
+ * If this API call fails, it is therefore necessary to check the domains
+ * for partial changes, see virDomainSnapshotCreateXML.
+ *
+ * Returns the number of created snapshots, which is the number of domains
+ * in @doms, on success and -1 on failure. The snapshot of @doms[i] is
+ * stored in (*@snaps)[i]. The caller is responsible for calling
+ * virDomainSnapshotFree on each of the snapshots and freeing the array.
+ */
+int
+virDomainListSnapshotCreateXML(virDomainPtr *doms,
+                               const char **xmlDescs,
+                               virDomainSnapshotPtr **snaps,
+                               unsigned int flags)
+{
+    virConnectPtr conn = NULL;
+    virDomainPtr *nextdom = doms;
+    unsigned int ndoms = 0;
+    int ret = -1;
+
+    VIR_DEBUG("doms=%p, xmlDescs=%p, snaps=%p, flags=0x%x",
+              doms, xmlDescs, snaps, flags);
+
+    virResetLastError();
+
+    virCheckNonNullArgGoto(doms, error);
+    virCheckNonNullArgGoto(xmlDescs, error);
+    virCheckNonNullArgGoto(snaps, error);
+
+    if (!*doms) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("doms array in %s must contain at least one domain"),
+                       __FUNCTION__);
+        goto error;
+    }
+
+    conn = doms[0]->conn;
+    virCheckConnectGoto(conn, error);
+    virCheckReadOnlyGoto(conn->flags, error);
+
+    while (*nextdom) {
+        virDomainPtr dom = *nextdom;
+
+        virCheckDomainGoto(dom, error);
+
+        if (dom->conn != conn) {
+            virReportError(VIR_ERR_INVALID_ARG, "%s",
+                           _("domains in 'doms' array must belong to a "
+                             "single connection"));
+            goto error;
+        }
+
+        virCheckNonNullArgGoto(xmlDescs[ndoms], error);
+
+        ndoms++;
+        nextdom++;
+    }
+
+    if (conn->driver->domainListSnapshotCreateXML) {
+        ret = conn->driver->domainListSnapshotCreateXML(conn, doms, ndoms,
+                                                         xmlDescs, snaps,
+                                                         flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+
+ error:
+    virDispatchError(conn);
+    return -1;
+}
+
+
 /**
  * virDomainSnapshotGetXMLDesc:
  * @snapshot: a domain snapshot object
@@ -1353,6 +1353,86 @@ virDomainCoreDumpWithFormat(virDomainPtr domain, const char *to,
 }
 
 
+/**
+ * virDomainCoreDumpStream:
+ * @domain: a domain object
+ * @stream: stream to use as output
+ * @dumpformat: format of domain memory's dump (one of virDomainCoreDumpFormat enum)
+ * @flags: bitwise-OR of virDomainCoreDumpFlags
+ *
+ * This method dumps the memory of a domain for analysis, like
+ * virDomainCoreDumpWithFormat() with VIR_DUMP_MEMORY_ONLY, but instead of
+ * writing the dump into a file on the host it is transferred to the caller
+ * through @stream.
+ *
+ * This call sets up a stream and starts the dump; subsequent use of stream
+ * API is necessary to transfer actual data, determine how much data is
+ * successfully transferred, and detect any errors. The dump runs as a job
+ * of the domain until all data was read from the stream, its progress can
+ * be watched using virDomainGetJobStats(). Aborting the stream cancels the
+ * dump.
+ *
+ * @dumpformat controls which format the dump will have. The compressed
+ * kdump formats are written in the flattened format of makedumpfile, since
+ * the stream cannot be seeked, and need to be converted by
+ * "makedumpfile -R" before analysis. Not all hypervisors are able to
+ * support all formats.
+ *
+ * If @flags includes VIR_DUMP_LIVE, then make the dump while continuing to
+ * allow the guest to run; otherwise, the guest is suspended during the
+ * dump. VIR_DUMP_MEMORY_ONLY is implied, other flags are not supported.
+ *
+ * Returns 0 in case of success and -1 in case of failure.
+ */
+int
+virDomainCoreDumpStream(virDomainPtr domain,
+                        virStreamPtr stream,
+                        unsigned int dumpformat,
+                        unsigned int flags)
+{
+    virConnectPtr conn;
+
+    VIR_DOMAIN_DEBUG(domain, "stream=%p, dumpformat=%u, flags=0x%x",
+                     stream, dumpformat, flags);
+
+    virResetLastError();
+
+    virCheckDomainReturn(domain, -1);
+    conn = domain->conn;
+
+    virCheckStreamGoto(stream, error);
+    virCheckReadOnlyGoto(conn->flags, error);
+
+    if (conn != stream->conn) {
+        virReportInvalidArg(stream,
+                            _("stream must match connection of domain '%s'"),
+                            domain->name);
+        goto error;
+    }
+
+    if (dumpformat >= VIR_DOMAIN_CORE_DUMP_FORMAT_LAST) {
+        virReportInvalidArg(flags, _("dumpformat '%d' is not supported"),
+                            dumpformat);
+        goto error;
+    }
+
+    if (conn->driver->domainCoreDumpStream) {
+        int ret;
+        ret = conn->driver->domainCoreDumpStream(domain, stream,
+                                                 dumpformat, flags);
+
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+
+ error:
+    virDispatchError(domain->conn);
+    return -1;
+}
+
 /**
  * virDomainScreenshot:
  * @domain: a domain object
@@ -8245,6 +8325,62 @@ virDomainAttachDeviceFlags(virDomainPtr domain,
 }
 
 
+/**
+ * virDomainAttachDevices:
+ * @domain: pointer to domain object
+ * @xmls: array of XML descriptions of one device each
+ * @nxmls: number of items in @xmls
+ * @flags: bitwise-OR of virDomainDeviceModifyFlags
+ *
+ * Attach several virtual devices to a domain at once. The devices are
+ * attached in the order they appear in @xmls and @flags have the same
+ * meaning as for virDomainAttachDeviceFlags(). Compared to attaching the
+ * devices one by one, the hypervisor driver may share the work common
+ * to all of them, such as saving the domain configuration.
+ *
+ * If attaching any of the devices fails, the persistent domain
+ * configuration is not modified. The devices attached to the running
+ * domain before the one which failed remain attached though, the caller
+ * may find out which they are from the domain XML.
+ *
+ * Returns 0 in case of success, -1 in case of failure.
+ */
+int
+virDomainAttachDevices(virDomainPtr domain,
+                       const char **xmls,
+                       unsigned int nxmls,
+                       unsigned int flags)
+{
+    virConnectPtr conn;
+
+    VIR_DOMAIN_DEBUG(domain, "xmls=%p, nxmls=%u, flags=0x%x",
+                     xmls, nxmls, flags);
+
+    virResetLastError();
+
+    virCheckDomainReturn(domain, -1);
+    conn = domain->conn;
+
+    virCheckNonNullArgGoto(xmls, error);
+    virCheckPositiveArgGoto(nxmls, error);
+    virCheckReadOnlyGoto(conn->flags, error);
+
+    if (conn->driver->domainAttachDevices) {
+        int ret;
+        ret = conn->driver->domainAttachDevices(domain, xmls, nxmls, flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+
+ error:
+    virDispatchError(domain->conn);
+    return -1;
+}
+
+
 /**
  * virDomainDetachDevice:
  * @domain: pointer to domain object
@@ -8324,7 +8460,10 @@ virDomainDetachDevice(virDomainPtr domain, const char *xml)
  * clients work better in most cases, this API will try to transform an
  * asynchronous device removal that finishes shortly after the request into
  * a synchronous removal. In other words, this API may wait a bit for the
- * removal to complete in case it was not synchronous.
+ * removal to complete in case it was not synchronous. Passing
+ * VIR_DOMAIN_DEVICE_MODIFY_ASYNC in @flags makes the API return as soon as
+ * the removal is requested, the VIR_DOMAIN_EVENT_ID_DEVICE_REMOVED event
+ * then signals the device was removed.
  *
  * Be aware that hotplug changes might not persist across a domain going
  * into S4 state (also known as hibernation) unless you also modify the
@@ -9929,6 +10068,8 @@ virDomainBlockJobAbort(virDomainPtr dom, const char *disk,
  * VIR_DOMAIN_BLOCK_JOB_INFO_BANDWIDTH_BYTES, bandwidth is in bytes/second
  * (although this mode can risk failure due to overflow, depending on both
  * client and server word size); otherwise, the value is rounded up to MiB/s.
+ * For jobs with adaptive speed (see virDomainBlockJobSetSpeed()) the
+ * bandwidth field holds the speed currently chosen by the hypervisor.
  *
  * The @disk parameter is either an unambiguous source name of the
  * block device (the <source file='...'/> sub-element, such as
@@ -10004,6 +10145,15 @@ virDomainGetBlockJobInfo(virDomainPtr dom, const char *disk,
  * virDomainGetBlockJobInfo() without scaling.  Hypervisors may further
  * restrict the range of valid bandwidth values.
  *
+ * If @flags contains VIR_DOMAIN_BLOCK_JOB_SPEED_ADAPTIVE, the hypervisor
+ * keeps adjusting the speed of the job so that the latency of guest
+ * requests to the disk stays below a target configured on the host, and
+ * @bandwidth is the upper bound of the speed, with 0 meaning no bound.
+ * The job slows down while the guest is busy and speeds up once it gets
+ * idle. The speed currently chosen by the hypervisor is reported by
+ * virDomainGetBlockJobInfo(). Setting the speed without the flag turns
+ * the adjustments off again.
+ *
  * The @disk parameter is either an unambiguous source name of the
  * block device (the <source file='...'/> sub-element, such as
  * "/path/to/image"), or (since 0.9.5) the device target shorthand
@@ -11198,6 +11348,303 @@ virDomainFSThaw(virDomainPtr dom,
     return -1;
 }
 
+
+/*
+ * Checks @doms is a non-empty NULL terminated list of domains of a single
+ * read-write connection. Returns the connection and the number of domains
+ * in @ndoms or NULL on error.
+ */
+static virConnectPtr
+virDomainListFSFreezeCheckDomains(virDomainPtr *doms,
+                                  unsigned int *ndoms)
+{
+    virConnectPtr conn;
+    virDomainPtr *nextdom = doms;
+
+    *ndoms = 0;
+
+    if (!*doms) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("doms array in %s must contain at least one domain"),
+                       __FUNCTION__);
+        return NULL;
+    }
+
+    conn = doms[0]->conn;
+    virCheckConnectGoto(conn, error);
+    virCheckReadOnlyGoto(conn->flags, error);
+
+    while (*nextdom) {
+        virDomainPtr dom = *nextdom;
+
+        virCheckDomainGoto(dom, error);
+
+        if (dom->conn != conn) {
+            virReportError(VIR_ERR_INVALID_ARG, "%s",
+                           _("domains in 'doms' array must belong to a "
+                             "single connection"));
+            goto error;
+        }
+
+        (*ndoms)++;
+        nextdom++;
+    }
+
+    return conn;
+
+ error:
+    return NULL;
+}
+
+
+/**
+ * virDomainListFSFreeze:
+ * @doms: NULL terminated array of domains
+ * @timeout: how long to wait for all domains in seconds, or 0 to only use
+ *           the response timeout of the guest agent of each domain
+ * @retResults: Pointer that will be filled with the array of results
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Freeze all mounted filesystems within each of the domains in @doms, as
+ * virDomainFSFreeze does with no mount points. The hypervisor driver may
+ * talk to the guests concurrently, which makes freezing many domains at
+ * once, e.g. for a consistent backup of a group of them, much faster than
+ * calling virDomainFSFreeze for each of them. All domains in @doms must
+ * share the same connection.
+ *
+ * If @timeout is positive, domains which did not respond within @timeout
+ * seconds since the call was made are reported as failed. Note that their
+ * file systems may still get frozen later and the caller should thaw all
+ * domains it tried to freeze once it is done.
+ *
+ * The failure to freeze a domain does not fail the whole call, it is
+ * reported in the record of the domain instead.
+ *
+ * Returns the count of returned records on success, -1 on error. The
+ * results are returned in the @retResults parameter. The returned array
+ * should be freed by the caller. See virDomainFSFreezeRecordListFree.
+ * Note that the count of returned records may be less than the domain
+ * count provided via @doms if some of the domains no longer exist.
+ */
+int
+virDomainListFSFreeze(virDomainPtr *doms,
+                      int timeout,
+                      virDomainFSFreezeRecordPtr **retResults,
+                      unsigned int flags)
+{
+    virConnectPtr conn = NULL;
+    unsigned int ndoms;
+    int ret = -1;
+
+    VIR_DEBUG("doms=%p, timeout=%d, retResults=%p, flags=0x%x",
+              doms, timeout, retResults, flags);
+
+    virResetLastError();
+
+    virCheckNonNullArgGoto(doms, cleanup);
+    virCheckNonNullArgGoto(retResults, cleanup);
+    virCheckNonNegativeArgGoto(timeout, cleanup);
+
+    if (!(conn = virDomainListFSFreezeCheckDomains(doms, &ndoms)))
+        goto cleanup;
+
+    if (!conn->driver->domainListFSFreeze) {
+        virReportUnsupportedError();
+        goto cleanup;
+    }
+
+    ret = conn->driver->domainListFSFreeze(conn, doms, ndoms, timeout,
+                                           retResults, flags);
+
+ cleanup:
+    if (ret < 0)
+        virDispatchError(conn);
+    return ret;
+}
+
+
+/**
+ * virDomainListFSThaw:
+ * @doms: NULL terminated array of domains
+ * @timeout: how long to wait for all domains in seconds, or 0 to only use
+ *           the response timeout of the guest agent of each domain
+ * @retResults: Pointer that will be filled with the array of results
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Thaw all file systems within each of the domains in @doms, the
+ * counterpart of virDomainListFSFreeze. See virDomainListFSFreeze for the
+ * meaning of the arguments and the returned records.
+ *
+ * Returns the count of returned records on success, -1 on error.
+ */
+int
+virDomainListFSThaw(virDomainPtr *doms,
+                    int timeout,
+                    virDomainFSFreezeRecordPtr **retResults,
+                    unsigned int flags)
+{
+    virConnectPtr conn = NULL;
+    unsigned int ndoms;
+    int ret = -1;
+
+    VIR_DEBUG("doms=%p, timeout=%d, retResults=%p, flags=0x%x",
+              doms, timeout, retResults, flags);
+
+    virResetLastError();
+
+    virCheckNonNullArgGoto(doms, cleanup);
+    virCheckNonNullArgGoto(retResults, cleanup);
+    virCheckNonNegativeArgGoto(timeout, cleanup);
+
+    if (!(conn = virDomainListFSFreezeCheckDomains(doms, &ndoms)))
+        goto cleanup;
+
+    if (!conn->driver->domainListFSThaw) {
+        virReportUnsupportedError();
+        goto cleanup;
+    }
+
+    ret = conn->driver->domainListFSThaw(conn, doms, ndoms, timeout,
+                                         retResults, flags);
+
+ cleanup:
+    if (ret < 0)
+        virDispatchError(conn);
+    return ret;
+}
+
+
+/**
+ * virDomainFSFreezeRecordListFree:
+ * @results: NULL terminated array of virDomainFSFreezeRecords to free
+ *
+ * Convenience function to free a list of results returned by
+ * virDomainListFSFreeze and virDomainListFSThaw.
+ */
+void
+virDomainFSFreezeRecordListFree(virDomainFSFreezeRecordPtr *results)
+{
+    virDomainFSFreezeRecordPtr *next;
+
+    if (!results)
+        return;
+
+    for (next = results; *next; next++) {
+        VIR_FREE((*next)->error);
+        virDomainFree((*next)->dom);
+        VIR_FREE(*next);
+    }
+
+    VIR_FREE(results);
+}
+
+
+/**
+ * virDomainListStop:
+ * @doms: NULL terminated array of domains
+ * @parallel: the maximum number of domains stopped at the same time, or 0
+ *            to let the hypervisor driver choose
+ * @timeout: how long to wait for all domains in seconds, or 0 to wait for
+ *           as long as it takes
+ * @retResults: Pointer that will be filled with the array of results
+ * @flags: bitwise-OR of virDomainListStopFlags
+ *
+ * Stops all running domains in @doms, which is meant to be used before
+ * the host is shut down for maintenance. By default each domain is shut
+ * down as with virDomainShutdown and the call waits until the domain is
+ * no longer running. With VIR_DOMAIN_LIST_STOP_MANAGED_SAVE the domains
+ * are saved as with virDomainManagedSave, optionally bypassing the file
+ * system cache with VIR_DOMAIN_LIST_STOP_BYPASS_CACHE, and with
+ * VIR_DOMAIN_LIST_STOP_SUSPEND they are suspended as with
+ * virDomainSuspend. Domains which are not running when their turn comes
+ * are left alone and reported as stopped. All domains in @doms must share
+ * the same connection.
+ *
+ * Up to @parallel domains are handled at the same time. If @timeout is
+ * positive, domains which did not stop within @timeout seconds since the
+ * call was made are reported as failed, and domains whose turn comes
+ * after the deadline are not touched at all. A managed save which is
+ * already running is not interrupted by the deadline though.
+ *
+ * The usual lifecycle events are emitted for each domain as it stops,
+ * so applications can watch the progress of the call by registering for
+ * them.
+ *
+ * The failure to stop a domain does not fail the whole call, it is
+ * reported in the record of the domain instead.
+ *
+ * Returns the count of returned records on success, -1 on error. The
+ * results are returned in the @retResults parameter. The returned array
+ * should be freed by the caller. See virDomainStopRecordListFree.
+ * Note that the count of returned records may be less than the domain
+ * count provided via @doms if some of the domains no longer exist.
+ */
+int
+virDomainListStop(virDomainPtr *doms,
+                  unsigned int parallel,
+                  int timeout,
+                  virDomainStopRecordPtr **retResults,
+                  unsigned int flags)
+{
+    virConnectPtr conn = NULL;
+    unsigned int ndoms;
+    int ret = -1;
+
+    VIR_DEBUG("doms=%p, parallel=%u, timeout=%d, retResults=%p, flags=0x%x",
+              doms, parallel, timeout, retResults, flags);
+
+    virResetLastError();
+
+    virCheckNonNullArgGoto(doms, cleanup);
+    virCheckNonNullArgGoto(retResults, cleanup);
+    virCheckNonNegativeArgGoto(timeout, cleanup);
+
+    VIR_EXCLUSIVE_FLAGS_GOTO(VIR_DOMAIN_LIST_STOP_MANAGED_SAVE,
+                             VIR_DOMAIN_LIST_STOP_SUSPEND,
+                             cleanup);
+
+    if (!(conn = virDomainListFSFreezeCheckDomains(doms, &ndoms)))
+        goto cleanup;
+
+    if (!conn->driver->domainListStop) {
+        virReportUnsupportedError();
+        goto cleanup;
+    }
+
+    ret = conn->driver->domainListStop(conn, doms, ndoms, parallel, timeout,
+                                       retResults, flags);
+
+ cleanup:
+    if (ret < 0)
+        virDispatchError(conn);
+    return ret;
+}
+
+
+/**
+ * virDomainStopRecordListFree:
+ * @results: NULL terminated array of virDomainStopRecords to free
+ *
+ * Convenience function to free a list of results returned by
+ * virDomainListStop.
+ */
+void
+virDomainStopRecordListFree(virDomainStopRecordPtr *results)
+{
+    virDomainStopRecordPtr *next;
+
+    if (!results)
+        return;
+
+    for (next = results; *next; next++) {
+        VIR_FREE((*next)->error);
+        virDomainFree((*next)->dom);
+        VIR_FREE(*next);
+    }
+
+    VIR_FREE(results);
+}
+
 /**
  * virDomainGetTime:
  * @dom: a domain object
@@ -11434,6 +11881,9 @@ virConnectGetDomainCapabilities(virConnectPtr conn,
  *     "cpu.user" - user cpu time spent in nanoseconds as unsigned long long.
  *     "cpu.system" - system cpu time spent in nanoseconds as unsigned long
  *                    long.
+ *     "cpu.helpers.time" - cpu time spent by helper processes of the domain,
+ *                          e.g. virtiofsd, in nanoseconds as unsigned long
+ *                          long. It is included in "cpu.time".
  *     "cpu.cache.monitor.count" - the number of cache monitors for this domain
  *     "cpu.cache.monitor.<num>.name" - the name of cache monitor <num>
  *     "cpu.cache.monitor.<num>.vcpus" - vcpu list of cache monitor <num>
@@ -11552,6 +12002,19 @@ virConnectGetDomainCapabilities(virConnectPtr conn,
  *     "block.<num>.fl.reqs" - total flush requests as unsigned long long.
  *     "block.<num>.fl.times" - total time (ns) spent on cache flushing as
  *                              unsigned long long.
+ *     "block.<num>.rd.hist.count" - number of bins of the read latency
+ *                                   histogram as unsigned long long. Only
+ *                                   present if the histogram is enabled
+ *                                   in the disk's <driver><statistics>.
+ *     "block.<num>.rd.hist.<bin>.start" - lowest latency (ns) counted in
+ *                                         the bin as unsigned long long.
+ *     "block.<num>.rd.hist.<bin>.value" - number of read requests whose
+ *                                         latency fell into the bin as
+ *                                         unsigned long long.
+ *     "block.<num>.wr.hist.*" - same as "block.<num>.rd.hist.*" for write
+ *                               requests.
+ *     "block.<num>.fl.hist.*" - same as "block.<num>.rd.hist.*" for flush
+ *                               requests.
  *     "block.<num>.errors" - Xen only: the 'oo_req' value as
  *                            unsigned long long.
  *     "block.<num>.allocation" - offset of the highest written sector
@@ -11632,6 +12095,15 @@ virConnectGetDomainCapabilities(virConnectPtr conn,
  *     "perf.emulation_faults" - The count of emulation faults as unsigned
  *                               long long. It is produced by the
  *                               emulation_faults perf event
+ *     "perf.vcpu.<num>.<event>" - the count of <event> for the thread of
+ *                                 vCPU <num> as unsigned long long. Only
+ *                                 reported for the cpu_cycles, instructions
+ *                                 and cache_misses events and if the
+ *                                 hypervisor is configured to do so.
+ *
+ *     Counts of events which the kernel had to multiplex with other events
+ *     on the hardware counters are scaled to the whole time the event was
+ *     enabled.
  *
  * VIR_DOMAIN_STATS_IOTHREAD:
  *     Return IOThread statistics if available. IOThread polling is a
@@ -11692,6 +12164,116 @@ virConnectGetDomainCapabilities(virConnectPtr conn,
  *                       bytes consumed by @vcpus that passing through all
  *                       memory controllers, either local or remote controller.
  *
+ * VIR_DOMAIN_STATS_DIRTYRATE:
+ *     Return the result of the last memory dirty rate calculation started by
+ *     virDomainStartDirtyRateCalc(). The typed parameter keys are in this
+ *     format:
+ *
+ *     "dirtyrate.calc_status" - the status of the last calculation as an int,
+ *                               one of virDomainDirtyRateStatus
+ *     "dirtyrate.calc_start_time" - the start time of the last calculation in
+ *                                   seconds as a long long
+ *     "dirtyrate.calc_period" - the period of the last calculation in seconds
+ *                               as an int
+ *     "dirtyrate.megabytes_per_second" - the calculated memory dirty rate in
+ *                                        MiB/s as a long long. It is present
+ *                                        only if the calculation is completed.
+ *
+ * VIR_DOMAIN_STATS_PRESSURE:
+ *     Return the pressure stall information (PSI) of the domain, i.e. how
+ *     much time its tasks spent waiting for a resource. Only available on
+ *     hosts using cgroups v2 with PSI enabled. The typed parameter keys are
+ *     in this format:
+ *
+ *     "pressure.<resource>.<type>.avg10" - percentage of time in the last
+ *                                          10 seconds the tasks of the domain
+ *                                          were stalled as a double
+ *     "pressure.<resource>.<type>.avg60" - same over the last 60 seconds
+ *     "pressure.<resource>.<type>.avg300" - same over the last 300 seconds
+ *     "pressure.<resource>.<type>.total" - total time stalled in microseconds
+ *                                          as unsigned long long
+ *
+ *     where <resource> is one of "cpu", "memory" or "io" and <type> is
+ *     "some" for time when at least one task was stalled, or "full" for
+ *     time when all non-idle tasks were stalled at once. "full" may be
+ *     missing for "cpu".
+ *
+ * VIR_DOMAIN_STATS_NUMA:
+ *     Return how much of the domain's memory is resident on each host NUMA
+ *     node. The typed parameter keys are in this format:
+ *
+ *     "numa.node.<num>.resident" - memory of the domain resident on host
+ *                                  NUMA node <num> in KiB as unsigned
+ *                                  long long. Nodes without any memory
+ *                                  of the domain are omitted.
+ *     "numa.cell.<cell>.node.<num>.resident" - memory of guest NUMA cell
+ *                                  <cell> resident on host NUMA node <num>
+ *                                  in KiB as unsigned long long. Only
+ *                                  reported for guests with NUMA cells
+ *                                  backed by hugepages or files, as the
+ *                                  memory of the individual cells can't
+ *                                  be told apart otherwise.
+ *
+ * VIR_DOMAIN_STATS_MEMORY_HOST:
+ *     Return how the memory of the domain is backed on the host. The typed
+ *     parameter keys are in this format:
+ *
+ *     "memory.host.share_pages" - whether the host may merge identical
+ *                                 pages of the domain (KSM) as boolean.
+ *     "memory.host.rss" - memory of the domain resident on the host in KiB
+ *                         as unsigned long long.
+ *     "memory.host.thp" - memory backed by transparent huge pages in KiB
+ *                         as unsigned long long.
+ *     "memory.host.hugetlb" - memory backed by hugetlbfs pages in KiB as
+ *                             unsigned long long.
+ *     "memory.host.ksm.rmap_items" - number of reverse mapping items KSM
+ *                                    keeps for the domain as unsigned long
+ *                                    long.
+ *     "memory.host.ksm.merging_pages" - number of pages of the domain merged
+ *                                       by KSM as unsigned long long.
+ *     "memory.host.ksm.zero_pages" - number of empty pages of the domain
+ *                                    merged with the zero page as unsigned
+ *                                    long long.
+ *     "memory.host.ksm.profit" - memory saved by KSM minus its overhead in
+ *                                bytes as long long, may be negative.
+ *
+ *     The "memory.host.ksm.*" fields are only reported on hosts whose kernel
+ *     provides per process KSM statistics.
+ *
+ * VIR_DOMAIN_STATS_MONITOR:
+ *     Return the latency of commands sent to the hypervisor monitor of the
+ *     domain since it was started, per command name. The typed parameter
+ *     keys are in this format:
+ *
+ *     "monitor.bucket.count" - number of buckets of the latency histogram
+ *                              as unsigned int.
+ *     "monitor.bucket.<num>.limit" - upper limit of the latency of bucket
+ *                                    <num> in microseconds as unsigned long
+ *                                    long. The last bucket has no limit.
+ *     "monitor.command.count" - number of command names reported as
+ *                               unsigned int.
+ *     "monitor.command.<num>.name" - name of the command as string.
+ *     "monitor.command.<num>.count" - number of commands sent as unsigned
+ *                                     long long.
+ *     "monitor.command.<num>.failed" - number of commands which did not get
+ *                                      a reply as unsigned long long.
+ *     "monitor.command.<num>.queue.time" - total time the commands waited
+ *                                          for other commands on the monitor
+ *                                          in microseconds as unsigned long
+ *                                          long.
+ *     "monitor.command.<num>.write.time" - total time spent writing the
+ *                                          commands in microseconds as
+ *                                          unsigned long long.
+ *     "monitor.command.<num>.reply.time" - total time the commands waited
+ *                                          for their reply in microseconds
+ *                                          as unsigned long long.
+ *     "monitor.command.<num>.max" - longest latency of a command in
+ *                                   microseconds as unsigned long long.
+ *     "monitor.command.<num>.bucket.<bucket>" - number of commands whose
+ *                                               latency fell into bucket
+ *                                               <bucket> as unsigned long
+ *                                               long.
+ *
  * Note that entire stats groups or individual stat fields may be missing from
  * the output in case they are not supported by the given hypervisor, are not
  * applicable for the current state of the guest domain, or their retrieval
@@ -11714,6 +12296,12 @@ virConnectGetDomainCapabilities(virConnectPtr conn,
  * is returned for the domain.  That subset being statistics that
  * don't involve querying the underlying hypervisor.
  *
+ * Passing VIR_CONNECT_GET_ALL_DOMAINS_STATS_CACHED in @flags allows the
+ * hypervisor driver to return statistics it has gathered recently
+ * instead of querying each domain again, if it keeps such a cache. How
+ * old the cached statistics may be is a matter of the driver
+ * configuration.
+ *
  * Similarly to virConnectListAllDomains, @flags can contain various flags to
  * filter the list of domains to provide stats for.
  *
@@ -11804,6 +12392,12 @@ virConnectGetAllDomainStats(virConnectPtr conn,
  * is returned for the domain.  That subset being statistics that
  * don't involve querying the underlying hypervisor.
  *
+ * Passing VIR_CONNECT_GET_ALL_DOMAINS_STATS_CACHED in @flags allows the
+ * hypervisor driver to return statistics it has gathered recently
+ * instead of querying each domain again, if it keeps such a cache. How
+ * old the cached statistics may be is a matter of the driver
+ * configuration.
+ *
  * Note that any of the domain list filtering flags in @flags may be rejected
  * by this function.
  *
@@ -11898,6 +12492,182 @@ virDomainStatsRecordListFree(virDomainStatsRecordPtr *stats)
 }
 
 
+/**
+ * virConnectGetAllDomainXMLDesc:
+ * @conn: pointer to the hypervisor connection
+ * @xmlflags: bitwise-OR of virDomainXMLFlags
+ * @retDescs: Pointer that will be filled with the array of returned XMLs
+ * @flags: extra flags; binary-OR of virConnectListAllDomainsFlags
+ *
+ * Provide the XML description of all domains on the connection in a
+ * single call. The descriptions are the same as those returned by
+ * virDomainGetXMLDesc called with @xmlflags for each of the domains,
+ * but fetching them at once saves a round trip per domain on remote
+ * connections.
+ *
+ * By default all domains are returned, @flags may contain the filters
+ * of virConnectListAllDomains to return only some of them. Domains
+ * the client is not allowed to read (with VIR_DOMAIN_XML_SECURE or
+ * VIR_DOMAIN_XML_MIGRATABLE in @xmlflags, to read securely) are
+ * silently skipped.
+ *
+ * On remote connections all descriptions are returned in one message,
+ * the call fails if they don't fit. Use virDomainListGetXMLDesc on
+ * smaller lists of domains in that case.
+ *
+ * Returns the count of returned records on success, -1 on error.
+ * The requested data are returned in the @retDescs parameter. The
+ * returned array should be freed by the caller. See
+ * virDomainXMLDescRecordListFree.
+ */
+int
+virConnectGetAllDomainXMLDesc(virConnectPtr conn,
+                              unsigned int xmlflags,
+                              virDomainXMLDescRecordPtr **retDescs,
+                              unsigned int flags)
+{
+    int ret = -1;
+
+    VIR_DEBUG("conn=%p, xmlflags=0x%x, retDescs=%p, flags=0x%x",
+              conn, xmlflags, retDescs, flags);
+
+    virResetLastError();
+
+    virCheckConnectReturn(conn, -1);
+    virCheckNonNullArgGoto(retDescs, cleanup);
+
+    if ((conn->flags & VIR_CONNECT_RO) &&
+        (xmlflags & (VIR_DOMAIN_XML_SECURE | VIR_DOMAIN_XML_MIGRATABLE))) {
+        virReportError(VIR_ERR_OPERATION_DENIED, "%s",
+                       _("virConnectGetAllDomainXMLDesc with secure flag"));
+        goto cleanup;
+    }
+
+    if (!conn->driver->connectGetAllDomainXMLDesc) {
+        virReportUnsupportedError();
+        goto cleanup;
+    }
+
+    ret = conn->driver->connectGetAllDomainXMLDesc(conn, NULL, 0, xmlflags,
+                                                   retDescs, flags);
+
+ cleanup:
+    if (ret < 0)
+        virDispatchError(conn);
+
+    return ret;
+}
+
+
+/**
+ * virDomainListGetXMLDesc:
+ * @doms: NULL terminated array of domains
+ * @xmlflags: bitwise-OR of virDomainXMLFlags
+ * @retDescs: Pointer that will be filled with the array of returned XMLs
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Provide the XML description of the domains in @doms in a single
+ * call, see virConnectGetAllDomainXMLDesc. Note that all domains in
+ * @doms must share the same connection.
+ *
+ * Returns the count of returned records on success, -1 on error.
+ * The requested data are returned in the @retDescs parameter. The
+ * returned array should be freed by the caller. See
+ * virDomainXMLDescRecordListFree. Note that the count of returned
+ * records may be less than the domain count provided via @doms.
+ */
+int
+virDomainListGetXMLDesc(virDomainPtr *doms,
+                        unsigned int xmlflags,
+                        virDomainXMLDescRecordPtr **retDescs,
+                        unsigned int flags)
+{
+    virConnectPtr conn = NULL;
+    virDomainPtr *nextdom = doms;
+    unsigned int ndoms = 0;
+    int ret = -1;
+
+    VIR_DEBUG("doms=%p, xmlflags=0x%x, retDescs=%p, flags=0x%x",
+              doms, xmlflags, retDescs, flags);
+
+    virResetLastError();
+
+    virCheckNonNullArgGoto(doms, cleanup);
+    virCheckNonNullArgGoto(retDescs, cleanup);
+
+    if (!*doms) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("doms array in %s must contain at least one domain"),
+                       __FUNCTION__);
+        goto cleanup;
+    }
+
+    conn = doms[0]->conn;
+    virCheckConnectReturn(conn, -1);
+
+    if ((conn->flags & VIR_CONNECT_RO) &&
+        (xmlflags & (VIR_DOMAIN_XML_SECURE | VIR_DOMAIN_XML_MIGRATABLE))) {
+        virReportError(VIR_ERR_OPERATION_DENIED, "%s",
+                       _("virDomainListGetXMLDesc with secure flag"));
+        goto cleanup;
+    }
+
+    if (!conn->driver->connectGetAllDomainXMLDesc) {
+        virReportUnsupportedError();
+        goto cleanup;
+    }
+
+    while (*nextdom) {
+        virDomainPtr dom = *nextdom;
+
+        virCheckDomainGoto(dom, cleanup);
+
+        if (dom->conn != conn) {
+            virReportError(VIR_ERR_INVALID_ARG, "%s",
+                           _("domains in 'doms' array must belong to a "
+                             "single connection"));
+            goto cleanup;
+        }
+
+        ndoms++;
+        nextdom++;
+    }
+
+    ret = conn->driver->connectGetAllDomainXMLDesc(conn, doms, ndoms,
+                                                   xmlflags, retDescs, flags);
+
+ cleanup:
+    if (ret < 0)
+        virDispatchError(conn);
+    return ret;
+}
+
+
+/**
+ * virDomainXMLDescRecordListFree:
+ * @descs: NULL terminated array of virDomainXMLDescRecords to free
+ *
+ * Convenience function to free a list of domain XML descriptions
+ * returned by virDomainListGetXMLDesc and virConnectGetAllDomainXMLDesc.
+ */
+void
+virDomainXMLDescRecordListFree(virDomainXMLDescRecordPtr *descs)
+{
+    virDomainXMLDescRecordPtr *next;
+
+    if (!descs)
+        return;
+
+    for (next = descs; *next; next++) {
+        VIR_FREE((*next)->xml);
+        virDomainFree((*next)->dom);
+        VIR_FREE(*next);
+    }
+
+    VIR_FREE(descs);
+}
+
+
 /**
  * virDomainGetFSInfo:
  * @dom: a domain object
@@ -12755,3 +13525,50 @@ virDomainBackupGetXMLDesc(virDomainPtr domain,
     virDispatchError(conn);
     return NULL;
 }
+
+
+/**
+ * virDomainStartDirtyRateCalc:
+ * @domain: a domain object
+ * @seconds: specified calculating time in seconds
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Calculate the current domain's memory dirty rate in next @seconds.
+ * The calculated dirty rate information is available by calling
+ * virConnectGetAllDomainStats with the VIR_DOMAIN_STATS_DIRTYRATE group.
+ * The calculation runs in the background and does not affect the guest
+ * beyond the cost of tracking written pages, which makes it suitable for
+ * estimating the cost of migrating the domain before starting it.
+ *
+ * Returns 0 in case of success, -1 otherwise.
+ */
+int
+virDomainStartDirtyRateCalc(virDomainPtr domain,
+                            int seconds,
+                            unsigned int flags)
+{
+    virConnectPtr conn;
+
+    VIR_DOMAIN_DEBUG(domain, "seconds=%d, flags=0x%x", seconds, flags);
+
+    virResetLastError();
+
+    virCheckDomainReturn(domain, -1);
+    conn = domain->conn;
+
+    virCheckReadOnlyGoto(conn->flags, error);
+
+    if (conn->driver->domainStartDirtyRateCalc) {
+        int ret;
+        ret = conn->driver->domainStartDirtyRateCalc(domain, seconds, flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+
+ error:
+    virDispatchError(conn);
+    return -1;
+}
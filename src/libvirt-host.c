@@ -1707,6 +1707,143 @@ virNodeAllocPages(virConnectPtr conn,
 }
 
 
+/**
+ * virNodeSetPagesLayout:
+ * @conn: pointer to the hypervisor connection
+ * @params: the requested layout of the huge page pools
+ * @nparams: number of items in @params
+ * @result: pointer to be filled with the achieved layout, or NULL
+ * @nresult: pointer to the number of items in @result, or NULL
+ * @flags: extra flags; binary-OR of virNodeSetPagesLayoutFlags
+ *
+ * Resizes several huge page pools of the host at once, e.g. to reserve
+ * pages on multiple NUMA nodes for a batch of domains about to be
+ * started. Each item of @params is a VIR_NODE_PAGES_LAYOUT_COUNT field
+ * giving the number of pages of one size the pool of one NUMA node
+ * should have. Pools not mentioned are left alone.
+ *
+ * The NUMA nodes are processed in parallel. When a node is too
+ * fragmented to fit the requested huge pages, its memory is compacted
+ * and the allocation retried. As the kernel might still fail to provide
+ * all the pages, the resulting number of pages of each requested pool is
+ * returned in @result using the same field names. Unless @flags contains
+ * VIR_NODE_SET_PAGES_LAYOUT_STRICT, pools which could not be resized in
+ * full are not considered an error. The caller should free @result with
+ * virTypedParamsFree().
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNodeSetPagesLayout(virConnectPtr conn,
+                      virTypedParameterPtr params,
+                      int nparams,
+                      virTypedParameterPtr *result,
+                      int *nresult,
+                      unsigned int flags)
+{
+    VIR_DEBUG("conn=%p params=%p nparams=%d result=%p nresult=%p flags=0x%x",
+              conn, params, nparams, result, nresult, flags);
+    VIR_TYPED_PARAMS_DEBUG(params, nparams);
+
+    virResetLastError();
+
+    virCheckConnectReturn(conn, -1);
+    virCheckReadOnlyGoto(conn->flags, error);
+    virCheckNonNullArgGoto(params, error);
+    virCheckPositiveArgGoto(nparams, error);
+    if (result)
+        virCheckNonNullArgGoto(nresult, error);
+
+    if (virTypedParameterValidateSet(conn, params, nparams) < 0)
+        goto error;
+
+    if (conn->driver->nodeSetPagesLayout) {
+        int ret;
+        ret = conn->driver->nodeSetPagesLayout(conn, params, nparams,
+                                               result, nresult, flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+ error:
+    virDispatchError(conn);
+    return -1;
+}
+
+
+/**
+ * virNodeGetAllCPUStats:
+ * @conn: pointer to the hypervisor connection
+ * @params: pointer to be filled with the statistics
+ * @nparams: pointer to the number of items in @params
+ * @flags: extra flags; binary-OR of virNodeGetAllCPUStatsFlags
+ *
+ * Returns the CPU time statistics of the host and of each of its online
+ * CPUs at once. Unlike calling virNodeGetCPUStats() for every CPU, the
+ * hypervisor reads them in a single pass, which makes a difference on
+ * hosts with many CPUs.
+ *
+ * The typed parameter keys are in this format, all times are in
+ * nanoseconds and reported as unsigned long long:
+ *
+ *     "cpu.total.kernel" - time spent in the kernel by all CPUs
+ *     "cpu.total.user" - time spent in user space by all CPUs
+ *     "cpu.total.idle" - time all CPUs were idle
+ *     "cpu.total.iowait" - time all CPUs were waiting for I/O
+ *     "cpu.<num>.kernel", "cpu.<num>.user", "cpu.<num>.idle",
+ *     "cpu.<num>.iowait" - the same for host CPU <num>
+ *
+ * With VIR_NODE_GET_ALL_CPU_STATS_FREQUENCY:
+ *
+ *     "cpu.<num>.frequency" - current frequency of CPU <num> in kHz as
+ *                             unsigned long long, if known
+ *
+ * With VIR_NODE_GET_ALL_CPU_STATS_IDLE_STATES:
+ *
+ *     "cpu.<num>.idle.count" - number of idle states of CPU <num> as
+ *                              unsigned int
+ *     "cpu.<num>.idle.<state>.name" - name of the idle state as string
+ *     "cpu.<num>.idle.<state>.time" - time spent in the idle state as
+ *                                     unsigned long long
+ *     "cpu.<num>.idle.<state>.usage" - number of times the idle state was
+ *                                      entered as unsigned long long
+ *
+ * The caller should free @params with virTypedParamsFree().
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNodeGetAllCPUStats(virConnectPtr conn,
+                      virTypedParameterPtr *params,
+                      int *nparams,
+                      unsigned int flags)
+{
+    VIR_DEBUG("conn=%p, params=%p, nparams=%p, flags=0x%x",
+              conn, params, nparams, flags);
+
+    virResetLastError();
+
+    virCheckConnectReturn(conn, -1);
+    virCheckNonNullArgGoto(params, error);
+    virCheckNonNullArgGoto(nparams, error);
+
+    if (conn->driver->nodeGetAllCPUStats) {
+        int ret;
+        ret = conn->driver->nodeGetAllCPUStats(conn, params, nparams, flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+ error:
+    virDispatchError(conn);
+    return -1;
+}
+
+
 /*
  * virNodeGetSEVInfo:
  * @conn: pointer to the hypervisor connection
@@ -818,3 +818,42 @@ virConnectSecretEventDeregisterAny(virConnectPtr conn,
     virDispatchError(conn);
     return -1;
 }
+
+
+/*
+ * Not for public use.  This function is part of the internal
+ * implementation of fetching secrets in the remote case.
+ *
+ * Fetches values of all secrets described by @lookups in one call. The
+ * values are filled into @lookups and must be cleared by the caller.
+ */
+int
+virConnectSecretGetValues(virConnectPtr conn,
+                          virSecretValueLookupPtr lookups,
+                          size_t nlookups,
+                          unsigned int flags)
+{
+    VIR_DEBUG("conn=%p, lookups=%p, nlookups=%zu, flags=0x%x",
+              conn, lookups, nlookups, flags);
+
+    virResetLastError();
+
+    virCheckConnectReturn(conn, -1);
+    virCheckReadOnlyGoto(conn->flags, error);
+    virCheckNonNullArgGoto(lookups, error);
+
+    if (conn->secretDriver &&
+        conn->secretDriver->connectSecretGetValues) {
+        int ret;
+        ret = conn->secretDriver->connectSecretGetValues(conn, lookups,
+                                                         nlookups, flags, 0);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+ error:
+    virDispatchError(conn);
+    return -1;
+}
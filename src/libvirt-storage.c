@@ -886,12 +886,20 @@ virStoragePoolRef(virStoragePoolPtr pool)
 /**
  * virStoragePoolRefresh:
  * @pool: pointer to storage pool
- * @flags: extra flags; not used yet, so callers should always pass 0
+ * @flags: bitwise-OR of virStoragePoolRefreshFlags
  *
  * Request that the pool refresh its list of volumes. This may
  * involve communicating with a remote server, and/or initializing
  * new devices at the OS layer
  *
+ * With VIR_STORAGE_POOL_REFRESH_INCREMENTAL, pools backed by a local
+ * or network filesystem directory only probe files whose inode, size,
+ * modification or change time differ from what was seen by the previous
+ * refresh, and keep serving the previous list of volumes until the new
+ * one is complete. Changes which leave all of those untouched, such as
+ * a modified backing file of a volume, are not picked up. Other pool
+ * types do a full refresh.
+ *
  * Returns 0 if the volume list was refreshed, -1 on failure
  */
 int
@@ -1490,6 +1498,13 @@ virStorageVolGetKey(virStorageVolPtr vol)
  * qcow2 image files which don't support full preallocation,
  * by creating a sparse image file with metadata.
  *
+ * If VIR_STORAGE_VOL_CREATE_ASYNC is present in @flags, the volume is
+ * returned as soon as allocating it started. The progress can then be
+ * followed with virStorageVolGetJobInfo, the job cancelled with
+ * virStorageVolAbortJob, and a VIR_STORAGE_POOL_EVENT_ID_REFRESH event
+ * is emitted for the pool once the job finished. If the job fails, the
+ * volume is removed from the pool.
+ *
  * virStorageVolFree should be used to free the resources after the
  * storage volume object is no longer needed.
  *
@@ -1541,6 +1556,18 @@ virStorageVolCreateXML(virStoragePoolPtr pool,
  * qcow2 image files which don't support full preallocation,
  * by creating a sparse image file with metadata.
  *
+ * Storage backends which clone volumes as copy-on-write children of
+ * @clonevol, such as RBD, copy all data of the parent into the new volume
+ * when VIR_STORAGE_VOL_CREATE_FLATTEN is present in @flags, so that it
+ * no longer depends on @clonevol.
+ *
+ * If VIR_STORAGE_VOL_CREATE_ASYNC is present in @flags, the volume is
+ * returned as soon as allocating it started. The progress can then be
+ * followed with virStorageVolGetJobInfo, the job cancelled with
+ * virStorageVolAbortJob, and a VIR_STORAGE_POOL_EVENT_ID_REFRESH event
+ * is emitted for the pool once the job finished. If the job fails, the
+ * volume is removed from the pool.
+ *
  * virStorageVolFree should be used to free the resources after the
  * storage volume object is no longer needed.
  *
@@ -1738,6 +1765,12 @@ virStorageVolUpload(virStorageVolPtr vol,
  *
  * Delete the storage volume from the pool
  *
+ * If VIR_STORAGE_VOL_DELETE_ASYNC is present in @flags, the function
+ * returns as soon as deleting the volume started. The progress can then
+ * be followed with virStorageVolGetJobInfo, the job cancelled with
+ * virStorageVolAbortJob, and a VIR_STORAGE_POOL_EVENT_ID_REFRESH event
+ * is emitted for the pool once the volume is gone.
+ *
  * Returns 0 on success, or -1 on error
  */
 int
@@ -1773,7 +1806,7 @@ virStorageVolDelete(virStorageVolPtr vol,
 /**
  * virStorageVolWipe:
  * @vol: pointer to storage volume
- * @flags: extra flags; not used yet, so callers should always pass 0
+ * @flags: bitwise-OR of virStorageVolWipeFlags
  *
  * Ensure data previously on a volume is not accessible to future reads.
  *
@@ -1787,6 +1820,9 @@ virStorageVolDelete(virStorageVolPtr vol,
  * stored journaled, log structured, copy-on-write, versioned, and
  * network file systems are known to be problematic.
  *
+ * If VIR_STORAGE_VOL_WIPE_ASYNC is present in @flags, the call returns
+ * as soon as the wipe started, see virStorageVolGetJobInfo.
+ *
  * Returns 0 on success, or -1 on error
  */
 int
@@ -1823,7 +1859,7 @@ virStorageVolWipe(virStorageVolPtr vol,
  * virStorageVolWipePattern:
  * @vol: pointer to storage volume
  * @algorithm: one of virStorageVolWipeAlgorithm
- * @flags: future flags, use 0 for now
+ * @flags: bitwise-OR of virStorageVolWipeFlags
  *
  * Similar to virStorageVolWipe, but one can choose between
  * different wiping algorithms. Also note, that depending on the
@@ -2014,6 +2050,96 @@ virStorageVolGetInfoFlags(virStorageVolPtr vol,
 }
 
 
+/**
+ * virStorageVolGetJobInfo:
+ * @vol: pointer to storage volume
+ * @info: pointer at which to store the job info
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Reports the progress of a long running job on the volume, such as
+ * allocating, cloning or wiping it. If no job is active, the type in
+ * @info is VIR_STORAGE_VOL_JOB_NONE. Progress is only known for the
+ * data copied or wiped by libvirt itself, jobs handed over to external
+ * tools report the total size only.
+ *
+ * Returns 0 on success, or -1 on failure
+ */
+int
+virStorageVolGetJobInfo(virStorageVolPtr vol,
+                        virStorageVolJobInfoPtr info,
+                        unsigned int flags)
+{
+    virConnectPtr conn;
+    VIR_DEBUG("vol=%p, info=%p, flags=0x%x", vol, info, flags);
+
+    virResetLastError();
+
+    if (info)
+        memset(info, 0, sizeof(*info));
+
+    virCheckStorageVolReturn(vol, -1);
+    virCheckNonNullArgGoto(info, error);
+
+    conn = vol->conn;
+
+    if (conn->storageDriver->storageVolGetJobInfo) {
+        int ret;
+        ret = conn->storageDriver->storageVolGetJobInfo(vol, info, flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+
+ error:
+    virDispatchError(vol->conn);
+    return -1;
+}
+
+
+/**
+ * virStorageVolAbortJob:
+ * @vol: pointer to storage volume
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Requests the job active on the volume to be cancelled. The job stops
+ * at its next progress update and fails with VIR_ERR_OPERATION_ABORTED;
+ * a volume which was being created or cloned is removed. Jobs handed
+ * over to external tools run to completion.
+ *
+ * Returns 0 on success, or -1 on failure
+ */
+int
+virStorageVolAbortJob(virStorageVolPtr vol,
+                      unsigned int flags)
+{
+    virConnectPtr conn;
+    VIR_DEBUG("vol=%p, flags=0x%x", vol, flags);
+
+    virResetLastError();
+
+    virCheckStorageVolReturn(vol, -1);
+    conn = vol->conn;
+
+    virCheckReadOnlyGoto(conn->flags, error);
+
+    if (conn->storageDriver && conn->storageDriver->storageVolAbortJob) {
+        int ret;
+        ret = conn->storageDriver->storageVolAbortJob(vol, flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+
+ error:
+    virDispatchError(vol->conn);
+    return -1;
+}
+
+
 /**
  * virStorageVolGetXMLDesc:
  * @vol: pointer to storage volume
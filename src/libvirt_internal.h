@@ -25,6 +25,7 @@
 #pragma once
 
 #include "internal.h"
+#include "virsecret.h"
 
 typedef void (*virStateInhibitCallback)(bool inhibit,
                                         void *opaque);
@@ -124,6 +125,21 @@ typedef enum {
      * Support for driver close callback rpc
      */
     VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK = 15,
+
+    /*
+     * Support for bulk domain stats with parameter names sent only once
+     */
+    VIR_DRV_FEATURE_REMOTE_COMPACT_STATS = 16,
+
+    /*
+     * Support for fetching values of several secrets in one call
+     */
+    VIR_DRV_FEATURE_REMOTE_SECRET_GET_VALUES = 17,
+
+    /*
+     * Support for calls carrying the trace context of the caller
+     */
+    VIR_DRV_FEATURE_REMOTE_TRACE_CONTEXT = 18,
 } virDrvFeature;
 
 
@@ -298,3 +314,8 @@ virTypedParameterValidateSet(virConnectPtr conn,
 int virStreamInData(virStreamPtr stream,
                     int *data,
                     long long *length);
+
+int virConnectSecretGetValues(virConnectPtr conn,
+                              virSecretValueLookupPtr lookups,
+                              size_t nlookups,
+                              unsigned int flags);
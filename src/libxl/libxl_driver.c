@@ -426,7 +426,7 @@ libxlReconnectDomain(virDomainObjPtr vm,
     }
 
     /* Update domid in case it changed (e.g. reboot) while we were gone? */
-    vm->def->id = d_info.domid;
+    virDomainObjListSetID(driver->domains, vm, d_info.domid);
 
     libxlLoggerOpenFile(cfg->logger, vm->def->id, vm->def->name, NULL);
 
@@ -1547,7 +1547,7 @@ libxlDomainPMWakeup(virDomainPtr dom, unsigned int flags)
 
  destroy_dom:
     libxlDomainDestroyInternal(driver, vm);
-    vm->def->id = -1;
+    virDomainObjListSetID(driver->domains, vm, -1);
     virDomainObjSetState(vm, VIR_DOMAIN_SHUTOFF, VIR_DOMAIN_SHUTOFF_FAILED);
     event = virDomainEventLifecycleNewFromObj(vm, VIR_DOMAIN_EVENT_STOPPED,
                                               VIR_DOMAIN_EVENT_STOPPED_FAILED);
@@ -5777,7 +5777,10 @@ libxlConnectSupportsFeature(virConnectPtr conn, int feature)
     case VIR_DRV_FEATURE_PROGRAM_KEEPALIVE:
     case VIR_DRV_FEATURE_REMOTE:
     case VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK:
+    case VIR_DRV_FEATURE_REMOTE_COMPACT_STATS:
     case VIR_DRV_FEATURE_REMOTE_EVENT_CALLBACK:
+    case VIR_DRV_FEATURE_REMOTE_SECRET_GET_VALUES:
+    case VIR_DRV_FEATURE_REMOTE_TRACE_CONTEXT:
     case VIR_DRV_FEATURE_XML_MIGRATABLE:
     default:
         return 0;
@@ -26,11 +26,84 @@
 #include "viruuid.h"
 #include "virerror.h"
 #include "virlog.h"
+#include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_LOCKING
 
 VIR_LOG_INIT("locking.domain_lock");
 
+/* Totals of all domains, one entry per lock driver */
+static virMutex virDomainLockStatsLock = VIR_MUTEX_INITIALIZER;
+static virDomainLockDriverStatsPtr virDomainLockStatsList;
+static size_t virDomainLockStatsCount;
+
+
+static void
+virDomainLockStatsAdd(virDomainLockStatsPtr stats,
+                      bool acquire,
+                      unsigned long long elapsed,
+                      int rc,
+                      bool busy)
+{
+    if (acquire) {
+        stats->acquires++;
+        stats->acquireTime += elapsed;
+        stats->acquireTimeMax = MAX(stats->acquireTimeMax, elapsed);
+        if (rc < 0)
+            stats->acquireFailed++;
+        if (busy)
+            stats->acquireBusy++;
+    } else {
+        stats->releases++;
+        stats->releaseTime += elapsed;
+        stats->releaseTimeMax = MAX(stats->releaseTimeMax, elapsed);
+        if (rc < 0)
+            stats->releaseFailed++;
+    }
+}
+
+
+/*
+ * Accounts a call to the lock manager which started at @start (monotonic
+ * time in microseconds) and returned @rc, both into @dom and into the
+ * totals of the lock driver of @plugin. The caller must hold the lock
+ * of @dom.
+ */
+static void
+virDomainLockStatsRecord(virLockManagerPluginPtr plugin,
+                         virDomainObjPtr dom,
+                         bool acquire,
+                         long long start,
+                         int rc)
+{
+    const char *name = virLockManagerPluginGetName(plugin);
+    unsigned long long elapsed = g_get_monotonic_time() - start;
+    bool busy = rc < 0 && virGetLastErrorCode() == VIR_ERR_RESOURCE_BUSY;
+    virDomainLockDriverStats entry = { 0 };
+    size_t i;
+
+    virDomainLockStatsAdd(&dom->lockStats, acquire, elapsed, rc, busy);
+
+    virMutexLock(&virDomainLockStatsLock);
+
+    for (i = 0; i < virDomainLockStatsCount; i++) {
+        if (STREQ(virDomainLockStatsList[i].driver, name))
+            break;
+    }
+
+    if (i == virDomainLockStatsCount) {
+        entry.driver = g_strdup(name);
+        ignore_value(VIR_APPEND_ELEMENT_COPY(virDomainLockStatsList,
+                                             virDomainLockStatsCount,
+                                             entry));
+    }
+
+    virDomainLockStatsAdd(&virDomainLockStatsList[i].stats,
+                          acquire, elapsed, rc, busy);
+
+    virMutexUnlock(&virDomainLockStatsLock);
+}
+
 
 static int virDomainLockManagerAddLease(virLockManagerPtr lock,
                                         virDomainLeaseDefPtr lease)
@@ -174,6 +247,7 @@ int virDomainLockProcessStart(virLockManagerPluginPtr plugin,
     virLockManagerPtr lock;
     int ret;
     int flags = VIR_LOCK_MANAGER_ACQUIRE_RESTRICT;
+    long long start;
 
     VIR_DEBUG("plugin=%p dom=%p paused=%d fd=%p",
               plugin, dom, paused, fd);
@@ -185,9 +259,16 @@ int virDomainLockProcessStart(virLockManagerPluginPtr plugin,
     if (paused)
         flags |= VIR_LOCK_MANAGER_ACQUIRE_REGISTER_ONLY;
 
+    start = g_get_monotonic_time();
     ret = virLockManagerAcquire(lock, NULL, flags,
                                 dom->def->onLockFailure, fd);
 
+    /* A paused process is only registered, its leases are acquired by
+     * virDomainLockProcessResume. QEMU even does this in the forked
+     * child where no locks may be taken. */
+    if (!paused)
+        virDomainLockStatsRecord(plugin, dom, true, start, ret);
+
     virLockManagerFree(lock);
 
     return ret;
@@ -199,6 +280,7 @@ int virDomainLockProcessPause(virLockManagerPluginPtr plugin,
 {
     virLockManagerPtr lock;
     int ret;
+    long long start;
 
     VIR_DEBUG("plugin=%p dom=%p state=%p",
               plugin, dom, state);
@@ -206,7 +288,9 @@ int virDomainLockProcessPause(virLockManagerPluginPtr plugin,
     if (!(lock = virDomainLockManagerNew(plugin, NULL, dom, true, 0)))
         return -1;
 
+    start = g_get_monotonic_time();
     ret = virLockManagerRelease(lock, state, 0);
+    virDomainLockStatsRecord(plugin, dom, false, start, ret);
     virLockManagerFree(lock);
 
     return ret;
@@ -219,6 +303,7 @@ int virDomainLockProcessResume(virLockManagerPluginPtr plugin,
 {
     virLockManagerPtr lock;
     int ret;
+    long long start;
 
     VIR_DEBUG("plugin=%p dom=%p state=%s",
               plugin, dom, NULLSTR(state));
@@ -226,7 +311,9 @@ int virDomainLockProcessResume(virLockManagerPluginPtr plugin,
     if (!(lock = virDomainLockManagerNew(plugin, uri, dom, true, 0)))
         return -1;
 
+    start = g_get_monotonic_time();
     ret = virLockManagerAcquire(lock, state, 0, dom->def->onLockFailure, NULL);
+    virDomainLockStatsRecord(plugin, dom, true, start, ret);
     virLockManagerFree(lock);
 
     return ret;
@@ -259,6 +346,8 @@ int virDomainLockImageAttach(virLockManagerPluginPtr plugin,
 {
     virLockManagerPtr lock;
     int ret = -1;
+    long long start;
+    int rc;
 
     VIR_DEBUG("plugin=%p dom=%p src=%p", plugin, dom, src);
 
@@ -268,8 +357,10 @@ int virDomainLockImageAttach(virLockManagerPluginPtr plugin,
     if (virDomainLockManagerAddImage(lock, src) < 0)
         goto cleanup;
 
-    if (virLockManagerAcquire(lock, NULL, 0,
-                              dom->def->onLockFailure, NULL) < 0)
+    start = g_get_monotonic_time();
+    rc = virLockManagerAcquire(lock, NULL, 0, dom->def->onLockFailure, NULL);
+    virDomainLockStatsRecord(plugin, dom, true, start, rc);
+    if (rc < 0)
         goto cleanup;
 
     ret = 0;
@@ -287,6 +378,8 @@ int virDomainLockImageDetach(virLockManagerPluginPtr plugin,
 {
     virLockManagerPtr lock;
     int ret = -1;
+    long long start;
+    int rc;
 
     VIR_DEBUG("plugin=%p dom=%p src=%p", plugin, dom, src);
 
@@ -296,7 +389,10 @@ int virDomainLockImageDetach(virLockManagerPluginPtr plugin,
     if (virDomainLockManagerAddImage(lock, src) < 0)
         goto cleanup;
 
-    if (virLockManagerRelease(lock, NULL, 0) < 0)
+    start = g_get_monotonic_time();
+    rc = virLockManagerRelease(lock, NULL, 0);
+    virDomainLockStatsRecord(plugin, dom, false, start, rc);
+    if (rc < 0)
         goto cleanup;
 
     ret = 0;
@@ -315,6 +411,8 @@ int virDomainLockLeaseAttach(virLockManagerPluginPtr plugin,
 {
     virLockManagerPtr lock;
     int ret = -1;
+    long long start;
+    int rc;
 
     VIR_DEBUG("plugin=%p dom=%p lease=%p",
               plugin, dom, lease);
@@ -325,8 +423,10 @@ int virDomainLockLeaseAttach(virLockManagerPluginPtr plugin,
     if (virDomainLockManagerAddLease(lock, lease) < 0)
         goto cleanup;
 
-    if (virLockManagerAcquire(lock, NULL, 0,
-                              dom->def->onLockFailure, NULL) < 0)
+    start = g_get_monotonic_time();
+    rc = virLockManagerAcquire(lock, NULL, 0, dom->def->onLockFailure, NULL);
+    virDomainLockStatsRecord(plugin, dom, true, start, rc);
+    if (rc < 0)
         goto cleanup;
 
     ret = 0;
@@ -343,6 +443,8 @@ int virDomainLockLeaseDetach(virLockManagerPluginPtr plugin,
 {
     virLockManagerPtr lock;
     int ret = -1;
+    long long start;
+    int rc;
 
     VIR_DEBUG("plugin=%p dom=%p lease=%p",
               plugin, dom, lease);
@@ -353,7 +455,10 @@ int virDomainLockLeaseDetach(virLockManagerPluginPtr plugin,
     if (virDomainLockManagerAddLease(lock, lease) < 0)
         goto cleanup;
 
-    if (virLockManagerRelease(lock, NULL, 0) < 0)
+    start = g_get_monotonic_time();
+    rc = virLockManagerRelease(lock, NULL, 0);
+    virDomainLockStatsRecord(plugin, dom, false, start, rc);
+    if (rc < 0)
         goto cleanup;
 
     ret = 0;
@@ -363,3 +468,51 @@ int virDomainLockLeaseDetach(virLockManagerPluginPtr plugin,
 
     return ret;
 }
+
+
+/**
+ * virDomainLockGetStats:
+ * @stats: filled with the statistics, one entry per lock driver
+ *
+ * Reports how many leases were acquired and released through each
+ * lock driver since the daemon started, how many of these requests
+ * failed and how long they took. The caller has to free @stats using
+ * virDomainLockDriverStatsFree.
+ *
+ * Returns the number of entries in @stats
+ */
+size_t
+virDomainLockGetStats(virDomainLockDriverStatsPtr *stats)
+{
+    size_t nstats;
+    size_t i;
+
+    virMutexLock(&virDomainLockStatsLock);
+
+    nstats = virDomainLockStatsCount;
+    *stats = g_new0(virDomainLockDriverStats, nstats);
+
+    for (i = 0; i < nstats; i++) {
+        (*stats)[i].driver = g_strdup(virDomainLockStatsList[i].driver);
+        (*stats)[i].stats = virDomainLockStatsList[i].stats;
+    }
+
+    virMutexUnlock(&virDomainLockStatsLock);
+
+    return nstats;
+}
+
+
+void
+virDomainLockDriverStatsFree(virDomainLockDriverStatsPtr stats,
+                             size_t nstats)
+{
+    size_t i;
+
+    if (!stats)
+        return;
+
+    for (i = 0; i < nstats; i++)
+        g_free(stats[i].driver);
+    g_free(stats);
+}
@@ -56,3 +56,15 @@ int virDomainLockLeaseAttach(virLockManagerPluginPtr plugin,
 int virDomainLockLeaseDetach(virLockManagerPluginPtr plugin,
                              virDomainObjPtr dom,
                              virDomainLeaseDefPtr lease);
+
+typedef struct _virDomainLockDriverStats virDomainLockDriverStats;
+typedef virDomainLockDriverStats *virDomainLockDriverStatsPtr;
+struct _virDomainLockDriverStats {
+    char *driver;
+    virDomainLockStats stats;
+};
+
+size_t virDomainLockGetStats(virDomainLockDriverStatsPtr *stats)
+    ATTRIBUTE_NONNULL(1);
+void virDomainLockDriverStatsFree(virDomainLockDriverStatsPtr stats,
+                                  size_t nstats);
@@ -134,7 +134,8 @@ virLockDaemonNew(virLockDaemonConfigPtr config, bool privileged)
         goto error;
 
     if (!(srv = virNetServerNew("virtlockd", 1,
-                                0, 0, 0, config->max_clients,
+                                !!config->max_workers, config->max_workers,
+                                0, config->max_clients,
                                 config->max_clients, -1, 0,
                                 virLockDaemonClientNew,
                                 virLockDaemonClientPreExecRestart,
@@ -62,6 +62,7 @@ virLockDaemonConfigNew(bool privileged G_GNUC_UNUSED)
 
     data->max_clients = 1024;
     data->admin_max_clients = 5000;
+    data->max_workers = 5;
 
     return data;
 }
@@ -92,6 +93,8 @@ virLockDaemonConfigLoadOptions(virLockDaemonConfigPtr data,
         return -1;
     if (virConfGetValueUInt(conf, "admin_max_clients", &data->admin_max_clients) < 0)
         return -1;
+    if (virConfGetValueUInt(conf, "max_workers", &data->max_workers) < 0)
+        return -1;
 
     return 0;
 }
@@ -35,6 +35,20 @@ VIR_LOG_INIT("locking.lock_daemon_dispatch");
 
 #include "lock_daemon_dispatch_stubs.h"
 
+static unsigned int
+virLockSpaceProtocolAcquireFlags(unsigned int flags)
+{
+    unsigned int newFlags = 0;
+
+    if (flags & VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_SHARED)
+        newFlags |= VIR_LOCK_SPACE_ACQUIRE_SHARED;
+    if (flags & VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_AUTOCREATE)
+        newFlags |= VIR_LOCK_SPACE_ACQUIRE_AUTOCREATE;
+
+    return newFlags;
+}
+
+
 static int
 virLockSpaceProtocolDispatchAcquireResource(virNetServerPtr server G_GNUC_UNUSED,
                                             virNetServerClientPtr client,
@@ -47,7 +61,6 @@ virLockSpaceProtocolDispatchAcquireResource(virNetServerPtr server G_GNUC_UNUSED
     virLockDaemonClientPtr priv =
         virNetServerClientGetPrivateData(client);
     virLockSpacePtr lockspace;
-    unsigned int newFlags;
 
     virMutexLock(&priv->lock);
 
@@ -73,16 +86,10 @@ virLockSpaceProtocolDispatchAcquireResource(virNetServerPtr server G_GNUC_UNUSED
         goto cleanup;
     }
 
-    newFlags = 0;
-    if (flags & VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_SHARED)
-        newFlags |= VIR_LOCK_SPACE_ACQUIRE_SHARED;
-    if (flags & VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_AUTOCREATE)
-        newFlags |= VIR_LOCK_SPACE_ACQUIRE_AUTOCREATE;
-
     if (virLockSpaceAcquireResource(lockspace,
                                     args->name,
                                     priv->ownerPid,
-                                    newFlags) < 0)
+                                    virLockSpaceProtocolAcquireFlags(flags)) < 0)
         goto cleanup;
 
     rv = 0;
@@ -427,3 +434,89 @@ virLockSpaceProtocolDispatchCreateLockSpace(virNetServerPtr server G_GNUC_UNUSED
     virMutexUnlock(&priv->lock);
     return rv;
 }
+
+
+static int
+virLockSpaceProtocolDispatchAcquireResources(virNetServerPtr server G_GNUC_UNUSED,
+                                             virNetServerClientPtr client,
+                                             virNetMessagePtr msg G_GNUC_UNUSED,
+                                             virNetMessageErrorPtr rerr,
+                                             virLockSpaceProtocolAcquireResourcesArgs *args)
+{
+    int rv = -1;
+    unsigned int flags = args->flags;
+    virLockDaemonClientPtr priv =
+        virNetServerClientGetPrivateData(client);
+    g_autofree virLockSpacePtr *lockspaces = NULL;
+    size_t nacquired = 0;
+    size_t i;
+
+    virMutexLock(&priv->lock);
+
+    virCheckFlagsGoto(0, cleanup);
+
+    if (priv->restricted) {
+        virReportError(VIR_ERR_OPERATION_DENIED, "%s",
+                       _("lock manager connection has been restricted"));
+        goto cleanup;
+    }
+
+    if (!priv->ownerId) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("lock owner details have not been registered"));
+        goto cleanup;
+    }
+
+    lockspaces = g_new0(virLockSpacePtr, args->resources.resources_len);
+
+    for (i = 0; i < args->resources.resources_len; i++) {
+        virLockSpaceProtocolResource *res = &args->resources.resources_val[i];
+
+        if (res->flags & ~(VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_SHARED |
+                           VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_AUTOCREATE)) {
+            virReportError(VIR_ERR_INVALID_ARG,
+                           _("unsupported flags (0x%x) for resource %s"),
+                           res->flags, res->name);
+            goto cleanup;
+        }
+
+        if (!(lockspaces[i] = virLockDaemonFindLockSpace(lockDaemon, res->path))) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Lockspace for path %s does not exist"),
+                           res->path);
+            goto cleanup;
+        }
+    }
+
+    for (i = 0; i < args->resources.resources_len; i++) {
+        virLockSpaceProtocolResource *res = &args->resources.resources_val[i];
+
+        if (virLockSpaceAcquireResource(lockspaces[i],
+                                        res->name,
+                                        priv->ownerPid,
+                                        virLockSpaceProtocolAcquireFlags(res->flags)) < 0)
+            goto cleanup;
+        nacquired++;
+    }
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0) {
+        virErrorPtr err;
+
+        /* Either all resources are acquired or none */
+        virErrorPreserveLast(&err);
+        while (nacquired > 0) {
+            nacquired--;
+            virLockSpaceReleaseResource(lockspaces[nacquired],
+                                        args->resources.resources_val[nacquired].name,
+                                        priv->ownerPid);
+        }
+        virErrorRestore(&err);
+
+        virNetMessageSaveError(rerr);
+    }
+    virMutexUnlock(&priv->lock);
+    return rv;
+}
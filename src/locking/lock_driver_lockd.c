@@ -597,6 +597,50 @@ static int virLockManagerLockDaemonAddResource(virLockManagerPtr lock,
 }
 
 
+/*
+ * Acquires all resources of @priv in a single call. Returns 0 on
+ * success, 1 if virtlockd doesn't know that call yet, -1 on error.
+ */
+static int
+virLockManagerLockDaemonAcquireResources(virLockManagerLockDaemonPrivatePtr priv,
+                                         virNetClientPtr client,
+                                         virNetClientProgramPtr program,
+                                         int *counter)
+{
+    virLockSpaceProtocolAcquireResourcesArgs args;
+    g_autofree virLockSpaceProtocolResource *resources = NULL;
+    size_t i;
+
+    resources = g_new0(virLockSpaceProtocolResource, priv->nresources);
+    for (i = 0; i < priv->nresources; i++) {
+        resources[i].path = priv->resources[i].lockspace;
+        resources[i].name = priv->resources[i].name;
+        resources[i].flags = priv->resources[i].flags;
+    }
+
+    memset(&args, 0, sizeof(args));
+    args.resources.resources_len = priv->nresources;
+    args.resources.resources_val = resources;
+
+    if (virNetClientProgramCall(program,
+                                client,
+                                (*counter)++,
+                                VIR_LOCK_SPACE_PROTOCOL_PROC_ACQUIRE_RESOURCES,
+                                0, NULL, NULL, NULL,
+                                (xdrproc_t)xdr_virLockSpaceProtocolAcquireResourcesArgs, &args,
+                                (xdrproc_t)xdr_void, NULL) < 0) {
+        if (virGetLastErrorCode() == VIR_ERR_RPC) {
+            VIR_DEBUG("Batched acquire not supported, acquiring one by one");
+            virResetLastError();
+            return 1;
+        }
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int virLockManagerLockDaemonAcquire(virLockManagerPtr lock,
                                            const char *state G_GNUC_UNUSED,
                                            unsigned int flags,
@@ -628,8 +672,21 @@ static int virLockManagerLockDaemonAcquire(virLockManagerPtr lock,
         goto cleanup;
 
     if (!(flags & VIR_LOCK_MANAGER_ACQUIRE_REGISTER_ONLY)) {
-        size_t i;
-        for (i = 0; i < priv->nresources; i++) {
+        size_t i = 0;
+        int rc;
+
+        if (priv->nresources > 1) {
+            if ((rc = virLockManagerLockDaemonAcquireResources(priv, client,
+                                                               program,
+                                                               &counter)) < 0)
+                goto cleanup;
+
+            /* all done unless virtlockd is too old */
+            if (rc == 0)
+                i = priv->nresources;
+        }
+
+        for (; i < priv->nresources; i++) {
             virLockSpaceProtocolAcquireResourceArgs args;
 
             memset(&args, 0, sizeof(args));
@@ -18,6 +18,9 @@ typedef string virLockSpaceProtocolNonNullString<VIR_LOCK_SPACE_PROTOCOL_STRING_
 /* A long string, which may be NULL. */
 typedef virLockSpaceProtocolNonNullString *virLockSpaceProtocolString;
 
+/* Upper limit on number of resources acquired in one call */
+const VIR_LOCK_SPACE_PROTOCOL_RESOURCES_MAX = 4096;
+
 struct virLockSpaceProtocolOwner {
     virLockSpaceProtocolUUID uuid;
     virLockSpaceProtocolNonNullString name;
@@ -67,6 +70,17 @@ struct virLockSpaceProtocolCreateLockSpaceArgs {
     virLockSpaceProtocolNonNullString path;
 };
 
+struct virLockSpaceProtocolResource {
+    virLockSpaceProtocolNonNullString path;
+    virLockSpaceProtocolNonNullString name;
+    unsigned int flags; /* virLockSpaceProtocolAcquireResourceFlags */
+};
+
+struct virLockSpaceProtocolAcquireResourcesArgs {
+    virLockSpaceProtocolResource resources<VIR_LOCK_SPACE_PROTOCOL_RESOURCES_MAX>;
+    unsigned int flags;
+};
+
 
 /* Define the program number, protocol version and procedure numbers here. */
 const VIR_LOCK_SPACE_PROTOCOL_PROGRAM = 0xEA7BEEF;
@@ -145,5 +159,11 @@ enum virLockSpaceProtocolProcedure {
      * @generate: none
      * @acl: none
      */
-    VIR_LOCK_SPACE_PROTOCOL_PROC_CREATE_LOCKSPACE = 8
+    VIR_LOCK_SPACE_PROTOCOL_PROC_CREATE_LOCKSPACE = 8,
+
+    /**
+     * @generate: none
+     * @acl: none
+     */
+    VIR_LOCK_SPACE_PROTOCOL_PROC_ACQUIRE_RESOURCES = 9
 };
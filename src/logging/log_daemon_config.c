@@ -99,6 +99,16 @@ virLogDaemonConfigLoadOptions(virLogDaemonConfigPtr data,
         return -1;
     if (virConfGetValueSizeT(conf, "max_backups", &data->max_backups) < 0)
         return -1;
+    if (virConfGetValueBool(conf, "compress_backups", &data->compress_backups) < 0)
+        return -1;
+
+#if !WITH_ZSTD
+    if (data->compress_backups) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                       _("compress_backups requires a build with zstd support"));
+        return -1;
+    }
+#endif /* !WITH_ZSTD */
 
     return 0;
 }
@@ -63,6 +63,7 @@ struct _virLogHandler {
     bool privileged;
     size_t max_size;
     size_t max_backups;
+    bool compress_backups;
 
     virLogHandlerLogFilePtr *files;
     size_t nfiles;
@@ -143,8 +144,6 @@ virLogHandlerDomainLogFileEvent(int watch,
 {
     virLogHandlerPtr handler = opaque;
     virLogHandlerLogFilePtr logfile;
-    char buf[1024];
-    ssize_t len;
 
     virObjectLock(handler);
     logfile = virLogHandlerGetLogFileFromWatch(handler, watch);
@@ -159,18 +158,7 @@ virLogHandlerDomainLogFileEvent(int watch,
         goto cleanup;
     }
 
- reread:
-    len = read(fd, buf, sizeof(buf));
-    if (len < 0) {
-        if (errno == EINTR)
-            goto reread;
-
-        virReportSystemError(errno, "%s",
-                             _("Unable to read from log pipe"));
-        goto error;
-    }
-
-    if (virRotatingFileWriterAppend(logfile->file, buf, len) != len)
+    if (virRotatingFileWriterAppendFD(logfile->file, fd) < 0)
         goto error;
 
     if (events & VIR_EVENT_HANDLE_HANGUP)
@@ -191,6 +179,7 @@ virLogHandlerPtr
 virLogHandlerNew(bool privileged,
                  size_t max_size,
                  size_t max_backups,
+                 bool compress_backups,
                  virLogHandlerShutdownInhibitor inhibitor,
                  void *opaque)
 {
@@ -205,6 +194,7 @@ virLogHandlerNew(bool privileged,
     handler->privileged = privileged;
     handler->max_size = max_size;
     handler->max_backups = max_backups;
+    handler->compress_backups = compress_backups;
     handler->inhibitor = inhibitor;
     handler->opaque = opaque;
 
@@ -263,6 +253,9 @@ virLogHandlerLogFilePostExecRestart(virLogHandlerPtr handler,
                                                false,
                                                DEFAULT_MODE)) == NULL)
         goto error;
+    if (virRotatingFileWriterSetCompress(file->file,
+                                         handler->compress_backups) < 0)
+        goto error;
 
     if (virJSONValueObjectGetNumberInt(object, "pipefd", &file->pipefd) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
@@ -289,6 +282,7 @@ virLogHandlerNewPostExecRestart(virJSONValuePtr object,
                                 bool privileged,
                                 size_t max_size,
                                 size_t max_backups,
+                                bool compress_backups,
                                 virLogHandlerShutdownInhibitor inhibitor,
                                 void *opaque)
 {
@@ -299,6 +293,7 @@ virLogHandlerNewPostExecRestart(virJSONValuePtr object,
     if (!(handler = virLogHandlerNew(privileged,
                                      max_size,
                                      max_backups,
+                                     compress_backups,
                                      inhibitor,
                                      opaque)))
         return NULL;
@@ -405,6 +400,9 @@ virLogHandlerDomainOpenLogFile(virLogHandlerPtr handler,
                                                trunc,
                                                DEFAULT_MODE)) == NULL)
         goto error;
+    if (virRotatingFileWriterSetCompress(file->file,
+                                         handler->compress_backups) < 0)
+        goto error;
 
     if (VIR_APPEND_ELEMENT_COPY(handler->files, handler->nfiles, file) < 0)
         goto error;
@@ -437,8 +435,6 @@ virLogHandlerDomainOpenLogFile(virLogHandlerPtr handler,
 static void
 virLogHandlerDomainLogFileDrain(virLogHandlerLogFilePtr file)
 {
-    char buf[1024];
-    ssize_t len;
     struct pollfd pfd;
     int ret;
 
@@ -458,15 +454,8 @@ virLogHandlerDomainLogFileDrain(virLogHandlerLogFilePtr file)
         if (ret == 0)
             return;
 
-        len = read(file->pipefd, buf, sizeof(buf));
         file->drained = true;
-        if (len < 0) {
-            if (errno == EINTR)
-                continue;
-            return;
-        }
-
-        if (virRotatingFileWriterAppend(file->file, buf, len) != len)
+        if (virRotatingFileWriterAppendFD(file->file, file->pipefd) <= 0)
             return;
     }
 }
@@ -592,6 +581,10 @@ virLogHandlerDomainAppendLogFile(virLogHandlerPtr handler,
                                                    DEFAULT_MODE)))
             goto cleanup;
 
+        if (virRotatingFileWriterSetCompress(newwriter,
+                                             handler->compress_backups) < 0)
+            goto cleanup;
+
         writer = newwriter;
     }
 
@@ -26,6 +26,7 @@
 #include "domain_cgroup.h"
 #include "virfile.h"
 #include "virerror.h"
+#include "virhostcpu.h"
 #include "virlog.h"
 #include "virstring.h"
 #include "virsystemd.h"
@@ -173,6 +174,138 @@ int virLXCCgroupGetMeminfo(virLXCMeminfoPtr meminfo)
 }
 
 
+void virLXCCpuinfoClear(virLXCCpuinfoPtr cpuinfo)
+{
+    virBitmapFree(cpuinfo->cpus);
+    cpuinfo->cpus = NULL;
+    VIR_FREE(cpuinfo->percpu);
+}
+
+
+/*
+ * Gets the host CPUs the container may run on, limited to as many
+ * CPUs as the CFS quota allows to use at once, and the CPU time the
+ * container consumed so far.
+ */
+int virLXCCgroupGetCpuinfo(virLXCCpuinfoPtr cpuinfo)
+{
+    g_autofree char *cpuset = NULL;
+    long long quota = 0;
+    unsigned long long period = 0;
+    virCgroupPtr cgroup;
+    int ret = -1;
+
+    memset(cpuinfo, 0, sizeof(*cpuinfo));
+
+    if (virCgroupNewSelf(&cgroup) < 0)
+        return -1;
+
+    if (virCgroupHasController(cgroup, VIR_CGROUP_CONTROLLER_CPUSET) &&
+        virCgroupGetCpusetCpus(cgroup, &cpuset) == 0 &&
+        *cpuset &&
+        !(cpuinfo->cpus = virBitmapParseUnlimited(cpuset)))
+        goto cleanup;
+
+    if (!cpuinfo->cpus &&
+        !(cpuinfo->cpus = virHostCPUGetOnlineBitmap()))
+        goto cleanup;
+
+    if (virCgroupHasController(cgroup, VIR_CGROUP_CONTROLLER_CPU) &&
+        virCgroupGetCpuCfsQuota(cgroup, &quota) == 0 &&
+        virCgroupGetCpuCfsPeriod(cgroup, &period) == 0 &&
+        quota > 0 && period > 0) {
+        size_t limit = (quota + period - 1) / period;
+        ssize_t cpu = -1;
+        size_t n = 0;
+
+        while ((cpu = virBitmapNextSetBit(cpuinfo->cpus, cpu)) >= 0) {
+            if (n++ >= limit)
+                ignore_value(virBitmapClearBit(cpuinfo->cpus, cpu));
+        }
+    }
+
+    if (virCgroupGetCpuacctStat(cgroup, &cpuinfo->user, &cpuinfo->sys) < 0)
+        goto cleanup;
+
+    if (virCgroupGetCpuacctPercpuUsage(cgroup, &cpuinfo->percpu) < 0)
+        virResetLastError();
+
+    ret = 0;
+ cleanup:
+    if (ret < 0)
+        virLXCCpuinfoClear(cpuinfo);
+    virCgroupFree(&cgroup);
+    return ret;
+}
+
+
+/*
+ * Counts the threads of the container and those of them which are
+ * runnable or in uninterruptible sleep, which is what the kernel
+ * counts in load averages.
+ */
+int virLXCCgroupGetTasks(unsigned int *running,
+                         unsigned int *total)
+{
+    g_autofree char *path = NULL;
+    g_autofree char *tasks = NULL;
+    g_auto(GStrv) tids = NULL;
+    virCgroupPtr cgroup;
+    size_t i;
+    int ret = -1;
+
+    *running = 0;
+    *total = 0;
+
+    if (virCgroupNewSelf(&cgroup) < 0)
+        return -1;
+
+    /* cgroup v2 lists threads in cgroup.threads */
+    if (virCgroupPathOfController(cgroup, VIR_CGROUP_CONTROLLER_CPUACCT,
+                                  "tasks", &path) < 0)
+        goto cleanup;
+
+    if (!virFileExists(path)) {
+        VIR_FREE(path);
+        if (virCgroupPathOfController(cgroup, VIR_CGROUP_CONTROLLER_CPUACCT,
+                                      "cgroup.threads", &path) < 0)
+            goto cleanup;
+    }
+
+    if (virFileReadAll(path, 1024 * 1024, &tasks) < 0)
+        goto cleanup;
+
+    tids = g_strsplit(tasks, "\n", 0);
+
+    for (i = 0; tids[i]; i++) {
+        g_autofree char *stat = NULL;
+        char *state;
+
+        if (!*tids[i])
+            continue;
+
+        (*total)++;
+
+        if (virFileReadValueString(&stat, "/proc/%s/stat", tids[i]) < 0) {
+            /* the thread exited meanwhile */
+            virResetLastError();
+            continue;
+        }
+
+        /* the state follows the command name which may contain spaces
+         * and parentheses */
+        if ((state = strrchr(stat, ')')) &&
+            (STRPREFIX(state, ") R") || STRPREFIX(state, ") D")))
+            (*running)++;
+    }
+
+    ret = 0;
+ cleanup:
+    virCgroupFree(&cgroup);
+    return ret;
+}
+
+
 
 typedef struct _virLXCCgroupDevicePolicy virLXCCgroupDevicePolicy;
 typedef virLXCCgroupDevicePolicy *virLXCCgroupDevicePolicyPtr;
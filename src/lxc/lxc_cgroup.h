@@ -36,6 +36,10 @@ int virLXCCgroupSetup(virDomainDefPtr def,
                       virBitmapPtr nodemask);
 
 int virLXCCgroupGetMeminfo(virLXCMeminfoPtr meminfo);
+int virLXCCgroupGetCpuinfo(virLXCCpuinfoPtr cpuinfo);
+void virLXCCpuinfoClear(virLXCCpuinfoPtr cpuinfo);
+int virLXCCgroupGetTasks(unsigned int *running,
+                         unsigned int *total);
 
 int
 virLXCSetupHostUSBDeviceCgroup(virUSBDevicePtr dev,
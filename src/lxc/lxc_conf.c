@@ -268,6 +268,9 @@ virLXCLoadDriverConfig(virLXCDriverConfigPtr cfg,
     if (virConfGetValueBool(conf, "security_require_confined", &cfg->securityRequireConfined) < 0)
         return -1;
 
+    if (virConfGetValueUInt(conf, "max_concurrent_starts", &cfg->maxConcurrentStarts) < 0)
+        return -1;
+
     return 0;
 }
 
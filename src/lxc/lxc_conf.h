@@ -61,6 +61,8 @@ struct _virLXCDriverConfig {
     char *securityDriverName;
     bool securityDefaultConfined;
     bool securityRequireConfined;
+
+    unsigned int maxConcurrentStarts;
 };
 
 struct _virLXCDriver {
@@ -86,6 +88,11 @@ struct _virLXCDriver {
     /* Atomic inc/dec only */
     unsigned int nactive;
 
+    /* Require lock, number of domains being started and a condition
+     * signalled whenever one of them finishes */
+    unsigned int nstarting;
+    virCond startCond;
+
     /* Immutable pointers. Caller must provide locking */
     virStateInhibitCallback inhibitCallback;
     void *inhibitOpaque;
@@ -51,6 +51,7 @@
 #include "virerror.h"
 #include "virlog.h"
 #include "lxc_container.h"
+#include "lxc_fuse.h"
 #include "viralloc.h"
 #include "virnetdevveth.h"
 #include "viruuid.h"
@@ -931,20 +932,25 @@ static int lxcContainerMountBasicFS(bool userns_enabled,
 static int lxcContainerMountProcFuse(virDomainDefPtr def,
                                      const char *stateDir)
 {
-    g_autofree char *meminfo_path = NULL;
+    size_t i;
 
-    VIR_DEBUG("Mount /proc/meminfo stateDir=%s", stateDir);
+    for (i = 0; i < VIR_LXC_FUSE_FILE_LAST; i++) {
+        const char *name = virLXCFuseFileTypeToString(i);
+        g_autofree char *src = NULL;
+        g_autofree char *dst = NULL;
 
-    meminfo_path = g_strdup_printf("/.oldroot/%s/%s.fuse/meminfo",
-                                   stateDir,
-                                   def->name);
+        VIR_DEBUG("Mount /proc/%s stateDir=%s", name, stateDir);
 
-    if (mount(meminfo_path, "/proc/meminfo",
-              NULL, MS_BIND, NULL) < 0) {
-        virReportSystemError(errno,
-                             _("Failed to mount %s on /proc/meminfo"),
-                             meminfo_path);
-        return -1;
+        src = g_strdup_printf("/.oldroot/%s/%s.fuse/%s",
+                              stateDir, def->name, name);
+        dst = g_strdup_printf("/proc/%s", name);
+
+        if (mount(src, dst, NULL, MS_BIND, NULL) < 0) {
+            virReportSystemError(errno,
+                                 _("Failed to mount %s on %s"),
+                                 src, dst);
+            return -1;
+        }
     }
 
     return 0;
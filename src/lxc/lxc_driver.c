@@ -1499,6 +1499,13 @@ static int lxcStateInitialize(bool privileged,
         return VIR_DRV_STATE_INIT_ERROR;
     }
 
+    if (virCondInit(&lxc_driver->startCond) < 0) {
+        virMutexDestroy(&lxc_driver->lock);
+        g_free(lxc_driver);
+        lxc_driver = NULL;
+        return VIR_DRV_STATE_INIT_ERROR;
+    }
+
     if (!(lxc_driver->domains = virDomainObjListNew()))
         goto cleanup;
 
@@ -1631,6 +1638,7 @@ static int lxcStateCleanup(void)
         virPidFileRelease(lxc_driver->config->stateDir, "driver", lxc_driver->lockFD);
 
     virObjectUnref(lxc_driver->config);
+    virCondDestroy(&lxc_driver->startCond);
     virMutexDestroy(&lxc_driver->lock);
     g_free(lxc_driver);
     lxc_driver = NULL;
@@ -1659,7 +1667,10 @@ lxcConnectSupportsFeature(virConnectPtr conn, int feature)
     case VIR_DRV_FEATURE_PROGRAM_KEEPALIVE:
     case VIR_DRV_FEATURE_REMOTE:
     case VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK:
+    case VIR_DRV_FEATURE_REMOTE_COMPACT_STATS:
     case VIR_DRV_FEATURE_REMOTE_EVENT_CALLBACK:
+    case VIR_DRV_FEATURE_REMOTE_SECRET_GET_VALUES:
+    case VIR_DRV_FEATURE_REMOTE_TRACE_CONTEXT:
     case VIR_DRV_FEATURE_XML_MIGRATABLE:
     default:
         return 0;
@@ -35,25 +35,53 @@
 
 #define VIR_FROM_THIS VIR_FROM_LXC
 
+VIR_ENUM_IMPL(virLXCFuseFile,
+              VIR_LXC_FUSE_FILE_LAST,
+              "meminfo",
+              "cpuinfo",
+              "stat",
+              "loadavg",
+              "uptime",
+);
+
 #if WITH_FUSE
 
-static const char *fuse_meminfo_path = "/meminfo";
+/* How long the generated content of a file is served to further reads */
+# define LXC_FUSE_CACHE_TTL (1000 * 1000)
+
+/* Load averages are computed like the kernel does it, see
+ * include/linux/sched/loadavg.h, i.e. in fixed point arithmetic with
+ * 11 bits of precision from samples taken every 5 seconds */
+# define LXC_FUSE_FSHIFT 11
+# define LXC_FUSE_FIXED_1 (1UL << LXC_FUSE_FSHIFT)
+# define LXC_FUSE_LOAD_FREQ (5 * G_USEC_PER_SEC)
+# define LXC_FUSE_LOAD_INT(x) ((x) >> LXC_FUSE_FSHIFT)
+# define LXC_FUSE_LOAD_FRAC(x) LXC_FUSE_LOAD_INT(((x) & (LXC_FUSE_FIXED_1 - 1)) * 100)
+
+/* 1/exp(5sec/1min), 1/exp(5sec/5min) and 1/exp(5sec/15min) */
+static const unsigned long lxcLoadExp[] = { 1884, 2014, 2037 };
+
+typedef int (*lxcProcGenerateFunc)(virLXCFusePtr fuse,
+                                   const char *hostpath,
+                                   virBufferPtr buf);
+
 
 static int lxcProcGetattr(const char *path, struct stat *stbuf)
 {
-    g_autofree char *mempath = NULL;
+    g_autofree char *hostpath = NULL;
     struct stat sb;
     struct fuse_context *context = fuse_get_context();
-    virDomainDefPtr def = (virDomainDefPtr)context->private_data;
+    virLXCFusePtr fuse = context->private_data;
+    virDomainDefPtr def = fuse->def;
 
     memset(stbuf, 0, sizeof(struct stat));
-    mempath = g_strdup_printf("/proc/%s", path);
+    hostpath = g_strdup_printf("/proc/%s", path);
 
     if (STREQ(path, "/")) {
         stbuf->st_mode = S_IFDIR | 0755;
         stbuf->st_nlink = 2;
-    } else if (STREQ(path, fuse_meminfo_path)) {
-        if (stat(mempath, &sb) < 0)
+    } else if (virLXCFuseFileTypeFromString(path + 1) >= 0) {
+        if (stat(hostpath, &sb) < 0)
             return -errno;
 
         stbuf->st_uid = def->idmap.uidmap ? def->idmap.uidmap[0].target : 0;
@@ -78,20 +106,23 @@ static int lxcProcReaddir(const char *path, void *buf,
                           off_t offset G_GNUC_UNUSED,
                           struct fuse_file_info *fi G_GNUC_UNUSED)
 {
+    size_t i;
+
     if (STRNEQ(path, "/"))
         return -ENOENT;
 
     filler(buf, ".", NULL, 0);
     filler(buf, "..", NULL, 0);
-    filler(buf, fuse_meminfo_path + 1, NULL, 0);
+    for (i = 0; i < VIR_LXC_FUSE_FILE_LAST; i++)
+        filler(buf, virLXCFuseFileTypeToString(i), NULL, 0);
 
     return 0;
 }
 
-static int lxcProcOpen(const char *path G_GNUC_UNUSED,
-                       struct fuse_file_info *fi G_GNUC_UNUSED)
+static int lxcProcOpen(const char *path,
+                       struct fuse_file_info *fi)
 {
-    if (STRNEQ(path, fuse_meminfo_path))
+    if (*path != '/' || virLXCFuseFileTypeFromString(path + 1) < 0)
         return -ENOENT;
 
     if ((fi->flags & 3) != O_RDONLY)
@@ -116,36 +147,41 @@ static int lxcProcHostRead(char *path, char *buf, size_t size, off_t offset)
     return res;
 }
 
-static int lxcProcReadMeminfo(char *hostpath, virDomainDefPtr def,
-                              char *buf, size_t size, off_t offset)
+static unsigned long long lxcProcUptime(virLXCFusePtr fuse)
 {
-    int res;
+    return (g_get_monotonic_time() - fuse->started) * 1000ULL;
+}
+
+static unsigned long long lxcProcNsToTicks(unsigned long long ns)
+{
+    long hz = sysconf(_SC_CLK_TCK);
+
+    if (hz <= 0)
+        hz = 100;
+
+    return ns / (1000000000ULL / hz);
+}
+
+static int lxcProcGenerateMeminfo(virLXCFusePtr fuse,
+                                  const char *hostpath,
+                                  virBufferPtr new_meminfo)
+{
+    virDomainDefPtr def = fuse->def;
+    int res = -1;
     FILE *fd = NULL;
     g_autofree char *line = NULL;
     size_t n;
     struct virLXCMeminfo meminfo;
-    g_auto(virBuffer) buffer = VIR_BUFFER_INITIALIZER;
-    virBufferPtr new_meminfo = &buffer;
 
-    if (virLXCCgroupGetMeminfo(&meminfo) < 0) {
-        virErrorSetErrnoFromLastError();
-        return -errno;
-    }
+    if (virLXCCgroupGetMeminfo(&meminfo) < 0)
+        return -1;
 
     fd = fopen(hostpath, "r");
     if (fd == NULL) {
         virReportSystemError(errno, _("Cannot open %s"), hostpath);
-        res = -errno;
         goto cleanup;
     }
 
-    if (fseek(fd, offset, SEEK_SET) < 0) {
-        virReportSystemError(errno, "%s", _("fseek failed"));
-        res = -errno;
-        goto cleanup;
-    }
-
-    res = -1;
     while (getline(&line, &n, fd) > 0) {
         char *ptr = strchr(line, ':');
         if (!ptr)
@@ -217,37 +253,283 @@ static int lxcProcReadMeminfo(char *hostpath, virDomainDefPtr def,
         }
 
     }
-    res = strlen(virBufferCurrentContent(new_meminfo));
-    if (res > size)
-        res = size;
-    memcpy(buf, virBufferCurrentContent(new_meminfo), res);
+    res = 0;
 
  cleanup:
     VIR_FORCE_FCLOSE(fd);
     return res;
 }
 
-static int lxcProcRead(const char *path G_GNUC_UNUSED,
-                       char *buf G_GNUC_UNUSED,
-                       size_t size G_GNUC_UNUSED,
-                       off_t offset G_GNUC_UNUSED,
+/*
+ * Keeps only the processors the container can use, renumbered from
+ * zero. Blocks not describing a processor are kept as they are.
+ */
+static int lxcProcGenerateCpuinfo(virLXCFusePtr fuse G_GNUC_UNUSED,
+                                  const char *hostpath,
+                                  virBufferPtr buf)
+{
+    struct virLXCCpuinfo cpuinfo;
+    g_autofree char *content = NULL;
+    g_auto(GStrv) blocks = NULL;
+    unsigned int n = 0;
+    size_t i;
+
+    if (virLXCCgroupGetCpuinfo(&cpuinfo) < 0)
+        return -1;
+
+    if (virFileReadAll(hostpath, 16 * 1024 * 1024, &content) < 0) {
+        virLXCCpuinfoClear(&cpuinfo);
+        return -1;
+    }
+
+    blocks = g_strsplit(content, "\n\n", 0);
+
+    for (i = 0; blocks[i]; i++) {
+        char *rest;
+        unsigned int cpu;
+
+        if (!*blocks[i])
+            continue;
+
+        if (STRPREFIX(blocks[i], "processor") &&
+            (rest = strchr(blocks[i], ':')) &&
+            virStrToLong_ui(rest + 1, &rest, 10, &cpu) == 0) {
+            if (!virBitmapIsBitSet(cpuinfo.cpus, cpu))
+                continue;
+
+            virBufferAsprintf(buf, "processor\t: %u%s\n\n", n++, rest);
+        } else {
+            virBufferAsprintf(buf, "%s\n\n", blocks[i]);
+        }
+    }
+
+    virLXCCpuinfoClear(&cpuinfo);
+    return 0;
+}
+
+static void lxcProcFormatStatCpu(virBufferPtr buf,
+                                 const char *name,
+                                 unsigned long long user,
+                                 unsigned long long sys,
+                                 unsigned long long idle)
+{
+    virBufferAsprintf(buf, "%s %llu 0 %llu %llu 0 0 0 0 0 0\n", name,
+                      lxcProcNsToTicks(user), lxcProcNsToTicks(sys),
+                      lxcProcNsToTicks(idle));
+}
+
+/*
+ * Reports CPU time of the container's cgroup over the processors it
+ * can use. Everything else but the boot time is taken from the host.
+ */
+static int lxcProcGenerateStat(virLXCFusePtr fuse,
+                               const char *hostpath,
+                               virBufferPtr buf)
+{
+    struct virLXCCpuinfo cpuinfo;
+    g_autofree char *content = NULL;
+    g_auto(GStrv) lines = NULL;
+    g_auto(GStrv) percpu = NULL;
+    unsigned long long uptime = lxcProcUptime(fuse);
+    unsigned long long usage;
+    unsigned long long total;
+    size_t npercpu = 0;
+    size_t ncpus;
+    size_t n = 0;
+    ssize_t cpu = -1;
+    size_t i;
+
+    if (virLXCCgroupGetCpuinfo(&cpuinfo) < 0)
+        return -1;
+
+    if (virFileReadAll(hostpath, 16 * 1024 * 1024, &content) < 0) {
+        virLXCCpuinfoClear(&cpuinfo);
+        return -1;
+    }
+
+    ncpus = virBitmapCountBits(cpuinfo.cpus);
+    usage = cpuinfo.user + cpuinfo.sys;
+    total = uptime * ncpus;
+
+    lxcProcFormatStatCpu(buf, "cpu ", cpuinfo.user, cpuinfo.sys,
+                         total > usage ? total - usage : 0);
+
+    if (cpuinfo.percpu) {
+        percpu = g_strsplit(cpuinfo.percpu, " ", 0);
+        npercpu = g_strv_length(percpu);
+    }
+
+    while ((cpu = virBitmapNextSetBit(cpuinfo.cpus, cpu)) >= 0) {
+        g_autofree char *name = g_strdup_printf("cpu%zu", n++);
+        unsigned long long cpuUsage = usage / MAX(ncpus, 1);
+        unsigned long long cpuUser;
+
+        if ((size_t) cpu < npercpu)
+            ignore_value(virStrToLong_ull(percpu[cpu], NULL, 10, &cpuUsage));
+
+        /* cpuacct splits the time into user and system in total only */
+        cpuUser = usage ? (double) cpuUsage * cpuinfo.user / usage : 0;
+
+        lxcProcFormatStatCpu(buf, name, cpuUser, cpuUsage - MIN(cpuUser, cpuUsage),
+                             uptime > cpuUsage ? uptime - cpuUsage : 0);
+    }
+
+    lines = g_strsplit(content, "\n", 0);
+
+    for (i = 0; lines[i]; i++) {
+        if (!*lines[i] || STRPREFIX(lines[i], "cpu"))
+            continue;
+
+        if (STRPREFIX(lines[i], "btime "))
+            virBufferAsprintf(buf, "btime %lld\n",
+                              (long long) (g_get_real_time() / G_USEC_PER_SEC -
+                                           uptime / 1000000000ULL));
+        else
+            virBufferAsprintf(buf, "%s\n", lines[i]);
+    }
+
+    virLXCCpuinfoClear(&cpuinfo);
+    return 0;
+}
+
+static unsigned long lxcProcCalcLoad(unsigned long load,
+                                     unsigned long exp,
+                                     unsigned long active)
+{
+    unsigned long newload = load * exp + active * (LXC_FUSE_FIXED_1 - exp);
+
+    if (active >= load)
+        newload += LXC_FUSE_FIXED_1 - 1;
+
+    return newload / LXC_FUSE_FIXED_1;
+}
+
+/*
+ * The kernel samples the number of active tasks every 5 seconds, here
+ * they are sampled only when the file is read and the value is used
+ * for all the periods since the previous read.
+ */
+static int lxcProcGenerateLoadavg(virLXCFusePtr fuse,
+                                  const char *hostpath,
+                                  virBufferPtr buf)
+{
+    g_autofree char *host = NULL;
+    const char *lastpid = NULL;
+    unsigned int running;
+    unsigned int total;
+    gint64 now = g_get_monotonic_time();
+    size_t i;
+
+    if (virLXCCgroupGetTasks(&running, &total) < 0)
+        return -1;
+
+    /* the averages converge long before an hour passes */
+    if (now - fuse->loadavgUpdated > 720 * LXC_FUSE_LOAD_FREQ)
+        fuse->loadavgUpdated = now - 720 * LXC_FUSE_LOAD_FREQ;
+
+    while (now - fuse->loadavgUpdated >= LXC_FUSE_LOAD_FREQ) {
+        for (i = 0; i < G_N_ELEMENTS(lxcLoadExp); i++)
+            fuse->loadavg[i] = lxcProcCalcLoad(fuse->loadavg[i], lxcLoadExp[i],
+                                               running * LXC_FUSE_FIXED_1);
+        fuse->loadavgUpdated += LXC_FUSE_LOAD_FREQ;
+    }
+
+    if (virFileReadValueString(&host, "%s", hostpath) == 0)
+        lastpid = strrchr(host, ' ');
+
+    for (i = 0; i < G_N_ELEMENTS(lxcLoadExp); i++)
+        virBufferAsprintf(buf, "%lu.%02lu ",
+                          LXC_FUSE_LOAD_INT(fuse->loadavg[i]),
+                          LXC_FUSE_LOAD_FRAC(fuse->loadavg[i]));
+
+    virBufferAsprintf(buf, "%u/%u %s\n", running, total,
+                      lastpid ? lastpid + 1 : "0");
+    return 0;
+}
+
+static int lxcProcGenerateUptime(virLXCFusePtr fuse,
+                                 const char *hostpath G_GNUC_UNUSED,
+                                 virBufferPtr buf)
+{
+    struct virLXCCpuinfo cpuinfo;
+    unsigned long long uptime = lxcProcUptime(fuse);
+    unsigned long long usage;
+    unsigned long long idle;
+
+    if (virLXCCgroupGetCpuinfo(&cpuinfo) < 0)
+        return -1;
+
+    usage = cpuinfo.user + cpuinfo.sys;
+    idle = uptime * virBitmapCountBits(cpuinfo.cpus);
+    idle = idle > usage ? idle - usage : 0;
+
+    /* in hundredths of a second */
+    uptime /= 10000000;
+    idle /= 10000000;
+
+    virBufferAsprintf(buf, "%llu.%02llu %llu.%02llu\n",
+                      uptime / 100, uptime % 100, idle / 100, idle % 100);
+
+    virLXCCpuinfoClear(&cpuinfo);
+    return 0;
+}
+
+static lxcProcGenerateFunc lxcProcGenerators[] = {
+    [VIR_LXC_FUSE_FILE_MEMINFO] = lxcProcGenerateMeminfo,
+    [VIR_LXC_FUSE_FILE_CPUINFO] = lxcProcGenerateCpuinfo,
+    [VIR_LXC_FUSE_FILE_STAT] = lxcProcGenerateStat,
+    [VIR_LXC_FUSE_FILE_LOADAVG] = lxcProcGenerateLoadavg,
+    [VIR_LXC_FUSE_FILE_UPTIME] = lxcProcGenerateUptime,
+};
+
+G_STATIC_ASSERT(G_N_ELEMENTS(lxcProcGenerators) == VIR_LXC_FUSE_FILE_LAST);
+
+/*
+ * Generating the files involves reading several cgroup files, which
+ * monitoring agents polling them make expensive. The content is thus
+ * kept for a short while. Reads at a non-zero offset continue reading
+ * the content served by the previous reads so that programs reading
+ * the file in pieces get a consistent view. There's no locking as
+ * fuse_loop handles requests in a single thread.
+ */
+static int lxcProcRead(const char *path,
+                       char *buf,
+                       size_t size,
+                       off_t offset,
                        struct fuse_file_info *fi G_GNUC_UNUSED)
 {
-    int res = -ENOENT;
     g_autofree char *hostpath = NULL;
-    struct fuse_context *context = NULL;
-    virDomainDefPtr def = NULL;
+    struct fuse_context *context = fuse_get_context();
+    virLXCFusePtr fuse = context->private_data;
+    struct virLXCFuseCache *cache;
+    gint64 now = g_get_monotonic_time();
+    int file;
+    size_t res;
+
+    if (*path != '/' || (file = virLXCFuseFileTypeFromString(path + 1)) < 0)
+        return -ENOENT;
 
     hostpath = g_strdup_printf("/proc/%s", path);
+    cache = &fuse->cache[file];
 
-    context = fuse_get_context();
-    def = (virDomainDefPtr)context->private_data;
+    if (!cache->content || (offset == 0 && now >= cache->expires)) {
+        g_auto(virBuffer) content = VIR_BUFFER_INITIALIZER;
 
-    if (STREQ(path, fuse_meminfo_path)) {
-        if ((res = lxcProcReadMeminfo(hostpath, def, buf, size, offset)) < 0)
-            res = lxcProcHostRead(hostpath, buf, size, offset);
+        if (lxcProcGenerators[file](fuse, hostpath, &content) < 0)
+            return lxcProcHostRead(hostpath, buf, size, offset);
+
+        g_free(cache->content);
+        cache->len = virBufferUse(&content);
+        cache->content = virBufferContentAndReset(&content);
+        cache->expires = now + LXC_FUSE_CACHE_TTL;
     }
 
+    if (offset < 0 || (size_t) offset >= cache->len)
+        return 0;
+
+    res = MIN(size, cache->len - (size_t) offset);
+    memcpy(buf, cache->content + offset, res);
+
     return res;
 }
 
@@ -309,7 +591,7 @@ int lxcSetupFuse(virLXCFusePtr *f, virDomainDefPtr def)
         goto cleanup1;
 
     fuse->fuse = fuse_new(fuse->ch, &args, &lxcProcOper,
-                          sizeof(lxcProcOper), fuse->def);
+                          sizeof(lxcProcOper), fuse);
     if (fuse->fuse == NULL) {
         fuse_unmount(fuse->mountpoint, fuse->ch);
         goto cleanup1;
@@ -330,6 +612,9 @@ int lxcSetupFuse(virLXCFusePtr *f, virDomainDefPtr def)
 
 int lxcStartFuse(virLXCFusePtr fuse)
 {
+    fuse->started = g_get_monotonic_time();
+    fuse->loadavgUpdated = fuse->started;
+
     if (virThreadCreateFull(&fuse->thread, false, lxcFuseRun,
                             "lxc-fuse", false, (void *)fuse) < 0) {
         lxcFuseDestroy(fuse);
@@ -342,6 +627,8 @@ int lxcStartFuse(virLXCFusePtr fuse)
 void lxcFreeFuse(virLXCFusePtr *f)
 {
     virLXCFusePtr fuse = *f;
+    size_t i;
+
     /* lxcFuseRun thread create success */
     if (fuse) {
         /* exit fuse_loop, lxcFuseRun thread may try to destroy
@@ -351,6 +638,8 @@ void lxcFreeFuse(virLXCFusePtr *f)
             fuse_exit(fuse->fuse);
         virMutexUnlock(&fuse->lock);
 
+        for (i = 0; i < VIR_LXC_FUSE_FILE_LAST; i++)
+            g_free(fuse->cache[i].content);
         g_free(fuse->mountpoint);
         g_free(*f);
     }
@@ -42,6 +42,33 @@ struct virLXCMeminfo {
 };
 typedef struct virLXCMeminfo *virLXCMeminfoPtr;
 
+struct virLXCCpuinfo {
+    virBitmapPtr cpus; /* host CPUs the container can use */
+    unsigned long long user; /* nanoseconds */
+    unsigned long long sys; /* nanoseconds */
+    char *percpu; /* cpuacct.usage_percpu, may be NULL */
+};
+typedef struct virLXCCpuinfo *virLXCCpuinfoPtr;
+
+typedef enum {
+    VIR_LXC_FUSE_FILE_MEMINFO,
+    VIR_LXC_FUSE_FILE_CPUINFO,
+    VIR_LXC_FUSE_FILE_STAT,
+    VIR_LXC_FUSE_FILE_LOADAVG,
+    VIR_LXC_FUSE_FILE_UPTIME,
+
+    VIR_LXC_FUSE_FILE_LAST
+} virLXCFuseFile;
+
+VIR_ENUM_DECL(virLXCFuseFile);
+
+/* Content of a file generated by a previous read */
+struct virLXCFuseCache {
+    char *content;
+    size_t len;
+    gint64 expires; /* monotonic time in microseconds */
+};
+
 struct virLXCFuse {
     virDomainDefPtr def;
     virThread thread;
@@ -49,6 +76,14 @@ struct virLXCFuse {
     struct fuse *fuse;
     struct fuse_chan *ch;
     virMutex lock;
+
+    gint64 started; /* monotonic time the container started at */
+    struct virLXCFuseCache cache[VIR_LXC_FUSE_FILE_LAST];
+
+    /* load averages in kernel fixed point format and the time they
+     * were last updated at */
+    unsigned long loadavg[3];
+    gint64 loadavgUpdated;
 };
 typedef struct virLXCFuse virLXCFuse;
 typedef struct virLXCFuse *virLXCFusePtr;
@@ -206,7 +206,7 @@ static void virLXCProcessCleanup(virLXCDriverPtr driver,
 
     virDomainObjSetState(vm, VIR_DOMAIN_SHUTOFF, reason);
     vm->pid = -1;
-    vm->def->id = -1;
+    virDomainObjListSetID(driver->domains, vm, -1);
 
     if (!!g_atomic_int_dec_and_test(&driver->nactive) && driver->inhibitCallback)
         driver->inhibitCallback(false, driver->inhibitOpaque);
@@ -1169,12 +1169,13 @@ virLXCProcessEnsureRootFS(virDomainObjPtr vm)
  *
  * Returns 0 on success or -1 in case of error
  */
-int virLXCProcessStart(virConnectPtr conn,
-                       virLXCDriverPtr  driver,
-                       virDomainObjPtr vm,
-                       unsigned int nfiles, int *files,
-                       bool autoDestroy,
-                       virDomainRunningReason reason)
+static int
+virLXCProcessStartInternal(virConnectPtr conn,
+                           virLXCDriverPtr  driver,
+                           virDomainObjPtr vm,
+                           unsigned int nfiles, int *files,
+                           bool autoDestroy,
+                           virDomainRunningReason reason)
 {
     int rc = -1, r;
     size_t nttyFDs = 0;
@@ -1429,7 +1430,7 @@ int virLXCProcessStart(virConnectPtr conn,
 
     priv->stopReason = VIR_DOMAIN_EVENT_STOPPED_FAILED;
     priv->wantReboot = false;
-    vm->def->id = vm->pid;
+    virDomainObjListSetID(driver->domains, vm, vm->pid);
     virDomainObjSetState(vm, VIR_DOMAIN_RUNNING, reason);
     priv->doneStopEvent = false;
 
@@ -1542,16 +1543,89 @@ int virLXCProcessStart(virConnectPtr conn,
     return rc;
 }
 
+
+/*
+ * Waits until fewer than max_concurrent_starts domains are being started.
+ * The domain object stays locked while waiting, which is fine as none of
+ * the starts we wait for can need it.
+ */
+static void
+virLXCProcessAcquireStartSlot(virLXCDriverPtr driver,
+                              unsigned int max)
+{
+    lxcDriverLock(driver);
+    while (max && driver->nstarting >= max) {
+        if (virCondWait(&driver->startCond, &driver->lock) < 0) {
+            VIR_WARN("Unable to wait for concurrent starts to finish");
+            break;
+        }
+    }
+    driver->nstarting++;
+    lxcDriverUnlock(driver);
+}
+
+
+static void
+virLXCProcessReleaseStartSlot(virLXCDriverPtr driver)
+{
+    lxcDriverLock(driver);
+    driver->nstarting--;
+    virCondSignal(&driver->startCond);
+    lxcDriverUnlock(driver);
+}
+
+
+/**
+ * virLXCProcessStart:
+ * @conn: pointer to connection
+ * @driver: pointer to driver structure
+ * @vm: pointer to virtual machine structure
+ * @nfiles: number of file descriptors to pass to the container
+ * @files: file descriptors to pass to the container
+ * @autoDestroy: mark the domain for auto destruction
+ * @reason: reason for switching vm to running state
+ *
+ * Starts the container. At most max_concurrent_starts containers are
+ * started at the same time, further starts wait for a free slot.
+ *
+ * Returns 0 on success or -1 in case of error
+ */
+int virLXCProcessStart(virConnectPtr conn,
+                       virLXCDriverPtr  driver,
+                       virDomainObjPtr vm,
+                       unsigned int nfiles, int *files,
+                       bool autoDestroy,
+                       virDomainRunningReason reason)
+{
+    virLXCDriverConfigPtr cfg = virLXCDriverGetConfig(driver);
+    int ret;
+
+    virLXCProcessAcquireStartSlot(driver, cfg->maxConcurrentStarts);
+    virObjectUnref(cfg);
+
+    ret = virLXCProcessStartInternal(conn, driver, vm, nfiles, files,
+                                     autoDestroy, reason);
+
+    virLXCProcessReleaseStartSlot(driver);
+
+    return ret;
+}
+
+
 struct virLXCProcessAutostartData {
     virLXCDriverPtr driver;
     virConnectPtr conn;
+
+    virMutex lock;
+    virDomainObjPtr *vms;
+    size_t nvms;
+    size_t next;
 };
 
 static int
 virLXCProcessAutostartDomain(virDomainObjPtr vm,
-                             void *opaque)
+                             struct virLXCProcessAutostartData *data)
 {
-    const struct virLXCProcessAutostartData *data = opaque;
     int ret = 0;
 
     virObjectLock(vm);
@@ -1578,6 +1652,26 @@ virLXCProcessAutostartDomain(virDomainObjPtr vm,
 }
 
 
+static void
+virLXCProcessAutostartWorker(void *opaque)
+{
+    struct virLXCProcessAutostartData *data = opaque;
+
+    while (true) {
+        size_t i;
+
+        virMutexLock(&data->lock);
+        i = data->next++;
+        virMutexUnlock(&data->lock);
+
+        if (i >= data->nvms)
+            break;
+
+        ignore_value(virLXCProcessAutostartDomain(data->vms[i], data));
+    }
+}
+
+
 void
 virLXCProcessAutostartAll(virLXCDriverPtr driver)
 {
@@ -1588,13 +1682,52 @@ virLXCProcessAutostartAll(virLXCDriverPtr driver)
      */
     virConnectPtr conn = virConnectOpen("lxc:///system");
     /* Ignoring NULL conn which is mostly harmless here */
+    virLXCDriverConfigPtr cfg = virLXCDriverGetConfig(driver);
+    struct virLXCProcessAutostartData data = { .driver = driver, .conn = conn };
+    g_autofree virThread *threads = NULL;
+    size_t nthreads = 0;
+    size_t i;
 
-    struct virLXCProcessAutostartData data = { driver, conn };
+    if (virMutexInit(&data.lock) < 0) {
+        virObjectUnref(cfg);
+        virObjectUnref(conn);
+        return;
+    }
 
-    virDomainObjListForEach(driver->domains, false,
-                            virLXCProcessAutostartDomain,
-                            &data);
+    if (virDomainObjListCollect(driver->domains, NULL, &data.vms, &data.nvms,
+                                NULL, VIR_CONNECT_LIST_DOMAINS_AUTOSTART) < 0) {
+        VIR_ERROR(_("Failed to list domains to autostart: %s"),
+                  virGetLastErrorMessage());
+        goto cleanup;
+    }
 
+    /* Containers are started from up to max_concurrent_starts threads,
+     * the current one included, so that a host with many containers
+     * doesn't have to start them one after another. */
+    if (cfg->maxConcurrentStarts > 1 && data.nvms > 1) {
+        threads = g_new0(virThread, MIN(cfg->maxConcurrentStarts, data.nvms) - 1);
+
+        for (i = 1; i < MIN(cfg->maxConcurrentStarts, data.nvms); i++) {
+            if (virThreadCreateFull(&threads[nthreads], true,
+                                    virLXCProcessAutostartWorker,
+                                    "lxc-autostart", false, &data) < 0) {
+                VIR_WARN("Unable to create autostart worker thread: %s",
+                         g_strerror(errno));
+                break;
+            }
+            nthreads++;
+        }
+    }
+
+    virLXCProcessAutostartWorker(&data);
+
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+
+ cleanup:
+    virObjectListFreeCount(data.vms, data.nvms);
+    virMutexDestroy(&data.lock);
+    virObjectUnref(cfg);
     virObjectUnref(conn);
 }
 
@@ -1641,7 +1774,7 @@ virLXCProcessReconnectDomain(virDomainObjPtr vm,
     priv = vm->privateData;
 
     if (vm->pid != 0) {
-        vm->def->id = vm->pid;
+        virDomainObjListSetID(driver->domains, vm, vm->pid);
         virDomainObjSetState(vm, VIR_DOMAIN_RUNNING,
                              VIR_DOMAIN_RUNNING_UNKNOWN);
 
@@ -1690,7 +1823,7 @@ virLXCProcessReconnectDomain(virDomainObjPtr vm,
         }
 
     } else {
-        vm->def->id = -1;
+        virDomainObjListSetID(driver->domains, vm, -1);
     }
 
     ret = 0;
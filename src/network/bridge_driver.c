@@ -384,6 +384,252 @@ networkDnsmasqLeaseFileNameCustom(virNetworkDriverStatePtr driver,
 }
 
 
+static char *
+networkDnsmasqLeaseIndexFileName(virNetworkDriverStatePtr driver,
+                                 const char *bridge)
+{
+    return g_strdup_printf("%s/%s.index", driver->dnsmasqStateDir, bridge);
+}
+
+
+/* Parsed lease status file of one bridge. The leases of every MAC
+ * address are indexed so that looking up the addresses of a single
+ * guest doesn't have to walk the leases of the whole network. The
+ * index is valid as long as leaseshelper didn't rewrite the file. */
+typedef struct _networkLeaseIndex networkLeaseIndex;
+typedef networkLeaseIndex *networkLeaseIndexPtr;
+struct _networkLeaseIndex {
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    struct timespec ctime;
+
+    virJSONValuePtr leases;
+    virHashTablePtr macs; /* MAC address -> networkLeaseIndexMac */
+};
+
+typedef struct _networkLeaseIndexMac networkLeaseIndexMac;
+typedef networkLeaseIndexMac *networkLeaseIndexMacPtr;
+struct _networkLeaseIndexMac {
+    size_t *leases; /* positions within networkLeaseIndex->leases */
+    size_t nleases;
+};
+
+
+static void
+networkLeaseIndexMacFree(void *opaque)
+{
+    networkLeaseIndexMacPtr entry = opaque;
+
+    g_free(entry->leases);
+    g_free(entry);
+}
+
+
+static void
+networkLeaseIndexFree(void *opaque)
+{
+    networkLeaseIndexPtr cache = opaque;
+
+    if (!cache)
+        return;
+
+    virJSONValueFree(cache->leases);
+    virHashFree(cache->macs);
+    g_free(cache);
+}
+
+
+static void
+networkLeaseIndexStamp(networkLeaseIndexPtr cache,
+                       const struct stat *sb)
+{
+    cache->dev = sb->st_dev;
+    cache->ino = sb->st_ino;
+    cache->size = sb->st_size;
+#ifdef __APPLE__
+    cache->mtime = sb->st_mtimespec;
+    cache->ctime = sb->st_ctimespec;
+#else /* ! __APPLE__ */
+    cache->mtime = sb->st_mtim;
+    cache->ctime = sb->st_ctim;
+#endif /* ! __APPLE__ */
+}
+
+
+static bool
+networkLeaseIndexIsCurrent(const networkLeaseIndex *cache,
+                           const struct stat *sb)
+{
+    networkLeaseIndex stamp = { 0 };
+
+    networkLeaseIndexStamp(&stamp, sb);
+
+    return cache->dev == stamp.dev &&
+           cache->ino == stamp.ino &&
+           cache->size == stamp.size &&
+           cache->mtime.tv_sec == stamp.mtime.tv_sec &&
+           cache->mtime.tv_nsec == stamp.mtime.tv_nsec &&
+           cache->ctime.tv_sec == stamp.ctime.tv_sec &&
+           cache->ctime.tv_nsec == stamp.ctime.tv_nsec;
+}
+
+
+/* MAC addresses are compared regardless of case and leading zeros,
+ * see virMacAddrCompare(), so index them in their canonical form */
+static char *
+networkLeaseIndexKey(const char *mac)
+{
+    virMacAddr addr;
+    char macstr[VIR_MAC_STRING_BUFLEN];
+
+    if (virMacAddrParse(mac, &addr) < 0)
+        return g_ascii_strdown(mac, -1);
+
+    return g_strdup(virMacAddrFormat(&addr, macstr));
+}
+
+
+static networkLeaseIndexPtr
+networkLeaseIndexParse(const char *path,
+                       const struct stat *sb)
+{
+    g_autofree char *lease_entries = NULL;
+    networkLeaseIndexPtr cache = NULL;
+    int len;
+    size_t i;
+
+    if ((len = virFileReadAllQuiet(path,
+                                   VIR_NETWORK_DHCP_LEASE_FILE_SIZE_MAX,
+                                   &lease_entries)) < 0) {
+        virReportSystemError(errno,
+                             _("Unable to read leases file: %s"),
+                             path);
+        return NULL;
+    }
+
+    cache = g_new0(networkLeaseIndex, 1);
+    networkLeaseIndexStamp(cache, sb);
+
+    if (!(cache->macs = virHashNew(networkLeaseIndexMacFree)))
+        goto error;
+
+    if (len == 0)
+        return cache;
+
+    if (!(cache->leases = virJSONValueFromString(lease_entries))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("invalid json in file: %s"), path);
+        goto error;
+    }
+
+    if (!virJSONValueIsArray(cache->leases)) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Malformed lease_entries array"));
+        goto error;
+    }
+
+    for (i = 0; i < virJSONValueArraySize(cache->leases); i++) {
+        virJSONValuePtr lease = virJSONValueArrayGet(cache->leases, i);
+        networkLeaseIndexMacPtr entry;
+        const char *mac;
+        g_autofree char *key = NULL;
+
+        if (!lease) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("failed to parse json"));
+            goto error;
+        }
+
+        if (!(mac = virJSONValueObjectGetString(lease, "mac-address"))) {
+            /* leaseshelper program guarantees that lease will be stored only if
+             * mac-address is known otherwise not */
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("found lease without mac-address"));
+            goto error;
+        }
+
+        key = networkLeaseIndexKey(mac);
+
+        if (!(entry = virHashLookup(cache->macs, key))) {
+            entry = g_new0(networkLeaseIndexMac, 1);
+            if (virHashAddEntry(cache->macs, key, entry) < 0) {
+                networkLeaseIndexMacFree(entry);
+                goto error;
+            }
+        }
+
+        if (VIR_APPEND_ELEMENT_COPY(entry->leases, entry->nleases, i) < 0)
+            goto error;
+    }
+
+    return cache;
+
+ error:
+    networkLeaseIndexFree(cache);
+    return NULL;
+}
+
+
+/**
+ * networkLeaseIndexGet:
+ * @driver: network driver state, must be locked
+ * @bridge: bridge name of the network
+ * @cache: filled with the lease index of @bridge
+ *
+ * Looks up the index of the lease status file of @bridge and parses
+ * the file again only if it changed since it was indexed last. Not all
+ * networks run dnsmasq and have a status file, for those @cache is set
+ * to NULL. The returned index is owned by @driver and is valid only
+ * while @driver remains locked.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int
+networkLeaseIndexGet(virNetworkDriverStatePtr driver,
+                     const char *bridge,
+                     networkLeaseIndexPtr *cache)
+{
+    g_autofree char *path = NULL;
+    networkLeaseIndexPtr ret;
+    struct stat sb;
+
+    *cache = NULL;
+
+    path = networkDnsmasqLeaseFileNameCustom(driver, bridge);
+
+    if (stat(path, &sb) < 0) {
+        if (errno == ENOENT) {
+            virHashRemoveEntry(driver->leases, bridge);
+            return 0;
+        }
+
+        virReportSystemError(errno,
+                             _("Unable to read leases file: %s"),
+                             path);
+        return -1;
+    }
+
+    if ((ret = virHashLookup(driver->leases, bridge)) &&
+        networkLeaseIndexIsCurrent(ret, &sb)) {
+        *cache = ret;
+        return 0;
+    }
+
+    if (!(ret = networkLeaseIndexParse(path, &sb)))
+        return -1;
+
+    if (virHashUpdateEntry(driver->leases, bridge, ret) < 0) {
+        networkLeaseIndexFree(ret);
+        return -1;
+    }
+
+    *cache = ret;
+    return 0;
+}
+
+
 static char *
 networkDnsmasqConfigFileName(virNetworkDriverStatePtr driver,
                              const char *netname)
@@ -424,6 +670,7 @@ networkRemoveInactive(virNetworkDriverStatePtr driver,
 {
     g_autofree char *leasefile = NULL;
     g_autofree char *customleasefile = NULL;
+    g_autofree char *leaseindexfile = NULL;
     g_autofree char *radvdconfigfile = NULL;
     g_autofree char *configfile = NULL;
     g_autofree char *radvdpidbase = NULL;
@@ -444,6 +691,9 @@ networkRemoveInactive(virNetworkDriverStatePtr driver,
     if (!(customleasefile = networkDnsmasqLeaseFileNameCustom(driver, def->bridge)))
         return -1;
 
+    if (!(leaseindexfile = networkDnsmasqLeaseIndexFileName(driver, def->bridge)))
+        return -1;
+
     if (!(radvdconfigfile = networkRadvdConfigFileName(driver, def->name)))
         return -1;
 
@@ -463,8 +713,13 @@ networkRemoveInactive(virNetworkDriverStatePtr driver,
     dnsmasqDelete(dctx);
     unlink(leasefile);
     unlink(customleasefile);
+    unlink(leaseindexfile);
     unlink(configfile);
 
+    networkDriverLock(driver);
+    virHashRemoveEntry(driver->leases, def->bridge);
+    networkDriverUnlock(driver);
+
     /* MAC map manager */
     unlink(macMapFile);
 
@@ -713,6 +968,9 @@ networkStateInitialize(bool privileged,
 
     network_driver->privileged = privileged;
 
+    if (!(network_driver->leases = virHashNew(networkLeaseIndexFree)))
+        goto error;
+
     if (!(network_driver->xmlopt = networkDnsmasqCreateXMLConf()))
         goto error;
 
@@ -883,6 +1141,7 @@ networkStateCleanup(void)
     g_free(network_driver->radvdStateDir);
 
     virObjectUnref(network_driver->dnsmasqCaps);
+    virHashFree(network_driver->leases);
 
     virMutexDestroy(&network_driver->lock);
 
@@ -1483,9 +1742,17 @@ networkDnsmasqConfContents(virNetworkObjPtr obj,
      * listening for DHCP, we should write a 0-length hosts
      * file to allow for runtime additions.
      */
-    if (ipv4def || ipv6def)
-        virBufferAsprintf(&configbuf, "dhcp-hostsfile=%s\n",
-                          dctx->hostsfile->path);
+    if (ipv4def || ipv6def) {
+        /* with a directory, dnsmasq picks up new hosts on its own */
+        if (dnsmasqCapsGet(caps, DNSMASQ_CAPS_DHCP_HOSTSDIR)) {
+            dctx->hostsdir = true;
+            virBufferAsprintf(&configbuf, "dhcp-hostsdir=%s\n",
+                              dctx->hostsfile->dirpath);
+        } else {
+            virBufferAsprintf(&configbuf, "dhcp-hostsfile=%s\n",
+                              dctx->hostsfile->path);
+        }
+    }
 
     /* Likewise, always create this file and put it on the
      * commandline, to allow for runtime additions.
@@ -1667,16 +1934,44 @@ networkStartDhcpDaemon(virNetworkDriverStatePtr driver,
 }
 
 
+/* networkDnsmasqUsesHostsdir:
+ *  Whether the dnsmasq of @obj was started reading its DHCP hosts from
+ *  a dhcp-hostsdir. This is looked up in its config file since that
+ *  dnsmasq may have been started before dnsmasq got updated.
+ */
+static bool
+networkDnsmasqUsesHostsdir(virNetworkDriverStatePtr driver,
+                           virNetworkObjPtr obj)
+{
+    virNetworkDefPtr def = virNetworkObjGetDef(obj);
+    g_autofree char *configfile = NULL;
+    g_autofree char *configstr = NULL;
+
+    if (!(configfile = networkDnsmasqConfigFileName(driver, def->name)) ||
+        virFileReadAllQuiet(configfile, 1024 * 1024, &configstr) < 0) {
+        virResetLastError();
+        return false;
+    }
+
+    return strstr(configstr, "\ndhcp-hostsdir=") != NULL;
+}
+
+
 /* networkRefreshDhcpDaemon:
  *  Update dnsmasq config files, then send a SIGHUP so that it rereads
- *  them.   This only works for the dhcp-hostsfile and the
- *  addn-hosts file.
+ *  them.   This only works for the dhcp-hostsfile (or dhcp-hostsdir)
+ *  and the addn-hosts file.
+ *
+ *  With @dhcpHostsOnly only the DHCP hosts are updated. If dnsmasq
+ *  reads them from a directory and no host was removed, it picks up
+ *  the changes on its own and is not signalled at all.
  *
  *  Returns 0 on success, -1 on failure.
  */
 static int
 networkRefreshDhcpDaemon(virNetworkDriverStatePtr driver,
-                         virNetworkObjPtr obj)
+                         virNetworkObjPtr obj,
+                         bool dhcpHostsOnly)
 {
     virNetworkDefPtr def = virNetworkObjGetDef(obj);
     size_t i;
@@ -1697,6 +1992,8 @@ networkRefreshDhcpDaemon(virNetworkDriverStatePtr driver,
     if (!(dctx = dnsmasqContextNew(def->name, driver->dnsmasqStateDir)))
         return -1;
 
+    dctx->hostsdir = networkDnsmasqUsesHostsdir(driver, obj);
+
     /* Look for first IPv4 address that has dhcp defined.
      * We only support dhcp-host config on one IPv4 subnetwork
      * and on one IPv6 subnetwork.
@@ -1723,11 +2020,24 @@ networkRefreshDhcpDaemon(virNetworkDriverStatePtr driver,
     if (ipv6def && (networkBuildDnsmasqDhcpHostsList(dctx, ipv6def) < 0))
         return -1;
 
-    if (networkBuildDnsmasqHostsList(dctx, &def->dns) < 0)
-        return -1;
+    if (dhcpHostsOnly) {
+        bool needReload;
 
-    if (dnsmasqSave(dctx) < 0)
-        return -1;
+        if (dnsmasqSaveDhcpHosts(dctx, &needReload) < 0)
+            return -1;
+
+        if (!needReload) {
+            VIR_DEBUG("dnsmasq for network %s picks up new hosts itself",
+                      def->name);
+            return 0;
+        }
+    } else {
+        if (networkBuildDnsmasqHostsList(dctx, &def->dns) < 0)
+            return -1;
+
+        if (dnsmasqSave(dctx) < 0)
+            return -1;
+    }
 
     dnsmasqPid = virNetworkObjGetDnsmasqPid(obj);
     return kill(dnsmasqPid, SIGHUP);
@@ -2036,7 +2346,7 @@ networkRefreshDaemonsHelper(virNetworkObjPtr obj,
              * dnsmasq and/or radvd, or restart them if they've
              * disappeared.
              */
-            networkRefreshDhcpDaemon(driver, obj);
+            networkRefreshDhcpDaemon(driver, obj, false);
             networkRefreshRadvd(driver, obj);
             break;
 
@@ -3823,9 +4133,10 @@ networkUpdate(virNetworkPtr net,
                 }
             }
 
-            if ((newDhcpActive != oldDhcpActive &&
-                 networkRestartDhcpDaemon(driver, obj) < 0) ||
-                networkRefreshDhcpDaemon(driver, obj) < 0) {
+            if (newDhcpActive != oldDhcpActive) {
+                if (networkRestartDhcpDaemon(driver, obj) < 0)
+                    goto cleanup;
+            } else if (networkRefreshDhcpDaemon(driver, obj, true) < 0) {
                 goto cleanup;
             }
 
@@ -3834,7 +4145,7 @@ networkUpdate(virNetworkPtr net,
              * (not the .conf file) so we can just update the config
              * files and send SIGHUP to dnsmasq.
              */
-            if (networkRefreshDhcpDaemon(driver, obj) < 0)
+            if (networkRefreshDhcpDaemon(driver, obj, false) < 0)
                 goto cleanup;
 
         }
@@ -4110,17 +4421,16 @@ networkGetDHCPLeases(virNetworkPtr net,
     size_t nleases = 0;
     int rv = -1;
     size_t size = 0;
-    int custom_lease_file_len = 0;
     bool need_results = !!leases;
+    bool locked = false;
     long long currtime = 0;
     long long expirytime_tmp = -1;
     bool ipv6 = false;
-    g_autofree char *lease_entries = NULL;
-    g_autofree char *custom_lease_file = NULL;
     const char *ip_tmp = NULL;
     const char *mac_tmp = NULL;
+    const size_t *positions = NULL;
+    networkLeaseIndexPtr cache = NULL;
     virJSONValuePtr lease_tmp = NULL;
-    g_autoptr(virJSONValue) leases_array = NULL;
     virNetworkIPDefPtr ipdef_tmp = NULL;
     virNetworkDHCPLeasePtr *leases_ret = NULL;
     virNetworkObjPtr obj;
@@ -4142,61 +4452,33 @@ networkGetDHCPLeases(virNetworkPtr net,
     if (virNetworkGetDHCPLeasesEnsureACL(net->conn, def) < 0)
         goto cleanup;
 
-    /* Retrieve custom leases file location */
-    custom_lease_file = networkDnsmasqLeaseFileNameCustom(driver, def->bridge);
-
-    /* Read entire contents */
-    if ((custom_lease_file_len = virFileReadAllQuiet(custom_lease_file,
-                                                     VIR_NETWORK_DHCP_LEASE_FILE_SIZE_MAX,
-                                                     &lease_entries)) < 0) {
-        /* Not all networks are guaranteed to have leases file.
-         * Only those which run dnsmasq. Therefore, if we failed
-         * to read the leases file, don't report error. Return 0
-         * leases instead. */
-        if (errno == ENOENT) {
-            rv = 0;
-        } else {
-            virReportSystemError(errno,
-                                 _("Unable to read leases file: %s"),
-                                 custom_lease_file);
-        }
+    networkDriverLock(driver);
+    locked = true;
+
+    if (networkLeaseIndexGet(driver, def->bridge, &cache) < 0)
         goto error;
-    }
 
-    if (custom_lease_file_len) {
-        if (!(leases_array = virJSONValueFromString(lease_entries))) {
-            virReportError(VIR_ERR_INTERNAL_ERROR,
-                           _("invalid json in file: %s"), custom_lease_file);
-            goto error;
-        }
+    if (cache && cache->leases) {
+        if (mac) {
+            char macstr[VIR_MAC_STRING_BUFLEN];
+            networkLeaseIndexMacPtr entry;
 
-        if (!virJSONValueIsArray(leases_array)) {
-            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                           _("Malformed lease_entries array"));
-            goto error;
+            if ((entry = virHashLookup(cache->macs,
+                                       virMacAddrFormat(&mac_addr, macstr)))) {
+                positions = entry->leases;
+                size = entry->nleases;
+            }
+        } else {
+            size = virJSONValueArraySize(cache->leases);
         }
-        size = virJSONValueArraySize(leases_array);
     }
 
     currtime = (long long)time(NULL);
 
     for (i = 0; i < size; i++) {
-        if (!(lease_tmp = virJSONValueArrayGet(leases_array, i))) {
-            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                           _("failed to parse json"));
-            goto error;
-        }
-
-        if (!(mac_tmp = virJSONValueObjectGetString(lease_tmp, "mac-address"))) {
-            /* leaseshelper program guarantees that lease will be stored only if
-             * mac-address is known otherwise not */
-            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                           _("found lease without mac-address"));
-            goto error;
-        }
-
-        if (mac && virMacAddrCompare(mac, mac_tmp))
-            continue;
+        lease_tmp = virJSONValueArrayGet(cache->leases,
+                                         positions ? positions[i] : i);
+        mac_tmp = virJSONValueObjectGetString(lease_tmp, "mac-address");
 
         if (virJSONValueObjectGetNumberLong(lease_tmp, "expiry-time", &expirytime_tmp) < 0) {
             /* A lease cannot be present without expiry-time */
@@ -4269,6 +4551,8 @@ networkGetDHCPLeases(virNetworkPtr net,
     rv = nleases;
 
  cleanup:
+    if (locked)
+        networkDriverUnlock(driver);
     virNetworkObjEndAPI(&obj);
     return rv;
 
@@ -4315,6 +4599,109 @@ networkLogAllocation(virNetworkDefPtr netdef,
 }
 
 
+/* networkHostdevPoolLookupPFs:
+ * @netdef: network with a hostdev pool
+ *
+ * Finds out the PFs of VFs in the pool which weren't looked up yet. The
+ * PF is unknown for devices which are not VFs, they form a group of
+ * their own when balancing allocations.
+ */
+static void
+networkHostdevPoolLookupPFs(virNetworkDefPtr netdef)
+{
+    size_t i;
+
+    for (i = 0; i < netdef->forward.nifs; i++) {
+        virNetworkForwardIfDefPtr dev = &netdef->forward.ifs[i];
+        g_autofree char *sysfs = NULL;
+        g_autofree virPCIDeviceAddressPtr pf = NULL;
+
+        if (dev->pfKnown ||
+            dev->type != VIR_NETWORK_FORWARD_HOSTDEV_DEVICE_PCI)
+            continue;
+
+        dev->pfKnown = true;
+
+        if (virPCIDeviceAddressGetSysfsFile(&dev->device.pci, &sysfs) < 0 ||
+            virPCIGetPhysicalFunction(sysfs, &pf) < 0) {
+            virResetLastError();
+            continue;
+        }
+
+        if (pf) {
+            dev->hasPF = true;
+            dev->pf = *pf;
+        }
+    }
+}
+
+
+/* networkHostdevPoolPick:
+ * @netdef: network with a hostdev pool
+ *
+ * Picks a free device from the pool. When the pool spans VFs of several
+ * PFs, the device is taken from the PF with the fewest VFs in use so that
+ * guests are spread evenly over the physical ports.
+ *
+ * Returns the device or NULL if none is free.
+ */
+static virNetworkForwardIfDefPtr
+networkHostdevPoolPick(virNetworkDefPtr netdef)
+{
+    virNetworkForwardIfDefPtr best = NULL;
+    g_autofree size_t *groupOf = NULL;
+    g_autofree int *used = NULL;
+    size_t ngroups = 0;
+    size_t i;
+    size_t j;
+
+    networkHostdevPoolLookupPFs(netdef);
+
+    /* Each device is assigned to the group of the first device sharing
+     * its PF, counting the devices in use per group. */
+    groupOf = g_new0(size_t, netdef->forward.nifs);
+    used = g_new0(int, netdef->forward.nifs);
+
+    for (i = 0; i < netdef->forward.nifs; i++) {
+        virNetworkForwardIfDefPtr dev = &netdef->forward.ifs[i];
+
+        groupOf[i] = i;
+        for (j = 0; j < i; j++) {
+            virNetworkForwardIfDefPtr other = &netdef->forward.ifs[groupOf[j]];
+
+            if (groupOf[j] == j &&
+                dev->hasPF == other->hasPF &&
+                (!dev->hasPF || virPCIDeviceAddressEqual(&dev->pf, &other->pf))) {
+                groupOf[i] = j;
+                break;
+            }
+        }
+
+        if (groupOf[i] == i)
+            ngroups++;
+
+        if (dev->connections > 0)
+            used[groupOf[i]]++;
+    }
+
+    for (i = 0; i < netdef->forward.nifs; i++) {
+        virNetworkForwardIfDefPtr dev = &netdef->forward.ifs[i];
+
+        if (dev->connections > 0)
+            continue;
+
+        if (!best || used[groupOf[i]] < used[groupOf[best - netdef->forward.ifs]])
+            best = dev;
+
+        /* with a single PF the first free device is as good as any */
+        if (ngroups == 1)
+            break;
+    }
+
+    return best;
+}
+
+
 /* Private API to deal with logical switch capabilities.
  * These functions are exported so that other parts of libvirt can
  * call them, but are not part of the public API and not in the
@@ -4436,13 +4823,7 @@ networkAllocatePort(virNetworkObjPtr obj,
         if (networkCreateInterfacePool(netdef) < 0)
             return -1;
 
-        /* pick first dev with 0 connections */
-        for (i = 0; i < netdef->forward.nifs; i++) {
-            if (netdef->forward.ifs[i].connections == 0) {
-                dev = &netdef->forward.ifs[i];
-                break;
-            }
-        }
+        dev = networkHostdevPoolPick(netdef);
         if (!dev) {
             virReportError(VIR_ERR_INTERNAL_ERROR,
                            _("network '%s' requires exclusive access "
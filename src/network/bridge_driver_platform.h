@@ -23,6 +23,7 @@
 
 #include "internal.h"
 #include "virthread.h"
+#include "virhash.h"
 #include "virdnsmasq.h"
 #include "virnetworkobj.h"
 #include "object_event.h"
@@ -53,6 +54,9 @@ struct _virNetworkDriverState {
      */
     dnsmasqCapsPtr dnsmasqCaps;
 
+    /* Require lock, parsed lease status files keyed by bridge name */
+    virHashTablePtr leases;
+
     /* Immutable pointer, self-locking APIs */
     virObjectEventStatePtr networkEventState;
 
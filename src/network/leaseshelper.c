@@ -23,6 +23,7 @@
 
 #include <config.h>
 
+#include <unistd.h>
 
 #include "virthread.h"
 #include "virfile.h"
@@ -84,6 +85,7 @@ main(int argc, char **argv)
 {
     g_autofree char *pid_file = NULL;
     g_autofree char *custom_lease_file = NULL;
+    g_autofree char *lease_index_file = NULL;
     const char *ip = NULL;
     const char *mac = NULL;
     const char *leases_str = NULL;
@@ -158,6 +160,8 @@ main(int argc, char **argv)
 
     custom_lease_file = g_strdup_printf(LOCALSTATEDIR "/lib/libvirt/dnsmasq/%s.status",
                                         interface);
+    lease_index_file = g_strdup_printf(LOCALSTATEDIR "/lib/libvirt/dnsmasq/%s.index",
+                                       interface);
 
     pid_file = g_strdup(RUNSTATEDIR "/leaseshelper.pid");
 
@@ -250,6 +254,14 @@ main(int argc, char **argv)
         break;
     }
 
+    /* The index only speeds up lookups by the NSS module which falls back
+     * to the status file without it, so failing to write it is no reason
+     * to fail the whole action. Do it on 'init' too so that the index
+     * exists after upgrading from a version not writing it. */
+    if (virLeaseWriteIndex(leases_array_new, custom_lease_file,
+                           lease_index_file) < 0)
+        unlink(lease_index_file);
+
     rv = EXIT_SUCCESS;
 
  cleanup:
@@ -255,11 +255,15 @@ nodeDeviceLookupByName(virConnectPtr conn,
     virNodeDeviceDefPtr def;
     virNodeDevicePtr device = NULL;
 
-    if (nodeDeviceWaitInit() < 0)
-        return NULL;
+    /* devices found so far can be looked up while the enumeration at
+     * startup is still running, wait for it only if @name isn't there */
+    if (!(obj = virNodeDeviceObjListFindByName(driver->devs, name))) {
+        if (nodeDeviceWaitInit() < 0)
+            return NULL;
 
-    if (!(obj = nodeDeviceObjFindByName(name)))
-        return NULL;
+        if (!(obj = nodeDeviceObjFindByName(name)))
+            return NULL;
+    }
     def = virNodeDeviceObjGetDef(obj);
 
     if (virNodeDeviceLookupByNameEnsureACL(conn, def) < 0)
@@ -509,7 +513,10 @@ nodeDeviceFindNewDevice(virConnectPtr conn,
         if (device != NULL)
             break;
 
-        sleep(5);
+        /* The device usually shows up right after udev settles, the
+         * event thread only batches events for a short while. Don't
+         * make every creation wait for seconds because of that. */
+        g_usleep(200 * 1000);
         if (nodeDeviceGetTime(&now) == -1)
             break;
     }
@@ -40,6 +40,7 @@
 #include "virstring.h"
 #include "virnetdev.h"
 #include "virmdev.h"
+#include "virtime.h"
 #include "virutil.h"
 
 #include "configmake.h"
@@ -52,6 +53,22 @@ VIR_LOG_INIT("node_device.node_device_udev");
 # define TYPE_RAID 12
 #endif
 
+/* Devices found at startup are processed in batches of this many. The
+ * details of the devices in a batch are gathered in parallel by up to
+ * UDEV_ENUMERATE_THREADS_MAX threads and the batch is then added to the
+ * device list at once, in the order of enumeration. */
+#define UDEV_ENUMERATE_BATCH 256
+#define UDEV_ENUMERATE_THREADS_MAX 8
+
+/* Events received within this many milliseconds of the first one are
+ * processed together, with change events of a device coalesced, unless
+ * there are more than UDEV_EVENT_BATCH_MAX of them. */
+#define UDEV_EVENT_COALESCE_MS 100
+#define UDEV_EVENT_BATCH_MAX 1024
+
+/* libpciaccess caches the ID database in global variables */
+static virMutex udevPCITranslateLock = VIR_MUTEX_INITIALIZER;
+
 typedef struct _udevEventData udevEventData;
 typedef udevEventData *udevEventDataPtr;
 
@@ -331,6 +348,8 @@ udevTranslatePCIIds(unsigned int vendor,
     m.device_class_mask = 0;
     m.match_data = 0;
 
+    virMutexLock(&udevPCITranslateLock);
+
     /* pci_get_strings returns void */
     pci_get_strings(&m,
                     &device_name,
@@ -341,6 +360,8 @@ udevTranslatePCIIds(unsigned int vendor,
     *vendor_string = g_strdup(vendor_name);
     *product_string = g_strdup(device_name);
 
+    virMutexUnlock(&udevPCITranslateLock);
+
     return 0;
 }
 
@@ -1257,9 +1278,15 @@ udevRemoveOneDevice(struct udev_device *device)
 }
 
 
+/*
+ * Sets the parent of @def to the closest ancestor of @device which is
+ * either in the device list or in @pending (if non-NULL), a table of
+ * definitions about to be added keyed by their sysfs path.
+ */
 static int
 udevSetParent(struct udev_device *device,
-              virNodeDeviceDefPtr def)
+              virNodeDeviceDefPtr def,
+              GHashTable *pending)
 {
     struct udev_device *parent_device = NULL;
     const char *parent_sysfs_path = NULL;
@@ -1281,8 +1308,12 @@ udevSetParent(struct udev_device *device,
             return -1;
         }
 
-        if ((obj = virNodeDeviceObjListFindBySysfsPath(driver->devs,
-                                                       parent_sysfs_path))) {
+        if (pending &&
+            (objdef = g_hash_table_lookup(pending, parent_sysfs_path))) {
+            def->parent = g_strdup(objdef->name);
+            def->parent_sysfs_path = g_strdup(parent_sysfs_path);
+        } else if ((obj = virNodeDeviceObjListFindBySysfsPath(driver->devs,
+                                                              parent_sysfs_path))) {
             objdef = virNodeDeviceObjGetDef(obj);
             def->parent = g_strdup(objdef->name);
             virNodeDeviceObjEndAPI(&obj);
@@ -1299,97 +1330,215 @@ udevSetParent(struct udev_device *device,
 }
 
 
+/*
+ * Gathers the details of @device into a new definition stored into @def.
+ * This doesn't touch the device list and thus may run in parallel for
+ * different devices, provided each thread uses its own udev context.
+ */
 static int
-udevAddOneDevice(struct udev_device *device)
+udevGetDeviceDef(struct udev_device *device,
+                 virNodeDeviceDefPtr *def)
 {
-    virNodeDeviceDefPtr def = NULL;
-    virNodeDeviceObjPtr obj = NULL;
-    virNodeDeviceDefPtr objdef;
-    virObjectEventPtr event = NULL;
-    bool new_device = true;
+    virNodeDeviceDefPtr newdef = NULL;
     int ret = -1;
 
-    if (VIR_ALLOC(def) != 0)
+    if (VIR_ALLOC(newdef) != 0)
         goto cleanup;
 
-    def->sysfs_path = g_strdup(udev_device_get_syspath(device));
+    newdef->sysfs_path = g_strdup(udev_device_get_syspath(device));
 
-    if (udevGetStringProperty(device, "DRIVER", &def->driver) < 0)
+    if (udevGetStringProperty(device, "DRIVER", &newdef->driver) < 0)
         goto cleanup;
 
-    if (VIR_ALLOC(def->caps) != 0)
+    if (VIR_ALLOC(newdef->caps) != 0)
         goto cleanup;
 
-    if (udevGetDeviceType(device, &def->caps->data.type) != 0)
+    if (udevGetDeviceType(device, &newdef->caps->data.type) != 0)
         goto cleanup;
 
-    if (udevGetDeviceNodes(device, def) != 0)
+    if (udevGetDeviceNodes(device, newdef) != 0)
         goto cleanup;
 
-    if (udevGetDeviceDetails(device, def) != 0)
+    if (udevGetDeviceDetails(device, newdef) != 0)
         goto cleanup;
 
-    if (udevSetParent(device, def) != 0)
-        goto cleanup;
+    *def = g_steal_pointer(&newdef);
+    ret = 0;
 
-    if ((obj = virNodeDeviceObjListFindByName(driver->devs, def->name))) {
-        virNodeDeviceObjEndAPI(&obj);
-        new_device = false;
+ cleanup:
+    if (ret != 0) {
+        VIR_DEBUG("Discarding device %d %p %s", ret, newdef,
+                  newdef ? NULLSTR(newdef->sysfs_path) : "");
+        virNodeDeviceDefFree(newdef);
     }
 
-    /* If this is a device change, the old definition will be freed
-     * and the current definition will take its place. */
-    if (!(obj = virNodeDeviceObjListAssignDef(driver->devs, def)))
-        goto cleanup;
-    objdef = virNodeDeviceObjGetDef(obj);
+    return ret;
+}
 
-    if (new_device)
-        event = virNodeDeviceEventLifecycleNew(objdef->name,
-                                               VIR_NODE_DEVICE_EVENT_CREATED,
-                                               0);
-    else
-        event = virNodeDeviceEventUpdateNew(objdef->name);
 
-    virNodeDeviceObjEndAPI(&obj);
+/*
+ * Adds @defs gathered from @devices to the device list at once, consuming
+ * them. Parents may be added along with their children as long as they
+ * precede them.
+ */
+static void
+udevAddDeviceDefs(struct udev_device **devices,
+                  virNodeDeviceDefPtr *defs,
+                  size_t ndefs)
+{
+    g_autoptr(GHashTable) pending = g_hash_table_new(g_str_hash, g_str_equal);
+    g_autofree bool *created = g_new0(bool, ndefs);
+    g_autofree char **names = g_new0(char *, ndefs);
+    size_t i;
 
-    ret = 0;
+    for (i = 0; i < ndefs; i++) {
+        if (!defs[i])
+            continue;
 
- cleanup:
-    virObjectEventStateQueue(driver->nodeDeviceEventState, event);
+        if (udevSetParent(devices[i], defs[i], pending) != 0) {
+            VIR_DEBUG("Discarding device %s", NULLSTR(defs[i]->sysfs_path));
+            g_clear_pointer(&defs[i], virNodeDeviceDefFree);
+            continue;
+        }
 
-    if (ret != 0) {
-        VIR_DEBUG("Discarding device %d %p %s", ret, def,
-                  def ? NULLSTR(def->sysfs_path) : "");
-        virNodeDeviceDefFree(def);
+        if (defs[i]->sysfs_path)
+            g_hash_table_insert(pending, defs[i]->sysfs_path, defs[i]);
+        names[i] = g_strdup(defs[i]->name);
     }
 
-    return ret;
+    /* the definitions are owned by the list after this */
+    g_hash_table_remove_all(pending);
+
+    virNodeDeviceObjListAssignDefs(driver->devs, defs, ndefs, created);
+
+    for (i = 0; i < ndefs; i++) {
+        virObjectEventPtr event = NULL;
+
+        if (defs[i]) {
+            VIR_DEBUG("Discarding device %s", NULLSTR(defs[i]->sysfs_path));
+            g_clear_pointer(&defs[i], virNodeDeviceDefFree);
+        } else if (names[i]) {
+            if (created[i])
+                event = virNodeDeviceEventLifecycleNew(names[i],
+                                                       VIR_NODE_DEVICE_EVENT_CREATED,
+                                                       0);
+            else
+                event = virNodeDeviceEventUpdateNew(names[i]);
+        }
+
+        virObjectEventStateQueue(driver->nodeDeviceEventState, event);
+        VIR_FREE(names[i]);
+    }
 }
 
 
 static int
-udevProcessDeviceListEntry(struct udev *udev,
-                           struct udev_list_entry *list_entry)
+udevAddOneDevice(struct udev_device *device)
 {
+    virNodeDeviceDefPtr def = NULL;
+
+    if (udevGetDeviceDef(device, &def) < 0)
+        return -1;
+
+    udevAddDeviceDefs(&device, &def, 1);
+    return 0;
+}
+
+
+typedef struct _udevEnumerateEntry udevEnumerateEntry;
+struct _udevEnumerateEntry {
+    const char *syspath;
     struct udev_device *device;
-    const char *name = NULL;
-    int ret = -1;
+    virNodeDeviceDefPtr def;
+};
+
+typedef struct _udevEnumerateBatch udevEnumerateBatch;
+struct _udevEnumerateBatch {
+    udevEnumerateEntry *entries;
+    size_t nentries;
+    int next; /* atomic, index of the next entry to process */
+};
+
+
+static void
+udevEnumerateWorker(void *opaque)
+{
+    udevEnumerateBatch *batch = opaque;
+    struct udev *udev;
+    int i;
+
+    /* libudev objects must not be shared between threads, each worker
+     * uses a context of its own */
+    if (!(udev = udev_new())) {
+        VIR_WARN("failed to create udev context");
+        return;
+    }
 
-    name = udev_list_entry_get_name(list_entry);
+    while ((i = g_atomic_int_add(&batch->next, 1)) < (int) batch->nentries) {
+        udevEnumerateEntry *entry = &batch->entries[i];
 
-    device = udev_device_new_from_syspath(udev, name);
+        if (!(entry->device = udev_device_new_from_syspath(udev, entry->syspath)))
+            continue;
 
-    if (device != NULL) {
-        if (udevAddOneDevice(device) != 0) {
+        if (udevGetDeviceDef(entry->device, &entry->def) != 0) {
             VIR_DEBUG("Failed to create node device for udev device '%s'",
-                      name);
+                      entry->syspath);
+            virResetLastError();
         }
-        ret = 0;
     }
 
-    udev_device_unref(device);
+    /* the devices hold a reference on the context */
+    udev_unref(udev);
+}
 
-    return ret;
+
+static void
+udevEnumerateProcessBatch(struct udev *udev,
+                          udevEnumerateBatch *batch,
+                          size_t nthreads)
+{
+    g_autofree virThread *threads = g_new0(virThread, nthreads);
+    g_autofree struct udev_device **devices = g_new0(struct udev_device *, batch->nentries);
+    g_autofree virNodeDeviceDefPtr *defs = g_new0(virNodeDeviceDefPtr, batch->nentries);
+    size_t nstarted = 0;
+    size_t i;
+
+    batch->next = 0;
+
+    for (i = 0; i < nthreads; i++) {
+        if (virThreadCreateFull(&threads[nstarted], true, udevEnumerateWorker,
+                                "nodedev-enum", false, batch) < 0) {
+            VIR_WARN("failed to create udev enumerate worker");
+            break;
+        }
+        nstarted++;
+    }
+
+    for (i = 0; i < nstarted; i++)
+        virThreadJoin(&threads[i]);
+
+    for (i = 0; i < batch->nentries; i++) {
+        udevEnumerateEntry *entry = &batch->entries[i];
+
+        /* leftovers in case no worker could be started */
+        if (!entry->device &&
+            (entry->device = udev_device_new_from_syspath(udev, entry->syspath)) &&
+            udevGetDeviceDef(entry->device, &entry->def) != 0)
+            virResetLastError();
+
+        devices[i] = entry->device;
+        defs[i] = g_steal_pointer(&entry->def);
+    }
+
+    udevAddDeviceDefs(devices, defs, batch->nentries);
+
+    for (i = 0; i < batch->nentries; i++) {
+        if (devices[i])
+            udev_device_unref(devices[i]);
+    }
+
+    memset(batch->entries, 0, sizeof(*batch->entries) * batch->nentries);
+    batch->nentries = 0;
 }
 
 
@@ -1422,6 +1571,8 @@ udevEnumerateDevices(struct udev *udev)
 {
     struct udev_enumerate *udev_enumerate = NULL;
     struct udev_list_entry *list_entry = NULL;
+    udevEnumerateBatch batch = { 0 };
+    size_t nthreads = MIN(g_get_num_processors(), UDEV_ENUMERATE_THREADS_MAX);
     int ret = -1;
 
     udev_enumerate = udev_enumerate_new(udev);
@@ -1431,14 +1582,26 @@ udevEnumerateDevices(struct udev *udev)
     if (udev_enumerate_scan_devices(udev_enumerate) < 0)
         VIR_WARN("udev scan devices failed");
 
+    batch.entries = g_new0(udevEnumerateEntry, UDEV_ENUMERATE_BATCH);
+
+    /* Devices are added batch by batch so that those found so far can be
+     * looked up while the rest is still being processed. Parents precede
+     * their children in the enumeration, which keeps working as the
+     * batches are added in order. */
     udev_list_entry_foreach(list_entry,
                             udev_enumerate_get_list_entry(udev_enumerate)) {
+        batch.entries[batch.nentries++].syspath = udev_list_entry_get_name(list_entry);
 
-        udevProcessDeviceListEntry(udev, list_entry);
+        if (batch.nentries == UDEV_ENUMERATE_BATCH)
+            udevEnumerateProcessBatch(udev, &batch, nthreads);
     }
 
+    if (batch.nentries > 0)
+        udevEnumerateProcessBatch(udev, &batch, nthreads);
+
     ret = 0;
  cleanup:
+    VIR_FREE(batch.entries);
     udev_enumerate_unref(udev_enumerate);
     return ret;
 }
@@ -1551,6 +1714,140 @@ udevEventMonitorSanityCheck(udevEventDataPtr priv,
 }
 
 
+static bool
+udevDeviceIsAdded(struct udev_device *device)
+{
+    const char *action = udev_device_get_action(device);
+
+    return STREQ_NULLABLE(action, "add") || STREQ_NULLABLE(action, "change");
+}
+
+
+/*
+ * Handles queued @devices in order. Runs of added or changed devices are
+ * inserted into the device list at once.
+ */
+static void
+udevHandleDevices(struct udev_device **devices,
+                  size_t ndevices)
+{
+    g_autofree struct udev_device **added = g_new0(struct udev_device *, ndevices);
+    g_autofree virNodeDeviceDefPtr *defs = g_new0(virNodeDeviceDefPtr, ndevices);
+    size_t nadded = 0;
+    bool invalidateTopology = false;
+    size_t i;
+
+    /* Cached PCI topology is stale once PCI devices come or go and mdev
+     * types of a device change along with its driver or mdevs */
+    for (i = 0; i < ndevices; i++) {
+        const char *subsystem = udev_device_get_subsystem(devices[i]);
+        const char *action = udev_device_get_action(devices[i]);
+
+        if (STREQ_NULLABLE(subsystem, "pci")) {
+            virPCIMdevTypesInvalidate(udev_device_get_syspath(devices[i]));
+
+            if (STRNEQ_NULLABLE(action, "change") &&
+                STRNEQ_NULLABLE(action, "bind") &&
+                STRNEQ_NULLABLE(action, "unbind"))
+                invalidateTopology = true;
+        } else if (STREQ_NULLABLE(subsystem, "mdev")) {
+            struct udev_device *parent = udev_device_get_parent(devices[i]);
+
+            if (parent)
+                virPCIMdevTypesInvalidate(udev_device_get_syspath(parent));
+        }
+    }
+
+    if (invalidateTopology)
+        virPCITopologyInvalidate();
+
+    for (i = 0; i <= ndevices; i++) {
+        if (i < ndevices && udevDeviceIsAdded(devices[i])) {
+            VIR_DEBUG("udev action: '%s'", udev_device_get_action(devices[i]));
+
+            if (udevGetDeviceDef(devices[i], &defs[nadded]) < 0)
+                continue;
+
+            added[nadded++] = devices[i];
+            continue;
+        }
+
+        if (nadded > 0) {
+            udevAddDeviceDefs(added, defs, nadded);
+            nadded = 0;
+        }
+
+        if (i < ndevices)
+            udevHandleOneDevice(devices[i]);
+    }
+}
+
+
+/*
+ * Appends @device to the queue of @devices unless it's a change event of
+ * a device already queued for addition or change, in which case it just
+ * replaces the queued one since only the latest state matters. @queued
+ * maps sysfs paths of such devices to their index in @devices plus one.
+ */
+static void
+udevQueueDevice(struct udev_device **devices,
+                size_t *ndevices,
+                GHashTable *queued,
+                struct udev_device *device)
+{
+    const char *syspath = udev_device_get_syspath(device);
+    const char *action = udev_device_get_action(device);
+    size_t idx;
+
+    if (!syspath || !action) {
+        devices[(*ndevices)++] = device;
+        return;
+    }
+
+    if (STREQ(action, "change") &&
+        (idx = GPOINTER_TO_SIZE(g_hash_table_lookup(queued, syspath)))) {
+        struct udev_device *old = devices[idx - 1];
+
+        VIR_DEBUG("coalescing '%s' event of '%s'", action, syspath);
+
+        devices[idx - 1] = device;
+        g_hash_table_replace(queued, g_strdup(syspath), GSIZE_TO_POINTER(idx));
+        udev_device_unref(old);
+        return;
+    }
+
+    devices[(*ndevices)++] = device;
+
+    if (udevDeviceIsAdded(device))
+        g_hash_table_replace(queued, g_strdup(syspath),
+                             GSIZE_TO_POINTER(*ndevices));
+    else
+        g_hash_table_remove(queued, syspath);
+}
+
+
+static void
+udevFlushDevices(struct udev_device **devices,
+                 size_t *ndevices,
+                 GHashTable *queued)
+{
+    size_t i;
+
+    if (*ndevices == 0)
+        return;
+
+    VIR_DEBUG("handling %zu queued udev events", *ndevices);
+
+    udevHandleDevices(devices, *ndevices);
+
+    for (i = 0; i < *ndevices; i++)
+        udev_device_unref(devices[i]);
+
+    *ndevices = 0;
+    g_hash_table_remove_all(queued);
+}
+
+
 /**
  * udevEventHandleThread
  * @opaque: unused
@@ -1565,6 +1862,11 @@ udevEventMonitorSanityCheck(udevEventDataPtr priv,
  * the handler thread is currently trying to process, simply because
  * the data hadn't been retrieved from the socket.
  *
+ * Events are not handled one by one. Those arriving within
+ * UDEV_EVENT_COALESCE_MS of the first one are queued and handled
+ * together so that storms of events, e.g. when many SR-IOV VFs are
+ * created at once, don't update the same device over and over again.
+ *
  * NB: Some older distros, such as CentOS 6, libudev opens sockets
  * without the NONBLOCK flag which might cause issues with event
  * based algorithm. Although the issue can be mitigated by resetting
@@ -1576,22 +1878,52 @@ udevEventHandleThread(void *opaque G_GNUC_UNUSED)
 {
     udevEventDataPtr priv = driver->privateData;
     struct udev_device *device = NULL;
+    g_autofree struct udev_device **devices = g_new0(struct udev_device *,
+                                                     UDEV_EVENT_BATCH_MAX);
+    g_autoptr(GHashTable) queued = g_hash_table_new_full(g_str_hash,
+                                                         g_str_equal,
+                                                         g_free, NULL);
+    size_t ndevices = 0;
+    unsigned long long deadline = 0;
+    unsigned long long now;
+    size_t i;
 
     /* continue rather than break from the loop on non-fatal errors */
     while (1) {
+        bool timedout = false;
+
         virObjectLock(priv);
         while (!priv->dataReady && !priv->threadQuit) {
-            if (virCondWait(&priv->threadCond, &priv->parent.lock)) {
+            int rc;
+
+            if (ndevices > 0)
+                rc = virCondWaitUntil(&priv->threadCond, &priv->parent.lock,
+                                      deadline);
+            else
+                rc = virCondWait(&priv->threadCond, &priv->parent.lock);
+
+            if (rc < 0) {
+                if (ndevices > 0 && errno == ETIMEDOUT) {
+                    timedout = true;
+                    break;
+                }
+
                 virReportSystemError(errno, "%s",
                                      _("handler failed to wait on condition"));
                 virObjectUnlock(priv);
-                return;
+                goto cleanup;
             }
         }
 
         if (priv->threadQuit) {
             virObjectUnlock(priv);
-            return;
+            goto cleanup;
+        }
+
+        if (timedout) {
+            virObjectUnlock(priv);
+            udevFlushDevices(devices, &ndevices, queued);
+            continue;
         }
 
         errno = 0;
@@ -1602,7 +1934,7 @@ udevEventHandleThread(void *opaque G_GNUC_UNUSED)
             if (errno == 0) {
                 virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                                _("failed to receive device from udev monitor"));
-                return;
+                goto cleanup;
             }
 
             /* POSIX allows both EAGAIN and EWOULDBLOCK to be used
@@ -1614,7 +1946,7 @@ udevEventHandleThread(void *opaque G_GNUC_UNUSED)
                 virReportSystemError(errno, "%s",
                                      _("failed to receive device from udev "
                                        "monitor"));
-                return;
+                goto cleanup;
             }
 
             /* Trying to move the reset of the @priv->dataReady flag to
@@ -1627,14 +1959,31 @@ udevEventHandleThread(void *opaque G_GNUC_UNUSED)
             continue;
         }
 
-        udevHandleOneDevice(device);
-        udev_device_unref(device);
+        if (virTimeMillisNow(&now) < 0) {
+            /* can't batch without a clock, handle the event right away */
+            udevFlushDevices(devices, &ndevices, queued);
+            udevHandleDevices(&device, 1);
+            udev_device_unref(device);
+            continue;
+        }
+
+        if (ndevices == 0)
+            deadline = now + UDEV_EVENT_COALESCE_MS;
+
+        udevQueueDevice(devices, &ndevices, queued, device);
 
-        /* Instead of waiting for the next event after processing @device
-         * data, let's keep reading from the udev monitor and only wait
-         * for the next event once either a EAGAIN or a EWOULDBLOCK error
-         * is encountered. */
+        /* Instead of waiting for the next event after queueing @device,
+         * let's keep reading from the udev monitor and only wait for the
+         * next event once either a EAGAIN or a EWOULDBLOCK error is
+         * encountered. Events keep coming during storms though, so the
+         * queue is flushed as soon as it's full or its time is up. */
+        if (ndevices == UDEV_EVENT_BATCH_MAX || now >= deadline)
+            udevFlushDevices(devices, &ndevices, queued);
     }
+
+ cleanup:
+    for (i = 0; i < ndevices; i++)
+        udev_device_unref(devices[i]);
 }
 
 
@@ -36,14 +36,16 @@
  */
 #include <config.h>
 
-#ifdef HAVE_LIBPCAP
-# include <pcap.h>
-#endif
-
 #include <fcntl.h>
 #include <poll.h>
 
 #include <net/if.h>
+#include <net/ethernet.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#include <linux/filter.h>
+#include <linux/if_packet.h>
 
 #include "viralloc.h"
 #include "virlog.h"
@@ -76,13 +78,21 @@ struct virNWFilterSnoopState {
     int                  leaseFD;
     int                  nLeases; /* number of active leases */
     int                  wLeases; /* number of written leases */
-    int                  nThreads; /* number of running threads */
     /* thread management */
     virHashTablePtr      snoopReqs;
     virHashTablePtr      ifnameToKey;
     virMutex             snoopLock;  /* protects SnoopReqs and IfNameToKey */
     virHashTablePtr      active;
     virMutex             activeLock; /* protects Active */
+    /* one socket captures the DHCP traffic of all snooped interfaces */
+    int                  captureFD;
+    int                  wakeupFDs[2];
+    virThread            captureThread;
+    bool                 captureRunning;
+    int                  captureQuit;
+    virHashTablePtr      captureIfaces; /* ifindex -> virNWFilterSnoopIface */
+    virMutex             captureLock;   /* protects CaptureIfaces */
+    virThreadPoolPtr     decodeWorkers;
 };
 
 # define virNWFilterSnoopLock() \
@@ -110,11 +120,8 @@ typedef virNWFilterSnoopReq *virNWFilterSnoopReqPtr;
 typedef struct _virNWFilterSnoopIPLease virNWFilterSnoopIPLease;
 typedef virNWFilterSnoopIPLease *virNWFilterSnoopIPLeasePtr;
 
-typedef enum {
-    THREAD_STATUS_NONE,
-    THREAD_STATUS_OK,
-    THREAD_STATUS_FAIL,
-} virNWFilterSnoopThreadStatus;
+typedef struct _virNWFilterDHCPDecodeJob virNWFilterDHCPDecodeJob;
+typedef virNWFilterDHCPDecodeJob *virNWFilterDHCPDecodeJobPtr;
 
 struct _virNWFilterSnoopReq {
     /*
@@ -133,13 +140,16 @@ struct _virNWFilterSnoopReq {
     virNWFilterSnoopIPLeasePtr           start;
     virNWFilterSnoopIPLeasePtr           end;
     char                                *threadkey;
-    virErrorPtr                          threadError;
-
-    virNWFilterSnoopThreadStatus         threadStatus;
-    virCond                              threadStatusCond;
 
     int                                  jobCompletionStatus;
-    /* the number of submitted jobs in the worker's queue */
+    /* packets waiting to be decoded, in the order they were captured;
+     * at most one worker at a time processes them */
+    virNWFilterDHCPDecodeJobPtr         *jobs;
+    size_t                               njobs;
+    /* the number of queued jobs per direction, indexed by fromVM */
+    unsigned int                         qCtr[2];
+    bool                                 decoding;
+    time_t                               last_displayed_queue;
     /*
      * protect those members that can change while the
      * req is on the public SnoopReq hash and
@@ -149,7 +159,7 @@ struct _virNWFilterSnoopReq {
      * - start
      * - end
      * - a lease while it is on the list
-     * - threadStatus
+     * - jobs, njobs, qCtr, decoding and last_displayed_queue
      * (for refctr, see above)
      */
     virMutex                             lock;
@@ -223,18 +233,19 @@ G_STATIC_ASSERT(sizeof(struct _virNWFilterSnoopDHCPHdr) == 236);
      sizeof(struct udphdr) + \
      offsetof(virNWFilterSnoopDHCPHdr, d_opts))
 
-# define PCAP_PBUFSIZE              576 /* >= IP/TCP/DHCP headers */
-# define PCAP_READ_MAXERRS          25 /* retries on failing device */
-# define PCAP_FLOOD_TIMEOUT_MS      10 /* ms */
+# define SNOOP_PBUFSIZE             576 /* >= IP/TCP/DHCP headers */
+# define SNOOP_FLOOD_TIMEOUT_MS     10 /* ms */
+# define SNOOP_READ_BATCH           64 /* packets read per wakeup */
+# define SNOOP_RCVBUF_SIZE          (1024 * 1024)
 
-typedef struct _virNWFilterDHCPDecodeJob virNWFilterDHCPDecodeJob;
-typedef virNWFilterDHCPDecodeJob *virNWFilterDHCPDecodeJobPtr;
+/* Decoding may instantiate filters, which takes a while; the workers
+ * are shared by all interfaces */
+# define DHCP_DECODE_WORKERS        4
 
 struct _virNWFilterDHCPDecodeJob {
-    unsigned char packet[PCAP_PBUFSIZE];
+    unsigned char packet[SNOOP_PBUFSIZE];
     int caplen;
     bool fromVM;
-    int *qCtr;
 };
 
 # define DHCP_PKT_RATE          10 /* pkts/sec */
@@ -250,25 +261,36 @@ struct _virNWFilterSnoopRateLimitConf {
     time_t prev;
     unsigned int pkt_ctr;
     time_t burst;
-    const unsigned int rate;
-    const unsigned int burstRate;
-    const unsigned int burstInterval;
+    unsigned int rate;
+    unsigned int burstRate;
+    unsigned int burstInterval;
 };
 # define SNOOP_POLL_MAX_TIMEOUT_MS  (10 * 1000) /* milliseconds */
 
-typedef struct _virNWFilterSnoopPcapConf virNWFilterSnoopPcapConf;
-typedef virNWFilterSnoopPcapConf *virNWFilterSnoopPcapConfPtr;
+typedef struct _virNWFilterSnoopDirConf virNWFilterSnoopDirConf;
+typedef virNWFilterSnoopDirConf *virNWFilterSnoopDirConfPtr;
 
-struct _virNWFilterSnoopPcapConf {
-    pcap_t *handle;
-    const pcap_direction_t dir;
-    const char *filter;
+struct _virNWFilterSnoopDirConf {
     virNWFilterSnoopRateLimitConf rateLimit; /* indep. rate limiters */
-    int qCtr; /* number of jobs in the worker's queue */
-    const unsigned int maxQSize;
     unsigned long long penaltyTimeoutAbs;
 };
 
+/*
+ * An interface whose DHCP traffic is snooped. Only the capture thread
+ * looks at the rate limiters; the rest is protected by the captureLock.
+ */
+typedef struct _virNWFilterSnoopIface virNWFilterSnoopIface;
+typedef virNWFilterSnoopIface *virNWFilterSnoopIfacePtr;
+
+struct _virNWFilterSnoopIface {
+    virNWFilterSnoopReqPtr req; /* holds a reference */
+    char *threadkey; /* snooping ends once this is not active anymore */
+    int ifindex;
+    virMacAddr mac;
+    virNWFilterSnoopDirConf dirConf[2]; /* indexed by fromVM */
+    time_t last_displayed;
+};
+
 /* local function prototypes */
 static int virNWFilterSnoopReqLeaseDel(virNWFilterSnoopReqPtr req,
                                        virSocketAddrPtr ipaddr,
@@ -284,6 +306,8 @@ static void virNWFilterSnoopLeaseFileSave(virNWFilterSnoopIPLeasePtr ipl);
 /* local variables */
 static struct virNWFilterSnoopState virNWFilterSnoopState = {
     .leaseFD = -1,
+    .captureFD = -1,
+    .wakeupFDs = { -1, -1 },
 };
 
 static const unsigned char dhcp_magic[4] = { 99, 130, 83, 99 };
@@ -557,18 +581,11 @@ virNWFilterSnoopReqNew(const char *ifkey)
         return NULL;
     }
 
-    req->threadStatus = THREAD_STATUS_NONE;
-
     if (virStrcpyStatic(req->ifkey, ifkey) < 0 ||
         virMutexInitRecursive(&req->lock) < 0) {
         return NULL;
     }
 
-    if (virCondInit(&req->threadStatusCond) < 0) {
-        virMutexDestroy(&req->lock);
-        return NULL;
-    }
-
     virNWFilterSnoopReqGet(req);
     return g_steal_pointer(&req);
 }
@@ -582,6 +599,7 @@ static void
 virNWFilterSnoopReqFree(virNWFilterSnoopReqPtr req)
 {
     virNWFilterSnoopIPLeasePtr ipl;
+    size_t i;
 
     if (!req)
         return;
@@ -596,9 +614,11 @@ virNWFilterSnoopReqFree(virNWFilterSnoopReqPtr req)
     /* free all req data */
     virNWFilterBindingDefFree(req->binding);
 
+    for (i = 0; i < req->njobs; i++)
+        g_free(req->jobs[i]);
+    g_free(req->jobs);
+
     virMutexDestroy(&req->lock);
-    virCondDestroy(&req->threadStatusCond);
-    virFreeError(req->threadError);
 
     g_free(req);
 }
@@ -1023,142 +1043,188 @@ virNWFilterSnoopDHCPDecode(virNWFilterSnoopReqPtr req,
     return 0;
 }
 
-static pcap_t *
-virNWFilterSnoopDHCPOpen(const char *ifname, virMacAddr *mac,
-                         const char *filter, pcap_direction_t dir)
-{
-    pcap_t *handle = NULL;
-    struct bpf_program fp;
-    char pcap_errbuf[PCAP_ERRBUF_SIZE];
-    g_autofree char *ext_filter = NULL;
-    char macaddr[VIR_MAC_STRING_BUFLEN];
-
-    virMacAddrFormat(mac, macaddr);
-
-    if (dir == PCAP_D_IN /* from VM */) {
-        /*
-         * don't want to hear about another VM's DHCP requests
-         *
-         * extend the filter with the macaddr of the VM; filter the
-         * more unlikely parameters first, then go for the MAC
-         */
-        ext_filter = g_strdup_printf("%s and ether src %s", filter, macaddr);
-    } else {
-        /*
-         * Some DHCP servers respond via MAC broadcast; we rely on later
-         * filtering of responses by comparing the MAC address inside the
-         * DHCP response against the one of the VM. Assuming that the
-         * bridge learns the VM's MAC address quickly this should not
-         * generate much more traffic than if we filtered by VM and
-         * braodcast MAC as well
-         */
-        ext_filter = g_strdup(filter);
-    }
-
-    handle = pcap_create(ifname, pcap_errbuf);
+/*
+ * Classic BPF program letting only IPv4 UDP packets between the DHCP
+ * client and server ports through, truncated to SNOOP_PBUFSIZE.
+ */
+static struct sock_filter dhcpFilter[] = {
+    /* ether type IPv4 */
+    BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETHERTYPE_IP, 0, 8),
+    /* protocol UDP */
+    BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 23),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, 6),
+    /* first fragment */
+    BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 20),
+    BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x1fff, 4, 0),
+    /* source and destination port */
+    BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 14),
+    BPF_STMT(BPF_LD | BPF_W | BPF_IND, 14),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (68 << 16) | 67, 2, 0),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (67 << 16) | 68, 1, 0),
+    BPF_STMT(BPF_RET | BPF_K, 0),
+    BPF_STMT(BPF_RET | BPF_K, SNOOP_PBUFSIZE),
+};
 
-    if (handle == NULL) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("pcap_create failed"));
-        return NULL;
-    }
+/*
+ * Open a packet socket seeing the DHCP traffic of all interfaces of
+ * the host in both directions. Packets are told apart by the index
+ * of the interface and by whether the host sent them.
+ */
+static int
+virNWFilterSnoopCaptureOpen(void)
+{
+    struct sock_fprog prog = {
+        .len = G_N_ELEMENTS(dhcpFilter),
+        .filter = dhcpFilter,
+    };
+    struct sockaddr_ll sll = {
+        .sll_family = AF_PACKET,
+        .sll_protocol = htons(ETH_P_ALL),
+    };
+    int rcvbuf = SNOOP_RCVBUF_SIZE;
+    int fd;
 
-    if (pcap_set_snaplen(handle, PCAP_PBUFSIZE) < 0 ||
-        pcap_set_immediate_mode(handle, 1) < 0 ||
-        pcap_activate(handle) < 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("setup of pcap handle failed: %s"),
-                       pcap_geterr(handle));
-        goto cleanup;
+    /* no protocol yet, so no packets are queued before the filter is
+     * in place */
+    if ((fd = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                     0)) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to open packet socket"));
+        return -1;
     }
 
-    if (pcap_compile(handle, &fp, ext_filter, 1, PCAP_NETMASK_UNKNOWN) != 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("pcap_compile: %s"), pcap_geterr(handle));
-        goto cleanup;
+    if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER,
+                   &prog, sizeof(prog)) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to attach DHCP filter to packet socket"));
+        goto error;
     }
 
-    if (pcap_setfilter(handle, &fp) != 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("pcap_setfilter: %s"), pcap_geterr(handle));
-        goto cleanup_freecode;
-    }
+    /* absorb the bursts of many VMs starting at once */
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) < 0)
+        VIR_WARN("Unable to enlarge the receive buffer of the packet socket");
 
-    if (pcap_setdirection(handle, dir) < 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("pcap_setdirection: %s"),
-                       pcap_geterr(handle));
-        goto cleanup_freecode;
+    if (bind(fd, (struct sockaddr *)&sll, sizeof(sll)) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to bind packet socket"));
+        goto error;
     }
 
-    pcap_freecode(&fp);
-    return handle;
+    return fd;
 
- cleanup_freecode:
-    pcap_freecode(&fp);
- cleanup:
-    pcap_close(handle);
-    return NULL;
+ error:
+    VIR_FORCE_CLOSE(fd);
+    return -1;
 }
 
 /*
- * Worker function to decode the DHCP message and with that
- * also do the time-consuming work of instantiating the filters
+ * Worker function to decode the DHCP messages of a request and with
+ * that also do the time-consuming work of instantiating the filters.
+ * The messages are processed in the order they were captured.
  */
-static void virNWFilterDHCPDecodeWorker(void *jobdata, void *opaque)
+static void virNWFilterDHCPDecodeWorker(void *jobdata,
+                                        void *opaque G_GNUC_UNUSED)
 {
-    virNWFilterSnoopReqPtr req = opaque;
-    g_autofree virNWFilterDHCPDecodeJobPtr job = jobdata;
-    virNWFilterSnoopEthHdrPtr packet = (virNWFilterSnoopEthHdrPtr)job->packet;
+    virNWFilterSnoopReqPtr req = jobdata;
 
-    if (virNWFilterSnoopDHCPDecode(req, packet,
-                                   job->caplen, job->fromVM) == -1) {
-        req->jobCompletionStatus = -1;
+    virNWFilterSnoopReqLock(req);
 
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("Instantiation of rules failed on "
-                         "interface '%s'"), req->binding->portdevname);
+    while (req->njobs > 0) {
+        g_autofree virNWFilterDHCPDecodeJobPtr job = req->jobs[0];
+        virNWFilterSnoopEthHdrPtr packet = (virNWFilterSnoopEthHdrPtr)job->packet;
+
+        VIR_DELETE_ELEMENT(req->jobs, 0, req->njobs);
+        req->qCtr[job->fromVM]--;
+
+        virNWFilterSnoopReqUnlock(req);
+
+        if (req->jobCompletionStatus == 0 &&
+            virNWFilterSnoopDHCPDecode(req, packet,
+                                       job->caplen, job->fromVM) == -1) {
+            req->jobCompletionStatus = -1;
+
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Instantiation of rules failed on "
+                             "interface '%s'"),
+                           NULLSTR(req->binding->portdevname));
+        }
+
+        virNWFilterSnoopReqLock(req);
     }
-    ignore_value(!!g_atomic_int_dec_and_test(job->qCtr));
+
+    req->decoding = false;
+
+    virNWFilterSnoopReqUnlock(req);
+
+    /* drop the reference the job was submitted with */
+    virNWFilterSnoopReqPut(req);
 }
 
 /*
- * Submit a job to the worker thread doing the time-consuming work...
+ * Queue a packet for decoding and have a worker process the queue of
+ * the request unless one is already at it.
+ *
+ * @req: the request the packet belongs to; the caller must hold a
+ *       reference which is handed over to the worker if one is started
+ *
+ * Returns 1 if the reference was handed over, 0 if not, -1 on error
  */
 static int
-virNWFilterSnoopDHCPDecodeJobSubmit(virThreadPoolPtr pool,
-                                    virNWFilterSnoopEthHdrPtr pep,
-                                    int len, pcap_direction_t dir,
-                                    int *qCtr)
+virNWFilterSnoopDHCPDecodeJobSubmit(virNWFilterSnoopReqPtr req,
+                                    const unsigned char *pep,
+                                    int len, bool fromVM)
 {
     virNWFilterDHCPDecodeJobPtr job;
-    int ret;
+    int ret = 0;
 
     if (len <= MIN_VALID_DHCP_PKT_SIZE || len > sizeof(job->packet))
         return 0;
 
+    virNWFilterSnoopReqLock(req);
+
+    if (req->qCtr[fromVM] > MAX_QUEUED_JOBS) {
+        if (time(0) - req->last_displayed_queue > 10) {
+            req->last_displayed_queue = time(0);
+            VIR_WARN("Decode queue of interface '%s' is too long",
+                     NULLSTR(req->binding->portdevname));
+        }
+        goto cleanup;
+    }
+
     job = g_new0(virNWFilterDHCPDecodeJob, 1);
 
     memcpy(job->packet, pep, len);
     job->caplen = len;
-    job->fromVM = (dir == PCAP_D_IN);
-    job->qCtr = qCtr;
-
-    ret = virThreadPoolSendJob(pool, 0, job);
+    job->fromVM = fromVM;
 
-    if (ret == 0)
-        g_atomic_int_add(qCtr, 1);
-    else
+    if (VIR_APPEND_ELEMENT(req->jobs, req->njobs, job) < 0) {
         g_free(job);
+        ret = -1;
+        goto cleanup;
+    }
+    req->qCtr[fromVM]++;
 
+    if (!req->decoding) {
+        if (virThreadPoolSendJob(virNWFilterSnoopState.decodeWorkers,
+                                 0, req) < 0) {
+            ret = -1;
+            goto cleanup;
+        }
+        req->decoding = true;
+        ret = 1;
+    }
+
+ cleanup:
+    virNWFilterSnoopReqUnlock(req);
     return ret;
 }
 
 /*
  * virNWFilterSnoopRateLimit -- limit the rate of jobs submitted to the
- *                              worker thread
+ *                              decode workers
  *
- * Help defend the worker thread from being flooded with likely bogus packets
+ * Help defend the decode workers from being flooded with likely bogus packets
  * sent by the VM.
  *
  * rl: The state of the rate limiter
@@ -1203,323 +1269,427 @@ virNWFilterSnoopRateLimit(virNWFilterSnoopRateLimitConfPtr rl)
 /*
  * virNWFilterSnoopRatePenalty
  *
- * @pc: pointer to the virNWFilterSnoopPcapConf
+ * @dc: pointer to the virNWFilterSnoopDirConf
  * @diff: the amount of pkts beyond the rate, i.e., if the rate is 10
  *        and 13 pkts have been received now in one seconds, then
  *        this should be 3.
  *
- * Adjusts the timeout the virNWFilterSnooPcapConf will be penalized for
+ * Adjusts the timeout the virNWFilterSnoopDirConf will be penalized for
  * sending too many packets.
  */
 static void
-virNWFilterSnoopRatePenalty(virNWFilterSnoopPcapConfPtr pc,
+virNWFilterSnoopRatePenalty(virNWFilterSnoopDirConfPtr dc,
                             unsigned int diff, unsigned int limit)
 {
     if (diff > limit) {
         unsigned long long now;
 
-        if (virTimeMillisNowRaw(&now) < 0) {
-            g_usleep(PCAP_FLOOD_TIMEOUT_MS); /* 1 ms */
-            pc->penaltyTimeoutAbs = 0;
-        } else {
-            /* don't listen to the fd for 1 ms */
-            pc->penaltyTimeoutAbs = now + PCAP_FLOOD_TIMEOUT_MS;
+        /* drop the packets of this direction for 10 ms */
+        if (virTimeMillisNowRaw(&now) < 0)
+            dc->penaltyTimeoutAbs = 0;
+        else
+            dc->penaltyTimeoutAbs = now + SNOOP_FLOOD_TIMEOUT_MS;
+    }
+}
+
+static bool
+virNWFilterSnoopInPenalty(virNWFilterSnoopDirConfPtr dc)
+{
+    unsigned long long now;
+
+    if (dc->penaltyTimeoutAbs == 0)
+        return false;
+
+    if (virTimeMillisNowRaw(&now) == 0 && now < dc->penaltyTimeoutAbs)
+        return true;
+
+    dc->penaltyTimeoutAbs = 0;
+    return false;
+}
+
+static void
+virNWFilterSnoopIfaceFree(virNWFilterSnoopIfacePtr iface)
+{
+    if (!iface)
+        return;
+
+    virNWFilterSnoopReqPut(iface->req);
+    g_free(iface->threadkey);
+    g_free(iface);
+}
+
+/*
+ * Hand a captured packet to the request snooping on the interface it
+ * was seen on.
+ *
+ * @fromVM: whether the VM sent the packet, i.e. the host received it
+ */
+static void
+virNWFilterSnoopCaptureDispatch(int ifindex, bool fromVM,
+                                const unsigned char *packet, int len)
+{
+    virNWFilterSnoopEthHdrPtr pep = (virNWFilterSnoopEthHdrPtr)packet;
+    virNWFilterSnoopIfacePtr iface;
+    virNWFilterSnoopReqPtr req = NULL;
+    char key[VIR_INT64_STR_BUFLEN];
+    unsigned int diff;
+    int rc;
+
+    if (len <= MIN_VALID_DHCP_PKT_SIZE)
+        return;
+
+    g_snprintf(key, sizeof(key), "%d", ifindex);
+
+    virMutexLock(&virNWFilterSnoopState.captureLock);
+
+    if (!(iface = virHashLookup(virNWFilterSnoopState.captureIfaces, key)))
+        goto unlock;
+
+    /* don't want to hear about another VM's DHCP requests */
+    if (fromVM && virMacAddrCmp(&iface->mac, &pep->eh_src) != 0)
+        goto unlock;
+
+    if (virNWFilterSnoopInPenalty(&iface->dirConf[fromVM]))
+        goto unlock;
+
+    diff = virNWFilterSnoopRateLimit(&iface->dirConf[fromVM].rateLimit);
+    if (diff > 0) {
+        virNWFilterSnoopRatePenalty(&iface->dirConf[fromVM], diff,
+                                    DHCP_PKT_RATE);
+        /* rate-limited warnings */
+        if (time(0) - iface->last_displayed > 10) {
+             iface->last_displayed = time(0);
+             VIR_WARN("Too many DHCP packets on interface '%s'",
+                      NULLSTR(iface->req->binding->portdevname));
         }
+        goto unlock;
+    }
+
+    /* the reference of the interface keeps the request alive while
+     * we take one of our own */
+    req = iface->req;
+    virNWFilterSnoopReqGet(req);
+
+ unlock:
+    virMutexUnlock(&virNWFilterSnoopState.captureLock);
+
+    if (!req)
+        return;
+
+    /* the req's lock must not be taken with the captureLock held */
+    rc = virNWFilterSnoopDHCPDecodeJobSubmit(req, packet, len, fromVM);
+    if (rc < 0) {
+        VIR_WARN("Job submission failed on interface '%s'",
+                 NULLSTR(req->binding->portdevname));
+        virResetLastError();
     }
+
+    if (rc <= 0)
+        virNWFilterSnoopReqPut(req);
 }
 
-static int
-virNWFilterSnoopAdjustPoll(virNWFilterSnoopPcapConfPtr pc,
-                           size_t nPc, struct pollfd *pfd,
-                           int *pollTo)
+static void
+virNWFilterSnoopCaptureRead(void)
 {
-    int ret = 0;
+    unsigned char packet[SNOOP_PBUFSIZE];
+    struct sockaddr_ll sll;
+    socklen_t slen;
+    ssize_t len;
     size_t i;
-    int tmp;
-    unsigned long long now = 0;
 
-    *pollTo = -1;
+    /* don't starve the lease timers while being flooded */
+    for (i = 0; i < SNOOP_READ_BATCH; i++) {
+        slen = sizeof(sll);
+        len = recvfrom(virNWFilterSnoopState.captureFD, packet, sizeof(packet),
+                       0, (struct sockaddr *)&sll, &slen);
+        if (len < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                VIR_WARN("Reading DHCP traffic failed: %s",
+                         g_strerror(errno));
+            return;
+        }
 
-    for (i = 0; i < nPc; i++) {
-        if (pc[i].penaltyTimeoutAbs != 0) {
-            if (now == 0) {
-                if (virTimeMillisNow(&now) < 0) {
-                    ret = -1;
-                    break;
-                }
-            }
+        virNWFilterSnoopCaptureDispatch(sll.sll_ifindex,
+                                        sll.sll_pkttype != PACKET_OUTGOING,
+                                        packet, len);
+    }
+}
 
-            if (now < pc[i].penaltyTimeoutAbs) {
-                /* don't listen to incoming data on the fd for some time */
-                pfd[i].events &= ~POLLIN;
-                /*
-                 * calc the max. time to spend in poll() until adjustments
-                 * to the pollfd array are needed again.
-                 */
-                tmp = pc[i].penaltyTimeoutAbs - now;
-                if (*pollTo == -1 || tmp < *pollTo)
-                    *pollTo = tmp;
-            } else {
-                /* listen again to the fd */
-                pfd[i].events |= POLLIN;
-
-                pc[i].penaltyTimeoutAbs = 0;
-            }
-        }
+struct virNWFilterSnoopCaptureTimerData {
+    virNWFilterSnoopReqPtr *reqs;
+    size_t nreqs;
+    virNWFilterSnoopIfacePtr *stale;
+    size_t nstale;
+};
+
+/*
+ * Collect the interfaces whose snooping ended for removal and take a
+ * reference on the requests of all others for running their timers.
+ * Call this function with the captureLock held.
+ */
+static int
+virNWFilterSnoopCaptureTimerIter(const void *payload,
+                                 const void *name G_GNUC_UNUSED,
+                                 const void *opaque)
+{
+    virNWFilterSnoopIfacePtr iface = (virNWFilterSnoopIfacePtr)payload;
+    struct virNWFilterSnoopCaptureTimerData *data = (void *)opaque;
+
+    if (!virNWFilterSnoopIsActive(iface->threadkey) ||
+        iface->req->jobCompletionStatus != 0) {
+        ignore_value(VIR_APPEND_ELEMENT(data->stale, data->nstale, iface));
+        return 1;
     }
 
-    return ret;
+    virNWFilterSnoopReqGet(iface->req);
+    if (VIR_APPEND_ELEMENT(data->reqs, data->nreqs, iface->req) < 0)
+        virNWFilterSnoopReqPut(iface->req);
+
+    return 0;
 }
 
 /*
- * The DHCP snooping thread. It spends most of its time in the pcap
- * library and if it gets suitable packets, it submits them to the worker
- * thread for processing.
+ * Run the lease timers of all snooped interfaces and stop snooping on
+ * those that were cancelled.
  */
 static void
-virNWFilterDHCPSnoopThread(void *req0)
+virNWFilterSnoopCaptureRunTimers(void)
 {
-    virNWFilterSnoopReqPtr req = req0;
-    struct pcap_pkthdr *hdr;
-    virNWFilterSnoopEthHdrPtr packet;
-    int ifindex = 0;
-    int errcount = 0;
-    int tmp = -1, rv, n, pollTo;
+    struct virNWFilterSnoopCaptureTimerData data = { 0 };
     size_t i;
-    g_autofree char *threadkey = NULL;
-    virThreadPoolPtr worker = NULL;
-    time_t last_displayed = 0, last_displayed_queue = 0;
-    virNWFilterSnoopPcapConf pcapConf[] = {
-        {
-            .dir = PCAP_D_IN, /* from VM */
-            .filter = "dst port 67 and src port 68",
-            .rateLimit = {
-                .prev = time(0),
-                .rate = DHCP_PKT_RATE,
-                .burstRate = DHCP_PKT_BURST,
-                .burstInterval = DHCP_BURST_INTERVAL_S,
-            },
-            .maxQSize = MAX_QUEUED_JOBS,
-        }, {
-            .dir = PCAP_D_OUT, /* to VM */
-            .filter = "src port 67 and dst port 68",
-            .rateLimit = {
-                .prev = time(0),
-                .rate = DHCP_PKT_RATE,
-                .burstRate = DHCP_PKT_BURST,
-                .burstInterval = DHCP_BURST_INTERVAL_S,
-            },
-            .maxQSize = MAX_QUEUED_JOBS,
-        },
-    };
+
+    virMutexLock(&virNWFilterSnoopState.captureLock);
+    virHashRemoveSet(virNWFilterSnoopState.captureIfaces,
+                     virNWFilterSnoopCaptureTimerIter, &data);
+    virMutexUnlock(&virNWFilterSnoopState.captureLock);
+
+    for (i = 0; i < data.nreqs; i++) {
+        virNWFilterSnoopReqLeaseTimerRun(data.reqs[i]);
+        virNWFilterSnoopReqPut(data.reqs[i]);
+    }
+
+    for (i = 0; i < data.nstale; i++)
+        virNWFilterSnoopIfaceFree(data.stale[i]);
+
+    g_free(data.reqs);
+    g_free(data.stale);
+}
+
+/*
+ * The DHCP capture thread. It reads the DHCP packets of all snooped
+ * interfaces from a single socket and submits them to the workers
+ * for processing.
+ */
+static void
+virNWFilterSnoopCaptureThread(void *opaque G_GNUC_UNUSED)
+{
     struct pollfd fds[] = {
         {
-            /* get a POLLERR if interface goes down or disappears */
-            .events = POLLIN | POLLERR,
+            .fd = virNWFilterSnoopState.captureFD,
+            .events = POLLIN,
         }, {
-            .events = POLLIN | POLLERR,
+            .fd = virNWFilterSnoopState.wakeupFDs[0],
+            .events = POLLIN,
         },
     };
-    bool error = false;
+    time_t lastTimerRun = 0;
 
-    /* whoever started us increased the reference counter for the req for us */
+    while (!g_atomic_int_get(&virNWFilterSnoopState.captureQuit)) {
+        int n = poll(fds, G_N_ELEMENTS(fds), SNOOP_POLL_MAX_TIMEOUT_MS);
 
-    /* protect req->binding->portdevname & req->threadkey */
-    virNWFilterSnoopReqLock(req);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EINTR)
+                continue;
+            virReportSystemError(errno, "%s",
+                                 _("poll on DHCP packet socket failed"));
+            break;
+        }
 
-    if (req->binding->portdevname && req->threadkey) {
-        for (i = 0; i < G_N_ELEMENTS(pcapConf); i++) {
-            pcapConf[i].handle =
-                virNWFilterSnoopDHCPOpen(req->binding->portdevname,
-                                         &req->binding->mac,
-                                         pcapConf[i].filter,
-                                         pcapConf[i].dir);
-            if (!pcapConf[i].handle) {
-                error = true;
-                break;
-            }
-            fds[i].fd = pcap_fileno(pcapConf[i].handle);
+        if (fds[1].revents) {
+            char ignore;
+
+            while (saferead(fds[1].fd, &ignore, 1) == 1)
+                ;
         }
-        tmp = virNetDevGetIndex(req->binding->portdevname, &ifindex);
-        threadkey = g_strdup(req->threadkey);
-        worker = virThreadPoolNewFull(1, 1, 0,
-                                      virNWFilterDHCPDecodeWorker,
-                                      "dhcp-decode",
-                                      req);
-    }
 
-    /* let creator know how well we initialized */
-    if (error || !threadkey || tmp < 0 || !worker ||
-        ifindex != req->ifindex) {
-        virErrorPreserveLast(&req->threadError);
-        req->threadStatus = THREAD_STATUS_FAIL;
-    } else {
-        req->threadStatus = THREAD_STATUS_OK;
+        if (fds[0].revents & POLLIN)
+            virNWFilterSnoopCaptureRead();
+
+        if (time(0) != lastTimerRun) {
+            lastTimerRun = time(0);
+            virNWFilterSnoopCaptureRunTimers();
+        }
     }
+}
 
-    virCondSignal(&req->threadStatusCond);
+/*
+ * Start capturing DHCP traffic. This is done once the first interface
+ * needs to be snooped.
+ * Call this function with the captureLock held.
+ */
+static int
+virNWFilterSnoopCaptureStart(void)
+{
+    if (virNWFilterSnoopState.captureRunning)
+        return 0;
 
-    virNWFilterSnoopReqUnlock(req);
+    if ((virNWFilterSnoopState.captureFD = virNWFilterSnoopCaptureOpen()) < 0)
+        return -1;
 
-    if (req->threadStatus != THREAD_STATUS_OK)
-        goto cleanup;
+    if (virPipeNonBlock(virNWFilterSnoopState.wakeupFDs) < 0)
+        goto error;
 
-    while (!error) {
-        if (virNWFilterSnoopAdjustPoll(pcapConf,
-                                       G_N_ELEMENTS(pcapConf),
-                                       fds, &pollTo) < 0) {
-            break;
-        }
+    if (!(virNWFilterSnoopState.decodeWorkers =
+          virThreadPoolNewFull(1, DHCP_DECODE_WORKERS, 0,
+                               virNWFilterDHCPDecodeWorker,
+                               "dhcp-decode", NULL)))
+        goto error;
 
-        /* cap pollTo so we don't hold up the join for too long */
-        if (pollTo < 0 || pollTo > SNOOP_POLL_MAX_TIMEOUT_MS)
-            pollTo = SNOOP_POLL_MAX_TIMEOUT_MS;
+    g_atomic_int_set(&virNWFilterSnoopState.captureQuit, 0);
 
-        n = poll(fds, G_N_ELEMENTS(fds), pollTo);
+    if (virThreadCreateFull(&virNWFilterSnoopState.captureThread, true,
+                            virNWFilterSnoopCaptureThread,
+                            "dhcp-snoop", false, NULL) != 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("unable to create DHCP snooping thread"));
+        goto error;
+    }
 
-        if (n < 0) {
-            if (errno != EAGAIN && errno != EINTR)
-                error = true;
-        }
+    virNWFilterSnoopState.captureRunning = true;
 
-        virNWFilterSnoopReqLeaseTimerRun(req);
+    return 0;
 
-        /*
-         * Check whether we were cancelled or whether
-         * a previously submitted job failed.
-         */
-        if (!virNWFilterSnoopIsActive(threadkey) ||
-            req->jobCompletionStatus != 0)
-            goto cleanup;
+ error:
+    g_clear_pointer(&virNWFilterSnoopState.decodeWorkers, virThreadPoolFree);
+    VIR_FORCE_CLOSE(virNWFilterSnoopState.wakeupFDs[0]);
+    VIR_FORCE_CLOSE(virNWFilterSnoopState.wakeupFDs[1]);
+    VIR_FORCE_CLOSE(virNWFilterSnoopState.captureFD);
+    return -1;
+}
 
-        for (i = 0; n > 0 && i < G_N_ELEMENTS(fds); i++) {
-            if (!fds[i].revents)
-                continue;
+static int
+virNWFilterSnoopCaptureStealIter(const void *payload,
+                                 const void *name G_GNUC_UNUSED,
+                                 const void *opaque)
+{
+    struct virNWFilterSnoopCaptureTimerData *data = (void *)opaque;
+    virNWFilterSnoopIfacePtr iface = (virNWFilterSnoopIfacePtr)payload;
 
-            fds[i].revents = 0;
-            n--;
+    ignore_value(VIR_APPEND_ELEMENT(data->stale, data->nstale, iface));
+    return 1;
+}
 
-            rv = pcap_next_ex(pcapConf[i].handle, &hdr,
-                              (const u_char **)&packet);
+/*
+ * Stop capturing DHCP traffic and wait for the capture thread and the
+ * workers to end.
+ */
+static void
+virNWFilterSnoopCaptureStop(void)
+{
+    struct virNWFilterSnoopCaptureTimerData data = { 0 };
+    size_t i;
 
-            if (rv < 0) {
-                /* error reading from socket */
-                tmp = -1;
+    if (!virNWFilterSnoopState.captureRunning)
+        return;
 
-                /* protect req->binding->portdevname */
-                virNWFilterSnoopReqLock(req);
+    g_atomic_int_set(&virNWFilterSnoopState.captureQuit, 1);
+    ignore_value(safewrite(virNWFilterSnoopState.wakeupFDs[1], "", 1));
+    virThreadJoin(&virNWFilterSnoopState.captureThread);
 
-                if (req->binding->portdevname)
-                    tmp = virNetDevValidateConfig(req->binding->portdevname, NULL, ifindex);
+    g_clear_pointer(&virNWFilterSnoopState.decodeWorkers, virThreadPoolFree);
 
-                virNWFilterSnoopReqUnlock(req);
+    virMutexLock(&virNWFilterSnoopState.captureLock);
+    virHashRemoveSet(virNWFilterSnoopState.captureIfaces,
+                     virNWFilterSnoopCaptureStealIter, &data);
+    virMutexUnlock(&virNWFilterSnoopState.captureLock);
 
-                if (tmp <= 0) {
-                    error = true;
-                    break;
-                }
+    for (i = 0; i < data.nstale; i++)
+        virNWFilterSnoopIfaceFree(data.stale[i]);
+    g_free(data.stale);
 
-                if (++errcount > PCAP_READ_MAXERRS) {
-                    pcap_close(pcapConf[i].handle);
-                    pcapConf[i].handle = NULL;
+    VIR_FORCE_CLOSE(virNWFilterSnoopState.wakeupFDs[0]);
+    VIR_FORCE_CLOSE(virNWFilterSnoopState.wakeupFDs[1]);
+    VIR_FORCE_CLOSE(virNWFilterSnoopState.captureFD);
 
-                    /* protect req->binding->portdevname */
-                    virNWFilterSnoopReqLock(req);
+    virNWFilterSnoopState.captureRunning = false;
+}
 
-                    virReportError(VIR_ERR_INTERNAL_ERROR,
-                                   _("interface '%s' failing; "
-                                     "reopening"),
-                                   req->binding->portdevname);
-                    if (req->binding->portdevname)
-                        pcapConf[i].handle =
-                            virNWFilterSnoopDHCPOpen(req->binding->portdevname,
-                                                     &req->binding->mac,
-                                                     pcapConf[i].filter,
-                                                     pcapConf[i].dir);
+/*
+ * Have the capture thread hand the DHCP packets seen on the interface
+ * of @req to it. The reference the caller holds on @req is taken over
+ * on success.
+ * Call this function with the SnoopLock and the req's lock held.
+ */
+static int
+virNWFilterSnoopCaptureAdd(virNWFilterSnoopReqPtr req)
+{
+    virNWFilterSnoopIfacePtr iface;
+    virNWFilterSnoopIfacePtr old;
+    char key[VIR_INT64_STR_BUFLEN];
+    size_t i;
 
-                    virNWFilterSnoopReqUnlock(req);
+    iface = g_new0(virNWFilterSnoopIface, 1);
+    iface->threadkey = g_strdup(req->threadkey);
+    iface->ifindex = req->ifindex;
+    virMacAddrSet(&iface->mac, &req->binding->mac);
+    for (i = 0; i < G_N_ELEMENTS(iface->dirConf); i++) {
+        iface->dirConf[i].rateLimit.prev = time(0);
+        iface->dirConf[i].rateLimit.rate = DHCP_PKT_RATE;
+        iface->dirConf[i].rateLimit.burstRate = DHCP_PKT_BURST;
+        iface->dirConf[i].rateLimit.burstInterval = DHCP_BURST_INTERVAL_S;
+    }
 
-                    if (!pcapConf[i].handle) {
-                        error = true;
-                        break;
-                    }
-                }
-                continue;
-            }
+    g_snprintf(key, sizeof(key), "%d", iface->ifindex);
 
-            errcount = 0;
-
-            if (rv) {
-                unsigned int diff;
-
-                /* submit packet to worker thread */
-                if (g_atomic_int_get(&pcapConf[i].qCtr) >
-                    pcapConf[i].maxQSize) {
-                    if (last_displayed_queue - time(0) > 10) {
-                        last_displayed_queue = time(0);
-                        VIR_WARN("Worker thread for interface '%s' has a "
-                                 "job queue that is too long",
-                                 req->binding->portdevname);
-                    }
-                    continue;
-                }
-
-                diff = virNWFilterSnoopRateLimit(&pcapConf[i].rateLimit);
-                if (diff > 0) {
-                    virNWFilterSnoopRatePenalty(&pcapConf[i], diff,
-                                                DHCP_PKT_RATE);
-                    /* rate-limited warnings */
-                    if (time(0) - last_displayed > 10) {
-                         last_displayed = time(0);
-                         VIR_WARN("Too many DHCP packets on interface '%s'",
-                                  req->binding->portdevname);
-                    }
-                    continue;
-                }
-
-                if (virNWFilterSnoopDHCPDecodeJobSubmit(worker, packet,
-                                                      hdr->caplen,
-                                                      pcapConf[i].dir,
-                                                      &pcapConf[i].qCtr) < 0) {
-                    virReportError(VIR_ERR_INTERNAL_ERROR,
-                                   _("Job submission failed on "
-                                     "interface '%s'"), req->binding->portdevname);
-                    error = true;
-                    break;
-                }
-            }
-        } /* for all fds */
-    } /* while (!error) */
+    virMutexLock(&virNWFilterSnoopState.captureLock);
 
-    /* protect IfNameToKey */
-    virNWFilterSnoopLock();
+    if (virNWFilterSnoopCaptureStart() < 0)
+        goto error;
 
-    /* protect req->binding->portdevname & req->threadkey */
-    virNWFilterSnoopReqLock(req);
+    /* an interface that went away without its snooping being ended */
+    old = virHashSteal(virNWFilterSnoopState.captureIfaces, key);
 
-    virNWFilterSnoopCancel(&req->threadkey);
+    if (virHashAddEntry(virNWFilterSnoopState.captureIfaces, key, iface) < 0) {
+        if (old)
+            ignore_value(virHashAddEntry(virNWFilterSnoopState.captureIfaces,
+                                         key, old));
+        goto error;
+    }
+    iface->req = req;
 
-    ignore_value(virHashRemoveEntry(virNWFilterSnoopState.ifnameToKey,
-                                    req->binding->portdevname));
+    virMutexUnlock(&virNWFilterSnoopState.captureLock);
 
-    g_clear_pointer(&req->binding->portdevname, g_free);
+    if (old) {
+        virNWFilterSnoopReqPtr oldreq = old->req;
 
-    virNWFilterSnoopReqUnlock(req);
-    virNWFilterSnoopUnlock();
+        VIR_DEBUG("Interface index %d reused; ending stale snooping",
+                  old->ifindex);
 
- cleanup:
-    virThreadPoolFree(worker);
+        virNWFilterSnoopReqLock(oldreq);
 
-    virNWFilterSnoopReqPut(req);
+        if (oldreq != req && virNWFilterSnoopIsActive(oldreq->threadkey) &&
+            STREQ_NULLABLE(oldreq->threadkey, old->threadkey)) {
+            virNWFilterSnoopCancel(&oldreq->threadkey);
+
+            if (oldreq->binding->portdevname) {
+                ignore_value(virHashRemoveEntry(virNWFilterSnoopState.ifnameToKey,
+                                                oldreq->binding->portdevname));
+                g_clear_pointer(&oldreq->binding->portdevname, g_free);
+            }
+        }
 
-    for (i = 0; i < G_N_ELEMENTS(pcapConf); i++) {
-        if (pcapConf[i].handle)
-            pcap_close(pcapConf[i].handle);
+        virNWFilterSnoopReqUnlock(oldreq);
+
+        virNWFilterSnoopIfaceFree(old);
     }
 
-    ignore_value(!!g_atomic_int_dec_and_test(&virNWFilterSnoopState.nThreads));
+    return 0;
 
-    return;
+ error:
+    virMutexUnlock(&virNWFilterSnoopState.captureLock);
+    g_free(iface->threadkey);
+    g_free(iface);
+    return -1;
 }
 
 static void
@@ -1540,9 +1710,7 @@ virNWFilterDHCPSnoopReq(virNWFilterTechDriverPtr techdriver,
     bool isnewreq;
     char ifkey[VIR_IFKEY_LEN];
     int tmp;
-    virThread thread;
     virNWFilterVarValuePtr dhcpsrvrs;
-    bool threadPuts = false;
 
     virNWFilterSnoopIFKeyFMT(ifkey, binding->owneruuid, &binding->mac);
 
@@ -1610,21 +1778,9 @@ virNWFilterDHCPSnoopReq(virNWFilterTechDriverPtr techdriver,
         goto exit_rem_ifnametokey;
     }
 
-    /* prevent thread from holding req */
+    /* protect req->threadkey */
     virNWFilterSnoopReqLock(req);
 
-    if (virThreadCreateFull(&thread, false, virNWFilterDHCPSnoopThread,
-                            "dhcp-snoop", false, req) != 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("virNWFilterDHCPSnoopReq virThreadCreate "
-                         "failed on interface '%s'"), binding->portdevname);
-        goto exit_snoopreq_unlock;
-    }
-
-    threadPuts = true;
-
-    g_atomic_int_add(&virNWFilterSnoopState.nThreads, 1);
-
     req->threadkey = virNWFilterSnoopActivate(req);
     if (!req->threadkey) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
@@ -1640,23 +1796,14 @@ virNWFilterDHCPSnoopReq(virNWFilterTechDriverPtr techdriver,
         goto exit_snoop_cancel;
     }
 
-    /* sync with thread */
-    if (virCondWait(&req->threadStatusCond, &req->lock) < 0) {
-        virReportSystemError(errno, "%s",
-                             _("unable to wait on dhcp snoop thread"));
-        goto exit_snoop_cancel;
-    }
-
-    if (req->threadStatus != THREAD_STATUS_OK) {
-        virErrorRestore(&req->threadError);
+    if (virNWFilterSnoopCaptureAdd(req) < 0)
         goto exit_snoop_cancel;
-    }
 
     virNWFilterSnoopReqUnlock(req);
 
     virNWFilterSnoopUnlock();
 
-    /* do not 'put' the req -- the thread will do this */
+    /* do not 'put' the req -- the capture thread will do this */
 
     return 0;
 
@@ -1669,8 +1816,7 @@ virNWFilterDHCPSnoopReq(virNWFilterTechDriverPtr techdriver,
  exit_snoopunlock:
     virNWFilterSnoopUnlock();
  exit_snoopreqput:
-    if (!threadPuts)
-        virNWFilterSnoopReqPut(req);
+    virNWFilterSnoopReqPut(req);
 
     return -1;
 }
@@ -1929,19 +2075,6 @@ virNWFilterSnoopLeaseFileLoad(void)
     virNWFilterSnoopUnlock();
 }
 
-/*
- * Wait until all threads have ended.
- */
-static void
-virNWFilterSnoopJoinThreads(void)
-{
-    while (g_atomic_int_get(&virNWFilterSnoopState.nThreads) != 0) {
-        VIR_WARN("Waiting for snooping threads to terminate: %u",
-                 g_atomic_int_get(&virNWFilterSnoopState.nThreads));
-        g_usleep(1000 * 1000);
-    }
-}
-
 /*
  * Iterator to remove a request, repeatedly called on one
  * request after another.
@@ -2002,17 +2135,20 @@ virNWFilterDHCPSnoopInit(void)
     VIR_DEBUG("Initializing DHCP snooping");
 
     if (virMutexInitRecursive(&virNWFilterSnoopState.snoopLock) < 0 ||
-        virMutexInit(&virNWFilterSnoopState.activeLock) < 0)
+        virMutexInit(&virNWFilterSnoopState.activeLock) < 0 ||
+        virMutexInit(&virNWFilterSnoopState.captureLock) < 0)
         return -1;
 
     virNWFilterSnoopState.ifnameToKey = virHashCreate(0, NULL);
     virNWFilterSnoopState.active = virHashCreate(0, NULL);
+    virNWFilterSnoopState.captureIfaces = virHashCreate(0, NULL);
     virNWFilterSnoopState.snoopReqs =
         virHashCreate(0, virNWFilterSnoopReqRelease);
 
     if (!virNWFilterSnoopState.ifnameToKey ||
         !virNWFilterSnoopState.snoopReqs ||
-        !virNWFilterSnoopState.active)
+        !virNWFilterSnoopState.active ||
+        !virNWFilterSnoopState.captureIfaces)
         goto error;
 
     virNWFilterSnoopLeaseFileLoad();
@@ -2030,6 +2166,9 @@ virNWFilterDHCPSnoopInit(void)
     virHashFree(virNWFilterSnoopState.active);
     virNWFilterSnoopState.active = NULL;
 
+    virHashFree(virNWFilterSnoopState.captureIfaces);
+    virNWFilterSnoopState.captureIfaces = NULL;
+
     return -1;
 }
 
@@ -2103,7 +2242,7 @@ void
 virNWFilterDHCPSnoopShutdown(void)
 {
     virNWFilterSnoopEndThreads();
-    virNWFilterSnoopJoinThreads();
+    virNWFilterSnoopCaptureStop();
 
     virNWFilterSnoopLock();
 
@@ -2116,6 +2255,10 @@ virNWFilterDHCPSnoopShutdown(void)
     virNWFilterSnoopActiveLock();
     virHashFree(virNWFilterSnoopState.active);
     virNWFilterSnoopActiveUnlock();
+
+    virMutexLock(&virNWFilterSnoopState.captureLock);
+    virHashFree(virNWFilterSnoopState.captureIfaces);
+    virMutexUnlock(&virNWFilterSnoopState.captureLock);
 }
 
 #else /* HAVE_LIBPCAP */
@@ -36,7 +36,9 @@
 #include "domain_nwfilter.h"
 #include "nwfilter_driver.h"
 #include "nwfilter_gentech_driver.h"
+#include "nwfilter_ebiptables_driver.h"
 #include "configmake.h"
+#include "virconf.h"
 #include "virfile.h"
 #include "virpidfile.h"
 #include "virstring.h"
@@ -170,6 +172,29 @@ virNWFilterTriggerRebuildImpl(void *opaque)
 }
 
 
+static int
+nwfilterDriverLoadConfig(const char *filename)
+{
+    g_autoptr(virConf) conf = NULL;
+
+    driver->firewallBackend = g_strdup(EBIPTABLES_DRIVER_ID);
+
+    if (access(filename, R_OK) == -1) {
+        VIR_INFO("Could not read nwfilter config file %s", filename);
+        return 0;
+    }
+
+    if (!(conf = virConfReadFile(filename, 0)))
+        return -1;
+
+    if (virConfGetValueString(conf, "firewall_backend",
+                              &driver->firewallBackend) < 0)
+        return -1;
+
+    return 0;
+}
+
+
 /**
  * nwfilterStateInitialize:
  *
@@ -230,7 +255,10 @@ nwfilterStateInitialize(bool privileged,
     if (virNWFilterDHCPSnoopInit() < 0)
         goto err_exit_learnshutdown;
 
-    if (virNWFilterTechDriversInit(privileged) < 0)
+    if (nwfilterDriverLoadConfig(SYSCONFDIR "/libvirt/nwfilter.conf") < 0)
+        goto err_dhcpsnoop_shutdown;
+
+    if (virNWFilterTechDriversInit(privileged, driver->firewallBackend) < 0)
         goto err_dhcpsnoop_shutdown;
 
     if (virNWFilterConfLayerInit(virNWFilterTriggerRebuildImpl,
@@ -303,6 +331,7 @@ nwfilterStateInitialize(bool privileged,
 
  err_free_driverstate:
     virNWFilterObjListFree(driver->nwfilters);
+    g_free(driver->firewallBackend);
     g_clear_pointer(&driver, g_free);
 
     return VIR_DRV_STATE_INIT_ERROR;
@@ -370,6 +399,7 @@ nwfilterStateCleanup(void)
         g_free(driver->stateDir);
         g_free(driver->configDir);
         g_free(driver->bindingDir);
+        g_free(driver->firewallBackend);
         nwfilterDriverUnlock();
     }
 
@@ -30,6 +30,7 @@
 #include "virerror.h"
 #include "nwfilter_gentech_driver.h"
 #include "nwfilter_ebiptables_driver.h"
+#include "nwfilter_nftables_driver.h"
 #include "nwfilter_dhcpsnoop.h"
 #include "nwfilter_ipaddrmap.h"
 #include "nwfilter_learnipaddr.h"
@@ -37,6 +38,7 @@
 #include "datatypes.h"
 #include "virsocketaddr.h"
 #include "virstring.h"
+#include "virthreadpool.h"
 
 #define VIR_FROM_THIS VIR_FROM_NWFILTER
 
@@ -52,9 +54,13 @@ static int _virNWFilterTeardownFilter(const char *ifname);
 
 static virNWFilterTechDriverPtr filter_tech_drivers[] = {
     &ebiptables_driver,
+    &nftables_driver,
     NULL
 };
 
+/* The tech driver all filters are instantiated with */
+static const char *filter_tech_driver_name = EBIPTABLES_DRIVER_ID;
+
 /* Serializes instantiation of filters. This is necessary
  * to avoid lock ordering deadlocks. eg virNWFilterInstantiateFilterUpdate
  * will hold a lock on a virNWFilterObjPtr. This in turn invokes
@@ -71,18 +77,56 @@ static virNWFilterTechDriverPtr filter_tech_drivers[] = {
  */
 static virMutex updateMutex;
 
-int virNWFilterTechDriversInit(bool privileged)
+/* Names of the filters the rules of each interface were built from,
+ * keyed by interface name. This tells which interfaces a changed filter
+ * can affect without expanding their filter trees. Protected by
+ * updateMutex. */
+static virHashTablePtr filterRefs;
+
+/* Minimum number of interfaces for which applying updated rules is
+ * spread over workers */
+#define VIR_NWFILTER_APPLY_PARALLEL_MIN 4
+
+/* Bounded since every worker runs firewall commands */
+#define VIR_NWFILTER_APPLY_WORKERS 8
+
+
+static void
+virNWFilterRefsFree(void *opaque)
+{
+    virStringListFree(opaque);
+}
+
+
+int virNWFilterTechDriversInit(bool privileged, const char *name)
 {
     size_t i = 0;
     VIR_DEBUG("Initializing NWFilter technology drivers");
-    if (virMutexInitRecursive(&updateMutex) < 0)
-        return -1;
 
     while (filter_tech_drivers[i]) {
-        if (!(filter_tech_drivers[i]->flags & TECHDRV_FLAG_INITIALIZED))
-            filter_tech_drivers[i]->init(privileged);
+        if (STREQ(filter_tech_drivers[i]->name, name))
+            break;
         i++;
     }
+
+    if (!filter_tech_drivers[i]) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                       _("unsupported firewall backend '%s'"), name);
+        return -1;
+    }
+
+    filter_tech_driver_name = filter_tech_drivers[i]->name;
+
+    if (virMutexInitRecursive(&updateMutex) < 0)
+        return -1;
+
+    if (!(filterRefs = virHashNew(virNWFilterRefsFree)))
+        return -1;
+
+    /* only the driver in use touches the host firewall */
+    if (!(filter_tech_drivers[i]->flags & TECHDRV_FLAG_INITIALIZED))
+        filter_tech_drivers[i]->init(privileged);
+
     return 0;
 }
 
@@ -95,6 +139,7 @@ void virNWFilterTechDriversShutdown(void)
             filter_tech_drivers[i]->shutdown();
         i++;
     }
+    g_clear_pointer(&filterRefs, virHashFree);
     virMutexDestroy(&updateMutex);
 }
 
@@ -126,6 +171,34 @@ virNWFilterRuleInstFree(virNWFilterRuleInstPtr inst)
 }
 
 
+/* The rules of an interface expanded ahead of applying them */
+typedef struct _virNWFilterApplyJob virNWFilterApplyJob;
+typedef virNWFilterApplyJob *virNWFilterApplyJobPtr;
+struct _virNWFilterApplyJob {
+    virNWFilterTechDriverPtr techdriver;
+    virNWFilterBindingDefPtr binding; /* NULL if there is nothing to apply */
+    int ifindex;
+    virNWFilterRuleInstPtr *rules;
+    size_t nrules;
+
+    int rc;
+    virErrorPtr err;
+};
+
+
+static void
+virNWFilterApplyJobClear(virNWFilterApplyJobPtr job)
+{
+    size_t i;
+
+    for (i = 0; i < job->nrules; i++)
+        virNWFilterRuleInstFree(job->rules[i]);
+    g_free(job->rules);
+    virFreeError(job->err);
+    memset(job, 0, sizeof(*job));
+}
+
+
 /**
  * Convert a virHashTable into a string of comma-separated
  * variable names.
@@ -244,6 +317,105 @@ virNWFilterInstReset(virNWFilterInstPtr inst)
 }
 
 
+/*
+ * Returns true if @a and @b expand to the same rules, in which case
+ * there is no need to touch the firewall of the interface.
+ */
+static bool
+virNWFilterInstEqual(virNWFilterInstPtr a,
+                     virNWFilterInstPtr b)
+{
+    size_t i;
+
+    if (a->nrules != b->nrules)
+        return false;
+
+    for (i = 0; i < a->nrules; i++) {
+        virNWFilterRuleInstPtr ra = a->rules[i];
+        virNWFilterRuleInstPtr rb = b->rules[i];
+
+        if (STRNEQ_NULLABLE(ra->chainSuffix, rb->chainSuffix) ||
+            ra->chainPriority != rb->chainPriority ||
+            ra->priority != rb->priority ||
+            !virNWFilterRuleDefEqual(ra->def, rb->def) ||
+            !virNWFilterHashTableEqual(ra->vars, rb->vars))
+            return false;
+    }
+
+    return true;
+}
+
+
+/*
+ * Remembers the filters @inst of interface @ifname was expanded from.
+ * With @merge the filters already known are kept, since the new rules
+ * may still be rolled back to the old ones.
+ *
+ * Call this function while holding the filter update lock
+ */
+static void
+virNWFilterRecordRefs(const char *ifname,
+                      virNWFilterDefPtr filter,
+                      virNWFilterInstPtr inst,
+                      bool merge)
+{
+    char **refs = NULL;
+    char **old;
+    size_t i;
+
+    if (!filterRefs)
+        return;
+
+    if (merge && (old = virHashLookup(filterRefs, ifname)))
+        refs = g_strdupv(old);
+
+    for (i = 0; i <= inst->nfilters; i++) {
+        const char *name;
+
+        if (i == inst->nfilters)
+            name = filter->name;
+        else
+            name = virNWFilterObjGetDef(inst->filters[i])->name;
+
+        if (!virStringListHasString((const char **)refs, name))
+            ignore_value(virStringListAdd(&refs, name));
+    }
+
+    if (virHashUpdateEntry(filterRefs, ifname, refs) < 0) {
+        /* unknown references make the interface be looked at again */
+        virResetLastError();
+        virStringListFree(refs);
+        virHashRemoveEntry(filterRefs, ifname);
+    }
+}
+
+
+/*
+ * Returns true if the rules of interface @ifname are known not to
+ * reference any of the filters in @changed.
+ *
+ * Call this function while holding the filter update lock
+ */
+static bool
+virNWFilterRefsUnaffected(const char *ifname,
+                          char **changed)
+{
+    const char **refs;
+    size_t i;
+
+    if (!filterRefs ||
+        !(refs = virHashLookup(filterRefs, ifname)))
+        return false;
+
+    for (i = 0; changed && changed[i]; i++) {
+        if (virStringListHasString(refs, changed[i]))
+            return false;
+    }
+
+    return true;
+}
+
+
 
 static int
 virNWFilterDefToInst(virNWFilterDriverStatePtr driver,
@@ -480,13 +652,48 @@ virNWFilterDetermineMissingVarsRec(virNWFilterDefPtr filter,
 }
 
 
+static int
+virNWFilterApplyRules(virNWFilterTechDriverPtr techdriver,
+                      virNWFilterBindingDefPtr binding,
+                      int ifindex,
+                      virNWFilterRuleInstPtr *rules,
+                      size_t nrules,
+                      bool teardownOld)
+{
+    int rc;
+
+    if (virNWFilterLockIface(binding->portdevname) < 0)
+        return -1;
+
+    rc = techdriver->applyNewRules(binding->portdevname, rules, nrules);
+
+    if (teardownOld && rc == 0)
+        techdriver->tearOldRules(binding->portdevname);
+
+    if (rc == 0 && (virNetDevValidateConfig(binding->portdevname, NULL, ifindex) <= 0)) {
+        virResetLastError();
+        /* interface changed/disappeared */
+        techdriver->allTeardown(binding->portdevname);
+        rc = -1;
+    }
+
+    virNWFilterUnlockIface(binding->portdevname);
+
+    return rc;
+}
+
+
 /**
  * virNWFilterDoInstantiate:
  * @techdriver: The driver to use for instantiation
  * @binding: description of port to bind the filter to
  * @filter: The filter to instantiate
+ * @oldFilter: The filter currently instantiated when following new
+ *  filters, to skip interfaces whose rules don't change; may be NULL
  * @forceWithPendingReq: Ignore the check whether a pending learn request
  *  is active; 'true' only when the rules are applied late
+ * @job: if not NULL, where to leave the rules for applying them later
+ *  instead of applying them right away
  *
  * Returns 0 on success, a value otherwise.
  *
@@ -501,15 +708,18 @@ static int
 virNWFilterDoInstantiate(virNWFilterTechDriverPtr techdriver,
                          virNWFilterBindingDefPtr binding,
                          virNWFilterDefPtr filter,
+                         virNWFilterDefPtr oldFilter,
                          int ifindex,
                          enum instCase useNewFilter,
                          bool *foundNewFilter,
                          bool teardownOld,
                          virNWFilterDriverStatePtr driver,
-                         bool forceWithPendingReq)
+                         bool forceWithPendingReq,
+                         virNWFilterApplyJobPtr job)
 {
     int rc;
     virNWFilterInst inst;
+    virNWFilterInst oldinst;
     bool instantiate = true;
     g_autofree char *buf = NULL;
     virNWFilterVarValuePtr lv;
@@ -519,6 +729,7 @@ virNWFilterDoInstantiate(virNWFilterTechDriverPtr techdriver,
     virHashTablePtr missing_vars = virNWFilterHashTableCreate(0);
 
     memset(&inst, 0, sizeof(inst));
+    memset(&oldinst, 0, sizeof(oldinst));
 
     if (!missing_vars) {
         rc = -1;
@@ -590,6 +801,9 @@ virNWFilterDoInstantiate(virNWFilterTechDriverPtr techdriver,
     if (rc < 0)
         goto error;
 
+    virNWFilterRecordRefs(binding->portdevname, filter, &inst,
+                          useNewFilter == INSTANTIATE_FOLLOW_NEWFILTER);
+
     switch (useNewFilter) {
     case INSTANTIATE_FOLLOW_NEWFILTER:
         instantiate = *foundNewFilter;
@@ -599,26 +813,43 @@ virNWFilterDoInstantiate(virNWFilterTechDriverPtr techdriver,
         break;
     }
 
-    if (instantiate) {
-        if (virNWFilterLockIface(binding->portdevname) < 0)
-            goto error;
-
-        rc = techdriver->applyNewRules(binding->portdevname, inst.rules, inst.nrules);
-
-        if (teardownOld && rc == 0)
-            techdriver->tearOldRules(binding->portdevname);
-
-        if (rc == 0 && (virNetDevValidateConfig(binding->portdevname, NULL, ifindex) <= 0)) {
+    /* a changed filter doesn't necessarily change the rules of every
+     * interface using it, e.g. if the change is in a rule whose
+     * variables are not set for this interface */
+    if (instantiate && oldFilter) {
+        bool foundOldFilter = false;
+
+        if (virNWFilterDefToInst(driver,
+                                 oldFilter,
+                                 binding->filterparams,
+                                 INSTANTIATE_ALWAYS, &foundOldFilter,
+                                 &oldinst) < 0) {
             virResetLastError();
-            /* interface changed/disappeared */
-            techdriver->allTeardown(binding->portdevname);
-            rc = -1;
+        } else if (virNWFilterInstEqual(&inst, &oldinst)) {
+            VIR_DEBUG("Rules of portdev=%s are unchanged",
+                      binding->portdevname);
+            *foundNewFilter = false;
+            instantiate = false;
         }
+    }
 
-        virNWFilterUnlockIface(binding->portdevname);
+    if (instantiate) {
+        if (job) {
+            job->techdriver = techdriver;
+            job->binding = binding;
+            job->ifindex = ifindex;
+            job->rules = g_steal_pointer(&inst.rules);
+            job->nrules = inst.nrules;
+            inst.nrules = 0;
+        } else {
+            rc = virNWFilterApplyRules(techdriver, binding, ifindex,
+                                       inst.rules, inst.nrules,
+                                       teardownOld);
+        }
     }
 
  error:
+    virNWFilterInstReset(&oldinst);
     virNWFilterInstReset(&inst);
     virHashFree(missing_vars);
 
@@ -670,14 +901,16 @@ virNWFilterInstantiateFilterUpdate(virNWFilterDriverStatePtr driver,
                                    int ifindex,
                                    enum instCase useNewFilter,
                                    bool forceWithPendingReq,
-                                   bool *foundNewFilter)
+                                   bool *foundNewFilter,
+                                   virNWFilterApplyJobPtr job)
 {
     int rc = -1;
-    const char *drvname = EBIPTABLES_DRIVER_ID;
+    const char *drvname = filter_tech_driver_name;
     virNWFilterTechDriverPtr techdriver;
     virNWFilterObjPtr obj;
     virNWFilterDefPtr filter;
     virNWFilterDefPtr newFilter;
+    virNWFilterDefPtr oldFilter = NULL;
     char vmmacaddr[VIR_MAC_STRING_BUFLEN] = {0};
     virNWFilterVarValuePtr ipaddr;
 
@@ -715,6 +948,7 @@ virNWFilterInstantiateFilterUpdate(virNWFilterDriverStatePtr driver,
 
     switch (useNewFilter) {
     case INSTANTIATE_FOLLOW_NEWFILTER:
+        oldFilter = filter;
         newFilter = virNWFilterObjGetNewDef(obj);
         if (newFilter) {
             filter = newFilter;
@@ -726,10 +960,10 @@ virNWFilterInstantiateFilterUpdate(virNWFilterDriverStatePtr driver,
         break;
     }
 
-    rc = virNWFilterDoInstantiate(techdriver, binding, filter,
+    rc = virNWFilterDoInstantiate(techdriver, binding, filter, oldFilter,
                                   ifindex, useNewFilter, foundNewFilter,
                                   teardownOld, driver,
-                                  forceWithPendingReq);
+                                  forceWithPendingReq, job);
 
  error:
     virNWFilterObjUnlock(obj);
@@ -743,7 +977,8 @@ virNWFilterInstantiateFilterInternal(virNWFilterDriverStatePtr driver,
                                      virNWFilterBindingDefPtr binding,
                                      bool teardownOld,
                                      enum instCase useNewFilter,
-                                     bool *foundNewFilter)
+                                     bool *foundNewFilter,
+                                     virNWFilterApplyJobPtr job)
 {
     int ifindex;
     int rc;
@@ -766,7 +1001,7 @@ virNWFilterInstantiateFilterInternal(virNWFilterDriverStatePtr driver,
                                             binding,
                                             ifindex,
                                             useNewFilter,
-                                            false, foundNewFilter);
+                                            false, foundNewFilter, job);
 
  cleanup:
     virMutexUnlock(&updateMutex);
@@ -789,7 +1024,7 @@ virNWFilterInstantiateFilterLate(virNWFilterDriverStatePtr driver,
     rc = virNWFilterInstantiateFilterUpdate(driver, true,
                                             binding, ifindex,
                                             INSTANTIATE_ALWAYS, true,
-                                            &foundNewFilter);
+                                            &foundNewFilter, NULL);
     if (rc < 0) {
         /* something went wrong... 'DOWN' the interface */
         if ((virNetDevValidateConfig(binding->portdevname, NULL, ifindex) <= 0) ||
@@ -816,21 +1051,22 @@ virNWFilterInstantiateFilter(virNWFilterDriverStatePtr driver,
     return virNWFilterInstantiateFilterInternal(driver, binding,
                                                 1,
                                                 INSTANTIATE_ALWAYS,
-                                                &foundNewFilter);
+                                                &foundNewFilter, NULL);
 }
 
 
-int
+static int
 virNWFilterUpdateInstantiateFilter(virNWFilterDriverStatePtr driver,
                                    virNWFilterBindingDefPtr binding,
-                                   bool *skipIface)
+                                   bool *skipIface,
+                                   virNWFilterApplyJobPtr job)
 {
     bool foundNewFilter = false;
 
     int rc = virNWFilterInstantiateFilterInternal(driver, binding,
                                                   0,
                                                   INSTANTIATE_FOLLOW_NEWFILTER,
-                                                  &foundNewFilter);
+                                                  &foundNewFilter, job);
 
     *skipIface = !foundNewFilter;
     return rc;
@@ -839,7 +1075,7 @@ virNWFilterUpdateInstantiateFilter(virNWFilterDriverStatePtr driver,
 static int
 virNWFilterRollbackUpdateFilter(virNWFilterBindingDefPtr binding)
 {
-    const char *drvname = EBIPTABLES_DRIVER_ID;
+    const char *drvname = filter_tech_driver_name;
     int ifindex;
     virNWFilterTechDriverPtr techdriver;
 
@@ -865,7 +1101,7 @@ virNWFilterRollbackUpdateFilter(virNWFilterBindingDefPtr binding)
 static int
 virNWFilterTearOldFilter(virNWFilterBindingDefPtr binding)
 {
-    const char *drvname = EBIPTABLES_DRIVER_ID;
+    const char *drvname = filter_tech_driver_name;
     int ifindex;
     virNWFilterTechDriverPtr techdriver;
 
@@ -891,7 +1127,7 @@ virNWFilterTearOldFilter(virNWFilterBindingDefPtr binding)
 static int
 _virNWFilterTeardownFilter(const char *ifname)
 {
-    const char *drvname = EBIPTABLES_DRIVER_ID;
+    const char *drvname = filter_tech_driver_name;
     virNWFilterTechDriverPtr techdriver;
     techdriver = virNWFilterTechDriverForName(drvname);
 
@@ -914,6 +1150,9 @@ _virNWFilterTeardownFilter(const char *ifname)
 
     virNWFilterIPAddrMapDelIPAddr(ifname, NULL);
 
+    if (filterRefs)
+        virHashRemoveEntry(filterRefs, ifname);
+
     virNWFilterUnlockIface(ifname);
 
     return 0;
@@ -931,7 +1170,6 @@ virNWFilterTeardownFilter(virNWFilterBindingDefPtr binding)
 }
 
 enum {
-    STEP_APPLY_NEW,
     STEP_ROLLBACK,
     STEP_SWITCH,
     STEP_APPLY_CURRENT,
@@ -943,23 +1181,10 @@ virNWFilterBuildOne(virNWFilterDriverStatePtr driver,
                     virHashTablePtr skipInterfaces,
                     int step)
 {
-    bool skipIface;
     int ret = 0;
     VIR_DEBUG("Building filter for portdev=%s step=%d", binding->portdevname, step);
 
     switch (step) {
-    case STEP_APPLY_NEW:
-        ret = virNWFilterUpdateInstantiateFilter(driver,
-                                                 binding,
-                                                 &skipIface);
-        if (ret == 0 && skipIface) {
-            /* filter tree unchanged -- no update needed */
-            ret = virHashAddEntry(skipInterfaces,
-                                  binding->portdevname,
-                                  (void *)~0);
-        }
-        break;
-
     case STEP_ROLLBACK:
         if (!virHashLookup(skipInterfaces, binding->portdevname))
             ret = virNWFilterRollbackUpdateFilter(binding);
@@ -996,6 +1221,193 @@ virNWFilterBuildIter(virNWFilterBindingObjPtr binding, void *opaque)
                                data->skipInterfaces, data->step);
 }
 
+
+struct virNWFilterCollectData {
+    virNWFilterBindingObjPtr *bindings;
+    size_t nbindings;
+};
+
+static int
+virNWFilterCollectIter(virNWFilterBindingObjPtr binding, void *opaque)
+{
+    struct virNWFilterCollectData *data = opaque;
+    virNWFilterBindingObjPtr obj = virObjectRef(binding);
+
+    if (VIR_APPEND_ELEMENT(data->bindings, data->nbindings, obj) < 0) {
+        virObjectUnref(obj);
+        return -1;
+    }
+    return 0;
+}
+
+
+typedef struct _virNWFilterApplyCtx virNWFilterApplyCtx;
+struct _virNWFilterApplyCtx {
+    virMutex lock;
+    virCond cond;
+    size_t pending;
+};
+
+
+static void
+virNWFilterApplyJobRun(virNWFilterApplyJobPtr job)
+{
+    if ((job->rc = virNWFilterApplyRules(job->techdriver, job->binding,
+                                         job->ifindex, job->rules,
+                                         job->nrules, false)) < 0)
+        virErrorPreserveLast(&job->err);
+    else
+        virResetLastError();
+}
+
+
+static void
+virNWFilterApplyWorker(void *jobdata,
+                       void *opaque)
+{
+    virNWFilterApplyCtx *ctx = opaque;
+
+    virNWFilterApplyJobRun(jobdata);
+
+    virMutexLock(&ctx->lock);
+    if (--ctx->pending == 0)
+        virCondSignal(&ctx->cond);
+    virMutexUnlock(&ctx->lock);
+}
+
+
+/*
+ * Applies the rules expanded into @jobs. Interfaces are independent of
+ * each other, so with many of them the new rules are applied from a
+ * bounded pool of worker threads.
+ */
+static void
+virNWFilterApplyJobs(virNWFilterApplyJobPtr jobs,
+                     size_t njobs)
+{
+    virNWFilterApplyCtx ctx = { 0 };
+    virThreadPoolPtr workers = NULL;
+    size_t i = 0;
+
+    if (njobs < VIR_NWFILTER_APPLY_PARALLEL_MIN)
+        goto sequential;
+
+    if (virMutexInit(&ctx.lock) < 0)
+        goto sequential;
+
+    if (virCondInit(&ctx.cond) < 0) {
+        virMutexDestroy(&ctx.lock);
+        goto sequential;
+    }
+
+    if (!(workers = virThreadPoolNew(0, MIN(njobs, VIR_NWFILTER_APPLY_WORKERS),
+                                     0, virNWFilterApplyWorker, &ctx))) {
+        virResetLastError();
+        virCondDestroy(&ctx.cond);
+        virMutexDestroy(&ctx.lock);
+        goto sequential;
+    }
+
+    virMutexLock(&ctx.lock);
+    for (; i < njobs; i++) {
+        if (virThreadPoolSendJob(workers, 0, &jobs[i]) < 0)
+            break;
+        ctx.pending++;
+    }
+
+    while (ctx.pending > 0)
+        ignore_value(virCondWait(&ctx.cond, &ctx.lock));
+    virMutexUnlock(&ctx.lock);
+
+    virThreadPoolFree(workers);
+    virCondDestroy(&ctx.cond);
+    virMutexDestroy(&ctx.lock);
+
+ sequential:
+    /* whatever couldn't be handed over to the workers */
+    for (; i < njobs; i++)
+        virNWFilterApplyJobRun(&jobs[i]);
+}
+
+
+/*
+ * Instantiates the new filters on all interfaces affected by them.
+ * Interfaces whose filter tree doesn't reference any of the changed
+ * filters, or whose rules come out the same, are added to
+ * @skipInterfaces and left alone.
+ */
+static int
+virNWFilterBuildNew(virNWFilterDriverStatePtr driver,
+                    virHashTablePtr skipInterfaces)
+{
+    struct virNWFilterCollectData data = { 0 };
+    VIR_AUTOSTRINGLIST changed = NULL;
+    virNWFilterApplyJobPtr jobs = NULL;
+    size_t njobs = 0;
+    size_t i;
+    int ret = 0;
+
+    if (virNWFilterBindingObjListForEach(driver->bindings,
+                                         virNWFilterCollectIter,
+                                         &data) < 0) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    jobs = g_new0(virNWFilterApplyJob, data.nbindings);
+
+    /* keep others from (re)instantiating filters until all new rules
+     * are in place */
+    virMutexLock(&updateMutex);
+
+    changed = virNWFilterObjListGetChangedNames(driver->nwfilters);
+
+    for (i = 0; i < data.nbindings; i++) {
+        virNWFilterBindingDefPtr def = virNWFilterBindingObjGetDef(data.bindings[i]);
+        bool skipIface = true;
+
+        if (!virNWFilterRefsUnaffected(def->portdevname, changed)) {
+            if (virNWFilterUpdateInstantiateFilter(driver, def, &skipIface,
+                                                   &jobs[njobs]) < 0) {
+                ret = -1;
+                continue;
+            }
+        } else {
+            VIR_DEBUG("Filters of portdev=%s are not affected",
+                      def->portdevname);
+        }
+
+        if (skipIface) {
+            /* filter tree unchanged -- no update needed */
+            if (virHashAddEntry(skipInterfaces, def->portdevname,
+                                (void *)~0) < 0)
+                ret = -1;
+        } else if (jobs[njobs].binding) {
+            njobs++;
+        }
+    }
+
+    virNWFilterApplyJobs(jobs, njobs);
+
+    for (i = 0; i < njobs; i++) {
+        if (jobs[i].rc < 0 && ret == 0) {
+            virErrorRestore(&jobs[i].err);
+            ret = -1;
+        }
+    }
+
+    virMutexUnlock(&updateMutex);
+
+ cleanup:
+    for (i = 0; i < njobs; i++)
+        virNWFilterApplyJobClear(&jobs[i]);
+    g_free(jobs);
+    for (i = 0; i < data.nbindings; i++)
+        virObjectUnref(data.bindings[i]);
+    g_free(data.bindings);
+    return ret;
+}
+
 int
 virNWFilterBuildAll(virNWFilterDriverStatePtr driver,
                     bool newFilters)
@@ -1011,10 +1423,7 @@ virNWFilterBuildAll(virNWFilterDriverStatePtr driver,
         if (!(data.skipInterfaces = virHashCreate(0, NULL)))
             return -1;
 
-        data.step = STEP_APPLY_NEW;
-        if (virNWFilterBindingObjListForEach(driver->bindings,
-                                             virNWFilterBuildIter,
-                                             &data) < 0)
+        if (virNWFilterBuildNew(driver, data.skipInterfaces) < 0)
             ret = -1;
 
         if (ret == -1) {
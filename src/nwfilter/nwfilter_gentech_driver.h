@@ -28,7 +28,7 @@
 
 virNWFilterTechDriverPtr virNWFilterTechDriverForName(const char *name);
 
-int virNWFilterTechDriversInit(bool privileged);
+int virNWFilterTechDriversInit(bool privileged, const char *name);
 void virNWFilterTechDriversShutdown(void);
 
 enum instCase {
@@ -39,9 +39,6 @@ enum instCase {
 
 int virNWFilterInstantiateFilter(virNWFilterDriverStatePtr driver,
                                  virNWFilterBindingDefPtr binding);
-int virNWFilterUpdateInstantiateFilter(virNWFilterDriverStatePtr driver,
-                                       virNWFilterBindingDefPtr binding,
-                                       bool *skipIface);
 
 int virNWFilterInstantiateFilterLate(virNWFilterDriverStatePtr driver,
                                      virNWFilterBindingDefPtr binding,
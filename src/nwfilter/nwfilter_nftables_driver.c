@@ -0,0 +1,2322 @@
+/*
+ * nwfilter_nftables_driver.c: driver for nftables filtering
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * All rules live in a single table of the bridge family. Every
+ * interface gets the root chains
+ *
+ *   I:<ifname>   layer 2, traffic sent by the guest
+ *   O:<ifname>   layer 2, traffic sent to the guest
+ *   FI:<ifname>  IP, traffic forwarded from the guest
+ *   FO:<ifname>  IP, traffic forwarded to the guest
+ *   HI:<ifname>  IP, traffic from the guest to the host
+ *
+ * plus one sub chain per filter with a chain suffix, named
+ * <root>:<ifname>:<suffix>. The base chains dispatch to the root
+ * chains through verdict maps keyed by interface name, so linking
+ * an interface is a single map element instead of a rule that has
+ * to be looked up in a linear rule set.
+ *
+ * Whatever is changed for an interface is submitted as one nftables
+ * transaction, which the kernel applies atomically: packets either
+ * see the complete old or the complete new rule set of a guest.
+ */
+
+#include <config.h>
+
+#if WITH_NFTABLES
+# include <nftables/libnftables.h>
+#endif
+
+#include "internal.h"
+
+#include "virbuffer.h"
+#include "viralloc.h"
+#include "virlog.h"
+#include "virerror.h"
+#include "virhash.h"
+#include "virmacaddr.h"
+#include "virsocketaddr.h"
+#include "virstring.h"
+#include "virthread.h"
+#include "nwfilter_conf.h"
+#include "nwfilter_nftables_driver.h"
+
+#define LIBVIRT_NWFILTER_NFTABLES_DRIVERPRIV_H_ALLOW
+#include "nwfilter_nftables_driverpriv.h"
+
+#define VIR_FROM_THIS VIR_FROM_NWFILTER
+
+VIR_LOG_INIT("nwfilter.nwfilter_nftables_driver");
+
+#define NFT_TABLE "bridge libvirt_nwfilter"
+
+/* nftables limits comments to 128 bytes including the terminating NUL */
+#define NFT_MAX_COMMENT_LENGTH 127
+
+#define NFT_ETHERTYPE_RARP "0x8035"
+
+typedef enum {
+    NFTABLES_ROOT_IN = 0,
+    NFTABLES_ROOT_OUT,
+    NFTABLES_ROOT_FWD_IN,
+    NFTABLES_ROOT_FWD_OUT,
+    NFTABLES_ROOT_HOST_IN,
+
+    NFTABLES_ROOT_LAST
+} nftablesRootChain;
+
+static const struct {
+    const char *prefix;
+    const char *map;
+    const char *hook;
+    int priority;
+    const char *ifmatch;
+} nftablesRoots[NFTABLES_ROOT_LAST] = {
+    /* same priorities as the ebtables nat table */
+    [NFTABLES_ROOT_IN] = { "I", "in", "prerouting", -300, "iifname" },
+    [NFTABLES_ROOT_OUT] = { "O", "out", "postrouting", 300, "oifname" },
+    [NFTABLES_ROOT_FWD_IN] = { "FI", "fwd_in", "forward", 0, "iifname" },
+    [NFTABLES_ROOT_FWD_OUT] = { "FO", "fwd_out", "forward", 0, "oifname" },
+    [NFTABLES_ROOT_HOST_IN] = { "HI", "host_in", "input", 0, "iifname" },
+};
+
+/* Matches selecting the traffic jumping to a layer 2 sub chain,
+ * looked up by prefix of the chain suffix like ebtables does. */
+static const struct {
+    const char *name;
+    const char *match;
+} nftablesSubChainProtos[] = {
+    { "ipv4", " ether type ip" },
+    { "ipv6", " ether type ip6" },
+    { "arp", " ether type arp" },
+    { "rarp", " ether type " NFT_ETHERTYPE_RARP },
+    { "vlan", " ether type vlan" },
+    { "stp", " ether daddr " NWFILTER_MAC_BGA },
+    { "mac", "" },
+};
+
+typedef enum {
+    NFTABLES_VALUE_HEX = (1 << 0), /* print numbers in hex */
+    NFTABLES_VALUE_RAW = (1 << 1), /* addresses as integers for raw payload */
+    NFTABLES_VALUE_SET = (1 << 2), /* the match accepts a set of values */
+} nftablesValueFlags;
+
+typedef struct _nftablesRuleCtx nftablesRuleCtx;
+typedef nftablesRuleCtx *nftablesRuleCtxPtr;
+struct _nftablesRuleCtx {
+    virNWFilterVarCombIterPtr vars;
+
+    /* variable whose values are matched as an anonymous set */
+    const virNWFilterVarAccess *setVar;
+    const virNWFilterVarValue *setValue;
+    size_t setUses;
+    bool setRefused;
+};
+
+/* What is instantiated on an interface */
+typedef struct _nftablesIface nftablesIface;
+typedef nftablesIface *nftablesIfacePtr;
+struct _nftablesIface {
+    char **chains;  /* sub chains */
+    char *rules;    /* NULL if not known, e.g. after a daemon restart */
+
+    /* kept between applyNewRules and tearOldRules for rolling back */
+    bool hasOld;
+    char **oldChains;
+    char *oldRules;
+};
+
+static virMutex nftablesLock = VIR_MUTEX_INITIALIZER;
+static virHashTablePtr nftablesIfaces;
+static virBufferPtr nftablesDryRunBuf;
+static char *nftablesBaseRules;
+
+#if WITH_NFTABLES
+static struct nft_ctx *nftablesCtx;
+#endif
+
+
+void
+nftablesDriverSetDryRun(virBufferPtr buf)
+{
+    nftablesDryRunBuf = buf;
+}
+
+
+static void
+nftablesIfaceFree(void *opaque)
+{
+    nftablesIfacePtr iface = opaque;
+
+    if (!iface)
+        return;
+
+    virStringListFree(iface->chains);
+    g_free(iface->rules);
+    virStringListFree(iface->oldChains);
+    g_free(iface->oldRules);
+    g_free(iface);
+}
+
+
+/* must be called with nftablesLock held */
+static nftablesIfacePtr
+nftablesIfaceGet(const char *ifname)
+{
+    nftablesIfacePtr iface;
+
+    if (!nftablesIfaces &&
+        !(nftablesIfaces = virHashNew(nftablesIfaceFree)))
+        return NULL;
+
+    if ((iface = virHashLookup(nftablesIfaces, ifname)))
+        return iface;
+
+    iface = g_new0(nftablesIface, 1);
+    iface->rules = g_strdup("");
+    if (virHashAddEntry(nftablesIfaces, ifname, iface) < 0) {
+        nftablesIfaceFree(iface);
+        return NULL;
+    }
+
+    return iface;
+}
+
+
+static int
+nftablesCheckIfname(const char *ifname)
+{
+    /* interface names end up in quoted strings of the rule set */
+    if (strchr(ifname, '"') || strchr(ifname, ':')) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                       _("interface name '%s' cannot be filtered by nftables"),
+                       ifname);
+        return -1;
+    }
+    return 0;
+}
+
+
+/* must be called with nftablesLock held */
+static int
+nftablesRun(const char *cmds)
+{
+    if (nftablesDryRunBuf) {
+        virBufferAdd(nftablesDryRunBuf, cmds, -1);
+        return 0;
+    }
+
+#if WITH_NFTABLES
+    {
+        g_autofree char *script = NULL;
+        int rc;
+
+        if (!nftablesCtx) {
+            virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                           _("nftables driver is not initialized"));
+            return -1;
+        }
+
+        /* recreating the table and the base chains is cheap and
+         * survives somebody flushing the ruleset behind our back */
+        script = g_strdup_printf("%s%s", nftablesBaseRules, cmds);
+
+        VIR_DEBUG("Applying nftables rules:\n%s", script);
+
+        rc = nft_run_cmd_from_buffer(nftablesCtx, script);
+        ignore_value(nft_ctx_get_output_buffer(nftablesCtx));
+        if (rc != 0) {
+            virReportError(VIR_ERR_OPERATION_FAILED,
+                           _("failed to apply nftables rules: %s"),
+                           NULLSTR(nft_ctx_get_error_buffer(nftablesCtx)));
+            return -1;
+        }
+        ignore_value(nft_ctx_get_error_buffer(nftablesCtx));
+    }
+
+    return 0;
+#else /* !WITH_NFTABLES */
+    virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                   _("nftables support was not compiled in"));
+    return -1;
+#endif /* !WITH_NFTABLES */
+}
+
+
+static char *
+nftablesFormatBaseRules(void)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    size_t i;
+
+    virBufferAddLit(&buf, "add table " NFT_TABLE "\n");
+
+    for (i = 0; i < NFTABLES_ROOT_LAST; i++)
+        virBufferAsprintf(&buf,
+                          "add map " NFT_TABLE " %s "
+                          "{ type ifname : verdict ; }\n",
+                          nftablesRoots[i].map);
+
+    for (i = 0; i < NFTABLES_ROOT_LAST; i++) {
+        /* the forward hook is shared by two root chains */
+        if (i > 0 && STREQ(nftablesRoots[i].hook, nftablesRoots[i - 1].hook))
+            continue;
+        virBufferAsprintf(&buf,
+                          "add chain " NFT_TABLE " %s "
+                          "{ type filter hook %s priority %d ; }\n"
+                          "flush chain " NFT_TABLE " %s\n",
+                          nftablesRoots[i].hook,
+                          nftablesRoots[i].hook, nftablesRoots[i].priority,
+                          nftablesRoots[i].hook);
+    }
+
+    for (i = 0; i < NFTABLES_ROOT_LAST; i++)
+        virBufferAsprintf(&buf,
+                          "add rule " NFT_TABLE " %s %s vmap @%s\n",
+                          nftablesRoots[i].hook,
+                          nftablesRoots[i].ifmatch,
+                          nftablesRoots[i].map);
+
+    return virBufferContentAndReset(&buf);
+}
+
+
+/*
+ * Formats the commands replacing whatever is instantiated on @ifname
+ * by @rules, which use the sub chains @newChains. Sub chains in
+ * @oldChains which are no longer needed are removed.
+ */
+static void
+nftablesFormatReplace(virBufferPtr buf,
+                      const char *ifname,
+                      char **oldChains,
+                      char **newChains,
+                      const char *rules)
+{
+    size_t i;
+
+    for (i = 0; i < NFTABLES_ROOT_LAST; i++)
+        virBufferAsprintf(buf,
+                          "add chain " NFT_TABLE " \"%s:%s\"\n"
+                          "flush chain " NFT_TABLE " \"%s:%s\"\n",
+                          nftablesRoots[i].prefix, ifname,
+                          nftablesRoots[i].prefix, ifname);
+
+    for (i = 0; oldChains && oldChains[i]; i++) {
+        if (virStringListHasString((const char **)newChains, oldChains[i]))
+            continue;
+        virBufferAsprintf(buf,
+                          "add chain " NFT_TABLE " \"%s\"\n"
+                          "flush chain " NFT_TABLE " \"%s\"\n"
+                          "delete chain " NFT_TABLE " \"%s\"\n",
+                          oldChains[i], oldChains[i], oldChains[i]);
+    }
+
+    for (i = 0; newChains && newChains[i]; i++)
+        virBufferAsprintf(buf,
+                          "add chain " NFT_TABLE " \"%s\"\n"
+                          "flush chain " NFT_TABLE " \"%s\"\n",
+                          newChains[i], newChains[i]);
+
+    virBufferAdd(buf, rules, -1);
+
+    /* user defined ebtables chains have an ACCEPT policy */
+    for (i = 0; newChains && newChains[i]; i++)
+        virBufferAsprintf(buf,
+                          "add rule " NFT_TABLE " \"%s\" accept\n",
+                          newChains[i]);
+
+    for (i = 0; i < NFTABLES_ROOT_LAST; i++)
+        virBufferAsprintf(buf,
+                          "add element " NFT_TABLE " %s "
+                          "{ \"%s\" : jump \"%s:%s\" }\n",
+                          nftablesRoots[i].map, ifname,
+                          nftablesRoots[i].prefix, ifname);
+}
+
+
+static void
+nftablesFormatTeardown(virBufferPtr buf,
+                       const char *ifname,
+                       char **chains)
+{
+    size_t i;
+
+    /* adding first makes deleting work whether they exist or not */
+    for (i = 0; i < NFTABLES_ROOT_LAST; i++)
+        virBufferAsprintf(buf,
+                          "add chain " NFT_TABLE " \"%s:%s\"\n"
+                          "add element " NFT_TABLE " %s "
+                          "{ \"%s\" : jump \"%s:%s\" }\n"
+                          "delete element " NFT_TABLE " %s { \"%s\" }\n"
+                          "flush chain " NFT_TABLE " \"%s:%s\"\n",
+                          nftablesRoots[i].prefix, ifname,
+                          nftablesRoots[i].map, ifname,
+                          nftablesRoots[i].prefix, ifname,
+                          nftablesRoots[i].map, ifname,
+                          nftablesRoots[i].prefix, ifname);
+
+    for (i = 0; chains && chains[i]; i++)
+        virBufferAsprintf(buf,
+                          "add chain " NFT_TABLE " \"%s\"\n"
+                          "flush chain " NFT_TABLE " \"%s\"\n"
+                          "delete chain " NFT_TABLE " \"%s\"\n",
+                          chains[i], chains[i], chains[i]);
+
+    for (i = 0; i < NFTABLES_ROOT_LAST; i++)
+        virBufferAsprintf(buf,
+                          "delete chain " NFT_TABLE " \"%s:%s\"\n",
+                          nftablesRoots[i].prefix, ifname);
+}
+
+
+/*
+ * Atomically replaces the rules of @ifname by @rules using the sub
+ * chains @chains, both of which are owned by @iface on success.
+ * Must be called with nftablesLock held.
+ */
+static int
+nftablesIfaceReplace(const char *ifname,
+                     nftablesIfacePtr iface,
+                     char ***chains,
+                     char **rules)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+
+    nftablesFormatReplace(&buf, ifname, iface->chains, *chains, *rules);
+
+    if (nftablesRun(virBufferCurrentContent(&buf)) < 0)
+        return -1;
+
+    virStringListFree(iface->chains);
+    g_free(iface->rules);
+    iface->chains = g_steal_pointer(chains);
+    iface->rules = g_steal_pointer(rules);
+
+    return 0;
+}
+
+
+static void
+nftablesIfaceDropOld(nftablesIfacePtr iface)
+{
+    iface->hasOld = false;
+    g_clear_pointer(&iface->oldChains, virStringListFree);
+    g_clear_pointer(&iface->oldRules, g_free);
+}
+
+
+/*
+ * Replaces the rules of @ifname, remembering the ones in place
+ * for nftablesTearNewRules if @keepOld is set.
+ */
+static int
+nftablesApplyIface(const char *ifname,
+                   char ***chains,
+                   char **rules,
+                   bool keepOld)
+{
+    nftablesIfacePtr iface;
+    char **oldChains = NULL;
+    char *oldRules = NULL;
+    int ret = -1;
+
+    virMutexLock(&nftablesLock);
+
+    if (!(iface = nftablesIfaceGet(ifname)))
+        goto cleanup;
+
+    /* a second update before tearOldRules keeps the first state */
+    if (keepOld && !iface->hasOld) {
+        oldChains = g_strdupv(iface->chains);
+        oldRules = g_strdup(iface->rules);
+    }
+
+    if (nftablesIfaceReplace(ifname, iface, chains, rules) < 0) {
+        virStringListFree(oldChains);
+        g_free(oldRules);
+        goto cleanup;
+    }
+
+    if (!keepOld) {
+        nftablesIfaceDropOld(iface);
+    } else if (!iface->hasOld) {
+        iface->hasOld = true;
+        iface->oldChains = oldChains;
+        iface->oldRules = oldRules;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&nftablesLock);
+    return ret;
+}
+
+
+static char *
+nftablesFormatIPv4Raw(const char *str)
+{
+    virSocketAddr addr;
+
+    if (virSocketAddrParseIPv4(&addr, str) < 0)
+        return NULL;
+
+    return g_strdup_printf("0x%08x", ntohl(addr.data.inet4.sin_addr.s_addr));
+}
+
+
+static char *
+nftablesFormatMACRaw(const char *str)
+{
+    virMacAddr mac;
+
+    if (virMacAddrParse(str, &mac) < 0) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("invalid MAC address '%s'"), str);
+        return NULL;
+    }
+
+    return g_strdup_printf("0x%02x%02x%02x%02x%02x%02x",
+                           mac.addr[0], mac.addr[1], mac.addr[2],
+                           mac.addr[3], mac.addr[4], mac.addr[5]);
+}
+
+
+static char *
+nftablesFormatString(enum attrDatatype datatype,
+                     const char *str,
+                     unsigned int flags)
+{
+    if (flags & NFTABLES_VALUE_RAW) {
+        switch (datatype) {
+        case DATATYPE_IPADDR:
+            return nftablesFormatIPv4Raw(str);
+        case DATATYPE_MACADDR:
+        case DATATYPE_MACMASK:
+            return nftablesFormatMACRaw(str);
+        default:
+            break;
+        }
+    }
+
+    return g_strdup(str);
+}
+
+
+static char *
+nftablesFormatLiteral(nwItemDescPtr item,
+                      unsigned int flags)
+{
+    char macaddr[VIR_MAC_STRING_BUFLEN];
+    bool asHex = !!(flags & NFTABLES_VALUE_HEX);
+
+    switch (item->datatype) {
+    case DATATYPE_IPADDR:
+    case DATATYPE_IPV6ADDR:
+        return virSocketAddrFormat(&item->u.ipaddr);
+
+    case DATATYPE_MACADDR:
+    case DATATYPE_MACMASK:
+        return g_strdup(virMacAddrFormat(&item->u.macaddr, macaddr));
+
+    case DATATYPE_IPV6MASK:
+    case DATATYPE_IPMASK:
+        return g_strdup_printf("%d", item->u.u8);
+
+    case DATATYPE_UINT32:
+    case DATATYPE_UINT32_HEX:
+        return g_strdup_printf(asHex ? "0x%x" : "%u", item->u.u32);
+
+    case DATATYPE_UINT16:
+    case DATATYPE_UINT16_HEX:
+        return g_strdup_printf(asHex ? "0x%x" : "%d", item->u.u16);
+
+    case DATATYPE_UINT8:
+    case DATATYPE_UINT8_HEX:
+        return g_strdup_printf(asHex ? "0x%x" : "%d", item->u.u8);
+
+    case DATATYPE_IPSETNAME:
+    case DATATYPE_IPSETFLAGS:
+    case DATATYPE_STRING:
+    case DATATYPE_STRINGCOPY:
+    case DATATYPE_BOOLEAN:
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Cannot print data type %x"), item->datatype);
+        return NULL;
+    case DATATYPE_LAST:
+    default:
+        virReportEnumRangeError(virNWFilterAttrDataType, item->datatype);
+        return NULL;
+    }
+}
+
+
+static char *
+nftablesFormatSet(const virNWFilterVarValue *value,
+                  enum attrDatatype datatype,
+                  unsigned int flags)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autofree char *elems = NULL;
+    unsigned int card = virNWFilterVarValueGetCardinality(value);
+    size_t nelems = 0;
+    size_t i, j;
+
+    for (i = 0; i < card; i++) {
+        const char *val = virNWFilterVarValueGetNthValue(value, i);
+        g_autofree char *elem = NULL;
+
+        /* sets cannot hold an element twice */
+        for (j = 0; j < i; j++) {
+            if (STREQ(val, virNWFilterVarValueGetNthValue(value, j)))
+                break;
+        }
+        if (j < i)
+            continue;
+
+        if (!(elem = nftablesFormatString(datatype, val, flags)))
+            return NULL;
+
+        if (nelems++ > 0)
+            virBufferAddLit(&buf, ", ");
+        virBufferAdd(&buf, elem, -1);
+    }
+
+    elems = virBufferContentAndReset(&buf);
+    if (nelems == 1)
+        return g_steal_pointer(&elems);
+
+    return g_strdup_printf("{ %s }", elems);
+}
+
+
+static char *
+nftablesFormatValue(nftablesRuleCtxPtr ctx,
+                    nwItemDescPtr item,
+                    unsigned int flags)
+{
+    g_autofree char *str = NULL;
+    const char *val;
+
+    if (!(item->flags & NWFILTER_ENTRY_ITEM_FLAG_HAS_VAR)) {
+        if (!(str = nftablesFormatLiteral(item, flags)))
+            return NULL;
+        return nftablesFormatString(item->datatype, str, flags);
+    }
+
+    if (ctx->setVar &&
+        virNWFilterVarAccessEqual(item->varAccess, ctx->setVar)) {
+        if (flags & NFTABLES_VALUE_SET) {
+            ctx->setUses++;
+            return nftablesFormatSet(ctx->setValue, item->datatype, flags);
+        }
+        /* the caller falls back to one rule per value */
+        ctx->setRefused = true;
+    }
+
+    if (!(val = virNWFilterVarCombIterGetVarValue(ctx->vars, item->varAccess)))
+        return NULL;
+
+    return nftablesFormatString(item->datatype, val, flags);
+}
+
+
+static int
+nftablesAddMatch(virBufferPtr rb,
+                 nftablesRuleCtxPtr ctx,
+                 const char *key,
+                 nwItemDescPtr item,
+                 unsigned int flags)
+{
+    g_autofree char *val = NULL;
+
+    if (!HAS_ENTRY_ITEM(item))
+        return 0;
+
+    if (!(val = nftablesFormatValue(ctx, item, flags)))
+        return -1;
+
+    virBufferAsprintf(rb, " %s %s%s",
+                      key, ENTRY_WANT_NEG_SIGN(item) ? "!= " : "", val);
+    return 0;
+}
+
+
+static int
+nftablesAddRangeMatch(virBufferPtr rb,
+                      nftablesRuleCtxPtr ctx,
+                      const char *key,
+                      nwItemDescPtr lo,
+                      nwItemDescPtr hi)
+{
+    g_autofree char *loval = NULL;
+    g_autofree char *hival = NULL;
+
+    if (!HAS_ENTRY_ITEM(lo))
+        return 0;
+
+    if (!HAS_ENTRY_ITEM(hi))
+        return nftablesAddMatch(rb, ctx, key, lo, NFTABLES_VALUE_SET);
+
+    if (!(loval = nftablesFormatValue(ctx, lo, 0)) ||
+        !(hival = nftablesFormatValue(ctx, hi, 0)))
+        return -1;
+
+    virBufferAsprintf(rb, " %s %s%s-%s",
+                      key, ENTRY_WANT_NEG_SIGN(lo) ? "!= " : "", loval, hival);
+    return 0;
+}
+
+
+static int
+nftablesAddPrefixMatch(virBufferPtr rb,
+                       nftablesRuleCtxPtr ctx,
+                       const char *key,
+                       nwItemDescPtr addr,
+                       nwItemDescPtr prefix)
+{
+    g_autofree char *addrval = NULL;
+    g_autofree char *prefixval = NULL;
+
+    if (!HAS_ENTRY_ITEM(addr))
+        return 0;
+
+    if (!HAS_ENTRY_ITEM(prefix))
+        return nftablesAddMatch(rb, ctx, key, addr, NFTABLES_VALUE_SET);
+
+    if (!(addrval = nftablesFormatValue(ctx, addr, 0)) ||
+        !(prefixval = nftablesFormatValue(ctx, prefix, 0)))
+        return -1;
+
+    virBufferAsprintf(rb, " %s %s%s/%s",
+                      key, ENTRY_WANT_NEG_SIGN(addr) ? "!= " : "",
+                      addrval, prefixval);
+    return 0;
+}
+
+
+/*
+ * Matches a MAC address under a mask, either as ethernet address or,
+ * with NFTABLES_VALUE_RAW, as 48 bit raw payload.
+ */
+static int
+nftablesAddMACMaskMatch(virBufferPtr rb,
+                        nftablesRuleCtxPtr ctx,
+                        const char *key,
+                        nwItemDescPtr addr,
+                        nwItemDescPtr mask,
+                        unsigned int flags)
+{
+    g_autofree char *addrval = NULL;
+    g_autofree char *maskval = NULL;
+    unsigned long long a;
+    unsigned long long m;
+    const char *neg;
+
+    if (!HAS_ENTRY_ITEM(addr))
+        return 0;
+
+    if (!HAS_ENTRY_ITEM(mask))
+        return nftablesAddMatch(rb, ctx, key, addr,
+                                flags | NFTABLES_VALUE_SET);
+
+    if (!(addrval = nftablesFormatValue(ctx, addr, NFTABLES_VALUE_RAW)) ||
+        !(maskval = nftablesFormatValue(ctx, mask, NFTABLES_VALUE_RAW)))
+        return -1;
+
+    if (virStrToLong_ull(addrval, NULL, 16, &a) < 0 ||
+        virStrToLong_ull(maskval, NULL, 16, &m) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("cannot parse MAC address '%s' or mask '%s'"),
+                       addrval, maskval);
+        return -1;
+    }
+
+    /* nftables refuses values with bits outside of the mask */
+    a &= m;
+    neg = ENTRY_WANT_NEG_SIGN(addr) ? "!=" : "==";
+
+    if (flags & NFTABLES_VALUE_RAW) {
+        virBufferAsprintf(rb, " %s & 0x%012llx %s 0x%012llx", key, m, neg, a);
+    } else {
+        virBufferAsprintf(rb,
+                          " %s & %02llx:%02llx:%02llx:%02llx:%02llx:%02llx "
+                          "%s %02llx:%02llx:%02llx:%02llx:%02llx:%02llx",
+                          key,
+                          (m >> 40) & 0xff, (m >> 32) & 0xff, (m >> 24) & 0xff,
+                          (m >> 16) & 0xff, (m >> 8) & 0xff, m & 0xff,
+                          neg,
+                          (a >> 40) & 0xff, (a >> 32) & 0xff, (a >> 24) & 0xff,
+                          (a >> 16) & 0xff, (a >> 8) & 0xff, a & 0xff);
+    }
+
+    return 0;
+}
+
+
+/* Matches an IPv4 address with an optional prefix length as raw payload */
+static int
+nftablesAddRawIPMatch(virBufferPtr rb,
+                      nftablesRuleCtxPtr ctx,
+                      const char *key,
+                      nwItemDescPtr addr,
+                      nwItemDescPtr prefix)
+{
+    g_autofree char *addrval = NULL;
+    g_autofree char *prefixval = NULL;
+    unsigned long long a;
+    unsigned int p;
+    unsigned int m;
+
+    if (!HAS_ENTRY_ITEM(addr))
+        return 0;
+
+    if (!HAS_ENTRY_ITEM(prefix))
+        return nftablesAddMatch(rb, ctx, key, addr,
+                                NFTABLES_VALUE_RAW | NFTABLES_VALUE_SET);
+
+    if (!(addrval = nftablesFormatValue(ctx, addr, NFTABLES_VALUE_RAW)) ||
+        !(prefixval = nftablesFormatValue(ctx, prefix, 0)))
+        return -1;
+
+    if (virStrToLong_ull(addrval, NULL, 16, &a) < 0 ||
+        virStrToLong_uip(prefixval, NULL, 10, &p) < 0 || p > 32) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("cannot parse IP address '%s' or prefix '%s'"),
+                       addrval, prefixval);
+        return -1;
+    }
+
+    m = p == 0 ? 0 : 0xffffffffU << (32 - p);
+
+    virBufferAsprintf(rb, " %s & 0x%08x %s 0x%08x",
+                      key, m, ENTRY_WANT_NEG_SIGN(addr) ? "!=" : "==",
+                      (unsigned int)a & m);
+    return 0;
+}
+
+
+static void
+nftablesAddComment(virBufferPtr rb,
+                   const char *comment)
+{
+    g_autofree char *str = g_strndup(comment, NFT_MAX_COMMENT_LENGTH);
+    g_autofree char *quoted = virStringReplace(str, "\"", "'");
+
+    virBufferAsprintf(rb, " comment \"%s\"", quoted);
+}
+
+
+static const char *
+nftablesVerdict(virNWFilterRuleActionType action,
+                const char *acceptVerdict,
+                bool layer2)
+{
+    switch (action) {
+    case VIR_NWFILTER_RULE_ACTION_DROP:
+        return "drop";
+    case VIR_NWFILTER_RULE_ACTION_ACCEPT:
+        return acceptVerdict;
+    case VIR_NWFILTER_RULE_ACTION_REJECT:
+        /* like ebtables, reject is not available at layer 2 */
+        return layer2 ? "drop" : "reject";
+    case VIR_NWFILTER_RULE_ACTION_RETURN:
+        return "return";
+    case VIR_NWFILTER_RULE_ACTION_CONTINUE:
+        return "continue";
+    case VIR_NWFILTER_RULE_ACTION_LAST:
+        break;
+    }
+
+    return "drop";
+}
+
+
+static void
+nftablesEmitRule(virBufferPtr buf,
+                 nftablesRuleCtxPtr ctx,
+                 const char *chain,
+                 virBufferPtr rb,
+                 const char *verdict)
+{
+    /* a set may only be matched once, otherwise the rule would
+     * match combinations of values the filter doesn't list */
+    if (ctx->setUses > 1)
+        ctx->setRefused = true;
+
+    virBufferAsprintf(buf, "add rule " NFT_TABLE " \"%s\"%s %s\n",
+                      chain, virBufferCurrentContent(rb), verdict);
+}
+
+
+static int
+nftablesHandleEthHdr(virBufferPtr rb,
+                     nftablesRuleCtxPtr ctx,
+                     ethHdrDataDefPtr ethHdr,
+                     bool reverse)
+{
+    if (nftablesAddMACMaskMatch(rb, ctx, reverse ? "ether daddr" : "ether saddr",
+                                &ethHdr->dataSrcMACAddr,
+                                &ethHdr->dataSrcMACMask, 0) < 0 ||
+        nftablesAddMACMaskMatch(rb, ctx, reverse ? "ether saddr" : "ether daddr",
+                                &ethHdr->dataDstMACAddr,
+                                &ethHdr->dataDstMACMask, 0) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+nftablesHandleICMPv6(virBufferPtr rb,
+                     nftablesRuleCtxPtr ctx,
+                     ipv6HdrFilterDefPtr ipv6Hdr)
+{
+    g_autofree char *typeLo = NULL;
+    g_autofree char *typeHi = NULL;
+    g_autofree char *codeLo = NULL;
+    g_autofree char *codeHi = NULL;
+    bool hasCode = HAS_ENTRY_ITEM(&ipv6Hdr->dataICMPCodeStart) ||
+                   HAS_ENTRY_ITEM(&ipv6Hdr->dataICMPCodeEnd);
+    bool neg = ENTRY_WANT_NEG_SIGN(&ipv6Hdr->dataICMPTypeStart);
+
+    if (!HAS_ENTRY_ITEM(&ipv6Hdr->dataICMPTypeStart) &&
+        !HAS_ENTRY_ITEM(&ipv6Hdr->dataICMPTypeEnd) && !hasCode)
+        return 0;
+
+    /* ebtables negates type and code as a whole */
+    if (neg && hasCode) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                       _("nftables cannot match a negated ICMPv6 type "
+                         "together with a code"));
+        return -1;
+    }
+
+    /* missing bounds default like they do with ebtables */
+    if (HAS_ENTRY_ITEM(&ipv6Hdr->dataICMPTypeStart)) {
+        if (!(typeLo = nftablesFormatValue(ctx, &ipv6Hdr->dataICMPTypeStart, 0)))
+            return -1;
+    } else {
+        typeLo = g_strdup("0");
+    }
+
+    if (HAS_ENTRY_ITEM(&ipv6Hdr->dataICMPTypeEnd)) {
+        if (!(typeHi = nftablesFormatValue(ctx, &ipv6Hdr->dataICMPTypeEnd, 0)))
+            return -1;
+    } else {
+        typeHi = g_strdup(HAS_ENTRY_ITEM(&ipv6Hdr->dataICMPTypeStart) ?
+                          typeLo : "255");
+    }
+
+    if (STREQ(typeLo, typeHi))
+        virBufferAsprintf(rb, " icmpv6 type %s%s", neg ? "!= " : "", typeLo);
+    else
+        virBufferAsprintf(rb, " icmpv6 type %s%s-%s",
+                          neg ? "!= " : "", typeLo, typeHi);
+
+    if (!hasCode)
+        return 0;
+
+    if (HAS_ENTRY_ITEM(&ipv6Hdr->dataICMPCodeStart)) {
+        if (!(codeLo = nftablesFormatValue(ctx, &ipv6Hdr->dataICMPCodeStart, 0)))
+            return -1;
+    } else {
+        codeLo = g_strdup("0");
+    }
+
+    if (HAS_ENTRY_ITEM(&ipv6Hdr->dataICMPCodeEnd)) {
+        if (!(codeHi = nftablesFormatValue(ctx, &ipv6Hdr->dataICMPCodeEnd, 0)))
+            return -1;
+    } else {
+        codeHi = g_strdup(HAS_ENTRY_ITEM(&ipv6Hdr->dataICMPCodeStart) ?
+                          codeLo : "255");
+    }
+
+    if (STREQ(codeLo, codeHi))
+        virBufferAsprintf(rb, " icmpv6 code %s", codeLo);
+    else
+        virBufferAsprintf(rb, " icmpv6 code %s-%s", codeLo, codeHi);
+
+    return 0;
+}
+
+
+/*
+ * nftablesCreateEthRule:
+ * @buf: buffer to append the rule to
+ * @ctx: the variables to resolve
+ * @chain: the chain to add the rule to
+ * @rule: the rule of the filter to convert
+ * @reverse: whether to reverse src and dst attributes
+ *
+ * Convert a layer 2 rule like ebtablesCreateRuleInstance does.
+ */
+static int
+nftablesCreateEthRule(virBufferPtr buf,
+                      nftablesRuleCtxPtr ctx,
+                      const char *chain,
+                      virNWFilterRuleDefPtr rule,
+                      bool reverse)
+{
+    g_auto(virBuffer) rb = VIR_BUFFER_INITIALIZER;
+
+    ctx->setUses = 0;
+
+#define ADD_MATCH(STRUCT, ITEM, KEY, FLAGS) \
+    if (nftablesAddMatch(&rb, ctx, KEY, &rule->p.STRUCT.ITEM, \
+                         (FLAGS) | NFTABLES_VALUE_SET) < 0) \
+        return -1;
+#define ADD_RANGE(STRUCT, ITEM, ITEM_HI, KEY) \
+    if (nftablesAddRangeMatch(&rb, ctx, KEY, &rule->p.STRUCT.ITEM, \
+                              &rule->p.STRUCT.ITEM_HI) < 0) \
+        return -1;
+
+    switch ((int)rule->prtclType) {
+    case VIR_NWFILTER_RULE_PROTOCOL_MAC:
+        if (nftablesHandleEthHdr(&rb, ctx,
+                                 &rule->p.ethHdrFilter.ethHdr, reverse) < 0)
+            return -1;
+
+        ADD_MATCH(ethHdrFilter, dataProtocolID, "ether type", NFTABLES_VALUE_HEX);
+        break;
+
+    case VIR_NWFILTER_RULE_PROTOCOL_VLAN:
+        if (nftablesHandleEthHdr(&rb, ctx,
+                                 &rule->p.vlanHdrFilter.ethHdr, reverse) < 0)
+            return -1;
+
+        virBufferAddLit(&rb, " ether type vlan");
+
+        ADD_MATCH(vlanHdrFilter, dataVlanID, "vlan id", 0);
+        ADD_MATCH(vlanHdrFilter, dataVlanEncap, "vlan type", NFTABLES_VALUE_HEX);
+        break;
+
+    case VIR_NWFILTER_RULE_PROTOCOL_STP:
+        /* cannot handle inout direction with srcmask set in reverse dir.
+           since this clashes with the destination address below... */
+        if (reverse &&
+            HAS_ENTRY_ITEM(&rule->p.stpHdrFilter.ethHdr.dataSrcMACAddr)) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("STP filtering in %s direction with "
+                             "source MAC address set is not supported"),
+                           virNWFilterRuleDirectionTypeToString(
+                               VIR_NWFILTER_RULE_DIRECTION_INOUT));
+            return -1;
+        }
+
+        if (nftablesHandleEthHdr(&rb, ctx,
+                                 &rule->p.stpHdrFilter.ethHdr, reverse) < 0)
+            return -1;
+
+        virBufferAddLit(&rb, " ether daddr " NWFILTER_MAC_BGA);
+
+        /* the BPDU follows the 3 byte LLC header, 17 bytes into
+         * the frame */
+        ADD_MATCH(stpHdrFilter, dataType, "@ll,160,8", 0);
+        ADD_MATCH(stpHdrFilter, dataFlags, "@ll,168,8", 0);
+        ADD_RANGE(stpHdrFilter, dataRootPri, dataRootPriHi, "@ll,176,16");
+        if (nftablesAddMACMaskMatch(&rb, ctx, "@ll,192,48",
+                                    &rule->p.stpHdrFilter.dataRootAddr,
+                                    &rule->p.stpHdrFilter.dataRootAddrMask,
+                                    NFTABLES_VALUE_RAW) < 0)
+            return -1;
+        ADD_RANGE(stpHdrFilter, dataRootCost, dataRootCostHi, "@ll,240,32");
+        ADD_RANGE(stpHdrFilter, dataSndrPrio, dataSndrPrioHi, "@ll,272,16");
+        if (nftablesAddMACMaskMatch(&rb, ctx, "@ll,288,48",
+                                    &rule->p.stpHdrFilter.dataSndrAddr,
+                                    &rule->p.stpHdrFilter.dataSndrAddrMask,
+                                    NFTABLES_VALUE_RAW) < 0)
+            return -1;
+        ADD_RANGE(stpHdrFilter, dataPort, dataPortHi, "@ll,336,16");
+        ADD_RANGE(stpHdrFilter, dataAge, dataAgeHi, "@ll,352,16");
+        ADD_RANGE(stpHdrFilter, dataMaxAge, dataMaxAgeHi, "@ll,368,16");
+        ADD_RANGE(stpHdrFilter, dataHelloTime, dataHelloTimeHi, "@ll,384,16");
+        ADD_RANGE(stpHdrFilter, dataFwdDelay, dataFwdDelayHi, "@ll,400,16");
+        break;
+
+    case VIR_NWFILTER_RULE_PROTOCOL_ARP:
+    case VIR_NWFILTER_RULE_PROTOCOL_RARP:
+        if (HAS_ENTRY_ITEM(&rule->p.arpHdrFilter.dataGratuitousARP) &&
+            rule->p.arpHdrFilter.dataGratuitousARP.u.boolean) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                           _("matching gratuitous ARP is not supported "
+                             "by nftables"));
+            return -1;
+        }
+
+        if (nftablesHandleEthHdr(&rb, ctx,
+                                 &rule->p.arpHdrFilter.ethHdr, reverse) < 0)
+            return -1;
+
+        if (rule->prtclType == VIR_NWFILTER_RULE_PROTOCOL_ARP)
+            virBufferAddLit(&rb, " ether type arp");
+        else
+            virBufferAddLit(&rb, " ether type " NFT_ETHERTYPE_RARP);
+
+        /* raw offsets into the ARP header, which work for RARP too */
+        ADD_MATCH(arpHdrFilter, dataHWType, "@nh,0,16", 0);
+        ADD_MATCH(arpHdrFilter, dataOpcode, "@nh,48,16", 0);
+        ADD_MATCH(arpHdrFilter, dataProtocolType, "@nh,16,16",
+                  NFTABLES_VALUE_HEX);
+
+        if (nftablesAddRawIPMatch(&rb, ctx,
+                                  reverse ? "@nh,192,32" : "@nh,112,32",
+                                  &rule->p.arpHdrFilter.dataARPSrcIPAddr,
+                                  &rule->p.arpHdrFilter.dataARPSrcIPMask) < 0 ||
+            nftablesAddRawIPMatch(&rb, ctx,
+                                  reverse ? "@nh,112,32" : "@nh,192,32",
+                                  &rule->p.arpHdrFilter.dataARPDstIPAddr,
+                                  &rule->p.arpHdrFilter.dataARPDstIPMask) < 0)
+            return -1;
+
+        ADD_MATCH(arpHdrFilter, dataARPSrcMACAddr,
+                  reverse ? "@nh,144,48" : "@nh,64,48", NFTABLES_VALUE_RAW);
+        ADD_MATCH(arpHdrFilter, dataARPDstMACAddr,
+                  reverse ? "@nh,64,48" : "@nh,144,48", NFTABLES_VALUE_RAW);
+        break;
+
+    case VIR_NWFILTER_RULE_PROTOCOL_IP:
+        if (nftablesHandleEthHdr(&rb, ctx,
+                                 &rule->p.ipHdrFilter.ethHdr, reverse) < 0)
+            return -1;
+
+        virBufferAddLit(&rb, " ether type ip");
+
+        if (nftablesAddPrefixMatch(&rb, ctx,
+                                   reverse ? "ip daddr" : "ip saddr",
+                                   &rule->p.ipHdrFilter.ipHdr.dataSrcIPAddr,
+                                   &rule->p.ipHdrFilter.ipHdr.dataSrcIPMask) < 0 ||
+            nftablesAddPrefixMatch(&rb, ctx,
+                                   reverse ? "ip saddr" : "ip daddr",
+                                   &rule->p.ipHdrFilter.ipHdr.dataDstIPAddr,
+                                   &rule->p.ipHdrFilter.ipHdr.dataDstIPMask) < 0)
+            return -1;
+
+        ADD_MATCH(ipHdrFilter, ipHdr.dataProtocolID, "ip protocol", 0);
+        ADD_RANGE(ipHdrFilter, portData.dataSrcPortStart,
+                  portData.dataSrcPortEnd, reverse ? "th dport" : "th sport");
+        ADD_RANGE(ipHdrFilter, portData.dataDstPortStart,
+                  portData.dataDstPortEnd, reverse ? "th sport" : "th dport");
+        ADD_MATCH(ipHdrFilter, ipHdr.dataDSCP, "ip dscp", NFTABLES_VALUE_HEX);
+        break;
+
+    case VIR_NWFILTER_RULE_PROTOCOL_IPV6:
+        if (nftablesHandleEthHdr(&rb, ctx,
+                                 &rule->p.ipv6HdrFilter.ethHdr, reverse) < 0)
+            return -1;
+
+        virBufferAddLit(&rb, " ether type ip6");
+
+        if (nftablesAddPrefixMatch(&rb, ctx,
+                                   reverse ? "ip6 daddr" : "ip6 saddr",
+                                   &rule->p.ipv6HdrFilter.ipHdr.dataSrcIPAddr,
+                                   &rule->p.ipv6HdrFilter.ipHdr.dataSrcIPMask) < 0 ||
+            nftablesAddPrefixMatch(&rb, ctx,
+                                   reverse ? "ip6 saddr" : "ip6 daddr",
+                                   &rule->p.ipv6HdrFilter.ipHdr.dataDstIPAddr,
+                                   &rule->p.ipv6HdrFilter.ipHdr.dataDstIPMask) < 0)
+            return -1;
+
+        /* like --ip6-protocol this skips extension headers */
+        ADD_MATCH(ipv6HdrFilter, ipHdr.dataProtocolID, "meta l4proto", 0);
+        ADD_RANGE(ipv6HdrFilter, portData.dataSrcPortStart,
+                  portData.dataSrcPortEnd, reverse ? "th dport" : "th sport");
+        ADD_RANGE(ipv6HdrFilter, portData.dataDstPortStart,
+                  portData.dataDstPortEnd, reverse ? "th sport" : "th dport");
+
+        if (nftablesHandleICMPv6(&rb, ctx, &rule->p.ipv6HdrFilter) < 0)
+            return -1;
+        break;
+
+    case VIR_NWFILTER_RULE_PROTOCOL_NONE:
+        break;
+
+    default:
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unexpected rule protocol %d"),
+                       rule->prtclType);
+        return -1;
+    }
+
+#undef ADD_RANGE
+#undef ADD_MATCH
+
+    nftablesEmitRule(buf, ctx, chain, &rb,
+                     nftablesVerdict(rule->action, "accept", true));
+    return 0;
+}
+
+
+static int
+nftablesHandleIPHdr(virBufferPtr rb,
+                    nftablesRuleCtxPtr ctx,
+                    const char *family,
+                    ipHdrDataDefPtr ipHdr,
+                    bool directionIn,
+                    bool *skipRule)
+{
+    g_autofree char *src = g_strdup_printf("%s %s", family,
+                                           directionIn ? "daddr" : "saddr");
+    g_autofree char *dst = g_strdup_printf("%s %s", family,
+                                           directionIn ? "saddr" : "daddr");
+    g_autofree char *dscp = g_strdup_printf("%s dscp", family);
+
+    if (HAS_ENTRY_ITEM(&ipHdr->dataSrcIPAddr)) {
+        if (nftablesAddPrefixMatch(rb, ctx, src, &ipHdr->dataSrcIPAddr,
+                                   &ipHdr->dataSrcIPMask) < 0)
+            return -1;
+    } else if (nftablesAddRangeMatch(rb, ctx, src, &ipHdr->dataSrcIPFrom,
+                                     &ipHdr->dataSrcIPTo) < 0) {
+        return -1;
+    }
+
+    if (HAS_ENTRY_ITEM(&ipHdr->dataDstIPAddr)) {
+        if (nftablesAddPrefixMatch(rb, ctx, dst, &ipHdr->dataDstIPAddr,
+                                   &ipHdr->dataDstIPMask) < 0)
+            return -1;
+    } else if (nftablesAddRangeMatch(rb, ctx, dst, &ipHdr->dataDstIPFrom,
+                                     &ipHdr->dataDstIPTo) < 0) {
+        return -1;
+    }
+
+    if (nftablesAddMatch(rb, ctx, dscp, &ipHdr->dataDSCP,
+                         NFTABLES_VALUE_SET) < 0)
+        return -1;
+
+    if (HAS_ENTRY_ITEM(&ipHdr->dataConnlimitAbove)) {
+        if (directionIn) {
+            /* only support for limit in outgoing dir. */
+            *skipRule = true;
+        } else {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                           _("connection limits are not supported "
+                             "by nftables"));
+            return -1;
+        }
+    }
+
+    if (HAS_ENTRY_ITEM(&ipHdr->dataIPSet) &&
+        HAS_ENTRY_ITEM(&ipHdr->dataIPSetFlags)) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                       _("ipset matches are not supported by nftables"));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+nftablesHandlePortData(virBufferPtr rb,
+                       nftablesRuleCtxPtr ctx,
+                       const char *proto,
+                       portDataDefPtr portData,
+                       bool directionIn)
+{
+    g_autofree char *sport = g_strdup_printf("%s %s", proto,
+                                             directionIn ? "dport" : "sport");
+    g_autofree char *dport = g_strdup_printf("%s %s", proto,
+                                             directionIn ? "sport" : "dport");
+
+    if (nftablesAddRangeMatch(rb, ctx, sport, &portData->dataSrcPortStart,
+                              &portData->dataSrcPortEnd) < 0 ||
+        nftablesAddRangeMatch(rb, ctx, dport, &portData->dataDstPortStart,
+                              &portData->dataDstPortEnd) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+/*
+ * _nftablesCreateIPRule:
+ * @buf: buffer to append the rule to
+ * @ctx: the variables to resolve
+ * @directionIn: whether the rule applies to traffic towards the guest
+ * @root: the root chain to add the rule to
+ * @rule: the rule of the filter to convert
+ * @ifname: the name of the interface to apply the rule to
+ * @match: optional connection tracking states to match
+ * @defMatch: whether @match was chosen by default
+ * @acceptVerdict: verdict for accepted traffic, "return" or "accept"
+ * @maySkipICMP: whether the rule may be skipped for ICMP types
+ *
+ * Convert an IP rule like _iptablesCreateRuleInstance does.
+ */
+static int
+_nftablesCreateIPRule(virBufferPtr buf,
+                      nftablesRuleCtxPtr ctx,
+                      bool directionIn,
+                      nftablesRootChain root,
+                      virNWFilterRuleDefPtr rule,
+                      const char *ifname,
+                      const char *match,
+                      bool defMatch,
+                      const char *acceptVerdict,
+                      bool maySkipICMP)
+{
+    g_auto(virBuffer) rb = VIR_BUFFER_INITIALIZER;
+    g_autofree char *chain = NULL;
+    /* all IP protocols start with the source MAC and the IP header */
+    allHdrFilterDefPtr hdr = &rule->p.allHdrFilter;
+    bool isIPv6 = virNWFilterRuleIsProtocolIPv6(rule);
+    const char *family = isIPv6 ? "ip6" : "ip";
+    const char *proto = NULL;
+    const char *verdict;
+    bool skipRule = false;
+    bool skipMatch = false;
+    bool hasICMPType = false;
+    size_t matchlen;
+
+    ctx->setUses = 0;
+
+    switch ((int)rule->prtclType) {
+    case VIR_NWFILTER_RULE_PROTOCOL_TCP:
+    case VIR_NWFILTER_RULE_PROTOCOL_TCPoIPV6:
+        proto = "tcp";
+        break;
+    case VIR_NWFILTER_RULE_PROTOCOL_UDP:
+    case VIR_NWFILTER_RULE_PROTOCOL_UDPoIPV6:
+        proto = "udp";
+        break;
+    case VIR_NWFILTER_RULE_PROTOCOL_UDPLITE:
+    case VIR_NWFILTER_RULE_PROTOCOL_UDPLITEoIPV6:
+        proto = "udplite";
+        break;
+    case VIR_NWFILTER_RULE_PROTOCOL_ESP:
+    case VIR_NWFILTER_RULE_PROTOCOL_ESPoIPV6:
+        proto = "esp";
+        break;
+    case VIR_NWFILTER_RULE_PROTOCOL_AH:
+    case VIR_NWFILTER_RULE_PROTOCOL_AHoIPV6:
+        proto = "ah";
+        break;
+    case VIR_NWFILTER_RULE_PROTOCOL_SCTP:
+    case VIR_NWFILTER_RULE_PROTOCOL_SCTPoIPV6:
+        proto = "sctp";
+        break;
+    case VIR_NWFILTER_RULE_PROTOCOL_ICMP:
+        proto = "icmp";
+        break;
+    case VIR_NWFILTER_RULE_PROTOCOL_ICMPV6:
+        proto = "ipv6-icmp";
+        break;
+    case VIR_NWFILTER_RULE_PROTOCOL_IGMP:
+        proto = "igmp";
+        break;
+    case VIR_NWFILTER_RULE_PROTOCOL_ALL:
+    case VIR_NWFILTER_RULE_PROTOCOL_ALLoIPV6:
+        break;
+    default:
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unexpected protocol %d"),
+                       rule->prtclType);
+        return -1;
+    }
+
+    virBufferAsprintf(&rb, " ether type %s", family);
+    if (proto)
+        virBufferAsprintf(&rb, " meta l4proto %s", proto);
+
+    matchlen = virBufferUse(&rb);
+
+    /* the source MAC address is meaningless for traffic to the guest */
+    if (!directionIn &&
+        nftablesAddMatch(&rb, ctx, "ether saddr", &hdr->dataSrcMACAddr,
+                         NFTABLES_VALUE_SET) < 0)
+        return -1;
+
+    if (nftablesHandleIPHdr(&rb, ctx, family, &hdr->ipHdr,
+                            directionIn, &skipRule) < 0)
+        return -1;
+
+    switch ((int)rule->prtclType) {
+    case VIR_NWFILTER_RULE_PROTOCOL_TCP:
+    case VIR_NWFILTER_RULE_PROTOCOL_TCPoIPV6:
+        if (HAS_ENTRY_ITEM(&rule->p.tcpHdrFilter.dataTCPFlags)) {
+            nwItemDescPtr flags = &rule->p.tcpHdrFilter.dataTCPFlags;
+
+            virBufferAsprintf(&rb, " tcp flags & 0x%x %s 0x%x",
+                              flags->u.tcpFlags.mask,
+                              ENTRY_WANT_NEG_SIGN(flags) ? "!=" : "==",
+                              flags->u.tcpFlags.flags);
+        }
+
+        if (nftablesHandlePortData(&rb, ctx, "tcp",
+                                   &rule->p.tcpHdrFilter.portData,
+                                   directionIn) < 0)
+            return -1;
+
+        if (HAS_ENTRY_ITEM(&rule->p.tcpHdrFilter.dataTCPOption)) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                           _("TCP option matches are not supported "
+                             "by nftables"));
+            return -1;
+        }
+        break;
+
+    case VIR_NWFILTER_RULE_PROTOCOL_UDP:
+    case VIR_NWFILTER_RULE_PROTOCOL_UDPoIPV6:
+        if (nftablesHandlePortData(&rb, ctx, "udp",
+                                   &rule->p.udpHdrFilter.portData,
+                                   directionIn) < 0)
+            return -1;
+        break;
+
+    case VIR_NWFILTER_RULE_PROTOCOL_SCTP:
+    case VIR_NWFILTER_RULE_PROTOCOL_SCTPoIPV6:
+        if (nftablesHandlePortData(&rb, ctx, "sctp",
+                                   &rule->p.sctpHdrFilter.portData,
+                                   directionIn) < 0)
+            return -1;
+        break;
+
+    case VIR_NWFILTER_RULE_PROTOCOL_ICMP:
+    case VIR_NWFILTER_RULE_PROTOCOL_ICMPV6:
+        if (HAS_ENTRY_ITEM(&rule->p.icmpHdrFilter.dataICMPType)) {
+            const char *icmp = isIPv6 ? "icmpv6" : "icmp";
+            g_autofree char *type = g_strdup_printf("%s type", icmp);
+            g_autofree char *code = g_strdup_printf("%s code", icmp);
+
+            hasICMPType = true;
+
+            if (maySkipICMP)
+                return 0;
+
+            if (ENTRY_WANT_NEG_SIGN(&rule->p.icmpHdrFilter.dataICMPType) &&
+                HAS_ENTRY_ITEM(&rule->p.icmpHdrFilter.dataICMPCode)) {
+                virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                               _("nftables cannot match a negated ICMP type "
+                                 "together with a code"));
+                return -1;
+            }
+
+            if (nftablesAddMatch(&rb, ctx, type,
+                                 &rule->p.icmpHdrFilter.dataICMPType,
+                                 NFTABLES_VALUE_SET) < 0 ||
+                nftablesAddMatch(&rb, ctx, code,
+                                 &rule->p.icmpHdrFilter.dataICMPCode,
+                                 NFTABLES_VALUE_SET) < 0)
+                return -1;
+        }
+        break;
+    }
+
+    if ((HAS_ENTRY_ITEM(&hdr->dataSrcMACAddr) && directionIn &&
+         matchlen == virBufferUse(&rb)) ||
+        skipRule)
+        return 0;
+
+    if (rule->action == VIR_NWFILTER_RULE_ACTION_ACCEPT) {
+        verdict = acceptVerdict;
+    } else {
+        verdict = nftablesVerdict(rule->action, acceptVerdict, false);
+        skipMatch = defMatch;
+    }
+
+    if (match && !skipMatch)
+        virBufferAsprintf(&rb, " ct state %s", match);
+
+    if (defMatch && match != NULL && !skipMatch && !hasICMPType &&
+        rule->tt != VIR_NWFILTER_RULE_DIRECTION_INOUT)
+        virBufferAsprintf(&rb, " ct direction %s",
+                          directionIn ? "reply" : "original");
+
+    if (HAS_ENTRY_ITEM(&hdr->ipHdr.dataComment))
+        nftablesAddComment(&rb, hdr->ipHdr.dataComment.u.string);
+
+    chain = g_strdup_printf("%s:%s", nftablesRoots[root].prefix, ifname);
+    nftablesEmitRule(buf, ctx, chain, &rb, verdict);
+
+    return 0;
+}
+
+
+static char *
+nftablesFormatStateMatch(int32_t flags)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autofree char *states = NULL;
+
+    virNWFilterPrintStateMatchFlags(&buf, "", flags, false);
+    if (!(states = virBufferContentAndReset(&buf)))
+        return NULL;
+
+    return g_ascii_strdown(states, -1);
+}
+
+
+static int
+nftablesCreateIPRuleStateCtrl(virBufferPtr buf,
+                              nftablesRuleCtxPtr ctx,
+                              virNWFilterRuleDefPtr rule,
+                              const char *ifname)
+{
+    bool directionIn = false;
+    bool inout = false;
+    g_autofree char *matchState = NULL;
+
+    if ((rule->tt == VIR_NWFILTER_RULE_DIRECTION_IN) ||
+        (rule->tt == VIR_NWFILTER_RULE_DIRECTION_INOUT)) {
+        directionIn = true;
+        inout = (rule->tt == VIR_NWFILTER_RULE_DIRECTION_INOUT);
+    }
+
+    /* NULL if the only state is NONE, matching without state then */
+    matchState = nftablesFormatStateMatch(rule->flags);
+
+    if (!directionIn || inout) {
+        if (_nftablesCreateIPRule(buf, ctx, directionIn,
+                                  NFTABLES_ROOT_FWD_IN, rule, ifname,
+                                  matchState, false, "return",
+                                  directionIn || inout) < 0)
+            return -1;
+    }
+
+    if (directionIn) {
+        if (_nftablesCreateIPRule(buf, ctx, !directionIn,
+                                  NFTABLES_ROOT_FWD_OUT, rule, ifname,
+                                  matchState, false, "accept",
+                                  !directionIn || inout) < 0)
+            return -1;
+    }
+
+    if (!directionIn || inout) {
+        if (_nftablesCreateIPRule(buf, ctx, directionIn,
+                                  NFTABLES_ROOT_HOST_IN, rule, ifname,
+                                  matchState, false, "return",
+                                  directionIn) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/*
+ * nftablesCreateIPRule:
+ *
+ * Convert an IP rule into the forward and host input chains of an
+ * interface like iptablesCreateRuleInstance does.
+ */
+static int
+nftablesCreateIPRule(virBufferPtr buf,
+                     nftablesRuleCtxPtr ctx,
+                     virNWFilterRuleDefPtr rule,
+                     const char *ifname)
+{
+    bool directionIn = false;
+    bool needState = true;
+    bool inout = false;
+    const char *matchState;
+
+    if (!(rule->flags & RULE_FLAG_NO_STATEMATCH) &&
+         (rule->flags & IPTABLES_STATE_FLAGS))
+        return nftablesCreateIPRuleStateCtrl(buf, ctx, rule, ifname);
+
+    if ((rule->tt == VIR_NWFILTER_RULE_DIRECTION_IN) ||
+        (rule->tt == VIR_NWFILTER_RULE_DIRECTION_INOUT)) {
+        directionIn = true;
+        inout = (rule->tt == VIR_NWFILTER_RULE_DIRECTION_INOUT);
+        if (inout)
+            needState = false;
+    }
+
+    if ((rule->flags & RULE_FLAG_NO_STATEMATCH))
+        needState = false;
+
+    if (needState)
+        matchState = directionIn ? "established" : "new,established";
+    else
+        matchState = NULL;
+
+    if (_nftablesCreateIPRule(buf, ctx, directionIn,
+                              NFTABLES_ROOT_FWD_IN, rule, ifname,
+                              matchState, true, "return",
+                              directionIn || inout) < 0)
+        return -1;
+
+    if (needState)
+        matchState = directionIn ? "new,established" : "established";
+
+    if (_nftablesCreateIPRule(buf, ctx, !directionIn,
+                              NFTABLES_ROOT_FWD_OUT, rule, ifname,
+                              matchState, true, "accept",
+                              !directionIn || inout) < 0)
+        return -1;
+
+    if (needState)
+        matchState = directionIn ? "established" : "new,established";
+
+    return _nftablesCreateIPRule(buf, ctx, directionIn,
+                                 NFTABLES_ROOT_HOST_IN, rule, ifname,
+                                 matchState, true, "return",
+                                 directionIn);
+}
+
+
+static int
+nftablesCreateRule(virBufferPtr buf,
+                   nftablesRuleCtxPtr ctx,
+                   virNWFilterRuleInstPtr inst,
+                   const char *ifname)
+{
+    virNWFilterRuleDefPtr rule = inst->def;
+    const char *root = virNWFilterChainSuffixTypeToString(
+                                     VIR_NWFILTER_CHAINSUFFIX_ROOT);
+    g_autofree char *chain = NULL;
+
+    if (!virNWFilterRuleIsProtocolEthernet(rule))
+        return nftablesCreateIPRule(buf, ctx, rule, ifname);
+
+    if (rule->tt == VIR_NWFILTER_RULE_DIRECTION_OUT ||
+        rule->tt == VIR_NWFILTER_RULE_DIRECTION_INOUT) {
+        if (STREQ(inst->chainSuffix, root))
+            chain = g_strdup_printf("I:%s", ifname);
+        else
+            chain = g_strdup_printf("I:%s:%s", ifname, inst->chainSuffix);
+
+        if (nftablesCreateEthRule(buf, ctx, chain, rule,
+                                  rule->tt == VIR_NWFILTER_RULE_DIRECTION_INOUT) < 0)
+            return -1;
+        g_clear_pointer(&chain, g_free);
+    }
+
+    if (rule->tt == VIR_NWFILTER_RULE_DIRECTION_IN ||
+        rule->tt == VIR_NWFILTER_RULE_DIRECTION_INOUT) {
+        if (STREQ(inst->chainSuffix, root))
+            chain = g_strdup_printf("O:%s", ifname);
+        else
+            chain = g_strdup_printf("O:%s:%s", ifname, inst->chainSuffix);
+
+        if (nftablesCreateEthRule(buf, ctx, chain, rule, false) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Returns the variable whose values a rule can match as one set
+ * instead of instantiating the rule once per value: the only
+ * variable of the rule iterated over multiple values.
+ */
+static const virNWFilterVarAccess *
+nftablesGetSetVar(virNWFilterRuleInstPtr inst)
+{
+    virNWFilterRuleDefPtr rule = inst->def;
+    const virNWFilterVarAccess *setVar = NULL;
+    size_t i;
+
+    for (i = 0; i < rule->nVarAccess; i++) {
+        const virNWFilterVarAccess *access = rule->varAccess[i];
+        virNWFilterVarValuePtr value;
+
+        if (virNWFilterVarAccessGetType(access) !=
+            VIR_NWFILTER_VAR_ACCESS_ITERATOR)
+            continue;
+
+        value = virHashLookup(inst->vars,
+                              virNWFilterVarAccessGetVarName(access));
+        if (!value || virNWFilterVarValueGetCardinality(value) <= 1)
+            continue;
+
+        if (setVar)
+            return NULL;
+        setVar = access;
+    }
+
+    if (!setVar)
+        return NULL;
+
+    /* variables sharing the iterator are walked in lockstep */
+    for (i = 0; i < rule->nVarAccess; i++) {
+        const virNWFilterVarAccess *access = rule->varAccess[i];
+
+        if (access != setVar &&
+            virNWFilterVarAccessGetType(access) ==
+            VIR_NWFILTER_VAR_ACCESS_ITERATOR &&
+            virNWFilterVarAccessGetIterId(access) ==
+            virNWFilterVarAccessGetIterId(setVar))
+            return NULL;
+    }
+
+    return setVar;
+}
+
+
+static int
+nftablesRuleInstCommand(virBufferPtr buf,
+                        const char *ifname,
+                        virNWFilterRuleInstPtr inst)
+{
+    nftablesRuleCtx ctx = { 0 };
+    virNWFilterVarCombIterPtr vciter;
+    int ret = -1;
+
+    if ((ctx.setVar = nftablesGetSetVar(inst))) {
+        g_auto(virBuffer) setbuf = VIR_BUFFER_INITIALIZER;
+
+        ctx.setValue = virHashLookup(inst->vars,
+                                     virNWFilterVarAccessGetVarName(ctx.setVar));
+        if (!(ctx.vars = virNWFilterVarCombIterCreate(inst->vars,
+                                                      inst->def->varAccess,
+                                                      inst->def->nVarAccess)))
+            return -1;
+
+        ret = nftablesCreateRule(&setbuf, &ctx, inst, ifname);
+        virNWFilterVarCombIterFree(ctx.vars);
+
+        if (ret < 0)
+            return -1;
+
+        if (!ctx.setRefused) {
+            virBufferAdd(buf, virBufferCurrentContent(&setbuf), -1);
+            return 0;
+        }
+
+        memset(&ctx, 0, sizeof(ctx));
+        ret = -1;
+    }
+
+    /* inst->vars holds all the variables names that this rule will access.
+     * iterate over all combinations of the variables' values and instantiate
+     * the filtering rule with each combination.
+     */
+    ctx.vars = vciter = virNWFilterVarCombIterCreate(inst->vars,
+                                                     inst->def->varAccess,
+                                                     inst->def->nVarAccess);
+    if (!vciter)
+        return -1;
+
+    do {
+        if (nftablesCreateRule(buf, &ctx, inst, ifname) < 0)
+            goto cleanup;
+        ctx.vars = virNWFilterVarCombIterNext(ctx.vars);
+    } while (ctx.vars != NULL);
+
+    ret = 0;
+ cleanup:
+    virNWFilterVarCombIterFree(vciter);
+    return ret;
+}
+
+
+static int
+nftablesRuleInstSort(const void *a, const void *b)
+{
+    virNWFilterRuleInst * const *insta = a;
+    virNWFilterRuleInst * const *instb = b;
+    const char *root = virNWFilterChainSuffixTypeToString(
+                                     VIR_NWFILTER_CHAINSUFFIX_ROOT);
+    bool root_a = STREQ((*insta)->chainSuffix, root);
+    bool root_b = STREQ((*instb)->chainSuffix, root);
+
+    /* ensure root chain rules appear before all others */
+    if (root_a) {
+        if (!root_b)
+            return -1; /* a before b */
+    } else if (root_b) {
+        return 1; /* b before a */
+    }
+
+    /* priorities are limited to range [-1000, 1000] */
+    return (*insta)->priority - (*instb)->priority;
+}
+
+
+typedef struct _nftablesSubChain nftablesSubChain;
+typedef nftablesSubChain *nftablesSubChainPtr;
+struct _nftablesSubChain {
+    virNWFilterChainPriority priority;
+    nftablesRootChain root;
+    const char *match;
+    const char *filtername;
+};
+
+
+static int
+nftablesSubChainSort(const void *a, const void *b)
+{
+    const nftablesSubChain *insta = a;
+    const nftablesSubChain *instb = b;
+
+    /* priorities are limited to range [-1000, 1000] */
+    return insta->priority - instb->priority;
+}
+
+
+static int
+nftablesFilterOrderSort(const virHashKeyValuePair *a,
+                        const virHashKeyValuePair *b)
+{
+    /* elements' values has been limited to range [-1000, 1000] */
+    return *(virNWFilterChainPriority *)a->value -
+           *(virNWFilterChainPriority *)b->value;
+}
+
+
+static int
+nftablesGetSubChains(virHashTablePtr chains,
+                     nftablesRootChain root,
+                     nftablesSubChainPtr *subchains,
+                     size_t *nsubchains)
+{
+    g_autofree virHashKeyValuePairPtr filter_names = NULL;
+    size_t i, j;
+
+    if (!(filter_names = virHashGetItems(chains, nftablesFilterOrderSort)))
+        return -1;
+
+    for (i = 0; filter_names[i].key; i++) {
+        nftablesSubChain sub = { 0 };
+
+        for (j = 0; j < G_N_ELEMENTS(nftablesSubChainProtos); j++) {
+            if (STRPREFIX(filter_names[i].key, nftablesSubChainProtos[j].name))
+                break;
+        }
+
+        if (j == G_N_ELEMENTS(nftablesSubChainProtos))
+            continue;
+
+        sub.priority = *(const virNWFilterChainPriority *)filter_names[i].value;
+        sub.root = root;
+        sub.match = nftablesSubChainProtos[j].match;
+        sub.filtername = filter_names[i].key;
+
+        if (VIR_APPEND_ELEMENT(*subchains, *nsubchains, sub) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+nftablesCreateSubChain(virBufferPtr buf,
+                       const char *ifname,
+                       nftablesSubChainPtr sub,
+                       char ***chains)
+{
+    const char *prefix = nftablesRoots[sub->root].prefix;
+    g_autofree char *chain = g_strdup_printf("%s:%s:%s", prefix, ifname,
+                                             sub->filtername);
+
+    virBufferAsprintf(buf,
+                      "add rule " NFT_TABLE " \"%s:%s\"%s jump \"%s\"\n",
+                      prefix, ifname, sub->match, chain);
+
+    return virStringListAdd(chains, chain);
+}
+
+
+static int
+nftablesApplyNewRules(const char *ifname,
+                      virNWFilterRuleInstPtr *rules,
+                      size_t nrules)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autoptr(virHashTable) chains_in_set = virHashCreate(10, NULL);
+    g_autoptr(virHashTable) chains_out_set = virHashCreate(10, NULL);
+    g_autofree nftablesSubChainPtr subchains = NULL;
+    size_t nsubchains = 0;
+    VIR_AUTOSTRINGLIST chains = NULL;
+    g_autofree char *script = NULL;
+    size_t i, j;
+
+    if (!chains_in_set || !chains_out_set)
+        return -1;
+
+    if (nftablesCheckIfname(ifname) < 0)
+        return -1;
+
+    if (nrules)
+        qsort(rules, nrules, sizeof(rules[0]), nftablesRuleInstSort);
+
+    /* raise the priority of rules below the priority of their chain
+     * so that the chain is jumped to before, see
+     * ebiptablesApplyNewRules */
+    for (i = 0; i < nrules; i++) {
+        if (rules[i]->chainPriority > rules[i]->priority &&
+            !strstr("root", rules[i]->chainSuffix)) {
+
+             rules[i]->priority = rules[i]->chainPriority;
+        }
+    }
+
+    /* scan the rules to see which sub chains need to be created */
+    for (i = 0; i < nrules; i++) {
+        if (!virNWFilterRuleIsProtocolEthernet(rules[i]->def))
+            continue;
+
+        if (rules[i]->def->tt == VIR_NWFILTER_RULE_DIRECTION_OUT ||
+            rules[i]->def->tt == VIR_NWFILTER_RULE_DIRECTION_INOUT) {
+            if (virHashUpdateEntry(chains_in_set, rules[i]->chainSuffix,
+                                   &rules[i]->chainPriority) < 0)
+                return -1;
+        }
+        if (rules[i]->def->tt == VIR_NWFILTER_RULE_DIRECTION_IN ||
+            rules[i]->def->tt == VIR_NWFILTER_RULE_DIRECTION_INOUT) {
+            if (virHashUpdateEntry(chains_out_set, rules[i]->chainSuffix,
+                                   &rules[i]->chainPriority) < 0)
+                return -1;
+        }
+    }
+
+    if (nftablesGetSubChains(chains_in_set, NFTABLES_ROOT_IN,
+                             &subchains, &nsubchains) < 0 ||
+        nftablesGetSubChains(chains_out_set, NFTABLES_ROOT_OUT,
+                             &subchains, &nsubchains) < 0)
+        return -1;
+
+    if (nsubchains > 0)
+        qsort(subchains, nsubchains, sizeof(subchains[0]),
+              nftablesSubChainSort);
+
+    /* interleave the jumps to the sub chains with the rules of the
+     * root chains by priority */
+    for (i = 0, j = 0; i < nrules; i++) {
+        if (!virNWFilterRuleIsProtocolEthernet(rules[i]->def))
+            continue;
+
+        while (j < nsubchains &&
+               subchains[j].priority <= rules[i]->priority) {
+            if (nftablesCreateSubChain(&buf, ifname, &subchains[j],
+                                       &chains) < 0)
+                return -1;
+            j++;
+        }
+        if (nftablesRuleInstCommand(&buf, ifname, rules[i]) < 0)
+            return -1;
+    }
+    while (j < nsubchains) {
+        if (nftablesCreateSubChain(&buf, ifname, &subchains[j], &chains) < 0)
+            return -1;
+        j++;
+    }
+
+    for (i = 0; i < nrules; i++) {
+        if (virNWFilterRuleIsProtocolEthernet(rules[i]->def))
+            continue;
+
+        if (nftablesRuleInstCommand(&buf, ifname, rules[i]) < 0)
+            return -1;
+    }
+
+    script = virBufferContentAndReset(&buf);
+    if (!script)
+        script = g_strdup("");
+
+    return nftablesApplyIface(ifname, &chains, &script, true);
+}
+
+
+static int
+nftablesTearNewRules(const char *ifname)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    nftablesIfacePtr iface;
+    int ret = -1;
+
+    virMutexLock(&nftablesLock);
+
+    if (!nftablesIfaces ||
+        !(iface = virHashLookup(nftablesIfaces, ifname)) ||
+        !iface->hasOld) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (!iface->oldRules) {
+        VIR_WARN("Previous rules of interface %s are not known, "
+                 "cannot restore them", ifname);
+        nftablesIfaceDropOld(iface);
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (!*iface->oldRules && !iface->oldChains) {
+        /* there was nothing before */
+        nftablesFormatTeardown(&buf, ifname, iface->chains);
+        if (nftablesRun(virBufferCurrentContent(&buf)) < 0)
+            goto cleanup;
+        virHashRemoveEntry(nftablesIfaces, ifname);
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (nftablesIfaceReplace(ifname, iface,
+                             &iface->oldChains, &iface->oldRules) < 0)
+        goto cleanup;
+
+    nftablesIfaceDropOld(iface);
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&nftablesLock);
+    return ret;
+}
+
+
+static int
+nftablesTearOldRules(const char *ifname)
+{
+    nftablesIfacePtr iface;
+
+    virMutexLock(&nftablesLock);
+
+    /* the new rules replaced the old ones already */
+    if (nftablesIfaces &&
+        (iface = virHashLookup(nftablesIfaces, ifname)))
+        nftablesIfaceDropOld(iface);
+
+    virMutexUnlock(&nftablesLock);
+    return 0;
+}
+
+
+static int
+nftablesAllTeardown(const char *ifname)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    nftablesIfacePtr iface = NULL;
+    int ret = -1;
+
+    if (nftablesCheckIfname(ifname) < 0)
+        return -1;
+
+    virMutexLock(&nftablesLock);
+
+    if (nftablesIfaces)
+        iface = virHashLookup(nftablesIfaces, ifname);
+
+    nftablesFormatTeardown(&buf, ifname, iface ? iface->chains : NULL);
+
+    if (nftablesRun(virBufferCurrentContent(&buf)) < 0)
+        goto cleanup;
+
+    if (iface)
+        virHashRemoveEntry(nftablesIfaces, ifname);
+
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&nftablesLock);
+    return ret;
+}
+
+
+static int
+nftablesCanApplyBasicRules(void)
+{
+    return true;
+}
+
+
+/**
+ * nftablesApplyBasicRules
+ *
+ * @ifname: name of the backend-interface to which to apply the rules
+ * @macaddr: MAC address the VM is using in packets sent through the
+ *    interface
+ *
+ * Returns 0 on success, -1 on failure with the previous rules in place
+ *
+ * Apply basic filtering rules on the given interface
+ * - filtering for MAC address spoofing
+ * - allowing IPv4 & ARP traffic
+ */
+static int
+nftablesApplyBasicRules(const char *ifname,
+                        const virMacAddr *macaddr)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    char macaddr_str[VIR_MAC_STRING_BUFLEN];
+    char **chains = NULL;
+    g_autofree char *rules = NULL;
+
+    if (nftablesCheckIfname(ifname) < 0)
+        return -1;
+
+    virMacAddrFormat(macaddr, macaddr_str);
+
+    virBufferAsprintf(&buf,
+                      "add rule " NFT_TABLE " \"I:%s\" ether saddr != %s drop\n"
+                      "add rule " NFT_TABLE " \"I:%s\" ether type { ip, arp } accept\n"
+                      "add rule " NFT_TABLE " \"I:%s\" drop\n",
+                      ifname, macaddr_str, ifname, ifname);
+
+    rules = virBufferContentAndReset(&buf);
+
+    return nftablesApplyIface(ifname, &chains, &rules, false);
+}
+
+
+/**
+ * nftablesApplyDHCPOnlyRules
+ *
+ * @ifname: name of the backend-interface to which to apply the rules
+ * @macaddr: MAC address the VM is using in packets sent through the
+ *    interface
+ * @dhcpsrvrs: The DHCP server(s) from which the VM may receive traffic
+ *    from; may be NULL
+ * @leaveTemporary: unused, the rules are in place right away
+ *
+ * Returns 0 on success, -1 on failure with the previous rules in place
+ *
+ * Apply filtering rules so that the VM can only send and receive
+ * DHCP traffic and nothing else.
+ */
+static int
+nftablesApplyDHCPOnlyRules(const char *ifname,
+                           const virMacAddr *macaddr,
+                           virNWFilterVarValuePtr dhcpsrvrs,
+                           bool leaveTemporary G_GNUC_UNUSED)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    char macaddr_str[VIR_MAC_STRING_BUFLEN];
+    char **chains = NULL;
+    g_autofree char *rules = NULL;
+    g_autofree char *srcmatch = NULL;
+
+    if (nftablesCheckIfname(ifname) < 0)
+        return -1;
+
+    virMacAddrFormat(macaddr, macaddr_str);
+
+    if (dhcpsrvrs && virNWFilterVarValueGetCardinality(dhcpsrvrs) > 0) {
+        g_autofree char *srvrs = NULL;
+
+        if (!(srvrs = nftablesFormatSet(dhcpsrvrs, DATATYPE_IPADDR, 0)))
+            return -1;
+        srcmatch = g_strdup_printf(" ip saddr %s", srvrs);
+    }
+
+    virBufferAsprintf(&buf,
+                      "add rule " NFT_TABLE " \"I:%s\" ether saddr %s "
+                      "ip protocol udp udp sport 68 udp dport 67 accept\n"
+                      "add rule " NFT_TABLE " \"I:%s\" drop\n",
+                      ifname, macaddr_str, ifname);
+
+    /* responses to the MAC address of the VM or broadcast, from the
+     * DHCP servers if any are given */
+    virBufferAsprintf(&buf,
+                      "add rule " NFT_TABLE " \"O:%s\" "
+                      "ether daddr { %s, ff:ff:ff:ff:ff:ff } "
+                      "ip protocol udp%s udp sport 67 udp dport 68 accept\n"
+                      "add rule " NFT_TABLE " \"O:%s\" drop\n",
+                      ifname, macaddr_str, NULLSTR_EMPTY(srcmatch), ifname);
+
+    rules = virBufferContentAndReset(&buf);
+
+    return nftablesApplyIface(ifname, &chains, &rules, false);
+}
+
+
+/**
+ * nftablesApplyDropAllRules
+ *
+ * @ifname: name of the backend-interface to which to apply the rules
+ *
+ * Returns 0 on success, -1 on failure with the previous rules in place
+ *
+ * Apply filtering rules so that the VM cannot receive or send traffic.
+ */
+static int
+nftablesApplyDropAllRules(const char *ifname)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    char **chains = NULL;
+    g_autofree char *rules = NULL;
+
+    if (nftablesCheckIfname(ifname) < 0)
+        return -1;
+
+    virBufferAsprintf(&buf,
+                      "add rule " NFT_TABLE " \"I:%s\" drop\n"
+                      "add rule " NFT_TABLE " \"O:%s\" drop\n",
+                      ifname, ifname);
+
+    rules = virBufferContentAndReset(&buf);
+
+    return nftablesApplyIface(ifname, &chains, &rules, false);
+}
+
+
+static int
+nftablesRemoveBasicRules(const char *ifname)
+{
+    return nftablesAllTeardown(ifname);
+}
+
+
+#if WITH_NFTABLES
+/*
+ * Learns the interfaces and sub chains left behind by a previous
+ * daemon, so that sub chains which are no longer used are removed
+ * when the filters are instantiated again.
+ */
+static int
+nftablesLoadChains(void)
+{
+    VIR_AUTOSTRINGLIST lines = NULL;
+    const char *output;
+    size_t i;
+
+    if (nft_run_cmd_from_buffer(nftablesCtx,
+                                "list chains " NFT_TABLE "\n") != 0) {
+        virReportError(VIR_ERR_OPERATION_FAILED,
+                       _("failed to list nftables chains: %s"),
+                       NULLSTR(nft_ctx_get_error_buffer(nftablesCtx)));
+        return -1;
+    }
+
+    output = nft_ctx_get_output_buffer(nftablesCtx);
+    if (!(lines = virStringSplit(NULLSTR_EMPTY(output), "\n", 0)))
+        return -1;
+
+    for (i = 0; lines[i]; i++) {
+        g_autofree char *name = NULL;
+        VIR_AUTOSTRINGLIST parts = NULL;
+        nftablesIfacePtr iface;
+        const char *line = lines[i];
+        char *tmp;
+
+        virSkipSpaces(&line);
+        if (!STRPREFIX(line, "chain "))
+            continue;
+
+        name = g_strdup(line + strlen("chain "));
+        if ((tmp = strchr(name, '{')))
+            *tmp = '\0';
+        virTrimSpaces(name, NULL);
+        if (name[0] == '"') {
+            memmove(name, name + 1, strlen(name));
+            if ((tmp = strchr(name, '"')))
+                *tmp = '\0';
+        }
+
+        /* <root>:<ifname>[:<suffix>] */
+        if (!(parts = virStringSplit(name, ":", 3)) ||
+            virStringListLength((const char * const *)parts) < 2)
+            continue;
+
+        if (!(iface = nftablesIfaceGet(parts[1])))
+            return -1;
+
+        /* whatever is in there is not known */
+        g_clear_pointer(&iface->rules, g_free);
+
+        if (parts[2] &&
+            !virStringListHasString((const char **)iface->chains, name) &&
+            virStringListAdd(&iface->chains, name) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+#endif /* WITH_NFTABLES */
+
+
+static int
+nftablesDriverInit(bool privileged)
+{
+    if (!privileged)
+        return 0;
+
+#if WITH_NFTABLES
+    if (!(nftablesCtx = nft_ctx_new(NFT_CTX_DEFAULT))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("cannot create nftables context"));
+        return -1;
+    }
+
+    if (nft_ctx_buffer_output(nftablesCtx) < 0 ||
+        nft_ctx_buffer_error(nftablesCtx) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("cannot set up nftables output buffering"));
+        goto error;
+    }
+
+    nftablesBaseRules = nftablesFormatBaseRules();
+
+    virMutexLock(&nftablesLock);
+    if (nftablesRun("") < 0 ||
+        nftablesLoadChains() < 0) {
+        virMutexUnlock(&nftablesLock);
+        goto error;
+    }
+    virMutexUnlock(&nftablesLock);
+
+    nftables_driver.flags = TECHDRV_FLAG_INITIALIZED;
+
+    return 0;
+
+ error:
+    g_clear_pointer(&nftablesBaseRules, g_free);
+    g_clear_pointer(&nftablesIfaces, virHashFree);
+    nft_ctx_free(nftablesCtx);
+    nftablesCtx = NULL;
+    return -1;
+#else /* !WITH_NFTABLES */
+    virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                   _("nftables support was not compiled in"));
+    return -1;
+#endif /* !WITH_NFTABLES */
+}
+
+
+static void
+nftablesDriverShutdown(void)
+{
+    nftables_driver.flags = 0;
+
+    virMutexLock(&nftablesLock);
+#if WITH_NFTABLES
+    if (nftablesCtx) {
+        nft_ctx_free(nftablesCtx);
+        nftablesCtx = NULL;
+    }
+#endif
+    g_clear_pointer(&nftablesBaseRules, g_free);
+    g_clear_pointer(&nftablesIfaces, virHashFree);
+    virMutexUnlock(&nftablesLock);
+}
+
+
+virNWFilterTechDriver nftables_driver = {
+    .name = NFTABLES_DRIVER_ID,
+    .flags = 0,
+
+    .init     = nftablesDriverInit,
+    .shutdown = nftablesDriverShutdown,
+
+    .applyNewRules       = nftablesApplyNewRules,
+    .tearNewRules        = nftablesTearNewRules,
+    .tearOldRules        = nftablesTearOldRules,
+    .allTeardown         = nftablesAllTeardown,
+
+    .canApplyBasicRules  = nftablesCanApplyBasicRules,
+    .applyBasicRules     = nftablesApplyBasicRules,
+    .applyDHCPOnlyRules  = nftablesApplyDHCPOnlyRules,
+    .removeBasicRules    = nftablesRemoveBasicRules,
+    .applyDropAllRules   = nftablesApplyDropAllRules,
+};
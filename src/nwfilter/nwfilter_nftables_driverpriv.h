@@ -0,0 +1,32 @@
+/*
+ * nwfilter_nftables_driverpriv.h: functions for testing nftables driver
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBVIRT_NWFILTER_NFTABLES_DRIVERPRIV_H_ALLOW
+# error "nwfilter_nftables_driverpriv.h may only be included by nwfilter_nftables_driver.c or test suites"
+#endif /* LIBVIRT_NWFILTER_NFTABLES_DRIVERPRIV_H_ALLOW */
+
+#pragma once
+
+#include "virbuffer.h"
+
+/*
+ * When set, the nftables commands of each interface are appended
+ * to @buf instead of being handed to the kernel. The commands
+ * setting up the table and the base chains are not included.
+ */
+void nftablesDriverSetDryRun(virBufferPtr buf);
@@ -110,6 +110,8 @@ struct _qemuAgent {
     bool running;
     bool singleSync;
     bool inSync;
+    /* skip guest-sync between commands, see qemuAgentBeginBurst */
+    bool burst;
 
     virDomainObjPtr vm;
 
@@ -772,6 +774,35 @@ qemuAgentNotifyClose(qemuAgentPtr agent)
 }
 
 
+/**
+ * qemuAgentSetEventContext:
+ * @agent: the agent
+ * @context: the new event loop context
+ *
+ * Moves handling of I/O of @agent to @context. An I/O callback running
+ * in the old context at the time may still finish there.
+ */
+void
+qemuAgentSetEventContext(qemuAgentPtr agent,
+                         GMainContext *context)
+{
+    virObjectLock(agent);
+
+    if (agent->context != context) {
+        bool registered = !!agent->watch;
+
+        qemuAgentUnregister(agent);
+        g_main_context_unref(agent->context);
+        agent->context = g_main_context_ref(context);
+
+        if (registered && agent->socket)
+            qemuAgentRegister(agent);
+    }
+
+    virObjectUnlock(agent);
+}
+
+
 void qemuAgentClose(qemuAgentPtr agent)
 {
     if (!agent)
@@ -896,7 +927,7 @@ qemuAgentGuestSync(qemuAgentPtr agent)
     qemuAgentMessage sync_msg;
     int timeout = VIR_DOMAIN_QEMU_AGENT_COMMAND_DEFAULT;
 
-    if (agent->singleSync && agent->inSync)
+    if ((agent->singleSync || agent->burst) && agent->inSync)
         return 0;
 
     /* if user specified a custom agent timeout that is lower than the
@@ -944,7 +975,7 @@ qemuAgentGuestSync(qemuAgentPtr agent)
         }
     }
 
-    if (agent->singleSync)
+    if (agent->singleSync || agent->burst)
         agent->inSync = true;
 
     ret = 0;
@@ -2491,3 +2522,39 @@ qemuAgentSetResponseTimeout(qemuAgentPtr agent,
 {
     agent->timeout = timeout;
 }
+
+
+/**
+ * qemuAgentBeginBurst:
+ * @agent: agent object
+ *
+ * Marks the start of a series of commands issued back to back. Only the
+ * first command of the series is preceded by the guest-sync handshake,
+ * the following ones rely on the channel being in sync as long as no
+ * command timed out. Agents opened with @singleSync behave like this
+ * all the time. The series is ended by qemuAgentEndBurst.
+ *
+ * The agent object must be locked prior to calling this function.
+ */
+void
+qemuAgentBeginBurst(qemuAgentPtr agent)
+{
+    agent->burst = true;
+}
+
+
+/**
+ * qemuAgentEndBurst:
+ * @agent: agent object
+ *
+ * Ends the series of commands started by qemuAgentBeginBurst.
+ *
+ * The agent object must be locked prior to calling this function.
+ */
+void
+qemuAgentEndBurst(qemuAgentPtr agent)
+{
+    agent->burst = false;
+    if (!agent->singleSync)
+        agent->inSync = false;
+}
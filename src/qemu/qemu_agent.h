@@ -47,6 +47,9 @@ qemuAgentPtr qemuAgentOpen(virDomainObjPtr vm,
 
 void qemuAgentClose(qemuAgentPtr mon);
 
+void qemuAgentSetEventContext(qemuAgentPtr agent,
+                              GMainContext *context);
+
 void qemuAgentNotifyClose(qemuAgentPtr mon);
 
 typedef enum {
@@ -170,3 +173,6 @@ int qemuAgentGetTimezone(qemuAgentPtr mon,
 
 void qemuAgentSetResponseTimeout(qemuAgentPtr mon,
                                  int timeout);
+
+void qemuAgentBeginBurst(qemuAgentPtr agent);
+void qemuAgentEndBurst(qemuAgentPtr agent);
@@ -110,6 +110,7 @@ struct qemuBackupDiskData {
     virStorageSourcePtr backingStore;
     char *incrementalBitmap;
     qemuBlockStorageSourceChainDataPtr crdata;
+    unsigned long long size; /* estimate of the data the job copies */
     bool labelled;
     bool initialized;
     bool created;
@@ -341,6 +342,42 @@ qemuBackupDiskPrepareDataOnePull(virJSONValuePtr actions,
 }
 
 
+/**
+ * qemuBackupDiskEstimateSize:
+ * @dd: disk backup data
+ * @blockNamedNodeData: hash table filled with qemuBlockNamedNodeData
+ *
+ * Estimates how much data the push mode job of @dd copies. Incremental
+ * backups copy the clusters recorded by the bitmaps of the checkpoint
+ * across the backing chain, summing them gives an upper bound. Full
+ * backups copy the whole disk.
+ */
+static void
+qemuBackupDiskEstimateSize(struct qemuBackupDiskData *dd,
+                           virHashTablePtr blockNamedNodeData)
+{
+    qemuBlockNamedNodeDataPtr entry;
+    virStorageSourcePtr n;
+
+    dd->size = 0;
+
+    if (dd->backupdisk->incremental) {
+        for (n = dd->domdisk->src; virStorageSourceIsBacking(n); n = n->backingStore) {
+            qemuBlockNamedNodeDataBitmapPtr bitmap;
+
+            if ((bitmap = qemuBlockNamedNodeDataGetBitmapByName(blockNamedNodeData, n,
+                                                                dd->backupdisk->incremental)))
+                dd->size += bitmap->dirtybytes;
+        }
+
+        return;
+    }
+
+    if ((entry = virHashLookup(blockNamedNodeData, dd->domdisk->src->nodeformat)))
+        dd->size = entry->capacity;
+}
+
+
 static ssize_t
 qemuBackupDiskPrepareData(virDomainObjPtr vm,
                           virDomainBackupDefPtr def,
@@ -375,6 +412,8 @@ qemuBackupDiskPrepareData(virDomainObjPtr vm,
         } else {
             if (qemuBackupDiskPrepareDataOnePush(actions, dd) < 0)
                 goto error;
+
+            qemuBackupDiskEstimateSize(dd, blockNamedNodeData);
         }
     }
 
@@ -488,6 +527,173 @@ qemuBackupDiskStarted(virDomainObjPtr vm,
 }
 
 
+static int
+qemuBackupDiskDataCompareSize(const void *a,
+                              const void *b)
+{
+    const struct qemuBackupDiskData *da = a;
+    const struct qemuBackupDiskData *db = b;
+
+    if (da->size > db->size)
+        return -1;
+    if (da->size < db->size)
+        return 1;
+    return 0;
+}
+
+
+/**
+ * qemuBackupSchedulerUpdate:
+ * @vm: domain object
+ * @backup: backup definition
+ * @asyncJob: currently used qemu asynchronous job type
+ *
+ * Resumes queued jobs of the push mode @backup in the order of their queue
+ * positions until backup_max_jobs jobs are running and splits
+ * backup_max_bandwidth evenly among the running jobs. Failures are only
+ * logged as the jobs keep running regardless.
+ */
+static void
+qemuBackupSchedulerUpdate(virDomainObjPtr vm,
+                          virDomainBackupDefPtr backup,
+                          int asyncJob)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(priv->driver);
+    g_autofree qemuBlockJobDataPtr *jobs = NULL;
+    g_autofree virDomainBackupDiskDefPtr *queued = NULL;
+    size_t njobs = 0;
+    size_t nqueued = 0;
+    size_t i;
+
+    if (backup->type != VIR_DOMAIN_BACKUP_TYPE_PUSH)
+        return;
+
+    jobs = g_new0(qemuBlockJobDataPtr, backup->ndisks);
+    queued = g_new0(virDomainBackupDiskDefPtr, backup->ndisks);
+
+    for (i = 0; i < backup->ndisks; i++) {
+        virDomainBackupDiskDefPtr backupdisk = backup->disks + i;
+
+        if (!backupdisk->store ||
+            backupdisk->state != VIR_DOMAIN_BACKUP_DISK_STATE_RUNNING)
+            continue;
+
+        if (backupdisk->queued > 0) {
+            queued[nqueued++] = backupdisk;
+        } else {
+            virDomainDiskDefPtr disk;
+            qemuBlockJobDataPtr job;
+
+            if ((disk = virDomainDiskByTarget(vm->def, backupdisk->name)) &&
+                (job = qemuBlockJobDiskGetJob(disk)))
+                jobs[njobs++] = job;
+        }
+    }
+
+    if (nqueued == 0 && cfg->backupMaxBandwidth == 0)
+        goto cleanup;
+
+    if (qemuDomainObjEnterMonitorAsync(priv->driver, vm, asyncJob) < 0)
+        goto cleanup;
+
+    while (nqueued > 0 &&
+           (cfg->backupMaxJobs == 0 || njobs < cfg->backupMaxJobs)) {
+        virDomainBackupDiskDefPtr next = NULL;
+        size_t nextidx = 0;
+        virDomainDiskDefPtr disk;
+        qemuBlockJobDataPtr job;
+
+        for (i = 0; i < nqueued; i++) {
+            if (!next || queued[i]->queued < next->queued) {
+                next = queued[i];
+                nextidx = i;
+            }
+        }
+
+        queued[nextidx] = queued[--nqueued];
+        next->queued = 0;
+
+        if (!(disk = virDomainDiskByTarget(vm->def, next->name)) ||
+            !(job = qemuBlockJobDiskGetJob(disk)))
+            continue;
+
+        VIR_DEBUG("resuming backup job '%s'", job->name);
+
+        if (qemuMonitorJobResume(priv->mon, job->name) < 0) {
+            VIR_WARN("failed to resume backup job '%s' of domain '%s'",
+                     job->name, vm->def->name);
+            virObjectUnref(job);
+            continue;
+        }
+
+        jobs[njobs++] = job;
+    }
+
+    if (cfg->backupMaxBandwidth > 0 && njobs > 0) {
+        unsigned long long speed = cfg->backupMaxBandwidth * 1024ULL * 1024ULL / njobs;
+
+        for (i = 0; i < njobs; i++) {
+            if (qemuMonitorBlockJobSetSpeed(priv->mon, jobs[i]->name, speed) < 0)
+                VIR_WARN("failed to set speed of backup job '%s' of domain '%s'",
+                         jobs[i]->name, vm->def->name);
+        }
+    }
+
+    ignore_value(qemuDomainObjExitMonitor(priv->driver, vm));
+
+ cleanup:
+    for (i = 0; i < njobs; i++)
+        virObjectUnref(jobs[i]);
+}
+
+
+/**
+ * qemuBackupSchedulerStart:
+ * @vm: domain object
+ * @dd: backup disk data list
+ * @ndd: number of valid disks in @dd
+ *
+ * All jobs of a backup are started by the transaction which creates the
+ * point in time of the backup. When backup_max_jobs limits the number of
+ * concurrent jobs of a push mode backup, all but the jobs with the most
+ * data to copy are paused right away and queued. A paused backup job still
+ * copies the data the guest is about to overwrite, so the point in time is
+ * preserved for the queued disks.
+ */
+static void
+qemuBackupSchedulerStart(virDomainObjPtr vm,
+                         struct qemuBackupDiskData *dd,
+                         size_t ndd)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(priv->driver);
+    size_t i;
+
+    if (cfg->backupMaxJobs > 0 && ndd > cfg->backupMaxJobs) {
+        qsort(dd, ndd, sizeof(*dd), qemuBackupDiskDataCompareSize);
+
+        if (qemuDomainObjEnterMonitorAsync(priv->driver, vm, QEMU_ASYNC_JOB_BACKUP) < 0)
+            return;
+
+        for (i = cfg->backupMaxJobs; i < ndd; i++) {
+            if (qemuMonitorJobPause(priv->mon, dd[i].blockjob->name) < 0) {
+                VIR_WARN("failed to queue backup job '%s' of domain '%s'",
+                         dd[i].blockjob->name, vm->def->name);
+                break;
+            }
+
+            dd[i].backupdisk->queued = i - cfg->backupMaxJobs + 1;
+        }
+
+        if (qemuDomainObjExitMonitor(priv->driver, vm) < 0)
+            return;
+    }
+
+    qemuBackupSchedulerUpdate(vm, priv->backup, QEMU_ASYNC_JOB_BACKUP);
+}
+
+
 /**
  * qemuBackupBeginPullExportDisks:
  * @vm: domain object
@@ -828,6 +1034,9 @@ qemuBackupBegin(virDomainObjPtr vm,
     job_started = true;
     qemuBackupDiskStarted(vm, dd, ndd);
 
+    if (!pull)
+        qemuBackupSchedulerStart(vm, dd, ndd);
+
     if (chk) {
         virDomainMomentObjPtr tmpchk = g_steal_pointer(&chk);
         if (qemuCheckpointCreateFinalize(priv->driver, vm, cfg, tmpchk, true) < 0)
@@ -1010,6 +1219,9 @@ qemuBackupNotifyBlockjobEnd(virDomainObjPtr vm,
     if (has_running && (has_failed || has_cancelled)) {
         /* cancel the rest of the jobs */
         qemuBackupJobCancelBlockjobs(vm, backup, false, asyncJob);
+    } else if (has_running && !has_cancelling) {
+        /* let queued jobs take the place of the finished one */
+        qemuBackupSchedulerUpdate(vm, backup, asyncJob);
     } else if (!has_running && !has_cancelling) {
         /* all sub-jobs have stopped */
 
@@ -498,6 +498,9 @@ qemuBlockJobRefreshJobs(virQEMUDriverPtr driver,
     qemuMonitorJobInfoPtr *jobinfo = NULL;
     size_t njobinfo = 0;
     qemuBlockJobDataPtr job = NULL;
+    g_autofree size_t *invalid = NULL;
+    g_autofree int *cancelled = NULL;
+    size_t ninvalid = 0;
     int newstate;
     size_t i;
     int ret = -1;
@@ -510,36 +513,58 @@ qemuBlockJobRefreshJobs(virQEMUDriverPtr driver,
     if (qemuDomainObjExitMonitor(driver, vm) < 0 || rc < 0)
         goto cleanup;
 
+    invalid = g_new0(size_t, njobinfo);
+    cancelled = g_new0(int, njobinfo);
+
     for (i = 0; i < njobinfo; i++) {
-        if (!(job = virHashLookup(priv->blockjobs, jobinfo[i]->id))) {
-            VIR_DEBUG("ignoring untracked job '%s'", jobinfo[i]->id);
-            continue;
-        }
+        if ((job = virHashLookup(priv->blockjobs, jobinfo[i]->id)) &&
+            job->invalidData)
+            invalid[ninvalid++] = i;
+    }
 
-        /* try cancelling invalid jobs - this works only if the job is not
-         * concluded. In such case it will fail. We'll leave such job linger
-         * in qemu and just forget about it in libvirt because there's not much
-         * we could do besides killing the VM */
-        if (job->invalidData) {
+    /* try cancelling invalid jobs - this works only if the job is not
+     * concluded. In such case it will fail. We'll leave such job linger
+     * in qemu and just forget about it in libvirt because there's not much
+     * we could do besides killing the VM. All of them are cancelled in a
+     * single monitor session. */
+    if (ninvalid > 0) {
+        qemuDomainObjEnterMonitor(driver, vm);
 
-            qemuBlockJobMarkBroken(job);
+        for (i = 0; i < ninvalid; i++)
+            cancelled[i] = qemuMonitorJobCancel(priv->mon,
+                                                jobinfo[invalid[i]]->id, true);
 
-            qemuDomainObjEnterMonitor(driver, vm);
+        if (qemuDomainObjExitMonitor(driver, vm) < 0)
+            goto cleanup;
+    }
 
-            rc = qemuMonitorJobCancel(priv->mon, job->name, true);
-            if (rc == -1 && jobinfo[i]->status == QEMU_MONITOR_JOB_STATUS_CONCLUDED)
-                VIR_WARN("can't cancel job '%s' with invalid data", job->name);
+    for (i = 0; i < ninvalid; i++) {
+        qemuMonitorJobInfoPtr info = jobinfo[invalid[i]];
 
-            if (qemuDomainObjExitMonitor(driver, vm) < 0)
-                goto cleanup;
+        if (!(job = virHashLookup(priv->blockjobs, info->id)))
+            continue;
 
-            if (rc < 0)
-                qemuBlockJobUnregister(job, vm);
-            else
-                job->reconnected = true;
+        qemuBlockJobMarkBroken(job);
+
+        if (cancelled[i] == -1 && info->status == QEMU_MONITOR_JOB_STATUS_CONCLUDED)
+            VIR_WARN("can't cancel job '%s' with invalid data", job->name);
+
+        if (cancelled[i] < 0)
+            qemuBlockJobUnregister(job, vm);
+        else
+            job->reconnected = true;
+    }
+
+    for (i = 0; i < njobinfo; i++) {
+        if (!(job = virHashLookup(priv->blockjobs, jobinfo[i]->id))) {
+            VIR_DEBUG("ignoring untracked job '%s'", jobinfo[i]->id);
             continue;
         }
 
+        /* handled above */
+        if (job->invalidData)
+            continue;
+
         if ((newstate = qemuBlockjobConvertMonitorStatus(jobinfo[i]->status)) < 0)
             continue;
 
@@ -800,12 +825,13 @@ qemuBlockJobEventProcessLegacy(virQEMUDriverPtr driver,
      * to match.  */
     switch ((virConnectDomainEventBlockJobStatus) job->state) {
     case VIR_DOMAIN_BLOCK_JOB_COMPLETED:
+        virStorageFileHeaderCacheInvalidate(disk->src);
         qemuBlockJobEventProcessLegacyCompleted(driver, vm, job, asyncJob);
         break;
 
     case VIR_DOMAIN_BLOCK_JOB_READY:
         disk->mirrorState = VIR_DOMAIN_DISK_MIRROR_STATE_READY;
-        qemuDomainSaveStatus(vm);
+        qemuDomainSaveStatusDeferred(vm);
         break;
 
     case VIR_DOMAIN_BLOCK_JOB_FAILED:
@@ -1652,7 +1678,7 @@ qemuBlockJobEventProcessConcluded(qemuBlockJobDataPtr job,
         job->newstate = QEMU_BLOCKJOB_STATE_CANCELLED;
 
     if (refreshed)
-        qemuDomainSaveStatus(vm);
+        qemuDomainSaveStatusDeferred(vm);
 
     VIR_DEBUG("handling job '%s' state '%d' newstate '%d'", job->name, job->state, job->newstate);
 
@@ -1691,6 +1717,9 @@ qemuBlockJobEventProcess(virQEMUDriverPtr driver,
     case QEMU_BLOCKJOB_STATE_FAILED:
     case QEMU_BLOCKJOB_STATE_CANCELLED:
     case QEMU_BLOCKJOB_STATE_CONCLUDED:
+        /* the job may have rewritten images of the chain */
+        if (job->disk)
+            virStorageFileHeaderCacheInvalidate(job->disk->src);
         qemuBlockJobEventProcessConcluded(job, driver, vm, asyncJob);
         break;
 
@@ -1702,7 +1731,7 @@ qemuBlockJobEventProcess(virQEMUDriverPtr driver,
         }
         job->state = job->newstate;
         job->newstate = -1;
-        qemuDomainSaveStatus(vm);
+        qemuDomainSaveStatusDeferred(vm);
         break;
 
     case QEMU_BLOCKJOB_STATE_NEW:
@@ -1847,3 +1876,167 @@ qemuBlockjobConvertMonitorStatus(int monitorstatus)
     return ret;
 
 }
+
+
+/* Jobs with adaptive speed start at this speed, in bytes/s, and are never
+ * slowed down below the minimum so that they still make progress */
+#define QEMU_BLOCKJOB_AUTOTUNE_START_SPEED (64ULL * 1024 * 1024)
+#define QEMU_BLOCKJOB_AUTOTUNE_MIN_SPEED (1024ULL * 1024)
+
+
+/**
+ * qemuBlockJobAutotuneStartSpeed:
+ * @max: upper bound of the speed in bytes/s, 0 if there's none
+ *
+ * Returns the speed a job switched to adaptive speed starts at.
+ */
+unsigned long long
+qemuBlockJobAutotuneStartSpeed(unsigned long long max)
+{
+    if (max > 0)
+        return MIN(max, QEMU_BLOCKJOB_AUTOTUNE_START_SPEED);
+
+    return QEMU_BLOCKJOB_AUTOTUNE_START_SPEED;
+}
+
+
+/**
+ * qemuBlockJobAutotuneNextSpeed:
+ * @speed: current speed of the job in bytes/s
+ * @max: upper bound of the speed in bytes/s, 0 if there's none
+ * @latency: average latency of guest requests since the previous pass in us
+ * @target: latency target in us
+ *
+ * Halves the speed when the guest requests are slower than @target and
+ * increases it by a quarter once they are well below it, the band in
+ * between keeps the speed from oscillating.
+ *
+ * Returns the new speed of the job.
+ */
+static unsigned long long
+qemuBlockJobAutotuneNextSpeed(unsigned long long speed,
+                              unsigned long long max,
+                              unsigned long long latency,
+                              unsigned int target)
+{
+    unsigned long long next;
+
+    if (latency > target)
+        next = speed / 2;
+    else if (latency * 10 <= target * 8ULL)
+        next = speed + MAX(speed / 4, QEMU_BLOCKJOB_AUTOTUNE_MIN_SPEED);
+    else
+        return speed;
+
+    next = MAX(next, QEMU_BLOCKJOB_AUTOTUNE_MIN_SPEED);
+    if (max > 0)
+        next = MIN(next, max);
+
+    return next;
+}
+
+
+/**
+ * qemuBlockJobAutotune:
+ * @driver: qemu driver
+ * @vm: domain object
+ * @target: latency target in us
+ *
+ * Adjusts the speed of the block jobs of @vm with adaptive speed based on
+ * the average latency of guest requests to the disk of each job since the
+ * previous call. The caller must hold a modify job on @vm.
+ */
+void
+qemuBlockJobAutotune(virQEMUDriverPtr driver,
+                     virDomainObjPtr vm,
+                     unsigned int target)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    bool blockdev = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV);
+    g_autoptr(virHashTable) stats = NULL;
+    bool changed = false;
+    size_t i;
+
+    for (i = 0; i < vm->def->ndisks; i++) {
+        virDomainDiskDefPtr disk = vm->def->disks[i];
+        g_autoptr(qemuBlockJobData) job = NULL;
+        qemuBlockJobAutotunePtr tune;
+        qemuBlockStatsPtr entry;
+        const char *entryname = disk->info.alias;
+        unsigned long long reqs;
+        unsigned long long totalTimeNs;
+        unsigned long long latency = 0;
+        unsigned long long next;
+        bool sampled;
+        int rc;
+
+        if (!(job = qemuBlockJobDiskGetJob(disk)) ||
+            !job->autotune.enabled ||
+            (job->state != QEMU_BLOCKJOB_STATE_RUNNING &&
+             job->state != QEMU_BLOCKJOB_STATE_READY))
+            continue;
+
+        tune = &job->autotune;
+
+        if (!stats) {
+            qemuDomainObjEnterMonitor(driver, vm);
+            rc = qemuMonitorGetAllBlockStatsInfo(priv->mon, &stats, false);
+            if (qemuDomainObjExitMonitor(driver, vm) < 0 || rc < 0)
+                goto cleanup;
+        }
+
+        if (blockdev && QEMU_DOMAIN_DISK_PRIVATE(disk)->qomName)
+            entryname = QEMU_DOMAIN_DISK_PRIVATE(disk)->qomName;
+
+        if (!entryname || !(entry = virHashLookup(stats, entryname)))
+            continue;
+
+        reqs = entry->rd_req + entry->wr_req + entry->flush_req;
+        totalTimeNs = entry->rd_total_times + entry->wr_total_times +
+                      entry->flush_total_times;
+
+        sampled = tune->sampled &&
+                  reqs >= tune->reqs &&
+                  totalTimeNs >= tune->totalTimeNs;
+
+        if (sampled && reqs > tune->reqs)
+            latency = (totalTimeNs - tune->totalTimeNs) / (reqs - tune->reqs) / 1000;
+
+        tune->sampled = true;
+        tune->reqs = reqs;
+        tune->totalTimeNs = totalTimeNs;
+
+        /* first sample or the counters were reset */
+        if (!sampled)
+            continue;
+
+        next = qemuBlockJobAutotuneNextSpeed(tune->speed, tune->max,
+                                             latency, target);
+
+        if (next == tune->speed)
+            continue;
+
+        VIR_DEBUG("block job '%s': guest latency %llu us, target %u us, "
+                  "speed %llu -> %llu bytes/s",
+                  job->name, latency, target, tune->speed, next);
+
+        qemuDomainObjEnterMonitor(driver, vm);
+        rc = qemuMonitorBlockJobSetSpeed(priv->mon, job->name, next);
+        if (qemuDomainObjExitMonitor(driver, vm) < 0)
+            goto cleanup;
+
+        if (rc < 0) {
+            VIR_WARN("Unable to adjust speed of block job '%s': %s",
+                     job->name, virGetLastErrorMessage());
+            virResetLastError();
+            continue;
+        }
+
+        tune->speed = next;
+        changed = true;
+    }
+
+ cleanup:
+    if (changed)
+        qemuDomainSaveStatus(vm);
+}
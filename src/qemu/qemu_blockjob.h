@@ -117,6 +117,21 @@ struct _qemuBlockJobBackupData {
 };
 
 
+typedef struct _qemuBlockJobAutotune qemuBlockJobAutotune;
+typedef qemuBlockJobAutotune *qemuBlockJobAutotunePtr;
+
+struct _qemuBlockJobAutotune {
+    bool enabled;
+    unsigned long long max; /* upper bound of the speed in bytes/s, 0 if none */
+    unsigned long long speed; /* speed last set by libvirt in bytes/s */
+
+    /* guest request counters of the disk seen by the previous pass */
+    bool sampled;
+    unsigned long long reqs;
+    unsigned long long totalTimeNs;
+};
+
+
 typedef struct _qemuBlockJobData qemuBlockJobData;
 typedef qemuBlockJobData *qemuBlockJobDataPtr;
 
@@ -145,6 +160,8 @@ struct _qemuBlockJobData {
     char *errmsg;
     bool synchronous; /* API call is waiting for this job */
 
+    qemuBlockJobAutotune autotune; /* adaptive speed of the job */
+
     int newstate; /* qemuBlockjobState, subset of events emitted by qemu */
 
     int brokentype; /* the previous type of a broken blockjob qemuBlockJobType */
@@ -245,3 +262,11 @@ qemuBlockJobGetByDisk(virDomainDiskDefPtr disk)
 
 qemuBlockjobState
 qemuBlockjobConvertMonitorStatus(int monitorstatus);
+
+unsigned long long
+qemuBlockJobAutotuneStartSpeed(unsigned long long max);
+
+void
+qemuBlockJobAutotune(virQEMUDriverPtr driver,
+                     virDomainObjPtr vm,
+                     unsigned int target);
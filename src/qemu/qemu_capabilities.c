@@ -597,6 +597,13 @@ VIR_ENUM_IMPL(virQEMUCaps,
               "spapr-tpm-proxy",
               "numa.hmat",
               "blockdev-hostdev-scsi",
+
+              /* 380 */
+              "memory-backend.prealloc-threads",
+              "calc-dirty-rate",
+              "virtio-balloon.free-page-reporting",
+              "virtio-net.rss",
+              "virtio-net.hash-report",
     );
 
 
@@ -1167,6 +1174,7 @@ struct virQEMUCapsStringFlags virQEMUCapsCommands[] = {
     { "block-dirty-bitmap-merge", QEMU_CAPS_BITMAP_MERGE },
     { "query-cpu-model-baseline", QEMU_CAPS_QUERY_CPU_MODEL_BASELINE },
     { "query-cpu-model-comparison", QEMU_CAPS_QUERY_CPU_MODEL_COMPARISON },
+    { "calc-dirty-rate", QEMU_CAPS_CALC_DIRTY_RATE },
 };
 
 struct virQEMUCapsStringFlags virQEMUCapsMigration[] = {
@@ -1339,6 +1347,7 @@ static struct virQEMUCapsDevicePropsFlags virQEMUCapsDevicePropsVirtioBalloon[]
     { "iommu_platform", QEMU_CAPS_VIRTIO_PCI_IOMMU_PLATFORM, NULL },
     { "ats", QEMU_CAPS_VIRTIO_PCI_ATS, NULL },
     { "packed", QEMU_CAPS_VIRTIO_PACKED_QUEUES, NULL },
+    { "free-page-reporting", QEMU_CAPS_VIRTIO_BALLOON_FREE_PAGE_REPORTING, NULL },
 };
 
 
@@ -1384,6 +1393,8 @@ static struct virQEMUCapsDevicePropsFlags virQEMUCapsDevicePropsVirtioNet[] = {
     { "ats", QEMU_CAPS_VIRTIO_PCI_ATS, NULL },
     { "failover", QEMU_CAPS_VIRTIO_NET_FAILOVER, NULL },
     { "packed", QEMU_CAPS_VIRTIO_PACKED_QUEUES, NULL },
+    { "rss", QEMU_CAPS_VIRTIO_NET_RSS, NULL },
+    { "hash", QEMU_CAPS_VIRTIO_NET_HASH_REPORT, NULL },
 };
 
 static struct virQEMUCapsDevicePropsFlags virQEMUCapsDevicePropsPCIeRootPort[] = {
@@ -1654,6 +1665,7 @@ static struct virQEMUCapsStringFlags virQEMUCapsObjectPropsMemoryBackendFile[] =
     { "discard-data", QEMU_CAPS_OBJECT_MEMORY_FILE_DISCARD },
     { "align", QEMU_CAPS_OBJECT_MEMORY_FILE_ALIGN },
     { "pmem", QEMU_CAPS_OBJECT_MEMORY_FILE_PMEM },
+    { "prealloc-threads", QEMU_CAPS_OBJECT_MEMORY_PREALLOC_THREADS },
 };
 
 static struct virQEMUCapsStringFlags virQEMUCapsObjectPropsMemoryBackendMemfd[] = {
@@ -2145,6 +2157,24 @@ struct virQEMUCapsSearchDomcapsData {
 };
 
 
+static int
+virQEMUCapsSearchDomcapsCPUModels(const void *payload,
+                                  const void *name G_GNUC_UNUSED,
+                                  const void *opaque)
+{
+    virDomainCapsPtr domCaps = (virDomainCapsPtr) payload;
+    struct virQEMUCapsSearchDomcapsData *data = (struct virQEMUCapsSearchDomcapsData *) opaque;
+
+    if (STREQ_NULLABLE(data->path, domCaps->path) &&
+        data->arch == domCaps->arch &&
+        data->virttype == domCaps->virttype &&
+        domCaps->cpu.custom)
+        return 1;
+
+    return 0;
+}
+
+
 static int
 virQEMUCapsSearchDomcaps(const void *payload,
                          const void *name G_GNUC_UNUSED,
@@ -2190,12 +2220,23 @@ virQEMUCapsGetDomainCapsCache(virQEMUCapsPtr qemuCaps,
     if (!domCaps) {
         g_autoptr(virDomainCaps) tempDomCaps = NULL;
         g_autofree char *key = NULL;
+        virDomainCapsPtr sibling;
 
         /* hash miss, build new domcaps */
         if (!(tempDomCaps = virDomainCapsNew(path, machine,
                                              arch, virttype)))
             goto cleanup;
 
+        /* Usable CPU models do not depend on the machine type, the immutable
+         * list can be shared with domcaps of any other machine type. */
+        if (virQEMUCapsIsCPUModeSupported(qemuCaps, hostarch, virttype,
+                                          VIR_CPU_MODE_CUSTOM, machine) &&
+            (sibling = virHashSearch(cache->cache,
+                                     virQEMUCapsSearchDomcapsCPUModels,
+                                     &data, NULL))) {
+            tempDomCaps->cpu.custom = virObjectRef(sibling->cpu.custom);
+        }
+
         if (virQEMUCapsFillDomainCaps(qemuCaps, hostarch, tempDomCaps,
                                       privileged, firmwares, nfirmwares) < 0)
             goto cleanup;
@@ -4690,6 +4731,7 @@ virQEMUCapsSaveFile(void *data,
                     void *privData G_GNUC_UNUSED)
 {
     virQEMUCapsPtr qemuCaps = data;
+    g_autofree char *binFile = NULL;
     char *xml = NULL;
     int ret = -1;
 
@@ -4707,6 +4749,15 @@ virQEMUCapsSaveFile(void *data,
               (long long)qemuCaps->ctime,
               (long long)qemuCaps->libvirtCtime);
 
+    /* the XML file is enough to load the capabilities again */
+    binFile = virQEMUCapsGetBinaryCacheName(filename);
+    if (virQEMUCapsSaveBinaryCache(qemuCaps, binFile, filename) < 0) {
+        VIR_WARN("Failed to save binary caps '%s' for '%s': %s",
+                 binFile, qemuCaps->binary, virGetLastErrorMessage());
+        virResetLastError();
+        unlink(binFile);
+    }
+
     ret = 0;
  cleanup:
     VIR_FREE(xml);
@@ -4714,6 +4765,670 @@ virQEMUCapsSaveFile(void *data,
 }
 
 
+/*
+ * Binary capabilities cache
+ *
+ * Next to each XML file in the capabilities cache a binary copy with the
+ * same base name and a ".bin" suffix is stored. It is mapped into memory
+ * and decoded without libxml2, which makes loading the cache considerably
+ * cheaper on hosts with many emulator binaries. The XML file stays the
+ * authoritative copy: the binary one is used only if its header matches
+ * the size and modification time of the XML file it was written
+ * together with, otherwise the XML file is parsed and the binary copy is
+ * rewritten.
+ *
+ * All numbers are stored in host byte order as either 32 or 64 bit
+ * unsigned integers, strings as a 32 bit length followed by the bytes
+ * and a terminating NUL byte. VIR_QEMU_CAPS_BINARY_NULL as length denotes
+ * a NULL string. The cache is never shared between hosts.
+ */
+
+#define VIR_QEMU_CAPS_BINARY_MAGIC "LVQCAPSB"
+#define VIR_QEMU_CAPS_BINARY_VERSION 1
+#define VIR_QEMU_CAPS_BINARY_BYTEORDER 0x01020304
+#define VIR_QEMU_CAPS_BINARY_NULL UINT32_MAX
+
+typedef struct _virQEMUCapsBinaryHeader virQEMUCapsBinaryHeader;
+struct _virQEMUCapsBinaryHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteorder;
+    uint64_t libvirtVersion;
+    uint64_t libvirtCtime;
+    uint64_t xmlSize;
+    uint64_t xmlMtime;
+    uint64_t payloadSize;
+};
+
+typedef struct _virQEMUCapsBinaryReader virQEMUCapsBinaryReader;
+typedef virQEMUCapsBinaryReader *virQEMUCapsBinaryReaderPtr;
+struct _virQEMUCapsBinaryReader {
+    const char *data;
+    size_t len;
+    size_t pos;
+};
+
+
+char *
+virQEMUCapsGetBinaryCacheName(const char *filename)
+{
+    const char *suffix = strrchr(filename, '.');
+    size_t len = strlen(filename);
+
+    if (suffix && !strchr(suffix, '/'))
+        len = suffix - filename;
+
+    return g_strdup_printf("%.*s.bin", (int)len, filename);
+}
+
+
+static void
+virQEMUCapsBinaryWriteUInt(GByteArray *buf,
+                           uint32_t val)
+{
+    g_byte_array_append(buf, (const guint8 *)&val, sizeof(val));
+}
+
+
+static void
+virQEMUCapsBinaryWriteULL(GByteArray *buf,
+                          uint64_t val)
+{
+    g_byte_array_append(buf, (const guint8 *)&val, sizeof(val));
+}
+
+
+static void
+virQEMUCapsBinaryWriteString(GByteArray *buf,
+                             const char *str)
+{
+    if (!str) {
+        virQEMUCapsBinaryWriteUInt(buf, VIR_QEMU_CAPS_BINARY_NULL);
+        return;
+    }
+
+    virQEMUCapsBinaryWriteUInt(buf, strlen(str));
+    g_byte_array_append(buf, (const guint8 *)str, strlen(str) + 1);
+}
+
+
+static int
+virQEMUCapsBinaryRead(virQEMUCapsBinaryReaderPtr rd,
+                      void *dst,
+                      size_t len)
+{
+    if (len > rd->len - rd->pos)
+        return -1;
+
+    memcpy(dst, rd->data + rd->pos, len);
+    rd->pos += len;
+    return 0;
+}
+
+
+static int
+virQEMUCapsBinaryReadUInt(virQEMUCapsBinaryReaderPtr rd,
+                          unsigned int *val)
+{
+    uint32_t tmp;
+
+    if (virQEMUCapsBinaryRead(rd, &tmp, sizeof(tmp)) < 0)
+        return -1;
+
+    *val = tmp;
+    return 0;
+}
+
+
+static int
+virQEMUCapsBinaryReadBool(virQEMUCapsBinaryReaderPtr rd,
+                          bool *val)
+{
+    unsigned int tmp;
+
+    if (virQEMUCapsBinaryReadUInt(rd, &tmp) < 0 || tmp > 1)
+        return -1;
+
+    *val = tmp == 1;
+    return 0;
+}
+
+
+static int
+virQEMUCapsBinaryReadULL(virQEMUCapsBinaryReaderPtr rd,
+                         unsigned long long *val)
+{
+    uint64_t tmp;
+
+    if (virQEMUCapsBinaryRead(rd, &tmp, sizeof(tmp)) < 0)
+        return -1;
+
+    *val = tmp;
+    return 0;
+}
+
+
+static int
+virQEMUCapsBinaryReadString(virQEMUCapsBinaryReaderPtr rd,
+                            char **str)
+{
+    uint32_t len;
+
+    if (virQEMUCapsBinaryRead(rd, &len, sizeof(len)) < 0)
+        return -1;
+
+    if (len == VIR_QEMU_CAPS_BINARY_NULL) {
+        *str = NULL;
+        return 0;
+    }
+
+    if (len >= rd->len - rd->pos || rd->data[rd->pos + len] != '\0')
+        return -1;
+
+    *str = g_strndup(rd->data + rd->pos, len);
+    rd->pos += len + 1;
+    return 0;
+}
+
+
+static void
+virQEMUCapsFormatBinaryAccel(virQEMUCapsPtr qemuCaps,
+                             GByteArray *buf,
+                             virDomainVirtType type)
+{
+    virQEMUCapsAccelPtr caps = virQEMUCapsGetAccel(qemuCaps, type);
+    qemuMonitorCPUModelInfoPtr model = caps->hostCPU.info;
+    qemuMonitorCPUDefsPtr defs = caps->cpuModels;
+    size_t i;
+    size_t j;
+
+    virQEMUCapsBinaryWriteUInt(buf, !!model);
+    if (model) {
+        virQEMUCapsBinaryWriteString(buf, model->name);
+        virQEMUCapsBinaryWriteUInt(buf, model->migratability);
+        virQEMUCapsBinaryWriteUInt(buf, model->nprops);
+
+        for (i = 0; i < model->nprops; i++) {
+            qemuMonitorCPUPropertyPtr prop = model->props + i;
+
+            virQEMUCapsBinaryWriteString(buf, prop->name);
+            virQEMUCapsBinaryWriteUInt(buf, prop->type);
+            virQEMUCapsBinaryWriteUInt(buf, prop->migratable);
+
+            switch (prop->type) {
+            case QEMU_MONITOR_CPU_PROPERTY_BOOLEAN:
+                virQEMUCapsBinaryWriteUInt(buf, prop->value.boolean);
+                break;
+
+            case QEMU_MONITOR_CPU_PROPERTY_STRING:
+                virQEMUCapsBinaryWriteString(buf, prop->value.string);
+                break;
+
+            case QEMU_MONITOR_CPU_PROPERTY_NUMBER:
+                virQEMUCapsBinaryWriteULL(buf, prop->value.number);
+                break;
+
+            case QEMU_MONITOR_CPU_PROPERTY_LAST:
+                break;
+            }
+        }
+    }
+
+    virQEMUCapsBinaryWriteUInt(buf, defs ? defs->ncpus : 0);
+    for (i = 0; defs && i < defs->ncpus; i++) {
+        qemuMonitorCPUDefInfoPtr cpu = defs->cpus + i;
+        size_t nblockers = cpu->blockers ? g_strv_length(cpu->blockers) : 0;
+
+        virQEMUCapsBinaryWriteString(buf, cpu->name);
+        virQEMUCapsBinaryWriteString(buf, cpu->type);
+        virQEMUCapsBinaryWriteUInt(buf, cpu->usable);
+        virQEMUCapsBinaryWriteUInt(buf, nblockers);
+        for (j = 0; j < nblockers; j++)
+            virQEMUCapsBinaryWriteString(buf, cpu->blockers[j]);
+    }
+
+    virQEMUCapsBinaryWriteUInt(buf, caps->nmachineTypes);
+    for (i = 0; i < caps->nmachineTypes; i++) {
+        virQEMUCapsMachineTypePtr machine = caps->machineTypes + i;
+
+        virQEMUCapsBinaryWriteString(buf, machine->name);
+        virQEMUCapsBinaryWriteString(buf, machine->alias);
+        virQEMUCapsBinaryWriteString(buf, machine->defaultCPU);
+        virQEMUCapsBinaryWriteUInt(buf, machine->maxCpus);
+        virQEMUCapsBinaryWriteUInt(buf, machine->hotplugCpus);
+        virQEMUCapsBinaryWriteUInt(buf, machine->qemuDefault);
+        virQEMUCapsBinaryWriteUInt(buf, machine->numaMemSupported);
+    }
+}
+
+
+static int
+virQEMUCapsLoadBinaryAccel(virQEMUCapsPtr qemuCaps,
+                           virQEMUCapsBinaryReaderPtr rd,
+                           virDomainVirtType type)
+{
+    virQEMUCapsAccelPtr caps = virQEMUCapsGetAccel(qemuCaps, type);
+    g_autoptr(qemuMonitorCPUDefs) defs = NULL;
+    qemuMonitorCPUModelInfoPtr model = NULL;
+    unsigned long long number;
+    unsigned int val;
+    unsigned int n;
+    size_t i;
+    size_t j;
+
+    if (virQEMUCapsBinaryReadUInt(rd, &val) < 0)
+        return -1;
+
+    if (val) {
+        model = g_new0(qemuMonitorCPUModelInfo, 1);
+        caps->hostCPU.info = model;
+
+        if (virQEMUCapsBinaryReadString(rd, &model->name) < 0 ||
+            !model->name ||
+            virQEMUCapsBinaryReadBool(rd, &model->migratability) < 0 ||
+            virQEMUCapsBinaryReadUInt(rd, &n) < 0 ||
+            n > rd->len)
+            return -1;
+
+        model->props = g_new0(qemuMonitorCPUProperty, n);
+        model->nprops = n;
+
+        for (i = 0; i < model->nprops; i++) {
+            qemuMonitorCPUPropertyPtr prop = model->props + i;
+
+            if (virQEMUCapsBinaryReadString(rd, &prop->name) < 0 ||
+                !prop->name ||
+                virQEMUCapsBinaryReadUInt(rd, &val) < 0 ||
+                val >= QEMU_MONITOR_CPU_PROPERTY_LAST)
+                return -1;
+            prop->type = val;
+
+            if (virQEMUCapsBinaryReadUInt(rd, &val) < 0 ||
+                val >= VIR_TRISTATE_BOOL_LAST)
+                return -1;
+            prop->migratable = val;
+
+            switch (prop->type) {
+            case QEMU_MONITOR_CPU_PROPERTY_BOOLEAN:
+                if (virQEMUCapsBinaryReadBool(rd, &prop->value.boolean) < 0)
+                    return -1;
+                break;
+
+            case QEMU_MONITOR_CPU_PROPERTY_STRING:
+                if (virQEMUCapsBinaryReadString(rd, &prop->value.string) < 0 ||
+                    !prop->value.string)
+                    return -1;
+                break;
+
+            case QEMU_MONITOR_CPU_PROPERTY_NUMBER:
+                if (virQEMUCapsBinaryReadULL(rd, &number) < 0)
+                    return -1;
+                prop->value.number = number;
+                break;
+
+            case QEMU_MONITOR_CPU_PROPERTY_LAST:
+                break;
+            }
+        }
+    }
+
+    if (virQEMUCapsBinaryReadUInt(rd, &n) < 0 || n > rd->len)
+        return -1;
+
+    if (n > 0) {
+        if (!(defs = qemuMonitorCPUDefsNew(n)))
+            return -1;
+
+        for (i = 0; i < defs->ncpus; i++) {
+            qemuMonitorCPUDefInfoPtr cpu = defs->cpus + i;
+            unsigned int nblockers;
+
+            if (virQEMUCapsBinaryReadString(rd, &cpu->name) < 0 ||
+                !cpu->name ||
+                virQEMUCapsBinaryReadString(rd, &cpu->type) < 0 ||
+                virQEMUCapsBinaryReadUInt(rd, &val) < 0 ||
+                val >= VIR_DOMCAPS_CPU_USABLE_LAST ||
+                virQEMUCapsBinaryReadUInt(rd, &nblockers) < 0 ||
+                nblockers > rd->len)
+                return -1;
+            cpu->usable = val;
+
+            if (nblockers > 0) {
+                cpu->blockers = g_new0(char *, nblockers + 1);
+
+                for (j = 0; j < nblockers; j++) {
+                    if (virQEMUCapsBinaryReadString(rd, &cpu->blockers[j]) < 0 ||
+                        !cpu->blockers[j])
+                        return -1;
+                }
+            }
+        }
+
+        caps->cpuModels = g_steal_pointer(&defs);
+    }
+
+    if (virQEMUCapsBinaryReadUInt(rd, &n) < 0 || n > rd->len)
+        return -1;
+
+    if (n > 0) {
+        caps->machineTypes = g_new0(virQEMUCapsMachineType, n);
+        caps->nmachineTypes = n;
+
+        for (i = 0; i < caps->nmachineTypes; i++) {
+            virQEMUCapsMachineTypePtr machine = caps->machineTypes + i;
+
+            if (virQEMUCapsBinaryReadString(rd, &machine->name) < 0 ||
+                !machine->name ||
+                virQEMUCapsBinaryReadString(rd, &machine->alias) < 0 ||
+                virQEMUCapsBinaryReadString(rd, &machine->defaultCPU) < 0 ||
+                virQEMUCapsBinaryReadUInt(rd, &machine->maxCpus) < 0 ||
+                virQEMUCapsBinaryReadBool(rd, &machine->hotplugCpus) < 0 ||
+                virQEMUCapsBinaryReadBool(rd, &machine->qemuDefault) < 0 ||
+                virQEMUCapsBinaryReadBool(rd, &machine->numaMemSupported) < 0)
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * virQEMUCapsFormatBinaryCache:
+ * @qemuCaps: capabilities to format
+ * @xmlFilename: XML cache file written together with the binary one or NULL
+ * @len: filled in with the size of the returned buffer
+ *
+ * Formats @qemuCaps into the binary cache format. If @xmlFilename is
+ * not NULL, its size and modification time are recorded in the header
+ * so that the binary copy is ignored once the XML file changes.
+ *
+ * Returns a newly allocated buffer or NULL on error.
+ */
+char *
+virQEMUCapsFormatBinaryCache(virQEMUCapsPtr qemuCaps,
+                             const char *xmlFilename,
+                             size_t *len)
+{
+    g_autoptr(GByteArray) buf = g_byte_array_new();
+    virQEMUCapsBinaryHeader hdr = { 0 };
+    struct stat sb;
+    size_t i;
+
+    memcpy(hdr.magic, VIR_QEMU_CAPS_BINARY_MAGIC, sizeof(hdr.magic));
+    hdr.version = VIR_QEMU_CAPS_BINARY_VERSION;
+    hdr.byteorder = VIR_QEMU_CAPS_BINARY_BYTEORDER;
+    hdr.libvirtVersion = qemuCaps->libvirtVersion;
+    hdr.libvirtCtime = qemuCaps->libvirtCtime;
+
+    if (xmlFilename) {
+        if (stat(xmlFilename, &sb) < 0) {
+            virReportSystemError(errno, _("cannot stat '%s'"), xmlFilename);
+            return NULL;
+        }
+        hdr.xmlSize = sb.st_size;
+        hdr.xmlMtime = sb.st_mtime;
+    }
+
+    g_byte_array_append(buf, (const guint8 *)&hdr, sizeof(hdr));
+
+    virQEMUCapsBinaryWriteString(buf, qemuCaps->binary);
+    virQEMUCapsBinaryWriteULL(buf, qemuCaps->ctime);
+
+    virQEMUCapsBinaryWriteUInt(buf, QEMU_CAPS_LAST);
+    for (i = 0; i < QEMU_CAPS_LAST; i++)
+        g_byte_array_append(buf, (const guint8 *)(virQEMUCapsGet(qemuCaps, i) ? "\1" : "\0"), 1);
+
+    virQEMUCapsBinaryWriteUInt(buf, qemuCaps->version);
+    virQEMUCapsBinaryWriteUInt(buf, qemuCaps->kvmVersion);
+    virQEMUCapsBinaryWriteUInt(buf, qemuCaps->microcodeVersion);
+    virQEMUCapsBinaryWriteString(buf, qemuCaps->hostCPUSignature);
+    virQEMUCapsBinaryWriteString(buf, qemuCaps->package);
+    virQEMUCapsBinaryWriteString(buf, qemuCaps->kernelVersion);
+    virQEMUCapsBinaryWriteUInt(buf, qemuCaps->arch);
+
+    virQEMUCapsFormatBinaryAccel(qemuCaps, buf, VIR_DOMAIN_VIRT_KVM);
+    virQEMUCapsFormatBinaryAccel(qemuCaps, buf, VIR_DOMAIN_VIRT_QEMU);
+
+    virQEMUCapsBinaryWriteUInt(buf, qemuCaps->ngicCapabilities);
+    for (i = 0; i < qemuCaps->ngicCapabilities; i++) {
+        virQEMUCapsBinaryWriteUInt(buf, qemuCaps->gicCapabilities[i].version);
+        virQEMUCapsBinaryWriteUInt(buf, qemuCaps->gicCapabilities[i].implementation);
+    }
+
+    virQEMUCapsBinaryWriteUInt(buf, !!qemuCaps->sevCapabilities);
+    if (qemuCaps->sevCapabilities) {
+        virSEVCapabilityPtr sev = qemuCaps->sevCapabilities;
+
+        virQEMUCapsBinaryWriteUInt(buf, sev->cbitpos);
+        virQEMUCapsBinaryWriteUInt(buf, sev->reduced_phys_bits);
+        virQEMUCapsBinaryWriteString(buf, sev->pdh);
+        virQEMUCapsBinaryWriteString(buf, sev->cert_chain);
+    }
+
+    virQEMUCapsBinaryWriteUInt(buf, qemuCaps->kvmSupportsNesting);
+    virQEMUCapsBinaryWriteUInt(buf, qemuCaps->kvmSupportsSecureGuest);
+
+    ((virQEMUCapsBinaryHeader *)buf->data)->payloadSize = buf->len - sizeof(hdr);
+
+    *len = buf->len;
+    return (char *)g_byte_array_free(g_steal_pointer(&buf), FALSE);
+}
+
+
+static int
+virQEMUCapsLoadBinaryPayload(virQEMUCapsPtr qemuCaps,
+                             virQEMUCapsBinaryReaderPtr rd)
+{
+    g_autofree char *binary = NULL;
+    unsigned long long ull;
+    unsigned int val;
+    unsigned int n;
+    size_t i;
+
+    if (virQEMUCapsBinaryReadString(rd, &binary) < 0 ||
+        STRNEQ_NULLABLE(binary, qemuCaps->binary))
+        return -1;
+
+    if (virQEMUCapsBinaryReadULL(rd, &ull) < 0)
+        return -1;
+    qemuCaps->ctime = ull;
+
+    if (virQEMUCapsBinaryReadUInt(rd, &n) < 0 || n != QEMU_CAPS_LAST ||
+        n > rd->len - rd->pos)
+        return -1;
+
+    for (i = 0; i < n; i++) {
+        if (rd->data[rd->pos + i])
+            virQEMUCapsSet(qemuCaps, i);
+    }
+    rd->pos += n;
+
+    if (virQEMUCapsBinaryReadUInt(rd, &qemuCaps->version) < 0 ||
+        virQEMUCapsBinaryReadUInt(rd, &qemuCaps->kvmVersion) < 0 ||
+        virQEMUCapsBinaryReadUInt(rd, &qemuCaps->microcodeVersion) < 0 ||
+        virQEMUCapsBinaryReadString(rd, &qemuCaps->hostCPUSignature) < 0 ||
+        virQEMUCapsBinaryReadString(rd, &qemuCaps->package) < 0 ||
+        virQEMUCapsBinaryReadString(rd, &qemuCaps->kernelVersion) < 0 ||
+        virQEMUCapsBinaryReadUInt(rd, &val) < 0 ||
+        val == VIR_ARCH_NONE || val >= VIR_ARCH_LAST)
+        return -1;
+    qemuCaps->arch = val;
+
+    if (virQEMUCapsLoadBinaryAccel(qemuCaps, rd, VIR_DOMAIN_VIRT_KVM) < 0 ||
+        virQEMUCapsLoadBinaryAccel(qemuCaps, rd, VIR_DOMAIN_VIRT_QEMU) < 0)
+        return -1;
+
+    if (virQEMUCapsBinaryReadUInt(rd, &n) < 0 || n > rd->len)
+        return -1;
+
+    if (n > 0) {
+        qemuCaps->gicCapabilities = g_new0(virGICCapability, n);
+        qemuCaps->ngicCapabilities = n;
+
+        for (i = 0; i < n; i++) {
+            virGICCapabilityPtr cap = qemuCaps->gicCapabilities + i;
+
+            if (virQEMUCapsBinaryReadUInt(rd, &val) < 0)
+                return -1;
+            cap->version = val;
+
+            if (virQEMUCapsBinaryReadUInt(rd, &val) < 0)
+                return -1;
+            cap->implementation = val;
+        }
+    }
+
+    if (virQEMUCapsBinaryReadUInt(rd, &val) < 0)
+        return -1;
+
+    if (val) {
+        virSEVCapabilityPtr sev = g_new0(virSEVCapability, 1);
+
+        qemuCaps->sevCapabilities = sev;
+
+        if (virQEMUCapsBinaryReadUInt(rd, &sev->cbitpos) < 0 ||
+            virQEMUCapsBinaryReadUInt(rd, &sev->reduced_phys_bits) < 0 ||
+            virQEMUCapsBinaryReadString(rd, &sev->pdh) < 0 ||
+            virQEMUCapsBinaryReadString(rd, &sev->cert_chain) < 0)
+            return -1;
+    }
+
+    if (virQEMUCapsBinaryReadBool(rd, &qemuCaps->kvmSupportsNesting) < 0 ||
+        virQEMUCapsBinaryReadBool(rd, &qemuCaps->kvmSupportsSecureGuest) < 0)
+        return -1;
+
+    if (rd->pos != rd->len)
+        return -1;
+
+    return 0;
+}
+
+
+/**
+ * virQEMUCapsLoadBinaryCache:
+ * @hostArch: host architecture
+ * @qemuCaps: freshly created capabilities to fill in
+ * @filename: binary cache file
+ * @xmlFilename: XML cache file the binary one must match or NULL
+ * @skipInvalidation: don't check libvirt version and modification time
+ *
+ * Loads capabilities from a binary cache file written by
+ * virQEMUCapsSaveBinaryCache. @qemuCaps may be partially filled in if
+ * anything but 0 is returned and must not be used then.
+ *
+ * Returns 0 on success, 1 if the file is missing, outdated or doesn't
+ * match @xmlFilename, -1 on error.
+ */
+int
+virQEMUCapsLoadBinaryCache(virArch hostArch,
+                           virQEMUCapsPtr qemuCaps,
+                           const char *filename,
+                           const char *xmlFilename,
+                           bool skipInvalidation)
+{
+    g_autoptr(GMappedFile) map = NULL;
+    g_autoptr(GError) err = NULL;
+    virQEMUCapsBinaryHeader hdr;
+    virQEMUCapsBinaryReader rd = { 0 };
+    struct stat sb;
+
+    if (!(map = g_mapped_file_new(filename, FALSE, &err))) {
+        VIR_DEBUG("No binary capabilities cache '%s' for '%s': %s",
+                  filename, qemuCaps->binary, err->message);
+        return 1;
+    }
+
+    rd.data = g_mapped_file_get_contents(map);
+    rd.len = g_mapped_file_get_length(map);
+
+    if (virQEMUCapsBinaryRead(&rd, &hdr, sizeof(hdr)) < 0 ||
+        memcmp(hdr.magic, VIR_QEMU_CAPS_BINARY_MAGIC, sizeof(hdr.magic)) != 0 ||
+        hdr.byteorder != VIR_QEMU_CAPS_BINARY_BYTEORDER ||
+        hdr.version != VIR_QEMU_CAPS_BINARY_VERSION) {
+        VIR_DEBUG("Unsupported binary capabilities cache '%s'", filename);
+        return 1;
+    }
+
+    if (xmlFilename &&
+        (stat(xmlFilename, &sb) < 0 ||
+         hdr.xmlSize != (uint64_t)sb.st_size ||
+         hdr.xmlMtime != (uint64_t)sb.st_mtime)) {
+        VIR_DEBUG("Binary capabilities cache '%s' doesn't match '%s'",
+                  filename, xmlFilename);
+        return 1;
+    }
+
+    qemuCaps->libvirtVersion = hdr.libvirtVersion;
+    qemuCaps->libvirtCtime = hdr.libvirtCtime;
+
+    if (!skipInvalidation &&
+        (qemuCaps->libvirtCtime != virGetSelfLastChanged() ||
+         qemuCaps->libvirtVersion != LIBVIR_VERSION_NUMBER)) {
+        VIR_DEBUG("Outdated binary capabilities in %s: libvirt changed",
+                  filename);
+        return 1;
+    }
+
+    if (hdr.payloadSize != rd.len - rd.pos ||
+        virQEMUCapsLoadBinaryPayload(qemuCaps, &rd) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("malformed binary QEMU capabilities cache '%s'"),
+                       filename);
+        return -1;
+    }
+
+    virQEMUCapsInitHostCPUModel(qemuCaps, hostArch, VIR_DOMAIN_VIRT_KVM);
+    virQEMUCapsInitHostCPUModel(qemuCaps, hostArch, VIR_DOMAIN_VIRT_QEMU);
+
+    if (skipInvalidation)
+        qemuCaps->invalidation = false;
+
+    return 0;
+}
+
+
+static int
+virQEMUCapsWriteBinaryCache(int fd,
+                            const void *opaque)
+{
+    GByteArray *buf = (GByteArray *)opaque;
+
+    if (safewrite(fd, buf->data, buf->len) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+/**
+ * virQEMUCapsSaveBinaryCache:
+ * @qemuCaps: capabilities to save
+ * @filename: binary cache file
+ * @xmlFilename: XML cache file already written for @qemuCaps or NULL
+ *
+ * Atomically replaces @filename with the binary form of @qemuCaps.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virQEMUCapsSaveBinaryCache(virQEMUCapsPtr qemuCaps,
+                           const char *filename,
+                           const char *xmlFilename)
+{
+    g_autoptr(GByteArray) buf = NULL;
+    char *data;
+    size_t len;
+
+    if (!(data = virQEMUCapsFormatBinaryCache(qemuCaps, xmlFilename, &len)))
+        return -1;
+
+    buf = g_byte_array_new_take((guint8 *)data, len);
+
+    return virFileRewrite(filename, 0600, virQEMUCapsWriteBinaryCache, buf);
+}
+
+
 /*
  * Check whether IBM Secure Execution (S390) is enabled
  */
@@ -5515,11 +6230,27 @@ virQEMUCapsLoadFile(const char *filename,
 {
     virQEMUCapsPtr qemuCaps = virQEMUCapsNewBinary(binary);
     virQEMUCapsCachePrivPtr priv = privData;
+    g_autofree char *binFile = virQEMUCapsGetBinaryCacheName(filename);
     int ret;
 
     if (!qemuCaps)
         return NULL;
 
+    ret = virQEMUCapsLoadBinaryCache(priv->hostArch, qemuCaps, binFile,
+                                     filename, false);
+    if (ret == 0)
+        return qemuCaps;
+
+    if (ret < 0) {
+        VIR_WARN("%s", virGetLastErrorMessage());
+        virResetLastError();
+    }
+
+    /* the binary cache may have filled in some data already */
+    virObjectUnref(qemuCaps);
+    if (!(qemuCaps = virQEMUCapsNewBinary(binary)))
+        return NULL;
+
     ret = virQEMUCapsLoadCache(priv->hostArch, qemuCaps, filename, false);
     if (ret < 0)
         goto error;
@@ -5528,6 +6259,12 @@ virQEMUCapsLoadFile(const char *filename,
         goto error;
     }
 
+    if (virQEMUCapsSaveBinaryCache(qemuCaps, binFile, filename) < 0) {
+        VIR_DEBUG("Failed to refresh binary caps '%s': %s",
+                  binFile, virGetLastErrorMessage());
+        virResetLastError();
+    }
+
     return qemuCaps;
 
  error:
@@ -5618,6 +6355,10 @@ virQEMUCapsCacheNew(const char *libDir,
     if (uname(&uts) == 0)
         priv->kernelVersion = g_strdup_printf("%s %s", uts.release, uts.version);
 
+    /* Probing an emulator takes seconds, don't let a domain start or an API
+     * call wait for it just because the emulator or libvirt was upgraded. */
+    virFileCacheSetRefreshAsync(cache, true);
+
  cleanup:
     VIR_FREE(capsCacheDir);
     return cache;
@@ -5936,10 +6677,15 @@ virQEMUCapsFillDomainCPUCaps(virQEMUCapsPtr qemuCaps,
                                       domCaps->machine)) {
         virCPUDefPtr cpu = virQEMUCapsGetHostModel(qemuCaps, domCaps->virttype,
                                                    VIR_QEMU_CAPS_HOST_CPU_REPORTED);
-        domCaps->cpu.hostModel = virCPUDefCopy(cpu);
+        /* the host model never changes once qemuCaps is created */
+        virCPUDefRef(cpu);
+        domCaps->cpu.hostModel = cpu;
     }
 
-    if (virQEMUCapsIsCPUModeSupported(qemuCaps, hostarch, domCaps->virttype,
+    /* The list of custom CPU models may have been shared by domain
+     * capabilities for another machine type already. */
+    if (!domCaps->cpu.custom &&
+        virQEMUCapsIsCPUModeSupported(qemuCaps, hostarch, domCaps->virttype,
                                       VIR_CPU_MODE_CUSTOM,
                                       domCaps->machine)) {
         const char *forbidden[] = { "host", NULL };
@@ -578,6 +578,13 @@ typedef enum { /* virQEMUCapsFlags grouping marker for syntax-check */
     QEMU_CAPS_NUMA_HMAT, /* -numa hmat */
     QEMU_CAPS_BLOCKDEV_HOSTDEV_SCSI, /* -blockdev used for (i)SCSI hostdevs */
 
+    /* 380 */
+    QEMU_CAPS_OBJECT_MEMORY_PREALLOC_THREADS, /* -object memory-backend-*,prealloc-threads= */
+    QEMU_CAPS_CALC_DIRTY_RATE, /* accepts calc-dirty-rate */
+    QEMU_CAPS_VIRTIO_BALLOON_FREE_PAGE_REPORTING, /* virtio balloon free-page-reporting */
+    QEMU_CAPS_VIRTIO_NET_RSS, /* virtio-net-*.rss */
+    QEMU_CAPS_VIRTIO_NET_HASH_REPORT, /* virtio-net-*.hash */
+
     QEMU_CAPS_LAST /* this must always be the last item */
 } virQEMUCapsFlags;
 
@@ -43,6 +43,19 @@ int virQEMUCapsLoadCache(virArch hostArch,
                          bool skipInvalidation);
 char *virQEMUCapsFormatCache(virQEMUCapsPtr qemuCaps);
 
+char *virQEMUCapsGetBinaryCacheName(const char *filename);
+char *virQEMUCapsFormatBinaryCache(virQEMUCapsPtr qemuCaps,
+                                   const char *xmlFilename,
+                                   size_t *len);
+int virQEMUCapsLoadBinaryCache(virArch hostArch,
+                               virQEMUCapsPtr qemuCaps,
+                               const char *filename,
+                               const char *xmlFilename,
+                               bool skipInvalidation);
+int virQEMUCapsSaveBinaryCache(virQEMUCapsPtr qemuCaps,
+                               const char *filename,
+                               const char *xmlFilename);
+
 int
 virQEMUCapsInitQMPMonitor(virQEMUCapsPtr qemuCaps,
                           qemuMonitorPtr mon);
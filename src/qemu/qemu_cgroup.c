@@ -907,6 +907,19 @@ qemuSetupCpuCgroup(virDomainObjPtr vm)
 }
 
 
+static int
+qemuStartCgroupStatsSession(virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(priv->driver);
+
+    if (!priv->cgroup || !cfg->statsCgroupKeepOpen)
+        return 0;
+
+    return virCgroupStatsSessionStart(priv->cgroup);
+}
+
+
 static int
 qemuInitCgroup(virDomainObjPtr vm,
                size_t nnicindexes,
@@ -958,7 +971,7 @@ qemuInitCgroup(virDomainObjPtr vm,
         return -1;
     }
 
-    return 0;
+    return qemuStartCgroupStatsSession(vm);
 }
 
 static void
@@ -1059,7 +1072,7 @@ qemuConnectCgroup(virDomainObjPtr vm)
         return -1;
 
     qemuRestoreCgroupState(vm);
-    return 0;
+    return qemuStartCgroupStatsSession(vm);
 }
 
 int
@@ -1122,6 +1135,9 @@ qemuSetupCgroupForExtDevices(virDomainObjPtr vm,
 {
     qemuDomainObjPrivatePtr priv = vm->privateData;
     virCgroupPtr cgroup_temp = NULL;
+    virBitmapPtr cpumask = NULL;
+    g_autofree char *mem_mask = NULL;
+    virDomainNumatuneMemMode mem_mode;
     int ret = -1;
 
     if (!qemuExtDevicesHasDevice(vm->def) ||
@@ -1137,14 +1153,46 @@ qemuSetupCgroupForExtDevices(virDomainObjPtr vm,
         !virCgroupHasController(priv->cgroup, VIR_CGROUP_CONTROLLER_CPUSET))
         return 0;
 
-    if (virCgroupNewThread(priv->cgroup, VIR_CGROUP_THREAD_EMULATOR, 0,
-                           false, &cgroup_temp) < 0)
+    /* The helpers get a cgroup of their own so that they can be pinned
+     * away from the vCPUs and their CPU time is accounted separately. */
+    if (virCgroupNewThread(priv->cgroup, VIR_CGROUP_THREAD_HELPER, 0,
+                           true, &cgroup_temp) < 0)
         goto cleanup;
 
+    if (virCgroupHasController(priv->cgroup, VIR_CGROUP_CONTROLLER_CPUSET)) {
+        /* without <helperpin/> the helpers share the CPUs of the emulator */
+        if (vm->def->cputune.helperpin)
+            cpumask = vm->def->cputune.helperpin;
+        else if (vm->def->cputune.emulatorpin)
+            cpumask = vm->def->cputune.emulatorpin;
+        else if (vm->def->placement_mode == VIR_DOMAIN_CPU_PLACEMENT_MODE_AUTO)
+            cpumask = priv->autoCpuset;
+        else
+            cpumask = vm->def->cpumask;
+
+        if (cpumask &&
+            qemuSetupCgroupCpusetCpus(cgroup_temp, cpumask) < 0)
+            goto cleanup;
+
+        if (virDomainNumatuneGetMode(vm->def->numa, -1, &mem_mode) == 0 &&
+            mem_mode == VIR_DOMAIN_NUMATUNE_MEM_STRICT &&
+            virDomainNumatuneMaybeFormatNodeset(vm->def->numa,
+                                                priv->autoNodeset,
+                                                &mem_mask, -1) < 0)
+            goto cleanup;
+
+        if (mem_mask && virCgroupSetCpusetMems(cgroup_temp, mem_mask) < 0)
+            goto cleanup;
+    }
+
     ret = qemuExtDevicesSetupCgroup(driver, vm, cgroup_temp);
 
  cleanup:
-    virCgroupFree(&cgroup_temp);
+    if (cgroup_temp) {
+        if (ret < 0)
+            virCgroupRemove(cgroup_temp);
+        virCgroupFree(&cgroup_temp);
+    }
 
     return ret;
 }
@@ -1205,6 +1253,8 @@ qemuRemoveCgroup(virDomainObjPtr vm)
             VIR_DEBUG("Failed to terminate cgroup for %s", vm->def->name);
     }
 
+    virCgroupStatsSessionStop(priv->cgroup);
+
     return virCgroupRemove(priv->cgroup);
 }
 
@@ -573,6 +573,22 @@ struct qemuCheckpointDiskMap {
 };
 
 
+static bool
+qemuCheckpointBitmapInBackingChain(virStorageSourcePtr src,
+                                   const char *bitmapname,
+                                   virHashTablePtr blockNamedNodeData)
+{
+    virStorageSourcePtr n;
+
+    for (n = src->backingStore; virStorageSourceIsBacking(n); n = n->backingStore) {
+        if (qemuBlockNamedNodeDataGetBitmapByName(blockNamedNodeData, n, bitmapname))
+            return true;
+    }
+
+    return false;
+}
+
+
 static int
 qemuCheckpointGetXMLDescUpdateSize(virDomainObjPtr vm,
                                    virDomainCheckpointDefPtr chkdef)
@@ -618,6 +634,22 @@ qemuCheckpointGetXMLDescUpdateSize(virDomainObjPtr vm,
         if (!qemuBlockBitmapChainIsValid(domdisk->src, chkdef->parent.name, blockNamedNodeData))
             continue;
 
+        /* the dirty byte count of a bitmap which is present only in the top
+         * image is accurate already, no need to merge it */
+        if (!qemuCheckpointBitmapInBackingChain(domdisk->src, chkdef->parent.name,
+                                                blockNamedNodeData)) {
+            qemuBlockNamedNodeDataBitmapPtr bitmap;
+
+            if ((bitmap = qemuBlockNamedNodeDataGetBitmapByName(blockNamedNodeData,
+                                                                domdisk->src,
+                                                                chkdef->parent.name))) {
+                chkdisk->size = bitmap->dirtybytes;
+                chkdisk->sizeValid = true;
+            }
+
+            continue;
+        }
+
         diskmap[ndisks].chkdisk = chkdisk;
         diskmap[ndisks].domdisk = domdisk;
         ndisks++;
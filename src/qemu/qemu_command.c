@@ -57,6 +57,7 @@
 #include "virtpm.h"
 #include "virscsi.h"
 #include "virnuma.h"
+#include "virhostcpu.h"
 #include "virgic.h"
 #include "virmdev.h"
 #include "virdomainsnapshotobjlist.h"
@@ -1079,6 +1080,20 @@ qemuDiskConfigBlkdeviotuneEnabled(virDomainDiskDefPtr disk)
 }
 
 
+bool
+qemuDiskConfigLatencyHistogramsEnabled(virDomainDiskDefPtr disk)
+{
+    size_t i;
+
+    for (i = 0; i < VIR_DOMAIN_DISK_LATENCY_HISTOGRAM_LAST; i++) {
+        if (disk->latencyHistograms[i].nbins > 0)
+            return true;
+    }
+
+    return false;
+}
+
+
 /* QEMU 1.2 and later have a binary flag -enable-fips that must be
  * used for VNC auth to obey FIPS settings; but the flag only
  * exists on Linux, and with no way to probe for it via QMP.  Our
@@ -2018,12 +2033,33 @@ qemuBuildObjectCommandline(virCommandPtr cmd,
 }
 
 
+/*
+ * Formats @props straight into the argument of -blockdev without an
+ * intermediate copy of the string.
+ */
+static int
+qemuBuildBlockdevCommandline(virCommandPtr cmd,
+                             virJSONValuePtr props)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+
+    if (!props)
+        return 0;
+
+    if (virJSONValueToBuffer(props, &buf, false) < 0)
+        return -1;
+
+    virCommandAddArg(cmd, "-blockdev");
+    virCommandAddArgBuffer(cmd, &buf);
+
+    return 0;
+}
+
+
 static int
 qemuBuildBlockStorageSourceAttachDataCommandline(virCommandPtr cmd,
                                                  qemuBlockStorageSourceAttachDataPtr data)
 {
-    char *tmp;
-
     if (qemuBuildObjectCommandline(cmd, data->prmgrProps) < 0 ||
         qemuBuildObjectCommandline(cmd, data->authsecretProps) < 0 ||
         qemuBuildObjectCommandline(cmd, data->encryptsecretProps) < 0 ||
@@ -2035,29 +2071,10 @@ qemuBuildBlockStorageSourceAttachDataCommandline(virCommandPtr cmd,
     if (data->driveCmd)
         virCommandAddArgList(cmd, "-drive", data->driveCmd, NULL);
 
-    if (data->storageProps) {
-        if (!(tmp = virJSONValueToString(data->storageProps, false)))
-            return -1;
-
-        virCommandAddArgList(cmd, "-blockdev", tmp, NULL);
-        VIR_FREE(tmp);
-    }
-
-    if (data->storageSliceProps) {
-        if (!(tmp = virJSONValueToString(data->storageSliceProps, false)))
-            return -1;
-
-        virCommandAddArgList(cmd, "-blockdev", tmp, NULL);
-        VIR_FREE(tmp);
-    }
-
-    if (data->formatProps) {
-        if (!(tmp = virJSONValueToString(data->formatProps, false)))
-            return -1;
-
-        virCommandAddArgList(cmd, "-blockdev", tmp, NULL);
-        VIR_FREE(tmp);
-    }
+    if (qemuBuildBlockdevCommandline(cmd, data->storageProps) < 0 ||
+        qemuBuildBlockdevCommandline(cmd, data->storageSliceProps) < 0 ||
+        qemuBuildBlockdevCommandline(cmd, data->formatProps) < 0)
+        return -1;
 
     return 0;
 }
@@ -2070,7 +2087,6 @@ qemuBuildDiskSourceCommandLine(virCommandPtr cmd,
 {
     g_autoptr(qemuBlockStorageSourceChainData) data = NULL;
     g_autoptr(virJSONValue) copyOnReadProps = NULL;
-    g_autofree char *copyOnReadPropsStr = NULL;
     size_t i;
 
     if (virQEMUCapsGet(qemuCaps, QEMU_CAPS_BLOCKDEV) &&
@@ -2096,12 +2112,8 @@ qemuBuildDiskSourceCommandLine(virCommandPtr cmd,
             return -1;
     }
 
-    if (copyOnReadProps) {
-        if (!(copyOnReadPropsStr = virJSONValueToString(copyOnReadProps, false)))
-            return -1;
-
-        virCommandAddArgList(cmd, "-blockdev", copyOnReadPropsStr, NULL);
-    }
+    if (qemuBuildBlockdevCommandline(cmd, copyOnReadProps) < 0)
+        return -1;
 
     return 0;
 }
@@ -2945,6 +2957,118 @@ qemuBuildMemoryGetDefaultPagesize(virQEMUDriverConfigPtr cfg,
 }
 
 
+/*
+ * Returns the number of CPUs of the host NUMA nodes in @nodemask so that
+ * each node is populated by its own CPUs, or the number of all host CPUs
+ * for unbound memory.
+ */
+static unsigned int
+qemuBuildMemoryBackendPreallocThreadsAuto(virBitmapPtr nodemask)
+{
+    unsigned int threads = 0;
+    ssize_t node = -1;
+    int ncpus;
+
+    while (nodemask && (node = virBitmapNextSetBit(nodemask, node)) >= 0) {
+        g_autoptr(virBitmap) cpus = NULL;
+
+        if ((ncpus = virNumaGetNodeCPUs(node, &cpus)) > 0)
+            threads += ncpus;
+        else if (ncpus == -1)
+            virResetLastError();
+    }
+
+    if (threads == 0) {
+        if ((ncpus = virHostCPUGetCount()) > 0)
+            threads = ncpus;
+        else
+            virResetLastError();
+    }
+
+    return MAX(threads, 1);
+}
+
+
+/*
+ * Returns the number of host CPUs any of the vCPUs of @def is pinned to,
+ * or 0 if they are not pinned.
+ */
+static unsigned int
+qemuBuildMemoryBackendPreallocThreadsPinned(virDomainDefPtr def)
+{
+    g_autoptr(virBitmap) cpus = NULL;
+    size_t i;
+
+    for (i = 0; i < virDomainDefGetVcpusMax(def); i++) {
+        virDomainVcpuDefPtr vcpu = virDomainDefGetVcpu(def, i);
+        virBitmapPtr cpumask = vcpu->cpumask ? vcpu->cpumask : def->cpumask;
+
+        if (!vcpu->online || !cpumask)
+            continue;
+
+        if (!cpus)
+            cpus = virBitmapNewCopy(cpumask);
+        else
+            virBitmapUnion(cpus, cpumask);
+    }
+
+    return cpus ? virBitmapCountBits(cpus) : 0;
+}
+
+
+/**
+ * qemuBuildMemoryBackendPreallocThreads:
+ * @def: domain definition
+ * @priv: domain private data
+ * @nodemask: host NUMA nodes the memory is bound to
+ * @threads: [out] number of threads, 0 to keep QEMU's default
+ *
+ * Selects the number of threads QEMU should use for preallocating a memory
+ * backend. A number requested for an incoming migration takes precedence
+ * over the one from memoryBacking/allocation in @def. Without either of
+ * them, immediately allocated memory of a domain with pinned vCPUs is
+ * preallocated by one thread per host CPU the vCPUs are pinned to, as long
+ * as QEMU supports it.
+ *
+ * Returns 0 on success, -1 if the requested number can't be set.
+ */
+static int
+qemuBuildMemoryBackendPreallocThreads(virDomainDefPtr def,
+                                      qemuDomainObjPrivatePtr priv,
+                                      virBitmapPtr nodemask,
+                                      unsigned int *threads)
+{
+    bool supported = virQEMUCapsGet(priv->qemuCaps,
+                                    QEMU_CAPS_OBJECT_MEMORY_PREALLOC_THREADS);
+
+    *threads = 0;
+
+    if (priv->memPreallocThreads == 0 && def->mem.allocation_threads == 0) {
+        if (supported &&
+            def->mem.allocation == VIR_DOMAIN_MEMORY_ALLOCATION_IMMEDIATE)
+            *threads = qemuBuildMemoryBackendPreallocThreadsPinned(def);
+
+        return 0;
+    }
+
+    if (!supported) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                       _("parallel memory preallocation is not "
+                         "supported with this QEMU binary"));
+        return -1;
+    }
+
+    if (priv->memPreallocThreads > 0)
+        *threads = priv->memPreallocThreads;
+    else if (def->mem.allocation_threads > 0)
+        *threads = def->mem.allocation_threads;
+    else
+        *threads = qemuBuildMemoryBackendPreallocThreadsAuto(nodemask);
+
+    return 0;
+}
+
+
 /**
  * qemuBuildMemoryBackendProps:
  * @backendProps: [out] constructed object
@@ -3190,6 +3314,19 @@ qemuBuildMemoryBackendProps(virJSONValuePtr *backendProps,
             return -1;
     }
 
+    /* with global -mem-prealloc QEMU preallocates every backend */
+    if (prealloc || priv->memPrealloc) {
+        unsigned int threads;
+
+        if (qemuBuildMemoryBackendPreallocThreads(def, priv, nodemask,
+                                                  &threads) < 0)
+            return -1;
+
+        if (threads > 0 &&
+            virJSONValueObjectAdd(props, "u:prealloc-threads", threads, NULL) < 0)
+            return -1;
+    }
+
     /* If none of the following is requested... */
     if (!needHugepage && !mem->sourceNodes && !nodeSpecified &&
         !mem->nvdimmPath &&
@@ -3516,6 +3653,14 @@ qemuBuildNicDevStr(virDomainDefPtr def,
         }
         virBufferAsprintf(&buf, ",tx_queue_size=%u", net->driver.virtio.tx_queue_size);
     }
+    if (usingVirtio && net->driver.virtio.rss) {
+        virBufferAsprintf(&buf, ",rss=%s",
+                          virTristateSwitchTypeToString(net->driver.virtio.rss));
+    }
+    if (usingVirtio && net->driver.virtio.rss_hash_report) {
+        virBufferAsprintf(&buf, ",hash=%s",
+                          virTristateSwitchTypeToString(net->driver.virtio.rss_hash_report));
+    }
 
     if (usingVirtio && net->mtu) {
         if (!virQEMUCapsGet(qemuCaps, QEMU_CAPS_VIRTIO_NET_HOST_MTU)) {
@@ -3821,6 +3966,11 @@ qemuBuildMemballoonCommandLine(virCommandPtr cmd,
                           virTristateSwitchTypeToString(def->memballoon->autodeflate));
     }
 
+    if (def->memballoon->free_page_reporting != VIR_TRISTATE_SWITCH_ABSENT) {
+        virBufferAsprintf(&buf, ",free-page-reporting=%s",
+                          virTristateSwitchTypeToString(def->memballoon->free_page_reporting));
+    }
+
     qemuBuildVirtioOptionsStr(&buf, def->memballoon->virtio);
 
     if (qemuCommandAddExtDevice(cmd, &def->memballoon->info) < 0)
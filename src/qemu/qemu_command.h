@@ -213,6 +213,9 @@ int qemuGetDriveSourceString(virStorageSourcePtr src,
 bool
 qemuDiskConfigBlkdeviotuneEnabled(virDomainDiskDefPtr disk);
 
+bool
+qemuDiskConfigLatencyHistogramsEnabled(virDomainDiskDefPtr disk);
+
 
 bool
 qemuCheckFips(void);
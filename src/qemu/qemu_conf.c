@@ -272,6 +272,16 @@ virQEMUDriverConfigPtr virQEMUDriverConfigNew(bool privileged,
 
     cfg->keepAliveInterval = 5;
     cfg->keepAliveCount = 5;
+    cfg->statsCacheMaxAge = 10;
+    cfg->numaRebalanceThreshold = 20;
+    cfg->numaRebalanceMaxMoves = 1;
+    cfg->resctrlFeedbackInterval = 1;
+    cfg->iothreadPollIOPSThreshold = 4000;
+    cfg->iothreadPollMaxNs = 32768;
+    cfg->memoryManagerLowFree = 1024;
+    cfg->memoryManagerHighFree = 2048;
+    cfg->blockJobAutotuneInterval = 2;
+    cfg->blockJobLatencyTarget = 10000;
     cfg->seccompSandbox = -1;
 
     cfg->logTimestamp = true;
@@ -528,6 +538,40 @@ virQEMUDriverConfigLoadSpecificTLSEntry(virQEMUDriverConfigPtr cfg,
 }
 
 
+static int
+virQEMUDriverConfigLoadBackupEntry(virQEMUDriverConfigPtr cfg,
+                                   virConfPtr conf)
+{
+    if (virConfGetValueUInt(conf, "backup_max_jobs", &cfg->backupMaxJobs) < 0)
+        return -1;
+    if (virConfGetValueUInt(conf, "backup_max_bandwidth", &cfg->backupMaxBandwidth) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+virQEMUDriverConfigLoadBlockJobEntry(virQEMUDriverConfigPtr cfg,
+                                     virConfPtr conf)
+{
+    if (virConfGetValueUInt(conf, "block_job_autotune_interval",
+                            &cfg->blockJobAutotuneInterval) < 0)
+        return -1;
+    if (virConfGetValueUInt(conf, "block_job_latency_target",
+                            &cfg->blockJobLatencyTarget) < 0)
+        return -1;
+
+    if (cfg->blockJobLatencyTarget == 0) {
+        virReportError(VIR_ERR_CONF_SYNTAX, "%s",
+                       _("block_job_latency_target must be greater than 0"));
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 virQEMUDriverConfigLoadRemoteDisplayEntry(virQEMUDriverConfigPtr cfg,
                                           virConfPtr conf,
@@ -615,6 +659,8 @@ virQEMUDriverConfigLoadSaveEntry(virQEMUDriverConfigPtr cfg,
         return -1;
     if (virConfGetValueBool(conf, "auto_start_bypass_cache", &cfg->autoStartBypassCache) < 0)
         return -1;
+    if (virConfGetValueUInt(conf, "auto_start_concurrency", &cfg->autoStartConcurrency) < 0)
+        return -1;
 
     return 0;
 }
@@ -658,6 +704,9 @@ virQEMUDriverConfigLoadProcessEntry(virQEMUDriverConfigPtr cfg,
     if (virConfGetValueString(conf, "pr_helper", &cfg->prHelperName) < 0)
         return -1;
 
+    if (virConfGetValueBool(conf, "pr_helper_shared", &cfg->prHelperShared) < 0)
+        return -1;
+
     if (virConfGetValueString(conf, "slirp_helper", &cfg->slirpHelperName) < 0)
         return -1;
 
@@ -745,6 +794,40 @@ virQEMUDriverConfigLoadRPCEntry(virQEMUDriverConfigPtr cfg,
         return -1;
     if (virConfGetValueUInt(conf, "keepalive_count", &cfg->keepAliveCount) < 0)
         return -1;
+    if (virConfGetValueUInt(conf, "monitor_event_threads", &cfg->monitorEventThreads) < 0)
+        return -1;
+    if (virConfGetValueBool(conf, "monitor_event_thread_numa", &cfg->monitorEventThreadNUMA) < 0)
+        return -1;
+    if (virConfGetValueUInt(conf, "monitor_slow_threshold", &cfg->monitorSlowThreshold) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+virQEMUDriverConfigLoadStatsEntry(virQEMUDriverConfigPtr cfg,
+                                  virConfPtr conf)
+{
+    if (virConfGetValueUInt(conf, "stats_workers", &cfg->statsWorkers) < 0)
+        return -1;
+    if (virConfGetValueUInt(conf, "stats_timeout", &cfg->statsTimeout) < 0)
+        return -1;
+    if (virConfGetValueUInt(conf, "stats_cache_interval", &cfg->statsCacheInterval) < 0)
+        return -1;
+    if (virConfGetValueUInt(conf, "stats_cache_max_age", &cfg->statsCacheMaxAge) < 0)
+        return -1;
+    if (virConfGetValueUInt(conf, "stats_block_capacity_max_age",
+                            &cfg->statsBlockCapacityMaxAge) < 0)
+        return -1;
+    if (virConfGetValueUInt(conf, "guest_info_cache_ttl", &cfg->guestInfoCacheTTL) < 0)
+        return -1;
+    if (virConfGetValueBool(conf, "stats_cgroup_keep_open", &cfg->statsCgroupKeepOpen) < 0)
+        return -1;
+    if (virConfGetValueBool(conf, "stats_perf_vcpu", &cfg->statsPerfVcpu) < 0)
+        return -1;
+    if (virConfGetValueUInt(conf, "reconnect_workers", &cfg->reconnectWorkers) < 0)
+        return -1;
 
     return 0;
 }
@@ -775,6 +858,17 @@ virQEMUDriverConfigLoadNetworkEntry(virQEMUDriverConfigPtr cfg,
         return -1;
     }
 
+    if (virConfGetValueUInt(conf, "migration_tunnel_compression_level",
+                            &cfg->migrationTunnelCompressionLevel) < 0)
+        return -1;
+    if (cfg->migrationTunnelCompressionLevel > 9) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("%s: migration_tunnel_compression_level: level "
+                         "must be between 0 and 9"),
+                       filename);
+        return -1;
+    }
+
     if (virConfGetValueString(conf, "migration_host", &cfg->migrateHost) < 0)
         return -1;
     virStringStripIPv6Brackets(cfg->migrateHost);
@@ -1001,6 +1095,110 @@ virQEMUDriverConfigLoadMemoryEntry(virQEMUDriverConfigPtr cfg,
 }
 
 
+static int
+virQEMUDriverConfigLoadNUMAEntry(virQEMUDriverConfigPtr cfg,
+                                 virConfPtr conf)
+{
+    if (virConfGetValueUInt(conf, "numa_rebalance_interval",
+                            &cfg->numaRebalanceInterval) < 0)
+        return -1;
+    if (virConfGetValueUInt(conf, "numa_rebalance_threshold",
+                            &cfg->numaRebalanceThreshold) < 0)
+        return -1;
+    if (virConfGetValueUInt(conf, "numa_rebalance_max_moves",
+                            &cfg->numaRebalanceMaxMoves) < 0)
+        return -1;
+
+    if (cfg->numaRebalanceThreshold > 100) {
+        virReportError(VIR_ERR_CONF_SYNTAX,
+                       _("numa_rebalance_threshold must be a percentage, "
+                         "got %u"), cfg->numaRebalanceThreshold);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+virQEMUDriverConfigLoadResctrlEntry(virQEMUDriverConfigPtr cfg,
+                                    virConfPtr conf)
+{
+    if (virConfGetValueUInt(conf, "resctrl_feedback_interval",
+                            &cfg->resctrlFeedbackInterval) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+virQEMUDriverConfigLoadIOThreadEntry(virQEMUDriverConfigPtr cfg,
+                                     virConfPtr conf)
+{
+    if (virConfGetValueUInt(conf, "iothread_poll_autotune_interval",
+                            &cfg->iothreadPollAutotuneInterval) < 0)
+        return -1;
+    if (virConfGetValueUInt(conf, "iothread_poll_iops_threshold",
+                            &cfg->iothreadPollIOPSThreshold) < 0)
+        return -1;
+    if (virConfGetValueUInt(conf, "iothread_poll_max_ns",
+                            &cfg->iothreadPollMaxNs) < 0)
+        return -1;
+
+    if (cfg->iothreadPollIOPSThreshold == 0) {
+        virReportError(VIR_ERR_CONF_SYNTAX, "%s",
+                       _("iothread_poll_iops_threshold must be greater than 0"));
+        return -1;
+    }
+
+    if (cfg->iothreadPollMaxNs == 0 || cfg->iothreadPollMaxNs > INT_MAX) {
+        virReportError(VIR_ERR_CONF_SYNTAX,
+                       _("iothread_poll_max_ns must be between 1 and %d"),
+                       INT_MAX);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+virQEMUDriverConfigLoadMemoryManagerEntry(virQEMUDriverConfigPtr cfg,
+                                          virConfPtr conf)
+{
+    if (virConfGetValueUInt(conf, "memory_manager_interval",
+                            &cfg->memoryManagerInterval) < 0)
+        return -1;
+    if (virConfGetValueUInt(conf, "memory_manager_low_free",
+                            &cfg->memoryManagerLowFree) < 0)
+        return -1;
+    if (virConfGetValueUInt(conf, "memory_manager_high_free",
+                            &cfg->memoryManagerHighFree) < 0)
+        return -1;
+
+    if (cfg->memoryManagerHighFree <= cfg->memoryManagerLowFree) {
+        virReportError(VIR_ERR_CONF_SYNTAX, "%s",
+                       _("memory_manager_high_free must be greater than "
+                         "memory_manager_low_free"));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+virQEMUDriverConfigLoadHookEntry(virQEMUDriverConfigPtr cfg,
+                                 virConfPtr conf)
+{
+    if (virConfGetValueBool(conf, "async_hooks", &cfg->asyncHooks) < 0)
+        return -1;
+
+    return 0;
+}
+
+
 static int
 virQEMUDriverConfigLoadSWTPMEntry(virQEMUDriverConfigPtr cfg,
                                   virConfPtr conf)
@@ -1066,6 +1264,12 @@ int virQEMUDriverConfigLoadFile(virQEMUDriverConfigPtr cfg,
     if (virQEMUDriverConfigLoadSpecificTLSEntry(cfg, conf) < 0)
         return -1;
 
+    if (virQEMUDriverConfigLoadBackupEntry(cfg, conf) < 0)
+        return -1;
+
+    if (virQEMUDriverConfigLoadBlockJobEntry(cfg, conf) < 0)
+        return -1;
+
     if (virQEMUDriverConfigLoadRemoteDisplayEntry(cfg, conf, filename) < 0)
         return -1;
 
@@ -1081,6 +1285,9 @@ int virQEMUDriverConfigLoadFile(virQEMUDriverConfigPtr cfg,
     if (virQEMUDriverConfigLoadRPCEntry(cfg, conf) < 0)
         return -1;
 
+    if (virQEMUDriverConfigLoadStatsEntry(cfg, conf) < 0)
+        return -1;
+
     if (virQEMUDriverConfigLoadNetworkEntry(cfg, conf, filename) < 0)
         return -1;
 
@@ -1099,6 +1306,21 @@ int virQEMUDriverConfigLoadFile(virQEMUDriverConfigPtr cfg,
     if (virQEMUDriverConfigLoadMemoryEntry(cfg, conf) < 0)
         return -1;
 
+    if (virQEMUDriverConfigLoadNUMAEntry(cfg, conf) < 0)
+        return -1;
+
+    if (virQEMUDriverConfigLoadResctrlEntry(cfg, conf) < 0)
+        return -1;
+
+    if (virQEMUDriverConfigLoadIOThreadEntry(cfg, conf) < 0)
+        return -1;
+
+    if (virQEMUDriverConfigLoadMemoryManagerEntry(cfg, conf) < 0)
+        return -1;
+
+    if (virQEMUDriverConfigLoadHookEntry(cfg, conf) < 0)
+        return -1;
+
     if (virQEMUDriverConfigLoadSWTPMEntry(cfg, conf) < 0)
         return -1;
 
@@ -1394,12 +1616,20 @@ virCapsPtr virQEMUDriverGetCapabilities(virQEMUDriverPtr driver,
     virCapsPtr ret = NULL;
     if (refresh) {
         virCapsPtr caps = NULL;
+        char *xml = NULL;
         if ((caps = virQEMUDriverCreateCapabilities(driver)) == NULL)
             return NULL;
 
+        if (!(xml = virCapabilitiesFormatXML(caps))) {
+            virObjectUnref(caps);
+            return NULL;
+        }
+
         qemuDriverLock(driver);
         virObjectUnref(driver->caps);
         driver->caps = caps;
+        g_free(driver->capsXML);
+        driver->capsXML = xml;
     } else {
         qemuDriverLock(driver);
 
@@ -1418,6 +1648,79 @@ virCapsPtr virQEMUDriverGetCapabilities(virQEMUDriverPtr driver,
 }
 
 
+/**
+ * virQEMUDriverGetCapabilitiesXML:
+ *
+ * Get the formatted capabilities of the driver. Once the capabilities
+ * were built, the formatted copy is returned right away and they are
+ * rebuilt in the background, so that changes such as newly installed
+ * emulators show up in one of the following calls.
+ *
+ * Returns: a newly allocated string or NULL
+ */
+char *
+virQEMUDriverGetCapabilitiesXML(virQEMUDriverPtr driver)
+{
+    g_autoptr(virCaps) caps = NULL;
+    char *xml = NULL;
+    bool refresh = false;
+
+    qemuDriverLock(driver);
+    if (driver->capsXML) {
+        xml = g_strdup(driver->capsXML);
+
+        if (driver->capsRefreshPool && !driver->capsRefreshPending) {
+            driver->capsRefreshPending = true;
+            refresh = true;
+        }
+    }
+    qemuDriverUnlock(driver);
+
+    if (xml) {
+        if (refresh &&
+            virThreadPoolSendJob(driver->capsRefreshPool, 0, NULL) < 0) {
+            VIR_WARN("Failed to queue capabilities refresh");
+            virResetLastError();
+
+            qemuDriverLock(driver);
+            driver->capsRefreshPending = false;
+            qemuDriverUnlock(driver);
+        }
+
+        return xml;
+    }
+
+    if (!(caps = virQEMUDriverGetCapabilities(driver, true)))
+        return NULL;
+
+    qemuDriverLock(driver);
+    xml = g_strdup(driver->capsXML);
+    qemuDriverUnlock(driver);
+
+    return xml;
+}
+
+
+void
+virQEMUDriverCapsRefreshRun(void *data G_GNUC_UNUSED,
+                            void *opaque)
+{
+    virQEMUDriverPtr driver = opaque;
+    g_autoptr(virCaps) caps = NULL;
+
+    /* calls coming in from now on need another refresh */
+    qemuDriverLock(driver);
+    driver->capsRefreshPending = false;
+    qemuDriverUnlock(driver);
+
+    if (!(caps = virQEMUDriverGetCapabilities(driver, true))) {
+        VIR_WARN("Failed to refresh capabilities: %s",
+                 virGetLastErrorMessage());
+        virResetLastError();
+    }
+}
+
+
 /**
  * virQEMUDriverGetDomainCapabilities:
  *
@@ -43,6 +43,7 @@
 #include "virthreadpool.h"
 #include "locking/lock_manager.h"
 #include "qemu_capabilities.h"
+#include "qemu_eventthreads.h"
 #include "virclosecallbacks.h"
 #include "virhostdev.h"
 #include "virfile.h"
@@ -148,6 +149,11 @@ struct _virQEMUDriverConfig {
     bool backupTLSx509verify;
     bool backupTLSx509verifyPresent;
     char *backupTLSx509secretUUID;
+    unsigned int backupMaxJobs;
+    unsigned int backupMaxBandwidth; /* MiB/s */
+
+    unsigned int blockJobAutotuneInterval; /* seconds */
+    unsigned int blockJobLatencyTarget; /* microseconds */
 
     bool vxhsTLS;
     char *vxhsTLSx509certdir;
@@ -168,6 +174,7 @@ struct _virQEMUDriverConfig {
 
     char *bridgeHelperName;
     char *prHelperName;
+    bool prHelperShared;
     char *slirpHelperName;
     char *dbusDaemonName;
 
@@ -197,12 +204,28 @@ struct _virQEMUDriverConfig {
     char *autoDumpPath;
     bool autoDumpBypassCache;
     bool autoStartBypassCache;
+    unsigned int autoStartConcurrency;
 
     char *lockManagerName;
 
     int keepAliveInterval;
     unsigned int keepAliveCount;
 
+    unsigned int monitorEventThreads;
+    bool monitorEventThreadNUMA;
+    unsigned int monitorSlowThreshold; /* in milliseconds */
+
+    unsigned int statsWorkers;
+    unsigned int statsTimeout;
+    unsigned int statsCacheInterval;
+    unsigned int statsCacheMaxAge;
+    unsigned int statsBlockCapacityMaxAge;
+    unsigned int guestInfoCacheTTL;
+    bool statsCgroupKeepOpen;
+    bool statsPerfVcpu;
+
+    unsigned int reconnectWorkers;
+
     int seccompSandbox;
 
     char *migrateHost;
@@ -210,6 +233,7 @@ struct _virQEMUDriverConfig {
     char *migrationAddress;
     unsigned int migrationPortMin;
     unsigned int migrationPortMax;
+    unsigned int migrationTunnelCompressionLevel;
 
     bool logTimestamp;
     bool stdioLogD;
@@ -221,6 +245,22 @@ struct _virQEMUDriverConfig {
 
     char *memoryBackingDir;
 
+    unsigned int numaRebalanceInterval;
+    unsigned int numaRebalanceThreshold;
+    unsigned int numaRebalanceMaxMoves;
+
+    unsigned int resctrlFeedbackInterval;
+
+    unsigned int iothreadPollAutotuneInterval; /* seconds */
+    unsigned int iothreadPollIOPSThreshold;
+    unsigned int iothreadPollMaxNs;
+
+    unsigned int memoryManagerInterval; /* seconds */
+    unsigned int memoryManagerLowFree; /* MiB */
+    unsigned int memoryManagerHighFree; /* MiB */
+
+    bool asyncHooks;
+
     uid_t swtpm_user;
     gid_t swtpm_group;
 
@@ -244,6 +284,94 @@ struct _virQEMUDriver {
     /* Immutable pointer, self-locking APIs */
     virThreadPoolPtr workerPool;
 
+    /* Immutable pointer, self-locking APIs. NULL unless parallel
+     * bulk stats collection is enabled in qemu.conf */
+    virThreadPoolPtr statsPool;
+
+    /* Immutable pointer, self-locking APIs. NULL unless the stats cache
+     * is enabled in qemu.conf */
+    virThreadPoolPtr statsCachePool;
+
+    /* Immutable value, periodic stats cache refresh timer or -1 */
+    int statsCacheTimer;
+
+    /* Immutable pointer, self-locking APIs. NULL unless NUMA rebalancing
+     * is enabled in qemu.conf */
+    virThreadPoolPtr numaRebalancePool;
+
+    /* Immutable value, periodic NUMA rebalancing timer or -1 */
+    int numaRebalanceTimer;
+
+    /* Atomic access only, a NUMA rebalancing pass is queued or running */
+    int numaRebalancePending;
+
+    /* Immutable pointer, self-locking APIs. NULL unless the memory
+     * bandwidth feedback control is enabled in qemu.conf */
+    virThreadPoolPtr resctrlFeedbackPool;
+
+    /* Immutable value, periodic memory bandwidth feedback timer or -1 */
+    int resctrlFeedbackTimer;
+
+    /* Atomic access only, a memory bandwidth feedback pass is queued or
+     * running */
+    int resctrlFeedbackPending;
+
+    /* Immutable pointer, self-locking APIs. NULL unless block job speed
+     * autotuning is enabled in qemu.conf */
+    virThreadPoolPtr blockJobAutotunePool;
+
+    /* Immutable value, periodic block job speed autotuning timer or -1 */
+    int blockJobAutotuneTimer;
+
+    /* Atomic access only, a block job speed autotuning pass is queued or
+     * running */
+    int blockJobAutotunePending;
+
+    /* Immutable pointer, self-locking APIs. NULL unless IOThread polling
+     * autotuning is enabled in qemu.conf */
+    virThreadPoolPtr iothreadPollPool;
+
+    /* Immutable value, periodic IOThread polling autotuning timer or -1 */
+    int iothreadPollTimer;
+
+    /* Atomic access only, an IOThread polling autotuning pass is queued or
+     * running */
+    int iothreadPollPending;
+
+    /* Immutable pointer, self-locking APIs. NULL unless the memory manager
+     * is enabled in qemu.conf */
+    virThreadPoolPtr memoryManagerPool;
+
+    /* Immutable value, periodic memory manager timer or -1 */
+    int memoryManagerTimer;
+
+    /* Atomic access only, a memory manager pass is queued or running */
+    int memoryManagerPending;
+
+    /* Immutable pointer, self-locking APIs. NULL unless shared monitor
+     * event threads are enabled in qemu.conf */
+    qemuEventThreadPoolPtr eventThreadPool;
+
+    /* Immutable value, periodic event thread rebalancing timer or -1 */
+    int eventThreadTimer;
+
+    /* Serializes starting and stopping the shared qemu-pr-helper */
+    virMutex sharedPRHelperLock;
+
+    /* Require sharedPRHelperLock, number of domains using the shared
+     * qemu-pr-helper */
+    unsigned int sharedPRHelperRefs;
+
+    /* Require lock, host CPUs the vCPUs of domains with topology
+     * placement were pinned to */
+    virBitmapPtr topologyCpus;
+
+    /* Immutable pointer once the daemon started, self-locking APIs */
+    virThreadPoolPtr reconnectPool;
+
+    /* Atomic dec only, domains whose reconnect is not finished yet */
+    int reconnectPending;
+
     /* Atomic increment only */
     int lastvmid;
 
@@ -272,6 +400,15 @@ struct _virQEMUDriver {
      */
     virCapsPtr caps;
 
+    /* Formatted @caps, replaced together with them. Require lock */
+    char *capsXML;
+
+    /* Require lock. Whether a background rebuild of @caps is queued */
+    bool capsRefreshPending;
+
+    /* Immutable pointer, self-locking APIs */
+    virThreadPoolPtr capsRefreshPool;
+
     /* Lazy initialized on first use, immutable thereafter.
      * Require lock to get the pointer & do optional initialization
      */
@@ -344,6 +481,8 @@ virCPUDefPtr virQEMUDriverGetHostCPU(virQEMUDriverPtr driver);
 virCapsPtr virQEMUDriverCreateCapabilities(virQEMUDriverPtr driver);
 virCapsPtr virQEMUDriverGetCapabilities(virQEMUDriverPtr driver,
                                         bool refresh);
+char *virQEMUDriverGetCapabilitiesXML(virQEMUDriverPtr driver);
+void virQEMUDriverCapsRefreshRun(void *data, void *opaque);
 
 virDomainCapsPtr
 virQEMUDriverGetDomainCapabilities(virQEMUDriverPtr driver,
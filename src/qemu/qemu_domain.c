@@ -52,8 +52,11 @@
 #include "virnetdevopenvswitch.h"
 #include "virstoragefile.h"
 #include "virstring.h"
+#include "virstringintern.h"
 #include "virthreadjob.h"
 #include "virprocess.h"
+#include "virhostcpu.h"
+#include "virnuma.h"
 #include "vircrypto.h"
 #include "virrandom.h"
 #include "virsystemd.h"
@@ -105,6 +108,8 @@ qemuJobResetPrivate(void *opaque)
     priv->dumpCompleted = false;
     qemuMigrationParamsFree(priv->migParams);
     priv->migParams = NULL;
+    priv->tunnelCompressed = false;
+    priv->tunnelStats = NULL;
 }
 
 
@@ -629,6 +634,7 @@ qemuDomainVcpuPrivateDispose(void *obj)
     VIR_FREE(priv->type);
     VIR_FREE(priv->alias);
     virJSONValueFree(priv->props);
+    virPerfGroupFree(priv->perf);
     return;
 }
 
@@ -873,7 +879,74 @@ qemuDomainVideoPrivateDispose(void *obj)
 }
 
 
+static virSecretValueLookupPtr
+qemuDomainSecretLookupFind(virSecretValueLookupPtr lookups,
+                           size_t nlookups,
+                           virSecretLookupTypeDefPtr seclookupdef,
+                           virSecretUsageType usageType)
+{
+    size_t i;
+
+    for (i = 0; i < nlookups; i++) {
+        virSecretValueLookupPtr lookup = lookups + i;
+
+        if (lookup->usageType != usageType ||
+            lookup->def.type != seclookupdef->type)
+            continue;
+
+        if (seclookupdef->type == VIR_SECRET_LOOKUP_TYPE_UUID &&
+            memcmp(lookup->def.u.uuid, seclookupdef->u.uuid, VIR_UUID_BUFLEN) == 0)
+            return lookup;
+
+        if (seclookupdef->type == VIR_SECRET_LOOKUP_TYPE_USAGE &&
+            STREQ_NULLABLE(lookup->def.u.usage, seclookupdef->u.usage))
+            return lookup;
+    }
+
+    return NULL;
+}
+
+
+/* qemuDomainSecretGetString:
+ * @priv: pointer to domain private object
+ * @seclookupdef: Secret lookup def
+ * @usageType: The virSecretUsageType
+ * @secret: returned secret
+ * @secretlen: length of @secret
+ *
+ * Same as virSecretGetSecretString, except that secrets already fetched by
+ * qemuDomainSecretPrefetch don't need another call of the secret driver.
+ *
+ * Returns 0 on success, -1 on failure with error message.
+ */
+static int
+qemuDomainSecretGetString(qemuDomainObjPrivatePtr priv,
+                          virSecretLookupTypeDefPtr seclookupdef,
+                          virSecretUsageType usageType,
+                          uint8_t **secret,
+                          size_t *secretlen)
+{
+    g_autoptr(virConnect) conn = NULL;
+    virSecretValueLookupPtr lookup;
+
+    if ((lookup = qemuDomainSecretLookupFind(priv->prefetchedSecrets,
+                                             priv->nprefetchedSecrets,
+                                             seclookupdef, usageType))) {
+        *secret = g_memdup(lookup->value, lookup->value_size);
+        *secretlen = lookup->value_size;
+        return 0;
+    }
+
+    if (!(conn = virGetConnectSecret()))
+        return -1;
+
+    return virSecretGetSecretString(conn, seclookupdef, usageType,
+                                    secret, secretlen);
+}
+
+
 /* qemuDomainSecretPlainSetup:
+ * @priv: pointer to domain private object
  * @secinfo: Pointer to secret info
  * @usageType: The virSecretUsageType
  * @username: username to use for authentication (may be NULL)
@@ -884,25 +957,18 @@ qemuDomainVideoPrivateDispose(void *obj)
  * Returns 0 on success, -1 on failure with error message
  */
 static int
-qemuDomainSecretPlainSetup(qemuDomainSecretInfoPtr secinfo,
+qemuDomainSecretPlainSetup(qemuDomainObjPrivatePtr priv,
+                           qemuDomainSecretInfoPtr secinfo,
                            virSecretUsageType usageType,
                            const char *username,
                            virSecretLookupTypeDefPtr seclookupdef)
 {
-    g_autoptr(virConnect) conn = virGetConnectSecret();
-    int ret = -1;
-
-    if (!conn)
-        return -1;
-
     secinfo->type = VIR_DOMAIN_SECRET_INFO_TYPE_PLAIN;
     secinfo->s.plain.username = g_strdup(username);
 
-    ret = virSecretGetSecretString(conn, seclookupdef, usageType,
-                                   &secinfo->s.plain.secret,
-                                   &secinfo->s.plain.secretlen);
-
-    return ret;
+    return qemuDomainSecretGetString(priv, seclookupdef, usageType,
+                                     &secinfo->s.plain.secret,
+                                     &secinfo->s.plain.secretlen);
 }
 
 
@@ -986,17 +1052,13 @@ qemuDomainSecretAESSetupFromSecret(qemuDomainObjPrivatePtr priv,
                                    const char *username,
                                    virSecretLookupTypeDefPtr seclookupdef)
 {
-    g_autoptr(virConnect) conn = virGetConnectSecret();
     qemuDomainSecretInfoPtr secinfo;
     g_autofree char *alias = qemuAliasForSecret(srcalias, secretuse);
     uint8_t *secret = NULL;
     size_t secretlen = 0;
 
-    if (!conn)
-        return NULL;
-
-    if (virSecretGetSecretString(conn, seclookupdef, usageType,
-                                 &secret, &secretlen) < 0)
+    if (qemuDomainSecretGetString(priv, seclookupdef, usageType,
+                                  &secret, &secretlen) < 0)
         return NULL;
 
     secinfo = qemuDomainSecretAESSetup(priv, alias, username, secret, secretlen);
@@ -1024,6 +1086,7 @@ qemuDomainSupportsEncryptedSecret(qemuDomainObjPrivatePtr priv)
 
 
 /* qemuDomainSecretInfoNewPlain:
+ * @priv: pointer to domain private object
  * @usageType: Secret usage type
  * @username: username
  * @lookupDef: lookup def describing secret
@@ -1035,7 +1098,8 @@ qemuDomainSupportsEncryptedSecret(qemuDomainObjPrivatePtr priv)
  * to eventually free @secinfo.
  */
 static qemuDomainSecretInfoPtr
-qemuDomainSecretInfoNewPlain(virSecretUsageType usageType,
+qemuDomainSecretInfoNewPlain(qemuDomainObjPrivatePtr priv,
+                             virSecretUsageType usageType,
                              const char *username,
                              virSecretLookupTypeDefPtr lookupDef)
 {
@@ -1044,7 +1108,7 @@ qemuDomainSecretInfoNewPlain(virSecretUsageType usageType,
     if (VIR_ALLOC(secinfo) < 0)
         return NULL;
 
-    if (qemuDomainSecretPlainSetup(secinfo, usageType, username, lookupDef) < 0) {
+    if (qemuDomainSecretPlainSetup(priv, secinfo, usageType, username, lookupDef) < 0) {
         g_clear_pointer(&secinfo, qemuDomainSecretInfoFree);
         return NULL;
     }
@@ -1181,7 +1245,7 @@ qemuDomainSecretStorageSourcePrepare(qemuDomainObjPrivatePtr priv,
 
         if (!qemuDomainSupportsEncryptedSecret(priv) ||
             (src->protocol == VIR_STORAGE_NET_PROTOCOL_ISCSI && !iscsiHasPS)) {
-            srcPriv->secinfo = qemuDomainSecretInfoNewPlain(usageType,
+            srcPriv->secinfo = qemuDomainSecretInfoNewPlain(priv, usageType,
                                                             src->auth->username,
                                                             &src->auth->seclookupdef);
         } else {
@@ -1263,7 +1327,7 @@ qemuDomainSecretHostdevPrepare(qemuDomainObjPrivatePtr priv,
             srcPriv = QEMU_DOMAIN_STORAGE_SOURCE_PRIVATE(src);
 
             if (!qemuDomainSupportsEncryptedSecret(priv) || !iscsiHasPS) {
-                srcPriv->secinfo = qemuDomainSecretInfoNewPlain(usageType,
+                srcPriv->secinfo = qemuDomainSecretInfoNewPlain(priv, usageType,
                                                                 src->auth->username,
                                                                 &src->auth->seclookupdef);
             } else {
@@ -1517,6 +1581,274 @@ qemuDomainSecretPrepare(virQEMUDriverPtr driver,
 }
 
 
+static int
+qemuDomainSecretPrefetchAdd(virSecretValueLookupPtr *lookups,
+                            size_t *nlookups,
+                            virSecretLookupTypeDefPtr seclookupdef,
+                            virSecretUsageType usageType)
+{
+    virSecretValueLookup lookup = { .usageType = usageType };
+
+    if (qemuDomainSecretLookupFind(*lookups, *nlookups, seclookupdef, usageType))
+        return 0;
+
+    virSecretLookupDefCopy(&lookup.def, seclookupdef);
+
+    return VIR_APPEND_ELEMENT(*lookups, *nlookups, lookup);
+}
+
+
+static int
+qemuDomainSecretPrefetchAddTLS(virSecretValueLookupPtr *lookups,
+                               size_t *nlookups,
+                               virTristateBool haveTLS,
+                               bool defaultTLS,
+                               const char *secretUUID)
+{
+    virSecretLookupTypeDef seclookupdef = { .type = VIR_SECRET_LOOKUP_TYPE_UUID };
+
+    if (!secretUUID)
+        return 0;
+
+    if (haveTLS == VIR_TRISTATE_BOOL_NO ||
+        (haveTLS == VIR_TRISTATE_BOOL_ABSENT && !defaultTLS))
+        return 0;
+
+    /* malformed UUIDs are reported by qemuDomainSecretInfoTLSNew */
+    if (virUUIDParse(secretUUID, seclookupdef.u.uuid) < 0)
+        return 0;
+
+    return qemuDomainSecretPrefetchAdd(lookups, nlookups, &seclookupdef,
+                                       VIR_SECRET_USAGE_TYPE_TLS);
+}
+
+
+static int
+qemuDomainSecretPrefetchStorageSource(virQEMUDriverConfigPtr cfg,
+                                      virStorageSourcePtr src,
+                                      virSecretValueLookupPtr *lookups,
+                                      size_t *nlookups)
+{
+    virStorageSourcePtr n;
+
+    for (n = src; virStorageSourceIsBacking(n); n = n->backingStore) {
+        if (qemuDomainStorageSourceHasAuth(n)) {
+            virSecretUsageType usageType = VIR_SECRET_USAGE_TYPE_ISCSI;
+
+            if (n->protocol == VIR_STORAGE_NET_PROTOCOL_RBD)
+                usageType = VIR_SECRET_USAGE_TYPE_CEPH;
+
+            if (qemuDomainSecretPrefetchAdd(lookups, nlookups,
+                                            &n->auth->seclookupdef,
+                                            usageType) < 0)
+                return -1;
+        }
+
+        if (qemuDomainDiskHasEncryptionSecret(n) &&
+            qemuDomainSecretPrefetchAdd(lookups, nlookups,
+                                        &n->encryption->secrets[0]->seclookupdef,
+                                        VIR_SECRET_USAGE_TYPE_VOLUME) < 0)
+            return -1;
+
+        if (virStorageSourceGetActualType(n) != VIR_STORAGE_TYPE_NETWORK)
+            continue;
+
+        if (n->protocol == VIR_STORAGE_NET_PROTOCOL_NBD &&
+            qemuDomainSecretPrefetchAddTLS(lookups, nlookups, n->haveTLS,
+                                           cfg->nbdTLS,
+                                           cfg->nbdTLSx509secretUUID) < 0)
+            return -1;
+
+        if (n->protocol == VIR_STORAGE_NET_PROTOCOL_VXHS &&
+            qemuDomainSecretPrefetchAddTLS(lookups, nlookups, n->haveTLS,
+                                           cfg->vxhsTLS,
+                                           cfg->vxhsTLSx509secretUUID) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+qemuDomainSecretPrefetchChardev(virQEMUDriverConfigPtr cfg,
+                                virDomainChrSourceDefPtr dev,
+                                virSecretValueLookupPtr *lookups,
+                                size_t *nlookups)
+{
+    if (dev->type != VIR_DOMAIN_CHR_TYPE_TCP)
+        return 0;
+
+    return qemuDomainSecretPrefetchAddTLS(lookups, nlookups,
+                                          dev->data.tcp.haveTLS, false,
+                                          cfg->chardevTLSx509secretUUID);
+}
+
+
+static int
+qemuDomainSecretPrefetchCollect(virQEMUDriverConfigPtr cfg,
+                                virDomainObjPtr vm,
+                                virSecretValueLookupPtr *lookups,
+                                size_t *nlookups)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virDomainDefPtr def = vm->def;
+    size_t i;
+
+    for (i = 0; i < def->ndisks; i++) {
+        if (qemuDomainSecretPrefetchStorageSource(cfg, def->disks[i]->src,
+                                                  lookups, nlookups) < 0)
+            return -1;
+    }
+
+    for (i = 0; i < def->nhostdevs; i++) {
+        virDomainHostdevDefPtr hostdev = def->hostdevs[i];
+        virDomainHostdevSubsysSCSIPtr scsisrc = &hostdev->source.subsys.u.scsi;
+        virStorageSourcePtr src = scsisrc->u.iscsi.src;
+
+        if (!virHostdevIsSCSIDevice(hostdev) ||
+            scsisrc->protocol != VIR_DOMAIN_HOSTDEV_SCSI_PROTOCOL_TYPE_ISCSI ||
+            !src->auth)
+            continue;
+
+        if (qemuDomainSecretPrefetchAdd(lookups, nlookups,
+                                        &src->auth->seclookupdef,
+                                        VIR_SECRET_USAGE_TYPE_ISCSI) < 0)
+            return -1;
+    }
+
+    for (i = 0; i < def->nserials; i++) {
+        if (qemuDomainSecretPrefetchChardev(cfg, def->serials[i]->source,
+                                            lookups, nlookups) < 0)
+            return -1;
+    }
+
+    for (i = 0; i < def->nparallels; i++) {
+        if (qemuDomainSecretPrefetchChardev(cfg, def->parallels[i]->source,
+                                            lookups, nlookups) < 0)
+            return -1;
+    }
+
+    for (i = 0; i < def->nchannels; i++) {
+        if (qemuDomainSecretPrefetchChardev(cfg, def->channels[i]->source,
+                                            lookups, nlookups) < 0)
+            return -1;
+    }
+
+    for (i = 0; i < def->nconsoles; i++) {
+        if (qemuDomainSecretPrefetchChardev(cfg, def->consoles[i]->source,
+                                            lookups, nlookups) < 0)
+            return -1;
+    }
+
+    for (i = 0; i < def->nsmartcards; i++) {
+        if (def->smartcards[i]->type == VIR_DOMAIN_SMARTCARD_TYPE_PASSTHROUGH &&
+            qemuDomainSecretPrefetchChardev(cfg, def->smartcards[i]->data.passthru,
+                                            lookups, nlookups) < 0)
+            return -1;
+    }
+
+    for (i = 0; i < def->nrngs; i++) {
+        if (def->rngs[i]->backend == VIR_DOMAIN_RNG_BACKEND_EGD &&
+            qemuDomainSecretPrefetchChardev(cfg, def->rngs[i]->source.chardev,
+                                            lookups, nlookups) < 0)
+            return -1;
+    }
+
+    for (i = 0; i < def->nredirdevs; i++) {
+        if (qemuDomainSecretPrefetchChardev(cfg, def->redirdevs[i]->source,
+                                            lookups, nlookups) < 0)
+            return -1;
+    }
+
+    for (i = 0; i < def->ngraphics; i++) {
+        if (def->graphics[i]->type != VIR_DOMAIN_GRAPHICS_TYPE_VNC ||
+            !virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_OBJECT_TLS_CREDS_X509))
+            continue;
+
+        if (qemuDomainSecretPrefetchAddTLS(lookups, nlookups,
+                                           VIR_TRISTATE_BOOL_ABSENT, cfg->vncTLS,
+                                           cfg->vncTLSx509secretUUID) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * qemuDomainSecretPrefetch:
+ * @cfg: driver configuration
+ * @vm: domain object
+ * @disk: disk being hotplugged or NULL
+ *
+ * Collects all secrets which will be needed to start @vm, or to hotplug
+ * @disk if it is non-NULL, and fetches them using a single call of the
+ * secret driver. The secrets are then used by the qemuDomainSecret*
+ * functions instead of looking up each of them separately.
+ *
+ * The prefetch is only an optimization. If fetching any of the secrets
+ * fails the prefetched data is discarded and the secrets are looked up
+ * one by one later, which reports errors for the particular secret.
+ *
+ * Callers must call qemuDomainSecretPrefetchClear once the secrets were
+ * prepared.
+ */
+void
+qemuDomainSecretPrefetch(virQEMUDriverConfigPtr cfg,
+                         virDomainObjPtr vm,
+                         virDomainDiskDefPtr disk)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    g_autoptr(virConnect) conn = NULL;
+    virSecretValueLookupPtr lookups = NULL;
+    size_t nlookups = 0;
+    size_t i;
+    int rc;
+
+    qemuDomainSecretPrefetchClear(priv);
+
+    if (disk)
+        rc = qemuDomainSecretPrefetchStorageSource(cfg, disk->src,
+                                                   &lookups, &nlookups);
+    else
+        rc = qemuDomainSecretPrefetchCollect(cfg, vm, &lookups, &nlookups);
+
+    if (rc < 0 || nlookups == 0)
+        goto cleanup;
+
+    VIR_DEBUG("prefetching %zu secrets of domain %s", nlookups, vm->def->name);
+
+    if (!(conn = virGetConnectSecret()) ||
+        virSecretGetSecretStrings(conn, lookups, nlookups) < 0) {
+        VIR_DEBUG("failed to prefetch secrets: %s", virGetLastErrorMessage());
+        virResetLastError();
+        goto cleanup;
+    }
+
+    priv->prefetchedSecrets = g_steal_pointer(&lookups);
+    priv->nprefetchedSecrets = nlookups;
+    nlookups = 0;
+
+ cleanup:
+    for (i = 0; i < nlookups; i++)
+        virSecretValueLookupClear(lookups + i);
+    VIR_FREE(lookups);
+}
+
+
+void
+qemuDomainSecretPrefetchClear(qemuDomainObjPrivatePtr priv)
+{
+    size_t i;
+
+    for (i = 0; i < priv->nprefetchedSecrets; i++)
+        virSecretValueLookupClear(priv->prefetchedSecrets + i);
+    VIR_FREE(priv->prefetchedSecrets);
+    priv->nprefetchedSecrets = 0;
+}
+
+
 /* This is the old way of setting up per-domain directories */
 static void
 qemuDomainSetPrivatePathsOld(virQEMUDriverPtr driver,
@@ -1556,15 +1888,63 @@ qemuDomainSetPrivatePaths(virQEMUDriverPtr driver,
 }
 
 
+/* Binds the event thread of @dom to the housekeeping CPUs of the host
+ * NUMA nodes the memory of @dom is bound to, so that the thread talks
+ * to QEMU and allocates its memory on the nodes of the domain. */
+static void
+qemuDomainObjBindWorker(virDomainObjPtr dom)
+{
+    qemuDomainObjPrivatePtr priv = dom->privateData;
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(priv->driver);
+    virBitmapPtr nodeset = NULL;
+    g_autoptr(virBitmap) cpus = NULL;
+    g_autoptr(virBitmap) isolated = NULL;
+
+    if (!cfg->monitorEventThreadNUMA || !priv->eventThread)
+        return;
+
+    if (virDomainNumatuneMaybeGetNodeset(dom->def->numa, priv->autoNodeset,
+                                         &nodeset, -1) < 0 ||
+        !nodeset ||
+        virNumaNodesetToCPUset(nodeset, &cpus) < 0 ||
+        !(isolated = virHostCPUGetIsolatedBitmap())) {
+        VIR_DEBUG("Not binding event thread of domain %s: %s",
+                  dom->def->name, NULLSTR(virGetLastErrorMessage()));
+        virResetLastError();
+        return;
+    }
+
+    virBitmapSubtract(cpus, isolated);
+    if (virBitmapIsAllClear(cpus)) {
+        VIR_DEBUG("No housekeeping CPUs on the NUMA nodes of domain %s",
+                  dom->def->name);
+        return;
+    }
+
+    virEventThreadSetAffinity(priv->eventThread, cpus);
+}
+
+
 int
 qemuDomainObjStartWorker(virDomainObjPtr dom)
 {
     qemuDomainObjPrivatePtr priv = dom->privateData;
+    qemuEventThreadPoolPtr pool = priv->driver->eventThreadPool;
+
+    if (pool) {
+        if (!priv->eventMember &&
+            !(priv->eventMember = qemuEventThreadPoolJoin(pool, dom->def->name)))
+            return -1;
+
+        return 0;
+    }
 
     if (!priv->eventThread) {
         g_autofree char *threadName = g_strdup_printf("vm-%s", dom->def->name);
         if (!(priv->eventThread = virEventThreadNew(threadName)))
             return -1;
+
+        qemuDomainObjBindWorker(dom);
     }
 
     return 0;
@@ -1580,6 +1960,53 @@ qemuDomainObjStopWorker(virDomainObjPtr dom)
         g_object_unref(priv->eventThread);
         priv->eventThread = NULL;
     }
+
+    if (priv->eventMember) {
+        qemuEventThreadPoolLeave(priv->driver->eventThreadPool,
+                                 priv->eventMember);
+        priv->eventMember = NULL;
+    }
+}
+
+
+/**
+ * qemuDomainObjGetWorkerContext:
+ * @dom: domain object
+ *
+ * Returns a new reference to the context which is supposed to handle
+ * I/O of the monitor and guest agent of @dom.
+ */
+GMainContext *
+qemuDomainObjGetWorkerContext(virDomainObjPtr dom)
+{
+    qemuDomainObjPrivatePtr priv = dom->privateData;
+
+    if (priv->eventMember)
+        return qemuEventThreadPoolGetContext(priv->driver->eventThreadPool,
+                                             priv->eventMember);
+
+    return g_main_context_ref(virEventThreadGetContext(priv->eventThread));
+}
+
+
+/**
+ * qemuDomainObjUpdateWorker:
+ * @dom: domain object
+ *
+ * Lets shared event threads know about the current monitor and guest
+ * agent of @dom, which have to be moved together with the domain.
+ */
+void
+qemuDomainObjUpdateWorker(virDomainObjPtr dom)
+{
+    qemuDomainObjPrivatePtr priv = dom->privateData;
+    qemuEventThreadPoolPtr pool = priv->driver->eventThreadPool;
+
+    if (!priv->eventMember)
+        return;
+
+    qemuEventThreadPoolSetMonitor(pool, priv->eventMember, priv->mon);
+    qemuEventThreadPoolSetAgent(pool, priv->eventMember, priv->agent);
 }
 
 
@@ -1643,13 +2070,18 @@ qemuDomainObjPrivateDataClear(qemuDomainObjPrivatePtr priv)
     VIR_FREE(priv->libDir);
     VIR_FREE(priv->channelTargetDir);
 
+    qemuDomainSecretPrefetchClear(priv);
+
     priv->memPrealloc = false;
+    priv->memPreallocThreads = 0;
 
     /* remove automatic pinning data */
     virBitmapFree(priv->autoNodeset);
     priv->autoNodeset = NULL;
     virBitmapFree(priv->autoCpuset);
     priv->autoCpuset = NULL;
+    virBitmapFree(priv->topologyCpus);
+    priv->topologyCpus = NULL;
 
     /* remove address data */
     virDomainPCIAddressSetFree(priv->pciaddrs);
@@ -1691,6 +2123,15 @@ qemuDomainObjPrivateDataClear(qemuDomainObjPrivatePtr priv)
     priv->dbusVMStateIds = NULL;
 
     priv->dbusVMState = false;
+
+    qemuDomainStatsCacheClear(priv);
+    qemuDomainGuestInfoCacheClear(priv);
+    qemuDomainBlockCapacityCacheClear(priv);
+    qemuDomainBalloonStatsCacheClear(priv);
+
+    VIR_FREE(priv->iothreadPoll);
+    priv->niothreadPoll = 0;
+    priv->iothreadPollTimestamp = 0;
 }
 
 
@@ -1730,6 +2171,10 @@ qemuDomainObjPrivateFree(void *data)
         g_object_unref(priv->eventThread);
     }
 
+    /* the membership is released together with the pool */
+    if (priv->eventMember)
+        VIR_ERROR(_("Unexpected event thread membership during domain deletion"));
+
     VIR_FREE(priv);
 }
 
@@ -1949,6 +2394,24 @@ qemuDomainObjPrivateXMLFormatAutomaticPlacement(virBufferPtr buf,
 }
 
 
+static int
+qemuDomainObjPrivateXMLFormatTopologyPlacement(virBufferPtr buf,
+                                               qemuDomainObjPrivatePtr priv)
+{
+    g_autofree char *cpuset = NULL;
+
+    if (!priv->topologyCpus)
+        return 0;
+
+    if (!(cpuset = virBitmapFormat(priv->topologyCpus)))
+        return -1;
+
+    virBufferAsprintf(buf, "<topologyPlacement cpuset='%s'/>\n", cpuset);
+
+    return 0;
+}
+
+
 typedef struct qemuDomainPrivateBlockJobFormatData {
     virDomainXMLOptionPtr xmlopt;
     virBufferPtr buf;
@@ -2057,6 +2520,10 @@ qemuDomainObjPrivateXMLFormatBlockjobIterator(void *payload,
         virXMLFormatElement(&childBuf, "chains", NULL, &chainsBuf);
     }
 
+    if (job->autotune.enabled)
+        virBufferAsprintf(&childBuf, "<autotune max='%llu' speed='%llu'/>\n",
+                          job->autotune.max, job->autotune.speed);
+
     switch ((qemuBlockJobType) job->type) {
         case QEMU_BLOCKJOB_TYPE_PULL:
             if (job->data.pull.base)
@@ -2171,6 +2638,8 @@ qemuDomainObjPrivateXMLFormatPR(virBufferPtr buf,
 {
     if (priv->prDaemonRunning)
         virBufferAddLit(buf, "<prDaemon/>\n");
+    if (priv->prDaemonShared)
+        virBufferAddLit(buf, "<prDaemonShared/>\n");
 }
 
 
@@ -2330,6 +2799,9 @@ qemuDomainObjPrivateXMLFormat(virBufferPtr buf,
     if (qemuDomainObjPrivateXMLFormatAutomaticPlacement(buf, priv) < 0)
         return -1;
 
+    if (qemuDomainObjPrivateXMLFormatTopologyPlacement(buf, priv) < 0)
+        return -1;
+
     /* Various per-domain paths */
     virBufferEscapeString(buf, "<libDir path='%s'/>\n", priv->libDir);
     virBufferEscapeString(buf, "<channelTargetDir path='%s'/>\n",
@@ -2690,6 +3162,13 @@ qemuDomainObjPrivateXMLParseBlockjobData(virDomainObjPtr vm,
     if (virXPathULongHex("string(./@jobflags)", ctxt, &jobflags) != 0)
         job->jobflagsmissing = true;
 
+    if (virXPathNode("./autotune", ctxt) &&
+        virXPathULongLong("string(./autotune/@max)", ctxt,
+                          &job->autotune.max) == 0 &&
+        virXPathULongLong("string(./autotune/@speed)", ctxt,
+                          &job->autotune.speed) == 0)
+        job->autotune.enabled = true;
+
     if (!disk && !invalidData) {
         if ((tmp = virXPathNode("./chains/disk", ctxt)) &&
             !(job->chain = qemuDomainObjPrivateXMLParseBlockjobChain(tmp, ctxt, xmlopt)))
@@ -2803,9 +3282,11 @@ qemuDomainObjPrivateXMLParseAllowReboot(xmlXPathContextPtr ctxt,
 
 static void
 qemuDomainObjPrivateXMLParsePR(xmlXPathContextPtr ctxt,
-                               bool *prDaemonRunning)
+                               bool *prDaemonRunning,
+                               bool *prDaemonShared)
 {
     *prDaemonRunning = virXPathBoolean("boolean(./prDaemon)", ctxt) > 0;
+    *prDaemonShared = virXPathBoolean("boolean(./prDaemonShared)", ctxt) > 0;
 }
 
 
@@ -3026,6 +3507,12 @@ qemuDomainObjPrivateXMLParse(xmlXPathContextPtr ctxt,
     if (qemuDomainObjPrivateXMLParseAutomaticPlacement(ctxt, priv, driver) < 0)
         goto error;
 
+    if ((tmp = virXPathString("string(./topologyPlacement/@cpuset)", ctxt))) {
+        if (virBitmapParse(tmp, &priv->topologyCpus, VIR_DOMAIN_CPUMASK_LEN) < 0)
+            goto error;
+        VIR_FREE(tmp);
+    }
+
     if ((tmp = virXPathString("string(./libDir/@path)", ctxt)))
         priv->libDir = tmp;
     if ((tmp = virXPathString("string(./channelTargetDir/@path)", ctxt)))
@@ -3042,7 +3529,8 @@ qemuDomainObjPrivateXMLParse(xmlXPathContextPtr ctxt,
 
     qemuDomainObjPrivateXMLParseAllowReboot(ctxt, &priv->allowReboot);
 
-    qemuDomainObjPrivateXMLParsePR(ctxt, &priv->prDaemonRunning);
+    qemuDomainObjPrivateXMLParsePR(ctxt, &priv->prDaemonRunning,
+                                   &priv->prDaemonShared);
 
     if (qemuDomainObjPrivateXMLParseBlockjobs(vm, priv, ctxt) < 0)
         goto error;
@@ -3704,8 +4192,8 @@ qemuCanonicalizeMachine(virDomainDefPtr def, virQEMUCapsPtr qemuCaps)
 
     if (STRNEQ(canon, def->os.machine)) {
         char *tmp;
-        tmp = g_strdup(canon);
-        VIR_FREE(def->os.machine);
+        tmp = virStringIntern(canon);
+        virStringInternRelease(def->os.machine);
         def->os.machine = tmp;
     }
 
@@ -4162,8 +4650,8 @@ qemuDomainDefPostParseBasic(virDomainDefPtr def,
 
     /* check for emulator and create a default one if needed */
     if (!def->emulator) {
-        if (!(def->emulator = virQEMUCapsGetDefaultEmulator(
-                  driver->hostarch, def->os.arch))) {
+        if (!(def->emulator = virStringInternTake(virQEMUCapsGetDefaultEmulator(
+                  driver->hostarch, def->os.arch)))) {
             virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
                            _("No emulator found for arch '%s'"),
                            virArchToString(def->os.arch));
@@ -4209,7 +4697,7 @@ qemuDomainDefPostParse(virDomainDefPtr def,
             return -1;
         }
 
-        def->os.machine = g_strdup(machine);
+        def->os.machine = virStringIntern(machine);
     }
 
     qemuDomainNVRAMPathGenerate(cfg, def);
@@ -5355,7 +5843,12 @@ void
 qemuDomainObjSaveStatus(virQEMUDriverPtr driver,
                         virDomainObjPtr obj)
 {
-    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    g_autoptr(virQEMUDriverConfig) cfg = NULL;
+
+    if (QEMU_DOMAIN_PRIVATE(obj)->saveStatusHeld)
+        return;
+
+    cfg = virQEMUDriverGetConfig(driver);
 
     if (virDomainObjIsActive(obj)) {
         if (virDomainObjSave(obj, driver->xmlopt, cfg->stateDir) < 0)
@@ -5371,6 +5864,33 @@ qemuDomainSaveStatus(virDomainObjPtr obj)
 }
 
 
+/**
+ * qemuDomainSaveStatusDeferred:
+ * @obj: domain object
+ *
+ * Like qemuDomainSaveStatus, but the status XML is written by a background
+ * worker after @obj is unlocked, so that bursts of updates result in a
+ * single write. Use only for state which is refreshed from QEMU on
+ * reconnect anyway; a following qemuDomainSaveStatus acts as a barrier.
+ */
+void
+qemuDomainSaveStatusDeferred(virDomainObjPtr obj)
+{
+    virQEMUDriverPtr driver = QEMU_DOMAIN_PRIVATE(obj)->driver;
+    g_autoptr(virQEMUDriverConfig) cfg = NULL;
+
+    if (QEMU_DOMAIN_PRIVATE(obj)->saveStatusHeld)
+        return;
+
+    cfg = virQEMUDriverGetConfig(driver);
+
+    if (virDomainObjIsActive(obj)) {
+        if (virDomainObjSaveDeferred(obj, driver->xmlopt, cfg->stateDir) < 0)
+            VIR_WARN("Failed to save status on vm %s", obj->def->name);
+    }
+}
+
+
 void
 qemuDomainSaveConfig(virDomainObjPtr obj)
 {
@@ -5423,7 +5943,8 @@ qemuDomainObjEnterMonitorInternal(virQEMUDriverPtr driver,
     } else if (priv->job.asyncOwner == virThreadSelfID()) {
         VIR_WARN("This thread seems to be the async job owner; entering"
                  " monitor without asking for a nested job is dangerous");
-    } else if (priv->job.owner != virThreadSelfID()) {
+    } else if (priv->job.owner != virThreadSelfID() &&
+               priv->job.queryActive == 0) {
         VIR_WARN("Entering a monitor without owning a job. "
                  "Job %s owner %s (%llu)",
                  qemuDomainJobTypeToString(priv->job.active),
@@ -5462,7 +5983,9 @@ qemuDomainObjExitMonitorInternal(virQEMUDriverPtr driver,
     if (!hasRefs)
         priv->mon = NULL;
 
-    if (priv->job.active == QEMU_JOB_ASYNC_NESTED)
+    /* query jobs may use the monitor while a nested job is active */
+    if (priv->job.active == QEMU_JOB_ASYNC_NESTED &&
+        priv->job.owner == virThreadSelfID())
         qemuDomainObjEndJob(driver, obj);
 }
 
@@ -10391,6 +10914,111 @@ qemuProcessEventFree(struct qemuProcessEvent *event)
 }
 
 
+/**
+ * qemuDomainStatsCacheGetEntry:
+ * @priv: domain private data
+ * @stats: single VIR_DOMAIN_STATS_* group
+ *
+ * Returns the stats cache entry of @vm for @stats, adding an empty one
+ * if there's none yet.
+ */
+qemuDomainStatsCacheEntryPtr
+qemuDomainStatsCacheGetEntry(qemuDomainObjPrivatePtr priv,
+                             unsigned int stats)
+{
+    qemuDomainStatsCacheEntry entry = { .stats = stats };
+    size_t i;
+
+    for (i = 0; i < priv->nstatsCache; i++) {
+        if (priv->statsCache[i].stats == stats)
+            return priv->statsCache + i;
+    }
+
+    ignore_value(VIR_APPEND_ELEMENT(priv->statsCache, priv->nstatsCache, entry));
+    return priv->statsCache + priv->nstatsCache - 1;
+}
+
+
+static void
+qemuDomainStatsCacheEntryReset(qemuDomainStatsCacheEntryPtr entry)
+{
+    virTypedParamsFree(entry->params, entry->nparams);
+    entry->params = NULL;
+    entry->nparams = 0;
+    entry->timestamp = 0;
+}
+
+
+/**
+ * qemuDomainStatsCacheInvalidate:
+ * @vm: domain object, must be locked
+ * @stats: mask of VIR_DOMAIN_STATS_* groups
+ *
+ * Drops the cached statistics of @vm for all groups in @stats, e.g.
+ * because an event reported a change of the data.
+ */
+void
+qemuDomainStatsCacheInvalidate(virDomainObjPtr vm,
+                               unsigned int stats)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    size_t i;
+
+    for (i = 0; i < priv->nstatsCache; i++) {
+        if (priv->statsCache[i].stats & stats)
+            qemuDomainStatsCacheEntryReset(priv->statsCache + i);
+    }
+}
+
+
+void
+qemuDomainStatsCacheClear(qemuDomainObjPrivatePtr priv)
+{
+    size_t i;
+
+    for (i = 0; i < priv->nstatsCache; i++)
+        qemuDomainStatsCacheEntryReset(priv->statsCache + i);
+    VIR_FREE(priv->statsCache);
+    priv->nstatsCache = 0;
+}
+
+
+void
+qemuDomainGuestInfoCacheClear(qemuDomainObjPrivatePtr priv)
+{
+    virTypedParamsFree(priv->guestInfoCache, priv->nguestInfoCache);
+    priv->guestInfoCache = NULL;
+    priv->nguestInfoCache = 0;
+    priv->guestInfoCacheTypes = 0;
+    priv->guestInfoCacheTimestamp = 0;
+}
+
+
+void
+qemuDomainBalloonStatsCacheClear(qemuDomainObjPrivatePtr priv)
+{
+    priv->nballoonStats = 0;
+    priv->balloonStatsExpire = 0;
+}
+
+
+/**
+ * qemuDomainBlockCapacityCacheClear:
+ * @priv: domain private data
+ *
+ * Drops the capacity data of block nodes kept for block statistics, e.g.
+ * because a disk was resized. The next statistics query fetches it from
+ * QEMU again.
+ */
+void
+qemuDomainBlockCapacityCacheClear(qemuDomainObjPrivatePtr priv)
+{
+    virHashFree(priv->blockCapacityCache);
+    priv->blockCapacityCache = NULL;
+    priv->blockCapacityCacheTimestamp = 0;
+}
+
+
 char *
 qemuDomainGetManagedPRSocketPath(qemuDomainObjPrivatePtr priv)
 {
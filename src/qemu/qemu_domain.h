@@ -65,6 +65,7 @@ qemuDomainObjSaveStatus(virQEMUDriverPtr driver,
                         virDomainObjPtr obj);
 
 void qemuDomainSaveStatus(virDomainObjPtr obj);
+void qemuDomainSaveStatusDeferred(virDomainObjPtr obj);
 void qemuDomainSaveConfig(virDomainObjPtr obj);
 
 
@@ -128,6 +129,31 @@ struct _qemuDomainSecretInfo {
     } s;
 };
 
+/* Statistics of one VIR_DOMAIN_STATS_* group last gathered for a domain */
+typedef struct _qemuDomainStatsCacheEntry qemuDomainStatsCacheEntry;
+typedef qemuDomainStatsCacheEntry *qemuDomainStatsCacheEntryPtr;
+struct _qemuDomainStatsCacheEntry {
+    unsigned int stats; /* virDomainStatsTypes group of the entry */
+    bool backing;       /* gathered with QEMU_DOMAIN_STATS_BACKING */
+    unsigned long long timestamp; /* ms since epoch, 0 if invalid */
+    virTypedParameterPtr params;
+    size_t nparams;
+};
+
+/* Load of one IOThread last sampled by the polling autotuning, see
+ * iothread_poll_autotune_interval in qemu.conf */
+typedef struct _qemuDomainIOThreadPoll qemuDomainIOThreadPoll;
+typedef qemuDomainIOThreadPoll *qemuDomainIOThreadPollPtr;
+struct _qemuDomainIOThreadPoll {
+    unsigned int iothread_id;
+    bool manual; /* polling was set by virDomainSetIOThreadParams */
+    virTristateBool polling; /* polling state set by the autotuning */
+    bool sampled;
+    unsigned long long cpuTime; /* ns */
+};
+
+#define QEMU_DOMAIN_MEM_PREALLOC_THREADS_AUTO -1
+
 typedef struct _qemuDomainObjPrivate qemuDomainObjPrivate;
 typedef qemuDomainObjPrivate *qemuDomainObjPrivatePtr;
 struct _qemuDomainObjPrivate {
@@ -138,6 +164,8 @@ struct _qemuDomainObjPrivate {
     virBitmapPtr namespaces;
 
     virEventThread *eventThread;
+    /* used instead of eventThread with shared event threads */
+    qemuEventThreadMemberPtr eventMember;
 
     qemuMonitorPtr mon;
     virDomainChrSourceDefPtr monConfig;
@@ -189,6 +217,9 @@ struct _qemuDomainObjPrivate {
     virBitmapPtr autoNodeset;
     virBitmapPtr autoCpuset;
 
+    /* host CPUs claimed by <vcpu placement='topology'/> */
+    virBitmapPtr topologyCpus;
+
     bool signalIOError; /* true if the domain condition should be signalled on
                            I/O error */
     bool signalStop; /* true if the domain condition should be signalled on
@@ -202,6 +233,11 @@ struct _qemuDomainObjPrivate {
     uint8_t *masterKey;
     size_t masterKeyLen;
 
+    /* values of secrets fetched ahead of preparing the domain or a device
+     * for startup or hotplug, see qemuDomainSecretPrefetch */
+    virSecretValueLookupPtr prefetchedSecrets;
+    size_t nprefetchedSecrets;
+
     /* note whether memory device alias does not correspond to slot number */
     bool memAliasOrderMismatch;
 
@@ -219,12 +255,18 @@ struct _qemuDomainObjPrivate {
     /* Tracks blockjob state for vm. Valid only while reconnecting to qemu. */
     virTristateBool reconnectBlockjobs;
 
+    /* Status XML saves are skipped while set. Used when reconnecting to
+     * qemu, which saves the status XML once at the end. */
+    bool saveStatusHeld;
+
     /* Migration capabilities. Rechecked on reconnect, not to be saved in
      * private XML. */
     virBitmapPtr migrationCaps;
 
     /* true if qemu-pr-helper process is running for the domain */
     bool prDaemonRunning;
+    /* true if the domain holds a reference to the shared qemu-pr-helper */
+    bool prDaemonShared;
 
     /* counter for generating node names for qemu disks */
     unsigned long long nodenameindex;
@@ -243,6 +285,11 @@ struct _qemuDomainObjPrivate {
     /* true if global -mem-prealloc appears on cmd line */
     bool memPrealloc;
 
+    /* number of threads used by QEMU for preallocating memory backends,
+     * QEMU_DOMAIN_MEM_PREALLOC_THREADS_AUTO to derive it from the host
+     * NUMA nodes backing the memory, or 0 to keep QEMU's default */
+    int memPreallocThreads;
+
     /* running block jobs */
     virHashTablePtr blockjobs;
 
@@ -263,6 +310,37 @@ struct _qemuDomainObjPrivate {
     char **dbusVMStateIds;
     /* true if -object dbus-vmstate was added */
     bool dbusVMState;
+
+    /* cached domain statistics, see stats_cache_interval in qemu.conf */
+    qemuDomainStatsCacheEntryPtr statsCache;
+    size_t nstatsCache;
+    bool statsCacheRefreshing; /* refresh is queued or running */
+    /* number of stats parameters reported last time, used to size
+     * the list of parameters for the next call */
+    size_t statsParamsHint;
+
+    /* cached result of virDomainGetGuestInfo, see guest_info_cache_ttl
+     * in qemu.conf */
+    virTypedParameterPtr guestInfoCache;
+    int nguestInfoCache;
+    unsigned int guestInfoCacheTypes; /* types requested by the caller */
+    unsigned long long guestInfoCacheTimestamp; /* ms, 0 if invalid */
+
+    /* qemuBlockStats with capacity data of block nodes keyed by node
+     * name, see stats_block_capacity_max_age in qemu.conf */
+    virHashTablePtr blockCapacityCache;
+    unsigned long long blockCapacityCacheTimestamp; /* ms */
+
+    /* IOThread polling autotuning state */
+    qemuDomainIOThreadPollPtr iothreadPoll;
+    size_t niothreadPoll;
+    unsigned long long iothreadPollTimestamp; /* ms, 0 if not sampled yet */
+
+    /* balloon statistics as last reported by the guest, they can't change
+     * until the guest reports new ones after the collection period */
+    virDomainMemoryStatStruct balloonStats[VIR_DOMAIN_MEMORY_STAT_NR];
+    int nballoonStats;
+    unsigned long long balloonStatsExpire; /* ms since epoch, 0 if invalid */
 };
 
 #define QEMU_DOMAIN_PRIVATE(vm) \
@@ -290,6 +368,11 @@ struct _qemuDomainDiskPrivate {
 
     char *qomName; /* QOM path of the disk (also refers to the block backend) */
     char *nodeCopyOnRead; /* nodename of the disk-wide copy-on-read blockdev layer */
+
+    /* IOThread polling autotuning */
+    bool iothreadPollSampled;
+    unsigned long long iothreadPollReqs; /* requests at the last sample */
+    unsigned int iothreadSuggested; /* IOThread last suggested for the disk */
 };
 
 #define QEMU_DOMAIN_STORAGE_SOURCE_PRIVATE(src) \
@@ -338,6 +421,11 @@ struct _qemuDomainVcpuPrivate {
     int thread_id;
     int node_id;
     int vcpus;
+
+    /* per-vCPU perf counters, opened on first use */
+    virPerfGroupPtr perf;
+    pid_t perfTid; /* thread @perf counts */
+    unsigned int perfEvents; /* bitmap of virPerfEventType in @perf */
 };
 
 #define QEMU_DOMAIN_VCPU_PRIVATE(vcpu) \
@@ -451,6 +539,19 @@ struct qemuProcessEvent {
 
 void qemuProcessEventFree(struct qemuProcessEvent *event);
 
+qemuDomainStatsCacheEntryPtr
+qemuDomainStatsCacheGetEntry(qemuDomainObjPrivatePtr priv,
+                             unsigned int stats);
+void qemuDomainStatsCacheInvalidate(virDomainObjPtr vm,
+                                    unsigned int stats);
+void qemuDomainStatsCacheClear(qemuDomainObjPrivatePtr priv);
+
+void qemuDomainGuestInfoCacheClear(qemuDomainObjPrivatePtr priv);
+
+void qemuDomainBlockCapacityCacheClear(qemuDomainObjPrivatePtr priv);
+
+void qemuDomainBalloonStatsCacheClear(qemuDomainObjPrivatePtr priv);
+
 #define QEMU_TYPE_DOMAIN_LOG_CONTEXT qemu_domain_log_context_get_type()
 G_DECLARE_FINAL_TYPE(qemuDomainLogContext, qemu_domain_log_context, QEMU, DOMAIN_LOG_CONTEXT, GObject);
 typedef qemuDomainLogContext *qemuDomainLogContextPtr;
@@ -491,10 +592,14 @@ struct _qemuDomainJobPrivate {
     bool spiceMigrated;                 /* spice migration completed */
     bool dumpCompleted;                 /* dump completed */
     qemuMigrationParamsPtr migParams;
+    bool tunnelCompressed;              /* incoming tunnel is compressed */
+    qemuDomainTunnelStatsPtr tunnelStats; /* owned by the migration tunnel */
 };
 
 int qemuDomainObjStartWorker(virDomainObjPtr dom);
 void qemuDomainObjStopWorker(virDomainObjPtr dom);
+GMainContext *qemuDomainObjGetWorkerContext(virDomainObjPtr dom);
+void qemuDomainObjUpdateWorker(virDomainObjPtr dom);
 
 virDomainObjPtr qemuDomainObjFromDomain(virDomainPtr domain);
 
@@ -870,6 +975,14 @@ int qemuDomainSecretPrepare(virQEMUDriverPtr driver,
                             virDomainObjPtr vm)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
 
+void qemuDomainSecretPrefetch(virQEMUDriverConfigPtr cfg,
+                              virDomainObjPtr vm,
+                              virDomainDiskDefPtr disk)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+
+void qemuDomainSecretPrefetchClear(qemuDomainObjPrivatePtr priv)
+    ATTRIBUTE_NONNULL(1);
+
 int qemuDomainDefValidateDiskLunSource(const virStorageSource *src)
     ATTRIBUTE_NONNULL(1);
 
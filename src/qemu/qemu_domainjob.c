@@ -26,6 +26,7 @@
 #include "virerror.h"
 #include "virtime.h"
 #include "virthreadjob.h"
+#include "virtrace.h"
 
 #define VIR_FROM_THIS VIR_FROM_QEMU
 
@@ -63,6 +64,25 @@ VIR_ENUM_IMPL(qemuDomainAsyncJob,
               "backup",
 );
 
+VIR_ENUM_IMPL(qemuDomainStartPhase,
+              QEMU_DOMAIN_START_PHASE_LAST,
+              "none",
+              "init",
+              "prepare",
+              "host",
+              "network",
+              "storage",
+              "ext_devices",
+              "cmdline",
+              "exec",
+              "cgroup",
+              "security",
+              "monitor",
+              "prealloc",
+              "qmp_init",
+              "finish",
+);
+
 const char *
 qemuDomainAsyncJobPhaseToString(qemuDomainAsyncJob job,
                                 int phase G_GNUC_UNUSED)
@@ -116,9 +136,23 @@ qemuDomainAsyncJobPhaseFromString(qemuDomainAsyncJob job,
 }
 
 
+void
+qemuDomainMirrorStatsClear(qemuDomainMirrorStatsPtr stats)
+{
+    size_t i;
+
+    for (i = 0; i < stats->ndisks; i++)
+        g_free(stats->disks[i].dst);
+    g_free(stats->disks);
+
+    memset(stats, 0, sizeof(*stats));
+}
+
+
 void
 qemuDomainJobInfoFree(qemuDomainJobInfoPtr info)
 {
+    qemuDomainMirrorStatsClear(&info->mirrorStats);
     g_free(info->errmsg);
     g_free(info);
 }
@@ -128,11 +162,19 @@ qemuDomainJobInfoPtr
 qemuDomainJobInfoCopy(qemuDomainJobInfoPtr info)
 {
     qemuDomainJobInfoPtr ret = g_new0(qemuDomainJobInfo, 1);
+    size_t i;
 
     memcpy(ret, info, sizeof(*info));
 
     ret->errmsg = g_strdup(info->errmsg);
 
+    ret->mirrorStats.disks = g_new0(qemuDomainMirrorDiskStats,
+                                    info->mirrorStats.ndisks);
+    for (i = 0; i < info->mirrorStats.ndisks; i++) {
+        ret->mirrorStats.disks[i] = info->mirrorStats.disks[i];
+        ret->mirrorStats.disks[i].dst = g_strdup(info->mirrorStats.disks[i].dst);
+    }
+
     return ret;
 }
 
@@ -264,6 +306,59 @@ qemuDomainTrackJob(qemuDomainJob job)
 }
 
 
+void
+qemuDomainJobInfoUpdateTunnel(qemuDomainJobInfoPtr jobInfo,
+                              qemuDomainTunnelStatsPtr stats)
+{
+    virMutexLock(&stats->lock);
+    jobInfo->tunnelRaw = stats->raw;
+    jobInfo->tunnelSent = stats->sent;
+    virMutexUnlock(&stats->lock);
+}
+
+
+void
+qemuDomainJobInfoUpdateLockStats(qemuDomainJobInfoPtr jobInfo,
+                                 virDomainObjPtr vm)
+{
+    virDomainLockStatsPtr base = &jobInfo->lockStatsBase;
+    virDomainLockStatsPtr now = &vm->lockStats;
+    virDomainLockStatsPtr stats = &jobInfo->lockStats;
+
+    /* maximums cannot be split per job and are left unset */
+    stats->acquires = now->acquires - base->acquires;
+    stats->acquireFailed = now->acquireFailed - base->acquireFailed;
+    stats->acquireBusy = now->acquireBusy - base->acquireBusy;
+    stats->acquireTime = now->acquireTime - base->acquireTime;
+    stats->releases = now->releases - base->releases;
+    stats->releaseFailed = now->releaseFailed - base->releaseFailed;
+    stats->releaseTime = now->releaseTime - base->releaseTime;
+}
+
+/**
+ * qemuDomainJobInfoSetStartPhase:
+ * @jobInfo: job info of the job starting a domain
+ * @phase: phase the start enters
+ *
+ * Accounts the time since the previous call to the phase entered then
+ * and starts measuring @phase. Passing QEMU_DOMAIN_START_PHASE_NONE
+ * stops measuring.
+ */
+void
+qemuDomainJobInfoSetStartPhase(qemuDomainJobInfoPtr jobInfo,
+                               qemuDomainStartPhase phase)
+{
+    unsigned long long now = g_get_monotonic_time();
+
+    if (jobInfo->startPhase != QEMU_DOMAIN_START_PHASE_NONE) {
+        jobInfo->startPhaseTime[jobInfo->startPhase] +=
+            now - jobInfo->startPhaseStamp;
+    }
+
+    jobInfo->startPhase = phase;
+    jobInfo->startPhaseStamp = now;
+}
+
 int
 qemuDomainJobInfoUpdateTime(qemuDomainJobInfoPtr jobInfo)
 {
@@ -385,6 +480,80 @@ qemuDomainJobInfoToInfo(qemuDomainJobInfoPtr jobInfo,
 }
 
 
+static int
+qemuDomainMirrorStatsToParams(qemuDomainMirrorStatsPtr stats,
+                              virTypedParameterPtr *par,
+                              int *npar,
+                              int *maxpar)
+{
+    size_t i;
+
+    if (stats->ndisks == 0)
+        return 0;
+
+    if (virTypedParamsAddUInt(par, npar, maxpar,
+                              VIR_DOMAIN_JOB_MIRROR_COUNT,
+                              stats->ndisks) < 0)
+        return -1;
+
+    for (i = 0; i < stats->ndisks; i++) {
+        qemuDomainMirrorDiskStatsPtr disk = stats->disks + i;
+        char field[VIR_TYPED_PARAM_FIELD_LENGTH];
+
+        g_snprintf(field, sizeof(field), "%s%zu%s", VIR_DOMAIN_JOB_MIRROR_PREFIX,
+                   i, VIR_DOMAIN_JOB_MIRROR_SUFFIX_NAME);
+        if (virTypedParamsAddString(par, npar, maxpar, field, disk->dst) < 0)
+            return -1;
+
+        g_snprintf(field, sizeof(field), "%s%zu%s", VIR_DOMAIN_JOB_MIRROR_PREFIX,
+                   i, VIR_DOMAIN_JOB_MIRROR_SUFFIX_TOTAL);
+        if (virTypedParamsAddULLong(par, npar, maxpar, field, disk->total) < 0)
+            return -1;
+
+        g_snprintf(field, sizeof(field), "%s%zu%s", VIR_DOMAIN_JOB_MIRROR_PREFIX,
+                   i, VIR_DOMAIN_JOB_MIRROR_SUFFIX_PROCESSED);
+        if (virTypedParamsAddULLong(par, npar, maxpar, field,
+                                    disk->transferred) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+qemuDomainLockStatsToParams(virDomainLockStatsPtr stats,
+                            virTypedParameterPtr *par,
+                            int *npar,
+                            int *maxpar)
+{
+    if (stats->acquires == 0 && stats->releases == 0)
+        return 0;
+
+    if (virTypedParamsAddULLong(par, npar, maxpar,
+                                VIR_DOMAIN_JOB_LOCK_ACQUIRES,
+                                stats->acquires) < 0 ||
+        virTypedParamsAddULLong(par, npar, maxpar,
+                                VIR_DOMAIN_JOB_LOCK_ACQUIRE_FAILED,
+                                stats->acquireFailed) < 0 ||
+        virTypedParamsAddULLong(par, npar, maxpar,
+                                VIR_DOMAIN_JOB_LOCK_ACQUIRE_BUSY,
+                                stats->acquireBusy) < 0 ||
+        virTypedParamsAddULLong(par, npar, maxpar,
+                                VIR_DOMAIN_JOB_LOCK_ACQUIRE_TIME,
+                                stats->acquireTime) < 0 ||
+        virTypedParamsAddULLong(par, npar, maxpar,
+                                VIR_DOMAIN_JOB_LOCK_RELEASES,
+                                stats->releases) < 0 ||
+        virTypedParamsAddULLong(par, npar, maxpar,
+                                VIR_DOMAIN_JOB_LOCK_RELEASE_TIME,
+                                stats->releaseTime) < 0)
+        return -1;
+
+    return 0;
+}
+
+
 static int
 qemuDomainMigrationJobInfoToParams(qemuDomainJobInfoPtr jobInfo,
                                    int *type,
@@ -494,12 +663,39 @@ qemuDomainMigrationJobInfoToParams(qemuDomainJobInfoPtr jobInfo,
                                 stats->ram_postcopy_reqs) < 0)
         goto error;
 
+    if (jobInfo->tunnelRaw > 0 &&
+        (virTypedParamsAddULLong(&par, &npar, &maxpar,
+                                 VIR_DOMAIN_JOB_TUNNEL_RAW,
+                                 jobInfo->tunnelRaw) < 0 ||
+         virTypedParamsAddULLong(&par, &npar, &maxpar,
+                                 VIR_DOMAIN_JOB_TUNNEL_SENT,
+                                 jobInfo->tunnelSent) < 0 ||
+         (jobInfo->timeElapsed > 0 &&
+          virTypedParamsAddULLong(&par, &npar, &maxpar,
+                                  VIR_DOMAIN_JOB_TUNNEL_BPS,
+                                  jobInfo->tunnelRaw * 1000 /
+                                  jobInfo->timeElapsed) < 0)))
+        goto error;
+
+    if (jobInfo->parallelConnections > 0 &&
+        (virTypedParamsAddInt(&par, &npar, &maxpar,
+                              VIR_DOMAIN_JOB_MEMORY_PARALLEL_CONNECTIONS,
+                              jobInfo->parallelConnections) < 0 ||
+         virTypedParamsAddULLong(&par, &npar, &maxpar,
+                                 VIR_DOMAIN_JOB_MEMORY_PARALLEL_BYTES,
+                                 stats->ram_multifd_bytes) < 0))
+        goto error;
+
     if (stats->ram_page_size > 0 &&
         virTypedParamsAddULLong(&par, &npar, &maxpar,
                                 VIR_DOMAIN_JOB_MEMORY_PAGE_SIZE,
                                 stats->ram_page_size) < 0)
         goto error;
 
+    if (qemuDomainLockStatsToParams(&jobInfo->lockStats,
+                                    &par, &npar, &maxpar) < 0)
+        goto error;
+
     /* The remaining stats are disk, mirror, or migration specific
      * so if this is a SAVEDUMP, we can just skip them */
     if (jobInfo->statsType == QEMU_DOMAIN_JOB_STATS_TYPE_SAVEDUMP)
@@ -525,6 +721,9 @@ qemuDomainMigrationJobInfoToParams(qemuDomainJobInfoPtr jobInfo,
                                 stats->disk_bps) < 0)
         goto error;
 
+    if (qemuDomainMirrorStatsToParams(mirrorStats, &par, &npar, &maxpar) < 0)
+        goto error;
+
     if (stats->xbzrle_set) {
         if (virTypedParamsAddULLong(&par, &npar, &maxpar,
                                     VIR_DOMAIN_JOB_COMPRESSION_CACHE,
@@ -562,6 +761,56 @@ qemuDomainMigrationJobInfoToParams(qemuDomainJobInfoPtr jobInfo,
 }
 
 
+static int
+qemuDomainGenericJobInfoToParams(qemuDomainJobInfoPtr jobInfo,
+                                 int *type,
+                                 virTypedParameterPtr *params,
+                                 int *nparams)
+{
+    virTypedParameterPtr par = NULL;
+    int maxpar = 0;
+    int npar = 0;
+    size_t i;
+
+    if (virTypedParamsAddInt(&par, &npar, &maxpar,
+                             VIR_DOMAIN_JOB_OPERATION,
+                             jobInfo->operation) < 0)
+        goto error;
+
+    if (virTypedParamsAddULLong(&par, &npar, &maxpar,
+                                VIR_DOMAIN_JOB_TIME_ELAPSED,
+                                jobInfo->timeElapsed) < 0)
+        goto error;
+
+    if (qemuDomainLockStatsToParams(&jobInfo->lockStats,
+                                    &par, &npar, &maxpar) < 0)
+        goto error;
+
+    /* named like the VIR_DOMAIN_JOB_START_TIME_* macros */
+    for (i = QEMU_DOMAIN_START_PHASE_NONE + 1; i < QEMU_DOMAIN_START_PHASE_LAST; i++) {
+        g_autofree char *field = NULL;
+
+        if (!jobInfo->startPhaseTime[i])
+            continue;
+
+        field = g_strdup_printf("start_time_%s",
+                                qemuDomainStartPhaseTypeToString(i));
+        if (virTypedParamsAddULLong(&par, &npar, &maxpar, field,
+                                    jobInfo->startPhaseTime[i]) < 0)
+            goto error;
+    }
+
+    *type = qemuDomainJobStatusToType(jobInfo->status);
+    *params = par;
+    *nparams = npar;
+    return 0;
+
+ error:
+    virTypedParamsFree(par, npar);
+    return -1;
+}
+
+
 static int
 qemuDomainDumpJobInfoToParams(qemuDomainJobInfoPtr jobInfo,
                               int *type,
@@ -680,9 +929,8 @@ qemuDomainJobInfoToParams(qemuDomainJobInfoPtr jobInfo,
         return qemuDomainBackupJobInfoToParams(jobInfo, type, params, nparams);
 
     case QEMU_DOMAIN_JOB_STATS_TYPE_NONE:
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("invalid job statistics type"));
-        break;
+        /* jobs which do not report progress, e.g. domain start */
+        return qemuDomainGenericJobInfoToParams(jobInfo, type, params, nparams);
 
     default:
         virReportEnumRangeError(qemuDomainJobStatsType, jobInfo->statsType);
@@ -758,6 +1006,28 @@ qemuDomainObjReleaseAsyncJob(virDomainObjPtr obj)
     priv->job.asyncOwner = 0;
 }
 
+/*
+ * qemuDomainObjAcquireAsyncJob:
+ *
+ * Makes the calling thread the owner of an async job previously released
+ * by qemuDomainObjReleaseAsyncJob, e.g. to finish it in a worker thread.
+ */
+void
+qemuDomainObjAcquireAsyncJob(virDomainObjPtr obj)
+{
+    qemuDomainObjPrivatePtr priv = obj->privateData;
+
+    VIR_DEBUG("Acquiring ownership of '%s' async job",
+              qemuDomainAsyncJobTypeToString(priv->job.asyncJob));
+
+    if (priv->job.asyncOwner) {
+        VIR_WARN("'%s' async job is owned by thread %llu",
+                 qemuDomainAsyncJobTypeToString(priv->job.asyncJob),
+                 priv->job.asyncOwner);
+    }
+    priv->job.asyncOwner = virThreadSelfID();
+}
+
 static bool
 qemuDomainNestedJobAllowed(qemuDomainJobObjPtr jobs, qemuDomainJob newJob)
 {
@@ -786,6 +1056,104 @@ qemuDomainObjCanSetJob(qemuDomainJobObjPtr job,
 /* Give up waiting for mutex after 30 seconds */
 #define QEMU_JOB_WAIT_TIME (1000ull * 30)
 
+/* Names of jobs in the statistics reported by qemuDomainJobGetWaitStats */
+VIR_ENUM_DECL(qemuDomainJobWaitStats);
+VIR_ENUM_IMPL(qemuDomainJobWaitStats,
+              QEMU_JOB_LAST,
+              "none",
+              "query",
+              "destroy",
+              "suspend",
+              "modify",
+              "abort",
+              "migration_op",
+              "async",
+              "async_nested",
+);
+
+typedef struct _qemuDomainJobWaitTime qemuDomainJobWaitTime;
+struct _qemuDomainJobWaitTime {
+    unsigned long long count;
+    unsigned long long timeTotal;
+    unsigned long long timeMax;
+};
+
+static virMutex qemuDomainJobWaitStatsLock = VIR_MUTEX_INITIALIZER;
+static qemuDomainJobWaitTime qemuDomainJobWaitTimes[QEMU_JOB_LAST];
+static qemuDomainJobWaitTime qemuDomainQueryJobWaitTime;
+
+
+static void
+qemuDomainJobWaitTimeUpdate(qemuDomainJobWaitTime *wait,
+                            unsigned long long start)
+{
+    unsigned long long elapsed = g_get_monotonic_time() - start;
+
+    virMutexLock(&qemuDomainJobWaitStatsLock);
+    wait->count++;
+    wait->timeTotal += elapsed;
+    wait->timeMax = MAX(wait->timeMax, elapsed);
+    virMutexUnlock(&qemuDomainJobWaitStatsLock);
+}
+
+
+static int
+qemuDomainJobWaitTimeFormat(virTypedParamListPtr params,
+                            const qemuDomainJobWaitTime *wait,
+                            const char *prefix,
+                            const char *name)
+{
+    unsigned long long avg = 0;
+
+    if (wait->count)
+        avg = wait->timeTotal / wait->count;
+
+    if (virTypedParamListAddULLong(params, wait->count,
+                                   "%sjob.%s.wait.count", prefix, name) < 0 ||
+        virTypedParamListAddULLong(params, avg,
+                                   "%sjob.%s.wait.time.avg", prefix, name) < 0 ||
+        virTypedParamListAddULLong(params, wait->timeMax,
+                                   "%sjob.%s.wait.time.max", prefix, name) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+/**
+ * qemuDomainJobGetWaitStats:
+ * @params: list to add the statistics to
+ * @prefix: prefix of the names of the statistics
+ *
+ * Reports how many jobs of each type were started and how long they had
+ * to wait for other jobs, in microseconds, for virAdmServerGetStats.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+qemuDomainJobGetWaitStats(virTypedParamListPtr params,
+                          const char *prefix)
+{
+    qemuDomainJobWaitTime waits[QEMU_JOB_LAST];
+    qemuDomainJobWaitTime queryWait;
+    size_t i;
+
+    virMutexLock(&qemuDomainJobWaitStatsLock);
+    memcpy(waits, qemuDomainJobWaitTimes, sizeof(waits));
+    queryWait = qemuDomainQueryJobWaitTime;
+    virMutexUnlock(&qemuDomainJobWaitStatsLock);
+
+    for (i = QEMU_JOB_NONE + 1; i < QEMU_JOB_LAST; i++) {
+        if (qemuDomainJobWaitTimeFormat(params, &waits[i], prefix,
+                                        qemuDomainJobWaitStatsTypeToString(i)) < 0)
+            return -1;
+    }
+
+    return qemuDomainJobWaitTimeFormat(params, &queryWait, prefix,
+                                       "concurrent_query");
+}
+
+
 /**
  * qemuDomainObjBeginJobInternal:
  * @driver: qemu driver
@@ -828,6 +1196,8 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
     unsigned long long duration = 0;
     unsigned long long agentDuration = 0;
     unsigned long long asyncDuration = 0;
+    unsigned long long start = g_get_monotonic_time();
+    virTraceSpan span = { 0 };
 
     VIR_DEBUG("Starting job: job=%s agentJob=%s asyncJob=%s "
               "(vm=%p name=%s, current job=%s agentJob=%s async=%s)",
@@ -842,6 +1212,15 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
     if (virTimeMillisNow(&now) < 0)
         return -1;
 
+    if (virTraceEnabled()) {
+        g_autofree char *detail = g_strdup_printf("%s/%s/%s",
+                                                  qemuDomainJobTypeToString(job),
+                                                  qemuDomainAgentJobTypeToString(agentJob),
+                                                  qemuDomainAsyncJobTypeToString(asyncJob));
+
+        virTraceSpanBegin(&span, "qemu.job.acquire", detail);
+    }
+
     priv->jobs_queued++;
     then = now + QEMU_JOB_WAIT_TIME;
 
@@ -901,6 +1280,7 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
             priv->job.asyncOwnerAPI = virThreadJobGet();
             priv->job.asyncStarted = now;
             priv->job.current->started = now;
+            priv->job.current->lockStatsBase = obj->lockStats;
         }
     }
 
@@ -918,9 +1298,13 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
         priv->job.agentStarted = now;
     }
 
+    if (job)
+        qemuDomainJobWaitTimeUpdate(&qemuDomainJobWaitTimes[job], start);
+
     if (qemuDomainTrackJob(job))
         qemuDomainObjSaveStatus(driver, obj);
 
+    virTraceSpanEnd(&span, false);
     return 0;
 
  error:
@@ -1012,6 +1396,7 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
 
  cleanup:
     priv->jobs_queued--;
+    virTraceSpanEnd(&span, true);
     return ret;
 }
 
@@ -1120,6 +1505,103 @@ qemuDomainObjBeginJobNowait(virQEMUDriverPtr driver,
                                          QEMU_ASYNC_JOB_NONE, true);
 }
 
+static int
+qemuDomainObjBeginQueryJobInternal(virDomainObjPtr obj,
+                                   bool nowait)
+{
+    qemuDomainObjPrivatePtr priv = obj->privateData;
+    unsigned long long start = g_get_monotonic_time();
+    unsigned long long then;
+
+    VIR_DEBUG("Starting query job (vm=%p name=%s, current job=%s async=%s)",
+              obj, obj->def->name,
+              qemuDomainJobTypeToString(priv->job.active),
+              qemuDomainAsyncJobTypeToString(priv->job.asyncJob));
+
+    if (virTimeMillisNow(&then) < 0)
+        return -1;
+    then += QEMU_JOB_WAIT_TIME;
+
+    while (!qemuDomainNestedJobAllowed(&priv->job, QEMU_JOB_QUERY)) {
+        if (nowait)
+            return -1;
+
+        VIR_DEBUG("Waiting for async job (vm=%p name=%s)", obj, obj->def->name);
+        if (virCondWaitUntil(&priv->job.asyncCond, &obj->parent.lock, then) < 0) {
+            if (errno == ETIMEDOUT) {
+                virReportError(VIR_ERR_OPERATION_TIMEOUT,
+                               _("cannot acquire state change "
+                                 "lock (held by monitor=%s)"),
+                               NULLSTR(priv->job.asyncOwnerAPI));
+            } else {
+                virReportSystemError(errno, "%s",
+                                     _("cannot acquire job mutex"));
+            }
+            return -1;
+        }
+    }
+
+    priv->job.queryActive++;
+    qemuDomainJobWaitTimeUpdate(&qemuDomainQueryJobWaitTime, start);
+
+    VIR_DEBUG("Started query job (vm=%p name=%s, running=%u)",
+              obj, obj->def->name, priv->job.queryActive);
+    return 0;
+}
+
+
+/**
+ * qemuDomainObjBeginQueryJob:
+ * @obj: domain object
+ *
+ * Acquires a job for an API which only reads data from the domain object
+ * and the QEMU monitor. Unlike QEMU_JOB_QUERY acquired by
+ * qemuDomainObjBeginJob, it doesn't wait for other synchronous jobs and
+ * any number of query jobs may run at once. The monitor serializes the
+ * commands of all of them. Only async jobs which don't allow
+ * QEMU_JOB_QUERY are waited for.
+ *
+ * Since another job may change the domain definition whenever the domain
+ * object is unlocked, callers must not keep pointers into the definition
+ * across monitor calls.
+ *
+ * To end the job call qemuDomainObjEndQueryJob.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+int
+qemuDomainObjBeginQueryJob(virDomainObjPtr obj)
+{
+    return qemuDomainObjBeginQueryJobInternal(obj, false);
+}
+
+
+/**
+ * qemuDomainObjBeginQueryJobNowait:
+ * @obj: domain object
+ *
+ * Same as qemuDomainObjBeginQueryJob but returns -1 without reporting
+ * an error if an async job doesn't allow queries.
+ */
+int
+qemuDomainObjBeginQueryJobNowait(virDomainObjPtr obj)
+{
+    return qemuDomainObjBeginQueryJobInternal(obj, true);
+}
+
+
+void
+qemuDomainObjEndQueryJob(virDomainObjPtr obj)
+{
+    qemuDomainObjPrivatePtr priv = obj->privateData;
+
+    priv->job.queryActive--;
+
+    VIR_DEBUG("Stopping query job (vm=%p name=%s, running=%u)",
+              obj, obj->def->name, priv->job.queryActive);
+}
+
+
 /*
  * obj must be locked and have a reference before calling
  *
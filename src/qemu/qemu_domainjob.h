@@ -99,12 +99,44 @@ typedef enum {
     QEMU_DOMAIN_JOB_STATS_TYPE_BACKUP,
 } qemuDomainJobStatsType;
 
+/* Phases of starting a QEMU process, see qemuProcessStart */
+typedef enum {
+    QEMU_DOMAIN_START_PHASE_NONE = 0,
+    QEMU_DOMAIN_START_PHASE_INIT,
+    QEMU_DOMAIN_START_PHASE_PREPARE,
+    QEMU_DOMAIN_START_PHASE_HOST,
+    QEMU_DOMAIN_START_PHASE_NETWORK,
+    QEMU_DOMAIN_START_PHASE_STORAGE,
+    QEMU_DOMAIN_START_PHASE_EXT_DEVICES,
+    QEMU_DOMAIN_START_PHASE_CMDLINE,
+    QEMU_DOMAIN_START_PHASE_EXEC,
+    QEMU_DOMAIN_START_PHASE_CGROUP,
+    QEMU_DOMAIN_START_PHASE_SECURITY,
+    QEMU_DOMAIN_START_PHASE_MONITOR,
+    QEMU_DOMAIN_START_PHASE_PREALLOC,
+    QEMU_DOMAIN_START_PHASE_QMP_INIT,
+    QEMU_DOMAIN_START_PHASE_FINISH,
+
+    QEMU_DOMAIN_START_PHASE_LAST
+} qemuDomainStartPhase;
+VIR_ENUM_DECL(qemuDomainStartPhase);
+
+
+typedef struct _qemuDomainMirrorDiskStats qemuDomainMirrorDiskStats;
+typedef qemuDomainMirrorDiskStats *qemuDomainMirrorDiskStatsPtr;
+struct _qemuDomainMirrorDiskStats {
+    char *dst;
+    unsigned long long transferred;
+    unsigned long long total;
+};
 
 typedef struct _qemuDomainMirrorStats qemuDomainMirrorStats;
 typedef qemuDomainMirrorStats *qemuDomainMirrorStatsPtr;
 struct _qemuDomainMirrorStats {
     unsigned long long transferred;
     unsigned long long total;
+    size_t ndisks;
+    qemuDomainMirrorDiskStatsPtr disks;
 };
 
 typedef struct _qemuDomainBackupStats qemuDomainBackupStats;
@@ -115,6 +147,15 @@ struct _qemuDomainBackupStats {
     unsigned long long tmp_total;
 };
 
+/* Counters of the migration tunnel, updated by its IO thread */
+typedef struct _qemuDomainTunnelStats qemuDomainTunnelStats;
+typedef qemuDomainTunnelStats *qemuDomainTunnelStatsPtr;
+struct _qemuDomainTunnelStats {
+    virMutex lock;
+    unsigned long long raw;     /* bytes read from QEMU */
+    unsigned long long sent;    /* bytes sent to the destination */
+};
+
 typedef struct _qemuDomainJobInfo qemuDomainJobInfo;
 typedef qemuDomainJobInfo *qemuDomainJobInfoPtr;
 struct _qemuDomainJobInfo {
@@ -142,10 +183,25 @@ struct _qemuDomainJobInfo {
         qemuDomainBackupStats backup;
     } stats;
     qemuDomainMirrorStats mirrorStats;
+    int parallelConnections; /* multifd channels used by migration */
+    unsigned long long tunnelRaw;  /* see qemuDomainTunnelStats */
+    unsigned long long tunnelSent;
+    /* Lock manager activity of the domain when the job started and the
+     * amount of it caused by the job so far */
+    virDomainLockStats lockStatsBase;
+    virDomainLockStats lockStats;
+    /* Time spent in each phase of starting QEMU, in microseconds, and
+     * the phase currently measured */
+    unsigned long long startPhaseTime[QEMU_DOMAIN_START_PHASE_LAST];
+    qemuDomainStartPhase startPhase;
+    unsigned long long startPhaseStamp;
 
     char *errmsg; /* optional error message for failed completed jobs */
 };
 
+void
+qemuDomainMirrorStatsClear(qemuDomainMirrorStatsPtr stats);
+
 void
 qemuDomainJobInfoFree(qemuDomainJobInfoPtr info);
 
@@ -190,6 +246,9 @@ struct _qemuDomainJobObj {
     const char *agentOwnerAPI;          /* The API which owns the agent job */
     unsigned long long agentStarted;    /* When the current agent job started */
 
+    /* Query jobs run alongside other jobs, see qemuDomainObjBeginQueryJob */
+    unsigned int queryActive;           /* Number of running query jobs */
+
     /* The following members are for QEMU_ASYNC_JOB_* */
     virCond asyncCond;                  /* Use to coordinate with async jobs */
     qemuDomainAsyncJob asyncJob;        /* Currently active async job */
@@ -238,9 +297,14 @@ int qemuDomainObjBeginJobNowait(virQEMUDriverPtr driver,
                                 virDomainObjPtr obj,
                                 qemuDomainJob job)
     G_GNUC_WARN_UNUSED_RESULT;
+int qemuDomainObjBeginQueryJob(virDomainObjPtr obj)
+    G_GNUC_WARN_UNUSED_RESULT;
+int qemuDomainObjBeginQueryJobNowait(virDomainObjPtr obj)
+    G_GNUC_WARN_UNUSED_RESULT;
 
 void qemuDomainObjEndJob(virQEMUDriverPtr driver,
                          virDomainObjPtr obj);
+void qemuDomainObjEndQueryJob(virDomainObjPtr obj);
 void qemuDomainObjEndAgentJob(virDomainObjPtr obj);
 void qemuDomainObjEndAsyncJob(virQEMUDriverPtr driver,
                               virDomainObjPtr obj);
@@ -255,6 +319,7 @@ int qemuDomainObjRestoreJob(virDomainObjPtr obj,
 void qemuDomainObjDiscardAsyncJob(virQEMUDriverPtr driver,
                                   virDomainObjPtr obj);
 void qemuDomainObjReleaseAsyncJob(virDomainObjPtr obj);
+void qemuDomainObjAcquireAsyncJob(virDomainObjPtr obj);
 
 void qemuDomainRemoveInactiveJob(virQEMUDriverPtr driver,
                                  virDomainObjPtr vm);
@@ -262,6 +327,17 @@ void qemuDomainRemoveInactiveJob(virQEMUDriverPtr driver,
 void qemuDomainRemoveInactiveJobLocked(virQEMUDriverPtr driver,
                                        virDomainObjPtr vm);
 
+int qemuDomainJobGetWaitStats(virTypedParamListPtr params,
+                              const char *prefix);
+
+void qemuDomainJobInfoUpdateTunnel(qemuDomainJobInfoPtr jobInfo,
+                                   qemuDomainTunnelStatsPtr stats);
+void qemuDomainJobInfoUpdateLockStats(qemuDomainJobInfoPtr jobInfo,
+                                      virDomainObjPtr vm)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+void qemuDomainJobInfoSetStartPhase(qemuDomainJobInfoPtr jobInfo,
+                                    qemuDomainStartPhase phase)
+    ATTRIBUTE_NONNULL(1);
 int qemuDomainJobInfoUpdateTime(qemuDomainJobInfoPtr jobInfo)
     ATTRIBUTE_NONNULL(1);
 int qemuDomainJobInfoUpdateDowntime(qemuDomainJobInfoPtr jobInfo)
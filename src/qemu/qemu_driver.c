@@ -39,6 +39,7 @@
 #include "qemu_conf.h"
 #include "qemu_capabilities.h"
 #include "qemu_command.h"
+#include "qemu_extdevice.h"
 #include "qemu_cgroup.h"
 #include "qemu_hostdev.h"
 #include "qemu_hotplug.h"
@@ -79,6 +80,7 @@
 #include "virsysinfo.h"
 #include "domain_nwfilter.h"
 #include "virhook.h"
+#include "virstatsprovider.h"
 #include "virstoragefile.h"
 #include "virfile.h"
 #include "virfdstream.h"
@@ -111,7 +113,7 @@
 
 VIR_LOG_INIT("qemu.qemu_driver");
 
-#define QEMU_NB_MEM_PARAM  3
+#define QEMU_NB_MEM_PARAM  4
 
 #define QEMU_NB_BLOCK_IO_TUNE_BASE_PARAMS 6
 #define QEMU_NB_BLOCK_IO_TUNE_MAX_PARAMS 7
@@ -137,6 +139,34 @@ VIR_LOG_INIT("qemu.qemu_driver");
 
 static void qemuProcessEventHandler(void *data, void *opaque);
 
+static void qemuDomainGetStatsJobRun(void *data, void *opaque);
+
+static void qemuDomainStatsCacheRefreshRun(void *data, void *opaque);
+
+static void qemuDomainStatsCacheTimer(int timer, void *opaque);
+
+static void qemuDomainNumaRebalanceRun(void *data, void *opaque);
+
+static void qemuDomainNumaRebalanceTimer(int timer, void *opaque);
+
+static void qemuDomainResctrlFeedbackRun(void *data, void *opaque);
+
+static void qemuDomainResctrlFeedbackTimer(int timer, void *opaque);
+
+static void qemuDomainBlockJobAutotuneRun(void *data, void *opaque);
+
+static void qemuDomainBlockJobAutotuneTimer(int timer, void *opaque);
+
+static void qemuDomainIOThreadPollRun(void *data, void *opaque);
+
+static void qemuDomainIOThreadPollTimer(int timer, void *opaque);
+
+static void qemuDomainMemoryManagerRun(void *data, void *opaque);
+
+static void qemuDomainMemoryManagerTimer(int timer, void *opaque);
+
+static void qemuEventThreadTimer(int timer, void *opaque);
+
 static int qemuStateCleanup(void);
 
 static int qemuDomainObjStart(virConnectPtr conn,
@@ -190,32 +220,84 @@ qemuSnapObjFromSnapshot(virDomainObjPtr vm,
 }
 
 
-static int
-qemuAutostartDomain(virDomainObjPtr vm,
-                    void *opaque)
+typedef struct _qemuAutostartData qemuAutostartData;
+typedef qemuAutostartData *qemuAutostartDataPtr;
+struct _qemuAutostartData {
+    virQEMUDriverPtr driver;
+    unsigned int flags;
+
+    virMutex lock;
+    virCond cond; /* signalled whenever a domain start finishes */
+    virDomainObjPtr *vms;
+    size_t nvms;
+    size_t next;
+    size_t nstarting;
+};
+
+
+/*
+ * Waits until the host has enough free memory for the whole memory of a
+ * domain of @memory KiB. The wait is over once no other domain is being
+ * started since there is nothing we could wait for, the start then either
+ * succeeds with memory overcommitted or fails as it used to.
+ */
+static void
+qemuAutostartAdmit(qemuAutostartDataPtr data,
+                   unsigned long long memory)
 {
-    virQEMUDriverPtr driver = opaque;
-    int flags = 0;
-    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
-    int ret = -1;
+    virMutexLock(&data->lock);
 
-    if (cfg->autoStartBypassCache)
-        flags |= VIR_DOMAIN_START_BYPASS_CACHE;
+    while (data->nstarting > 0) {
+        unsigned long long freeMem;
+
+        if (virHostMemGetInfo(NULL, &freeMem) < 0) {
+            virResetLastError();
+            break;
+        }
+
+        if (freeMem / 1024 >= memory)
+            break;
+
+        VIR_DEBUG("Waiting for %zu domain starts to finish, %llu KiB free "
+                  "on the host, %llu KiB needed",
+                  data->nstarting, freeMem / 1024, memory);
+
+        if (virCondWait(&data->cond, &data->lock) < 0)
+            break;
+    }
+
+    data->nstarting++;
+    virMutexUnlock(&data->lock);
+}
+
+
+static void
+qemuAutostartDomain(qemuAutostartDataPtr data,
+                    virDomainObjPtr vm)
+{
+    virQEMUDriverPtr driver = data->driver;
+    unsigned long long memory;
+
+    virObjectLock(vm);
+    memory = virDomainDefGetMemoryTotal(vm->def);
+    virObjectUnlock(vm);
+
+    qemuAutostartAdmit(data, memory);
 
     virObjectLock(vm);
-    virObjectRef(vm);
     virResetLastError();
     if (vm->autostart &&
         !virDomainObjIsActive(vm)) {
         if (qemuProcessBeginJob(driver, vm,
-                                VIR_DOMAIN_JOB_OPERATION_START, flags) < 0) {
+                                VIR_DOMAIN_JOB_OPERATION_START,
+                                data->flags) < 0) {
             virReportError(VIR_ERR_INTERNAL_ERROR,
                            _("Failed to start job on VM '%s': %s"),
                            vm->def->name, virGetLastErrorMessage());
             goto cleanup;
         }
 
-        if (qemuDomainObjStart(NULL, driver, vm, flags,
+        if (qemuDomainObjStart(NULL, driver, vm, data->flags,
                                QEMU_ASYNC_JOB_START) < 0) {
             virReportError(VIR_ERR_INTERNAL_ERROR,
                            _("Failed to autostart VM '%s': %s"),
@@ -225,17 +307,94 @@ qemuAutostartDomain(virDomainObjPtr vm,
         qemuProcessEndJob(driver, vm);
     }
 
-    ret = 0;
  cleanup:
-    virDomainObjEndAPI(&vm);
-    return ret;
+    virObjectUnlock(vm);
+
+    virMutexLock(&data->lock);
+    data->nstarting--;
+    virCondBroadcast(&data->cond);
+    virMutexUnlock(&data->lock);
+}
+
+
+static void
+qemuAutostartWorker(void *opaque)
+{
+    qemuAutostartDataPtr data = opaque;
+
+    while (true) {
+        size_t i;
+
+        virMutexLock(&data->lock);
+        i = data->next++;
+        virMutexUnlock(&data->lock);
+
+        if (i >= data->nvms)
+            break;
+
+        qemuAutostartDomain(data, data->vms[i]);
+    }
 }
 
 
+/*
+ * Starts all domains marked for autostart from up to auto_start_concurrency
+ * threads, the current one included.
+ */
 static void
 qemuAutostartDomains(virQEMUDriverPtr driver)
 {
-    virDomainObjListForEach(driver->domains, false, qemuAutostartDomain, driver);
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    qemuAutostartData data = { .driver = driver };
+    g_autofree virThread *threads = NULL;
+    size_t nworkers;
+    size_t nthreads = 0;
+    size_t i;
+
+    if (cfg->autoStartBypassCache)
+        data.flags |= VIR_DOMAIN_START_BYPASS_CACHE;
+
+    if (virMutexInit(&data.lock) < 0)
+        return;
+
+    if (virCondInit(&data.cond) < 0) {
+        virMutexDestroy(&data.lock);
+        return;
+    }
+
+    if (virDomainObjListCollect(driver->domains, NULL, &data.vms, &data.nvms,
+                                NULL, VIR_CONNECT_LIST_DOMAINS_AUTOSTART) < 0) {
+        VIR_ERROR(_("Failed to list domains to autostart: %s"),
+                  virGetLastErrorMessage());
+        goto cleanup;
+    }
+
+    nworkers = MIN(MAX(cfg->autoStartConcurrency, 1), data.nvms);
+
+    if (nworkers > 1) {
+        threads = g_new0(virThread, nworkers - 1);
+
+        for (i = 1; i < nworkers; i++) {
+            if (virThreadCreateFull(&threads[nthreads], true,
+                                    qemuAutostartWorker,
+                                    "qemu-autostart", false, &data) < 0) {
+                VIR_WARN("Unable to create autostart worker thread: %s",
+                         g_strerror(errno));
+                break;
+            }
+            nthreads++;
+        }
+    }
+
+    qemuAutostartWorker(&data);
+
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+
+ cleanup:
+    virObjectListFreeCount(data.vms, data.nvms);
+    virCondDestroy(&data.cond);
+    virMutexDestroy(&data.lock);
 }
 
 
@@ -621,6 +780,58 @@ qemuDomainFindMaxID(virDomainObjPtr vm,
 }
 
 
+static int
+qemuDomainCountQueuedJobs(virDomainObjPtr vm,
+                          void *data)
+{
+    unsigned long long *queued = data;
+    qemuDomainObjPrivatePtr priv;
+
+    virObjectLock(vm);
+    priv = vm->privateData;
+    *queued += priv->jobs_queued;
+    virObjectUnlock(vm);
+
+    return 0;
+}
+
+
+/* Reports driver wide counters for virAdmServerGetStats */
+static int
+qemuStateGetStats(virTypedParamListPtr params,
+                  const char *prefix,
+                  void *opaque)
+{
+    virQEMUDriverPtr driver = opaque;
+    qemuMonitorCommandStats monStats;
+    unsigned long long queued = 0;
+
+    qemuMonitorGetCommandStats(&monStats);
+    virDomainObjListForEach(driver->domains, false,
+                            qemuDomainCountQueuedJobs, &queued);
+
+    if (virTypedParamListAddULLong(params, monStats.commands,
+                                   "%smonitor.commands", prefix) < 0 ||
+        virTypedParamListAddULLong(params, monStats.failed,
+                                   "%smonitor.failed", prefix) < 0 ||
+        virTypedParamListAddULLong(params, monStats.timeAvg,
+                                   "%smonitor.time.avg", prefix) < 0 ||
+        virTypedParamListAddULLong(params, monStats.timeMax,
+                                   "%smonitor.time.max", prefix) < 0 ||
+        virTypedParamListAddULLong(params, queued,
+                                   "%sjob.queued", prefix) < 0)
+        return -1;
+
+    if (qemuDomainJobGetWaitStats(params, prefix) < 0)
+        return -1;
+
+    if (qemuProcessGetStartStats(params, prefix) < 0)
+        return -1;
+
+    return 0;
+}
+
+
 /**
  * qemuStateInitialize:
  *
@@ -645,6 +856,13 @@ qemuStateInitialize(bool privileged,
         return VIR_DRV_STATE_INIT_ERROR;
 
     qemu_driver->lockFD = -1;
+    qemu_driver->statsCacheTimer = -1;
+    qemu_driver->numaRebalanceTimer = -1;
+    qemu_driver->resctrlFeedbackTimer = -1;
+    qemu_driver->blockJobAutotuneTimer = -1;
+    qemu_driver->iothreadPollTimer = -1;
+    qemu_driver->memoryManagerTimer = -1;
+    qemu_driver->eventThreadTimer = -1;
 
     if (virMutexInit(&qemu_driver->lock) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
@@ -653,6 +871,14 @@ qemuStateInitialize(bool privileged,
         return VIR_DRV_STATE_INIT_ERROR;
     }
 
+    if (virMutexInit(&qemu_driver->sharedPRHelperLock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("cannot initialize mutex"));
+        virMutexDestroy(&qemu_driver->lock);
+        VIR_FREE(qemu_driver);
+        return VIR_DRV_STATE_INIT_ERROR;
+    }
+
     qemu_driver->inhibitCallback = callback;
     qemu_driver->inhibitOpaque = opaque;
 
@@ -669,10 +895,6 @@ qemuStateInitialize(bool privileged,
     if (!qemu_driver->domainEventState)
         goto error;
 
-    /* read the host sysinfo */
-    if (privileged)
-        qemu_driver->hostsysinfo = virSysinfoRead();
-
     if (!(qemu_driver->config = cfg = virQEMUDriverConfigNew(privileged, root)))
         goto error;
 
@@ -703,6 +925,14 @@ qemuStateInitialize(bool privileged,
                              cfg->cacheDir);
         goto error;
     }
+
+    /* read the host sysinfo */
+    if (privileged) {
+        g_autofree char *sysinfoCache = g_strdup_printf("%s/sysinfo",
+                                                        cfg->cacheDir);
+
+        qemu_driver->hostsysinfo = virSysinfoReadCached(sysinfoCache);
+    }
     if (virFileMakePath(cfg->saveDir) < 0) {
         virReportSystemError(errno, _("Failed to create save dir %s"),
                              cfg->saveDir);
@@ -997,8 +1227,133 @@ qemuStateInitialize(bool privileged,
     if (!qemu_driver->workerPool)
         goto error;
 
+    qemu_driver->capsRefreshPool = virThreadPoolNewFull(0, 1, 0,
+                                                        virQEMUDriverCapsRefreshRun,
+                                                        "qemu-caps-refresh",
+                                                        qemu_driver);
+    if (!qemu_driver->capsRefreshPool)
+        goto error;
+
+    if (cfg->statsWorkers > 0) {
+        qemu_driver->statsPool = virThreadPoolNewFull(0, cfg->statsWorkers, 0,
+                                                      qemuDomainGetStatsJobRun,
+                                                      "qemu-stats", qemu_driver);
+        if (!qemu_driver->statsPool)
+            goto error;
+    }
+
+    if (cfg->statsCacheInterval > 0) {
+        qemu_driver->statsCachePool = virThreadPoolNewFull(0, 1, 0,
+                                                           qemuDomainStatsCacheRefreshRun,
+                                                           "qemu-stats-cache",
+                                                           qemu_driver);
+        if (!qemu_driver->statsCachePool)
+            goto error;
+    }
+
+    if (cfg->numaRebalanceInterval > 0) {
+        qemu_driver->numaRebalancePool = virThreadPoolNewFull(0, 1, 0,
+                                                              qemuDomainNumaRebalanceRun,
+                                                              "qemu-numa-rebalance",
+                                                              qemu_driver);
+        if (!qemu_driver->numaRebalancePool)
+            goto error;
+    }
+
+    if (cfg->resctrlFeedbackInterval > 0) {
+        qemu_driver->resctrlFeedbackPool = virThreadPoolNewFull(0, 1, 0,
+                                                                qemuDomainResctrlFeedbackRun,
+                                                                "qemu-resctrl-feedback",
+                                                                qemu_driver);
+        if (!qemu_driver->resctrlFeedbackPool)
+            goto error;
+    }
+
+    if (cfg->blockJobAutotuneInterval > 0) {
+        qemu_driver->blockJobAutotunePool = virThreadPoolNewFull(0, 1, 0,
+                                                                 qemuDomainBlockJobAutotuneRun,
+                                                                 "qemu-blockjob-autotune",
+                                                                 qemu_driver);
+        if (!qemu_driver->blockJobAutotunePool)
+            goto error;
+    }
+
+    if (cfg->iothreadPollAutotuneInterval > 0) {
+        qemu_driver->iothreadPollPool = virThreadPoolNewFull(0, 1, 0,
+                                                             qemuDomainIOThreadPollRun,
+                                                             "qemu-iothread-poll",
+                                                             qemu_driver);
+        if (!qemu_driver->iothreadPollPool)
+            goto error;
+    }
+
+    if (cfg->memoryManagerInterval > 0) {
+        qemu_driver->memoryManagerPool = virThreadPoolNewFull(0, 1, 0,
+                                                              qemuDomainMemoryManagerRun,
+                                                              "qemu-memory-manager",
+                                                              qemu_driver);
+        if (!qemu_driver->memoryManagerPool)
+            goto error;
+    }
+
+    if (cfg->monitorEventThreads > 0 &&
+        !(qemu_driver->eventThreadPool =
+          qemuEventThreadPoolNew(cfg->monitorEventThreads)))
+        goto error;
+
     qemuProcessReconnectAll(qemu_driver);
 
+    if (qemu_driver->statsCachePool &&
+        (qemu_driver->statsCacheTimer =
+         virEventAddTimeout(cfg->statsCacheInterval * 1000,
+                            qemuDomainStatsCacheTimer,
+                            qemu_driver, NULL)) < 0)
+        VIR_WARN("Unable to register stats cache refresh timer, the cache "
+                 "will only be filled by stats queries");
+
+    if (qemu_driver->numaRebalancePool &&
+        (qemu_driver->numaRebalanceTimer =
+         virEventAddTimeout(cfg->numaRebalanceInterval * 1000,
+                            qemuDomainNumaRebalanceTimer,
+                            qemu_driver, NULL)) < 0)
+        VIR_WARN("Unable to register NUMA rebalancing timer");
+
+    if (qemu_driver->resctrlFeedbackPool &&
+        (qemu_driver->resctrlFeedbackTimer =
+         virEventAddTimeout(cfg->resctrlFeedbackInterval * 1000,
+                            qemuDomainResctrlFeedbackTimer,
+                            qemu_driver, NULL)) < 0)
+        VIR_WARN("Unable to register memory bandwidth feedback timer");
+
+    if (qemu_driver->blockJobAutotunePool &&
+        (qemu_driver->blockJobAutotuneTimer =
+         virEventAddTimeout(cfg->blockJobAutotuneInterval * 1000,
+                            qemuDomainBlockJobAutotuneTimer,
+                            qemu_driver, NULL)) < 0)
+        VIR_WARN("Unable to register block job autotuning timer");
+
+    if (qemu_driver->iothreadPollPool &&
+        (qemu_driver->iothreadPollTimer =
+         virEventAddTimeout(cfg->iothreadPollAutotuneInterval * 1000,
+                            qemuDomainIOThreadPollTimer,
+                            qemu_driver, NULL)) < 0)
+        VIR_WARN("Unable to register IOThread polling autotuning timer");
+
+    if (qemu_driver->memoryManagerPool &&
+        (qemu_driver->memoryManagerTimer =
+         virEventAddTimeout(cfg->memoryManagerInterval * 1000,
+                            qemuDomainMemoryManagerTimer,
+                            qemu_driver, NULL)) < 0)
+        VIR_WARN("Unable to register memory manager timer");
+
+    if (qemu_driver->eventThreadPool &&
+        (qemu_driver->eventThreadTimer =
+         virEventAddTimeout(1000, qemuEventThreadTimer,
+                            qemu_driver, NULL)) < 0)
+        VIR_WARN("Unable to register event thread rebalancing timer");
+
+    virStatsProviderRegister("qemu", qemuStateGetStats, qemu_driver);
+
     if (virDriverShouldAutostart(cfg->stateDir, &autostart) < 0)
         goto error;
 
@@ -1117,6 +1472,31 @@ qemuStateCleanup(void)
     if (!qemu_driver)
         return -1;
 
+    virStatsProviderUnregister("qemu");
+
+    if (qemu_driver->statsCacheTimer != -1)
+        virEventRemoveTimeout(qemu_driver->statsCacheTimer);
+    if (qemu_driver->numaRebalanceTimer != -1)
+        virEventRemoveTimeout(qemu_driver->numaRebalanceTimer);
+    if (qemu_driver->resctrlFeedbackTimer != -1)
+        virEventRemoveTimeout(qemu_driver->resctrlFeedbackTimer);
+    if (qemu_driver->blockJobAutotuneTimer != -1)
+        virEventRemoveTimeout(qemu_driver->blockJobAutotuneTimer);
+    if (qemu_driver->iothreadPollTimer != -1)
+        virEventRemoveTimeout(qemu_driver->iothreadPollTimer);
+    if (qemu_driver->memoryManagerTimer != -1)
+        virEventRemoveTimeout(qemu_driver->memoryManagerTimer);
+    if (qemu_driver->eventThreadTimer != -1)
+        virEventRemoveTimeout(qemu_driver->eventThreadTimer);
+    /* the rebalancing, feedback, autotuning and memory manager passes walk
+     * the domain list */
+    virThreadPoolFree(qemu_driver->numaRebalancePool);
+    virThreadPoolFree(qemu_driver->resctrlFeedbackPool);
+    virThreadPoolFree(qemu_driver->blockJobAutotunePool);
+    virThreadPoolFree(qemu_driver->iothreadPollPool);
+    virThreadPoolFree(qemu_driver->memoryManagerPool);
+    virThreadPoolFree(qemu_driver->capsRefreshPool);
+
     virObjectUnref(qemu_driver->migrationErrors);
     virObjectUnref(qemu_driver->closeCallbacks);
     virLockManagerPluginUnref(qemu_driver->lockManager);
@@ -1132,16 +1512,23 @@ qemuStateCleanup(void)
     virObjectUnref(qemu_driver->xmlopt);
     virCPUDefFree(qemu_driver->hostcpu);
     virCapabilitiesHostNUMAUnref(qemu_driver->hostnuma);
+    virBitmapFree(qemu_driver->topologyCpus);
     virObjectUnref(qemu_driver->caps);
+    VIR_FREE(qemu_driver->capsXML);
     ebtablesContextFree(qemu_driver->ebtables);
     VIR_FREE(qemu_driver->qemuImgBinary);
     virObjectUnref(qemu_driver->domains);
+    qemuEventThreadPoolFree(qemu_driver->eventThreadPool);
     virThreadPoolFree(qemu_driver->workerPool);
+    virThreadPoolFree(qemu_driver->statsPool);
+    virThreadPoolFree(qemu_driver->statsCachePool);
+    virThreadPoolFree(qemu_driver->reconnectPool);
 
     if (qemu_driver->lockFD != -1)
         virPidFileRelease(qemu_driver->config->stateDir, "driver", qemu_driver->lockFD);
 
     virObjectUnref(qemu_driver->config);
+    virMutexDestroy(&qemu_driver->sharedPRHelperLock);
     virMutexDestroy(&qemu_driver->lock);
     VIR_FREE(qemu_driver);
 
@@ -1244,7 +1631,10 @@ qemuConnectSupportsFeature(virConnectPtr conn, int feature)
     case VIR_DRV_FEATURE_PROGRAM_KEEPALIVE:
     case VIR_DRV_FEATURE_REMOTE:
     case VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK:
+    case VIR_DRV_FEATURE_REMOTE_COMPACT_STATS:
     case VIR_DRV_FEATURE_REMOTE_EVENT_CALLBACK:
+    case VIR_DRV_FEATURE_REMOTE_SECRET_GET_VALUES:
+    case VIR_DRV_FEATURE_REMOTE_TRACE_CONTEXT:
     default:
         return 0;
     }
@@ -1321,15 +1711,11 @@ qemuConnectGetMaxVcpus(virConnectPtr conn G_GNUC_UNUSED, const char *type)
 
 static char *qemuConnectGetCapabilities(virConnectPtr conn) {
     virQEMUDriverPtr driver = conn->privateData;
-    g_autoptr(virCaps) caps = NULL;
 
     if (virConnectGetCapabilitiesEnsureACL(conn) < 0)
         return NULL;
 
-    if (!(caps = virQEMUDriverGetCapabilities(driver, true)))
-        return NULL;
-
-    return virCapabilitiesFormatXML(caps);
+    return virQEMUDriverGetCapabilitiesXML(driver);
 }
 
 
@@ -1466,6 +1852,46 @@ qemuGetProcessInfo(unsigned long long *cpuTime, int *lastCpu, long *vm_rss,
 }
 
 
+/**
+ * qemuDomainHelperGetVcpuSchedStats:
+ * @vm: domain object
+ * @cputime: filled with the CPU time of each online vCPU
+ * @cpuwait: filled with the wait time of each online vCPU
+ * @maxinfo: size of @cputime and @cpuwait
+ *
+ * Reads the times of all online vCPU threads in one pass. Returns 0 on
+ * success, -1 on error in which case the caller should fall back to
+ * reading the per-thread stat files.
+ */
+static int
+qemuDomainHelperGetVcpuSchedStats(virDomainObjPtr vm,
+                                  unsigned long long *cputime,
+                                  unsigned long long *cpuwait,
+                                  int maxinfo)
+{
+    g_autofree pid_t *tids = NULL;
+    size_t ntids = 0;
+    size_t i;
+
+    tids = g_new0(pid_t, maxinfo);
+
+    for (i = 0; i < virDomainDefGetVcpusMax(vm->def) && ntids < maxinfo; i++) {
+        virDomainVcpuDefPtr vcpu = virDomainDefGetVcpu(vm->def, i);
+
+        if (!vcpu->online)
+            continue;
+
+        tids[ntids++] = qemuDomainGetVcpuPid(vm, i);
+    }
+
+    return virProcessGetSchedStats(vm->pid, tids, ntids, cputime, cpuwait);
+}
+
+
+/*
+ * Note that when @cpuwait is requested the vCPU times are gathered in
+ * bulk and @info->cpu is left unset.
+ */
 static int
 qemuDomainHelperGetVcpus(virDomainObjPtr vm,
                          virVcpuInfoPtr info,
@@ -1474,6 +1900,8 @@ qemuDomainHelperGetVcpus(virDomainObjPtr vm,
                          unsigned char *cpumaps,
                          int maplen)
 {
+    g_autofree unsigned long long *cputime = NULL;
+    bool bulk = false;
     size_t ncpuinfo = 0;
     size_t i;
 
@@ -1486,6 +1914,19 @@ qemuDomainHelperGetVcpus(virDomainObjPtr vm,
         return -1;
     }
 
+    if (info && cpuwait) {
+        cputime = g_new0(unsigned long long, maxinfo);
+
+        if (qemuDomainHelperGetVcpuSchedStats(vm, cputime, cpuwait,
+                                              maxinfo) == 0) {
+            bulk = true;
+        } else {
+            VIR_DEBUG("falling back to per-thread vCPU stats: %s",
+                      virGetLastErrorMessage());
+            virResetLastError();
+        }
+    }
+
     if (info)
         memset(info, 0, sizeof(*info) * maxinfo);
 
@@ -1504,7 +1945,9 @@ qemuDomainHelperGetVcpus(virDomainObjPtr vm,
             vcpuinfo->number = i;
             vcpuinfo->state = VIR_VCPU_RUNNING;
 
-            if (qemuGetProcessInfo(&vcpuinfo->cpuTime,
+            if (bulk) {
+                vcpuinfo->cpuTime = cputime[ncpuinfo];
+            } else if (qemuGetProcessInfo(&vcpuinfo->cpuTime,
                                    &vcpuinfo->cpu, NULL,
                                    vm->pid, vcpupid) < 0) {
                 virReportSystemError(errno, "%s",
@@ -1524,7 +1967,7 @@ qemuDomainHelperGetVcpus(virDomainObjPtr vm,
             virBitmapFree(map);
         }
 
-        if (cpuwait) {
+        if (cpuwait && !bulk) {
             if (qemuGetSchedInfo(&(cpuwait[ncpuinfo]), vm->pid, vcpupid) < 0)
                 return -1;
         }
@@ -1809,27 +2252,18 @@ static virDomainPtr qemuDomainCreateXML(virConnectPtr conn,
 }
 
 
-static int qemuDomainSuspend(virDomainPtr dom)
+static int
+qemuDomainSuspendInternal(virQEMUDriverPtr driver,
+                          virDomainObjPtr vm)
 {
-    virQEMUDriverPtr driver = dom->conn->privateData;
-    virDomainObjPtr vm;
     int ret = -1;
-    qemuDomainObjPrivatePtr priv;
+    qemuDomainObjPrivatePtr priv = vm->privateData;
     virDomainPausedReason reason;
     int state;
-    g_autoptr(virQEMUDriverConfig) cfg = NULL;
-
-    if (!(vm = qemuDomainObjFromDomain(dom)))
-        return -1;
-
-    if (virDomainSuspendEnsureACL(dom->conn, vm->def) < 0)
-        goto cleanup;
-
-    cfg = virQEMUDriverGetConfig(driver);
-    priv = vm->privateData;
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
 
     if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_SUSPEND) < 0)
-        goto cleanup;
+        return -1;
 
     if (virDomainObjCheckActive(vm) < 0)
         goto endjob;
@@ -1856,6 +2290,23 @@ static int qemuDomainSuspend(virDomainPtr dom)
 
  endjob:
     qemuDomainObjEndJob(driver, vm);
+    return ret;
+}
+
+
+static int qemuDomainSuspend(virDomainPtr dom)
+{
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainObjPtr vm;
+    int ret = -1;
+
+    if (!(vm = qemuDomainObjFromDomain(dom)))
+        return -1;
+
+    if (virDomainSuspendEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
+
+    ret = qemuDomainSuspendInternal(driver, vm);
 
  cleanup:
     virDomainObjEndAPI(&vm);
@@ -1987,29 +2438,23 @@ qemuDomainShutdownFlagsMonitor(virQEMUDriverPtr driver,
 }
 
 
-static int qemuDomainShutdownFlags(virDomainPtr dom, unsigned int flags)
+static int
+qemuDomainShutdownFlagsInternal(virQEMUDriverPtr driver,
+                                virDomainObjPtr vm,
+                                unsigned int flags)
 {
-    virQEMUDriverPtr driver = dom->conn->privateData;
-    virDomainObjPtr vm;
+    qemuDomainObjPrivatePtr priv = vm->privateData;
     int ret = -1;
-    qemuDomainObjPrivatePtr priv;
     bool useAgent = false, agentRequested, acpiRequested;
     bool isReboot = false;
     bool agentForced;
 
-    virCheckFlags(VIR_DOMAIN_SHUTDOWN_ACPI_POWER_BTN |
-                  VIR_DOMAIN_SHUTDOWN_GUEST_AGENT, -1);
-
-    if (!(vm = qemuDomainObjFromDomain(dom)))
-        goto cleanup;
-
     if (vm->def->onPoweroff == VIR_DOMAIN_LIFECYCLE_ACTION_RESTART ||
         vm->def->onPoweroff == VIR_DOMAIN_LIFECYCLE_ACTION_RESTART_RENAME) {
         isReboot = true;
         VIR_INFO("Domain on_poweroff setting overridden, attempting reboot");
     }
 
-    priv = vm->privateData;
     agentRequested = flags & VIR_DOMAIN_SHUTDOWN_GUEST_AGENT;
     acpiRequested  = flags & VIR_DOMAIN_SHUTDOWN_ACPI_POWER_BTN;
 
@@ -2017,14 +2462,11 @@ static int qemuDomainShutdownFlags(virDomainPtr dom, unsigned int flags)
     if (agentRequested || (!flags && priv->agent))
         useAgent = true;
 
-    if (virDomainShutdownFlagsEnsureACL(dom->conn, vm->def, flags) < 0)
-        goto cleanup;
-
     agentForced = agentRequested && !acpiRequested;
     if (useAgent) {
         ret = qemuDomainShutdownFlagsAgent(driver, vm, isReboot, agentForced);
         if (ret < 0 && agentForced)
-            goto cleanup;
+            return ret;
     }
 
     /* If we are not enforced to use just an agent, try ACPI
@@ -2033,23 +2475,42 @@ static int qemuDomainShutdownFlags(virDomainPtr dom, unsigned int flags)
     if (!useAgent || (ret < 0 && (acpiRequested || !flags))) {
         /* Even if agent failed, we have to check if guest went away
          * by itself while our locks were down.  */
-        if (useAgent && !virDomainObjIsActive(vm)) {
-            ret = 0;
-            goto cleanup;
-        }
+        if (useAgent && !virDomainObjIsActive(vm))
+            return 0;
 
         ret = qemuDomainShutdownFlagsMonitor(driver, vm, isReboot);
     }
 
- cleanup:
-    virDomainObjEndAPI(&vm);
     return ret;
 }
 
-static int qemuDomainShutdown(virDomainPtr dom)
+
+static int qemuDomainShutdownFlags(virDomainPtr dom, unsigned int flags)
 {
-    return qemuDomainShutdownFlags(dom, 0);
-}
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainObjPtr vm;
+    int ret = -1;
+
+    virCheckFlags(VIR_DOMAIN_SHUTDOWN_ACPI_POWER_BTN |
+                  VIR_DOMAIN_SHUTDOWN_GUEST_AGENT, -1);
+
+    if (!(vm = qemuDomainObjFromDomain(dom)))
+        goto cleanup;
+
+    if (virDomainShutdownFlagsEnsureACL(dom->conn, vm->def, flags) < 0)
+        goto cleanup;
+
+    ret = qemuDomainShutdownFlagsInternal(driver, vm, flags);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+static int qemuDomainShutdown(virDomainPtr dom)
+{
+    return qemuDomainShutdownFlags(dom, 0);
+}
 
 
 static int
@@ -2517,6 +2978,7 @@ static int qemuDomainSetMemoryStatsPeriod(virDomainPtr dom, int period,
         }
 
         def->memballoon->period = period;
+        qemuDomainBalloonStatsCacheClear(priv);
         if (virDomainObjSave(vm, driver->xmlopt, cfg->stateDir) < 0)
             goto endjob;
     }
@@ -2698,11 +3160,27 @@ qemuDomainGetState(virDomainPtr dom,
                    int *reason,
                    unsigned int flags)
 {
-    virDomainObjPtr vm;
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    g_autoptr(virDomainObjSummary) summary = NULL;
+    virDomainObjPtr vm = NULL;
     int ret = -1;
 
     virCheckFlags(0, -1);
 
+    /* Avoid waiting for the domain object lock which may be held by
+     * a long running operation. The locked path below is only used
+     * for domains without a summary and to report errors. */
+    if ((summary = virDomainObjListFindSummaryByUUID(driver->domains,
+                                                     dom->uuid))) {
+        if (virDomainGetStateEnsureACL(dom->conn, summary->def) < 0)
+            return -1;
+
+        *state = summary->state.state;
+        if (reason)
+            *reason = summary->state.reason;
+        return 0;
+    }
+
     if (!(vm = qemuDomainObjFromDomain(dom)))
         goto cleanup;
 
@@ -2781,7 +3259,12 @@ qemuDomainGetControlInfo(virDomainPtr dom,
  */
 #define QEMU_SAVE_MAGIC   "LibvirtQemudSave"
 #define QEMU_SAVE_PARTIAL "LibvirtQemudPart"
-#define QEMU_SAVE_VERSION 2
+#define QEMU_SAVE_VERSION 3
+
+/* Only images using the chunked zstd format are marked with version 3 so
+ * that older releases refuse them upfront. Others keep using version 2 and
+ * can still be restored by older releases. */
+#define QEMU_SAVE_VERSION_COMPAT 2
 
 G_STATIC_ASSERT(sizeof(QEMU_SAVE_MAGIC) == sizeof(QEMU_SAVE_PARTIAL));
 
@@ -2795,6 +3278,7 @@ typedef enum {
      */
     QEMU_SAVE_FORMAT_XZ = 3,
     QEMU_SAVE_FORMAT_LZOP = 4,
+    QEMU_SAVE_FORMAT_ZSTD = 5,
     /* Note: add new members only at the end.
        These values are used in the on-disk format.
        Do not change or re-use numbers. */
@@ -2810,6 +3294,7 @@ VIR_ENUM_IMPL(qemuSaveCompression,
               "bzip2",
               "xz",
               "lzop",
+              "zstd",
 );
 
 VIR_ENUM_DECL(qemuDumpFormat);
@@ -2891,7 +3376,10 @@ virQEMUSaveDataNew(char *domXML,
 
     header = &data->header;
     memcpy(header->magic, QEMU_SAVE_PARTIAL, sizeof(header->magic));
-    header->version = QEMU_SAVE_VERSION;
+    if (compressed == QEMU_SAVE_FORMAT_ZSTD)
+        header->version = QEMU_SAVE_VERSION;
+    else
+        header->version = QEMU_SAVE_VERSION_COMPAT;
     header->was_running = running ? 1 : 0;
     header->compressed = compressed;
 
@@ -3004,12 +3492,46 @@ virQEMUSaveDataFinish(virQEMUSaveDataPtr data,
 }
 
 
+/**
+ * qemuCompressGetZstdCommand:
+ * @compress: whether to compress or decompress
+ *
+ * The chunked zstd format is produced by the I/O helper, which compresses
+ * and decompresses chunks of the image on several threads.
+ *
+ * Returns the command filtering stdin to stdout or NULL on error.
+ */
+static virCommandPtr
+qemuCompressGetZstdCommand(bool compress)
+{
+#if WITH_ZSTD
+    g_autofree char *iohelper_path = NULL;
+
+    if (!(iohelper_path = virFileFindResource("libvirt_iohelper",
+                                              abs_top_builddir "/src",
+                                              LIBEXECDIR)))
+        return NULL;
+
+    return virCommandNewArgList(iohelper_path,
+                                compress ? "--zstd-compress" : "--zstd-decompress",
+                                NULL);
+#else
+    virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                   _("zstd compressed save images are not supported by this build"));
+    return NULL;
+#endif
+}
+
+
 static virCommandPtr
 qemuCompressGetCommand(virQEMUSaveFormat compression)
 {
     virCommandPtr ret = NULL;
     const char *prog = qemuSaveCompressionTypeToString(compression);
 
+    if (compression == QEMU_SAVE_FORMAT_ZSTD)
+        return qemuCompressGetZstdCommand(false);
+
     if (!prog) {
         virReportError(VIR_ERR_OPERATION_FAILED,
                        _("Invalid compressed save format %d"),
@@ -3464,6 +3986,16 @@ qemuGetCompressionProgram(const char *imageFormat,
     if (ret == QEMU_SAVE_FORMAT_RAW)
         return QEMU_SAVE_FORMAT_RAW;
 
+    if (ret == QEMU_SAVE_FORMAT_ZSTD) {
+#if WITH_ZSTD
+        if (!(*compressor = qemuCompressGetZstdCommand(true)))
+            goto error;
+        return ret;
+#else
+        goto error;
+#endif
+    }
+
     if (!(prog = virFindFileInPath(imageFormat)))
         goto error;
 
@@ -3563,43 +4095,33 @@ qemuDomainManagedSavePath(virQEMUDriverPtr driver, virDomainObjPtr vm)
 }
 
 static int
-qemuDomainManagedSave(virDomainPtr dom, unsigned int flags)
+qemuDomainManagedSaveInternal(virQEMUDriverPtr driver,
+                              virDomainObjPtr vm,
+                              unsigned int flags)
 {
-    virQEMUDriverPtr driver = dom->conn->privateData;
     g_autoptr(virQEMUDriverConfig) cfg = NULL;
     int compressed;
     g_autoptr(virCommand) compressor = NULL;
-    virDomainObjPtr vm;
     g_autofree char *name = NULL;
-    int ret = -1;
-
-    virCheckFlags(VIR_DOMAIN_SAVE_BYPASS_CACHE |
-                  VIR_DOMAIN_SAVE_RUNNING |
-                  VIR_DOMAIN_SAVE_PAUSED, -1);
-
-    if (!(vm = qemuDomainObjFromDomain(dom)))
-        return -1;
-
-    if (virDomainManagedSaveEnsureACL(dom->conn, vm->def) < 0)
-        goto cleanup;
+    int ret;
 
     if (virDomainObjCheckActive(vm) < 0)
-        goto cleanup;
+        return -1;
 
     if (!vm->persistent) {
         virReportError(VIR_ERR_OPERATION_INVALID, "%s",
                        _("cannot do managed save for transient domain"));
-        goto cleanup;
+        return -1;
     }
 
     cfg = virQEMUDriverGetConfig(driver);
     if ((compressed = qemuGetCompressionProgram(cfg->saveImageFormat,
                                                 &compressor,
                                                 "save", false)) < 0)
-        goto cleanup;
+        return -1;
 
     if (!(name = qemuDomainManagedSavePath(driver, vm)))
-        goto cleanup;
+        return -1;
 
     VIR_INFO("Saving state of domain '%s' to '%s'", vm->def->name, name);
 
@@ -3608,6 +4130,28 @@ qemuDomainManagedSave(virDomainPtr dom, unsigned int flags)
     if (ret == 0)
         vm->hasManagedSave = true;
 
+    return ret;
+}
+
+static int
+qemuDomainManagedSave(virDomainPtr dom, unsigned int flags)
+{
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainObjPtr vm;
+    int ret = -1;
+
+    virCheckFlags(VIR_DOMAIN_SAVE_BYPASS_CACHE |
+                  VIR_DOMAIN_SAVE_RUNNING |
+                  VIR_DOMAIN_SAVE_PAUSED, -1);
+
+    if (!(vm = qemuDomainObjFromDomain(dom)))
+        return -1;
+
+    if (virDomainManagedSaveEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
+
+    ret = qemuDomainManagedSaveInternal(driver, vm, flags);
+
  cleanup:
     virDomainObjEndAPI(&vm);
 
@@ -3732,25 +4276,25 @@ qemuDumpWaitForCompletion(virDomainObjPtr vm)
 }
 
 
+/**
+ * qemuDumpStart:
+ *
+ * Starts dumping guest memory into @fd. With @detach the dump runs in the
+ * background and qemuDumpWaitForCompletion has to be used to wait for it.
+ *
+ * Returns 0 on success, -1 on failure
+ */
 static int
-qemuDumpToFd(virQEMUDriverPtr driver,
-             virDomainObjPtr vm,
-             int fd,
-             qemuDomainAsyncJob asyncJob,
-             const char *dumpformat)
+qemuDumpStart(virQEMUDriverPtr driver,
+              virDomainObjPtr vm,
+              int fd,
+              qemuDomainAsyncJob asyncJob,
+              const char *dumpformat,
+              bool detach)
 {
     qemuDomainObjPrivatePtr priv = vm->privateData;
-    bool detach = false;
     int ret = -1;
 
-    if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_DUMP_GUEST_MEMORY)) {
-        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
-                       _("dump-guest-memory is not supported"));
-        return -1;
-    }
-
-    detach = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_DUMP_COMPLETED);
-
     if (qemuSecuritySetImageFDLabel(driver->securityManager, vm->def, fd) < 0)
         return -1;
 
@@ -3780,10 +4324,35 @@ qemuDumpToFd(virQEMUDriverPtr driver,
     if ((qemuDomainObjExitMonitor(driver, vm) < 0) || ret < 0)
         return -1;
 
+    return 0;
+}
+
+
+static int
+qemuDumpToFd(virQEMUDriverPtr driver,
+             virDomainObjPtr vm,
+             int fd,
+             qemuDomainAsyncJob asyncJob,
+             const char *dumpformat)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    bool detach = false;
+
+    if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_DUMP_GUEST_MEMORY)) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("dump-guest-memory is not supported"));
+        return -1;
+    }
+
+    detach = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_DUMP_COMPLETED);
+
+    if (qemuDumpStart(driver, vm, fd, asyncJob, dumpformat, detach) < 0)
+        return -1;
+
     if (detach)
-        ret = qemuDumpWaitForCompletion(vm);
+        return qemuDumpWaitForCompletion(vm);
 
-    return ret;
+    return 0;
 }
 
 
@@ -3997,6 +4566,181 @@ qemuDomainCoreDump(virDomainPtr dom,
 }
 
 
+typedef struct _qemuDumpStreamData qemuDumpStreamData;
+struct _qemuDumpStreamData {
+    virQEMUDriverPtr driver;
+    virDomainObjPtr vm;
+    bool resume;
+};
+
+
+/*
+ * Waits until the dump started by qemuDomainCoreDumpStream is complete,
+ * i.e. all data was read from the stream or the stream was aborted, and
+ * finishes its async job.
+ */
+static void
+qemuDomainCoreDumpStreamFinish(void *opaque)
+{
+    g_autofree qemuDumpStreamData *data = opaque;
+    virQEMUDriverPtr driver = data->driver;
+    virDomainObjPtr vm = data->vm;
+    virObjectEventPtr event = NULL;
+
+    virObjectLock(vm);
+    qemuDomainObjAcquireAsyncJob(vm);
+
+    if (qemuDumpWaitForCompletion(vm) < 0) {
+        VIR_WARN("streamed memory dump of domain %s failed: %s",
+                 vm->def->name, virGetLastErrorMessage());
+        virResetLastError();
+    }
+
+    if (data->resume && virDomainObjIsActive(vm) &&
+        qemuProcessStartCPUs(driver, vm, VIR_DOMAIN_RUNNING_UNPAUSED,
+                             QEMU_ASYNC_JOB_DUMP) < 0) {
+        event = virDomainEventLifecycleNewFromObj(vm,
+                                                  VIR_DOMAIN_EVENT_SUSPENDED,
+                                                  VIR_DOMAIN_EVENT_SUSPENDED_API_ERROR);
+        VIR_WARN("resuming domain %s after dump failed: %s",
+                 vm->def->name, virGetLastErrorMessage());
+        virResetLastError();
+    }
+
+    qemuDomainObjEndAsyncJob(driver, vm);
+    virDomainObjEndAPI(&vm);
+    virObjectEventStateQueue(driver->domainEventState, event);
+}
+
+
+static int
+qemuDomainCoreDumpStream(virDomainPtr dom,
+                         virStreamPtr st,
+                         unsigned int dumpformat,
+                         unsigned int flags)
+{
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainObjPtr vm;
+    qemuDomainObjPrivatePtr priv;
+    qemuDumpStreamData *data = NULL;
+    const char *memory_dump_format = NULL;
+    virThread thread;
+    int pipeFD[2] = { -1, -1 };
+    bool resume = false;
+    bool paused = false;
+    bool started = false;
+    int ret = -1;
+
+    virCheckFlags(VIR_DUMP_LIVE | VIR_DUMP_MEMORY_ONLY, -1);
+
+    if (!(vm = qemuDomainObjFromDomain(dom)))
+        return -1;
+
+    priv = vm->privateData;
+
+    if (virDomainCoreDumpStreamEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
+
+    if (!(memory_dump_format = qemuDumpFormatTypeToString(dumpformat))) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("unknown dumpformat '%d'"), dumpformat);
+        goto cleanup;
+    }
+
+    /* qemu dumps in "elf" without dumpformat set */
+    if (STREQ(memory_dump_format, "elf"))
+        memory_dump_format = NULL;
+
+    /* Aborting a memory-only dump is not possible, the stream has to be
+     * aborted instead */
+    if (qemuDomainObjBeginAsyncJob(driver, vm,
+                                   QEMU_ASYNC_JOB_DUMP,
+                                   VIR_DOMAIN_JOB_OPERATION_DUMP,
+                                   flags | VIR_DUMP_MEMORY_ONLY) < 0)
+        goto cleanup;
+
+    if (virDomainObjCheckActive(vm) < 0)
+        goto endjob;
+
+    /* the dump is running while the data is read from the stream, which
+     * requires qemu to report its completion asynchronously */
+    if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_DUMP_GUEST_MEMORY) ||
+        !virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_DUMP_COMPLETED)) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("streaming a memory dump is not supported by this QEMU binary"));
+        goto endjob;
+    }
+
+    resume = virDomainObjGetState(vm, NULL) == VIR_DOMAIN_RUNNING;
+
+    if (!(flags & VIR_DUMP_LIVE) && resume) {
+        if (qemuProcessStopCPUs(driver, vm, VIR_DOMAIN_PAUSED_DUMP,
+                                QEMU_ASYNC_JOB_DUMP) < 0)
+            goto endjob;
+        paused = true;
+
+        if (!virDomainObjIsActive(vm)) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("guest unexpectedly quit"));
+            goto endjob;
+        }
+    }
+
+    if (virPipe(pipeFD) < 0)
+        goto endjob;
+
+    if (qemuDumpStart(driver, vm, pipeFD[1], QEMU_ASYNC_JOB_DUMP,
+                      memory_dump_format, true) < 0)
+        goto endjob;
+    started = true;
+
+    /* qemu has its own copy of the write end now */
+    VIR_FORCE_CLOSE(pipeFD[1]);
+
+    if (virFDStreamOpen(st, pipeFD[0]) < 0)
+        goto endjob;
+    pipeFD[0] = -1; /* 'st' owns the FD now & will close it */
+
+    data = g_new0(qemuDumpStreamData, 1);
+    data->driver = driver;
+    data->vm = virObjectRef(vm);
+    data->resume = paused;
+
+    if (virThreadCreateFull(&thread, false, qemuDomainCoreDumpStreamFinish,
+                            "qemu-dump-stream", false, data) < 0) {
+        virObjectUnref(vm);
+        VIR_FREE(data);
+        /* close the reading end so that qemu fails the dump */
+        st->driver->streamAbort(st);
+        goto endjob;
+    }
+
+    qemuDomainObjReleaseAsyncJob(vm);
+    ret = 0;
+    goto cleanup;
+
+ endjob:
+    VIR_FORCE_CLOSE(pipeFD[0]);
+    VIR_FORCE_CLOSE(pipeFD[1]);
+
+    /* without the reading end of the pipe qemu fails the dump soon */
+    if (started &&
+        qemuDumpWaitForCompletion(vm) < 0)
+        virResetLastError();
+
+    if (paused && virDomainObjIsActive(vm) &&
+        qemuProcessStartCPUs(driver, vm, VIR_DOMAIN_RUNNING_UNPAUSED,
+                             QEMU_ASYNC_JOB_DUMP) < 0)
+        VIR_WARN("Unable to resume guest CPUs after dump failure");
+
+    qemuDomainObjEndAsyncJob(driver, vm);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+
 static char *
 qemuDomainScreenshot(virDomainPtr dom,
                      virStreamPtr st,
@@ -5999,12 +6743,36 @@ qemuDomainHotplugAddIOThread(virQEMUDriverPtr driver,
 }
 
 
+/*
+ * Returns the polling autotuning state of IOThread @iothread_id of @vm,
+ * adding it if it doesn't exist yet.
+ */
+static qemuDomainIOThreadPollPtr
+qemuDomainIOThreadPollGet(qemuDomainObjPrivatePtr priv,
+                          unsigned int iothread_id)
+{
+    qemuDomainIOThreadPoll state = { .iothread_id = iothread_id };
+    size_t i;
+
+    for (i = 0; i < priv->niothreadPoll; i++) {
+        if (priv->iothreadPoll[i].iothread_id == iothread_id)
+            return &priv->iothreadPoll[i];
+    }
+
+    if (VIR_APPEND_ELEMENT(priv->iothreadPoll, priv->niothreadPoll, state) < 0)
+        return NULL;
+
+    return &priv->iothreadPoll[priv->niothreadPoll - 1];
+}
+
+
 static int
 qemuDomainHotplugModIOThread(virQEMUDriverPtr driver,
                              virDomainObjPtr vm,
                              qemuMonitorIOThreadInfo iothread)
 {
     qemuDomainObjPrivatePtr priv = vm->privateData;
+    qemuDomainIOThreadPollPtr state;
     int rc;
 
     if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_IOTHREAD_POLLING)) {
@@ -6023,7 +6791,12 @@ qemuDomainHotplugModIOThread(virQEMUDriverPtr driver,
     if (rc < 0)
         return -1;
 
-    return 0;
+    /* explicitly set polling parameters win over the autotuning */
+    if (!(state = qemuDomainIOThreadPollGet(priv, iothread.iothread_id)))
+        return -1;
+    state->manual = true;
+
+    return 0;
 }
 
 
@@ -6853,7 +7626,7 @@ qemuDomainSaveImageStartVM(virConnectPtr conn,
                                  virDomainXMLOptionGetSaveCookie(driver->xmlopt)) < 0)
         goto cleanup;
 
-    if ((header->version == 2) &&
+    if ((header->version >= 2) &&
         (header->compressed != QEMU_SAVE_FORMAT_RAW)) {
         if (!(cmd = qemuCompressGetCommand(header->compressed)))
             goto cleanup;
@@ -7368,6 +8141,107 @@ static char
 }
 
 
+static int
+qemuConnectGetAllDomainXMLDesc(virConnectPtr conn,
+                               virDomainPtr *doms,
+                               unsigned int ndoms,
+                               unsigned int xmlflags,
+                               virDomainXMLDescRecordPtr **retDescs,
+                               unsigned int flags)
+{
+    virQEMUDriverPtr driver = conn->privateData;
+    virDomainObjPtr *vms = NULL;
+    size_t nvms = 0;
+    virDomainXMLDescRecordPtr *tmpdescs = NULL;
+    size_t ndescs = 0;
+    size_t i;
+    int ret = -1;
+
+    virCheckFlags(VIR_CONNECT_LIST_DOMAINS_FILTERS_ALL, -1);
+
+    if (xmlflags & ~(VIR_DOMAIN_XML_COMMON_FLAGS | VIR_DOMAIN_XML_UPDATE_CPU)) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("unsupported XML flags 0x%x"),
+                       xmlflags & ~(VIR_DOMAIN_XML_COMMON_FLAGS |
+                                    VIR_DOMAIN_XML_UPDATE_CPU));
+        return -1;
+    }
+
+    if (virConnectGetAllDomainXMLDescEnsureACL(conn) < 0)
+        return -1;
+
+    /* The ACL check depends on @xmlflags, so it's done for each domain
+     * below rather than by the list filter */
+    if (ndoms) {
+        if (flags) {
+            virReportError(VIR_ERR_INVALID_ARG, "%s",
+                           _("filtering is not supported with a domain list"));
+            return -1;
+        }
+
+        if (virDomainObjListConvert(driver->domains, conn, doms, ndoms, &vms,
+                                    &nvms, NULL, 0, true) < 0)
+            return -1;
+    } else {
+        if (virDomainObjListCollect(driver->domains, conn, &vms, &nvms,
+                                    NULL, flags) < 0)
+            return -1;
+    }
+
+    if (VIR_ALLOC_N(tmpdescs, nvms + 1) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nvms; i++) {
+        virDomainObjPtr vm = vms[i];
+        unsigned int vmflags = xmlflags;
+        virDomainXMLDescRecordPtr rec = NULL;
+
+        virObjectLock(vm);
+
+        /* skip domains undefined since they were collected and those
+         * the client isn't allowed to read with @xmlflags */
+        if (vm->removing ||
+            !virConnectGetAllDomainXMLDescCheckACL(conn, vm->def, xmlflags)) {
+            virObjectUnlock(vm);
+            continue;
+        }
+
+        qemuDomainUpdateCurrentMemorySize(vm);
+
+        if ((vmflags & VIR_DOMAIN_XML_MIGRATABLE))
+            vmflags |= QEMU_DOMAIN_FORMAT_LIVE_FLAGS;
+
+        /* See qemuDomainGetXMLDesc */
+        if (virDomainObjIsActive(vm) &&
+            !(vmflags & VIR_DOMAIN_XML_INACTIVE))
+            vmflags &= ~VIR_DOMAIN_XML_UPDATE_CPU;
+
+        if (VIR_ALLOC(rec) < 0 ||
+            !(rec->xml = qemuDomainFormatXML(driver, vm, vmflags)) ||
+            !(rec->dom = virGetDomain(conn, vm->def->name,
+                                      vm->def->uuid, vm->def->id))) {
+            virObjectUnlock(vm);
+            if (rec)
+                VIR_FREE(rec->xml);
+            VIR_FREE(rec);
+            goto cleanup;
+        }
+
+        virObjectUnlock(vm);
+
+        tmpdescs[ndescs++] = rec;
+    }
+
+    *retDescs = g_steal_pointer(&tmpdescs);
+    ret = ndescs;
+
+ cleanup:
+    virDomainXMLDescRecordListFree(tmpdescs);
+    virObjectListFreeCount(vms, nvms);
+    return ret;
+}
+
+
 static char *qemuConnectDomainXMLToNative(virConnectPtr conn,
                                           const char *format,
                                           const char *xmlData,
@@ -7975,9 +8849,6 @@ qemuDomainAttachDeviceLive(virDomainObjPtr vm,
         virObjectEventStateQueue(driver->domainEventState, event);
     }
 
-    if (ret == 0)
-        ret = qemuDomainUpdateDeviceList(driver, vm, QEMU_ASYNC_JOB_NONE);
-
     return ret;
 }
 
@@ -8663,18 +9534,29 @@ qemuDomainAttachDeviceLiveAndConfigHomogenize(const virDomainDeviceDef *devConf,
 }
 
 
+/*
+ * Attaches devices described by @xmls in the given order. The persistent
+ * definition is copied, parsed against and saved only once and so is the
+ * status XML of the running domain, which makes attaching many devices at
+ * once much cheaper than attaching them one by one. Should attaching a
+ * device to the running domain fail, the devices attached before it stay
+ * attached, but the persistent definition is left untouched.
+ */
 static int
 qemuDomainAttachDeviceLiveAndConfig(virDomainObjPtr vm,
                                     virQEMUDriverPtr driver,
-                                    const char *xml,
+                                    const char *const *xmls,
+                                    size_t nxmls,
                                     unsigned int flags)
 {
     qemuDomainObjPrivatePtr priv = vm->privateData;
     virDomainDefPtr vmdef = NULL;
     g_autoptr(virQEMUDriverConfig) cfg = NULL;
     virDomainDeviceDefPtr devConf = NULL;
-    virDomainDeviceDef devConfSave = { 0 };
+    g_autofree virDomainDeviceDef *devConfSave = NULL;
     virDomainDeviceDefPtr devLive = NULL;
+    size_t nattached = 0;
+    size_t i;
     int ret = -1;
     unsigned int parse_flags = VIR_DOMAIN_DEF_PARSE_INACTIVE |
                                VIR_DOMAIN_DEF_PARSE_ABI_UPDATE;
@@ -8693,53 +9575,72 @@ qemuDomainAttachDeviceLiveAndConfig(virDomainObjPtr vm,
         if (!vmdef)
             goto cleanup;
 
-        if (!(devConf = virDomainDeviceDefParse(xml, vmdef,
-                                                driver->xmlopt, priv->qemuCaps,
-                                                parse_flags)))
-            goto cleanup;
+        devConfSave = g_new0(virDomainDeviceDef, nxmls);
 
-        /*
-         * devConf will be NULLed out by
-         * qemuDomainAttachDeviceConfig(), so save it for later use by
-         * qemuDomainAttachDeviceLiveAndConfigHomogenize()
-         */
-        devConfSave = *devConf;
+        for (i = 0; i < nxmls; i++) {
+            if (!(devConf = virDomainDeviceDefParse(xmls[i], vmdef,
+                                                    driver->xmlopt,
+                                                    priv->qemuCaps,
+                                                    parse_flags)))
+                goto cleanup;
 
-        if (virDomainDeviceValidateAliasForHotplug(vm, devConf,
-                                                   VIR_DOMAIN_AFFECT_CONFIG) < 0)
-            goto cleanup;
+            /*
+             * devConf will be NULLed out by
+             * qemuDomainAttachDeviceConfig(), so save it for later use by
+             * qemuDomainAttachDeviceLiveAndConfigHomogenize()
+             */
+            devConfSave[i] = *devConf;
 
-        if (virDomainDefCompatibleDevice(vmdef, devConf, NULL,
-                                         VIR_DOMAIN_DEVICE_ACTION_ATTACH,
-                                         false) < 0)
-            goto cleanup;
+            if (virDomainDeviceValidateAliasForHotplug(vm, devConf,
+                                                       VIR_DOMAIN_AFFECT_CONFIG) < 0)
+                goto cleanup;
 
-        if (qemuDomainAttachDeviceConfig(vmdef, devConf, priv->qemuCaps,
-                                         parse_flags,
-                                         driver->xmlopt) < 0)
-            goto cleanup;
+            if (virDomainDefCompatibleDevice(vmdef, devConf, NULL,
+                                             VIR_DOMAIN_DEVICE_ACTION_ATTACH,
+                                             false) < 0)
+                goto cleanup;
+
+            if (qemuDomainAttachDeviceConfig(vmdef, devConf, priv->qemuCaps,
+                                             parse_flags,
+                                             driver->xmlopt) < 0)
+                goto cleanup;
+
+            g_clear_pointer(&devConf, virDomainDeviceDefFree);
+        }
     }
 
     if (flags & VIR_DOMAIN_AFFECT_LIVE) {
-        if (!(devLive = virDomainDeviceDefParse(xml, vm->def,
-                                                driver->xmlopt, priv->qemuCaps,
-                                                parse_flags)))
-            goto cleanup;
+        for (i = 0; i < nxmls; i++) {
+            if (!(devLive = virDomainDeviceDefParse(xmls[i], vm->def,
+                                                    driver->xmlopt,
+                                                    priv->qemuCaps,
+                                                    parse_flags)))
+                break;
 
-        if (flags & VIR_DOMAIN_AFFECT_CONFIG)
-            qemuDomainAttachDeviceLiveAndConfigHomogenize(&devConfSave, devLive);
+            if (flags & VIR_DOMAIN_AFFECT_CONFIG)
+                qemuDomainAttachDeviceLiveAndConfigHomogenize(&devConfSave[i],
+                                                              devLive);
 
-        if (virDomainDeviceValidateAliasForHotplug(vm, devLive,
-                                                   VIR_DOMAIN_AFFECT_LIVE) < 0)
-            goto cleanup;
+            if (virDomainDeviceValidateAliasForHotplug(vm, devLive,
+                                                       VIR_DOMAIN_AFFECT_LIVE) < 0)
+                break;
 
-        if (virDomainDefCompatibleDevice(vm->def, devLive, NULL,
-                                         VIR_DOMAIN_DEVICE_ACTION_ATTACH,
-                                         true) < 0)
-            goto cleanup;
+            if (virDomainDefCompatibleDevice(vm->def, devLive, NULL,
+                                             VIR_DOMAIN_DEVICE_ACTION_ATTACH,
+                                             true) < 0)
+                break;
+
+            if (qemuDomainAttachDeviceLive(vm, devLive, driver) < 0)
+                break;
+
+            g_clear_pointer(&devLive, virDomainDeviceDefFree);
+            nattached++;
+        }
 
-        if (qemuDomainAttachDeviceLive(vm, devLive, driver) < 0)
+        if (nattached > 0 &&
+            qemuDomainUpdateDeviceList(driver, vm, QEMU_ASYNC_JOB_NONE) < 0)
             goto cleanup;
+
         /*
          * update domain status forcibly because the domain status may be
          * changed even if we failed to attach the device. For example,
@@ -8747,6 +9648,9 @@ qemuDomainAttachDeviceLiveAndConfig(virDomainObjPtr vm,
          */
         if (virDomainObjSave(vm, driver->xmlopt, cfg->stateDir) < 0)
             goto cleanup;
+
+        if (nattached < nxmls)
+            goto cleanup;
     }
 
     /* Finally, if no error until here, we can save config. */
@@ -8790,7 +9694,48 @@ qemuDomainAttachDeviceFlags(virDomainPtr dom,
     if (virDomainObjUpdateModificationImpact(vm, &flags) < 0)
         goto endjob;
 
-    if (qemuDomainAttachDeviceLiveAndConfig(vm, driver, xml, flags) < 0)
+    if (qemuDomainAttachDeviceLiveAndConfig(vm, driver, &xml, 1, flags) < 0)
+        goto endjob;
+
+    ret = 0;
+
+ endjob:
+    qemuDomainObjEndJob(driver, vm);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    virNWFilterUnlockFilterUpdates();
+    return ret;
+}
+
+
+static int
+qemuDomainAttachDevices(virDomainPtr dom,
+                        const char **xmls,
+                        unsigned int nxmls,
+                        unsigned int flags)
+{
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainObjPtr vm = NULL;
+    int ret = -1;
+
+    virNWFilterReadLockFilterUpdates();
+
+    if (!(vm = qemuDomainObjFromDomain(dom)))
+        goto cleanup;
+
+    if (virDomainAttachDevicesEnsureACL(dom->conn, vm->def, flags) < 0)
+        goto cleanup;
+
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
+        goto cleanup;
+
+    if (virDomainObjUpdateModificationImpact(vm, &flags) < 0)
+        goto endjob;
+
+    if (qemuDomainAttachDeviceLiveAndConfig(vm, driver,
+                                            (const char *const *)xmls, nxmls,
+                                            flags) < 0)
         goto endjob;
 
     ret = 0;
@@ -8926,6 +9871,7 @@ static int
 qemuDomainDetachDeviceLiveAndConfig(virQEMUDriverPtr driver,
                                     virDomainObjPtr vm,
                                     const char *xml,
+                                    bool async,
                                     unsigned int flags)
 {
     qemuDomainObjPrivatePtr priv = vm->privateData;
@@ -8977,7 +9923,7 @@ qemuDomainDetachDeviceLiveAndConfig(virQEMUDriverPtr driver,
     if (flags & VIR_DOMAIN_AFFECT_LIVE) {
         int rc;
 
-        if ((rc = qemuDomainDetachDeviceLive(vm, dev_copy, driver, false)) < 0)
+        if ((rc = qemuDomainDetachDeviceLive(vm, dev_copy, driver, async)) < 0)
             goto cleanup;
 
         if (rc == 0 && qemuDomainUpdateDeviceList(driver, vm, QEMU_ASYNC_JOB_NONE) < 0)
@@ -9088,6 +10034,7 @@ qemuDomainDetachDeviceFlags(virDomainPtr dom,
 {
     virQEMUDriverPtr driver = dom->conn->privateData;
     virDomainObjPtr vm = NULL;
+    bool async = !!(flags & VIR_DOMAIN_DEVICE_MODIFY_ASYNC);
     int ret = -1;
 
     if (!(vm = qemuDomainObjFromDomain(dom)))
@@ -9096,13 +10043,18 @@ qemuDomainDetachDeviceFlags(virDomainPtr dom,
     if (virDomainDetachDeviceFlagsEnsureACL(dom->conn, vm->def, flags) < 0)
         goto cleanup;
 
+    /* With async the removal is finished by processDeviceDeletedEvent in a
+     * job of its own, other jobs may run until the guest releases the
+     * device. */
+    flags &= ~VIR_DOMAIN_DEVICE_MODIFY_ASYNC;
+
     if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
         goto cleanup;
 
     if (virDomainObjUpdateModificationImpact(vm, &flags) < 0)
         goto endjob;
 
-    if (qemuDomainDetachDeviceLiveAndConfig(driver, vm, xml, flags) < 0)
+    if (qemuDomainDetachDeviceLiveAndConfig(driver, vm, xml, async, flags) < 0)
         goto endjob;
 
     ret = 0;
@@ -9496,6 +10448,9 @@ qemuDomainSetMemoryParameters(virDomainPtr dom,
     g_autoptr(virQEMUDriverConfig) cfg = NULL;
     int ret = -1;
     qemuDomainObjPrivatePtr priv;
+    bool sharePages = false;
+    int setSharePages;
+    bool setLimits;
 
     virCheckFlags(VIR_DOMAIN_AFFECT_LIVE |
                   VIR_DOMAIN_AFFECT_CONFIG, -1);
@@ -9507,9 +10462,17 @@ qemuDomainSetMemoryParameters(virDomainPtr dom,
                                VIR_TYPED_PARAM_ULLONG,
                                VIR_DOMAIN_MEMORY_SWAP_HARD_LIMIT,
                                VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_MEMORY_SHARE_PAGES,
+                               VIR_TYPED_PARAM_BOOLEAN,
                                NULL) < 0)
         return -1;
 
+    if ((setSharePages = virTypedParamsGetBoolean(params, nparams,
+                                                  VIR_DOMAIN_MEMORY_SHARE_PAGES,
+                                                  &sharePages)) < 0)
+        return -1;
+
+    setLimits = nparams > setSharePages;
 
     if (!(vm = qemuDomainObjFromDomain(dom)))
         return -1;
@@ -9533,18 +10496,43 @@ qemuDomainSetMemoryParameters(virDomainPtr dom,
     if (virDomainObjGetDefs(vm, flags, &def, &persistentDef) < 0)
         goto endjob;
 
-    if (def &&
+    if (def && setLimits &&
         !virCgroupHasController(priv->cgroup, VIR_CGROUP_CONTROLLER_MEMORY)) {
         virReportError(VIR_ERR_OPERATION_INVALID, "%s",
                        _("cgroup memory controller is not mounted"));
         goto endjob;
     }
 
-    if (virDomainCgroupSetMemoryLimitParameters(priv->cgroup, vm, def,
+    if (setLimits &&
+        virDomainCgroupSetMemoryLimitParameters(priv->cgroup, vm, def,
                                                 persistentDef,
                                                 params, nparams) < 0)
         goto endjob;
 
+    if (setSharePages) {
+        if (def && def->mem.nosharepages == sharePages) {
+            int rc;
+
+            qemuDomainObjEnterMonitor(driver, vm);
+            rc = qemuMonitorSetMemoryBackendsMerge(priv->mon, sharePages);
+            if (qemuDomainObjExitMonitor(driver, vm) < 0 || rc < 0)
+                goto endjob;
+
+            if (rc == 0) {
+                virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                               _("sharing of memory pages can be changed only "
+                                 "for domains with guest NUMA nodes or memory "
+                                 "devices while they are running"));
+                goto endjob;
+            }
+
+            def->mem.nosharepages = !sharePages;
+        }
+
+        if (persistentDef)
+            persistentDef->mem.nosharepages = !sharePages;
+    }
+
     if (def &&
         virDomainObjSave(vm, driver->xmlopt, cfg->stateDir) < 0)
         goto endjob;
@@ -9583,6 +10571,7 @@ qemuDomainGetMemoryParameters(virDomainPtr dom,
     int ret = -1;
     qemuDomainObjPrivatePtr priv;
     unsigned long long swap_hard_limit, mem_hard_limit, mem_soft_limit;
+    bool share_pages;
 
     virCheckFlags(VIR_DOMAIN_AFFECT_LIVE |
                   VIR_DOMAIN_AFFECT_CONFIG |
@@ -9616,7 +10605,10 @@ qemuDomainGetMemoryParameters(virDomainPtr dom,
         mem_hard_limit = persistentDef->mem.hard_limit;
         mem_soft_limit = persistentDef->mem.soft_limit;
         swap_hard_limit = persistentDef->mem.swap_hard_limit;
+        share_pages = !persistentDef->mem.nosharepages;
     } else {
+        share_pages = !vm->def->mem.nosharepages;
+
         if (!virCgroupHasController(priv->cgroup, VIR_CGROUP_CONTROLLER_MEMORY)) {
             virReportError(VIR_ERR_OPERATION_INVALID,
                            "%s", _("cgroup memory controller is not mounted"));
@@ -9641,6 +10633,11 @@ qemuDomainGetMemoryParameters(virDomainPtr dom,
     QEMU_ASSIGN_MEM_PARAM(1, VIR_DOMAIN_MEMORY_SOFT_LIMIT, mem_soft_limit);
     QEMU_ASSIGN_MEM_PARAM(2, VIR_DOMAIN_MEMORY_SWAP_HARD_LIMIT, swap_hard_limit);
 
+    if (3 < *nparams &&
+        virTypedParameterAssign(&params[3], VIR_DOMAIN_MEMORY_SHARE_PAGES,
+                                VIR_TYPED_PARAM_BOOLEAN, share_pages) < 0)
+        goto cleanup;
+
     if (QEMU_NB_MEM_PARAM < *nparams)
         *nparams = QEMU_NB_MEM_PARAM;
     ret = 0;
@@ -10830,6 +11827,8 @@ qemuDomainBlockResize(virDomainPtr dom,
             goto endjob;
     }
 
+    qemuDomainBlockCapacityCacheClear(priv);
+
     qemuDomainObjEnterMonitor(driver, vm);
     if (qemuMonitorBlockResize(priv->mon, device, nodename, size) < 0) {
         ignore_value(qemuDomainObjExitMonitor(driver, vm));
@@ -11491,7 +12490,81 @@ qemuDomainGetInterfaceParameters(virDomainPtr dom,
     return ret;
 }
 
-/* This functions assumes that job QEMU_JOB_QUERY is started by a caller */
+/*
+ * The guest pushes its balloon statistics to QEMU once per collection
+ * period and QEMU records when that happened. Until the next push is due,
+ * asking QEMU for them again would just return the same data, so they are
+ * served from memory instead. Only the current balloon size may change in
+ * the meantime, but that one is kept up to date by BALLOON_CHANGE events.
+ *
+ * Returns the number of statistics copied into @stats or -1 if there are
+ * no usable cached statistics.
+ */
+static int
+qemuDomainBalloonStatsFromCache(virDomainObjPtr vm,
+                                virDomainMemoryStatPtr stats,
+                                unsigned int nr_stats)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    unsigned long long now;
+    int n;
+    int i;
+
+    if (priv->balloonStatsExpire == 0 ||
+        virTimeMillisNow(&now) < 0 ||
+        now >= priv->balloonStatsExpire)
+        return -1;
+
+    n = MIN(priv->nballoonStats, nr_stats);
+    for (i = 0; i < n; i++) {
+        stats[i] = priv->balloonStats[i];
+
+        if (stats[i].tag == VIR_DOMAIN_MEMORY_STAT_ACTUAL_BALLOON)
+            stats[i].val = vm->def->mem.cur_balloon;
+    }
+
+    return n;
+}
+
+
+static void
+qemuDomainBalloonStatsToCache(virDomainObjPtr vm,
+                              virDomainMemoryStatPtr stats,
+                              int nstats)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    unsigned long long lastUpdate = 0;
+    unsigned long long now;
+    int i;
+
+    qemuDomainBalloonStatsCacheClear(priv);
+
+    /* the statistics don't get refreshed without a collection period */
+    if (vm->def->memballoon->period <= 0 ||
+        nstats > VIR_DOMAIN_MEMORY_STAT_NR)
+        return;
+
+    for (i = 0; i < nstats; i++) {
+        if (stats[i].tag == VIR_DOMAIN_MEMORY_STAT_LAST_UPDATE)
+            lastUpdate = stats[i].val;
+    }
+
+    if (lastUpdate == 0 || virTimeMillisNow(&now) < 0)
+        return;
+
+    priv->balloonStatsExpire = (lastUpdate + vm->def->memballoon->period) * 1000;
+    if (priv->balloonStatsExpire <= now) {
+        priv->balloonStatsExpire = 0;
+        return;
+    }
+
+    memcpy(priv->balloonStats, stats, sizeof(*stats) * nstats);
+    priv->nballoonStats = nstats;
+}
+
+
+/* This functions assumes that job QEMU_JOB_QUERY or a query job started
+ * by qemuDomainObjBeginQueryJob is held by a caller */
 static int
 qemuDomainMemoryStatsInternal(virQEMUDriverPtr driver,
                               virDomainObjPtr vm,
@@ -11506,11 +12579,17 @@ qemuDomainMemoryStatsInternal(virQEMUDriverPtr driver,
         return -1;
 
     if (virDomainDefHasMemballoon(vm->def)) {
-        qemuDomainObjEnterMonitor(driver, vm);
-        ret = qemuMonitorGetMemoryStats(qemuDomainGetMonitor(vm),
-                                        vm->def->memballoon, stats, nr_stats);
-        if (qemuDomainObjExitMonitor(driver, vm) < 0)
-            ret = -1;
+        if ((ret = qemuDomainBalloonStatsFromCache(vm, stats, nr_stats)) < 0) {
+            qemuDomainObjEnterMonitor(driver, vm);
+            ret = qemuMonitorGetMemoryStats(qemuDomainGetMonitor(vm),
+                                            vm->def->memballoon, stats, nr_stats);
+            if (qemuDomainObjExitMonitor(driver, vm) < 0)
+                ret = -1;
+
+            /* a partial set of statistics is not worth caching */
+            if (ret >= 0 && nr_stats >= VIR_DOMAIN_MEMORY_STAT_NR)
+                qemuDomainBalloonStatsToCache(vm, stats, ret);
+        }
 
         if (ret < 0 || ret >= nr_stats)
             return ret;
@@ -11548,12 +12627,12 @@ qemuDomainMemoryStats(virDomainPtr dom,
     if (virDomainMemoryStatsEnsureACL(dom->conn, vm->def) < 0)
         goto cleanup;
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) < 0)
+    if (qemuDomainObjBeginQueryJob(vm) < 0)
         goto cleanup;
 
     ret = qemuDomainMemoryStatsInternal(driver, vm, stats, nr_stats);
 
-    qemuDomainObjEndJob(driver, vm);
+    qemuDomainObjEndQueryJob(vm);
 
  cleanup:
     virDomainObjEndAPI(&vm);
@@ -13491,6 +14570,7 @@ qemuDomainGetJobInfoMigrationStats(virQEMUDriverPtr driver,
                                    qemuDomainJobInfoPtr jobInfo)
 {
     qemuDomainObjPrivatePtr priv = vm->privateData;
+    qemuDomainJobPrivatePtr jobPriv = priv->job.privateData;
     bool events = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_MIGRATION_EVENT);
 
     if (jobInfo->status == QEMU_DOMAIN_JOB_STATUS_ACTIVE ||
@@ -13509,6 +14589,9 @@ qemuDomainGetJobInfoMigrationStats(virQEMUDriverPtr driver,
                                              jobInfo) < 0)
             return -1;
 
+        if (jobPriv->tunnelStats)
+            qemuDomainJobInfoUpdateTunnel(jobInfo, jobPriv->tunnelStats);
+
         if (qemuDomainJobInfoUpdateTime(jobInfo) < 0)
             return -1;
     }
@@ -13604,6 +14687,7 @@ qemuDomainGetJobStatsInternal(virQEMUDriverPtr driver,
         goto cleanup;
     }
     *jobInfo = qemuDomainJobInfoCopy(priv->job.current);
+    qemuDomainJobInfoUpdateLockStats(*jobInfo, vm);
 
     switch ((*jobInfo)->statsType) {
     case QEMU_DOMAIN_JOB_STATS_TYPE_MIGRATION:
@@ -13623,6 +14707,8 @@ qemuDomainGetJobStatsInternal(virQEMUDriverPtr driver,
         break;
 
     case QEMU_DOMAIN_JOB_STATS_TYPE_NONE:
+        if (qemuDomainJobInfoUpdateTime(*jobInfo) < 0)
+            goto cleanup;
         break;
     }
 
@@ -13902,7 +14988,7 @@ qemuDomainMigrateGetMaxDowntime(virDomainPtr dom,
     if (virDomainMigrateGetMaxDowntimeEnsureACL(dom->conn, vm->def) < 0)
         goto cleanup;
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) < 0)
+    if (qemuDomainObjBeginQueryJob(vm) < 0)
         goto cleanup;
 
     if (virDomainObjCheckActive(vm) < 0)
@@ -13928,7 +15014,7 @@ qemuDomainMigrateGetMaxDowntime(virDomainPtr dom,
     ret = 0;
 
  endjob:
-    qemuDomainObjEndJob(driver, vm);
+    qemuDomainObjEndQueryJob(vm);
 
  cleanup:
     qemuMigrationParamsFree(migParams);
@@ -15622,6 +16708,31 @@ qemuDomainSnapshotCreateActiveExternal(virQEMUDriverPtr driver,
 }
 
 
+/* reject snapshot names containing slashes or starting with dot as
+ * snapshot definitions are saved in files named by the snapshot name */
+static int
+qemuDomainSnapshotCheckName(const char *name)
+{
+    if (strchr(name, '/')) {
+        virReportError(VIR_ERR_XML_DETAIL,
+                       _("invalid snapshot name '%s': "
+                         "name can't contain '/'"),
+                       name);
+        return -1;
+    }
+
+    if (name[0] == '.') {
+        virReportError(VIR_ERR_XML_DETAIL,
+                       _("invalid snapshot name '%s': "
+                         "name can't start with '.'"),
+                       name);
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static virDomainSnapshotPtr
 qemuDomainSnapshotCreateXML(virDomainPtr domain,
                             const char *xmlDesc,
@@ -15695,25 +16806,9 @@ qemuDomainSnapshotCreateXML(virDomainPtr domain,
                                                 priv->qemuCaps, NULL, parse_flags)))
         goto cleanup;
 
-    /* reject snapshot names containing slashes or starting with dot as
-     * snapshot definitions are saved in files named by the snapshot name */
-    if (!(flags & VIR_DOMAIN_SNAPSHOT_CREATE_NO_METADATA)) {
-        if (strchr(def->parent.name, '/')) {
-            virReportError(VIR_ERR_XML_DETAIL,
-                           _("invalid snapshot name '%s': "
-                             "name can't contain '/'"),
-                           def->parent.name);
-            goto cleanup;
-        }
-
-        if (def->parent.name[0] == '.') {
-            virReportError(VIR_ERR_XML_DETAIL,
-                           _("invalid snapshot name '%s': "
-                             "name can't start with '.'"),
-                           def->parent.name);
-            goto cleanup;
-        }
-    }
+    if (!(flags & VIR_DOMAIN_SNAPSHOT_CREATE_NO_METADATA) &&
+        qemuDomainSnapshotCheckName(def->parent.name) < 0)
+        goto cleanup;
 
     /* reject the VIR_DOMAIN_SNAPSHOT_CREATE_LIVE flag where not supported */
     if (flags & VIR_DOMAIN_SNAPSHOT_CREATE_LIVE &&
@@ -15909,1399 +17004,4322 @@ qemuDomainSnapshotCreateXML(virDomainPtr domain,
 }
 
 
-static int
-qemuDomainSnapshotListNames(virDomainPtr domain,
-                            char **names,
-                            int nameslen,
-                            unsigned int flags)
-{
-    virDomainObjPtr vm = NULL;
-    int n = -1;
+/* Upper bound on the number of threads working on domains at once in
+ * qemuDomainListSnapshotCreateXML */
+#define QEMU_DOMAIN_LIST_SNAPSHOT_THREADS 32
 
-    virCheckFlags(VIR_DOMAIN_SNAPSHOT_LIST_ROOTS |
-                  VIR_DOMAIN_SNAPSHOT_LIST_TOPOLOGICAL |
-                  VIR_DOMAIN_SNAPSHOT_FILTERS_ALL, -1);
+typedef struct _qemuDomainListSnapshotEntry qemuDomainListSnapshotEntry;
+typedef qemuDomainListSnapshotEntry *qemuDomainListSnapshotEntryPtr;
+struct _qemuDomainListSnapshotEntry {
+    virDomainObjPtr vm;
+    const char *xmlDesc;
+
+    virDomainMomentObjPtr snap;
+    char *name; /* name of the snapshot once it was taken */
+    virJSONValuePtr actions;
+    qemuDomainSnapshotDiskDataPtr diskdata;
+    size_t ndiskdata;
+    bool blockdev;
+
+    bool job; /* the snapshot async job was started */
+    bool resume; /* the CPUs were paused for the snapshot */
+    bool taken; /* the transaction succeeded */
+    virErrorPtr err; /* the first error which occurred */
+};
 
-    if (!(vm = qemuDomainObjFromDomain(domain)))
-        return -1;
+typedef struct _qemuDomainListSnapshotData qemuDomainListSnapshotData;
+typedef qemuDomainListSnapshotData *qemuDomainListSnapshotDataPtr;
 
-    if (virDomainSnapshotListNamesEnsureACL(domain->conn, vm->def) < 0)
-        goto cleanup;
+typedef int
+(*qemuDomainListSnapshotStep)(qemuDomainListSnapshotDataPtr data,
+                              qemuDomainListSnapshotEntryPtr entry);
 
-    n = virDomainSnapshotObjListGetNames(vm->snapshots, NULL, names, nameslen,
-                                         flags);
+struct _qemuDomainListSnapshotData {
+    virQEMUDriverPtr driver;
+    virQEMUDriverConfigPtr cfg;
+    unsigned int flags;
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return n;
-}
+    qemuDomainListSnapshotEntryPtr entries;
+    size_t nentries;
+
+    qemuDomainListSnapshotStep step;
+
+    /* protects @next, the index of the next domain to process, and
+     * @failed which is set once @step failed for any domain */
+    virMutex lock;
+    size_t next;
+    bool failed;
+};
 
 
 static int
-qemuDomainSnapshotNum(virDomainPtr domain,
-                      unsigned int flags)
+qemuDomainListSnapshotPrepareOne(qemuDomainListSnapshotDataPtr data,
+                                 qemuDomainListSnapshotEntryPtr entry)
 {
-    virDomainObjPtr vm = NULL;
-    int n = -1;
-
-    virCheckFlags(VIR_DOMAIN_SNAPSHOT_LIST_ROOTS |
-                  VIR_DOMAIN_SNAPSHOT_LIST_TOPOLOGICAL |
-                  VIR_DOMAIN_SNAPSHOT_FILTERS_ALL, -1);
+    virQEMUDriverPtr driver = data->driver;
+    virDomainObjPtr vm = entry->vm;
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    unsigned int parse_flags = VIR_DOMAIN_SNAPSHOT_PARSE_DISKS |
+                               VIR_DOMAIN_SNAPSHOT_PARSE_OFFLINE;
+    unsigned int flags = data->flags;
+    bool reuse = (flags & VIR_DOMAIN_SNAPSHOT_CREATE_REUSE_EXT) != 0;
+    g_autoptr(virDomainSnapshotDef) def = NULL;
+    g_autoptr(virHashTable) blockNamedNodeData = NULL;
+    g_autofree char *xml = NULL;
+    virDomainMomentObjPtr current;
 
-    if (!(vm = qemuDomainObjFromDomain(domain)))
+    if (qemuDomainSupportsCheckpointsBlockjobs(vm) < 0)
         return -1;
 
-    if (virDomainSnapshotNumEnsureACL(domain->conn, vm->def) < 0)
-        goto cleanup;
-
-    n = virDomainSnapshotObjListNum(vm->snapshots, NULL, flags);
+    if (flags & VIR_DOMAIN_SNAPSHOT_CREATE_VALIDATE)
+        parse_flags |= VIR_DOMAIN_SNAPSHOT_PARSE_VALIDATE;
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return n;
-}
+    if (!(def = virDomainSnapshotDefParseString(entry->xmlDesc, driver->xmlopt,
+                                                priv->qemuCaps, NULL, parse_flags)))
+        return -1;
 
+    if (!(flags & VIR_DOMAIN_SNAPSHOT_CREATE_NO_METADATA) &&
+        qemuDomainSnapshotCheckName(def->parent.name) < 0)
+        return -1;
 
-static int
-qemuDomainListAllSnapshots(virDomainPtr domain,
-                           virDomainSnapshotPtr **snaps,
-                           unsigned int flags)
-{
-    virDomainObjPtr vm = NULL;
-    int n = -1;
+    if (qemuDomainObjBeginAsyncJob(driver, vm, QEMU_ASYNC_JOB_SNAPSHOT,
+                                   VIR_DOMAIN_JOB_OPERATION_SNAPSHOT, flags) < 0)
+        return -1;
 
-    virCheckFlags(VIR_DOMAIN_SNAPSHOT_LIST_ROOTS |
-                  VIR_DOMAIN_SNAPSHOT_LIST_TOPOLOGICAL |
-                  VIR_DOMAIN_SNAPSHOT_FILTERS_ALL, -1);
+    entry->job = true;
+    qemuDomainObjSetAsyncJobMask(vm, QEMU_JOB_NONE);
 
-    if (!(vm = qemuDomainObjFromDomain(domain)))
+    if (virDomainObjCheckActive(vm) < 0)
         return -1;
 
-    if (virDomainListAllSnapshotsEnsureACL(domain->conn, vm->def) < 0)
-        goto cleanup;
-
-    n = virDomainListSnapshots(vm->snapshots, NULL, domain, snaps, flags);
+    if (virDomainObjGetState(vm, NULL) == VIR_DOMAIN_PMSUSPENDED) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("qemu doesn't support taking snapshots of "
+                         "PMSUSPENDED guests"));
+        return -1;
+    }
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return n;
-}
+    if (!(xml = qemuDomainDefFormatLive(driver, priv->qemuCaps,
+                                        vm->def, priv->origCPU,
+                                        true, true)) ||
+        !(def->parent.dom = virDomainDefParseString(xml, driver->xmlopt,
+                                                    priv->qemuCaps,
+                                                    VIR_DOMAIN_DEF_PARSE_INACTIVE |
+                                                    VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE)))
+        return -1;
 
+    if (vm->newDef &&
+        !(def->parent.inactiveDom = virDomainDefCopy(vm->newDef, driver->xmlopt,
+                                                     priv->qemuCaps, true)))
+        return -1;
 
-static int
-qemuDomainSnapshotListChildrenNames(virDomainSnapshotPtr snapshot,
-                                    char **names,
-                                    int nameslen,
-                                    unsigned int flags)
-{
-    virDomainObjPtr vm = NULL;
-    virDomainMomentObjPtr snap = NULL;
-    int n = -1;
+    def->state = VIR_DOMAIN_SNAPSHOT_DISK_SNAPSHOT;
+    def->memory = VIR_DOMAIN_SNAPSHOT_LOCATION_NONE;
 
-    virCheckFlags(VIR_DOMAIN_SNAPSHOT_LIST_DESCENDANTS |
-                  VIR_DOMAIN_SNAPSHOT_LIST_TOPOLOGICAL |
-                  VIR_DOMAIN_SNAPSHOT_FILTERS_ALL, -1);
+    if (virDomainSnapshotAlignDisks(def, VIR_DOMAIN_SNAPSHOT_LOCATION_EXTERNAL,
+                                    false) < 0 ||
+        qemuDomainSnapshotPrepare(vm, def, &flags) < 0)
+        return -1;
 
-    if (!(vm = qemuDomObjFromSnapshot(snapshot)))
+    if (!(entry->snap = virDomainSnapshotAssignDef(vm->snapshots, def)))
         return -1;
+    def = NULL;
 
-    if (virDomainSnapshotListChildrenNamesEnsureACL(snapshot->domain->conn, vm->def) < 0)
-        goto cleanup;
+    if ((current = virDomainSnapshotGetCurrent(vm->snapshots)))
+        entry->snap->def->parent_name = g_strdup(current->def->name);
 
-    if (!(snap = qemuSnapObjFromSnapshot(vm, snapshot)))
-        goto cleanup;
+    entry->blockdev = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV);
 
-    n = virDomainSnapshotObjListGetNames(vm->snapshots, snap, names, nameslen,
-                                         flags);
+    if (entry->blockdev &&
+        !(blockNamedNodeData = qemuBlockGetNamedNodeData(vm, QEMU_ASYNC_JOB_SNAPSHOT)))
+        return -1;
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return n;
+    entry->actions = virJSONValueNewArray();
+
+    /* creates the overlay images, which is the slow part, before any of
+     * the domains gets paused */
+    return qemuDomainSnapshotDiskPrepare(driver, vm, entry->snap, data->cfg,
+                                         reuse, entry->blockdev,
+                                         blockNamedNodeData,
+                                         QEMU_ASYNC_JOB_SNAPSHOT,
+                                         &entry->diskdata, &entry->ndiskdata,
+                                         entry->actions);
 }
 
 
 static int
-qemuDomainSnapshotNumChildren(virDomainSnapshotPtr snapshot,
-                              unsigned int flags)
+qemuDomainListSnapshotPauseOne(qemuDomainListSnapshotDataPtr data,
+                               qemuDomainListSnapshotEntryPtr entry)
 {
-    virDomainObjPtr vm = NULL;
-    virDomainMomentObjPtr snap = NULL;
-    int n = -1;
+    virDomainObjPtr vm = entry->vm;
 
-    virCheckFlags(VIR_DOMAIN_SNAPSHOT_LIST_DESCENDANTS |
-                  VIR_DOMAIN_SNAPSHOT_LIST_TOPOLOGICAL |
-                  VIR_DOMAIN_SNAPSHOT_FILTERS_ALL, -1);
+    /* domains paused by the user stay paused */
+    if (virDomainObjGetState(vm, NULL) != VIR_DOMAIN_RUNNING)
+        return 0;
 
-    if (!(vm = qemuDomObjFromSnapshot(snapshot)))
+    if (qemuProcessStopCPUs(data->driver, vm, VIR_DOMAIN_PAUSED_SNAPSHOT,
+                            QEMU_ASYNC_JOB_SNAPSHOT) < 0)
         return -1;
 
-    if (virDomainSnapshotNumChildrenEnsureACL(snapshot->domain->conn, vm->def) < 0)
-        goto cleanup;
-
-    if (!(snap = qemuSnapObjFromSnapshot(vm, snapshot)))
-        goto cleanup;
+    entry->resume = true;
 
-    n = virDomainSnapshotObjListNum(vm->snapshots, snap, flags);
+    if (!virDomainObjIsActive(vm)) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("guest unexpectedly quit"));
+        return -1;
+    }
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return n;
+    return 0;
 }
 
 
 static int
-qemuDomainSnapshotListAllChildren(virDomainSnapshotPtr snapshot,
-                                  virDomainSnapshotPtr **snaps,
-                                  unsigned int flags)
+qemuDomainListSnapshotTransactionOne(qemuDomainListSnapshotDataPtr data,
+                                     qemuDomainListSnapshotEntryPtr entry)
 {
-    virDomainObjPtr vm = NULL;
-    virDomainMomentObjPtr snap = NULL;
-    int n = -1;
-
-    virCheckFlags(VIR_DOMAIN_SNAPSHOT_LIST_DESCENDANTS |
-                  VIR_DOMAIN_SNAPSHOT_LIST_TOPOLOGICAL |
-                  VIR_DOMAIN_SNAPSHOT_FILTERS_ALL, -1);
+    virQEMUDriverPtr driver = data->driver;
+    virDomainObjPtr vm = entry->vm;
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    size_t i;
+    int rc;
 
-    if (!(vm = qemuDomObjFromSnapshot(snapshot)))
+    if (virDomainObjCheckActive(vm) < 0)
         return -1;
 
-    if (virDomainSnapshotListAllChildrenEnsureACL(snapshot->domain->conn, vm->def) < 0)
-        goto cleanup;
-
-    if (!(snap = qemuSnapObjFromSnapshot(vm, snapshot)))
-        goto cleanup;
-
-    n = virDomainListSnapshots(vm->snapshots, snap, snapshot->domain, snaps,
-                               flags);
+    if (entry->ndiskdata > 0) {
+        if (qemuDomainObjEnterMonitorAsync(driver, vm, QEMU_ASYNC_JOB_SNAPSHOT) < 0)
+            return -1;
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return n;
-}
+        rc = qemuMonitorTransaction(priv->mon, &entry->actions);
 
+        if (qemuDomainObjExitMonitor(driver, vm) < 0)
+            rc = -1;
 
-static virDomainSnapshotPtr
-qemuDomainSnapshotLookupByName(virDomainPtr domain,
-                               const char *name,
-                               unsigned int flags)
-{
-    virDomainObjPtr vm;
-    virDomainMomentObjPtr snap = NULL;
-    virDomainSnapshotPtr snapshot = NULL;
+        for (i = 0; i < entry->ndiskdata; i++) {
+            qemuDomainSnapshotDiskDataPtr dd = &entry->diskdata[i];
 
-    virCheckFlags(0, NULL);
+            virDomainAuditDisk(vm, dd->disk->src, dd->src, "snapshot", rc >= 0);
 
-    if (!(vm = qemuDomainObjFromDomain(domain)))
-        return NULL;
+            if (rc == 0)
+                qemuDomainSnapshotDiskUpdateSource(driver, vm, dd, entry->blockdev);
+        }
 
-    if (virDomainSnapshotLookupByNameEnsureACL(domain->conn, vm->def) < 0)
-        goto cleanup;
+        if (rc < 0)
+            return -1;
+    }
 
-    if (!(snap = qemuSnapObjFromName(vm, name)))
-        goto cleanup;
+    entry->taken = true;
 
-    snapshot = virGetDomainSnapshot(domain, snap->def->name);
+    if (virDomainObjSave(vm, driver->xmlopt, data->cfg->stateDir) < 0 ||
+        (vm->newDef && virDomainDefSave(vm->newDef, driver->xmlopt,
+                                        data->cfg->configDir) < 0))
+        return -1;
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return snapshot;
+    return 0;
 }
 
 
 static int
-qemuDomainHasCurrentSnapshot(virDomainPtr domain,
-                             unsigned int flags)
+qemuDomainListSnapshotResumeOne(qemuDomainListSnapshotDataPtr data,
+                                qemuDomainListSnapshotEntryPtr entry)
 {
-    virDomainObjPtr vm;
-    int ret = -1;
-
-    virCheckFlags(0, -1);
+    virDomainObjPtr vm = entry->vm;
+    virObjectEventPtr event;
 
-    if (!(vm = qemuDomainObjFromDomain(domain)))
-        return -1;
+    if (!entry->resume || !virDomainObjIsActive(vm))
+        return 0;
 
-    if (virDomainHasCurrentSnapshotEnsureACL(domain->conn, vm->def) < 0)
-        goto cleanup;
+    entry->resume = false;
 
-    ret = (virDomainSnapshotGetCurrent(vm->snapshots) != NULL);
+    if (qemuProcessStartCPUs(data->driver, vm, VIR_DOMAIN_RUNNING_UNPAUSED,
+                             QEMU_ASYNC_JOB_SNAPSHOT) < 0) {
+        event = virDomainEventLifecycleNewFromObj(vm,
+                                         VIR_DOMAIN_EVENT_SUSPENDED,
+                                         VIR_DOMAIN_EVENT_SUSPENDED_API_ERROR);
+        virObjectEventStateQueue(data->driver->domainEventState, event);
+        if (virGetLastErrorCode() == VIR_ERR_OK) {
+            virReportError(VIR_ERR_OPERATION_FAILED, "%s",
+                           _("resuming after snapshot failed"));
+        }
+        return -1;
+    }
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return ret;
+    return 0;
 }
 
 
-static virDomainSnapshotPtr
-qemuDomainSnapshotGetParent(virDomainSnapshotPtr snapshot,
-                            unsigned int flags)
+static int
+qemuDomainListSnapshotFinishOne(qemuDomainListSnapshotDataPtr data,
+                                qemuDomainListSnapshotEntryPtr entry)
 {
-    virDomainObjPtr vm;
-    virDomainMomentObjPtr snap = NULL;
-    virDomainSnapshotPtr parent = NULL;
-
-    virCheckFlags(0, NULL);
+    virQEMUDriverPtr driver = data->driver;
+    virDomainObjPtr vm = entry->vm;
+    virDomainMomentObjPtr snap = entry->snap;
+    int ret = 0;
 
-    if (!(vm = qemuDomObjFromSnapshot(snapshot)))
-        return NULL;
+    if (!entry->job)
+        return 0;
 
-    if (virDomainSnapshotGetParentEnsureACL(snapshot->domain->conn, vm->def) < 0)
-        goto cleanup;
+    qemuDomainSnapshotDiskCleanup(entry->diskdata, entry->ndiskdata, driver, vm,
+                                  QEMU_ASYNC_JOB_SNAPSHOT);
+    entry->diskdata = NULL;
+    entry->ndiskdata = 0;
 
-    if (!(snap = qemuSnapObjFromSnapshot(vm, snapshot)))
-        goto cleanup;
+    if (entry->taken)
+        entry->name = g_strdup(snap->def->name);
 
-    if (!snap->def->parent_name) {
-        virReportError(VIR_ERR_NO_DOMAIN_SNAPSHOT,
-                       _("snapshot '%s' does not have a parent"),
-                       snap->def->name);
-        goto cleanup;
+    if (entry->taken && !(data->flags & VIR_DOMAIN_SNAPSHOT_CREATE_NO_METADATA)) {
+        virDomainSnapshotSetCurrent(vm->snapshots, snap);
+        if (qemuDomainSnapshotWriteMetadata(vm, snap, driver->xmlopt,
+                                            data->cfg->snapshotDir) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("unable to save metadata for snapshot %s"),
+                           snap->def->name);
+            virDomainSnapshotObjListRemove(vm->snapshots, snap);
+            ret = -1;
+        } else {
+            virDomainSnapshotLinkParent(vm->snapshots, snap);
+        }
+    } else if (snap) {
+        virDomainSnapshotObjListRemove(vm->snapshots, snap);
     }
+    entry->snap = NULL;
 
-    parent = virGetDomainSnapshot(snapshot->domain, snap->def->parent_name);
+    qemuDomainObjEndAsyncJob(driver, vm);
+    entry->job = false;
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return parent;
+    return ret;
 }
 
 
-static virDomainSnapshotPtr
-qemuDomainSnapshotCurrent(virDomainPtr domain,
-                          unsigned int flags)
+static void
+qemuDomainListSnapshotWorker(void *opaque)
 {
-    virDomainObjPtr vm;
-    virDomainSnapshotPtr snapshot = NULL;
-    const char *name;
+    qemuDomainListSnapshotDataPtr data = opaque;
 
-    virCheckFlags(0, NULL);
+    while (true) {
+        qemuDomainListSnapshotEntryPtr entry;
+        size_t i;
+        int rc;
 
-    if (!(vm = qemuDomainObjFromDomain(domain)))
-        return NULL;
+        virMutexLock(&data->lock);
+        i = data->next++;
+        virMutexUnlock(&data->lock);
 
-    if (virDomainSnapshotCurrentEnsureACL(domain->conn, vm->def) < 0)
-        goto cleanup;
+        if (i >= data->nentries)
+            break;
 
-    name = virDomainSnapshotGetCurrentName(vm->snapshots);
-    if (!name) {
-        virReportError(VIR_ERR_NO_DOMAIN_SNAPSHOT, "%s",
-                       _("the domain does not have a current snapshot"));
-        goto cleanup;
-    }
+        entry = data->entries + i;
 
-    snapshot = virGetDomainSnapshot(domain, name);
+        virObjectLock(entry->vm);
+        rc = data->step(data, entry);
+        virObjectUnlock(entry->vm);
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return snapshot;
-}
+        if (rc < 0) {
+            if (!entry->err)
+                virErrorPreserveLast(&entry->err);
+            else
+                virResetLastError();
 
+            virMutexLock(&data->lock);
+            data->failed = true;
+            virMutexUnlock(&data->lock);
+        }
+    }
+}
 
-static char *
-qemuDomainSnapshotGetXMLDesc(virDomainSnapshotPtr snapshot,
-                             unsigned int flags)
+
+/*
+ * Runs @step for all domains concurrently from a bounded set of threads.
+ * The caller's thread takes part in the work too so that the operation
+ * succeeds even if no additional thread can be created. Returns -1 if
+ * @step failed for any of the domains.
+ */
+static int
+qemuDomainListSnapshotRunStep(qemuDomainListSnapshotDataPtr data,
+                              qemuDomainListSnapshotStep step)
 {
-    virQEMUDriverPtr driver = snapshot->domain->conn->privateData;
-    virDomainObjPtr vm = NULL;
-    char *xml = NULL;
-    virDomainMomentObjPtr snap = NULL;
-    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    virThread threads[QEMU_DOMAIN_LIST_SNAPSHOT_THREADS];
+    size_t nthreads = 0;
+    size_t i;
 
-    virCheckFlags(VIR_DOMAIN_SNAPSHOT_XML_SECURE, NULL);
+    data->step = step;
+    data->next = 0;
+    data->failed = false;
 
-    if (!(vm = qemuDomObjFromSnapshot(snapshot)))
-        return NULL;
+    for (i = 1; i < MIN(data->nentries, QEMU_DOMAIN_LIST_SNAPSHOT_THREADS); i++) {
+        if (virThreadCreateFull(&threads[nthreads], true,
+                                qemuDomainListSnapshotWorker,
+                                "qemu-snapshot", false, data) < 0) {
+            VIR_WARN("Unable to create snapshot worker thread: %s",
+                     g_strerror(errno));
+            break;
+        }
+        nthreads++;
+    }
 
-    if (virDomainSnapshotGetXMLDescEnsureACL(snapshot->domain->conn, vm->def, flags) < 0)
+    qemuDomainListSnapshotWorker(data);
+
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+
+    return data->failed ? -1 : 0;
+}
+
+
+/*
+ * Takes external disk-only snapshots of all of @doms at one point in time.
+ * The overlay images of all domains are prepared before any domain is
+ * paused and all of the per-domain steps run concurrently so that the
+ * domains stay paused only for as long as it takes to pause all of them,
+ * run one 'transaction' command in each of them and resume them.
+ */
+static int
+qemuDomainListSnapshotCreateXML(virConnectPtr conn,
+                                virDomainPtr *doms,
+                                unsigned int ndoms,
+                                const char **xmlDescs,
+                                virDomainSnapshotPtr **snaps,
+                                unsigned int flags)
+{
+    virQEMUDriverPtr driver = conn->privateData;
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    qemuDomainListSnapshotData data = { .driver = driver, .cfg = cfg,
+                                        .flags = flags };
+    g_autoptr(GHashTable) seen = NULL;
+    virDomainObjPtr *vms = NULL;
+    size_t nvms = 0;
+    virDomainSnapshotPtr *tmpsnaps = NULL;
+    virErrorPtr err = NULL;
+    size_t i;
+    int ret = -1;
+
+    virCheckFlags(VIR_DOMAIN_SNAPSHOT_CREATE_NO_METADATA |
+                  VIR_DOMAIN_SNAPSHOT_CREATE_DISK_ONLY |
+                  VIR_DOMAIN_SNAPSHOT_CREATE_REUSE_EXT |
+                  VIR_DOMAIN_SNAPSHOT_CREATE_ATOMIC |
+                  VIR_DOMAIN_SNAPSHOT_CREATE_VALIDATE, -1);
+
+    if (!(flags & VIR_DOMAIN_SNAPSHOT_CREATE_DISK_ONLY)) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("only disk snapshots of multiple domains are supported"));
+        return -1;
+    }
+
+    if (virMutexInit(&data.lock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("cannot initialize mutex"));
+        return -1;
+    }
+
+    if (virDomainObjListConvert(driver->domains, conn, doms, ndoms,
+                                &vms, &nvms, NULL, 0, false) < 0)
         goto cleanup;
 
-    if (!(snap = qemuSnapObjFromSnapshot(vm, snapshot)))
+    seen = g_hash_table_new(NULL, NULL);
+    data.entries = g_new0(qemuDomainListSnapshotEntry, nvms);
+    data.nentries = nvms;
+
+    for (i = 0; i < nvms; i++) {
+        virDomainObjPtr vm = vms[i];
+        int rc = 0;
+
+        virObjectLock(vm);
+
+        if (vm->removing) {
+            char uuidstr[VIR_UUID_STRING_BUFLEN];
+
+            virUUIDFormat(vm->def->uuid, uuidstr);
+            virReportError(VIR_ERR_NO_DOMAIN,
+                           _("no domain with matching uuid '%s' (%s)"),
+                           uuidstr, vm->def->name);
+            rc = -1;
+        } else if (!g_hash_table_add(seen, vm)) {
+            virReportError(VIR_ERR_INVALID_ARG,
+                           _("domain '%s' is listed more than once"),
+                           vm->def->name);
+            rc = -1;
+        } else {
+            rc = virDomainListSnapshotCreateXMLEnsureACL(conn, vm->def);
+        }
+
+        virObjectUnlock(vm);
+
+        if (rc < 0)
+            goto cleanup;
+
+        data.entries[i].vm = vm;
+        data.entries[i].xmlDesc = xmlDescs[i];
+    }
+
+    if (qemuDomainListSnapshotRunStep(&data, qemuDomainListSnapshotPrepareOne) == 0 &&
+        qemuDomainListSnapshotRunStep(&data, qemuDomainListSnapshotPauseOne) == 0)
+        qemuDomainListSnapshotRunStep(&data, qemuDomainListSnapshotTransactionOne);
+
+    qemuDomainListSnapshotRunStep(&data, qemuDomainListSnapshotResumeOne);
+    qemuDomainListSnapshotRunStep(&data, qemuDomainListSnapshotFinishOne);
+
+    /* report the first error which occurred in any of the steps */
+    for (i = 0; i < data.nentries; i++) {
+        if (data.entries[i].err) {
+            err = g_steal_pointer(&data.entries[i].err);
+            break;
+        }
+    }
+
+    if (err) {
+        virErrorRestore(&err);
         goto cleanup;
+    }
 
-    virUUIDFormat(snapshot->domain->uuid, uuidstr);
+    tmpsnaps = g_new0(virDomainSnapshotPtr, data.nentries + 1);
+    for (i = 0; i < data.nentries; i++) {
+        if (!(tmpsnaps[i] = virGetDomainSnapshot(doms[i], data.entries[i].name)))
+            goto cleanup;
+    }
 
-    xml = virDomainSnapshotDefFormat(uuidstr, virDomainSnapshotObjGetDef(snap),
-                                     driver->xmlopt,
-                                     virDomainSnapshotFormatConvertXMLFlags(flags));
+    *snaps = g_steal_pointer(&tmpsnaps);
+    ret = data.nentries;
 
  cleanup:
-    virDomainObjEndAPI(&vm);
-    return xml;
+    if (tmpsnaps) {
+        for (i = 0; i < data.nentries; i++)
+            virObjectUnref(tmpsnaps[i]);
+        g_free(tmpsnaps);
+    }
+    for (i = 0; i < data.nentries; i++) {
+        g_free(data.entries[i].name);
+        virJSONValueFree(data.entries[i].actions);
+        virFreeError(data.entries[i].err);
+    }
+    g_free(data.entries);
+    virObjectListFreeCount(vms, nvms);
+    virMutexDestroy(&data.lock);
+    return ret;
 }
 
 
 static int
-qemuDomainSnapshotIsCurrent(virDomainSnapshotPtr snapshot,
+qemuDomainSnapshotListNames(virDomainPtr domain,
+                            char **names,
+                            int nameslen,
                             unsigned int flags)
 {
     virDomainObjPtr vm = NULL;
-    int ret = -1;
-    virDomainMomentObjPtr snap = NULL;
+    int n = -1;
 
-    virCheckFlags(0, -1);
+    virCheckFlags(VIR_DOMAIN_SNAPSHOT_LIST_ROOTS |
+                  VIR_DOMAIN_SNAPSHOT_LIST_TOPOLOGICAL |
+                  VIR_DOMAIN_SNAPSHOT_FILTERS_ALL, -1);
 
-    if (!(vm = qemuDomObjFromSnapshot(snapshot)))
+    if (!(vm = qemuDomainObjFromDomain(domain)))
         return -1;
 
-    if (virDomainSnapshotIsCurrentEnsureACL(snapshot->domain->conn, vm->def) < 0)
-        goto cleanup;
-
-    if (!(snap = qemuSnapObjFromSnapshot(vm, snapshot)))
+    if (virDomainSnapshotListNamesEnsureACL(domain->conn, vm->def) < 0)
         goto cleanup;
 
-    ret = snap == virDomainSnapshotGetCurrent(vm->snapshots);
+    n = virDomainSnapshotObjListGetNames(vm->snapshots, NULL, names, nameslen,
+                                         flags);
 
  cleanup:
     virDomainObjEndAPI(&vm);
-    return ret;
+    return n;
 }
 
 
 static int
-qemuDomainSnapshotHasMetadata(virDomainSnapshotPtr snapshot,
-                              unsigned int flags)
+qemuDomainSnapshotNum(virDomainPtr domain,
+                      unsigned int flags)
 {
     virDomainObjPtr vm = NULL;
-    int ret = -1;
-    virDomainMomentObjPtr snap = NULL;
+    int n = -1;
 
-    virCheckFlags(0, -1);
+    virCheckFlags(VIR_DOMAIN_SNAPSHOT_LIST_ROOTS |
+                  VIR_DOMAIN_SNAPSHOT_LIST_TOPOLOGICAL |
+                  VIR_DOMAIN_SNAPSHOT_FILTERS_ALL, -1);
 
-    if (!(vm = qemuDomObjFromSnapshot(snapshot)))
+    if (!(vm = qemuDomainObjFromDomain(domain)))
         return -1;
 
-    if (virDomainSnapshotHasMetadataEnsureACL(snapshot->domain->conn, vm->def) < 0)
-        goto cleanup;
-
-    if (!(snap = qemuSnapObjFromSnapshot(vm, snapshot)))
+    if (virDomainSnapshotNumEnsureACL(domain->conn, vm->def) < 0)
         goto cleanup;
 
-    /* XXX Someday, we should recognize internal snapshots in qcow2
-     * images that are not tied to a libvirt snapshot; if we ever do
-     * that, then we would have a reason to return 0 here.  */
-    ret = 1;
+    n = virDomainSnapshotObjListNum(vm->snapshots, NULL, flags);
 
  cleanup:
     virDomainObjEndAPI(&vm);
-    return ret;
+    return n;
 }
 
 
-/* The domain is expected to be locked and inactive. */
 static int
-qemuDomainSnapshotRevertInactive(virQEMUDriverPtr driver,
-                                 virDomainObjPtr vm,
-                                 virDomainMomentObjPtr snap)
+qemuDomainListAllSnapshots(virDomainPtr domain,
+                           virDomainSnapshotPtr **snaps,
+                           unsigned int flags)
 {
-    /* Try all disks, but report failure if we skipped any.  */
-    int ret = qemuDomainSnapshotForEachQcow2(driver, vm, snap, "-a", true);
-    return ret > 0 ? -1 : ret;
+    virDomainObjPtr vm = NULL;
+    int n = -1;
+
+    virCheckFlags(VIR_DOMAIN_SNAPSHOT_LIST_ROOTS |
+                  VIR_DOMAIN_SNAPSHOT_LIST_TOPOLOGICAL |
+                  VIR_DOMAIN_SNAPSHOT_FILTERS_ALL, -1);
+
+    if (!(vm = qemuDomainObjFromDomain(domain)))
+        return -1;
+
+    if (virDomainListAllSnapshotsEnsureACL(domain->conn, vm->def) < 0)
+        goto cleanup;
+
+    n = virDomainListSnapshots(vm->snapshots, NULL, domain, snaps, flags);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return n;
 }
 
 
 static int
-qemuDomainRevertToSnapshot(virDomainSnapshotPtr snapshot,
-                           unsigned int flags)
+qemuDomainSnapshotListChildrenNames(virDomainSnapshotPtr snapshot,
+                                    char **names,
+                                    int nameslen,
+                                    unsigned int flags)
 {
-    virQEMUDriverPtr driver = snapshot->domain->conn->privateData;
     virDomainObjPtr vm = NULL;
-    int ret = -1;
     virDomainMomentObjPtr snap = NULL;
-    virDomainSnapshotDefPtr snapdef;
-    virObjectEventPtr event = NULL;
-    virObjectEventPtr event2 = NULL;
-    int detail;
-    qemuDomainObjPrivatePtr priv;
-    int rc;
-    virDomainDefPtr config = NULL;
-    virDomainDefPtr inactiveConfig = NULL;
-    g_autoptr(virQEMUDriverConfig) cfg = NULL;
-    bool was_stopped = false;
-    qemuDomainSaveCookiePtr cookie;
-    virCPUDefPtr origCPU = NULL;
-    unsigned int start_flags = VIR_QEMU_PROCESS_START_GEN_VMID;
-    qemuDomainAsyncJob jobType = QEMU_ASYNC_JOB_START;
-    bool defined = false;
+    int n = -1;
 
-    virCheckFlags(VIR_DOMAIN_SNAPSHOT_REVERT_RUNNING |
-                  VIR_DOMAIN_SNAPSHOT_REVERT_PAUSED |
-                  VIR_DOMAIN_SNAPSHOT_REVERT_FORCE, -1);
+    virCheckFlags(VIR_DOMAIN_SNAPSHOT_LIST_DESCENDANTS |
+                  VIR_DOMAIN_SNAPSHOT_LIST_TOPOLOGICAL |
+                  VIR_DOMAIN_SNAPSHOT_FILTERS_ALL, -1);
 
-    /* We have the following transitions, which create the following events:
-     * 1. inactive -> inactive: none
-     * 2. inactive -> running:  EVENT_STARTED
-     * 3. inactive -> paused:   EVENT_STARTED, EVENT_PAUSED
-     * 4. running  -> inactive: EVENT_STOPPED
-     * 5. running  -> running:  none
-     * 6. running  -> paused:   EVENT_PAUSED
-     * 7. paused   -> inactive: EVENT_STOPPED
-     * 8. paused   -> running:  EVENT_RESUMED
-     * 9. paused   -> paused:   none
-     * Also, several transitions occur even if we fail partway through,
-     * and use of FORCE can cause multiple transitions.
-     */
+    if (!(vm = qemuDomObjFromSnapshot(snapshot)))
+        return -1;
 
-    virNWFilterReadLockFilterUpdates();
+    if (virDomainSnapshotListChildrenNamesEnsureACL(snapshot->domain->conn, vm->def) < 0)
+        goto cleanup;
 
-    if (!(vm = qemuDomObjFromSnapshot(snapshot)))
+    if (!(snap = qemuSnapObjFromSnapshot(vm, snapshot)))
         goto cleanup;
 
-    priv = vm->privateData;
-    cfg = virQEMUDriverGetConfig(driver);
+    n = virDomainSnapshotObjListGetNames(vm->snapshots, snap, names, nameslen,
+                                         flags);
 
-    if (virDomainRevertToSnapshotEnsureACL(snapshot->domain->conn, vm->def) < 0)
-        goto cleanup;
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return n;
+}
 
-    if (qemuDomainHasBlockjob(vm, false)) {
-        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
-                       _("domain has active block job"));
-        goto cleanup;
-    }
 
-    if (qemuProcessBeginJob(driver, vm,
-                            VIR_DOMAIN_JOB_OPERATION_SNAPSHOT_REVERT,
-                            flags) < 0)
+static int
+qemuDomainSnapshotNumChildren(virDomainSnapshotPtr snapshot,
+                              unsigned int flags)
+{
+    virDomainObjPtr vm = NULL;
+    virDomainMomentObjPtr snap = NULL;
+    int n = -1;
+
+    virCheckFlags(VIR_DOMAIN_SNAPSHOT_LIST_DESCENDANTS |
+                  VIR_DOMAIN_SNAPSHOT_LIST_TOPOLOGICAL |
+                  VIR_DOMAIN_SNAPSHOT_FILTERS_ALL, -1);
+
+    if (!(vm = qemuDomObjFromSnapshot(snapshot)))
+        return -1;
+
+    if (virDomainSnapshotNumChildrenEnsureACL(snapshot->domain->conn, vm->def) < 0)
         goto cleanup;
 
     if (!(snap = qemuSnapObjFromSnapshot(vm, snapshot)))
-        goto endjob;
-    snapdef = virDomainSnapshotObjGetDef(snap);
+        goto cleanup;
 
-    if (!vm->persistent &&
-        snapdef->state != VIR_DOMAIN_SNAPSHOT_RUNNING &&
-        snapdef->state != VIR_DOMAIN_SNAPSHOT_PAUSED &&
-        (flags & (VIR_DOMAIN_SNAPSHOT_REVERT_RUNNING |
-                  VIR_DOMAIN_SNAPSHOT_REVERT_PAUSED)) == 0) {
-        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
-                       _("transient domain needs to request run or pause "
-                         "to revert to inactive snapshot"));
-        goto endjob;
-    }
+    n = virDomainSnapshotObjListNum(vm->snapshots, snap, flags);
 
-    if (virDomainSnapshotIsExternal(snap)) {
-        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
-                       _("revert to external snapshot not supported yet"));
-        goto endjob;
-    }
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return n;
+}
 
-    if (!(flags & VIR_DOMAIN_SNAPSHOT_REVERT_FORCE)) {
-        if (!snap->def->dom) {
-            virReportError(VIR_ERR_SNAPSHOT_REVERT_RISKY,
-                           _("snapshot '%s' lacks domain '%s' rollback info"),
-                           snap->def->name, vm->def->name);
-            goto endjob;
-        }
-        if (virDomainObjIsActive(vm) &&
-            !(snapdef->state == VIR_DOMAIN_SNAPSHOT_RUNNING ||
-              snapdef->state == VIR_DOMAIN_SNAPSHOT_PAUSED) &&
-            (flags & (VIR_DOMAIN_SNAPSHOT_REVERT_RUNNING |
-                      VIR_DOMAIN_SNAPSHOT_REVERT_PAUSED))) {
-            virReportError(VIR_ERR_SNAPSHOT_REVERT_RISKY, "%s",
-                           _("must respawn qemu to start inactive snapshot"));
-            goto endjob;
-        }
-        if (vm->hasManagedSave &&
-            !(snapdef->state == VIR_DOMAIN_SNAPSHOT_RUNNING ||
-              snapdef->state == VIR_DOMAIN_SNAPSHOT_PAUSED)) {
-            virReportError(VIR_ERR_SNAPSHOT_REVERT_RISKY, "%s",
-                           _("snapshot without memory state, removal of "
-                             "existing managed saved state strongly "
-                             "recommended to avoid corruption"));
-            goto endjob;
-        }
-    }
 
-    if (snap->def->dom) {
-        config = virDomainDefCopy(snap->def->dom,
-                                  driver->xmlopt, priv->qemuCaps, true);
-        if (!config)
-            goto endjob;
-    }
+static int
+qemuDomainSnapshotListAllChildren(virDomainSnapshotPtr snapshot,
+                                  virDomainSnapshotPtr **snaps,
+                                  unsigned int flags)
+{
+    virDomainObjPtr vm = NULL;
+    virDomainMomentObjPtr snap = NULL;
+    int n = -1;
 
-    if (snap->def->inactiveDom) {
-        inactiveConfig = virDomainDefCopy(snap->def->inactiveDom,
-                                          driver->xmlopt, priv->qemuCaps, true);
-        if (!inactiveConfig)
-            goto endjob;
-    } else {
-        /* Inactive domain definition is missing:
-         * - either this is an old active snapshot and we need to copy the
-         *   active definition as an inactive one
-         * - or this is an inactive snapshot which means config contains the
-         *   inactive definition.
-         */
-        if (snapdef->state == VIR_DOMAIN_SNAPSHOT_RUNNING ||
-            snapdef->state == VIR_DOMAIN_SNAPSHOT_PAUSED) {
-            inactiveConfig = virDomainDefCopy(snap->def->dom,
-                                              driver->xmlopt, priv->qemuCaps, true);
-            if (!inactiveConfig)
-                goto endjob;
-        } else {
-            inactiveConfig = g_steal_pointer(&config);
-        }
-    }
+    virCheckFlags(VIR_DOMAIN_SNAPSHOT_LIST_DESCENDANTS |
+                  VIR_DOMAIN_SNAPSHOT_LIST_TOPOLOGICAL |
+                  VIR_DOMAIN_SNAPSHOT_FILTERS_ALL, -1);
 
-    cookie = (qemuDomainSaveCookiePtr) snapdef->cookie;
+    if (!(vm = qemuDomObjFromSnapshot(snapshot)))
+        return -1;
 
-    switch ((virDomainSnapshotState) snapdef->state) {
-    case VIR_DOMAIN_SNAPSHOT_RUNNING:
-    case VIR_DOMAIN_SNAPSHOT_PAUSED:
-        start_flags |= VIR_QEMU_PROCESS_START_PAUSED;
+    if (virDomainSnapshotListAllChildrenEnsureACL(snapshot->domain->conn, vm->def) < 0)
+        goto cleanup;
 
-        /* Transitions 2, 3, 5, 6, 8, 9 */
-        /* When using the loadvm monitor command, qemu does not know
-         * whether to pause or run the reverted domain, and just stays
-         * in the same state as before the monitor command, whether
-         * that is paused or running.  We always pause before loadvm,
-         * to have finer control.  */
-        if (virDomainObjIsActive(vm)) {
-            /* Transitions 5, 6, 8, 9 */
-            /* Check for ABI compatibility. We need to do this check against
-             * the migratable XML or it will always fail otherwise */
-            if (config) {
-                bool compatible;
+    if (!(snap = qemuSnapObjFromSnapshot(vm, snapshot)))
+        goto cleanup;
 
-                /* Replace the CPU in config and put the original one in priv
-                 * once we're done. When we have the updated CPU def in the
-                 * cookie, we don't want to replace the CPU in migratable def
-                 * when doing ABI checks to make sure the current CPU exactly
-                 * matches the one used at the time the snapshot was taken.
-                 */
-                if (cookie && cookie->cpu && config->cpu) {
-                    origCPU = config->cpu;
-                    if (!(config->cpu = virCPUDefCopy(cookie->cpu)))
-                        goto endjob;
+    n = virDomainListSnapshots(vm->snapshots, snap, snapshot->domain, snaps,
+                               flags);
 
-                    compatible = qemuDomainDefCheckABIStability(driver,
-                                                                priv->qemuCaps,
-                                                                vm->def,
-                                                                config);
-                } else {
-                    compatible = qemuDomainCheckABIStability(driver, vm, config);
-                }
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return n;
+}
 
-                /* If using VM GenID, there is no way currently to change
-                 * the genid for the running guest, so set an error,
-                 * mark as incompatible, and don't allow change of genid
-                 * if the revert force flag would start the guest again. */
-                if (compatible && config->genidRequested) {
-                    virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
-                                   _("domain genid update requires restart"));
-                    compatible = false;
-                    start_flags &= ~VIR_QEMU_PROCESS_START_GEN_VMID;
-                }
 
-                if (!compatible) {
-                    virErrorPtr err = virGetLastError();
+static virDomainSnapshotPtr
+qemuDomainSnapshotLookupByName(virDomainPtr domain,
+                               const char *name,
+                               unsigned int flags)
+{
+    virDomainObjPtr vm;
+    virDomainMomentObjPtr snap = NULL;
+    virDomainSnapshotPtr snapshot = NULL;
 
-                    if (!(flags & VIR_DOMAIN_SNAPSHOT_REVERT_FORCE)) {
-                        /* Re-spawn error using correct category. */
-                        if (err->code == VIR_ERR_CONFIG_UNSUPPORTED)
-                            virReportError(VIR_ERR_SNAPSHOT_REVERT_RISKY, "%s",
-                                           err->str2);
-                        goto endjob;
-                    }
-                    virResetError(err);
-                    qemuProcessStop(driver, vm,
-                                    VIR_DOMAIN_SHUTOFF_FROM_SNAPSHOT,
-                                    QEMU_ASYNC_JOB_START, 0);
-                    virDomainAuditStop(vm, "from-snapshot");
-                    detail = VIR_DOMAIN_EVENT_STOPPED_FROM_SNAPSHOT;
-                    event = virDomainEventLifecycleNewFromObj(vm,
-                                                     VIR_DOMAIN_EVENT_STOPPED,
-                                                     detail);
-                    virObjectEventStateQueue(driver->domainEventState, event);
-                    /* Start after stop won't be an async start job, so
-                     * reset to none */
-                    jobType = QEMU_ASYNC_JOB_NONE;
-                    goto load;
-                }
-            }
+    virCheckFlags(0, NULL);
 
-            if (virDomainObjGetState(vm, NULL) == VIR_DOMAIN_RUNNING) {
-                /* Transitions 5, 6 */
-                if (qemuProcessStopCPUs(driver, vm,
-                                        VIR_DOMAIN_PAUSED_FROM_SNAPSHOT,
-                                        QEMU_ASYNC_JOB_START) < 0)
-                    goto endjob;
-                if (!virDomainObjIsActive(vm)) {
-                    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                                   _("guest unexpectedly quit"));
-                    goto endjob;
-                }
-            }
+    if (!(vm = qemuDomainObjFromDomain(domain)))
+        return NULL;
 
-            if (qemuDomainObjEnterMonitorAsync(driver, vm,
-                                               QEMU_ASYNC_JOB_START) < 0)
-                goto endjob;
-            rc = qemuMonitorLoadSnapshot(priv->mon, snap->def->name);
-            if (qemuDomainObjExitMonitor(driver, vm) < 0)
-                goto endjob;
-            if (rc < 0) {
-                /* XXX resume domain if it was running before the
-                 * failed loadvm attempt? */
-                goto endjob;
-            }
-            if (config) {
-                virCPUDefFree(priv->origCPU);
-                priv->origCPU = g_steal_pointer(&origCPU);
-            }
+    if (virDomainSnapshotLookupByNameEnsureACL(domain->conn, vm->def) < 0)
+        goto cleanup;
 
-            if (cookie && !cookie->slirpHelper)
-                priv->disableSlirp = true;
+    if (!(snap = qemuSnapObjFromName(vm, name)))
+        goto cleanup;
 
-            if (inactiveConfig) {
-                virDomainObjAssignDef(vm, inactiveConfig, false, NULL);
-                inactiveConfig = NULL;
-                defined = true;
-            }
-        } else {
-            /* Transitions 2, 3 */
-        load:
-            was_stopped = true;
+    snapshot = virGetDomainSnapshot(domain, snap->def->name);
 
-            if (inactiveConfig) {
-                virDomainObjAssignDef(vm, inactiveConfig, false, NULL);
-                inactiveConfig = NULL;
-                defined = true;
-            }
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return snapshot;
+}
 
-            if (config) {
-                virDomainObjAssignDef(vm, config, true, NULL);
-                config = NULL;
-            }
 
-            /* No cookie means libvirt which saved the domain was too old to
-             * mess up the CPU definitions.
-             */
-            if (cookie &&
-                qemuDomainFixupCPUs(vm, &cookie->cpu) < 0)
-                goto cleanup;
+static int
+qemuDomainHasCurrentSnapshot(virDomainPtr domain,
+                             unsigned int flags)
+{
+    virDomainObjPtr vm;
+    int ret = -1;
+
+    virCheckFlags(0, -1);
+
+    if (!(vm = qemuDomainObjFromDomain(domain)))
+        return -1;
+
+    if (virDomainHasCurrentSnapshotEnsureACL(domain->conn, vm->def) < 0)
+        goto cleanup;
+
+    ret = (virDomainSnapshotGetCurrent(vm->snapshots) != NULL);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+
+static virDomainSnapshotPtr
+qemuDomainSnapshotGetParent(virDomainSnapshotPtr snapshot,
+                            unsigned int flags)
+{
+    virDomainObjPtr vm;
+    virDomainMomentObjPtr snap = NULL;
+    virDomainSnapshotPtr parent = NULL;
+
+    virCheckFlags(0, NULL);
+
+    if (!(vm = qemuDomObjFromSnapshot(snapshot)))
+        return NULL;
+
+    if (virDomainSnapshotGetParentEnsureACL(snapshot->domain->conn, vm->def) < 0)
+        goto cleanup;
+
+    if (!(snap = qemuSnapObjFromSnapshot(vm, snapshot)))
+        goto cleanup;
+
+    if (!snap->def->parent_name) {
+        virReportError(VIR_ERR_NO_DOMAIN_SNAPSHOT,
+                       _("snapshot '%s' does not have a parent"),
+                       snap->def->name);
+        goto cleanup;
+    }
+
+    parent = virGetDomainSnapshot(snapshot->domain, snap->def->parent_name);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return parent;
+}
+
+
+static virDomainSnapshotPtr
+qemuDomainSnapshotCurrent(virDomainPtr domain,
+                          unsigned int flags)
+{
+    virDomainObjPtr vm;
+    virDomainSnapshotPtr snapshot = NULL;
+    const char *name;
+
+    virCheckFlags(0, NULL);
+
+    if (!(vm = qemuDomainObjFromDomain(domain)))
+        return NULL;
+
+    if (virDomainSnapshotCurrentEnsureACL(domain->conn, vm->def) < 0)
+        goto cleanup;
+
+    name = virDomainSnapshotGetCurrentName(vm->snapshots);
+    if (!name) {
+        virReportError(VIR_ERR_NO_DOMAIN_SNAPSHOT, "%s",
+                       _("the domain does not have a current snapshot"));
+        goto cleanup;
+    }
+
+    snapshot = virGetDomainSnapshot(domain, name);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return snapshot;
+}
+
+
+static char *
+qemuDomainSnapshotGetXMLDesc(virDomainSnapshotPtr snapshot,
+                             unsigned int flags)
+{
+    virQEMUDriverPtr driver = snapshot->domain->conn->privateData;
+    virDomainObjPtr vm = NULL;
+    char *xml = NULL;
+    virDomainMomentObjPtr snap = NULL;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+
+    virCheckFlags(VIR_DOMAIN_SNAPSHOT_XML_SECURE, NULL);
+
+    if (!(vm = qemuDomObjFromSnapshot(snapshot)))
+        return NULL;
+
+    if (virDomainSnapshotGetXMLDescEnsureACL(snapshot->domain->conn, vm->def, flags) < 0)
+        goto cleanup;
+
+    if (!(snap = qemuSnapObjFromSnapshot(vm, snapshot)))
+        goto cleanup;
+
+    virUUIDFormat(snapshot->domain->uuid, uuidstr);
+
+    xml = virDomainSnapshotDefFormat(uuidstr, virDomainSnapshotObjGetDef(snap),
+                                     driver->xmlopt,
+                                     virDomainSnapshotFormatConvertXMLFlags(flags));
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return xml;
+}
+
+
+static int
+qemuDomainSnapshotIsCurrent(virDomainSnapshotPtr snapshot,
+                            unsigned int flags)
+{
+    virDomainObjPtr vm = NULL;
+    int ret = -1;
+    virDomainMomentObjPtr snap = NULL;
+
+    virCheckFlags(0, -1);
+
+    if (!(vm = qemuDomObjFromSnapshot(snapshot)))
+        return -1;
+
+    if (virDomainSnapshotIsCurrentEnsureACL(snapshot->domain->conn, vm->def) < 0)
+        goto cleanup;
+
+    if (!(snap = qemuSnapObjFromSnapshot(vm, snapshot)))
+        goto cleanup;
+
+    ret = snap == virDomainSnapshotGetCurrent(vm->snapshots);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+
+static int
+qemuDomainSnapshotHasMetadata(virDomainSnapshotPtr snapshot,
+                              unsigned int flags)
+{
+    virDomainObjPtr vm = NULL;
+    int ret = -1;
+    virDomainMomentObjPtr snap = NULL;
+
+    virCheckFlags(0, -1);
+
+    if (!(vm = qemuDomObjFromSnapshot(snapshot)))
+        return -1;
+
+    if (virDomainSnapshotHasMetadataEnsureACL(snapshot->domain->conn, vm->def) < 0)
+        goto cleanup;
+
+    if (!(snap = qemuSnapObjFromSnapshot(vm, snapshot)))
+        goto cleanup;
+
+    /* XXX Someday, we should recognize internal snapshots in qcow2
+     * images that are not tied to a libvirt snapshot; if we ever do
+     * that, then we would have a reason to return 0 here.  */
+    ret = 1;
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+
+/* The domain is expected to be locked and inactive. */
+static int
+qemuDomainSnapshotRevertInactive(virQEMUDriverPtr driver,
+                                 virDomainObjPtr vm,
+                                 virDomainMomentObjPtr snap)
+{
+    /* Try all disks, but report failure if we skipped any.  */
+    int ret = qemuDomainSnapshotForEachQcow2(driver, vm, snap, "-a", true);
+    return ret > 0 ? -1 : ret;
+}
+
+
+static int
+qemuDomainRevertToSnapshot(virDomainSnapshotPtr snapshot,
+                           unsigned int flags)
+{
+    virQEMUDriverPtr driver = snapshot->domain->conn->privateData;
+    virDomainObjPtr vm = NULL;
+    int ret = -1;
+    virDomainMomentObjPtr snap = NULL;
+    virDomainSnapshotDefPtr snapdef;
+    virObjectEventPtr event = NULL;
+    virObjectEventPtr event2 = NULL;
+    int detail;
+    qemuDomainObjPrivatePtr priv;
+    int rc;
+    virDomainDefPtr config = NULL;
+    virDomainDefPtr inactiveConfig = NULL;
+    g_autoptr(virQEMUDriverConfig) cfg = NULL;
+    bool was_stopped = false;
+    qemuDomainSaveCookiePtr cookie;
+    virCPUDefPtr origCPU = NULL;
+    unsigned int start_flags = VIR_QEMU_PROCESS_START_GEN_VMID;
+    qemuDomainAsyncJob jobType = QEMU_ASYNC_JOB_START;
+    bool defined = false;
+
+    virCheckFlags(VIR_DOMAIN_SNAPSHOT_REVERT_RUNNING |
+                  VIR_DOMAIN_SNAPSHOT_REVERT_PAUSED |
+                  VIR_DOMAIN_SNAPSHOT_REVERT_FORCE, -1);
+
+    /* We have the following transitions, which create the following events:
+     * 1. inactive -> inactive: none
+     * 2. inactive -> running:  EVENT_STARTED
+     * 3. inactive -> paused:   EVENT_STARTED, EVENT_PAUSED
+     * 4. running  -> inactive: EVENT_STOPPED
+     * 5. running  -> running:  none
+     * 6. running  -> paused:   EVENT_PAUSED
+     * 7. paused   -> inactive: EVENT_STOPPED
+     * 8. paused   -> running:  EVENT_RESUMED
+     * 9. paused   -> paused:   none
+     * Also, several transitions occur even if we fail partway through,
+     * and use of FORCE can cause multiple transitions.
+     */
+
+    virNWFilterReadLockFilterUpdates();
+
+    if (!(vm = qemuDomObjFromSnapshot(snapshot)))
+        goto cleanup;
+
+    priv = vm->privateData;
+    cfg = virQEMUDriverGetConfig(driver);
+
+    if (virDomainRevertToSnapshotEnsureACL(snapshot->domain->conn, vm->def) < 0)
+        goto cleanup;
+
+    if (qemuDomainHasBlockjob(vm, false)) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("domain has active block job"));
+        goto cleanup;
+    }
+
+    if (qemuProcessBeginJob(driver, vm,
+                            VIR_DOMAIN_JOB_OPERATION_SNAPSHOT_REVERT,
+                            flags) < 0)
+        goto cleanup;
+
+    if (!(snap = qemuSnapObjFromSnapshot(vm, snapshot)))
+        goto endjob;
+    snapdef = virDomainSnapshotObjGetDef(snap);
+
+    if (!vm->persistent &&
+        snapdef->state != VIR_DOMAIN_SNAPSHOT_RUNNING &&
+        snapdef->state != VIR_DOMAIN_SNAPSHOT_PAUSED &&
+        (flags & (VIR_DOMAIN_SNAPSHOT_REVERT_RUNNING |
+                  VIR_DOMAIN_SNAPSHOT_REVERT_PAUSED)) == 0) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("transient domain needs to request run or pause "
+                         "to revert to inactive snapshot"));
+        goto endjob;
+    }
+
+    if (virDomainSnapshotIsExternal(snap)) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                       _("revert to external snapshot not supported yet"));
+        goto endjob;
+    }
+
+    if (!(flags & VIR_DOMAIN_SNAPSHOT_REVERT_FORCE)) {
+        if (!snap->def->dom) {
+            virReportError(VIR_ERR_SNAPSHOT_REVERT_RISKY,
+                           _("snapshot '%s' lacks domain '%s' rollback info"),
+                           snap->def->name, vm->def->name);
+            goto endjob;
+        }
+        if (virDomainObjIsActive(vm) &&
+            !(snapdef->state == VIR_DOMAIN_SNAPSHOT_RUNNING ||
+              snapdef->state == VIR_DOMAIN_SNAPSHOT_PAUSED) &&
+            (flags & (VIR_DOMAIN_SNAPSHOT_REVERT_RUNNING |
+                      VIR_DOMAIN_SNAPSHOT_REVERT_PAUSED))) {
+            virReportError(VIR_ERR_SNAPSHOT_REVERT_RISKY, "%s",
+                           _("must respawn qemu to start inactive snapshot"));
+            goto endjob;
+        }
+        if (vm->hasManagedSave &&
+            !(snapdef->state == VIR_DOMAIN_SNAPSHOT_RUNNING ||
+              snapdef->state == VIR_DOMAIN_SNAPSHOT_PAUSED)) {
+            virReportError(VIR_ERR_SNAPSHOT_REVERT_RISKY, "%s",
+                           _("snapshot without memory state, removal of "
+                             "existing managed saved state strongly "
+                             "recommended to avoid corruption"));
+            goto endjob;
+        }
+    }
+
+    if (snap->def->dom) {
+        config = virDomainDefCopy(snap->def->dom,
+                                  driver->xmlopt, priv->qemuCaps, true);
+        if (!config)
+            goto endjob;
+    }
+
+    if (snap->def->inactiveDom) {
+        inactiveConfig = virDomainDefCopy(snap->def->inactiveDom,
+                                          driver->xmlopt, priv->qemuCaps, true);
+        if (!inactiveConfig)
+            goto endjob;
+    } else {
+        /* Inactive domain definition is missing:
+         * - either this is an old active snapshot and we need to copy the
+         *   active definition as an inactive one
+         * - or this is an inactive snapshot which means config contains the
+         *   inactive definition.
+         */
+        if (snapdef->state == VIR_DOMAIN_SNAPSHOT_RUNNING ||
+            snapdef->state == VIR_DOMAIN_SNAPSHOT_PAUSED) {
+            inactiveConfig = virDomainDefCopy(snap->def->dom,
+                                              driver->xmlopt, priv->qemuCaps, true);
+            if (!inactiveConfig)
+                goto endjob;
+        } else {
+            inactiveConfig = g_steal_pointer(&config);
+        }
+    }
+
+    cookie = (qemuDomainSaveCookiePtr) snapdef->cookie;
+
+    switch ((virDomainSnapshotState) snapdef->state) {
+    case VIR_DOMAIN_SNAPSHOT_RUNNING:
+    case VIR_DOMAIN_SNAPSHOT_PAUSED:
+        start_flags |= VIR_QEMU_PROCESS_START_PAUSED;
+
+        /* Transitions 2, 3, 5, 6, 8, 9 */
+        /* When using the loadvm monitor command, qemu does not know
+         * whether to pause or run the reverted domain, and just stays
+         * in the same state as before the monitor command, whether
+         * that is paused or running.  We always pause before loadvm,
+         * to have finer control.  */
+        if (virDomainObjIsActive(vm)) {
+            /* Transitions 5, 6, 8, 9 */
+            /* Check for ABI compatibility. We need to do this check against
+             * the migratable XML or it will always fail otherwise */
+            if (config) {
+                bool compatible;
+
+                /* Replace the CPU in config and put the original one in priv
+                 * once we're done. When we have the updated CPU def in the
+                 * cookie, we don't want to replace the CPU in migratable def
+                 * when doing ABI checks to make sure the current CPU exactly
+                 * matches the one used at the time the snapshot was taken.
+                 */
+                if (cookie && cookie->cpu && config->cpu) {
+                    origCPU = config->cpu;
+                    if (!(config->cpu = virCPUDefCopy(cookie->cpu)))
+                        goto endjob;
+
+                    compatible = qemuDomainDefCheckABIStability(driver,
+                                                                priv->qemuCaps,
+                                                                vm->def,
+                                                                config);
+                } else {
+                    compatible = qemuDomainCheckABIStability(driver, vm, config);
+                }
+
+                /* If using VM GenID, there is no way currently to change
+                 * the genid for the running guest, so set an error,
+                 * mark as incompatible, and don't allow change of genid
+                 * if the revert force flag would start the guest again. */
+                if (compatible && config->genidRequested) {
+                    virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                                   _("domain genid update requires restart"));
+                    compatible = false;
+                    start_flags &= ~VIR_QEMU_PROCESS_START_GEN_VMID;
+                }
+
+                if (!compatible) {
+                    virErrorPtr err = virGetLastError();
+
+                    if (!(flags & VIR_DOMAIN_SNAPSHOT_REVERT_FORCE)) {
+                        /* Re-spawn error using correct category. */
+                        if (err->code == VIR_ERR_CONFIG_UNSUPPORTED)
+                            virReportError(VIR_ERR_SNAPSHOT_REVERT_RISKY, "%s",
+                                           err->str2);
+                        goto endjob;
+                    }
+                    virResetError(err);
+                    qemuProcessStop(driver, vm,
+                                    VIR_DOMAIN_SHUTOFF_FROM_SNAPSHOT,
+                                    QEMU_ASYNC_JOB_START, 0);
+                    virDomainAuditStop(vm, "from-snapshot");
+                    detail = VIR_DOMAIN_EVENT_STOPPED_FROM_SNAPSHOT;
+                    event = virDomainEventLifecycleNewFromObj(vm,
+                                                     VIR_DOMAIN_EVENT_STOPPED,
+                                                     detail);
+                    virObjectEventStateQueue(driver->domainEventState, event);
+                    /* Start after stop won't be an async start job, so
+                     * reset to none */
+                    jobType = QEMU_ASYNC_JOB_NONE;
+                    goto load;
+                }
+            }
+
+            if (virDomainObjGetState(vm, NULL) == VIR_DOMAIN_RUNNING) {
+                /* Transitions 5, 6 */
+                if (qemuProcessStopCPUs(driver, vm,
+                                        VIR_DOMAIN_PAUSED_FROM_SNAPSHOT,
+                                        QEMU_ASYNC_JOB_START) < 0)
+                    goto endjob;
+                if (!virDomainObjIsActive(vm)) {
+                    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                                   _("guest unexpectedly quit"));
+                    goto endjob;
+                }
+            }
+
+            if (qemuDomainObjEnterMonitorAsync(driver, vm,
+                                               QEMU_ASYNC_JOB_START) < 0)
+                goto endjob;
+            rc = qemuMonitorLoadSnapshot(priv->mon, snap->def->name);
+            if (qemuDomainObjExitMonitor(driver, vm) < 0)
+                goto endjob;
+            if (rc < 0) {
+                /* XXX resume domain if it was running before the
+                 * failed loadvm attempt? */
+                goto endjob;
+            }
+            if (config) {
+                virCPUDefFree(priv->origCPU);
+                priv->origCPU = g_steal_pointer(&origCPU);
+            }
+
+            if (cookie && !cookie->slirpHelper)
+                priv->disableSlirp = true;
+
+            if (inactiveConfig) {
+                virDomainObjAssignDef(vm, inactiveConfig, false, NULL);
+                inactiveConfig = NULL;
+                defined = true;
+            }
+        } else {
+            /* Transitions 2, 3 */
+        load:
+            was_stopped = true;
+
+            if (inactiveConfig) {
+                virDomainObjAssignDef(vm, inactiveConfig, false, NULL);
+                inactiveConfig = NULL;
+                defined = true;
+            }
+
+            if (config) {
+                virDomainObjAssignDef(vm, config, true, NULL);
+                config = NULL;
+            }
+
+            /* No cookie means libvirt which saved the domain was too old to
+             * mess up the CPU definitions.
+             */
+            if (cookie &&
+                qemuDomainFixupCPUs(vm, &cookie->cpu) < 0)
+                goto cleanup;
+
+            rc = qemuProcessStart(snapshot->domain->conn, driver, vm,
+                                  cookie ? cookie->cpu : NULL,
+                                  jobType, NULL, -1, NULL, snap,
+                                  VIR_NETDEV_VPORT_PROFILE_OP_CREATE,
+                                  start_flags);
+            virDomainAuditStart(vm, "from-snapshot", rc >= 0);
+            detail = VIR_DOMAIN_EVENT_STARTED_FROM_SNAPSHOT;
+            event = virDomainEventLifecycleNewFromObj(vm,
+                                             VIR_DOMAIN_EVENT_STARTED,
+                                             detail);
+            if (rc < 0)
+                goto endjob;
+        }
+
+        /* Touch up domain state.  */
+        if (!(flags & VIR_DOMAIN_SNAPSHOT_REVERT_RUNNING) &&
+            (snapdef->state == VIR_DOMAIN_SNAPSHOT_PAUSED ||
+             (flags & VIR_DOMAIN_SNAPSHOT_REVERT_PAUSED))) {
+            /* Transitions 3, 6, 9 */
+            virDomainObjSetState(vm, VIR_DOMAIN_PAUSED,
+                                 VIR_DOMAIN_PAUSED_FROM_SNAPSHOT);
+            if (was_stopped) {
+                /* Transition 3, use event as-is and add event2 */
+                detail = VIR_DOMAIN_EVENT_SUSPENDED_FROM_SNAPSHOT;
+                event2 = virDomainEventLifecycleNewFromObj(vm,
+                                                  VIR_DOMAIN_EVENT_SUSPENDED,
+                                                  detail);
+            } /* else transition 6 and 9 use event as-is */
+        } else {
+            /* Transitions 2, 5, 8 */
+            if (!virDomainObjIsActive(vm)) {
+                virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                               _("guest unexpectedly quit"));
+                goto endjob;
+            }
+            rc = qemuProcessStartCPUs(driver, vm,
+                                      VIR_DOMAIN_RUNNING_FROM_SNAPSHOT,
+                                      jobType);
+            if (rc < 0)
+                goto endjob;
+            virObjectUnref(event);
+            event = NULL;
+            if (was_stopped) {
+                /* Transition 2 */
+                detail = VIR_DOMAIN_EVENT_STARTED_FROM_SNAPSHOT;
+                event = virDomainEventLifecycleNewFromObj(vm,
+                                                 VIR_DOMAIN_EVENT_STARTED,
+                                                 detail);
+            }
+        }
+        break;
+
+    case VIR_DOMAIN_SNAPSHOT_SHUTDOWN:
+    case VIR_DOMAIN_SNAPSHOT_SHUTOFF:
+    case VIR_DOMAIN_SNAPSHOT_CRASHED:
+        /* Transitions 1, 4, 7 */
+        /* Newer qemu -loadvm refuses to revert to the state of a snapshot
+         * created by qemu-img snapshot -c.  If the domain is running, we
+         * must take it offline; then do the revert using qemu-img.
+         */
+
+        if (virDomainObjIsActive(vm)) {
+            /* Transitions 4, 7 */
+            qemuProcessStop(driver, vm, VIR_DOMAIN_SHUTOFF_FROM_SNAPSHOT,
+                            QEMU_ASYNC_JOB_START, 0);
+            virDomainAuditStop(vm, "from-snapshot");
+            detail = VIR_DOMAIN_EVENT_STOPPED_FROM_SNAPSHOT;
+            event = virDomainEventLifecycleNewFromObj(vm,
+                                             VIR_DOMAIN_EVENT_STOPPED,
+                                             detail);
+        }
+
+        if (qemuDomainSnapshotRevertInactive(driver, vm, snap) < 0) {
+            qemuDomainRemoveInactive(driver, vm);
+            qemuProcessEndJob(driver, vm);
+            goto cleanup;
+        }
+
+        if (inactiveConfig) {
+            virDomainObjAssignDef(vm, inactiveConfig, false, NULL);
+            inactiveConfig = NULL;
+            defined = true;
+        }
+
+        if (flags & (VIR_DOMAIN_SNAPSHOT_REVERT_RUNNING |
+                     VIR_DOMAIN_SNAPSHOT_REVERT_PAUSED)) {
+            /* Flush first event, now do transition 2 or 3 */
+            bool paused = (flags & VIR_DOMAIN_SNAPSHOT_REVERT_PAUSED) != 0;
+
+            start_flags |= paused ? VIR_QEMU_PROCESS_START_PAUSED : 0;
+
+            virObjectEventStateQueue(driver->domainEventState, event);
+            rc = qemuProcessStart(snapshot->domain->conn, driver, vm, NULL,
+                                  QEMU_ASYNC_JOB_START, NULL, -1, NULL, NULL,
+                                  VIR_NETDEV_VPORT_PROFILE_OP_CREATE,
+                                  start_flags);
+            virDomainAuditStart(vm, "from-snapshot", rc >= 0);
+            if (rc < 0) {
+                qemuDomainRemoveInactive(driver, vm);
+                qemuProcessEndJob(driver, vm);
+                goto cleanup;
+            }
+            detail = VIR_DOMAIN_EVENT_STARTED_FROM_SNAPSHOT;
+            event = virDomainEventLifecycleNewFromObj(vm,
+                                             VIR_DOMAIN_EVENT_STARTED,
+                                             detail);
+            if (paused) {
+                detail = VIR_DOMAIN_EVENT_SUSPENDED_FROM_SNAPSHOT;
+                event2 = virDomainEventLifecycleNewFromObj(vm,
+                                                  VIR_DOMAIN_EVENT_SUSPENDED,
+                                                  detail);
+            }
+        }
+        break;
+
+    case VIR_DOMAIN_SNAPSHOT_PMSUSPENDED:
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("qemu doesn't support reversion of snapshot taken in "
+                         "PMSUSPENDED state"));
+        goto endjob;
+
+    case VIR_DOMAIN_SNAPSHOT_DISK_SNAPSHOT:
+        /* Rejected earlier as an external snapshot */
+    case VIR_DOMAIN_SNAPSHOT_NOSTATE:
+    case VIR_DOMAIN_SNAPSHOT_BLOCKED:
+    case VIR_DOMAIN_SNAPSHOT_LAST:
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Invalid target domain state '%s'. Refusing "
+                         "snapshot reversion"),
+                       virDomainSnapshotStateTypeToString(snapdef->state));
+        goto endjob;
+    }
+
+    ret = 0;
+
+ endjob:
+    qemuProcessEndJob(driver, vm);
+
+ cleanup:
+    if (ret == 0) {
+        virDomainSnapshotSetCurrent(vm->snapshots, snap);
+        if (qemuDomainSnapshotWriteMetadata(vm, snap,
+                                            driver->xmlopt,
+                                            cfg->snapshotDir) < 0) {
+            virDomainSnapshotSetCurrent(vm->snapshots, NULL);
+            ret = -1;
+        }
+    }
+    if (ret == 0 && defined && vm->persistent &&
+        !(ret = virDomainDefSave(vm->newDef ? vm->newDef : vm->def,
+                                 driver->xmlopt, cfg->configDir))) {
+        detail = VIR_DOMAIN_EVENT_DEFINED_FROM_SNAPSHOT;
+        virObjectEventStateQueue(driver->domainEventState,
+            virDomainEventLifecycleNewFromObj(vm,
+                                              VIR_DOMAIN_EVENT_DEFINED,
+                                              detail));
+    }
+    virObjectEventStateQueue(driver->domainEventState, event);
+    virObjectEventStateQueue(driver->domainEventState, event2);
+    virDomainObjEndAPI(&vm);
+    virNWFilterUnlockFilterUpdates();
+    virCPUDefFree(origCPU);
+    virDomainDefFree(config);
+    virDomainDefFree(inactiveConfig);
+
+    return ret;
+}
+
+
+typedef struct _virQEMUMomentReparent virQEMUMomentReparent;
+typedef virQEMUMomentReparent *virQEMUMomentReparentPtr;
+struct _virQEMUMomentReparent {
+    const char *dir;
+    virDomainMomentObjPtr parent;
+    virDomainObjPtr vm;
+    virDomainXMLOptionPtr xmlopt;
+    int err;
+    int (*writeMetadata)(virDomainObjPtr, virDomainMomentObjPtr,
+                         virDomainXMLOptionPtr, const char *);
+};
+
+
+static int
+qemuDomainMomentReparentChildren(void *payload,
+                                 const void *name G_GNUC_UNUSED,
+                                 void *data)
+{
+    virDomainMomentObjPtr moment = payload;
+    virQEMUMomentReparentPtr rep = data;
+
+    if (rep->err < 0)
+        return 0;
+
+    VIR_FREE(moment->def->parent_name);
+
+    if (rep->parent->def)
+        moment->def->parent_name = g_strdup(rep->parent->def->name);
+
+    rep->err = rep->writeMetadata(rep->vm, moment, rep->xmlopt,
+                                  rep->dir);
+    return 0;
+}
+
+
+static int
+qemuDomainSnapshotDelete(virDomainSnapshotPtr snapshot,
+                         unsigned int flags)
+{
+    virQEMUDriverPtr driver = snapshot->domain->conn->privateData;
+    virDomainObjPtr vm = NULL;
+    int ret = -1;
+    virDomainMomentObjPtr snap = NULL;
+    virQEMUMomentRemove rem;
+    virQEMUMomentReparent rep;
+    bool metadata_only = !!(flags & VIR_DOMAIN_SNAPSHOT_DELETE_METADATA_ONLY);
+    int external = 0;
+    g_autoptr(virQEMUDriverConfig) cfg = NULL;
+
+    virCheckFlags(VIR_DOMAIN_SNAPSHOT_DELETE_CHILDREN |
+                  VIR_DOMAIN_SNAPSHOT_DELETE_METADATA_ONLY |
+                  VIR_DOMAIN_SNAPSHOT_DELETE_CHILDREN_ONLY, -1);
+
+    if (!(vm = qemuDomObjFromSnapshot(snapshot)))
+        return -1;
+
+    cfg = virQEMUDriverGetConfig(driver);
+
+    if (virDomainSnapshotDeleteEnsureACL(snapshot->domain->conn, vm->def) < 0)
+        goto cleanup;
+
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
+        goto cleanup;
+
+    if (!(snap = qemuSnapObjFromSnapshot(vm, snapshot)))
+        goto endjob;
+
+    if (!metadata_only) {
+        if (!(flags & VIR_DOMAIN_SNAPSHOT_DELETE_CHILDREN_ONLY) &&
+            virDomainSnapshotIsExternal(snap))
+            external++;
+        if (flags & (VIR_DOMAIN_SNAPSHOT_DELETE_CHILDREN |
+                     VIR_DOMAIN_SNAPSHOT_DELETE_CHILDREN_ONLY))
+            virDomainMomentForEachDescendant(snap,
+                                             qemuDomainSnapshotCountExternal,
+                                             &external);
+        if (external) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                           _("deletion of %d external disk snapshots not "
+                             "supported yet"), external);
+            goto endjob;
+        }
+    }
+
+    if (flags & (VIR_DOMAIN_SNAPSHOT_DELETE_CHILDREN |
+                 VIR_DOMAIN_SNAPSHOT_DELETE_CHILDREN_ONLY)) {
+        rem.driver = driver;
+        rem.vm = vm;
+        rem.metadata_only = metadata_only;
+        rem.err = 0;
+        rem.current = virDomainSnapshotGetCurrent(vm->snapshots);
+        rem.found = false;
+        rem.momentDiscard = qemuDomainSnapshotDiscard;
+        virDomainMomentForEachDescendant(snap, qemuDomainMomentDiscardAll,
+                                         &rem);
+        if (rem.err < 0)
+            goto endjob;
+        if (rem.found) {
+            virDomainSnapshotSetCurrent(vm->snapshots, snap);
+            if (flags & VIR_DOMAIN_SNAPSHOT_DELETE_CHILDREN_ONLY) {
+                if (qemuDomainSnapshotWriteMetadata(vm, snap,
+                                                    driver->xmlopt,
+                                                    cfg->snapshotDir) < 0) {
+                    virReportError(VIR_ERR_INTERNAL_ERROR,
+                                   _("failed to set snapshot '%s' as current"),
+                                   snap->def->name);
+                    virDomainSnapshotSetCurrent(vm->snapshots, NULL);
+                    goto endjob;
+                }
+            }
+        }
+    } else if (snap->nchildren) {
+        rep.dir = cfg->snapshotDir;
+        rep.parent = snap->parent;
+        rep.vm = vm;
+        rep.err = 0;
+        rep.xmlopt = driver->xmlopt;
+        rep.writeMetadata = qemuDomainSnapshotWriteMetadata;
+        virDomainMomentForEachChild(snap,
+                                    qemuDomainMomentReparentChildren,
+                                    &rep);
+        if (rep.err < 0)
+            goto endjob;
+        virDomainMomentMoveChildren(snap, snap->parent);
+    }
+
+    if (flags & VIR_DOMAIN_SNAPSHOT_DELETE_CHILDREN_ONLY) {
+        virDomainMomentDropChildren(snap);
+        ret = 0;
+    } else {
+        ret = qemuDomainSnapshotDiscard(driver, vm, snap, true, metadata_only);
+    }
+
+ endjob:
+    qemuDomainObjEndJob(driver, vm);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+
+static virDomainCheckpointPtr
+qemuDomainCheckpointCreateXML(virDomainPtr domain,
+                              const char *xmlDesc,
+                              unsigned int flags)
+{
+    virDomainObjPtr vm = NULL;
+    virDomainCheckpointPtr checkpoint = NULL;
+
+    if (!(vm = qemuDomainObjFromDomain(domain)))
+        goto cleanup;
+
+    if (virDomainCheckpointCreateXMLEnsureACL(domain->conn, vm->def, flags) < 0)
+        goto cleanup;
+
+    checkpoint = qemuCheckpointCreateXML(domain, vm, xmlDesc, flags);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return checkpoint;
+}
+
+
+static int
+qemuDomainListAllCheckpoints(virDomainPtr domain,
+                             virDomainCheckpointPtr **chks,
+                             unsigned int flags)
+{
+    virDomainObjPtr vm = NULL;
+    int n = -1;
+
+    virCheckFlags(VIR_DOMAIN_CHECKPOINT_LIST_ROOTS |
+                  VIR_DOMAIN_CHECKPOINT_LIST_TOPOLOGICAL |
+                  VIR_DOMAIN_CHECKPOINT_FILTERS_ALL, -1);
+
+    if (!(vm = qemuDomainObjFromDomain(domain)))
+        return -1;
+
+    if (virDomainListAllCheckpointsEnsureACL(domain->conn, vm->def) < 0)
+        goto cleanup;
+
+    n = virDomainListCheckpoints(vm->checkpoints, NULL, domain, chks, flags);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return n;
+}
+
+
+static int
+qemuDomainCheckpointListAllChildren(virDomainCheckpointPtr checkpoint,
+                                    virDomainCheckpointPtr **chks,
+                                    unsigned int flags)
+{
+    virDomainObjPtr vm = NULL;
+    virDomainMomentObjPtr chk = NULL;
+    int n = -1;
+
+    virCheckFlags(VIR_DOMAIN_CHECKPOINT_LIST_DESCENDANTS |
+                  VIR_DOMAIN_CHECKPOINT_LIST_TOPOLOGICAL |
+                  VIR_DOMAIN_CHECKPOINT_FILTERS_ALL, -1);
+
+    if (!(vm = qemuDomObjFromCheckpoint(checkpoint)))
+        return -1;
+
+    if (virDomainCheckpointListAllChildrenEnsureACL(checkpoint->domain->conn,
+                                                    vm->def) < 0)
+        goto cleanup;
+
+    if (!(chk = qemuCheckpointObjFromCheckpoint(vm, checkpoint)))
+        goto cleanup;
+
+    n = virDomainListCheckpoints(vm->checkpoints, chk, checkpoint->domain,
+                                 chks, flags);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return n;
+}
+
+
+static virDomainCheckpointPtr
+qemuDomainCheckpointLookupByName(virDomainPtr domain,
+                                 const char *name,
+                                 unsigned int flags)
+{
+    virDomainObjPtr vm;
+    virDomainMomentObjPtr chk = NULL;
+    virDomainCheckpointPtr checkpoint = NULL;
+
+    virCheckFlags(0, NULL);
+
+    if (!(vm = qemuDomainObjFromDomain(domain)))
+        return NULL;
+
+    if (virDomainCheckpointLookupByNameEnsureACL(domain->conn, vm->def) < 0)
+        goto cleanup;
+
+    if (!(chk = qemuCheckpointObjFromName(vm, name)))
+        goto cleanup;
+
+    checkpoint = virGetDomainCheckpoint(domain, chk->def->name);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return checkpoint;
+}
+
+
+static virDomainCheckpointPtr
+qemuDomainCheckpointGetParent(virDomainCheckpointPtr checkpoint,
+                              unsigned int flags)
+{
+    virDomainObjPtr vm;
+    virDomainMomentObjPtr chk = NULL;
+    virDomainCheckpointPtr parent = NULL;
+
+    virCheckFlags(0, NULL);
+
+    if (!(vm = qemuDomObjFromCheckpoint(checkpoint)))
+        return NULL;
+
+    if (virDomainCheckpointGetParentEnsureACL(checkpoint->domain->conn, vm->def) < 0)
+        goto cleanup;
+
+    if (!(chk = qemuCheckpointObjFromCheckpoint(vm, checkpoint)))
+        goto cleanup;
+
+    if (!chk->def->parent_name) {
+        virReportError(VIR_ERR_NO_DOMAIN_CHECKPOINT,
+                       _("checkpoint '%s' does not have a parent"),
+                       chk->def->name);
+        goto cleanup;
+    }
+
+    parent = virGetDomainCheckpoint(checkpoint->domain, chk->def->parent_name);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return parent;
+}
+
+
+static char *
+qemuDomainCheckpointGetXMLDesc(virDomainCheckpointPtr checkpoint,
+                               unsigned int flags)
+{
+    virDomainObjPtr vm = NULL;
+    char *xml = NULL;
+
+    if (!(vm = qemuDomObjFromCheckpoint(checkpoint)))
+        return NULL;
+
+    if (virDomainCheckpointGetXMLDescEnsureACL(checkpoint->domain->conn, vm->def, flags) < 0)
+        goto cleanup;
+
+    xml = qemuCheckpointGetXMLDesc(vm, checkpoint, flags);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return xml;
+}
+
+
+static int
+qemuDomainCheckpointDelete(virDomainCheckpointPtr checkpoint,
+                           unsigned int flags)
+{
+    virDomainObjPtr vm = NULL;
+    int ret = -1;
+
+    if (!(vm = qemuDomObjFromCheckpoint(checkpoint)))
+        return -1;
+
+    if (virDomainCheckpointDeleteEnsureACL(checkpoint->domain->conn, vm->def) < 0)
+        goto cleanup;
+
+    ret = qemuCheckpointDelete(vm, checkpoint, flags);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+
+static int
+qemuDomainBackupBegin(virDomainPtr domain,
+                      const char *backupXML,
+                      const char *checkpointXML,
+                      unsigned int flags)
+{
+    virDomainObjPtr vm = NULL;
+    int ret = -1;
+
+    if (!(vm = qemuDomainObjFromDomain(domain)))
+        goto cleanup;
+
+    if (virDomainBackupBeginEnsureACL(domain->conn, vm->def) < 0)
+        goto cleanup;
+
+    ret = qemuBackupBegin(vm, backupXML, checkpointXML, flags);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+
+static char *
+qemuDomainBackupGetXMLDesc(virDomainPtr domain,
+                           unsigned int flags)
+{
+    virDomainObjPtr vm = NULL;
+    char *ret = NULL;
+
+    if (!(vm = qemuDomainObjFromDomain(domain)))
+        return NULL;
+
+    if (virDomainBackupGetXMLDescEnsureACL(domain->conn, vm->def) < 0)
+        goto cleanup;
+
+    ret = qemuBackupGetXMLDesc(vm, flags);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+
+static int qemuDomainQemuMonitorCommand(virDomainPtr domain, const char *cmd,
+                                        char **result, unsigned int flags)
+{
+    virQEMUDriverPtr driver = domain->conn->privateData;
+    virDomainObjPtr vm = NULL;
+    int ret = -1;
+    qemuDomainObjPrivatePtr priv;
+    bool hmp;
+
+    virCheckFlags(VIR_DOMAIN_QEMU_MONITOR_COMMAND_HMP, -1);
+
+    if (!(vm = qemuDomainObjFromDomain(domain)))
+        goto cleanup;
+
+    if (virDomainQemuMonitorCommandEnsureACL(domain->conn, vm->def) < 0)
+        goto cleanup;
+
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) < 0)
+        goto cleanup;
+
+    if (virDomainObjCheckActive(vm) < 0)
+        goto endjob;
+
+    priv = vm->privateData;
+
+    qemuDomainObjTaint(driver, vm, VIR_DOMAIN_TAINT_CUSTOM_MONITOR, NULL);
+
+    hmp = !!(flags & VIR_DOMAIN_QEMU_MONITOR_COMMAND_HMP);
+
+    qemuDomainObjEnterMonitor(driver, vm);
+    ret = qemuMonitorArbitraryCommand(priv->mon, cmd, result, hmp);
+    if (qemuDomainObjExitMonitor(driver, vm) < 0)
+        ret = -1;
+
+ endjob:
+    qemuDomainObjEndJob(driver, vm);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+
+static int
+qemuDomainOpenConsole(virDomainPtr dom,
+                      const char *dev_name,
+                      virStreamPtr st,
+                      unsigned int flags)
+{
+    virDomainObjPtr vm = NULL;
+    int ret = -1;
+    size_t i;
+    virDomainChrDefPtr chr = NULL;
+    qemuDomainObjPrivatePtr priv;
+
+    virCheckFlags(VIR_DOMAIN_CONSOLE_SAFE |
+                  VIR_DOMAIN_CONSOLE_FORCE, -1);
+
+    if (!(vm = qemuDomainObjFromDomain(dom)))
+        goto cleanup;
+
+    if (virDomainOpenConsoleEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
+
+    if (virDomainObjCheckActive(vm) < 0)
+        goto cleanup;
+
+    priv = vm->privateData;
+
+    if (dev_name) {
+        for (i = 0; !chr && i < vm->def->nconsoles; i++) {
+            if (vm->def->consoles[i]->info.alias &&
+                STREQ(dev_name, vm->def->consoles[i]->info.alias))
+                chr = vm->def->consoles[i];
+        }
+        for (i = 0; !chr && i < vm->def->nserials; i++) {
+            if (STREQ(dev_name, vm->def->serials[i]->info.alias))
+                chr = vm->def->serials[i];
+        }
+        for (i = 0; !chr && i < vm->def->nparallels; i++) {
+            if (STREQ(dev_name, vm->def->parallels[i]->info.alias))
+                chr = vm->def->parallels[i];
+        }
+    } else {
+        if (vm->def->nconsoles)
+            chr = vm->def->consoles[0];
+        else if (vm->def->nserials)
+            chr = vm->def->serials[0];
+    }
+
+    if (!chr) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("cannot find character device %s"),
+                       NULLSTR(dev_name));
+        goto cleanup;
+    }
+
+    if (chr->source->type != VIR_DOMAIN_CHR_TYPE_PTY) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("character device %s is not using a PTY"),
+                       dev_name ? dev_name : NULLSTR(chr->info.alias));
+        goto cleanup;
+    }
+
+    /* handle mutually exclusive access to console devices */
+    ret = virChrdevOpen(priv->devs,
+                        chr->source,
+                        st,
+                        (flags & VIR_DOMAIN_CONSOLE_FORCE) != 0);
+
+    if (ret == 1) {
+        virReportError(VIR_ERR_OPERATION_FAILED, "%s",
+                       _("Active console session exists for this domain"));
+        ret = -1;
+    }
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+static int
+qemuDomainOpenChannel(virDomainPtr dom,
+                      const char *name,
+                      virStreamPtr st,
+                      unsigned int flags)
+{
+    virDomainObjPtr vm = NULL;
+    int ret = -1;
+    size_t i;
+    virDomainChrDefPtr chr = NULL;
+    qemuDomainObjPrivatePtr priv;
+
+    virCheckFlags(VIR_DOMAIN_CHANNEL_FORCE, -1);
+
+    if (!(vm = qemuDomainObjFromDomain(dom)))
+        goto cleanup;
+
+    if (virDomainOpenChannelEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
+
+    if (virDomainObjCheckActive(vm) < 0)
+        goto cleanup;
+
+    priv = vm->privateData;
+
+    if (name) {
+        for (i = 0; !chr && i < vm->def->nchannels; i++) {
+            if (STREQ(name, vm->def->channels[i]->info.alias))
+                chr = vm->def->channels[i];
+
+            if (vm->def->channels[i]->targetType == \
+                VIR_DOMAIN_CHR_CHANNEL_TARGET_TYPE_VIRTIO &&
+                STREQ_NULLABLE(name, vm->def->channels[i]->target.name))
+                chr = vm->def->channels[i];
+        }
+    } else {
+        if (vm->def->nchannels)
+            chr = vm->def->channels[0];
+    }
+
+    if (!chr) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("cannot find channel %s"),
+                       NULLSTR(name));
+        goto cleanup;
+    }
+
+    if (chr->source->type != VIR_DOMAIN_CHR_TYPE_UNIX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("channel %s is not using a UNIX socket"),
+                       name ? name : NULLSTR(chr->info.alias));
+        goto cleanup;
+    }
+
+    /* handle mutually exclusive access to channel devices */
+    ret = virChrdevOpen(priv->devs,
+                        chr->source,
+                        st,
+                        (flags & VIR_DOMAIN_CHANNEL_FORCE) != 0);
+
+    if (ret == 1) {
+        virReportError(VIR_ERR_OPERATION_FAILED, "%s",
+                       _("Active channel stream exists for this domain"));
+        ret = -1;
+    }
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+
+/* Called while holding the VM job lock, to implement a block job
+ * abort with pivot; this updates the VM definition as appropriate, on
+ * either success or failure.  */
+static int
+qemuDomainBlockPivot(virQEMUDriverPtr driver,
+                     virDomainObjPtr vm,
+                     qemuBlockJobDataPtr job,
+                     virDomainDiskDefPtr disk)
+{
+    g_autoptr(qemuBlockStorageSourceChainData) chainattachdata = NULL;
+    int ret = -1;
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    bool blockdev = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV);
+    g_autoptr(virJSONValue) bitmapactions = NULL;
+    g_autoptr(virJSONValue) reopenactions = NULL;
+
+    if (job->state != QEMU_BLOCKJOB_STATE_READY) {
+        virReportError(VIR_ERR_BLOCK_COPY_ACTIVE,
+                       _("block job '%s' not ready for pivot yet"),
+                       job->name);
+        return -1;
+    }
+
+    switch ((qemuBlockJobType) job->type) {
+    case QEMU_BLOCKJOB_TYPE_NONE:
+    case QEMU_BLOCKJOB_TYPE_LAST:
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("invalid job type '%d'"), job->type);
+        return -1;
+
+    case QEMU_BLOCKJOB_TYPE_PULL:
+    case QEMU_BLOCKJOB_TYPE_COMMIT:
+    case QEMU_BLOCKJOB_TYPE_BACKUP:
+    case QEMU_BLOCKJOB_TYPE_INTERNAL:
+    case QEMU_BLOCKJOB_TYPE_CREATE:
+    case QEMU_BLOCKJOB_TYPE_BROKEN:
+        virReportError(VIR_ERR_OPERATION_INVALID,
+                       _("job type '%s' does not support pivot"),
+                       qemuBlockjobTypeToString(job->type));
+        return -1;
+
+    case QEMU_BLOCKJOB_TYPE_COPY:
+        if (blockdev && !job->jobflagsmissing) {
+            bool shallow = job->jobflags & VIR_DOMAIN_BLOCK_COPY_SHALLOW;
+            bool reuse = job->jobflags & VIR_DOMAIN_BLOCK_COPY_REUSE_EXT;
+
+            bitmapactions = virJSONValueNewArray();
+
+            if (qemuMonitorTransactionBitmapAdd(bitmapactions,
+                                                disk->mirror->nodeformat,
+                                                "libvirt-tmp-activewrite",
+                                                false,
+                                                false,
+                                                0) < 0)
+                return -1;
+
+            /* Open and install the backing chain of 'mirror' late if we can use
+             * blockdev-snapshot to do it. This is to appease oVirt that wants
+             * to copy data into the backing chain while the top image is being
+             * copied shallow */
+            if (reuse && shallow &&
+                virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV_SNAPSHOT_ALLOW_WRITE_ONLY) &&
+                virStorageSourceHasBacking(disk->mirror)) {
+
+                if (!(chainattachdata = qemuBuildStorageSourceChainAttachPrepareBlockdev(disk->mirror->backingStore,
+                                                                                         priv->qemuCaps)))
+                    return -1;
+
+                reopenactions = virJSONValueNewArray();
+
+                if (qemuMonitorTransactionSnapshotBlockdev(reopenactions,
+                                                           disk->mirror->backingStore->nodeformat,
+                                                           disk->mirror->nodeformat))
+                    return -1;
+            }
+
+        }
+        break;
+
+    case QEMU_BLOCKJOB_TYPE_ACTIVE_COMMIT:
+        if (blockdev) {
+            bitmapactions = virJSONValueNewArray();
+
+            if (qemuMonitorTransactionBitmapAdd(bitmapactions,
+                                                job->data.commit.base->nodeformat,
+                                                "libvirt-tmp-activewrite",
+                                                false,
+                                                false,
+                                                0) < 0)
+                return -1;
+        }
+
+        break;
+    }
+
+    qemuDomainObjEnterMonitor(driver, vm);
+    if (blockdev) {
+        int rc = 0;
+
+        if (chainattachdata) {
+            if ((rc = qemuBlockStorageSourceChainAttach(priv->mon, chainattachdata)) == 0) {
+                /* install backing images on success, or unplug them on failure */
+                if ((rc = qemuMonitorTransaction(priv->mon, &reopenactions)) != 0)
+                    qemuBlockStorageSourceChainDetach(priv->mon, chainattachdata);
+            }
+        }
+
+        if (bitmapactions && rc == 0)
+            ignore_value(qemuMonitorTransaction(priv->mon, &bitmapactions));
+
+        if (rc == 0)
+            ret = qemuMonitorJobComplete(priv->mon, job->name);
+    } else {
+        ret = qemuMonitorDrivePivot(priv->mon, job->name);
+    }
+    if (qemuDomainObjExitMonitor(driver, vm) < 0)
+        return -1;
+
+    /* The pivot failed. The block job in QEMU remains in the synchronised state */
+    if (ret < 0)
+        return -1;
+
+    if (disk && disk->mirror)
+        disk->mirrorState = VIR_DOMAIN_DISK_MIRROR_STATE_PIVOT;
+    job->state = QEMU_BLOCKJOB_STATE_PIVOTING;
+
+    return ret;
+}
+
+
+/* bandwidth in MiB/s per public API. Caller must lock vm beforehand,
+ * and not access it afterwards.  */
+static int
+qemuDomainBlockPullCommon(virDomainObjPtr vm,
+                          const char *path,
+                          const char *base,
+                          unsigned long bandwidth,
+                          unsigned int flags)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virQEMUDriverPtr driver = priv->driver;
+    const char *device = NULL;
+    const char *jobname = NULL;
+    virDomainDiskDefPtr disk;
+    virStorageSourcePtr baseSource = NULL;
+    unsigned int baseIndex = 0;
+    g_autofree char *basePath = NULL;
+    g_autofree char *backingPath = NULL;
+    unsigned long long speed = bandwidth;
+    qemuBlockJobDataPtr job = NULL;
+    bool persistjob = false;
+    const char *nodebase = NULL;
+    bool blockdev = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV);
+    int ret = -1;
+
+    if (flags & VIR_DOMAIN_BLOCK_REBASE_RELATIVE && !base) {
+        virReportError(VIR_ERR_INVALID_ARG, "%s",
+                       _("flag VIR_DOMAIN_BLOCK_REBASE_RELATIVE is valid only "
+                         "with non-null base"));
+        goto cleanup;
+    }
+
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
+        goto cleanup;
+
+    if (virDomainObjCheckActive(vm) < 0)
+        goto endjob;
+
+    if (qemuDomainSupportsCheckpointsBlockjobs(vm) < 0)
+        goto endjob;
+
+    if (!(disk = qemuDomainDiskByName(vm->def, path)))
+        goto endjob;
+
+    if (qemuDomainDiskBlockJobIsActive(disk))
+        goto endjob;
+
+    if (!qemuDomainDiskBlockJobIsSupported(vm, disk))
+        goto endjob;
+
+    if (base &&
+        (virStorageFileParseChainIndex(disk->dst, base, &baseIndex) < 0 ||
+         !(baseSource = virStorageFileChainLookup(disk->src, disk->src,
+                                                  base, baseIndex, NULL))))
+        goto endjob;
+
+    if (baseSource) {
+        if (flags & VIR_DOMAIN_BLOCK_REBASE_RELATIVE) {
+            if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_CHANGE_BACKING_FILE)) {
+                virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                               _("this QEMU binary doesn't support relative "
+                                 "block pull/rebase"));
+                goto endjob;
+            }
+
+            if (blockdev &&
+                qemuBlockUpdateRelativeBacking(vm, disk->src, disk->src) < 0)
+                goto endjob;
+
+            if (virStorageFileGetRelativeBackingPath(disk->src->backingStore,
+                                                     baseSource,
+                                                     &backingPath) < 0)
+                goto endjob;
+
+            if (!backingPath) {
+                virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                               _("can't keep relative backing relationship"));
+                goto endjob;
+            }
+        }
+    }
+
+    /* Convert bandwidth MiB to bytes, if needed */
+    if (!(flags & VIR_DOMAIN_BLOCK_PULL_BANDWIDTH_BYTES)) {
+        if (speed > LLONG_MAX >> 20) {
+            virReportError(VIR_ERR_OVERFLOW,
+                           _("bandwidth must be less than %llu"),
+                           LLONG_MAX >> 20);
+            goto endjob;
+        }
+        speed <<= 20;
+    }
+
+    if (!(job = qemuBlockJobDiskNewPull(vm, disk, baseSource, flags)))
+        goto endjob;
+
+    if (blockdev) {
+        jobname = job->name;
+        persistjob = true;
+        if (baseSource) {
+            nodebase = baseSource->nodeformat;
+            if (!backingPath &&
+                !(backingPath = qemuBlockGetBackingStoreString(baseSource, false)))
+                goto endjob;
+        }
+        device = disk->src->nodeformat;
+    } else {
+        device = job->name;
+    }
+
+    qemuDomainObjEnterMonitor(driver, vm);
+    if (!blockdev && baseSource)
+        basePath = qemuMonitorDiskNameLookup(priv->mon, device, disk->src,
+                                             baseSource);
+
+    if (blockdev ||
+        (!baseSource || basePath))
+        ret = qemuMonitorBlockStream(priv->mon, device, jobname, persistjob, basePath,
+                                     nodebase, backingPath, speed);
+    if (qemuDomainObjExitMonitor(driver, vm) < 0)
+        ret = -1;
+
+    if (ret < 0)
+        goto endjob;
+
+    qemuBlockJobStarted(job, vm);
+
+ endjob:
+    qemuDomainObjEndJob(driver, vm);
+
+ cleanup:
+    qemuBlockJobStartupFinalize(vm, job);
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+
+static int
+qemuDomainBlockJobAbort(virDomainPtr dom,
+                        const char *path,
+                        unsigned int flags)
+{
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainDiskDefPtr disk = NULL;
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    bool pivot = !!(flags & VIR_DOMAIN_BLOCK_JOB_ABORT_PIVOT);
+    bool async = !!(flags & VIR_DOMAIN_BLOCK_JOB_ABORT_ASYNC);
+    g_autoptr(qemuBlockJobData) job = NULL;
+    virDomainObjPtr vm;
+    qemuDomainObjPrivatePtr priv = NULL;
+    bool blockdev = false;
+    int ret = -1;
+
+    virCheckFlags(VIR_DOMAIN_BLOCK_JOB_ABORT_ASYNC |
+                  VIR_DOMAIN_BLOCK_JOB_ABORT_PIVOT, -1);
+
+    if (!(vm = qemuDomainObjFromDomain(dom)))
+        return -1;
+
+    if (virDomainBlockJobAbortEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
+
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
+        goto cleanup;
+
+    if (virDomainObjCheckActive(vm) < 0)
+        goto endjob;
+
+    if (!(disk = qemuDomainDiskByName(vm->def, path)))
+        goto endjob;
+
+    if (!(job = qemuBlockJobDiskGetJob(disk))) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("disk %s does not have an active block job"), disk->dst);
+        goto endjob;
+    }
+
+    priv = vm->privateData;
+    blockdev = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV);
+
+    if (job->state == QEMU_BLOCKJOB_STATE_ABORTING ||
+        job->state == QEMU_BLOCKJOB_STATE_PIVOTING) {
+        virReportError(VIR_ERR_OPERATION_INVALID,
+                       _("block job on disk '%s' is still being ended"),
+                       disk->dst);
+        goto endjob;
+    }
+
+    if (!async)
+        qemuBlockJobSyncBegin(job);
+
+    if (pivot) {
+        if ((ret = qemuDomainBlockPivot(driver, vm, job, disk)) < 0)
+            goto endjob;
+    } else {
+        qemuDomainObjEnterMonitor(driver, vm);
+        if (blockdev)
+            ret = qemuMonitorJobCancel(priv->mon, job->name, false);
+        else
+            ret = qemuMonitorBlockJobCancel(priv->mon, job->name);
+        if (qemuDomainObjExitMonitor(driver, vm) < 0) {
+            ret = -1;
+            goto endjob;
+        }
+
+        if (ret < 0)
+            goto endjob;
+
+        if (disk->mirror)
+            disk->mirrorState = VIR_DOMAIN_DISK_MIRROR_STATE_ABORT;
+        job->state = QEMU_BLOCKJOB_STATE_ABORTING;
+    }
+
+    ignore_value(virDomainObjSave(vm, driver->xmlopt, cfg->stateDir));
+
+    if (!async) {
+        qemuBlockJobUpdate(vm, job, QEMU_ASYNC_JOB_NONE);
+        while (qemuBlockJobIsRunning(job)) {
+            if (virDomainObjWait(vm) < 0) {
+                ret = -1;
+                goto endjob;
+            }
+            qemuBlockJobUpdate(vm, job, QEMU_ASYNC_JOB_NONE);
+        }
+
+        if (pivot &&
+            job->state == QEMU_BLOCKJOB_STATE_FAILED) {
+            if (job->errmsg) {
+                virReportError(VIR_ERR_OPERATION_FAILED,
+                               _("block job '%s' failed while pivoting"),
+                               job->name);
+            } else {
+                virReportError(VIR_ERR_OPERATION_FAILED,
+                               _("block job '%s' failed while pivoting: %s"),
+                               job->name, job->errmsg);
+            }
+
+            ret = -1;
+            goto endjob;
+        }
+    }
+
+ endjob:
+    if (job && !async)
+        qemuBlockJobSyncEnd(vm, job, QEMU_ASYNC_JOB_NONE);
+    qemuDomainObjEndJob(driver, vm);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+
+static int
+qemuBlockJobInfoTranslate(qemuMonitorBlockJobInfoPtr rawInfo,
+                          virDomainBlockJobInfoPtr info,
+                          virDomainDiskDefPtr disk,
+                          bool reportBytes)
+{
+    info->cur = rawInfo->cur;
+    info->end = rawInfo->end;
+
+    /* Fix job completeness reporting. If cur == end mgmt
+     * applications think job is completed. Except when both cur
+     * and end are zero, in which case qemu hasn't started the
+     * job yet. */
+    if (!info->cur && !info->end) {
+        if (rawInfo->ready > 0) {
+            info->cur = info->end = 1;
+        } else if (!rawInfo->ready) {
+            info->end = 1;
+        }
+    }
+
+    /* If qemu reports that it's not ready yet don't make the job go to
+     * cur == end as some apps wrote code polling this instead of waiting for
+     * the ready event */
+    if (rawInfo->ready == 0 &&
+        info->cur == info->end &&
+        info->cur > 0)
+        info->cur -= 1;
+
+    info->type = rawInfo->type;
+    if (info->type == VIR_DOMAIN_BLOCK_JOB_TYPE_COMMIT &&
+        disk->mirrorJob == VIR_DOMAIN_BLOCK_JOB_TYPE_ACTIVE_COMMIT)
+        info->type = disk->mirrorJob;
+
+    if (rawInfo->bandwidth && !reportBytes)
+        rawInfo->bandwidth = VIR_DIV_UP(rawInfo->bandwidth, 1024 * 1024);
+    info->bandwidth = rawInfo->bandwidth;
+    if (info->bandwidth != rawInfo->bandwidth) {
+        virReportError(VIR_ERR_OVERFLOW,
+                       _("bandwidth %llu cannot be represented in result"),
+                       rawInfo->bandwidth);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+qemuDomainGetBlockJobInfo(virDomainPtr dom,
+                          const char *path,
+                          virDomainBlockJobInfoPtr info,
+                          unsigned int flags)
+{
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainObjPtr vm;
+    virDomainDiskDefPtr disk;
+    int ret = -1;
+    qemuMonitorBlockJobInfo rawInfo;
+    g_autoptr(qemuBlockJobData) job = NULL;
+
+    virCheckFlags(VIR_DOMAIN_BLOCK_JOB_INFO_BANDWIDTH_BYTES, -1);
+
+    if (!(vm = qemuDomainObjFromDomain(dom)))
+        return -1;
+
+    if (virDomainGetBlockJobInfoEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
+
+
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) < 0)
+        goto cleanup;
+
+    if (virDomainObjCheckActive(vm) < 0)
+        goto endjob;
+
+    if (!(disk = qemuDomainDiskByName(vm->def, path)))
+        goto endjob;
+
+    if (!(job = qemuBlockJobDiskGetJob(disk))) {
+        ret = 0;
+        goto endjob;
+    }
+
+    qemuDomainObjEnterMonitor(driver, vm);
+    ret = qemuMonitorGetBlockJobInfo(qemuDomainGetMonitor(vm), job->name, &rawInfo);
+    if (qemuDomainObjExitMonitor(driver, vm) < 0)
+        ret = -1;
+    if (ret <= 0)
+        goto endjob;
+
+    if (qemuBlockJobInfoTranslate(&rawInfo, info, disk,
+                                  flags & VIR_DOMAIN_BLOCK_JOB_INFO_BANDWIDTH_BYTES) < 0) {
+        ret = -1;
+        goto endjob;
+    }
+
+ endjob:
+    qemuDomainObjEndJob(driver, vm);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+
+static int
+qemuDomainBlockJobSetSpeed(virDomainPtr dom,
+                           const char *path,
+                           unsigned long bandwidth,
+                           unsigned int flags)
+{
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainDiskDefPtr disk;
+    int ret = -1;
+    virDomainObjPtr vm;
+    unsigned long long speed = bandwidth;
+    unsigned long long curspeed;
+    g_autoptr(qemuBlockJobData) job = NULL;
+
+    virCheckFlags(VIR_DOMAIN_BLOCK_JOB_SPEED_BANDWIDTH_BYTES |
+                  VIR_DOMAIN_BLOCK_JOB_SPEED_ADAPTIVE, -1);
+
+    /* Convert bandwidth MiB to bytes, if needed */
+    if (!(flags & VIR_DOMAIN_BLOCK_JOB_SPEED_BANDWIDTH_BYTES)) {
+        if (speed > LLONG_MAX >> 20) {
+            virReportError(VIR_ERR_OVERFLOW,
+                           _("bandwidth must be less than %llu"),
+                           LLONG_MAX >> 20);
+            return -1;
+        }
+        speed <<= 20;
+    }
+    curspeed = speed;
+
+    if (!(vm = qemuDomainObjFromDomain(dom)))
+        return -1;
+
+    if (virDomainBlockJobSetSpeedEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
+
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
+        goto cleanup;
+
+    if (virDomainObjCheckActive(vm) < 0)
+        goto endjob;
+
+    if (!(disk = qemuDomainDiskByName(vm->def, path)))
+        goto endjob;
+
+    if (!(job = qemuBlockJobDiskGetJob(disk))) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("disk %s does not have an active block job"), disk->dst);
+        goto endjob;
+    }
+
+    /* with adaptive speed @speed is the upper bound, the speed itself is
+     * adjusted periodically by qemuBlockJobAutotune */
+    if (flags & VIR_DOMAIN_BLOCK_JOB_SPEED_ADAPTIVE) {
+        g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+
+        if (cfg->blockJobAutotuneInterval == 0) {
+            virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                           _("block job autotuning is disabled in qemu.conf"));
+            goto endjob;
+        }
+
+        curspeed = qemuBlockJobAutotuneStartSpeed(speed);
+    }
+
+    qemuDomainObjEnterMonitor(driver, vm);
+    ret = qemuMonitorBlockJobSetSpeed(qemuDomainGetMonitor(vm),
+                                      job->name,
+                                      curspeed);
+    if (qemuDomainObjExitMonitor(driver, vm) < 0)
+        ret = -1;
+
+    if (ret == 0) {
+        job->autotune.enabled = !!(flags & VIR_DOMAIN_BLOCK_JOB_SPEED_ADAPTIVE);
+        job->autotune.max = speed;
+        job->autotune.speed = curspeed;
+        job->autotune.sampled = false;
+        qemuDomainSaveStatus(vm);
+    }
+
+ endjob:
+    qemuDomainObjEndJob(driver, vm);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+
+    return ret;
+}
+
+
+static int
+qemuDomainBlockCopyValidateMirror(virStorageSourcePtr mirror,
+                                  const char *dst,
+                                  bool *reuse)
+{
+    int desttype = virStorageSourceGetActualType(mirror);
+    struct stat st;
+
+    if (!virStorageSourceIsLocalStorage(mirror))
+        return 0;
+
+    if (virStorageFileAccess(mirror, F_OK) < 0) {
+        if (errno != ENOENT) {
+            virReportSystemError(errno, "%s",
+                                 _("unable to verify existence of "
+                                   "block copy target"));
+            return -1;
+        }
+
+        if (*reuse || desttype == VIR_STORAGE_TYPE_BLOCK) {
+            virReportSystemError(errno,
+                                 _("missing destination file for disk %s: %s"),
+                                 dst, mirror->path);
+            return -1;
+        }
+    } else {
+        if (virStorageFileStat(mirror, &st) < 0) {
+            virReportSystemError(errno,
+                                 _("unable to stat block copy target '%s'"),
+                                 mirror->path);
+            return -1;
+        }
+
+        if (S_ISBLK(st.st_mode)) {
+            /* if the target is a block device, assume that we are reusing it,
+             * so there are no attempts to create it */
+            *reuse = true;
+        } else {
+            if (st.st_size && !(*reuse)) {
+                virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                               _("external destination file for disk %s already "
+                                 "exists and is not a block device: %s"),
+                               dst, mirror->path);
+                return -1;
+            }
+
+            if (desttype == VIR_STORAGE_TYPE_BLOCK) {
+                virReportError(VIR_ERR_INVALID_ARG,
+                               _("blockdev flag requested for disk %s, but file "
+                                 "'%s' is not a block device"),
+                               dst, mirror->path);
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * qemuDomainBlockCopyCommonValidateUserMirrorBackingStore:
+ * @mirror: target of the block copy
+ * @flags: block copy API flags
+ * @blockdev: true if blockdev is used for the VM
+ *
+ * Validates whether backingStore of @mirror makes sense according to @flags.
+ * This makes sure that:
+ * 1) mirror has a terminator if it isn't supposed to have backing chain
+ * 2) if shallow copy is requested there is a chain or prepopulated image
+ * 3) user specified chain is present only when blockdev is used
+ * 4) if deep copy is requested, there's no chain
+ */
+static int
+qemuDomainBlockCopyCommonValidateUserMirrorBackingStore(virStorageSourcePtr mirror,
+                                                        bool shallow,
+                                                        bool blockdev)
+{
+    if (!virStorageSourceHasBacking(mirror)) {
+        /* for deep copy there won't be backing chain so we can terminate it */
+        if (!mirror->backingStore &&
+            !shallow &&
+            !(mirror->backingStore = virStorageSourceNew()))
+            return -1;
+
+        /* When reusing an external image we document that the user must ensure
+         * that the <mirror> image must expose data as the original image did
+         * either by providing correct chain or prepopulating the image. This
+         * means we can't validate this any more regardless of whether shallow
+         * copy is requested.
+         *
+         * For a copy when we are not reusing external image requesting shallow
+         * is okay and will inherit the original backing chain */
+    } else {
+        if (!blockdev) {
+            virReportError(VIR_ERR_INVALID_ARG, "%s",
+                           _("backingStore of mirror target is not supported by this qemu"));
+            return -1;
+        }
+
+        if (!shallow) {
+            virReportError(VIR_ERR_INVALID_ARG, "%s",
+                           _("backingStore of mirror without VIR_DOMAIN_BLOCK_COPY_SHALLOW doesn't make sense"));
+            return -1;
+        }
+
+        if (qemuDomainStorageSourceValidateDepth(mirror, 0, NULL) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/* bandwidth in bytes/s.  Caller must lock vm beforehand, and not
+ * access mirror afterwards.  */
+static int
+qemuDomainBlockCopyCommon(virDomainObjPtr vm,
+                          virConnectPtr conn,
+                          const char *path,
+                          virStorageSourcePtr mirrorsrc,
+                          unsigned long long bandwidth,
+                          unsigned int granularity,
+                          unsigned long long buf_size,
+                          unsigned int flags,
+                          bool keepParentLabel)
+{
+    virQEMUDriverPtr driver = conn->privateData;
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virDomainDiskDefPtr disk = NULL;
+    int ret = -1;
+    bool need_unlink = false;
+    bool need_revoke = false;
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    const char *format = NULL;
+    bool mirror_reuse = !!(flags & VIR_DOMAIN_BLOCK_COPY_REUSE_EXT);
+    bool mirror_shallow = !!(flags & VIR_DOMAIN_BLOCK_COPY_SHALLOW);
+    bool existing = mirror_reuse;
+    qemuBlockJobDataPtr job = NULL;
+    g_autoptr(virStorageSource) mirror = mirrorsrc;
+    bool blockdev = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV);
+    bool supports_create = false;
+    bool supports_access = false;
+    bool supports_detect = false;
+    g_autoptr(qemuBlockStorageSourceChainData) data = NULL;
+    g_autoptr(qemuBlockStorageSourceChainData) crdata = NULL;
+    virStorageSourcePtr n;
+    virStorageSourcePtr mirrorBacking = NULL;
+    g_autoptr(virHashTable) blockNamedNodeData = NULL;
+    int rc = 0;
+
+    /* Preliminaries: find the disk we are editing, sanity checks */
+    virCheckFlags(VIR_DOMAIN_BLOCK_COPY_SHALLOW |
+                  VIR_DOMAIN_BLOCK_COPY_REUSE_EXT |
+                  VIR_DOMAIN_BLOCK_COPY_TRANSIENT_JOB, -1);
+
+    if (virStorageSourceIsRelative(mirror)) {
+        virReportError(VIR_ERR_INVALID_ARG, "%s",
+                       _("absolute path must be used as block copy target"));
+        return -1;
+    }
+
+    if (bandwidth > LLONG_MAX) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("bandwidth must be less than "
+                         "'%llu' bytes/s (%llu MiB/s)"),
+                       LLONG_MAX, LLONG_MAX >> 20);
+        return -1;
+    }
+
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
+        return -1;
+
+    if (virDomainObjCheckActive(vm) < 0)
+        goto endjob;
+
+    if (qemuDomainSupportsCheckpointsBlockjobs(vm) < 0)
+        goto endjob;
+
+    if (!(disk = qemuDomainDiskByName(vm->def, path)))
+        goto endjob;
+
+    if (qemuDomainDiskBlockJobIsActive(disk))
+        goto endjob;
+
+    if (!qemuDomainDiskBlockJobIsSupported(vm, disk))
+        goto endjob;
+
+    if (disk->device == VIR_DOMAIN_DISK_DEVICE_LUN &&
+        qemuDomainDefValidateDiskLunSource(mirror) < 0)
+        goto endjob;
+
+    if (!(flags & VIR_DOMAIN_BLOCK_COPY_TRANSIENT_JOB) &&
+        vm->persistent) {
+        /* XXX if qemu ever lets us start a new domain with mirroring
+         * already active, we can relax this; but for now, the risk of
+         * 'managedsave' due to libvirt-guests means we can't risk
+         * this on persistent domains.  */
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("domain is not transient"));
+        goto endjob;
+    }
+
+    /* clear the _SHALLOW flag if there is only one layer */
+    if (!virStorageSourceHasBacking(disk->src)) {
+        flags &= ~VIR_DOMAIN_BLOCK_COPY_SHALLOW;
+        mirror_shallow = false;
+    }
+
+    if (qemuDomainBlockCopyCommonValidateUserMirrorBackingStore(mirror,
+                                                                mirror_shallow,
+                                                                blockdev) < 0)
+        goto endjob;
+
+    /* unless the user provides a pre-created file, shallow copy into a raw
+     * file is not possible */
+    if (mirror_shallow && !existing && mirror->format == VIR_STORAGE_FILE_RAW) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                       _("shallow copy of disk '%s' into a raw file "
+                         "is not possible"),
+                       disk->dst);
+        goto endjob;
+    }
+
+    /* Prepare the destination file.  */
+    if (!blockdev &&
+        !virStorageSourceIsLocalStorage(mirror)) {
+        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED, "%s",
+                       _("non-file destination not supported yet"));
+        goto endjob;
+    }
+
+    supports_access = virStorageFileSupportsAccess(mirror) == 1;
+    supports_create = virStorageFileSupportsCreate(mirror) == 1;
+    supports_detect = virStorageFileSupportsBackingChainTraversal(mirror) == 1;
+
+    if (supports_access || supports_create || supports_detect) {
+        if (qemuDomainStorageFileInit(driver, vm, mirror, NULL) < 0)
+            goto endjob;
+    }
+
+    if (supports_access &&
+        qemuDomainBlockCopyValidateMirror(mirror, disk->dst, &existing) < 0)
+        goto endjob;
+
+    if (!mirror->format) {
+        if (!mirror_reuse) {
+            mirror->format = disk->src->format;
+        } else {
+            /* If the user passed the REUSE_EXT flag, then either they
+             * can also pass the RAW flag or use XML to tell us the format.
+             * So if we get here, we assume it is safe for us to probe the
+             * format from the file that we will be using.  */
+            if (!supports_detect ||
+                !virStorageSourceIsLocalStorage(mirror) ||
+                (mirror->format = virStorageFileProbeFormat(mirror->path, cfg->user,
+                                                            cfg->group)) < 0) {
+                virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                               _("reused mirror destination format must be specified"));
+                goto endjob;
+            }
+        }
+    }
+
+    /* When copying a shareable disk we need to make sure that the disk can
+     * be safely shared, since block copy may change the format. */
+    if (disk->src->shared && !disk->src->readonly &&
+        !qemuBlockStorageSourceSupportsConcurrentAccess(mirror)) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("can't pivot a shared disk to a storage volume not "
+                         "supporting sharing"));
+        goto endjob;
+    }
+
+    /* pre-create the image file. In case when 'blockdev' is used this is
+     * required so that libvirt can properly label the image for access by qemu */
+    if (!existing) {
+        if (supports_create) {
+            if (virStorageFileCreate(mirror) < 0) {
+                virReportSystemError(errno, "%s", _("failed to create copy target"));
+                goto endjob;
+            }
+
+            need_unlink = true;
+        }
+    }
+
+    if (mirror->format > 0)
+        format = virStorageFileFormatTypeToString(mirror->format);
+
+    if (virStorageSourceInitChainElement(mirror, disk->src,
+                                         keepParentLabel) < 0)
+        goto endjob;
+
+    if (mirror->readonly) {
+        if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV_REOPEN)) {
+            virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                           _("copy of read-only disks is not supported"));
+            goto endjob;
+        }
+        mirror->readonly = false;
+    }
+
+    /* we must initialize XML-provided chain prior to detecting to keep semantics
+     * with VM startup */
+    if (blockdev) {
+        for (n = mirror; virStorageSourceIsBacking(n); n = n->backingStore) {
+            if (qemuDomainPrepareStorageSourceBlockdev(disk, n, priv, cfg) < 0)
+                goto endjob;
+        }
+    }
+
+    /* If reusing an external image that includes a backing file but the user
+     * did not enumerate the chain in the XML we need to detect the chain */
+    if (mirror_reuse &&
+        mirror->format >= VIR_STORAGE_FILE_BACKING &&
+        mirror->backingStore == NULL &&
+        qemuDomainDetermineDiskChain(driver, vm, disk, mirror, true) < 0)
+        goto endjob;
+
+    if (qemuDomainStorageSourceChainAccessAllow(driver, vm, mirror) < 0)
+        goto endjob;
+    need_revoke = true;
+
+    if (blockdev) {
+        if (mirror_reuse) {
+            /* oVirt depended on late-backing-chain-opening semantics the old
+             * qemu command had to copy the backing chain data while the top
+             * level is being copied. To restore this semantics if
+             * blockdev-reopen is supported defer opening of the backing chain
+             * of 'mirror' to the pivot step */
+            if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV_SNAPSHOT_ALLOW_WRITE_ONLY)) {
+                g_autoptr(virStorageSource) terminator = virStorageSourceNew();
+
+                if (!terminator)
+                    goto endjob;
+
+                if (!(data = qemuBuildStorageSourceChainAttachPrepareBlockdevTop(mirror,
+                                                                                 terminator,
+                                                                                 priv->qemuCaps)))
+                    goto endjob;
+            } else {
+                if (!(data = qemuBuildStorageSourceChainAttachPrepareBlockdev(mirror,
+                                                                              priv->qemuCaps)))
+                    goto endjob;
+            }
+        } else {
+            if (!(blockNamedNodeData = qemuBlockGetNamedNodeData(vm, QEMU_ASYNC_JOB_NONE)))
+                goto endjob;
+
+            if (qemuBlockStorageSourceCreateDetectSize(blockNamedNodeData,
+                                                       mirror, disk->src))
+                goto endjob;
+
+            if (mirror_shallow) {
+                /* if external backing store is populated we'll need to open it */
+                if (virStorageSourceHasBacking(mirror)) {
+                    if (!(data = qemuBuildStorageSourceChainAttachPrepareBlockdev(mirror->backingStore,
+                                                                                  priv->qemuCaps)))
+                        goto endjob;
+
+                    mirrorBacking = mirror->backingStore;
+                } else {
+                    /* backing store of original image will be reused, but the
+                     * new image must refer to it in the metadata */
+                    mirrorBacking = disk->src->backingStore;
+                }
+            } else {
+                mirrorBacking = mirror->backingStore;
+            }
+
+            if (!(crdata = qemuBuildStorageSourceChainAttachPrepareBlockdevTop(mirror,
+                                                                               mirrorBacking,
+                                                                               priv->qemuCaps)))
+                goto endjob;
+        }
+
+        if (data) {
+            qemuDomainObjEnterMonitor(driver, vm);
+            rc = qemuBlockStorageSourceChainAttach(priv->mon, data);
+            if (qemuDomainObjExitMonitor(driver, vm) < 0)
+                goto endjob;
+
+            if (rc < 0)
+                goto endjob;
+        }
+
+        if (crdata &&
+            qemuBlockStorageSourceCreate(vm, mirror, mirrorBacking, mirror->backingStore,
+                                         crdata->srcdata[0], QEMU_ASYNC_JOB_NONE) < 0)
+            goto endjob;
+    }
+
+    if (!(job = qemuBlockJobDiskNewCopy(vm, disk, mirror, mirror_shallow, mirror_reuse, flags)))
+        goto endjob;
+
+    disk->mirrorState = VIR_DOMAIN_DISK_MIRROR_STATE_NONE;
+
+    /* Actually start the mirroring */
+    qemuDomainObjEnterMonitor(driver, vm);
+
+    if (blockdev) {
+        ret = qemuMonitorBlockdevMirror(priv->mon, job->name, true,
+                                        qemuDomainDiskGetTopNodename(disk),
+                                        mirror->nodeformat, bandwidth,
+                                        granularity, buf_size, mirror_shallow);
+    } else {
+        /* qemuMonitorDriveMirror needs to honor the REUSE_EXT flag as specified
+         * by the user */
+        ret = qemuMonitorDriveMirror(priv->mon, job->name, mirror->path, format,
+                                     bandwidth, granularity, buf_size,
+                                     mirror_shallow, mirror_reuse);
+    }
+
+    virDomainAuditDisk(vm, NULL, mirror, "mirror", ret >= 0);
+    if (qemuDomainObjExitMonitor(driver, vm) < 0)
+        ret = -1;
+    if (ret < 0) {
+        qemuDomainStorageSourceChainAccessRevoke(driver, vm, mirror);
+        goto endjob;
+    }
+
+    /* Update vm in place to match changes.  */
+    need_unlink = false;
+    virStorageFileDeinit(mirror);
+    disk->mirror = g_steal_pointer(&mirror);
+    disk->mirrorJob = VIR_DOMAIN_BLOCK_JOB_TYPE_COPY;
+    qemuBlockJobStarted(job, vm);
+
+ endjob:
+    if (ret < 0 &&
+        virDomainObjIsActive(vm)) {
+        if (data || crdata) {
+            qemuDomainObjEnterMonitor(driver, vm);
+            if (data)
+                qemuBlockStorageSourceChainDetach(priv->mon, data);
+            if (crdata)
+                qemuBlockStorageSourceAttachRollback(priv->mon, crdata->srcdata[0]);
+            ignore_value(qemuDomainObjExitMonitor(driver, vm));
+        }
+        if (need_revoke)
+            qemuDomainStorageSourceChainAccessRevoke(driver, vm, mirror);
+    }
+    if (need_unlink && virStorageFileUnlink(mirror) < 0)
+        VIR_WARN("%s", _("unable to remove just-created copy target"));
+    virStorageFileDeinit(mirror);
+    qemuDomainObjEndJob(driver, vm);
+    qemuBlockJobStartupFinalize(vm, job);
+
+    return ret;
+}
+
+static int
+qemuDomainBlockRebase(virDomainPtr dom, const char *path, const char *base,
+                      unsigned long bandwidth, unsigned int flags)
+{
+    virDomainObjPtr vm;
+    int ret = -1;
+    unsigned long long speed = bandwidth;
+    g_autoptr(virStorageSource) dest = NULL;
+
+    virCheckFlags(VIR_DOMAIN_BLOCK_REBASE_SHALLOW |
+                  VIR_DOMAIN_BLOCK_REBASE_REUSE_EXT |
+                  VIR_DOMAIN_BLOCK_REBASE_COPY |
+                  VIR_DOMAIN_BLOCK_REBASE_COPY_RAW |
+                  VIR_DOMAIN_BLOCK_REBASE_RELATIVE |
+                  VIR_DOMAIN_BLOCK_REBASE_COPY_DEV |
+                  VIR_DOMAIN_BLOCK_REBASE_BANDWIDTH_BYTES, -1);
+
+    if (!(vm = qemuDomainObjFromDomain(dom)))
+        return -1;
+
+    if (virDomainBlockRebaseEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
+
+    /* For normal rebase (enhanced blockpull), the common code handles
+     * everything, including vm cleanup. */
+    if (!(flags & VIR_DOMAIN_BLOCK_REBASE_COPY))
+        return qemuDomainBlockPullCommon(vm, path, base, bandwidth, flags);
+
+    /* If we got here, we are doing a block copy rebase. */
+    if (!(dest = virStorageSourceNew()))
+        goto cleanup;
+    dest->type = (flags & VIR_DOMAIN_BLOCK_REBASE_COPY_DEV) ?
+        VIR_STORAGE_TYPE_BLOCK : VIR_STORAGE_TYPE_FILE;
+    dest->path = g_strdup(base);
+    if (flags & VIR_DOMAIN_BLOCK_REBASE_COPY_RAW)
+        dest->format = VIR_STORAGE_FILE_RAW;
+
+    /* Convert bandwidth MiB to bytes, if necessary */
+    if (!(flags & VIR_DOMAIN_BLOCK_REBASE_BANDWIDTH_BYTES)) {
+        if (speed > LLONG_MAX >> 20) {
+            virReportError(VIR_ERR_OVERFLOW,
+                           _("bandwidth must be less than %llu"),
+                           LLONG_MAX >> 20);
+            goto cleanup;
+        }
+        speed <<= 20;
+    }
+
+    /* XXX: If we are doing a shallow copy but not reusing an external
+     * file, we should attempt to pre-create the destination with a
+     * relative backing chain instead of qemu's default of absolute */
+    if (flags & VIR_DOMAIN_BLOCK_REBASE_RELATIVE) {
+        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED, "%s",
+                       _("Relative backing during copy not supported yet"));
+        goto cleanup;
+    }
+
+    /* We rely on the fact that VIR_DOMAIN_BLOCK_REBASE_SHALLOW
+     * and VIR_DOMAIN_BLOCK_REBASE_REUSE_EXT map to the same values
+     * as for block copy. */
+    flags &= (VIR_DOMAIN_BLOCK_REBASE_SHALLOW |
+              VIR_DOMAIN_BLOCK_REBASE_REUSE_EXT);
+    ret = qemuDomainBlockCopyCommon(vm, dom->conn, path, dest,
+                                    speed, 0, 0, flags, true);
+    dest = NULL;
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+
+static int
+qemuDomainBlockCopy(virDomainPtr dom, const char *disk, const char *destxml,
+                    virTypedParameterPtr params, int nparams,
+                    unsigned int flags)
+{
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainObjPtr vm;
+    int ret = -1;
+    unsigned long long bandwidth = 0;
+    unsigned int granularity = 0;
+    unsigned long long buf_size = 0;
+    virDomainDiskDefPtr diskdef = NULL;
+    virStorageSourcePtr dest = NULL;
+    size_t i;
+
+    virCheckFlags(VIR_DOMAIN_BLOCK_COPY_SHALLOW |
+                  VIR_DOMAIN_BLOCK_COPY_REUSE_EXT |
+                  VIR_DOMAIN_BLOCK_COPY_TRANSIENT_JOB, -1);
+    if (virTypedParamsValidate(params, nparams,
+                               VIR_DOMAIN_BLOCK_COPY_BANDWIDTH,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_COPY_GRANULARITY,
+                               VIR_TYPED_PARAM_UINT,
+                               VIR_DOMAIN_BLOCK_COPY_BUF_SIZE,
+                               VIR_TYPED_PARAM_ULLONG,
+                               NULL) < 0)
+        return -1;
+
+    if (!(vm = qemuDomainObjFromDomain(dom)))
+        return -1;
+
+    if (virDomainBlockCopyEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nparams; i++) {
+        virTypedParameterPtr param = &params[i];
+
+        /* Typed params (wisely) refused to expose unsigned long, but
+         * back-compat demands that we stick with a maximum of
+         * unsigned long bandwidth in MiB/s, while our value is
+         * unsigned long long in bytes/s.  Hence, we have to do
+         * overflow detection if this is a 32-bit server handling a
+         * 64-bit client.  */
+        if (STREQ(param->field, VIR_DOMAIN_BLOCK_COPY_BANDWIDTH)) {
+            if (sizeof(unsigned long)< sizeof(bandwidth) &&
+                param->value.ul > ULONG_MAX * (1ULL << 20)) {
+                virReportError(VIR_ERR_OVERFLOW,
+                               _("bandwidth must be less than %llu bytes"),
+                               ULONG_MAX * (1ULL << 20));
+                goto cleanup;
+            }
+            bandwidth = param->value.ul;
+        } else if (STREQ(param->field, VIR_DOMAIN_BLOCK_COPY_GRANULARITY)) {
+            if (param->value.ui != VIR_ROUND_UP_POWER_OF_TWO(param->value.ui)) {
+                virReportError(VIR_ERR_INVALID_ARG, "%s",
+                               _("granularity must be power of 2"));
+                goto cleanup;
+            }
+            granularity = param->value.ui;
+        } else if (STREQ(param->field, VIR_DOMAIN_BLOCK_COPY_BUF_SIZE)) {
+            buf_size = param->value.ul;
+        }
+    }
+
+    if (!(diskdef = virDomainDiskDefParse(destxml, driver->xmlopt,
+                                          VIR_DOMAIN_DEF_PARSE_INACTIVE |
+                                          VIR_DOMAIN_DEF_PARSE_DISK_SOURCE)))
+        goto cleanup;
+
+    dest = g_steal_pointer(&diskdef->src);
+
+    ret = qemuDomainBlockCopyCommon(vm, dom->conn, disk, dest, bandwidth,
+                                    granularity, buf_size, flags, false);
+
+ cleanup:
+    virDomainDiskDefFree(diskdef);
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+
+static int
+qemuDomainBlockPull(virDomainPtr dom, const char *path, unsigned long bandwidth,
+                    unsigned int flags)
+{
+    virDomainObjPtr vm;
+    virCheckFlags(VIR_DOMAIN_BLOCK_PULL_BANDWIDTH_BYTES, -1);
+
+    if (!(vm = qemuDomainObjFromDomain(dom)))
+        return -1;
+
+    if (virDomainBlockPullEnsureACL(dom->conn, vm->def) < 0) {
+        virDomainObjEndAPI(&vm);
+        return -1;
+    }
+
+    /* qemuDomainBlockPullCommon consumes the reference on @vm */
+    return qemuDomainBlockPullCommon(vm, path, NULL, bandwidth, flags);
+}
+
+
+static int
+qemuDomainBlockCommit(virDomainPtr dom,
+                      const char *path,
+                      const char *base,
+                      const char *top,
+                      unsigned long bandwidth,
+                      unsigned int flags)
+{
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    qemuDomainObjPrivatePtr priv;
+    virDomainObjPtr vm = NULL;
+    const char *device = NULL;
+    const char *jobname = NULL;
+    int ret = -1;
+    virDomainDiskDefPtr disk = NULL;
+    virStorageSourcePtr topSource;
+    unsigned int topIndex = 0;
+    virStorageSourcePtr baseSource = NULL;
+    unsigned int baseIndex = 0;
+    virStorageSourcePtr top_parent = NULL;
+    bool clean_access = false;
+    g_autofree char *topPath = NULL;
+    g_autofree char *basePath = NULL;
+    g_autofree char *backingPath = NULL;
+    unsigned long long speed = bandwidth;
+    qemuBlockJobDataPtr job = NULL;
+    g_autoptr(virStorageSource) mirror = NULL;
+    const char *nodetop = NULL;
+    const char *nodebase = NULL;
+    bool persistjob = false;
+    bool blockdev = false;
+
+    virCheckFlags(VIR_DOMAIN_BLOCK_COMMIT_SHALLOW |
+                  VIR_DOMAIN_BLOCK_COMMIT_ACTIVE |
+                  VIR_DOMAIN_BLOCK_COMMIT_RELATIVE |
+                  VIR_DOMAIN_BLOCK_COMMIT_DELETE |
+                  VIR_DOMAIN_BLOCK_COMMIT_BANDWIDTH_BYTES, -1);
+
+    if (!(vm = qemuDomainObjFromDomain(dom)))
+        goto cleanup;
+    priv = vm->privateData;
+
+    if (virDomainBlockCommitEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
+
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
+        goto cleanup;
+
+    if (virDomainObjCheckActive(vm) < 0)
+        goto endjob;
+
+    blockdev = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV);
+
+    /* Convert bandwidth MiB to bytes, if necessary */
+    if (!(flags & VIR_DOMAIN_BLOCK_COMMIT_BANDWIDTH_BYTES)) {
+        if (speed > LLONG_MAX >> 20) {
+            virReportError(VIR_ERR_OVERFLOW,
+                           _("bandwidth must be less than %llu"),
+                           LLONG_MAX >> 20);
+            goto endjob;
+        }
+        speed <<= 20;
+    }
+
+    if (!(disk = qemuDomainDiskByName(vm->def, path)))
+        goto endjob;
+
+    if (!qemuDomainDiskBlockJobIsSupported(vm, disk))
+        goto endjob;
+
+    if (virStorageSourceIsEmpty(disk->src)) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                       _("disk %s has no source file to be committed"),
+                       disk->dst);
+        goto endjob;
+    }
+
+    if (qemuDomainDiskBlockJobIsActive(disk))
+        goto endjob;
+
+    if (qemuDomainSupportsCheckpointsBlockjobs(vm) < 0)
+        goto endjob;
+
+    if (!blockdev && (flags & VIR_DOMAIN_BLOCK_COMMIT_DELETE)) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("deleting committed images is not supported by this VM"));
+        goto endjob;
+    }
+
+    if (!top || STREQ(top, disk->dst))
+        topSource = disk->src;
+    else if (virStorageFileParseChainIndex(disk->dst, top, &topIndex) < 0 ||
+             !(topSource = virStorageFileChainLookup(disk->src, NULL,
+                                                     top, topIndex,
+                                                     &top_parent)))
+        goto endjob;
+
+    if (topSource == disk->src) {
+        if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_ACTIVE_COMMIT)) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                           _("active commit not supported with this QEMU binary"));
+            goto endjob;
+        }
+        /* XXX Should we auto-pivot when COMMIT_ACTIVE is not specified? */
+        if (!(flags & VIR_DOMAIN_BLOCK_COMMIT_ACTIVE)) {
+            virReportError(VIR_ERR_INVALID_ARG,
+                           _("commit of '%s' active layer requires active flag"),
+                           disk->dst);
+            goto endjob;
+        }
+    } else if (flags & VIR_DOMAIN_BLOCK_COMMIT_ACTIVE) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("active commit requested but '%s' is not active"),
+                       topSource->path);
+        goto endjob;
+    }
+
+    if (!virStorageSourceHasBacking(topSource)) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("top '%s' in chain for '%s' has no backing file"),
+                       topSource->path, path);
+        goto endjob;
+    }
+
+    if (!base && (flags & VIR_DOMAIN_BLOCK_COMMIT_SHALLOW))
+        baseSource = topSource->backingStore;
+    else if (virStorageFileParseChainIndex(disk->dst, base, &baseIndex) < 0 ||
+             !(baseSource = virStorageFileChainLookup(disk->src, topSource,
+                                                      base, baseIndex, NULL)))
+        goto endjob;
+
+    if ((flags & VIR_DOMAIN_BLOCK_COMMIT_SHALLOW) &&
+        baseSource != topSource->backingStore) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("base '%s' is not immediately below '%s' in chain "
+                         "for '%s'"),
+                       base, topSource->path, path);
+        goto endjob;
+    }
+
+    /* For an active commit, clone enough of the base to act as the mirror */
+    if (topSource == disk->src) {
+        if (!(mirror = virStorageSourceCopy(baseSource, false)))
+            goto endjob;
+        if (virStorageSourceInitChainElement(mirror,
+                                             disk->src,
+                                             true) < 0)
+            goto endjob;
+    }
+
+    if (flags & VIR_DOMAIN_BLOCK_COMMIT_RELATIVE &&
+        topSource != disk->src) {
+        if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_CHANGE_BACKING_FILE)) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                           _("this qemu doesn't support relative block commit"));
+            goto endjob;
+        }
+
+        if (blockdev && top_parent &&
+            qemuBlockUpdateRelativeBacking(vm, top_parent, disk->src) < 0)
+            goto endjob;
+
+        if (virStorageFileGetRelativeBackingPath(topSource, baseSource,
+                                                 &backingPath) < 0)
+            goto endjob;
+
+        if (!backingPath) {
+            virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                           _("can't keep relative backing relationship"));
+            goto endjob;
+        }
+    }
+
+    /* For the commit to succeed, we must allow qemu to open both the
+     * 'base' image and the parent of 'top' as read/write; 'top' might
+     * not have a parent, or might already be read-write.  XXX It
+     * would also be nice to revert 'base' to read-only, as well as
+     * revoke access to files removed from the chain, when the commit
+     * operation succeeds, but doing that requires tracking the
+     * operation in XML across libvirtd restarts.  */
+    clean_access = true;
+    if (qemuDomainStorageSourceAccessAllow(driver, vm, baseSource,
+                                           false, false, false) < 0)
+        goto endjob;
+
+    if (top_parent && top_parent != disk->src) {
+        /* While top_parent is topmost image, we don't need to remember its
+         * owner as it will be overwritten upon finishing the commit. Hence,
+         * pass chainTop = false. */
+        if (qemuDomainStorageSourceAccessAllow(driver, vm, top_parent,
+                                               false, false, false) < 0)
+            goto endjob;
+    }
+
+    if (!(job = qemuBlockJobDiskNewCommit(vm, disk, top_parent, topSource,
+                                          baseSource,
+                                          flags & VIR_DOMAIN_BLOCK_COMMIT_DELETE,
+                                          flags)))
+        goto endjob;
+
+    disk->mirrorState = VIR_DOMAIN_DISK_MIRROR_STATE_NONE;
+
+    /* Start the commit operation.  Pass the user's original spelling,
+     * if any, through to qemu, since qemu may behave differently
+     * depending on whether the input was specified as relative or
+     * absolute (that is, our absolute top_canon may do the wrong
+     * thing if the user specified a relative name).  */
+
+    if (blockdev) {
+        persistjob = true;
+        jobname = job->name;
+        nodetop = topSource->nodeformat;
+        nodebase = baseSource->nodeformat;
+        device = qemuDomainDiskGetTopNodename(disk);
+        if (!backingPath && top_parent &&
+            !(backingPath = qemuBlockGetBackingStoreString(baseSource, false)))
+            goto endjob;
+
+    } else {
+        device = job->name;
+    }
+
+    qemuDomainObjEnterMonitor(driver, vm);
+
+    if (!blockdev) {
+        basePath = qemuMonitorDiskNameLookup(priv->mon, device, disk->src,
+                                             baseSource);
+        topPath = qemuMonitorDiskNameLookup(priv->mon, device, disk->src,
+                                            topSource);
+    }
+
+    if (blockdev || (basePath && topPath))
+        ret = qemuMonitorBlockCommit(priv->mon, device, jobname, persistjob,
+                                     topPath, nodetop, basePath, nodebase,
+                                     backingPath, speed);
+
+    if (qemuDomainObjExitMonitor(driver, vm) < 0 || ret < 0) {
+        ret = -1;
+        goto endjob;
+    }
+
+    if (mirror) {
+        disk->mirror = g_steal_pointer(&mirror);
+        disk->mirrorJob = VIR_DOMAIN_BLOCK_JOB_TYPE_ACTIVE_COMMIT;
+    }
+    qemuBlockJobStarted(job, vm);
+
+ endjob:
+    if (ret < 0 && clean_access) {
+        virErrorPtr orig_err;
+        virErrorPreserveLast(&orig_err);
+        /* Revert access to read-only, if possible.  */
+        qemuDomainStorageSourceAccessAllow(driver, vm, baseSource,
+                                           true, false, false);
+        if (top_parent && top_parent != disk->src)
+            qemuDomainStorageSourceAccessAllow(driver, vm, top_parent,
+                                               true, false, false);
+
+        virErrorRestore(&orig_err);
+    }
+    qemuBlockJobStartupFinalize(vm, job);
+    qemuDomainObjEndJob(driver, vm);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+static int
+qemuDomainOpenGraphics(virDomainPtr dom,
+                       unsigned int idx,
+                       int fd,
+                       unsigned int flags)
+{
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainObjPtr vm = NULL;
+    int ret = -1;
+    qemuDomainObjPrivatePtr priv;
+    const char *protocol;
+
+    virCheckFlags(VIR_DOMAIN_OPEN_GRAPHICS_SKIPAUTH, -1);
+
+    if (!(vm = qemuDomainObjFromDomain(dom)))
+        return -1;
+
+    if (virDomainOpenGraphicsEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
+
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
+        goto cleanup;
+
+    if (virDomainObjCheckActive(vm) < 0)
+        goto endjob;
+
+    priv = vm->privateData;
+
+    if (idx >= vm->def->ngraphics) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("No graphics backend with index %d"), idx);
+        goto endjob;
+    }
+    switch (vm->def->graphics[idx]->type) {
+    case VIR_DOMAIN_GRAPHICS_TYPE_VNC:
+        protocol = "vnc";
+        break;
+    case VIR_DOMAIN_GRAPHICS_TYPE_SPICE:
+        protocol = "spice";
+        break;
+    case VIR_DOMAIN_GRAPHICS_TYPE_SDL:
+    case VIR_DOMAIN_GRAPHICS_TYPE_RDP:
+    case VIR_DOMAIN_GRAPHICS_TYPE_DESKTOP:
+    case VIR_DOMAIN_GRAPHICS_TYPE_EGL_HEADLESS:
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                       _("Can only open VNC or SPICE graphics backends, not %s"),
+                       virDomainGraphicsTypeToString(vm->def->graphics[idx]->type));
+        goto endjob;
+    case VIR_DOMAIN_GRAPHICS_TYPE_LAST:
+    default:
+        virReportEnumRangeError(virDomainGraphicsType,
+                                vm->def->graphics[idx]->type);
+        goto endjob;
+    }
+
+    if (qemuSecuritySetImageFDLabel(driver->securityManager, vm->def, fd) < 0)
+        goto endjob;
+
+    qemuDomainObjEnterMonitor(driver, vm);
+    ret = qemuMonitorOpenGraphics(priv->mon, protocol, fd, "graphicsfd",
+                                  (flags & VIR_DOMAIN_OPEN_GRAPHICS_SKIPAUTH) != 0);
+    if (qemuDomainObjExitMonitor(driver, vm) < 0)
+        ret = -1;
+
+ endjob:
+    qemuDomainObjEndJob(driver, vm);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+static int
+qemuDomainOpenGraphicsFD(virDomainPtr dom,
+                         unsigned int idx,
+                         unsigned int flags)
+{
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainObjPtr vm = NULL;
+    int ret = -1;
+    qemuDomainObjPrivatePtr priv;
+    const char *protocol;
+    int pair[2] = {-1, -1};
+
+    virCheckFlags(VIR_DOMAIN_OPEN_GRAPHICS_SKIPAUTH, -1);
+
+    if (!(vm = qemuDomainObjFromDomain(dom)))
+        return -1;
+
+    if (virDomainOpenGraphicsFdEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
+
+    if (virDomainObjCheckActive(vm) < 0)
+        goto cleanup;
+
+    priv = vm->privateData;
+
+    if (idx >= vm->def->ngraphics) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("No graphics backend with index %d"), idx);
+        goto cleanup;
+    }
+    switch (vm->def->graphics[idx]->type) {
+    case VIR_DOMAIN_GRAPHICS_TYPE_VNC:
+        protocol = "vnc";
+        break;
+    case VIR_DOMAIN_GRAPHICS_TYPE_SPICE:
+        protocol = "spice";
+        break;
+    case VIR_DOMAIN_GRAPHICS_TYPE_SDL:
+    case VIR_DOMAIN_GRAPHICS_TYPE_RDP:
+    case VIR_DOMAIN_GRAPHICS_TYPE_DESKTOP:
+    case VIR_DOMAIN_GRAPHICS_TYPE_EGL_HEADLESS:
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                       _("Can only open VNC or SPICE graphics backends, not %s"),
+                       virDomainGraphicsTypeToString(vm->def->graphics[idx]->type));
+        goto cleanup;
+    case VIR_DOMAIN_GRAPHICS_TYPE_LAST:
+    default:
+        virReportEnumRangeError(virDomainGraphicsType,
+                                vm->def->graphics[idx]->type);
+        goto cleanup;
+    }
+
+    if (qemuSecuritySetSocketLabel(driver->securityManager, vm->def) < 0)
+        goto cleanup;
+
+    if (socketpair(PF_UNIX, SOCK_STREAM, 0, pair) < 0)
+        goto cleanup;
+
+    if (qemuSecurityClearSocketLabel(driver->securityManager, vm->def) < 0)
+        goto cleanup;
+
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
+        goto cleanup;
+    qemuDomainObjEnterMonitor(driver, vm);
+    ret = qemuMonitorOpenGraphics(priv->mon, protocol, pair[1], "graphicsfd",
+                                  (flags & VIR_DOMAIN_OPEN_GRAPHICS_SKIPAUTH));
+    if (qemuDomainObjExitMonitor(driver, vm) < 0)
+        ret = -1;
+    qemuDomainObjEndJob(driver, vm);
+    if (ret < 0)
+        goto cleanup;
+
+    ret = pair[0];
+    pair[0] = -1;
+
+ cleanup:
+    VIR_FORCE_CLOSE(pair[0]);
+    VIR_FORCE_CLOSE(pair[1]);
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+typedef enum {
+    QEMU_BLOCK_IOTUNE_SET_BYTES            = 1 << 0,
+    QEMU_BLOCK_IOTUNE_SET_IOPS             = 1 << 1,
+    QEMU_BLOCK_IOTUNE_SET_BYTES_MAX        = 1 << 2,
+    QEMU_BLOCK_IOTUNE_SET_IOPS_MAX         = 1 << 3,
+    QEMU_BLOCK_IOTUNE_SET_SIZE_IOPS        = 1 << 4,
+    QEMU_BLOCK_IOTUNE_SET_GROUP_NAME       = 1 << 5,
+    QEMU_BLOCK_IOTUNE_SET_BYTES_MAX_LENGTH = 1 << 6,
+    QEMU_BLOCK_IOTUNE_SET_IOPS_MAX_LENGTH  = 1 << 7,
+} qemuBlockIoTuneSetFlags;
+
+
+/* If the user didn't specify bytes limits, inherit previous values;
+ * likewise if the user didn't specify iops limits.  */
+static int
+qemuDomainSetBlockIoTuneDefaults(virDomainBlockIoTuneInfoPtr newinfo,
+                                 virDomainBlockIoTuneInfoPtr oldinfo,
+                                 qemuBlockIoTuneSetFlags set_fields)
+{
+#define SET_IOTUNE_DEFAULTS(BOOL, FIELD) \
+    if (!(set_fields & QEMU_BLOCK_IOTUNE_SET_##BOOL)) { \
+        newinfo->total_##FIELD = oldinfo->total_##FIELD; \
+        newinfo->read_##FIELD = oldinfo->read_##FIELD; \
+        newinfo->write_##FIELD = oldinfo->write_##FIELD; \
+    }
+
+    SET_IOTUNE_DEFAULTS(BYTES, bytes_sec);
+    SET_IOTUNE_DEFAULTS(BYTES_MAX, bytes_sec_max);
+    SET_IOTUNE_DEFAULTS(IOPS, iops_sec);
+    SET_IOTUNE_DEFAULTS(IOPS_MAX, iops_sec_max);
+#undef SET_IOTUNE_DEFAULTS
+
+    if (!(set_fields & QEMU_BLOCK_IOTUNE_SET_SIZE_IOPS))
+        newinfo->size_iops_sec = oldinfo->size_iops_sec;
+    if (!(set_fields & QEMU_BLOCK_IOTUNE_SET_GROUP_NAME))
+        newinfo->group_name = g_strdup(oldinfo->group_name);
 
-            rc = qemuProcessStart(snapshot->domain->conn, driver, vm,
-                                  cookie ? cookie->cpu : NULL,
-                                  jobType, NULL, -1, NULL, snap,
-                                  VIR_NETDEV_VPORT_PROFILE_OP_CREATE,
-                                  start_flags);
-            virDomainAuditStart(vm, "from-snapshot", rc >= 0);
-            detail = VIR_DOMAIN_EVENT_STARTED_FROM_SNAPSHOT;
-            event = virDomainEventLifecycleNewFromObj(vm,
-                                             VIR_DOMAIN_EVENT_STARTED,
-                                             detail);
-            if (rc < 0)
-                goto endjob;
-        }
+    /* The length field is handled a bit differently. If not defined/set,
+     * QEMU will default these to 0 or 1 depending on whether something in
+     * the same family is set or not.
+     *
+     * Similar to other values, if nothing in the family is defined/set,
+     * then take whatever is in the oldinfo.
+     *
+     * To clear an existing limit, a 0 is provided; however, passing that
+     * 0 onto QEMU if there's a family value defined/set (or defaulted)
+     * will cause an error. So, to mimic that, if our oldinfo was set and
+     * our newinfo is clearing, then set max_length based on whether we
+     * have a value in the family set/defined. */
+#define SET_MAX_LENGTH(BOOL, FIELD) \
+    if (!(set_fields & QEMU_BLOCK_IOTUNE_SET_##BOOL)) \
+        newinfo->FIELD##_max_length = oldinfo->FIELD##_max_length; \
+    else if ((set_fields & QEMU_BLOCK_IOTUNE_SET_##BOOL) && \
+             oldinfo->FIELD##_max_length && \
+             !newinfo->FIELD##_max_length) \
+        newinfo->FIELD##_max_length = (newinfo->FIELD || \
+                                       newinfo->FIELD##_max) ? 1 : 0;
 
-        /* Touch up domain state.  */
-        if (!(flags & VIR_DOMAIN_SNAPSHOT_REVERT_RUNNING) &&
-            (snapdef->state == VIR_DOMAIN_SNAPSHOT_PAUSED ||
-             (flags & VIR_DOMAIN_SNAPSHOT_REVERT_PAUSED))) {
-            /* Transitions 3, 6, 9 */
-            virDomainObjSetState(vm, VIR_DOMAIN_PAUSED,
-                                 VIR_DOMAIN_PAUSED_FROM_SNAPSHOT);
-            if (was_stopped) {
-                /* Transition 3, use event as-is and add event2 */
-                detail = VIR_DOMAIN_EVENT_SUSPENDED_FROM_SNAPSHOT;
-                event2 = virDomainEventLifecycleNewFromObj(vm,
-                                                  VIR_DOMAIN_EVENT_SUSPENDED,
-                                                  detail);
-            } /* else transition 6 and 9 use event as-is */
-        } else {
-            /* Transitions 2, 5, 8 */
-            if (!virDomainObjIsActive(vm)) {
-                virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                               _("guest unexpectedly quit"));
-                goto endjob;
-            }
-            rc = qemuProcessStartCPUs(driver, vm,
-                                      VIR_DOMAIN_RUNNING_FROM_SNAPSHOT,
-                                      jobType);
-            if (rc < 0)
-                goto endjob;
-            virObjectUnref(event);
-            event = NULL;
-            if (was_stopped) {
-                /* Transition 2 */
-                detail = VIR_DOMAIN_EVENT_STARTED_FROM_SNAPSHOT;
-                event = virDomainEventLifecycleNewFromObj(vm,
-                                                 VIR_DOMAIN_EVENT_STARTED,
-                                                 detail);
-            }
-        }
-        break;
+    SET_MAX_LENGTH(BYTES_MAX_LENGTH, total_bytes_sec);
+    SET_MAX_LENGTH(BYTES_MAX_LENGTH, read_bytes_sec);
+    SET_MAX_LENGTH(BYTES_MAX_LENGTH, write_bytes_sec);
+    SET_MAX_LENGTH(IOPS_MAX_LENGTH, total_iops_sec);
+    SET_MAX_LENGTH(IOPS_MAX_LENGTH, read_iops_sec);
+    SET_MAX_LENGTH(IOPS_MAX_LENGTH, write_iops_sec);
 
-    case VIR_DOMAIN_SNAPSHOT_SHUTDOWN:
-    case VIR_DOMAIN_SNAPSHOT_SHUTOFF:
-    case VIR_DOMAIN_SNAPSHOT_CRASHED:
-        /* Transitions 1, 4, 7 */
-        /* Newer qemu -loadvm refuses to revert to the state of a snapshot
-         * created by qemu-img snapshot -c.  If the domain is running, we
-         * must take it offline; then do the revert using qemu-img.
-         */
+#undef SET_MAX_LENGTH
 
-        if (virDomainObjIsActive(vm)) {
-            /* Transitions 4, 7 */
-            qemuProcessStop(driver, vm, VIR_DOMAIN_SHUTOFF_FROM_SNAPSHOT,
-                            QEMU_ASYNC_JOB_START, 0);
-            virDomainAuditStop(vm, "from-snapshot");
-            detail = VIR_DOMAIN_EVENT_STOPPED_FROM_SNAPSHOT;
-            event = virDomainEventLifecycleNewFromObj(vm,
-                                             VIR_DOMAIN_EVENT_STOPPED,
-                                             detail);
-        }
+    return 0;
+}
 
-        if (qemuDomainSnapshotRevertInactive(driver, vm, snap) < 0) {
-            qemuDomainRemoveInactive(driver, vm);
-            qemuProcessEndJob(driver, vm);
-            goto cleanup;
-        }
 
-        if (inactiveConfig) {
-            virDomainObjAssignDef(vm, inactiveConfig, false, NULL);
-            inactiveConfig = NULL;
-            defined = true;
-        }
+static void
+qemuDomainSetGroupBlockIoTune(virDomainDefPtr def,
+                              virDomainBlockIoTuneInfoPtr iotune)
+{
+    size_t i;
 
-        if (flags & (VIR_DOMAIN_SNAPSHOT_REVERT_RUNNING |
-                     VIR_DOMAIN_SNAPSHOT_REVERT_PAUSED)) {
-            /* Flush first event, now do transition 2 or 3 */
-            bool paused = (flags & VIR_DOMAIN_SNAPSHOT_REVERT_PAUSED) != 0;
+    if (!iotune->group_name)
+        return;
 
-            start_flags |= paused ? VIR_QEMU_PROCESS_START_PAUSED : 0;
+    for (i = 0; i < def->ndisks; i++) {
+        virDomainDiskDefPtr d = def->disks[i];
 
-            virObjectEventStateQueue(driver->domainEventState, event);
-            rc = qemuProcessStart(snapshot->domain->conn, driver, vm, NULL,
-                                  QEMU_ASYNC_JOB_START, NULL, -1, NULL, NULL,
-                                  VIR_NETDEV_VPORT_PROFILE_OP_CREATE,
-                                  start_flags);
-            virDomainAuditStart(vm, "from-snapshot", rc >= 0);
-            if (rc < 0) {
-                qemuDomainRemoveInactive(driver, vm);
-                qemuProcessEndJob(driver, vm);
-                goto cleanup;
-            }
-            detail = VIR_DOMAIN_EVENT_STARTED_FROM_SNAPSHOT;
-            event = virDomainEventLifecycleNewFromObj(vm,
-                                             VIR_DOMAIN_EVENT_STARTED,
-                                             detail);
-            if (paused) {
-                detail = VIR_DOMAIN_EVENT_SUSPENDED_FROM_SNAPSHOT;
-                event2 = virDomainEventLifecycleNewFromObj(vm,
-                                                  VIR_DOMAIN_EVENT_SUSPENDED,
-                                                  detail);
-            }
+        if (STREQ_NULLABLE(d->blkdeviotune.group_name, iotune->group_name)) {
+            VIR_FREE(d->blkdeviotune.group_name);
+            virDomainBlockIoTuneInfoCopy(iotune, &d->blkdeviotune);
         }
-        break;
+    }
+}
 
-    case VIR_DOMAIN_SNAPSHOT_PMSUSPENDED:
-        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
-                       _("qemu doesn't support reversion of snapshot taken in "
-                         "PMSUSPENDED state"));
-        goto endjob;
 
-    case VIR_DOMAIN_SNAPSHOT_DISK_SNAPSHOT:
-        /* Rejected earlier as an external snapshot */
-    case VIR_DOMAIN_SNAPSHOT_NOSTATE:
-    case VIR_DOMAIN_SNAPSHOT_BLOCKED:
-    case VIR_DOMAIN_SNAPSHOT_LAST:
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("Invalid target domain state '%s'. Refusing "
-                         "snapshot reversion"),
-                       virDomainSnapshotStateTypeToString(snapdef->state));
-        goto endjob;
-    }
+static virDomainBlockIoTuneInfoPtr
+qemuDomainFindGroupBlockIoTune(virDomainDefPtr def,
+                               virDomainDiskDefPtr disk,
+                               virDomainBlockIoTuneInfoPtr newiotune)
+{
+    size_t i;
 
-    ret = 0;
+    if (!newiotune->group_name ||
+        STREQ_NULLABLE(disk->blkdeviotune.group_name, newiotune->group_name))
+        return &disk->blkdeviotune;
 
- endjob:
-    qemuProcessEndJob(driver, vm);
+    for (i = 0; i < def->ndisks; i++) {
+        virDomainDiskDefPtr d = def->disks[i];
 
- cleanup:
-    if (ret == 0) {
-        virDomainSnapshotSetCurrent(vm->snapshots, snap);
-        if (qemuDomainSnapshotWriteMetadata(vm, snap,
-                                            driver->xmlopt,
-                                            cfg->snapshotDir) < 0) {
-            virDomainSnapshotSetCurrent(vm->snapshots, NULL);
-            ret = -1;
-        }
-    }
-    if (ret == 0 && defined && vm->persistent &&
-        !(ret = virDomainDefSave(vm->newDef ? vm->newDef : vm->def,
-                                 driver->xmlopt, cfg->configDir))) {
-        detail = VIR_DOMAIN_EVENT_DEFINED_FROM_SNAPSHOT;
-        virObjectEventStateQueue(driver->domainEventState,
-            virDomainEventLifecycleNewFromObj(vm,
-                                              VIR_DOMAIN_EVENT_DEFINED,
-                                              detail));
+        if (STREQ_NULLABLE(newiotune->group_name, d->blkdeviotune.group_name))
+            return &d->blkdeviotune;
     }
-    virObjectEventStateQueue(driver->domainEventState, event);
-    virObjectEventStateQueue(driver->domainEventState, event2);
-    virDomainObjEndAPI(&vm);
-    virNWFilterUnlockFilterUpdates();
-    virCPUDefFree(origCPU);
-    virDomainDefFree(config);
-    virDomainDefFree(inactiveConfig);
 
-    return ret;
+    return &disk->blkdeviotune;
 }
 
 
-typedef struct _virQEMUMomentReparent virQEMUMomentReparent;
-typedef virQEMUMomentReparent *virQEMUMomentReparentPtr;
-struct _virQEMUMomentReparent {
-    const char *dir;
-    virDomainMomentObjPtr parent;
-    virDomainObjPtr vm;
-    virDomainXMLOptionPtr xmlopt;
-    int err;
-    int (*writeMetadata)(virDomainObjPtr, virDomainMomentObjPtr,
-                         virDomainXMLOptionPtr, const char *);
-};
-
-
 static int
-qemuDomainMomentReparentChildren(void *payload,
-                                 const void *name G_GNUC_UNUSED,
-                                 void *data)
+qemuDomainCheckBlockIoTuneReset(virDomainDiskDefPtr disk,
+                                virDomainBlockIoTuneInfoPtr newiotune)
 {
-    virDomainMomentObjPtr moment = payload;
-    virQEMUMomentReparentPtr rep = data;
-
-    if (rep->err < 0)
+    if (virDomainBlockIoTuneInfoHasAny(newiotune))
         return 0;
 
-    VIR_FREE(moment->def->parent_name);
+    if (newiotune->group_name &&
+        STRNEQ_NULLABLE(newiotune->group_name, disk->blkdeviotune.group_name)) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                       _("creating a new group/updating existing with all"
+                         " tune parameters zero is not supported"));
+        return -1;
+    }
 
-    if (rep->parent->def)
-        moment->def->parent_name = g_strdup(rep->parent->def->name);
+    /* all zero means remove any throttling and remove from group for qemu */
+    VIR_FREE(newiotune->group_name);
 
-    rep->err = rep->writeMetadata(rep->vm, moment, rep->xmlopt,
-                                  rep->dir);
     return 0;
 }
 
 
 static int
-qemuDomainSnapshotDelete(virDomainSnapshotPtr snapshot,
+qemuDomainSetBlockIoTune(virDomainPtr dom,
+                         const char *path,
+                         virTypedParameterPtr params,
+                         int nparams,
                          unsigned int flags)
 {
-    virQEMUDriverPtr driver = snapshot->domain->conn->privateData;
+    virQEMUDriverPtr driver = dom->conn->privateData;
     virDomainObjPtr vm = NULL;
+    qemuDomainObjPrivatePtr priv;
+    virDomainDefPtr def = NULL;
+    virDomainDefPtr persistentDef = NULL;
+    virDomainBlockIoTuneInfo info;
+    virDomainBlockIoTuneInfo conf_info;
+    g_autofree char *drivealias = NULL;
+    const char *qdevid = NULL;
     int ret = -1;
-    virDomainMomentObjPtr snap = NULL;
-    virQEMUMomentRemove rem;
-    virQEMUMomentReparent rep;
-    bool metadata_only = !!(flags & VIR_DOMAIN_SNAPSHOT_DELETE_METADATA_ONLY);
-    int external = 0;
+    size_t i;
+    virDomainDiskDefPtr conf_disk = NULL;
+    virDomainDiskDefPtr disk;
+    qemuBlockIoTuneSetFlags set_fields = 0;
+    bool supportMaxOptions = true;
+    bool supportGroupNameOption = true;
+    bool supportMaxLengthOptions = true;
     g_autoptr(virQEMUDriverConfig) cfg = NULL;
+    virObjectEventPtr event = NULL;
+    virTypedParameterPtr eventParams = NULL;
+    int eventNparams = 0;
+    int eventMaxparams = 0;
+    virDomainBlockIoTuneInfoPtr cur_info;
+    virDomainBlockIoTuneInfoPtr conf_cur_info;
 
-    virCheckFlags(VIR_DOMAIN_SNAPSHOT_DELETE_CHILDREN |
-                  VIR_DOMAIN_SNAPSHOT_DELETE_METADATA_ONLY |
-                  VIR_DOMAIN_SNAPSHOT_DELETE_CHILDREN_ONLY, -1);
 
-    if (!(vm = qemuDomObjFromSnapshot(snapshot)))
+    virCheckFlags(VIR_DOMAIN_AFFECT_LIVE |
+                  VIR_DOMAIN_AFFECT_CONFIG, -1);
+    if (virTypedParamsValidate(params, nparams,
+                               VIR_DOMAIN_BLOCK_IOTUNE_TOTAL_BYTES_SEC,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_READ_BYTES_SEC,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_WRITE_BYTES_SEC,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_TOTAL_IOPS_SEC,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_READ_IOPS_SEC,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_WRITE_IOPS_SEC,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_TOTAL_BYTES_SEC_MAX,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_READ_BYTES_SEC_MAX,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_WRITE_BYTES_SEC_MAX,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_TOTAL_IOPS_SEC_MAX,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_READ_IOPS_SEC_MAX,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_WRITE_IOPS_SEC_MAX,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_SIZE_IOPS_SEC,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_GROUP_NAME,
+                               VIR_TYPED_PARAM_STRING,
+                               VIR_DOMAIN_BLOCK_IOTUNE_TOTAL_BYTES_SEC_MAX_LENGTH,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_READ_BYTES_SEC_MAX_LENGTH,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_WRITE_BYTES_SEC_MAX_LENGTH,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_TOTAL_IOPS_SEC_MAX_LENGTH,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_READ_IOPS_SEC_MAX_LENGTH,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_WRITE_IOPS_SEC_MAX_LENGTH,
+                               VIR_TYPED_PARAM_ULLONG,
+                               NULL) < 0)
         return -1;
 
-    cfg = virQEMUDriverGetConfig(driver);
+    memset(&info, 0, sizeof(info));
+    memset(&conf_info, 0, sizeof(conf_info));
 
-    if (virDomainSnapshotDeleteEnsureACL(snapshot->domain->conn, vm->def) < 0)
-        goto cleanup;
+    if (!(vm = qemuDomainObjFromDomain(dom)))
+        return -1;
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
+    if (virDomainSetBlockIoTuneEnsureACL(dom->conn, vm->def, flags) < 0)
         goto cleanup;
 
-    if (!(snap = qemuSnapObjFromSnapshot(vm, snapshot)))
-        goto endjob;
-
-    if (!metadata_only) {
-        if (!(flags & VIR_DOMAIN_SNAPSHOT_DELETE_CHILDREN_ONLY) &&
-            virDomainSnapshotIsExternal(snap))
-            external++;
-        if (flags & (VIR_DOMAIN_SNAPSHOT_DELETE_CHILDREN |
-                     VIR_DOMAIN_SNAPSHOT_DELETE_CHILDREN_ONLY))
-            virDomainMomentForEachDescendant(snap,
-                                             qemuDomainSnapshotCountExternal,
-                                             &external);
-        if (external) {
-            virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
-                           _("deletion of %d external disk snapshots not "
-                             "supported yet"), external);
-            goto endjob;
-        }
-    }
-
-    if (flags & (VIR_DOMAIN_SNAPSHOT_DELETE_CHILDREN |
-                 VIR_DOMAIN_SNAPSHOT_DELETE_CHILDREN_ONLY)) {
-        rem.driver = driver;
-        rem.vm = vm;
-        rem.metadata_only = metadata_only;
-        rem.err = 0;
-        rem.current = virDomainSnapshotGetCurrent(vm->snapshots);
-        rem.found = false;
-        rem.momentDiscard = qemuDomainSnapshotDiscard;
-        virDomainMomentForEachDescendant(snap, qemuDomainMomentDiscardAll,
-                                         &rem);
-        if (rem.err < 0)
-            goto endjob;
-        if (rem.found) {
-            virDomainSnapshotSetCurrent(vm->snapshots, snap);
-            if (flags & VIR_DOMAIN_SNAPSHOT_DELETE_CHILDREN_ONLY) {
-                if (qemuDomainSnapshotWriteMetadata(vm, snap,
-                                                    driver->xmlopt,
-                                                    cfg->snapshotDir) < 0) {
-                    virReportError(VIR_ERR_INTERNAL_ERROR,
-                                   _("failed to set snapshot '%s' as current"),
-                                   snap->def->name);
-                    virDomainSnapshotSetCurrent(vm->snapshots, NULL);
-                    goto endjob;
-                }
-            }
-        }
-    } else if (snap->nchildren) {
-        rep.dir = cfg->snapshotDir;
-        rep.parent = snap->parent;
-        rep.vm = vm;
-        rep.err = 0;
-        rep.xmlopt = driver->xmlopt;
-        rep.writeMetadata = qemuDomainSnapshotWriteMetadata;
-        virDomainMomentForEachChild(snap,
-                                    qemuDomainMomentReparentChildren,
-                                    &rep);
-        if (rep.err < 0)
-            goto endjob;
-        virDomainMomentMoveChildren(snap, snap->parent);
-    }
-
-    if (flags & VIR_DOMAIN_SNAPSHOT_DELETE_CHILDREN_ONLY) {
-        virDomainMomentDropChildren(snap);
-        ret = 0;
-    } else {
-        ret = qemuDomainSnapshotDiscard(driver, vm, snap, true, metadata_only);
-    }
-
- endjob:
-    qemuDomainObjEndJob(driver, vm);
-
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return ret;
-}
-
-
-static virDomainCheckpointPtr
-qemuDomainCheckpointCreateXML(virDomainPtr domain,
-                              const char *xmlDesc,
-                              unsigned int flags)
-{
-    virDomainObjPtr vm = NULL;
-    virDomainCheckpointPtr checkpoint = NULL;
-
-    if (!(vm = qemuDomainObjFromDomain(domain)))
-        goto cleanup;
+    cfg = virQEMUDriverGetConfig(driver);
 
-    if (virDomainCheckpointCreateXMLEnsureACL(domain->conn, vm->def, flags) < 0)
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
         goto cleanup;
 
-    checkpoint = qemuCheckpointCreateXML(domain, vm, xmlDesc, flags);
-
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return checkpoint;
-}
-
-
-static int
-qemuDomainListAllCheckpoints(virDomainPtr domain,
-                             virDomainCheckpointPtr **chks,
-                             unsigned int flags)
-{
-    virDomainObjPtr vm = NULL;
-    int n = -1;
+    priv = vm->privateData;
 
-    virCheckFlags(VIR_DOMAIN_CHECKPOINT_LIST_ROOTS |
-                  VIR_DOMAIN_CHECKPOINT_LIST_TOPOLOGICAL |
-                  VIR_DOMAIN_CHECKPOINT_FILTERS_ALL, -1);
+    if (virDomainObjGetDefs(vm, flags, &def, &persistentDef) < 0)
+        goto endjob;
 
-    if (!(vm = qemuDomainObjFromDomain(domain)))
-        return -1;
+    if (virTypedParamsAddString(&eventParams, &eventNparams, &eventMaxparams,
+                                VIR_DOMAIN_TUNABLE_BLKDEV_DISK, path) < 0)
+        goto endjob;
 
-    if (virDomainListAllCheckpointsEnsureACL(domain->conn, vm->def) < 0)
-        goto cleanup;
+#define SET_IOTUNE_FIELD(FIELD, BOOL, CONST) \
+    if (STREQ(param->field, VIR_DOMAIN_BLOCK_IOTUNE_##CONST)) { \
+        info.FIELD = param->value.ul; \
+        set_fields |= QEMU_BLOCK_IOTUNE_SET_##BOOL; \
+        if (virTypedParamsAddULLong(&eventParams, &eventNparams, \
+                                    &eventMaxparams, \
+                                    VIR_DOMAIN_TUNABLE_BLKDEV_##CONST, \
+                                    param->value.ul) < 0) \
+            goto endjob; \
+        continue; \
+    }
 
-    n = virDomainListCheckpoints(vm->checkpoints, NULL, domain, chks, flags);
+    for (i = 0; i < nparams; i++) {
+        virTypedParameterPtr param = &params[i];
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return n;
-}
+        if (param->value.ul > QEMU_BLOCK_IOTUNE_MAX) {
+            virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED,
+                           _("block I/O throttle limit value must"
+                             " be no more than %llu"), QEMU_BLOCK_IOTUNE_MAX);
+            goto endjob;
+        }
 
+        SET_IOTUNE_FIELD(total_bytes_sec, BYTES, TOTAL_BYTES_SEC);
+        SET_IOTUNE_FIELD(read_bytes_sec, BYTES, READ_BYTES_SEC);
+        SET_IOTUNE_FIELD(write_bytes_sec, BYTES, WRITE_BYTES_SEC);
+        SET_IOTUNE_FIELD(total_iops_sec, IOPS, TOTAL_IOPS_SEC);
+        SET_IOTUNE_FIELD(read_iops_sec, IOPS, READ_IOPS_SEC);
+        SET_IOTUNE_FIELD(write_iops_sec, IOPS, WRITE_IOPS_SEC);
 
-static int
-qemuDomainCheckpointListAllChildren(virDomainCheckpointPtr checkpoint,
-                                    virDomainCheckpointPtr **chks,
-                                    unsigned int flags)
-{
-    virDomainObjPtr vm = NULL;
-    virDomainMomentObjPtr chk = NULL;
-    int n = -1;
+        SET_IOTUNE_FIELD(total_bytes_sec_max, BYTES_MAX,
+                         TOTAL_BYTES_SEC_MAX);
+        SET_IOTUNE_FIELD(read_bytes_sec_max, BYTES_MAX,
+                         READ_BYTES_SEC_MAX);
+        SET_IOTUNE_FIELD(write_bytes_sec_max, BYTES_MAX,
+                         WRITE_BYTES_SEC_MAX);
+        SET_IOTUNE_FIELD(total_iops_sec_max, IOPS_MAX,
+                         TOTAL_IOPS_SEC_MAX);
+        SET_IOTUNE_FIELD(read_iops_sec_max, IOPS_MAX,
+                         READ_IOPS_SEC_MAX);
+        SET_IOTUNE_FIELD(write_iops_sec_max, IOPS_MAX,
+                         WRITE_IOPS_SEC_MAX);
+        SET_IOTUNE_FIELD(size_iops_sec, SIZE_IOPS, SIZE_IOPS_SEC);
 
-    virCheckFlags(VIR_DOMAIN_CHECKPOINT_LIST_DESCENDANTS |
-                  VIR_DOMAIN_CHECKPOINT_LIST_TOPOLOGICAL |
-                  VIR_DOMAIN_CHECKPOINT_FILTERS_ALL, -1);
+        /* NB: Cannot use macro since this is a value.s not a value.ul */
+        if (STREQ(param->field, VIR_DOMAIN_BLOCK_IOTUNE_GROUP_NAME)) {
+            info.group_name = g_strdup(param->value.s);
+            set_fields |= QEMU_BLOCK_IOTUNE_SET_GROUP_NAME;
+            if (virTypedParamsAddString(&eventParams, &eventNparams,
+                                        &eventMaxparams,
+                                        VIR_DOMAIN_TUNABLE_BLKDEV_GROUP_NAME,
+                                        param->value.s) < 0)
+                goto endjob;
+            continue;
+        }
 
-    if (!(vm = qemuDomObjFromCheckpoint(checkpoint)))
-        return -1;
+        SET_IOTUNE_FIELD(total_bytes_sec_max_length, BYTES_MAX_LENGTH,
+                         TOTAL_BYTES_SEC_MAX_LENGTH);
+        SET_IOTUNE_FIELD(read_bytes_sec_max_length, BYTES_MAX_LENGTH,
+                         READ_BYTES_SEC_MAX_LENGTH);
+        SET_IOTUNE_FIELD(write_bytes_sec_max_length, BYTES_MAX_LENGTH,
+                         WRITE_BYTES_SEC_MAX_LENGTH);
+        SET_IOTUNE_FIELD(total_iops_sec_max_length, IOPS_MAX_LENGTH,
+                         TOTAL_IOPS_SEC_MAX_LENGTH);
+        SET_IOTUNE_FIELD(read_iops_sec_max_length, IOPS_MAX_LENGTH,
+                         READ_IOPS_SEC_MAX_LENGTH);
+        SET_IOTUNE_FIELD(write_iops_sec_max_length, IOPS_MAX_LENGTH,
+                         WRITE_IOPS_SEC_MAX_LENGTH);
+    }
 
-    if (virDomainCheckpointListAllChildrenEnsureACL(checkpoint->domain->conn,
-                                                    vm->def) < 0)
-        goto cleanup;
+#undef SET_IOTUNE_FIELD
 
-    if (!(chk = qemuCheckpointObjFromCheckpoint(vm, checkpoint)))
-        goto cleanup;
+    if ((info.total_bytes_sec && info.read_bytes_sec) ||
+        (info.total_bytes_sec && info.write_bytes_sec)) {
+        virReportError(VIR_ERR_INVALID_ARG, "%s",
+                       _("total and read/write of bytes_sec "
+                         "cannot be set at the same time"));
+        goto endjob;
+    }
 
-    n = virDomainListCheckpoints(vm->checkpoints, chk, checkpoint->domain,
-                                 chks, flags);
+    if ((info.total_iops_sec && info.read_iops_sec) ||
+        (info.total_iops_sec && info.write_iops_sec)) {
+        virReportError(VIR_ERR_INVALID_ARG, "%s",
+                       _("total and read/write of iops_sec "
+                         "cannot be set at the same time"));
+        goto endjob;
+    }
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return n;
-}
+    if ((info.total_bytes_sec_max && info.read_bytes_sec_max) ||
+        (info.total_bytes_sec_max && info.write_bytes_sec_max)) {
+        virReportError(VIR_ERR_INVALID_ARG, "%s",
+                       _("total and read/write of bytes_sec_max "
+                         "cannot be set at the same time"));
+        goto endjob;
+    }
 
+    if ((info.total_iops_sec_max && info.read_iops_sec_max) ||
+        (info.total_iops_sec_max && info.write_iops_sec_max)) {
+        virReportError(VIR_ERR_INVALID_ARG, "%s",
+                       _("total and read/write of iops_sec_max "
+                         "cannot be set at the same time"));
+        goto endjob;
+    }
 
-static virDomainCheckpointPtr
-qemuDomainCheckpointLookupByName(virDomainPtr domain,
-                                 const char *name,
-                                 unsigned int flags)
-{
-    virDomainObjPtr vm;
-    virDomainMomentObjPtr chk = NULL;
-    virDomainCheckpointPtr checkpoint = NULL;
+    virDomainBlockIoTuneInfoCopy(&info, &conf_info);
 
-    virCheckFlags(0, NULL);
+    if (def) {
+        supportMaxOptions = virQEMUCapsGet(priv->qemuCaps,
+                                           QEMU_CAPS_DRIVE_IOTUNE_MAX);
+        supportGroupNameOption = virQEMUCapsGet(priv->qemuCaps,
+                                                QEMU_CAPS_DRIVE_IOTUNE_GROUP);
+        supportMaxLengthOptions =
+            virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_DRIVE_IOTUNE_MAX_LENGTH);
 
-    if (!(vm = qemuDomainObjFromDomain(domain)))
-        return NULL;
+        if (!supportMaxOptions &&
+            (set_fields & (QEMU_BLOCK_IOTUNE_SET_BYTES_MAX |
+                           QEMU_BLOCK_IOTUNE_SET_IOPS_MAX |
+                           QEMU_BLOCK_IOTUNE_SET_SIZE_IOPS))) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                           _("a block I/O throttling parameter is not "
+                             "supported with this QEMU binary"));
+             goto endjob;
+        }
 
-    if (virDomainCheckpointLookupByNameEnsureACL(domain->conn, vm->def) < 0)
-        goto cleanup;
+        if (!supportGroupNameOption &&
+            (set_fields & QEMU_BLOCK_IOTUNE_SET_GROUP_NAME)) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                           _("the block I/O throttling group parameter is not "
+                             "supported with this QEMU binary"));
+             goto endjob;
+        }
 
-    if (!(chk = qemuCheckpointObjFromName(vm, name)))
-        goto cleanup;
+        if (!supportMaxLengthOptions &&
+            (set_fields & (QEMU_BLOCK_IOTUNE_SET_BYTES_MAX_LENGTH |
+                           QEMU_BLOCK_IOTUNE_SET_IOPS_MAX_LENGTH))) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                           _("a block I/O throttling length parameter is not "
+                             "supported with this QEMU binary"));
+             goto endjob;
+        }
 
-    checkpoint = virGetDomainCheckpoint(domain, chk->def->name);
+        if (!(disk = qemuDomainDiskByName(def, path)))
+            goto endjob;
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return checkpoint;
-}
+        if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV) &&
+            QEMU_DOMAIN_DISK_PRIVATE(disk)->qomName) {
+            qdevid = QEMU_DOMAIN_DISK_PRIVATE(disk)->qomName;
+        } else {
+            if (!(drivealias = qemuAliasDiskDriveFromDisk(disk)))
+                goto endjob;
+        }
 
+        cur_info = qemuDomainFindGroupBlockIoTune(def, disk, &info);
 
-static virDomainCheckpointPtr
-qemuDomainCheckpointGetParent(virDomainCheckpointPtr checkpoint,
-                              unsigned int flags)
-{
-    virDomainObjPtr vm;
-    virDomainMomentObjPtr chk = NULL;
-    virDomainCheckpointPtr parent = NULL;
+        if (qemuDomainSetBlockIoTuneDefaults(&info, cur_info,
+                                             set_fields) < 0)
+            goto endjob;
 
-    virCheckFlags(0, NULL);
+        if (qemuDomainCheckBlockIoTuneReset(disk, &info) < 0)
+            goto endjob;
 
-    if (!(vm = qemuDomObjFromCheckpoint(checkpoint)))
-        return NULL;
+#define CHECK_MAX(val, _bool) \
+        do { \
+            if (info.val##_max) { \
+                if (!info.val) { \
+                    if (QEMU_BLOCK_IOTUNE_SET_##_bool) { \
+                        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, \
+                                       _("cannot reset '%s' when " \
+                                         "'%s' is set"), \
+                                       #val, #val "_max"); \
+                    } else { \
+                        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, \
+                                       _("value '%s' cannot be set if " \
+                                         "'%s' is not set"), \
+                                       #val "_max", #val); \
+                    } \
+                    goto endjob; \
+                } \
+                if (info.val##_max < info.val) { \
+                    virReportError(VIR_ERR_CONFIG_UNSUPPORTED, \
+                                   _("value '%s' cannot be " \
+                                     "smaller than '%s'"), \
+                                   #val "_max", #val); \
+                    goto endjob; \
+                } \
+            } \
+        } while (false)
 
-    if (virDomainCheckpointGetParentEnsureACL(checkpoint->domain->conn, vm->def) < 0)
-        goto cleanup;
+        CHECK_MAX(total_bytes_sec, BYTES);
+        CHECK_MAX(read_bytes_sec, BYTES);
+        CHECK_MAX(write_bytes_sec, BYTES);
+        CHECK_MAX(total_iops_sec, IOPS);
+        CHECK_MAX(read_iops_sec, IOPS);
+        CHECK_MAX(write_iops_sec, IOPS);
 
-    if (!(chk = qemuCheckpointObjFromCheckpoint(vm, checkpoint)))
-        goto cleanup;
+#undef CHECK_MAX
 
-    if (!chk->def->parent_name) {
-        virReportError(VIR_ERR_NO_DOMAIN_CHECKPOINT,
-                       _("checkpoint '%s' does not have a parent"),
-                       chk->def->name);
-        goto cleanup;
-    }
+         /* NB: Let's let QEMU decide how to handle issues with _length
+          * via the JSON error code from the block_set_io_throttle call */
 
-    parent = virGetDomainCheckpoint(checkpoint->domain, chk->def->parent_name);
+        qemuDomainObjEnterMonitor(driver, vm);
+        ret = qemuMonitorSetBlockIoThrottle(priv->mon, drivealias, qdevid,
+                                            &info, supportMaxOptions,
+                                            set_fields & QEMU_BLOCK_IOTUNE_SET_GROUP_NAME,
+                                            supportMaxLengthOptions);
+        if (qemuDomainObjExitMonitor(driver, vm) < 0)
+            ret = -1;
+        if (ret < 0)
+            goto endjob;
+        ret = -1;
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return parent;
-}
+        if (virDomainDiskSetBlockIOTune(disk, &info) < 0)
+            goto endjob;
 
+        qemuDomainSetGroupBlockIoTune(def, &info);
 
-static char *
-qemuDomainCheckpointGetXMLDesc(virDomainCheckpointPtr checkpoint,
-                               unsigned int flags)
-{
-    virDomainObjPtr vm = NULL;
-    char *xml = NULL;
+        if (virDomainObjSave(vm, driver->xmlopt, cfg->stateDir) < 0)
+            goto endjob;
 
-    if (!(vm = qemuDomObjFromCheckpoint(checkpoint)))
-        return NULL;
+        if (eventNparams) {
+            event = virDomainEventTunableNewFromDom(dom, eventParams, eventNparams);
+            eventNparams = 0;
+            virObjectEventStateQueue(driver->domainEventState, event);
+        }
+    }
 
-    if (virDomainCheckpointGetXMLDescEnsureACL(checkpoint->domain->conn, vm->def, flags) < 0)
-        goto cleanup;
+    if (persistentDef) {
+        if (!(conf_disk = virDomainDiskByName(persistentDef, path, true))) {
+            virReportError(VIR_ERR_INVALID_ARG,
+                           _("missing persistent configuration for disk '%s'"),
+                           path);
+            goto endjob;
+        }
 
-    xml = qemuCheckpointGetXMLDesc(vm, checkpoint, flags);
+        conf_cur_info = qemuDomainFindGroupBlockIoTune(persistentDef, conf_disk, &info);
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return xml;
-}
+        if (qemuDomainSetBlockIoTuneDefaults(&conf_info, conf_cur_info,
+                                             set_fields) < 0)
+            goto endjob;
 
+        if (qemuDomainCheckBlockIoTuneReset(conf_disk, &conf_info) < 0)
+            goto endjob;
 
-static int
-qemuDomainCheckpointDelete(virDomainCheckpointPtr checkpoint,
-                           unsigned int flags)
-{
-    virDomainObjPtr vm = NULL;
-    int ret = -1;
+        if (virDomainDiskSetBlockIOTune(conf_disk, &conf_info) < 0)
+            goto endjob;
 
-    if (!(vm = qemuDomObjFromCheckpoint(checkpoint)))
-        return -1;
+        qemuDomainSetGroupBlockIoTune(persistentDef, &conf_info);
 
-    if (virDomainCheckpointDeleteEnsureACL(checkpoint->domain->conn, vm->def) < 0)
-        goto cleanup;
+        if (virDomainDefSave(persistentDef, driver->xmlopt,
+                             cfg->configDir) < 0)
+            goto endjob;
+    }
 
-    ret = qemuCheckpointDelete(vm, checkpoint, flags);
+    ret = 0;
+ endjob:
+    qemuDomainObjEndJob(driver, vm);
 
  cleanup:
+    VIR_FREE(info.group_name);
+    VIR_FREE(conf_info.group_name);
     virDomainObjEndAPI(&vm);
+    if (eventNparams)
+        virTypedParamsFree(eventParams, eventNparams);
     return ret;
 }
 
-
 static int
-qemuDomainBackupBegin(virDomainPtr domain,
-                      const char *backupXML,
-                      const char *checkpointXML,
-                      unsigned int flags)
+qemuDomainGetBlockIoTune(virDomainPtr dom,
+                         const char *path,
+                         virTypedParameterPtr params,
+                         int *nparams,
+                         unsigned int flags)
 {
+    virDomainDiskDefPtr disk;
+    virQEMUDriverPtr driver = dom->conn->privateData;
     virDomainObjPtr vm = NULL;
+    qemuDomainObjPrivatePtr priv = NULL;
+    virDomainDefPtr def = NULL;
+    virDomainDefPtr persistentDef = NULL;
+    virDomainBlockIoTuneInfo reply = {0};
+    g_autofree char *drivealias = NULL;
+    const char *qdevid = NULL;
     int ret = -1;
+    int maxparams;
 
-    if (!(vm = qemuDomainObjFromDomain(domain)))
+    virCheckFlags(VIR_DOMAIN_AFFECT_LIVE |
+                  VIR_DOMAIN_AFFECT_CONFIG |
+                  VIR_TYPED_PARAM_STRING_OKAY, -1);
+
+    /* We don't return strings, and thus trivially support this flag.  */
+    flags &= ~VIR_TYPED_PARAM_STRING_OKAY;
+
+    if (!(vm = qemuDomainObjFromDomain(dom)))
+        return -1;
+
+    priv = vm->privateData;
+
+    if (virDomainGetBlockIoTuneEnsureACL(dom->conn, vm->def) < 0)
         goto cleanup;
 
-    if (virDomainBackupBeginEnsureACL(domain->conn, vm->def) < 0)
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) < 0)
         goto cleanup;
 
-    ret = qemuBackupBegin(vm, backupXML, checkpointXML, flags);
+    /* the API check guarantees that only one of the definitions will be set */
+    if (virDomainObjGetDefs(vm, flags, &def, &persistentDef) < 0)
+        goto endjob;
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return ret;
-}
+    if (def) {
+        /* If the VM is running, we can check if the current VM can use
+         * optional parameters or not. */
+        maxparams = QEMU_NB_BLOCK_IO_TUNE_BASE_PARAMS;
+        if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_DRIVE_IOTUNE_MAX))
+            maxparams += QEMU_NB_BLOCK_IO_TUNE_MAX_PARAMS;
+        if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_DRIVE_IOTUNE_GROUP))
+            maxparams += QEMU_NB_BLOCK_IO_TUNE_GROUP_PARAMS;
+        if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_DRIVE_IOTUNE_MAX_LENGTH))
+            maxparams += QEMU_NB_BLOCK_IO_TUNE_LENGTH_PARAMS;
+    } else {
+        maxparams = QEMU_NB_BLOCK_IO_TUNE_ALL_PARAMS;
+    }
 
+    if (*nparams == 0) {
+        *nparams = maxparams;
+        ret = 0;
+        goto endjob;
+    } else if (*nparams < maxparams) {
+        maxparams = *nparams;
+    }
 
-static char *
-qemuDomainBackupGetXMLDesc(virDomainPtr domain,
-                           unsigned int flags)
-{
-    virDomainObjPtr vm = NULL;
-    char *ret = NULL;
+    *nparams = 0;
 
-    if (!(vm = qemuDomainObjFromDomain(domain)))
-        return NULL;
+    if (def) {
+        if (!(disk = qemuDomainDiskByName(def, path)))
+            goto endjob;
 
-    if (virDomainBackupGetXMLDescEnsureACL(domain->conn, vm->def) < 0)
-        goto cleanup;
+        if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV) &&
+            QEMU_DOMAIN_DISK_PRIVATE(disk)->qomName) {
+            qdevid = QEMU_DOMAIN_DISK_PRIVATE(disk)->qomName;
+        } else {
+            if (!(drivealias = qemuAliasDiskDriveFromDisk(disk)))
+                goto endjob;
+        }
+        qemuDomainObjEnterMonitor(driver, vm);
+        ret = qemuMonitorGetBlockIoThrottle(priv->mon, drivealias, qdevid, &reply);
+        if (qemuDomainObjExitMonitor(driver, vm) < 0)
+            goto endjob;
+        if (ret < 0)
+            goto endjob;
+    }
 
-    ret = qemuBackupGetXMLDesc(vm, flags);
+    if (persistentDef) {
+        if (!(disk = virDomainDiskByName(persistentDef, path, true))) {
+            virReportError(VIR_ERR_INVALID_ARG,
+                           _("disk '%s' was not found in the domain config"),
+                           path);
+            goto endjob;
+        }
+        reply = disk->blkdeviotune;
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return ret;
-}
+        /* Group name needs to be copied since qemuMonitorGetBlockIoThrottle
+         * allocates it as well */
+        reply.group_name = g_strdup(disk->blkdeviotune.group_name);
+    }
+
+#define BLOCK_IOTUNE_ASSIGN(name, var) \
+    if (*nparams < maxparams && \
+        virTypedParameterAssign(&params[(*nparams)++], \
+                                VIR_DOMAIN_BLOCK_IOTUNE_ ## name, \
+                                VIR_TYPED_PARAM_ULLONG, \
+                                reply.var) < 0) \
+        goto endjob
 
 
-static int qemuDomainQemuMonitorCommand(virDomainPtr domain, const char *cmd,
-                                        char **result, unsigned int flags)
-{
-    virQEMUDriverPtr driver = domain->conn->privateData;
-    virDomainObjPtr vm = NULL;
-    int ret = -1;
-    qemuDomainObjPrivatePtr priv;
-    bool hmp;
+    BLOCK_IOTUNE_ASSIGN(TOTAL_BYTES_SEC, total_bytes_sec);
+    BLOCK_IOTUNE_ASSIGN(READ_BYTES_SEC, read_bytes_sec);
+    BLOCK_IOTUNE_ASSIGN(WRITE_BYTES_SEC, write_bytes_sec);
 
-    virCheckFlags(VIR_DOMAIN_QEMU_MONITOR_COMMAND_HMP, -1);
+    BLOCK_IOTUNE_ASSIGN(TOTAL_IOPS_SEC, total_iops_sec);
+    BLOCK_IOTUNE_ASSIGN(READ_IOPS_SEC, read_iops_sec);
+    BLOCK_IOTUNE_ASSIGN(WRITE_IOPS_SEC, write_iops_sec);
 
-    if (!(vm = qemuDomainObjFromDomain(domain)))
-        goto cleanup;
+    BLOCK_IOTUNE_ASSIGN(TOTAL_BYTES_SEC_MAX, total_bytes_sec_max);
+    BLOCK_IOTUNE_ASSIGN(READ_BYTES_SEC_MAX, read_bytes_sec_max);
+    BLOCK_IOTUNE_ASSIGN(WRITE_BYTES_SEC_MAX, write_bytes_sec_max);
 
-    if (virDomainQemuMonitorCommandEnsureACL(domain->conn, vm->def) < 0)
-        goto cleanup;
+    BLOCK_IOTUNE_ASSIGN(TOTAL_IOPS_SEC_MAX, total_iops_sec_max);
+    BLOCK_IOTUNE_ASSIGN(READ_IOPS_SEC_MAX, read_iops_sec_max);
+    BLOCK_IOTUNE_ASSIGN(WRITE_IOPS_SEC_MAX, write_iops_sec_max);
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) < 0)
-        goto cleanup;
+    BLOCK_IOTUNE_ASSIGN(SIZE_IOPS_SEC, size_iops_sec);
 
-    if (virDomainObjCheckActive(vm) < 0)
-        goto endjob;
+    if (*nparams < maxparams) {
+        if (virTypedParameterAssign(&params[(*nparams)++],
+                                    VIR_DOMAIN_BLOCK_IOTUNE_GROUP_NAME,
+                                    VIR_TYPED_PARAM_STRING,
+                                    reply.group_name) < 0)
+            goto endjob;
 
-    priv = vm->privateData;
+        reply.group_name = NULL;
+    }
 
-    qemuDomainObjTaint(driver, vm, VIR_DOMAIN_TAINT_CUSTOM_MONITOR, NULL);
+    BLOCK_IOTUNE_ASSIGN(TOTAL_BYTES_SEC_MAX_LENGTH, total_bytes_sec_max_length);
+    BLOCK_IOTUNE_ASSIGN(READ_BYTES_SEC_MAX_LENGTH, read_bytes_sec_max_length);
+    BLOCK_IOTUNE_ASSIGN(WRITE_BYTES_SEC_MAX_LENGTH, write_bytes_sec_max_length);
 
-    hmp = !!(flags & VIR_DOMAIN_QEMU_MONITOR_COMMAND_HMP);
+    BLOCK_IOTUNE_ASSIGN(TOTAL_IOPS_SEC_MAX_LENGTH, total_iops_sec_max_length);
+    BLOCK_IOTUNE_ASSIGN(READ_IOPS_SEC_MAX_LENGTH, read_iops_sec_max_length);
+    BLOCK_IOTUNE_ASSIGN(WRITE_IOPS_SEC_MAX_LENGTH, write_iops_sec_max_length);
+#undef BLOCK_IOTUNE_ASSIGN
 
-    qemuDomainObjEnterMonitor(driver, vm);
-    ret = qemuMonitorArbitraryCommand(priv->mon, cmd, result, hmp);
-    if (qemuDomainObjExitMonitor(driver, vm) < 0)
-        ret = -1;
+    ret = 0;
 
  endjob:
     qemuDomainObjEndJob(driver, vm);
 
  cleanup:
+    VIR_FREE(reply.group_name);
     virDomainObjEndAPI(&vm);
     return ret;
 }
 
-
 static int
-qemuDomainOpenConsole(virDomainPtr dom,
-                      const char *dev_name,
-                      virStreamPtr st,
-                      unsigned int flags)
+qemuDomainGetDiskErrors(virDomainPtr dom,
+                        virDomainDiskErrorPtr errors,
+                        unsigned int nerrors,
+                        unsigned int flags)
 {
+    virQEMUDriverPtr driver = dom->conn->privateData;
     virDomainObjPtr vm = NULL;
+    qemuDomainObjPrivatePtr priv;
+    virHashTablePtr table = NULL;
+    bool blockdev = false;
     int ret = -1;
     size_t i;
-    virDomainChrDefPtr chr = NULL;
-    qemuDomainObjPrivatePtr priv;
+    int n = 0;
 
-    virCheckFlags(VIR_DOMAIN_CONSOLE_SAFE |
-                  VIR_DOMAIN_CONSOLE_FORCE, -1);
+    virCheckFlags(0, -1);
 
     if (!(vm = qemuDomainObjFromDomain(dom)))
         goto cleanup;
 
-    if (virDomainOpenConsoleEnsureACL(dom->conn, vm->def) < 0)
+    priv = vm->privateData;
+    blockdev = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV);
+
+    if (virDomainGetDiskErrorsEnsureACL(dom->conn, vm->def) < 0)
         goto cleanup;
 
-    if (virDomainObjCheckActive(vm) < 0)
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) < 0)
         goto cleanup;
 
-    priv = vm->privateData;
+    if (virDomainObjCheckActive(vm) < 0)
+        goto endjob;
 
-    if (dev_name) {
-        for (i = 0; !chr && i < vm->def->nconsoles; i++) {
-            if (vm->def->consoles[i]->info.alias &&
-                STREQ(dev_name, vm->def->consoles[i]->info.alias))
-                chr = vm->def->consoles[i];
-        }
-        for (i = 0; !chr && i < vm->def->nserials; i++) {
-            if (STREQ(dev_name, vm->def->serials[i]->info.alias))
-                chr = vm->def->serials[i];
-        }
-        for (i = 0; !chr && i < vm->def->nparallels; i++) {
-            if (STREQ(dev_name, vm->def->parallels[i]->info.alias))
-                chr = vm->def->parallels[i];
-        }
-    } else {
-        if (vm->def->nconsoles)
-            chr = vm->def->consoles[0];
-        else if (vm->def->nserials)
-            chr = vm->def->serials[0];
+    if (!errors) {
+        ret = vm->def->ndisks;
+        goto endjob;
     }
 
-    if (!chr) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("cannot find character device %s"),
-                       NULLSTR(dev_name));
-        goto cleanup;
-    }
+    qemuDomainObjEnterMonitor(driver, vm);
+    table = qemuMonitorGetBlockInfo(priv->mon);
+    if (qemuDomainObjExitMonitor(driver, vm) < 0)
+        goto endjob;
+    if (!table)
+        goto endjob;
+
+    for (i = n = 0; i < vm->def->ndisks; i++) {
+        struct qemuDomainDiskInfo *info;
+        virDomainDiskDefPtr disk = vm->def->disks[i];
+        qemuDomainDiskPrivatePtr diskPriv = QEMU_DOMAIN_DISK_PRIVATE(disk);
+        const char *entryname = disk->info.alias;
+
+        if (blockdev && diskPriv->qomName)
+            entryname = diskPriv->qomName;
+
+        if ((info = virHashLookup(table, entryname)) &&
+            info->io_status != VIR_DOMAIN_DISK_ERROR_NONE) {
+            if (n == nerrors)
+                break;
 
-    if (chr->source->type != VIR_DOMAIN_CHR_TYPE_PTY) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("character device %s is not using a PTY"),
-                       dev_name ? dev_name : NULLSTR(chr->info.alias));
-        goto cleanup;
+            errors[n].disk = g_strdup(disk->dst);
+            errors[n].error = info->io_status;
+            n++;
+        }
     }
 
-    /* handle mutually exclusive access to console devices */
-    ret = virChrdevOpen(priv->devs,
-                        chr->source,
-                        st,
-                        (flags & VIR_DOMAIN_CONSOLE_FORCE) != 0);
+    ret = n;
 
-    if (ret == 1) {
-        virReportError(VIR_ERR_OPERATION_FAILED, "%s",
-                       _("Active console session exists for this domain"));
-        ret = -1;
-    }
+ endjob:
+    qemuDomainObjEndJob(driver, vm);
 
  cleanup:
     virDomainObjEndAPI(&vm);
+    virHashFree(table);
+    if (ret < 0) {
+        for (i = 0; i < n; i++)
+            VIR_FREE(errors[i].disk);
+    }
     return ret;
 }
 
 static int
-qemuDomainOpenChannel(virDomainPtr dom,
-                      const char *name,
-                      virStreamPtr st,
+qemuDomainSetMetadata(virDomainPtr dom,
+                      int type,
+                      const char *metadata,
+                      const char *key,
+                      const char *uri,
                       unsigned int flags)
 {
-    virDomainObjPtr vm = NULL;
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainObjPtr vm;
+    g_autoptr(virQEMUDriverConfig) cfg = NULL;
     int ret = -1;
-    size_t i;
-    virDomainChrDefPtr chr = NULL;
-    qemuDomainObjPrivatePtr priv;
 
-    virCheckFlags(VIR_DOMAIN_CHANNEL_FORCE, -1);
+    virCheckFlags(VIR_DOMAIN_AFFECT_LIVE |
+                  VIR_DOMAIN_AFFECT_CONFIG, -1);
 
     if (!(vm = qemuDomainObjFromDomain(dom)))
-        goto cleanup;
+        return -1;
 
-    if (virDomainOpenChannelEnsureACL(dom->conn, vm->def) < 0)
-        goto cleanup;
+    cfg = virQEMUDriverGetConfig(driver);
 
-    if (virDomainObjCheckActive(vm) < 0)
+    if (virDomainSetMetadataEnsureACL(dom->conn, vm->def, flags) < 0)
         goto cleanup;
 
-    priv = vm->privateData;
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
+        goto cleanup;
 
-    if (name) {
-        for (i = 0; !chr && i < vm->def->nchannels; i++) {
-            if (STREQ(name, vm->def->channels[i]->info.alias))
-                chr = vm->def->channels[i];
+    ret = virDomainObjSetMetadata(vm, type, metadata, key, uri,
+                                  driver->xmlopt, cfg->stateDir,
+                                  cfg->configDir, flags);
 
-            if (vm->def->channels[i]->targetType == \
-                VIR_DOMAIN_CHR_CHANNEL_TARGET_TYPE_VIRTIO &&
-                STREQ_NULLABLE(name, vm->def->channels[i]->target.name))
-                chr = vm->def->channels[i];
-        }
-    } else {
-        if (vm->def->nchannels)
-            chr = vm->def->channels[0];
+    if (ret == 0) {
+        virObjectEventPtr ev = NULL;
+        ev = virDomainEventMetadataChangeNewFromObj(vm, type, uri);
+        virObjectEventStateQueue(driver->domainEventState, ev);
     }
 
-    if (!chr) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("cannot find channel %s"),
-                       NULLSTR(name));
-        goto cleanup;
-    }
+    qemuDomainObjEndJob(driver, vm);
 
-    if (chr->source->type != VIR_DOMAIN_CHR_TYPE_UNIX) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("channel %s is not using a UNIX socket"),
-                       name ? name : NULLSTR(chr->info.alias));
-        goto cleanup;
-    }
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
 
-    /* handle mutually exclusive access to channel devices */
-    ret = virChrdevOpen(priv->devs,
-                        chr->source,
-                        st,
-                        (flags & VIR_DOMAIN_CHANNEL_FORCE) != 0);
+static char *
+qemuDomainGetMetadata(virDomainPtr dom,
+                      int type,
+                      const char *uri,
+                      unsigned int flags)
+{
+    virDomainObjPtr vm;
+    char *ret = NULL;
 
-    if (ret == 1) {
-        virReportError(VIR_ERR_OPERATION_FAILED, "%s",
-                       _("Active channel stream exists for this domain"));
-        ret = -1;
-    }
+    if (!(vm = qemuDomainObjFromDomain(dom)))
+        return NULL;
+
+    if (virDomainGetMetadataEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
+
+    ret = virDomainObjGetMetadata(vm, type, uri, flags);
 
  cleanup:
     virDomainObjEndAPI(&vm);
@@ -17309,488 +21327,385 @@ qemuDomainOpenChannel(virDomainPtr dom,
 }
 
 
-/* Called while holding the VM job lock, to implement a block job
- * abort with pivot; this updates the VM definition as appropriate, on
- * either success or failure.  */
 static int
-qemuDomainBlockPivot(virQEMUDriverPtr driver,
-                     virDomainObjPtr vm,
-                     qemuBlockJobDataPtr job,
-                     virDomainDiskDefPtr disk)
+qemuDomainGetCPUStats(virDomainPtr domain,
+                      virTypedParameterPtr params,
+                      unsigned int nparams,
+                      int start_cpu,
+                      unsigned int ncpus,
+                      unsigned int flags)
 {
-    g_autoptr(qemuBlockStorageSourceChainData) chainattachdata = NULL;
+    virDomainObjPtr vm = NULL;
     int ret = -1;
-    qemuDomainObjPrivatePtr priv = vm->privateData;
-    bool blockdev = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV);
-    g_autoptr(virJSONValue) bitmapactions = NULL;
-    g_autoptr(virJSONValue) reopenactions = NULL;
-
-    if (job->state != QEMU_BLOCKJOB_STATE_READY) {
-        virReportError(VIR_ERR_BLOCK_COPY_ACTIVE,
-                       _("block job '%s' not ready for pivot yet"),
-                       job->name);
-        return -1;
-    }
+    qemuDomainObjPrivatePtr priv;
+    virBitmapPtr guestvcpus = NULL;
 
-    switch ((qemuBlockJobType) job->type) {
-    case QEMU_BLOCKJOB_TYPE_NONE:
-    case QEMU_BLOCKJOB_TYPE_LAST:
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("invalid job type '%d'"), job->type);
-        return -1;
+    virCheckFlags(VIR_TYPED_PARAM_STRING_OKAY, -1);
 
-    case QEMU_BLOCKJOB_TYPE_PULL:
-    case QEMU_BLOCKJOB_TYPE_COMMIT:
-    case QEMU_BLOCKJOB_TYPE_BACKUP:
-    case QEMU_BLOCKJOB_TYPE_INTERNAL:
-    case QEMU_BLOCKJOB_TYPE_CREATE:
-    case QEMU_BLOCKJOB_TYPE_BROKEN:
-        virReportError(VIR_ERR_OPERATION_INVALID,
-                       _("job type '%s' does not support pivot"),
-                       qemuBlockjobTypeToString(job->type));
+    if (!(vm = qemuDomainObjFromDomain(domain)))
         return -1;
 
-    case QEMU_BLOCKJOB_TYPE_COPY:
-        if (blockdev && !job->jobflagsmissing) {
-            bool shallow = job->jobflags & VIR_DOMAIN_BLOCK_COPY_SHALLOW;
-            bool reuse = job->jobflags & VIR_DOMAIN_BLOCK_COPY_REUSE_EXT;
-
-            bitmapactions = virJSONValueNewArray();
-
-            if (qemuMonitorTransactionBitmapAdd(bitmapactions,
-                                                disk->mirror->nodeformat,
-                                                "libvirt-tmp-activewrite",
-                                                false,
-                                                false,
-                                                0) < 0)
-                return -1;
-
-            /* Open and install the backing chain of 'mirror' late if we can use
-             * blockdev-snapshot to do it. This is to appease oVirt that wants
-             * to copy data into the backing chain while the top image is being
-             * copied shallow */
-            if (reuse && shallow &&
-                virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV_SNAPSHOT_ALLOW_WRITE_ONLY) &&
-                virStorageSourceHasBacking(disk->mirror)) {
+    priv = vm->privateData;
 
-                if (!(chainattachdata = qemuBuildStorageSourceChainAttachPrepareBlockdev(disk->mirror->backingStore,
-                                                                                         priv->qemuCaps)))
-                    return -1;
+    if (virDomainGetCPUStatsEnsureACL(domain->conn, vm->def) < 0)
+        goto cleanup;
 
-                reopenactions = virJSONValueNewArray();
+    if (virDomainObjCheckActive(vm) < 0)
+        goto cleanup;
 
-                if (qemuMonitorTransactionSnapshotBlockdev(reopenactions,
-                                                           disk->mirror->backingStore->nodeformat,
-                                                           disk->mirror->nodeformat))
-                    return -1;
-            }
+    if (!virCgroupHasController(priv->cgroup, VIR_CGROUP_CONTROLLER_CPUACCT)) {
+        virReportError(VIR_ERR_OPERATION_INVALID,
+                       "%s", _("cgroup CPUACCT controller is not mounted"));
+        goto cleanup;
+    }
 
-        }
-        break;
+    if (qemuDomainHasVcpuPids(vm) &&
+        !(guestvcpus = virDomainDefGetOnlineVcpumap(vm->def)))
+        goto cleanup;
 
-    case QEMU_BLOCKJOB_TYPE_ACTIVE_COMMIT:
-        if (blockdev) {
-            bitmapactions = virJSONValueNewArray();
+    if (start_cpu == -1)
+        ret = virCgroupGetDomainTotalCpuStats(priv->cgroup,
+                                              params, nparams);
+    else
+        ret = virCgroupGetPercpuStats(priv->cgroup, params, nparams,
+                                      start_cpu, ncpus, guestvcpus);
+ cleanup:
+    virBitmapFree(guestvcpus);
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
 
-            if (qemuMonitorTransactionBitmapAdd(bitmapactions,
-                                                job->data.commit.base->nodeformat,
-                                                "libvirt-tmp-activewrite",
-                                                false,
-                                                false,
-                                                0) < 0)
-                return -1;
-        }
 
-        break;
-    }
+static int
+qemuDomainProbeQMPCurrentMachine(virQEMUDriverPtr driver,
+                                 virDomainObjPtr vm,
+                                 bool *wakeupSupported)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    qemuMonitorCurrentMachineInfo info = { 0 };
+    int rv;
 
     qemuDomainObjEnterMonitor(driver, vm);
-    if (blockdev) {
-        int rc = 0;
+    rv = qemuMonitorGetCurrentMachineInfo(priv->mon, &info);
+    if (qemuDomainObjExitMonitor(driver, vm) < 0 ||
+        rv < 0)
+        return -1;
+
+    *wakeupSupported = info.wakeupSuspendSupport;
+    return 0;
+}
 
-        if (chainattachdata) {
-            if ((rc = qemuBlockStorageSourceChainAttach(priv->mon, chainattachdata)) == 0) {
-                /* install backing images on success, or unplug them on failure */
-                if ((rc = qemuMonitorTransaction(priv->mon, &reopenactions)) != 0)
-                    qemuBlockStorageSourceChainDetach(priv->mon, chainattachdata);
-            }
-        }
 
-        if (bitmapactions && rc == 0)
-            ignore_value(qemuMonitorTransaction(priv->mon, &bitmapactions));
+/* returns -1 on error, or if query is not supported, 0 if query was successful */
+static int
+qemuDomainQueryWakeupSuspendSupport(virQEMUDriverPtr driver,
+                                    virDomainObjPtr vm,
+                                    bool *wakeupSupported)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    int ret = -1;
 
-        if (rc == 0)
-            ret = qemuMonitorJobComplete(priv->mon, job->name);
-    } else {
-        ret = qemuMonitorDrivePivot(priv->mon, job->name);
-    }
-    if (qemuDomainObjExitMonitor(driver, vm) < 0)
+    if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_QUERY_CURRENT_MACHINE))
         return -1;
 
-    /* The pivot failed. The block job in QEMU remains in the synchronised state */
-    if (ret < 0)
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
         return -1;
 
-    if (disk && disk->mirror)
-        disk->mirrorState = VIR_DOMAIN_DISK_MIRROR_STATE_PIVOT;
-    job->state = QEMU_BLOCKJOB_STATE_PIVOTING;
+    if ((ret = virDomainObjCheckActive(vm)) < 0)
+        goto endjob;
+
+    ret = qemuDomainProbeQMPCurrentMachine(driver, vm, wakeupSupported);
 
+ endjob:
+    qemuDomainObjEndJob(driver, vm);
     return ret;
 }
 
 
-/* bandwidth in MiB/s per public API. Caller must lock vm beforehand,
- * and not access it afterwards.  */
 static int
-qemuDomainBlockPullCommon(virDomainObjPtr vm,
-                          const char *path,
-                          const char *base,
-                          unsigned long bandwidth,
-                          unsigned int flags)
+qemuDomainPMSuspendAgent(virQEMUDriverPtr driver,
+                         virDomainObjPtr vm,
+                         unsigned int target)
 {
-    qemuDomainObjPrivatePtr priv = vm->privateData;
-    virQEMUDriverPtr driver = priv->driver;
-    const char *device = NULL;
-    const char *jobname = NULL;
-    virDomainDiskDefPtr disk;
-    virStorageSourcePtr baseSource = NULL;
-    unsigned int baseIndex = 0;
-    g_autofree char *basePath = NULL;
-    g_autofree char *backingPath = NULL;
-    unsigned long long speed = bandwidth;
-    qemuBlockJobDataPtr job = NULL;
-    bool persistjob = false;
-    const char *nodebase = NULL;
-    bool blockdev = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV);
+    qemuAgentPtr agent;
     int ret = -1;
 
-    if (flags & VIR_DOMAIN_BLOCK_REBASE_RELATIVE && !base) {
-        virReportError(VIR_ERR_INVALID_ARG, "%s",
-                       _("flag VIR_DOMAIN_BLOCK_REBASE_RELATIVE is valid only "
-                         "with non-null base"));
-        goto cleanup;
-    }
-
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
-        goto cleanup;
-
-    if (virDomainObjCheckActive(vm) < 0)
-        goto endjob;
+    if (qemuDomainObjBeginAgentJob(driver, vm, QEMU_AGENT_JOB_MODIFY) < 0)
+        return -1;
 
-    if (qemuDomainSupportsCheckpointsBlockjobs(vm) < 0)
+    if ((ret = virDomainObjCheckActive(vm)) < 0)
         goto endjob;
 
-    if (!(disk = qemuDomainDiskByName(vm->def, path)))
+    if (!qemuDomainAgentAvailable(vm, true))
         goto endjob;
 
-    if (qemuDomainDiskBlockJobIsActive(disk))
-        goto endjob;
+    agent = qemuDomainObjEnterAgent(vm);
+    ret = qemuAgentSuspend(agent, target);
+    qemuDomainObjExitAgent(vm, agent);
 
-    if (!qemuDomainDiskBlockJobIsSupported(vm, disk))
-        goto endjob;
+ endjob:
+    qemuDomainObjEndAgentJob(vm);
+    return ret;
+}
 
-    if (base &&
-        (virStorageFileParseChainIndex(disk->dst, base, &baseIndex) < 0 ||
-         !(baseSource = virStorageFileChainLookup(disk->src, disk->src,
-                                                  base, baseIndex, NULL))))
-        goto endjob;
 
-    if (baseSource) {
-        if (flags & VIR_DOMAIN_BLOCK_REBASE_RELATIVE) {
-            if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_CHANGE_BACKING_FILE)) {
-                virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
-                               _("this QEMU binary doesn't support relative "
-                                 "block pull/rebase"));
-                goto endjob;
-            }
+static int
+qemuDomainPMSuspendForDuration(virDomainPtr dom,
+                               unsigned int target,
+                               unsigned long long duration,
+                               unsigned int flags)
+{
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainObjPtr vm;
+    int ret = -1;
+    bool wakeupSupported;
 
-            if (blockdev &&
-                qemuBlockUpdateRelativeBacking(vm, disk->src, disk->src) < 0)
-                goto endjob;
+    virCheckFlags(0, -1);
 
-            if (virStorageFileGetRelativeBackingPath(disk->src->backingStore,
-                                                     baseSource,
-                                                     &backingPath) < 0)
-                goto endjob;
+    if (duration) {
+        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED, "%s",
+                       _("Duration not supported. Use 0 for now"));
+        return -1;
+    }
 
-            if (!backingPath) {
-                virReportError(VIR_ERR_OPERATION_INVALID, "%s",
-                               _("can't keep relative backing relationship"));
-                goto endjob;
-            }
-        }
+    if (!(target == VIR_NODE_SUSPEND_TARGET_MEM ||
+          target == VIR_NODE_SUSPEND_TARGET_DISK ||
+          target == VIR_NODE_SUSPEND_TARGET_HYBRID)) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("Unknown suspend target: %u"),
+                       target);
+        return -1;
     }
 
-    /* Convert bandwidth MiB to bytes, if needed */
-    if (!(flags & VIR_DOMAIN_BLOCK_PULL_BANDWIDTH_BYTES)) {
-        if (speed > LLONG_MAX >> 20) {
-            virReportError(VIR_ERR_OVERFLOW,
-                           _("bandwidth must be less than %llu"),
-                           LLONG_MAX >> 20);
-            goto endjob;
+    if (!(vm = qemuDomainObjFromDomain(dom)))
+        goto cleanup;
+
+    if (virDomainPMSuspendForDurationEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
+
+    /*
+     * The case we want to handle here is when QEMU has the API (i.e.
+     * QEMU_CAPS_QUERY_CURRENT_MACHINE is set). Otherwise, do not interfere
+     * with the suspend process. This means that existing running domains,
+     * that don't know about this cap, will keep their old behavior of
+     * suspending 'in the dark'.
+     */
+    if (qemuDomainQueryWakeupSuspendSupport(driver, vm, &wakeupSupported) == 0) {
+        if (!wakeupSupported) {
+            virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                           _("Domain does not have suspend support"));
+            goto cleanup;
         }
-        speed <<= 20;
     }
 
-    if (!(job = qemuBlockJobDiskNewPull(vm, disk, baseSource, flags)))
-        goto endjob;
+    if (vm->def->pm.s3 || vm->def->pm.s4) {
+        if (vm->def->pm.s3 == VIR_TRISTATE_BOOL_NO &&
+            (target == VIR_NODE_SUSPEND_TARGET_MEM ||
+             target == VIR_NODE_SUSPEND_TARGET_HYBRID)) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("S3 state is disabled for this domain"));
+            goto cleanup;
+        }
 
-    if (blockdev) {
-        jobname = job->name;
-        persistjob = true;
-        if (baseSource) {
-            nodebase = baseSource->nodeformat;
-            if (!backingPath &&
-                !(backingPath = qemuBlockGetBackingStoreString(baseSource, false)))
-                goto endjob;
+        if (vm->def->pm.s4 == VIR_TRISTATE_BOOL_NO &&
+            target == VIR_NODE_SUSPEND_TARGET_DISK) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("S4 state is disabled for this domain"));
+            goto cleanup;
         }
-        device = disk->src->nodeformat;
-    } else {
-        device = job->name;
     }
 
-    qemuDomainObjEnterMonitor(driver, vm);
-    if (!blockdev && baseSource)
-        basePath = qemuMonitorDiskNameLookup(priv->mon, device, disk->src,
-                                             baseSource);
+    ret = qemuDomainPMSuspendAgent(driver, vm, target);
 
-    if (blockdev ||
-        (!baseSource || basePath))
-        ret = qemuMonitorBlockStream(priv->mon, device, jobname, persistjob, basePath,
-                                     nodebase, backingPath, speed);
-    if (qemuDomainObjExitMonitor(driver, vm) < 0)
-        ret = -1;
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
 
-    if (ret < 0)
+static int
+qemuDomainPMWakeup(virDomainPtr dom,
+                   unsigned int flags)
+{
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainObjPtr vm;
+    int ret = -1;
+    qemuDomainObjPrivatePtr priv;
+
+    virCheckFlags(0, -1);
+
+    if (!(vm = qemuDomainObjFromDomain(dom)))
+        goto cleanup;
+
+    if (virDomainPMWakeupEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
+
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
+        goto cleanup;
+
+    if (virDomainObjCheckActive(vm) < 0)
         goto endjob;
 
-    qemuBlockJobStarted(job, vm);
+    priv = vm->privateData;
+
+    qemuDomainObjEnterMonitor(driver, vm);
+    ret = qemuMonitorSystemWakeup(priv->mon);
+    if (qemuDomainObjExitMonitor(driver, vm) < 0)
+        ret = -1;
 
  endjob:
     qemuDomainObjEndJob(driver, vm);
 
  cleanup:
-    qemuBlockJobStartupFinalize(vm, job);
     virDomainObjEndAPI(&vm);
     return ret;
 }
 
-
 static int
-qemuDomainBlockJobAbort(virDomainPtr dom,
-                        const char *path,
-                        unsigned int flags)
+qemuConnectListAllDomains(virConnectPtr conn,
+                          virDomainPtr **domains,
+                          unsigned int flags)
+{
+    virQEMUDriverPtr driver = conn->privateData;
+
+    virCheckFlags(VIR_CONNECT_LIST_DOMAINS_FILTERS_ALL, -1);
+
+    if (virConnectListAllDomainsEnsureACL(conn) < 0)
+        return -1;
+
+    return virDomainObjListExport(driver->domains, conn, domains,
+                                  virConnectListAllDomainsCheckACL, flags);
+}
+
+static char *
+qemuDomainQemuAgentCommand(virDomainPtr domain,
+                           const char *cmd,
+                           int timeout,
+                           unsigned int flags)
 {
-    virQEMUDriverPtr driver = dom->conn->privateData;
-    virDomainDiskDefPtr disk = NULL;
-    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
-    bool pivot = !!(flags & VIR_DOMAIN_BLOCK_JOB_ABORT_PIVOT);
-    bool async = !!(flags & VIR_DOMAIN_BLOCK_JOB_ABORT_ASYNC);
-    g_autoptr(qemuBlockJobData) job = NULL;
+    virQEMUDriverPtr driver = domain->conn->privateData;
     virDomainObjPtr vm;
-    qemuDomainObjPrivatePtr priv = NULL;
-    bool blockdev = false;
     int ret = -1;
+    char *result = NULL;
+    qemuAgentPtr agent;
 
-    virCheckFlags(VIR_DOMAIN_BLOCK_JOB_ABORT_ASYNC |
-                  VIR_DOMAIN_BLOCK_JOB_ABORT_PIVOT, -1);
+    virCheckFlags(0, NULL);
 
-    if (!(vm = qemuDomainObjFromDomain(dom)))
-        return -1;
+    if (!(vm = qemuDomainObjFromDomain(domain)))
+        goto cleanup;
 
-    if (virDomainBlockJobAbortEnsureACL(dom->conn, vm->def) < 0)
+    if (virDomainQemuAgentCommandEnsureACL(domain->conn, vm->def) < 0)
         goto cleanup;
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
+    if (qemuDomainObjBeginAgentJob(driver, vm, QEMU_AGENT_JOB_MODIFY) < 0)
         goto cleanup;
 
     if (virDomainObjCheckActive(vm) < 0)
         goto endjob;
 
-    if (!(disk = qemuDomainDiskByName(vm->def, path)))
-        goto endjob;
-
-    if (!(job = qemuBlockJobDiskGetJob(disk))) {
-        virReportError(VIR_ERR_INVALID_ARG,
-                       _("disk %s does not have an active block job"), disk->dst);
-        goto endjob;
-    }
-
-    priv = vm->privateData;
-    blockdev = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV);
-
-    if (job->state == QEMU_BLOCKJOB_STATE_ABORTING ||
-        job->state == QEMU_BLOCKJOB_STATE_PIVOTING) {
-        virReportError(VIR_ERR_OPERATION_INVALID,
-                       _("block job on disk '%s' is still being ended"),
-                       disk->dst);
+    if (!qemuDomainAgentAvailable(vm, true))
         goto endjob;
-    }
 
-    if (!async)
-        qemuBlockJobSyncBegin(job);
-
-    if (pivot) {
-        if ((ret = qemuDomainBlockPivot(driver, vm, job, disk)) < 0)
-            goto endjob;
-    } else {
-        qemuDomainObjEnterMonitor(driver, vm);
-        if (blockdev)
-            ret = qemuMonitorJobCancel(priv->mon, job->name, false);
-        else
-            ret = qemuMonitorBlockJobCancel(priv->mon, job->name);
-        if (qemuDomainObjExitMonitor(driver, vm) < 0) {
-            ret = -1;
-            goto endjob;
-        }
+    qemuDomainObjTaint(driver, vm, VIR_DOMAIN_TAINT_CUSTOM_GA_COMMAND, NULL);
 
-        if (ret < 0)
-            goto endjob;
+    agent = qemuDomainObjEnterAgent(vm);
+    ret = qemuAgentArbitraryCommand(agent, cmd, &result, timeout);
+    qemuDomainObjExitAgent(vm, agent);
+    if (ret < 0)
+        VIR_FREE(result);
 
-        if (disk->mirror)
-            disk->mirrorState = VIR_DOMAIN_DISK_MIRROR_STATE_ABORT;
-        job->state = QEMU_BLOCKJOB_STATE_ABORTING;
-    }
+ endjob:
+    qemuDomainObjEndAgentJob(vm);
 
-    ignore_value(virDomainObjSave(vm, driver->xmlopt, cfg->stateDir));
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return result;
+}
 
-    if (!async) {
-        qemuBlockJobUpdate(vm, job, QEMU_ASYNC_JOB_NONE);
-        while (qemuBlockJobIsRunning(job)) {
-            if (virDomainObjWait(vm) < 0) {
-                ret = -1;
-                goto endjob;
-            }
-            qemuBlockJobUpdate(vm, job, QEMU_ASYNC_JOB_NONE);
-        }
 
-        if (pivot &&
-            job->state == QEMU_BLOCKJOB_STATE_FAILED) {
-            if (job->errmsg) {
-                virReportError(VIR_ERR_OPERATION_FAILED,
-                               _("block job '%s' failed while pivoting"),
-                               job->name);
-            } else {
-                virReportError(VIR_ERR_OPERATION_FAILED,
-                               _("block job '%s' failed while pivoting: %s"),
-                               job->name, job->errmsg);
-            }
+static int
+qemuConnectDomainQemuMonitorEventRegister(virConnectPtr conn,
+                                          virDomainPtr dom,
+                                          const char *event,
+                                          virConnectDomainQemuMonitorEventCallback callback,
+                                          void *opaque,
+                                          virFreeCallback freecb,
+                                          unsigned int flags)
+{
+    virQEMUDriverPtr driver = conn->privateData;
+    int ret = -1;
 
-            ret = -1;
-            goto endjob;
-        }
-    }
+    if (virConnectDomainQemuMonitorEventRegisterEnsureACL(conn) < 0)
+        return -1;
 
- endjob:
-    if (job && !async)
-        qemuBlockJobSyncEnd(vm, job, QEMU_ASYNC_JOB_NONE);
-    qemuDomainObjEndJob(driver, vm);
+    if (virDomainQemuMonitorEventStateRegisterID(conn,
+                                                 driver->domainEventState,
+                                                 dom, event, callback,
+                                                 opaque, freecb, flags,
+                                                 &ret) < 0)
+        ret = -1;
 
- cleanup:
-    virDomainObjEndAPI(&vm);
     return ret;
 }
 
 
 static int
-qemuBlockJobInfoTranslate(qemuMonitorBlockJobInfoPtr rawInfo,
-                          virDomainBlockJobInfoPtr info,
-                          virDomainDiskDefPtr disk,
-                          bool reportBytes)
+qemuConnectDomainQemuMonitorEventDeregister(virConnectPtr conn,
+                                            int callbackID)
 {
-    info->cur = rawInfo->cur;
-    info->end = rawInfo->end;
-
-    /* Fix job completeness reporting. If cur == end mgmt
-     * applications think job is completed. Except when both cur
-     * and end are zero, in which case qemu hasn't started the
-     * job yet. */
-    if (!info->cur && !info->end) {
-        if (rawInfo->ready > 0) {
-            info->cur = info->end = 1;
-        } else if (!rawInfo->ready) {
-            info->end = 1;
-        }
-    }
-
-    /* If qemu reports that it's not ready yet don't make the job go to
-     * cur == end as some apps wrote code polling this instead of waiting for
-     * the ready event */
-    if (rawInfo->ready == 0 &&
-        info->cur == info->end &&
-        info->cur > 0)
-        info->cur -= 1;
+    virQEMUDriverPtr driver = conn->privateData;
 
-    info->type = rawInfo->type;
-    if (info->type == VIR_DOMAIN_BLOCK_JOB_TYPE_COMMIT &&
-        disk->mirrorJob == VIR_DOMAIN_BLOCK_JOB_TYPE_ACTIVE_COMMIT)
-        info->type = disk->mirrorJob;
+    if (virConnectDomainQemuMonitorEventDeregisterEnsureACL(conn) < 0)
+        return -1;
 
-    if (rawInfo->bandwidth && !reportBytes)
-        rawInfo->bandwidth = VIR_DIV_UP(rawInfo->bandwidth, 1024 * 1024);
-    info->bandwidth = rawInfo->bandwidth;
-    if (info->bandwidth != rawInfo->bandwidth) {
-        virReportError(VIR_ERR_OVERFLOW,
-                       _("bandwidth %llu cannot be represented in result"),
-                       rawInfo->bandwidth);
+    if (virObjectEventStateDeregisterID(conn, driver->domainEventState,
+                                        callbackID, true) < 0)
         return -1;
-    }
 
     return 0;
 }
 
 
 static int
-qemuDomainGetBlockJobInfo(virDomainPtr dom,
-                          const char *path,
-                          virDomainBlockJobInfoPtr info,
-                          unsigned int flags)
+qemuDomainFSTrim(virDomainPtr dom,
+                 const char *mountPoint,
+                 unsigned long long minimum,
+                 unsigned int flags)
 {
     virQEMUDriverPtr driver = dom->conn->privateData;
     virDomainObjPtr vm;
-    virDomainDiskDefPtr disk;
+    qemuAgentPtr agent;
     int ret = -1;
-    qemuMonitorBlockJobInfo rawInfo;
-    g_autoptr(qemuBlockJobData) job = NULL;
 
-    virCheckFlags(VIR_DOMAIN_BLOCK_JOB_INFO_BANDWIDTH_BYTES, -1);
+    virCheckFlags(0, -1);
 
-    if (!(vm = qemuDomainObjFromDomain(dom)))
+    if (mountPoint) {
+        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED, "%s",
+                       _("Specifying mount point "
+                         "is not supported for now"));
         return -1;
+    }
 
-    if (virDomainGetBlockJobInfoEnsureACL(dom->conn, vm->def) < 0)
+    if (!(vm = qemuDomainObjFromDomain(dom)))
         goto cleanup;
 
-
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) < 0)
+    if (virDomainFSTrimEnsureACL(dom->conn, vm->def) < 0)
         goto cleanup;
 
-    if (virDomainObjCheckActive(vm) < 0)
-        goto endjob;
-
-    if (!(disk = qemuDomainDiskByName(vm->def, path)))
-        goto endjob;
+    if (qemuDomainObjBeginAgentJob(driver, vm, QEMU_AGENT_JOB_MODIFY) < 0)
+        goto cleanup;
 
-    if (!(job = qemuBlockJobDiskGetJob(disk))) {
-        ret = 0;
+    if (!qemuDomainAgentAvailable(vm, true))
         goto endjob;
-    }
 
-    qemuDomainObjEnterMonitor(driver, vm);
-    ret = qemuMonitorGetBlockJobInfo(qemuDomainGetMonitor(vm), job->name, &rawInfo);
-    if (qemuDomainObjExitMonitor(driver, vm) < 0)
-        ret = -1;
-    if (ret <= 0)
+    if (virDomainObjCheckActive(vm) < 0)
         goto endjob;
 
-    if (qemuBlockJobInfoTranslate(&rawInfo, info, disk,
-                                  flags & VIR_DOMAIN_BLOCK_JOB_INFO_BANDWIDTH_BYTES) < 0) {
-        ret = -1;
-        goto endjob;
-    }
+    agent = qemuDomainObjEnterAgent(vm);
+    ret = qemuAgentFSTrim(agent, minimum);
+    qemuDomainObjExitAgent(vm, agent);
 
  endjob:
-    qemuDomainObjEndJob(driver, vm);
+    qemuDomainObjEndAgentJob(vm);
 
  cleanup:
     virDomainObjEndAPI(&vm);
@@ -17799,3961 +21714,4678 @@ qemuDomainGetBlockJobInfo(virDomainPtr dom,
 
 
 static int
-qemuDomainBlockJobSetSpeed(virDomainPtr dom,
-                           const char *path,
-                           unsigned long bandwidth,
-                           unsigned int flags)
+qemuNodeGetInfo(virConnectPtr conn,
+                virNodeInfoPtr nodeinfo)
 {
-    virQEMUDriverPtr driver = dom->conn->privateData;
-    virDomainDiskDefPtr disk;
-    int ret = -1;
-    virDomainObjPtr vm;
-    unsigned long long speed = bandwidth;
-    g_autoptr(qemuBlockJobData) job = NULL;
-
-    virCheckFlags(VIR_DOMAIN_BLOCK_JOB_SPEED_BANDWIDTH_BYTES, -1);
-
-    /* Convert bandwidth MiB to bytes, if needed */
-    if (!(flags & VIR_DOMAIN_BLOCK_JOB_SPEED_BANDWIDTH_BYTES)) {
-        if (speed > LLONG_MAX >> 20) {
-            virReportError(VIR_ERR_OVERFLOW,
-                           _("bandwidth must be less than %llu"),
-                           LLONG_MAX >> 20);
-            return -1;
-        }
-        speed <<= 20;
-    }
-
-    if (!(vm = qemuDomainObjFromDomain(dom)))
+    if (virNodeGetInfoEnsureACL(conn) < 0)
         return -1;
 
-    if (virDomainBlockJobSetSpeedEnsureACL(dom->conn, vm->def) < 0)
-        goto cleanup;
+    return virCapabilitiesGetNodeInfo(nodeinfo);
+}
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
-        goto cleanup;
 
-    if (virDomainObjCheckActive(vm) < 0)
-        goto endjob;
+static int
+qemuNodeGetCPUStats(virConnectPtr conn,
+                    int cpuNum,
+                    virNodeCPUStatsPtr params,
+                    int *nparams,
+                    unsigned int flags)
+{
+    if (virNodeGetCPUStatsEnsureACL(conn) < 0)
+        return -1;
 
-    if (!(disk = qemuDomainDiskByName(vm->def, path)))
-        goto endjob;
+    return virHostCPUGetStats(cpuNum, params, nparams, flags);
+}
 
-    if (!(job = qemuBlockJobDiskGetJob(disk))) {
-        virReportError(VIR_ERR_INVALID_ARG,
-                       _("disk %s does not have an active block job"), disk->dst);
-        goto endjob;
-    }
 
-    qemuDomainObjEnterMonitor(driver, vm);
-    ret = qemuMonitorBlockJobSetSpeed(qemuDomainGetMonitor(vm),
-                                      job->name,
-                                      speed);
-    if (qemuDomainObjExitMonitor(driver, vm) < 0)
-        ret = -1;
+static int
+qemuNodeGetMemoryStats(virConnectPtr conn,
+                       int cellNum,
+                       virNodeMemoryStatsPtr params,
+                       int *nparams,
+                       unsigned int flags)
+{
+    if (virNodeGetMemoryStatsEnsureACL(conn) < 0)
+        return -1;
 
- endjob:
-    qemuDomainObjEndJob(driver, vm);
+    return virHostMemGetStats(cellNum, params, nparams, flags);
+}
 
- cleanup:
-    virDomainObjEndAPI(&vm);
 
-    return ret;
+static int
+qemuNodeGetCellsFreeMemory(virConnectPtr conn,
+                           unsigned long long *freeMems,
+                           int startCell,
+                           int maxCells)
+{
+    if (virNodeGetCellsFreeMemoryEnsureACL(conn) < 0)
+        return -1;
+
+    return virHostMemGetCellsFree(freeMems, startCell, maxCells);
 }
 
 
-static int
-qemuDomainBlockCopyValidateMirror(virStorageSourcePtr mirror,
-                                  const char *dst,
-                                  bool *reuse)
+static unsigned long long
+qemuNodeGetFreeMemory(virConnectPtr conn)
 {
-    int desttype = virStorageSourceGetActualType(mirror);
-    struct stat st;
+    unsigned long long freeMem;
 
-    if (!virStorageSourceIsLocalStorage(mirror))
+    if (virNodeGetFreeMemoryEnsureACL(conn) < 0)
         return 0;
 
-    if (virStorageFileAccess(mirror, F_OK) < 0) {
-        if (errno != ENOENT) {
-            virReportSystemError(errno, "%s",
-                                 _("unable to verify existence of "
-                                   "block copy target"));
-            return -1;
-        }
+    if (virHostMemGetInfo(NULL, &freeMem) < 0)
+        return 0;
 
-        if (*reuse || desttype == VIR_STORAGE_TYPE_BLOCK) {
-            virReportSystemError(errno,
-                                 _("missing destination file for disk %s: %s"),
-                                 dst, mirror->path);
-            return -1;
-        }
-    } else {
-        if (virStorageFileStat(mirror, &st) < 0) {
-            virReportSystemError(errno,
-                                 _("unable to stat block copy target '%s'"),
-                                 mirror->path);
-            return -1;
-        }
+    return freeMem;
+}
 
-        if (S_ISBLK(st.st_mode)) {
-            /* if the target is a block device, assume that we are reusing it,
-             * so there are no attempts to create it */
-            *reuse = true;
-        } else {
-            if (st.st_size && !(*reuse)) {
-                virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
-                               _("external destination file for disk %s already "
-                                 "exists and is not a block device: %s"),
-                               dst, mirror->path);
-                return -1;
-            }
 
-            if (desttype == VIR_STORAGE_TYPE_BLOCK) {
-                virReportError(VIR_ERR_INVALID_ARG,
-                               _("blockdev flag requested for disk %s, but file "
-                                 "'%s' is not a block device"),
-                               dst, mirror->path);
-                return -1;
-            }
-        }
-    }
+static int
+qemuNodeGetMemoryParameters(virConnectPtr conn,
+                            virTypedParameterPtr params,
+                            int *nparams,
+                            unsigned int flags)
+{
+    if (virNodeGetMemoryParametersEnsureACL(conn) < 0)
+        return -1;
 
-    return 0;
+    return virHostMemGetParameters(params, nparams, flags);
 }
 
 
-/**
- * qemuDomainBlockCopyCommonValidateUserMirrorBackingStore:
- * @mirror: target of the block copy
- * @flags: block copy API flags
- * @blockdev: true if blockdev is used for the VM
- *
- * Validates whether backingStore of @mirror makes sense according to @flags.
- * This makes sure that:
- * 1) mirror has a terminator if it isn't supposed to have backing chain
- * 2) if shallow copy is requested there is a chain or prepopulated image
- * 3) user specified chain is present only when blockdev is used
- * 4) if deep copy is requested, there's no chain
- */
 static int
-qemuDomainBlockCopyCommonValidateUserMirrorBackingStore(virStorageSourcePtr mirror,
-                                                        bool shallow,
-                                                        bool blockdev)
+qemuNodeSetMemoryParameters(virConnectPtr conn,
+                            virTypedParameterPtr params,
+                            int nparams,
+                            unsigned int flags)
 {
-    if (!virStorageSourceHasBacking(mirror)) {
-        /* for deep copy there won't be backing chain so we can terminate it */
-        if (!mirror->backingStore &&
-            !shallow &&
-            !(mirror->backingStore = virStorageSourceNew()))
-            return -1;
+    if (virNodeSetMemoryParametersEnsureACL(conn) < 0)
+        return -1;
 
-        /* When reusing an external image we document that the user must ensure
-         * that the <mirror> image must expose data as the original image did
-         * either by providing correct chain or prepopulating the image. This
-         * means we can't validate this any more regardless of whether shallow
-         * copy is requested.
-         *
-         * For a copy when we are not reusing external image requesting shallow
-         * is okay and will inherit the original backing chain */
-    } else {
-        if (!blockdev) {
-            virReportError(VIR_ERR_INVALID_ARG, "%s",
-                           _("backingStore of mirror target is not supported by this qemu"));
-            return -1;
-        }
+    return virHostMemSetParameters(params, nparams, flags);
+}
 
-        if (!shallow) {
-            virReportError(VIR_ERR_INVALID_ARG, "%s",
-                           _("backingStore of mirror without VIR_DOMAIN_BLOCK_COPY_SHALLOW doesn't make sense"));
-            return -1;
-        }
 
-        if (qemuDomainStorageSourceValidateDepth(mirror, 0, NULL) < 0)
-            return -1;
-    }
+static int
+qemuNodeGetCPUMap(virConnectPtr conn,
+                  unsigned char **cpumap,
+                  unsigned int *online,
+                  unsigned int flags)
+{
+    if (virNodeGetCPUMapEnsureACL(conn) < 0)
+        return -1;
 
-    return 0;
+    return virHostCPUGetMap(cpumap, online, flags);
 }
 
 
-/* bandwidth in bytes/s.  Caller must lock vm beforehand, and not
- * access mirror afterwards.  */
 static int
-qemuDomainBlockCopyCommon(virDomainObjPtr vm,
-                          virConnectPtr conn,
-                          const char *path,
-                          virStorageSourcePtr mirrorsrc,
-                          unsigned long long bandwidth,
-                          unsigned int granularity,
-                          unsigned long long buf_size,
-                          unsigned int flags,
-                          bool keepParentLabel)
+qemuNodeSuspendForDuration(virConnectPtr conn,
+                           unsigned int target,
+                           unsigned long long duration,
+                           unsigned int flags)
 {
-    virQEMUDriverPtr driver = conn->privateData;
-    qemuDomainObjPrivatePtr priv = vm->privateData;
-    virDomainDiskDefPtr disk = NULL;
-    int ret = -1;
-    bool need_unlink = false;
-    bool need_revoke = false;
-    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
-    const char *format = NULL;
-    bool mirror_reuse = !!(flags & VIR_DOMAIN_BLOCK_COPY_REUSE_EXT);
-    bool mirror_shallow = !!(flags & VIR_DOMAIN_BLOCK_COPY_SHALLOW);
-    bool existing = mirror_reuse;
-    qemuBlockJobDataPtr job = NULL;
-    g_autoptr(virStorageSource) mirror = mirrorsrc;
-    bool blockdev = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV);
-    bool supports_create = false;
-    bool supports_access = false;
-    bool supports_detect = false;
-    g_autoptr(qemuBlockStorageSourceChainData) data = NULL;
-    g_autoptr(qemuBlockStorageSourceChainData) crdata = NULL;
-    virStorageSourcePtr n;
-    virStorageSourcePtr mirrorBacking = NULL;
-    g_autoptr(virHashTable) blockNamedNodeData = NULL;
-    int rc = 0;
+    if (virNodeSuspendForDurationEnsureACL(conn) < 0)
+        return -1;
 
-    /* Preliminaries: find the disk we are editing, sanity checks */
-    virCheckFlags(VIR_DOMAIN_BLOCK_COPY_SHALLOW |
-                  VIR_DOMAIN_BLOCK_COPY_REUSE_EXT |
-                  VIR_DOMAIN_BLOCK_COPY_TRANSIENT_JOB, -1);
+    return virNodeSuspend(target, duration, flags);
+}
 
-    if (virStorageSourceIsRelative(mirror)) {
-        virReportError(VIR_ERR_INVALID_ARG, "%s",
-                       _("absolute path must be used as block copy target"));
+static int
+qemuConnectGetCPUModelNames(virConnectPtr conn,
+                            const char *archName,
+                            char ***models,
+                            unsigned int flags)
+{
+    virArch arch;
+
+    virCheckFlags(0, -1);
+    if (virConnectGetCPUModelNamesEnsureACL(conn) < 0)
         return -1;
-    }
 
-    if (bandwidth > LLONG_MAX) {
+    if (!(arch = virArchFromString(archName))) {
         virReportError(VIR_ERR_INVALID_ARG,
-                       _("bandwidth must be less than "
-                         "'%llu' bytes/s (%llu MiB/s)"),
-                       LLONG_MAX, LLONG_MAX >> 20);
+                       _("cannot find architecture %s"),
+                       archName);
         return -1;
     }
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
+    return virCPUGetModels(arch, models);
+}
+
+
+static int
+qemuDomainGetHostnameAgent(virQEMUDriverPtr driver,
+                           virDomainObjPtr vm,
+                           char **hostname)
+{
+    qemuAgentPtr agent;
+    int ret = -1;
+
+    if (qemuDomainObjBeginAgentJob(driver, vm, QEMU_AGENT_JOB_QUERY) < 0)
         return -1;
 
     if (virDomainObjCheckActive(vm) < 0)
         goto endjob;
 
-    if (qemuDomainSupportsCheckpointsBlockjobs(vm) < 0)
-        goto endjob;
-
-    if (!(disk = qemuDomainDiskByName(vm->def, path)))
-        goto endjob;
-
-    if (qemuDomainDiskBlockJobIsActive(disk))
+    if (!qemuDomainAgentAvailable(vm, true))
         goto endjob;
 
-    if (!qemuDomainDiskBlockJobIsSupported(vm, disk))
-        goto endjob;
+    agent = qemuDomainObjEnterAgent(vm);
+    ignore_value(qemuAgentGetHostname(agent, hostname, true));
+    qemuDomainObjExitAgent(vm, agent);
 
-    if (disk->device == VIR_DOMAIN_DISK_DEVICE_LUN &&
-        qemuDomainDefValidateDiskLunSource(mirror) < 0)
-        goto endjob;
+    ret = 0;
+ endjob:
+    qemuDomainObjEndAgentJob(vm);
+    return ret;
+}
 
-    if (!(flags & VIR_DOMAIN_BLOCK_COPY_TRANSIENT_JOB) &&
-        vm->persistent) {
-        /* XXX if qemu ever lets us start a new domain with mirroring
-         * already active, we can relax this; but for now, the risk of
-         * 'managedsave' due to libvirt-guests means we can't risk
-         * this on persistent domains.  */
-        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
-                       _("domain is not transient"));
-        goto endjob;
-    }
 
-    /* clear the _SHALLOW flag if there is only one layer */
-    if (!virStorageSourceHasBacking(disk->src)) {
-        flags &= ~VIR_DOMAIN_BLOCK_COPY_SHALLOW;
-        mirror_shallow = false;
-    }
+static int
+qemuDomainGetHostnameLease(virQEMUDriverPtr driver,
+                           virDomainObjPtr vm,
+                           char **hostname)
+{
+    char macaddr[VIR_MAC_STRING_BUFLEN];
+    g_autoptr(virConnect) conn = NULL;
+    virNetworkDHCPLeasePtr *leases = NULL;
+    int n_leases;
+    size_t i, j;
+    int ret = -1;
 
-    if (qemuDomainBlockCopyCommonValidateUserMirrorBackingStore(mirror,
-                                                                mirror_shallow,
-                                                                blockdev) < 0)
-        goto endjob;
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) < 0)
+        return -1;
 
-    /* unless the user provides a pre-created file, shallow copy into a raw
-     * file is not possible */
-    if (mirror_shallow && !existing && mirror->format == VIR_STORAGE_FILE_RAW) {
-        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
-                       _("shallow copy of disk '%s' into a raw file "
-                         "is not possible"),
-                       disk->dst);
+    if (virDomainObjCheckActive(vm) < 0)
         goto endjob;
-    }
 
-    /* Prepare the destination file.  */
-    if (!blockdev &&
-        !virStorageSourceIsLocalStorage(mirror)) {
-        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED, "%s",
-                       _("non-file destination not supported yet"));
+    if (!(conn = virGetConnectNetwork()))
         goto endjob;
-    }
 
-    supports_access = virStorageFileSupportsAccess(mirror) == 1;
-    supports_create = virStorageFileSupportsCreate(mirror) == 1;
-    supports_detect = virStorageFileSupportsBackingChainTraversal(mirror) == 1;
+    for (i = 0; i < vm->def->nnets; i++) {
+        g_autoptr(virNetwork) network = NULL;
+        virDomainNetDefPtr net = vm->def->nets[i];
 
-    if (supports_access || supports_create || supports_detect) {
-        if (qemuDomainStorageFileInit(driver, vm, mirror, NULL) < 0)
-            goto endjob;
-    }
+        if (net->type != VIR_DOMAIN_NET_TYPE_NETWORK)
+            continue;
 
-    if (supports_access &&
-        qemuDomainBlockCopyValidateMirror(mirror, disk->dst, &existing) < 0)
-        goto endjob;
+        virMacAddrFormat(&net->mac, macaddr);
+        network = virNetworkLookupByName(conn, net->data.network.name);
 
-    if (!mirror->format) {
-        if (!mirror_reuse) {
-            mirror->format = disk->src->format;
-        } else {
-            /* If the user passed the REUSE_EXT flag, then either they
-             * can also pass the RAW flag or use XML to tell us the format.
-             * So if we get here, we assume it is safe for us to probe the
-             * format from the file that we will be using.  */
-            if (!supports_detect ||
-                !virStorageSourceIsLocalStorage(mirror) ||
-                (mirror->format = virStorageFileProbeFormat(mirror->path, cfg->user,
-                                                            cfg->group)) < 0) {
-                virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
-                               _("reused mirror destination format must be specified"));
-                goto endjob;
-            }
-        }
-    }
+        if (!network)
+            goto endjob;
 
-    /* When copying a shareable disk we need to make sure that the disk can
-     * be safely shared, since block copy may change the format. */
-    if (disk->src->shared && !disk->src->readonly &&
-        !qemuBlockStorageSourceSupportsConcurrentAccess(mirror)) {
-        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
-                       _("can't pivot a shared disk to a storage volume not "
-                         "supporting sharing"));
-        goto endjob;
-    }
+        if ((n_leases = virNetworkGetDHCPLeases(network, macaddr,
+                                                &leases, 0)) < 0)
+            goto endjob;
 
-    /* pre-create the image file. In case when 'blockdev' is used this is
-     * required so that libvirt can properly label the image for access by qemu */
-    if (!existing) {
-        if (supports_create) {
-            if (virStorageFileCreate(mirror) < 0) {
-                virReportSystemError(errno, "%s", _("failed to create copy target"));
-                goto endjob;
-            }
+        for (j = 0; j < n_leases; j++) {
+            virNetworkDHCPLeasePtr lease = leases[j];
+            if (lease->hostname && !*hostname)
+                *hostname = g_strdup(lease->hostname);
 
-            need_unlink = true;
+            virNetworkDHCPLeaseFree(lease);
         }
-    }
-
-    if (mirror->format > 0)
-        format = virStorageFileFormatTypeToString(mirror->format);
 
-    if (virStorageSourceInitChainElement(mirror, disk->src,
-                                         keepParentLabel) < 0)
-        goto endjob;
+        VIR_FREE(leases);
 
-    if (mirror->readonly) {
-        if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV_REOPEN)) {
-            virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
-                           _("copy of read-only disks is not supported"));
+        if (*hostname)
             goto endjob;
-        }
-        mirror->readonly = false;
     }
 
-    /* we must initialize XML-provided chain prior to detecting to keep semantics
-     * with VM startup */
-    if (blockdev) {
-        for (n = mirror; virStorageSourceIsBacking(n); n = n->backingStore) {
-            if (qemuDomainPrepareStorageSourceBlockdev(disk, n, priv, cfg) < 0)
-                goto endjob;
-        }
-    }
+    ret = 0;
+ endjob:
+    qemuDomainObjEndJob(driver, vm);
+    return ret;
+}
 
-    /* If reusing an external image that includes a backing file but the user
-     * did not enumerate the chain in the XML we need to detect the chain */
-    if (mirror_reuse &&
-        mirror->format >= VIR_STORAGE_FILE_BACKING &&
-        mirror->backingStore == NULL &&
-        qemuDomainDetermineDiskChain(driver, vm, disk, mirror, true) < 0)
-        goto endjob;
 
-    if (qemuDomainStorageSourceChainAccessAllow(driver, vm, mirror) < 0)
-        goto endjob;
-    need_revoke = true;
+static char *
+qemuDomainGetHostname(virDomainPtr dom,
+                      unsigned int flags)
+{
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainObjPtr vm = NULL;
+    char *hostname = NULL;
 
-    if (blockdev) {
-        if (mirror_reuse) {
-            /* oVirt depended on late-backing-chain-opening semantics the old
-             * qemu command had to copy the backing chain data while the top
-             * level is being copied. To restore this semantics if
-             * blockdev-reopen is supported defer opening of the backing chain
-             * of 'mirror' to the pivot step */
-            if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV_SNAPSHOT_ALLOW_WRITE_ONLY)) {
-                g_autoptr(virStorageSource) terminator = virStorageSourceNew();
+    virCheckFlags(VIR_DOMAIN_GET_HOSTNAME_LEASE |
+                  VIR_DOMAIN_GET_HOSTNAME_AGENT, NULL);
 
-                if (!terminator)
-                    goto endjob;
+    VIR_EXCLUSIVE_FLAGS_RET(VIR_DOMAIN_GET_HOSTNAME_LEASE,
+                            VIR_DOMAIN_GET_HOSTNAME_AGENT,
+                            NULL);
 
-                if (!(data = qemuBuildStorageSourceChainAttachPrepareBlockdevTop(mirror,
-                                                                                 terminator,
-                                                                                 priv->qemuCaps)))
-                    goto endjob;
-            } else {
-                if (!(data = qemuBuildStorageSourceChainAttachPrepareBlockdev(mirror,
-                                                                              priv->qemuCaps)))
-                    goto endjob;
-            }
-        } else {
-            if (!(blockNamedNodeData = qemuBlockGetNamedNodeData(vm, QEMU_ASYNC_JOB_NONE)))
-                goto endjob;
+    if (!(flags & VIR_DOMAIN_GET_HOSTNAME_LEASE))
+        flags |= VIR_DOMAIN_GET_HOSTNAME_AGENT;
 
-            if (qemuBlockStorageSourceCreateDetectSize(blockNamedNodeData,
-                                                       mirror, disk->src))
-                goto endjob;
+    if (!(vm = qemuDomainObjFromDomain(dom)))
+        return NULL;
 
-            if (mirror_shallow) {
-                /* if external backing store is populated we'll need to open it */
-                if (virStorageSourceHasBacking(mirror)) {
-                    if (!(data = qemuBuildStorageSourceChainAttachPrepareBlockdev(mirror->backingStore,
-                                                                                  priv->qemuCaps)))
-                        goto endjob;
+    if (virDomainGetHostnameEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
 
-                    mirrorBacking = mirror->backingStore;
-                } else {
-                    /* backing store of original image will be reused, but the
-                     * new image must refer to it in the metadata */
-                    mirrorBacking = disk->src->backingStore;
-                }
-            } else {
-                mirrorBacking = mirror->backingStore;
-            }
+    if (flags & VIR_DOMAIN_GET_HOSTNAME_AGENT) {
+        if (qemuDomainGetHostnameAgent(driver, vm, &hostname) < 0)
+            goto cleanup;
+    } else if (flags & VIR_DOMAIN_GET_HOSTNAME_LEASE) {
+        if (qemuDomainGetHostnameLease(driver, vm, &hostname) < 0)
+            goto cleanup;
+    }
+
+    if (!hostname) {
+        virReportError(VIR_ERR_NO_HOSTNAME,
+                       _("no hostname found for domain %s"),
+                       vm->def->name);
+        goto cleanup;
+    }
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return hostname;
+}
 
-            if (!(crdata = qemuBuildStorageSourceChainAttachPrepareBlockdevTop(mirror,
-                                                                               mirrorBacking,
-                                                                               priv->qemuCaps)))
-                goto endjob;
-        }
 
-        if (data) {
-            qemuDomainObjEnterMonitor(driver, vm);
-            rc = qemuBlockStorageSourceChainAttach(priv->mon, data);
-            if (qemuDomainObjExitMonitor(driver, vm) < 0)
-                goto endjob;
+static int
+qemuDomainGetTime(virDomainPtr dom,
+                  long long *seconds,
+                  unsigned int *nseconds,
+                  unsigned int flags)
+{
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainObjPtr vm = NULL;
+    qemuAgentPtr agent;
+    int ret = -1;
+    int rv;
 
-            if (rc < 0)
-                goto endjob;
-        }
+    virCheckFlags(0, ret);
 
-        if (crdata &&
-            qemuBlockStorageSourceCreate(vm, mirror, mirrorBacking, mirror->backingStore,
-                                         crdata->srcdata[0], QEMU_ASYNC_JOB_NONE) < 0)
-            goto endjob;
-    }
+    if (!(vm = qemuDomainObjFromDomain(dom)))
+        return ret;
 
-    if (!(job = qemuBlockJobDiskNewCopy(vm, disk, mirror, mirror_shallow, mirror_reuse, flags)))
-        goto endjob;
+    if (virDomainGetTimeEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
 
-    disk->mirrorState = VIR_DOMAIN_DISK_MIRROR_STATE_NONE;
+    if (qemuDomainObjBeginAgentJob(driver, vm, QEMU_AGENT_JOB_QUERY) < 0)
+        goto cleanup;
 
-    /* Actually start the mirroring */
-    qemuDomainObjEnterMonitor(driver, vm);
+    if (virDomainObjCheckActive(vm) < 0)
+        goto endjob;
 
-    if (blockdev) {
-        ret = qemuMonitorBlockdevMirror(priv->mon, job->name, true,
-                                        qemuDomainDiskGetTopNodename(disk),
-                                        mirror->nodeformat, bandwidth,
-                                        granularity, buf_size, mirror_shallow);
-    } else {
-        /* qemuMonitorDriveMirror needs to honor the REUSE_EXT flag as specified
-         * by the user */
-        ret = qemuMonitorDriveMirror(priv->mon, job->name, mirror->path, format,
-                                     bandwidth, granularity, buf_size,
-                                     mirror_shallow, mirror_reuse);
-    }
+    if (!qemuDomainAgentAvailable(vm, true))
+        goto endjob;
 
-    virDomainAuditDisk(vm, NULL, mirror, "mirror", ret >= 0);
-    if (qemuDomainObjExitMonitor(driver, vm) < 0)
-        ret = -1;
-    if (ret < 0) {
-        qemuDomainStorageSourceChainAccessRevoke(driver, vm, mirror);
+    agent = qemuDomainObjEnterAgent(vm);
+    rv = qemuAgentGetTime(agent, seconds, nseconds);
+    qemuDomainObjExitAgent(vm, agent);
+
+    if (rv < 0)
         goto endjob;
-    }
 
-    /* Update vm in place to match changes.  */
-    need_unlink = false;
-    virStorageFileDeinit(mirror);
-    disk->mirror = g_steal_pointer(&mirror);
-    disk->mirrorJob = VIR_DOMAIN_BLOCK_JOB_TYPE_COPY;
-    qemuBlockJobStarted(job, vm);
+    ret = 0;
 
  endjob:
-    if (ret < 0 &&
-        virDomainObjIsActive(vm)) {
-        if (data || crdata) {
-            qemuDomainObjEnterMonitor(driver, vm);
-            if (data)
-                qemuBlockStorageSourceChainDetach(priv->mon, data);
-            if (crdata)
-                qemuBlockStorageSourceAttachRollback(priv->mon, crdata->srcdata[0]);
-            ignore_value(qemuDomainObjExitMonitor(driver, vm));
-        }
-        if (need_revoke)
-            qemuDomainStorageSourceChainAccessRevoke(driver, vm, mirror);
-    }
-    if (need_unlink && virStorageFileUnlink(mirror) < 0)
-        VIR_WARN("%s", _("unable to remove just-created copy target"));
-    virStorageFileDeinit(mirror);
-    qemuDomainObjEndJob(driver, vm);
-    qemuBlockJobStartupFinalize(vm, job);
+    qemuDomainObjEndAgentJob(vm);
 
+ cleanup:
+    virDomainObjEndAPI(&vm);
     return ret;
 }
 
+
 static int
-qemuDomainBlockRebase(virDomainPtr dom, const char *path, const char *base,
-                      unsigned long bandwidth, unsigned int flags)
+qemuDomainSetTimeAgent(virQEMUDriverPtr driver,
+                       virDomainObjPtr vm,
+                       long long seconds,
+                       unsigned int nseconds,
+                       bool rtcSync)
 {
-    virDomainObjPtr vm;
+    qemuAgentPtr agent;
     int ret = -1;
-    unsigned long long speed = bandwidth;
-    g_autoptr(virStorageSource) dest = NULL;
-
-    virCheckFlags(VIR_DOMAIN_BLOCK_REBASE_SHALLOW |
-                  VIR_DOMAIN_BLOCK_REBASE_REUSE_EXT |
-                  VIR_DOMAIN_BLOCK_REBASE_COPY |
-                  VIR_DOMAIN_BLOCK_REBASE_COPY_RAW |
-                  VIR_DOMAIN_BLOCK_REBASE_RELATIVE |
-                  VIR_DOMAIN_BLOCK_REBASE_COPY_DEV |
-                  VIR_DOMAIN_BLOCK_REBASE_BANDWIDTH_BYTES, -1);
 
-    if (!(vm = qemuDomainObjFromDomain(dom)))
+    if (qemuDomainObjBeginAgentJob(driver, vm, QEMU_AGENT_JOB_MODIFY) < 0)
         return -1;
 
-    if (virDomainBlockRebaseEnsureACL(dom->conn, vm->def) < 0)
-        goto cleanup;
-
-    /* For normal rebase (enhanced blockpull), the common code handles
-     * everything, including vm cleanup. */
-    if (!(flags & VIR_DOMAIN_BLOCK_REBASE_COPY))
-        return qemuDomainBlockPullCommon(vm, path, base, bandwidth, flags);
-
-    /* If we got here, we are doing a block copy rebase. */
-    if (!(dest = virStorageSourceNew()))
-        goto cleanup;
-    dest->type = (flags & VIR_DOMAIN_BLOCK_REBASE_COPY_DEV) ?
-        VIR_STORAGE_TYPE_BLOCK : VIR_STORAGE_TYPE_FILE;
-    dest->path = g_strdup(base);
-    if (flags & VIR_DOMAIN_BLOCK_REBASE_COPY_RAW)
-        dest->format = VIR_STORAGE_FILE_RAW;
-
-    /* Convert bandwidth MiB to bytes, if necessary */
-    if (!(flags & VIR_DOMAIN_BLOCK_REBASE_BANDWIDTH_BYTES)) {
-        if (speed > LLONG_MAX >> 20) {
-            virReportError(VIR_ERR_OVERFLOW,
-                           _("bandwidth must be less than %llu"),
-                           LLONG_MAX >> 20);
-            goto cleanup;
-        }
-        speed <<= 20;
-    }
+    if (virDomainObjCheckActive(vm) < 0)
+        goto endjob;
 
-    /* XXX: If we are doing a shallow copy but not reusing an external
-     * file, we should attempt to pre-create the destination with a
-     * relative backing chain instead of qemu's default of absolute */
-    if (flags & VIR_DOMAIN_BLOCK_REBASE_RELATIVE) {
-        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED, "%s",
-                       _("Relative backing during copy not supported yet"));
-        goto cleanup;
-    }
+    if (!qemuDomainAgentAvailable(vm, true))
+        goto endjob;
 
-    /* We rely on the fact that VIR_DOMAIN_BLOCK_REBASE_SHALLOW
-     * and VIR_DOMAIN_BLOCK_REBASE_REUSE_EXT map to the same values
-     * as for block copy. */
-    flags &= (VIR_DOMAIN_BLOCK_REBASE_SHALLOW |
-              VIR_DOMAIN_BLOCK_REBASE_REUSE_EXT);
-    ret = qemuDomainBlockCopyCommon(vm, dom->conn, path, dest,
-                                    speed, 0, 0, flags, true);
-    dest = NULL;
+    agent = qemuDomainObjEnterAgent(vm);
+    ret = qemuAgentSetTime(agent, seconds, nseconds, rtcSync);
+    qemuDomainObjExitAgent(vm, agent);
 
- cleanup:
-    virDomainObjEndAPI(&vm);
+ endjob:
+    qemuDomainObjEndAgentJob(vm);
     return ret;
 }
 
 
 static int
-qemuDomainBlockCopy(virDomainPtr dom, const char *disk, const char *destxml,
-                    virTypedParameterPtr params, int nparams,
-                    unsigned int flags)
+qemuDomainSetTime(virDomainPtr dom,
+                  long long seconds,
+                  unsigned int nseconds,
+                  unsigned int flags)
 {
     virQEMUDriverPtr driver = dom->conn->privateData;
+    qemuDomainObjPrivatePtr priv;
     virDomainObjPtr vm;
+    bool rtcSync = flags & VIR_DOMAIN_TIME_SYNC;
     int ret = -1;
-    unsigned long long bandwidth = 0;
-    unsigned int granularity = 0;
-    unsigned long long buf_size = 0;
-    virDomainDiskDefPtr diskdef = NULL;
-    virStorageSourcePtr dest = NULL;
-    size_t i;
+    int rv;
 
-    virCheckFlags(VIR_DOMAIN_BLOCK_COPY_SHALLOW |
-                  VIR_DOMAIN_BLOCK_COPY_REUSE_EXT |
-                  VIR_DOMAIN_BLOCK_COPY_TRANSIENT_JOB, -1);
-    if (virTypedParamsValidate(params, nparams,
-                               VIR_DOMAIN_BLOCK_COPY_BANDWIDTH,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_COPY_GRANULARITY,
-                               VIR_TYPED_PARAM_UINT,
-                               VIR_DOMAIN_BLOCK_COPY_BUF_SIZE,
-                               VIR_TYPED_PARAM_ULLONG,
-                               NULL) < 0)
-        return -1;
+    virCheckFlags(VIR_DOMAIN_TIME_SYNC, ret);
 
     if (!(vm = qemuDomainObjFromDomain(dom)))
-        return -1;
+        return ret;
 
-    if (virDomainBlockCopyEnsureACL(dom->conn, vm->def) < 0)
+    if (virDomainSetTimeEnsureACL(dom->conn, vm->def) < 0)
         goto cleanup;
 
-    for (i = 0; i < nparams; i++) {
-        virTypedParameterPtr param = &params[i];
+    priv = vm->privateData;
 
-        /* Typed params (wisely) refused to expose unsigned long, but
-         * back-compat demands that we stick with a maximum of
-         * unsigned long bandwidth in MiB/s, while our value is
-         * unsigned long long in bytes/s.  Hence, we have to do
-         * overflow detection if this is a 32-bit server handling a
-         * 64-bit client.  */
-        if (STREQ(param->field, VIR_DOMAIN_BLOCK_COPY_BANDWIDTH)) {
-            if (sizeof(unsigned long)< sizeof(bandwidth) &&
-                param->value.ul > ULONG_MAX * (1ULL << 20)) {
-                virReportError(VIR_ERR_OVERFLOW,
-                               _("bandwidth must be less than %llu bytes"),
-                               ULONG_MAX * (1ULL << 20));
-                goto cleanup;
-            }
-            bandwidth = param->value.ul;
-        } else if (STREQ(param->field, VIR_DOMAIN_BLOCK_COPY_GRANULARITY)) {
-            if (param->value.ui != VIR_ROUND_UP_POWER_OF_TWO(param->value.ui)) {
-                virReportError(VIR_ERR_INVALID_ARG, "%s",
-                               _("granularity must be power of 2"));
-                goto cleanup;
-            }
-            granularity = param->value.ui;
-        } else if (STREQ(param->field, VIR_DOMAIN_BLOCK_COPY_BUF_SIZE)) {
-            buf_size = param->value.ul;
-        }
+    /* On x86, the rtc-reset-reinjection QMP command must be called after
+     * setting the time to avoid trouble down the line. If the command is
+     * not available, don't set the time at all and report an error */
+    if (ARCH_IS_X86(vm->def->os.arch) &&
+        !virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_RTC_RESET_REINJECTION))
+    {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("cannot set time: qemu doesn't support "
+                         "rtc-reset-reinjection command"));
+        goto cleanup;
     }
 
-    if (!(diskdef = virDomainDiskDefParse(destxml, driver->xmlopt,
-                                          VIR_DOMAIN_DEF_PARSE_INACTIVE |
-                                          VIR_DOMAIN_DEF_PARSE_DISK_SOURCE)))
-        goto cleanup;
+    if (qemuDomainSetTimeAgent(driver, vm, seconds, nseconds, rtcSync) < 0)
+        goto cleanup;
+
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
+        goto cleanup;
+
+    if (virDomainObjCheckActive(vm) < 0)
+        goto endjob;
+
+    /* Don't try to call rtc-reset-reinjection if it's not available */
+    if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_RTC_RESET_REINJECTION)) {
+        qemuDomainObjEnterMonitor(driver, vm);
+        rv = qemuMonitorRTCResetReinjection(priv->mon);
+        if (qemuDomainObjExitMonitor(driver, vm) < 0)
+            goto endjob;
+
+        if (rv < 0)
+            goto endjob;
+    }
 
-    dest = g_steal_pointer(&diskdef->src);
+    ret = 0;
 
-    ret = qemuDomainBlockCopyCommon(vm, dom->conn, disk, dest, bandwidth,
-                                    granularity, buf_size, flags, false);
+ endjob:
+    qemuDomainObjEndJob(driver, vm);
 
  cleanup:
-    virDomainDiskDefFree(diskdef);
     virDomainObjEndAPI(&vm);
     return ret;
 }
 
 
 static int
-qemuDomainBlockPull(virDomainPtr dom, const char *path, unsigned long bandwidth,
-                    unsigned int flags)
+qemuDomainFSFreeze(virDomainPtr dom,
+                   const char **mountpoints,
+                   unsigned int nmountpoints,
+                   unsigned int flags)
 {
+    virQEMUDriverPtr driver = dom->conn->privateData;
     virDomainObjPtr vm;
-    virCheckFlags(VIR_DOMAIN_BLOCK_PULL_BANDWIDTH_BYTES, -1);
+    int ret = -1;
+
+    virCheckFlags(0, -1);
 
     if (!(vm = qemuDomainObjFromDomain(dom)))
-        return -1;
+        goto cleanup;
 
-    if (virDomainBlockPullEnsureACL(dom->conn, vm->def) < 0) {
-        virDomainObjEndAPI(&vm);
-        return -1;
-    }
+    if (virDomainFSFreezeEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
 
-    /* qemuDomainBlockPullCommon consumes the reference on @vm */
-    return qemuDomainBlockPullCommon(vm, path, NULL, bandwidth, flags);
+    if (qemuDomainObjBeginAgentJob(driver, vm, QEMU_AGENT_JOB_MODIFY) < 0)
+        goto cleanup;
+
+    if (virDomainObjCheckActive(vm) < 0)
+        goto endjob;
+
+    ret = qemuDomainSnapshotFSFreeze(vm, mountpoints, nmountpoints);
+
+ endjob:
+    qemuDomainObjEndAgentJob(vm);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
 }
 
 
 static int
-qemuDomainBlockCommit(virDomainPtr dom,
-                      const char *path,
-                      const char *base,
-                      const char *top,
-                      unsigned long bandwidth,
-                      unsigned int flags)
+qemuDomainFSThaw(virDomainPtr dom,
+                 const char **mountpoints,
+                 unsigned int nmountpoints,
+                 unsigned int flags)
 {
     virQEMUDriverPtr driver = dom->conn->privateData;
-    qemuDomainObjPrivatePtr priv;
-    virDomainObjPtr vm = NULL;
-    const char *device = NULL;
-    const char *jobname = NULL;
+    virDomainObjPtr vm;
     int ret = -1;
-    virDomainDiskDefPtr disk = NULL;
-    virStorageSourcePtr topSource;
-    unsigned int topIndex = 0;
-    virStorageSourcePtr baseSource = NULL;
-    unsigned int baseIndex = 0;
-    virStorageSourcePtr top_parent = NULL;
-    bool clean_access = false;
-    g_autofree char *topPath = NULL;
-    g_autofree char *basePath = NULL;
-    g_autofree char *backingPath = NULL;
-    unsigned long long speed = bandwidth;
-    qemuBlockJobDataPtr job = NULL;
-    g_autoptr(virStorageSource) mirror = NULL;
-    const char *nodetop = NULL;
-    const char *nodebase = NULL;
-    bool persistjob = false;
-    bool blockdev = false;
 
-    virCheckFlags(VIR_DOMAIN_BLOCK_COMMIT_SHALLOW |
-                  VIR_DOMAIN_BLOCK_COMMIT_ACTIVE |
-                  VIR_DOMAIN_BLOCK_COMMIT_RELATIVE |
-                  VIR_DOMAIN_BLOCK_COMMIT_DELETE |
-                  VIR_DOMAIN_BLOCK_COMMIT_BANDWIDTH_BYTES, -1);
+    virCheckFlags(0, -1);
+
+    if (mountpoints || nmountpoints) {
+        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED, "%s",
+                       _("specifying mountpoints is not supported"));
+        return ret;
+    }
 
     if (!(vm = qemuDomainObjFromDomain(dom)))
         goto cleanup;
-    priv = vm->privateData;
 
-    if (virDomainBlockCommitEnsureACL(dom->conn, vm->def) < 0)
+    if (virDomainFSThawEnsureACL(dom->conn, vm->def) < 0)
         goto cleanup;
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
+    if (qemuDomainObjBeginAgentJob(driver, vm, QEMU_AGENT_JOB_MODIFY) < 0)
         goto cleanup;
 
     if (virDomainObjCheckActive(vm) < 0)
         goto endjob;
 
-    blockdev = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV);
+    ret = qemuDomainSnapshotFSThaw(vm, true);
 
-    /* Convert bandwidth MiB to bytes, if necessary */
-    if (!(flags & VIR_DOMAIN_BLOCK_COMMIT_BANDWIDTH_BYTES)) {
-        if (speed > LLONG_MAX >> 20) {
-            virReportError(VIR_ERR_OVERFLOW,
-                           _("bandwidth must be less than %llu"),
-                           LLONG_MAX >> 20);
-            goto endjob;
-        }
-        speed <<= 20;
-    }
+ endjob:
+    qemuDomainObjEndAgentJob(vm);
 
-    if (!(disk = qemuDomainDiskByName(vm->def, path)))
-        goto endjob;
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
 
-    if (!qemuDomainDiskBlockJobIsSupported(vm, disk))
-        goto endjob;
 
-    if (virStorageSourceIsEmpty(disk->src)) {
-        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
-                       _("disk %s has no source file to be committed"),
-                       disk->dst);
-        goto endjob;
-    }
+/* Upper bound on the number of threads talking to guest agents at once
+ * in qemuDomainListFSFreeze and qemuDomainListFSThaw */
+#define QEMU_DOMAIN_LIST_FSFREEZE_THREADS 32
 
-    if (qemuDomainDiskBlockJobIsActive(disk))
-        goto endjob;
+typedef struct _qemuDomainListFSFreezeData qemuDomainListFSFreezeData;
+typedef qemuDomainListFSFreezeData *qemuDomainListFSFreezeDataPtr;
+struct _qemuDomainListFSFreezeData {
+    virQEMUDriverPtr driver;
+    bool freeze;
+    unsigned long long deadline; /* in ms, 0 if there is none */
 
-    if (qemuDomainSupportsCheckpointsBlockjobs(vm) < 0)
-        goto endjob;
+    virDomainObjPtr *vms;
+    virDomainFSFreezeRecordPtr *records;
+    size_t nvms;
 
-    if (!blockdev && (flags & VIR_DOMAIN_BLOCK_COMMIT_DELETE)) {
-        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
-                       _("deleting committed images is not supported by this VM"));
-        goto endjob;
-    }
+    /* protects @next, the index of the next domain to process */
+    virMutex lock;
+    size_t next;
+};
 
-    if (!top || STREQ(top, disk->dst))
-        topSource = disk->src;
-    else if (virStorageFileParseChainIndex(disk->dst, top, &topIndex) < 0 ||
-             !(topSource = virStorageFileChainLookup(disk->src, NULL,
-                                                     top, topIndex,
-                                                     &top_parent)))
+
+static int
+qemuDomainListFSFreezeOne(qemuDomainListFSFreezeDataPtr data,
+                          virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    qemuAgentPtr agent;
+    int timeout = 0;
+    int ret = -1;
+
+    if (qemuDomainObjBeginAgentJob(data->driver, vm, QEMU_AGENT_JOB_MODIFY) < 0)
+        return -1;
+
+    if (virDomainObjCheckActive(vm) < 0 ||
+        !qemuDomainAgentAvailable(vm, true))
         goto endjob;
 
-    if (topSource == disk->src) {
-        if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_ACTIVE_COMMIT)) {
-            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
-                           _("active commit not supported with this QEMU binary"));
+    if (data->deadline) {
+        unsigned long long now;
+        unsigned long long remaining;
+
+        if (virTimeMillisNow(&now) < 0)
             goto endjob;
-        }
-        /* XXX Should we auto-pivot when COMMIT_ACTIVE is not specified? */
-        if (!(flags & VIR_DOMAIN_BLOCK_COMMIT_ACTIVE)) {
-            virReportError(VIR_ERR_INVALID_ARG,
-                           _("commit of '%s' active layer requires active flag"),
-                           disk->dst);
+
+        /* domains whose turn comes after the deadline aren't touched at
+         * all so that no guest gets frozen once the caller gave up */
+        if (now >= data->deadline) {
+            virReportError(VIR_ERR_OPERATION_TIMEOUT, "%s",
+                           _("timed out before contacting the guest agent"));
             goto endjob;
         }
-    } else if (flags & VIR_DOMAIN_BLOCK_COMMIT_ACTIVE) {
-        virReportError(VIR_ERR_INVALID_ARG,
-                       _("active commit requested but '%s' is not active"),
-                       topSource->path);
-        goto endjob;
-    }
 
-    if (!virStorageSourceHasBacking(topSource)) {
-        virReportError(VIR_ERR_INVALID_ARG,
-                       _("top '%s' in chain for '%s' has no backing file"),
-                       topSource->path, path);
-        goto endjob;
+        remaining = (data->deadline - now + 999) / 1000;
+
+        /* the deadline replaces the default and the blocking timeouts
+         * and shortens the configured one if needed */
+        timeout = priv->agentTimeout;
+        if (timeout < 0 || (unsigned long long) timeout > remaining)
+            timeout = remaining;
     }
 
-    if (!base && (flags & VIR_DOMAIN_BLOCK_COMMIT_SHALLOW))
-        baseSource = topSource->backingStore;
-    else if (virStorageFileParseChainIndex(disk->dst, base, &baseIndex) < 0 ||
-             !(baseSource = virStorageFileChainLookup(disk->src, topSource,
-                                                      base, baseIndex, NULL)))
-        goto endjob;
+    agent = qemuDomainObjEnterAgent(vm);
+    if (data->deadline)
+        qemuAgentSetResponseTimeout(agent, timeout);
 
-    if ((flags & VIR_DOMAIN_BLOCK_COMMIT_SHALLOW) &&
-        baseSource != topSource->backingStore) {
-        virReportError(VIR_ERR_INVALID_ARG,
-                       _("base '%s' is not immediately below '%s' in chain "
-                         "for '%s'"),
-                       base, topSource->path, path);
-        goto endjob;
-    }
+    if (data->freeze)
+        ret = qemuAgentFSFreeze(agent, NULL, 0);
+    else
+        ret = qemuAgentFSThaw(agent);
+    qemuDomainObjExitAgent(vm, agent);
 
-    /* For an active commit, clone enough of the base to act as the mirror */
-    if (topSource == disk->src) {
-        if (!(mirror = virStorageSourceCopy(baseSource, false)))
-            goto endjob;
-        if (virStorageSourceInitChainElement(mirror,
-                                             disk->src,
-                                             true) < 0)
-            goto endjob;
+    /* priv->agentTimeout may have been changed meanwhile, see
+     * qemuDomainAgentSetResponseTimeout */
+    if (data->deadline && priv->agent) {
+        virObjectLock(priv->agent);
+        qemuAgentSetResponseTimeout(priv->agent, priv->agentTimeout);
+        virObjectUnlock(priv->agent);
     }
 
-    if (flags & VIR_DOMAIN_BLOCK_COMMIT_RELATIVE &&
-        topSource != disk->src) {
-        if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_CHANGE_BACKING_FILE)) {
-            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
-                           _("this qemu doesn't support relative block commit"));
-            goto endjob;
-        }
+ endjob:
+    qemuDomainObjEndAgentJob(vm);
+    return ret;
+}
 
-        if (blockdev && top_parent &&
-            qemuBlockUpdateRelativeBacking(vm, top_parent, disk->src) < 0)
-            goto endjob;
 
-        if (virStorageFileGetRelativeBackingPath(topSource, baseSource,
-                                                 &backingPath) < 0)
-            goto endjob;
+static void
+qemuDomainListFSFreezeWorker(void *opaque)
+{
+    qemuDomainListFSFreezeDataPtr data = opaque;
 
-        if (!backingPath) {
-            virReportError(VIR_ERR_OPERATION_INVALID, "%s",
-                           _("can't keep relative backing relationship"));
-            goto endjob;
+    while (true) {
+        virDomainFSFreezeRecordPtr rec;
+        virDomainObjPtr vm;
+        size_t i;
+
+        virMutexLock(&data->lock);
+        i = data->next++;
+        virMutexUnlock(&data->lock);
+
+        if (i >= data->nvms)
+            break;
+
+        /* skipped or already failed in qemuDomainListFSFreezeThaw */
+        rec = data->records[i];
+        if (!rec || rec->error)
+            continue;
+
+        vm = data->vms[i];
+        virObjectLock(vm);
+        rec->nfilesystems = qemuDomainListFSFreezeOne(data, vm);
+        virObjectUnlock(vm);
+
+        if (rec->nfilesystems < 0) {
+            rec->error = g_strdup(virGetLastErrorMessage());
+            virResetLastError();
         }
     }
+}
+
+
+/*
+ * Freezes or thaws filesystems of all of @doms concurrently, each guest
+ * agent is talked to by one of a bounded set of threads. The caller's
+ * thread takes part in the work too so that the operation succeeds even
+ * if no additional thread can be created.
+ */
+static int
+qemuDomainListFSFreezeThaw(virConnectPtr conn,
+                           virDomainPtr *doms,
+                           unsigned int ndoms,
+                           int timeout,
+                           virDomainFSFreezeRecordPtr **retResults,
+                           bool freeze)
+{
+    virQEMUDriverPtr driver = conn->privateData;
+    qemuDomainListFSFreezeData data = { .driver = driver, .freeze = freeze };
+    g_autofree virThread *threads = NULL;
+    size_t nthreads = 0;
+    size_t nrecords = 0;
+    virDomainFSFreezeRecordPtr *tmpret = NULL;
+    size_t i;
+    int ret = -1;
+
+    if (timeout > 0) {
+        if (virTimeMillisNow(&data.deadline) < 0)
+            return -1;
+        data.deadline += timeout * 1000ull;
+    }
+
+    if (virMutexInit(&data.lock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("cannot initialize mutex"));
+        return -1;
+    }
 
-    /* For the commit to succeed, we must allow qemu to open both the
-     * 'base' image and the parent of 'top' as read/write; 'top' might
-     * not have a parent, or might already be read-write.  XXX It
-     * would also be nice to revert 'base' to read-only, as well as
-     * revoke access to files removed from the chain, when the commit
-     * operation succeeds, but doing that requires tracking the
-     * operation in XML across libvirtd restarts.  */
-    clean_access = true;
-    if (qemuDomainStorageSourceAccessAllow(driver, vm, baseSource,
-                                           false, false, false) < 0)
-        goto endjob;
+    if (virDomainObjListConvert(driver->domains, conn, doms, ndoms,
+                                &data.vms, &data.nvms, NULL, 0, true) < 0)
+        goto cleanup;
 
-    if (top_parent && top_parent != disk->src) {
-        /* While top_parent is topmost image, we don't need to remember its
-         * owner as it will be overwritten upon finishing the commit. Hence,
-         * pass chainTop = false. */
-        if (qemuDomainStorageSourceAccessAllow(driver, vm, top_parent,
-                                               false, false, false) < 0)
-            goto endjob;
-    }
+    data.records = g_new0(virDomainFSFreezeRecordPtr, data.nvms);
 
-    if (!(job = qemuBlockJobDiskNewCommit(vm, disk, top_parent, topSource,
-                                          baseSource,
-                                          flags & VIR_DOMAIN_BLOCK_COMMIT_DELETE,
-                                          flags)))
-        goto endjob;
+    for (i = 0; i < data.nvms; i++) {
+        virDomainObjPtr vm = data.vms[i];
+        virDomainFSFreezeRecordPtr rec;
+        int rc;
 
-    disk->mirrorState = VIR_DOMAIN_DISK_MIRROR_STATE_NONE;
+        virObjectLock(vm);
 
-    /* Start the commit operation.  Pass the user's original spelling,
-     * if any, through to qemu, since qemu may behave differently
-     * depending on whether the input was specified as relative or
-     * absolute (that is, our absolute top_canon may do the wrong
-     * thing if the user specified a relative name).  */
+        /* skip domains undefined since the list was converted */
+        if (vm->removing) {
+            virObjectUnlock(vm);
+            continue;
+        }
 
-    if (blockdev) {
-        persistjob = true;
-        jobname = job->name;
-        nodetop = topSource->nodeformat;
-        nodebase = baseSource->nodeformat;
-        device = qemuDomainDiskGetTopNodename(disk);
-        if (!backingPath && top_parent &&
-            !(backingPath = qemuBlockGetBackingStoreString(baseSource, false)))
-            goto endjob;
+        rec = g_new0(virDomainFSFreezeRecord, 1);
+        data.records[i] = rec;
 
-    } else {
-        device = job->name;
-    }
+        if (!(rec->dom = virGetDomain(conn, vm->def->name,
+                                      vm->def->uuid, vm->def->id))) {
+            virObjectUnlock(vm);
+            goto cleanup;
+        }
 
-    qemuDomainObjEnterMonitor(driver, vm);
+        if (freeze)
+            rc = virDomainListFSFreezeEnsureACL(conn, vm->def);
+        else
+            rc = virDomainListFSThawEnsureACL(conn, vm->def);
 
-    if (!blockdev) {
-        basePath = qemuMonitorDiskNameLookup(priv->mon, device, disk->src,
-                                             baseSource);
-        topPath = qemuMonitorDiskNameLookup(priv->mon, device, disk->src,
-                                            topSource);
+        if (rc < 0) {
+            rec->nfilesystems = -1;
+            rec->error = g_strdup(virGetLastErrorMessage());
+            virResetLastError();
+        }
+
+        virObjectUnlock(vm);
     }
 
-    if (blockdev || (basePath && topPath))
-        ret = qemuMonitorBlockCommit(priv->mon, device, jobname, persistjob,
-                                     topPath, nodetop, basePath, nodebase,
-                                     backingPath, speed);
+    threads = g_new0(virThread, QEMU_DOMAIN_LIST_FSFREEZE_THREADS);
 
-    if (qemuDomainObjExitMonitor(driver, vm) < 0 || ret < 0) {
-        ret = -1;
-        goto endjob;
+    for (i = 1; i < MIN(data.nvms, QEMU_DOMAIN_LIST_FSFREEZE_THREADS); i++) {
+        if (virThreadCreateFull(&threads[nthreads], true,
+                                qemuDomainListFSFreezeWorker,
+                                "qemu-fsfreeze", false, &data) < 0) {
+            VIR_WARN("Unable to create fsfreeze worker thread: %s",
+                     g_strerror(errno));
+            break;
+        }
+        nthreads++;
     }
 
-    if (mirror) {
-        disk->mirror = g_steal_pointer(&mirror);
-        disk->mirrorJob = VIR_DOMAIN_BLOCK_JOB_TYPE_ACTIVE_COMMIT;
-    }
-    qemuBlockJobStarted(job, vm);
+    qemuDomainListFSFreezeWorker(&data);
 
- endjob:
-    if (ret < 0 && clean_access) {
-        virErrorPtr orig_err;
-        virErrorPreserveLast(&orig_err);
-        /* Revert access to read-only, if possible.  */
-        qemuDomainStorageSourceAccessAllow(driver, vm, baseSource,
-                                           true, false, false);
-        if (top_parent && top_parent != disk->src)
-            qemuDomainStorageSourceAccessAllow(driver, vm, top_parent,
-                                               true, false, false);
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
 
-        virErrorRestore(&orig_err);
+    tmpret = g_new0(virDomainFSFreezeRecordPtr, data.nvms + 1);
+    for (i = 0; i < data.nvms; i++) {
+        if (data.records[i])
+            tmpret[nrecords++] = g_steal_pointer(&data.records[i]);
     }
-    qemuBlockJobStartupFinalize(vm, job);
-    qemuDomainObjEndJob(driver, vm);
+
+    *retResults = g_steal_pointer(&tmpret);
+    ret = nrecords;
 
  cleanup:
-    virDomainObjEndAPI(&vm);
+    if (data.records) {
+        for (i = 0; i < data.nvms; i++) {
+            if (!data.records[i])
+                continue;
+            virObjectUnref(data.records[i]->dom);
+            g_free(data.records[i]->error);
+            g_free(data.records[i]);
+        }
+        g_free(data.records);
+    }
+    virObjectListFreeCount(data.vms, data.nvms);
+    virMutexDestroy(&data.lock);
     return ret;
 }
 
+
 static int
-qemuDomainOpenGraphics(virDomainPtr dom,
-                       unsigned int idx,
-                       int fd,
+qemuDomainListFSFreeze(virConnectPtr conn,
+                       virDomainPtr *doms,
+                       unsigned int ndoms,
+                       int timeout,
+                       virDomainFSFreezeRecordPtr **retResults,
                        unsigned int flags)
 {
-    virQEMUDriverPtr driver = dom->conn->privateData;
-    virDomainObjPtr vm = NULL;
-    int ret = -1;
-    qemuDomainObjPrivatePtr priv;
-    const char *protocol;
+    virCheckFlags(0, -1);
 
-    virCheckFlags(VIR_DOMAIN_OPEN_GRAPHICS_SKIPAUTH, -1);
+    return qemuDomainListFSFreezeThaw(conn, doms, ndoms, timeout,
+                                      retResults, true);
+}
 
-    if (!(vm = qemuDomainObjFromDomain(dom)))
-        return -1;
 
-    if (virDomainOpenGraphicsEnsureACL(dom->conn, vm->def) < 0)
-        goto cleanup;
+static int
+qemuDomainListFSThaw(virConnectPtr conn,
+                     virDomainPtr *doms,
+                     unsigned int ndoms,
+                     int timeout,
+                     virDomainFSFreezeRecordPtr **retResults,
+                     unsigned int flags)
+{
+    virCheckFlags(0, -1);
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
-        goto cleanup;
+    return qemuDomainListFSFreezeThaw(conn, doms, ndoms, timeout,
+                                      retResults, false);
+}
 
-    if (virDomainObjCheckActive(vm) < 0)
-        goto endjob;
 
-    priv = vm->privateData;
+/* Number of domains stopped at the same time by qemuDomainListStop if
+ * the caller doesn't say */
+#define QEMU_DOMAIN_LIST_STOP_THREADS 8
 
-    if (idx >= vm->def->ngraphics) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("No graphics backend with index %d"), idx);
-        goto endjob;
-    }
-    switch (vm->def->graphics[idx]->type) {
-    case VIR_DOMAIN_GRAPHICS_TYPE_VNC:
-        protocol = "vnc";
-        break;
-    case VIR_DOMAIN_GRAPHICS_TYPE_SPICE:
-        protocol = "spice";
-        break;
-    case VIR_DOMAIN_GRAPHICS_TYPE_SDL:
-    case VIR_DOMAIN_GRAPHICS_TYPE_RDP:
-    case VIR_DOMAIN_GRAPHICS_TYPE_DESKTOP:
-    case VIR_DOMAIN_GRAPHICS_TYPE_EGL_HEADLESS:
-        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
-                       _("Can only open VNC or SPICE graphics backends, not %s"),
-                       virDomainGraphicsTypeToString(vm->def->graphics[idx]->type));
-        goto endjob;
-    case VIR_DOMAIN_GRAPHICS_TYPE_LAST:
-    default:
-        virReportEnumRangeError(virDomainGraphicsType,
-                                vm->def->graphics[idx]->type);
-        goto endjob;
-    }
+typedef struct _qemuDomainListStopData qemuDomainListStopData;
+typedef qemuDomainListStopData *qemuDomainListStopDataPtr;
+struct _qemuDomainListStopData {
+    virQEMUDriverPtr driver;
+    unsigned int flags;
+    unsigned long long deadline; /* in ms, 0 if there is none */
 
-    if (qemuSecuritySetImageFDLabel(driver->securityManager, vm->def, fd) < 0)
-        goto endjob;
+    virDomainObjPtr *vms;
+    virDomainStopRecordPtr *records;
+    size_t nvms;
 
-    qemuDomainObjEnterMonitor(driver, vm);
-    ret = qemuMonitorOpenGraphics(priv->mon, protocol, fd, "graphicsfd",
-                                  (flags & VIR_DOMAIN_OPEN_GRAPHICS_SKIPAUTH) != 0);
-    if (qemuDomainObjExitMonitor(driver, vm) < 0)
-        ret = -1;
+    /* protects @next, the index of the next domain to process */
+    virMutex lock;
+    size_t next;
+};
 
- endjob:
-    qemuDomainObjEndJob(driver, vm);
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return ret;
+/*
+ * Waits until @vm is no longer active. The domain lock is dropped while
+ * waiting and the domain is rechecked at least once a second since not
+ * every way a domain may stop broadcasts its condition.
+ */
+static int
+qemuDomainListStopWaitInactive(virDomainObjPtr vm,
+                               unsigned long long deadline)
+{
+    while (virDomainObjIsActive(vm)) {
+        unsigned long long now;
+        unsigned long long until;
+
+        if (virTimeMillisNow(&now) < 0)
+            return -1;
+
+        if (deadline && now >= deadline) {
+            virReportError(VIR_ERR_OPERATION_TIMEOUT, "%s",
+                           _("timed out waiting for the domain to shut down"));
+            return -1;
+        }
+
+        until = now + 1000;
+        if (deadline && until > deadline)
+            until = deadline;
+
+        if (virDomainObjWaitUntil(vm, until) < 0)
+            return -1;
+    }
+
+    return 0;
 }
 
+
 static int
-qemuDomainOpenGraphicsFD(virDomainPtr dom,
-                         unsigned int idx,
-                         unsigned int flags)
+qemuDomainListStopOne(qemuDomainListStopDataPtr data,
+                      virDomainObjPtr vm)
 {
-    virQEMUDriverPtr driver = dom->conn->privateData;
-    virDomainObjPtr vm = NULL;
-    int ret = -1;
-    qemuDomainObjPrivatePtr priv;
-    const char *protocol;
-    int pair[2] = {-1, -1};
+    unsigned int saveFlags = 0;
 
-    virCheckFlags(VIR_DOMAIN_OPEN_GRAPHICS_SKIPAUTH, -1);
+    if (data->deadline) {
+        unsigned long long now;
 
-    if (!(vm = qemuDomainObjFromDomain(dom)))
+        if (virTimeMillisNow(&now) < 0)
+            return -1;
+
+        /* domains whose turn comes after the deadline aren't touched at
+         * all so that the caller can deal with them on its own */
+        if (now >= data->deadline) {
+            virReportError(VIR_ERR_OPERATION_TIMEOUT, "%s",
+                           _("timed out before stopping the domain"));
+            return -1;
+        }
+    }
+
+    if (!virDomainObjIsActive(vm))
+        return 0;
+
+    if (data->flags & VIR_DOMAIN_LIST_STOP_SUSPEND)
+        return qemuDomainSuspendInternal(data->driver, vm);
+
+    if (data->flags & VIR_DOMAIN_LIST_STOP_MANAGED_SAVE) {
+        if (data->flags & VIR_DOMAIN_LIST_STOP_BYPASS_CACHE)
+            saveFlags |= VIR_DOMAIN_SAVE_BYPASS_CACHE;
+
+        return qemuDomainManagedSaveInternal(data->driver, vm, saveFlags);
+    }
+
+    if (qemuDomainShutdownFlagsInternal(data->driver, vm, 0) < 0)
         return -1;
 
-    if (virDomainOpenGraphicsFdEnsureACL(dom->conn, vm->def) < 0)
-        goto cleanup;
+    return qemuDomainListStopWaitInactive(vm, data->deadline);
+}
 
-    if (virDomainObjCheckActive(vm) < 0)
-        goto cleanup;
 
-    priv = vm->privateData;
+static void
+qemuDomainListStopWorker(void *opaque)
+{
+    qemuDomainListStopDataPtr data = opaque;
 
-    if (idx >= vm->def->ngraphics) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("No graphics backend with index %d"), idx);
-        goto cleanup;
+    while (true) {
+        virDomainStopRecordPtr rec;
+        virDomainObjPtr vm;
+        size_t i;
+
+        virMutexLock(&data->lock);
+        i = data->next++;
+        virMutexUnlock(&data->lock);
+
+        if (i >= data->nvms)
+            break;
+
+        /* skipped or already failed in qemuDomainListStop */
+        rec = data->records[i];
+        if (!rec || rec->error)
+            continue;
+
+        vm = data->vms[i];
+        virObjectLock(vm);
+        rec->result = qemuDomainListStopOne(data, vm);
+        virObjectUnlock(vm);
+
+        if (rec->result < 0) {
+            rec->error = g_strdup(virGetLastErrorMessage());
+            virResetLastError();
+        }
     }
-    switch (vm->def->graphics[idx]->type) {
-    case VIR_DOMAIN_GRAPHICS_TYPE_VNC:
-        protocol = "vnc";
-        break;
-    case VIR_DOMAIN_GRAPHICS_TYPE_SPICE:
-        protocol = "spice";
-        break;
-    case VIR_DOMAIN_GRAPHICS_TYPE_SDL:
-    case VIR_DOMAIN_GRAPHICS_TYPE_RDP:
-    case VIR_DOMAIN_GRAPHICS_TYPE_DESKTOP:
-    case VIR_DOMAIN_GRAPHICS_TYPE_EGL_HEADLESS:
-        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
-                       _("Can only open VNC or SPICE graphics backends, not %s"),
-                       virDomainGraphicsTypeToString(vm->def->graphics[idx]->type));
-        goto cleanup;
-    case VIR_DOMAIN_GRAPHICS_TYPE_LAST:
-    default:
-        virReportEnumRangeError(virDomainGraphicsType,
-                                vm->def->graphics[idx]->type);
-        goto cleanup;
+}
+
+
+/*
+ * Stops all of @doms using at most @parallel threads, including the
+ * caller's one which takes part in the work so that the operation
+ * succeeds even if no additional thread can be created.
+ */
+static int
+qemuDomainListStop(virConnectPtr conn,
+                   virDomainPtr *doms,
+                   unsigned int ndoms,
+                   unsigned int parallel,
+                   int timeout,
+                   virDomainStopRecordPtr **retResults,
+                   unsigned int flags)
+{
+    virQEMUDriverPtr driver = conn->privateData;
+    qemuDomainListStopData data = { .driver = driver, .flags = flags };
+    g_autofree virThread *threads = NULL;
+    size_t nthreads = 0;
+    size_t nrecords = 0;
+    virDomainStopRecordPtr *tmpret = NULL;
+    size_t i;
+    int ret = -1;
+
+    virCheckFlags(VIR_DOMAIN_LIST_STOP_MANAGED_SAVE |
+                  VIR_DOMAIN_LIST_STOP_SUSPEND |
+                  VIR_DOMAIN_LIST_STOP_BYPASS_CACHE, -1);
+
+    if (parallel == 0)
+        parallel = QEMU_DOMAIN_LIST_STOP_THREADS;
+
+    if (timeout > 0) {
+        if (virTimeMillisNow(&data.deadline) < 0)
+            return -1;
+        data.deadline += timeout * 1000ull;
     }
 
-    if (qemuSecuritySetSocketLabel(driver->securityManager, vm->def) < 0)
-        goto cleanup;
+    if (virMutexInit(&data.lock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("cannot initialize mutex"));
+        return -1;
+    }
 
-    if (socketpair(PF_UNIX, SOCK_STREAM, 0, pair) < 0)
+    if (virDomainObjListConvert(driver->domains, conn, doms, ndoms,
+                                &data.vms, &data.nvms, NULL, 0, true) < 0)
         goto cleanup;
 
-    if (qemuSecurityClearSocketLabel(driver->securityManager, vm->def) < 0)
-        goto cleanup;
+    data.records = g_new0(virDomainStopRecordPtr, data.nvms);
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
-        goto cleanup;
-    qemuDomainObjEnterMonitor(driver, vm);
-    ret = qemuMonitorOpenGraphics(priv->mon, protocol, pair[1], "graphicsfd",
-                                  (flags & VIR_DOMAIN_OPEN_GRAPHICS_SKIPAUTH));
-    if (qemuDomainObjExitMonitor(driver, vm) < 0)
-        ret = -1;
-    qemuDomainObjEndJob(driver, vm);
-    if (ret < 0)
-        goto cleanup;
+    for (i = 0; i < data.nvms; i++) {
+        virDomainObjPtr vm = data.vms[i];
+        virDomainStopRecordPtr rec;
 
-    ret = pair[0];
-    pair[0] = -1;
+        virObjectLock(vm);
 
- cleanup:
-    VIR_FORCE_CLOSE(pair[0]);
-    VIR_FORCE_CLOSE(pair[1]);
-    virDomainObjEndAPI(&vm);
-    return ret;
-}
+        /* skip domains undefined since the list was converted */
+        if (vm->removing) {
+            virObjectUnlock(vm);
+            continue;
+        }
 
-typedef enum {
-    QEMU_BLOCK_IOTUNE_SET_BYTES            = 1 << 0,
-    QEMU_BLOCK_IOTUNE_SET_IOPS             = 1 << 1,
-    QEMU_BLOCK_IOTUNE_SET_BYTES_MAX        = 1 << 2,
-    QEMU_BLOCK_IOTUNE_SET_IOPS_MAX         = 1 << 3,
-    QEMU_BLOCK_IOTUNE_SET_SIZE_IOPS        = 1 << 4,
-    QEMU_BLOCK_IOTUNE_SET_GROUP_NAME       = 1 << 5,
-    QEMU_BLOCK_IOTUNE_SET_BYTES_MAX_LENGTH = 1 << 6,
-    QEMU_BLOCK_IOTUNE_SET_IOPS_MAX_LENGTH  = 1 << 7,
-} qemuBlockIoTuneSetFlags;
+        rec = g_new0(virDomainStopRecord, 1);
+        data.records[i] = rec;
 
+        if (!(rec->dom = virGetDomain(conn, vm->def->name,
+                                      vm->def->uuid, vm->def->id))) {
+            virObjectUnlock(vm);
+            goto cleanup;
+        }
 
-/* If the user didn't specify bytes limits, inherit previous values;
- * likewise if the user didn't specify iops limits.  */
-static int
-qemuDomainSetBlockIoTuneDefaults(virDomainBlockIoTuneInfoPtr newinfo,
-                                 virDomainBlockIoTuneInfoPtr oldinfo,
-                                 qemuBlockIoTuneSetFlags set_fields)
-{
-#define SET_IOTUNE_DEFAULTS(BOOL, FIELD) \
-    if (!(set_fields & QEMU_BLOCK_IOTUNE_SET_##BOOL)) { \
-        newinfo->total_##FIELD = oldinfo->total_##FIELD; \
-        newinfo->read_##FIELD = oldinfo->read_##FIELD; \
-        newinfo->write_##FIELD = oldinfo->write_##FIELD; \
+        if (virDomainListStopEnsureACL(conn, vm->def, flags) < 0) {
+            rec->result = -1;
+            rec->error = g_strdup(virGetLastErrorMessage());
+            virResetLastError();
+        }
+
+        virObjectUnlock(vm);
     }
 
-    SET_IOTUNE_DEFAULTS(BYTES, bytes_sec);
-    SET_IOTUNE_DEFAULTS(BYTES_MAX, bytes_sec_max);
-    SET_IOTUNE_DEFAULTS(IOPS, iops_sec);
-    SET_IOTUNE_DEFAULTS(IOPS_MAX, iops_sec_max);
-#undef SET_IOTUNE_DEFAULTS
+    threads = g_new0(virThread, MIN(data.nvms, parallel));
 
-    if (!(set_fields & QEMU_BLOCK_IOTUNE_SET_SIZE_IOPS))
-        newinfo->size_iops_sec = oldinfo->size_iops_sec;
-    if (!(set_fields & QEMU_BLOCK_IOTUNE_SET_GROUP_NAME))
-        newinfo->group_name = g_strdup(oldinfo->group_name);
+    for (i = 1; i < MIN(data.nvms, parallel); i++) {
+        if (virThreadCreateFull(&threads[nthreads], true,
+                                qemuDomainListStopWorker,
+                                "qemu-stop", false, &data) < 0) {
+            VIR_WARN("Unable to create domain stop worker thread: %s",
+                     g_strerror(errno));
+            break;
+        }
+        nthreads++;
+    }
 
-    /* The length field is handled a bit differently. If not defined/set,
-     * QEMU will default these to 0 or 1 depending on whether something in
-     * the same family is set or not.
-     *
-     * Similar to other values, if nothing in the family is defined/set,
-     * then take whatever is in the oldinfo.
-     *
-     * To clear an existing limit, a 0 is provided; however, passing that
-     * 0 onto QEMU if there's a family value defined/set (or defaulted)
-     * will cause an error. So, to mimic that, if our oldinfo was set and
-     * our newinfo is clearing, then set max_length based on whether we
-     * have a value in the family set/defined. */
-#define SET_MAX_LENGTH(BOOL, FIELD) \
-    if (!(set_fields & QEMU_BLOCK_IOTUNE_SET_##BOOL)) \
-        newinfo->FIELD##_max_length = oldinfo->FIELD##_max_length; \
-    else if ((set_fields & QEMU_BLOCK_IOTUNE_SET_##BOOL) && \
-             oldinfo->FIELD##_max_length && \
-             !newinfo->FIELD##_max_length) \
-        newinfo->FIELD##_max_length = (newinfo->FIELD || \
-                                       newinfo->FIELD##_max) ? 1 : 0;
+    qemuDomainListStopWorker(&data);
 
-    SET_MAX_LENGTH(BYTES_MAX_LENGTH, total_bytes_sec);
-    SET_MAX_LENGTH(BYTES_MAX_LENGTH, read_bytes_sec);
-    SET_MAX_LENGTH(BYTES_MAX_LENGTH, write_bytes_sec);
-    SET_MAX_LENGTH(IOPS_MAX_LENGTH, total_iops_sec);
-    SET_MAX_LENGTH(IOPS_MAX_LENGTH, read_iops_sec);
-    SET_MAX_LENGTH(IOPS_MAX_LENGTH, write_iops_sec);
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
 
-#undef SET_MAX_LENGTH
+    tmpret = g_new0(virDomainStopRecordPtr, data.nvms + 1);
+    for (i = 0; i < data.nvms; i++) {
+        if (data.records[i])
+            tmpret[nrecords++] = g_steal_pointer(&data.records[i]);
+    }
 
-    return 0;
+    *retResults = g_steal_pointer(&tmpret);
+    ret = nrecords;
+
+ cleanup:
+    if (data.records) {
+        for (i = 0; i < data.nvms; i++) {
+            if (!data.records[i])
+                continue;
+            virObjectUnref(data.records[i]->dom);
+            g_free(data.records[i]->error);
+            g_free(data.records[i]);
+        }
+        g_free(data.records);
+    }
+    virObjectListFreeCount(data.vms, data.nvms);
+    virMutexDestroy(&data.lock);
+    return ret;
 }
 
 
-static void
-qemuDomainSetGroupBlockIoTune(virDomainDefPtr def,
-                              virDomainBlockIoTuneInfoPtr iotune)
+static int
+qemuNodeGetFreePages(virConnectPtr conn,
+                     unsigned int npages,
+                     unsigned int *pages,
+                     int startCell,
+                     unsigned int cellCount,
+                     unsigned long long *counts,
+                     unsigned int flags)
 {
-    size_t i;
-
-    if (!iotune->group_name)
-        return;
+    virCheckFlags(0, -1);
 
-    for (i = 0; i < def->ndisks; i++) {
-        virDomainDiskDefPtr d = def->disks[i];
+    if (virNodeGetFreePagesEnsureACL(conn) < 0)
+        return -1;
 
-        if (STREQ_NULLABLE(d->blkdeviotune.group_name, iotune->group_name)) {
-            VIR_FREE(d->blkdeviotune.group_name);
-            virDomainBlockIoTuneInfoCopy(iotune, &d->blkdeviotune);
-        }
-    }
+    return virHostMemGetFreePages(npages, pages, startCell, cellCount, counts);
 }
 
 
-static virDomainBlockIoTuneInfoPtr
-qemuDomainFindGroupBlockIoTune(virDomainDefPtr def,
-                               virDomainDiskDefPtr disk,
-                               virDomainBlockIoTuneInfoPtr newiotune)
+static char *
+qemuConnectGetDomainCapabilities(virConnectPtr conn,
+                                 const char *emulatorbin,
+                                 const char *arch_str,
+                                 const char *machine,
+                                 const char *virttype_str,
+                                 unsigned int flags)
 {
-    size_t i;
+    virQEMUDriverPtr driver = conn->privateData;
+    g_autoptr(virQEMUCaps) qemuCaps = NULL;
+    virArch arch;
+    virDomainVirtType virttype;
+    g_autoptr(virDomainCaps) domCaps = NULL;
 
-    if (!newiotune->group_name ||
-        STREQ_NULLABLE(disk->blkdeviotune.group_name, newiotune->group_name))
-        return &disk->blkdeviotune;
+    virCheckFlags(0, NULL);
 
-    for (i = 0; i < def->ndisks; i++) {
-        virDomainDiskDefPtr d = def->disks[i];
+    if (virConnectGetDomainCapabilitiesEnsureACL(conn) < 0)
+        return NULL;
 
-        if (STREQ_NULLABLE(newiotune->group_name, d->blkdeviotune.group_name))
-            return &d->blkdeviotune;
+    qemuCaps = virQEMUCapsCacheLookupDefault(driver->qemuCapsCache,
+                                             emulatorbin,
+                                             arch_str,
+                                             virttype_str,
+                                             machine,
+                                             &arch, &virttype, &machine);
+    if (!qemuCaps)
+        return NULL;
+
+    if (!(domCaps = virQEMUDriverGetDomainCapabilities(driver,
+                                                       qemuCaps, machine,
+                                                       arch, virttype)))
+        return NULL;
+
+    return virDomainCapsFormat(domCaps);
+}
+
+
+/*
+ * Host wide data gathered once and shared by all domains of a single
+ * stats request. Members are NULL if the data couldn't be gathered,
+ * in which case the workers have to query it on their own.
+ */
+typedef struct _qemuDomainGetStatsHost qemuDomainGetStatsHost;
+typedef qemuDomainGetStatsHost *qemuDomainGetStatsHostPtr;
+struct _qemuDomainGetStatsHost {
+    virHashTablePtr ifstats; /* see virNetDevTapInterfaceStatsAll */
+};
+
+
+static void
+qemuDomainGetStatsHostGather(qemuDomainGetStatsHostPtr host,
+                             unsigned int stats)
+{
+    if (stats & VIR_DOMAIN_STATS_INTERFACE &&
+        !(host->ifstats = virNetDevTapInterfaceStatsAll())) {
+        VIR_DEBUG("Unable to get stats of all interfaces: %s",
+                  virGetLastErrorMessage());
+        virResetLastError();
     }
+}
 
-    return &disk->blkdeviotune;
+
+static void
+qemuDomainGetStatsHostClear(qemuDomainGetStatsHostPtr host)
+{
+    virHashFree(host->ifstats);
+    host->ifstats = NULL;
 }
 
 
 static int
-qemuDomainCheckBlockIoTuneReset(virDomainDiskDefPtr disk,
-                                virDomainBlockIoTuneInfoPtr newiotune)
+qemuDomainGetStatsState(virQEMUDriverPtr driver G_GNUC_UNUSED,
+                        virDomainObjPtr dom,
+                        virTypedParamListPtr params,
+                        unsigned int privflags G_GNUC_UNUSED,
+                        const qemuDomainGetStatsHost *host G_GNUC_UNUSED)
 {
-    if (virDomainBlockIoTuneInfoHasAny(newiotune))
-        return 0;
-
-    if (newiotune->group_name &&
-        STRNEQ_NULLABLE(newiotune->group_name, disk->blkdeviotune.group_name)) {
-        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
-                       _("creating a new group/updating existing with all"
-                         " tune parameters zero is not supported"));
+    if (virTypedParamListAddInt(params, dom->state.state, "state.state") < 0)
         return -1;
-    }
 
-    /* all zero means remove any throttling and remove from group for qemu */
-    VIR_FREE(newiotune->group_name);
+    if (virTypedParamListAddInt(params, dom->state.reason, "state.reason") < 0)
+        return -1;
 
     return 0;
 }
 
 
+typedef enum {
+    QEMU_DOMAIN_STATS_HAVE_JOB = 1 << 0, /* job is entered, monitor can be
+                                            accessed */
+    QEMU_DOMAIN_STATS_BACKING  = 1 << 1, /* include backing chain in
+                                            block stats */
+    QEMU_DOMAIN_STATS_CACHED   = 1 << 2, /* the stats cache may be used */
+} qemuDomainStatsFlags;
+
+
+#define HAVE_JOB(flags) ((flags) & QEMU_DOMAIN_STATS_HAVE_JOB)
+
+
+typedef struct _virQEMUResctrlMonData virQEMUResctrlMonData;
+typedef virQEMUResctrlMonData *virQEMUResctrlMonDataPtr;
+struct _virQEMUResctrlMonData {
+    char *name;
+    char *vcpus;
+    virResctrlMonitorStatsPtr *stats;
+    size_t nstats;
+};
+
+
+static void
+qemuDomainFreeResctrlMonData(virQEMUResctrlMonDataPtr resdata)
+{
+    size_t i = 0;
+
+    VIR_FREE(resdata->name);
+    VIR_FREE(resdata->vcpus);
+    for (i = 0; i < resdata->nstats; i++)
+        virResctrlMonitorStatsFree(resdata->stats[i]);
+    VIR_FREE(resdata->stats);
+    VIR_FREE(resdata);
+}
+
+
+/**
+ * qemuDomainGetResctrlMonData:
+ * @dom: Pointer for the domain that the resctrl monitors reside in
+ * @driver: Pointer to qemu driver
+ * @resdata: Pointer of virQEMUResctrlMonDataPtr pointer for receiving the
+ *            virQEMUResctrlMonDataPtr array. Caller is responsible for
+ *            freeing the array.
+ * @nresdata: Pointer of size_t to report the size virQEMUResctrlMonDataPtr
+ *            array to caller. If *@nresdata is not 0, even if function
+ *            returns an error, the caller is also required to call
+ *            qemuDomainFreeResctrlMonData to free each element in the
+ *            *@resdata array and then the array itself.
+ * @tag: Could be VIR_RESCTRL_MONITOR_TYPE_CACHE for getting cache statistics
+ *       from @dom cache monitors. VIR_RESCTRL_MONITOR_TYPE_MEMBW for
+ *       getting memory bandwidth statistics from memory bandwidth monitors.
+ *
+ * Get cache or memory bandwidth statistics from @dom monitors.
+ *
+ * Returns -1 on failure, or 0 on success.
+ */
 static int
-qemuDomainSetBlockIoTune(virDomainPtr dom,
-                         const char *path,
-                         virTypedParameterPtr params,
-                         int nparams,
-                         unsigned int flags)
+qemuDomainGetResctrlMonData(virQEMUDriverPtr driver,
+                            virDomainObjPtr dom,
+                            virQEMUResctrlMonDataPtr **resdata,
+                            size_t *nresdata,
+                            virResctrlMonitorType tag)
 {
-    virQEMUDriverPtr driver = dom->conn->privateData;
-    virDomainObjPtr vm = NULL;
-    qemuDomainObjPrivatePtr priv;
-    virDomainDefPtr def = NULL;
-    virDomainDefPtr persistentDef = NULL;
-    virDomainBlockIoTuneInfo info;
-    virDomainBlockIoTuneInfo conf_info;
-    g_autofree char *drivealias = NULL;
-    const char *qdevid = NULL;
-    int ret = -1;
-    size_t i;
-    virDomainDiskDefPtr conf_disk = NULL;
-    virDomainDiskDefPtr disk;
-    qemuBlockIoTuneSetFlags set_fields = 0;
-    bool supportMaxOptions = true;
-    bool supportGroupNameOption = true;
-    bool supportMaxLengthOptions = true;
-    g_autoptr(virQEMUDriverConfig) cfg = NULL;
-    virObjectEventPtr event = NULL;
-    virTypedParameterPtr eventParams = NULL;
-    int eventNparams = 0;
-    int eventMaxparams = 0;
-    virDomainBlockIoTuneInfoPtr cur_info;
-    virDomainBlockIoTuneInfoPtr conf_cur_info;
-
+    virDomainResctrlDefPtr resctrl = NULL;
+    virQEMUResctrlMonDataPtr res = NULL;
+    char **features = NULL;
+    g_autoptr(virCaps) caps = NULL;
+    size_t i = 0;
+    size_t j = 0;
 
-    virCheckFlags(VIR_DOMAIN_AFFECT_LIVE |
-                  VIR_DOMAIN_AFFECT_CONFIG, -1);
-    if (virTypedParamsValidate(params, nparams,
-                               VIR_DOMAIN_BLOCK_IOTUNE_TOTAL_BYTES_SEC,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_READ_BYTES_SEC,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_WRITE_BYTES_SEC,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_TOTAL_IOPS_SEC,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_READ_IOPS_SEC,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_WRITE_IOPS_SEC,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_TOTAL_BYTES_SEC_MAX,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_READ_BYTES_SEC_MAX,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_WRITE_BYTES_SEC_MAX,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_TOTAL_IOPS_SEC_MAX,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_READ_IOPS_SEC_MAX,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_WRITE_IOPS_SEC_MAX,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_SIZE_IOPS_SEC,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_GROUP_NAME,
-                               VIR_TYPED_PARAM_STRING,
-                               VIR_DOMAIN_BLOCK_IOTUNE_TOTAL_BYTES_SEC_MAX_LENGTH,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_READ_BYTES_SEC_MAX_LENGTH,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_WRITE_BYTES_SEC_MAX_LENGTH,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_TOTAL_IOPS_SEC_MAX_LENGTH,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_READ_IOPS_SEC_MAX_LENGTH,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_WRITE_IOPS_SEC_MAX_LENGTH,
-                               VIR_TYPED_PARAM_ULLONG,
-                               NULL) < 0)
+    if (!(caps = virQEMUDriverGetCapabilities(driver, false)))
         return -1;
 
-    memset(&info, 0, sizeof(info));
-    memset(&conf_info, 0, sizeof(conf_info));
-
-    if (!(vm = qemuDomainObjFromDomain(dom)))
+    switch (tag) {
+    case VIR_RESCTRL_MONITOR_TYPE_CACHE:
+        if (caps->host.cache.monitor)
+            features = caps->host.cache.monitor->features;
+        break;
+    case VIR_RESCTRL_MONITOR_TYPE_MEMBW:
+        if (caps->host.memBW.monitor)
+            features = caps->host.memBW.monitor->features;
+        break;
+    case VIR_RESCTRL_MONITOR_TYPE_UNSUPPORT:
+    case VIR_RESCTRL_MONITOR_TYPE_LAST:
+        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED, "%s",
+                       _("Unsupported resctrl monitor type"));
         return -1;
+    }
 
-    if (virDomainSetBlockIoTuneEnsureACL(dom->conn, vm->def, flags) < 0)
-        goto cleanup;
+    if (virStringListLength((const char * const *)features) == 0)
+        return 0;
 
-    cfg = virQEMUDriverGetConfig(driver);
+    for (i = 0; i < dom->def->nresctrls; i++) {
+        resctrl = dom->def->resctrls[i];
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
-        goto cleanup;
+        for (j = 0; j < resctrl->nmonitors; j++) {
+            virDomainResctrlMonDefPtr domresmon = NULL;
+            virResctrlMonitorPtr monitor = NULL;
 
-    priv = vm->privateData;
+            domresmon = resctrl->monitors[j];
+            monitor = domresmon->instance;
 
-    if (virDomainObjGetDefs(vm, flags, &def, &persistentDef) < 0)
-        goto endjob;
+            if (domresmon->tag != tag)
+                continue;
 
-    if (virTypedParamsAddString(&eventParams, &eventNparams, &eventMaxparams,
-                                VIR_DOMAIN_TUNABLE_BLKDEV_DISK, path) < 0)
-        goto endjob;
+            if (VIR_ALLOC(res) < 0)
+                return -1;
 
-#define SET_IOTUNE_FIELD(FIELD, BOOL, CONST) \
-    if (STREQ(param->field, VIR_DOMAIN_BLOCK_IOTUNE_##CONST)) { \
-        info.FIELD = param->value.ul; \
-        set_fields |= QEMU_BLOCK_IOTUNE_SET_##BOOL; \
-        if (virTypedParamsAddULLong(&eventParams, &eventNparams, \
-                                    &eventMaxparams, \
-                                    VIR_DOMAIN_TUNABLE_BLKDEV_##CONST, \
-                                    param->value.ul) < 0) \
-            goto endjob; \
-        continue; \
-    }
+            /* If virBitmapFormat successfully returns an vcpu string, then
+             * res.vcpus is assigned with an memory space holding it,
+             * let this newly allocated memory buffer to be freed along with
+             * the free of 'res' */
+            if (!(res->vcpus = virBitmapFormat(domresmon->vcpus)))
+                goto error;
 
-    for (i = 0; i < nparams; i++) {
-        virTypedParameterPtr param = &params[i];
+            res->name = g_strdup(virResctrlMonitorGetID(monitor));
 
-        if (param->value.ul > QEMU_BLOCK_IOTUNE_MAX) {
-            virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED,
-                           _("block I/O throttle limit value must"
-                             " be no more than %llu"), QEMU_BLOCK_IOTUNE_MAX);
-            goto endjob;
-        }
+            if (virResctrlMonitorGetStats(monitor, (const char **)features,
+                                          &res->stats, &res->nstats) < 0)
+                goto error;
 
-        SET_IOTUNE_FIELD(total_bytes_sec, BYTES, TOTAL_BYTES_SEC);
-        SET_IOTUNE_FIELD(read_bytes_sec, BYTES, READ_BYTES_SEC);
-        SET_IOTUNE_FIELD(write_bytes_sec, BYTES, WRITE_BYTES_SEC);
-        SET_IOTUNE_FIELD(total_iops_sec, IOPS, TOTAL_IOPS_SEC);
-        SET_IOTUNE_FIELD(read_iops_sec, IOPS, READ_IOPS_SEC);
-        SET_IOTUNE_FIELD(write_iops_sec, IOPS, WRITE_IOPS_SEC);
+            if (VIR_APPEND_ELEMENT(*resdata, *nresdata, res) < 0)
+                goto error;
+        }
+    }
 
-        SET_IOTUNE_FIELD(total_bytes_sec_max, BYTES_MAX,
-                         TOTAL_BYTES_SEC_MAX);
-        SET_IOTUNE_FIELD(read_bytes_sec_max, BYTES_MAX,
-                         READ_BYTES_SEC_MAX);
-        SET_IOTUNE_FIELD(write_bytes_sec_max, BYTES_MAX,
-                         WRITE_BYTES_SEC_MAX);
-        SET_IOTUNE_FIELD(total_iops_sec_max, IOPS_MAX,
-                         TOTAL_IOPS_SEC_MAX);
-        SET_IOTUNE_FIELD(read_iops_sec_max, IOPS_MAX,
-                         READ_IOPS_SEC_MAX);
-        SET_IOTUNE_FIELD(write_iops_sec_max, IOPS_MAX,
-                         WRITE_IOPS_SEC_MAX);
-        SET_IOTUNE_FIELD(size_iops_sec, SIZE_IOPS, SIZE_IOPS_SEC);
+    return 0;
 
-        /* NB: Cannot use macro since this is a value.s not a value.ul */
-        if (STREQ(param->field, VIR_DOMAIN_BLOCK_IOTUNE_GROUP_NAME)) {
-            info.group_name = g_strdup(param->value.s);
-            set_fields |= QEMU_BLOCK_IOTUNE_SET_GROUP_NAME;
-            if (virTypedParamsAddString(&eventParams, &eventNparams,
-                                        &eventMaxparams,
-                                        VIR_DOMAIN_TUNABLE_BLKDEV_GROUP_NAME,
-                                        param->value.s) < 0)
-                goto endjob;
-            continue;
-        }
+ error:
+    qemuDomainFreeResctrlMonData(res);
+    return -1;
+}
 
-        SET_IOTUNE_FIELD(total_bytes_sec_max_length, BYTES_MAX_LENGTH,
-                         TOTAL_BYTES_SEC_MAX_LENGTH);
-        SET_IOTUNE_FIELD(read_bytes_sec_max_length, BYTES_MAX_LENGTH,
-                         READ_BYTES_SEC_MAX_LENGTH);
-        SET_IOTUNE_FIELD(write_bytes_sec_max_length, BYTES_MAX_LENGTH,
-                         WRITE_BYTES_SEC_MAX_LENGTH);
-        SET_IOTUNE_FIELD(total_iops_sec_max_length, IOPS_MAX_LENGTH,
-                         TOTAL_IOPS_SEC_MAX_LENGTH);
-        SET_IOTUNE_FIELD(read_iops_sec_max_length, IOPS_MAX_LENGTH,
-                         READ_IOPS_SEC_MAX_LENGTH);
-        SET_IOTUNE_FIELD(write_iops_sec_max_length, IOPS_MAX_LENGTH,
-                         WRITE_IOPS_SEC_MAX_LENGTH);
-    }
 
-#undef SET_IOTUNE_FIELD
+static int
+qemuDomainGetStatsMemoryBandwidth(virQEMUDriverPtr driver,
+                                  virDomainObjPtr dom,
+                                  virTypedParamListPtr params)
+{
+    virQEMUResctrlMonDataPtr *resdata = NULL;
+    char **features = NULL;
+    size_t nresdata = 0;
+    size_t i = 0;
+    size_t j = 0;
+    size_t k = 0;
+    int ret = -1;
 
-    if ((info.total_bytes_sec && info.read_bytes_sec) ||
-        (info.total_bytes_sec && info.write_bytes_sec)) {
-        virReportError(VIR_ERR_INVALID_ARG, "%s",
-                       _("total and read/write of bytes_sec "
-                         "cannot be set at the same time"));
-        goto endjob;
-    }
+    if (!virDomainObjIsActive(dom))
+        return 0;
 
-    if ((info.total_iops_sec && info.read_iops_sec) ||
-        (info.total_iops_sec && info.write_iops_sec)) {
-        virReportError(VIR_ERR_INVALID_ARG, "%s",
-                       _("total and read/write of iops_sec "
-                         "cannot be set at the same time"));
-        goto endjob;
-    }
+    if (qemuDomainGetResctrlMonData(driver, dom, &resdata, &nresdata,
+                                    VIR_RESCTRL_MONITOR_TYPE_MEMBW) < 0)
+        goto cleanup;
 
-    if ((info.total_bytes_sec_max && info.read_bytes_sec_max) ||
-        (info.total_bytes_sec_max && info.write_bytes_sec_max)) {
-        virReportError(VIR_ERR_INVALID_ARG, "%s",
-                       _("total and read/write of bytes_sec_max "
-                         "cannot be set at the same time"));
-        goto endjob;
-    }
+    if (nresdata == 0)
+        return 0;
 
-    if ((info.total_iops_sec_max && info.read_iops_sec_max) ||
-        (info.total_iops_sec_max && info.write_iops_sec_max)) {
-        virReportError(VIR_ERR_INVALID_ARG, "%s",
-                       _("total and read/write of iops_sec_max "
-                         "cannot be set at the same time"));
-        goto endjob;
-    }
+    if (virTypedParamListAddUInt(params, nresdata,
+                                 "memory.bandwidth.monitor.count") < 0)
+        goto cleanup;
 
-    virDomainBlockIoTuneInfoCopy(&info, &conf_info);
+    for (i = 0; i < nresdata; i++) {
+        if (virTypedParamListAddString(params, resdata[i]->name,
+                                       "memory.bandwidth.monitor.%zu.name",
+                                       i) < 0)
+            goto cleanup;
 
-    if (def) {
-        supportMaxOptions = virQEMUCapsGet(priv->qemuCaps,
-                                           QEMU_CAPS_DRIVE_IOTUNE_MAX);
-        supportGroupNameOption = virQEMUCapsGet(priv->qemuCaps,
-                                                QEMU_CAPS_DRIVE_IOTUNE_GROUP);
-        supportMaxLengthOptions =
-            virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_DRIVE_IOTUNE_MAX_LENGTH);
+        if (virTypedParamListAddString(params, resdata[i]->vcpus,
+                                       "memory.bandwidth.monitor.%zu.vcpus",
+                                       i) < 0)
+            goto cleanup;
 
-        if (!supportMaxOptions &&
-            (set_fields & (QEMU_BLOCK_IOTUNE_SET_BYTES_MAX |
-                           QEMU_BLOCK_IOTUNE_SET_IOPS_MAX |
-                           QEMU_BLOCK_IOTUNE_SET_SIZE_IOPS))) {
-            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
-                           _("a block I/O throttling parameter is not "
-                             "supported with this QEMU binary"));
-             goto endjob;
-        }
+        if (virTypedParamListAddUInt(params, resdata[i]->nstats,
+                                     "memory.bandwidth.monitor.%zu.node.count",
+                                     i) < 0)
+            goto cleanup;
 
-        if (!supportGroupNameOption &&
-            (set_fields & QEMU_BLOCK_IOTUNE_SET_GROUP_NAME)) {
-            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
-                           _("the block I/O throttling group parameter is not "
-                             "supported with this QEMU binary"));
-             goto endjob;
-        }
 
-        if (!supportMaxLengthOptions &&
-            (set_fields & (QEMU_BLOCK_IOTUNE_SET_BYTES_MAX_LENGTH |
-                           QEMU_BLOCK_IOTUNE_SET_IOPS_MAX_LENGTH))) {
-            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
-                           _("a block I/O throttling length parameter is not "
-                             "supported with this QEMU binary"));
-             goto endjob;
-        }
+        for (j = 0; j < resdata[i]->nstats; j++) {
+            if (virTypedParamListAddUInt(params, resdata[i]->stats[j]->id,
+                                         "memory.bandwidth.monitor.%zu."
+                                         "node.%zu.id",
+                                         i, j) < 0)
+                goto cleanup;
 
-        if (!(disk = qemuDomainDiskByName(def, path)))
-            goto endjob;
 
-        if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV) &&
-            QEMU_DOMAIN_DISK_PRIVATE(disk)->qomName) {
-            qdevid = QEMU_DOMAIN_DISK_PRIVATE(disk)->qomName;
-        } else {
-            if (!(drivealias = qemuAliasDiskDriveFromDisk(disk)))
-                goto endjob;
-        }
+            features = resdata[i]->stats[j]->features;
+            for (k = 0; features[k]; k++) {
+                if (STREQ(features[k], "mbm_local_bytes")) {
+                    /* The accumulative data passing through local memory
+                     * controller is recorded with 64 bit counter. */
+                    if (virTypedParamListAddULLong(params,
+                                                   resdata[i]->stats[j]->vals[k],
+                                                   "memory.bandwidth.monitor."
+                                                   "%zu.node.%zu.bytes.local",
+                                                   i, j) < 0)
+                        goto cleanup;
+                }
 
-        cur_info = qemuDomainFindGroupBlockIoTune(def, disk, &info);
+                if (STREQ(features[k], "mbm_total_bytes")) {
+                    /* The accumulative data passing through local and remote
+                     * memory controller is recorded with 64 bit counter. */
+                    if (virTypedParamListAddULLong(params,
+                                                   resdata[i]->stats[j]->vals[k],
+                                                   "memory.bandwidth.monitor."
+                                                   "%zu.node.%zu.bytes.total",
+                                                   i, j) < 0)
+                        goto cleanup;
+                }
+            }
+        }
+    }
 
-        if (qemuDomainSetBlockIoTuneDefaults(&info, cur_info,
-                                             set_fields) < 0)
-            goto endjob;
+    ret = 0;
+ cleanup:
+    for (i = 0; i < nresdata; i++)
+        qemuDomainFreeResctrlMonData(resdata[i]);
+    VIR_FREE(resdata);
+    return ret;
+}
 
-        if (qemuDomainCheckBlockIoTuneReset(disk, &info) < 0)
-            goto endjob;
 
-#define CHECK_MAX(val, _bool) \
-        do { \
-            if (info.val##_max) { \
-                if (!info.val) { \
-                    if (QEMU_BLOCK_IOTUNE_SET_##_bool) { \
-                        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, \
-                                       _("cannot reset '%s' when " \
-                                         "'%s' is set"), \
-                                       #val, #val "_max"); \
-                    } else { \
-                        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, \
-                                       _("value '%s' cannot be set if " \
-                                         "'%s' is not set"), \
-                                       #val "_max", #val); \
-                    } \
-                    goto endjob; \
-                } \
-                if (info.val##_max < info.val) { \
-                    virReportError(VIR_ERR_CONFIG_UNSUPPORTED, \
-                                   _("value '%s' cannot be " \
-                                     "smaller than '%s'"), \
-                                   #val "_max", #val); \
-                    goto endjob; \
-                } \
-            } \
-        } while (false)
+static int
+qemuDomainGetStatsCpuCache(virQEMUDriverPtr driver,
+                           virDomainObjPtr dom,
+                           virTypedParamListPtr params)
+{
+    virQEMUResctrlMonDataPtr *resdata = NULL;
+    size_t nresdata = 0;
+    size_t i = 0;
+    size_t j = 0;
+    int ret = -1;
 
-        CHECK_MAX(total_bytes_sec, BYTES);
-        CHECK_MAX(read_bytes_sec, BYTES);
-        CHECK_MAX(write_bytes_sec, BYTES);
-        CHECK_MAX(total_iops_sec, IOPS);
-        CHECK_MAX(read_iops_sec, IOPS);
-        CHECK_MAX(write_iops_sec, IOPS);
+    if (!virDomainObjIsActive(dom))
+        return 0;
 
-#undef CHECK_MAX
+    if (qemuDomainGetResctrlMonData(driver, dom, &resdata, &nresdata,
+                                    VIR_RESCTRL_MONITOR_TYPE_CACHE) < 0)
+        goto cleanup;
 
-         /* NB: Let's let QEMU decide how to handle issues with _length
-          * via the JSON error code from the block_set_io_throttle call */
+    if (virTypedParamListAddUInt(params, nresdata, "cpu.cache.monitor.count") < 0)
+        goto cleanup;
 
-        qemuDomainObjEnterMonitor(driver, vm);
-        ret = qemuMonitorSetBlockIoThrottle(priv->mon, drivealias, qdevid,
-                                            &info, supportMaxOptions,
-                                            set_fields & QEMU_BLOCK_IOTUNE_SET_GROUP_NAME,
-                                            supportMaxLengthOptions);
-        if (qemuDomainObjExitMonitor(driver, vm) < 0)
-            ret = -1;
-        if (ret < 0)
-            goto endjob;
-        ret = -1;
+    for (i = 0; i < nresdata; i++) {
+        if (virTypedParamListAddString(params, resdata[i]->name,
+                                       "cpu.cache.monitor.%zu.name", i) < 0)
+            goto cleanup;
 
-        if (virDomainDiskSetBlockIOTune(disk, &info) < 0)
-            goto endjob;
+        if (virTypedParamListAddString(params, resdata[i]->vcpus,
+                                       "cpu.cache.monitor.%zu.vcpus", i) < 0)
+            goto cleanup;
 
-        qemuDomainSetGroupBlockIoTune(def, &info);
+        if (virTypedParamListAddUInt(params, resdata[i]->nstats,
+                                     "cpu.cache.monitor.%zu.bank.count", i) < 0)
+            goto cleanup;
 
-        if (virDomainObjSave(vm, driver->xmlopt, cfg->stateDir) < 0)
-            goto endjob;
+        for (j = 0; j < resdata[i]->nstats; j++) {
+            if (virTypedParamListAddUInt(params, resdata[i]->stats[j]->id,
+                                         "cpu.cache.monitor.%zu.bank.%zu.id", i, j) < 0)
+                goto cleanup;
 
-        if (eventNparams) {
-            event = virDomainEventTunableNewFromDom(dom, eventParams, eventNparams);
-            eventNparams = 0;
-            virObjectEventStateQueue(driver->domainEventState, event);
+            /* 'resdata[i]->stats[j]->vals[0]' keeps the value of how many last
+             * level cache in bank j currently occupied by the vcpus listed in
+             * resource monitor i, in bytes. This value is reported through a
+             * 64 bit hardware counter, so it is better to be arranged with
+             * data type in 64 bit width, but considering the fact that
+             * physical cache on a CPU could never be designed to be bigger
+             * than 4G bytes in size, to keep the 'domstats' interface
+             * historically consistent, it is safe to report the value with a
+             * truncated 'UInt' data type here. */
+            if (virTypedParamListAddUInt(params,
+                                         (unsigned int)resdata[i]->stats[j]->vals[0],
+                                         "cpu.cache.monitor.%zu.bank.%zu.bytes",
+                                         i, j) < 0)
+                goto cleanup;
         }
     }
 
-    if (persistentDef) {
-        if (!(conf_disk = virDomainDiskByName(persistentDef, path, true))) {
-            virReportError(VIR_ERR_INVALID_ARG,
-                           _("missing persistent configuration for disk '%s'"),
-                           path);
-            goto endjob;
-        }
+    ret = 0;
+ cleanup:
+    for (i = 0; i < nresdata; i++)
+        qemuDomainFreeResctrlMonData(resdata[i]);
+    VIR_FREE(resdata);
+    return ret;
+}
 
-        conf_cur_info = qemuDomainFindGroupBlockIoTune(persistentDef, conf_disk, &info);
 
-        if (qemuDomainSetBlockIoTuneDefaults(&conf_info, conf_cur_info,
-                                             set_fields) < 0)
-            goto endjob;
+static int
+qemuDomainGetStatsCpuCgroup(virDomainObjPtr dom,
+                            virTypedParamListPtr params)
+{
+    qemuDomainObjPrivatePtr priv = dom->privateData;
+    unsigned long long cpu_time = 0;
+    unsigned long long user_time = 0;
+    unsigned long long sys_time = 0;
+    int err = 0;
+
+    if (!priv->cgroup)
+        return 0;
+
+    err = virCgroupGetCpuacctUsage(priv->cgroup, &cpu_time);
+    if (!err && virTypedParamListAddULLong(params, cpu_time, "cpu.time") < 0)
+        return -1;
+
+    err = virCgroupGetCpuacctStat(priv->cgroup, &user_time, &sys_time);
+    if (!err && virTypedParamListAddULLong(params, user_time, "cpu.user") < 0)
+        return -1;
+    if (!err && virTypedParamListAddULLong(params, sys_time, "cpu.system") < 0)
+        return -1;
 
-        if (qemuDomainCheckBlockIoTuneReset(conf_disk, &conf_info) < 0)
-            goto endjob;
+    if (qemuExtDevicesHasDevice(dom->def)) {
+        virCgroupPtr cgroup_helper = NULL;
+        unsigned long long helper_time = 0;
 
-        if (virDomainDiskSetBlockIOTune(conf_disk, &conf_info) < 0)
-            goto endjob;
+        /* helper processes are in the cgroup only if it was possible to
+         * create it when they were started */
+        if (virCgroupNewThread(priv->cgroup, VIR_CGROUP_THREAD_HELPER, 0,
+                               false, &cgroup_helper) < 0 ||
+            virCgroupGetCpuacctUsage(cgroup_helper, &helper_time) < 0) {
+            virCgroupFree(&cgroup_helper);
+            virResetLastError();
+            return 0;
+        }
 
-        qemuDomainSetGroupBlockIoTune(persistentDef, &conf_info);
+        virCgroupFree(&cgroup_helper);
 
-        if (virDomainDefSave(persistentDef, driver->xmlopt,
-                             cfg->configDir) < 0)
-            goto endjob;
+        if (virTypedParamListAddULLong(params, helper_time,
+                                       "cpu.helpers.time") < 0)
+            return -1;
     }
 
-    ret = 0;
- endjob:
-    qemuDomainObjEndJob(driver, vm);
-
- cleanup:
-    VIR_FREE(info.group_name);
-    VIR_FREE(conf_info.group_name);
-    virDomainObjEndAPI(&vm);
-    if (eventNparams)
-        virTypedParamsFree(eventParams, eventNparams);
-    return ret;
+    return 0;
 }
 
+
 static int
-qemuDomainGetBlockIoTune(virDomainPtr dom,
-                         const char *path,
-                         virTypedParameterPtr params,
-                         int *nparams,
-                         unsigned int flags)
+qemuDomainGetStatsCpu(virQEMUDriverPtr driver,
+                      virDomainObjPtr dom,
+                      virTypedParamListPtr params,
+                      unsigned int privflags G_GNUC_UNUSED,
+                      const qemuDomainGetStatsHost *host G_GNUC_UNUSED)
 {
-    virDomainDiskDefPtr disk;
-    virQEMUDriverPtr driver = dom->conn->privateData;
-    virDomainObjPtr vm = NULL;
-    qemuDomainObjPrivatePtr priv = NULL;
-    virDomainDefPtr def = NULL;
-    virDomainDefPtr persistentDef = NULL;
-    virDomainBlockIoTuneInfo reply = {0};
-    g_autofree char *drivealias = NULL;
-    const char *qdevid = NULL;
-    int ret = -1;
-    int maxparams;
-
-    virCheckFlags(VIR_DOMAIN_AFFECT_LIVE |
-                  VIR_DOMAIN_AFFECT_CONFIG |
-                  VIR_TYPED_PARAM_STRING_OKAY, -1);
-
-    /* We don't return strings, and thus trivially support this flag.  */
-    flags &= ~VIR_TYPED_PARAM_STRING_OKAY;
+    if (qemuDomainGetStatsCpuCgroup(dom, params) < 0)
+        return -1;
 
-    if (!(vm = qemuDomainObjFromDomain(dom)))
+    if (qemuDomainGetStatsCpuCache(driver, dom, params) < 0)
         return -1;
 
-    priv = vm->privateData;
+    return 0;
+}
 
-    if (virDomainGetBlockIoTuneEnsureACL(dom->conn, vm->def) < 0)
-        goto cleanup;
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) < 0)
-        goto cleanup;
+static int
+qemuDomainGetStatsMemory(virQEMUDriverPtr driver,
+                         virDomainObjPtr dom,
+                         virTypedParamListPtr params,
+                         unsigned int privflags G_GNUC_UNUSED,
+                         const qemuDomainGetStatsHost *host G_GNUC_UNUSED)
+{
+    return qemuDomainGetStatsMemoryBandwidth(driver, dom, params);
+}
 
-    /* the API check guarantees that only one of the definitions will be set */
-    if (virDomainObjGetDefs(vm, flags, &def, &persistentDef) < 0)
-        goto endjob;
 
-    if (def) {
-        /* If the VM is running, we can check if the current VM can use
-         * optional parameters or not. */
-        maxparams = QEMU_NB_BLOCK_IO_TUNE_BASE_PARAMS;
-        if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_DRIVE_IOTUNE_MAX))
-            maxparams += QEMU_NB_BLOCK_IO_TUNE_MAX_PARAMS;
-        if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_DRIVE_IOTUNE_GROUP))
-            maxparams += QEMU_NB_BLOCK_IO_TUNE_GROUP_PARAMS;
-        if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_DRIVE_IOTUNE_MAX_LENGTH))
-            maxparams += QEMU_NB_BLOCK_IO_TUNE_LENGTH_PARAMS;
-    } else {
-        maxparams = QEMU_NB_BLOCK_IO_TUNE_ALL_PARAMS;
-    }
+static int
+qemuDomainGetStatsDirtyRateMon(virQEMUDriverPtr driver,
+                               virDomainObjPtr vm,
+                               qemuMonitorDirtyRateInfoPtr info)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    int ret;
 
-    if (*nparams == 0) {
-        *nparams = maxparams;
-        ret = 0;
-        goto endjob;
-    } else if (*nparams < maxparams) {
-        maxparams = *nparams;
-    }
+    qemuDomainObjEnterMonitor(driver, vm);
+    ret = qemuMonitorQueryDirtyRate(priv->mon, info);
+    if (qemuDomainObjExitMonitor(driver, vm) < 0)
+        ret = -1;
 
-    *nparams = 0;
+    return ret;
+}
 
-    if (def) {
-        if (!(disk = qemuDomainDiskByName(def, path)))
-            goto endjob;
 
-        if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV) &&
-            QEMU_DOMAIN_DISK_PRIVATE(disk)->qomName) {
-            qdevid = QEMU_DOMAIN_DISK_PRIVATE(disk)->qomName;
-        } else {
-            if (!(drivealias = qemuAliasDiskDriveFromDisk(disk)))
-                goto endjob;
-        }
-        qemuDomainObjEnterMonitor(driver, vm);
-        ret = qemuMonitorGetBlockIoThrottle(priv->mon, drivealias, qdevid, &reply);
-        if (qemuDomainObjExitMonitor(driver, vm) < 0)
-            goto endjob;
-        if (ret < 0)
-            goto endjob;
-    }
+static int
+qemuDomainGetStatsDirtyRate(virQEMUDriverPtr driver,
+                            virDomainObjPtr dom,
+                            virTypedParamListPtr params,
+                            unsigned int privflags,
+                            const qemuDomainGetStatsHost *host G_GNUC_UNUSED)
+{
+    qemuDomainObjPrivatePtr priv = dom->privateData;
+    qemuMonitorDirtyRateInfo info;
 
-    if (persistentDef) {
-        if (!(disk = virDomainDiskByName(persistentDef, path, true))) {
-            virReportError(VIR_ERR_INVALID_ARG,
-                           _("disk '%s' was not found in the domain config"),
-                           path);
-            goto endjob;
-        }
-        reply = disk->blkdeviotune;
+    if (!HAVE_JOB(privflags) || !virDomainObjIsActive(dom))
+        return 0;
 
-        /* Group name needs to be copied since qemuMonitorGetBlockIoThrottle
-         * allocates it as well */
-        reply.group_name = g_strdup(disk->blkdeviotune.group_name);
-    }
+    if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_CALC_DIRTY_RATE))
+        return 0;
 
-#define BLOCK_IOTUNE_ASSIGN(name, var) \
-    if (*nparams < maxparams && \
-        virTypedParameterAssign(&params[(*nparams)++], \
-                                VIR_DOMAIN_BLOCK_IOTUNE_ ## name, \
-                                VIR_TYPED_PARAM_ULLONG, \
-                                reply.var) < 0) \
-        goto endjob
+    if (qemuDomainGetStatsDirtyRateMon(driver, dom, &info) < 0)
+        return -1;
 
+    if (virTypedParamListAddInt(params, info.status,
+                                "dirtyrate.calc_status") < 0)
+        return -1;
 
-    BLOCK_IOTUNE_ASSIGN(TOTAL_BYTES_SEC, total_bytes_sec);
-    BLOCK_IOTUNE_ASSIGN(READ_BYTES_SEC, read_bytes_sec);
-    BLOCK_IOTUNE_ASSIGN(WRITE_BYTES_SEC, write_bytes_sec);
+    if (virTypedParamListAddLLong(params, info.startTime,
+                                  "dirtyrate.calc_start_time") < 0)
+        return -1;
 
-    BLOCK_IOTUNE_ASSIGN(TOTAL_IOPS_SEC, total_iops_sec);
-    BLOCK_IOTUNE_ASSIGN(READ_IOPS_SEC, read_iops_sec);
-    BLOCK_IOTUNE_ASSIGN(WRITE_IOPS_SEC, write_iops_sec);
+    if (virTypedParamListAddInt(params, info.calcTime,
+                                "dirtyrate.calc_period") < 0)
+        return -1;
 
-    BLOCK_IOTUNE_ASSIGN(TOTAL_BYTES_SEC_MAX, total_bytes_sec_max);
-    BLOCK_IOTUNE_ASSIGN(READ_BYTES_SEC_MAX, read_bytes_sec_max);
-    BLOCK_IOTUNE_ASSIGN(WRITE_BYTES_SEC_MAX, write_bytes_sec_max);
+    if ((info.status == VIR_DOMAIN_DIRTYRATE_MEASURED) &&
+        virTypedParamListAddLLong(params, info.dirtyRate,
+                                  "dirtyrate.megabytes_per_second") < 0)
+        return -1;
 
-    BLOCK_IOTUNE_ASSIGN(TOTAL_IOPS_SEC_MAX, total_iops_sec_max);
-    BLOCK_IOTUNE_ASSIGN(READ_IOPS_SEC_MAX, read_iops_sec_max);
-    BLOCK_IOTUNE_ASSIGN(WRITE_IOPS_SEC_MAX, write_iops_sec_max);
+    return 0;
+}
 
-    BLOCK_IOTUNE_ASSIGN(SIZE_IOPS_SEC, size_iops_sec);
 
-    if (*nparams < maxparams) {
-        if (virTypedParameterAssign(&params[(*nparams)++],
-                                    VIR_DOMAIN_BLOCK_IOTUNE_GROUP_NAME,
-                                    VIR_TYPED_PARAM_STRING,
-                                    reply.group_name) < 0)
-            goto endjob;
+static int
+qemuDomainGetStatsBalloon(virQEMUDriverPtr driver,
+                          virDomainObjPtr dom,
+                          virTypedParamListPtr params,
+                          unsigned int privflags,
+                          const qemuDomainGetStatsHost *host G_GNUC_UNUSED)
+{
+    virDomainMemoryStatStruct stats[VIR_DOMAIN_MEMORY_STAT_NR];
+    int nr_stats;
+    unsigned long long cur_balloon = 0;
+    size_t i;
 
-        reply.group_name = NULL;
+    if (!virDomainDefHasMemballoon(dom->def)) {
+        cur_balloon = virDomainDefGetMemoryTotal(dom->def);
+    } else {
+        cur_balloon = dom->def->mem.cur_balloon;
     }
 
-    BLOCK_IOTUNE_ASSIGN(TOTAL_BYTES_SEC_MAX_LENGTH, total_bytes_sec_max_length);
-    BLOCK_IOTUNE_ASSIGN(READ_BYTES_SEC_MAX_LENGTH, read_bytes_sec_max_length);
-    BLOCK_IOTUNE_ASSIGN(WRITE_BYTES_SEC_MAX_LENGTH, write_bytes_sec_max_length);
+    if (virTypedParamListAddULLong(params, cur_balloon, "balloon.current") < 0)
+        return -1;
 
-    BLOCK_IOTUNE_ASSIGN(TOTAL_IOPS_SEC_MAX_LENGTH, total_iops_sec_max_length);
-    BLOCK_IOTUNE_ASSIGN(READ_IOPS_SEC_MAX_LENGTH, read_iops_sec_max_length);
-    BLOCK_IOTUNE_ASSIGN(WRITE_IOPS_SEC_MAX_LENGTH, write_iops_sec_max_length);
-#undef BLOCK_IOTUNE_ASSIGN
+    if (virTypedParamListAddULLong(params, virDomainDefGetMemoryTotal(dom->def),
+                                   "balloon.maximum") < 0)
+        return -1;
 
-    ret = 0;
+    if (!HAVE_JOB(privflags) || !virDomainObjIsActive(dom))
+        return 0;
 
- endjob:
-    qemuDomainObjEndJob(driver, vm);
+    nr_stats = qemuDomainMemoryStatsInternal(driver, dom, stats,
+                                             VIR_DOMAIN_MEMORY_STAT_NR);
+    if (nr_stats < 0)
+        return 0;
 
- cleanup:
-    VIR_FREE(reply.group_name);
-    virDomainObjEndAPI(&vm);
-    return ret;
+#define STORE_MEM_RECORD(TAG, NAME) \
+    if (stats[i].tag == VIR_DOMAIN_MEMORY_STAT_ ##TAG) \
+        if (virTypedParamListAddULLong(params, stats[i].val, "balloon." NAME) < 0) \
+            return -1;
+
+    for (i = 0; i < nr_stats; i++) {
+        STORE_MEM_RECORD(SWAP_IN, "swap_in")
+        STORE_MEM_RECORD(SWAP_OUT, "swap_out")
+        STORE_MEM_RECORD(MAJOR_FAULT, "major_fault")
+        STORE_MEM_RECORD(MINOR_FAULT, "minor_fault")
+        STORE_MEM_RECORD(UNUSED, "unused")
+        STORE_MEM_RECORD(AVAILABLE, "available")
+        STORE_MEM_RECORD(RSS, "rss")
+        STORE_MEM_RECORD(LAST_UPDATE, "last-update")
+        STORE_MEM_RECORD(USABLE, "usable")
+        STORE_MEM_RECORD(DISK_CACHES, "disk_caches")
+        STORE_MEM_RECORD(HUGETLB_PGALLOC, "hugetlb_pgalloc")
+        STORE_MEM_RECORD(HUGETLB_PGFAIL, "hugetlb_pgfail")
+    }
+
+#undef STORE_MEM_RECORD
+
+    return 0;
 }
 
+
 static int
-qemuDomainGetDiskErrors(virDomainPtr dom,
-                        virDomainDiskErrorPtr errors,
-                        unsigned int nerrors,
-                        unsigned int flags)
+qemuDomainGetStatsVcpu(virQEMUDriverPtr driver,
+                       virDomainObjPtr dom,
+                       virTypedParamListPtr params,
+                       unsigned int privflags,
+                       const qemuDomainGetStatsHost *host G_GNUC_UNUSED)
 {
-    virQEMUDriverPtr driver = dom->conn->privateData;
-    virDomainObjPtr vm = NULL;
-    qemuDomainObjPrivatePtr priv;
-    virHashTablePtr table = NULL;
-    bool blockdev = false;
-    int ret = -1;
+    virDomainVcpuDefPtr vcpu;
+    qemuDomainVcpuPrivatePtr vcpupriv;
     size_t i;
-    int n = 0;
-
-    virCheckFlags(0, -1);
+    int ret = -1;
+    virVcpuInfoPtr cpuinfo = NULL;
+    g_autofree unsigned long long *cpuwait = NULL;
 
-    if (!(vm = qemuDomainObjFromDomain(dom)))
-        goto cleanup;
+    if (virTypedParamListAddUInt(params, virDomainDefGetVcpus(dom->def),
+                                 "vcpu.current") < 0)
+        return -1;
 
-    priv = vm->privateData;
-    blockdev = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV);
+    if (virTypedParamListAddUInt(params, virDomainDefGetVcpusMax(dom->def),
+                                 "vcpu.maximum") < 0)
+        return -1;
 
-    if (virDomainGetDiskErrorsEnsureACL(dom->conn, vm->def) < 0)
+    if (VIR_ALLOC_N(cpuinfo, virDomainDefGetVcpus(dom->def)) < 0 ||
+        VIR_ALLOC_N(cpuwait, virDomainDefGetVcpus(dom->def)) < 0)
         goto cleanup;
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) < 0)
+    if (HAVE_JOB(privflags) && virDomainObjIsActive(dom) &&
+        qemuDomainRefreshVcpuHalted(driver, dom, QEMU_ASYNC_JOB_NONE) < 0) {
+            /* it's ok to be silent and go ahead, because halted vcpu info
+             * wasn't here from the beginning */
+            virResetLastError();
+    }
+
+    if (qemuDomainHelperGetVcpus(dom, cpuinfo, cpuwait,
+                                 virDomainDefGetVcpus(dom->def),
+                                 NULL, 0) < 0) {
+        virResetLastError();
+        ret = 0; /* it's ok to be silent and go ahead */
         goto cleanup;
+    }
 
-    if (virDomainObjCheckActive(vm) < 0)
-        goto endjob;
+    for (i = 0; i < virDomainDefGetVcpus(dom->def); i++) {
+        if (virTypedParamListAddInt(params, cpuinfo[i].state,
+                                    "vcpu.%u.state", cpuinfo[i].number) < 0)
+            goto cleanup;
 
-    if (!errors) {
-        ret = vm->def->ndisks;
-        goto endjob;
-    }
+        /* stats below are available only if the VM is alive */
+        if (!virDomainObjIsActive(dom))
+            continue;
 
-    qemuDomainObjEnterMonitor(driver, vm);
-    table = qemuMonitorGetBlockInfo(priv->mon);
-    if (qemuDomainObjExitMonitor(driver, vm) < 0)
-        goto endjob;
-    if (!table)
-        goto endjob;
+        if (virTypedParamListAddULLong(params, cpuinfo[i].cpuTime,
+                                       "vcpu.%u.time", cpuinfo[i].number) < 0)
+            goto cleanup;
 
-    for (i = n = 0; i < vm->def->ndisks; i++) {
-        struct qemuDomainDiskInfo *info;
-        virDomainDiskDefPtr disk = vm->def->disks[i];
-        qemuDomainDiskPrivatePtr diskPriv = QEMU_DOMAIN_DISK_PRIVATE(disk);
-        const char *entryname = disk->info.alias;
+        if (virTypedParamListAddULLong(params, cpuwait[i],
+                                       "vcpu.%u.wait", cpuinfo[i].number) < 0)
+            goto cleanup;
 
-        if (blockdev && diskPriv->qomName)
-            entryname = diskPriv->qomName;
+        /* state below is extracted from the individual vcpu structs */
+        if (!(vcpu = virDomainDefGetVcpu(dom->def, cpuinfo[i].number)))
+            continue;
 
-        if ((info = virHashLookup(table, entryname)) &&
-            info->io_status != VIR_DOMAIN_DISK_ERROR_NONE) {
-            if (n == nerrors)
-                break;
+        vcpupriv = QEMU_DOMAIN_VCPU_PRIVATE(vcpu);
 
-            errors[n].disk = g_strdup(disk->dst);
-            errors[n].error = info->io_status;
-            n++;
+        if (vcpupriv->halted != VIR_TRISTATE_BOOL_ABSENT) {
+            if (virTypedParamListAddBoolean(params,
+                                            vcpupriv->halted == VIR_TRISTATE_BOOL_YES,
+                                            "vcpu.%u.halted",
+                                            cpuinfo[i].number) < 0)
+                goto cleanup;
         }
     }
 
-    ret = n;
-
- endjob:
-    qemuDomainObjEndJob(driver, vm);
+    ret = 0;
 
  cleanup:
-    virDomainObjEndAPI(&vm);
-    virHashFree(table);
-    if (ret < 0) {
-        for (i = 0; i < n; i++)
-            VIR_FREE(errors[i].disk);
-    }
+    VIR_FREE(cpuinfo);
     return ret;
 }
 
+#define QEMU_ADD_NET_PARAM(params, num, name, value) \
+    if (value >= 0 && \
+        virTypedParamListAddULLong((params), (value), "net.%zu.%s", (num), (name)) < 0) \
+        return -1;
+
 static int
-qemuDomainSetMetadata(virDomainPtr dom,
-                      int type,
-                      const char *metadata,
-                      const char *key,
-                      const char *uri,
-                      unsigned int flags)
+qemuDomainGetStatsInterface(virQEMUDriverPtr driver G_GNUC_UNUSED,
+                            virDomainObjPtr dom,
+                            virTypedParamListPtr params,
+                            unsigned int privflags G_GNUC_UNUSED,
+                            const qemuDomainGetStatsHost *host)
 {
-    virQEMUDriverPtr driver = dom->conn->privateData;
-    virDomainObjPtr vm;
-    g_autoptr(virQEMUDriverConfig) cfg = NULL;
-    int ret = -1;
+    size_t i;
+    struct _virDomainInterfaceStats tmp;
 
-    virCheckFlags(VIR_DOMAIN_AFFECT_LIVE |
-                  VIR_DOMAIN_AFFECT_CONFIG, -1);
+    if (!virDomainObjIsActive(dom))
+        return 0;
 
-    if (!(vm = qemuDomainObjFromDomain(dom)))
+    if (virTypedParamListAddUInt(params, dom->def->nnets, "net.count") < 0)
         return -1;
 
-    cfg = virQEMUDriverGetConfig(driver);
+    /* Check the path is one of the domain's network interfaces. */
+    for (i = 0; i < dom->def->nnets; i++) {
+        virDomainNetDefPtr net = dom->def->nets[i];
+        virDomainNetType actualType;
 
-    if (virDomainSetMetadataEnsureACL(dom->conn, vm->def, flags) < 0)
-        goto cleanup;
+        if (!net->ifname)
+            continue;
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
-        goto cleanup;
+        memset(&tmp, 0, sizeof(tmp));
 
-    ret = virDomainObjSetMetadata(vm, type, metadata, key, uri,
-                                  driver->xmlopt, cfg->stateDir,
-                                  cfg->configDir, flags);
+        actualType = virDomainNetGetActualType(net);
 
-    if (ret == 0) {
-        virObjectEventPtr ev = NULL;
-        ev = virDomainEventMetadataChangeNewFromObj(vm, type, uri);
-        virObjectEventStateQueue(driver->domainEventState, ev);
+        if (virTypedParamListAddString(params, net->ifname, "net.%zu.name", i) < 0)
+            return -1;
+
+        if (actualType == VIR_DOMAIN_NET_TYPE_VHOSTUSER) {
+            if (virNetDevOpenvswitchInterfaceStats(net->ifname, &tmp) < 0) {
+                virResetLastError();
+                continue;
+            }
+        } else if (host && host->ifstats) {
+            if (virNetDevTapInterfaceStatsLookup(host->ifstats, net->ifname, &tmp,
+                                                 !virDomainNetTypeSharesHostView(net)) < 0) {
+                virResetLastError();
+                continue;
+            }
+        } else {
+            if (virNetDevTapInterfaceStats(net->ifname, &tmp,
+                                           !virDomainNetTypeSharesHostView(net)) < 0) {
+                virResetLastError();
+                continue;
+            }
+        }
+
+        QEMU_ADD_NET_PARAM(params, i,
+                           "rx.bytes", tmp.rx_bytes);
+        QEMU_ADD_NET_PARAM(params, i,
+                           "rx.pkts", tmp.rx_packets);
+        QEMU_ADD_NET_PARAM(params, i,
+                           "rx.errs", tmp.rx_errs);
+        QEMU_ADD_NET_PARAM(params, i,
+                           "rx.drop", tmp.rx_drop);
+        QEMU_ADD_NET_PARAM(params, i,
+                           "tx.bytes", tmp.tx_bytes);
+        QEMU_ADD_NET_PARAM(params, i,
+                           "tx.pkts", tmp.tx_packets);
+        QEMU_ADD_NET_PARAM(params, i,
+                           "tx.errs", tmp.tx_errs);
+        QEMU_ADD_NET_PARAM(params, i,
+                           "tx.drop", tmp.tx_drop);
     }
 
-    qemuDomainObjEndJob(driver, vm);
+    return 0;
+}
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return ret;
+#undef QEMU_ADD_NET_PARAM
+
+/* refresh information by opening images on the disk */
+static int
+qemuDomainGetStatsOneBlockFallback(virQEMUDriverPtr driver,
+                                   virQEMUDriverConfigPtr cfg,
+                                   virDomainObjPtr dom,
+                                   virTypedParamListPtr params,
+                                   virStorageSourcePtr src,
+                                   size_t block_idx)
+{
+    if (virStorageSourceIsEmpty(src))
+        return 0;
+
+    if (qemuStorageLimitsRefresh(driver, cfg, dom, src, true) <= 0) {
+        virResetLastError();
+        return 0;
+    }
+
+    if (src->allocation &&
+        virTypedParamListAddULLong(params, src->allocation,
+                                   "block.%zu.allocation", block_idx) < 0)
+        return -1;
+
+    if (src->capacity &&
+        virTypedParamListAddULLong(params, src->capacity,
+                                   "block.%zu.capacity", block_idx) < 0)
+        return -1;
+
+    if (src->physical &&
+        virTypedParamListAddULLong(params, src->physical,
+                                   "block.%zu.physical", block_idx) < 0)
+        return -1;
+
+    return 0;
 }
 
-static char *
-qemuDomainGetMetadata(virDomainPtr dom,
-                      int type,
-                      const char *uri,
-                      unsigned int flags)
+
+/**
+ * qemuDomainGetStatsOneBlockRefreshNamed:
+ * @src: disk source structure
+ * @alias: disk alias
+ * @stats: hash table containing stats for all disks
+ * @nodedata: reply containing 'query-named-block-nodes' data
+ *
+ * Refresh disk block stats data (qemuBlockStatsPtr) which are present only
+ * in the reply of 'query-named-block-nodes' in cases when the data was gathered
+ * by using query-block originally.
+ */
+static void
+qemuDomainGetStatsOneBlockRefreshNamed(virStorageSourcePtr src,
+                                       const char *alias,
+                                       virHashTablePtr stats,
+                                       virHashTablePtr nodedata)
 {
-    virDomainObjPtr vm;
-    char *ret = NULL;
+    qemuBlockStatsPtr entry;
 
-    if (!(vm = qemuDomainObjFromDomain(dom)))
-        return NULL;
+    virJSONValuePtr data;
+    unsigned long long tmp;
 
-    if (virDomainGetMetadataEnsureACL(dom->conn, vm->def) < 0)
-        goto cleanup;
+    if (!nodedata || !src->nodestorage)
+        return;
 
-    ret = virDomainObjGetMetadata(vm, type, uri, flags);
+    if (!(entry = virHashLookup(stats, alias)))
+        return;
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return ret;
+    if (!(data = virHashLookup(nodedata, src->nodestorage)))
+        return;
+
+    if (virJSONValueObjectGetNumberUlong(data, "write_threshold", &tmp) == 0)
+        entry->write_threshold = tmp;
 }
 
 
 static int
-qemuDomainGetCPUStats(virDomainPtr domain,
-                      virTypedParameterPtr params,
-                      unsigned int nparams,
-                      int start_cpu,
-                      unsigned int ncpus,
-                      unsigned int flags)
+qemuDomainGetStatsOneBlock(virQEMUDriverPtr driver,
+                           virQEMUDriverConfigPtr cfg,
+                           virDomainObjPtr dom,
+                           virTypedParamListPtr params,
+                           const char *entryname,
+                           virStorageSourcePtr src,
+                           size_t block_idx,
+                           virHashTablePtr stats)
 {
-    virDomainObjPtr vm = NULL;
-    int ret = -1;
-    qemuDomainObjPrivatePtr priv;
-    virBitmapPtr guestvcpus = NULL;
-
-    virCheckFlags(VIR_TYPED_PARAM_STRING_OKAY, -1);
+    qemuBlockStats *entry;
 
-    if (!(vm = qemuDomainObjFromDomain(domain)))
-        return -1;
+    /* the VM is offline so we have to go and load the stast from the disk by
+     * ourselves */
+    if (!virDomainObjIsActive(dom)) {
+        return qemuDomainGetStatsOneBlockFallback(driver, cfg, dom, params,
+                                                  src, block_idx);
+    }
 
-    priv = vm->privateData;
+    /* In case where qemu didn't provide the stats we stop here rather than
+     * trying to refresh the stats from the disk. Inability to provide stats is
+     * usually caused by blocked storage so this would make libvirtd hang */
+    if (!stats || !entryname || !(entry = virHashLookup(stats, entryname)))
+        return 0;
 
-    if (virDomainGetCPUStatsEnsureACL(domain->conn, vm->def) < 0)
-        goto cleanup;
+    if (virTypedParamListAddULLong(params, entry->wr_highest_offset,
+                                   "block.%zu.allocation", block_idx) < 0)
+        return -1;
 
-    if (virDomainObjCheckActive(vm) < 0)
-        goto cleanup;
+    if (entry->capacity &&
+        virTypedParamListAddULLong(params, entry->capacity,
+                                   "block.%zu.capacity", block_idx) < 0)
+        return -1;
 
-    if (!virCgroupHasController(priv->cgroup, VIR_CGROUP_CONTROLLER_CPUACCT)) {
-        virReportError(VIR_ERR_OPERATION_INVALID,
-                       "%s", _("cgroup CPUACCT controller is not mounted"));
-        goto cleanup;
+    if (entry->physical) {
+        if (virTypedParamListAddULLong(params, entry->physical,
+                                       "block.%zu.physical", block_idx) < 0)
+            return -1;
+    } else {
+        if (qemuDomainStorageUpdatePhysical(driver, cfg, dom, src) == 0) {
+            if (virTypedParamListAddULLong(params, src->physical,
+                                           "block.%zu.physical", block_idx) < 0)
+                return -1;
+        }
     }
 
-    if (qemuDomainHasVcpuPids(vm) &&
-        !(guestvcpus = virDomainDefGetOnlineVcpumap(vm->def)))
-        goto cleanup;
-
-    if (start_cpu == -1)
-        ret = virCgroupGetDomainTotalCpuStats(priv->cgroup,
-                                              params, nparams);
-    else
-        ret = virCgroupGetPercpuStats(priv->cgroup, params, nparams,
-                                      start_cpu, ncpus, guestvcpus);
- cleanup:
-    virBitmapFree(guestvcpus);
-    virDomainObjEndAPI(&vm);
-    return ret;
+    return 0;
 }
 
 
 static int
-qemuDomainProbeQMPCurrentMachine(virQEMUDriverPtr driver,
-                                 virDomainObjPtr vm,
-                                 bool *wakeupSupported)
+qemuDomainGetStatsBlockExportBackendStorage(const char *entryname,
+                                            virHashTablePtr stats,
+                                            size_t recordnr,
+                                            virTypedParamListPtr params)
 {
-    qemuDomainObjPrivatePtr priv = vm->privateData;
-    qemuMonitorCurrentMachineInfo info = { 0 };
-    int rv;
+    qemuBlockStats *entry;
 
-    qemuDomainObjEnterMonitor(driver, vm);
-    rv = qemuMonitorGetCurrentMachineInfo(priv->mon, &info);
-    if (qemuDomainObjExitMonitor(driver, vm) < 0 ||
-        rv < 0)
+    if (!stats || !entryname || !(entry = virHashLookup(stats, entryname)))
+        return 0;
+
+    if (entry->write_threshold &&
+        virTypedParamListAddULLong(params, entry->write_threshold,
+                                   "block.%zu.threshold", recordnr) < 0)
         return -1;
 
-    *wakeupSupported = info.wakeupSuspendSupport;
     return 0;
 }
 
 
-/* returns -1 on error, or if query is not supported, 0 if query was successful */
 static int
-qemuDomainQueryWakeupSuspendSupport(virQEMUDriverPtr driver,
-                                    virDomainObjPtr vm,
-                                    bool *wakeupSupported)
+qemuDomainGetStatsBlockExportHistogram(const qemuBlockStatsHistogram *hist,
+                                       const char *type,
+                                       size_t idx,
+                                       virTypedParamListPtr par)
 {
-    qemuDomainObjPrivatePtr priv = vm->privateData;
-    int ret = -1;
+    size_t i;
 
-    if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_QUERY_CURRENT_MACHINE))
-        return -1;
+    if (hist->nbins == 0)
+        return 0;
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
+    if (virTypedParamListAddULLong(par, hist->nbins,
+                                   "block.%zu.%s.hist.count", idx, type) < 0)
         return -1;
 
-    if ((ret = virDomainObjCheckActive(vm)) < 0)
-        goto endjob;
-
-    ret = qemuDomainProbeQMPCurrentMachine(driver, vm, wakeupSupported);
+    for (i = 0; i < hist->nbins; i++) {
+        if (virTypedParamListAddULLong(par, hist->starts[i],
+                                       "block.%zu.%s.hist.%zu.start",
+                                       idx, type, i) < 0 ||
+            virTypedParamListAddULLong(par, hist->counts[i],
+                                       "block.%zu.%s.hist.%zu.value",
+                                       idx, type, i) < 0)
+            return -1;
+    }
 
- endjob:
-    qemuDomainObjEndJob(driver, vm);
-    return ret;
+    return 0;
 }
 
 
 static int
-qemuDomainPMSuspendAgent(virQEMUDriverPtr driver,
-                         virDomainObjPtr vm,
-                         unsigned int target)
+qemuDomainGetStatsBlockExportFrontend(const char *frontendname,
+                                      virHashTablePtr stats,
+                                      size_t idx,
+                                      virTypedParamListPtr par)
 {
-    qemuAgentPtr agent;
-    int ret = -1;
-
-    if (qemuDomainObjBeginAgentJob(driver, vm, QEMU_AGENT_JOB_MODIFY) < 0)
-        return -1;
+    qemuBlockStats *en;
 
-    if ((ret = virDomainObjCheckActive(vm)) < 0)
-        goto endjob;
+    /* In case where qemu didn't provide the stats we stop here rather than
+     * trying to refresh the stats from the disk. Inability to provide stats is
+     * usually caused by blocked storage so this would make libvirtd hang */
+    if (!stats || !frontendname || !(en = virHashLookup(stats, frontendname)))
+        return 0;
 
-    if (!qemuDomainAgentAvailable(vm, true))
-        goto endjob;
+    if (virTypedParamListAddULLong(par, en->rd_req, "block.%zu.rd.reqs", idx) < 0 ||
+        virTypedParamListAddULLong(par, en->rd_bytes, "block.%zu.rd.bytes", idx) < 0 ||
+        virTypedParamListAddULLong(par, en->rd_total_times, "block.%zu.rd.times", idx) < 0 ||
+        virTypedParamListAddULLong(par, en->wr_req, "block.%zu.wr.reqs", idx) < 0 ||
+        virTypedParamListAddULLong(par, en->wr_bytes, "block.%zu.wr.bytes", idx) < 0 ||
+        virTypedParamListAddULLong(par, en->wr_total_times, "block.%zu.wr.times", idx) < 0 ||
+        virTypedParamListAddULLong(par, en->flush_req, "block.%zu.fl.reqs", idx) < 0 ||
+        virTypedParamListAddULLong(par, en->flush_total_times, "block.%zu.fl.times", idx) < 0)
+        return -1;
 
-    agent = qemuDomainObjEnterAgent(vm);
-    ret = qemuAgentSuspend(agent, target);
-    qemuDomainObjExitAgent(vm, agent);
+    if (qemuDomainGetStatsBlockExportHistogram(&en->rd_histogram, "rd", idx, par) < 0 ||
+        qemuDomainGetStatsBlockExportHistogram(&en->wr_histogram, "wr", idx, par) < 0 ||
+        qemuDomainGetStatsBlockExportHistogram(&en->fl_histogram, "fl", idx, par) < 0)
+        return -1;
 
- endjob:
-    qemuDomainObjEndAgentJob(vm);
-    return ret;
+    return 0;
 }
 
 
 static int
-qemuDomainPMSuspendForDuration(virDomainPtr dom,
-                               unsigned int target,
-                               unsigned long long duration,
-                               unsigned int flags)
+qemuDomainGetStatsBlockExportHeader(virDomainDiskDefPtr disk,
+                                    virStorageSourcePtr src,
+                                    size_t recordnr,
+                                    virTypedParamListPtr params)
 {
-    virQEMUDriverPtr driver = dom->conn->privateData;
-    virDomainObjPtr vm;
-    int ret = -1;
-    bool wakeupSupported;
-
-    virCheckFlags(0, -1);
+    if (virTypedParamListAddString(params, disk->dst, "block.%zu.name", recordnr) < 0)
+        return -1;
 
-    if (duration) {
-        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED, "%s",
-                       _("Duration not supported. Use 0 for now"));
+    if (virStorageSourceIsLocalStorage(src) && src->path &&
+        virTypedParamListAddString(params, src->path, "block.%zu.path", recordnr) < 0)
         return -1;
-    }
 
-    if (!(target == VIR_NODE_SUSPEND_TARGET_MEM ||
-          target == VIR_NODE_SUSPEND_TARGET_DISK ||
-          target == VIR_NODE_SUSPEND_TARGET_HYBRID)) {
-        virReportError(VIR_ERR_INVALID_ARG,
-                       _("Unknown suspend target: %u"),
-                       target);
+    if (src->id &&
+        virTypedParamListAddUInt(params, src->id, "block.%zu.backingIndex", recordnr) < 0)
         return -1;
-    }
 
-    if (!(vm = qemuDomainObjFromDomain(dom)))
-        goto cleanup;
+    return 0;
+}
 
-    if (virDomainPMSuspendForDurationEnsureACL(dom->conn, vm->def) < 0)
-        goto cleanup;
+
+static int
+qemuDomainGetStatsBlockExportDisk(virDomainDiskDefPtr disk,
+                                  virHashTablePtr stats,
+                                  virHashTablePtr nodestats,
+                                  virTypedParamListPtr params,
+                                  size_t *recordnr,
+                                  bool visitBacking,
+                                  virQEMUDriverPtr driver,
+                                  virQEMUDriverConfigPtr cfg,
+                                  virDomainObjPtr dom,
+                                  bool blockdev)
+
+{
+    virStorageSourcePtr n;
+    const char *frontendalias;
+    const char *backendalias;
+    const char *backendstoragealias;
 
     /*
-     * The case we want to handle here is when QEMU has the API (i.e.
-     * QEMU_CAPS_QUERY_CURRENT_MACHINE is set). Otherwise, do not interfere
-     * with the suspend process. This means that existing running domains,
-     * that don't know about this cap, will keep their old behavior of
-     * suspending 'in the dark'.
+     * This helps to keep logs clean from error messages on getting stats
+     * for optional disk with nonexistent source file. We won't get any
+     * stats for such a disk anyway in below code.
      */
-    if (qemuDomainQueryWakeupSuspendSupport(driver, vm, &wakeupSupported) == 0) {
-        if (!wakeupSupported) {
-            virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
-                           _("Domain does not have suspend support"));
-            goto cleanup;
-        }
+    if (!virDomainObjIsActive(dom) &&
+        qemuDomainDiskIsMissingLocalOptional(disk)) {
+        VIR_INFO("optional disk '%s' source file is missing, "
+                 "skip getting stats", disk->dst);
+
+        return qemuDomainGetStatsBlockExportHeader(disk, disk->src, *recordnr,
+                                                   params);
     }
 
-    if (vm->def->pm.s3 || vm->def->pm.s4) {
-        if (vm->def->pm.s3 == VIR_TRISTATE_BOOL_NO &&
-            (target == VIR_NODE_SUSPEND_TARGET_MEM ||
-             target == VIR_NODE_SUSPEND_TARGET_HYBRID)) {
-            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                           _("S3 state is disabled for this domain"));
-            goto cleanup;
+    for (n = disk->src; virStorageSourceIsBacking(n); n = n->backingStore) {
+        g_autofree char *alias = NULL;
+
+        /* for 'sd' disks we won't be displaying stats for the backing chain
+         * as we don't update the stats correctly */
+        if (blockdev && QEMU_DOMAIN_DISK_PRIVATE(disk)->qomName) {
+            frontendalias = QEMU_DOMAIN_DISK_PRIVATE(disk)->qomName;
+            backendalias = n->nodeformat;
+            backendstoragealias = n->nodestorage;
+        } else {
+            /* alias may be NULL if the VM is not running */
+            if (disk->info.alias &&
+                !(alias = qemuDomainStorageAlias(disk->info.alias, n->id)))
+                return -1;
+
+            qemuDomainGetStatsOneBlockRefreshNamed(n, alias, stats, nodestats);
+
+            frontendalias = alias;
+            backendalias = alias;
+            backendstoragealias = alias;
         }
 
-        if (vm->def->pm.s4 == VIR_TRISTATE_BOOL_NO &&
-            target == VIR_NODE_SUSPEND_TARGET_DISK) {
-            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                           _("S4 state is disabled for this domain"));
-            goto cleanup;
+        if (qemuDomainGetStatsBlockExportHeader(disk, n, *recordnr, params) < 0)
+            return -1;
+
+        /* The following stats make sense only for the frontend device */
+        if (n == disk->src) {
+            if (qemuDomainGetStatsBlockExportFrontend(frontendalias, stats, *recordnr,
+                                                      params) < 0)
+                return -1;
         }
-    }
 
-    ret = qemuDomainPMSuspendAgent(driver, vm, target);
+        if (qemuDomainGetStatsOneBlock(driver, cfg, dom, params,
+                                       backendalias, n, *recordnr,
+                                       stats) < 0)
+            return -1;
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return ret;
+        if (qemuDomainGetStatsBlockExportBackendStorage(backendstoragealias,
+                                                        stats, *recordnr,
+                                                        params) < 0)
+            return -1;
+
+        (*recordnr)++;
+
+        if (!visitBacking)
+            break;
+    }
+
+    return 0;
 }
 
+
 static int
-qemuDomainPMWakeup(virDomainPtr dom,
-                   unsigned int flags)
+qemuDomainBlockCapacityCacheStoreOne(void *payload,
+                                     const void *name,
+                                     void *opaque)
 {
-    virQEMUDriverPtr driver = dom->conn->privateData;
-    virDomainObjPtr vm;
-    int ret = -1;
-    qemuDomainObjPrivatePtr priv;
+    qemuBlockStatsPtr entry = payload;
+    virHashTablePtr cache = opaque;
+    qemuBlockStatsPtr copy;
 
-    virCheckFlags(0, -1);
+    if (!entry->capacity && !entry->physical && !entry->write_threshold)
+        return 0;
 
-    if (!(vm = qemuDomainObjFromDomain(dom)))
-        goto cleanup;
+    copy = g_new0(qemuBlockStats, 1);
+    copy->capacity = entry->capacity;
+    copy->physical = entry->physical;
+    copy->write_threshold = entry->write_threshold;
 
-    if (virDomainPMWakeupEnsureACL(dom->conn, vm->def) < 0)
-        goto cleanup;
+    if (virHashAddEntry(cache, name, copy) < 0) {
+        g_free(copy);
+        return -1;
+    }
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
-        goto cleanup;
+    return 0;
+}
 
-    if (virDomainObjCheckActive(vm) < 0)
-        goto endjob;
 
-    priv = vm->privateData;
+/* Remembers the capacity data of all block nodes in @stats */
+static void
+qemuDomainBlockCapacityCacheStore(qemuDomainObjPrivatePtr priv,
+                                  virHashTablePtr stats,
+                                  unsigned long long now)
+{
+    virHashTablePtr cache;
 
-    qemuDomainObjEnterMonitor(driver, vm);
-    ret = qemuMonitorSystemWakeup(priv->mon);
-    if (qemuDomainObjExitMonitor(driver, vm) < 0)
-        ret = -1;
+    qemuDomainBlockCapacityCacheClear(priv);
 
- endjob:
-    qemuDomainObjEndJob(driver, vm);
+    if (!(cache = virHashCreate(10, virHashValueFree)))
+        return;
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return ret;
+    if (virHashForEach(stats, qemuDomainBlockCapacityCacheStoreOne, cache) < 0) {
+        virHashFree(cache);
+        virResetLastError();
+        return;
+    }
+
+    priv->blockCapacityCache = cache;
+    priv->blockCapacityCacheTimestamp = now;
 }
 
+
 static int
-qemuConnectListAllDomains(virConnectPtr conn,
-                          virDomainPtr **domains,
-                          unsigned int flags)
+qemuDomainBlockCapacityCacheFillOne(void *payload,
+                                    const void *name,
+                                    void *opaque)
 {
-    virQEMUDriverPtr driver = conn->privateData;
+    qemuBlockStatsPtr cached = payload;
+    virHashTablePtr stats = opaque;
+    qemuBlockStatsPtr entry;
 
-    virCheckFlags(VIR_CONNECT_LIST_DOMAINS_FILTERS_ALL, -1);
+    if (!(entry = virHashLookup(stats, name))) {
+        entry = g_new0(qemuBlockStats, 1);
 
-    if (virConnectListAllDomainsEnsureACL(conn) < 0)
-        return -1;
+        if (virHashAddEntry(stats, name, entry) < 0) {
+            g_free(entry);
+            return -1;
+        }
+    }
 
-    return virDomainObjListExport(driver->domains, conn, domains,
-                                  virConnectListAllDomainsCheckACL, flags);
+    entry->capacity = cached->capacity;
+    entry->physical = cached->physical;
+    entry->write_threshold = cached->write_threshold;
+
+    return 0;
 }
 
-static char *
-qemuDomainQemuAgentCommand(virDomainPtr domain,
-                           const char *cmd,
-                           int timeout,
-                           unsigned int flags)
+
+/*
+ * Returns true if the cached capacity data of @vm is recent enough and
+ * covers all the block nodes statistics are reported for. Block jobs,
+ * snapshots and hotplug give new node names to the nodes they add, so
+ * there's no need to track them explicitly.
+ */
+static bool
+qemuDomainBlockCapacityCacheValid(virDomainObjPtr vm,
+                                  unsigned int maxAge,
+                                  bool visitBacking,
+                                  unsigned long long now)
 {
-    virQEMUDriverPtr driver = domain->conn->privateData;
-    virDomainObjPtr vm;
-    int ret = -1;
-    char *result = NULL;
-    qemuAgentPtr agent;
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    size_t i;
 
-    virCheckFlags(0, NULL);
+    if (maxAge == 0 || !priv->blockCapacityCache ||
+        now - priv->blockCapacityCacheTimestamp >= maxAge * 1000ull)
+        return false;
 
-    if (!(vm = qemuDomainObjFromDomain(domain)))
-        goto cleanup;
+    for (i = 0; i < vm->def->ndisks; i++) {
+        virStorageSourcePtr n;
 
-    if (virDomainQemuAgentCommandEnsureACL(domain->conn, vm->def) < 0)
-        goto cleanup;
+        for (n = vm->def->disks[i]->src; virStorageSourceIsBacking(n);
+             n = n->backingStore) {
+            if (!n->nodeformat ||
+                !virHashLookup(priv->blockCapacityCache, n->nodeformat))
+                return false;
 
-    if (qemuDomainObjBeginAgentJob(driver, vm, QEMU_AGENT_JOB_MODIFY) < 0)
-        goto cleanup;
+            if (!visitBacking)
+                break;
+        }
+    }
 
-    if (virDomainObjCheckActive(vm) < 0)
-        goto endjob;
+    return true;
+}
 
-    if (!qemuDomainAgentAvailable(vm, true))
-        goto endjob;
 
-    qemuDomainObjTaint(driver, vm, VIR_DOMAIN_TAINT_CUSTOM_GA_COMMAND, NULL);
+static int
+qemuDomainGetStatsBlock(virQEMUDriverPtr driver,
+                        virDomainObjPtr dom,
+                        virTypedParamListPtr params,
+                        unsigned int privflags,
+                        const qemuDomainGetStatsHost *host G_GNUC_UNUSED)
+{
+    size_t i;
+    int ret = -1;
+    int rc;
+    virHashTablePtr stats = NULL;
+    virHashTablePtr nodestats = NULL;
+    virJSONValuePtr nodedata = NULL;
+    qemuDomainObjPrivatePtr priv = dom->privateData;
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    bool blockdev = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV);
+    bool fetchnodedata = virQEMUCapsGet(priv->qemuCaps,
+                                        QEMU_CAPS_QUERY_NAMED_BLOCK_NODES) && !blockdev;
+    int count_index = -1;
+    size_t visited = 0;
+    bool visitBacking = !!(privflags & QEMU_DOMAIN_STATS_BACKING);
+    bool cachedCapacity = false;
+    unsigned long long now = 0;
 
-    agent = qemuDomainObjEnterAgent(vm);
-    ret = qemuAgentArbitraryCommand(agent, cmd, &result, timeout);
-    qemuDomainObjExitAgent(vm, agent);
-    if (ret < 0)
-        VIR_FREE(result);
+    if (HAVE_JOB(privflags) && virDomainObjIsActive(dom)) {
+        if (blockdev && cfg->statsBlockCapacityMaxAge > 0 &&
+            virTimeMillisNow(&now) == 0) {
+            cachedCapacity = qemuDomainBlockCapacityCacheValid(dom,
+                                                               cfg->statsBlockCapacityMaxAge,
+                                                               visitBacking,
+                                                               now);
+        }
 
- endjob:
-    qemuDomainObjEndAgentJob(vm);
+        qemuDomainObjEnterMonitor(driver, dom);
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return result;
-}
+        if (cachedCapacity) {
+            rc = qemuMonitorGetAllBlockStatsInfo(priv->mon, &stats, visitBacking);
+        } else if (blockdev) {
+            rc = qemuMonitorGetAllBlockStatsInfoBlockdev(priv->mon, &stats,
+                                                         visitBacking);
+        } else {
+            rc = qemuMonitorGetAllBlockStatsInfo(priv->mon, &stats, visitBacking);
 
+            if (rc >= 0)
+                ignore_value(qemuMonitorBlockStatsUpdateCapacity(priv->mon, stats,
+                                                                 visitBacking));
+        }
 
-static int
-qemuConnectDomainQemuMonitorEventRegister(virConnectPtr conn,
-                                          virDomainPtr dom,
-                                          const char *event,
-                                          virConnectDomainQemuMonitorEventCallback callback,
-                                          void *opaque,
-                                          virFreeCallback freecb,
-                                          unsigned int flags)
-{
-    virQEMUDriverPtr driver = conn->privateData;
-    int ret = -1;
+        if (fetchnodedata)
+            nodedata = qemuMonitorQueryNamedBlockNodes(priv->mon);
 
-    if (virConnectDomainQemuMonitorEventRegisterEnsureACL(conn) < 0)
-        return -1;
+        if (qemuDomainObjExitMonitor(driver, dom) < 0)
+            goto cleanup;
 
-    if (virDomainQemuMonitorEventStateRegisterID(conn,
-                                                 driver->domainEventState,
-                                                 dom, event, callback,
-                                                 opaque, freecb, flags,
-                                                 &ret) < 0)
-        ret = -1;
+        /* failure to retrieve stats is fine at this point */
+        if (rc < 0 || (fetchnodedata && !nodedata))
+            virResetLastError();
 
-    return ret;
-}
+        /* the cache might have been dropped while in the monitor */
+        if (cachedCapacity && rc >= 0 && priv->blockCapacityCache) {
+            if (virHashForEach(priv->blockCapacityCache,
+                               qemuDomainBlockCapacityCacheFillOne, stats) < 0)
+                goto cleanup;
+        } else if (now && rc >= 0) {
+            qemuDomainBlockCapacityCacheStore(priv, stats, now);
+        }
+    }
 
+    if (nodedata &&
+        !(nodestats = qemuBlockGetNodeData(nodedata)))
+        goto cleanup;
 
-static int
-qemuConnectDomainQemuMonitorEventDeregister(virConnectPtr conn,
-                                            int callbackID)
-{
-    virQEMUDriverPtr driver = conn->privateData;
+    /* When listing backing chains, it's easier to fix up the count
+     * after the iteration than it is to iterate twice; but we still
+     * want count listed first.  */
+    count_index = params->npar;
+    if (virTypedParamListAddUInt(params, 0, "block.count") < 0)
+        goto cleanup;
 
-    if (virConnectDomainQemuMonitorEventDeregisterEnsureACL(conn) < 0)
-        return -1;
+    for (i = 0; i < dom->def->ndisks; i++) {
+        if (qemuDomainGetStatsBlockExportDisk(dom->def->disks[i], stats, nodestats,
+                                              params, &visited,
+                                              visitBacking, driver, cfg, dom,
+                                              blockdev) < 0)
+            goto cleanup;
+    }
 
-    if (virObjectEventStateDeregisterID(conn, driver->domainEventState,
-                                        callbackID, true) < 0)
-        return -1;
+    params->par[count_index].value.ui = visited;
+    ret = 0;
 
-    return 0;
+ cleanup:
+    virHashFree(stats);
+    virHashFree(nodestats);
+    virJSONValueFree(nodedata);
+    return ret;
 }
 
 
 static int
-qemuDomainFSTrim(virDomainPtr dom,
-                 const char *mountPoint,
-                 unsigned long long minimum,
-                 unsigned int flags)
+qemuDomainGetStatsIOThread(virQEMUDriverPtr driver,
+                           virDomainObjPtr dom,
+                           virTypedParamListPtr params,
+                           unsigned int privflags,
+                           const qemuDomainGetStatsHost *host G_GNUC_UNUSED)
 {
-    virQEMUDriverPtr driver = dom->conn->privateData;
-    virDomainObjPtr vm;
-    qemuAgentPtr agent;
+    qemuDomainObjPrivatePtr priv = dom->privateData;
+    size_t i;
+    qemuMonitorIOThreadInfoPtr *iothreads = NULL;
+    int niothreads;
     int ret = -1;
 
-    virCheckFlags(0, -1);
-
-    if (mountPoint) {
-        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED, "%s",
-                       _("Specifying mount point "
-                         "is not supported for now"));
-        return -1;
-    }
+    if (!HAVE_JOB(privflags) || !virDomainObjIsActive(dom))
+        return 0;
 
-    if (!(vm = qemuDomainObjFromDomain(dom)))
-        goto cleanup;
+    if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_OBJECT_IOTHREAD))
+        return 0;
 
-    if (virDomainFSTrimEnsureACL(dom->conn, vm->def) < 0)
-        goto cleanup;
+    if ((niothreads = qemuDomainGetIOThreadsMon(driver, dom, &iothreads)) < 0)
+        return -1;
 
-    if (qemuDomainObjBeginAgentJob(driver, vm, QEMU_AGENT_JOB_MODIFY) < 0)
+    /* qemuDomainGetIOThreadsMon returns a NULL-terminated list, so we must free
+     * it even if it returns 0 */
+    if (niothreads == 0) {
+        ret = 0;
         goto cleanup;
+    }
 
-    if (!qemuDomainAgentAvailable(vm, true))
-        goto endjob;
-
-    if (virDomainObjCheckActive(vm) < 0)
-        goto endjob;
+    if (virTypedParamListAddUInt(params, niothreads, "iothread.count") < 0)
+        goto cleanup;
 
-    agent = qemuDomainObjEnterAgent(vm);
-    ret = qemuAgentFSTrim(agent, minimum);
-    qemuDomainObjExitAgent(vm, agent);
+    for (i = 0; i < niothreads; i++) {
+        if (iothreads[i]->poll_valid) {
+            if (virTypedParamListAddULLong(params, iothreads[i]->poll_max_ns,
+                                           "iothread.%u.poll-max-ns",
+                                           iothreads[i]->iothread_id) < 0)
+                goto cleanup;
+            if (virTypedParamListAddUInt(params, iothreads[i]->poll_grow,
+                                         "iothread.%u.poll-grow",
+                                         iothreads[i]->iothread_id) < 0)
+                goto cleanup;
+            if (virTypedParamListAddUInt(params, iothreads[i]->poll_shrink,
+                                         "iothread.%u.poll-shrink",
+                                         iothreads[i]->iothread_id) < 0)
+                goto cleanup;
+        }
+    }
 
- endjob:
-    qemuDomainObjEndAgentJob(vm);
+    ret = 0;
 
  cleanup:
-    virDomainObjEndAPI(&vm);
+    for (i = 0; i < niothreads; i++)
+        VIR_FREE(iothreads[i]);
+    VIR_FREE(iothreads);
+
     return ret;
 }
 
 
 static int
-qemuNodeGetInfo(virConnectPtr conn,
-                virNodeInfoPtr nodeinfo)
+qemuDomainGetStatsPerfOneEvent(virPerfPtr perf,
+                               virPerfEventType type,
+                               virTypedParamListPtr params)
 {
-    if (virNodeGetInfoEnsureACL(conn) < 0)
-        return -1;
-
-    return virCapabilitiesGetNodeInfo(nodeinfo);
-}
+    uint64_t value = 0;
 
+    if (virPerfReadEvent(perf, type, &value) < 0)
+        return -1;
 
-static int
-qemuNodeGetCPUStats(virConnectPtr conn,
-                    int cpuNum,
-                    virNodeCPUStatsPtr params,
-                    int *nparams,
-                    unsigned int flags)
-{
-    if (virNodeGetCPUStatsEnsureACL(conn) < 0)
+    if (virTypedParamListAddULLong(params, value, "perf.%s",
+                                   virPerfEventTypeToString(type)) < 0)
         return -1;
 
-    return virHostCPUGetStats(cpuNum, params, nparams, flags);
+    return 0;
 }
 
+/* Events which are also counted per vCPU thread if stats_perf_vcpu is set */
+static const virPerfEventType qemuDomainVcpuPerfEvents[] = {
+    VIR_PERF_EVENT_CPU_CYCLES,
+    VIR_PERF_EVENT_INSTRUCTIONS,
+    VIR_PERF_EVENT_CACHE_MISSES,
+};
+
 
 static int
-qemuNodeGetMemoryStats(virConnectPtr conn,
-                       int cellNum,
-                       virNodeMemoryStatsPtr params,
-                       int *nparams,
-                       unsigned int flags)
+qemuDomainGetStatsPerfVcpu(virDomainObjPtr dom,
+                           virTypedParamListPtr params)
 {
-    if (virNodeGetMemoryStatsEnsureACL(conn) < 0)
-        return -1;
+    qemuDomainObjPrivatePtr priv = dom->privateData;
+    virPerfEventType types[G_N_ELEMENTS(qemuDomainVcpuPerfEvents)];
+    uint64_t values[G_N_ELEMENTS(qemuDomainVcpuPerfEvents)];
+    unsigned int events = 0;
+    size_t ntypes = 0;
+    size_t maxvcpus = virDomainDefGetVcpusMax(dom->def);
+    size_t i;
+    size_t j;
 
-    return virHostMemGetStats(cellNum, params, nparams, flags);
-}
+    for (i = 0; i < G_N_ELEMENTS(qemuDomainVcpuPerfEvents); i++) {
+        if (!virPerfEventIsEnabled(priv->perf, qemuDomainVcpuPerfEvents[i]))
+            continue;
 
+        types[ntypes++] = qemuDomainVcpuPerfEvents[i];
+        events |= 1 << qemuDomainVcpuPerfEvents[i];
+    }
 
-static int
-qemuNodeGetCellsFreeMemory(virConnectPtr conn,
-                           unsigned long long *freeMems,
-                           int startCell,
-                           int maxCells)
-{
-    if (virNodeGetCellsFreeMemoryEnsureACL(conn) < 0)
-        return -1;
+    for (i = 0; i < maxvcpus; i++) {
+        virDomainVcpuDefPtr vcpu = virDomainDefGetVcpu(dom->def, i);
+        qemuDomainVcpuPrivatePtr vcpupriv = QEMU_DOMAIN_VCPU_PRIVATE(vcpu);
 
-    return virHostMemGetCellsFree(freeMems, startCell, maxCells);
-}
+        /* drop counters of unplugged vCPUs or for a different set of events */
+        if (vcpupriv->perf &&
+            (vcpupriv->perfTid != vcpupriv->tid ||
+             vcpupriv->perfEvents != events)) {
+            virPerfGroupFree(vcpupriv->perf);
+            vcpupriv->perf = NULL;
+        }
 
+        if (ntypes == 0 || !vcpu->online || vcpupriv->tid == 0)
+            continue;
 
-static unsigned long long
-qemuNodeGetFreeMemory(virConnectPtr conn)
-{
-    unsigned long long freeMem;
+        if (!vcpupriv->perf) {
+            /* the per-vCPU counters are best effort, the PMU might not
+             * allow that many events */
+            if (!(vcpupriv->perf = virPerfGroupNew(vcpupriv->tid, types,
+                                                   ntypes))) {
+                VIR_DEBUG("Unable to count perf events of vCPU %zu: %s",
+                          i, virGetLastErrorMessage());
+                virResetLastError();
+                continue;
+            }
 
-    if (virNodeGetFreeMemoryEnsureACL(conn) < 0)
-        return 0;
+            vcpupriv->perfTid = vcpupriv->tid;
+            vcpupriv->perfEvents = events;
+        }
 
-    if (virHostMemGetInfo(NULL, &freeMem) < 0)
-        return 0;
+        if (virPerfGroupRead(vcpupriv->perf, values) < 0)
+            return -1;
 
-    return freeMem;
+        for (j = 0; j < ntypes; j++) {
+            if (virTypedParamListAddULLong(params, values[j],
+                                           "perf.vcpu.%zu.%s", i,
+                                           virPerfEventTypeToString(types[j])) < 0)
+                return -1;
+        }
+    }
+
+    return 0;
 }
 
 
 static int
-qemuNodeGetMemoryParameters(virConnectPtr conn,
-                            virTypedParameterPtr params,
-                            int *nparams,
-                            unsigned int flags)
+qemuDomainGetStatsPerf(virQEMUDriverPtr driver,
+                       virDomainObjPtr dom,
+                       virTypedParamListPtr params,
+                       unsigned int privflags G_GNUC_UNUSED,
+                       const qemuDomainGetStatsHost *host G_GNUC_UNUSED)
 {
-    if (virNodeGetMemoryParametersEnsureACL(conn) < 0)
-        return -1;
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    size_t i;
+    qemuDomainObjPrivatePtr priv = dom->privateData;
 
-    return virHostMemGetParameters(params, nparams, flags);
-}
+    for (i = 0; i < VIR_PERF_EVENT_LAST; i++) {
+        if (!virPerfEventIsEnabled(priv->perf, i))
+             continue;
 
+        if (qemuDomainGetStatsPerfOneEvent(priv->perf, i, params) < 0)
+            return -1;
+    }
 
-static int
-qemuNodeSetMemoryParameters(virConnectPtr conn,
-                            virTypedParameterPtr params,
-                            int nparams,
-                            unsigned int flags)
-{
-    if (virNodeSetMemoryParametersEnsureACL(conn) < 0)
+    if (cfg->statsPerfVcpu && virDomainObjIsActive(dom) &&
+        qemuDomainGetStatsPerfVcpu(dom, params) < 0)
         return -1;
 
-    return virHostMemSetParameters(params, nparams, flags);
+    return 0;
 }
 
-
 static int
-qemuNodeGetCPUMap(virConnectPtr conn,
-                  unsigned char **cpumap,
-                  unsigned int *online,
-                  unsigned int flags)
+qemuDomainGetStatsPressureStat(virTypedParamListPtr params,
+                               virCgroupPressureStat *stat,
+                               const char *resource,
+                               const char *type)
 {
-    if (virNodeGetCPUMapEnsureACL(conn) < 0)
+    if (virTypedParamListAddDouble(params, stat->avg10,
+                                   "pressure.%s.%s.avg10", resource, type) < 0 ||
+        virTypedParamListAddDouble(params, stat->avg60,
+                                   "pressure.%s.%s.avg60", resource, type) < 0 ||
+        virTypedParamListAddDouble(params, stat->avg300,
+                                   "pressure.%s.%s.avg300", resource, type) < 0 ||
+        virTypedParamListAddULLong(params, stat->total,
+                                   "pressure.%s.%s.total", resource, type) < 0)
         return -1;
 
-    return virHostCPUGetMap(cpumap, online, flags);
+    return 0;
 }
 
 
 static int
-qemuNodeSuspendForDuration(virConnectPtr conn,
-                           unsigned int target,
-                           unsigned long long duration,
-                           unsigned int flags)
+qemuDomainGetStatsPressure(virQEMUDriverPtr driver G_GNUC_UNUSED,
+                           virDomainObjPtr dom,
+                           virTypedParamListPtr params,
+                           unsigned int privflags G_GNUC_UNUSED,
+                           const qemuDomainGetStatsHost *host G_GNUC_UNUSED)
 {
-    if (virNodeSuspendForDurationEnsureACL(conn) < 0)
-        return -1;
+    qemuDomainObjPrivatePtr priv = dom->privateData;
+    size_t i;
 
-    return virNodeSuspend(target, duration, flags);
-}
+    if (!virDomainObjIsActive(dom) || !priv->cgroup)
+        return 0;
 
-static int
-qemuConnectGetCPUModelNames(virConnectPtr conn,
-                            const char *archName,
-                            char ***models,
-                            unsigned int flags)
-{
-    virArch arch;
+    for (i = 0; i < VIR_CGROUP_PRESSURE_LAST; i++) {
+        const char *resource = virCgroupPressureResourceTypeToString(i);
+        virCgroupPressure pressure;
 
-    virCheckFlags(0, -1);
-    if (virConnectGetCPUModelNamesEnsureACL(conn) < 0)
-        return -1;
+        /* PSI is available only with cgroups v2 and CONFIG_PSI */
+        if (virCgroupGetPressure(priv->cgroup, i, &pressure) < 0) {
+            virResetLastError();
+            continue;
+        }
 
-    if (!(arch = virArchFromString(archName))) {
-        virReportError(VIR_ERR_INVALID_ARG,
-                       _("cannot find architecture %s"),
-                       archName);
-        return -1;
+        if (pressure.hasSome &&
+            qemuDomainGetStatsPressureStat(params, &pressure.some,
+                                           resource, "some") < 0)
+            return -1;
+
+        if (pressure.hasFull &&
+            qemuDomainGetStatsPressureStat(params, &pressure.full,
+                                           resource, "full") < 0)
+            return -1;
     }
 
-    return virCPUGetModels(arch, models);
+    return 0;
 }
 
 
+/* Returns the guest NUMA cell @map backs, or -1 if it can't be told */
 static int
-qemuDomainGetHostnameAgent(virQEMUDriverPtr driver,
-                           virDomainObjPtr vm,
-                           char **hostname)
+qemuDomainGetStatsNumaMapCell(virNumaMapPtr map)
 {
-    qemuAgentPtr agent;
-    int ret = -1;
+    const char *tmp;
+    char *end;
+    unsigned int cell;
 
-    if (qemuDomainObjBeginAgentJob(driver, vm, QEMU_AGENT_JOB_QUERY) < 0)
+    /* memory backends of guest NUMA cells are called "ram-node<N>" which
+     * shows in the name of the file backing them */
+    if (!map->file || !(tmp = strstr(map->file, "ram-node")))
         return -1;
 
-    if (virDomainObjCheckActive(vm) < 0)
-        goto endjob;
-
-    if (!qemuDomainAgentAvailable(vm, true))
-        goto endjob;
-
-    agent = qemuDomainObjEnterAgent(vm);
-    ignore_value(qemuAgentGetHostname(agent, hostname, true));
-    qemuDomainObjExitAgent(vm, agent);
+    if (virStrToLong_ui(tmp + strlen("ram-node"), &end, 10, &cell) < 0)
+        return -1;
 
-    ret = 0;
- endjob:
-    qemuDomainObjEndAgentJob(vm);
-    return ret;
+    return cell;
 }
 
 
 static int
-qemuDomainGetHostnameLease(virQEMUDriverPtr driver,
-                           virDomainObjPtr vm,
-                           char **hostname)
+qemuDomainGetStatsNuma(virQEMUDriverPtr driver G_GNUC_UNUSED,
+                       virDomainObjPtr dom,
+                       virTypedParamListPtr params,
+                       unsigned int privflags G_GNUC_UNUSED,
+                       const qemuDomainGetStatsHost *host G_GNUC_UNUSED)
 {
-    char macaddr[VIR_MAC_STRING_BUFLEN];
-    g_autoptr(virConnect) conn = NULL;
-    virNetworkDHCPLeasePtr *leases = NULL;
-    int n_leases;
-    size_t i, j;
+    qemuDomainObjPrivatePtr priv = dom->privateData;
+    virDomainDefPtr def = dom->def;
+    size_t ncells = virDomainNumaGetNodeCount(def->numa);
+    g_autofree unsigned long long *nodes = NULL;
+    size_t nnodes = 0;
+    g_autofree unsigned long long *cells = NULL;
+    size_t ncellnodes = 0;
+    virNumaMapPtr maps = NULL;
+    size_t nmaps = 0;
+    bool readMaps = false;
+    bool fromCgroup = true;
+    size_t i;
+    size_t j;
     int ret = -1;
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) < 0)
-        return -1;
+    if (!virDomainObjIsActive(dom))
+        return 0;
 
-    if (virDomainObjCheckActive(vm) < 0)
-        goto endjob;
+    /* Reading numa_maps makes the kernel walk the page tables of the whole
+     * process, so it's done only if the guest NUMA cells have their memory
+     * in named files (hugepages or file backing) and can be told apart. */
+    if (ncells > 0 &&
+        (def->mem.nhugepages > 0 ||
+         def->mem.source == VIR_DOMAIN_MEMORY_SOURCE_FILE))
+        readMaps = true;
+
+    /* totals per host node are cheap to get from the cgroup */
+    if (!priv->cgroup ||
+        virCgroupGetMemoryNumaStat(priv->cgroup, &nodes, &nnodes) < 0) {
+        virResetLastError();
+        g_clear_pointer(&nodes, g_free);
+        nnodes = 0;
+        fromCgroup = false;
+        readMaps = true;
+    }
 
-    if (!(conn = virGetConnectNetwork()))
-        goto endjob;
+    if (readMaps &&
+        virNumaGetProcessMaps(dom->pid, &maps, &nmaps) < 0)
+        virResetLastError();
 
-    for (i = 0; i < vm->def->nnets; i++) {
-        g_autoptr(virNetwork) network = NULL;
-        virDomainNetDefPtr net = vm->def->nets[i];
+    for (i = 0; i < nmaps; i++) {
+        virNumaMapPtr map = &maps[i];
+        int cell = qemuDomainGetStatsNumaMapCell(map);
 
-        if (net->type != VIR_DOMAIN_NET_TYPE_NETWORK)
-            continue;
+        /* fall back to summing up all the mappings of the process */
+        if (!fromCgroup) {
+            if (map->nnodes > nnodes &&
+                VIR_EXPAND_N(nodes, nnodes, map->nnodes - nnodes) < 0)
+                goto cleanup;
 
-        virMacAddrFormat(&net->mac, macaddr);
-        network = virNetworkLookupByName(conn, net->data.network.name);
+            for (j = 0; j < map->nnodes; j++)
+                nodes[j] += map->nodes[j];
+        }
 
-        if (!network)
-            goto endjob;
+        if (cell < 0 || (size_t) cell >= ncells)
+            continue;
 
-        if ((n_leases = virNetworkGetDHCPLeases(network, macaddr,
-                                                &leases, 0)) < 0)
-            goto endjob;
+        if (map->nnodes > ncellnodes) {
+            /* @cells is a ncells x ncellnodes matrix */
+            g_autofree unsigned long long *tmp = NULL;
+            size_t k;
 
-        for (j = 0; j < n_leases; j++) {
-            virNetworkDHCPLeasePtr lease = leases[j];
-            if (lease->hostname && !*hostname)
-                *hostname = g_strdup(lease->hostname);
+            tmp = g_new0(unsigned long long, ncells * map->nnodes);
+            for (j = 0; j < ncells; j++) {
+                for (k = 0; k < ncellnodes; k++)
+                    tmp[j * map->nnodes + k] = cells[j * ncellnodes + k];
+            }
 
-            virNetworkDHCPLeaseFree(lease);
+            g_free(cells);
+            cells = g_steal_pointer(&tmp);
+            ncellnodes = map->nnodes;
         }
 
-        VIR_FREE(leases);
+        for (j = 0; j < map->nnodes; j++)
+            cells[cell * ncellnodes + j] += map->nodes[j];
+    }
+
+    for (i = 0; i < nnodes; i++) {
+        if (nodes[i] == 0)
+            continue;
+
+        if (virTypedParamListAddULLong(params, nodes[i],
+                                       "numa.node.%zu.resident", i) < 0)
+            goto cleanup;
+    }
 
-        if (*hostname)
-            goto endjob;
+    for (i = 0; i < ncells && cells; i++) {
+        for (j = 0; j < ncellnodes; j++) {
+            if (cells[i * ncellnodes + j] == 0)
+                continue;
+
+            if (virTypedParamListAddULLong(params, cells[i * ncellnodes + j],
+                                           "numa.cell.%zu.node.%zu.resident",
+                                           i, j) < 0)
+                goto cleanup;
+        }
     }
 
     ret = 0;
- endjob:
-    qemuDomainObjEndJob(driver, vm);
+
+ cleanup:
+    virNumaMapsFree(maps, nmaps);
     return ret;
 }
 
 
-static char *
-qemuDomainGetHostname(virDomainPtr dom,
-                      unsigned int flags)
+static int
+qemuDomainGetStatsMemoryHost(virQEMUDriverPtr driver G_GNUC_UNUSED,
+                             virDomainObjPtr dom,
+                             virTypedParamListPtr params,
+                             unsigned int privflags G_GNUC_UNUSED,
+                             const qemuDomainGetStatsHost *host G_GNUC_UNUSED)
 {
-    virQEMUDriverPtr driver = dom->conn->privateData;
-    virDomainObjPtr vm = NULL;
-    char *hostname = NULL;
+    virProcessMemoryStats stats;
 
-    virCheckFlags(VIR_DOMAIN_GET_HOSTNAME_LEASE |
-                  VIR_DOMAIN_GET_HOSTNAME_AGENT, NULL);
-
-    VIR_EXCLUSIVE_FLAGS_RET(VIR_DOMAIN_GET_HOSTNAME_LEASE,
-                            VIR_DOMAIN_GET_HOSTNAME_AGENT,
-                            NULL);
+    if (!virDomainObjIsActive(dom))
+        return 0;
 
-    if (!(flags & VIR_DOMAIN_GET_HOSTNAME_LEASE))
-        flags |= VIR_DOMAIN_GET_HOSTNAME_AGENT;
+    if (virTypedParamListAddBoolean(params, !dom->def->mem.nosharepages,
+                                    "memory.host.share_pages") < 0)
+        return -1;
 
-    if (!(vm = qemuDomainObjFromDomain(dom)))
-        return NULL;
+    if (virProcessGetMemoryStats(dom->pid, &stats) < 0) {
+        virResetLastError();
+        return 0;
+    }
 
-    if (virDomainGetHostnameEnsureACL(dom->conn, vm->def) < 0)
-        goto cleanup;
+    if (virTypedParamListAddULLong(params, stats.rss,
+                                   "memory.host.rss") < 0 ||
+        virTypedParamListAddULLong(params, stats.anonHugePages,
+                                   "memory.host.thp") < 0 ||
+        virTypedParamListAddULLong(params, stats.hugetlb,
+                                   "memory.host.hugetlb") < 0)
+        return -1;
 
-    if (flags & VIR_DOMAIN_GET_HOSTNAME_AGENT) {
-        if (qemuDomainGetHostnameAgent(driver, vm, &hostname) < 0)
-            goto cleanup;
-    } else if (flags & VIR_DOMAIN_GET_HOSTNAME_LEASE) {
-        if (qemuDomainGetHostnameLease(driver, vm, &hostname) < 0)
-            goto cleanup;
-    }
+    if (!stats.ksm)
+        return 0;
 
-    if (!hostname) {
-        virReportError(VIR_ERR_NO_HOSTNAME,
-                       _("no hostname found for domain %s"),
-                       vm->def->name);
-        goto cleanup;
-    }
+    if (virTypedParamListAddULLong(params, stats.ksmRmapItems,
+                                   "memory.host.ksm.rmap_items") < 0 ||
+        virTypedParamListAddULLong(params, stats.ksmMergingPages,
+                                   "memory.host.ksm.merging_pages") < 0 ||
+        virTypedParamListAddULLong(params, stats.ksmZeroPages,
+                                   "memory.host.ksm.zero_pages") < 0 ||
+        virTypedParamListAddLLong(params, stats.ksmProfit,
+                                  "memory.host.ksm.profit") < 0)
+        return -1;
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return hostname;
+    return 0;
 }
 
 
 static int
-qemuDomainGetTime(virDomainPtr dom,
-                  long long *seconds,
-                  unsigned int *nseconds,
-                  unsigned int flags)
+qemuDomainGetStatsMonitor(virQEMUDriverPtr driver G_GNUC_UNUSED,
+                          virDomainObjPtr dom,
+                          virTypedParamListPtr params,
+                          unsigned int privflags G_GNUC_UNUSED,
+                          const qemuDomainGetStatsHost *host G_GNUC_UNUSED)
 {
-    virQEMUDriverPtr driver = dom->conn->privateData;
-    virDomainObjPtr vm = NULL;
-    qemuAgentPtr agent;
+    qemuDomainObjPrivatePtr priv = dom->privateData;
+    qemuMonitorCommandLatencyPtr latency = NULL;
+    size_t nlatency = 0;
+    size_t i;
+    size_t j;
     int ret = -1;
-    int rv;
 
-    virCheckFlags(0, ret);
+    if (!virDomainObjIsActive(dom) || !priv->mon)
+        return 0;
 
-    if (!(vm = qemuDomainObjFromDomain(dom)))
-        return ret;
+    if (qemuMonitorGetCommandLatency(priv->mon, &latency, &nlatency) < 0)
+        return -1;
 
-    if (virDomainGetTimeEnsureACL(dom->conn, vm->def) < 0)
+    if (virHistogramAddLimits(params, "monitor.") < 0)
         goto cleanup;
 
-    if (qemuDomainObjBeginAgentJob(driver, vm, QEMU_AGENT_JOB_QUERY) < 0)
+    if (virTypedParamListAddUInt(params, nlatency,
+                                 "monitor.command.count") < 0)
         goto cleanup;
 
-    if (virDomainObjCheckActive(vm) < 0)
-        goto endjob;
-
-    if (!qemuDomainAgentAvailable(vm, true))
-        goto endjob;
+    for (i = 0; i < nlatency; i++) {
+        qemuMonitorCommandLatencyPtr cmd = latency + i;
 
-    agent = qemuDomainObjEnterAgent(vm);
-    rv = qemuAgentGetTime(agent, seconds, nseconds);
-    qemuDomainObjExitAgent(vm, agent);
+        if (virTypedParamListAddString(params, cmd->name,
+                                       "monitor.command.%zu.name", i) < 0 ||
+            virTypedParamListAddULLong(params, cmd->count,
+                                       "monitor.command.%zu.count", i) < 0 ||
+            virTypedParamListAddULLong(params, cmd->failed,
+                                       "monitor.command.%zu.failed", i) < 0 ||
+            virTypedParamListAddULLong(params, cmd->queueTime,
+                                       "monitor.command.%zu.queue.time", i) < 0 ||
+            virTypedParamListAddULLong(params, cmd->writeTime,
+                                       "monitor.command.%zu.write.time", i) < 0 ||
+            virTypedParamListAddULLong(params, cmd->replyTime,
+                                       "monitor.command.%zu.reply.time", i) < 0 ||
+            virTypedParamListAddULLong(params, cmd->hist.max,
+                                       "monitor.command.%zu.max", i) < 0)
+            goto cleanup;
 
-    if (rv < 0)
-        goto endjob;
+        for (j = 0; j < VIR_HISTOGRAM_BUCKETS; j++) {
+            if (virTypedParamListAddULLong(params, cmd->hist.buckets[j],
+                                           "monitor.command.%zu.bucket.%zu",
+                                           i, j) < 0)
+                goto cleanup;
+        }
+    }
 
     ret = 0;
 
- endjob:
-    qemuDomainObjEndAgentJob(vm);
-
  cleanup:
-    virDomainObjEndAPI(&vm);
+    qemuMonitorCommandLatencyFree(latency, nlatency);
     return ret;
 }
 
 
+typedef int
+(*qemuDomainGetStatsFunc)(virQEMUDriverPtr driver,
+                          virDomainObjPtr dom,
+                          virTypedParamListPtr list,
+                          unsigned int flags,
+                          const qemuDomainGetStatsHost *host);
+
+struct qemuDomainGetStatsWorker {
+    qemuDomainGetStatsFunc func;
+    unsigned int stats;
+    bool monitor;
+};
+
+static struct qemuDomainGetStatsWorker qemuDomainGetStatsWorkers[] = {
+    { qemuDomainGetStatsState, VIR_DOMAIN_STATS_STATE, false },
+    { qemuDomainGetStatsCpu, VIR_DOMAIN_STATS_CPU_TOTAL, false },
+    { qemuDomainGetStatsBalloon, VIR_DOMAIN_STATS_BALLOON, true },
+    { qemuDomainGetStatsVcpu, VIR_DOMAIN_STATS_VCPU, true },
+    { qemuDomainGetStatsInterface, VIR_DOMAIN_STATS_INTERFACE, false },
+    { qemuDomainGetStatsBlock, VIR_DOMAIN_STATS_BLOCK, true },
+    { qemuDomainGetStatsPerf, VIR_DOMAIN_STATS_PERF, false },
+    { qemuDomainGetStatsIOThread, VIR_DOMAIN_STATS_IOTHREAD, true },
+    { qemuDomainGetStatsMemory, VIR_DOMAIN_STATS_MEMORY, false },
+    { qemuDomainGetStatsDirtyRate, VIR_DOMAIN_STATS_DIRTYRATE, true },
+    { qemuDomainGetStatsPressure, VIR_DOMAIN_STATS_PRESSURE, false },
+    { qemuDomainGetStatsNuma, VIR_DOMAIN_STATS_NUMA, false },
+    { qemuDomainGetStatsMemoryHost, VIR_DOMAIN_STATS_MEMORY_HOST, false },
+    { qemuDomainGetStatsMonitor, VIR_DOMAIN_STATS_MONITOR, false },
+    { NULL, 0, false }
+};
+
+
 static int
-qemuDomainSetTimeAgent(virQEMUDriverPtr driver,
-                       virDomainObjPtr vm,
-                       long long seconds,
-                       unsigned int nseconds,
-                       bool rtcSync)
+qemuDomainGetStatsCheckSupport(unsigned int *stats,
+                               bool enforce)
 {
-    qemuAgentPtr agent;
-    int ret = -1;
+    unsigned int supportedstats = 0;
+    size_t i;
 
-    if (qemuDomainObjBeginAgentJob(driver, vm, QEMU_AGENT_JOB_MODIFY) < 0)
+    for (i = 0; qemuDomainGetStatsWorkers[i].func; i++)
+        supportedstats |= qemuDomainGetStatsWorkers[i].stats;
+
+    if (*stats == 0) {
+        *stats = supportedstats;
+        return 0;
+    }
+
+    if (enforce &&
+        *stats & ~supportedstats) {
+        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED,
+                       _("Stats types bits 0x%x are not supported by this daemon"),
+                       *stats & ~supportedstats);
         return -1;
+    }
 
-    if (virDomainObjCheckActive(vm) < 0)
-        goto endjob;
+    *stats &= supportedstats;
+    return 0;
+}
 
-    if (!qemuDomainAgentAvailable(vm, true))
-        goto endjob;
 
-    agent = qemuDomainObjEnterAgent(vm);
-    ret = qemuAgentSetTime(agent, seconds, nseconds, rtcSync);
-    qemuDomainObjExitAgent(vm, agent);
+static bool
+qemuDomainGetStatsNeedMonitor(unsigned int stats)
+{
+    size_t i;
 
- endjob:
-    qemuDomainObjEndAgentJob(vm);
-    return ret;
+    for (i = 0; qemuDomainGetStatsWorkers[i].func; i++)
+        if (stats & qemuDomainGetStatsWorkers[i].stats &&
+            qemuDomainGetStatsWorkers[i].monitor)
+            return true;
+
+    return false;
 }
 
 
-static int
-qemuDomainSetTime(virDomainPtr dom,
-                  long long seconds,
-                  unsigned int nseconds,
-                  unsigned int flags)
+/*
+ * Returns the cache entry of @dom for the @stats group if it's usable
+ * for a query with @privflags at @now, NULL otherwise.
+ */
+static qemuDomainStatsCacheEntryPtr
+qemuDomainStatsCacheLookup(virQEMUDriverConfigPtr cfg,
+                           virDomainObjPtr dom,
+                           unsigned int stats,
+                           unsigned int privflags,
+                           unsigned long long now)
 {
-    virQEMUDriverPtr driver = dom->conn->privateData;
-    qemuDomainObjPrivatePtr priv;
-    virDomainObjPtr vm;
-    bool rtcSync = flags & VIR_DOMAIN_TIME_SYNC;
-    int ret = -1;
-    int rv;
+    qemuDomainObjPrivatePtr priv = dom->privateData;
+    bool backing = !!(privflags & QEMU_DOMAIN_STATS_BACKING);
+    size_t i;
 
-    virCheckFlags(VIR_DOMAIN_TIME_SYNC, ret);
+    for (i = 0; i < priv->nstatsCache; i++) {
+        qemuDomainStatsCacheEntryPtr entry = priv->statsCache + i;
 
-    if (!(vm = qemuDomainObjFromDomain(dom)))
-        return ret;
+        if (entry->stats != stats || entry->timestamp == 0)
+            continue;
 
-    if (virDomainSetTimeEnsureACL(dom->conn, vm->def) < 0)
-        goto cleanup;
+        if (now > entry->timestamp + cfg->statsCacheMaxAge * 1000ULL)
+            return NULL;
 
-    priv = vm->privateData;
+        /* only block stats differ with the backing chain */
+        if (stats == VIR_DOMAIN_STATS_BLOCK && entry->backing != backing)
+            return NULL;
 
-    /* On x86, the rtc-reset-reinjection QMP command must be called after
-     * setting the time to avoid trouble down the line. If the command is
-     * not available, don't set the time at all and report an error */
-    if (ARCH_IS_X86(vm->def->os.arch) &&
-        !virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_RTC_RESET_REINJECTION))
-    {
-        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
-                       _("cannot set time: qemu doesn't support "
-                         "rtc-reset-reinjection command"));
-        goto cleanup;
+        return entry;
     }
 
-    if (qemuDomainSetTimeAgent(driver, vm, seconds, nseconds, rtcSync) < 0)
-        goto cleanup;
+    return NULL;
+}
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
-        goto cleanup;
 
-    if (virDomainObjCheckActive(vm) < 0)
-        goto endjob;
+/*
+ * Returns the subset of @stats which can't be served from the stats
+ * cache of @dom.
+ */
+static unsigned int
+qemuDomainStatsCacheMissing(virQEMUDriverPtr driver,
+                            virDomainObjPtr dom,
+                            unsigned int stats,
+                            unsigned int privflags)
+{
+    g_autoptr(virQEMUDriverConfig) cfg = NULL;
+    unsigned long long now;
+    unsigned int missing = 0;
+    size_t i;
 
-    /* Don't try to call rtc-reset-reinjection if it's not available */
-    if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_RTC_RESET_REINJECTION)) {
-        qemuDomainObjEnterMonitor(driver, vm);
-        rv = qemuMonitorRTCResetReinjection(priv->mon);
-        if (qemuDomainObjExitMonitor(driver, vm) < 0)
-            goto endjob;
+    if (!driver->statsCachePool || !virDomainObjIsActive(dom) ||
+        virTimeMillisNow(&now) < 0)
+        return stats;
 
-        if (rv < 0)
-            goto endjob;
+    cfg = virQEMUDriverGetConfig(driver);
+
+    for (i = 0; qemuDomainGetStatsWorkers[i].func; i++) {
+        unsigned int group = qemuDomainGetStatsWorkers[i].stats;
+
+        if (stats & group &&
+            !qemuDomainStatsCacheLookup(cfg, dom, group, privflags, now))
+            missing |= group;
+    }
+
+    return missing;
+}
+
+
+static void
+qemuDomainStatsCacheStore(virDomainObjPtr dom,
+                          unsigned int stats,
+                          unsigned int privflags,
+                          unsigned long long now,
+                          virTypedParameterPtr params,
+                          size_t nparams)
+{
+    qemuDomainStatsCacheEntryPtr entry;
+
+    entry = qemuDomainStatsCacheGetEntry(dom->privateData, stats);
+
+    virTypedParamsFree(entry->params, entry->nparams);
+    entry->params = NULL;
+    entry->nparams = 0;
+    entry->timestamp = 0;
+
+    if (virTypedParamsCopy(&entry->params, params, nparams) < 0)
+        return;
+
+    entry->nparams = nparams;
+    entry->backing = !!(privflags & QEMU_DOMAIN_STATS_BACKING);
+    entry->timestamp = now;
+}
+
+
+/*
+ * Gathers the @stats groups of @dom into @params. If the stats cache is
+ * enabled, freshly gathered data is stored into it and, with
+ * QEMU_DOMAIN_STATS_CACHED in @privflags, groups with recent enough
+ * cached data are served from the cache. @host is optional.
+ */
+static int
+qemuDomainGetStatsParams(virQEMUDriverPtr driver,
+                         virDomainObjPtr dom,
+                         unsigned int stats,
+                         virTypedParamListPtr params,
+                         unsigned int privflags,
+                         const qemuDomainGetStatsHost *host)
+{
+    g_autoptr(virQEMUDriverConfig) cfg = NULL;
+    unsigned long long now = 0;
+    size_t i;
+
+    if (driver->statsCachePool && virDomainObjIsActive(dom)) {
+        if (virTimeMillisNow(&now) < 0)
+            return -1;
+        cfg = virQEMUDriverGetConfig(driver);
     }
 
-    ret = 0;
+    for (i = 0; qemuDomainGetStatsWorkers[i].func; i++) {
+        struct qemuDomainGetStatsWorker *worker = qemuDomainGetStatsWorkers + i;
+        qemuDomainStatsCacheEntryPtr entry;
+        size_t start = params->npar;
 
- endjob:
-    qemuDomainObjEndJob(driver, vm);
+        if (!(stats & worker->stats))
+            continue;
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return ret;
+        if (cfg && privflags & QEMU_DOMAIN_STATS_CACHED &&
+            (entry = qemuDomainStatsCacheLookup(cfg, dom, worker->stats,
+                                                privflags, now))) {
+            if (virTypedParamListAddCopy(params, entry->params,
+                                         entry->nparams) < 0)
+                return -1;
+            continue;
+        }
+
+        if (worker->func(driver, dom, params, privflags, host) < 0)
+            return -1;
+
+        /* without a job the monitor based workers report partial data;
+         * the domain state is cheap to get and must never be stale */
+        if (cfg && (!worker->monitor || HAVE_JOB(privflags)) &&
+            worker->stats != VIR_DOMAIN_STATS_STATE)
+            qemuDomainStatsCacheStore(dom, worker->stats, privflags, now,
+                                      params->par + start,
+                                      params->npar - start);
+    }
+
+    return 0;
 }
 
 
 static int
-qemuDomainFSFreeze(virDomainPtr dom,
-                   const char **mountpoints,
-                   unsigned int nmountpoints,
+qemuDomainGetStats(virConnectPtr conn,
+                   virDomainObjPtr dom,
+                   unsigned int stats,
+                   const qemuDomainGetStatsHost *host,
+                   virDomainStatsRecordPtr *record,
                    unsigned int flags)
 {
-    virQEMUDriverPtr driver = dom->conn->privateData;
-    virDomainObjPtr vm;
-    int ret = -1;
-
-    virCheckFlags(0, -1);
+    qemuDomainObjPrivatePtr priv = dom->privateData;
+    g_autofree virDomainStatsRecordPtr tmp = NULL;
+    g_autoptr(virTypedParamList) params = NULL;
 
-    if (!(vm = qemuDomainObjFromDomain(dom)))
-        goto cleanup;
+    if (VIR_ALLOC(params) < 0)
+        return -1;
 
-    if (virDomainFSFreezeEnsureACL(dom->conn, vm->def) < 0)
-        goto cleanup;
+    /* domains with many devices report thousands of parameters, don't
+     * grow the list step by step each time */
+    virTypedParamListReserve(params, priv->statsParamsHint);
 
-    if (qemuDomainObjBeginAgentJob(driver, vm, QEMU_AGENT_JOB_MODIFY) < 0)
-        goto cleanup;
+    if (qemuDomainGetStatsParams(conn->privateData, dom, stats, params,
+                                 flags, host) < 0)
+        return -1;
 
-    if (virDomainObjCheckActive(vm) < 0)
-        goto endjob;
+    priv->statsParamsHint = params->npar;
 
-    ret = qemuDomainSnapshotFSFreeze(vm, mountpoints, nmountpoints);
+    if (VIR_ALLOC(tmp) < 0)
+        return -1;
 
- endjob:
-    qemuDomainObjEndAgentJob(vm);
+    if (!(tmp->dom = virGetDomain(conn, dom->def->name,
+                                  dom->def->uuid, dom->def->id)))
+        return -1;
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return ret;
+    tmp->nparams = virTypedParamListStealParams(params, &tmp->params);
+    *record = g_steal_pointer(&tmp);
+    return 0;
 }
 
 
 static int
-qemuDomainFSThaw(virDomainPtr dom,
-                 const char **mountpoints,
-                 unsigned int nmountpoints,
-                 unsigned int flags)
+qemuConnectGetAllDomainStatsOne(virConnectPtr conn,
+                                virDomainObjPtr vm,
+                                unsigned int stats,
+                                const qemuDomainGetStatsHost *host,
+                                unsigned int privflags,
+                                unsigned int flags,
+                                virDomainStatsRecordPtr *record)
 {
-    virQEMUDriverPtr driver = dom->conn->privateData;
-    virDomainObjPtr vm;
-    int ret = -1;
+    virQEMUDriverPtr driver = conn->privateData;
+    unsigned int domflags = 0;
+    int ret;
 
-    virCheckFlags(0, -1);
+    virObjectLock(vm);
 
-    if (mountpoints || nmountpoints) {
-        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED, "%s",
-                       _("specifying mountpoints is not supported"));
-        return ret;
-    }
+    if (flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING)
+        domflags |= QEMU_DOMAIN_STATS_BACKING;
 
-    if (!(vm = qemuDomainObjFromDomain(dom)))
-        goto cleanup;
+    if (flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_CACHED) {
+        domflags |= QEMU_DOMAIN_STATS_CACHED;
 
-    if (virDomainFSThawEnsureACL(dom->conn, vm->def) < 0)
-        goto cleanup;
+        /* no need to wait for a job if the cache can serve all the
+         * monitor based stats */
+        if (!qemuDomainGetStatsNeedMonitor(qemuDomainStatsCacheMissing(driver, vm,
+                                                                       stats,
+                                                                       domflags)))
+            privflags &= ~QEMU_DOMAIN_STATS_HAVE_JOB;
+    }
 
-    if (qemuDomainObjBeginAgentJob(driver, vm, QEMU_AGENT_JOB_MODIFY) < 0)
-        goto cleanup;
+    if (HAVE_JOB(privflags)) {
+        int rv;
 
-    if (virDomainObjCheckActive(vm) < 0)
-        goto endjob;
+        /* stats only query the monitor, so they don't need to wait for
+         * other synchronous jobs */
+        if (flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT)
+            rv = qemuDomainObjBeginQueryJobNowait(vm);
+        else
+            rv = qemuDomainObjBeginQueryJob(vm);
 
-    ret = qemuDomainSnapshotFSThaw(vm, true);
+        if (rv == 0)
+            domflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
+    }
+    /* else: without a job it's still possible to gather some data */
 
- endjob:
-    qemuDomainObjEndAgentJob(vm);
+    ret = qemuDomainGetStats(conn, vm, stats, host, record, domflags);
 
- cleanup:
-    virDomainObjEndAPI(&vm);
+    if (HAVE_JOB(domflags))
+        qemuDomainObjEndQueryJob(vm);
+
+    virObjectUnlock(vm);
     return ret;
 }
 
 
-static int
-qemuNodeGetFreePages(virConnectPtr conn,
-                     unsigned int npages,
-                     unsigned int *pages,
-                     int startCell,
-                     unsigned int cellCount,
-                     unsigned long long *counts,
-                     unsigned int flags)
+static void
+qemuDomainStatsCacheRefreshRun(void *data,
+                               void *opaque)
 {
-    virCheckFlags(0, -1);
-
-    if (virNodeGetFreePagesEnsureACL(conn) < 0)
-        return -1;
-
-    return virHostMemGetFreePages(npages, pages, startCell, cellCount, counts);
-}
+    virDomainObjPtr vm = data;
+    virQEMUDriverPtr driver = opaque;
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    g_autoptr(virTypedParamList) params = g_new0(virTypedParamList, 1);
+    unsigned int stats = 0;
+    unsigned int domflags = 0;
 
+    virObjectLock(vm);
 
-static char *
-qemuConnectGetDomainCapabilities(virConnectPtr conn,
-                                 const char *emulatorbin,
-                                 const char *arch_str,
-                                 const char *machine,
-                                 const char *virttype_str,
-                                 unsigned int flags)
-{
-    virQEMUDriverPtr driver = conn->privateData;
-    g_autoptr(virQEMUCaps) qemuCaps = NULL;
-    virArch arch;
-    virDomainVirtType virttype;
-    g_autoptr(virDomainCaps) domCaps = NULL;
+    if (!virDomainObjIsActive(vm))
+        goto cleanup;
 
-    virCheckFlags(0, NULL);
+    ignore_value(qemuDomainGetStatsCheckSupport(&stats, false));
 
-    if (virConnectGetDomainCapabilitiesEnsureACL(conn) < 0)
-        return NULL;
+    /* don't hold up the refresh of other domains behind a busy one, its
+     * monitor based stats will be refreshed the next time */
+    if (qemuDomainObjBeginQueryJobNowait(vm) == 0)
+        domflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
 
-    qemuCaps = virQEMUCapsCacheLookupDefault(driver->qemuCapsCache,
-                                             emulatorbin,
-                                             arch_str,
-                                             virttype_str,
-                                             machine,
-                                             &arch, &virttype, &machine);
-    if (!qemuCaps)
-        return NULL;
+    if (qemuDomainGetStatsParams(driver, vm, stats, params, domflags, NULL) < 0) {
+        VIR_WARN("Unable to refresh cached stats of domain %s: %s",
+                 vm->def->name, virGetLastErrorMessage());
+        virResetLastError();
+    }
 
-    if (!(domCaps = virQEMUDriverGetDomainCapabilities(driver,
-                                                       qemuCaps, machine,
-                                                       arch, virttype)))
-        return NULL;
+    if (HAVE_JOB(domflags))
+        qemuDomainObjEndQueryJob(vm);
 
-    return virDomainCapsFormat(domCaps);
+ cleanup:
+    priv->statsCacheRefreshing = false;
+    virDomainObjEndAPI(&vm);
 }
 
 
 static int
-qemuDomainGetStatsState(virQEMUDriverPtr driver G_GNUC_UNUSED,
-                        virDomainObjPtr dom,
-                        virTypedParamListPtr params,
-                        unsigned int privflags G_GNUC_UNUSED)
+qemuDomainStatsCacheScheduleOne(virDomainObjPtr vm,
+                                void *opaque)
 {
-    if (virTypedParamListAddInt(params, dom->state.state, "state.state") < 0)
-        return -1;
+    virQEMUDriverPtr driver = opaque;
+    qemuDomainObjPrivatePtr priv;
+    int ret = 0;
 
-    if (virTypedParamListAddInt(params, dom->state.reason, "state.reason") < 0)
-        return -1;
+    virObjectLock(vm);
+    priv = vm->privateData;
 
-    return 0;
-}
+    if (virDomainObjIsActive(vm) && !priv->statsCacheRefreshing) {
+        virObjectRef(vm);
+        if (virThreadPoolSendJob(driver->statsCachePool, 0, vm) < 0) {
+            virObjectUnref(vm);
+            ret = -1;
+        } else {
+            priv->statsCacheRefreshing = true;
+        }
+    }
 
+    virObjectUnlock(vm);
+    return ret;
+}
 
-typedef enum {
-    QEMU_DOMAIN_STATS_HAVE_JOB = 1 << 0, /* job is entered, monitor can be
-                                            accessed */
-    QEMU_DOMAIN_STATS_BACKING  = 1 << 1, /* include backing chain in
-                                            block stats */
-} qemuDomainStatsFlags;
 
+static void
+qemuDomainStatsCacheTimer(int timer G_GNUC_UNUSED,
+                          void *opaque)
+{
+    virQEMUDriverPtr driver = opaque;
 
-#define HAVE_JOB(flags) ((flags) & QEMU_DOMAIN_STATS_HAVE_JOB)
+    if (virDomainObjListForEach(driver->domains, false,
+                                qemuDomainStatsCacheScheduleOne,
+                                driver) < 0)
+        VIR_WARN("Unable to schedule refresh of cached domain stats");
+}
 
 
-typedef struct _virQEMUResctrlMonData virQEMUResctrlMonData;
-typedef virQEMUResctrlMonData *virQEMUResctrlMonDataPtr;
-struct _virQEMUResctrlMonData {
-    char *name;
-    char *vcpus;
-    virResctrlMonitorStatsPtr *stats;
-    size_t nstats;
+typedef struct _qemuDomainNumaRebalanceCandidate qemuDomainNumaRebalanceCandidate;
+struct _qemuDomainNumaRebalanceCandidate {
+    virDomainObjPtr vm;
+    unsigned long long memory; /* in KiB */
 };
 
-
-static void
-qemuDomainFreeResctrlMonData(virQEMUResctrlMonDataPtr resdata)
-{
-    size_t i = 0;
-
-    VIR_FREE(resdata->name);
-    VIR_FREE(resdata->vcpus);
-    for (i = 0; i < resdata->nstats; i++)
-        virResctrlMonitorStatsFree(resdata->stats[i]);
-    VIR_FREE(resdata->stats);
-    VIR_FREE(resdata);
-}
+typedef struct _qemuDomainNumaRebalanceData qemuDomainNumaRebalanceData;
+struct _qemuDomainNumaRebalanceData {
+    int source;                     /* most loaded node */
+    int target;                     /* least loaded node */
+    unsigned long long targetFree;  /* free memory of @target in KiB */
+    qemuDomainNumaRebalanceCandidate *candidates;
+    size_t ncandidates;
+};
 
 
-/**
- * qemuDomainGetResctrlMonData:
- * @dom: Pointer for the domain that the resctrl monitors reside in
- * @driver: Pointer to qemu driver
- * @resdata: Pointer of virQEMUResctrlMonDataPtr pointer for receiving the
- *            virQEMUResctrlMonDataPtr array. Caller is responsible for
- *            freeing the array.
- * @nresdata: Pointer of size_t to report the size virQEMUResctrlMonDataPtr
- *            array to caller. If *@nresdata is not 0, even if function
- *            returns an error, the caller is also required to call
- *            qemuDomainFreeResctrlMonData to free each element in the
- *            *@resdata array and then the array itself.
- * @tag: Could be VIR_RESCTRL_MONITOR_TYPE_CACHE for getting cache statistics
- *       from @dom cache monitors. VIR_RESCTRL_MONITOR_TYPE_MEMBW for
- *       getting memory bandwidth statistics from memory bandwidth monitors.
- *
- * Get cache or memory bandwidth statistics from @dom monitors.
- *
- * Returns -1 on failure, or 0 on success.
- */
 static int
-qemuDomainGetResctrlMonData(virQEMUDriverPtr driver,
-                            virDomainObjPtr dom,
-                            virQEMUResctrlMonDataPtr **resdata,
-                            size_t *nresdata,
-                            virResctrlMonitorType tag)
+qemuDomainNumaRebalanceCollect(virDomainObjPtr vm,
+                               void *opaque)
 {
-    virDomainResctrlDefPtr resctrl = NULL;
-    virQEMUResctrlMonDataPtr res = NULL;
-    char **features = NULL;
-    g_autoptr(virCaps) caps = NULL;
-    size_t i = 0;
-    size_t j = 0;
-
-    if (!(caps = virQEMUDriverGetCapabilities(driver, false)))
-        return -1;
+    qemuDomainNumaRebalanceData *data = opaque;
+    qemuDomainObjPrivatePtr priv;
+    qemuDomainNumaRebalanceCandidate candidate = { 0 };
+    int ret = 0;
 
-    switch (tag) {
-    case VIR_RESCTRL_MONITOR_TYPE_CACHE:
-        if (caps->host.cache.monitor)
-            features = caps->host.cache.monitor->features;
-        break;
-    case VIR_RESCTRL_MONITOR_TYPE_MEMBW:
-        if (caps->host.memBW.monitor)
-            features = caps->host.memBW.monitor->features;
-        break;
-    case VIR_RESCTRL_MONITOR_TYPE_UNSUPPORT:
-    case VIR_RESCTRL_MONITOR_TYPE_LAST:
-        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED, "%s",
-                       _("Unsupported resctrl monitor type"));
-        return -1;
-    }
+    virObjectLock(vm);
+    priv = vm->privateData;
 
-    if (virStringListLength((const char * const *)features) == 0)
-        return 0;
+    if (!virDomainObjIsActive(vm) ||
+        !virDomainDefNeedsPlacementAdvice(vm->def) ||
+        !priv->autoNodeset ||
+        !virBitmapIsBitSet(priv->autoNodeset, data->source) ||
+        virBitmapIsBitSet(priv->autoNodeset, data->target))
+        goto cleanup;
 
-    for (i = 0; i < dom->def->nresctrls; i++) {
-        resctrl = dom->def->resctrls[i];
+    /* don't move a domain which wouldn't fit */
+    candidate.memory = virDomainDefGetMemoryTotal(vm->def);
+    if (candidate.memory >= data->targetFree)
+        goto cleanup;
 
-        for (j = 0; j < resctrl->nmonitors; j++) {
-            virDomainResctrlMonDefPtr domresmon = NULL;
-            virResctrlMonitorPtr monitor = NULL;
+    candidate.vm = virObjectRef(vm);
+    if (VIR_APPEND_ELEMENT(data->candidates, data->ncandidates, candidate) < 0) {
+        virObjectUnref(vm);
+        ret = -1;
+    }
 
-            domresmon = resctrl->monitors[j];
-            monitor = domresmon->instance;
+ cleanup:
+    virObjectUnlock(vm);
+    return ret;
+}
 
-            if (domresmon->tag != tag)
-                continue;
 
-            if (VIR_ALLOC(res) < 0)
-                return -1;
+static int
+qemuDomainNumaRebalanceCandidateCompare(const void *a,
+                                        const void *b)
+{
+    const qemuDomainNumaRebalanceCandidate *ca = a;
+    const qemuDomainNumaRebalanceCandidate *cb = b;
 
-            /* If virBitmapFormat successfully returns an vcpu string, then
-             * res.vcpus is assigned with an memory space holding it,
-             * let this newly allocated memory buffer to be freed along with
-             * the free of 'res' */
-            if (!(res->vcpus = virBitmapFormat(domresmon->vcpus)))
-                goto error;
+    if (ca->memory < cb->memory)
+        return -1;
+    if (ca->memory > cb->memory)
+        return 1;
+    return 0;
+}
 
-            res->name = g_strdup(virResctrlMonitorGetID(monitor));
 
-            if (virResctrlMonitorGetStats(monitor, (const char **)features,
-                                          &res->stats, &res->nstats) < 0)
-                goto error;
+static int
+qemuDomainNumaRebalanceSetAffinity(virDomainObjPtr vm,
+                                   virCgroupThreadName nameval,
+                                   int id,
+                                   pid_t pid,
+                                   virBitmapPtr cpumap)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virCgroupPtr cgroup = NULL;
+    int ret = -1;
 
-            if (VIR_APPEND_ELEMENT(*resdata, *nresdata, res) < 0)
-                goto error;
-        }
+    if (virCgroupHasController(priv->cgroup, VIR_CGROUP_CONTROLLER_CPUSET)) {
+        if (virCgroupNewThread(priv->cgroup, nameval, id, false, &cgroup) < 0 ||
+            qemuSetupCgroupCpusetCpus(cgroup, cpumap) < 0)
+            goto cleanup;
     }
 
-    return 0;
+    if (virProcessSetAffinity(pid, cpumap) < 0)
+        goto cleanup;
 
- error:
-    qemuDomainFreeResctrlMonData(res);
-    return -1;
+    ret = 0;
+
+ cleanup:
+    virCgroupFree(&cgroup);
+    return ret;
 }
 
 
+/**
+ * qemuDomainNumaRebalanceMove:
+ *
+ * Moves the threads and memory of @vm which follow the automatic
+ * placement from host NUMA node @source to @target. Threads with an
+ * explicit pinning are left alone. The caller must hold a job.
+ */
 static int
-qemuDomainGetStatsMemoryBandwidth(virQEMUDriverPtr driver,
-                                  virDomainObjPtr dom,
-                                  virTypedParamListPtr params)
+qemuDomainNumaRebalanceMove(virQEMUDriverPtr driver,
+                            virDomainObjPtr vm,
+                            virCapsHostNUMAPtr caps,
+                            int source,
+                            int target)
 {
-    virQEMUResctrlMonDataPtr *resdata = NULL;
-    char **features = NULL;
-    size_t nresdata = 0;
-    size_t i = 0;
-    size_t j = 0;
-    size_t k = 0;
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virDomainDefPtr def = vm->def;
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    g_autoptr(virBitmap) nodeset = NULL;
+    g_autoptr(virBitmap) cpuset = NULL;
+    g_autofree char *nodesetStr = NULL;
+    g_autofree char *cpusetStr = NULL;
+    virTypedParameterPtr eventParams = NULL;
+    int eventNparams = 0;
+    int eventMaxparams = 0;
+    char paramField[VIR_TYPED_PARAM_FIELD_LENGTH] = "";
+    virDomainNumatuneMemMode mode;
+    size_t i;
     int ret = -1;
 
-    if (!virDomainObjIsActive(dom))
-        return 0;
+    if (!(nodeset = virBitmapNewCopy(priv->autoNodeset)))
+        goto cleanup;
 
-    if (qemuDomainGetResctrlMonData(driver, dom, &resdata, &nresdata,
-                                    VIR_RESCTRL_MONITOR_TYPE_MEMBW) < 0)
+    ignore_value(virBitmapClearBit(nodeset, source));
+    if (virBitmapSetBitExpand(nodeset, target) < 0)
         goto cleanup;
 
-    if (nresdata == 0)
-        return 0;
+    if (!(cpuset = virCapabilitiesHostNUMAGetCpus(caps, nodeset)))
+        goto cleanup;
 
-    if (virTypedParamListAddUInt(params, nresdata,
-                                 "memory.bandwidth.monitor.count") < 0)
+    if (!(nodesetStr = virBitmapFormat(nodeset)) ||
+        !(cpusetStr = virBitmapFormat(cpuset)))
         goto cleanup;
 
-    for (i = 0; i < nresdata; i++) {
-        if (virTypedParamListAddString(params, resdata[i]->name,
-                                       "memory.bandwidth.monitor.%zu.name",
-                                       i) < 0)
-            goto cleanup;
+    VIR_DEBUG("Moving domain %s from NUMA node %d to %d, nodeset=%s cpuset=%s",
+              def->name, source, target, nodesetStr, cpusetStr);
 
-        if (virTypedParamListAddString(params, resdata[i]->vcpus,
-                                       "memory.bandwidth.monitor.%zu.vcpus",
-                                       i) < 0)
+    if (virDomainNumatuneHasPlacementAuto(def->numa) &&
+        virDomainNumatuneGetMode(def->numa, -1, &mode) == 0 &&
+        mode == VIR_DOMAIN_NUMATUNE_MEM_STRICT) {
+        if (qemuDomainSetNumaParamsLive(vm, nodeset) < 0)
             goto cleanup;
 
-        if (virTypedParamListAddUInt(params, resdata[i]->nstats,
-                                     "memory.bandwidth.monitor.%zu.node.count",
-                                     i) < 0)
+        if (virTypedParamsAddString(&eventParams, &eventNparams,
+                                    &eventMaxparams,
+                                    VIR_DOMAIN_TUNABLE_NUMA_MEMORY_NODESET,
+                                    nodesetStr) < 0)
             goto cleanup;
+    }
 
+    if (def->placement_mode == VIR_DOMAIN_CPU_PLACEMENT_MODE_AUTO) {
+        if (qemuDomainHasVcpuPids(vm)) {
+            for (i = 0; i < virDomainDefGetVcpusMax(def); i++) {
+                virDomainVcpuDefPtr vcpu = virDomainDefGetVcpu(def, i);
 
-        for (j = 0; j < resdata[i]->nstats; j++) {
-            if (virTypedParamListAddUInt(params, resdata[i]->stats[j]->id,
-                                         "memory.bandwidth.monitor.%zu."
-                                         "node.%zu.id",
-                                         i, j) < 0)
+                if (!vcpu->online || vcpu->cpumask)
+                    continue;
+
+                if (qemuDomainNumaRebalanceSetAffinity(vm, VIR_CGROUP_THREAD_VCPU, i,
+                                                       qemuDomainGetVcpuPid(vm, i),
+                                                       cpuset) < 0)
+                    goto cleanup;
+
+                g_snprintf(paramField, sizeof(paramField),
+                           VIR_DOMAIN_TUNABLE_CPU_VCPUPIN, (unsigned int) i);
+                if (virTypedParamsAddString(&eventParams, &eventNparams,
+                                            &eventMaxparams, paramField,
+                                            cpusetStr) < 0)
+                    goto cleanup;
+            }
+        }
+
+        if (!def->cputune.emulatorpin) {
+            if (qemuDomainNumaRebalanceSetAffinity(vm, VIR_CGROUP_THREAD_EMULATOR, 0,
+                                                   vm->pid, cpuset) < 0)
                 goto cleanup;
 
+            if (virTypedParamsAddString(&eventParams, &eventNparams,
+                                        &eventMaxparams,
+                                        VIR_DOMAIN_TUNABLE_CPU_EMULATORPIN,
+                                        cpusetStr) < 0)
+                goto cleanup;
+        }
 
-            features = resdata[i]->stats[j]->features;
-            for (k = 0; features[k]; k++) {
-                if (STREQ(features[k], "mbm_local_bytes")) {
-                    /* The accumulative data passing through local memory
-                     * controller is recorded with 64 bit counter. */
-                    if (virTypedParamListAddULLong(params,
-                                                   resdata[i]->stats[j]->vals[k],
-                                                   "memory.bandwidth.monitor."
-                                                   "%zu.node.%zu.bytes.local",
-                                                   i, j) < 0)
-                        goto cleanup;
-                }
+        for (i = 0; i < def->niothreadids; i++) {
+            virDomainIOThreadIDDefPtr iothread = def->iothreadids[i];
 
-                if (STREQ(features[k], "mbm_total_bytes")) {
-                    /* The accumulative data passing through local and remote
-                     * memory controller is recorded with 64 bit counter. */
-                    if (virTypedParamListAddULLong(params,
-                                                   resdata[i]->stats[j]->vals[k],
-                                                   "memory.bandwidth.monitor."
-                                                   "%zu.node.%zu.bytes.total",
-                                                   i, j) < 0)
-                        goto cleanup;
-                }
-            }
+            if (iothread->cpumask || iothread->thread_id == 0)
+                continue;
+
+            if (qemuDomainNumaRebalanceSetAffinity(vm, VIR_CGROUP_THREAD_IOTHREAD,
+                                                   iothread->iothread_id,
+                                                   iothread->thread_id,
+                                                   cpuset) < 0)
+                goto cleanup;
+
+            g_snprintf(paramField, sizeof(paramField),
+                       VIR_DOMAIN_TUNABLE_CPU_IOTHREADSPIN,
+                       iothread->iothread_id);
+            if (virTypedParamsAddString(&eventParams, &eventNparams,
+                                        &eventMaxparams, paramField,
+                                        cpusetStr) < 0)
+                goto cleanup;
         }
     }
 
+    virBitmapFree(priv->autoNodeset);
+    priv->autoNodeset = g_steal_pointer(&nodeset);
+    virBitmapFree(priv->autoCpuset);
+    priv->autoCpuset = g_steal_pointer(&cpuset);
+
+    if (virDomainObjSave(vm, driver->xmlopt, cfg->stateDir) < 0)
+        VIR_WARN("Unable to save status of domain %s", def->name);
+
+    if (eventNparams > 0) {
+        virObjectEventPtr event;
+
+        event = virDomainEventTunableNewFromObj(vm, eventParams, eventNparams);
+        eventParams = NULL;
+        virObjectEventStateQueue(driver->domainEventState, event);
+    }
+
     ret = 0;
+
  cleanup:
-    for (i = 0; i < nresdata; i++)
-        qemuDomainFreeResctrlMonData(resdata[i]);
-    VIR_FREE(resdata);
+    virTypedParamsFree(eventParams, eventNparams);
     return ret;
 }
 
 
-static int
-qemuDomainGetStatsCpuCache(virQEMUDriverPtr driver,
-                           virDomainObjPtr dom,
-                           virTypedParamListPtr params)
+static void
+qemuDomainNumaRebalanceRun(void *data G_GNUC_UNUSED,
+                           void *opaque)
 {
-    virQEMUResctrlMonDataPtr *resdata = NULL;
-    size_t nresdata = 0;
-    size_t i = 0;
-    size_t j = 0;
-    int ret = -1;
+    virQEMUDriverPtr driver = opaque;
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    g_autoptr(virCapsHostNUMA) caps = NULL;
+    g_autoptr(virBitmap) nodes = NULL;
+    qemuDomainNumaRebalanceData rebalance = { .source = -1, .target = -1 };
+    unsigned long long sourceShare = 0;
+    unsigned long long targetShare = 0;
+    size_t moved = 0;
+    size_t i;
+    ssize_t node = -1;
 
-    if (!virDomainObjIsActive(dom))
-        return 0;
+    if (!(nodes = virNumaGetHostMemoryNodeset()))
+        goto cleanup;
 
-    if (qemuDomainGetResctrlMonData(driver, dom, &resdata, &nresdata,
-                                    VIR_RESCTRL_MONITOR_TYPE_CACHE) < 0)
+    /* Find the nodes with the lowest and highest share of free memory */
+    while ((node = virBitmapNextSetBit(nodes, node)) >= 0) {
+        unsigned long long memsize;
+        unsigned long long memfree;
+        unsigned long long share;
+
+        if (virNumaGetNodeMemory(node, &memsize, &memfree) < 0 || memsize == 0)
+            continue;
+
+        share = memfree * 100 / memsize;
+
+        if (rebalance.source < 0 || share < sourceShare) {
+            rebalance.source = node;
+            sourceShare = share;
+        }
+
+        if (rebalance.target < 0 || share > targetShare) {
+            rebalance.target = node;
+            targetShare = share;
+            rebalance.targetFree = memfree / 1024;
+        }
+    }
+
+    if (rebalance.source < 0 || rebalance.source == rebalance.target ||
+        targetShare - sourceShare <= cfg->numaRebalanceThreshold)
         goto cleanup;
 
-    if (virTypedParamListAddUInt(params, nresdata, "cpu.cache.monitor.count") < 0)
+    VIR_DEBUG("NUMA node %d has %llu%% free memory, node %d %llu%%",
+              rebalance.source, sourceShare, rebalance.target, targetShare);
+
+    if (!(caps = virQEMUDriverGetHostNUMACaps(driver)))
         goto cleanup;
 
-    for (i = 0; i < nresdata; i++) {
-        if (virTypedParamListAddString(params, resdata[i]->name,
-                                       "cpu.cache.monitor.%zu.name", i) < 0)
-            goto cleanup;
+    if (virDomainObjListForEach(driver->domains, false,
+                                qemuDomainNumaRebalanceCollect,
+                                &rebalance) < 0)
+        goto cleanup;
 
-        if (virTypedParamListAddString(params, resdata[i]->vcpus,
-                                       "cpu.cache.monitor.%zu.vcpus", i) < 0)
-            goto cleanup;
+    /* smaller domains are cheaper to move */
+    qsort(rebalance.candidates, rebalance.ncandidates,
+          sizeof(*rebalance.candidates),
+          qemuDomainNumaRebalanceCandidateCompare);
 
-        if (virTypedParamListAddUInt(params, resdata[i]->nstats,
-                                     "cpu.cache.monitor.%zu.bank.count", i) < 0)
-            goto cleanup;
+    for (i = 0; i < rebalance.ncandidates; i++) {
+        virDomainObjPtr vm = rebalance.candidates[i].vm;
+        qemuDomainObjPrivatePtr priv = vm->privateData;
+        unsigned long long memory = rebalance.candidates[i].memory;
 
-        for (j = 0; j < resdata[i]->nstats; j++) {
-            if (virTypedParamListAddUInt(params, resdata[i]->stats[j]->id,
-                                         "cpu.cache.monitor.%zu.bank.%zu.id", i, j) < 0)
-                goto cleanup;
+        if (moved >= cfg->numaRebalanceMaxMoves)
+            break;
 
-            /* 'resdata[i]->stats[j]->vals[0]' keeps the value of how many last
-             * level cache in bank j currently occupied by the vcpus listed in
-             * resource monitor i, in bytes. This value is reported through a
-             * 64 bit hardware counter, so it is better to be arranged with
-             * data type in 64 bit width, but considering the fact that
-             * physical cache on a CPU could never be designed to be bigger
-             * than 4G bytes in size, to keep the 'domstats' interface
-             * historically consistent, it is safe to report the value with a
-             * truncated 'UInt' data type here. */
-            if (virTypedParamListAddUInt(params,
-                                         (unsigned int)resdata[i]->stats[j]->vals[0],
-                                         "cpu.cache.monitor.%zu.bank.%zu.bytes",
-                                         i, j) < 0)
-                goto cleanup;
+        if (memory >= rebalance.targetFree)
+            continue;
+
+        virObjectLock(vm);
+
+        /* a busy domain will be considered in the next pass */
+        if (qemuDomainObjBeginJobNowait(driver, vm, QEMU_JOB_MODIFY) < 0) {
+            virResetLastError();
+            virObjectUnlock(vm);
+            continue;
+        }
+
+        if (virDomainObjIsActive(vm) && priv->autoNodeset &&
+            virBitmapIsBitSet(priv->autoNodeset, rebalance.source)) {
+            if (qemuDomainNumaRebalanceMove(driver, vm, caps,
+                                            rebalance.source,
+                                            rebalance.target) < 0) {
+                VIR_WARN("Unable to move domain %s to NUMA node %d: %s",
+                         vm->def->name, rebalance.target,
+                         virGetLastErrorMessage());
+                virResetLastError();
+            } else {
+                rebalance.targetFree -= memory;
+                moved++;
+            }
         }
+
+        qemuDomainObjEndJob(driver, vm);
+        virObjectUnlock(vm);
+    }
+
+ cleanup:
+    for (i = 0; i < rebalance.ncandidates; i++)
+        virObjectUnref(rebalance.candidates[i].vm);
+    VIR_FREE(rebalance.candidates);
+    virResetLastError();
+    g_atomic_int_set(&driver->numaRebalancePending, 0);
+}
+
+
+static void
+qemuDomainNumaRebalanceTimer(int timer G_GNUC_UNUSED,
+                             void *opaque)
+{
+    virQEMUDriverPtr driver = opaque;
+
+    /* the previous pass is still running */
+    if (!g_atomic_int_compare_and_exchange(&driver->numaRebalancePending, 0, 1))
+        return;
+
+    if (virThreadPoolSendJob(driver->numaRebalancePool, 0, driver) < 0) {
+        VIR_WARN("Unable to schedule NUMA rebalancing");
+        g_atomic_int_set(&driver->numaRebalancePending, 0);
+    }
+}
+
+
+typedef struct _qemuDomainResctrlFeedbackData qemuDomainResctrlFeedbackData;
+struct _qemuDomainResctrlFeedbackData {
+    virDomainObjPtr *vms;
+    size_t nvms;
+};
+
+
+static int
+qemuDomainResctrlFeedbackCollect(virDomainObjPtr vm,
+                                 void *opaque)
+{
+    qemuDomainResctrlFeedbackData *data = opaque;
+    virDomainObjPtr ref;
+    size_t i;
+    int ret = 0;
+
+    virObjectLock(vm);
+
+    if (!virDomainObjIsActive(vm))
+        goto cleanup;
+
+    for (i = 0; i < vm->def->nresctrls; i++) {
+        if (vm->def->resctrls[i]->ntargets > 0)
+            break;
+    }
+
+    if (i == vm->def->nresctrls)
+        goto cleanup;
+
+    ref = virObjectRef(vm);
+    if (VIR_APPEND_ELEMENT(data->vms, data->nvms, ref) < 0) {
+        virObjectUnref(vm);
+        ret = -1;
     }
 
-    ret = 0;
  cleanup:
-    for (i = 0; i < nresdata; i++)
-        qemuDomainFreeResctrlMonData(resdata[i]);
-    VIR_FREE(resdata);
+    virObjectUnlock(vm);
     return ret;
 }
 
 
+/**
+ * qemuDomainResctrlFeedbackAdjust:
+ * @info: host resctrl information
+ * @resctrl: memory bandwidth allocation with targets
+ * @now: current time in ms
+ *
+ * Steers the limits of @resctrl towards their targets based on the total
+ * traffic its monitor counted since the previous pass. The traffic is
+ * assumed to scale linearly with the limit, which holds for bandwidth bound
+ * workloads; for the others the limit simply drifts towards the top of the
+ * allowed range, where it no longer matters.
+ *
+ * Returns 0 on success, -1 on error.
+ */
 static int
-qemuDomainGetStatsCpuCgroup(virDomainObjPtr dom,
-                            virTypedParamListPtr params)
+qemuDomainResctrlFeedbackAdjust(virResctrlInfoPtr info,
+                                virDomainResctrlDefPtr resctrl,
+                                unsigned long long now)
 {
-    qemuDomainObjPrivatePtr priv = dom->privateData;
-    unsigned long long cpu_time = 0;
-    unsigned long long user_time = 0;
-    unsigned long long sys_time = 0;
-    int err = 0;
+    const char *features[] = { "mbm_total_bytes", NULL };
+    virResctrlMonitorPtr monitor = NULL;
+    virResctrlMonitorStatsPtr *stats = NULL;
+    size_t nstats = 0;
+    size_t i;
+    size_t j;
+    int ret = -1;
 
-    if (!priv->cgroup)
+    for (i = 0; i < resctrl->nmonitors; i++) {
+        if (resctrl->monitors[i]->tag == VIR_RESCTRL_MONITOR_TYPE_MEMBW &&
+            virBitmapEqual(resctrl->monitors[i]->vcpus, resctrl->vcpus)) {
+            monitor = resctrl->monitors[i]->instance;
+            break;
+        }
+    }
+
+    if (!monitor)
         return 0;
 
-    err = virCgroupGetCpuacctUsage(priv->cgroup, &cpu_time);
-    if (!err && virTypedParamListAddULLong(params, cpu_time, "cpu.time") < 0)
+    if (virResctrlMonitorGetStats(monitor, features, &stats, &nstats) < 0)
         return -1;
 
-    err = virCgroupGetCpuacctStat(priv->cgroup, &user_time, &sys_time);
-    if (!err && virTypedParamListAddULLong(params, user_time, "cpu.user") < 0)
-        return -1;
-    if (!err && virTypedParamListAddULLong(params, sys_time, "cpu.system") < 0)
-        return -1;
+    for (i = 0; i < resctrl->ntargets; i++) {
+        virDomainMemorytuneTargetPtr target = &resctrl->targets[i];
+        unsigned long long prevBytes = target->lastBytes;
+        unsigned long long prevTime = target->lastTime;
+        unsigned long long bytes;
+        unsigned long long rate;
+        unsigned long long next;
+        unsigned int cur;
 
-    return 0;
-}
+        for (j = 0; j < nstats; j++) {
+            if (stats[j]->id == target->id && stats[j]->nvals > 0)
+                break;
+        }
 
+        if (j == nstats)
+            continue;
 
-static int
-qemuDomainGetStatsCpu(virQEMUDriverPtr driver,
-                      virDomainObjPtr dom,
-                      virTypedParamListPtr params,
-                      unsigned int privflags G_GNUC_UNUSED)
-{
-    if (qemuDomainGetStatsCpuCgroup(dom, params) < 0)
-        return -1;
+        bytes = stats[j]->vals[0];
+        target->lastBytes = bytes;
+        target->lastTime = now;
 
-    if (qemuDomainGetStatsCpuCache(driver, dom, params) < 0)
-        return -1;
+        /* first sample or the counter was reset */
+        if (prevTime == 0 || now <= prevTime || bytes < prevBytes)
+            continue;
 
-    return 0;
-}
+        /* MiB/s */
+        rate = (bytes - prevBytes) * 1000 / (now - prevTime) / (1024 * 1024);
 
+        /* don't chase the noise within 5% of the target */
+        if (rate * 20 >= target->target * 19 &&
+            rate * 20 <= target->target * 21)
+            continue;
 
-static int
-qemuDomainGetStatsMemory(virQEMUDriverPtr driver,
-                         virDomainObjPtr dom,
-                         virTypedParamListPtr params,
-                         unsigned int privflags G_GNUC_UNUSED)
+        if (virResctrlAllocGetMemoryBandwidth(resctrl->alloc, target->id,
+                                              &cur) < 0)
+            goto cleanup;
 
-{
-    return qemuDomainGetStatsMemoryBandwidth(driver, dom, params);
+        if (rate == 0)
+            next = target->max;
+        else
+            next = cur * target->target / rate;
+
+        next = MAX(next, target->min);
+        next = MIN(next, target->max);
+
+        if (next == cur)
+            continue;
+
+        VIR_DEBUG("Node %u: %llu MiB/s with limit %u%%, target %llu MiB/s, "
+                  "new limit %llu%%",
+                  target->id, rate, cur, target->target, next);
+
+        if (virResctrlAllocUpdateMemoryBandwidth(info, resctrl->alloc,
+                                                 target->id, next) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    for (j = 0; j < nstats; j++)
+        virResctrlMonitorStatsFree(stats[j]);
+    VIR_FREE(stats);
+    return ret;
 }
 
 
-static int
-qemuDomainGetStatsBalloon(virQEMUDriverPtr driver,
-                          virDomainObjPtr dom,
-                          virTypedParamListPtr params,
-                          unsigned int privflags)
+static void
+qemuDomainResctrlFeedbackRun(void *data G_GNUC_UNUSED,
+                             void *opaque)
 {
-    virDomainMemoryStatStruct stats[VIR_DOMAIN_MEMORY_STAT_NR];
-    int nr_stats;
-    unsigned long long cur_balloon = 0;
+    virQEMUDriverPtr driver = opaque;
+    g_autoptr(virCaps) caps = NULL;
+    qemuDomainResctrlFeedbackData feedback = { 0 };
     size_t i;
+    size_t j;
 
-    if (!virDomainDefHasMemballoon(dom->def)) {
-        cur_balloon = virDomainDefGetMemoryTotal(dom->def);
-    } else {
-        cur_balloon = dom->def->mem.cur_balloon;
-    }
+    if (!(caps = virQEMUDriverGetCapabilities(driver, false)) ||
+        !caps->host.resctrl)
+        goto cleanup;
 
-    if (virTypedParamListAddULLong(params, cur_balloon, "balloon.current") < 0)
-        return -1;
+    if (virDomainObjListForEach(driver->domains, false,
+                                qemuDomainResctrlFeedbackCollect,
+                                &feedback) < 0)
+        goto cleanup;
 
-    if (virTypedParamListAddULLong(params, virDomainDefGetMemoryTotal(dom->def),
-                                   "balloon.maximum") < 0)
-        return -1;
+    for (i = 0; i < feedback.nvms; i++) {
+        virDomainObjPtr vm = feedback.vms[i];
+        unsigned long long now;
 
-    if (!HAVE_JOB(privflags) || !virDomainObjIsActive(dom))
-        return 0;
+        virObjectLock(vm);
 
-    nr_stats = qemuDomainMemoryStatsInternal(driver, dom, stats,
-                                             VIR_DOMAIN_MEMORY_STAT_NR);
-    if (nr_stats < 0)
-        return 0;
+        if (virDomainObjIsActive(vm) && virTimeMillisNow(&now) == 0) {
+            for (j = 0; j < vm->def->nresctrls; j++) {
+                virDomainResctrlDefPtr resctrl = vm->def->resctrls[j];
 
-#define STORE_MEM_RECORD(TAG, NAME) \
-    if (stats[i].tag == VIR_DOMAIN_MEMORY_STAT_ ##TAG) \
-        if (virTypedParamListAddULLong(params, stats[i].val, "balloon." NAME) < 0) \
-            return -1;
+                if (resctrl->ntargets == 0)
+                    continue;
 
-    for (i = 0; i < nr_stats; i++) {
-        STORE_MEM_RECORD(SWAP_IN, "swap_in")
-        STORE_MEM_RECORD(SWAP_OUT, "swap_out")
-        STORE_MEM_RECORD(MAJOR_FAULT, "major_fault")
-        STORE_MEM_RECORD(MINOR_FAULT, "minor_fault")
-        STORE_MEM_RECORD(UNUSED, "unused")
-        STORE_MEM_RECORD(AVAILABLE, "available")
-        STORE_MEM_RECORD(RSS, "rss")
-        STORE_MEM_RECORD(LAST_UPDATE, "last-update")
-        STORE_MEM_RECORD(USABLE, "usable")
-        STORE_MEM_RECORD(DISK_CACHES, "disk_caches")
-        STORE_MEM_RECORD(HUGETLB_PGALLOC, "hugetlb_pgalloc")
-        STORE_MEM_RECORD(HUGETLB_PGFAIL, "hugetlb_pgfail")
-    }
+                if (qemuDomainResctrlFeedbackAdjust(caps->host.resctrl,
+                                                    resctrl, now) < 0) {
+                    VIR_WARN("Unable to adjust memory bandwidth of domain %s: %s",
+                             vm->def->name, virGetLastErrorMessage());
+                    virResetLastError();
+                }
+            }
+        }
 
-#undef STORE_MEM_RECORD
+        virObjectUnlock(vm);
+    }
 
-    return 0;
+ cleanup:
+    for (i = 0; i < feedback.nvms; i++)
+        virObjectUnref(feedback.vms[i]);
+    VIR_FREE(feedback.vms);
+    virResetLastError();
+    g_atomic_int_set(&driver->resctrlFeedbackPending, 0);
 }
 
 
-static int
-qemuDomainGetStatsVcpu(virQEMUDriverPtr driver,
-                       virDomainObjPtr dom,
-                       virTypedParamListPtr params,
-                       unsigned int privflags)
+static void
+qemuDomainResctrlFeedbackTimer(int timer G_GNUC_UNUSED,
+                               void *opaque)
 {
-    virDomainVcpuDefPtr vcpu;
-    qemuDomainVcpuPrivatePtr vcpupriv;
-    size_t i;
-    int ret = -1;
-    virVcpuInfoPtr cpuinfo = NULL;
-    g_autofree unsigned long long *cpuwait = NULL;
-
-    if (virTypedParamListAddUInt(params, virDomainDefGetVcpus(dom->def),
-                                 "vcpu.current") < 0)
-        return -1;
-
-    if (virTypedParamListAddUInt(params, virDomainDefGetVcpusMax(dom->def),
-                                 "vcpu.maximum") < 0)
-        return -1;
+    virQEMUDriverPtr driver = opaque;
 
-    if (VIR_ALLOC_N(cpuinfo, virDomainDefGetVcpus(dom->def)) < 0 ||
-        VIR_ALLOC_N(cpuwait, virDomainDefGetVcpus(dom->def)) < 0)
-        goto cleanup;
+    /* the previous pass is still running */
+    if (!g_atomic_int_compare_and_exchange(&driver->resctrlFeedbackPending, 0, 1))
+        return;
 
-    if (HAVE_JOB(privflags) && virDomainObjIsActive(dom) &&
-        qemuDomainRefreshVcpuHalted(driver, dom, QEMU_ASYNC_JOB_NONE) < 0) {
-            /* it's ok to be silent and go ahead, because halted vcpu info
-             * wasn't here from the beginning */
-            virResetLastError();
+    if (virThreadPoolSendJob(driver->resctrlFeedbackPool, 0, driver) < 0) {
+        VIR_WARN("Unable to schedule memory bandwidth feedback");
+        g_atomic_int_set(&driver->resctrlFeedbackPending, 0);
     }
+}
 
-    if (qemuDomainHelperGetVcpus(dom, cpuinfo, cpuwait,
-                                 virDomainDefGetVcpus(dom->def),
-                                 NULL, 0) < 0) {
-        virResetLastError();
-        ret = 0; /* it's ok to be silent and go ahead */
-        goto cleanup;
-    }
 
-    for (i = 0; i < virDomainDefGetVcpus(dom->def); i++) {
-        if (virTypedParamListAddInt(params, cpuinfo[i].state,
-                                    "vcpu.%u.state", cpuinfo[i].number) < 0)
-            goto cleanup;
+typedef struct _qemuDomainBlockJobAutotuneData qemuDomainBlockJobAutotuneData;
+struct _qemuDomainBlockJobAutotuneData {
+    virDomainObjPtr *vms;
+    size_t nvms;
+};
 
-        /* stats below are available only if the VM is alive */
-        if (!virDomainObjIsActive(dom))
-            continue;
 
-        if (virTypedParamListAddULLong(params, cpuinfo[i].cpuTime,
-                                       "vcpu.%u.time", cpuinfo[i].number) < 0)
-            goto cleanup;
+static int
+qemuDomainBlockJobAutotuneCollect(virDomainObjPtr vm,
+                                  void *opaque)
+{
+    qemuDomainBlockJobAutotuneData *data = opaque;
+    virDomainObjPtr ref;
+    size_t i;
+    int ret = 0;
 
-        if (virTypedParamListAddULLong(params, cpuwait[i],
-                                       "vcpu.%u.wait", cpuinfo[i].number) < 0)
-            goto cleanup;
+    virObjectLock(vm);
 
-        /* state below is extracted from the individual vcpu structs */
-        if (!(vcpu = virDomainDefGetVcpu(dom->def, cpuinfo[i].number)))
-            continue;
+    if (!virDomainObjIsActive(vm))
+        goto cleanup;
 
-        vcpupriv = QEMU_DOMAIN_VCPU_PRIVATE(vcpu);
+    for (i = 0; i < vm->def->ndisks; i++) {
+        qemuBlockJobDataPtr job = QEMU_DOMAIN_DISK_PRIVATE(vm->def->disks[i])->blockjob;
 
-        if (vcpupriv->halted != VIR_TRISTATE_BOOL_ABSENT) {
-            if (virTypedParamListAddBoolean(params,
-                                            vcpupriv->halted == VIR_TRISTATE_BOOL_YES,
-                                            "vcpu.%u.halted",
-                                            cpuinfo[i].number) < 0)
-                goto cleanup;
-        }
+        if (job && job->autotune.enabled)
+            break;
     }
 
-    ret = 0;
+    if (i == vm->def->ndisks)
+        goto cleanup;
+
+    ref = virObjectRef(vm);
+    if (VIR_APPEND_ELEMENT(data->vms, data->nvms, ref) < 0) {
+        virObjectUnref(vm);
+        ret = -1;
+    }
 
  cleanup:
-    VIR_FREE(cpuinfo);
+    virObjectUnlock(vm);
     return ret;
 }
 
-#define QEMU_ADD_NET_PARAM(params, num, name, value) \
-    if (value >= 0 && \
-        virTypedParamListAddULLong((params), (value), "net.%zu.%s", (num), (name)) < 0) \
-        return -1;
 
-static int
-qemuDomainGetStatsInterface(virQEMUDriverPtr driver G_GNUC_UNUSED,
-                            virDomainObjPtr dom,
-                            virTypedParamListPtr params,
-                            unsigned int privflags G_GNUC_UNUSED)
+static void
+qemuDomainBlockJobAutotuneRun(void *data G_GNUC_UNUSED,
+                              void *opaque)
 {
+    virQEMUDriverPtr driver = opaque;
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    qemuDomainBlockJobAutotuneData autotune = { 0 };
     size_t i;
-    struct _virDomainInterfaceStats tmp;
 
-    if (!virDomainObjIsActive(dom))
-        return 0;
+    if (virDomainObjListForEach(driver->domains, false,
+                                qemuDomainBlockJobAutotuneCollect,
+                                &autotune) < 0)
+        goto cleanup;
 
-    if (virTypedParamListAddUInt(params, dom->def->nnets, "net.count") < 0)
-        return -1;
+    for (i = 0; i < autotune.nvms; i++) {
+        virDomainObjPtr vm = autotune.vms[i];
 
-    /* Check the path is one of the domain's network interfaces. */
-    for (i = 0; i < dom->def->nnets; i++) {
-        virDomainNetDefPtr net = dom->def->nets[i];
-        virDomainNetType actualType;
+        virObjectLock(vm);
 
-        if (!net->ifname)
+        /* a busy domain is adjusted the next time */
+        if (qemuDomainObjBeginJobNowait(driver, vm, QEMU_JOB_MODIFY) < 0) {
+            virResetLastError();
+            virObjectUnlock(vm);
             continue;
-
-        memset(&tmp, 0, sizeof(tmp));
-
-        actualType = virDomainNetGetActualType(net);
-
-        if (virTypedParamListAddString(params, net->ifname, "net.%zu.name", i) < 0)
-            return -1;
-
-        if (actualType == VIR_DOMAIN_NET_TYPE_VHOSTUSER) {
-            if (virNetDevOpenvswitchInterfaceStats(net->ifname, &tmp) < 0) {
-                virResetLastError();
-                continue;
-            }
-        } else {
-            if (virNetDevTapInterfaceStats(net->ifname, &tmp,
-                                           !virDomainNetTypeSharesHostView(net)) < 0) {
-                virResetLastError();
-                continue;
-            }
         }
 
-        QEMU_ADD_NET_PARAM(params, i,
-                           "rx.bytes", tmp.rx_bytes);
-        QEMU_ADD_NET_PARAM(params, i,
-                           "rx.pkts", tmp.rx_packets);
-        QEMU_ADD_NET_PARAM(params, i,
-                           "rx.errs", tmp.rx_errs);
-        QEMU_ADD_NET_PARAM(params, i,
-                           "rx.drop", tmp.rx_drop);
-        QEMU_ADD_NET_PARAM(params, i,
-                           "tx.bytes", tmp.tx_bytes);
-        QEMU_ADD_NET_PARAM(params, i,
-                           "tx.pkts", tmp.tx_packets);
-        QEMU_ADD_NET_PARAM(params, i,
-                           "tx.errs", tmp.tx_errs);
-        QEMU_ADD_NET_PARAM(params, i,
-                           "tx.drop", tmp.tx_drop);
+        if (virDomainObjIsActive(vm))
+            qemuBlockJobAutotune(driver, vm, cfg->blockJobLatencyTarget);
+
+        qemuDomainObjEndJob(driver, vm);
+        virObjectUnlock(vm);
+        virResetLastError();
     }
 
-    return 0;
+ cleanup:
+    for (i = 0; i < autotune.nvms; i++)
+        virObjectUnref(autotune.vms[i]);
+    VIR_FREE(autotune.vms);
+    virResetLastError();
+    g_atomic_int_set(&driver->blockJobAutotunePending, 0);
 }
 
-#undef QEMU_ADD_NET_PARAM
 
-/* refresh information by opening images on the disk */
-static int
-qemuDomainGetStatsOneBlockFallback(virQEMUDriverPtr driver,
-                                   virQEMUDriverConfigPtr cfg,
-                                   virDomainObjPtr dom,
-                                   virTypedParamListPtr params,
-                                   virStorageSourcePtr src,
-                                   size_t block_idx)
+static void
+qemuDomainBlockJobAutotuneTimer(int timer G_GNUC_UNUSED,
+                                void *opaque)
 {
-    if (virStorageSourceIsEmpty(src))
-        return 0;
+    virQEMUDriverPtr driver = opaque;
 
-    if (qemuStorageLimitsRefresh(driver, cfg, dom, src, true) <= 0) {
-        virResetLastError();
-        return 0;
+    /* the previous pass is still running */
+    if (!g_atomic_int_compare_and_exchange(&driver->blockJobAutotunePending, 0, 1))
+        return;
+
+    if (virThreadPoolSendJob(driver->blockJobAutotunePool, 0, driver) < 0) {
+        VIR_WARN("Unable to schedule block job autotuning");
+        g_atomic_int_set(&driver->blockJobAutotunePending, 0);
     }
+}
 
-    if (src->allocation &&
-        virTypedParamListAddULLong(params, src->allocation,
-                                   "block.%zu.allocation", block_idx) < 0)
-        return -1;
 
-    if (src->capacity &&
-        virTypedParamListAddULLong(params, src->capacity,
-                                   "block.%zu.capacity", block_idx) < 0)
-        return -1;
+typedef struct _qemuDomainIOThreadPollData qemuDomainIOThreadPollData;
+struct _qemuDomainIOThreadPollData {
+    virDomainObjPtr *vms;
+    size_t nvms;
+};
 
-    if (src->physical &&
-        virTypedParamListAddULLong(params, src->physical,
-                                   "block.%zu.physical", block_idx) < 0)
-        return -1;
 
-    return 0;
+static int
+qemuDomainIOThreadPollCollect(virDomainObjPtr vm,
+                              void *opaque)
+{
+    qemuDomainIOThreadPollData *data = opaque;
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virDomainObjPtr ref;
+    int ret = 0;
+
+    virObjectLock(vm);
+
+    if (!virDomainObjIsActive(vm) ||
+        vm->def->niothreadids == 0 ||
+        !virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_IOTHREAD_POLLING))
+        goto cleanup;
+
+    ref = virObjectRef(vm);
+    if (VIR_APPEND_ELEMENT(data->vms, data->nvms, ref) < 0) {
+        virObjectUnref(vm);
+        ret = -1;
+    }
+
+ cleanup:
+    virObjectUnlock(vm);
+    return ret;
 }
 
 
 /**
- * qemuDomainGetStatsOneBlockRefreshNamed:
- * @src: disk source structure
- * @alias: disk alias
- * @stats: hash table containing stats for all disks
- * @nodedata: reply containing 'query-named-block-nodes' data
+ * qemuDomainIOThreadPollAdjust:
+ * @driver: qemu driver data
+ * @vm: domain object, with a job held
+ * @cfg: driver configuration
  *
- * Refresh disk block stats data (qemuBlockStatsPtr) which are present only
- * in the reply of 'query-named-block-nodes' in cases when the data was gathered
- * by using query-block originally.
+ * Computes the requests per second of the disks of @vm and of the IOThreads
+ * serving them since the previous pass. Polling of IOThreads serving at
+ * least iothread_poll_iops_threshold requests per second is enabled,
+ * polling of those serving less than half of that is disabled. The CPU time
+ * the IOThreads consumed is sampled too; busy disks served by the main loop
+ * or by an IOThread shared with other busy disks are logged along with the
+ * least loaded idle IOThread, as disks can't be moved between IOThreads of
+ * a running domain.
  */
 static void
-qemuDomainGetStatsOneBlockRefreshNamed(virStorageSourcePtr src,
-                                       const char *alias,
-                                       virHashTablePtr stats,
-                                       virHashTablePtr nodedata)
+qemuDomainIOThreadPollAdjust(virQEMUDriverPtr driver,
+                             virDomainObjPtr vm,
+                             virQEMUDriverConfigPtr cfg)
 {
-    qemuBlockStatsPtr entry;
-
-    virJSONValuePtr data;
-    unsigned long long tmp;
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    bool blockdev = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV);
+    unsigned int threshold = cfg->iothreadPollIOPSThreshold;
+    g_autoptr(virHashTable) stats = NULL;
+    g_autofree unsigned long long *diskIOPS = NULL;
+    g_autofree unsigned long long *iops = NULL;
+    g_autofree unsigned long long *cpu = NULL;
+    unsigned long long prev = priv->iothreadPollTimestamp;
+    unsigned long long now;
+    unsigned long long elapsed = 0;
+    ssize_t idle = -1;
+    size_t i;
+    size_t j;
+    int rc;
 
-    if (!nodedata || !src->nodestorage)
+    if (virTimeMillisNow(&now) < 0)
         return;
 
-    if (!(entry = virHashLookup(stats, alias)))
+    qemuDomainObjEnterMonitor(driver, vm);
+    rc = qemuMonitorGetAllBlockStatsInfo(priv->mon, &stats, false);
+    if (qemuDomainObjExitMonitor(driver, vm) < 0 || rc < 0)
         return;
 
-    if (!(data = virHashLookup(nodedata, src->nodestorage)))
-        return;
+    priv->iothreadPollTimestamp = now;
+    if (prev > 0 && now > prev)
+        elapsed = now - prev;
 
-    if (virJSONValueObjectGetNumberUlong(data, "write_threshold", &tmp) == 0)
-        entry->write_threshold = tmp;
-}
+    diskIOPS = g_new0(unsigned long long, vm->def->ndisks);
+    iops = g_new0(unsigned long long, vm->def->niothreadids);
+    cpu = g_new0(unsigned long long, vm->def->niothreadids);
 
+    for (i = 0; i < vm->def->ndisks; i++) {
+        virDomainDiskDefPtr disk = vm->def->disks[i];
+        qemuDomainDiskPrivatePtr diskPriv = QEMU_DOMAIN_DISK_PRIVATE(disk);
+        const char *entryname = disk->info.alias;
+        qemuBlockStatsPtr entry;
+        unsigned long long reqs;
 
-static int
-qemuDomainGetStatsOneBlock(virQEMUDriverPtr driver,
-                           virQEMUDriverConfigPtr cfg,
-                           virDomainObjPtr dom,
-                           virTypedParamListPtr params,
-                           const char *entryname,
-                           virStorageSourcePtr src,
-                           size_t block_idx,
-                           virHashTablePtr stats)
-{
-    qemuBlockStats *entry;
+        if (blockdev && diskPriv->qomName)
+            entryname = diskPriv->qomName;
 
-    /* the VM is offline so we have to go and load the stast from the disk by
-     * ourselves */
-    if (!virDomainObjIsActive(dom)) {
-        return qemuDomainGetStatsOneBlockFallback(driver, cfg, dom, params,
-                                                  src, block_idx);
+        if (!entryname || !(entry = virHashLookup(stats, entryname))) {
+            diskPriv->iothreadPollSampled = false;
+            continue;
+        }
+
+        reqs = entry->rd_req + entry->wr_req + entry->flush_req;
+
+        /* skip the first sample and reset counters */
+        if (elapsed > 0 &&
+            diskPriv->iothreadPollSampled &&
+            reqs >= diskPriv->iothreadPollReqs)
+            diskIOPS[i] = (reqs - diskPriv->iothreadPollReqs) * 1000 / elapsed;
+
+        diskPriv->iothreadPollSampled = true;
+        diskPriv->iothreadPollReqs = reqs;
+
+        for (j = 0; j < vm->def->niothreadids; j++) {
+            if (vm->def->iothreadids[j]->iothread_id == disk->iothread)
+                iops[j] += diskIOPS[i];
+        }
     }
 
-    /* In case where qemu didn't provide the stats we stop here rather than
-     * trying to refresh the stats from the disk. Inability to provide stats is
-     * usually caused by blocked storage so this would make libvirtd hang */
-    if (!stats || !entryname || !(entry = virHashLookup(stats, entryname)))
-        return 0;
+    /* forget IOThreads which were removed since the previous pass */
+    for (i = priv->niothreadPoll; i > 0; i--) {
+        if (!virDomainIOThreadIDFind(vm->def, priv->iothreadPoll[i - 1].iothread_id))
+            VIR_DELETE_ELEMENT(priv->iothreadPoll, i - 1, priv->niothreadPoll);
+    }
 
-    if (virTypedParamListAddULLong(params, entry->wr_highest_offset,
-                                   "block.%zu.allocation", block_idx) < 0)
-        return -1;
+    for (j = 0; j < vm->def->niothreadids; j++) {
+        virDomainIOThreadIDDefPtr iothread = vm->def->iothreadids[j];
+        qemuMonitorIOThreadInfo info = { .iothread_id = iothread->iothread_id,
+                                         .set_poll_max_ns = true };
+        qemuDomainIOThreadPollPtr state;
+        unsigned long long cpuTime;
+        virTristateBool polling;
 
-    if (entry->capacity &&
-        virTypedParamListAddULLong(params, entry->capacity,
-                                   "block.%zu.capacity", block_idx) < 0)
-        return -1;
+        if (!(state = qemuDomainIOThreadPollGet(priv, iothread->iothread_id)))
+            return;
 
-    if (entry->physical) {
-        if (virTypedParamListAddULLong(params, entry->physical,
-                                       "block.%zu.physical", block_idx) < 0)
-            return -1;
-    } else {
-        if (qemuDomainStorageUpdatePhysical(driver, cfg, dom, src) == 0) {
-            if (virTypedParamListAddULLong(params, src->physical,
-                                           "block.%zu.physical", block_idx) < 0)
-                return -1;
+        if (iothread->thread_id > 0 &&
+            qemuGetProcessInfo(&cpuTime, NULL, NULL, vm->pid,
+                               iothread->thread_id) == 0) {
+            /* percent of one host CPU */
+            if (elapsed > 0 && state->sampled && cpuTime >= state->cpuTime)
+                cpu[j] = (cpuTime - state->cpuTime) / (elapsed * 10000);
+
+            state->sampled = true;
+            state->cpuTime = cpuTime;
+        }
+
+        if (elapsed == 0)
+            continue;
+
+        if (iops[j] * 2 < threshold &&
+            (idle < 0 || iops[j] < iops[idle] ||
+             (iops[j] == iops[idle] && cpu[j] < cpu[idle])))
+            idle = j;
+
+        if (state->manual)
+            continue;
+
+        if (iops[j] >= threshold)
+            polling = VIR_TRISTATE_BOOL_YES;
+        else if (iops[j] * 2 < threshold)
+            polling = VIR_TRISTATE_BOOL_NO;
+        else
+            continue;
+
+        if (polling == state->polling)
+            continue;
+
+        if (polling == VIR_TRISTATE_BOOL_YES)
+            info.poll_max_ns = cfg->iothreadPollMaxNs;
+
+        VIR_DEBUG("IOThread %u of domain %s: %llu IOPS, %llu%% CPU, "
+                  "poll-max-ns %llu",
+                  iothread->iothread_id, vm->def->name, iops[j], cpu[j],
+                  info.poll_max_ns);
+
+        qemuDomainObjEnterMonitor(driver, vm);
+        rc = qemuMonitorSetIOThread(priv->mon, &info);
+        if (qemuDomainObjExitMonitor(driver, vm) < 0)
+            return;
+
+        if (rc < 0) {
+            VIR_WARN("Unable to set polling of IOThread %u of domain %s: %s",
+                     iothread->iothread_id, vm->def->name,
+                     virGetLastErrorMessage());
+            virResetLastError();
+            continue;
         }
+
+        state->polling = polling;
     }
 
-    return 0;
-}
+    if (idle < 0)
+        return;
 
+    for (i = 0; i < vm->def->ndisks; i++) {
+        virDomainDiskDefPtr disk = vm->def->disks[i];
+        qemuDomainDiskPrivatePtr diskPriv = QEMU_DOMAIN_DISK_PRIVATE(disk);
+        unsigned int suggested = vm->def->iothreadids[idle]->iothread_id;
+        bool shared = false;
 
-static int
-qemuDomainGetStatsBlockExportBackendStorage(const char *entryname,
-                                            virHashTablePtr stats,
-                                            size_t recordnr,
-                                            virTypedParamListPtr params)
-{
-    qemuBlockStats *entry;
+        if (disk->bus != VIR_DOMAIN_DISK_BUS_VIRTIO ||
+            diskIOPS[i] < threshold ||
+            disk->iothread == suggested ||
+            diskPriv->iothreadSuggested == suggested)
+            continue;
 
-    if (!stats || !entryname || !(entry = virHashLookup(stats, entryname)))
-        return 0;
+        for (j = 0; j < vm->def->niothreadids; j++) {
+            if (vm->def->iothreadids[j]->iothread_id == disk->iothread &&
+                iops[j] - diskIOPS[i] >= threshold)
+                shared = true;
+        }
 
-    if (entry->write_threshold &&
-        virTypedParamListAddULLong(params, entry->write_threshold,
-                                   "block.%zu.threshold", recordnr) < 0)
-        return -1;
+        if (disk->iothread != 0 && !shared)
+            continue;
 
-    return 0;
+        diskPriv->iothreadSuggested = suggested;
+
+        VIR_INFO("Disk %s of domain %s serves %llu IOPS %s, IOThread %u "
+                 "is idle and would serve it better",
+                 disk->dst, vm->def->name, diskIOPS[i],
+                 disk->iothread ? "in an IOThread shared with other busy disks" :
+                                  "in the main loop",
+                 suggested);
+    }
 }
 
 
-static int
-qemuDomainGetStatsBlockExportFrontend(const char *frontendname,
-                                      virHashTablePtr stats,
-                                      size_t idx,
-                                      virTypedParamListPtr par)
+static void
+qemuDomainIOThreadPollRun(void *data G_GNUC_UNUSED,
+                          void *opaque)
 {
-    qemuBlockStats *en;
+    virQEMUDriverPtr driver = opaque;
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    qemuDomainIOThreadPollData autotune = { 0 };
+    size_t i;
 
-    /* In case where qemu didn't provide the stats we stop here rather than
-     * trying to refresh the stats from the disk. Inability to provide stats is
-     * usually caused by blocked storage so this would make libvirtd hang */
-    if (!stats || !frontendname || !(en = virHashLookup(stats, frontendname)))
-        return 0;
+    if (virDomainObjListForEach(driver->domains, false,
+                                qemuDomainIOThreadPollCollect,
+                                &autotune) < 0)
+        goto cleanup;
 
-    if (virTypedParamListAddULLong(par, en->rd_req, "block.%zu.rd.reqs", idx) < 0 ||
-        virTypedParamListAddULLong(par, en->rd_bytes, "block.%zu.rd.bytes", idx) < 0 ||
-        virTypedParamListAddULLong(par, en->rd_total_times, "block.%zu.rd.times", idx) < 0 ||
-        virTypedParamListAddULLong(par, en->wr_req, "block.%zu.wr.reqs", idx) < 0 ||
-        virTypedParamListAddULLong(par, en->wr_bytes, "block.%zu.wr.bytes", idx) < 0 ||
-        virTypedParamListAddULLong(par, en->wr_total_times, "block.%zu.wr.times", idx) < 0 ||
-        virTypedParamListAddULLong(par, en->flush_req, "block.%zu.fl.reqs", idx) < 0 ||
-        virTypedParamListAddULLong(par, en->flush_total_times, "block.%zu.fl.times", idx) < 0)
-        return -1;
+    for (i = 0; i < autotune.nvms; i++) {
+        virDomainObjPtr vm = autotune.vms[i];
 
-    return 0;
+        virObjectLock(vm);
+
+        /* a busy domain is sampled the next time */
+        if (qemuDomainObjBeginJobNowait(driver, vm, QEMU_JOB_MODIFY) < 0) {
+            virResetLastError();
+            virObjectUnlock(vm);
+            continue;
+        }
+
+        if (virDomainObjIsActive(vm))
+            qemuDomainIOThreadPollAdjust(driver, vm, cfg);
+
+        qemuDomainObjEndJob(driver, vm);
+        virObjectUnlock(vm);
+        virResetLastError();
+    }
+
+ cleanup:
+    for (i = 0; i < autotune.nvms; i++)
+        virObjectUnref(autotune.vms[i]);
+    VIR_FREE(autotune.vms);
+    virResetLastError();
+    g_atomic_int_set(&driver->iothreadPollPending, 0);
 }
 
 
-static int
-qemuDomainGetStatsBlockExportHeader(virDomainDiskDefPtr disk,
-                                    virStorageSourcePtr src,
-                                    size_t recordnr,
-                                    virTypedParamListPtr params)
+static void
+qemuDomainIOThreadPollTimer(int timer G_GNUC_UNUSED,
+                            void *opaque)
 {
-    if (virTypedParamListAddString(params, disk->dst, "block.%zu.name", recordnr) < 0)
-        return -1;
+    virQEMUDriverPtr driver = opaque;
+
+    /* the previous pass is still running */
+    if (!g_atomic_int_compare_and_exchange(&driver->iothreadPollPending, 0, 1))
+        return;
+
+    if (virThreadPoolSendJob(driver->iothreadPollPool, 0, driver) < 0) {
+        VIR_WARN("Unable to schedule IOThread polling autotuning");
+        g_atomic_int_set(&driver->iothreadPollPending, 0);
+    }
+}
+
 
-    if (virStorageSourceIsLocalStorage(src) && src->path &&
-        virTypedParamListAddString(params, src->path, "block.%zu.path", recordnr) < 0)
-        return -1;
+typedef struct _qemuDomainMemoryManagerDomain qemuDomainMemoryManagerDomain;
+struct _qemuDomainMemoryManagerDomain {
+    virDomainObjPtr vm;
+    unsigned int priority;
+    unsigned long long min; /* KiB */
+    unsigned long long max; /* KiB */
+    /* filled by qemuDomainMemoryManagerSample, 0 if unknown */
+    unsigned long long actual; /* KiB */
+    unsigned long long avail; /* KiB */
+};
 
-    if (src->id &&
-        virTypedParamListAddUInt(params, src->id, "block.%zu.backingIndex", recordnr) < 0)
-        return -1;
 
-    return 0;
-}
+typedef struct _qemuDomainMemoryManagerData qemuDomainMemoryManagerData;
+struct _qemuDomainMemoryManagerData {
+    qemuDomainMemoryManagerDomain *doms;
+    size_t ndoms;
+};
 
 
 static int
-qemuDomainGetStatsBlockExportDisk(virDomainDiskDefPtr disk,
-                                  virHashTablePtr stats,
-                                  virHashTablePtr nodestats,
-                                  virTypedParamListPtr params,
-                                  size_t *recordnr,
-                                  bool visitBacking,
-                                  virQEMUDriverPtr driver,
-                                  virQEMUDriverConfigPtr cfg,
-                                  virDomainObjPtr dom,
-                                  bool blockdev)
-
+qemuDomainMemoryManagerCollect(virDomainObjPtr vm,
+                               void *opaque)
 {
-    virStorageSourcePtr n;
-    const char *frontendalias;
-    const char *backendalias;
-    const char *backendstoragealias;
+    qemuDomainMemoryManagerData *data = opaque;
+    virDomainMemballoonDefPtr balloon = vm->def->memballoon;
+    qemuDomainMemoryManagerDomain dom = { 0 };
+    int ret = 0;
 
-    /*
-     * This helps to keep logs clean from error messages on getting stats
-     * for optional disk with nonexistent source file. We won't get any
-     * stats for such a disk anyway in below code.
-     */
-    if (!virDomainObjIsActive(dom) &&
-        qemuDomainDiskIsMissingLocalOptional(disk)) {
-        VIR_INFO("optional disk '%s' source file is missing, "
-                 "skip getting stats", disk->dst);
+    virObjectLock(vm);
 
-        return qemuDomainGetStatsBlockExportHeader(disk, disk->src, *recordnr,
-                                                   params);
-    }
+    if (!virDomainObjIsActive(vm) ||
+        !virDomainDefHasMemballoon(vm->def) ||
+        !balloon->overcommit ||
+        balloon->period == 0)
+        goto cleanup;
 
-    for (n = disk->src; virStorageSourceIsBacking(n); n = n->backingStore) {
-        g_autofree char *alias = NULL;
+    dom.priority = balloon->overcommit_priority;
+    dom.max = virDomainDefGetMemoryTotal(vm->def);
+    if (balloon->overcommit_max && balloon->overcommit_max < dom.max)
+        dom.max = balloon->overcommit_max;
+    dom.min = MIN(balloon->overcommit_min, dom.max);
 
-        /* for 'sd' disks we won't be displaying stats for the backing chain
-         * as we don't update the stats correctly */
-        if (blockdev && QEMU_DOMAIN_DISK_PRIVATE(disk)->qomName) {
-            frontendalias = QEMU_DOMAIN_DISK_PRIVATE(disk)->qomName;
-            backendalias = n->nodeformat;
-            backendstoragealias = n->nodestorage;
-        } else {
-            /* alias may be NULL if the VM is not running */
-            if (disk->info.alias &&
-                !(alias = qemuDomainStorageAlias(disk->info.alias, n->id)))
-                return -1;
+    dom.vm = virObjectRef(vm);
+    if (VIR_APPEND_ELEMENT(data->doms, data->ndoms, dom) < 0) {
+        virObjectUnref(vm);
+        ret = -1;
+    }
 
-            qemuDomainGetStatsOneBlockRefreshNamed(n, alias, stats, nodestats);
+ cleanup:
+    virObjectUnlock(vm);
+    return ret;
+}
 
-            frontendalias = alias;
-            backendalias = alias;
-            backendstoragealias = alias;
-        }
 
-        if (qemuDomainGetStatsBlockExportHeader(disk, n, *recordnr, params) < 0)
-            return -1;
+/*
+ * Reads the balloon size and the memory available to the guest. Guests
+ * which don't report how much memory they could spare are left alone.
+ */
+static void
+qemuDomainMemoryManagerSample(virQEMUDriverPtr driver,
+                              qemuDomainMemoryManagerDomain *dom)
+{
+    virDomainObjPtr vm = dom->vm;
+    virDomainMemoryStatStruct stats[VIR_DOMAIN_MEMORY_STAT_NR];
+    unsigned long long unused = 0;
+    bool usable = false;
+    int nstats;
+    int i;
 
-        /* The following stats make sense only for the frontend device */
-        if (n == disk->src) {
-            if (qemuDomainGetStatsBlockExportFrontend(frontendalias, stats, *recordnr,
-                                                      params) < 0)
-                return -1;
-        }
+    virObjectLock(vm);
 
-        if (qemuDomainGetStatsOneBlock(driver, cfg, dom, params,
-                                       backendalias, n, *recordnr,
-                                       stats) < 0)
-            return -1;
+    /* a domain in the middle of an async job is sampled the next time */
+    if (qemuDomainObjBeginQueryJobNowait(vm) < 0) {
+        virObjectUnlock(vm);
+        return;
+    }
 
-        if (qemuDomainGetStatsBlockExportBackendStorage(backendstoragealias,
-                                                        stats, *recordnr,
-                                                        params) < 0)
-            return -1;
+    if (virDomainObjIsActive(vm) &&
+        (nstats = qemuDomainMemoryStatsInternal(driver, vm, stats,
+                                                VIR_DOMAIN_MEMORY_STAT_NR)) > 0) {
+        for (i = 0; i < nstats; i++) {
+            switch ((virDomainMemoryStatTags) stats[i].tag) {
+            case VIR_DOMAIN_MEMORY_STAT_ACTUAL_BALLOON:
+                dom->actual = stats[i].val;
+                break;
+            case VIR_DOMAIN_MEMORY_STAT_USABLE:
+                dom->avail = stats[i].val;
+                usable = true;
+                break;
+            case VIR_DOMAIN_MEMORY_STAT_UNUSED:
+                unused = stats[i].val;
+                break;
+            default:
+                break;
+            }
+        }
 
-        (*recordnr)++;
+        /* memory used by caches can be reclaimed by the guest too */
+        if (!usable)
+            dom->avail = unused;
 
-        if (!visitBacking)
-            break;
+        if (!usable && unused == 0)
+            dom->actual = 0;
     }
 
-    return 0;
+    qemuDomainObjEndQueryJob(vm);
+    virObjectUnlock(vm);
+    virResetLastError();
 }
 
 
-static int
-qemuDomainGetStatsBlock(virQEMUDriverPtr driver,
-                        virDomainObjPtr dom,
-                        virTypedParamListPtr params,
-                        unsigned int privflags)
+static void
+qemuDomainMemoryManagerResize(virQEMUDriverPtr driver,
+                              qemuDomainMemoryManagerDomain *dom,
+                              unsigned long long target,
+                              unsigned long long hostFree)
 {
-    size_t i;
-    int ret = -1;
+    virDomainObjPtr vm = dom->vm;
+    qemuDomainObjPrivatePtr priv = vm->privateData;
     int rc;
-    virHashTablePtr stats = NULL;
-    virHashTablePtr nodestats = NULL;
-    virJSONValuePtr nodedata = NULL;
-    qemuDomainObjPrivatePtr priv = dom->privateData;
-    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
-    bool blockdev = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV);
-    bool fetchnodedata = virQEMUCapsGet(priv->qemuCaps,
-                                        QEMU_CAPS_QUERY_NAMED_BLOCK_NODES) && !blockdev;
-    int count_index = -1;
-    size_t visited = 0;
-    bool visitBacking = !!(privflags & QEMU_DOMAIN_STATS_BACKING);
 
-    if (HAVE_JOB(privflags) && virDomainObjIsActive(dom)) {
-        qemuDomainObjEnterMonitor(driver, dom);
+    virObjectLock(vm);
 
-        rc = qemuMonitorGetAllBlockStatsInfo(priv->mon, &stats, visitBacking);
+    if (qemuDomainObjBeginJobNowait(driver, vm, QEMU_JOB_MODIFY) < 0) {
+        virResetLastError();
+        virObjectUnlock(vm);
+        return;
+    }
 
-        if (rc >= 0) {
-            if (blockdev)
-                rc = qemuMonitorBlockStatsUpdateCapacityBlockdev(priv->mon, stats);
-            else
-                ignore_value(qemuMonitorBlockStatsUpdateCapacity(priv->mon, stats,
-                                                                 visitBacking));
-        }
+    if (!virDomainObjIsActive(vm))
+        goto endjob;
 
-        if (fetchnodedata)
-            nodedata = qemuMonitorQueryNamedBlockNodes(priv->mon);
+    VIR_INFO("Resizing balloon of domain %s from %llu KiB to %llu KiB, "
+             "%llu KiB available to the guest, %llu KiB free on the host",
+             vm->def->name, dom->actual, target, dom->avail, hostFree);
 
-        if (qemuDomainObjExitMonitor(driver, dom) < 0)
-            goto cleanup;
+    qemuDomainObjEnterMonitor(driver, vm);
+    rc = qemuMonitorSetBalloon(priv->mon, target);
+    if (qemuDomainObjExitMonitor(driver, vm) < 0)
+        goto endjob;
 
-        /* failure to retrieve stats is fine at this point */
-        if (rc < 0 || (fetchnodedata && !nodedata))
-            virResetLastError();
+    if (rc <= 0) {
+        VIR_WARN("Unable to resize balloon of domain %s: %s",
+                 vm->def->name,
+                 rc < 0 ? virGetLastErrorMessage() : "no balloon driver");
+        goto endjob;
     }
 
-    if (nodedata &&
-        !(nodestats = qemuBlockGetNodeData(nodedata)))
-        goto cleanup;
+    /* the statistics no longer describe the guest */
+    qemuDomainBalloonStatsCacheClear(priv);
 
-    /* When listing backing chains, it's easier to fix up the count
-     * after the iteration than it is to iterate twice; but we still
-     * want count listed first.  */
-    count_index = params->npar;
-    if (virTypedParamListAddUInt(params, 0, "block.count") < 0)
-        goto cleanup;
+ endjob:
+    qemuDomainObjEndJob(driver, vm);
+    virObjectUnlock(vm);
+    virResetLastError();
+}
 
-    for (i = 0; i < dom->def->ndisks; i++) {
-        if (qemuDomainGetStatsBlockExportDisk(dom->def->disks[i], stats, nodestats,
-                                              params, &visited,
-                                              visitBacking, driver, cfg, dom,
-                                              blockdev) < 0)
-            goto cleanup;
-    }
 
-    params->par[count_index].value.ui = visited;
-    ret = 0;
+/* lowest priority first and among equal ones the most idle guests */
+static int
+qemuDomainMemoryManagerReclaimCompare(const void *a,
+                                      const void *b)
+{
+    const qemuDomainMemoryManagerDomain *da = a;
+    const qemuDomainMemoryManagerDomain *db = b;
 
- cleanup:
-    virHashFree(stats);
-    virHashFree(nodestats);
-    virJSONValueFree(nodedata);
-    return ret;
+    if (da->priority != db->priority)
+        return da->priority < db->priority ? -1 : 1;
+    if (da->avail != db->avail)
+        return da->avail > db->avail ? -1 : 1;
+    return 0;
 }
 
 
+/* highest priority first and among equal ones the most starved guests */
 static int
-qemuDomainGetStatsIOThread(virQEMUDriverPtr driver,
-                           virDomainObjPtr dom,
-                           virTypedParamListPtr params,
-                           unsigned int privflags)
+qemuDomainMemoryManagerGrowCompare(const void *a,
+                                   const void *b)
 {
-    qemuDomainObjPrivatePtr priv = dom->privateData;
-    size_t i;
-    qemuMonitorIOThreadInfoPtr *iothreads = NULL;
-    int niothreads;
-    int ret = -1;
+    const qemuDomainMemoryManagerDomain *da = a;
+    const qemuDomainMemoryManagerDomain *db = b;
 
-    if (!HAVE_JOB(privflags) || !virDomainObjIsActive(dom))
-        return 0;
+    if (da->priority != db->priority)
+        return da->priority > db->priority ? -1 : 1;
+    if (da->avail != db->avail)
+        return da->avail < db->avail ? -1 : 1;
+    return 0;
+}
 
-    if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_OBJECT_IOTHREAD))
-        return 0;
 
-    if ((niothreads = qemuDomainGetIOThreadsMon(driver, dom, &iothreads)) < 0)
-        return -1;
+/**
+ * qemuDomainMemoryManagerRun:
+ *
+ * When the host has less than memory_manager_low_free MiB of free memory,
+ * balloons are inflated by the memory their guests don't need until
+ * memory_manager_high_free MiB are free again. Each guest keeps an eighth
+ * of its memory available. Memory above memory_manager_high_free is given
+ * back to guests which have less than that available or whose balloon is
+ * below their minimum. The gap between the two thresholds keeps the
+ * balloons from oscillating.
+ */
+static void
+qemuDomainMemoryManagerRun(void *data G_GNUC_UNUSED,
+                           void *opaque)
+{
+    virQEMUDriverPtr driver = opaque;
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    qemuDomainMemoryManagerData manager = { 0 };
+    unsigned long long lowFree = cfg->memoryManagerLowFree * 1024ULL;
+    unsigned long long highFree = cfg->memoryManagerHighFree * 1024ULL;
+    unsigned long long hostFree;
+    unsigned long long left;
+    size_t i;
 
-    /* qemuDomainGetIOThreadsMon returns a NULL-terminated list, so we must free
-     * it even if it returns 0 */
-    if (niothreads == 0) {
-        ret = 0;
+    if (virDomainObjListForEach(driver->domains, false,
+                                qemuDomainMemoryManagerCollect,
+                                &manager) < 0)
         goto cleanup;
-    }
 
-    if (virTypedParamListAddUInt(params, niothreads, "iothread.count") < 0)
+    if (manager.ndoms == 0)
         goto cleanup;
 
-    for (i = 0; i < niothreads; i++) {
-        if (iothreads[i]->poll_valid) {
-            if (virTypedParamListAddULLong(params, iothreads[i]->poll_max_ns,
-                                           "iothread.%u.poll-max-ns",
-                                           iothreads[i]->iothread_id) < 0)
-                goto cleanup;
-            if (virTypedParamListAddUInt(params, iothreads[i]->poll_grow,
-                                         "iothread.%u.poll-grow",
-                                         iothreads[i]->iothread_id) < 0)
-                goto cleanup;
-            if (virTypedParamListAddUInt(params, iothreads[i]->poll_shrink,
-                                         "iothread.%u.poll-shrink",
-                                         iothreads[i]->iothread_id) < 0)
-                goto cleanup;
+    for (i = 0; i < manager.ndoms; i++)
+        qemuDomainMemoryManagerSample(driver, &manager.doms[i]);
+
+    if (virHostMemGetInfo(NULL, &hostFree) < 0)
+        goto cleanup;
+    hostFree /= 1024;
+
+    VIR_DEBUG("%llu KiB free on the host, %zu managed domains",
+              hostFree, manager.ndoms);
+
+    if (hostFree < lowFree) {
+        left = highFree - hostFree;
+
+        qsort(manager.doms, manager.ndoms, sizeof(*manager.doms),
+              qemuDomainMemoryManagerReclaimCompare);
+
+        for (i = 0; i < manager.ndoms && left > 0; i++) {
+            qemuDomainMemoryManagerDomain *dom = &manager.doms[i];
+            unsigned long long reserve = dom->actual / 8;
+            unsigned long long reclaim;
+
+            if (dom->actual <= dom->min || dom->avail <= reserve)
+                continue;
+
+            reclaim = dom->avail - reserve;
+            reclaim = MIN(reclaim, dom->actual - dom->min);
+            reclaim = MIN(reclaim, left);
+
+            qemuDomainMemoryManagerResize(driver, dom, dom->actual - reclaim,
+                                          hostFree);
+            left -= reclaim;
         }
-    }
+    } else if (hostFree > highFree) {
+        left = hostFree - highFree;
 
-    ret = 0;
+        qsort(manager.doms, manager.ndoms, sizeof(*manager.doms),
+              qemuDomainMemoryManagerGrowCompare);
+
+        for (i = 0; i < manager.ndoms && left > 0; i++) {
+            qemuDomainMemoryManagerDomain *dom = &manager.doms[i];
+            unsigned long long grow = 0;
+
+            if (dom->actual == 0 || dom->actual >= dom->max)
+                continue;
+
+            if (dom->actual < dom->min)
+                grow = dom->min - dom->actual;
+
+            if (dom->avail < dom->actual / 8)
+                grow = MAX(grow, dom->actual / 4 - dom->avail);
+
+            grow = MIN(grow, dom->max - dom->actual);
+            grow = MIN(grow, left);
+
+            if (grow == 0)
+                continue;
+
+            qemuDomainMemoryManagerResize(driver, dom, dom->actual + grow,
+                                          hostFree);
+            left -= grow;
+        }
+    }
 
  cleanup:
-    for (i = 0; i < niothreads; i++)
-        VIR_FREE(iothreads[i]);
-    VIR_FREE(iothreads);
+    for (i = 0; i < manager.ndoms; i++)
+        virObjectUnref(manager.doms[i].vm);
+    VIR_FREE(manager.doms);
+    virResetLastError();
+    g_atomic_int_set(&driver->memoryManagerPending, 0);
+}
+
+
+static void
+qemuDomainMemoryManagerTimer(int timer G_GNUC_UNUSED,
+                             void *opaque)
+{
+    virQEMUDriverPtr driver = opaque;
+
+    /* the previous pass is still running */
+    if (!g_atomic_int_compare_and_exchange(&driver->memoryManagerPending, 0, 1))
+        return;
 
-    return ret;
+    if (virThreadPoolSendJob(driver->memoryManagerPool, 0, driver) < 0) {
+        VIR_WARN("Unable to schedule memory manager");
+        g_atomic_int_set(&driver->memoryManagerPending, 0);
+    }
 }
 
 
-static int
-qemuDomainGetStatsPerfOneEvent(virPerfPtr perf,
-                               virPerfEventType type,
-                               virTypedParamListPtr params)
+/* The pass only touches monitors and agents, never domain objects, so
+ * it's quick enough to run from the timer directly */
+static void
+qemuEventThreadTimer(int timer G_GNUC_UNUSED,
+                     void *opaque)
 {
-    uint64_t value = 0;
+    virQEMUDriverPtr driver = opaque;
 
-    if (virPerfReadEvent(perf, type, &value) < 0)
-        return -1;
+    qemuEventThreadPoolRebalance(driver->eventThreadPool);
+}
 
-    if (virTypedParamListAddULLong(params, value, "perf.%s",
-                                   virPerfEventTypeToString(type)) < 0)
-        return -1;
 
-    return 0;
-}
+/*
+ * Bookkeeping shared by all the jobs of one parallel
+ * virConnectGetAllDomainStats call. Workers store their record at the
+ * index of their domain so that the caller can return them in the
+ * original order. The caller may stop waiting once the stats_timeout
+ * deadline passes, so the group is refcounted and outlives the call
+ * until the last worker is done with it.
+ */
+typedef struct _qemuDomainGetStatsGroup qemuDomainGetStatsGroup;
+typedef qemuDomainGetStatsGroup *qemuDomainGetStatsGroupPtr;
+struct _qemuDomainGetStatsGroup {
+    virObjectLockable parent;
+
+    virCond cond;
+    size_t pending;   /* number of jobs not finished yet */
+    bool abandoned;   /* caller is no longer interested in results */
+    virErrorPtr error;  /* first error reported by a worker */
+    qemuDomainGetStatsHost host;
+
+    size_t nrecords;
+    virDomainStatsRecordPtr *records;
+};
 
-static int
-qemuDomainGetStatsPerf(virQEMUDriverPtr driver G_GNUC_UNUSED,
-                       virDomainObjPtr dom,
-                       virTypedParamListPtr params,
-                       unsigned int privflags G_GNUC_UNUSED)
+typedef struct _qemuDomainGetStatsJob qemuDomainGetStatsJob;
+typedef qemuDomainGetStatsJob *qemuDomainGetStatsJobPtr;
+struct _qemuDomainGetStatsJob {
+    qemuDomainGetStatsGroupPtr group;
+    virConnectPtr conn;
+    virDomainObjPtr vm;
+    size_t idx;
+    unsigned int stats;
+    unsigned int privflags;
+    unsigned int flags;
+};
+
+static virClassPtr qemuDomainGetStatsGroupClass;
+
+static void
+qemuDomainGetStatsGroupDispose(void *obj)
 {
+    qemuDomainGetStatsGroupPtr group = obj;
     size_t i;
-    qemuDomainObjPrivatePtr priv = dom->privateData;
-
-    for (i = 0; i < VIR_PERF_EVENT_LAST; i++) {
-        if (!virPerfEventIsEnabled(priv->perf, i))
-             continue;
+    size_t j = 0;
 
-        if (qemuDomainGetStatsPerfOneEvent(priv->perf, i, params) < 0)
-            return -1;
+    /* compact the array so that it can be freed as a regular
+     * NULL terminated record list */
+    for (i = 0; i < group->nrecords; i++) {
+        if (group->records[i])
+            group->records[j++] = group->records[i];
     }
+    if (group->records)
+        group->records[j] = NULL;
 
-    return 0;
+    virDomainStatsRecordListFree(group->records);
+    virFreeError(group->error);
+    qemuDomainGetStatsHostClear(&group->host);
+    virCondDestroy(&group->cond);
 }
 
-typedef int
-(*qemuDomainGetStatsFunc)(virQEMUDriverPtr driver,
-                          virDomainObjPtr dom,
-                          virTypedParamListPtr list,
-                          unsigned int flags);
+static int
+qemuDomainGetStatsGroupOnceInit(void)
+{
+    if (!VIR_CLASS_NEW(qemuDomainGetStatsGroup, virClassForObjectLockable()))
+        return -1;
 
-struct qemuDomainGetStatsWorker {
-    qemuDomainGetStatsFunc func;
-    unsigned int stats;
-    bool monitor;
-};
+    return 0;
+}
 
-static struct qemuDomainGetStatsWorker qemuDomainGetStatsWorkers[] = {
-    { qemuDomainGetStatsState, VIR_DOMAIN_STATS_STATE, false },
-    { qemuDomainGetStatsCpu, VIR_DOMAIN_STATS_CPU_TOTAL, false },
-    { qemuDomainGetStatsBalloon, VIR_DOMAIN_STATS_BALLOON, true },
-    { qemuDomainGetStatsVcpu, VIR_DOMAIN_STATS_VCPU, true },
-    { qemuDomainGetStatsInterface, VIR_DOMAIN_STATS_INTERFACE, false },
-    { qemuDomainGetStatsBlock, VIR_DOMAIN_STATS_BLOCK, true },
-    { qemuDomainGetStatsPerf, VIR_DOMAIN_STATS_PERF, false },
-    { qemuDomainGetStatsIOThread, VIR_DOMAIN_STATS_IOTHREAD, true },
-    { qemuDomainGetStatsMemory, VIR_DOMAIN_STATS_MEMORY, false },
-    { NULL, 0, false }
-};
+VIR_ONCE_GLOBAL_INIT(qemuDomainGetStatsGroup);
 
 
-static int
-qemuDomainGetStatsCheckSupport(unsigned int *stats,
-                               bool enforce)
+static qemuDomainGetStatsGroupPtr
+qemuDomainGetStatsGroupNew(size_t nrecords)
 {
-    unsigned int supportedstats = 0;
-    size_t i;
+    qemuDomainGetStatsGroupPtr group;
 
-    for (i = 0; qemuDomainGetStatsWorkers[i].func; i++)
-        supportedstats |= qemuDomainGetStatsWorkers[i].stats;
+    if (qemuDomainGetStatsGroupInitialize() < 0)
+        return NULL;
 
-    if (*stats == 0) {
-        *stats = supportedstats;
-        return 0;
-    }
+    if (!(group = virObjectLockableNew(qemuDomainGetStatsGroupClass)))
+        return NULL;
 
-    if (enforce &&
-        *stats & ~supportedstats) {
-        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED,
-                       _("Stats types bits 0x%x are not supported by this daemon"),
-                       *stats & ~supportedstats);
-        return -1;
+    if (virCondInit(&group->cond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot initialize condition variable"));
+        virObjectUnref(group);
+        return NULL;
     }
 
-    *stats &= supportedstats;
-    return 0;
+    group->records = g_new0(virDomainStatsRecordPtr, nrecords + 1);
+    group->nrecords = nrecords;
+
+    return group;
 }
 
 
-static bool
-qemuDomainGetStatsNeedMonitor(unsigned int stats)
+static void
+qemuDomainGetStatsJobFree(qemuDomainGetStatsJobPtr job)
 {
-    size_t i;
+    if (!job)
+        return;
 
-    for (i = 0; qemuDomainGetStatsWorkers[i].func; i++)
-        if (stats & qemuDomainGetStatsWorkers[i].stats &&
-            qemuDomainGetStatsWorkers[i].monitor)
-            return true;
+    virObjectUnref(job->vm);
+    virObjectUnref(job->conn);
+    virObjectUnref(job->group);
+    g_free(job);
+}
 
-    return false;
+
+static void
+qemuDomainGetStatsJobRun(void *data,
+                         void *opaque G_GNUC_UNUSED)
+{
+    qemuDomainGetStatsJobPtr job = data;
+    qemuDomainGetStatsGroupPtr group = job->group;
+    virDomainStatsRecordPtr record = NULL;
+    bool skip;
+    int rc = 0;
+
+    virObjectLock(group);
+    skip = group->abandoned || group->error;
+    virObjectUnlock(group);
+
+    if (!skip)
+        rc = qemuConnectGetAllDomainStatsOne(job->conn, job->vm, job->stats,
+                                             &group->host, job->privflags,
+                                             job->flags, &record);
+
+    virObjectLock(group);
+    if (rc < 0 && !group->error)
+        group->error = virSaveLastError();
+    group->records[job->idx] = record;
+    if (--group->pending == 0)
+        virCondBroadcast(&group->cond);
+    virObjectUnlock(group);
+
+    qemuDomainGetStatsJobFree(job);
 }
 
 
+/*
+ * Gather stats of @vms using the driver's stats worker pool. On
+ * success the records of the domains which were queried before the
+ * configured deadline are stored into @tmpstats (allocated by caller to
+ * hold @nvms + 1 entries) in the order of @vms and their count is
+ * returned. Returns -1 on error.
+ */
 static int
-qemuDomainGetStats(virConnectPtr conn,
-                   virDomainObjPtr dom,
-                   unsigned int stats,
-                   virDomainStatsRecordPtr *record,
-                   unsigned int flags)
+qemuConnectGetAllDomainStatsParallel(virConnectPtr conn,
+                                     virDomainObjPtr *vms,
+                                     size_t nvms,
+                                     unsigned int stats,
+                                     unsigned int privflags,
+                                     unsigned int flags,
+                                     virDomainStatsRecordPtr *tmpstats)
 {
-    g_autofree virDomainStatsRecordPtr tmp = NULL;
-    g_autoptr(virTypedParamList) params = NULL;
+    virQEMUDriverPtr driver = conn->privateData;
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    qemuDomainGetStatsGroupPtr group = NULL;
+    unsigned long long deadline = 0;
+    int nstats = 0;
     size_t i;
+    int ret = -1;
 
-    if (VIR_ALLOC(params) < 0)
+    if (cfg->statsTimeout > 0) {
+        if (virTimeMillisNow(&deadline) < 0)
+            return -1;
+        deadline += cfg->statsTimeout * 1000ull;
+    }
+
+    if (!(group = qemuDomainGetStatsGroupNew(nvms)))
         return -1;
 
-    for (i = 0; qemuDomainGetStatsWorkers[i].func; i++) {
-        if (stats & qemuDomainGetStatsWorkers[i].stats) {
-            if (qemuDomainGetStatsWorkers[i].func(conn->privateData, dom, params,
-                                                  flags) < 0)
-                return -1;
+    /* owned by the group as workers may outlive the deadline */
+    qemuDomainGetStatsHostGather(&group->host, stats);
+
+    virObjectLock(group);
+
+    for (i = 0; i < nvms; i++) {
+        qemuDomainGetStatsJobPtr job = g_new0(qemuDomainGetStatsJob, 1);
+
+        job->group = virObjectRef(group);
+        job->conn = virObjectRef(conn);
+        job->vm = virObjectRef(vms[i]);
+        job->idx = i;
+        job->stats = stats;
+        job->privflags = privflags;
+        job->flags = flags;
+
+        group->pending++;
+        if (virThreadPoolSendJob(driver->statsPool, 0, job) < 0) {
+            group->pending--;
+            qemuDomainGetStatsJobFree(job);
+            goto cleanup;
         }
     }
 
-    if (VIR_ALLOC(tmp) < 0)
-        return -1;
+    while (group->pending > 0) {
+        if (deadline) {
+            if (virCondWaitUntil(&group->cond, &group->parent.lock,
+                                 deadline) < 0) {
+                if (errno != ETIMEDOUT) {
+                    virReportSystemError(errno, "%s",
+                                         _("failed to wait on condition"));
+                    goto cleanup;
+                }
 
-    if (!(tmp->dom = virGetDomain(conn, dom->def->name,
-                                  dom->def->uuid, dom->def->id)))
-        return -1;
+                VIR_WARN("Timed out gathering stats, %zu of %zu domains omitted",
+                         group->pending, nvms);
+                break;
+            }
+        } else if (virCondWait(&group->cond, &group->parent.lock) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("failed to wait on condition"));
+            goto cleanup;
+        }
+    }
 
-    tmp->nparams = virTypedParamListStealParams(params, &tmp->params);
-    *record = g_steal_pointer(&tmp);
-    return 0;
+    if (group->error) {
+        virSetError(group->error);
+        goto cleanup;
+    }
+
+    for (i = 0; i < nvms; i++) {
+        if (group->records[i])
+            tmpstats[nstats++] = g_steal_pointer(&group->records[i]);
+    }
+
+    ret = nstats;
+
+ cleanup:
+    group->abandoned = true;
+    virObjectUnlock(group);
+    virObjectUnref(group);
+    return ret;
 }
 
 
@@ -21768,15 +26400,14 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
     virQEMUDriverPtr driver = conn->privateData;
     virErrorPtr orig_err = NULL;
     virDomainObjPtr *vms = NULL;
-    virDomainObjPtr vm;
     size_t nvms;
     virDomainStatsRecordPtr *tmpstats = NULL;
+    qemuDomainGetStatsHost host = { 0 };
     bool enforce = !!(flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS);
     int nstats = 0;
     size_t i;
     int ret = -1;
     unsigned int privflags = 0;
-    unsigned int domflags = 0;
     unsigned int lflags = flags & (VIR_CONNECT_LIST_DOMAINS_FILTERS_ACTIVE |
                                    VIR_CONNECT_LIST_DOMAINS_FILTERS_PERSISTENT |
                                    VIR_CONNECT_LIST_DOMAINS_FILTERS_STATE);
@@ -21785,6 +26416,7 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
                   VIR_CONNECT_LIST_DOMAINS_FILTERS_PERSISTENT |
                   VIR_CONNECT_LIST_DOMAINS_FILTERS_STATE |
                   VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT |
+                  VIR_CONNECT_GET_ALL_DOMAINS_STATS_CACHED |
                   VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING |
                   VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS, -1);
 
@@ -21812,43 +26444,25 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
     if (qemuDomainGetStatsNeedMonitor(stats))
         privflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
 
-    for (i = 0; i < nvms; i++) {
-        virDomainStatsRecordPtr tmp = NULL;
-        domflags = 0;
-        vm = vms[i];
-
-        virObjectLock(vm);
-
-        if (HAVE_JOB(privflags)) {
-            int rv;
-
-            if (flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT)
-                rv = qemuDomainObjBeginJobNowait(driver, vm, QEMU_JOB_QUERY);
-            else
-                rv = qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY);
-
-            if (rv == 0)
-                domflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
-        }
-        /* else: without a job it's still possible to gather some data */
-
-        if (flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING)
-            domflags |= QEMU_DOMAIN_STATS_BACKING;
-        if (qemuDomainGetStats(conn, vm, stats, &tmp, domflags) < 0) {
-            if (HAVE_JOB(domflags) && vm)
-                qemuDomainObjEndJob(driver, vm);
-
-            virObjectUnlock(vm);
+    if (driver->statsPool && nvms > 1) {
+        if ((nstats = qemuConnectGetAllDomainStatsParallel(conn, vms, nvms,
+                                                           stats, privflags,
+                                                           flags,
+                                                           tmpstats)) < 0)
             goto cleanup;
-        }
+    } else {
+        qemuDomainGetStatsHostGather(&host, stats);
 
-        if (tmp)
-            tmpstats[nstats++] = tmp;
+        for (i = 0; i < nvms; i++) {
+            virDomainStatsRecordPtr tmp = NULL;
 
-        if (HAVE_JOB(domflags))
-            qemuDomainObjEndJob(driver, vm);
+            if (qemuConnectGetAllDomainStatsOne(conn, vms[i], stats, &host,
+                                                privflags, flags, &tmp) < 0)
+                goto cleanup;
 
-        virObjectUnlock(vm);
+            if (tmp)
+                tmpstats[nstats++] = tmp;
+        }
     }
 
     *retStats = tmpstats;
@@ -21858,6 +26472,7 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
 
  cleanup:
     virErrorPreserveLast(&orig_err);
+    qemuDomainGetStatsHostClear(&host);
     virDomainStatsRecordListFree(tmpstats);
     virObjectListFreeCount(vms, nvms);
     virErrorRestore(&orig_err);
@@ -21886,6 +26501,37 @@ qemuNodeAllocPages(virConnectPtr conn,
                                 startCell, cellCount, add);
 }
 
+
+static int
+qemuNodeSetPagesLayout(virConnectPtr conn,
+                       virTypedParameterPtr params,
+                       int nparams,
+                       virTypedParameterPtr *result,
+                       int *nresult,
+                       unsigned int flags)
+{
+    virCheckFlags(VIR_NODE_SET_PAGES_LAYOUT_STRICT, -1);
+
+    if (virNodeSetPagesLayoutEnsureACL(conn) < 0)
+        return -1;
+
+    return virHostMemSetPagesLayout(params, nparams, result, nresult,
+                                    !!(flags & VIR_NODE_SET_PAGES_LAYOUT_STRICT));
+}
+
+
+static int
+qemuNodeGetAllCPUStats(virConnectPtr conn,
+                       virTypedParameterPtr *params,
+                       int *nparams,
+                       unsigned int flags)
+{
+    if (virNodeGetAllCPUStatsEnsureACL(conn) < 0)
+        return -1;
+
+    return virHostCPUGetAllStats(params, nparams, flags);
+}
+
 static int
 qemuDomainGetFSInfoAgent(virQEMUDriverPtr driver,
                          virDomainObjPtr vm,
@@ -22635,6 +27281,8 @@ qemuDomainSetBlockThreshold(virDomainPtr dom,
 
     nodename = g_strdup(src->nodestorage);
 
+    qemuDomainBlockCapacityCacheClear(priv);
+
     qemuDomainObjEnterMonitor(driver, vm);
     rc = qemuMonitorSetBlockThreshold(priv->mon, nodename, threshold);
     if (qemuDomainObjExitMonitor(driver, vm) < 0 || rc < 0)
@@ -23004,7 +27652,9 @@ qemuDomainGetGuestInfo(virDomainPtr dom,
                        unsigned int flags)
 {
     virQEMUDriverPtr driver = dom->conn->privateData;
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
     virDomainObjPtr vm = NULL;
+    qemuDomainObjPrivatePtr priv;
     qemuAgentPtr agent;
     int ret = -1;
     int maxparams = 0;
@@ -23014,6 +27664,8 @@ qemuDomainGetGuestInfo(virDomainPtr dom,
     int rc;
     size_t nfs = 0;
     qemuAgentFSInfoPtr *agentfsinfo = NULL;
+    bool fsformatted = false;
+    unsigned long long now = 0;
     size_t i;
 
     virCheckFlags(0, -1);
@@ -23027,6 +27679,25 @@ qemuDomainGetGuestInfo(virDomainPtr dom,
     if (virDomainGetGuestInfoEnsureACL(dom->conn, vm->def) < 0)
         goto cleanup;
 
+    priv = vm->privateData;
+
+    if (cfg->guestInfoCacheTTL > 0) {
+        if (virTimeMillisNow(&now) < 0)
+            goto cleanup;
+
+        if (priv->guestInfoCacheTimestamp &&
+            priv->guestInfoCacheTypes == types &&
+            now - priv->guestInfoCacheTimestamp < cfg->guestInfoCacheTTL * 1000ull) {
+            VIR_DEBUG("Using cached guest info of '%s'", vm->def->name);
+            if (virTypedParamsCopy(params, priv->guestInfoCache,
+                                   priv->nguestInfoCache) < 0)
+                goto cleanup;
+            *nparams = priv->nguestInfoCache;
+            ret = 0;
+            goto cleanup;
+        }
+    }
+
     if (qemuDomainObjBeginAgentJob(driver, vm,
                                    QEMU_AGENT_JOB_QUERY) < 0)
         goto cleanup;
@@ -23036,6 +27707,10 @@ qemuDomainGetGuestInfo(virDomainPtr dom,
 
     agent = qemuDomainObjEnterAgent(vm);
 
+    /* the commands below are issued back to back, one guest-sync
+     * handshake is enough for all of them */
+    qemuAgentBeginBurst(agent);
+
     /* The agent info commands will return -2 for any commands that are not
      * supported by the agent, or -1 for all other errors. In the case where no
      * categories were explicitly requested (i.e. 'types' is 0), ignore
@@ -23073,6 +27748,7 @@ qemuDomainGetGuestInfo(virDomainPtr dom,
     ret = 0;
 
  exitagent:
+    qemuAgentEndBurst(agent);
     qemuDomainObjExitAgent(vm, agent);
 
  endagentjob:
@@ -23088,11 +27764,23 @@ qemuDomainGetGuestInfo(virDomainPtr dom,
         /* we need to convert the agent fsinfo struct to parameters and match
          * it to the vm disk target */
         qemuAgentFSInfoFormatParams(agentfsinfo, nfs, vm->def, params, nparams, &maxparams);
+        fsformatted = true;
 
  endjob:
         qemuDomainObjEndJob(driver, vm);
     }
 
+    /* don't cache results lacking the filesystem information */
+    if (ret == 0 && cfg->guestInfoCacheTTL > 0 &&
+        (nfs == 0 || fsformatted) && virDomainObjIsActive(vm)) {
+        qemuDomainGuestInfoCacheClear(priv);
+        if (virTypedParamsCopy(&priv->guestInfoCache, *params, *nparams) == 0) {
+            priv->nguestInfoCache = *nparams;
+            priv->guestInfoCacheTypes = types;
+            priv->guestInfoCacheTimestamp = now;
+        }
+    }
+
  cleanup:
     for (i = 0; i < nfs; i++)
         qemuAgentFSInfoFree(agentfsinfo[i]);
@@ -23157,6 +27845,67 @@ qemuDomainAgentSetResponseTimeout(virDomainPtr dom,
 }
 
 
+#define MIN_DIRTYRATE_CALC_PERIOD 1  /* supported min dirtyrate calculating time: 1s */
+#define MAX_DIRTYRATE_CALC_PERIOD 60 /* supported max dirtyrate calculating time: 60s */
+
+static int
+qemuDomainStartDirtyRateCalc(virDomainPtr dom,
+                             int seconds,
+                             unsigned int flags)
+{
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainObjPtr vm = NULL;
+    qemuDomainObjPrivatePtr priv;
+    int ret = -1;
+
+    virCheckFlags(0, -1);
+
+    if (seconds < MIN_DIRTYRATE_CALC_PERIOD ||
+        seconds > MAX_DIRTYRATE_CALC_PERIOD) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("seconds=%d is invalid, please choose value within [%d, %d]."),
+                       seconds,
+                       MIN_DIRTYRATE_CALC_PERIOD,
+                       MAX_DIRTYRATE_CALC_PERIOD);
+        return -1;
+    }
+
+    if (!(vm = qemuDomainObjFromDomain(dom)))
+        return -1;
+
+    if (virDomainStartDirtyRateCalcEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
+
+    priv = vm->privateData;
+
+    if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_CALC_DIRTY_RATE)) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("QEMU does not support dirty rate calculation"));
+        goto cleanup;
+    }
+
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
+        goto cleanup;
+
+    if (virDomainObjCheckActive(vm) < 0)
+        goto endjob;
+
+    VIR_DEBUG("Calculate dirty rate in next %d seconds", seconds);
+
+    qemuDomainObjEnterMonitor(driver, vm);
+    ret = qemuMonitorStartDirtyRateCalc(priv->mon, seconds);
+    if (qemuDomainObjExitMonitor(driver, vm) < 0)
+        ret = -1;
+
+ endjob:
+    qemuDomainObjEndJob(driver, vm);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+
 static virHypervisorDriver qemuHypervisorDriver = {
     .name = QEMU_DRIVER_NAME,
     .connectURIProbe = qemuConnectURIProbe,
@@ -23396,6 +28145,16 @@ static virHypervisorDriver qemuHypervisorDriver = {
     .domainAgentSetResponseTimeout = qemuDomainAgentSetResponseTimeout, /* 5.10.0 */
     .domainBackupBegin = qemuDomainBackupBegin, /* 6.0.0 */
     .domainBackupGetXMLDesc = qemuDomainBackupGetXMLDesc, /* 6.0.0 */
+    .connectGetAllDomainXMLDesc = qemuConnectGetAllDomainXMLDesc, /* 6.8.0 */
+    .domainStartDirtyRateCalc = qemuDomainStartDirtyRateCalc, /* 6.8.0 */
+    .nodeSetPagesLayout = qemuNodeSetPagesLayout, /* 6.8.0 */
+    .nodeGetAllCPUStats = qemuNodeGetAllCPUStats, /* 6.8.0 */
+    .domainAttachDevices = qemuDomainAttachDevices, /* 6.8.0 */
+    .domainListFSFreeze = qemuDomainListFSFreeze, /* 6.8.0 */
+    .domainListFSThaw = qemuDomainListFSThaw, /* 6.8.0 */
+    .domainListSnapshotCreateXML = qemuDomainListSnapshotCreateXML, /* 6.8.0 */
+    .domainListStop = qemuDomainListStop, /* 6.8.0 */
+    .domainCoreDumpStream = qemuDomainCoreDumpStream, /* 6.8.0 */
 };
 
 
@@ -0,0 +1,410 @@
+/*
+ * qemu_eventthreads.c: event threads shared by QEMU monitors and agents
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "qemu_eventthreads.h"
+#include "viralloc.h"
+#include "virerror.h"
+#include "vireventthread.h"
+#include "virlog.h"
+#include "virthread.h"
+
+#define VIR_FROM_THIS VIR_FROM_QEMU
+
+VIR_LOG_INIT("qemu.qemu_eventthreads");
+
+/* How long a shared thread may be blocked before its domains are moved
+ * to a new thread, in microseconds */
+#define QEMU_EVENT_THREAD_STALL_MAX (1000 * 1000)
+
+/* Share of the time between two rebalancing passes the monitor of a
+ * domain may keep a shared thread busy before the domain gets a thread
+ * of its own, in percent */
+#define QEMU_EVENT_THREAD_BUSY_MAX 50
+
+typedef struct _qemuEventThreadSlot qemuEventThreadSlot;
+struct _qemuEventThreadSlot {
+    virEventThread *evt;
+    size_t nmembers;
+};
+
+struct _qemuEventThreadMember {
+    char *name;
+
+    /* index of the shared thread serving the domain or -1 if the domain
+     * has a thread of its own */
+    ssize_t slot;
+    virEventThread *evt;
+
+    qemuMonitorPtr mon;
+    qemuAgentPtr agent;
+
+    /* monitor dispatch time seen by the last rebalancing pass */
+    unsigned long long dispatchTime;
+};
+
+/*
+ * Each domain is a member of the pool from the time its monitor is
+ * about to be connected until the monitor is closed. The pool holds
+ * references to the monitor and agent of every member so that it can
+ * move their I/O to another thread without touching the domain object,
+ * whose lock may be exactly what a blocked thread is waiting for.
+ */
+struct _qemuEventThreadPool {
+    virMutex lock;
+
+    qemuEventThreadSlot *slots;
+    size_t nslots;
+
+    qemuEventThreadMemberPtr *members;
+    size_t nmembers;
+
+    gint64 lastRebalance;
+};
+
+
+static virEventThread *
+qemuEventThreadPoolNewThread(size_t slot)
+{
+    g_autofree char *name = g_strdup_printf("qemu-event-%zu", slot);
+    virEventThread *evt;
+
+    if (!(evt = virEventThreadNew(name)))
+        return NULL;
+
+    virEventThreadStartLatencyProbe(evt);
+
+    return evt;
+}
+
+
+qemuEventThreadPoolPtr
+qemuEventThreadPoolNew(size_t nthreads)
+{
+    qemuEventThreadPoolPtr pool = g_new0(qemuEventThreadPool, 1);
+    size_t i;
+
+    if (virMutexInit(&pool->lock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("cannot initialize mutex"));
+        g_free(pool);
+        return NULL;
+    }
+
+    pool->slots = g_new0(qemuEventThreadSlot, nthreads);
+    pool->nslots = nthreads;
+    pool->lastRebalance = g_get_monotonic_time();
+
+    for (i = 0; i < nthreads; i++) {
+        if (!(pool->slots[i].evt = qemuEventThreadPoolNewThread(i))) {
+            qemuEventThreadPoolFree(pool);
+            return NULL;
+        }
+    }
+
+    return pool;
+}
+
+
+static void
+qemuEventThreadMemberFree(qemuEventThreadMemberPtr member)
+{
+    virObjectUnref(member->mon);
+    virObjectUnref(member->agent);
+    g_object_unref(member->evt);
+    g_free(member->name);
+    g_free(member);
+}
+
+
+void
+qemuEventThreadPoolFree(qemuEventThreadPoolPtr pool)
+{
+    size_t i;
+
+    if (!pool)
+        return;
+
+    for (i = 0; i < pool->nmembers; i++)
+        qemuEventThreadMemberFree(pool->members[i]);
+    g_free(pool->members);
+
+    for (i = 0; i < pool->nslots; i++) {
+        if (pool->slots[i].evt)
+            g_object_unref(pool->slots[i].evt);
+    }
+    g_free(pool->slots);
+
+    virMutexDestroy(&pool->lock);
+    g_free(pool);
+}
+
+
+/**
+ * qemuEventThreadPoolJoin:
+ * @pool: the pool
+ * @name: name of the domain
+ *
+ * Assigns a domain to the shared thread serving the fewest domains.
+ *
+ * Returns the membership, which has to be passed to
+ * qemuEventThreadPoolLeave once the domain's monitor is closed.
+ */
+qemuEventThreadMemberPtr
+qemuEventThreadPoolJoin(qemuEventThreadPoolPtr pool,
+                        const char *name)
+{
+    qemuEventThreadMemberPtr member = g_new0(qemuEventThreadMember, 1);
+    size_t best = 0;
+    size_t i;
+
+    member->name = g_strdup(name);
+
+    virMutexLock(&pool->lock);
+
+    for (i = 1; i < pool->nslots; i++) {
+        if (pool->slots[i].nmembers < pool->slots[best].nmembers)
+            best = i;
+    }
+
+    member->slot = best;
+    member->evt = g_object_ref(pool->slots[best].evt);
+
+    if (VIR_APPEND_ELEMENT_COPY(pool->members, pool->nmembers, member) < 0) {
+        virMutexUnlock(&pool->lock);
+        qemuEventThreadMemberFree(member);
+        return NULL;
+    }
+
+    pool->slots[best].nmembers++;
+
+    virMutexUnlock(&pool->lock);
+
+    VIR_DEBUG("Domain '%s' uses shared event thread %zu", name, best);
+    return member;
+}
+
+
+void
+qemuEventThreadPoolLeave(qemuEventThreadPoolPtr pool,
+                         qemuEventThreadMemberPtr member)
+{
+    size_t i;
+
+    if (!member)
+        return;
+
+    virMutexLock(&pool->lock);
+
+    for (i = 0; i < pool->nmembers; i++) {
+        if (pool->members[i] == member) {
+            VIR_DELETE_ELEMENT(pool->members, i, pool->nmembers);
+            break;
+        }
+    }
+
+    if (member->slot >= 0)
+        pool->slots[member->slot].nmembers--;
+
+    virMutexUnlock(&pool->lock);
+
+    qemuEventThreadMemberFree(member);
+}
+
+
+/**
+ * qemuEventThreadPoolGetContext:
+ * @pool: the pool
+ * @member: membership of a domain
+ *
+ * Returns a new reference to the context of the loop currently serving
+ * the domain.
+ */
+GMainContext *
+qemuEventThreadPoolGetContext(qemuEventThreadPoolPtr pool,
+                              qemuEventThreadMemberPtr member)
+{
+    GMainContext *ret;
+
+    virMutexLock(&pool->lock);
+    ret = g_main_context_ref(virEventThreadGetContext(member->evt));
+    virMutexUnlock(&pool->lock);
+
+    return ret;
+}
+
+
+/*
+ * The monitor or agent may have been opened with a context obtained
+ * before the domain was moved, so it's moved to the current one here.
+ */
+void
+qemuEventThreadPoolSetMonitor(qemuEventThreadPoolPtr pool,
+                              qemuEventThreadMemberPtr member,
+                              qemuMonitorPtr mon)
+{
+    virMutexLock(&pool->lock);
+
+    virObjectUnref(member->mon);
+    member->mon = virObjectRef(mon);
+    member->dispatchTime = 0;
+
+    if (mon)
+        qemuMonitorSetEventContext(mon, virEventThreadGetContext(member->evt));
+
+    virMutexUnlock(&pool->lock);
+}
+
+
+void
+qemuEventThreadPoolSetAgent(qemuEventThreadPoolPtr pool,
+                            qemuEventThreadMemberPtr member,
+                            qemuAgentPtr agent)
+{
+    virMutexLock(&pool->lock);
+
+    virObjectUnref(member->agent);
+    member->agent = virObjectRef(agent);
+
+    if (agent)
+        qemuAgentSetEventContext(agent, virEventThreadGetContext(member->evt));
+
+    virMutexUnlock(&pool->lock);
+}
+
+
+static void
+qemuEventThreadMemberMove(qemuEventThreadMemberPtr member,
+                          virEventThread *evt)
+{
+    GMainContext *context = virEventThreadGetContext(evt);
+
+    if (member->mon)
+        qemuMonitorSetEventContext(member->mon, context);
+    if (member->agent)
+        qemuAgentSetEventContext(member->agent, context);
+
+    g_object_unref(member->evt);
+    member->evt = g_object_ref(evt);
+}
+
+
+static void
+qemuEventThreadPoolReplaceStalled(qemuEventThreadPoolPtr pool,
+                                  size_t slot)
+{
+    qemuEventThreadSlot *s = &pool->slots[slot];
+    unsigned long long stall = virEventThreadGetStall(s->evt);
+    virEventThread *evt;
+    size_t i;
+
+    if (stall <= QEMU_EVENT_THREAD_STALL_MAX)
+        return;
+
+    VIR_WARN("Shared event thread %zu is blocked for %llu ms, moving its "
+             "%zu domains to a new thread",
+             slot, stall / 1000, s->nmembers);
+
+    if (!(evt = qemuEventThreadPoolNewThread(slot))) {
+        VIR_WARN("Unable to replace shared event thread %zu: %s",
+                 slot, virGetLastErrorMessage());
+        virResetLastError();
+        return;
+    }
+
+    for (i = 0; i < pool->nmembers; i++) {
+        if (pool->members[i]->slot == (ssize_t) slot)
+            qemuEventThreadMemberMove(pool->members[i], evt);
+    }
+
+    /* the old loop quits once the blocked callback returns */
+    g_object_unref(s->evt);
+    s->evt = evt;
+}
+
+
+static void
+qemuEventThreadPoolIsolateBusy(qemuEventThreadPoolPtr pool,
+                               qemuEventThreadMemberPtr member,
+                               unsigned long long elapsed)
+{
+    g_autofree char *name = NULL;
+    unsigned long long dispatchTime;
+    unsigned long long busy;
+    virEventThread *evt;
+
+    if (member->slot < 0 || !member->mon)
+        return;
+
+    dispatchTime = qemuMonitorGetDispatchTime(member->mon);
+    busy = dispatchTime - member->dispatchTime;
+    member->dispatchTime = dispatchTime;
+
+    if (pool->slots[member->slot].nmembers < 2 ||
+        busy * 100 <= elapsed * QEMU_EVENT_THREAD_BUSY_MAX)
+        return;
+
+    name = g_strdup_printf("vm-%s", member->name);
+    if (!(evt = virEventThreadNew(name))) {
+        VIR_WARN("Unable to create event thread for domain '%s': %s",
+                 member->name, virGetLastErrorMessage());
+        virResetLastError();
+        return;
+    }
+
+    VIR_INFO("Monitor of domain '%s' kept shared event thread %zd busy "
+             "for %llu ms out of %llu ms, moving the domain to its own thread",
+             member->name, member->slot, busy / 1000, elapsed / 1000);
+
+    qemuEventThreadMemberMove(member, evt);
+    g_object_unref(evt);
+
+    pool->slots[member->slot].nmembers--;
+    member->slot = -1;
+}
+
+
+/**
+ * qemuEventThreadPoolRebalance:
+ * @pool: the pool
+ *
+ * Replaces shared threads blocked for too long, moving all their domains
+ * to the new threads, and moves domains whose monitor keeps a shared
+ * thread busy to threads of their own. Meant to be called periodically.
+ */
+void
+qemuEventThreadPoolRebalance(qemuEventThreadPoolPtr pool)
+{
+    gint64 now = g_get_monotonic_time();
+    unsigned long long elapsed;
+    size_t i;
+
+    virMutexLock(&pool->lock);
+
+    elapsed = now - pool->lastRebalance;
+    pool->lastRebalance = now;
+
+    for (i = 0; i < pool->nslots; i++)
+        qemuEventThreadPoolReplaceStalled(pool, i);
+
+    for (i = 0; i < pool->nmembers; i++)
+        qemuEventThreadPoolIsolateBusy(pool, pool->members[i], elapsed);
+
+    virMutexUnlock(&pool->lock);
+}
@@ -0,0 +1,48 @@
+/*
+ * qemu_eventthreads.h: event threads shared by QEMU monitors and agents
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "qemu_agent.h"
+#include "qemu_monitor.h"
+
+typedef struct _qemuEventThreadPool qemuEventThreadPool;
+typedef qemuEventThreadPool *qemuEventThreadPoolPtr;
+
+typedef struct _qemuEventThreadMember qemuEventThreadMember;
+typedef qemuEventThreadMember *qemuEventThreadMemberPtr;
+
+qemuEventThreadPoolPtr qemuEventThreadPoolNew(size_t nthreads);
+void qemuEventThreadPoolFree(qemuEventThreadPoolPtr pool);
+
+qemuEventThreadMemberPtr qemuEventThreadPoolJoin(qemuEventThreadPoolPtr pool,
+                                                 const char *name);
+void qemuEventThreadPoolLeave(qemuEventThreadPoolPtr pool,
+                              qemuEventThreadMemberPtr member);
+
+GMainContext *qemuEventThreadPoolGetContext(qemuEventThreadPoolPtr pool,
+                                            qemuEventThreadMemberPtr member);
+
+void qemuEventThreadPoolSetMonitor(qemuEventThreadPoolPtr pool,
+                                   qemuEventThreadMemberPtr member,
+                                   qemuMonitorPtr mon);
+void qemuEventThreadPoolSetAgent(qemuEventThreadPoolPtr pool,
+                                 qemuEventThreadMemberPtr member,
+                                 qemuAgentPtr agent);
+
+void qemuEventThreadPoolRebalance(qemuEventThreadPoolPtr pool);
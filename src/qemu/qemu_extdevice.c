@@ -160,6 +160,93 @@ qemuExtDevicesCleanupHost(virQEMUDriverPtr driver,
 }
 
 
+typedef struct _qemuExtDevicesStartData qemuExtDevicesStartData;
+typedef qemuExtDevicesStartData *qemuExtDevicesStartDataPtr;
+struct _qemuExtDevicesStartData {
+    virQEMUDriverPtr driver;
+    virDomainObjPtr vm;
+    virLogManagerPtr logManager;
+    bool incomingMigration;
+
+    /* the helper to start, exactly one of them is set */
+    virDomainVideoDefPtr video;
+    bool tpm;
+    bool slirp;
+    virDomainFSDefPtr fs;
+
+    virThread thread;
+    virErrorPtr err;
+};
+
+
+static int
+qemuExtDevicesStartSlirp(virQEMUDriverPtr driver,
+                         virDomainObjPtr vm,
+                         bool incomingMigration)
+{
+    size_t i;
+
+    for (i = 0; i < vm->def->nnets; i++) {
+        virDomainNetDefPtr net = vm->def->nets[i];
+        qemuSlirpPtr slirp = QEMU_DOMAIN_NETWORK_PRIVATE(net)->slirp;
+
+        if (slirp &&
+            qemuSlirpStart(slirp, vm, driver, net, incomingMigration) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+qemuExtDevicesStartOne(qemuExtDevicesStartDataPtr data)
+{
+    if (data->video)
+        return qemuExtVhostUserGPUStart(data->driver, data->vm, data->video);
+
+    if (data->tpm)
+        return qemuExtTPMStart(data->driver, data->vm, data->incomingMigration);
+
+    if (data->slirp)
+        return qemuExtDevicesStartSlirp(data->driver, data->vm,
+                                        data->incomingMigration);
+
+    if (data->fs)
+        return qemuVirtioFSStart(data->logManager, data->driver, data->vm,
+                                 data->fs);
+
+    return 0;
+}
+
+
+static void
+qemuExtDevicesStartThread(void *opaque)
+{
+    qemuExtDevicesStartDataPtr data = opaque;
+
+    if (qemuExtDevicesStartOne(data) < 0)
+        virErrorPreserveLast(&data->err);
+}
+
+
+/*
+ * qemuExtDevicesStart:
+ *
+ * @driver: QEMU driver
+ * @vm: the domain object
+ * @logManager: log manager for helpers logging through virtlogd
+ * @incomingMigration: whether we have an incoming migration
+ *
+ * Start the external helper processes of the domain. The helpers don't
+ * depend on each other, so each of them is started and waited for in its
+ * own thread. The function waits for all of them and reports the first
+ * error encountered; helpers which did start are left running for the
+ * caller to clean up with qemuExtDevicesStop.
+ *
+ * All slirp helpers are started by the same thread as they share the
+ * per domain D-Bus daemon.
+ */
 int
 qemuExtDevicesStart(virQEMUDriverPtr driver,
                     virDomainObjPtr vm,
@@ -167,42 +254,82 @@ qemuExtDevicesStart(virQEMUDriverPtr driver,
                     bool incomingMigration)
 {
     virDomainDefPtr def = vm->def;
+    g_autofree qemuExtDevicesStartDataPtr data = NULL;
+    size_t ndata = 0;
+    size_t nthreads = 0;
+    virErrorPtr err = NULL;
     size_t i;
+    int ret = 0;
 
     if (qemuExtDevicesInitPaths(driver, def) < 0)
         return -1;
 
+    /* one helper per video and filesystem at most, plus TPM and slirp */
+    data = g_new0(qemuExtDevicesStartData, def->nvideos + def->nfss + 2);
+
     for (i = 0; i < def->nvideos; i++) {
         virDomainVideoDefPtr video = def->videos[i];
 
-        if (video->backend == VIR_DOMAIN_VIDEO_BACKEND_TYPE_VHOSTUSER) {
-            if (qemuExtVhostUserGPUStart(driver, vm, video) < 0)
-                return -1;
-        }
+        if (video->backend == VIR_DOMAIN_VIDEO_BACKEND_TYPE_VHOSTUSER)
+            data[ndata++].video = video;
     }
 
-    if (def->ntpms > 0 && qemuExtTPMStart(driver, vm, incomingMigration) < 0)
-        return -1;
+    if (def->ntpms > 0)
+        data[ndata++].tpm = true;
 
     for (i = 0; i < def->nnets; i++) {
-        virDomainNetDefPtr net = def->nets[i];
-        qemuSlirpPtr slirp = QEMU_DOMAIN_NETWORK_PRIVATE(net)->slirp;
-
-        if (slirp &&
-            qemuSlirpStart(slirp, vm, driver, net, incomingMigration) < 0)
-            return -1;
+        if (QEMU_DOMAIN_NETWORK_PRIVATE(def->nets[i])->slirp) {
+            data[ndata++].slirp = true;
+            break;
+        }
     }
 
     for (i = 0; i < def->nfss; i++) {
         virDomainFSDefPtr fs = def->fss[i];
 
-        if (fs->fsdriver == VIR_DOMAIN_FS_DRIVER_TYPE_VIRTIOFS) {
-            if (qemuVirtioFSStart(logManager, driver, vm, fs) < 0)
-                return -1;
+        if (fs->fsdriver == VIR_DOMAIN_FS_DRIVER_TYPE_VIRTIOFS)
+            data[ndata++].fs = fs;
+    }
+
+    for (i = 0; i < ndata; i++) {
+        data[i].driver = driver;
+        data[i].vm = vm;
+        data[i].logManager = logManager;
+        data[i].incomingMigration = incomingMigration;
+    }
+
+    /* not worth a thread */
+    if (ndata == 1)
+        return qemuExtDevicesStartOne(&data[0]);
+
+    for (i = 0; i < ndata; i++) {
+        if (virThreadCreateFull(&data[i].thread, true,
+                                qemuExtDevicesStartThread,
+                                "qemu-ext-start", false, &data[i]) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("unable to create external device start thread"));
+            ret = -1;
+            break;
         }
+        nthreads++;
     }
 
-    return 0;
+    for (i = 0; i < nthreads; i++) {
+        virThreadJoin(&data[i].thread);
+
+        if (!data[i].err)
+            continue;
+
+        if (ret == 0) {
+            err = g_steal_pointer(&data[i].err);
+            ret = -1;
+        } else {
+            virFreeError(data[i].err);
+        }
+    }
+    virErrorRestore(&err);
+
+    return ret;
 }
 
 
@@ -32,6 +32,10 @@
 #include "virstring.h"
 #include "viralloc.h"
 #include "virenum.h"
+#include "virobject.h"
+#include "virthread.h"
+
+#include <sys/stat.h>
 
 #define VIR_FROM_THIS VIR_FROM_QEMU
 
@@ -1179,39 +1183,178 @@ qemuFirmwareSanityCheck(const qemuFirmware *fw,
 }
 
 
-static ssize_t
-qemuFirmwareFetchParsedConfigs(bool privileged,
-                               qemuFirmwarePtr **firmwaresRet,
-                               char ***pathsRet)
+typedef struct _qemuFirmwareFileStamp qemuFirmwareFileStamp;
+struct _qemuFirmwareFileStamp {
+    ino_t ino;
+    off_t size;
+    time_t mtime;
+    time_t ctime;
+};
+
+
+/* All firmware descriptors found on the host, parsed. */
+typedef struct _qemuFirmwareList qemuFirmwareList;
+typedef qemuFirmwareList *qemuFirmwareListPtr;
+struct _qemuFirmwareList {
+    virObject parent;
+
+    char **paths;
+    qemuFirmwareFileStamp *stamps;
+    qemuFirmwarePtr *firmwares;
+    size_t nfirmwares;
+};
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(qemuFirmwareList, virObjectUnref);
+
+
+static virClassPtr qemuFirmwareListClass;
+
+/* Parsing the descriptors is needed for every domain capabilities query
+ * and every start of a domain using firmware auto-selection. The parsed
+ * descriptors are thus kept, separately for privileged and unprivileged
+ * callers since they see different sets of files, and parsed again only
+ * if any of the descriptor files changes. */
+static virMutex qemuFirmwareListLock = VIR_MUTEX_INITIALIZER;
+static qemuFirmwareListPtr qemuFirmwareListCached[2];
+
+
+static void
+qemuFirmwareListDispose(void *obj)
+{
+    qemuFirmwareListPtr list = obj;
+    size_t i;
+
+    for (i = 0; i < list->nfirmwares; i++)
+        qemuFirmwareFree(list->firmwares[i]);
+    VIR_FREE(list->firmwares);
+    VIR_FREE(list->stamps);
+    g_strfreev(list->paths);
+}
+
+
+static int
+qemuFirmwareListOnceInit(void)
+{
+    if (!VIR_CLASS_NEW(qemuFirmwareList, virClassForObject()))
+        return -1;
+
+    return 0;
+}
+
+
+VIR_ONCE_GLOBAL_INIT(qemuFirmwareList);
+
+
+static void
+qemuFirmwareFileStampGet(const char *path,
+                         qemuFirmwareFileStamp *stamp)
+{
+    struct stat sb;
+
+    memset(stamp, 0, sizeof(*stamp));
+
+    /* a file we can't stat is going to fail to parse anyway */
+    if (stat(path, &sb) < 0)
+        return;
+
+    stamp->ino = sb.st_ino;
+    stamp->size = sb.st_size;
+    stamp->mtime = sb.st_mtime;
+    stamp->ctime = sb.st_ctime;
+}
+
+
+static bool
+qemuFirmwareListIsValid(qemuFirmwareListPtr list,
+                        char **paths,
+                        const qemuFirmwareFileStamp *stamps)
+{
+    size_t npaths = virStringListLength((const char **)paths);
+    size_t i;
+
+    if (npaths != list->nfirmwares)
+        return false;
+
+    for (i = 0; i < npaths; i++) {
+        if (STRNEQ(paths[i], list->paths[i]) ||
+            memcmp(&stamps[i], &list->stamps[i], sizeof(stamps[i])) != 0)
+            return false;
+    }
+
+    return true;
+}
+
+
+static qemuFirmwareListPtr
+qemuFirmwareListNew(char ***paths,
+                    qemuFirmwareFileStamp **stamps)
+{
+    g_autoptr(qemuFirmwareList) list = NULL;
+    size_t npaths = virStringListLength((const char **)*paths);
+
+    if (qemuFirmwareListInitialize() < 0)
+        return NULL;
+
+    if (!(list = virObjectNew(qemuFirmwareListClass)))
+        return NULL;
+
+    list->firmwares = g_new0(qemuFirmwarePtr, npaths);
+
+    for (list->nfirmwares = 0; list->nfirmwares < npaths; list->nfirmwares++) {
+        const char *path = (*paths)[list->nfirmwares];
+
+        if (!(list->firmwares[list->nfirmwares] = qemuFirmwareParse(path)))
+            return NULL;
+    }
+
+    list->paths = g_steal_pointer(paths);
+    list->stamps = g_steal_pointer(stamps);
+
+    return g_steal_pointer(&list);
+}
+
+
+/*
+ * Returns a reference to the parsed firmware descriptors, the caller
+ * must not modify them.
+ */
+static qemuFirmwareListPtr
+qemuFirmwareFetchParsedConfigs(bool privileged)
 {
     VIR_AUTOSTRINGLIST paths = NULL;
+    g_autofree qemuFirmwareFileStamp *stamps = NULL;
+    qemuFirmwareListPtr list = NULL;
     size_t npaths;
-    qemuFirmwarePtr *firmwares = NULL;
     size_t i;
 
     if (qemuFirmwareFetchConfigs(&paths, privileged) < 0)
-        return -1;
+        return NULL;
 
     npaths = virStringListLength((const char **)paths);
 
-    if (VIR_ALLOC_N(firmwares, npaths) < 0)
-        return -1;
+    stamps = g_new0(qemuFirmwareFileStamp, npaths);
+    for (i = 0; i < npaths; i++)
+        qemuFirmwareFileStampGet(paths[i], &stamps[i]);
 
-    for (i = 0; i < npaths; i++) {
-        if (!(firmwares[i] = qemuFirmwareParse(paths[i])))
-            goto error;
+    virMutexLock(&qemuFirmwareListLock);
+
+    list = qemuFirmwareListCached[privileged];
+    if (list && qemuFirmwareListIsValid(list, paths, stamps)) {
+        virObjectRef(list);
+        goto cleanup;
     }
 
-    *firmwaresRet = g_steal_pointer(&firmwares);
-    if (pathsRet)
-        *pathsRet = g_steal_pointer(&paths);
-    return npaths;
+    VIR_DEBUG("Parsing %zu firmware descriptors", npaths);
+
+    if (!(list = qemuFirmwareListNew(&paths, &stamps)))
+        goto cleanup;
 
- error:
-    while (i > 0)
-        qemuFirmwareFree(firmwares[--i]);
-    VIR_FREE(firmwares);
-    return -1;
+    virObjectUnref(qemuFirmwareListCached[privileged]);
+    qemuFirmwareListCached[privileged] = virObjectRef(list);
+
+ cleanup:
+    virMutexUnlock(&qemuFirmwareListLock);
+    return list;
 }
 
 
@@ -1220,13 +1363,10 @@ qemuFirmwareFillDomain(virQEMUDriverPtr driver,
                        virDomainDefPtr def,
                        unsigned int flags)
 {
-    VIR_AUTOSTRINGLIST paths = NULL;
-    qemuFirmwarePtr *firmwares = NULL;
-    ssize_t nfirmwares = 0;
+    g_autoptr(qemuFirmwareList) list = NULL;
     const qemuFirmware *theone = NULL;
     bool needResult = true;
     size_t i;
-    int ret = -1;
 
     if (!(flags & VIR_QEMU_PROCESS_START_NEW))
         return 0;
@@ -1248,15 +1388,14 @@ qemuFirmwareFillDomain(virQEMUDriverPtr driver,
         needResult = false;
     }
 
-    if ((nfirmwares = qemuFirmwareFetchParsedConfigs(driver->privileged,
-                                                     &firmwares, &paths)) < 0)
+    if (!(list = qemuFirmwareFetchParsedConfigs(driver->privileged)))
         return -1;
 
-    for (i = 0; i < nfirmwares; i++) {
-        if (qemuFirmwareMatchDomain(def, firmwares[i], paths[i])) {
-            theone = firmwares[i];
+    for (i = 0; i < list->nfirmwares; i++) {
+        if (qemuFirmwareMatchDomain(def, list->firmwares[i], list->paths[i])) {
+            theone = list->firmwares[i];
             VIR_DEBUG("Found matching firmware (description path '%s')",
-                      paths[i]);
+                      list->paths[i]);
             break;
         }
     }
@@ -1270,27 +1409,22 @@ qemuFirmwareFillDomain(virQEMUDriverPtr driver,
             VIR_DEBUG("Unable to find NVRAM template for '%s', "
                       "falling back to old style",
                       NULLSTR(def->os.loader ? def->os.loader->path : NULL));
-            ret = 0;
+            return 0;
         }
-        goto cleanup;
+        return -1;
     }
 
     /* Firstly, let's do some sanity checks. If either of these
      * fail we can still start the domain successfully, but it's
      * likely that admin/FW manufacturer messed up. */
-    qemuFirmwareSanityCheck(theone, paths[i]);
+    qemuFirmwareSanityCheck(theone, list->paths[i]);
 
     if (qemuFirmwareEnableFeatures(driver, def, theone) < 0)
-        goto cleanup;
+        return -1;
 
     def->os.firmware = VIR_DOMAIN_OS_DEF_FIRMWARE_NONE;
 
-    ret = 0;
- cleanup:
-    for (i = 0; i < nfirmwares; i++)
-        qemuFirmwareFree(firmwares[i]);
-    VIR_FREE(firmwares);
-    return ret;
+    return 0;
 }
 
 
@@ -1333,8 +1467,7 @@ qemuFirmwareGetSupported(const char *machine,
                          virFirmwarePtr **fws,
                          size_t *nfws)
 {
-    qemuFirmwarePtr *firmwares = NULL;
-    ssize_t nfirmwares = 0;
+    g_autoptr(qemuFirmwareList) list = NULL;
     size_t i;
 
     *supported = VIR_DOMAIN_OS_DEF_FIRMWARE_NONE;
@@ -1345,12 +1478,11 @@ qemuFirmwareGetSupported(const char *machine,
         *nfws = 0;
     }
 
-    if ((nfirmwares = qemuFirmwareFetchParsedConfigs(privileged,
-                                                     &firmwares, NULL)) < 0)
+    if (!(list = qemuFirmwareFetchParsedConfigs(privileged)))
         return -1;
 
-    for (i = 0; i < nfirmwares; i++) {
-        qemuFirmwarePtr fw = firmwares[i];
+    for (i = 0; i < list->nfirmwares; i++) {
+        qemuFirmwarePtr fw = list->firmwares[i];
         const qemuFirmwareMappingFlash *flash = &fw->mapping.data.flash;
         const qemuFirmwareMappingMemory *memory = &fw->mapping.data.memory;
         const char *fwpath = NULL;
@@ -1433,12 +1565,9 @@ qemuFirmwareGetSupported(const char *machine,
         }
     }
 
-    if (fws && !*fws && nfirmwares &&
+    if (fws && !*fws && list->nfirmwares &&
         VIR_REALLOC_N(*fws, 0) < 0)
         return -1;
 
-    for (i = 0; i < nfirmwares; i++)
-        qemuFirmwareFree(firmwares[i]);
-    VIR_FREE(firmwares);
     return 0;
 }
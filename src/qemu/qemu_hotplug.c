@@ -622,7 +622,10 @@ qemuDomainChangeEjectableMedia(virQEMUDriverPtr driver,
     if (qemuDomainDetermineDiskChain(driver, vm, disk, NULL, true) < 0)
         goto cleanup;
 
-    if (qemuDomainPrepareDiskSource(disk, priv, cfg) < 0)
+    qemuDomainSecretPrefetch(cfg, vm, disk);
+    rc = qemuDomainPrepareDiskSource(disk, priv, cfg);
+    qemuDomainSecretPrefetchClear(priv);
+    if (rc < 0)
         goto cleanup;
 
     if (qemuDomainStorageSourceChainAccessAllow(driver, vm, newsrc) < 0)
@@ -693,6 +696,7 @@ qemuDomainAttachDiskGeneric(virQEMUDriverPtr driver,
     g_autofree char *corAlias = NULL;
     bool corAdded = false;
     bool blockdev = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV);
+    int rc;
 
     if (qemuDomainStorageSourceChainAccessAllow(driver, vm, disk->src) < 0)
         return -1;
@@ -700,7 +704,10 @@ qemuDomainAttachDiskGeneric(virQEMUDriverPtr driver,
     if (qemuAssignDeviceDiskAlias(vm->def, disk, priv->qemuCaps) < 0)
         goto cleanup;
 
-    if (qemuDomainPrepareDiskSource(disk, priv, cfg) < 0)
+    qemuDomainSecretPrefetch(cfg, vm, disk);
+    rc = qemuDomainPrepareDiskSource(disk, priv, cfg);
+    qemuDomainSecretPrefetchClear(priv);
+    if (rc < 0)
         goto cleanup;
 
     if (blockdev) {
@@ -764,6 +771,18 @@ qemuDomainAttachDiskGeneric(virQEMUDriverPtr driver,
             VIR_WARN("failed to set blkdeviotune for '%s' of '%s'", disk->dst, vm->def->name);
     }
 
+    /* Latency histograms can be set only once the frontend exists. Same as
+     * with throttling above, a failure doesn't make the attach fail. */
+    if (qemuDiskConfigLatencyHistogramsEnabled(disk)) {
+        qemuDomainDiskPrivatePtr diskPriv = QEMU_DOMAIN_DISK_PRIVATE(disk);
+        const char *id = diskPriv->qomName ? diskPriv->qomName : disk->info.alias;
+
+        if (qemuMonitorBlockLatencyHistogramSet(priv->mon, id,
+                                                disk->latencyHistograms) < 0)
+            VIR_WARN("failed to set latency histograms for '%s' of '%s'",
+                     disk->dst, vm->def->name);
+    }
+
     if (qemuDomainObjExitMonitor(driver, vm) < 0) {
         ret = -2;
         goto cleanup;
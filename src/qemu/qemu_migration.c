@@ -24,6 +24,7 @@
 #include <sys/time.h>
 #include <fcntl.h>
 #include <poll.h>
+#include <gio/gio.h>
 
 #include "qemu_migration.h"
 #include "qemu_migration_cookie.h"
@@ -295,6 +296,36 @@ qemuMigrationAnyCopyDisk(virDomainDiskDef const *disk,
 }
 
 
+typedef struct _qemuMigrationPrecreateData qemuMigrationPrecreateData;
+typedef qemuMigrationPrecreateData *qemuMigrationPrecreateDataPtr;
+struct _qemuMigrationPrecreateData {
+    virConnectPtr conn;
+    virDomainDiskDefPtr disk;
+    unsigned long long capacity;
+    virThread thread;
+    virErrorPtr err;
+};
+
+
+static void
+qemuMigrationDstPrecreateDiskThread(void *opaque)
+{
+    qemuMigrationPrecreateDataPtr data = opaque;
+
+    if (qemuMigrationDstPrecreateDisk(data->conn, data->disk,
+                                      data->capacity) < 0)
+        virErrorPreserveLast(&data->err);
+}
+
+
+/**
+ * qemuMigrationDstPrecreateStorage:
+ *
+ * Creates all missing disks which are going to be copied from the source.
+ * Creating a volume may take long (e.g., when it needs to be allocated), so
+ * each volume is created in its own thread. The function waits for all of
+ * them and reports the first error encountered.
+ */
 static int
 qemuMigrationDstPrecreateStorage(virDomainObjPtr vm,
                                  qemuMigrationCookieNBDPtr nbd,
@@ -304,7 +335,10 @@ qemuMigrationDstPrecreateStorage(virDomainObjPtr vm,
 {
     int ret = -1;
     size_t i = 0;
+    size_t nthreads = 0;
     virConnectPtr conn;
+    g_autofree qemuMigrationPrecreateDataPtr data = NULL;
+    virErrorPtr err = NULL;
 
     if (!nbd || !nbd->ndisks)
         return 0;
@@ -312,6 +346,8 @@ qemuMigrationDstPrecreateStorage(virDomainObjPtr vm,
     if (!(conn = virGetConnectStorage()))
         return -1;
 
+    data = g_new0(qemuMigrationPrecreateData, nbd->ndisks);
+
     for (i = 0; i < nbd->ndisks; i++) {
         virDomainDiskDefPtr disk;
         const char *diskSrcPath;
@@ -349,12 +385,36 @@ qemuMigrationDstPrecreateStorage(virDomainObjPtr vm,
 
         VIR_DEBUG("Proceeding with disk source %s", NULLSTR(diskSrcPath));
 
-        if (qemuMigrationDstPrecreateDisk(conn, disk, nbd->disks[i].capacity) < 0)
+        data[nthreads].conn = conn;
+        data[nthreads].disk = disk;
+        data[nthreads].capacity = nbd->disks[i].capacity;
+
+        if (virThreadCreateFull(&data[nthreads].thread, true,
+                                qemuMigrationDstPrecreateDiskThread,
+                                "mig-precreate", false, &data[nthreads]) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("unable to create storage precreation thread"));
             goto cleanup;
+        }
+        nthreads++;
     }
 
     ret = 0;
  cleanup:
+    for (i = 0; i < nthreads; i++) {
+        virThreadJoin(&data[i].thread);
+
+        if (!data[i].err)
+            continue;
+
+        if (ret == 0) {
+            err = g_steal_pointer(&data[i].err);
+            ret = -1;
+        } else {
+            virFreeError(data[i].err);
+        }
+    }
+    virErrorRestore(&err);
     virObjectUnref(conn);
     return ret;
 }
@@ -975,6 +1035,95 @@ qemuMigrationSrcNBDStorageCopyOne(virQEMUDriverPtr driver,
 }
 
 
+typedef struct _qemuMigrationNBDDisk qemuMigrationNBDDisk;
+struct _qemuMigrationNBDDisk {
+    virDomainDiskDefPtr disk;
+    unsigned long long size;
+};
+
+
+static int
+qemuMigrationNBDDiskCompare(const void *a,
+                            const void *b)
+{
+    const qemuMigrationNBDDisk *da = a;
+    const qemuMigrationNBDDisk *db = b;
+
+    /* largest first */
+    if (da->size > db->size)
+        return -1;
+    if (da->size < db->size)
+        return 1;
+    return 0;
+}
+
+
+/**
+ * qemuMigrationSrcNBDStorageCopySort:
+ * @driver: qemu driver
+ * @vm: domain
+ * @disks: disks to be copied
+ * @ndisks: number of @disks
+ *
+ * Sorts @disks so that the largest ones are copied first, which gives the
+ * shortest overall time when only a limited number of disks is copied at
+ * the same time. The order is kept if disk sizes cannot be queried.
+ */
+static void
+qemuMigrationSrcNBDStorageCopySort(virQEMUDriverPtr driver,
+                                   virDomainObjPtr vm,
+                                   qemuMigrationNBDDisk *disks,
+                                   size_t ndisks)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    bool blockdev = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV);
+    virHashTablePtr blockstats = NULL;
+    size_t i;
+    int rc;
+
+    if (qemuDomainObjEnterMonitorAsync(driver, vm,
+                                       QEMU_ASYNC_JOB_MIGRATION_OUT) < 0)
+        goto error;
+
+    rc = qemuMonitorGetAllBlockStatsInfo(priv->mon, &blockstats, false);
+    if (rc >= 0) {
+        if (blockdev)
+            rc = qemuMonitorBlockStatsUpdateCapacityBlockdev(priv->mon,
+                                                             blockstats);
+        else
+            rc = qemuMonitorBlockStatsUpdateCapacity(priv->mon, blockstats,
+                                                     false);
+    }
+
+    if (qemuDomainObjExitMonitor(driver, vm) < 0 || rc < 0)
+        goto error;
+
+    for (i = 0; i < ndisks; i++) {
+        virDomainDiskDefPtr disk = disks[i].disk;
+        qemuBlockStatsPtr stats;
+        const char *entryname = disk->info.alias;
+
+        if (blockdev)
+            entryname = disk->src->nodeformat;
+
+        if (!entryname || !(stats = virHashLookup(blockstats, entryname)))
+            continue;
+
+        disks[i].size = stats->physical ? stats->physical : stats->capacity;
+    }
+
+    qsort(disks, ndisks, sizeof(*disks), qemuMigrationNBDDiskCompare);
+    virHashFree(blockstats);
+    return;
+
+ error:
+    VIR_WARN("Unable to order disks of domain %s by size: %s",
+             vm->def->name, virGetLastErrorMessage());
+    virResetLastError();
+    virHashFree(blockstats);
+}
+
+
 /**
  * qemuMigrationSrcNBDStorageCopy:
  * @driver: qemu driver
@@ -983,9 +1132,13 @@ qemuMigrationSrcNBDStorageCopyOne(virQEMUDriverPtr driver,
  * @host: where are we migrating to
  * @speed: bandwidth limit in MiB/s
  * @migrate_flags: migrate monitor command flags
+ * @concurrency: maximum number of disks copied at the same time, 0 for all
  *
  * Migrate non-shared storage using the NBD protocol to the server running
  * inside the qemu process on dst and wait until the copy converges.
+ * When @concurrency is limited, the largest disks are started first, another
+ * one is started whenever a mirror gets ready, and the bandwidth limit is
+ * shared by the mirrors running at the same time.
  * On success update @migrate_flags so we don't tell 'migrate' command
  * to do the very same operation. On failure, the caller is
  * expected to call qemuMigrationSrcNBDCopyCancel to stop all
@@ -1005,13 +1158,18 @@ qemuMigrationSrcNBDStorageCopy(virQEMUDriverPtr driver,
                                const char **migrate_disks,
                                virConnectPtr dconn,
                                const char *tlsAlias,
-                               unsigned int flags)
+                               unsigned int flags,
+                               size_t concurrency)
 {
     qemuDomainObjPrivatePtr priv = vm->privateData;
     int port;
     size_t i;
     unsigned long long mirror_speed = speed;
     bool mirror_shallow = *migrate_flags & QEMU_MONITOR_MIGRATE_NON_SHARED_INC;
+    g_autofree qemuMigrationNBDDisk *disks = NULL;
+    size_t ndisks = 0;
+    size_t next = 0;
+    size_t syncing;
     int rv;
     g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
 
@@ -1029,28 +1187,51 @@ qemuMigrationSrcNBDStorageCopy(virQEMUDriverPtr driver,
     port = mig->nbd->port;
     mig->nbd->port = 0;
 
+    disks = g_new0(qemuMigrationNBDDisk, vm->def->ndisks);
     for (i = 0; i < vm->def->ndisks; i++) {
-        virDomainDiskDefPtr disk = vm->def->disks[i];
-
         /* check whether disk should be migrated */
-        if (!qemuMigrationAnyCopyDisk(disk, nmigrate_disks, migrate_disks))
-            continue;
-
-        if (qemuMigrationSrcNBDStorageCopyOne(driver, vm, disk, host, port,
-                                              mirror_speed, mirror_shallow,
-                                              tlsAlias, flags) < 0)
-            return -1;
+        if (qemuMigrationAnyCopyDisk(vm->def->disks[i],
+                                     nmigrate_disks, migrate_disks))
+            disks[ndisks++].disk = vm->def->disks[i];
+    }
 
-        if (virDomainObjSave(vm, driver->xmlopt, cfg->stateDir) < 0) {
-            VIR_WARN("Failed to save status on vm %s", vm->def->name);
-            return -1;
-        }
+    if (concurrency == 0 || concurrency > ndisks) {
+        concurrency = ndisks;
+    } else {
+        qemuMigrationSrcNBDStorageCopySort(driver, vm, disks, ndisks);
+        mirror_speed /= concurrency;
+        VIR_DEBUG("Copying at most %zu disks at the same time", concurrency);
     }
 
-    while ((rv = qemuMigrationSrcNBDStorageCopyReady(vm, QEMU_ASYNC_JOB_MIGRATION_OUT)) != 1) {
+    while ((rv = qemuMigrationSrcNBDStorageCopyReady(vm, QEMU_ASYNC_JOB_MIGRATION_OUT)) != 1 ||
+           next < ndisks) {
         if (rv < 0)
             return -1;
 
+        syncing = 0;
+        for (i = 0; i < next; i++) {
+            if (disks[i].disk->mirrorState != VIR_DOMAIN_DISK_MIRROR_STATE_READY)
+                syncing++;
+        }
+
+        if (next < ndisks && syncing < concurrency) {
+            for (; next < ndisks && syncing < concurrency; next++, syncing++) {
+                if (qemuMigrationSrcNBDStorageCopyOne(driver, vm,
+                                                      disks[next].disk,
+                                                      host, port,
+                                                      mirror_speed,
+                                                      mirror_shallow,
+                                                      tlsAlias, flags) < 0)
+                    return -1;
+
+                if (virDomainObjSave(vm, driver->xmlopt, cfg->stateDir) < 0) {
+                    VIR_WARN("Failed to save status on vm %s", vm->def->name);
+                    return -1;
+                }
+            }
+            continue;
+        }
+
         if (priv->job.abortJob) {
             priv->job.current->status = QEMU_DOMAIN_JOB_STATUS_CANCELED;
             virReportError(VIR_ERR_OPERATION_ABORTED, _("%s: %s"),
@@ -1700,6 +1881,113 @@ qemuMigrationAnyCompleted(virQEMUDriverPtr driver,
 }
 
 
+/* How often the downtime policy checks the progress of migration */
+#define QEMU_MIGRATION_POLICY_INTERVAL 1000 /* ms */
+
+typedef struct _qemuMigrationSrcPolicyState qemuMigrationSrcPolicyState;
+typedef qemuMigrationSrcPolicyState *qemuMigrationSrcPolicyStatePtr;
+struct _qemuMigrationSrcPolicyState {
+    qemuMigrationPolicy policy;
+    bool postcopy; /* switching to post-copy is allowed */
+    unsigned long long iteration; /* last evaluated memory iteration */
+    unsigned int exceeded; /* iterations above the downtime target */
+    unsigned long long next; /* when to check again */
+    bool done;
+};
+
+
+/**
+ * qemuMigrationSrcPolicyCheck:
+ *
+ * Projects the downtime of a running migration from the remaining memory
+ * and the current bandwidth once per memory iteration. When the projection
+ * stays above the target for the configured number of iterations (or when
+ * the guest dirties memory faster than it can be transferred), CPU
+ * throttling is raised and once it cannot be raised any further, the
+ * migration is switched to post-copy if allowed.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int
+qemuMigrationSrcPolicyCheck(virQEMUDriverPtr driver,
+                            virDomainObjPtr vm,
+                            qemuDomainAsyncJob asyncJob,
+                            qemuMigrationSrcPolicyStatePtr state)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    qemuMonitorMigrationStats stats = { 0 };
+    unsigned long long downtime;
+    unsigned long long dirty;
+    int rc;
+
+    if (qemuDomainObjEnterMonitorAsync(driver, vm, asyncJob) < 0)
+        return -1;
+
+    rc = qemuMonitorGetMigrationStats(priv->mon, &stats, NULL);
+
+    if (qemuDomainObjExitMonitor(driver, vm) < 0 || rc < 0)
+        return -1;
+
+    /* Bandwidth and dirty rate are only known once the first pass ended */
+    if (stats.status != QEMU_MONITOR_MIGRATION_STATUS_ACTIVE ||
+        stats.ram_iteration <= state->iteration ||
+        stats.ram_bps == 0)
+        return 0;
+
+    state->iteration = stats.ram_iteration;
+    downtime = stats.ram_remaining / stats.ram_bps * 1000 +
+               stats.ram_remaining % stats.ram_bps * 1000 / stats.ram_bps;
+    dirty = stats.ram_dirty_rate * stats.ram_page_size;
+
+    VIR_DEBUG("Migration iteration %llu: projected downtime %llu ms "
+              "(target %llu ms), dirty rate %llu B/s, bandwidth %llu B/s",
+              stats.ram_iteration, downtime, state->policy.downtime,
+              dirty, stats.ram_bps);
+
+    if (downtime <= state->policy.downtime) {
+        state->exceeded = 0;
+        return 0;
+    }
+
+    if (dirty >= stats.ram_bps)
+        state->exceeded = state->policy.iterations;
+    else
+        state->exceeded++;
+
+    if (state->exceeded < state->policy.iterations)
+        return 0;
+
+    state->exceeded = 0;
+
+    if ((rc = qemuMigrationParamsRaiseThrottle(driver, vm, asyncJob,
+                                               &state->policy)) != 0)
+        return rc < 0 ? -1 : 0;
+
+    state->done = true;
+
+    if (!state->postcopy) {
+        VIR_WARN("Migration of domain %s cannot reach downtime target "
+                 "of %llu ms, projected downtime is %llu ms",
+                 vm->def->name, state->policy.downtime, downtime);
+        return 0;
+    }
+
+    VIR_INFO("Switching migration of domain %s to post-copy, projected "
+             "downtime %llu ms exceeds target of %llu ms",
+             vm->def->name, downtime, state->policy.downtime);
+
+    if (qemuDomainObjEnterMonitorAsync(driver, vm, asyncJob) < 0)
+        return -1;
+
+    rc = qemuMonitorMigrateStartPostCopy(priv->mon);
+
+    if (qemuDomainObjExitMonitor(driver, vm) < 0 || rc < 0)
+        return -1;
+
+    return 0;
+}
+
+
 /* Returns 0 on success, -2 when migration needs to be cancelled, or -1 when
  * QEMU reports failed migration.
  */
@@ -1708,21 +1996,47 @@ qemuMigrationSrcWaitForCompletion(virQEMUDriverPtr driver,
                                   virDomainObjPtr vm,
                                   qemuDomainAsyncJob asyncJob,
                                   virConnectPtr dconn,
-                                  unsigned int flags)
+                                  unsigned int flags,
+                                  qemuMigrationParamsPtr migParams)
 {
     qemuDomainObjPrivatePtr priv = vm->privateData;
     qemuDomainJobInfoPtr jobInfo = priv->job.current;
     bool events = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_MIGRATION_EVENT);
+    qemuMigrationSrcPolicyState state = { 0 };
+    unsigned long long now;
     int rv;
 
     jobInfo->status = QEMU_DOMAIN_JOB_STATUS_MIGRATING;
 
+    if (!migParams || !qemuMigrationParamsGetPolicy(migParams, &state.policy))
+        state.done = true;
+    state.postcopy = !!(flags & QEMU_MIGRATION_COMPLETED_POSTCOPY);
+
     while ((rv = qemuMigrationAnyCompleted(driver, vm, asyncJob,
                                            dconn, flags)) != 1) {
         if (rv < 0)
             return rv;
 
-        if (events) {
+        if (!state.done && virTimeMillisNow(&now) == 0 && now >= state.next) {
+            if (qemuMigrationSrcPolicyCheck(driver, vm, asyncJob, &state) < 0) {
+                VIR_WARN("Disabling downtime policy for migration of "
+                         "domain %s: %s",
+                         vm->def->name, virGetLastErrorMessage());
+                virResetLastError();
+                state.done = true;
+            }
+            state.next = now + QEMU_MIGRATION_POLICY_INTERVAL;
+        }
+
+        if (events && !state.done) {
+            /* Wake up periodically to let the policy check the progress */
+            if (virDomainObjWaitUntil(vm, state.next) < 0 ||
+                !virDomainObjIsActive(vm)) {
+                if (virDomainObjIsActive(vm))
+                    jobInfo->status = QEMU_DOMAIN_JOB_STATUS_FAILED;
+                return -2;
+            }
+        } else if (events) {
             if (virDomainObjWait(vm) < 0) {
                 if (virDomainObjIsActive(vm))
                     jobInfo->status = QEMU_DOMAIN_JOB_STATUS_FAILED;
@@ -1743,6 +2057,7 @@ qemuMigrationSrcWaitForCompletion(virQEMUDriverPtr driver,
 
     qemuDomainJobInfoUpdateTime(jobInfo);
     qemuDomainJobInfoUpdateDowntime(jobInfo);
+    qemuDomainJobInfoUpdateLockStats(jobInfo, vm);
     g_clear_pointer(&priv->job.completed, qemuDomainJobInfoFree);
     priv->job.completed = qemuDomainJobInfoCopy(jobInfo);
     priv->job.completed->status = QEMU_DOMAIN_JOB_STATUS_COMPLETED;
@@ -2112,6 +2427,13 @@ qemuMigrationSrcBeginPhase(virQEMUDriverPtr driver,
         return NULL;
     }
 
+    if (flags & VIR_MIGRATE_PARALLEL && flags & VIR_MIGRATE_TUNNELLED) {
+        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED, "%s",
+                       _("parallel migration is not supported with tunnelled "
+                         "migration, use native TLS migration instead"));
+        return NULL;
+    }
+
     if (flags & (VIR_MIGRATE_NON_SHARED_DISK | VIR_MIGRATE_NON_SHARED_INC)) {
         if (nmigrate_disks) {
             size_t i, j;
@@ -2371,6 +2693,172 @@ qemuMigrationDstPrepare(virDomainObjPtr vm,
                                      migrateFrom, fd, NULL);
 }
 
+#define TUNNEL_SEND_BUF_SIZE 65536
+
+typedef int (*qemuMigrationTunnelOutputFunc)(const char *buf,
+                                             size_t len,
+                                             void *opaque);
+
+/*
+ * Runs @in through @converter and passes every chunk of output collected
+ * in @out to @output. With G_CONVERTER_INPUT_AT_END in @flags the converter
+ * is drained completely.
+ */
+static int
+qemuMigrationTunnelConvert(GConverter *converter,
+                           const char *in,
+                           size_t inlen,
+                           GConverterFlags flags,
+                           char *out,
+                           size_t outlen,
+                           qemuMigrationTunnelOutputFunc output,
+                           void *opaque)
+{
+    size_t inpos = 0;
+
+    for (;;) {
+        g_autoptr(GError) err = NULL;
+        GConverterResult res;
+        gsize nread = 0;
+        gsize nwritten = 0;
+
+        res = g_converter_convert(converter,
+                                  in + inpos, inlen - inpos,
+                                  out, outlen,
+                                  flags, &nread, &nwritten, &err);
+
+        if (res == G_CONVERTER_ERROR) {
+            /* all input was consumed and there's no output pending */
+            if (inpos == inlen &&
+                g_error_matches(err, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT))
+                return 0;
+
+            virReportError(VIR_ERR_OPERATION_FAILED,
+                           _("failed to convert tunnelled migration data: %s"),
+                           err->message);
+            return -1;
+        }
+
+        inpos += nread;
+
+        if (nwritten > 0 && output(out, nwritten, opaque) < 0)
+            return -1;
+
+        if (res == G_CONVERTER_FINISHED)
+            return 0;
+
+        /* A full output buffer means the converter may have more */
+        if (inpos == inlen && nwritten < outlen &&
+            !(flags & G_CONVERTER_INPUT_AT_END))
+            return 0;
+    }
+}
+
+
+typedef struct _qemuMigrationDstDecompress qemuMigrationDstDecompress;
+struct _qemuMigrationDstDecompress {
+    int in;     /* compressed data written by the stream */
+    int out;    /* decompressed data read by QEMU */
+    GConverter *decompressor;
+};
+
+
+static int
+qemuMigrationDstDecompressWrite(const char *buf,
+                                size_t len,
+                                void *opaque)
+{
+    qemuMigrationDstDecompress *data = opaque;
+
+    if (safewrite(data->out, buf, len) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("failed to pass tunnelled migration data to qemu"));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static void
+qemuMigrationDstDecompressFunc(void *opaque)
+{
+    qemuMigrationDstDecompress *data = opaque;
+    g_autofree char *buffer = g_new(char, TUNNEL_SEND_BUF_SIZE);
+    g_autofree char *decompressed = g_new(char, TUNNEL_SEND_BUF_SIZE);
+    ssize_t nbytes;
+
+    while ((nbytes = saferead(data->in, buffer, TUNNEL_SEND_BUF_SIZE)) > 0) {
+        if (qemuMigrationTunnelConvert(data->decompressor, buffer, nbytes,
+                                       G_CONVERTER_NO_FLAGS,
+                                       decompressed, TUNNEL_SEND_BUF_SIZE,
+                                       qemuMigrationDstDecompressWrite,
+                                       data) < 0)
+            goto cleanup;
+    }
+
+    if (nbytes < 0) {
+        virReportSystemError(errno, "%s",
+                             _("failed to read tunnelled migration data"));
+        goto cleanup;
+    }
+
+    ignore_value(qemuMigrationTunnelConvert(data->decompressor, NULL, 0,
+                                            G_CONVERTER_INPUT_AT_END,
+                                            decompressed, TUNNEL_SEND_BUF_SIZE,
+                                            qemuMigrationDstDecompressWrite,
+                                            data));
+
+ cleanup:
+    /* Closing the pipes makes both the stream and QEMU notice a failure,
+     * the error itself was logged when reported */
+    VIR_FORCE_CLOSE(data->in);
+    VIR_FORCE_CLOSE(data->out);
+    g_object_unref(data->decompressor);
+    g_free(data);
+}
+
+
+/*
+ * Starts a thread which decompresses the tunnelled migration stream and
+ * passes the result to QEMU through @fd. The thread takes over @fd on
+ * success.
+ *
+ * Returns the file descriptor the stream should write to or -1 on error.
+ */
+static int
+qemuMigrationDstStartDecompress(int fd)
+{
+    qemuMigrationDstDecompress *data;
+    int pipeFD[2] = { -1, -1 };
+    virThread thread;
+
+    if (virPipe(pipeFD) < 0)
+        return -1;
+
+    data = g_new0(qemuMigrationDstDecompress, 1);
+    data->in = pipeFD[0];
+    data->out = fd;
+    data->decompressor = G_CONVERTER(g_zlib_decompressor_new(G_ZLIB_COMPRESSOR_FORMAT_ZLIB));
+
+    if (virThreadCreateFull(&thread, false,
+                            qemuMigrationDstDecompressFunc,
+                            "qemu-mig-unzip",
+                            false,
+                            data) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to create migration thread"));
+        VIR_FORCE_CLOSE(pipeFD[0]);
+        VIR_FORCE_CLOSE(pipeFD[1]);
+        g_object_unref(data->decompressor);
+        g_free(data);
+        return -1;
+    }
+
+    return pipeFD[1];
+}
+
+
 static int
 qemuMigrationDstPrepareAny(virQEMUDriverPtr driver,
                            virConnectPtr dconn,
@@ -2396,6 +2884,8 @@ qemuMigrationDstPrepareAny(virQEMUDriverPtr driver,
     virErrorPtr origErr;
     int ret = -1;
     int dataFD[2] = { -1, -1 };
+    int parallelConnections = 0;
+    int preallocThreads;
     qemuDomainObjPrivatePtr priv = NULL;
     qemuMigrationCookiePtr mig = NULL;
     qemuDomainJobPrivatePtr jobPriv = NULL;
@@ -2453,6 +2943,13 @@ qemuMigrationDstPrepareAny(virQEMUDriverPtr driver,
         goto cleanup;
     }
 
+    if (flags & VIR_MIGRATE_PARALLEL && flags & VIR_MIGRATE_TUNNELLED) {
+        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED, "%s",
+                       _("parallel migration is not supported with tunnelled "
+                         "migration, use native TLS migration instead"));
+        goto cleanup;
+    }
+
     if (!qemuMigrationSrcIsAllowedHostdev(*def))
         goto cleanup;
 
@@ -2549,7 +3046,7 @@ qemuMigrationDstPrepareAny(virQEMUDriverPtr driver,
     qemuMigrationJobSetPhase(driver, vm, QEMU_MIGRATION_PHASE_PREPARE);
 
     /* Domain starts inactive, even if the domain XML had an id field. */
-    vm->def->id = -1;
+    virDomainObjListSetID(driver->domains, vm, -1);
 
     if (flags & VIR_MIGRATE_OFFLINE)
         goto done;
@@ -2567,6 +3064,13 @@ qemuMigrationDstPrepareAny(virQEMUDriverPtr driver,
 
     priv->allowReboot = mig->allowReboot;
 
+    if ((preallocThreads = qemuMigrationParamsGetPreallocThreads(migParams)) >= 0) {
+        if (preallocThreads == 0)
+            priv->memPreallocThreads = QEMU_DOMAIN_MEM_PREALLOC_THREADS_AUTO;
+        else
+            priv->memPreallocThreads = preallocThreads;
+    }
+
     if (!(incoming = qemuMigrationDstPrepare(vm, tunnel, protocol,
                                              listenAddress, port,
                                              dataFD[0])))
@@ -2590,6 +3094,17 @@ qemuMigrationDstPrepareAny(virQEMUDriverPtr driver,
     relabel = true;
 
     if (tunnel) {
+        if (mig->caps->tunnelCompress) {
+            int fd;
+
+            if ((fd = qemuMigrationDstStartDecompress(dataFD[1])) < 0)
+                goto stopjob;
+
+            /* the decompressing thread owns the pipe to QEMU now */
+            dataFD[1] = fd;
+            jobPriv->tunnelCompressed = true;
+        }
+
         if (virFDStreamOpen(st, dataFD[1]) < 0) {
             virReportSystemError(errno, "%s",
                                  _("cannot pass pipe for tunnelled migration"));
@@ -2603,6 +3118,14 @@ qemuMigrationDstPrepareAny(virQEMUDriverPtr driver,
         goto stopjob;
     }
 
+    /* Size parallel migration automatically only if the source is able to
+     * use the number we send back, both sides have to agree on it */
+    if (mig->caps->parallelAuto)
+        parallelConnections = qemuMigrationParamsGetAutoParallelConnections();
+    priv->job.current->parallelConnections =
+        qemuMigrationParamsSetParallelConnections(migParams, flags,
+                                                  parallelConnections);
+
     if (qemuMigrationParamsCheck(driver, vm, QEMU_ASYNC_JOB_MIGRATION_IN,
                                  migParams, mig->caps->automatic) < 0)
         goto stopjob;
@@ -3172,8 +3695,6 @@ struct _qemuMigrationSpec {
     } fwd;
 };
 
-#define TUNNEL_SEND_BUF_SIZE 65536
-
 typedef struct _qemuMigrationIOThread qemuMigrationIOThread;
 typedef qemuMigrationIOThread *qemuMigrationIOThreadPtr;
 struct _qemuMigrationIOThread {
@@ -3183,22 +3704,46 @@ struct _qemuMigrationIOThread {
     virError err;
     int wakeupRecvFD;
     int wakeupSendFD;
+    GConverter *compressor;     /* NULL if the tunnel is not compressed */
+    qemuDomainTunnelStats stats;
 };
 
+
+static int
+qemuMigrationSrcIOSend(const char *buf,
+                       size_t len,
+                       void *opaque)
+{
+    qemuMigrationIOThreadPtr data = opaque;
+
+    if (virStreamSend(data->st, buf, len) < 0)
+        return -1;
+
+    virMutexLock(&data->stats.lock);
+    data->stats.sent += len;
+    virMutexUnlock(&data->stats.lock);
+
+    return 0;
+}
+
 static void qemuMigrationSrcIOFunc(void *arg)
 {
     qemuMigrationIOThreadPtr data = arg;
     char *buffer = NULL;
+    g_autofree char *compressed = NULL;
     struct pollfd fds[2];
     int timeout = -1;
     virErrorPtr err = NULL;
 
-    VIR_DEBUG("Running migration tunnel; stream=%p, sock=%d",
-              data->st, data->sock);
+    VIR_DEBUG("Running migration tunnel; stream=%p, sock=%d, compressed=%d",
+              data->st, data->sock, !!data->compressor);
 
     if (VIR_ALLOC_N(buffer, TUNNEL_SEND_BUF_SIZE) < 0)
         goto abrt;
 
+    if (data->compressor)
+        compressed = g_new(char, TUNNEL_SEND_BUF_SIZE);
+
     fds[0].fd = data->sock;
     fds[1].fd = data->wakeupRecvFD;
 
@@ -3250,8 +3795,22 @@ static void qemuMigrationSrcIOFunc(void *arg)
 
             nbytes = saferead(data->sock, buffer, TUNNEL_SEND_BUF_SIZE);
             if (nbytes > 0) {
-                if (virStreamSend(data->st, buffer, nbytes) < 0)
+                virMutexLock(&data->stats.lock);
+                data->stats.raw += nbytes;
+                virMutexUnlock(&data->stats.lock);
+
+                if (data->compressor) {
+                    if (qemuMigrationTunnelConvert(data->compressor,
+                                                   buffer, nbytes,
+                                                   G_CONVERTER_NO_FLAGS,
+                                                   compressed,
+                                                   TUNNEL_SEND_BUF_SIZE,
+                                                   qemuMigrationSrcIOSend,
+                                                   data) < 0)
+                        goto error;
+                } else if (qemuMigrationSrcIOSend(buffer, nbytes, data) < 0) {
                     goto error;
+                }
             } else if (nbytes < 0) {
                 virReportSystemError(errno, "%s",
                         _("tunnelled migration failed to read from qemu"));
@@ -3263,6 +3822,13 @@ static void qemuMigrationSrcIOFunc(void *arg)
         }
     }
 
+    if (data->compressor &&
+        qemuMigrationTunnelConvert(data->compressor, NULL, 0,
+                                   G_CONVERTER_INPUT_AT_END,
+                                   compressed, TUNNEL_SEND_BUF_SIZE,
+                                   qemuMigrationSrcIOSend, data) < 0)
+        goto error;
+
     if (virStreamFinish(data->st) < 0)
         goto error;
 
@@ -3291,9 +3857,14 @@ static void qemuMigrationSrcIOFunc(void *arg)
 }
 
 
+/*
+ * Starts the IO thread forwarding migration data from @sock to @st. If
+ * @compressionLevel is non-zero, the data is compressed with zlib.
+ */
 static qemuMigrationIOThreadPtr
 qemuMigrationSrcStartTunnel(virStreamPtr st,
-                            int sock)
+                            int sock,
+                            unsigned int compressionLevel)
 {
     qemuMigrationIOThreadPtr io = NULL;
     int wakeupFD[2] = { -1, -1 };
@@ -3304,11 +3875,22 @@ qemuMigrationSrcStartTunnel(virStreamPtr st,
     if (VIR_ALLOC(io) < 0)
         goto error;
 
+    if (virMutexInit(&io->stats.lock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to initialize mutex"));
+        VIR_FREE(io);
+        goto error;
+    }
+
     io->st = st;
     io->sock = sock;
     io->wakeupRecvFD = wakeupFD[0];
     io->wakeupSendFD = wakeupFD[1];
 
+    if (compressionLevel > 0)
+        io->compressor = G_CONVERTER(g_zlib_compressor_new(G_ZLIB_COMPRESSOR_FORMAT_ZLIB,
+                                                           compressionLevel));
+
     if (virThreadCreateFull(&io->thread, true,
                             qemuMigrationSrcIOFunc,
                             "qemu-mig-tunnel",
@@ -3316,6 +3898,9 @@ qemuMigrationSrcStartTunnel(virStreamPtr st,
                             io) < 0) {
         virReportSystemError(errno, "%s",
                              _("Unable to create migration thread"));
+        g_clear_object(&io->compressor);
+        virMutexDestroy(&io->stats.lock);
+        VIR_FREE(io);
         goto error;
     }
 
@@ -3324,12 +3909,13 @@ qemuMigrationSrcStartTunnel(virStreamPtr st,
  error:
     VIR_FORCE_CLOSE(wakeupFD[0]);
     VIR_FORCE_CLOSE(wakeupFD[1]);
-    VIR_FREE(io);
     return NULL;
 }
 
 static int
-qemuMigrationSrcStopTunnel(qemuMigrationIOThreadPtr io, bool error)
+qemuMigrationSrcStopTunnel(qemuMigrationIOThreadPtr io,
+                           qemuDomainJobInfoPtr jobInfo,
+                           bool error)
 {
     int rv = -1;
     char stop = error ? 1 : 0;
@@ -3343,6 +3929,9 @@ qemuMigrationSrcStopTunnel(qemuMigrationIOThreadPtr io, bool error)
 
     virThreadJoin(&io->thread);
 
+    if (jobInfo)
+        qemuDomainJobInfoUpdateTunnel(jobInfo, &io->stats);
+
     /* Forward error from the IO thread, to this thread */
     if (io->err.code != VIR_ERR_OK) {
         if (error)
@@ -3358,6 +3947,8 @@ qemuMigrationSrcStopTunnel(qemuMigrationIOThreadPtr io, bool error)
  cleanup:
     VIR_FORCE_CLOSE(io->wakeupSendFD);
     VIR_FORCE_CLOSE(io->wakeupRecvFD);
+    g_clear_object(&io->compressor);
+    virMutexDestroy(&io->stats.lock);
     VIR_FREE(io);
     return rv;
 }
@@ -3479,6 +4070,7 @@ qemuMigrationSrcRun(virQEMUDriverPtr driver,
     int ret = -1;
     unsigned int migrate_flags = QEMU_MONITOR_MIGRATE_BACKGROUND;
     qemuDomainObjPrivatePtr priv = vm->privateData;
+    qemuDomainJobPrivatePtr jobPriv = priv->job.privateData;
     g_autoptr(qemuMigrationCookie) mig = NULL;
     g_autofree char *tlsAlias = NULL;
     qemuMigrationIOThreadPtr iothread = NULL;
@@ -3553,6 +4145,12 @@ qemuMigrationSrcRun(virQEMUDriverPtr driver,
     if (qemuMigrationSrcGraphicsRelocate(driver, vm, mig, graphicsuri) < 0)
         VIR_WARN("unable to provide data for graphics client relocation");
 
+    /* Use the number of parallel connections chosen by the destination,
+     * older daemons don't send it and leave the default to QEMU */
+    priv->job.current->parallelConnections =
+        qemuMigrationParamsSetParallelConnections(migParams, flags,
+                                                  mig->caps->parallelConnections);
+
     if (qemuMigrationParamsCheck(driver, vm, QEMU_ASYNC_JOB_MIGRATION_OUT,
                                  migParams, mig->caps->automatic) < 0)
         goto error;
@@ -3588,6 +4186,8 @@ qemuMigrationSrcRun(virQEMUDriverPtr driver,
     if (migrate_flags & (QEMU_MONITOR_MIGRATE_NON_SHARED_DISK |
                          QEMU_MONITOR_MIGRATE_NON_SHARED_INC)) {
         if (mig->nbd) {
+            size_t disksConcurrency = qemuMigrationParamsGetDisksConcurrency(migParams);
+
             /* Currently libvirt does not support setting up of the NBD
              * non-shared storage migration with TLS. As we need to honour the
              * VIR_MIGRATE_TLS flag, we need to reject such migration until
@@ -3606,7 +4206,8 @@ qemuMigrationSrcRun(virQEMUDriverPtr driver,
                                                &migrate_flags,
                                                nmigrate_disks,
                                                migrate_disks,
-                                               dconn, tlsAlias, flags) < 0) {
+                                               dconn, tlsAlias, flags,
+                                               disksConcurrency) < 0) {
                 goto error;
             }
         } else {
@@ -3693,8 +4294,19 @@ qemuMigrationSrcRun(virQEMUDriverPtr driver,
     cancel = true;
 
     if (spec->fwdType != MIGRATION_FWD_DIRECT) {
-        if (!(iothread = qemuMigrationSrcStartTunnel(spec->fwd.stream, fd)))
+        unsigned int compressionLevel = 0;
+
+        /* the destination agreed to decompress what we offered in Begin */
+        if (mig->caps->tunnelCompress) {
+            g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+
+            compressionLevel = MAX(cfg->migrationTunnelCompressionLevel, 1);
+        }
+
+        if (!(iothread = qemuMigrationSrcStartTunnel(spec->fwd.stream, fd,
+                                                     compressionLevel)))
             goto error;
+        jobPriv->tunnelStats = &iothread->stats;
         /* If we've created a tunnel, then the 'fd' will be closed in the
          * qemuMigrationIOFunc as data->sock.
          */
@@ -3711,7 +4323,7 @@ qemuMigrationSrcRun(virQEMUDriverPtr driver,
 
     rc = qemuMigrationSrcWaitForCompletion(driver, vm,
                                            QEMU_ASYNC_JOB_MIGRATION_OUT,
-                                           dconn, waitFlags);
+                                           dconn, waitFlags, migParams);
     if (rc == -2) {
         goto error;
     } else if (rc == -1) {
@@ -3751,7 +4363,7 @@ qemuMigrationSrcRun(virQEMUDriverPtr driver,
 
         rc = qemuMigrationSrcWaitForCompletion(driver, vm,
                                                QEMU_ASYNC_JOB_MIGRATION_OUT,
-                                               dconn, waitFlags);
+                                               dconn, waitFlags, NULL);
         if (rc == -2) {
             goto error;
         } else if (rc == -1) {
@@ -3765,14 +4377,18 @@ qemuMigrationSrcRun(virQEMUDriverPtr driver,
         qemuMigrationIOThreadPtr io;
 
         io = g_steal_pointer(&iothread);
-        if (qemuMigrationSrcStopTunnel(io, false) < 0)
+        jobPriv->tunnelStats = NULL;
+        if (qemuMigrationSrcStopTunnel(io, priv->job.current, false) < 0)
             goto error;
     }
 
     if (priv->job.completed) {
+        priv->job.completed->tunnelRaw = priv->job.current->tunnelRaw;
+        priv->job.completed->tunnelSent = priv->job.current->tunnelSent;
         priv->job.completed->stopped = priv->job.current->stopped;
         qemuDomainJobInfoUpdateTime(priv->job.completed);
         qemuDomainJobInfoUpdateDowntime(priv->job.completed);
+        qemuDomainJobInfoUpdateLockStats(priv->job.completed, vm);
         ignore_value(virTimeMillisNow(&priv->job.completed->sent));
     }
 
@@ -3818,8 +4434,10 @@ qemuMigrationSrcRun(virQEMUDriverPtr driver,
             priv->job.current->status = QEMU_DOMAIN_JOB_STATUS_FAILED;
     }
 
-    if (iothread)
-        qemuMigrationSrcStopTunnel(iothread, true);
+    if (iothread) {
+        jobPriv->tunnelStats = NULL;
+        qemuMigrationSrcStopTunnel(iothread, NULL, true);
+    }
 
     goto cleanup;
 
@@ -5229,6 +5847,9 @@ qemuMigrationDstFinish(virQEMUDriverPtr driver,
 
     if (dom) {
         if (jobInfo) {
+            /* lock statistics are local to each side of the migration */
+            jobInfo->lockStatsBase = priv->job.current->lockStatsBase;
+            qemuDomainJobInfoUpdateLockStats(jobInfo, vm);
             priv->job.completed = g_steal_pointer(&jobInfo);
             priv->job.completed->status = QEMU_DOMAIN_JOB_STATUS_COMPLETED;
             priv->job.completed->statsType = QEMU_DOMAIN_JOB_STATS_TYPE_MIGRATION;
@@ -5369,7 +5990,7 @@ qemuMigrationSrcToFile(virQEMUDriverPtr driver, virDomainObjPtr vm,
     if (rc < 0)
         goto cleanup;
 
-    rc = qemuMigrationSrcWaitForCompletion(driver, vm, asyncJob, NULL, 0);
+    rc = qemuMigrationSrcWaitForCompletion(driver, vm, asyncJob, NULL, 0, NULL);
 
     if (rc < 0) {
         if (rc == -2) {
@@ -5636,11 +6257,13 @@ qemuMigrationSrcFetchMirrorStats(virQEMUDriverPtr driver,
     if (qemuDomainObjExitMonitor(driver, vm) < 0 || !blockinfo)
         return -1;
 
-    memset(stats, 0, sizeof(*stats));
+    qemuDomainMirrorStatsClear(stats);
+    stats->disks = g_new0(qemuDomainMirrorDiskStats, vm->def->ndisks);
 
     for (i = 0; i < vm->def->ndisks; i++) {
         virDomainDiskDefPtr disk = vm->def->disks[i];
         qemuDomainDiskPrivatePtr diskPriv = QEMU_DOMAIN_DISK_PRIVATE(disk);
+        qemuDomainMirrorDiskStatsPtr diskStats;
         qemuMonitorBlockJobInfoPtr data;
 
         if (!diskPriv->migrating ||
@@ -5649,6 +6272,11 @@ qemuMigrationSrcFetchMirrorStats(virQEMUDriverPtr driver,
 
         stats->transferred += data->cur;
         stats->total += data->end;
+
+        diskStats = stats->disks + stats->ndisks++;
+        diskStats->dst = g_strdup(disk->dst);
+        diskStats->transferred = data->cur;
+        diskStats->total = data->end;
     }
 
     virHashFree(blockinfo);
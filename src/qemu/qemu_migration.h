@@ -72,6 +72,7 @@
     VIR_MIGRATE_PARAM_MIGRATE_DISKS,    VIR_TYPED_PARAM_STRING | \
                                         VIR_TYPED_PARAM_MULTIPLE, \
     VIR_MIGRATE_PARAM_DISKS_PORT,       VIR_TYPED_PARAM_INT, \
+    VIR_MIGRATE_PARAM_DISKS_CONCURRENCY, VIR_TYPED_PARAM_INT, \
     VIR_MIGRATE_PARAM_COMPRESSION,      VIR_TYPED_PARAM_STRING | \
                                         VIR_TYPED_PARAM_MULTIPLE, \
     VIR_MIGRATE_PARAM_COMPRESSION_MT_LEVEL,         VIR_TYPED_PARAM_INT, \
@@ -84,6 +85,9 @@
     VIR_MIGRATE_PARAM_BANDWIDTH_POSTCOPY, VIR_TYPED_PARAM_ULLONG, \
     VIR_MIGRATE_PARAM_PARALLEL_CONNECTIONS, VIR_TYPED_PARAM_INT, \
     VIR_MIGRATE_PARAM_TLS_DESTINATION, VIR_TYPED_PARAM_STRING, \
+    VIR_MIGRATE_PARAM_DOWNTIME_TARGET, VIR_TYPED_PARAM_ULLONG, \
+    VIR_MIGRATE_PARAM_DOWNTIME_ITERATIONS, VIR_TYPED_PARAM_INT, \
+    VIR_MIGRATE_PARAM_PREALLOC_THREADS, VIR_TYPED_PARAM_INT, \
     NULL
 
 
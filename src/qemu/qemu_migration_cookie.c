@@ -574,6 +574,19 @@ qemuMigrationCookieAddCaps(qemuMigrationCookiePtr mig,
     if (!mig->caps->supported || !mig->caps->automatic)
         return -1;
 
+    if (party == QEMU_MIGRATION_SOURCE) {
+        g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(priv->driver);
+
+        mig->caps->parallelAuto = true;
+        mig->caps->tunnelCompress = cfg->migrationTunnelCompressionLevel > 0;
+    } else {
+        qemuDomainJobPrivatePtr jobPriv = priv->job.privateData;
+
+        if (priv->job.current)
+            mig->caps->parallelConnections = priv->job.current->parallelConnections;
+        mig->caps->tunnelCompress = jobPriv->tunnelCompressed;
+    }
+
     mig->flags |= QEMU_MIGRATION_COOKIE_CAPS;
 
     return 0;
@@ -699,6 +712,15 @@ qemuMigrationCookieStatisticsXMLFormat(virBufferPtr buf,
                       VIR_DOMAIN_JOB_MEMORY_POSTCOPY_REQS,
                       stats->ram_postcopy_reqs);
 
+    if (jobInfo->parallelConnections > 0) {
+        virBufferAsprintf(buf, "<%1$s>%2$d</%1$s>\n",
+                          VIR_DOMAIN_JOB_MEMORY_PARALLEL_CONNECTIONS,
+                          jobInfo->parallelConnections);
+        virBufferAsprintf(buf, "<%1$s>%2$llu</%1$s>\n",
+                          VIR_DOMAIN_JOB_MEMORY_PARALLEL_BYTES,
+                          stats->ram_multifd_bytes);
+    }
+
     virBufferAsprintf(buf, "<%1$s>%2$llu</%1$s>\n",
                       VIR_DOMAIN_JOB_MEMORY_PAGE_SIZE,
                       stats->ram_page_size);
@@ -765,6 +787,19 @@ qemuMigrationCookieCapsXMLFormat(virBufferPtr buf,
         }
     }
 
+    if (caps->parallelAuto || caps->parallelConnections > 0) {
+        virBufferAddLit(buf, "<parallel");
+        if (caps->parallelAuto)
+            virBufferAddLit(buf, " auto='yes'");
+        if (caps->parallelConnections > 0)
+            virBufferAsprintf(buf, " connections='%d'",
+                              caps->parallelConnections);
+        virBufferAddLit(buf, "/>\n");
+    }
+
+    if (caps->tunnelCompress)
+        virBufferAddLit(buf, "<tunnel compression='zlib'/>\n");
+
     virBufferAdjustIndent(buf, -2);
     virBufferAddLit(buf, "</capabilities>\n");
 }
@@ -1092,6 +1127,10 @@ qemuMigrationCookieStatisticsXMLParse(xmlXPathContextPtr ctxt)
                       ctxt, &stats->ram_iteration);
     virXPathULongLong("string(./" VIR_DOMAIN_JOB_MEMORY_POSTCOPY_REQS "[1])",
                       ctxt, &stats->ram_postcopy_reqs);
+    virXPathInt("string(./" VIR_DOMAIN_JOB_MEMORY_PARALLEL_CONNECTIONS "[1])",
+                ctxt, &jobInfo->parallelConnections);
+    virXPathULongLong("string(./" VIR_DOMAIN_JOB_MEMORY_PARALLEL_BYTES "[1])",
+                      ctxt, &stats->ram_multifd_bytes);
 
     virXPathULongLong("string(./" VIR_DOMAIN_JOB_MEMORY_PAGE_SIZE "[1])",
                       ctxt, &stats->ram_page_size);
@@ -1166,6 +1205,19 @@ qemuMigrationCookieCapsXMLParse(xmlXPathContextPtr ctxt)
         VIR_FREE(automatic);
     }
 
+    caps->parallelAuto = virXPathBoolean("boolean(./capabilities[1]/parallel[@auto='yes'])",
+                                         ctxt) == 1;
+
+    caps->tunnelCompress = virXPathBoolean("boolean(./capabilities[1]/tunnel[@compression='zlib'])",
+                                           ctxt) == 1;
+
+    if (virXPathInt("string(./capabilities[1]/parallel/@connections)",
+                    ctxt, &caps->parallelConnections) == -2) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("invalid number of parallel migration connections"));
+        goto cleanup;
+    }
+
     ret = g_steal_pointer(&caps);
 
  cleanup:
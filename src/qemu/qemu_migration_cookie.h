@@ -103,6 +103,9 @@ typedef qemuMigrationCookieCaps *qemuMigrationCookieCapsPtr;
 struct _qemuMigrationCookieCaps {
     virBitmapPtr supported;
     virBitmapPtr automatic;
+    bool parallelAuto; /* source accepts parallelConnections */
+    int parallelConnections; /* chosen by the destination, 0 if unknown */
+    bool tunnelCompress; /* offered by the source, accepted by the destination */
 };
 
 typedef struct _qemuMigrationCookie qemuMigrationCookie;
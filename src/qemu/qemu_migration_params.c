@@ -25,6 +25,7 @@
 #include "virerror.h"
 #include "viralloc.h"
 #include "virstring.h"
+#include "virhostcpu.h"
 
 #include "qemu_alias.h"
 #include "qemu_hotplug.h"
@@ -40,6 +41,12 @@ VIR_LOG_INIT("qemu.qemu_migration_params");
 
 #define QEMU_MIGRATION_TLS_ALIAS_BASE "libvirt_migrate"
 
+/* QEMU's default for cpu-throttle-increment */
+#define QEMU_MIGRATION_THROTTLE_INCREMENT_DEFAULT 10
+/* Larger steps would just stall the guest without helping convergence */
+#define QEMU_MIGRATION_THROTTLE_INCREMENT_MAX 50
+#define QEMU_MIGRATION_DOWNTIME_ITERATIONS_DEFAULT 2
+
 typedef enum {
     QEMU_MIGRATION_PARAM_TYPE_INT,
     QEMU_MIGRATION_PARAM_TYPE_ULL,
@@ -63,6 +70,10 @@ struct _qemuMigrationParams {
     unsigned long long compMethods; /* bit-wise OR of qemuMigrationCompressMethod */
     virBitmapPtr caps;
     qemuMigrationParamValue params[QEMU_MIGRATION_PARAM_LAST];
+    unsigned long long downtimeTarget; /* ms, 0 when not requested */
+    int downtimeIterations;
+    int disksConcurrency; /* 0 when not limited */
+    qemuMigrationParamValue preallocThreads; /* not a QEMU parameter */
 };
 
 typedef enum {
@@ -534,6 +545,105 @@ qemuMigrationParamsSetCompression(virTypedParameterPtr params,
 }
 
 
+static int
+qemuMigrationParamsSetDisksConcurrency(virTypedParameterPtr params,
+                                       int nparams,
+                                       unsigned long flags,
+                                       qemuMigrationParamsPtr migParams)
+{
+    int rc;
+
+    if ((rc = virTypedParamsGetInt(params, nparams,
+                                   VIR_MIGRATE_PARAM_DISKS_CONCURRENCY,
+                                   &migParams->disksConcurrency)) < 0)
+        return -1;
+
+    if (rc == 1 && migParams->disksConcurrency <= 0) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("migration parameter '%s' must be positive"),
+                       VIR_MIGRATE_PARAM_DISKS_CONCURRENCY);
+        return -1;
+    }
+
+    if (rc == 1 &&
+        !(flags & (VIR_MIGRATE_NON_SHARED_DISK | VIR_MIGRATE_NON_SHARED_INC))) {
+        virReportError(VIR_ERR_INVALID_ARG, "%s",
+                       _("Turn storage migration on to tune it"));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+qemuMigrationParamsSetPreallocThreads(virTypedParameterPtr params,
+                                      int nparams,
+                                      qemuMigrationParamsPtr migParams)
+{
+    qemuMigrationParamValuePtr pv = &migParams->preallocThreads;
+    int rc;
+
+    if ((rc = virTypedParamsGetInt(params, nparams,
+                                   VIR_MIGRATE_PARAM_PREALLOC_THREADS,
+                                   &pv->value.i)) < 0)
+        return -1;
+
+    if (rc == 1 && pv->value.i < 0) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("migration parameter '%s' must not be negative"),
+                       VIR_MIGRATE_PARAM_PREALLOC_THREADS);
+        return -1;
+    }
+
+    pv->set = !!rc;
+    return 0;
+}
+
+
+static int
+qemuMigrationParamsSetPolicy(virTypedParameterPtr params,
+                             int nparams,
+                             unsigned long flags,
+                             qemuMigrationParamsPtr migParams)
+{
+    int rc;
+
+    if (virTypedParamsGetULLong(params, nparams,
+                                VIR_MIGRATE_PARAM_DOWNTIME_TARGET,
+                                &migParams->downtimeTarget) < 0)
+        return -1;
+
+    if ((rc = virTypedParamsGetInt(params, nparams,
+                                   VIR_MIGRATE_PARAM_DOWNTIME_ITERATIONS,
+                                   &migParams->downtimeIterations)) < 0)
+        return -1;
+
+    if (rc == 1 && migParams->downtimeIterations <= 0) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("migration parameter '%s' must be positive"),
+                       VIR_MIGRATE_PARAM_DOWNTIME_ITERATIONS);
+        return -1;
+    }
+
+    if (rc == 1 && migParams->downtimeTarget == 0) {
+        virReportError(VIR_ERR_INVALID_ARG, "%s",
+                       _("Set downtime target to tune it"));
+        return -1;
+    }
+
+    if (migParams->downtimeTarget > 0 &&
+        !(flags & (VIR_MIGRATE_AUTO_CONVERGE | VIR_MIGRATE_POSTCOPY))) {
+        virReportError(VIR_ERR_INVALID_ARG, "%s",
+                       _("Turn auto convergence or post-copy on to reach "
+                         "downtime target"));
+        return -1;
+    }
+
+    return 0;
+}
+
+
 qemuMigrationParamsPtr
 qemuMigrationParamsFromFlags(virTypedParameterPtr params,
                              int nparams,
@@ -607,6 +717,16 @@ qemuMigrationParamsFromFlags(virTypedParameterPtr params,
         goto error;
     }
 
+    if (party & QEMU_MIGRATION_SOURCE &&
+        (qemuMigrationParamsSetPolicy(params, nparams, flags, migParams) < 0 ||
+         qemuMigrationParamsSetDisksConcurrency(params, nparams, flags,
+                                                migParams) < 0))
+        goto error;
+
+    /* parsed on both sides since the source passes it to the destination */
+    if (qemuMigrationParamsSetPreallocThreads(params, nparams, migParams) < 0)
+        goto error;
+
     if (qemuMigrationParamsSetCompression(params, nparams, flags, migParams) < 0)
         goto error;
 
@@ -618,6 +738,194 @@ qemuMigrationParamsFromFlags(virTypedParameterPtr params,
 }
 
 
+/**
+ * qemuMigrationParamsGetAutoParallelConnections:
+ *
+ * Returns the number of parallel migration connections derived from the
+ * host CPU count or 0 if it cannot be determined.
+ */
+int
+qemuMigrationParamsGetAutoParallelConnections(void)
+{
+    int ncpus;
+
+    if ((ncpus = virHostCPUGetCount()) < 0) {
+        VIR_WARN("Unable to size parallel migration: %s",
+                 virGetLastErrorMessage());
+        virResetLastError();
+        return 0;
+    }
+
+    return MIN(MAX(ncpus, QEMU_MIGRATION_PARALLEL_CONNECTIONS_MIN),
+               QEMU_MIGRATION_PARALLEL_CONNECTIONS_MAX);
+}
+
+
+/**
+ * qemuMigrationParamsSetParallelConnections:
+ * @migParams: migration parameters
+ * @flags: migration flags
+ * @connections: number of connections, 0 to keep QEMU's default
+ *
+ * Sets the number of connections used by parallel migration unless it was
+ * explicitly requested by the user. Both sides of migration have to agree
+ * on the number, which is why the destination chooses it and passes it to
+ * the source in the migration cookie.
+ *
+ * Returns the number of connections which will be used or 0 if parallel
+ * migration is disabled or the number is left to QEMU.
+ */
+int
+qemuMigrationParamsSetParallelConnections(qemuMigrationParamsPtr migParams,
+                                          unsigned long flags,
+                                          int connections)
+{
+    qemuMigrationParamValuePtr pv;
+
+    if (!(flags & VIR_MIGRATE_PARALLEL))
+        return 0;
+
+    pv = &migParams->params[QEMU_MIGRATION_PARAM_MULTIFD_CHANNELS];
+    if (pv->set)
+        return pv->value.i;
+
+    if (connections <= 0)
+        return 0;
+
+    VIR_DEBUG("Using %d parallel migration connections", connections);
+
+    pv->value.i = connections;
+    pv->set = true;
+
+    return connections;
+}
+
+
+/**
+ * qemuMigrationParamsGetPolicy:
+ * @migParams: migration parameters
+ * @policy: filled in with the downtime policy
+ *
+ * Returns true if the user asked for a downtime target and thus the source
+ * should watch the migration and act on @policy, false otherwise.
+ */
+bool
+qemuMigrationParamsGetPolicy(qemuMigrationParamsPtr migParams,
+                             qemuMigrationPolicyPtr policy)
+{
+    qemuMigrationParamValuePtr pv;
+
+    memset(policy, 0, sizeof(*policy));
+
+    if (migParams->downtimeTarget == 0)
+        return false;
+
+    policy->downtime = migParams->downtimeTarget;
+    policy->iterations = QEMU_MIGRATION_DOWNTIME_ITERATIONS_DEFAULT;
+    if (migParams->downtimeIterations > 0)
+        policy->iterations = migParams->downtimeIterations;
+
+    if (virBitmapIsBitSet(migParams->caps, QEMU_MIGRATION_CAP_AUTO_CONVERGE)) {
+        pv = &migParams->params[QEMU_MIGRATION_PARAM_THROTTLE_INCREMENT];
+        policy->throttleIncrement = QEMU_MIGRATION_THROTTLE_INCREMENT_DEFAULT;
+        if (pv->set && pv->value.i > 0)
+            policy->throttleIncrement = pv->value.i;
+    }
+
+    return true;
+}
+
+
+/**
+ * qemuMigrationParamsGetDisksConcurrency:
+ * @migParams: migration parameters
+ *
+ * Returns the maximum number of disks which should be copied at the same
+ * time by storage migration or 0 if it is not limited.
+ */
+int
+qemuMigrationParamsGetDisksConcurrency(qemuMigrationParamsPtr migParams)
+{
+    return migParams->disksConcurrency;
+}
+
+
+/**
+ * qemuMigrationParamsGetPreallocThreads:
+ * @migParams: migration parameters
+ *
+ * Returns the number of threads the destination should use for
+ * preallocating guest memory, 0 if the number should be derived from the
+ * host, or -1 if parallel preallocation was not requested.
+ */
+int
+qemuMigrationParamsGetPreallocThreads(qemuMigrationParamsPtr migParams)
+{
+    if (!migParams->preallocThreads.set)
+        return -1;
+
+    return migParams->preallocThreads.value.i;
+}
+
+
+/**
+ * qemuMigrationParamsRaiseThrottle:
+ * @driver: qemu driver
+ * @vm: domain object
+ * @asyncJob: migration job
+ * @policy: downtime policy
+ *
+ * Doubles the auto-convergence throttling increment of a running migration
+ * unless it already reached its maximum.
+ *
+ * Returns 1 if the increment was raised, 0 if it cannot be raised any
+ * further, and -1 on error.
+ */
+int
+qemuMigrationParamsRaiseThrottle(virQEMUDriverPtr driver,
+                                 virDomainObjPtr vm,
+                                 int asyncJob,
+                                 qemuMigrationPolicyPtr policy)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    g_autoptr(qemuMigrationParams) migParams = NULL;
+    g_autoptr(virJSONValue) params = NULL;
+    int increment;
+    int rc;
+
+    if (policy->throttleIncrement <= 0 ||
+        policy->throttleIncrement >= QEMU_MIGRATION_THROTTLE_INCREMENT_MAX)
+        return 0;
+
+    increment = MIN(policy->throttleIncrement * 2,
+                    QEMU_MIGRATION_THROTTLE_INCREMENT_MAX);
+
+    if (!(migParams = qemuMigrationParamsNew()))
+        return -1;
+
+    migParams->params[QEMU_MIGRATION_PARAM_THROTTLE_INCREMENT].value.i = increment;
+    migParams->params[QEMU_MIGRATION_PARAM_THROTTLE_INCREMENT].set = true;
+
+    if (!(params = qemuMigrationParamsToJSON(migParams)))
+        return -1;
+
+    VIR_DEBUG("Raising CPU throttling increment from %d to %d",
+              policy->throttleIncrement, increment);
+
+    if (qemuDomainObjEnterMonitorAsync(driver, vm, asyncJob) < 0)
+        return -1;
+
+    rc = qemuMonitorSetMigrationParams(priv->mon, params);
+    params = NULL;
+
+    if (qemuDomainObjExitMonitor(driver, vm) < 0 || rc < 0)
+        return -1;
+
+    policy->throttleIncrement = increment;
+    return 1;
+}
+
+
 int
 qemuMigrationParamsDump(qemuMigrationParamsPtr migParams,
                         virTypedParameterPtr *params,
@@ -673,6 +981,12 @@ qemuMigrationParamsDump(qemuMigrationParamsPtr migParams,
         }
     }
 
+    if (migParams->preallocThreads.set &&
+        virTypedParamsAddInt(params, nparams, maxparams,
+                             VIR_MIGRATE_PARAM_PREALLOC_THREADS,
+                             migParams->preallocThreads.value.i) < 0)
+        return -1;
+
     return 0;
 }
 
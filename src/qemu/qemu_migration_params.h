@@ -70,6 +70,19 @@ typedef enum {
     QEMU_MIGRATION_DESTINATION = (1 << 1),
 } qemuMigrationParty;
 
+/* Bounds for automatically sized parallel migration, the lower one
+ * matches QEMU's default */
+#define QEMU_MIGRATION_PARALLEL_CONNECTIONS_MIN 2
+#define QEMU_MIGRATION_PARALLEL_CONNECTIONS_MAX 16
+
+typedef struct _qemuMigrationPolicy qemuMigrationPolicy;
+typedef qemuMigrationPolicy *qemuMigrationPolicyPtr;
+struct _qemuMigrationPolicy {
+    unsigned long long downtime; /* projected downtime target in ms */
+    unsigned int iterations; /* iterations above the target before acting */
+    int throttleIncrement; /* current auto-convergence increment, 0 if off */
+};
+
 
 virBitmapPtr
 qemuMigrationParamsGetAlwaysOnCaps(qemuMigrationParty party);
@@ -80,6 +93,30 @@ qemuMigrationParamsFromFlags(virTypedParameterPtr params,
                              unsigned long flags,
                              qemuMigrationParty party);
 
+int
+qemuMigrationParamsGetAutoParallelConnections(void);
+
+int
+qemuMigrationParamsSetParallelConnections(qemuMigrationParamsPtr migParams,
+                                          unsigned long flags,
+                                          int connections);
+
+bool
+qemuMigrationParamsGetPolicy(qemuMigrationParamsPtr migParams,
+                             qemuMigrationPolicyPtr policy);
+
+int
+qemuMigrationParamsGetDisksConcurrency(qemuMigrationParamsPtr migParams);
+
+int
+qemuMigrationParamsGetPreallocThreads(qemuMigrationParamsPtr migParams);
+
+int
+qemuMigrationParamsRaiseThrottle(virQEMUDriverPtr driver,
+                                 virDomainObjPtr vm,
+                                 int asyncJob,
+                                 qemuMigrationPolicyPtr policy);
+
 int
 qemuMigrationParamsDump(qemuMigrationParamsPtr migParams,
                         virTypedParameterPtr *params,
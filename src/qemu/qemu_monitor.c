@@ -41,6 +41,7 @@
 #include "virprobe.h"
 #include "virstring.h"
 #include "virtime.h"
+#include "virtrace.h"
 #include "virsocket.h"
 #include "virutil.h"
 
@@ -71,6 +72,7 @@ struct _qemuMonitor {
     virObjectLockable parent;
 
     virCond notify;
+    virCond sendCond; /* signalled whenever @msg is cleared */
 
     int fd;
 
@@ -84,7 +86,7 @@ struct _qemuMonitor {
     void *callbackOpaque;
 
     /* If there's a command being processed this will be
-     * non-NULL */
+     * non-NULL. Pipelined commands are chained via msg->next */
     qemuMonitorMessagePtr msg;
 
     /* Buffer incoming data ready for Text/QMP monitor
@@ -101,6 +103,16 @@ struct _qemuMonitor {
 
     bool waitGreeting;
 
+    /* time spent handling I/O in the event loop, in microseconds */
+    unsigned long long dispatchTime;
+
+    /* qemuMonitorCommandLatency per command name */
+    virHashTablePtr latency;
+
+    /* commands waiting longer than this for their reply, in milliseconds,
+     * are reported via the domainMonitorSlow callback, 0 disables that */
+    unsigned int slowThreshold;
+
     /* cache of query-command-line-options results */
     virJSONValuePtr options;
 
@@ -147,6 +159,12 @@ struct _qemuMonitor {
 
 static virClassPtr qemuMonitorClass;
 static __thread bool qemuMonitorDisposed;
+
+/* Round trips of commands of all monitors, times in microseconds */
+static virMutex qemuMonitorStatsLock = VIR_MUTEX_INITIALIZER;
+static qemuMonitorCommandStats qemuMonitorStats;
+static unsigned long long qemuMonitorStatsTimeTotal;
+
 static void qemuMonitorDispose(void *obj);
 
 static int qemuMonitorOnceInit(void)
@@ -231,9 +249,11 @@ qemuMonitorDispose(void *obj)
     g_main_context_unref(mon->context);
     virResetError(&mon->lastError);
     virCondDestroy(&mon->notify);
+    virCondDestroy(&mon->sendCond);
     VIR_FREE(mon->buffer);
     virJSONValueFree(mon->options);
     VIR_FREE(mon->balloonpath);
+    virHashFree(mon->latency);
 }
 
 
@@ -305,6 +325,55 @@ qemuMonitorOpenUnix(const char *monitor,
 }
 
 
+/* Returns the first message of the pending chain which was not
+ * transmitted yet, or NULL if everything was written. */
+static qemuMonitorMessagePtr
+qemuMonitorGetTxMessage(qemuMonitorPtr mon)
+{
+    qemuMonitorMessagePtr msg;
+
+    for (msg = mon->msg; msg; msg = msg->next) {
+        if (msg->txOffset < msg->txLength)
+            return msg;
+    }
+
+    return NULL;
+}
+
+
+static bool
+qemuMonitorMessagesFinished(qemuMonitorPtr mon)
+{
+    qemuMonitorMessagePtr msg;
+
+    for (msg = mon->msg; msg; msg = msg->next) {
+        if (!msg->finished)
+            return false;
+    }
+
+    return true;
+}
+
+
+/* Marks all pending messages as finished, e.g. after a fatal error on
+ * the monitor channel. Returns true if there was anything to finish. */
+static bool
+qemuMonitorMessagesAbort(qemuMonitorPtr mon)
+{
+    qemuMonitorMessagePtr msg;
+    bool aborted = false;
+
+    for (msg = mon->msg; msg; msg = msg->next) {
+        if (!msg->finished) {
+            msg->finished = true;
+            aborted = true;
+        }
+    }
+
+    return aborted;
+}
+
+
 /* This method processes data that has been received
  * from the monitor. Looking for async events and
  * replies/errors.
@@ -316,7 +385,9 @@ qemuMonitorIOProcess(qemuMonitorPtr mon)
     qemuMonitorMessagePtr msg = NULL;
 
     /* See if there's a message & whether its ready for its reply
-     * ie whether its completed writing all its data */
+     * ie whether its completed writing all its data. In case of
+     * pipelined messages the JSON code picks the right one from
+     * the chain. */
     if (mon->msg && mon->msg->txOffset == mon->msg->txLength)
         msg = mon->msg;
 
@@ -358,7 +429,7 @@ qemuMonitorIOProcess(qemuMonitorPtr mon)
     /* As the monitor mutex was unlocked in qemuMonitorJSONIOProcess()
      * while dealing with qemu event, mon->msg could be changed which
      * means the above 'msg' may be invalid, thus we use 'mon->msg' here */
-    if (mon->msg && mon->msg->finished)
+    if (mon->msg && qemuMonitorMessagesFinished(mon))
         virCondBroadcast(&mon->notify);
     return len;
 }
@@ -409,45 +480,57 @@ qemuMonitorIOWriteWithFD(qemuMonitorPtr mon,
 /*
  * Called when the monitor is able to write data
  * Call this function while holding the monitor lock.
+ *
+ * Pipelined messages are written back-to-back until the socket
+ * would block or all of them are transmitted.
  */
 static int
 qemuMonitorIOWrite(qemuMonitorPtr mon)
 {
+    qemuMonitorMessagePtr msg;
     int done;
+    int total = 0;
     char *buf;
     size_t len;
 
     /* If no active message, or fully transmitted, the no-op */
-    if (!mon->msg || mon->msg->txOffset == mon->msg->txLength)
-        return 0;
+    while ((msg = qemuMonitorGetTxMessage(mon))) {
+        buf = msg->txBuffer + msg->txOffset;
+        len = msg->txLength - msg->txOffset;
+        if (msg->txFD == -1)
+            done = write(mon->fd, buf, len);
+        else
+            done = qemuMonitorIOWriteWithFD(mon, buf, len, msg->txFD);
 
-    buf = mon->msg->txBuffer + mon->msg->txOffset;
-    len = mon->msg->txLength - mon->msg->txOffset;
-    if (mon->msg->txFD == -1)
-        done = write(mon->fd, buf, len);
-    else
-        done = qemuMonitorIOWriteWithFD(mon, buf, len, mon->msg->txFD);
+        PROBE(QEMU_MONITOR_IO_WRITE,
+              "mon=%p buf=%s len=%zu ret=%d errno=%d",
+              mon, buf, len, done, done < 0 ? errno : 0);
+
+        if (msg->txFD != -1) {
+            PROBE(QEMU_MONITOR_IO_SEND_FD,
+                  "mon=%p fd=%d ret=%d errno=%d",
+                  mon, msg->txFD, done, done < 0 ? errno : 0);
+        }
 
-    PROBE(QEMU_MONITOR_IO_WRITE,
-          "mon=%p buf=%s len=%zu ret=%d errno=%d",
-          mon, buf, len, done, done < 0 ? errno : 0);
+        if (done < 0) {
+            if (errno == EAGAIN)
+                return total;
 
-    if (mon->msg->txFD != -1) {
-        PROBE(QEMU_MONITOR_IO_SEND_FD,
-              "mon=%p fd=%d ret=%d errno=%d",
-              mon, mon->msg->txFD, done, done < 0 ? errno : 0);
-    }
+            virReportSystemError(errno, "%s",
+                                 _("Unable to write to monitor"));
+            return -1;
+        }
+        msg->txOffset += done;
+        total += done;
 
-    if (done < 0) {
-        if (errno == EAGAIN)
-            return 0;
+        /* partial write, wait for the socket to become writable again */
+        if (msg->txOffset < msg->txLength)
+            break;
 
-        virReportSystemError(errno, "%s",
-                             _("Unable to write to monitor"));
-        return -1;
+        msg->written = g_get_monotonic_time();
     }
-    mon->msg->txOffset += done;
-    return done;
+
+    return total;
 }
 
 
@@ -527,6 +610,7 @@ qemuMonitorIO(GSocket *socket G_GNUC_UNUSED,
     bool error = false;
     bool eof = false;
     bool hangup = false;
+    gint64 start = g_get_monotonic_time();
 
     virObjectRef(mon);
 
@@ -618,14 +702,14 @@ qemuMonitorIO(GSocket *socket G_GNUC_UNUSED,
         VIR_DEBUG("Error on monitor %s", NULLSTR(mon->lastError.message));
         /* If IO process resulted in an error & we have a message,
          * then wakeup that waiter */
-        if (mon->msg && !mon->msg->finished) {
-            mon->msg->finished = true;
+        if (qemuMonitorMessagesAbort(mon))
             virCondSignal(&mon->notify);
-        }
     }
 
     qemuMonitorUpdateWatch(mon);
 
+    mon->dispatchTime += g_get_monotonic_time() - start;
+
     /* We have to unlock to avoid deadlock against command thread,
      * but is this safe ?  I think it is, because the callback
      * will try to acquire the virDomainObjPtr mutex next */
@@ -690,12 +774,18 @@ qemuMonitorOpenInternal(virDomainObjPtr vm,
                        _("cannot initialize monitor condition"));
         goto cleanup;
     }
+    if (virCondInit(&mon->sendCond) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("cannot initialize monitor condition"));
+        goto cleanup;
+    }
     mon->fd = fd;
     mon->context = g_main_context_ref(context);
     mon->vm = virObjectRef(vm);
     mon->waitGreeting = true;
     mon->cb = cb;
     mon->callbackOpaque = opaque;
+    mon->latency = virHashNew(virHashValueFree);
 
     if (virSetCloseExec(mon->fd) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
@@ -826,7 +916,7 @@ qemuMonitorRegister(qemuMonitorPtr mon)
     if (mon->lastError.code == VIR_ERR_OK) {
         cond |= G_IO_IN;
 
-        if ((mon->msg && mon->msg->txOffset < mon->msg->txLength) &&
+        if (qemuMonitorGetTxMessage(mon) &&
             !mon->waitGreeting)
             cond |= G_IO_OUT;
     }
@@ -856,6 +946,55 @@ qemuMonitorUnregister(qemuMonitorPtr mon)
     }
 }
 
+/**
+ * qemuMonitorSetEventContext:
+ * @mon: QEMU monitor
+ * @context: the new event loop context
+ *
+ * Moves handling of I/O of @mon to @context. An I/O callback running in
+ * the old context at the time may still finish there.
+ */
+void
+qemuMonitorSetEventContext(qemuMonitorPtr mon,
+                           GMainContext *context)
+{
+    virObjectLock(mon);
+
+    if (mon->context != context) {
+        bool registered = !!mon->watch;
+
+        qemuMonitorUnregister(mon);
+        g_main_context_unref(mon->context);
+        mon->context = g_main_context_ref(context);
+
+        if (registered && mon->socket)
+            qemuMonitorRegister(mon);
+    }
+
+    virObjectUnlock(mon);
+}
+
+
+/**
+ * qemuMonitorGetDispatchTime:
+ * @mon: QEMU monitor
+ *
+ * Returns the time the event loop spent handling I/O of @mon, including
+ * processing of replies and events, in microseconds.
+ */
+unsigned long long
+qemuMonitorGetDispatchTime(qemuMonitorPtr mon)
+{
+    unsigned long long ret;
+
+    virObjectLock(mon);
+    ret = mon->dispatchTime;
+    virObjectUnlock(mon);
+
+    return ret;
+}
+
+
 void
 qemuMonitorClose(qemuMonitorPtr mon)
 {
@@ -891,7 +1030,7 @@ qemuMonitorClose(qemuMonitorPtr mon)
             else
                 virResetLastError();
         }
-        mon->msg->finished = true;
+        qemuMonitorMessagesAbort(mon);
         virCondSignal(&mon->notify);
     }
 
@@ -924,11 +1063,135 @@ qemuMonitorResetCommandID(qemuMonitorPtr mon)
 }
 
 
+/* Name of the command in @msg, without any of its arguments which may
+ * include secrets */
+static char *
+qemuMonitorMessageCommandName(qemuMonitorMessagePtr msg)
+{
+    const char *prefix = "{\"execute\":\"";
+    const char *cmd;
+
+    if (!msg->txBuffer || !STRPREFIX(msg->txBuffer, prefix))
+        return g_strdup("unknown");
+
+    cmd = msg->txBuffer + strlen(prefix);
+    return g_strndup(cmd, strcspn(cmd, "\""));
+}
+
+
+static char *
+qemuMonitorMessageTraceDetail(qemuMonitorMessagePtr msg)
+{
+    g_autofree char *name = qemuMonitorMessageCommandName(msg);
+
+    /* Chained messages are all sent at once, name just the first one */
+    if (msg->next)
+        return g_strdup_printf("%s,...", name);
+
+    return g_steal_pointer(&name);
+}
+
+
+/*
+ * Adds the latency of the chain of messages @msg to the histogram of the
+ * monitor. The caller waited for the monitor since @queued and sent the
+ * messages at @start. Call this function while holding the monitor lock.
+ */
+static void
+qemuMonitorRecordLatency(qemuMonitorPtr mon,
+                         qemuMonitorMessagePtr msg,
+                         unsigned long long queued,
+                         unsigned long long start,
+                         bool failed)
+{
+    unsigned long long now = g_get_monotonic_time();
+
+    for (; msg; msg = msg->next) {
+        g_autofree char *name = qemuMonitorMessageCommandName(msg);
+        qemuMonitorCommandLatencyPtr latency;
+        unsigned long long written = msg->written ? msg->written : now;
+        unsigned long long replied = msg->replied ? msg->replied : now;
+        unsigned long long total = replied - queued;
+
+        if (!(latency = virHashLookup(mon->latency, name))) {
+            latency = g_new0(qemuMonitorCommandLatency, 1);
+            if (virHashAddEntry(mon->latency, name, latency) < 0) {
+                g_free(latency);
+                return;
+            }
+        }
+
+        latency->count++;
+        if (failed)
+            latency->failed++;
+        latency->queueTime += start - queued;
+        latency->writeTime += written - start;
+        latency->replyTime += replied - written;
+        virHistogramRecord(&latency->hist, total);
+    }
+}
+
+
+/*
+ * Reports that the first message of the chain being sent which did not
+ * get its reply yet is waiting for longer than the threshold. The monitor
+ * is unlocked while the callback runs.
+ */
+static void
+qemuMonitorReportSlow(qemuMonitorPtr mon,
+                      unsigned long long start)
+{
+    qemuMonitorMessagePtr msg;
+    g_autofree char *name = NULL;
+    unsigned long long elapsed = (g_get_monotonic_time() - start) / 1000;
+
+    for (msg = mon->msg; msg && msg->finished; msg = msg->next)
+        ;
+
+    if (!msg)
+        return;
+
+    name = qemuMonitorMessageCommandName(msg);
+    VIR_WARN("QEMU monitor command '%s' did not finish within %llu ms",
+             name, elapsed);
+
+    qemuMonitorEmitMonitorSlow(mon, name, elapsed);
+}
+
+
+/**
+ * qemuMonitorSend:
+ * @mon: monitor object
+ * @msg: message to send
+ *
+ * Sends @msg and waits for its reply. If @msg has further messages
+ * chained via its @next member they are all written to the monitor
+ * without waiting for individual replies and the function returns
+ * once every message in the chain got its reply. Replies are matched
+ * to the messages via their @id.
+ *
+ * Returns 0 on success, -1 on error.
+ */
 int
 qemuMonitorSend(qemuMonitorPtr mon,
                 qemuMonitorMessagePtr msg)
 {
     int ret = -1;
+    unsigned long long queued = g_get_monotonic_time();
+    unsigned long long start;
+    unsigned long long elapsed;
+    unsigned long long then = 0;
+    virTraceSpan span = { 0 };
+
+    /* Query jobs may use the monitor concurrently with other jobs, their
+     * commands are sent one after another */
+    while (mon->msg) {
+        if (virCondWait(&mon->sendCond, &mon->parent.lock) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("Unable to wait on monitor condition"));
+            return -1;
+        }
+    }
 
     /* Check whether qemu quit unexpectedly */
     if (mon->lastError.code != VIR_ERR_OK) {
@@ -938,6 +1201,20 @@ qemuMonitorSend(qemuMonitorPtr mon,
         return -1;
     }
 
+    if (mon->slowThreshold > 0) {
+        if (virTimeMillisNow(&then) < 0)
+            return -1;
+        then += mon->slowThreshold;
+    }
+
+    start = g_get_monotonic_time();
+
+    if (virTraceEnabled()) {
+        g_autofree char *detail = qemuMonitorMessageTraceDetail(msg);
+
+        virTraceSpanBegin(&span, "qemu.monitor", detail);
+    }
+
     mon->msg = msg;
     qemuMonitorUpdateWatch(mon);
 
@@ -945,8 +1222,21 @@ qemuMonitorSend(qemuMonitorPtr mon,
           "mon=%p msg=%s fd=%d",
           mon, mon->msg->txBuffer, mon->msg->txFD);
 
-    while (!mon->msg->finished) {
-        if (virCondWait(&mon->notify, &mon->parent.lock) < 0) {
+    while (!qemuMonitorMessagesFinished(mon)) {
+        if (then) {
+            if (virCondWaitUntil(&mon->notify, &mon->parent.lock, then) < 0) {
+                if (errno != ETIMEDOUT) {
+                    virReportSystemError(errno, "%s",
+                                         _("Unable to wait on monitor condition"));
+                    goto cleanup;
+                }
+
+                /* Report a slow command just once and keep waiting for
+                 * it, giving up on it would desynchronize the monitor */
+                then = 0;
+                qemuMonitorReportSlow(mon, start);
+            }
+        } else if (virCondWait(&mon->notify, &mon->parent.lock) < 0) {
             virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                            _("Unable to wait on monitor condition"));
             goto cleanup;
@@ -965,11 +1255,129 @@ qemuMonitorSend(qemuMonitorPtr mon,
  cleanup:
     mon->msg = NULL;
     qemuMonitorUpdateWatch(mon);
+    virCondSignal(&mon->sendCond);
+
+    virTraceSpanEnd(&span, ret < 0);
+
+    qemuMonitorRecordLatency(mon, msg, queued, start, ret < 0);
+
+    elapsed = g_get_monotonic_time() - start;
+    virMutexLock(&qemuMonitorStatsLock);
+    qemuMonitorStats.commands++;
+    if (ret < 0)
+        qemuMonitorStats.failed++;
+    qemuMonitorStatsTimeTotal += elapsed;
+    qemuMonitorStats.timeMax = MAX(qemuMonitorStats.timeMax, elapsed);
+    qemuMonitorStats.timeAvg = qemuMonitorStatsTimeTotal /
+                               qemuMonitorStats.commands;
+    virMutexUnlock(&qemuMonitorStatsLock);
 
     return ret;
 }
 
 
+/**
+ * qemuMonitorGetCommandStats:
+ * @stats: filled with the statistics
+ *
+ * Reports the number of commands sent to all monitors so far and how
+ * long they took from being sent until the reply was processed.
+ */
+void
+qemuMonitorGetCommandStats(qemuMonitorCommandStatsPtr stats)
+{
+    virMutexLock(&qemuMonitorStatsLock);
+    *stats = qemuMonitorStats;
+    virMutexUnlock(&qemuMonitorStatsLock);
+}
+
+
+static int
+qemuMonitorCommandLatencySorter(const virHashKeyValuePair *a,
+                                const virHashKeyValuePair *b)
+{
+    return strcmp(a->key, b->key);
+}
+
+
+/**
+ * qemuMonitorGetCommandLatency:
+ * @mon: QEMU monitor
+ * @latency: filled with an array of latency statistics
+ * @nlatency: filled with the number of elements of @latency
+ *
+ * Reports the latency of commands sent to @mon so far, one element per
+ * command name sorted by the name. The latency is the time from when the
+ * caller started waiting for the monitor until the reply was received.
+ * Free @latency with qemuMonitorCommandLatencyFree.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+qemuMonitorGetCommandLatency(qemuMonitorPtr mon,
+                             qemuMonitorCommandLatencyPtr *latency,
+                             size_t *nlatency)
+{
+    g_autofree virHashKeyValuePairPtr items = NULL;
+    size_t n;
+    size_t i;
+
+    virObjectLock(mon);
+
+    if (!(items = virHashGetItems(mon->latency,
+                                  qemuMonitorCommandLatencySorter))) {
+        virObjectUnlock(mon);
+        return -1;
+    }
+
+    n = virHashSize(mon->latency);
+    *latency = g_new0(qemuMonitorCommandLatency, n);
+
+    for (i = 0; i < n; i++) {
+        (*latency)[i] = *(qemuMonitorCommandLatencyPtr) items[i].value;
+        (*latency)[i].name = g_strdup(items[i].key);
+    }
+
+    virObjectUnlock(mon);
+
+    *nlatency = n;
+    return 0;
+}
+
+
+void
+qemuMonitorCommandLatencyFree(qemuMonitorCommandLatencyPtr latency,
+                              size_t nlatency)
+{
+    size_t i;
+
+    if (!latency)
+        return;
+
+    for (i = 0; i < nlatency; i++)
+        g_free(latency[i].name);
+    g_free(latency);
+}
+
+
+/**
+ * qemuMonitorSetSlowThreshold:
+ * @mon: QEMU monitor
+ * @threshold: time in milliseconds, 0 to disable
+ *
+ * Commands which do not get their reply within @threshold are reported
+ * via the domainMonitorSlow callback while they are still waiting.
+ */
+void
+qemuMonitorSetSlowThreshold(qemuMonitorPtr mon,
+                            unsigned int threshold)
+{
+    virObjectLock(mon);
+    mon->slowThreshold = threshold;
+    virObjectUnlock(mon);
+}
+
+
 /**
  * This function returns a new virError object; the caller is responsible
  * for freeing it.
@@ -1551,6 +1959,19 @@ qemuMonitorEmitGuestCrashloaded(qemuMonitorPtr mon)
 }
 
 
+int
+qemuMonitorEmitMonitorSlow(qemuMonitorPtr mon,
+                           const char *command,
+                           unsigned long long elapsed)
+{
+    int ret = -1;
+    VIR_DEBUG("mon=%p command=%s elapsed=%llu", mon, command, elapsed);
+    QEMU_MONITOR_CALLBACK(mon, ret, domainMonitorSlow, mon->vm,
+                          command, elapsed);
+    return ret;
+}
+
+
 int
 qemuMonitorSetCapabilities(qemuMonitorPtr mon)
 {
@@ -2183,6 +2604,46 @@ qemuMonitorBlockStatsUpdateCapacityBlockdev(qemuMonitorPtr mon,
 }
 
 
+/**
+ * qemuMonitorGetAllBlockStatsInfoBlockdev:
+ * @mon: monitor object
+ * @ret_stats: pointer that is filled with a hash table containing the stats
+ * @backingChain: recurse into the backing chain of devices
+ *
+ * Same as qemuMonitorGetAllBlockStatsInfo followed by
+ * qemuMonitorBlockStatsUpdateCapacityBlockdev, but the two underlying
+ * commands are pipelined to save a round-trip to the monitor.
+ *
+ * Returns the count of supported block stats fields on success, -1 on
+ * error. If only the capacity data could not be fetched -2 is returned
+ * and @ret_stats is still filled.
+ */
+int
+qemuMonitorGetAllBlockStatsInfoBlockdev(qemuMonitorPtr mon,
+                                        virHashTablePtr *ret_stats,
+                                        bool backingChain)
+{
+    int ret;
+
+    VIR_DEBUG("ret_stats=%p, backing=%d", ret_stats, backingChain);
+
+    QEMU_CHECK_MONITOR(mon);
+
+    if (!(*ret_stats = virHashCreate(10, virHashValueFree)))
+        return -1;
+
+    ret = qemuMonitorJSONGetAllBlockStatsInfoBlockdev(mon, *ret_stats,
+                                                      backingChain);
+
+    if (ret == -1) {
+        virHashFree(*ret_stats);
+        *ret_stats = NULL;
+    }
+
+    return ret;
+}
+
+
 /**
  * qemuMonitorBlockGetNamedNodeData:
  * @mon: monitor object
@@ -2393,6 +2854,29 @@ qemuMonitorSetDBusVMStateIdList(qemuMonitorPtr mon,
 }
 
 
+/**
+ * qemuMonitorSetMemoryBackendsMerge:
+ * @mon: monitor object
+ * @merge: whether pages of guest memory should be merged by KSM
+ *
+ * Sets the 'merge' property, i.e. MADV_MERGEABLE, of all memory backend
+ * objects. Guest memory which is not in a backend object (the plain -m
+ * memory) is not affected.
+ *
+ * Returns the number of updated backends on success, -1 on error.
+ */
+int
+qemuMonitorSetMemoryBackendsMerge(qemuMonitorPtr mon,
+                                  bool merge)
+{
+    VIR_DEBUG("merge=%d", merge);
+
+    QEMU_CHECK_MONITOR(mon);
+
+    return qemuMonitorJSONSetMemoryBackendsMerge(mon, merge);
+}
+
+
 int
 qemuMonitorSetMigrationSpeed(qemuMonitorPtr mon,
                              unsigned long bandwidth)
@@ -3360,6 +3844,30 @@ qemuMonitorJobComplete(qemuMonitorPtr mon,
 }
 
 
+int
+qemuMonitorJobPause(qemuMonitorPtr mon,
+                    const char *jobname)
+{
+    VIR_DEBUG("jobname=%s", jobname);
+
+    QEMU_CHECK_MONITOR(mon);
+
+    return qemuMonitorJSONJobPause(mon, jobname);
+}
+
+
+int
+qemuMonitorJobResume(qemuMonitorPtr mon,
+                     const char *jobname)
+{
+    VIR_DEBUG("jobname=%s", jobname);
+
+    QEMU_CHECK_MONITOR(mon);
+
+    return qemuMonitorJSONJobResume(mon, jobname);
+}
+
+
 int
 qemuMonitorSetBlockIoThrottle(qemuMonitorPtr mon,
                               const char *drivealias,
@@ -4252,6 +4760,28 @@ qemuMonitorSetBlockThreshold(qemuMonitorPtr mon,
 }
 
 
+/**
+ * qemuMonitorBlockLatencyHistogramSet:
+ * @mon: monitor object
+ * @id: qdev id or QOM path of the disk frontend
+ * @histograms: array of VIR_DOMAIN_DISK_LATENCY_HISTOGRAM_LAST histograms
+ *
+ * Enables the latency histograms of the disk which have bins configured
+ * in @histograms.
+ */
+int
+qemuMonitorBlockLatencyHistogramSet(qemuMonitorPtr mon,
+                                    const char *id,
+                                    const virDomainDiskLatencyHistogram *histograms)
+{
+    VIR_DEBUG("id='%s'", id);
+
+    QEMU_CHECK_MONITOR(mon);
+
+    return qemuMonitorJSONBlockLatencyHistogramSet(mon, id, histograms);
+}
+
+
 virJSONValuePtr
 qemuMonitorQueryNamedBlockNodes(qemuMonitorPtr mon)
 {
@@ -4544,6 +5074,30 @@ qemuMonitorGetCPUMigratable(qemuMonitorPtr mon,
 }
 
 
+int
+qemuMonitorStartDirtyRateCalc(qemuMonitorPtr mon,
+                              int seconds)
+{
+    VIR_DEBUG("seconds=%d", seconds);
+
+    QEMU_CHECK_MONITOR(mon);
+
+    return qemuMonitorJSONStartDirtyRateCalc(mon, seconds);
+}
+
+
+int
+qemuMonitorQueryDirtyRate(qemuMonitorPtr mon,
+                          qemuMonitorDirtyRateInfoPtr info)
+{
+    VIR_DEBUG("info=%p", info);
+
+    QEMU_CHECK_MONITOR(mon);
+
+    return qemuMonitorJSONQueryDirtyRate(mon, info);
+}
+
+
 int
 qemuMonitorTransactionBitmapAdd(virJSONValuePtr actions,
                                 const char *node,
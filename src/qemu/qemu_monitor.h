@@ -26,6 +26,7 @@
 #include "domain_conf.h"
 #include "virbitmap.h"
 #include "virhash.h"
+#include "virhistogram.h"
 #include "virjson.h"
 #include "virnetdev.h"
 #include "device_conf.h"
@@ -56,6 +57,30 @@ struct _qemuMonitorMessage {
      * fatal error occurred on the monitor channel
      */
     bool finished;
+
+    /* Command "id" used to match the reply to this message. Not owned
+     * by the message. May be NULL for messages without an id. */
+    const char *id;
+
+    /* NULL terminated list of members of the reply the caller is
+     * interested in (see virJSONValueFromStringFiltered). Everything
+     * else is dropped while parsing the reply. NULL keeps everything. */
+    const char *const *replyFilter;
+
+    /* Parse the reply into an arena (see virJSONValueFromStringArena).
+     * The reply must be used read-only then. */
+    bool replyArena;
+
+    /* Monotonic times in microseconds when the message was completely
+     * written to the monitor and when its reply arrived, 0 until then */
+    unsigned long long written;
+    unsigned long long replied;
+
+    /* Further messages which are to be submitted in the same
+     * qemuMonitorSend() call. They are written to the monitor
+     * back-to-back without waiting for the reply of the previous
+     * one. */
+    qemuMonitorMessagePtr next;
 };
 
 typedef enum {
@@ -340,6 +365,12 @@ typedef int (*qemuMonitorDomainGuestCrashloadedCallback)(qemuMonitorPtr mon,
                                                          virDomainObjPtr vm,
                                                          void *opaque);
 
+typedef int (*qemuMonitorDomainMonitorSlowCallback)(qemuMonitorPtr mon,
+                                                    virDomainObjPtr vm,
+                                                    const char *command,
+                                                    unsigned long long elapsed,
+                                                    void *opaque);
+
 typedef struct _qemuMonitorCallbacks qemuMonitorCallbacks;
 typedef qemuMonitorCallbacks *qemuMonitorCallbacksPtr;
 struct _qemuMonitorCallbacks {
@@ -376,6 +407,7 @@ struct _qemuMonitorCallbacks {
     qemuMonitorDomainPRManagerStatusChangedCallback domainPRManagerStatusChanged;
     qemuMonitorDomainRdmaGidStatusChangedCallback domainRdmaGidStatusChanged;
     qemuMonitorDomainGuestCrashloadedCallback domainGuestCrashloaded;
+    qemuMonitorDomainMonitorSlowCallback domainMonitorSlow;
 };
 
 qemuMonitorPtr qemuMonitorOpen(virDomainObjPtr vm,
@@ -396,8 +428,52 @@ void qemuMonitorUnregister(qemuMonitorPtr mon)
     ATTRIBUTE_NONNULL(1);
 void qemuMonitorClose(qemuMonitorPtr mon);
 
+void qemuMonitorSetEventContext(qemuMonitorPtr mon,
+                                GMainContext *context)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+unsigned long long qemuMonitorGetDispatchTime(qemuMonitorPtr mon)
+    ATTRIBUTE_NONNULL(1);
+
 virErrorPtr qemuMonitorLastError(qemuMonitorPtr mon);
 
+typedef struct _qemuMonitorCommandStats qemuMonitorCommandStats;
+typedef qemuMonitorCommandStats *qemuMonitorCommandStatsPtr;
+struct _qemuMonitorCommandStats {
+    unsigned long long commands;
+    unsigned long long failed;
+    unsigned long long timeAvg; /* in microseconds */
+    unsigned long long timeMax; /* in microseconds */
+};
+
+void qemuMonitorGetCommandStats(qemuMonitorCommandStatsPtr stats)
+    ATTRIBUTE_NONNULL(1);
+
+/* Latency of commands with the same name sent to a single monitor */
+typedef struct _qemuMonitorCommandLatency qemuMonitorCommandLatency;
+typedef qemuMonitorCommandLatency *qemuMonitorCommandLatencyPtr;
+struct _qemuMonitorCommandLatency {
+    char *name;
+    unsigned long long count;
+    unsigned long long failed;
+    /* total times in microseconds spent waiting for commands sent by
+     * other threads, writing the command and waiting for its reply */
+    unsigned long long queueTime;
+    unsigned long long writeTime;
+    unsigned long long replyTime;
+    virHistogram hist; /* of the whole latency of the commands */
+};
+
+int qemuMonitorGetCommandLatency(qemuMonitorPtr mon,
+                                 qemuMonitorCommandLatencyPtr *latency,
+                                 size_t *nlatency)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(3);
+void qemuMonitorCommandLatencyFree(qemuMonitorCommandLatencyPtr latency,
+                                   size_t nlatency);
+
+void qemuMonitorSetSlowThreshold(qemuMonitorPtr mon,
+                                 unsigned int threshold)
+    ATTRIBUTE_NONNULL(1);
+
 int qemuMonitorSetCapabilities(qemuMonitorPtr mon);
 
 int qemuMonitorSetLink(qemuMonitorPtr mon,
@@ -508,6 +584,9 @@ int qemuMonitorEmitRdmaGidStatusChanged(qemuMonitorPtr mon,
                                         unsigned long long interface_id);
 
 int qemuMonitorEmitGuestCrashloaded(qemuMonitorPtr mon);
+int qemuMonitorEmitMonitorSlow(qemuMonitorPtr mon,
+                               const char *command,
+                               unsigned long long elapsed);
 
 int qemuMonitorStartCPUs(qemuMonitorPtr mon);
 int qemuMonitorStopCPUs(qemuMonitorPtr mon);
@@ -638,6 +717,16 @@ virHashTablePtr qemuMonitorGetBlockInfo(qemuMonitorPtr mon);
 
 virJSONValuePtr qemuMonitorQueryBlockstats(qemuMonitorPtr mon);
 
+/* Latency histogram of one type of block operations. The number of
+ * bins is bounded so that qemuBlockStats can still be copied by value. */
+typedef struct _qemuBlockStatsHistogram qemuBlockStatsHistogram;
+typedef qemuBlockStatsHistogram *qemuBlockStatsHistogramPtr;
+struct _qemuBlockStatsHistogram {
+    size_t nbins; /* 0 if the histogram isn't enabled */
+    unsigned long long starts[VIR_DOMAIN_DISK_LATENCY_HISTOGRAM_BINS_MAX]; /* ns */
+    unsigned long long counts[VIR_DOMAIN_DISK_LATENCY_HISTOGRAM_BINS_MAX];
+};
+
 typedef struct _qemuBlockStats qemuBlockStats;
 typedef qemuBlockStats *qemuBlockStatsPtr;
 struct _qemuBlockStats {
@@ -659,6 +748,10 @@ struct _qemuBlockStats {
 
     /* write_threshold is valid only if it's non-zero, conforming to qemu semantics */
     unsigned long long write_threshold;
+
+    qemuBlockStatsHistogram rd_histogram;
+    qemuBlockStatsHistogram wr_histogram;
+    qemuBlockStatsHistogram fl_histogram;
 };
 
 int qemuMonitorGetAllBlockStatsInfo(qemuMonitorPtr mon,
@@ -674,6 +767,10 @@ int qemuMonitorBlockStatsUpdateCapacity(qemuMonitorPtr mon,
 int qemuMonitorBlockStatsUpdateCapacityBlockdev(qemuMonitorPtr mon,
                                                 virHashTablePtr stats)
     ATTRIBUTE_NONNULL(2);
+int qemuMonitorGetAllBlockStatsInfoBlockdev(qemuMonitorPtr mon,
+                                            virHashTablePtr *ret_stats,
+                                            bool backingChain)
+    ATTRIBUTE_NONNULL(2);
 
 typedef struct _qemuBlockNamedNodeDataBitmap qemuBlockNamedNodeDataBitmap;
 typedef qemuBlockNamedNodeDataBitmap *qemuBlockNamedNodeDataBitmapPtr;
@@ -743,6 +840,9 @@ int qemuMonitorSavePhysicalMemory(qemuMonitorPtr mon,
 int qemuMonitorSetDBusVMStateIdList(qemuMonitorPtr mon,
                                     const char **list);
 
+int qemuMonitorSetMemoryBackendsMerge(qemuMonitorPtr mon,
+                                      bool merge);
+
 int qemuMonitorSetMigrationSpeed(qemuMonitorPtr mon,
                                  unsigned long bandwidth);
 
@@ -805,6 +905,7 @@ struct _qemuMonitorMigrationStats {
     unsigned long long ram_page_size;
     unsigned long long ram_iteration;
     unsigned long long ram_postcopy_reqs;
+    unsigned long long ram_multifd_bytes;
 
     unsigned long long disk_transferred;
     unsigned long long disk_remaining;
@@ -1059,6 +1160,14 @@ int qemuMonitorJobComplete(qemuMonitorPtr mon,
                            const char *jobname)
     ATTRIBUTE_NONNULL(2);
 
+int qemuMonitorJobPause(qemuMonitorPtr mon,
+                        const char *jobname)
+    ATTRIBUTE_NONNULL(2);
+
+int qemuMonitorJobResume(qemuMonitorPtr mon,
+                         const char *jobname)
+    ATTRIBUTE_NONNULL(2);
+
 int qemuMonitorOpenGraphics(qemuMonitorPtr mon,
                             const char *protocol,
                             int fd,
@@ -1317,6 +1426,10 @@ int qemuMonitorSetBlockThreshold(qemuMonitorPtr mon,
                                  const char *nodename,
                                  unsigned long long threshold);
 
+int qemuMonitorBlockLatencyHistogramSet(qemuMonitorPtr mon,
+                                        const char *id,
+                                        const virDomainDiskLatencyHistogram *histograms);
+
 virJSONValuePtr qemuMonitorQueryNamedBlockNodes(qemuMonitorPtr mon);
 
 int qemuMonitorSetWatchdogAction(qemuMonitorPtr mon,
@@ -1381,6 +1494,25 @@ int
 qemuMonitorGetCPUMigratable(qemuMonitorPtr mon,
                             bool *migratable);
 
+int
+qemuMonitorStartDirtyRateCalc(qemuMonitorPtr mon,
+                              int seconds);
+
+typedef struct _qemuMonitorDirtyRateInfo qemuMonitorDirtyRateInfo;
+typedef qemuMonitorDirtyRateInfo *qemuMonitorDirtyRateInfoPtr;
+
+struct _qemuMonitorDirtyRateInfo {
+    int status;             /* the status of last dirtyrate calculation,
+                               one of virDomainDirtyRateStatus */
+    int calcTime;           /* the period of dirtyrate calculation */
+    long long startTime;    /* the start time of dirtyrate calculation */
+    long long dirtyRate;    /* the dirtyrate in MiB/s */
+};
+
+int
+qemuMonitorQueryDirtyRate(qemuMonitorPtr mon,
+                          qemuMonitorDirtyRateInfoPtr info);
+
 int
 qemuMonitorTransactionBitmapAdd(virJSONValuePtr actions,
                                 const char *node,
@@ -209,6 +209,73 @@ qemuMonitorJSONIOProcessEvent(qemuMonitorPtr mon,
     return 0;
 }
 
+/* Find the message a reply belongs to. @msg is the head of the chain of
+ * pending messages. Replies are matched via their "id". As QEMU
+ * processes commands in order, replies without a known id belong to the
+ * first transmitted message still waiting for its reply. */
+static qemuMonitorMessagePtr
+qemuMonitorJSONFindReplyMessage(qemuMonitorMessagePtr msg,
+                                virJSONValuePtr reply)
+{
+    const char *id = virJSONValueObjectGetString(reply, "id");
+    qemuMonitorMessagePtr first = NULL;
+
+    for (; msg && msg->txOffset == msg->txLength; msg = msg->next) {
+        if (msg->finished)
+            continue;
+
+        if (id && STREQ_NULLABLE(id, msg->id))
+            return msg;
+
+        if (!first)
+            first = msg;
+    }
+
+    return first;
+}
+
+
+/* Parses @line. If the message expecting the next reply asked for only
+ * parts of the reply, the rest is dropped while parsing. Members needed
+ * to dispatch events and replies are always kept. The message may also
+ * ask for the reply to be parsed into an arena. */
+static virJSONValuePtr
+qemuMonitorJSONParseLine(const char *line,
+                         qemuMonitorMessagePtr msg)
+{
+    static const char *common[] = {
+        "QMP", "event", "data", "timestamp", "error", "id",
+    };
+    g_autofree const char **filter = NULL;
+    size_t n;
+    size_t i;
+
+    while (msg && msg->finished)
+        msg = msg->next;
+
+    if (!msg || msg->txOffset < msg->txLength ||
+        (!msg->replyFilter && !msg->replyArena))
+        return virJSONValueFromString(line);
+
+    if (!msg->replyFilter)
+        return virJSONValueFromStringArena(line, NULL);
+
+    for (n = 0; msg->replyFilter[n]; n++)
+        ;
+
+    filter = g_new0(const char *, G_N_ELEMENTS(common) + n + 1);
+    for (i = 0; i < G_N_ELEMENTS(common); i++)
+        filter[i] = common[i];
+    for (i = 0; i < n; i++)
+        filter[G_N_ELEMENTS(common) + i] = msg->replyFilter[i];
+
+    if (msg->replyArena)
+        return virJSONValueFromStringArena(line, filter);
+
+    return virJSONValueFromStringFiltered(line, filter);
+}
+
+
 int
 qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
                              const char *line,
@@ -219,7 +286,7 @@ qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
 
     VIR_DEBUG("Line [%s]", line);
 
-    if (!(obj = virJSONValueFromString(line)))
+    if (!(obj = qemuMonitorJSONParseLine(line, msg)))
         goto cleanup;
 
     if (virJSONValueGetType(obj) != VIR_JSON_TYPE_OBJECT) {
@@ -238,8 +305,9 @@ qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
                virJSONValueObjectHasKey(obj, "return") == 1) {
         PROBE(QEMU_MONITOR_RECV_REPLY,
               "mon=%p reply=%s", mon, line);
-        if (msg) {
+        if ((msg = qemuMonitorJSONFindReplyMessage(msg, obj))) {
             msg->rxObject = obj;
+            msg->replied = g_get_monotonic_time();
             msg->finished = 1;
             obj = NULL;
             ret = 0;
@@ -293,10 +361,12 @@ int qemuMonitorJSONIOProcess(qemuMonitorPtr mon,
 }
 
 static int
-qemuMonitorJSONCommandWithFd(qemuMonitorPtr mon,
-                             virJSONValuePtr cmd,
-                             int scm_fd,
-                             virJSONValuePtr *reply)
+qemuMonitorJSONCommandFull(qemuMonitorPtr mon,
+                           virJSONValuePtr cmd,
+                           int scm_fd,
+                           const char *const *filter,
+                           bool arena,
+                           virJSONValuePtr *reply)
 {
     int ret = -1;
     qemuMonitorMessage msg;
@@ -324,6 +394,8 @@ qemuMonitorJSONCommandWithFd(qemuMonitorPtr mon,
     msg.txLength = virBufferUse(&cmdbuf);
     msg.txBuffer = virBufferContentAndReset(&cmdbuf);
     msg.txFD = scm_fd;
+    msg.replyFilter = filter;
+    msg.replyArena = arena;
 
     ret = qemuMonitorSend(mon, &msg);
 
@@ -345,14 +417,159 @@ qemuMonitorJSONCommandWithFd(qemuMonitorPtr mon,
 }
 
 
+static int
+qemuMonitorJSONCommandWithFd(qemuMonitorPtr mon,
+                             virJSONValuePtr cmd,
+                             int scm_fd,
+                             virJSONValuePtr *reply)
+{
+    return qemuMonitorJSONCommandFull(mon, cmd, scm_fd, NULL, false, reply);
+}
+
+
 static int
 qemuMonitorJSONCommand(qemuMonitorPtr mon,
                        virJSONValuePtr cmd,
                        virJSONValuePtr *reply)
 {
-    return qemuMonitorJSONCommandWithFd(mon, cmd, -1, reply);
+    return qemuMonitorJSONCommandFull(mon, cmd, -1, NULL, false, reply);
 }
 
+
+/**
+ * qemuMonitorJSONCommandArena:
+ * @mon: monitor object
+ * @cmd: command to execute
+ * @reply: filled with the reply
+ *
+ * Same as qemuMonitorJSONCommand, but the reply is parsed into an arena
+ * which makes building and freeing it much cheaper. Meant for callers
+ * which only read data from the reply and then throw it away; members
+ * stolen from the reply are copied.
+ */
+static int
+qemuMonitorJSONCommandArena(qemuMonitorPtr mon,
+                            virJSONValuePtr cmd,
+                            virJSONValuePtr *reply)
+{
+    return qemuMonitorJSONCommandFull(mon, cmd, -1, NULL, true, reply);
+}
+
+
+/**
+ * qemuMonitorJSONCommandFiltered:
+ * @mon: monitor object
+ * @cmd: command to execute
+ * @filter: NULL terminated list of members of the reply to keep
+ * @reply: filled with the reply
+ *
+ * Same as qemuMonitorJSONCommandArena, but only the members of the
+ * reply listed in @filter (as dotted paths starting at "return", see
+ * virJSONValueFromStringFiltered) are parsed into @reply. Useful for
+ * commands with huge replies of which only a few fields are needed.
+ */
+static int
+qemuMonitorJSONCommandFiltered(qemuMonitorPtr mon,
+                               virJSONValuePtr cmd,
+                               const char *const *filter,
+                               virJSONValuePtr *reply)
+{
+    return qemuMonitorJSONCommandFull(mon, cmd, -1, filter, true, reply);
+}
+
+
+/**
+ * qemuMonitorJSONCommandPipelined:
+ * @mon: monitor object
+ * @cmds: array of commands
+ * @ncmds: number of commands in @cmds
+ * @filters: optional array of @ncmds reply filters
+ * @replies: array of @ncmds entries filled with the replies
+ *
+ * Submits all @cmds to the monitor back-to-back without waiting for the
+ * reply of the previous command and then waits for all replies. Replies
+ * are returned in the order of @cmds and need to be checked for QMP
+ * errors by the caller as with qemuMonitorJSONCommand. If @filters is
+ * non-NULL, each non-NULL member is used to prune the reply of the
+ * corresponding command as in qemuMonitorJSONCommandFiltered. With
+ * @arena the replies are parsed as in qemuMonitorJSONCommandArena.
+ *
+ * Returns 0 on success, -1 on failure (no replies are returned then).
+ */
+static int
+qemuMonitorJSONCommandPipelined(qemuMonitorPtr mon,
+                                virJSONValuePtr *cmds,
+                                size_t ncmds,
+                                const char *const **filters,
+                                bool arena,
+                                virJSONValuePtr *replies)
+{
+    g_autofree qemuMonitorMessagePtr msgs = NULL;
+    g_autofree char **ids = NULL;
+    size_t i;
+    int ret = -1;
+
+    if (ncmds == 0)
+        return 0;
+
+    msgs = g_new0(qemuMonitorMessage, ncmds);
+    ids = g_new0(char *, ncmds);
+
+    for (i = 0; i < ncmds; i++) {
+        g_auto(virBuffer) cmdbuf = VIR_BUFFER_INITIALIZER;
+
+        replies[i] = NULL;
+
+        if (!(ids[i] = qemuMonitorNextCommandID(mon)))
+            goto cleanup;
+        if (virJSONValueObjectAppendString(cmds[i], "id", ids[i]) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("Unable to append command 'id' string"));
+            goto cleanup;
+        }
+
+        if (virJSONValueToBuffer(cmds[i], &cmdbuf, false) < 0)
+            goto cleanup;
+        virBufferAddLit(&cmdbuf, "\r\n");
+
+        msgs[i].txLength = virBufferUse(&cmdbuf);
+        msgs[i].txBuffer = virBufferContentAndReset(&cmdbuf);
+        msgs[i].txFD = -1;
+        msgs[i].id = ids[i];
+        if (filters)
+            msgs[i].replyFilter = filters[i];
+        msgs[i].replyArena = arena;
+        if (i > 0)
+            msgs[i - 1].next = &msgs[i];
+    }
+
+    if (qemuMonitorSend(mon, msgs) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ncmds; i++) {
+        if (!msgs[i].rxObject) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("Missing monitor reply object"));
+            goto cleanup;
+        }
+    }
+
+    for (i = 0; i < ncmds; i++)
+        replies[i] = g_steal_pointer(&msgs[i].rxObject);
+
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < ncmds; i++) {
+        VIR_FREE(ids[i]);
+        VIR_FREE(msgs[i].txBuffer);
+        virJSONValueFree(msgs[i].rxObject);
+    }
+
+    return ret;
+}
+
+
 /* Ignoring OOM in this method, since we're already reporting
  * a more important error
  *
@@ -1988,7 +2205,7 @@ qemuMonitorJSONQueryCPUs(qemuMonitorPtr mon,
     if (!cmd)
         return -1;
 
-    if (qemuMonitorJSONCommand(mon, cmd, &reply) < 0)
+    if (qemuMonitorJSONCommandArena(mon, cmd, &reply) < 0)
         goto cleanup;
 
     if (force && qemuMonitorJSONCheckError(cmd, reply) < 0)
@@ -2176,7 +2393,7 @@ qemuMonitorJSONGetBalloonInfo(qemuMonitorPtr mon,
     if (!cmd)
         return -1;
 
-    if (qemuMonitorJSONCommand(mon, cmd, &reply) < 0)
+    if (qemuMonitorJSONCommandArena(mon, cmd, &reply) < 0)
         goto cleanup;
 
     /* See if balloon soft-failed */
@@ -2369,6 +2586,48 @@ qemuMonitorJSONSetDBusVMStateIdList(qemuMonitorPtr mon,
 }
 
 
+int
+qemuMonitorJSONSetMemoryBackendsMerge(qemuMonitorPtr mon,
+                                      bool merge)
+{
+    qemuMonitorJSONListPathPtr *paths = NULL;
+    qemuMonitorJSONObjectProperty prop = {
+        .type = QEMU_MONITOR_OBJECT_PROPERTY_BOOLEAN,
+        .val.b = merge,
+    };
+    int npaths;
+    int nbackends = 0;
+    int ret = -1;
+    size_t i;
+
+    if ((npaths = qemuMonitorJSONGetObjectListPaths(mon, "/objects", &paths)) < 0)
+        return -1;
+
+    for (i = 0; i < npaths; i++) {
+        g_autofree char *path = NULL;
+
+        if (!STRPREFIX(paths[i]->type, "child<memory-backend-"))
+            continue;
+
+        path = g_strdup_printf("/objects/%s", paths[i]->name);
+
+        /* the setter calls madvise() on the backend right away */
+        if (qemuMonitorJSONSetObjectProperty(mon, path, "merge", &prop) < 0)
+            goto cleanup;
+
+        nbackends++;
+    }
+
+    ret = nbackends;
+
+ cleanup:
+    for (i = 0; i < npaths; i++)
+        qemuMonitorJSONListPathFree(paths[i]);
+    VIR_FREE(paths);
+    return ret;
+}
+
+
 /* qemuMonitorJSONQueryBlock:
  * @mon: Monitor pointer
  *
@@ -2539,6 +2798,46 @@ int qemuMonitorJSONGetBlockInfo(qemuMonitorPtr mon,
 }
 
 
+/* Histograms with more bins than we can store, e.g. set up outside of
+ * libvirt, are silently skipped */
+static void
+qemuMonitorJSONBlockStatsCollectHistogram(virJSONValuePtr stats,
+                                          const char *name,
+                                          qemuBlockStatsHistogramPtr hist)
+{
+    virJSONValuePtr data;
+    virJSONValuePtr boundaries;
+    virJSONValuePtr bins;
+    size_t nbins;
+    size_t i;
+
+    if (!(data = virJSONValueObjectGetObject(stats, name)) ||
+        !(boundaries = virJSONValueObjectGetArray(data, "boundaries")) ||
+        !(bins = virJSONValueObjectGetArray(data, "bins")))
+        return;
+
+    nbins = virJSONValueArraySize(bins);
+    if (nbins != virJSONValueArraySize(boundaries) + 1 ||
+        nbins > G_N_ELEMENTS(hist->counts))
+        return;
+
+    for (i = 0; i < nbins; i++) {
+        if (virJSONValueGetNumberUlong(virJSONValueArrayGet(bins, i),
+                                       &hist->counts[i]) < 0)
+            return;
+
+        if (i == 0) {
+            hist->starts[i] = 0;
+        } else if (virJSONValueGetNumberUlong(virJSONValueArrayGet(boundaries, i - 1),
+                                              &hist->starts[i]) < 0) {
+            return;
+        }
+    }
+
+    hist->nbins = nbins;
+}
+
+
 static qemuBlockStatsPtr
 qemuMonitorJSONBlockStatsCollectData(virJSONValuePtr dev,
                                      int *nstats)
@@ -2577,6 +2876,13 @@ qemuMonitorJSONBlockStatsCollectData(virJSONValuePtr dev,
     QEMU_MONITOR_BLOCK_STAT_GET("flush_total_time_ns", bstats->flush_total_times, false);
 #undef QEMU_MONITOR_BLOCK_STAT_GET
 
+    qemuMonitorJSONBlockStatsCollectHistogram(stats, "rd_latency_histogram",
+                                              &bstats->rd_histogram);
+    qemuMonitorJSONBlockStatsCollectHistogram(stats, "wr_latency_histogram",
+                                              &bstats->wr_histogram);
+    qemuMonitorJSONBlockStatsCollectHistogram(stats, "flush_latency_histogram",
+                                              &bstats->fl_histogram);
+
     if ((parent = virJSONValueObjectGetObject(dev, "parent")) &&
         (parentstats = virJSONValueObjectGetObject(parent, "stats"))) {
         if (virJSONValueObjectGetNumberUlong(parentstats, "wr_highest_offset",
@@ -2687,18 +2993,14 @@ qemuMonitorJSONQueryBlockstats(qemuMonitorPtr mon)
 }
 
 
-int
-qemuMonitorJSONGetAllBlockStatsInfo(qemuMonitorPtr mon,
-                                    virHashTablePtr hash,
-                                    bool backingChain)
+static int
+qemuMonitorJSONGetAllBlockStatsInfoParse(virJSONValuePtr devices,
+                                         virHashTablePtr hash,
+                                         bool backingChain)
 {
     int nstats = 0;
     int rc;
     size_t i;
-    g_autoptr(virJSONValue) devices = NULL;
-
-    if (!(devices = qemuMonitorJSONQueryBlockstats(mon)))
-        return -1;
 
     for (i = 0; i < virJSONValueArraySize(devices); i++) {
         virJSONValuePtr dev = virJSONValueArrayGet(devices, i);
@@ -2735,6 +3037,28 @@ qemuMonitorJSONGetAllBlockStatsInfo(qemuMonitorPtr mon,
 }
 
 
+int
+qemuMonitorJSONGetAllBlockStatsInfo(qemuMonitorPtr mon,
+                                    virHashTablePtr hash,
+                                    bool backingChain)
+{
+    g_autoptr(virJSONValue) cmd = NULL;
+    g_autoptr(virJSONValue) reply = NULL;
+
+    if (!(cmd = qemuMonitorJSONMakeCommand("query-blockstats", NULL)))
+        return -1;
+
+    if (qemuMonitorJSONCommandArena(mon, cmd, &reply) < 0)
+        return -1;
+
+    if (qemuMonitorJSONCheckReply(cmd, reply, VIR_JSON_TYPE_ARRAY) < 0)
+        return -1;
+
+    return qemuMonitorJSONGetAllBlockStatsInfoParse(virJSONValueObjectGetArray(reply, "return"),
+                                                    hash, backingChain);
+}
+
+
 static int
 qemuMonitorJSONBlockStatsUpdateCapacityData(virJSONValuePtr image,
                                             const char *name,
@@ -2872,25 +3196,129 @@ qemuMonitorJSONBlockStatsUpdateCapacityBlockdevWorker(size_t pos G_GNUC_UNUSED,
 }
 
 
+/* The 'query-named-block-nodes' reply is parsed into an arena, so iterate
+ * it directly rather than via virJSONValueArrayForeachSteal, which would
+ * have to copy each entry. */
+static int
+qemuMonitorJSONBlockStatsUpdateCapacityBlockdevNodes(virJSONValuePtr nodes,
+                                                     virHashTablePtr stats)
+{
+    size_t i;
+
+    for (i = 0; i < virJSONValueArraySize(nodes); i++) {
+        if (qemuMonitorJSONBlockStatsUpdateCapacityBlockdevWorker(i,
+                                                                  virJSONValueArrayGet(nodes, i),
+                                                                  stats) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/* Members of the 'query-named-block-nodes' reply used by
+ * qemuMonitorJSONBlockStatsUpdateCapacityBlockdevWorker. Parsing just
+ * these avoids building the (potentially huge) 'backing-image' trees. */
+static const char *qemuMonitorJSONBlockStatsCapacityFilter[] = {
+    "return.node-name",
+    "return.write_threshold",
+    "return.image.virtual-size",
+    "return.image.actual-size",
+    NULL
+};
+
+
 int
 qemuMonitorJSONBlockStatsUpdateCapacityBlockdev(qemuMonitorPtr mon,
                                                 virHashTablePtr stats)
 {
+    g_autoptr(virJSONValue) cmd = NULL;
+    g_autoptr(virJSONValue) reply = NULL;
     virJSONValuePtr nodes;
-    int ret = -1;
 
-    if (!(nodes = qemuMonitorJSONQueryNamedBlockNodes(mon, false)))
+    if (!(cmd = qemuMonitorJSONMakeCommand("query-named-block-nodes",
+                                           "B:flat", false,
+                                           NULL)))
+        return -1;
+
+    if (qemuMonitorJSONCommandFiltered(mon, cmd,
+                                       qemuMonitorJSONBlockStatsCapacityFilter,
+                                       &reply) < 0)
         return -1;
 
-    if (virJSONValueArrayForeachSteal(nodes,
-                                      qemuMonitorJSONBlockStatsUpdateCapacityBlockdevWorker,
-                                      stats) < 0)
+    if (qemuMonitorJSONCheckReply(cmd, reply, VIR_JSON_TYPE_ARRAY) < 0)
+        return -1;
+
+    nodes = virJSONValueObjectGetArray(reply, "return");
+
+    return qemuMonitorJSONBlockStatsUpdateCapacityBlockdevNodes(nodes, stats);
+}
+
+
+/**
+ * qemuMonitorJSONGetAllBlockStatsInfoBlockdev:
+ * @mon: monitor object
+ * @hash: hash table filled with the stats
+ * @backingChain: recurse into the backing chain of devices
+ *
+ * Combination of qemuMonitorJSONGetAllBlockStatsInfo and
+ * qemuMonitorJSONBlockStatsUpdateCapacityBlockdev which submits
+ * 'query-blockstats' and 'query-named-block-nodes' in one pipelined
+ * round-trip to the monitor.
+ *
+ * Returns the count of supported block stats fields on success, -1 if
+ * 'query-blockstats' failed and -2 if only the capacity data could not
+ * be gathered (@hash contains the stats in such case).
+ */
+int
+qemuMonitorJSONGetAllBlockStatsInfoBlockdev(qemuMonitorPtr mon,
+                                            virHashTablePtr hash,
+                                            bool backingChain)
+{
+    virJSONValuePtr cmds[2] = { NULL, NULL };
+    const char *const *filters[2] = {
+        NULL, qemuMonitorJSONBlockStatsCapacityFilter
+    };
+    virJSONValuePtr replies[2] = { NULL, NULL };
+    virJSONValuePtr devices;
+    virJSONValuePtr nodes;
+    int nstats;
+    int ret = -1;
+
+    if (!(cmds[0] = qemuMonitorJSONMakeCommand("query-blockstats", NULL)) ||
+        !(cmds[1] = qemuMonitorJSONMakeCommand("query-named-block-nodes",
+                                               "B:flat", false,
+                                               NULL)))
         goto cleanup;
 
-    ret = 0;
+    if (qemuMonitorJSONCommandPipelined(mon, cmds, G_N_ELEMENTS(cmds),
+                                        filters, true, replies) < 0)
+        goto cleanup;
+
+    if (qemuMonitorJSONCheckReply(cmds[0], replies[0], VIR_JSON_TYPE_ARRAY) < 0)
+        goto cleanup;
+
+    devices = virJSONValueObjectGetArray(replies[0], "return");
+    if ((nstats = qemuMonitorJSONGetAllBlockStatsInfoParse(devices, hash,
+                                                           backingChain)) < 0)
+        goto cleanup;
+
+    ret = -2;
+
+    if (qemuMonitorJSONCheckReply(cmds[1], replies[1], VIR_JSON_TYPE_ARRAY) < 0)
+        goto cleanup;
+
+    nodes = virJSONValueObjectGetArray(replies[1], "return");
+    if (qemuMonitorJSONBlockStatsUpdateCapacityBlockdevNodes(nodes, hash) < 0)
+        goto cleanup;
+
+    ret = nstats;
 
  cleanup:
-    virJSONValueFree(nodes);
+    virJSONValueFree(cmds[0]);
+    virJSONValueFree(cmds[1]);
+    virJSONValueFree(replies[0]);
+    virJSONValueFree(replies[1]);
     return ret;
 }
 
@@ -3596,6 +4024,8 @@ qemuMonitorJSONGetMigrationStatsReply(virJSONValuePtr reply,
                                                       &stats->ram_iteration));
         ignore_value(virJSONValueObjectGetNumberUlong(ram, "postcopy-requests",
                                                       &stats->ram_postcopy_reqs));
+        ignore_value(virJSONValueObjectGetNumberUlong(ram, "multifd-bytes",
+                                                      &stats->ram_multifd_bytes));
 
         disk = virJSONValueObjectGetObject(ret, "disk");
         if (disk) {
@@ -5211,6 +5641,50 @@ qemuMonitorJSONJobComplete(qemuMonitorPtr mon,
 }
 
 
+int
+qemuMonitorJSONJobPause(qemuMonitorPtr mon,
+                        const char *jobname)
+{
+    g_autoptr(virJSONValue) cmd = NULL;
+    g_autoptr(virJSONValue) reply = NULL;
+
+    if (!(cmd = qemuMonitorJSONMakeCommand("job-pause",
+                                           "s:id", jobname,
+                                           NULL)))
+        return -1;
+
+    if (qemuMonitorJSONCommand(mon, cmd, &reply) < 0)
+        return -1;
+
+    if (qemuMonitorJSONBlockJobError(cmd, reply, jobname) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+int
+qemuMonitorJSONJobResume(qemuMonitorPtr mon,
+                         const char *jobname)
+{
+    g_autoptr(virJSONValue) cmd = NULL;
+    g_autoptr(virJSONValue) reply = NULL;
+
+    if (!(cmd = qemuMonitorJSONMakeCommand("job-resume",
+                                           "s:id", jobname,
+                                           NULL)))
+        return -1;
+
+    if (qemuMonitorJSONCommand(mon, cmd, &reply) < 0)
+        return -1;
+
+    if (qemuMonitorJSONBlockJobError(cmd, reply, jobname) < 0)
+        return -1;
+
+    return 0;
+}
+
+
 int qemuMonitorJSONOpenGraphics(qemuMonitorPtr mon,
                                 const char *protocol,
                                 const char *fdname,
@@ -8040,7 +8514,7 @@ qemuMonitorJSONGetIOThreads(qemuMonitorPtr mon,
     if (!(cmd = qemuMonitorJSONMakeCommand("query-iothreads", NULL)))
         return ret;
 
-    if (qemuMonitorJSONCommand(mon, cmd, &reply) < 0)
+    if (qemuMonitorJSONCommandArena(mon, cmd, &reply) < 0)
         goto cleanup;
 
     if (qemuMonitorJSONCheckReply(cmd, reply, VIR_JSON_TYPE_ARRAY) < 0)
@@ -8737,6 +9211,69 @@ qemuMonitorJSONSetBlockThreshold(qemuMonitorPtr mon,
 }
 
 
+int
+qemuMonitorJSONBlockLatencyHistogramSet(qemuMonitorPtr mon,
+                                        const char *id,
+                                        const virDomainDiskLatencyHistogram *histograms)
+{
+    /* indexed by virDomainDiskLatencyHistogramType */
+    static const char *argnames[] = {
+        "boundaries",
+        "boundaries-read",
+        "boundaries-write",
+        "boundaries-flush",
+    };
+    g_autoptr(virJSONValue) cmd = NULL;
+    g_autoptr(virJSONValue) reply = NULL;
+    virJSONValuePtr args;
+    size_t i;
+    size_t j;
+
+    G_STATIC_ASSERT(G_N_ELEMENTS(argnames) == VIR_DOMAIN_DISK_LATENCY_HISTOGRAM_LAST);
+
+    if (!(cmd = qemuMonitorJSONMakeCommand("block-latency-histogram-set",
+                                           "s:id", id,
+                                           NULL)))
+        return -1;
+
+    args = virJSONValueObjectGetObject(cmd, "arguments");
+
+    for (i = 0; i < VIR_DOMAIN_DISK_LATENCY_HISTOGRAM_LAST; i++) {
+        g_autoptr(virJSONValue) boundaries = NULL;
+
+        if (histograms[i].nbins == 0)
+            continue;
+
+        boundaries = virJSONValueNewArray();
+
+        /* QEMU takes the upper bounds of all but the last bin, the first
+         * bin always starts at 0 */
+        for (j = 1; j < histograms[i].nbins; j++) {
+            g_autoptr(virJSONValue) val = virJSONValueNewNumberUlong(histograms[i].bins[j]);
+
+            if (virJSONValueArrayAppend(boundaries, val) < 0)
+                return -1;
+            val = NULL;
+        }
+
+        if (virJSONValueObjectAppend(args, argnames[i], boundaries) < 0)
+            return -1;
+        boundaries = NULL;
+    }
+
+    if (qemuMonitorJSONCommand(mon, cmd, &reply) < 0)
+        return -1;
+
+    if (qemuMonitorJSONHasError(reply, "CommandNotFound")) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("latency histograms are not supported by this QEMU"));
+        return -1;
+    }
+
+    return qemuMonitorJSONCheckError(cmd, reply);
+}
+
+
 virJSONValuePtr
 qemuMonitorJSONQueryNamedBlockNodes(qemuMonitorPtr mon,
                                     bool flat)
@@ -9415,3 +9952,101 @@ qemuMonitorJSONGetCPUMigratable(qemuMonitorPtr mon,
     return virJSONValueGetBoolean(virJSONValueObjectGet(reply, "return"),
                                   migratable);
 }
+
+
+int
+qemuMonitorJSONStartDirtyRateCalc(qemuMonitorPtr mon,
+                                  int seconds)
+{
+    g_autoptr(virJSONValue) cmd = NULL;
+    g_autoptr(virJSONValue) reply = NULL;
+
+    if (!(cmd = qemuMonitorJSONMakeCommand("calc-dirty-rate",
+                                           "i:calc-time", seconds,
+                                           NULL)))
+        return -1;
+
+    if (qemuMonitorJSONCommand(mon, cmd, &reply) < 0)
+        return -1;
+
+    if (qemuMonitorJSONCheckError(cmd, reply) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+VIR_ENUM_DECL(qemuMonitorDirtyRateStatus);
+VIR_ENUM_IMPL(qemuMonitorDirtyRateStatus,
+              VIR_DOMAIN_DIRTYRATE_LAST,
+              "unstarted",
+              "measuring",
+              "measured");
+
+
+static int
+qemuMonitorJSONExtractDirtyRateInfo(virJSONValuePtr data,
+                                    qemuMonitorDirtyRateInfoPtr info)
+{
+    const char *statusstr;
+    int status;
+
+    if (!(statusstr = virJSONValueObjectGetString(data, "status"))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("query-dirty-rate reply was missing 'status' data"));
+        return -1;
+    }
+
+    if ((status = qemuMonitorDirtyRateStatusTypeFromString(statusstr)) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unknown dirty rate status: %s"), statusstr);
+        return -1;
+    }
+    info->status = status;
+
+    /* `query-dirty-rate` replies `dirty-rate` data only if the status of the
+     * latest calculation is `measured`. */
+    if ((info->status == VIR_DOMAIN_DIRTYRATE_MEASURED) &&
+        (virJSONValueObjectGetNumberLong(data, "dirty-rate", &info->dirtyRate) < 0)) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("query-dirty-rate reply was missing 'dirty-rate' data"));
+        return -1;
+    }
+
+    if (virJSONValueObjectGetNumberLong(data, "start-time", &info->startTime) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("query-dirty-rate reply was missing 'start-time' data"));
+        return -1;
+    }
+
+    if (virJSONValueObjectGetNumberInt(data, "calc-time", &info->calcTime) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("query-dirty-rate reply was missing 'calc-time' data"));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+int
+qemuMonitorJSONQueryDirtyRate(qemuMonitorPtr mon,
+                              qemuMonitorDirtyRateInfoPtr info)
+{
+    g_autoptr(virJSONValue) cmd = NULL;
+    g_autoptr(virJSONValue) reply = NULL;
+    virJSONValuePtr data = NULL;
+
+    if (!(cmd = qemuMonitorJSONMakeCommand("query-dirty-rate", NULL)))
+        return -1;
+
+    if (qemuMonitorJSONCommand(mon, cmd, &reply) < 0)
+        return -1;
+
+    if (qemuMonitorJSONCheckReply(cmd, reply, VIR_JSON_TYPE_OBJECT) < 0)
+        return -1;
+
+    data = virJSONValueObjectGetObject(reply, "return");
+
+    return qemuMonitorJSONExtractDirtyRateInfo(data, info);
+}
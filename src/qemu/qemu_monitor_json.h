@@ -86,6 +86,9 @@ int qemuMonitorJSONBlockStatsUpdateCapacity(qemuMonitorPtr mon,
                                             bool backingChain);
 int qemuMonitorJSONBlockStatsUpdateCapacityBlockdev(qemuMonitorPtr mon,
                                                     virHashTablePtr stats);
+int qemuMonitorJSONGetAllBlockStatsInfoBlockdev(qemuMonitorPtr mon,
+                                                virHashTablePtr hash,
+                                                bool backingChain);
 
 virHashTablePtr
 qemuMonitorJSONBlockGetNamedNodeDataJSON(virJSONValuePtr nodes);
@@ -346,6 +349,14 @@ int qemuMonitorJSONJobComplete(qemuMonitorPtr mon,
                                const char *jobname)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
 
+int qemuMonitorJSONJobPause(qemuMonitorPtr mon,
+                            const char *jobname)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+
+int qemuMonitorJSONJobResume(qemuMonitorPtr mon,
+                             const char *jobname)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+
 int qemuMonitorJSONSetLink(qemuMonitorPtr mon,
                            const char *name,
                            virDomainNetInterfaceLinkState state);
@@ -585,6 +596,11 @@ int qemuMonitorJSONSetBlockThreshold(qemuMonitorPtr mon,
                                      unsigned long long threshold)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
 
+int qemuMonitorJSONBlockLatencyHistogramSet(qemuMonitorPtr mon,
+                                            const char *id,
+                                            const virDomainDiskLatencyHistogram *histograms)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(3);
+
 virJSONValuePtr qemuMonitorJSONQueryNamedBlockNodes(qemuMonitorPtr mon,
                                                     bool flat)
     ATTRIBUTE_NONNULL(1);
@@ -691,6 +707,18 @@ int qemuMonitorJSONSetDBusVMStateIdList(qemuMonitorPtr mon,
                                         const char **list)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(3);
 
+int qemuMonitorJSONSetMemoryBackendsMerge(qemuMonitorPtr mon,
+                                          bool merge)
+    ATTRIBUTE_NONNULL(1);
+
 int
 qemuMonitorJSONGetCPUMigratable(qemuMonitorPtr mon,
                                 bool *migratable);
+
+int
+qemuMonitorJSONStartDirtyRateCalc(qemuMonitorPtr mon,
+                                  int seconds);
+
+int
+qemuMonitorJSONQueryDirtyRate(qemuMonitorPtr mon,
+                              qemuMonitorDirtyRateInfoPtr info);
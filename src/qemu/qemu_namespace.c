@@ -1164,6 +1164,15 @@ qemuNamespacePrepareOneItem(qemuNamespaceMknodDataPtr data,
     while (1) {
         qemuNamespaceMknodItem item = { 0 };
 
+        /* Paths are often shared by multiple devices, e.g. /dev/vfio/vfio
+         * by all VFIO hostdevs or symlinks in /dev/mapper/ by all LVM
+         * disks. Creating them once is enough and the rest of their
+         * symlink chain was followed already too. */
+        for (i = 0; i < data->nitems; i++) {
+            if (STREQ(data->items[i].file, next))
+                return 0;
+        }
+
         if (qemuNamespaceMknodItemInit(&item, cfg, vm, next) < 0)
             return -1;
 
@@ -1230,6 +1239,15 @@ qemuNamespaceMknodPaths(virDomainObjPtr vm,
             goto cleanup;
     }
 
+    /* Only paths under /dev are created in the namespace, everything else
+     * is visible in it already. Don't fork a child which would do nothing,
+     * which is the common case of disks backed by regular files. */
+    if (data.nitems == 0) {
+        VIR_DEBUG("No paths to create in the namespace of %s", vm->def->name);
+        ret = 0;
+        goto cleanup;
+    }
+
     for (i = 0; i < data.nitems; i++) {
         qemuNamespaceMknodItemPtr item = &data.items[i];
         if (item->target &&
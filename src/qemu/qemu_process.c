@@ -93,11 +93,113 @@
 #include "viridentity.h"
 #include "virthreadjob.h"
 #include "virutil.h"
+#include "virhistogram.h"
 
 #define VIR_FROM_THIS VIR_FROM_QEMU
 
 VIR_LOG_INIT("qemu.qemu_process");
 
+/* Phase durations of all successful domain starts */
+static virMutex qemuProcessStartStatsLock = VIR_MUTEX_INITIALIZER;
+static unsigned long long qemuProcessStartCount;
+static virHistogram qemuProcessStartStats[QEMU_DOMAIN_START_PHASE_LAST];
+
+
+static void
+qemuProcessSetStartPhase(virDomainObjPtr vm,
+                         qemuDomainStartPhase phase)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+
+    if (priv->job.current)
+        qemuDomainJobInfoSetStartPhase(priv->job.current, phase);
+}
+
+
+/*
+ * Adds durations of phases of a successful start to the histogram. The
+ * durations are the difference between @base taken before the start and
+ * @times taken after it since a single job may start a domain repeatedly.
+ */
+static void
+qemuProcessRecordStartStats(const unsigned long long *base,
+                            const unsigned long long *times)
+{
+    size_t i;
+
+    virMutexLock(&qemuProcessStartStatsLock);
+
+    qemuProcessStartCount++;
+
+    for (i = QEMU_DOMAIN_START_PHASE_NONE + 1; i < QEMU_DOMAIN_START_PHASE_LAST; i++)
+        virHistogramRecord(&qemuProcessStartStats[i], times[i] - base[i]);
+
+    virMutexUnlock(&qemuProcessStartStatsLock);
+}
+
+
+/**
+ * qemuProcessGetStartStats:
+ * @params: list to add the statistics to
+ * @prefix: prefix of the names of the statistics
+ *
+ * Reports the histogram of durations of phases of successful domain
+ * starts, in microseconds, for virAdmServerGetStats.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+qemuProcessGetStartStats(virTypedParamListPtr params,
+                         const char *prefix)
+{
+    virHistogram stats[QEMU_DOMAIN_START_PHASE_LAST];
+    g_autofree char *startPrefix = NULL;
+    unsigned long long count;
+    size_t i;
+    size_t j;
+
+    virMutexLock(&qemuProcessStartStatsLock);
+    count = qemuProcessStartCount;
+    memcpy(stats, qemuProcessStartStats, sizeof(stats));
+    virMutexUnlock(&qemuProcessStartStatsLock);
+
+    if (virTypedParamListAddULLong(params, count,
+                                   "%sstart.count", prefix) < 0)
+        return -1;
+
+    startPrefix = g_strdup_printf("%sstart.", prefix);
+    if (virHistogramAddLimits(params, startPrefix) < 0)
+        return -1;
+
+    for (i = QEMU_DOMAIN_START_PHASE_NONE + 1; i < QEMU_DOMAIN_START_PHASE_LAST; i++) {
+        const char *phase = qemuDomainStartPhaseTypeToString(i);
+        unsigned long long avg = 0;
+
+        if (count)
+            avg = stats[i].total / count;
+
+        if (virTypedParamListAddULLong(params, stats[i].total,
+                                       "%sstart.%s.time.total",
+                                       prefix, phase) < 0 ||
+            virTypedParamListAddULLong(params, avg,
+                                       "%sstart.%s.time.avg",
+                                       prefix, phase) < 0 ||
+            virTypedParamListAddULLong(params, stats[i].max,
+                                       "%sstart.%s.time.max",
+                                       prefix, phase) < 0)
+            return -1;
+
+        for (j = 0; j < VIR_HISTOGRAM_BUCKETS; j++) {
+            if (virTypedParamListAddULLong(params, stats[i].buckets[j],
+                                           "%sstart.%s.bucket.%zu",
+                                           prefix, phase, j) < 0)
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
 /**
  * qemuProcessRemoveDomainStatus
  *
@@ -113,6 +215,8 @@ qemuProcessRemoveDomainStatus(virQEMUDriverPtr driver,
 
     file = g_strdup_printf("%s/%s.xml", cfg->stateDir, vm->def->name);
 
+    virDomainObjSaveCancel(vm);
+
     if (unlink(file) < 0 && errno != ENOENT && errno != ENOTDIR)
         VIR_WARN("Failed to remove domain XML for %s: %s",
                  vm->def->name, g_strerror(errno));
@@ -157,6 +261,9 @@ qemuProcessHandleAgentEOF(qemuAgentPtr agent,
     priv->agent = NULL;
     priv->agentError = false;
 
+    /* the guest is likely rebooting, don't report stale information */
+    qemuDomainGuestInfoCacheClear(priv);
+
     virObjectUnlock(vm);
     return;
 
@@ -211,6 +318,7 @@ qemuConnectAgent(virQEMUDriverPtr driver, virDomainObjPtr vm)
     qemuDomainObjPrivatePtr priv = vm->privateData;
     qemuAgentPtr agent = NULL;
     virDomainChrDefPtr config = qemuFindAgentConfig(vm->def);
+    g_autoptr(GMainContext) context = NULL;
 
     if (!config)
         return 0;
@@ -234,11 +342,13 @@ qemuConnectAgent(virQEMUDriverPtr driver, virDomainObjPtr vm)
      * deleted while the agent is active */
     virObjectRef(vm);
 
+    context = qemuDomainObjGetWorkerContext(vm);
+
     virObjectUnlock(vm);
 
     agent = qemuAgentOpen(vm,
                           config->source,
-                          virEventThreadGetContext(priv->eventThread),
+                          context,
                           &agentCallbacks,
                           virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_VSERPORT_CHANGE));
 
@@ -262,6 +372,7 @@ qemuConnectAgent(virQEMUDriverPtr driver, virDomainObjPtr vm)
     }
 
     priv->agent = agent;
+    qemuDomainObjUpdateWorker(vm);
     if (!priv->agent)
         VIR_INFO("Failed to connect agent for %s", vm->def->name);
 
@@ -952,6 +1063,8 @@ qemuProcessHandleBlockJob(qemuMonitorPtr mon G_GNUC_UNUSED,
     VIR_DEBUG("Block job for device %s (domain: %p,%s) type %d status %d",
               diskAlias, vm, vm->def->name, type, status);
 
+    qemuDomainStatsCacheInvalidate(vm, VIR_DOMAIN_STATS_BLOCK);
+
     if (!(disk = qemuProcessFindDomainDiskByAliasOrQOM(vm, diskAlias, NULL)))
         goto cleanup;
 
@@ -1024,6 +1137,7 @@ qemuProcessHandleJobStatusChange(qemuMonitorPtr mon G_GNUC_UNUSED,
     }
 
     job->newstate = jobnewstate;
+    qemuDomainStatsCacheInvalidate(vm, VIR_DOMAIN_STATS_BLOCK);
 
     if (job->synchronous) {
         VIR_DEBUG("job '%s' handled synchronously", jobname);
@@ -1266,6 +1380,7 @@ qemuProcessHandleBalloonChange(qemuMonitorPtr mon G_GNUC_UNUSED,
     VIR_DEBUG("Updating balloon from %lld to %lld kb",
               vm->def->mem.cur_balloon, actual);
     vm->def->mem.cur_balloon = actual;
+    qemuDomainStatsCacheInvalidate(vm, VIR_DOMAIN_STATS_BALLOON);
 
     if (virDomainObjSave(vm, driver->xmlopt, cfg->stateDir) < 0)
         VIR_WARN("unable to save domain status with balloon change");
@@ -1510,6 +1625,9 @@ qemuProcessHandleBlockThreshold(qemuMonitorPtr mon G_GNUC_UNUSED,
               "threshold '%llu' exceeded by '%llu'",
               nodename, vm, vm->def->name, threshold, excess);
 
+    /* QEMU disarms the threshold once it is crossed */
+    qemuDomainBlockCapacityCacheClear(vm->privateData);
+
     if ((disk = qemuDomainDiskLookupByNodename(vm->def, nodename, &src))) {
         if (virStorageSourceIsLocalStorage(src))
             path = src->path;
@@ -1895,6 +2013,30 @@ qemuProcessHandleGuestCrashloaded(qemuMonitorPtr mon G_GNUC_UNUSED,
 }
 
 
+static int
+qemuProcessHandleMonitorSlow(qemuMonitorPtr mon G_GNUC_UNUSED,
+                             virDomainObjPtr vm,
+                             const char *command,
+                             unsigned long long elapsed,
+                             void *opaque)
+{
+    virQEMUDriverPtr driver = opaque;
+    virObjectEventPtr event = NULL;
+
+    virObjectLock(vm);
+
+    VIR_DEBUG("Monitor command '%s' of domain %p %s waiting for %llu ms",
+              command, vm, vm->def->name, elapsed);
+
+    event = virDomainEventMonitorSlowNewFromObj(vm, command, elapsed);
+
+    virObjectUnlock(vm);
+    virObjectEventStateQueue(driver->domainEventState, event);
+
+    return 0;
+}
+
+
 static qemuMonitorCallbacks monitorCallbacks = {
     .eofNotify = qemuProcessHandleMonitorEOF,
     .errorNotify = qemuProcessHandleMonitorError,
@@ -1927,6 +2069,7 @@ static qemuMonitorCallbacks monitorCallbacks = {
     .domainPRManagerStatusChanged = qemuProcessHandlePRManagerStatusChanged,
     .domainRdmaGidStatusChanged = qemuProcessHandleRdmaGidStatusChanged,
     .domainGuestCrashloaded = qemuProcessHandleGuestCrashloaded,
+    .domainMonitorSlow = qemuProcessHandleMonitorSlow,
 };
 
 static void
@@ -1962,13 +2105,32 @@ qemuProcessInitMonitor(virQEMUDriverPtr driver,
 }
 
 
+/*
+ * Whether QEMU preallocates memory of @vm before it starts answering on
+ * the monitor.
+ */
+static bool
+qemuProcessHasMemPrealloc(virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+
+    /* hugepages are always preallocated, see qemuBuildMemoryBackendProps */
+    return priv->memPrealloc ||
+           vm->def->mem.allocation == VIR_DOMAIN_MEMORY_ALLOCATION_IMMEDIATE ||
+           vm->def->mem.nhugepages > 0;
+}
+
+
 static int
 qemuConnectMonitor(virQEMUDriverPtr driver, virDomainObjPtr vm, int asyncJob,
                    bool retry, qemuDomainLogContextPtr logCtxt)
 {
     qemuDomainObjPrivatePtr priv = vm->privateData;
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
     qemuMonitorPtr mon = NULL;
     unsigned long long timeout = 0;
+    g_autoptr(GMainContext) context = NULL;
+    int rc;
 
     if (qemuSecuritySetDaemonSocketLabel(driver->securityManager, vm->def) < 0) {
         VIR_ERROR(_("Failed to set security context for monitor for %s"),
@@ -1984,11 +2146,13 @@ qemuConnectMonitor(virQEMUDriverPtr driver, virDomainObjPtr vm, int asyncJob,
 
     ignore_value(virTimeMillisNow(&priv->monStart));
 
+    context = qemuDomainObjGetWorkerContext(vm);
+
     mon = qemuMonitorOpen(vm,
                           priv->monConfig,
                           retry,
                           timeout,
-                          virEventThreadGetContext(priv->eventThread),
+                          context,
                           &monitorCallbacks,
                           driver);
 
@@ -2000,8 +2164,12 @@ qemuConnectMonitor(virQEMUDriverPtr driver, virDomainObjPtr vm, int asyncJob,
                                 qemuProcessMonitorLogFree);
     }
 
+    if (mon && cfg->monitorSlowThreshold > 0)
+        qemuMonitorSetSlowThreshold(mon, cfg->monitorSlowThreshold);
+
     priv->monStart = 0;
     priv->mon = mon;
+    qemuDomainObjUpdateWorker(vm);
 
     if (qemuSecurityClearSocketLabel(driver->securityManager, vm->def) < 0) {
         VIR_ERROR(_("Failed to clear security context for monitor for %s"),
@@ -2014,7 +2182,19 @@ qemuConnectMonitor(virQEMUDriverPtr driver, virDomainObjPtr vm, int asyncJob,
         return -1;
     }
 
-    if (qemuProcessInitMonitor(driver, vm, asyncJob) < 0)
+    /* QEMU only starts answering on the monitor once it created the
+     * machine, which includes preallocating guest memory */
+    if (priv->job.current &&
+        priv->job.current->startPhase == QEMU_DOMAIN_START_PHASE_MONITOR &&
+        qemuProcessHasMemPrealloc(vm)) {
+        qemuProcessSetStartPhase(vm, QEMU_DOMAIN_START_PHASE_PREALLOC);
+        rc = qemuProcessInitMonitor(driver, vm, asyncJob);
+        qemuProcessSetStartPhase(vm, QEMU_DOMAIN_START_PHASE_MONITOR);
+    } else {
+        rc = qemuProcessInitMonitor(driver, vm, asyncJob);
+    }
+
+    if (rc < 0)
         return -1;
 
     if (qemuMigrationCapsCheck(driver, vm, asyncJob) < 0)
@@ -2805,6 +2985,95 @@ qemuProcessBuildPRHelperPidfilePath(virDomainObjPtr vm)
 }
 
 
+/* Only root can access the directory with the socket of the shared
+ * qemu-pr-helper, domains reach it via links in their private directory. */
+static char *
+qemuProcessBuildSharedPRHelperDir(virQEMUDriverConfigPtr cfg)
+{
+    return g_strdup_printf("%s/pr-helper", cfg->stateDir);
+}
+
+
+static char *
+qemuProcessBuildSharedPRHelperSocketPath(virQEMUDriverConfigPtr cfg)
+{
+    return g_strdup_printf("%s/pr-helper/%s.sock", cfg->stateDir,
+                           qemuDomainGetManagedPRAlias());
+}
+
+
+/*
+ * Shared qemu-pr-helper can be used only by domains which don't need
+ * the socket labelled for them, i.e. those with no other than DAC labels.
+ */
+static bool
+qemuProcessCanSharePRDaemon(virDomainObjPtr vm)
+{
+    size_t i;
+
+    for (i = 0; i < vm->def->nseclabels; i++) {
+        virSecurityLabelDefPtr seclabel = vm->def->seclabels[i];
+
+        if (seclabel->type != VIR_DOMAIN_SECLABEL_NONE &&
+            STRNEQ_NULLABLE(seclabel->model, "dac"))
+            return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * qemuProcessRefSharedPRDaemon:
+ * @driver: qemu driver
+ *
+ * Counts the reference to the shared qemu-pr-helper of a domain the daemon
+ * reconnected to.
+ */
+static void
+qemuProcessRefSharedPRDaemon(virQEMUDriverPtr driver)
+{
+    virMutexLock(&driver->sharedPRHelperLock);
+    driver->sharedPRHelperRefs++;
+    virMutexUnlock(&driver->sharedPRHelperLock);
+}
+
+
+static void
+qemuProcessKillSharedPRDaemon(virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virQEMUDriverPtr driver = priv->driver;
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    g_autofree char *dir = qemuProcessBuildSharedPRHelperDir(cfg);
+    g_autofree char *sharedPath = qemuProcessBuildSharedPRHelperSocketPath(cfg);
+    g_autofree char *socketPath = qemuDomainGetManagedPRSocketPath(priv);
+    g_autofree char *pidfile = virPidFileBuildPath(dir, qemuDomainGetManagedPRAlias());
+    virErrorPtr orig_err;
+
+    virErrorPreserveLast(&orig_err);
+    virMutexLock(&driver->sharedPRHelperLock);
+
+    /* revoke the access of the domain to the helper */
+    if (unlink(socketPath) < 0 && errno != ENOENT)
+        VIR_WARN("Unable to remove pr-helper socket link %s", socketPath);
+
+    priv->prDaemonShared = false;
+    priv->prDaemonRunning = false;
+
+    if (driver->sharedPRHelperRefs > 0 &&
+        --driver->sharedPRHelperRefs == 0) {
+        VIR_DEBUG("Stopping shared pr-helper");
+        if (virPidFileForceCleanupPath(pidfile) < 0)
+            VIR_WARN("Unable to kill shared pr-helper process");
+        unlink(sharedPath);
+    }
+
+    virMutexUnlock(&driver->sharedPRHelperLock);
+    virErrorRestore(&orig_err);
+}
+
+
 void
 qemuProcessKillManagedPRDaemon(virDomainObjPtr vm)
 {
@@ -2812,6 +3081,11 @@ qemuProcessKillManagedPRDaemon(virDomainObjPtr vm)
     virErrorPtr orig_err;
     g_autofree char *pidfile = NULL;
 
+    if (priv->prDaemonShared) {
+        qemuProcessKillSharedPRDaemon(vm);
+        return;
+    }
+
     if (!(pidfile = qemuProcessBuildPRHelperPidfilePath(vm))) {
         VIR_WARN("Unable to construct pr-helper pidfile path");
         return;
@@ -2852,35 +3126,32 @@ qemuProcessStartPRDaemonHook(void *opaque)
 }
 
 
-int
-qemuProcessStartManagedPRDaemon(virDomainObjPtr vm)
+/*
+ * Runs qemu-pr-helper listening on @socketPath and waits until the socket
+ * shows up. If @vm is non-NULL the helper is placed into its namespaces.
+ * On success the PID of the helper is stored into @pid, on failure the
+ * helper is killed.
+ */
+static int
+qemuProcessRunPRDaemon(virQEMUDriverConfigPtr cfg,
+                       virDomainObjPtr vm,
+                       const char *pidfile,
+                       const char *socketPath,
+                       pid_t *pid)
 {
-    qemuDomainObjPrivatePtr priv = vm->privateData;
-    virQEMUDriverPtr driver = priv->driver;
-    g_autoptr(virQEMUDriverConfig) cfg = NULL;
     int errfd = -1;
-    g_autofree char *pidfile = NULL;
-    g_autofree char *socketPath = NULL;
     pid_t cpid = -1;
     g_autoptr(virCommand) cmd = NULL;
     virTimeBackOffVar timebackoff;
     const unsigned long long timeout = 500000; /* ms */
     int ret = -1;
 
-    cfg = virQEMUDriverGetConfig(driver);
-
     if (!virFileIsExecutable(cfg->prHelperName)) {
         virReportSystemError(errno, _("'%s' is not a suitable pr helper"),
                              cfg->prHelperName);
         goto cleanup;
     }
 
-    if (!(pidfile = qemuProcessBuildPRHelperPidfilePath(vm)))
-        goto cleanup;
-
-    if (!(socketPath = qemuDomainGetManagedPRSocketPath(priv)))
-        goto cleanup;
-
     /* Remove stale socket */
     if (unlink(socketPath) < 0 &&
         errno != ENOENT) {
@@ -2901,7 +3172,8 @@ qemuProcessStartManagedPRDaemon(virDomainObjPtr vm)
 
     /* Place the process into the same namespace and cgroup as
      * qemu (so that it shares the same view of the system). */
-    virCommandSetPreExecHook(cmd, qemuProcessStartPRDaemonHook, vm);
+    if (vm)
+        virCommandSetPreExecHook(cmd, qemuProcessStartPRDaemonHook, vm);
 
     if (virCommandRun(cmd, NULL) < 0)
         goto cleanup;
@@ -2941,28 +3213,139 @@ qemuProcessStartManagedPRDaemon(virDomainObjPtr vm)
         goto cleanup;
     }
 
-    if (priv->cgroup &&
-        virCgroupAddMachineProcess(priv->cgroup, cpid) < 0)
-        goto cleanup;
-
-    if (qemuSecurityDomainSetPathLabel(driver, vm, socketPath, true) < 0)
-        goto cleanup;
-
-    priv->prDaemonRunning = true;
+    *pid = cpid;
     ret = 0;
  cleanup:
     if (ret < 0) {
         virCommandAbort(cmd);
         if (cpid >= 0)
             virProcessKillPainfully(cpid, true);
-        if (pidfile)
-            unlink(pidfile);
+        unlink(pidfile);
     }
     VIR_FORCE_CLOSE(errfd);
     return ret;
 }
 
 
+/*
+ * Gives @vm access to the shared qemu-pr-helper, starting the helper
+ * first if it isn't running.
+ */
+static int
+qemuProcessStartSharedPRDaemon(virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virQEMUDriverPtr driver = priv->driver;
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    g_autofree char *dir = qemuProcessBuildSharedPRHelperDir(cfg);
+    g_autofree char *sharedPath = qemuProcessBuildSharedPRHelperSocketPath(cfg);
+    g_autofree char *socketPath = qemuDomainGetManagedPRSocketPath(priv);
+    g_autofree char *pidfile = virPidFileBuildPath(dir, qemuDomainGetManagedPRAlias());
+    pid_t cpid = -1;
+    int ret = -1;
+
+    virMutexLock(&driver->sharedPRHelperLock);
+
+    if (g_mkdir_with_parents(dir, 0700) < 0) {
+        virReportSystemError(errno, _("Cannot create directory '%s'"), dir);
+        goto cleanup;
+    }
+
+    if (virPidFileReadPathIfAlive(pidfile, &cpid, cfg->prHelperName) < 0)
+        cpid = -1;
+
+    /* the helper survives daemon restarts, start it only if it died */
+    if (cpid < 0 || !virFileExists(sharedPath)) {
+        if (cpid >= 0)
+            virProcessKillPainfully(cpid, true);
+
+        VIR_DEBUG("Starting shared pr-helper");
+
+        if (qemuProcessRunPRDaemon(cfg, NULL, pidfile, sharedPath, &cpid) < 0)
+            goto cleanup;
+
+        /* the directory and the links take care of access control */
+        if (chmod(sharedPath, 0666) < 0) {
+            virReportSystemError(errno,
+                                 _("Unable to set permissions of '%s'"),
+                                 sharedPath);
+            goto cleanup;
+        }
+    }
+
+    if (unlink(socketPath) < 0 &&
+        errno != ENOENT) {
+        virReportSystemError(errno,
+                             _("Unable to remove stale socket path: %s"),
+                             socketPath);
+        goto cleanup;
+    }
+
+    if (link(sharedPath, socketPath) < 0) {
+        virReportSystemError(errno,
+                             _("Unable to link '%s' to '%s'"),
+                             socketPath, sharedPath);
+        goto cleanup;
+    }
+
+    if (!priv->prDaemonShared) {
+        driver->sharedPRHelperRefs++;
+        priv->prDaemonShared = true;
+    }
+
+    priv->prDaemonRunning = true;
+    ret = 0;
+
+ cleanup:
+    /* don't leave a helper nobody uses behind */
+    if (ret < 0 && driver->sharedPRHelperRefs == 0 && cpid >= 0) {
+        virProcessKillPainfully(cpid, true);
+        unlink(pidfile);
+        unlink(sharedPath);
+    }
+    virMutexUnlock(&driver->sharedPRHelperLock);
+    return ret;
+}
+
+
+int
+qemuProcessStartManagedPRDaemon(virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virQEMUDriverPtr driver = priv->driver;
+    g_autoptr(virQEMUDriverConfig) cfg = NULL;
+    g_autofree char *pidfile = NULL;
+    g_autofree char *socketPath = NULL;
+    pid_t cpid = -1;
+
+    cfg = virQEMUDriverGetConfig(driver);
+
+    if (priv->prDaemonShared ||
+        (cfg->prHelperShared && qemuProcessCanSharePRDaemon(vm)))
+        return qemuProcessStartSharedPRDaemon(vm);
+
+    if (!(pidfile = qemuProcessBuildPRHelperPidfilePath(vm)))
+        return -1;
+
+    if (!(socketPath = qemuDomainGetManagedPRSocketPath(priv)))
+        return -1;
+
+    if (qemuProcessRunPRDaemon(cfg, vm, pidfile, socketPath, &cpid) < 0)
+        return -1;
+
+    if ((priv->cgroup &&
+         virCgroupAddMachineProcess(priv->cgroup, cpid) < 0) ||
+        qemuSecurityDomainSetPathLabel(driver, vm, socketPath, true) < 0) {
+        virProcessKillPainfully(cpid, true);
+        unlink(pidfile);
+        return -1;
+    }
+
+    priv->prDaemonRunning = true;
+    return 0;
+}
+
+
 static int
 qemuProcessInitPasswords(virQEMUDriverPtr driver,
                          virDomainObjPtr vm,
@@ -4592,15 +4975,61 @@ void
 qemuProcessEndJob(virQEMUDriverPtr driver,
                   virDomainObjPtr vm)
 {
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+
+    /* Keep the statistics of the job around, they show how long the
+     * start was waiting for the lock manager and where it spent time. */
+    if (priv->job.current) {
+        qemuDomainJobInfoPtr jobInfo = priv->job.current;
+
+        ignore_value(qemuDomainJobInfoUpdateTime(jobInfo));
+        qemuDomainJobInfoUpdateLockStats(jobInfo, vm);
+
+        g_clear_pointer(&priv->job.completed, qemuDomainJobInfoFree);
+        priv->job.completed = qemuDomainJobInfoCopy(jobInfo);
+        if (virDomainObjIsActive(vm))
+            priv->job.completed->status = QEMU_DOMAIN_JOB_STATUS_COMPLETED;
+        else
+            priv->job.completed->status = QEMU_DOMAIN_JOB_STATUS_FAILED;
+    }
+
     qemuDomainObjEndAsyncJob(driver, vm);
 }
 
 
+/*
+ * Calls the hook script for @op. Phases whose result is ignored are run
+ * in the background if async_hooks is enabled in qemu.conf.
+ */
 static int
-qemuProcessStartHook(virQEMUDriverPtr driver,
-                     virDomainObjPtr vm,
-                     virHookQemuOpType op,
-                     virHookSubopType subop)
+qemuProcessCallHook(virQEMUDriverPtr driver,
+                    virDomainObjPtr vm,
+                    virHookQemuOpType op,
+                    virHookSubopType subop,
+                    const char *xml)
+{
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+
+    if (cfg->asyncHooks &&
+        (op == VIR_HOOK_QEMU_OP_STARTED ||
+         op == VIR_HOOK_QEMU_OP_STOPPED ||
+         op == VIR_HOOK_QEMU_OP_RELEASE)) {
+        if (virHookCallAsync(VIR_HOOK_DRIVER_QEMU, vm->def->name, op, subop,
+                             NULL, xml) < 0)
+            return -1;
+        return 0;
+    }
+
+    return virHookCall(VIR_HOOK_DRIVER_QEMU, vm->def->name, op, subop,
+                       NULL, xml, NULL);
+}
+
+
+static int
+qemuProcessStartHook(virQEMUDriverPtr driver,
+                     virDomainObjPtr vm,
+                     virHookQemuOpType op,
+                     virHookSubopType subop)
 {
     qemuDomainObjPrivatePtr priv = vm->privateData;
     g_autofree char *xml = NULL;
@@ -4612,8 +5041,7 @@ qemuProcessStartHook(virQEMUDriverPtr driver,
     if (!(xml = qemuDomainDefFormatXML(driver, priv->qemuCaps, vm->def, 0)))
         return -1;
 
-    ret = virHookCall(VIR_HOOK_DRIVER_QEMU, vm->def->name, op, subop,
-                      NULL, xml, NULL);
+    ret = qemuProcessCallHook(driver, vm, op, subop, xml);
 
     return ret;
 }
@@ -5576,7 +6004,8 @@ qemuProcessInit(virQEMUDriverPtr driver,
             goto cleanup;
         }
     } else {
-        vm->def->id = qemuDriverAllocateID(driver);
+        virDomainObjListSetID(driver->domains, vm,
+                              qemuDriverAllocateID(driver));
         qemuDomainSetFakeReboot(driver, vm, false);
         virDomainObjSetState(vm, VIR_DOMAIN_PAUSED, VIR_DOMAIN_PAUSED_STARTING_UP);
 
@@ -6137,12 +6566,312 @@ qemuProcessPrepareDomainNUMAPlacement(virQEMUDriverPtr driver,
 }
 
 
+typedef struct _qemuProcessTopologyDie qemuProcessTopologyDie;
+struct _qemuProcessTopologyDie {
+    size_t first; /* index of the first CPU of the die in the sorted list */
+    size_t last; /* index one past the last CPU of the die */
+    size_t nfree; /* CPUs of the die which vCPUs can be placed onto */
+};
+
+
+static int
+qemuProcessTopologyCPUCompare(const void *a,
+                              const void *b)
+{
+    const virCapsHostNUMACellCPU *ca = *(virCapsHostNUMACellCPUPtr const *) a;
+    const virCapsHostNUMACellCPU *cb = *(virCapsHostNUMACellCPUPtr const *) b;
+
+    if (ca->socket_id != cb->socket_id)
+        return ca->socket_id < cb->socket_id ? -1 : 1;
+    if (ca->die_id != cb->die_id)
+        return ca->die_id < cb->die_id ? -1 : 1;
+    if (ca->core_id != cb->core_id)
+        return ca->core_id < cb->core_id ? -1 : 1;
+    if (ca->id != cb->id)
+        return ca->id < cb->id ? -1 : 1;
+    return 0;
+}
+
+
 static int
-qemuProcessPrepareDomainStorage(virQEMUDriverPtr driver,
-                                virDomainObjPtr vm,
-                                qemuDomainObjPrivatePtr priv,
-                                virQEMUDriverConfigPtr cfg,
-                                unsigned int flags)
+qemuProcessTopologyDieCompare(const void *a,
+                              const void *b)
+{
+    const qemuProcessTopologyDie *da = a;
+    const qemuProcessTopologyDie *db = b;
+
+    /* most free CPUs first */
+    if (da->nfree != db->nfree)
+        return da->nfree > db->nfree ? -1 : 1;
+    return da->first < db->first ? -1 : 1;
+}
+
+
+/* Whether all the siblings of @cpu are in @available */
+static bool
+qemuProcessTopologyCoreIsFree(virCapsHostNUMACellCPUPtr cpu,
+                              virBitmapPtr available)
+{
+    ssize_t i = -1;
+
+    if (!cpu->siblings)
+        return virBitmapIsBitSet(available, cpu->id);
+
+    while ((i = virBitmapNextSetBit(cpu->siblings, i)) >= 0) {
+        if (!virBitmapIsBitSet(available, i))
+            return false;
+    }
+
+    return true;
+}
+
+
+/* Computes the pinning of the vCPUs, iothreads and the emulator thread
+ * of a domain with <vcpu placement='topology'/> that the config leaves
+ * unpinned, and claims the host CPUs of the vCPUs so that other domains
+ * with such placement stay off them. */
+static int
+qemuProcessPrepareDomainTopologyPlacement(virQEMUDriverPtr driver,
+                                          virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virDomainDefPtr def = vm->def;
+    g_autoptr(virCapsHostNUMA) caps = NULL;
+    g_autoptr(virBitmap) isolated = NULL;
+    g_autoptr(virBitmap) housekeeping = virBitmapNewEmpty();
+    g_autoptr(virBitmap) available = virBitmapNewEmpty();
+    g_autoptr(virBitmap) wholeCores = virBitmapNewEmpty();
+    g_autoptr(virBitmap) claimed = virBitmapNewEmpty();
+    g_autoptr(virBitmap) helpers = virBitmapNewEmpty();
+    g_autofree virCapsHostNUMACellCPUPtr *cpus = NULL;
+    g_autofree qemuProcessTopologyDie *dies = NULL;
+    size_t maxvcpus = virDomainDefGetVcpusMax(def);
+    size_t ncpus = 0;
+    size_t ndies = 0;
+    size_t nvcpus = 0;
+    size_t nplaced = 0;
+    size_t vcpuid = 0;
+    size_t i;
+    size_t j;
+    int pass;
+    int ret = -1;
+
+    if (def->placement_mode != VIR_DOMAIN_CPU_PLACEMENT_MODE_TOPOLOGY)
+        return 0;
+
+    if (!(caps = virQEMUDriverGetHostNUMACaps(driver)) ||
+        !(isolated = virHostCPUGetIsolatedBitmap()))
+        return -1;
+
+    for (i = 0; i < caps->cells->len; i++) {
+        virCapsHostNUMACellPtr cell = g_ptr_array_index(caps->cells, i);
+        ncpus += cell->ncpus;
+    }
+
+    if (ncpus == 0) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("host CPU topology is unknown"));
+        return -1;
+    }
+
+    cpus = g_new0(virCapsHostNUMACellCPUPtr, ncpus);
+    ncpus = 0;
+    for (i = 0; i < caps->cells->len; i++) {
+        virCapsHostNUMACellPtr cell = g_ptr_array_index(caps->cells, i);
+
+        for (j = 0; j < cell->ncpus; j++)
+            cpus[ncpus++] = &cell->cpus[j];
+    }
+
+    qsort(cpus, ncpus, sizeof(*cpus), qemuProcessTopologyCPUCompare);
+
+    /* Housekeeping CPUs are those not isolated from the scheduler, or
+     * the first core if nothing is isolated. */
+    for (i = 0; i < ncpus; i++) {
+        bool keep;
+
+        if (virBitmapIsAllClear(isolated))
+            keep = cpus[i]->socket_id == cpus[0]->socket_id &&
+                   cpus[i]->die_id == cpus[0]->die_id &&
+                   cpus[i]->core_id == cpus[0]->core_id;
+        else
+            keep = !virBitmapIsBitSet(isolated, cpus[i]->id);
+
+        if (keep && virBitmapSetBitExpand(housekeeping, cpus[i]->id) < 0)
+            return -1;
+    }
+
+    for (i = 0; i < maxvcpus; i++) {
+        if (!virDomainDefGetVcpu(def, i)->cpumask)
+            nvcpus++;
+    }
+
+    qemuDriverLock(driver);
+
+    for (i = 0; i < ncpus; i++) {
+        unsigned int id = cpus[i]->id;
+
+        if (virBitmapIsBitSet(housekeeping, id) ||
+            (def->cpumask && !virBitmapIsBitSet(def->cpumask, id)) ||
+            (driver->topologyCpus && virBitmapIsBitSet(driver->topologyCpus, id)))
+            continue;
+
+        if (virBitmapSetBitExpand(available, id) < 0)
+            goto cleanup;
+    }
+
+    for (i = 0; i < ncpus; i++) {
+        if (i == 0 ||
+            cpus[i]->socket_id != cpus[i - 1]->socket_id ||
+            cpus[i]->die_id != cpus[i - 1]->die_id) {
+            if (VIR_EXPAND_N(dies, ndies, 1) < 0)
+                goto cleanup;
+            dies[ndies - 1].first = i;
+        }
+
+        dies[ndies - 1].last = i + 1;
+
+        if (virBitmapIsBitSet(available, cpus[i]->id)) {
+            dies[ndies - 1].nfree++;
+
+            if (qemuProcessTopologyCoreIsFree(cpus[i], available) &&
+                virBitmapSetBitExpand(wholeCores, cpus[i]->id) < 0)
+                goto cleanup;
+        }
+    }
+
+    /* Prefer the die that fits all the vCPUs most tightly, otherwise
+     * spill over the dies with the most free CPUs. */
+    qsort(dies, ndies, sizeof(*dies), qemuProcessTopologyDieCompare);
+    for (i = ndies; i > 0; i--) {
+        if (dies[i - 1].nfree >= nvcpus) {
+            qemuProcessTopologyDie tmp = dies[0];
+            dies[0] = dies[i - 1];
+            dies[i - 1] = tmp;
+            break;
+        }
+    }
+
+    for (i = 0; i < ndies && nplaced < nvcpus; i++) {
+        /* the first pass packs vCPUs onto cores nobody else uses */
+        for (pass = 0; pass < 2 && nplaced < nvcpus; pass++) {
+            for (j = dies[i].first; j < dies[i].last && nplaced < nvcpus; j++) {
+                unsigned int id = cpus[j]->id;
+                virDomainVcpuDefPtr vcpu;
+
+                if (!virBitmapIsBitSet(available, id) ||
+                    (pass == 0 && !virBitmapIsBitSet(wholeCores, id)))
+                    continue;
+
+                while (virDomainDefGetVcpu(def, vcpuid)->cpumask)
+                    vcpuid++;
+                vcpu = virDomainDefGetVcpu(def, vcpuid);
+
+                vcpu->cpumask = virBitmapNewEmpty();
+                if (virBitmapSetBitExpand(vcpu->cpumask, id) < 0 ||
+                    virBitmapSetBitExpand(claimed, id) < 0)
+                    goto cleanup;
+
+                ignore_value(virBitmapClearBit(available, id));
+                nplaced++;
+            }
+        }
+    }
+
+    if (nplaced < nvcpus) {
+        virReportError(VIR_ERR_OPERATION_FAILED,
+                       _("not enough free host CPUs to place %zu vCPUs"),
+                       nvcpus);
+        goto cleanup;
+    }
+
+    if (!driver->topologyCpus)
+        driver->topologyCpus = virBitmapNewEmpty();
+
+    if (virBitmapUnion(driver->topologyCpus, claimed) < 0)
+        goto cleanup;
+
+    priv->topologyCpus = g_steal_pointer(&claimed);
+    ret = 0;
+
+ cleanup:
+    qemuDriverUnlock(driver);
+
+    if (ret < 0)
+        return -1;
+
+    /* the helper threads share the housekeeping CPUs next to the vCPUs */
+    for (j = dies[0].first; j < dies[0].last; j++) {
+        if (virBitmapIsBitSet(housekeeping, cpus[j]->id) &&
+            virBitmapSetBitExpand(helpers, cpus[j]->id) < 0)
+            return -1;
+    }
+
+    if (virBitmapIsAllClear(helpers) &&
+        virBitmapUnion(helpers, housekeeping) < 0)
+        return -1;
+
+    /* every CPU is isolated, leave the helper threads alone */
+    if (virBitmapIsAllClear(helpers))
+        return 0;
+
+    if (!def->cputune.emulatorpin)
+        def->cputune.emulatorpin = virBitmapNewCopy(helpers);
+
+    for (i = 0; i < def->niothreadids; i++) {
+        if (!def->iothreadids[i]->cpumask)
+            def->iothreadids[i]->cpumask = virBitmapNewCopy(helpers);
+    }
+
+    VIR_DEBUG("Placed %zu vCPUs of domain %s", nplaced, def->name);
+
+    return 0;
+}
+
+
+static int
+qemuProcessClaimTopologyPlacement(virQEMUDriverPtr driver,
+                                  virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    int ret;
+
+    if (!priv->topologyCpus)
+        return 0;
+
+    qemuDriverLock(driver);
+    if (!driver->topologyCpus)
+        driver->topologyCpus = virBitmapNewEmpty();
+    ret = virBitmapUnion(driver->topologyCpus, priv->topologyCpus);
+    qemuDriverUnlock(driver);
+
+    return ret;
+}
+
+
+static void
+qemuProcessReleaseTopologyPlacement(virQEMUDriverPtr driver,
+                                    virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+
+    if (!priv->topologyCpus)
+        return;
+
+    qemuDriverLock(driver);
+    if (driver->topologyCpus)
+        virBitmapSubtract(driver->topologyCpus, priv->topologyCpus);
+    qemuDriverUnlock(driver);
+
+    virBitmapFree(priv->topologyCpus);
+    priv->topologyCpus = NULL;
+}
+
+
+static int
+qemuProcessTranslateDomainStorage(virQEMUDriverPtr driver,
+                                  virDomainObjPtr vm,
+                                  unsigned int flags)
 {
     size_t i;
     bool cold_boot = flags & VIR_QEMU_PROCESS_START_COLD;
@@ -6158,8 +6887,21 @@ qemuProcessPrepareDomainStorage(virQEMUDriverPtr driver,
             /* disk source was dropped */
             continue;
         }
+    }
+
+    return 0;
+}
 
-        if (qemuDomainPrepareDiskSource(disk, priv, cfg) < 0)
+
+static int
+qemuProcessPrepareDomainStorage(virDomainObjPtr vm,
+                                qemuDomainObjPrivatePtr priv,
+                                virQEMUDriverConfigPtr cfg)
+{
+    size_t i;
+
+    for (i = 0; i < vm->def->ndisks; i++) {
+        if (qemuDomainPrepareDiskSource(vm->def->disks[i], priv, cfg) < 0)
             return -1;
     }
 
@@ -6208,6 +6950,7 @@ qemuProcessPrepareDomain(virQEMUDriverPtr driver,
                          unsigned int flags)
 {
     size_t i;
+    int rc;
     qemuDomainObjPrivatePtr priv = vm->privateData;
     g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
 
@@ -6227,6 +6970,9 @@ qemuProcessPrepareDomain(virQEMUDriverPtr driver,
 
         if (qemuProcessPrepareDomainNUMAPlacement(driver, vm) < 0)
             return -1;
+
+        if (qemuProcessPrepareDomainTopologyPlacement(driver, vm) < 0)
+            return -1;
     }
 
     /* Whether we should use virtlogd as stdio handler for character
@@ -6265,15 +7011,27 @@ qemuProcessPrepareDomain(virQEMUDriverPtr driver,
     if (qemuDomainMasterKeyCreate(vm) < 0)
         return -1;
 
-    VIR_DEBUG("Setting up storage");
-    if (qemuProcessPrepareDomainStorage(driver, vm, priv, cfg, flags) < 0)
-        return -1;
-
     VIR_DEBUG("Prepare chardev source backends for TLS");
     qemuDomainPrepareChardevSource(vm->def, cfg);
 
-    VIR_DEBUG("Prepare device secrets");
-    if (qemuDomainSecretPrepare(driver, vm) < 0)
+    VIR_DEBUG("Translating disk sources");
+    if (qemuProcessTranslateDomainStorage(driver, vm, flags) < 0)
+        return -1;
+
+    /* Fetch all secrets needed by disks and other devices at once */
+    qemuDomainSecretPrefetch(cfg, vm, NULL);
+
+    VIR_DEBUG("Setting up storage");
+    rc = qemuProcessPrepareDomainStorage(vm, priv, cfg);
+
+    if (rc == 0) {
+        VIR_DEBUG("Prepare device secrets");
+        rc = qemuDomainSecretPrepare(driver, vm);
+    }
+
+    qemuDomainSecretPrefetchClear(priv);
+
+    if (rc < 0)
         return -1;
 
     VIR_DEBUG("Prepare bios/uefi paths");
@@ -6467,6 +7225,8 @@ qemuProcessPrepareHost(virQEMUDriverPtr driver,
     qemuDomainObjPrivatePtr priv = vm->privateData;
     g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
 
+    qemuProcessSetStartPhase(vm, QEMU_DOMAIN_START_PHASE_HOST);
+
     if (qemuPrepareNVRAM(cfg, vm) < 0)
         return -1;
 
@@ -6479,8 +7239,10 @@ qemuProcessPrepareHost(virQEMUDriverPtr driver,
      * will need to be setup.
      */
     VIR_DEBUG("Preparing network devices");
+    qemuProcessSetStartPhase(vm, QEMU_DOMAIN_START_PHASE_NETWORK);
     if (qemuProcessNetworkPrepareDevices(driver, vm) < 0)
         return -1;
+    qemuProcessSetStartPhase(vm, QEMU_DOMAIN_START_PHASE_HOST);
 
     /* Must be run before security labelling */
     VIR_DEBUG("Preparing host devices");
@@ -6542,8 +7304,10 @@ qemuProcessPrepareHost(virQEMUDriverPtr driver,
         return -1;
 
     VIR_DEBUG("Preparing disks (host)");
+    qemuProcessSetStartPhase(vm, QEMU_DOMAIN_START_PHASE_STORAGE);
     if (qemuProcessPrepareHostStorage(driver, vm, flags) < 0)
         return -1;
+    qemuProcessSetStartPhase(vm, QEMU_DOMAIN_START_PHASE_HOST);
 
     VIR_DEBUG("Preparing external devices");
     if (qemuExtDevicesPrepareHost(driver, vm) < 0)
@@ -6640,6 +7404,59 @@ qemuProcessSetupDiskThrottlingBlockdev(virQEMUDriverPtr driver,
 }
 
 
+/**
+ * qemuProcessSetupDiskLatencyHistograms:
+ *
+ * Enables the latency histograms of disks configured in the domain
+ * definition. QEMU can't set them up from the command line.
+ */
+static int
+qemuProcessSetupDiskLatencyHistograms(virQEMUDriverPtr driver,
+                                      virDomainObjPtr vm,
+                                      qemuDomainAsyncJob asyncJob)
+{
+    size_t i;
+    int ret = -1;
+
+    for (i = 0; i < vm->def->ndisks; i++) {
+        if (qemuDiskConfigLatencyHistogramsEnabled(vm->def->disks[i]))
+            break;
+    }
+
+    if (i == vm->def->ndisks)
+        return 0;
+
+    VIR_DEBUG("Setting up disk latency histograms");
+
+    if (qemuDomainObjEnterMonitorAsync(driver, vm, asyncJob) < 0)
+        return -1;
+
+    for (i = 0; i < vm->def->ndisks; i++) {
+        virDomainDiskDefPtr disk = vm->def->disks[i];
+        qemuDomainDiskPrivatePtr diskPriv = QEMU_DOMAIN_DISK_PRIVATE(disk);
+        const char *id = diskPriv->qomName ? diskPriv->qomName : disk->info.alias;
+
+        /* sd-cards don't have a frontend device */
+        if (qemuDiskBusIsSD(disk->bus))
+            continue;
+
+        if (!qemuDiskConfigLatencyHistogramsEnabled(disk))
+            continue;
+
+        if (qemuMonitorBlockLatencyHistogramSet(qemuDomainGetMonitor(vm), id,
+                                                disk->latencyHistograms) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (qemuDomainObjExitMonitor(driver, vm) < 0)
+        ret = -1;
+    return ret;
+}
+
+
 static int
 qemuProcessEnableDomainNamespaces(virQEMUDriverPtr driver,
                                   virDomainObjPtr vm)
@@ -6739,12 +7556,14 @@ qemuProcessLaunch(virConnectPtr conn,
     if (qemuProcessGenID(vm, flags) < 0)
         goto cleanup;
 
+    qemuProcessSetStartPhase(vm, QEMU_DOMAIN_START_PHASE_EXT_DEVICES);
     if (qemuExtDevicesStart(driver, vm,
                             qemuDomainLogContextGetManager(logCtxt),
                             incoming != NULL) < 0)
         goto cleanup;
 
     VIR_DEBUG("Building emulator command line");
+    qemuProcessSetStartPhase(vm, QEMU_DOMAIN_START_PHASE_CMDLINE);
     if (!(cmd = qemuBuildCommandLine(driver,
                                      qemuDomainLogContextGetManager(logCtxt),
                                      driver->securityManager,
@@ -6765,6 +7584,8 @@ qemuProcessLaunch(virConnectPtr conn,
                              VIR_HOOK_SUBOP_BEGIN) < 0)
         goto cleanup;
 
+    qemuProcessSetStartPhase(vm, QEMU_DOMAIN_START_PHASE_EXEC);
+
     qemuLogOperation(vm, "starting up", cmd, logCtxt);
 
     qemuDomainObjCheckTaint(driver, vm, logCtxt);
@@ -6832,6 +7653,7 @@ qemuProcessLaunch(virConnectPtr conn,
     }
 
     VIR_DEBUG("Building domain mount namespace (if required)");
+    qemuProcessSetStartPhase(vm, QEMU_DOMAIN_START_PHASE_CGROUP);
     if (qemuDomainBuildNamespace(cfg, vm) < 0)
         goto cleanup;
 
@@ -6871,6 +7693,7 @@ qemuProcessLaunch(virConnectPtr conn,
         goto cleanup;
 
     VIR_DEBUG("Setting domain security labels");
+    qemuProcessSetStartPhase(vm, QEMU_DOMAIN_START_PHASE_SECURITY);
     if (qemuSecuritySetAllLabel(driver,
                                 vm,
                                 incoming ? incoming->path : NULL,
@@ -6917,6 +7740,7 @@ qemuProcessLaunch(virConnectPtr conn,
         goto cleanup;
 
     VIR_DEBUG("Waiting for monitor to show up");
+    qemuProcessSetStartPhase(vm, QEMU_DOMAIN_START_PHASE_MONITOR);
     if (qemuProcessWaitForMonitor(driver, vm, asyncJob, logCtxt) < 0)
         goto cleanup;
 
@@ -6924,6 +7748,7 @@ qemuProcessLaunch(virConnectPtr conn,
         goto cleanup;
 
     VIR_DEBUG("Verifying and updating provided guest CPU");
+    qemuProcessSetStartPhase(vm, QEMU_DOMAIN_START_PHASE_QMP_INIT);
     if (qemuProcessUpdateAndVerifyCPU(driver, vm, asyncJob) < 0)
         goto cleanup;
 
@@ -6989,6 +7814,9 @@ qemuProcessLaunch(virConnectPtr conn,
     if (qemuProcessSetupDiskThrottlingBlockdev(driver, vm, asyncJob) < 0)
         goto cleanup;
 
+    if (qemuProcessSetupDiskLatencyHistograms(driver, vm, asyncJob) < 0)
+        goto cleanup;
+
     /* Since CPUs were not started yet, the balloon could not return the memory
      * to the host and thus cur_balloon needs to be updated so that GetXMLdesc
      * and friends return the correct size in case they can't grab the job */
@@ -7003,6 +7831,7 @@ qemuProcessLaunch(virConnectPtr conn,
     ret = 0;
 
  cleanup:
+    qemuProcessSetStartPhase(vm, QEMU_DOMAIN_START_PHASE_NONE);
     qemuDomainSecretDestroy(vm);
     return ret;
 }
@@ -7107,6 +7936,7 @@ qemuProcessStart(virConnectPtr conn,
     unsigned int stopFlags;
     bool relabel = false;
     bool relabelSavedState = false;
+    unsigned long long phaseTimeBase[QEMU_DOMAIN_START_PHASE_LAST] = { 0 };
     int ret = -1;
     int rv;
 
@@ -7126,6 +7956,12 @@ qemuProcessStart(virConnectPtr conn,
     if (!migrateFrom && !snapshot)
         flags |= VIR_QEMU_PROCESS_START_NEW;
 
+    if (priv->job.current) {
+        memcpy(phaseTimeBase, priv->job.current->startPhaseTime,
+               sizeof(phaseTimeBase));
+    }
+
+    qemuProcessSetStartPhase(vm, QEMU_DOMAIN_START_PHASE_INIT);
     if (qemuProcessInit(driver, vm, updatedCPU,
                         asyncJob, !!migrateFrom, flags) < 0)
         goto cleanup;
@@ -7137,6 +7973,7 @@ qemuProcessStart(virConnectPtr conn,
             goto stop;
     }
 
+    qemuProcessSetStartPhase(vm, QEMU_DOMAIN_START_PHASE_PREPARE);
     if (qemuProcessPrepareDomain(driver, vm, flags) < 0)
         goto stop;
 
@@ -7158,6 +7995,7 @@ qemuProcessStart(virConnectPtr conn,
     }
     relabel = true;
 
+    qemuProcessSetStartPhase(vm, QEMU_DOMAIN_START_PHASE_QMP_INIT);
     if (incoming) {
         if (incoming->deferredURI &&
             qemuMigrationDstRun(driver, vm, incoming->deferredURI, asyncJob) < 0)
@@ -7170,6 +8008,7 @@ qemuProcessStart(virConnectPtr conn,
             goto stop;
     }
 
+    qemuProcessSetStartPhase(vm, QEMU_DOMAIN_START_PHASE_FINISH);
     if (qemuProcessFinishStartup(driver, vm, asyncJob,
                                  !(flags & VIR_QEMU_PROCESS_START_PAUSED),
                                  incoming ?
@@ -7183,9 +8022,15 @@ qemuProcessStart(virConnectPtr conn,
         qemuMonitorSetDomainLog(priv->mon, NULL, NULL, NULL);
     }
 
+    qemuProcessSetStartPhase(vm, QEMU_DOMAIN_START_PHASE_NONE);
+    if (priv->job.current)
+        qemuProcessRecordStartStats(phaseTimeBase,
+                                    priv->job.current->startPhaseTime);
+
     ret = 0;
 
  cleanup:
+    qemuProcessSetStartPhase(vm, QEMU_DOMAIN_START_PHASE_NONE);
     if (relabelSavedState &&
         qemuSecurityRestoreSavedStateLabel(driver->securityManager,
                                            vm->def, migratePath) < 0)
@@ -7443,7 +8288,7 @@ void qemuProcessStop(virQEMUDriverPtr driver,
 
     qemuDBusStop(driver, vm);
 
-    vm->def->id = -1;
+    virDomainObjListSetID(driver->domains, vm, -1);
 
     /* Stop autodestroy in case guest is restarted */
     qemuProcessAutoDestroyRemove(driver, vm);
@@ -7453,9 +8298,9 @@ void qemuProcessStop(virQEMUDriverPtr driver,
         g_autofree char *xml = qemuDomainDefFormatXML(driver, NULL, vm->def, 0);
 
         /* we can't stop the operation even if the script raised an error */
-        ignore_value(virHookCall(VIR_HOOK_DRIVER_QEMU, vm->def->name,
-                                 VIR_HOOK_QEMU_OP_STOPPED, VIR_HOOK_SUBOP_END,
-                                 NULL, xml, NULL));
+        ignore_value(qemuProcessCallHook(driver, vm,
+                                         VIR_HOOK_QEMU_OP_STOPPED,
+                                         VIR_HOOK_SUBOP_END, xml));
     }
 
     /* Reset Security Labels unless caller don't want us to */
@@ -7639,6 +8484,8 @@ void qemuProcessStop(virQEMUDriverPtr driver,
         }
     }
 
+    qemuProcessReleaseTopologyPlacement(driver, vm);
+
     /* clear all private data entries which are no longer needed */
     qemuDomainObjPrivateDataClear(priv);
 
@@ -7647,9 +8494,9 @@ void qemuProcessStop(virQEMUDriverPtr driver,
         g_autofree char *xml = qemuDomainDefFormatXML(driver, NULL, vm->def, 0);
 
         /* we can't stop the operation even if the script raised an error */
-        virHookCall(VIR_HOOK_DRIVER_QEMU, vm->def->name,
-                    VIR_HOOK_QEMU_OP_RELEASE, VIR_HOOK_SUBOP_END,
-                    NULL, xml, NULL);
+        ignore_value(qemuProcessCallHook(driver, vm,
+                                         VIR_HOOK_QEMU_OP_RELEASE,
+                                         VIR_HOOK_SUBOP_END, xml));
     }
 
     virDomainObjRemoveTransientDef(vm);
@@ -7990,11 +8837,20 @@ qemuProcessRefreshBlockjobs(virQEMUDriverPtr driver,
                             virDomainObjPtr vm)
 {
     qemuDomainObjPrivatePtr priv = vm->privateData;
+    int ret;
+
+    /* jobs which changed while we were away would otherwise save the
+     * status XML one by one, qemuProcessReconnect saves it at the end */
+    priv->saveStatusHeld = true;
 
     if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV))
-        return qemuBlockJobRefreshJobs(driver, vm);
+        ret = qemuBlockJobRefreshJobs(driver, vm);
     else
-        return qemuProcessRefreshLegacyBlockjobs(driver, vm);
+        ret = qemuProcessRefreshLegacyBlockjobs(driver, vm);
+
+    priv->saveStatusHeld = false;
+
+    return ret;
 }
 
 
@@ -8002,15 +8858,31 @@ struct qemuProcessReconnectData {
     virQEMUDriverPtr driver;
     virDomainObjPtr obj;
     virIdentityPtr identity;
+    qemuDomainJobObj oldjob; /* job restored from the status XML */
+    bool jobStarted;
+};
+
+
+/* Domains waiting for reconnect, the ones which had a job running when
+ * the daemon stopped are reconnected first */
+struct qemuProcessReconnectList {
+    virQEMUDriverPtr driver;
+    struct qemuProcessReconnectData **prio;
+    size_t nprio;
+    struct qemuProcessReconnectData **other;
+    size_t nother;
 };
+
+
 /*
  * Open an existing VM's monitor, re-detect VCPU threads
  * and re-reserve the security labels in use
  *
- * This function also inherits a locked and ref'd domain object.
+ * This function also inherits a ref'd domain object on which
+ * qemuProcessReconnectHelper already started a job unless
+ * @data->jobStarted is false.
  *
  * This function needs to:
- * 1. Enter job
  * 1. just before monitor reconnect do lightweight MonitorEnter
  *    (increase VM refcount and unlock VM)
  * 2. reconnect to monitor
@@ -8022,7 +8894,8 @@ struct qemuProcessReconnectData {
  * monitor lock, which does not exists in this early phase.
  */
 static void
-qemuProcessReconnect(void *opaque)
+qemuProcessReconnect(void *opaque,
+                     void *unused G_GNUC_UNUSED)
 {
     struct qemuProcessReconnectData *data = opaque;
     virQEMUDriverPtr driver = data->driver;
@@ -8040,18 +8913,24 @@ qemuProcessReconnect(void *opaque)
 
     virIdentitySetCurrent(data->identity);
     g_clear_object(&data->identity);
+    oldjob = data->oldjob;
+    jobStarted = data->jobStarted;
     VIR_FREE(data);
 
-    qemuDomainObjRestoreJob(obj, &oldjob);
+    virObjectLock(obj);
+
     if (oldjob.asyncJob == QEMU_ASYNC_JOB_MIGRATION_IN)
         stopFlags |= VIR_QEMU_PROCESS_STOP_MIGRATED;
 
     cfg = virQEMUDriverGetConfig(driver);
     priv = obj->privateData;
 
-    if (qemuDomainObjBeginJob(driver, obj, QEMU_JOB_MODIFY) < 0)
+    /* the reference is dropped once the domain stops, even on error */
+    if (priv->prDaemonShared)
+        qemuProcessRefSharedPRDaemon(driver);
+
+    if (!jobStarted)
         goto error;
-    jobStarted = true;
 
     /* XXX If we ever gonna change pid file pattern, come up with
      * some intelligence here to deal with old paths. */
@@ -8182,6 +9061,9 @@ qemuProcessReconnect(void *opaque)
     if (qemuProcessRefreshCPU(driver, obj) < 0)
         goto error;
 
+    if (qemuProcessClaimTopologyPlacement(driver, obj) < 0)
+        goto error;
+
     if (qemuDomainRefreshVcpuInfo(driver, obj, QEMU_ASYNC_JOB_NONE, true) < 0)
         goto error;
 
@@ -8284,6 +9166,11 @@ qemuProcessReconnect(void *opaque)
     virDomainObjEndAPI(&obj);
     virNWFilterUnlockFilterUpdates();
     virIdentitySetCurrent(NULL);
+    if (g_atomic_int_dec_and_test(&driver->reconnectPending))
+        VIR_INFO("Reconnect to all running domains finished");
+    else
+        VIR_DEBUG("%d domains still waiting for reconnect",
+                  g_atomic_int_get(&driver->reconnectPending));
     return;
 
  error:
@@ -8318,10 +9205,8 @@ static int
 qemuProcessReconnectHelper(virDomainObjPtr obj,
                            void *opaque)
 {
-    virThread thread;
-    struct qemuProcessReconnectData *src = opaque;
+    struct qemuProcessReconnectList *list = opaque;
     struct qemuProcessReconnectData *data;
-    g_autofree char *name = NULL;
 
     /* If the VM was inactive, we don't need to reconnect */
     if (!obj->pid)
@@ -8330,55 +9215,112 @@ qemuProcessReconnectHelper(virDomainObjPtr obj,
     if (VIR_ALLOC(data) < 0)
         return -1;
 
-    memcpy(data, src, sizeof(*data));
-    data->obj = obj;
+    data->driver = list->driver;
+    data->obj = virObjectRef(obj);
     data->identity = virIdentityGetCurrent();
 
     virNWFilterReadLockFilterUpdates();
 
-    /* this lock and reference will be eventually transferred to the thread
-     * that handles the reconnect */
+    /* Enter the job right away so that the domain is not touched by any
+     * API until its reconnect is done, while APIs which don't need a job
+     * are not blocked by domains waiting for a free reconnect worker. */
     virObjectLock(obj);
-    virObjectRef(obj);
+    qemuDomainObjRestoreJob(obj, &data->oldjob);
+    data->jobStarted = qemuDomainObjBeginJob(list->driver, obj,
+                                             QEMU_JOB_MODIFY) == 0;
+    virObjectUnlock(obj);
+
+    if (data->oldjob.active != QEMU_JOB_NONE ||
+        data->oldjob.asyncJob != QEMU_ASYNC_JOB_NONE)
+        ignore_value(VIR_APPEND_ELEMENT(list->prio, list->nprio, data));
+    else
+        ignore_value(VIR_APPEND_ELEMENT(list->other, list->nother, data));
 
-    name = g_strdup_printf("init-%s", obj->def->name);
+    return 0;
+}
 
-    if (virThreadCreateFull(&thread, false, qemuProcessReconnect,
-                            name, false, data) < 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("Could not create thread. QEMU initialization "
-                         "might be incomplete"));
-        /* We can't spawn a thread and thus connect to monitor. Kill qemu.
-         * It's safe to call qemuProcessStop without a job here since there
-         * is no thread that could be doing anything else with the same domain
-         * object.
-         */
-        qemuProcessStop(src->driver, obj, VIR_DOMAIN_SHUTOFF_FAILED,
-                        QEMU_ASYNC_JOB_NONE, 0);
-        qemuDomainRemoveInactiveJobLocked(src->driver, obj);
 
-        virDomainObjEndAPI(&obj);
-        virNWFilterUnlockFilterUpdates();
-        g_clear_object(&data->identity);
-        VIR_FREE(data);
-        return -1;
+static void
+qemuProcessReconnectSubmit(virQEMUDriverPtr driver,
+                           struct qemuProcessReconnectData *data)
+{
+    virDomainObjPtr obj = data->obj;
+
+    if (driver->reconnectPool &&
+        virThreadPoolSendJob(driver->reconnectPool, 0, data) == 0)
+        return;
+
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("Could not queue domain reconnect. QEMU initialization "
+                     "might be incomplete"));
+
+    /* We can't connect to the monitor. Kill qemu. */
+    virObjectLock(obj);
+    qemuProcessStop(driver, obj, VIR_DOMAIN_SHUTOFF_FAILED,
+                    QEMU_ASYNC_JOB_NONE, 0);
+    if (data->jobStarted) {
+        qemuDomainRemoveInactive(driver, obj);
+        qemuDomainObjEndJob(driver, obj);
+    } else {
+        qemuDomainRemoveInactiveJob(driver, obj);
     }
 
-    return 0;
+    virDomainObjEndAPI(&obj);
+    virNWFilterUnlockFilterUpdates();
+    g_clear_object(&data->identity);
+    VIR_FREE(data);
+    g_atomic_int_add(&driver->reconnectPending, -1);
 }
 
+
 /**
  * qemuProcessReconnectAll
  *
  * Try to re-open the resources for live VMs that we care
- * about.
+ * about. The reconnects are done by a pool of reconnect_workers
+ * threads (one per domain by default) and this function doesn't wait
+ * for them to finish.
  */
 void
 qemuProcessReconnectAll(virQEMUDriverPtr driver)
 {
-    struct qemuProcessReconnectData data = {.driver = driver};
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    struct qemuProcessReconnectList list = { .driver = driver };
+    size_t nworkers;
+    size_t i;
+
     virDomainObjListForEach(driver->domains, true,
-                            qemuProcessReconnectHelper, &data);
+                            qemuProcessReconnectHelper, &list);
+
+    if (list.nprio + list.nother == 0)
+        return;
+
+    nworkers = list.nprio + list.nother;
+    if (cfg->reconnectWorkers > 0)
+        nworkers = MIN(nworkers, cfg->reconnectWorkers);
+
+    VIR_INFO("Reconnecting to %zu domains using %zu workers",
+             list.nprio + list.nother, nworkers);
+
+    g_atomic_int_set(&driver->reconnectPending, list.nprio + list.nother);
+
+    if (!driver->reconnectPool &&
+        !(driver->reconnectPool = virThreadPoolNewFull(0, nworkers, 0,
+                                                       qemuProcessReconnect,
+                                                       "qemu-reconnect",
+                                                       NULL))) {
+        /* qemuProcessReconnectSubmit kills the domains then */
+        VIR_ERROR(_("Unable to create reconnect worker pool: %s"),
+                  virGetLastErrorMessage());
+    }
+
+    for (i = 0; i < list.nprio; i++)
+        qemuProcessReconnectSubmit(driver, list.prio[i]);
+    for (i = 0; i < list.nother; i++)
+        qemuProcessReconnectSubmit(driver, list.other[i]);
+
+    VIR_FREE(list.prio);
+    VIR_FREE(list.other);
 }
 
 
@@ -25,6 +25,7 @@
 #include "qemu_domain.h"
 #include "virstoragefile.h"
 #include "vireventthread.h"
+#include "virtypedparam.h"
 
 int qemuProcessPrepareMonitorChr(virDomainChrSourceDefPtr monConfig,
                                  const char *domainDir);
@@ -73,6 +74,9 @@ int qemuProcessBeginJob(virQEMUDriverPtr driver,
 void qemuProcessEndJob(virQEMUDriverPtr driver,
                        virDomainObjPtr vm);
 
+int qemuProcessGetStartStats(virTypedParamListPtr params,
+                             const char *prefix);
+
 typedef enum {
     VIR_QEMU_PROCESS_START_COLD         = 1 << 0,
     VIR_QEMU_PROCESS_START_PAUSED       = 1 << 1,
@@ -578,6 +578,31 @@ qemuValidateDomainDefMemory(const virDomainDef *def,
     const long system_page_size = virGetSystemPageSizeKB();
     const virDomainMemtune *mem = &def->mem;
 
+    if (mem->allocation_threads > 0) {
+        if (mem->allocation == VIR_DOMAIN_MEMORY_ALLOCATION_ONDEMAND) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                           _("preallocation threads are not allowed with "
+                             "memory allocation ondemand"));
+            return -1;
+        }
+
+        if (!virQEMUCapsGet(qemuCaps, QEMU_CAPS_OBJECT_MEMORY_PREALLOC_THREADS)) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                           _("parallel memory preallocation is not "
+                             "supported with this QEMU binary"));
+            return -1;
+        }
+
+        /* QEMU sizes the threads for memory not backed by memory-backend-*
+         * objects on its own */
+        if (virDomainNumaGetNodeCount(def->numa) == 0) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                           _("preallocation threads are not supported "
+                             "without guest numa node"));
+            return -1;
+        }
+    }
+
     if (mem->nhugepages == 0)
         return 0;
 
@@ -1248,6 +1273,30 @@ qemuValidateDomainDeviceDefNetwork(const virDomainNetDef *net,
                            _("tx_queue_size has to be a power of two"));
             return -1;
         }
+        if (net->driver.virtio.rss == VIR_TRISTATE_SWITCH_ON &&
+            !virQEMUCapsGet(qemuCaps, QEMU_CAPS_VIRTIO_NET_RSS)) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                           _("virtio-net rss is not supported with this QEMU binary"));
+            return -1;
+        }
+        if (net->driver.virtio.rss_hash_report == VIR_TRISTATE_SWITCH_ON) {
+            if (!virQEMUCapsGet(qemuCaps, QEMU_CAPS_VIRTIO_NET_HASH_REPORT)) {
+                virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                               _("virtio-net rss hash reporting is not supported with this QEMU binary"));
+                return -1;
+            }
+            if (net->driver.virtio.rss != VIR_TRISTATE_SWITCH_ON) {
+                virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                               _("virtio-net rss hash reporting requires rss to be enabled"));
+                return -1;
+            }
+        }
+        if (net->driver.virtio.rss == VIR_TRISTATE_SWITCH_ON &&
+            net->driver.virtio.queues <= 1) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                           _("virtio-net rss requires more than one queue"));
+            return -1;
+        }
         if (qemuValidateDomainVirtioOptions(net->virtio, qemuCaps) < 0)
             return -1;
     }
@@ -3859,6 +3908,13 @@ qemuValidateDomainDeviceDefMemballoon(const virDomainMemballoonDef *memballoon,
         return -1;
     }
 
+    if (memballoon->free_page_reporting != VIR_TRISTATE_SWITCH_ABSENT &&
+        !virQEMUCapsGet(qemuCaps, QEMU_CAPS_VIRTIO_BALLOON_FREE_PAGE_REPORTING)) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                       _("free-page-reporting is not supported by this QEMU binary"));
+        return -1;
+    }
+
     if (qemuValidateDomainVirtioOptions(memballoon->virtio, qemuCaps) < 0)
         return -1;
 
@@ -57,7 +57,9 @@
 #include "util/virnetdevopenvswitch.h"
 #include "virsystemd.h"
 #include "virhostuptime.h"
+#include "virhostcpu.h"
 #include "virdaemon.h"
+#include "virtrace.h"
 
 #include "driver.h"
 
@@ -76,6 +78,7 @@ virNetSASLContextPtr saslCtxt = NULL;
 #endif
 virNetServerProgramPtr remoteProgram = NULL;
 virNetServerProgramPtr qemuProgram = NULL;
+unsigned int remoteMaxCompressionLevel;
 
 volatile bool driversInitialized = false;
 
@@ -680,6 +683,41 @@ daemonSetupHostUUID(const struct daemonConfig *config)
     return 0;
 }
 
+/* Parses the worker_cpus setting into @cpus, which stays NULL if the
+ * threads are not confined */
+static int
+daemonSetupWorkerCPUs(const struct daemonConfig *config,
+                      virBitmapPtr *cpus)
+{
+    g_autoptr(virBitmap) isolated = NULL;
+    g_autoptr(virBitmap) ret = NULL;
+
+    if (!config->worker_cpus)
+        return 0;
+
+    if (STREQ(config->worker_cpus, "housekeeping")) {
+        if (!(ret = virHostCPUGetOnlineBitmap()) ||
+            !(isolated = virHostCPUGetIsolatedBitmap())) {
+            VIR_ERROR(_("Can't get housekeeping CPUs: %s"),
+                      virGetLastErrorMessage());
+            return -1;
+        }
+
+        virBitmapSubtract(ret, isolated);
+    } else if (!(ret = virBitmapParseUnlimited(config->worker_cpus))) {
+        VIR_ERROR(_("invalid worker CPUs: %s"), config->worker_cpus);
+        return -1;
+    }
+
+    if (virBitmapIsAllClear(ret)) {
+        VIR_ERROR(_("no CPUs left for workers in '%s'"), config->worker_cpus);
+        return -1;
+    }
+
+    *cpus = g_steal_pointer(&ret);
+    return 0;
+}
+
 typedef struct {
     const char *opts;
     const char *help;
@@ -785,6 +823,7 @@ int main(int argc, char **argv) {
     bool implicit_conf = false;
     char *run_dir = NULL;
     mode_t old_umask;
+    virBitmapPtr workerCPUs = NULL;
 
     struct option opts[] = {
         { "verbose", no_argument, &verbose, 'v'},
@@ -919,6 +958,37 @@ int main(int argc, char **argv) {
                           verbose,
                           godaemon);
 
+    if (config->log_buffer_size > 0) {
+        int overflow = VIR_LOG_OVERFLOW_DROP;
+
+        if (config->log_buffer_overflow &&
+            (overflow = virLogOverflowTypeFromString(config->log_buffer_overflow)) < 0) {
+            VIR_ERROR(_("invalid log buffer overflow policy: %s"),
+                      config->log_buffer_overflow);
+            exit(EXIT_FAILURE);
+        }
+
+        if (virLogSetAsync(config->log_buffer_size, overflow) < 0) {
+            VIR_ERROR(_("Can't setup asynchronous logging: %s"),
+                      virGetLastErrorMessage());
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (config->lock_profiling) {
+        VIR_INFO("Enabling lock profiling");
+        virMutexProfileEnable(true);
+    }
+
+    if (config->trace_file &&
+        virTraceSetOutput(config->trace_file) < 0) {
+        VIR_ERROR(_("Can't setup tracing: %s"), virGetLastErrorMessage());
+        exit(EXIT_FAILURE);
+    }
+
+    if (daemonSetupWorkerCPUs(config, &workerCPUs) < 0)
+        exit(EXIT_FAILURE);
+
     /* Let's try to initialize global variable that holds the host's boot time. */
     if (virHostBootTimeInit() < 0) {
         /* This is acceptable failure. Maybe we won't need the boot time
@@ -1023,6 +1093,16 @@ int main(int argc, char **argv) {
         goto cleanup;
     }
 
+    if (virNetServerSetEventThreads(srv, config->event_threads) < 0) {
+        ret = VIR_DAEMON_ERR_INIT;
+        goto cleanup;
+    }
+
+    if (workerCPUs)
+        virNetServerSetThreadCPUs(srv, workerCPUs);
+
+    remoteSetEventPolicy(config->event_queue_max, config->event_coalesce);
+
     if (virNetDaemonAddServer(dmn, srv) < 0) {
         ret = VIR_DAEMON_ERR_INIT;
         goto cleanup;
@@ -1033,6 +1113,8 @@ int main(int argc, char **argv) {
         goto cleanup;
     }
 
+    remoteMaxCompressionLevel = MIN(config->max_compression_level, 9);
+
     remoteProcs[REMOTE_PROC_AUTH_LIST].needAuth = false;
     remoteProcs[REMOTE_PROC_AUTH_SASL_INIT].needAuth = false;
     remoteProcs[REMOTE_PROC_AUTH_SASL_STEP].needAuth = false;
@@ -1045,6 +1127,9 @@ int main(int argc, char **argv) {
         ret = VIR_DAEMON_ERR_INIT;
         goto cleanup;
     }
+#ifdef VIRTPROXYD
+    virNetServerProgramSetForward(remoteProgram, remoteDispatchForward, NULL);
+#endif
     if (virNetServerAddProgram(srv, remoteProgram) < 0) {
         ret = VIR_DAEMON_ERR_INIT;
         goto cleanup;
@@ -1090,6 +1175,9 @@ int main(int argc, char **argv) {
         goto cleanup;
     }
 
+    if (workerCPUs)
+        virNetServerSetThreadCPUs(srvAdm, workerCPUs);
+
     if (virNetDaemonAddServer(dmn, srvAdm) < 0) {
         ret = VIR_DAEMON_ERR_INIT;
         goto cleanup;
@@ -1227,6 +1315,7 @@ int main(int argc, char **argv) {
         virPidFileReleasePath(pid_file, pid_file_fd);
 
     VIR_FREE(run_dir);
+    virBitmapFree(workerCPUs);
 
     if (statuswrite != -1) {
         if (ret != 0) {
@@ -1246,5 +1335,8 @@ int main(int argc, char **argv) {
     VIR_FREE(remote_config_file);
     daemonConfigFree(config);
 
+    /* write out messages still queued by the asynchronous logger */
+    ignore_value(virLogSetAsync(0, VIR_LOG_OVERFLOW_DROP));
+
     return ret;
 }
@@ -99,3 +99,4 @@ extern virNetSASLContextPtr saslCtxt;
 #endif
 extern virNetServerProgramPtr remoteProgram;
 extern virNetServerProgramPtr qemuProgram;
+extern unsigned int remoteMaxCompressionLevel;
@@ -145,6 +145,15 @@ daemonConfigNew(bool privileged G_GNUC_UNUSED)
 
     data->max_client_requests = 5;
 
+    data->max_compression_level = 0;
+
+    data->event_threads = 0;
+
+    data->event_queue_max = 0;
+    data->event_coalesce = false;
+
+    data->lock_profiling = false;
+
     data->audit_level = 1;
     data->audit_logging = false;
 
@@ -219,6 +228,9 @@ daemonConfigFree(struct daemonConfig *data)
     VIR_FREE(data->host_uuid_source);
     VIR_FREE(data->log_filters);
     VIR_FREE(data->log_outputs);
+    VIR_FREE(data->log_buffer_overflow);
+    VIR_FREE(data->trace_file);
+    VIR_FREE(data->worker_cpus);
 
     VIR_FREE(data);
 }
@@ -327,6 +339,23 @@ daemonConfigLoadOptions(struct daemonConfig *data,
     if (virConfGetValueUInt(conf, "max_client_requests", &data->max_client_requests) < 0)
         return -1;
 
+    if (virConfGetValueUInt(conf, "max_compression_level", &data->max_compression_level) < 0)
+        return -1;
+
+    if (virConfGetValueUInt(conf, "event_threads", &data->event_threads) < 0)
+        return -1;
+
+    if (virConfGetValueUInt(conf, "event_queue_max", &data->event_queue_max) < 0)
+        return -1;
+    if (virConfGetValueBool(conf, "event_coalesce", &data->event_coalesce) < 0)
+        return -1;
+
+    if (virConfGetValueBool(conf, "lock_profiling", &data->lock_profiling) < 0)
+        return -1;
+
+    if (virConfGetValueString(conf, "worker_cpus", &data->worker_cpus) < 0)
+        return -1;
+
     if (virConfGetValueUInt(conf, "admin_min_workers", &data->admin_min_workers) < 0)
         return -1;
     if (virConfGetValueUInt(conf, "admin_max_workers", &data->admin_max_workers) < 0)
@@ -354,6 +383,13 @@ daemonConfigLoadOptions(struct daemonConfig *data,
         return -1;
     if (virConfGetValueString(conf, "log_outputs", &data->log_outputs) < 0)
         return -1;
+    if (virConfGetValueUInt(conf, "log_buffer_size", &data->log_buffer_size) < 0)
+        return -1;
+    if (virConfGetValueString(conf, "log_buffer_overflow", &data->log_buffer_overflow) < 0)
+        return -1;
+
+    if (virConfGetValueString(conf, "trace_file", &data->trace_file) < 0)
+        return -1;
 
     if (virConfGetValueInt(conf, "keepalive_interval", &data->keepalive_interval) < 0)
         return -1;
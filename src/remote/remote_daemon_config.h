@@ -75,9 +75,24 @@ struct daemonConfig {
 
     unsigned int max_client_requests;
 
+    unsigned int max_compression_level;
+
+    unsigned int event_threads;
+
+    unsigned int event_queue_max;
+    bool event_coalesce;
+
+    bool lock_profiling;
+
+    char *worker_cpus;
+
     unsigned int log_level;
     char *log_filters;
     char *log_outputs;
+    unsigned int log_buffer_size;
+    char *log_buffer_overflow;
+
+    char *trace_file;
 
     unsigned int audit_level;
     bool audit_logging;
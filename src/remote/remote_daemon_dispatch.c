@@ -50,6 +50,9 @@
 #include "virpolkit.h"
 #include "virthreadjob.h"
 #include "configmake.h"
+#ifdef VIRTPROXYD
+# include "remote_driver.h"
+#endif
 
 #define VIR_FROM_THIS VIR_FROM_RPC
 
@@ -142,6 +145,17 @@ remoteDispatchObjectEventSend(virNetServerClientPtr client,
                               int procnr,
                               xdrproc_t proc,
                               void *data);
+static void
+remoteDispatchObjectEventSendKey(virNetServerClientPtr client,
+                                 virNetServerProgramPtr program,
+                                 int procnr,
+                                 xdrproc_t proc,
+                                 void *data,
+                                 const char *key);
+
+/* Event delivery policy applied to each client connection */
+static size_t remoteEventQueueMax;
+static bool remoteEventCoalesce;
 
 static void
 remoteEventCallbackFree(void *opaque)
@@ -155,6 +169,26 @@ remoteEventCallbackFree(void *opaque)
 }
 
 
+/* Events which only report the latest state of something can be
+ * superseded by a newer one while they wait to be sent to the client.
+ * The key tells which events supersede each other. */
+static char *
+remoteRelayDomainEventKey(daemonClientEventCallbackPtr callback,
+                          int procnr,
+                          virDomainPtr dom,
+                          const char *detail)
+{
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+
+    if (!remoteEventCoalesce)
+        return NULL;
+
+    virUUIDFormat(dom->uuid, uuidstr);
+    return g_strdup_printf("%d:%d:%s:%s", procnr, callback->callbackID,
+                           uuidstr, NULLSTR_EMPTY(detail));
+}
+
+
 static bool
 remoteRelayDomainEventCheckACL(virNetServerClientPtr client,
                                virConnectPtr conn, virDomainPtr dom)
@@ -396,6 +430,7 @@ remoteRelayDomainEventRTCChange(virConnectPtr conn,
 {
     daemonClientEventCallbackPtr callback = opaque;
     remote_domain_event_rtc_change_msg data;
+    g_autofree char *key = NULL;
 
     if (callback->callbackID < 0 ||
         !remoteRelayDomainEventCheckACL(callback->client, conn, dom))
@@ -411,16 +446,24 @@ remoteRelayDomainEventRTCChange(virConnectPtr conn,
     data.offset = offset;
 
     if (callback->legacy) {
-        remoteDispatchObjectEventSend(callback->client, callback->program,
-                                      REMOTE_PROC_DOMAIN_EVENT_RTC_CHANGE,
-                                      (xdrproc_t)xdr_remote_domain_event_rtc_change_msg, &data);
+        key = remoteRelayDomainEventKey(callback,
+                                        REMOTE_PROC_DOMAIN_EVENT_RTC_CHANGE,
+                                        dom, NULL);
+        remoteDispatchObjectEventSendKey(callback->client, callback->program,
+                                         REMOTE_PROC_DOMAIN_EVENT_RTC_CHANGE,
+                                         (xdrproc_t)xdr_remote_domain_event_rtc_change_msg, &data,
+                                         key);
     } else {
         remote_domain_event_callback_rtc_change_msg msg = { callback->callbackID,
                                                             data };
 
-        remoteDispatchObjectEventSend(callback->client, callback->program,
-                                      REMOTE_PROC_DOMAIN_EVENT_CALLBACK_RTC_CHANGE,
-                                      (xdrproc_t)xdr_remote_domain_event_callback_rtc_change_msg, &msg);
+        key = remoteRelayDomainEventKey(callback,
+                                        REMOTE_PROC_DOMAIN_EVENT_CALLBACK_RTC_CHANGE,
+                                        dom, NULL);
+        remoteDispatchObjectEventSendKey(callback->client, callback->program,
+                                         REMOTE_PROC_DOMAIN_EVENT_CALLBACK_RTC_CHANGE,
+                                         (xdrproc_t)xdr_remote_domain_event_callback_rtc_change_msg, &msg,
+                                         key);
     }
 
     return 0;
@@ -873,6 +916,7 @@ remoteRelayDomainEventBalloonChange(virConnectPtr conn,
 {
     daemonClientEventCallbackPtr callback = opaque;
     remote_domain_event_balloon_change_msg data;
+    g_autofree char *key = NULL;
 
     if (callback->callbackID < 0 ||
         !remoteRelayDomainEventCheckACL(callback->client, conn, dom))
@@ -887,16 +931,24 @@ remoteRelayDomainEventBalloonChange(virConnectPtr conn,
     data.actual = actual;
 
     if (callback->legacy) {
-        remoteDispatchObjectEventSend(callback->client, callback->program,
-                                      REMOTE_PROC_DOMAIN_EVENT_BALLOON_CHANGE,
-                                      (xdrproc_t)xdr_remote_domain_event_balloon_change_msg, &data);
+        key = remoteRelayDomainEventKey(callback,
+                                        REMOTE_PROC_DOMAIN_EVENT_BALLOON_CHANGE,
+                                        dom, NULL);
+        remoteDispatchObjectEventSendKey(callback->client, callback->program,
+                                         REMOTE_PROC_DOMAIN_EVENT_BALLOON_CHANGE,
+                                         (xdrproc_t)xdr_remote_domain_event_balloon_change_msg, &data,
+                                         key);
     } else {
         remote_domain_event_callback_balloon_change_msg msg = { callback->callbackID,
                                                                 data };
 
-        remoteDispatchObjectEventSend(callback->client, callback->program,
-                                      REMOTE_PROC_DOMAIN_EVENT_CALLBACK_BALLOON_CHANGE,
-                                      (xdrproc_t)xdr_remote_domain_event_callback_balloon_change_msg, &msg);
+        key = remoteRelayDomainEventKey(callback,
+                                        REMOTE_PROC_DOMAIN_EVENT_CALLBACK_BALLOON_CHANGE,
+                                        dom, NULL);
+        remoteDispatchObjectEventSendKey(callback->client, callback->program,
+                                         REMOTE_PROC_DOMAIN_EVENT_CALLBACK_BALLOON_CHANGE,
+                                         (xdrproc_t)xdr_remote_domain_event_callback_balloon_change_msg, &msg,
+                                         key);
     }
 
     return 0;
@@ -1129,6 +1181,7 @@ remoteRelayDomainEventMigrationIteration(virConnectPtr conn,
 {
     daemonClientEventCallbackPtr callback = opaque;
     remote_domain_event_callback_migration_iteration_msg data;
+    g_autofree char *key = NULL;
 
     if (callback->callbackID < 0 ||
         !remoteRelayDomainEventCheckACL(callback->client, conn, dom))
@@ -1145,10 +1198,13 @@ remoteRelayDomainEventMigrationIteration(virConnectPtr conn,
 
     data.iteration = iteration;
 
-    remoteDispatchObjectEventSend(callback->client, callback->program,
-                                  REMOTE_PROC_DOMAIN_EVENT_CALLBACK_MIGRATION_ITERATION,
-                                  (xdrproc_t)xdr_remote_domain_event_callback_migration_iteration_msg,
-                                  &data);
+    key = remoteRelayDomainEventKey(callback,
+                                    REMOTE_PROC_DOMAIN_EVENT_CALLBACK_MIGRATION_ITERATION,
+                                    dom, NULL);
+    remoteDispatchObjectEventSendKey(callback->client, callback->program,
+                                     REMOTE_PROC_DOMAIN_EVENT_CALLBACK_MIGRATION_ITERATION,
+                                     (xdrproc_t)xdr_remote_domain_event_callback_migration_iteration_msg,
+                                     &data, key);
 
     return 0;
 }
@@ -1275,6 +1331,7 @@ remoteRelayDomainEventBlockThreshold(virConnectPtr conn,
 {
     daemonClientEventCallbackPtr callback = opaque;
     remote_domain_event_block_threshold_msg data;
+    g_autofree char *key = NULL;
 
     if (callback->callbackID < 0 ||
         !remoteRelayDomainEventCheckACL(callback->client, conn, dom))
@@ -1295,9 +1352,46 @@ remoteRelayDomainEventBlockThreshold(virConnectPtr conn,
     data.excess = excess;
     make_nonnull_domain(&data.dom, dom);
 
+    key = remoteRelayDomainEventKey(callback,
+                                    REMOTE_PROC_DOMAIN_EVENT_BLOCK_THRESHOLD,
+                                    dom, dev);
+    remoteDispatchObjectEventSendKey(callback->client, callback->program,
+                                     REMOTE_PROC_DOMAIN_EVENT_BLOCK_THRESHOLD,
+                                     (xdrproc_t)xdr_remote_domain_event_block_threshold_msg, &data,
+                                     key);
+
+    return 0;
+}
+
+
+static int
+remoteRelayDomainEventMonitorSlow(virConnectPtr conn,
+                                  virDomainPtr dom,
+                                  const char *command,
+                                  unsigned long long elapsed,
+                                  void *opaque)
+{
+    daemonClientEventCallbackPtr callback = opaque;
+    remote_domain_event_callback_monitor_slow_msg data;
+
+    if (callback->callbackID < 0 ||
+        !remoteRelayDomainEventCheckACL(callback->client, conn, dom))
+        return -1;
+
+    VIR_DEBUG("Relaying domain monitor slow event %s %d %s %llu, callback %d",
+              dom->name, dom->id, command, elapsed, callback->callbackID);
+
+    /* build return data */
+    memset(&data, 0, sizeof(data));
+    data.callbackID = callback->callbackID;
+    data.command = g_strdup(command);
+    data.elapsed = elapsed;
+    make_nonnull_domain(&data.dom, dom);
+
     remoteDispatchObjectEventSend(callback->client, callback->program,
-                                  REMOTE_PROC_DOMAIN_EVENT_BLOCK_THRESHOLD,
-                                  (xdrproc_t)xdr_remote_domain_event_block_threshold_msg, &data);
+                                  REMOTE_PROC_DOMAIN_EVENT_CALLBACK_MONITOR_SLOW,
+                                  (xdrproc_t)xdr_remote_domain_event_callback_monitor_slow_msg,
+                                  &data);
 
     return 0;
 }
@@ -1329,6 +1423,7 @@ static virConnectDomainEventGenericCallback domainEventCallbacks[] = {
     VIR_DOMAIN_EVENT_CALLBACK(remoteRelayDomainEventDeviceRemovalFailed),
     VIR_DOMAIN_EVENT_CALLBACK(remoteRelayDomainEventMetadataChange),
     VIR_DOMAIN_EVENT_CALLBACK(remoteRelayDomainEventBlockThreshold),
+    VIR_DOMAIN_EVENT_CALLBACK(remoteRelayDomainEventMonitorSlow),
 };
 
 G_STATIC_ASSERT(G_N_ELEMENTS(domainEventCallbacks) == VIR_DOMAIN_EVENT_ID_LAST);
@@ -1430,9 +1525,48 @@ remoteRelayStoragePoolEventRefresh(virConnectPtr conn,
     return 0;
 }
 
+static int
+remoteRelayStoragePoolEventThreshold(virConnectPtr conn,
+                                     virStoragePoolPtr pool,
+                                     const char *volume,
+                                     unsigned long long threshold,
+                                     unsigned long long excess,
+                                     void *opaque)
+{
+    daemonClientEventCallbackPtr callback = opaque;
+    remote_storage_pool_event_threshold_msg data;
+
+    if (callback->callbackID < 0 ||
+        !remoteRelayStoragePoolEventCheckACL(callback->client, conn, pool))
+        return -1;
+
+    VIR_DEBUG("Relaying storage pool threshold event %s %s %llu %llu, callback %d",
+              pool->name, NULLSTR(volume), threshold, excess,
+              callback->callbackID);
+
+    /* build return data */
+    memset(&data, 0, sizeof(data));
+    make_nonnull_storage_pool(&data.pool, pool);
+    data.callbackID = callback->callbackID;
+    if (volume) {
+        data.volume = g_new0(remote_nonnull_string, 1);
+        *(data.volume) = g_strdup(volume);
+    }
+    data.threshold = threshold;
+    data.excess = excess;
+
+    remoteDispatchObjectEventSend(callback->client, callback->program,
+                                  REMOTE_PROC_STORAGE_POOL_EVENT_THRESHOLD,
+                                  (xdrproc_t)xdr_remote_storage_pool_event_threshold_msg,
+                                  &data);
+
+    return 0;
+}
+
 static virConnectStoragePoolEventGenericCallback storageEventCallbacks[] = {
     VIR_STORAGE_POOL_EVENT_CALLBACK(remoteRelayStoragePoolEventLifecycle),
     VIR_STORAGE_POOL_EVENT_CALLBACK(remoteRelayStoragePoolEventRefresh),
+    VIR_STORAGE_POOL_EVENT_CALLBACK(remoteRelayStoragePoolEventThreshold),
 };
 
 G_STATIC_ASSERT(G_N_ELEMENTS(storageEventCallbacks) == VIR_STORAGE_POOL_EVENT_ID_LAST);
@@ -1918,6 +2052,10 @@ void *remoteClientNew(virNetServerClientPtr client,
     }
 
     virNetServerClientSetCloseHook(client, remoteClientCloseFunc);
+    if (remoteEventQueueMax > 0 || remoteEventCoalesce)
+        virNetServerClientSetEventPolicy(client, remoteEventQueueMax,
+                                         remoteEventCoalesce,
+                                         remoteClientEventsLost, NULL);
     return priv;
 }
 
@@ -2040,6 +2178,187 @@ remoteDispatchProbeURI(bool readonly,
     VIR_DEBUG("No driver sock exists");
     return 0;
 }
+
+
+/*
+ * Calls which don't create any state in virtproxyd itself, such as
+ * event callbacks or streams, and tend to carry large payloads are
+ * passed on to the daemon of the driver as they are, instead of being
+ * decoded here and encoded again by the remote driver. The daemon sees
+ * the same arguments and performs the same access checks either way,
+ * since the connection to it carries the identity of our client.
+ */
+static bool
+remoteDispatchCanForward(int proc)
+{
+    switch ((remote_procedure) proc) {
+    case REMOTE_PROC_CONNECT_GET_ALL_DOMAIN_STATS:
+    case REMOTE_PROC_CONNECT_GET_CAPABILITIES:
+    case REMOTE_PROC_CONNECT_GET_DOMAIN_CAPABILITIES:
+    case REMOTE_PROC_CONNECT_LIST_ALL_DOMAINS:
+    case REMOTE_PROC_CONNECT_LIST_ALL_NETWORKS:
+    case REMOTE_PROC_CONNECT_LIST_ALL_NODE_DEVICES:
+    case REMOTE_PROC_CONNECT_LIST_ALL_STORAGE_POOLS:
+    case REMOTE_PROC_DOMAIN_BLOCK_STATS:
+    case REMOTE_PROC_DOMAIN_BLOCK_STATS_FLAGS:
+    case REMOTE_PROC_DOMAIN_DEFINE_XML:
+    case REMOTE_PROC_DOMAIN_DEFINE_XML_FLAGS:
+    case REMOTE_PROC_DOMAIN_GET_BLOCK_INFO:
+    case REMOTE_PROC_DOMAIN_GET_INFO:
+    case REMOTE_PROC_DOMAIN_GET_JOB_STATS:
+    case REMOTE_PROC_DOMAIN_GET_METADATA:
+    case REMOTE_PROC_DOMAIN_GET_STATE:
+    case REMOTE_PROC_DOMAIN_GET_VCPUS:
+    case REMOTE_PROC_DOMAIN_GET_XML_DESC:
+    case REMOTE_PROC_DOMAIN_INTERFACE_STATS:
+    case REMOTE_PROC_DOMAIN_LIST_ALL_SNAPSHOTS:
+    case REMOTE_PROC_DOMAIN_LOOKUP_BY_ID:
+    case REMOTE_PROC_DOMAIN_LOOKUP_BY_NAME:
+    case REMOTE_PROC_DOMAIN_LOOKUP_BY_UUID:
+    case REMOTE_PROC_DOMAIN_MEMORY_STATS:
+    case REMOTE_PROC_DOMAIN_SNAPSHOT_GET_XML_DESC:
+    case REMOTE_PROC_NETWORK_GET_XML_DESC:
+    case REMOTE_PROC_NODE_DEVICE_GET_XML_DESC:
+    case REMOTE_PROC_STORAGE_POOL_GET_XML_DESC:
+    case REMOTE_PROC_STORAGE_POOL_LIST_ALL_VOLUMES:
+    case REMOTE_PROC_STORAGE_VOL_GET_XML_DESC:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+
+typedef struct _remoteForwardCall remoteForwardCall;
+typedef remoteForwardCall *remoteForwardCallPtr;
+struct _remoteForwardCall {
+    virNetServerProgramPtr prog;
+    virNetServerClientPtr client;
+    virNetMessagePtr msg; /* the call, reused for the reply */
+};
+
+
+static void
+remoteDispatchForwardDone(virNetClientPtr netclient G_GNUC_UNUSED,
+                          virNetMessagePtr reply,
+                          int status,
+                          void *opaque)
+{
+    remoteForwardCallPtr call = opaque;
+    virNetMessagePtr msg = call->msg;
+    virNetMessagePtr chunks = NULL;
+    virNetMessageError rerr;
+    const char *payload;
+    size_t len;
+
+    memset(&rerr, 0, sizeof(rerr));
+
+    if (status < 0)
+        goto error;
+
+    if (reply->header.type != VIR_NET_REPLY ||
+        (reply->header.status != VIR_NET_OK &&
+         reply->header.status != VIR_NET_ERROR)) {
+        virReportError(VIR_ERR_RPC,
+                       _("Unexpected forwarded reply type %d status %d"),
+                       reply->header.type, reply->header.status);
+        goto error;
+    }
+
+    payload = reply->buffer + reply->bufferOffset;
+    len = reply->bufferLength - reply->bufferOffset;
+
+    msg->header.type = VIR_NET_REPLY;
+    msg->header.status = reply->header.status;
+
+    if (virNetMessageEncodeHeader(msg) < 0)
+        goto error;
+
+    if (virNetServerClientGetChunkedReplies(call->client)) {
+        if (virNetMessageEncodePayloadRawChunked(msg, payload, len, &chunks) < 0)
+            goto error;
+    } else {
+        if (virNetMessageEncodePayloadRaw(msg, payload, len) < 0)
+            goto error;
+    }
+
+    while (chunks) {
+        virNetMessagePtr chunk = virNetMessageQueueServe(&chunks);
+
+        if (virNetServerClientSendMessage(call->client, chunk) < 0) {
+            virNetMessageFree(chunk);
+            while (chunks)
+                virNetMessageFree(virNetMessageQueueServe(&chunks));
+            goto fatal;
+        }
+    }
+
+    if (virNetServerClientSendMessage(call->client, msg) < 0)
+        goto fatal;
+
+    goto cleanup;
+
+ error:
+    if (virNetServerProgramSendReplyError(call->prog, call->client, msg,
+                                          &rerr, &msg->header) < 0)
+        goto fatal;
+    goto cleanup;
+
+ fatal:
+    virNetMessageFree(msg);
+    virNetServerClientClose(call->client);
+
+ cleanup:
+    virObjectUnref(call->client);
+    virObjectUnref(call->prog);
+    g_free(call);
+}
+
+
+int
+remoteDispatchForward(virNetServerProgramPtr prog,
+                      virNetServerClientPtr client,
+                      virNetMessagePtr msg,
+                      void *opaque G_GNUC_UNUSED)
+{
+    struct daemonClientPrivate *priv = virNetServerClientGetPrivateData(client);
+    remoteForwardCallPtr call;
+    virConnectPtr conn = NULL;
+    int rc;
+
+    if (!remoteDispatchCanForward(msg->header.proc))
+        return 0;
+
+    virMutexLock(&priv->lock);
+    if (priv->conn)
+        conn = virObjectRef(priv->conn);
+    virMutexUnlock(&priv->lock);
+
+    /* Let the regular dispatcher report the missing connection */
+    if (!conn)
+        return 0;
+
+    call = g_new0(remoteForwardCall, 1);
+    call->prog = virObjectRef(prog);
+    call->client = virObjectRef(client);
+    call->msg = msg;
+
+    VIR_DEBUG("Forwarding proc=%d serial=%u",
+              msg->header.proc, msg->header.serial);
+
+    rc = remoteConnectForwardCall(conn, msg, remoteDispatchForwardDone, call);
+    virObjectUnref(conn);
+
+    if (rc != 0) {
+        virObjectUnref(call->client);
+        virObjectUnref(call->prog);
+        g_free(call);
+        return rc < 0 ? -1 : 0;
+    }
+
+    return 1;
+}
 #endif /* VIRTPROXYD */
 
 
@@ -4336,17 +4655,16 @@ remoteDispatchConnectDomainEventDeregister(virNetServerPtr server G_GNUC_UNUSED,
     return rv;
 }
 
-static void
-remoteDispatchObjectEventSend(virNetServerClientPtr client,
-                              virNetServerProgramPtr program,
-                              int procnr,
-                              xdrproc_t proc,
-                              void *data)
+static virNetMessagePtr
+remoteDispatchObjectEventNew(virNetServerProgramPtr program,
+                             int procnr,
+                             xdrproc_t proc,
+                             void *data)
 {
     virNetMessagePtr msg;
 
     if (!(msg = virNetMessageNew(false)))
-        goto cleanup;
+        return NULL;
 
     msg->header.prog = virNetServerProgramGetID(program);
     msg->header.vers = virNetServerProgramGetVersion(program);
@@ -4355,24 +4673,78 @@ remoteDispatchObjectEventSend(virNetServerClientPtr client,
     msg->header.serial = 1;
     msg->header.status = VIR_NET_OK;
 
-    if (virNetMessageEncodeHeader(msg) < 0)
-        goto cleanup;
+    if (virNetMessageEncodeHeader(msg) < 0 ||
+        virNetMessageEncodePayload(msg, proc, data) < 0) {
+        virNetMessageFree(msg);
+        return NULL;
+    }
 
-    if (virNetMessageEncodePayload(msg, proc, data) < 0)
-        goto cleanup;
+    return msg;
+}
 
-    VIR_DEBUG("Queue event %d %zu", procnr, msg->bufferLength);
-    if (virNetServerClientSendMessage(client, msg) < 0)
-        goto cleanup;
 
-    xdr_free(proc, data);
-    return;
+static void
+remoteDispatchObjectEventSendKey(virNetServerClientPtr client,
+                                 virNetServerProgramPtr program,
+                                 int procnr,
+                                 xdrproc_t proc,
+                                 void *data,
+                                 const char *key)
+{
+    virNetMessagePtr msg;
+
+    if ((msg = remoteDispatchObjectEventNew(program, procnr, proc, data))) {
+        VIR_DEBUG("Queue event %d %zu", procnr, msg->bufferLength);
+        if (virNetServerClientSendEvent(client, msg, key) < 0)
+            virNetMessageFree(msg);
+    }
 
- cleanup:
-    virNetMessageFree(msg);
     xdr_free(proc, data);
 }
 
+
+static void
+remoteDispatchObjectEventSend(virNetServerClientPtr client,
+                              virNetServerProgramPtr program,
+                              int procnr,
+                              xdrproc_t proc,
+                              void *data)
+{
+    remoteDispatchObjectEventSendKey(client, program, procnr, proc, data, NULL);
+}
+
+
+static virNetMessagePtr
+remoteClientEventsLost(virNetServerClientPtr client,
+                       unsigned long long lost,
+                       void *opaque G_GNUC_UNUSED)
+{
+    remote_connect_event_lost_msg data = { lost };
+
+    VIR_DEBUG("client=%p lost %llu events", client, lost);
+
+    return remoteDispatchObjectEventNew(remoteProgram,
+                                        REMOTE_PROC_CONNECT_EVENT_LOST,
+                                        (xdrproc_t)xdr_remote_connect_event_lost_msg,
+                                        &data);
+}
+
+
+/**
+ * remoteSetEventPolicy:
+ * @queueMax: maximum number of events queued for a client, 0 for no limit
+ * @coalesce: whether events superseded by newer ones may be dropped
+ *
+ * Sets the event delivery policy for client connections made from now on.
+ */
+void
+remoteSetEventPolicy(size_t queueMax,
+                     bool coalesce)
+{
+    remoteEventQueueMax = queueMax;
+    remoteEventCoalesce = coalesce;
+}
+
 static int
 remoteDispatchSecretGetValue(virNetServerPtr server G_GNUC_UNUSED,
                              virNetServerClientPtr client,
@@ -4408,6 +4780,74 @@ remoteDispatchSecretGetValue(virNetServerPtr server G_GNUC_UNUSED,
     return rv;
 }
 
+static int
+remoteDispatchConnectSecretGetValues(virNetServerPtr server G_GNUC_UNUSED,
+                                     virNetServerClientPtr client,
+                                     virNetMessagePtr msg G_GNUC_UNUSED,
+                                     virNetMessageErrorPtr rerr,
+                                     remote_connect_secret_get_values_args *args,
+                                     remote_connect_secret_get_values_ret *ret)
+{
+    virSecretValueLookupPtr lookups = NULL;
+    size_t nlookups = args->lookups.lookups_len;
+    size_t i;
+    int rv = -1;
+    virConnectPtr conn = remoteGetSecretConn(client);
+
+    if (!conn)
+        goto cleanup;
+
+    if (nlookups > REMOTE_SECRET_VALUES_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("too many secrets '%zu' for limit '%d'"),
+                       nlookups, REMOTE_SECRET_VALUES_MAX);
+        goto cleanup;
+    }
+
+    lookups = g_new0(virSecretValueLookup, nlookups);
+    for (i = 0; i < nlookups; i++) {
+        remote_secret_value_lookup *lookup = args->lookups.lookups_val + i;
+
+        lookups[i].def.type = lookup->type;
+        lookups[i].usageType = lookup->usageType;
+        if (lookup->type == VIR_SECRET_LOOKUP_TYPE_UUID) {
+            memcpy(lookups[i].def.u.uuid, lookup->uuid, VIR_UUID_BUFLEN);
+        } else if (lookup->type == VIR_SECRET_LOOKUP_TYPE_USAGE) {
+            if (!lookup->usageID) {
+                virReportError(VIR_ERR_INVALID_ARG, "%s",
+                               _("missing secret usage"));
+                goto cleanup;
+            }
+            lookups[i].def.u.usage = g_strdup(*lookup->usageID);
+        }
+    }
+
+    if (virConnectSecretGetValues(conn, lookups, nlookups, args->flags) < 0)
+        goto cleanup;
+
+    ret->values.values_val = g_new0(remote_secret_value, nlookups);
+    ret->values.values_len = nlookups;
+    for (i = 0; i < nlookups; i++) {
+        remote_secret_value *value = ret->values.values_val + i;
+
+        value->value.value_val = (char *) g_steal_pointer(&lookups[i].value);
+        value->value.value_len = lookups[i].value_size;
+        lookups[i].value_size = 0;
+    }
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    if (lookups) {
+        for (i = 0; i < nlookups; i++)
+            virSecretValueLookupClear(lookups + i);
+        VIR_FREE(lookups);
+    }
+    return rv;
+}
+
 static int
 remoteDispatchDomainGetState(virNetServerPtr server G_GNUC_UNUSED,
                              virNetServerClientPtr client,
@@ -4995,6 +5435,9 @@ static int remoteDispatchConnectSupportsFeature(virNetServerPtr server G_GNUC_UN
     case VIR_DRV_FEATURE_FD_PASSING:
     case VIR_DRV_FEATURE_REMOTE_EVENT_CALLBACK:
     case VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK:
+    case VIR_DRV_FEATURE_REMOTE_COMPACT_STATS:
+    case VIR_DRV_FEATURE_REMOTE_SECRET_GET_VALUES:
+    case VIR_DRV_FEATURE_REMOTE_TRACE_CONTEXT:
         supported = 1;
         break;
     case VIR_DRV_FEATURE_MIGRATION_V1:
@@ -6869,12 +7312,13 @@ remoteDispatchConnectGetAllDomainStats(virNetServerPtr server G_GNUC_UNUSED,
 
             make_nonnull_domain(&dst->dom, retStats[i]->dom);
 
-            if (virTypedParamsSerialize(retStats[i]->params,
-                                        retStats[i]->nparams,
-                                        REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX,
-                                        (virTypedParameterRemotePtr *) &dst->params.params_val,
-                                        &dst->params.params_len,
-                                        VIR_TYPED_PARAM_STRING_OKAY) < 0)
+            /* the records are freed right below, no need to copy strings */
+            if (virTypedParamsSerializeSteal(retStats[i]->params,
+                                             retStats[i]->nparams,
+                                             REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX,
+                                             (virTypedParameterRemotePtr *) &dst->params.params_val,
+                                             &dst->params.params_len,
+                                             VIR_TYPED_PARAM_STRING_OKAY) < 0)
                 goto cleanup;
         }
     } else {
@@ -6898,46 +7342,641 @@ remoteDispatchConnectGetAllDomainStats(virNetServerPtr server G_GNUC_UNUSED,
 }
 
 
+/* Encodes @record into @dst, adding names of its parameters which were not
+ * seen in any of the previous records into @fields. The string values are
+ * moved from @record. */
 static int
-remoteDispatchNodeAllocPages(virNetServerPtr server G_GNUC_UNUSED,
-                             virNetServerClientPtr client,
-                             virNetMessagePtr msg G_GNUC_UNUSED,
-                             virNetMessageErrorPtr rerr,
-                             remote_node_alloc_pages_args *args,
-                             remote_node_alloc_pages_ret *ret)
+remoteSerializeDomainStatsCompact(virDomainStatsRecordPtr record,
+                                  remote_domain_stats_compact_record *dst,
+                                  virHashTablePtr fieldIDs,
+                                  remote_connect_get_all_domain_stats_compact_ret *ret,
+                                  size_t *nfieldsAlloc)
 {
-    int rv = -1;
-    int len;
-    virConnectPtr conn = remoteGetHypervisorConn(client);
+    size_t i;
+    size_t j;
 
-    if (!conn)
-        goto cleanup;
+    if (record->nparams > REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("too many parameters '%d' for limit '%d'"),
+                       record->nparams, REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX);
+        return -1;
+    }
 
-    if ((len = virNodeAllocPages(conn,
-                                 args->pageSizes.pageSizes_len,
-                                 args->pageSizes.pageSizes_val,
-                                 (unsigned long long *) args->pageCounts.pageCounts_val,
-                                 args->startCell,
-                                 args->cellCount,
-                                 args->flags)) < 0)
-        goto cleanup;
+    make_nonnull_domain(&dst->dom, record->dom);
 
-    ret->ret = len;
-    rv = 0;
+    dst->params.params_val = g_new0(remote_domain_stats_compact_param,
+                                    record->nparams);
 
- cleanup:
-    if (rv < 0)
-        virNetMessageSaveError(rerr);
-    return rv;
-}
+    for (i = 0, j = 0; i < record->nparams; i++) {
+        virTypedParameterPtr param = record->params + i;
+        remote_domain_stats_compact_param *val = dst->params.params_val + j;
+        size_t id;
 
+        /* sparse arrays, see virTypedParamsSerialize */
+        if (!param->type)
+            continue;
 
-static int
-remoteDispatchDomainGetFSInfo(virNetServerPtr server G_GNUC_UNUSED,
-                              virNetServerClientPtr client,
-                              virNetMessagePtr msg G_GNUC_UNUSED,
-                              virNetMessageErrorPtr rerr,
-                              remote_domain_get_fsinfo_args *args,
+        /* IDs are stored incremented by one so that they can't be NULL */
+        if (!(id = GPOINTER_TO_SIZE(virHashLookup(fieldIDs, param->field)))) {
+            if (ret->fields.fields_len >= REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_FIELDS_MAX) {
+                virReportError(VIR_ERR_RPC,
+                               _("too many distinct parameters for limit '%d'"),
+                               REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_FIELDS_MAX);
+                return -1;
+            }
+
+            if (VIR_RESIZE_N(ret->fields.fields_val, *nfieldsAlloc,
+                             ret->fields.fields_len, 1) < 0)
+                return -1;
+
+            ret->fields.fields_val[ret->fields.fields_len] = g_strdup(param->field);
+            id = ++ret->fields.fields_len;
+
+            if (virHashAddEntry(fieldIDs, param->field, GSIZE_TO_POINTER(id)) < 0)
+                return -1;
+        }
+
+        val->field = id - 1;
+        if (virTypedParamSerializeValue(param,
+                                        (virTypedParameterRemoteValue *) &val->value,
+                                        true) < 0)
+            return -1;
+
+        dst->params.params_len = ++j;
+    }
+
+    return 0;
+}
+
+
+static int
+remoteDispatchConnectGetAllDomainStatsCompact(virNetServerPtr server G_GNUC_UNUSED,
+                                              virNetServerClientPtr client,
+                                              virNetMessagePtr msg G_GNUC_UNUSED,
+                                              virNetMessageErrorPtr rerr,
+                                              remote_connect_get_all_domain_stats_compact_args *args,
+                                              remote_connect_get_all_domain_stats_compact_ret *ret)
+{
+    int rv = -1;
+    size_t i;
+    virDomainStatsRecordPtr *retStats = NULL;
+    int nrecords = 0;
+    virDomainPtr *doms = NULL;
+    g_autoptr(virHashTable) fieldIDs = NULL;
+    size_t nfieldsAlloc = 0;
+    virConnectPtr conn = remoteGetHypervisorConn(client);
+
+    if (!conn)
+        goto cleanup;
+
+    if (args->doms.doms_len) {
+        doms = g_new0(virDomainPtr, args->doms.doms_len + 1);
+
+        for (i = 0; i < args->doms.doms_len; i++) {
+            if (!(doms[i] = get_nonnull_domain(conn, args->doms.doms_val[i])))
+                goto cleanup;
+        }
+
+        if ((nrecords = virDomainListGetStats(doms,
+                                              args->stats,
+                                              &retStats,
+                                              args->flags)) < 0)
+            goto cleanup;
+    } else {
+        if ((nrecords = virConnectGetAllDomainStats(conn,
+                                                    args->stats,
+                                                    &retStats,
+                                                    args->flags)) < 0)
+            goto cleanup;
+    }
+
+    if (nrecords > REMOTE_DOMAIN_LIST_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Number of domain stats records is %d, "
+                         "which exceeds max limit: %d"),
+                       nrecords, REMOTE_DOMAIN_LIST_MAX);
+        goto cleanup;
+    }
+
+    if (nrecords) {
+        if (!(fieldIDs = virHashNew(NULL)))
+            goto cleanup;
+
+        ret->retStats.retStats_val = g_new0(remote_domain_stats_compact_record,
+                                            nrecords);
+        ret->retStats.retStats_len = nrecords;
+
+        for (i = 0; i < nrecords; i++) {
+            if (remoteSerializeDomainStatsCompact(retStats[i],
+                                                  ret->retStats.retStats_val + i,
+                                                  fieldIDs, ret,
+                                                  &nfieldsAlloc) < 0)
+                goto cleanup;
+        }
+    }
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0) {
+        virNetMessageSaveError(rerr);
+        xdr_free((xdrproc_t)xdr_remote_connect_get_all_domain_stats_compact_ret,
+                 (char *) ret);
+    }
+
+    virDomainStatsRecordListFree(retStats);
+    virObjectListFree(doms);
+
+    return rv;
+}
+
+static int
+remoteDispatchConnectGetAllDomainXMLDesc(virNetServerPtr server G_GNUC_UNUSED,
+                                         virNetServerClientPtr client,
+                                         virNetMessagePtr msg G_GNUC_UNUSED,
+                                         virNetMessageErrorPtr rerr,
+                                         remote_connect_get_all_domain_xml_desc_args *args,
+                                         remote_connect_get_all_domain_xml_desc_ret *ret)
+{
+    int rv = -1;
+    size_t i;
+    virDomainXMLDescRecordPtr *retDescs = NULL;
+    int nrecords = 0;
+    virDomainPtr *doms = NULL;
+    virConnectPtr conn = remoteGetHypervisorConn(client);
+
+    if (!conn)
+        goto cleanup;
+
+    if (args->doms.doms_len) {
+        if (VIR_ALLOC_N(doms, args->doms.doms_len + 1) < 0)
+            goto cleanup;
+
+        for (i = 0; i < args->doms.doms_len; i++) {
+            if (!(doms[i] = get_nonnull_domain(conn, args->doms.doms_val[i])))
+                goto cleanup;
+        }
+
+        if ((nrecords = virDomainListGetXMLDesc(doms,
+                                                args->xmlflags,
+                                                &retDescs,
+                                                args->flags)) < 0)
+            goto cleanup;
+    } else {
+        if ((nrecords = virConnectGetAllDomainXMLDesc(conn,
+                                                      args->xmlflags,
+                                                      &retDescs,
+                                                      args->flags)) < 0)
+            goto cleanup;
+    }
+
+    if (nrecords > REMOTE_DOMAIN_LIST_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Number of domain XML records is %d, "
+                         "which exceeds max limit: %d"),
+                       nrecords, REMOTE_DOMAIN_LIST_MAX);
+        goto cleanup;
+    }
+
+    if (nrecords) {
+        if (VIR_ALLOC_N(ret->retDescs.retDescs_val, nrecords) < 0)
+            goto cleanup;
+
+        ret->retDescs.retDescs_len = nrecords;
+
+        for (i = 0; i < nrecords; i++) {
+            remote_domain_xml_desc_record *dst = ret->retDescs.retDescs_val + i;
+
+            make_nonnull_domain(&dst->dom, retDescs[i]->dom);
+            dst->xml = g_steal_pointer(&retDescs[i]->xml);
+        }
+    }
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0) {
+        virNetMessageSaveError(rerr);
+        xdr_free((xdrproc_t)xdr_remote_connect_get_all_domain_xml_desc_ret,
+                 (char *) ret);
+    }
+
+    virDomainXMLDescRecordListFree(retDescs);
+    virObjectListFree(doms);
+
+    return rv;
+}
+
+
+static int
+remoteDispatchDomainListFSFreeze(virNetServerPtr server G_GNUC_UNUSED,
+                                 virNetServerClientPtr client,
+                                 virNetMessagePtr msg G_GNUC_UNUSED,
+                                 virNetMessageErrorPtr rerr,
+                                 remote_domain_list_fsfreeze_args *args,
+                                 remote_domain_list_fsfreeze_ret *ret)
+{
+    int rv = -1;
+    size_t i;
+    virDomainFSFreezeRecordPtr *retResults = NULL;
+    int nrecords = 0;
+    virDomainPtr *doms = NULL;
+    virConnectPtr conn = remoteGetHypervisorConn(client);
+
+    if (!conn)
+        goto cleanup;
+
+    if (VIR_ALLOC_N(doms, args->doms.doms_len + 1) < 0)
+        goto cleanup;
+
+    for (i = 0; i < args->doms.doms_len; i++) {
+        if (!(doms[i] = get_nonnull_domain(conn, args->doms.doms_val[i])))
+            goto cleanup;
+    }
+
+    if ((nrecords = virDomainListFSFreeze(doms, args->timeout,
+                                          &retResults, args->flags)) < 0)
+        goto cleanup;
+
+    if (nrecords > REMOTE_DOMAIN_LIST_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Number of fsfreeze records is %d, "
+                         "which exceeds max limit: %d"),
+                       nrecords, REMOTE_DOMAIN_LIST_MAX);
+        goto cleanup;
+    }
+
+    if (nrecords) {
+        if (VIR_ALLOC_N(ret->retResults.retResults_val, nrecords) < 0)
+            goto cleanup;
+
+        ret->retResults.retResults_len = nrecords;
+
+        for (i = 0; i < nrecords; i++) {
+            remote_domain_fsfreeze_record *dst = ret->retResults.retResults_val + i;
+
+            make_nonnull_domain(&dst->dom, retResults[i]->dom);
+            dst->nfilesystems = retResults[i]->nfilesystems;
+            if (retResults[i]->error) {
+                dst->error = g_new0(char *, 1);
+                *dst->error = g_steal_pointer(&retResults[i]->error);
+            }
+        }
+    }
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0) {
+        virNetMessageSaveError(rerr);
+        xdr_free((xdrproc_t)xdr_remote_domain_list_fsfreeze_ret,
+                 (char *) ret);
+    }
+
+    virDomainFSFreezeRecordListFree(retResults);
+    virObjectListFree(doms);
+
+    return rv;
+}
+
+
+static int
+remoteDispatchDomainListFSThaw(virNetServerPtr server G_GNUC_UNUSED,
+                               virNetServerClientPtr client,
+                               virNetMessagePtr msg G_GNUC_UNUSED,
+                               virNetMessageErrorPtr rerr,
+                               remote_domain_list_fsthaw_args *args,
+                               remote_domain_list_fsthaw_ret *ret)
+{
+    int rv = -1;
+    size_t i;
+    virDomainFSFreezeRecordPtr *retResults = NULL;
+    int nrecords = 0;
+    virDomainPtr *doms = NULL;
+    virConnectPtr conn = remoteGetHypervisorConn(client);
+
+    if (!conn)
+        goto cleanup;
+
+    if (VIR_ALLOC_N(doms, args->doms.doms_len + 1) < 0)
+        goto cleanup;
+
+    for (i = 0; i < args->doms.doms_len; i++) {
+        if (!(doms[i] = get_nonnull_domain(conn, args->doms.doms_val[i])))
+            goto cleanup;
+    }
+
+    if ((nrecords = virDomainListFSThaw(doms, args->timeout,
+                                        &retResults, args->flags)) < 0)
+        goto cleanup;
+
+    if (nrecords > REMOTE_DOMAIN_LIST_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Number of fsfreeze records is %d, "
+                         "which exceeds max limit: %d"),
+                       nrecords, REMOTE_DOMAIN_LIST_MAX);
+        goto cleanup;
+    }
+
+    if (nrecords) {
+        if (VIR_ALLOC_N(ret->retResults.retResults_val, nrecords) < 0)
+            goto cleanup;
+
+        ret->retResults.retResults_len = nrecords;
+
+        for (i = 0; i < nrecords; i++) {
+            remote_domain_fsfreeze_record *dst = ret->retResults.retResults_val + i;
+
+            make_nonnull_domain(&dst->dom, retResults[i]->dom);
+            dst->nfilesystems = retResults[i]->nfilesystems;
+            if (retResults[i]->error) {
+                dst->error = g_new0(char *, 1);
+                *dst->error = g_steal_pointer(&retResults[i]->error);
+            }
+        }
+    }
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0) {
+        virNetMessageSaveError(rerr);
+        xdr_free((xdrproc_t)xdr_remote_domain_list_fsthaw_ret,
+                 (char *) ret);
+    }
+
+    virDomainFSFreezeRecordListFree(retResults);
+    virObjectListFree(doms);
+
+    return rv;
+}
+
+
+static int
+remoteDispatchDomainListStop(virNetServerPtr server G_GNUC_UNUSED,
+                             virNetServerClientPtr client,
+                             virNetMessagePtr msg G_GNUC_UNUSED,
+                             virNetMessageErrorPtr rerr,
+                             remote_domain_list_stop_args *args,
+                             remote_domain_list_stop_ret *ret)
+{
+    int rv = -1;
+    size_t i;
+    virDomainStopRecordPtr *retResults = NULL;
+    int nrecords = 0;
+    virDomainPtr *doms = NULL;
+    virConnectPtr conn = remoteGetHypervisorConn(client);
+
+    if (!conn)
+        goto cleanup;
+
+    if (VIR_ALLOC_N(doms, args->doms.doms_len + 1) < 0)
+        goto cleanup;
+
+    for (i = 0; i < args->doms.doms_len; i++) {
+        if (!(doms[i] = get_nonnull_domain(conn, args->doms.doms_val[i])))
+            goto cleanup;
+    }
+
+    if ((nrecords = virDomainListStop(doms, args->parallel, args->timeout,
+                                      &retResults, args->flags)) < 0)
+        goto cleanup;
+
+    if (nrecords > REMOTE_DOMAIN_LIST_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Number of stop records is %d, "
+                         "which exceeds max limit: %d"),
+                       nrecords, REMOTE_DOMAIN_LIST_MAX);
+        goto cleanup;
+    }
+
+    if (nrecords) {
+        if (VIR_ALLOC_N(ret->retResults.retResults_val, nrecords) < 0)
+            goto cleanup;
+
+        ret->retResults.retResults_len = nrecords;
+
+        for (i = 0; i < nrecords; i++) {
+            remote_domain_stop_record *dst = ret->retResults.retResults_val + i;
+
+            make_nonnull_domain(&dst->dom, retResults[i]->dom);
+            dst->result = retResults[i]->result;
+            if (retResults[i]->error) {
+                dst->error = g_new0(char *, 1);
+                *dst->error = g_steal_pointer(&retResults[i]->error);
+            }
+        }
+    }
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0) {
+        virNetMessageSaveError(rerr);
+        xdr_free((xdrproc_t)xdr_remote_domain_list_stop_ret,
+                 (char *) ret);
+    }
+
+    virDomainStopRecordListFree(retResults);
+    virObjectListFree(doms);
+
+    return rv;
+}
+
+
+static int
+remoteDispatchDomainListSnapshotCreateXML(virNetServerPtr server G_GNUC_UNUSED,
+                                          virNetServerClientPtr client,
+                                          virNetMessagePtr msg G_GNUC_UNUSED,
+                                          virNetMessageErrorPtr rerr,
+                                          remote_domain_list_snapshot_create_xml_args *args,
+                                          remote_domain_list_snapshot_create_xml_ret *ret)
+{
+    int rv = -1;
+    size_t i;
+    virDomainSnapshotPtr *snaps = NULL;
+    int nsnaps = 0;
+    virDomainPtr *doms = NULL;
+    virConnectPtr conn = remoteGetHypervisorConn(client);
+
+    if (!conn)
+        goto cleanup;
+
+    if (args->xmlDescs.xmlDescs_len != args->doms.doms_len) {
+        virReportError(VIR_ERR_RPC,
+                       _("Number of snapshot XMLs is %d, expected %d"),
+                       args->xmlDescs.xmlDescs_len, args->doms.doms_len);
+        goto cleanup;
+    }
+
+    if (VIR_ALLOC_N(doms, args->doms.doms_len + 1) < 0)
+        goto cleanup;
+
+    for (i = 0; i < args->doms.doms_len; i++) {
+        if (!(doms[i] = get_nonnull_domain(conn, args->doms.doms_val[i])))
+            goto cleanup;
+    }
+
+    if ((nsnaps = virDomainListSnapshotCreateXML(doms,
+                                                 (const char **) args->xmlDescs.xmlDescs_val,
+                                                 &snaps, args->flags)) < 0)
+        goto cleanup;
+
+    if (VIR_ALLOC_N(ret->snaps.snaps_val, nsnaps) < 0)
+        goto cleanup;
+
+    ret->snaps.snaps_len = nsnaps;
+
+    for (i = 0; i < nsnaps; i++)
+        make_nonnull_domain_snapshot(ret->snaps.snaps_val + i, snaps[i]);
+
+    ret->ret = nsnaps;
+    rv = 0;
+
+ cleanup:
+    if (rv < 0) {
+        virNetMessageSaveError(rerr);
+        xdr_free((xdrproc_t)xdr_remote_domain_list_snapshot_create_xml_ret,
+                 (char *) ret);
+    }
+
+    if (snaps) {
+        for (i = 0; i < nsnaps; i++)
+            virObjectUnref(snaps[i]);
+        VIR_FREE(snaps);
+    }
+    virObjectListFree(doms);
+
+    return rv;
+}
+
+
+static int
+remoteDispatchNodeAllocPages(virNetServerPtr server G_GNUC_UNUSED,
+                             virNetServerClientPtr client,
+                             virNetMessagePtr msg G_GNUC_UNUSED,
+                             virNetMessageErrorPtr rerr,
+                             remote_node_alloc_pages_args *args,
+                             remote_node_alloc_pages_ret *ret)
+{
+    int rv = -1;
+    int len;
+    virConnectPtr conn = remoteGetHypervisorConn(client);
+
+    if (!conn)
+        goto cleanup;
+
+    if ((len = virNodeAllocPages(conn,
+                                 args->pageSizes.pageSizes_len,
+                                 args->pageSizes.pageSizes_val,
+                                 (unsigned long long *) args->pageCounts.pageCounts_val,
+                                 args->startCell,
+                                 args->cellCount,
+                                 args->flags)) < 0)
+        goto cleanup;
+
+    ret->ret = len;
+    rv = 0;
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    return rv;
+}
+
+
+static int
+remoteDispatchNodeSetPagesLayout(virNetServerPtr server G_GNUC_UNUSED,
+                                 virNetServerClientPtr client,
+                                 virNetMessagePtr msg G_GNUC_UNUSED,
+                                 virNetMessageErrorPtr rerr,
+                                 remote_node_set_pages_layout_args *args,
+                                 remote_node_set_pages_layout_ret *ret)
+{
+    int rv = -1;
+    virConnectPtr conn = remoteGetHypervisorConn(client);
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    virTypedParameterPtr result = NULL;
+    int nresult = 0;
+
+    if (!conn)
+        goto cleanup;
+
+    if (virTypedParamsDeserialize((virTypedParameterRemotePtr) args->params.params_val,
+                                  args->params.params_len,
+                                  REMOTE_NODE_PAGES_LAYOUT_PARAMS_MAX,
+                                  &params,
+                                  &nparams) < 0)
+        goto cleanup;
+
+    if (virNodeSetPagesLayout(conn, params, nparams,
+                              args->need_results ? &result : NULL,
+                              args->need_results ? &nresult : NULL,
+                              args->flags) < 0)
+        goto cleanup;
+
+    if (result &&
+        virTypedParamsSerialize(result, nresult,
+                                REMOTE_NODE_PAGES_LAYOUT_PARAMS_MAX,
+                                (virTypedParameterRemotePtr *) &ret->result.result_val,
+                                &ret->result.result_len,
+                                0) < 0)
+        goto cleanup;
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    virTypedParamsFree(params, nparams);
+    virTypedParamsFree(result, nresult);
+    return rv;
+}
+
+
+static int
+remoteDispatchNodeGetAllCPUStats(virNetServerPtr server G_GNUC_UNUSED,
+                                 virNetServerClientPtr client,
+                                 virNetMessagePtr msg G_GNUC_UNUSED,
+                                 virNetMessageErrorPtr rerr,
+                                 remote_node_get_all_cpu_stats_args *args,
+                                 remote_node_get_all_cpu_stats_ret *ret)
+{
+    int rv = -1;
+    virConnectPtr conn = remoteGetHypervisorConn(client);
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+
+    if (!conn)
+        goto cleanup;
+
+    if (virNodeGetAllCPUStats(conn, &params, &nparams, args->flags) < 0)
+        goto cleanup;
+
+    if (virTypedParamsSerialize(params, nparams,
+                                REMOTE_NODE_ALL_CPU_STATS_PARAMS_MAX,
+                                (virTypedParameterRemotePtr *) &ret->params.params_val,
+                                &ret->params.params_len,
+                                VIR_TYPED_PARAM_STRING_OKAY) < 0)
+        goto cleanup;
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    virTypedParamsFree(params, nparams);
+    return rv;
+}
+
+
+static int
+remoteDispatchDomainGetFSInfo(virNetServerPtr server G_GNUC_UNUSED,
+                              virNetServerClientPtr client,
+                              virNetMessagePtr msg G_GNUC_UNUSED,
+                              virNetMessageErrorPtr rerr,
+                              remote_domain_get_fsinfo_args *args,
                               remote_domain_get_fsinfo_ret *ret)
 {
     int rv = -1;
@@ -7457,3 +8496,90 @@ remoteDispatchDomainGetGuestInfo(virNetServerPtr server G_GNUC_UNUSED,
 
     return rv;
 }
+
+
+static int
+remoteDispatchConnectSetCompression(virNetServerPtr server G_GNUC_UNUSED,
+                                    virNetServerClientPtr client,
+                                    virNetMessagePtr msg G_GNUC_UNUSED,
+                                    virNetMessageErrorPtr rerr,
+                                    remote_connect_set_compression_args *args)
+{
+    int rv = -1;
+    unsigned int flags = args->flags;
+
+    virCheckFlagsGoto(0, cleanup);
+
+    if (remoteMaxCompressionLevel == 0) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("compression is disabled by the daemon configuration"));
+        goto cleanup;
+    }
+
+    if (args->level < 1 || args->level > 9) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("invalid compression level %d"), args->level);
+        goto cleanup;
+    }
+
+    /* The level only affects the compressing side, so the client
+     * may use a higher one than the daemon is willing to spend
+     * CPU time on */
+    if (virNetServerClientSetCompression(client,
+                                         MIN(args->level,
+                                             remoteMaxCompressionLevel)) < 0)
+        goto cleanup;
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    return rv;
+}
+
+
+static int
+remoteDispatchConnectEnableChunkedReplies(virNetServerPtr server G_GNUC_UNUSED,
+                                          virNetServerClientPtr client,
+                                          virNetMessagePtr msg G_GNUC_UNUSED,
+                                          virNetMessageErrorPtr rerr,
+                                          remote_connect_enable_chunked_replies_args *args)
+{
+    int rv = -1;
+    unsigned int flags = args->flags;
+
+    virCheckFlagsGoto(0, cleanup);
+
+    virNetServerClientSetChunkedReplies(client, true);
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    return rv;
+}
+
+
+static int
+remoteDispatchConnectEnableEventBatches(virNetServerPtr server G_GNUC_UNUSED,
+                                        virNetServerClientPtr client,
+                                        virNetMessagePtr msg G_GNUC_UNUSED,
+                                        virNetMessageErrorPtr rerr,
+                                        remote_connect_enable_event_batches_args *args)
+{
+    int rv = -1;
+    unsigned int flags = args->flags;
+
+    virCheckFlagsGoto(0, cleanup);
+
+    virNetServerClientSetEventBatches(client, true);
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    return rv;
+}
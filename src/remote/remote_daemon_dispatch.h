@@ -37,3 +37,12 @@ extern size_t qemuNProcs;
 void remoteClientFree(void *data);
 void *remoteClientNew(virNetServerClientPtr client,
                       void *opaque);
+void remoteSetEventPolicy(size_t queueMax,
+                          bool coalesce);
+
+#ifdef VIRTPROXYD
+int remoteDispatchForward(virNetServerProgramPtr prog,
+                          virNetServerClientPtr client,
+                          virNetMessagePtr msg,
+                          void *opaque);
+#endif /* VIRTPROXYD */
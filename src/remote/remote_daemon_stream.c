@@ -850,9 +850,6 @@ daemonStreamHandleRead(virNetServerClientPtr client,
 
     memset(&rerr, 0, sizeof(rerr));
 
-    if (VIR_ALLOC_N(buffer, bufferLen) < 0)
-        return -1;
-
     if (!(msg = virNetMessageNew(false)))
         goto cleanup;
 
@@ -908,6 +905,14 @@ daemonStreamHandleRead(virNetServerClientPtr client,
         bufferLen > stream->dataLen)
         bufferLen = stream->dataLen;
 
+    /* Receive the data straight into the message payload */
+    if (!(buffer = virNetServerProgramPrepareStreamData(stream->prog,
+                                                        msg,
+                                                        stream->procedure,
+                                                        stream->serial,
+                                                        bufferLen)))
+        goto cleanup;
+
     rv = virStreamRecv(stream->st, buffer, bufferLen);
     if (rv == -2) {
         /* Should never get this, since we're only called when we know
@@ -932,12 +937,7 @@ daemonStreamHandleRead(virNetServerClientPtr client,
         msg->cb = daemonStreamMessageFinished;
         msg->opaque = stream;
         stream->refs++;
-        if (virNetServerProgramSendStreamData(stream->prog,
-                                              client,
-                                              msg,
-                                              stream->procedure,
-                                              stream->serial,
-                                              buffer, rv) < 0)
+        if (virNetServerProgramSendPreparedStreamData(client, msg, rv) < 0)
             goto cleanup;
         msg = NULL;
     }
@@ -945,7 +945,6 @@ daemonStreamHandleRead(virNetServerClientPtr client,
  done:
     ret = 0;
  cleanup:
-    VIR_FREE(buffer);
     virNetMessageFree(msg);
     return ret;
 }
@@ -42,7 +42,9 @@
 #include "qemu_protocol.h"
 #include "viralloc.h"
 #include "virfile.h"
+#include "virhash.h"
 #include "vircommand.h"
+#include "virreplycache.h"
 #include "virtypedparam.h"
 #include "viruri.h"
 #include "virauth.h"
@@ -115,6 +117,9 @@ VIR_ENUM_IMPL(remoteDriverMode,
 
 static bool inside_daemon;
 
+typedef struct _remoteSharedConn remoteSharedConn;
+typedef remoteSharedConn *remoteSharedConnPtr;
+
 struct private_data {
     virMutex lock;
 
@@ -134,11 +139,43 @@ struct private_data {
     bool serverKeepAlive;       /* Does server support keepalive protocol? */
     bool serverEventFilter;     /* Does server support modern event filtering */
     bool serverCloseCallback;   /* Does server support driver close callback */
+    bool serverCompactStats;    /* Does server support compact bulk stats */
+    bool serverSecretGetValues; /* Does server support bulk secret fetch */
 
     virObjectEventStatePtr eventState;
     virConnectCloseCallbackDataPtr closeCallback;
+
+    /* Replies of APIs returning data which rarely changes, such as
+     * capabilities, are cached for cacheTTL seconds if it is non-zero */
+    unsigned int cacheTTL;
+    virReplyCachePtr cache;
+
+    /* non-NULL if other connections may share this one */
+    remoteSharedConnPtr shared;
+};
+
+/*
+ * Connections opened with share=1 in their URI use the channel of an
+ * open connection to the same URI, if there is one, instead of opening
+ * their own. The connection which opened the channel is the owner, its
+ * virConnect is used to deliver events, so it is kept alive as long as
+ * any other connection uses the channel.
+ */
+struct _remoteSharedConn {
+    char *key;
+    virConnectPtr owner;
+    size_t nusers; /* connections other than owner */
 };
 
+/* Maps keys built from URIs to remoteSharedConnPtr, entries are owned
+ * by private data of the connections */
+static virHashTablePtr remoteSharedConns;
+static virMutex remoteSharedConnsLock = VIR_MUTEX_INITIALIZER;
+
+/* Domain capabilities are cached per combination of arguments, so
+ * bound the number of cached replies */
+#define REMOTE_CACHE_MAX_ENTRIES 32
+
 enum {
     REMOTE_CALL_QEMU              = (1 << 0),
     REMOTE_CALL_LXC               = (1 << 1),
@@ -155,6 +192,59 @@ static void remoteDriverUnlock(struct private_data *driver)
     virMutexUnlock(&driver->lock);
 }
 
+
+/*
+ * Returns a copy of the reply cached under @key or NULL if there is
+ * none or it expired. Must be called with the driver lock held.
+ */
+static char *
+remoteCacheLookup(struct private_data *priv,
+                  const char *key)
+{
+    if (!priv->cache)
+        return NULL;
+
+    return virReplyCacheLookup(priv->cache, key);
+}
+
+
+/*
+ * Caches a copy of @value under @key if caching is enabled. Must be
+ * called with the driver lock held.
+ */
+static void
+remoteCacheStore(struct private_data *priv,
+                 const char *key,
+                 const char *value)
+{
+    if (!priv->cache)
+        return;
+
+    virReplyCacheStore(priv->cache, key, value);
+}
+
+
+/*
+ * Drops the cached replies after a successful call of @proc_nr if it
+ * changes what they report. Must be called with the driver lock held.
+ */
+static void
+remoteCacheInvalidate(struct private_data *priv,
+                      int proc_nr)
+{
+    if (!priv->cache)
+        return;
+
+    switch (proc_nr) {
+    case REMOTE_PROC_NODE_ALLOC_PAGES:
+        /* the capabilities report the huge pages of NUMA cells */
+    case REMOTE_PROC_CONNECT_SET_IDENTITY:
+        /* the replies were authorized for the previous identity */
+        virReplyCacheInvalidate(priv->cache);
+        break;
+    }
+}
+
 static int call(virConnectPtr conn, struct private_data *priv,
                 unsigned int flags, int proc_nr,
                 xdrproc_t args_filter, char *args,
@@ -443,6 +533,11 @@ remoteStoragePoolBuildEventRefresh(virNetClientProgramPtr prog G_GNUC_UNUSED,
                                    virNetClientPtr client G_GNUC_UNUSED,
                                    void *evdata, void *opaque);
 
+static void
+remoteStoragePoolBuildEventThreshold(virNetClientProgramPtr prog G_GNUC_UNUSED,
+                                     virNetClientPtr client G_GNUC_UNUSED,
+                                     void *evdata, void *opaque);
+
 static void
 remoteNodeDeviceBuildEventLifecycle(virNetClientProgramPtr prog G_GNUC_UNUSED,
                                     virNetClientPtr client G_GNUC_UNUSED,
@@ -468,11 +563,21 @@ remoteDomainBuildEventBlockThreshold(virNetClientProgramPtr prog,
                                      virNetClientPtr client,
                                      void *evdata, void *opaque);
 
+static void
+remoteDomainBuildEventCallbackMonitorSlow(virNetClientProgramPtr prog,
+                                          virNetClientPtr client,
+                                          void *evdata, void *opaque);
+
 static void
 remoteConnectNotifyEventConnectionClosed(virNetClientProgramPtr prog G_GNUC_UNUSED,
                                          virNetClientPtr client G_GNUC_UNUSED,
                                          void *evdata, void *opaque);
 
+static void
+remoteConnectNotifyEventLost(virNetClientProgramPtr prog G_GNUC_UNUSED,
+                             virNetClientPtr client G_GNUC_UNUSED,
+                             void *evdata, void *opaque);
+
 static virNetClientProgramEvent remoteEvents[] = {
     { REMOTE_PROC_DOMAIN_EVENT_LIFECYCLE,
       remoteDomainBuildEventLifecycle,
@@ -659,6 +764,10 @@ static virNetClientProgramEvent remoteEvents[] = {
       remoteStoragePoolBuildEventRefresh,
       sizeof(remote_storage_pool_event_refresh_msg),
       (xdrproc_t)xdr_remote_storage_pool_event_refresh_msg },
+    { REMOTE_PROC_STORAGE_POOL_EVENT_THRESHOLD,
+      remoteStoragePoolBuildEventThreshold,
+      sizeof(remote_storage_pool_event_threshold_msg),
+      (xdrproc_t)xdr_remote_storage_pool_event_threshold_msg },
     { REMOTE_PROC_NODE_DEVICE_EVENT_LIFECYCLE,
       remoteNodeDeviceBuildEventLifecycle,
       sizeof(remote_node_device_event_lifecycle_msg),
@@ -679,6 +788,14 @@ static virNetClientProgramEvent remoteEvents[] = {
       remoteDomainBuildEventBlockThreshold,
       sizeof(remote_domain_event_block_threshold_msg),
       (xdrproc_t)xdr_remote_domain_event_block_threshold_msg },
+    { REMOTE_PROC_DOMAIN_EVENT_CALLBACK_MONITOR_SLOW,
+      remoteDomainBuildEventCallbackMonitorSlow,
+      sizeof(remote_domain_event_callback_monitor_slow_msg),
+      (xdrproc_t)xdr_remote_domain_event_callback_monitor_slow_msg },
+    { REMOTE_PROC_CONNECT_EVENT_LOST,
+      remoteConnectNotifyEventLost,
+      sizeof(remote_connect_event_lost_msg),
+      (xdrproc_t)xdr_remote_connect_event_lost_msg },
 };
 
 static void
@@ -693,6 +810,21 @@ remoteConnectNotifyEventConnectionClosed(virNetClientProgramPtr prog G_GNUC_UNUS
     virConnectCloseCallbackDataCall(priv->closeCallback, msg->reason);
 }
 
+static void
+remoteConnectNotifyEventLost(virNetClientProgramPtr prog G_GNUC_UNUSED,
+                             virNetClientPtr client G_GNUC_UNUSED,
+                             void *evdata, void *opaque)
+{
+    virConnectPtr conn = opaque;
+    remote_connect_event_lost_msg *msg = evdata;
+
+    /* There's no way to tell which callbacks missed what, so all
+     * we can do is let the user know events were lost */
+    VIR_WARN("Server dropped %llu events for connection %p because "
+             "they were not read quickly enough",
+             (unsigned long long)msg->count, conn);
+}
+
 static void
 remoteDomainBuildQemuMonitorEvent(virNetClientProgramPtr prog G_GNUC_UNUSED,
                                   virNetClientPtr client G_GNUC_UNUSED,
@@ -951,12 +1083,15 @@ doRemoteOpen(virConnectPtr conn,
     g_autofree char *knownHosts = NULL;
     g_autofree char *mode_str = NULL;
     g_autofree char *daemon_name = NULL;
+    g_autofree char *compress = NULL;
+    g_autofree char *cache_ttl = NULL;
     bool sanity = true;
     bool verify = true;
 #ifndef WIN32
     bool tty = true;
 #endif
     int mode;
+    int compressLevel = 0;
 
     if (inside_daemon && !conn->uri->server) {
         mode = REMOTE_DRIVER_MODE_DIRECT;
@@ -1031,6 +1166,13 @@ doRemoteOpen(virConnectPtr conn,
             EXTRACT_URI_ARG_STR("known_hosts_verify", knownHostsVerify);
             EXTRACT_URI_ARG_STR("tls_priority", tls_priority);
             EXTRACT_URI_ARG_STR("mode", mode_str);
+            EXTRACT_URI_ARG_STR("compress", compress);
+            EXTRACT_URI_ARG_STR("cache_ttl", cache_ttl);
+            if (STRCASEEQ(var->name, "share")) {
+                /* handled by remoteConnectOpen */
+                var->ignore = 1;
+                continue;
+            }
             EXTRACT_URI_ARG_BOOL("no_sanity", sanity);
             EXTRACT_URI_ARG_BOOL("no_verify", verify);
 #ifndef WIN32
@@ -1083,6 +1225,24 @@ doRemoteOpen(virConnectPtr conn,
         (mode = remoteDriverModeTypeFromString(mode_str)) < 0)
         goto failed;
 
+    if (compress &&
+        (virStrToLong_i(compress, NULL, 10, &compressLevel) < 0 ||
+         compressLevel < 0 || compressLevel > 9)) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("invalid compression level '%s'"), compress);
+        goto failed;
+    }
+
+    if (cache_ttl &&
+        virStrToLong_ui(cache_ttl, NULL, 10, &priv->cacheTTL) < 0) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("invalid cache TTL '%s'"), cache_ttl);
+        goto failed;
+    }
+
+    if (priv->cacheTTL > 0)
+        priv->cache = virReplyCacheNew(priv->cacheTTL, REMOTE_CACHE_MAX_ENTRIES);
+
     /* Sanity check that nothing requested !direct mode by mistake */
     if (inside_daemon && !conn->uri->server && mode != REMOTE_DRIVER_MODE_DIRECT) {
         virReportError(VIR_ERR_INVALID_ARG, "%s",
@@ -1318,6 +1478,54 @@ doRemoteOpen(virConnectPtr conn,
         }
     }
 
+    /* Compression is an optimization only, if the daemon is too old
+     * or refuses to compress, carry on without it */
+    if (compressLevel > 0) {
+        remote_connect_set_compression_args args = { compressLevel, 0 };
+
+        VIR_DEBUG("Trying to enable compression level %d", compressLevel);
+        if (call(conn, priv, 0, REMOTE_PROC_CONNECT_SET_COMPRESSION,
+                 (xdrproc_t) xdr_remote_connect_set_compression_args, (char *) &args,
+                 (xdrproc_t) xdr_void, (char *) NULL) == -1) {
+            VIR_WARN("Unable to enable compression: %s",
+                     virGetLastErrorMessage());
+            virResetLastError();
+        } else if (virNetClientSetCompression(priv->client, compressLevel) < 0) {
+            goto failed;
+        }
+    }
+
+    /* Let the daemon send replies larger than a single message in
+     * several parts. Older daemons don't know how to, so their
+     * replies stay limited. */
+    {
+        remote_connect_enable_chunked_replies_args args = { 0 };
+
+        VIR_DEBUG("Trying to enable chunked replies");
+        if (call(conn, priv, 0, REMOTE_PROC_CONNECT_ENABLE_CHUNKED_REPLIES,
+                 (xdrproc_t) xdr_remote_connect_enable_chunked_replies_args, (char *) &args,
+                 (xdrproc_t) xdr_void, (char *) NULL) == -1) {
+            VIR_DEBUG("Chunked replies not supported: %s",
+                      virGetLastErrorMessage());
+            virResetLastError();
+        }
+    }
+
+    /* Let the daemon join events piling up for us into a single
+     * message, which virNetClient unpacks again */
+    {
+        remote_connect_enable_event_batches_args args = { 0 };
+
+        VIR_DEBUG("Trying to enable event batches");
+        if (call(conn, priv, 0, REMOTE_PROC_CONNECT_ENABLE_EVENT_BATCHES,
+                 (xdrproc_t) xdr_remote_connect_enable_event_batches_args, (char *) &args,
+                 (xdrproc_t) xdr_void, (char *) NULL) == -1) {
+            VIR_DEBUG("Event batches not supported: %s",
+                      virGetLastErrorMessage());
+            virResetLastError();
+        }
+    }
+
     /* Finally we can call the remote side's open function. */
     {
         remote_connect_open_args args = { &name, flags };
@@ -1366,6 +1574,16 @@ doRemoteOpen(virConnectPtr conn,
                  "by the remote side.");
     }
 
+    priv->serverCompactStats = remoteConnectSupportsFeatureUnlocked(conn,
+                                    priv, VIR_DRV_FEATURE_REMOTE_COMPACT_STATS);
+
+    priv->serverSecretGetValues = remoteConnectSupportsFeatureUnlocked(conn,
+                                    priv, VIR_DRV_FEATURE_REMOTE_SECRET_GET_VALUES);
+
+    if (remoteConnectSupportsFeatureUnlocked(conn, priv,
+                                             VIR_DRV_FEATURE_REMOTE_TRACE_CONTEXT))
+        virNetClientSetTraceContext(priv->client, true);
+
     return VIR_DRV_OPEN_SUCCESS;
 
  failed:
@@ -1379,6 +1597,8 @@ doRemoteOpen(virConnectPtr conn,
     priv->closeCallback = NULL;
     virObjectUnref(priv->tls);
     priv->tls = NULL;
+    virReplyCacheFree(priv->cache);
+    priv->cache = NULL;
 
     VIR_FREE(priv->hostname);
     return VIR_DRV_OPEN_ERROR;
@@ -1405,6 +1625,101 @@ remoteAllocPrivateData(void)
     return priv;
 }
 
+static char *
+remoteSharedConnKey(virConnectPtr conn,
+                    unsigned int flags)
+{
+    g_autofree char *uri = NULL;
+    size_t i;
+
+    if (!conn->uri)
+        return NULL;
+
+    for (i = 0; i < conn->uri->paramsCount; i++) {
+        virURIParamPtr var = &conn->uri->params[i];
+
+        if (STRCASEEQ(var->name, "share") && STREQ(var->value, "1"))
+            break;
+    }
+
+    if (i == conn->uri->paramsCount)
+        return NULL;
+
+    if (!(uri = virURIFormat(conn->uri)))
+        return NULL;
+
+    return g_strdup_printf("%s %u", uri, flags & VIR_CONNECT_RO);
+}
+
+
+/*
+ * Looks up an open connection to share. On success, the private data of
+ * the connection is returned locked. Must be called with
+ * remoteSharedConnsLock held.
+ */
+static struct private_data *
+remoteSharedConnAcquire(const char *key)
+{
+    remoteSharedConnPtr shared;
+    struct private_data *priv;
+
+    if (!remoteSharedConns ||
+        !(shared = virHashLookup(remoteSharedConns, key)))
+        return NULL;
+
+    priv = shared->owner->privateData;
+    remoteDriverLock(priv);
+
+    if (!priv->client || !virNetClientIsOpen(priv->client)) {
+        remoteDriverUnlock(priv);
+        return NULL;
+    }
+
+    priv->localUses++;
+    if (shared->nusers++ == 0)
+        virObjectRef(shared->owner);
+
+    VIR_DEBUG("Sharing connection %p, users=%zu", shared->owner, shared->nusers);
+    return priv;
+}
+
+
+/*
+ * Offers the connection @conn to others with the same @key. Must be
+ * called with remoteSharedConnsLock held and the private data of @conn
+ * locked.
+ */
+static void
+remoteSharedConnAdd(virConnectPtr conn,
+                    struct private_data *priv,
+                    const char *key)
+{
+    remoteSharedConnPtr shared;
+
+    if (!remoteSharedConns &&
+        !(remoteSharedConns = virHashNew(NULL)))
+        goto error;
+
+    shared = g_new0(remoteSharedConn, 1);
+    shared->key = g_strdup(key);
+    shared->owner = conn;
+
+    /* a dead connection to the same URI might still be in the table */
+    if (virHashUpdateEntry(remoteSharedConns, key, shared) < 0) {
+        g_free(shared->key);
+        g_free(shared);
+        goto error;
+    }
+
+    priv->shared = shared;
+    return;
+
+ error:
+    VIR_WARN("Unable to share connection: %s", virGetLastErrorMessage());
+    virResetLastError();
+}
+
+
 static virDrvOpenStatus
 remoteConnectOpen(virConnectPtr conn,
                   virConnectAuthPtr auth,
@@ -1417,6 +1732,7 @@ remoteConnectOpen(virConnectPtr conn,
     const char *autostart = getenv("LIBVIRT_AUTOSTART");
     char *driver = NULL;
     char *transport = NULL;
+    g_autofree char *sharekey = NULL;
 
     if (conn->uri &&
         remoteSplitURIScheme(conn->uri, &driver, &transport) < 0)
@@ -1438,6 +1754,18 @@ remoteConnectOpen(virConnectPtr conn,
         }
     }
 
+    if ((sharekey = remoteSharedConnKey(conn, flags))) {
+        virMutexLock(&remoteSharedConnsLock);
+        if ((priv = remoteSharedConnAcquire(sharekey))) {
+            conn->privateData = priv;
+            remoteDriverUnlock(priv);
+            virMutexUnlock(&remoteSharedConnsLock);
+            ret = VIR_DRV_OPEN_SUCCESS;
+            goto cleanup;
+        }
+        virMutexUnlock(&remoteSharedConnsLock);
+    }
+
     if (!(priv = remoteAllocPrivateData()))
         goto cleanup;
 
@@ -1497,6 +1825,14 @@ remoteConnectOpen(virConnectPtr conn,
         VIR_FREE(priv);
     } else {
         conn->privateData = priv;
+        if (sharekey) {
+            /* keep the lock order of remoteConnectClose */
+            remoteDriverUnlock(priv);
+            virMutexLock(&remoteSharedConnsLock);
+            remoteDriverLock(priv);
+            remoteSharedConnAdd(conn, priv, sharekey);
+            virMutexUnlock(&remoteSharedConnsLock);
+        }
         remoteDriverUnlock(priv);
     }
 
@@ -1543,6 +1879,9 @@ doRemoteClose(virConnectPtr conn, struct private_data *priv)
     /* See comment for remoteType. */
     VIR_FREE(priv->type);
 
+    virReplyCacheFree(priv->cache);
+    priv->cache = NULL;
+
     virObjectUnref(priv->eventState);
     priv->eventState = NULL;
 
@@ -1554,10 +1893,26 @@ remoteConnectClose(virConnectPtr conn)
 {
     int ret = 0;
     struct private_data *priv = conn->privateData;
+    remoteSharedConnPtr shared;
+    virConnectPtr owner = NULL;
 
+    virMutexLock(&remoteSharedConnsLock);
     remoteDriverLock(priv);
+
+    shared = priv->shared;
+    if (shared && conn != shared->owner && --shared->nusers == 0)
+        owner = shared->owner;
+
     priv->localUses--;
     if (!priv->localUses) {
+        if (shared) {
+            if (virHashLookup(remoteSharedConns, shared->key) == shared)
+                virHashRemoveEntry(remoteSharedConns, shared->key);
+            g_free(shared->key);
+            g_free(shared);
+            priv->shared = NULL;
+        }
+
         ret = doRemoteClose(conn, priv);
         conn->privateData = NULL;
         remoteDriverUnlock(priv);
@@ -1566,6 +1921,11 @@ remoteConnectClose(virConnectPtr conn)
     }
     if (priv)
         remoteDriverUnlock(priv);
+    virMutexUnlock(&remoteSharedConnsLock);
+
+    /* the last user of a shared connection releases its owner, which
+     * closes the channel if it was closed by the application already */
+    virObjectUnref(owner);
 
     return ret;
 }
@@ -1608,6 +1968,145 @@ remoteConnectGetType(virConnectPtr conn)
     return rv;
 }
 
+
+/* The following APIs return data which changes only when the
+ * hypervisor is upgraded or reconfigured. Their replies can be cached,
+ * see remoteCacheLookup, so that applications calling them over and
+ * over don't make the daemon generate the same XML again and again. */
+static int
+remoteConnectGetVersion(virConnectPtr conn,
+                        unsigned long *hvVer)
+{
+    int rv = -1;
+    remote_connect_get_version_ret ret;
+    struct private_data *priv = conn->privateData;
+    g_autofree char *cached = NULL;
+
+    remoteDriverLock(priv);
+
+    if ((cached = remoteCacheLookup(priv, "version")) &&
+        virStrToLong_ul(cached, NULL, 10, hvVer) == 0) {
+        rv = 0;
+        goto done;
+    }
+
+    memset(&ret, 0, sizeof(ret));
+    if (call(conn, priv, 0, REMOTE_PROC_CONNECT_GET_VERSION,
+             (xdrproc_t) xdr_void, (char *) NULL,
+             (xdrproc_t) xdr_remote_connect_get_version_ret, (char *) &ret) == -1)
+        goto done;
+
+    HYPER_TO_ULONG(*hvVer, ret.hv_ver);
+
+    VIR_FREE(cached);
+    cached = g_strdup_printf("%lu", *hvVer);
+    remoteCacheStore(priv, "version", cached);
+    rv = 0;
+
+ done:
+    remoteDriverUnlock(priv);
+    return rv;
+}
+
+
+static char *
+remoteConnectGetHostname(virConnectPtr conn)
+{
+    char *rv = NULL;
+    remote_connect_get_hostname_ret ret;
+    struct private_data *priv = conn->privateData;
+
+    remoteDriverLock(priv);
+
+    if ((rv = remoteCacheLookup(priv, "hostname")))
+        goto done;
+
+    memset(&ret, 0, sizeof(ret));
+    if (call(conn, priv, 0, REMOTE_PROC_CONNECT_GET_HOSTNAME,
+             (xdrproc_t) xdr_void, (char *) NULL,
+             (xdrproc_t) xdr_remote_connect_get_hostname_ret, (char *) &ret) == -1)
+        goto done;
+
+    rv = ret.hostname;
+    remoteCacheStore(priv, "hostname", rv);
+
+ done:
+    remoteDriverUnlock(priv);
+    return rv;
+}
+
+
+static char *
+remoteConnectGetCapabilities(virConnectPtr conn)
+{
+    char *rv = NULL;
+    remote_connect_get_capabilities_ret ret;
+    struct private_data *priv = conn->privateData;
+
+    remoteDriverLock(priv);
+
+    if ((rv = remoteCacheLookup(priv, "capabilities")))
+        goto done;
+
+    memset(&ret, 0, sizeof(ret));
+    if (call(conn, priv, 0, REMOTE_PROC_CONNECT_GET_CAPABILITIES,
+             (xdrproc_t) xdr_void, (char *) NULL,
+             (xdrproc_t) xdr_remote_connect_get_capabilities_ret, (char *) &ret) == -1)
+        goto done;
+
+    rv = ret.capabilities;
+    remoteCacheStore(priv, "capabilities", rv);
+
+ done:
+    remoteDriverUnlock(priv);
+    return rv;
+}
+
+
+static char *
+remoteConnectGetDomainCapabilities(virConnectPtr conn,
+                                   const char *emulatorbin,
+                                   const char *arch,
+                                   const char *machine,
+                                   const char *virttype,
+                                   unsigned int flags)
+{
+    char *rv = NULL;
+    remote_connect_get_domain_capabilities_args args;
+    remote_connect_get_domain_capabilities_ret ret;
+    struct private_data *priv = conn->privateData;
+    g_autofree char *key = NULL;
+
+    remoteDriverLock(priv);
+
+    key = g_strdup_printf("domcaps\n%s\n%s\n%s\n%s\n%u",
+                          NULLSTR_EMPTY(emulatorbin), NULLSTR_EMPTY(arch),
+                          NULLSTR_EMPTY(machine), NULLSTR_EMPTY(virttype),
+                          flags);
+
+    if ((rv = remoteCacheLookup(priv, key)))
+        goto done;
+
+    args.emulatorbin = emulatorbin ? (char **)&emulatorbin : NULL;
+    args.arch = arch ? (char **)&arch : NULL;
+    args.machine = machine ? (char **)&machine : NULL;
+    args.virttype = virttype ? (char **)&virttype : NULL;
+    args.flags = flags;
+
+    memset(&ret, 0, sizeof(ret));
+    if (call(conn, priv, 0, REMOTE_PROC_CONNECT_GET_DOMAIN_CAPABILITIES,
+             (xdrproc_t) xdr_remote_connect_get_domain_capabilities_args, (char *) &args,
+             (xdrproc_t) xdr_remote_connect_get_domain_capabilities_ret, (char *) &ret) == -1)
+        goto done;
+
+    rv = ret.capabilities;
+    remoteCacheStore(priv, key, rv);
+
+ done:
+    remoteDriverUnlock(priv);
+    return rv;
+}
+
 static int remoteConnectIsSecure(virConnectPtr conn)
 {
     int rv = -1;
@@ -5518,23 +6017,46 @@ remoteStoragePoolBuildEventRefresh(virNetClientProgramPtr prog G_GNUC_UNUSED,
 }
 
 static void
-remoteNodeDeviceBuildEventLifecycle(virNetClientProgramPtr prog G_GNUC_UNUSED,
-                                    virNetClientPtr client G_GNUC_UNUSED,
-                                    void *evdata, void *opaque)
+remoteStoragePoolBuildEventThreshold(virNetClientProgramPtr prog G_GNUC_UNUSED,
+                                     virNetClientPtr client G_GNUC_UNUSED,
+                                     void *evdata, void *opaque)
 {
     virConnectPtr conn = opaque;
     struct private_data *priv = conn->privateData;
-    remote_node_device_event_lifecycle_msg *msg = evdata;
-    virNodeDevicePtr dev;
+    remote_storage_pool_event_threshold_msg *msg = evdata;
+    virStoragePoolPtr pool;
     virObjectEventPtr event = NULL;
 
-    dev = get_nonnull_node_device(conn, msg->dev);
-    if (!dev)
+    pool = get_nonnull_storage_pool(conn, msg->pool);
+    if (!pool)
         return;
 
-    event = virNodeDeviceEventLifecycleNew(dev->name, msg->event,
-                                           msg->detail);
-    virObjectUnref(dev);
+    event = virStoragePoolEventThresholdNew(pool->name, pool->uuid,
+                                            msg->volume ? *msg->volume : NULL,
+                                            msg->threshold, msg->excess);
+    virObjectUnref(pool);
+
+    virObjectEventStateQueueRemote(priv->eventState, event, msg->callbackID);
+}
+
+static void
+remoteNodeDeviceBuildEventLifecycle(virNetClientProgramPtr prog G_GNUC_UNUSED,
+                                    virNetClientPtr client G_GNUC_UNUSED,
+                                    void *evdata, void *opaque)
+{
+    virConnectPtr conn = opaque;
+    struct private_data *priv = conn->privateData;
+    remote_node_device_event_lifecycle_msg *msg = evdata;
+    virNodeDevicePtr dev;
+    virObjectEventPtr event = NULL;
+
+    dev = get_nonnull_node_device(conn, msg->dev);
+    if (!dev)
+        return;
+
+    event = virNodeDeviceEventLifecycleNew(dev->name, msg->event,
+                                           msg->detail);
+    virObjectUnref(dev);
 
     virObjectEventStateQueueRemote(priv->eventState, event, msg->callbackID);
 }
@@ -5663,6 +6185,94 @@ remoteSecretGetValue(virSecretPtr secret, size_t *value_size,
 }
 
 
+static int
+remoteConnectSecretGetValues(virConnectPtr conn,
+                             virSecretValueLookupPtr lookups,
+                             size_t nlookups,
+                             unsigned int flags,
+                             unsigned int internalFlags G_GNUC_UNUSED)
+{
+    int rv = -1;
+    size_t i;
+    remote_connect_secret_get_values_args args;
+    remote_connect_secret_get_values_ret ret;
+    struct private_data *priv = conn->privateData;
+
+    remoteDriverLock(priv);
+
+    memset(&args, 0, sizeof(args));
+    memset(&ret, 0, sizeof(ret));
+
+    if (!priv->serverSecretGetValues) {
+        virReportError(VIR_ERR_NO_SUPPORT, "%s",
+                       _("fetching several secrets at once is not supported "
+                         "by the remote side"));
+        goto done;
+    }
+
+    if (nlookups > REMOTE_SECRET_VALUES_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("too many secrets '%zu' for limit '%d'"),
+                       nlookups, REMOTE_SECRET_VALUES_MAX);
+        goto done;
+    }
+
+    /* internalFlags intentionally do not go over the wire, the remote side
+     * refuses to reveal private secrets on its own */
+    args.lookups.lookups_val = g_new0(remote_secret_value_lookup, nlookups);
+    args.lookups.lookups_len = nlookups;
+    for (i = 0; i < nlookups; i++) {
+        remote_secret_value_lookup *lookup = args.lookups.lookups_val + i;
+
+        lookup->type = lookups[i].def.type;
+        lookup->usageType = lookups[i].usageType;
+        if (lookups[i].def.type == VIR_SECRET_LOOKUP_TYPE_UUID) {
+            memcpy(lookup->uuid, lookups[i].def.u.uuid, VIR_UUID_BUFLEN);
+        } else if (lookups[i].def.type == VIR_SECRET_LOOKUP_TYPE_USAGE) {
+            lookup->usageID = g_new0(char *, 1);
+            *lookup->usageID = g_strdup(lookups[i].def.u.usage);
+        }
+    }
+    args.flags = flags;
+
+    if (call(conn, priv, 0, REMOTE_PROC_CONNECT_SECRET_GET_VALUES,
+             (xdrproc_t) xdr_remote_connect_secret_get_values_args, (char *) &args,
+             (xdrproc_t) xdr_remote_connect_secret_get_values_ret, (char *) &ret) == -1)
+        goto done;
+
+    if (ret.values.values_len != nlookups) {
+        virReportError(VIR_ERR_RPC,
+                       _("expected %zu secret values, got %u"),
+                       nlookups, ret.values.values_len);
+        goto cleanup;
+    }
+
+    for (i = 0; i < nlookups; i++) {
+        remote_secret_value *value = ret.values.values_val + i;
+
+        lookups[i].value = (uint8_t *) g_steal_pointer(&value->value.value_val);
+        lookups[i].value_size = value->value.value_len;
+        value->value.value_len = 0;
+    }
+
+    rv = 0;
+
+ cleanup:
+    for (i = 0; i < ret.values.values_len; i++) {
+        remote_secret_value *value = ret.values.values_val + i;
+
+        if (value->value.value_val)
+            memset(value->value.value_val, 0, value->value.value_len);
+    }
+    xdr_free((xdrproc_t) xdr_remote_connect_secret_get_values_ret, (char *) &ret);
+
+ done:
+    xdr_free((xdrproc_t) xdr_remote_connect_secret_get_values_args, (char *) &args);
+    remoteDriverUnlock(priv);
+    return rv;
+}
+
+
 static void
 remoteDomainBuildEventBlockThreshold(virNetClientProgramPtr prog G_GNUC_UNUSED,
                                      virNetClientPtr client G_GNUC_UNUSED,
@@ -5687,6 +6297,29 @@ remoteDomainBuildEventBlockThreshold(virNetClientProgramPtr prog G_GNUC_UNUSED,
 }
 
 
+static void
+remoteDomainBuildEventCallbackMonitorSlow(virNetClientProgramPtr prog G_GNUC_UNUSED,
+                                          virNetClientPtr client G_GNUC_UNUSED,
+                                          void *evdata, void *opaque)
+{
+    virConnectPtr conn = opaque;
+    remote_domain_event_callback_monitor_slow_msg *msg = evdata;
+    struct private_data *priv = conn->privateData;
+    virDomainPtr dom;
+    virObjectEventPtr event = NULL;
+
+    if (!(dom = get_nonnull_domain(conn, msg->dom)))
+        return;
+
+    event = virDomainEventMonitorSlowNewFromDom(dom, msg->command,
+                                                msg->elapsed);
+
+    virObjectUnref(dom);
+
+    virObjectEventStateQueueRemote(priv->eventState, event, msg->callbackID);
+}
+
+
 static int
 remoteStreamSend(virStreamPtr st,
                  const char *data,
@@ -6762,6 +7395,9 @@ callFull(virConnectPtr conn G_GNUC_UNUSED,
     remoteDriverLock(priv);
     priv->localUses--;
 
+    if (rv == 0 && prog == priv->remoteProgram)
+        remoteCacheInvalidate(priv, proc_nr);
+
     return rv;
 }
 
@@ -7711,6 +8347,136 @@ remoteNetworkGetDHCPLeases(virNetworkPtr net,
 }
 
 
+static int
+remoteDeserializeDomainStatsCompact(virConnectPtr conn,
+                                    remote_domain_stats_compact_record *rec,
+                                    char **fields,
+                                    unsigned int nfields,
+                                    virDomainStatsRecordPtr *elem)
+{
+    virDomainStatsRecordPtr tmp;
+    virDomainPtr dom;
+    size_t i;
+
+    if (rec->params.params_len > REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("too many parameters '%u' for limit '%d'"),
+                       rec->params.params_len,
+                       REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX);
+        return -1;
+    }
+
+    if (!(dom = get_nonnull_domain(conn, rec->dom)))
+        return -1;
+
+    /* Filled in place so that the caller frees partially decoded record
+     * along with the rest of the list. */
+    *elem = tmp = g_new0(virDomainStatsRecord, 1);
+    tmp->dom = dom;
+    tmp->params = g_new0(virTypedParameter, rec->params.params_len);
+
+    for (i = 0; i < rec->params.params_len; i++) {
+        remote_domain_stats_compact_param *val = rec->params.params_val + i;
+        virTypedParameterPtr param = tmp->params + i;
+
+        if (val->field >= nfields) {
+            virReportError(VIR_ERR_RPC,
+                           _("unknown parameter name id '%u'"), val->field);
+            return -1;
+        }
+
+        if (virStrcpyStatic(param->field, fields[val->field]) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("parameter %s too big for destination"),
+                           fields[val->field]);
+            return -1;
+        }
+
+        if (virTypedParamDeserializeValue((virTypedParameterRemoteValue *) &val->value,
+                                          param) < 0)
+            return -1;
+
+        tmp->nparams++;
+    }
+
+    return 0;
+}
+
+
+/* Same as remoteConnectGetAllDomainStats, except that names of the stats
+ * are transferred only once per call rather than once per domain. */
+static int
+remoteConnectGetAllDomainStatsCompact(virConnectPtr conn,
+                                      virDomainPtr *doms,
+                                      unsigned int ndoms,
+                                      unsigned int stats,
+                                      virDomainStatsRecordPtr **retStats,
+                                      unsigned int flags)
+{
+    struct private_data *priv = conn->privateData;
+    int rv = -1;
+    size_t i;
+    remote_connect_get_all_domain_stats_compact_args args;
+    remote_connect_get_all_domain_stats_compact_ret ret;
+    virDomainStatsRecordPtr *tmpret = NULL;
+
+    memset(&args, 0, sizeof(args));
+
+    if (ndoms) {
+        args.doms.doms_val = g_new0(remote_nonnull_domain, ndoms);
+
+        for (i = 0; i < ndoms; i++)
+            make_nonnull_domain(args.doms.doms_val + i, doms[i]);
+    }
+    args.doms.doms_len = ndoms;
+
+    args.stats = stats;
+    args.flags = flags;
+
+    memset(&ret, 0, sizeof(ret));
+
+    remoteDriverLock(priv);
+    if (call(conn, priv, 0, REMOTE_PROC_CONNECT_GET_ALL_DOMAIN_STATS_COMPACT,
+             (xdrproc_t)xdr_remote_connect_get_all_domain_stats_compact_args, (char *)&args,
+             (xdrproc_t)xdr_remote_connect_get_all_domain_stats_compact_ret, (char *)&ret) == -1) {
+        remoteDriverUnlock(priv);
+        goto cleanup;
+    }
+    remoteDriverUnlock(priv);
+
+    if (ret.retStats.retStats_len > REMOTE_DOMAIN_LIST_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Number of stats entries is %d, which exceeds max limit: %d"),
+                       ret.retStats.retStats_len, REMOTE_DOMAIN_LIST_MAX);
+        goto cleanup;
+    }
+
+    *retStats = NULL;
+
+    tmpret = g_new0(virDomainStatsRecordPtr, ret.retStats.retStats_len + 1);
+
+    for (i = 0; i < ret.retStats.retStats_len; i++) {
+        if (remoteDeserializeDomainStatsCompact(conn,
+                                                ret.retStats.retStats_val + i,
+                                                ret.fields.fields_val,
+                                                ret.fields.fields_len,
+                                                tmpret + i) < 0)
+            goto cleanup;
+    }
+
+    *retStats = g_steal_pointer(&tmpret);
+    rv = ret.retStats.retStats_len;
+
+ cleanup:
+    virDomainStatsRecordListFree(tmpret);
+    VIR_FREE(args.doms.doms_val);
+    xdr_free((xdrproc_t)xdr_remote_connect_get_all_domain_stats_compact_ret,
+             (char *) &ret);
+
+    return rv;
+}
+
+
 static int
 remoteConnectGetAllDomainStats(virConnectPtr conn,
                                virDomainPtr *doms,
@@ -7727,6 +8493,10 @@ remoteConnectGetAllDomainStats(virConnectPtr conn,
     virDomainStatsRecordPtr elem = NULL;
     virDomainStatsRecordPtr *tmpret = NULL;
 
+    if (priv->serverCompactStats)
+        return remoteConnectGetAllDomainStatsCompact(conn, doms, ndoms, stats,
+                                                     retStats, flags);
+
     memset(&args, 0, sizeof(args));
 
     if (ndoms) {
@@ -7802,6 +8572,405 @@ remoteConnectGetAllDomainStats(virConnectPtr conn,
 }
 
 
+static int
+remoteConnectGetAllDomainXMLDesc(virConnectPtr conn,
+                                 virDomainPtr *doms,
+                                 unsigned int ndoms,
+                                 unsigned int xmlflags,
+                                 virDomainXMLDescRecordPtr **retDescs,
+                                 unsigned int flags)
+{
+    struct private_data *priv = conn->privateData;
+    int rv = -1;
+    size_t i;
+    remote_connect_get_all_domain_xml_desc_args args;
+    remote_connect_get_all_domain_xml_desc_ret ret;
+    virDomainXMLDescRecordPtr elem = NULL;
+    virDomainXMLDescRecordPtr *tmpret = NULL;
+
+    memset(&args, 0, sizeof(args));
+
+    if (ndoms) {
+        if (VIR_ALLOC_N(args.doms.doms_val, ndoms) < 0)
+            goto cleanup;
+
+        for (i = 0; i < ndoms; i++)
+            make_nonnull_domain(args.doms.doms_val + i, doms[i]);
+    }
+    args.doms.doms_len = ndoms;
+
+    args.xmlflags = xmlflags;
+    args.flags = flags;
+
+    memset(&ret, 0, sizeof(ret));
+
+    remoteDriverLock(priv);
+    if (call(conn, priv, 0, REMOTE_PROC_CONNECT_GET_ALL_DOMAIN_XML_DESC,
+             (xdrproc_t)xdr_remote_connect_get_all_domain_xml_desc_args, (char *)&args,
+             (xdrproc_t)xdr_remote_connect_get_all_domain_xml_desc_ret, (char *)&ret) == -1) {
+        remoteDriverUnlock(priv);
+        goto cleanup;
+    }
+    remoteDriverUnlock(priv);
+
+    if (ret.retDescs.retDescs_len > REMOTE_DOMAIN_LIST_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Number of XML entries is %d, which exceeds max limit: %d"),
+                       ret.retDescs.retDescs_len, REMOTE_DOMAIN_LIST_MAX);
+        goto cleanup;
+    }
+
+    *retDescs = NULL;
+
+    if (VIR_ALLOC_N(tmpret, ret.retDescs.retDescs_len + 1) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ret.retDescs.retDescs_len; i++) {
+        remote_domain_xml_desc_record *rec = ret.retDescs.retDescs_val + i;
+
+        if (VIR_ALLOC(elem) < 0)
+            goto cleanup;
+
+        if (!(elem->dom = get_nonnull_domain(conn, rec->dom)))
+            goto cleanup;
+
+        /* steal the string from the reply */
+        elem->xml = rec->xml;
+        rec->xml = NULL;
+
+        tmpret[i] = elem;
+        elem = NULL;
+    }
+
+    *retDescs = tmpret;
+    tmpret = NULL;
+    rv = ret.retDescs.retDescs_len;
+
+ cleanup:
+    if (elem) {
+        virObjectUnref(elem->dom);
+        VIR_FREE(elem);
+    }
+    virDomainXMLDescRecordListFree(tmpret);
+    VIR_FREE(args.doms.doms_val);
+    xdr_free((xdrproc_t)xdr_remote_connect_get_all_domain_xml_desc_ret,
+             (char *) &ret);
+
+    return rv;
+}
+
+
+static int
+remoteDomainFSFreezeRecordsDecode(virConnectPtr conn,
+                                  remote_domain_fsfreeze_record *recs,
+                                  unsigned int nrecs,
+                                  virDomainFSFreezeRecordPtr **retResults)
+{
+    virDomainFSFreezeRecordPtr elem = NULL;
+    virDomainFSFreezeRecordPtr *tmpret = NULL;
+    size_t i;
+    int rv = -1;
+
+    if (nrecs > REMOTE_DOMAIN_LIST_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Number of fsfreeze records is %d, which exceeds max limit: %d"),
+                       nrecs, REMOTE_DOMAIN_LIST_MAX);
+        goto cleanup;
+    }
+
+    if (VIR_ALLOC_N(tmpret, nrecs + 1) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nrecs; i++) {
+        remote_domain_fsfreeze_record *rec = recs + i;
+
+        if (VIR_ALLOC(elem) < 0)
+            goto cleanup;
+
+        if (!(elem->dom = get_nonnull_domain(conn, rec->dom)))
+            goto cleanup;
+
+        elem->nfilesystems = rec->nfilesystems;
+        /* steal the string from the reply */
+        if (rec->error)
+            elem->error = g_steal_pointer(rec->error);
+
+        tmpret[i] = g_steal_pointer(&elem);
+    }
+
+    *retResults = g_steal_pointer(&tmpret);
+    rv = nrecs;
+
+ cleanup:
+    if (elem) {
+        virObjectUnref(elem->dom);
+        VIR_FREE(elem);
+    }
+    virDomainFSFreezeRecordListFree(tmpret);
+    return rv;
+}
+
+
+static int
+remoteDomainListFSFreeze(virConnectPtr conn,
+                         virDomainPtr *doms,
+                         unsigned int ndoms,
+                         int timeout,
+                         virDomainFSFreezeRecordPtr **retResults,
+                         unsigned int flags)
+{
+    struct private_data *priv = conn->privateData;
+    int rv = -1;
+    size_t i;
+    remote_domain_list_fsfreeze_args args;
+    remote_domain_list_fsfreeze_ret ret;
+
+    memset(&args, 0, sizeof(args));
+    memset(&ret, 0, sizeof(ret));
+
+    if (VIR_ALLOC_N(args.doms.doms_val, ndoms) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ndoms; i++)
+        make_nonnull_domain(args.doms.doms_val + i, doms[i]);
+    args.doms.doms_len = ndoms;
+
+    args.timeout = timeout;
+    args.flags = flags;
+
+    remoteDriverLock(priv);
+    if (call(conn, priv, 0, REMOTE_PROC_DOMAIN_LIST_FSFREEZE,
+             (xdrproc_t)xdr_remote_domain_list_fsfreeze_args, (char *)&args,
+             (xdrproc_t)xdr_remote_domain_list_fsfreeze_ret, (char *)&ret) == -1) {
+        remoteDriverUnlock(priv);
+        goto cleanup;
+    }
+    remoteDriverUnlock(priv);
+
+    rv = remoteDomainFSFreezeRecordsDecode(conn,
+                                           ret.retResults.retResults_val,
+                                           ret.retResults.retResults_len,
+                                           retResults);
+
+ cleanup:
+    VIR_FREE(args.doms.doms_val);
+    xdr_free((xdrproc_t)xdr_remote_domain_list_fsfreeze_ret,
+             (char *) &ret);
+
+    return rv;
+}
+
+
+static int
+remoteDomainListFSThaw(virConnectPtr conn,
+                       virDomainPtr *doms,
+                       unsigned int ndoms,
+                       int timeout,
+                       virDomainFSFreezeRecordPtr **retResults,
+                       unsigned int flags)
+{
+    struct private_data *priv = conn->privateData;
+    int rv = -1;
+    size_t i;
+    remote_domain_list_fsthaw_args args;
+    remote_domain_list_fsthaw_ret ret;
+
+    memset(&args, 0, sizeof(args));
+    memset(&ret, 0, sizeof(ret));
+
+    if (VIR_ALLOC_N(args.doms.doms_val, ndoms) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ndoms; i++)
+        make_nonnull_domain(args.doms.doms_val + i, doms[i]);
+    args.doms.doms_len = ndoms;
+
+    args.timeout = timeout;
+    args.flags = flags;
+
+    remoteDriverLock(priv);
+    if (call(conn, priv, 0, REMOTE_PROC_DOMAIN_LIST_FSTHAW,
+             (xdrproc_t)xdr_remote_domain_list_fsthaw_args, (char *)&args,
+             (xdrproc_t)xdr_remote_domain_list_fsthaw_ret, (char *)&ret) == -1) {
+        remoteDriverUnlock(priv);
+        goto cleanup;
+    }
+    remoteDriverUnlock(priv);
+
+    rv = remoteDomainFSFreezeRecordsDecode(conn,
+                                           ret.retResults.retResults_val,
+                                           ret.retResults.retResults_len,
+                                           retResults);
+
+ cleanup:
+    VIR_FREE(args.doms.doms_val);
+    xdr_free((xdrproc_t)xdr_remote_domain_list_fsthaw_ret,
+             (char *) &ret);
+
+    return rv;
+}
+
+
+static int
+remoteDomainListStop(virConnectPtr conn,
+                     virDomainPtr *doms,
+                     unsigned int ndoms,
+                     unsigned int parallel,
+                     int timeout,
+                     virDomainStopRecordPtr **retResults,
+                     unsigned int flags)
+{
+    struct private_data *priv = conn->privateData;
+    virDomainStopRecordPtr elem = NULL;
+    virDomainStopRecordPtr *tmpret = NULL;
+    int rv = -1;
+    size_t i;
+    remote_domain_list_stop_args args;
+    remote_domain_list_stop_ret ret;
+
+    memset(&args, 0, sizeof(args));
+    memset(&ret, 0, sizeof(ret));
+
+    if (VIR_ALLOC_N(args.doms.doms_val, ndoms) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ndoms; i++)
+        make_nonnull_domain(args.doms.doms_val + i, doms[i]);
+    args.doms.doms_len = ndoms;
+
+    args.parallel = parallel;
+    args.timeout = timeout;
+    args.flags = flags;
+
+    remoteDriverLock(priv);
+    if (call(conn, priv, 0, REMOTE_PROC_DOMAIN_LIST_STOP,
+             (xdrproc_t)xdr_remote_domain_list_stop_args, (char *)&args,
+             (xdrproc_t)xdr_remote_domain_list_stop_ret, (char *)&ret) == -1) {
+        remoteDriverUnlock(priv);
+        goto cleanup;
+    }
+    remoteDriverUnlock(priv);
+
+    if (ret.retResults.retResults_len > REMOTE_DOMAIN_LIST_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Number of stop records is %d, which exceeds max limit: %d"),
+                       ret.retResults.retResults_len, REMOTE_DOMAIN_LIST_MAX);
+        goto cleanup;
+    }
+
+    if (VIR_ALLOC_N(tmpret, ret.retResults.retResults_len + 1) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ret.retResults.retResults_len; i++) {
+        remote_domain_stop_record *rec = ret.retResults.retResults_val + i;
+
+        if (VIR_ALLOC(elem) < 0)
+            goto cleanup;
+
+        if (!(elem->dom = get_nonnull_domain(conn, rec->dom)))
+            goto cleanup;
+
+        elem->result = rec->result;
+        /* steal the string from the reply */
+        if (rec->error)
+            elem->error = g_steal_pointer(rec->error);
+
+        tmpret[i] = g_steal_pointer(&elem);
+    }
+
+    *retResults = g_steal_pointer(&tmpret);
+    rv = ret.retResults.retResults_len;
+
+ cleanup:
+    if (elem) {
+        virObjectUnref(elem->dom);
+        VIR_FREE(elem);
+    }
+    virDomainStopRecordListFree(tmpret);
+    VIR_FREE(args.doms.doms_val);
+    xdr_free((xdrproc_t)xdr_remote_domain_list_stop_ret,
+             (char *) &ret);
+
+    return rv;
+}
+
+
+static int
+remoteDomainListSnapshotCreateXML(virConnectPtr conn,
+                                  virDomainPtr *doms,
+                                  unsigned int ndoms,
+                                  const char **xmlDescs,
+                                  virDomainSnapshotPtr **snaps,
+                                  unsigned int flags)
+{
+    struct private_data *priv = conn->privateData;
+    int rv = -1;
+    size_t i;
+    virDomainSnapshotPtr *tmpsnaps = NULL;
+    remote_domain_list_snapshot_create_xml_args args;
+    remote_domain_list_snapshot_create_xml_ret ret;
+
+    memset(&args, 0, sizeof(args));
+    memset(&ret, 0, sizeof(ret));
+
+    if (ndoms > REMOTE_DOMAIN_LIST_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("Number of domains is %d, which exceeds max limit: %d"),
+                       ndoms, REMOTE_DOMAIN_LIST_MAX);
+        return -1;
+    }
+
+    if (VIR_ALLOC_N(args.doms.doms_val, ndoms) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ndoms; i++)
+        make_nonnull_domain(args.doms.doms_val + i, doms[i]);
+    args.doms.doms_len = ndoms;
+
+    args.xmlDescs.xmlDescs_val = (char **) xmlDescs;
+    args.xmlDescs.xmlDescs_len = ndoms;
+    args.flags = flags;
+
+    remoteDriverLock(priv);
+    if (call(conn, priv, 0, REMOTE_PROC_DOMAIN_LIST_SNAPSHOT_CREATE_XML,
+             (xdrproc_t)xdr_remote_domain_list_snapshot_create_xml_args, (char *)&args,
+             (xdrproc_t)xdr_remote_domain_list_snapshot_create_xml_ret, (char *)&ret) == -1) {
+        remoteDriverUnlock(priv);
+        goto cleanup;
+    }
+    remoteDriverUnlock(priv);
+
+    if (ret.snaps.snaps_len != ndoms) {
+        virReportError(VIR_ERR_RPC,
+                       _("Number of snapshots is %d, expected %d"),
+                       ret.snaps.snaps_len, ndoms);
+        goto cleanup;
+    }
+
+    tmpsnaps = g_new0(virDomainSnapshotPtr, ndoms + 1);
+    for (i = 0; i < ndoms; i++) {
+        if (!(tmpsnaps[i] = get_nonnull_domain_snapshot(doms[i],
+                                                        ret.snaps.snaps_val[i])))
+            goto cleanup;
+    }
+
+    *snaps = g_steal_pointer(&tmpsnaps);
+    rv = ret.ret;
+
+ cleanup:
+    if (tmpsnaps) {
+        for (i = 0; i < ndoms; i++)
+            virObjectUnref(tmpsnaps[i]);
+        VIR_FREE(tmpsnaps);
+    }
+    VIR_FREE(args.doms.doms_val);
+    xdr_free((xdrproc_t)xdr_remote_domain_list_snapshot_create_xml_ret,
+             (char *) &ret);
+
+    return rv;
+}
+
+
 static int
 remoteNodeAllocPages(virConnectPtr conn,
                      unsigned int npages,
@@ -7847,6 +9016,105 @@ remoteNodeAllocPages(virConnectPtr conn,
 }
 
 
+static int
+remoteNodeSetPagesLayout(virConnectPtr conn,
+                         virTypedParameterPtr params,
+                         int nparams,
+                         virTypedParameterPtr *result,
+                         int *nresult,
+                         unsigned int flags)
+{
+    int rv = -1;
+    remote_node_set_pages_layout_args args;
+    remote_node_set_pages_layout_ret ret;
+    struct private_data *priv = conn->privateData;
+
+    remoteDriverLock(priv);
+
+    memset(&args, 0, sizeof(args));
+    memset(&ret, 0, sizeof(ret));
+
+    if (virTypedParamsSerialize(params, nparams,
+                                REMOTE_NODE_PAGES_LAYOUT_PARAMS_MAX,
+                                (virTypedParameterRemotePtr *) &args.params.params_val,
+                                &args.params.params_len,
+                                0) < 0) {
+        xdr_free((xdrproc_t) xdr_remote_node_set_pages_layout_args,
+                 (char *) &args);
+        goto done;
+    }
+
+    args.need_results = !!result;
+    args.flags = flags;
+
+    if (call(conn, priv, 0, REMOTE_PROC_NODE_SET_PAGES_LAYOUT,
+             (xdrproc_t) xdr_remote_node_set_pages_layout_args, (char *) &args,
+             (xdrproc_t) xdr_remote_node_set_pages_layout_ret, (char *) &ret) == -1)
+        goto done;
+
+    if (result &&
+        virTypedParamsDeserialize((virTypedParameterRemotePtr) ret.result.result_val,
+                                  ret.result.result_len,
+                                  REMOTE_NODE_PAGES_LAYOUT_PARAMS_MAX,
+                                  result,
+                                  nresult) < 0)
+        goto cleanup;
+
+    rv = 0;
+
+ cleanup:
+    xdr_free((xdrproc_t) xdr_remote_node_set_pages_layout_ret,
+             (char *) &ret);
+
+ done:
+    virTypedParamsRemoteFree((virTypedParameterRemotePtr) args.params.params_val,
+                             args.params.params_len);
+    remoteDriverUnlock(priv);
+    return rv;
+}
+
+
+static int
+remoteNodeGetAllCPUStats(virConnectPtr conn,
+                         virTypedParameterPtr *params,
+                         int *nparams,
+                         unsigned int flags)
+{
+    int rv = -1;
+    remote_node_get_all_cpu_stats_args args;
+    remote_node_get_all_cpu_stats_ret ret;
+    struct private_data *priv = conn->privateData;
+
+    remoteDriverLock(priv);
+
+    args.flags = flags;
+
+    memset(&ret, 0, sizeof(ret));
+
+    if (call(conn, priv, 0, REMOTE_PROC_NODE_GET_ALL_CPU_STATS,
+             (xdrproc_t) xdr_remote_node_get_all_cpu_stats_args, (char *) &args,
+             (xdrproc_t) xdr_remote_node_get_all_cpu_stats_ret, (char *) &ret) == -1)
+        goto done;
+
+    if (virTypedParamsDeserialize((virTypedParameterRemotePtr) ret.params.params_val,
+                                  ret.params.params_len,
+                                  REMOTE_NODE_ALL_CPU_STATS_PARAMS_MAX,
+                                  params,
+                                  nparams) < 0)
+        goto cleanup;
+
+    rv = 0;
+
+ cleanup:
+    xdr_free((xdrproc_t) xdr_remote_node_get_all_cpu_stats_ret,
+             (char *) &ret);
+
+ done:
+    remoteDriverUnlock(priv);
+    return rv;
+}
+
+
 static int
 remoteDomainGetFSInfo(virDomainPtr dom,
                       virDomainFSInfoPtr **info,
@@ -8684,6 +9952,16 @@ static virHypervisorDriver hypervisor_driver = {
     .domainAgentSetResponseTimeout = remoteDomainAgentSetResponseTimeout, /* 5.10.0 */
     .domainBackupBegin = remoteDomainBackupBegin, /* 6.0.0 */
     .domainBackupGetXMLDesc = remoteDomainBackupGetXMLDesc, /* 6.0.0 */
+    .connectGetAllDomainXMLDesc = remoteConnectGetAllDomainXMLDesc, /* 6.8.0 */
+    .domainStartDirtyRateCalc = remoteDomainStartDirtyRateCalc, /* 6.8.0 */
+    .nodeSetPagesLayout = remoteNodeSetPagesLayout, /* 6.8.0 */
+    .nodeGetAllCPUStats = remoteNodeGetAllCPUStats, /* 6.8.0 */
+    .domainAttachDevices = remoteDomainAttachDevices, /* 6.8.0 */
+    .domainListFSFreeze = remoteDomainListFSFreeze, /* 6.8.0 */
+    .domainListFSThaw = remoteDomainListFSThaw, /* 6.8.0 */
+    .domainListSnapshotCreateXML = remoteDomainListSnapshotCreateXML, /* 6.8.0 */
+    .domainListStop = remoteDomainListStop, /* 6.8.0 */
+    .domainCoreDumpStream = remoteDomainCoreDumpStream, /* 6.8.0 */
 };
 
 static virNetworkDriver network_driver = {
@@ -8784,6 +10062,8 @@ static virStorageDriver storage_driver = {
     .storageVolResize = remoteStorageVolResize, /* 0.9.10 */
     .storagePoolIsActive = remoteStoragePoolIsActive, /* 0.7.3 */
     .storagePoolIsPersistent = remoteStoragePoolIsPersistent, /* 0.7.3 */
+    .storageVolGetJobInfo = remoteStorageVolGetJobInfo, /* 6.8.0 */
+    .storageVolAbortJob = remoteStorageVolAbortJob, /* 6.8.0 */
 };
 
 static virSecretDriver secret_driver = {
@@ -8799,6 +10079,7 @@ static virSecretDriver secret_driver = {
     .secretUndefine = remoteSecretUndefine, /* 0.7.1 */
     .connectSecretEventDeregisterAny = remoteConnectSecretEventDeregisterAny, /* 3.0.0 */
     .connectSecretEventRegisterAny = remoteConnectSecretEventRegisterAny, /* 3.0.0 */
+    .connectSecretGetValues = remoteConnectSecretGetValues, /* 6.8.0 */
 };
 
 static virNodeDeviceDriver node_device_driver = {
@@ -8849,6 +10130,60 @@ static virStateDriver state_driver = {
 };
 
 
+/**
+ * remoteConnectForwardCall:
+ * @conn: connection to forward the call over
+ * @call: call of the remote program received from a client of the daemon
+ * @func: callback invoked with the reply
+ * @opaque: data for @func
+ *
+ * Sends @call to the daemon @conn is connected to without decoding it.
+ * Only its serial number is changed. Once the reply arrives, @func is
+ * called with it as described for virNetClientSendAsync, the reply's
+ * payload is left as the daemon encoded it.
+ *
+ * Returns 0 if the call was sent, 1 if @conn is not a connection of the
+ * remote driver and -1 on error.
+ */
+int
+remoteConnectForwardCall(virConnectPtr conn,
+                         virNetMessagePtr call,
+                         virNetClientCallFunc func,
+                         void *opaque)
+{
+    struct private_data *priv = conn->privateData;
+    virNetMessagePtr msg = NULL;
+    virNetClientPtr client;
+
+    if (conn->driver != &hypervisor_driver)
+        return 1;
+
+    if (!(msg = virNetMessageNew(false)))
+        return -1;
+
+    msg->header = call->header;
+    msg->header.type = VIR_NET_CALL;
+    msg->header.status = VIR_NET_OK;
+
+    remoteDriverLock(priv);
+    msg->header.serial = priv->counter++;
+    client = virObjectRef(priv->client);
+    remoteDriverUnlock(priv);
+
+    if (virNetMessageEncodeHeader(msg) < 0 ||
+        virNetMessageEncodePayloadRaw(msg, call->buffer + call->bufferOffset,
+                                      call->bufferLength - call->bufferOffset) < 0 ||
+        virNetClientSendAsync(client, msg, func, opaque) < 0) {
+        virNetMessageFree(msg);
+        virObjectUnref(client);
+        return -1;
+    }
+
+    virObjectUnref(client);
+    return 0;
+}
+
+
 /** remoteRegister:
  *
  * Register driver with libvirt driver system.
@@ -23,9 +23,15 @@
 
 #include "internal.h"
 #include "configmake.h"
+#include "virnetclient.h"
 
 int remoteRegister (void);
 
+int remoteConnectForwardCall(virConnectPtr conn,
+                             virNetMessagePtr call,
+                             virNetClientCallFunc func,
+                             void *opaque);
+
 unsigned long remoteVersion(void);
 
 #define LIBVIRTD_LISTEN_ADDR NULL
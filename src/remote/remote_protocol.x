@@ -191,6 +191,11 @@ const REMOTE_SECRET_VALUE_MAX = 65536;
  */
 const REMOTE_SECRET_LIST_MAX = 16384;
 
+/*
+ * Upper limit on number of secrets fetched at once.
+ */
+const REMOTE_SECRET_VALUES_MAX = 1024;
+
 /*
  * Upper limit on list of CPUs accepted when computing a baseline CPU.
  */
@@ -245,6 +250,10 @@ const REMOTE_NETWORK_DHCP_LEASES_MAX = 65536;
 /* Upper limit on count of parameters returned via bulk stats API */
 const REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX = 262144;
 
+/* Upper limit on count of distinct parameter names in a compact reply
+ * of the bulk stats API */
+const REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_FIELDS_MAX = 262144;
+
 /* Upper limit of message size for tunable event. */
 const REMOTE_DOMAIN_EVENT_TUNABLE_MAX = 2048;
 
@@ -275,6 +284,16 @@ const REMOTE_DOMAIN_LAUNCH_SECURITY_INFO_PARAMS_MAX = 64;
 /* Upper limit on number of parameters describing a guest */
 const REMOTE_DOMAIN_GUEST_INFO_PARAMS_MAX = 2048;
 
+/* Upper limit on number of huge page pools in a page layout */
+const REMOTE_NODE_PAGES_LAYOUT_PARAMS_MAX = 1024;
+
+/* Upper limit on number of host CPU statistics returned at once,
+ * enough for a few thousand CPUs with their idle states */
+const REMOTE_NODE_ALL_CPU_STATS_PARAMS_MAX = 65536;
+
+/* Upper limit on number of devices attached at once */
+const REMOTE_DOMAIN_ATTACH_DEVICES_MAX = 1024;
+
 /*
  * Upper limit on list of network port parameters
  */
@@ -1009,6 +1028,12 @@ struct remote_domain_core_dump_with_format_args {
     unsigned int flags;
 };
 
+struct remote_domain_core_dump_stream_args {
+    remote_nonnull_domain dom;
+    unsigned int dumpformat;
+    unsigned int flags;
+};
+
 struct remote_domain_screenshot_args {
     remote_nonnull_domain dom;
     unsigned int screen;
@@ -2021,6 +2046,22 @@ struct remote_storage_vol_get_info_flags_ret { /* insert@1 */
     unsigned hyper allocation;
 };
 
+struct remote_storage_vol_get_job_info_args {
+    remote_nonnull_storage_vol vol;
+    unsigned int flags;
+};
+
+struct remote_storage_vol_get_job_info_ret { /* insert@1 */
+    int type;
+    unsigned hyper total;
+    unsigned hyper done;
+};
+
+struct remote_storage_vol_abort_job_args {
+    remote_nonnull_storage_vol vol;
+    unsigned int flags;
+};
+
 struct remote_storage_vol_get_path_args {
     remote_nonnull_storage_vol vol;
 };
@@ -3172,6 +3213,13 @@ struct remote_domain_event_block_threshold_msg {
     unsigned hyper excess;
 };
 
+struct remote_domain_event_callback_monitor_slow_msg {
+    int callbackID;
+    remote_nonnull_domain dom;
+    remote_nonnull_string command;
+    unsigned hyper elapsed;
+};
+
 struct remote_domain_event_callback_tunable_msg {
     int callbackID;
     remote_nonnull_domain dom;
@@ -3188,6 +3236,10 @@ struct remote_connect_event_connection_closed_msg {
     int reason;
 };
 
+struct remote_connect_event_lost_msg {
+    unsigned hyper count;
+};
+
 struct remote_connect_get_cpu_model_names_args {
     remote_nonnull_string arch;
     int need_results;
@@ -3244,6 +3296,14 @@ struct remote_storage_pool_event_refresh_msg {
     remote_nonnull_storage_pool pool;
 };
 
+struct remote_storage_pool_event_threshold_msg {
+    int callbackID;
+    remote_nonnull_storage_pool pool;
+    remote_string volume;
+    unsigned hyper threshold;
+    unsigned hyper excess;
+};
+
 struct remote_connect_node_device_event_register_any_args {
     int eventID;
     remote_node_device dev;
@@ -3771,6 +3831,161 @@ struct remote_domain_backup_get_xml_desc_ret {
     remote_nonnull_string xml;
 };
 
+struct remote_domain_xml_desc_record {
+    remote_nonnull_domain dom;
+    remote_nonnull_string xml;
+};
+
+struct remote_connect_get_all_domain_xml_desc_args {
+    remote_nonnull_domain doms<REMOTE_DOMAIN_LIST_MAX>;
+    unsigned int xmlflags;
+    unsigned int flags;
+};
+
+struct remote_connect_get_all_domain_xml_desc_ret {
+    remote_domain_xml_desc_record retDescs<REMOTE_DOMAIN_LIST_MAX>;
+};
+
+struct remote_connect_set_compression_args {
+    int level;
+    unsigned int flags;
+};
+
+struct remote_connect_enable_chunked_replies_args {
+    unsigned int flags;
+};
+
+struct remote_connect_enable_event_batches_args {
+    unsigned int flags;
+};
+
+struct remote_domain_start_dirty_rate_calc_args {
+    remote_nonnull_domain dom;
+    int seconds;
+    unsigned int flags;
+};
+
+struct remote_node_set_pages_layout_args {
+    remote_typed_param params<REMOTE_NODE_PAGES_LAYOUT_PARAMS_MAX>;
+    int need_results;
+    unsigned int flags;
+};
+
+struct remote_node_set_pages_layout_ret {
+    remote_typed_param result<REMOTE_NODE_PAGES_LAYOUT_PARAMS_MAX>;
+};
+
+struct remote_node_get_all_cpu_stats_args {
+    unsigned int flags;
+};
+
+struct remote_node_get_all_cpu_stats_ret {
+    remote_typed_param params<REMOTE_NODE_ALL_CPU_STATS_PARAMS_MAX>;
+};
+
+struct remote_domain_attach_devices_args {
+    remote_nonnull_domain dom;
+    remote_nonnull_string xmls<REMOTE_DOMAIN_ATTACH_DEVICES_MAX>; /* (const char **) */
+    unsigned int flags;
+};
+
+struct remote_domain_fsfreeze_record {
+    remote_nonnull_domain dom;
+    int nfilesystems;
+    remote_string error;
+};
+
+struct remote_domain_list_fsfreeze_args {
+    remote_nonnull_domain doms<REMOTE_DOMAIN_LIST_MAX>;
+    int timeout;
+    unsigned int flags;
+};
+
+struct remote_domain_list_fsfreeze_ret {
+    remote_domain_fsfreeze_record retResults<REMOTE_DOMAIN_LIST_MAX>;
+};
+
+struct remote_domain_list_fsthaw_args {
+    remote_nonnull_domain doms<REMOTE_DOMAIN_LIST_MAX>;
+    int timeout;
+    unsigned int flags;
+};
+
+struct remote_domain_list_fsthaw_ret {
+    remote_domain_fsfreeze_record retResults<REMOTE_DOMAIN_LIST_MAX>;
+};
+
+struct remote_domain_list_snapshot_create_xml_args {
+    remote_nonnull_domain doms<REMOTE_DOMAIN_LIST_MAX>;
+    remote_nonnull_string xmlDescs<REMOTE_DOMAIN_LIST_MAX>;
+    unsigned int flags;
+};
+
+struct remote_domain_list_snapshot_create_xml_ret {
+    remote_nonnull_domain_snapshot snaps<REMOTE_DOMAIN_LIST_MAX>;
+    int ret;
+};
+
+/* A stats parameter whose name is given by its index into the 'fields'
+ * of remote_connect_get_all_domain_stats_compact_ret */
+struct remote_domain_stats_compact_param {
+    unsigned int field;
+    remote_typed_param_value value;
+};
+
+struct remote_domain_stats_compact_record {
+    remote_nonnull_domain dom;
+    remote_domain_stats_compact_param params<REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX>;
+};
+
+struct remote_connect_get_all_domain_stats_compact_args {
+    remote_nonnull_domain doms<REMOTE_DOMAIN_LIST_MAX>;
+    unsigned int stats;
+    unsigned int flags;
+};
+
+struct remote_connect_get_all_domain_stats_compact_ret {
+    remote_nonnull_string fields<REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_FIELDS_MAX>;
+    remote_domain_stats_compact_record retStats<REMOTE_DOMAIN_LIST_MAX>;
+};
+
+struct remote_domain_stop_record {
+    remote_nonnull_domain dom;
+    int result;
+    remote_string error;
+};
+
+struct remote_domain_list_stop_args {
+    remote_nonnull_domain doms<REMOTE_DOMAIN_LIST_MAX>;
+    unsigned int parallel;
+    int timeout;
+    unsigned int flags;
+};
+
+struct remote_domain_list_stop_ret {
+    remote_domain_stop_record retResults<REMOTE_DOMAIN_LIST_MAX>;
+};
+
+struct remote_secret_value_lookup {
+    int type; /* virSecretLookupType */
+    remote_uuid uuid;
+    remote_string usageID;
+    int usageType;
+};
+
+struct remote_secret_value {
+    opaque value<REMOTE_SECRET_VALUE_MAX>;
+};
+
+struct remote_connect_secret_get_values_args {
+    remote_secret_value_lookup lookups<REMOTE_SECRET_VALUES_MAX>;
+    unsigned int flags;
+};
+
+struct remote_connect_secret_get_values_ret {
+    remote_secret_value values<REMOTE_SECRET_VALUES_MAX>;
+};
+
 /*----- Protocol. -----*/
 
 /* Define the program number, protocol version and procedure numbers here. */
@@ -3845,7 +4060,7 @@ enum remote_procedure {
     REMOTE_PROC_CONNECT_GET_TYPE = 3,
 
     /**
-     * @generate: both
+     * @generate: server
      * @priority: high
      * @acl: connect:getattr
      */
@@ -3866,7 +4081,7 @@ enum remote_procedure {
     REMOTE_PROC_NODE_GET_INFO = 6,
 
     /**
-     * @generate: both
+     * @generate: server
      * @acl: connect:read
      */
     REMOTE_PROC_CONNECT_GET_CAPABILITIES = 7,
@@ -4224,7 +4439,7 @@ enum remote_procedure {
     REMOTE_PROC_DOMAIN_SET_SCHEDULER_PARAMETERS = 58,
 
     /**
-     * @generate: both
+     * @generate: server
      * @priority: high
      * @acl: connect:getattr
      */
@@ -6135,7 +6350,7 @@ enum remote_procedure {
     REMOTE_PROC_NETWORK_GET_DHCP_LEASES = 341,
 
     /**
-     * @generate: both
+     * @generate: server
      * @acl: connect:write
      */
     REMOTE_PROC_CONNECT_GET_DOMAIN_CAPABILITIES = 342,
@@ -6664,5 +6879,139 @@ enum remote_procedure {
      * @priority: high
      * @acl: domain:read
      */
-    REMOTE_PROC_DOMAIN_BACKUP_GET_XML_DESC = 422
+    REMOTE_PROC_DOMAIN_BACKUP_GET_XML_DESC = 422,
+
+    /**
+     * @generate: none
+     * @acl: connect:search_domains
+     * @aclfilter: domain:read
+     * @aclfilter: domain:read_secure:VIR_DOMAIN_XML_SECURE
+     * @aclfilter: domain:read_secure:VIR_DOMAIN_XML_MIGRATABLE
+     */
+    REMOTE_PROC_CONNECT_GET_ALL_DOMAIN_XML_DESC = 423,
+
+    /**
+     * @generate: none
+     * @priority: high
+     * @acl: none
+     */
+    REMOTE_PROC_CONNECT_SET_COMPRESSION = 424,
+
+    /**
+     * @generate: none
+     * @priority: high
+     * @acl: none
+     */
+    REMOTE_PROC_CONNECT_ENABLE_CHUNKED_REPLIES = 425,
+
+    /**
+     * @generate: both
+     * @acl: domain:read
+     */
+    REMOTE_PROC_DOMAIN_START_DIRTY_RATE_CALC = 426,
+
+    /**
+     * @generate: none
+     * @acl: connect:write
+     */
+    REMOTE_PROC_NODE_SET_PAGES_LAYOUT = 427,
+
+    /**
+     * @generate: none
+     * @acl: connect:read
+     */
+    REMOTE_PROC_NODE_GET_ALL_CPU_STATS = 428,
+
+    /**
+     * @generate: both
+     * @acl: storage_vol:read
+     */
+    REMOTE_PROC_STORAGE_VOL_GET_JOB_INFO = 429,
+
+    /**
+     * @generate: both
+     * @acl: storage_vol:data_write
+     */
+    REMOTE_PROC_STORAGE_VOL_ABORT_JOB = 430,
+
+    /**
+     * @generate: both
+     * @acl: none
+     */
+    REMOTE_PROC_STORAGE_POOL_EVENT_THRESHOLD = 431,
+
+    /**
+     * @generate: none
+     * @acl: none
+     */
+    REMOTE_PROC_CONNECT_EVENT_LOST = 432,
+
+    /**
+     * @generate: none
+     * @priority: high
+     * @acl: none
+     */
+    REMOTE_PROC_CONNECT_ENABLE_EVENT_BATCHES = 433,
+
+    /**
+     * @generate: both
+     * @acl: domain:write
+     * @acl: domain:save:!VIR_DOMAIN_AFFECT_CONFIG|VIR_DOMAIN_AFFECT_LIVE
+     * @acl: domain:save:VIR_DOMAIN_AFFECT_CONFIG
+     */
+    REMOTE_PROC_DOMAIN_ATTACH_DEVICES = 434,
+
+    /**
+     * @generate: none
+     * @acl: domain:fs_freeze
+     */
+    REMOTE_PROC_DOMAIN_LIST_FSFREEZE = 435,
+
+    /**
+     * @generate: none
+     * @acl: domain:fs_freeze
+     */
+    REMOTE_PROC_DOMAIN_LIST_FSTHAW = 436,
+
+    /**
+     * @generate: none
+     * @acl: domain:snapshot
+     */
+    REMOTE_PROC_DOMAIN_LIST_SNAPSHOT_CREATE_XML = 437,
+
+    /**
+     * @generate: none
+     * @acl: connect:search_domains
+     * @aclfilter: domain:read
+     */
+    REMOTE_PROC_CONNECT_GET_ALL_DOMAIN_STATS_COMPACT = 438,
+
+    /**
+     * @generate: none
+     * @acl: domain:read
+     * @acl: domain:init_control:!VIR_DOMAIN_LIST_STOP_MANAGED_SAVE|VIR_DOMAIN_LIST_STOP_SUSPEND
+     * @acl: domain:hibernate:VIR_DOMAIN_LIST_STOP_MANAGED_SAVE
+     * @acl: domain:suspend:VIR_DOMAIN_LIST_STOP_SUSPEND
+     */
+    REMOTE_PROC_DOMAIN_LIST_STOP = 439,
+
+    /**
+     * @generate: none
+     * @priority: high
+     * @acl: secret:read_secure
+     */
+    REMOTE_PROC_CONNECT_SECRET_GET_VALUES = 440,
+
+    /**
+     * @generate: both
+     * @readstream: 1
+     * @acl: domain:core_dump
+     */
+    REMOTE_PROC_DOMAIN_CORE_DUMP_STREAM = 441,
+
+    /**
+     * @generate: both
+     * @acl: none
+     */
+    REMOTE_PROC_DOMAIN_EVENT_CALLBACK_MONITOR_SLOW = 442
 };
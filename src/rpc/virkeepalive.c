@@ -23,6 +23,8 @@
 #include "viralloc.h"
 #include "virthread.h"
 #include "virfile.h"
+#include "vireventglib.h"
+#include "vireventthread.h"
 #include "virlog.h"
 #include "virerror.h"
 #include "virnetsocket.h"
@@ -44,13 +46,29 @@ struct _virKeepAlive {
     time_t intervalStart;
     int timer;
 
+    /* Round trip times of our requests, in microseconds */
+    long long pingSent; /* when the oldest unanswered request was sent */
+    unsigned long long pings;
+    unsigned long long pongs;
+    unsigned long long rttTotal;
+    unsigned long long rttLast;
+    unsigned long long rttMax;
+
     virKeepAliveSendFunc sendCB;
     virKeepAliveDeadFunc deadCB;
     virKeepAliveFreeFunc freeCB;
+    virKeepAliveActiveFunc activeCB; /* non-NULL if the timer runs in
+                                      * virKeepAliveThread */
     void *client;
 };
 
 
+/* Runs the timers of all virKeepAlive objects set up with
+ * virKeepAliveUseThread, created on first use */
+static virMutex virKeepAliveThreadLock = VIR_MUTEX_INITIALIZER;
+static virEventThread *virKeepAliveThread;
+
+
 static virClassPtr virKeepAliveClass;
 static void virKeepAliveDispose(void *obj);
 
@@ -64,6 +82,25 @@ static int virKeepAliveOnceInit(void)
 
 VIR_ONCE_GLOBAL_INIT(virKeepAlive);
 
+
+static GMainContext *
+virKeepAliveGetThreadContext(void)
+{
+    GMainContext *context = NULL;
+
+    virMutexLock(&virKeepAliveThreadLock);
+
+    if (!virKeepAliveThread)
+        virKeepAliveThread = virEventThreadNew("rpc-keepalive");
+
+    if (virKeepAliveThread)
+        context = virEventThreadGetContext(virKeepAliveThread);
+
+    virMutexUnlock(&virKeepAliveThreadLock);
+
+    return context;
+}
+
 static virNetMessagePtr
 virKeepAliveMessage(virKeepAlivePtr ka, int proc)
 {
@@ -111,6 +148,7 @@ virKeepAliveMessage(virKeepAlivePtr ka, int proc)
 
 static bool
 virKeepAliveTimerInternal(virKeepAlivePtr ka,
+                          bool active,
                           virNetMessagePtr *msg)
 {
     time_t now = time(NULL);
@@ -125,6 +163,17 @@ virKeepAliveTimerInternal(virKeepAlivePtr ka,
         return false;
     }
 
+    if (active) {
+        /* The peer did send something, we just did not get to read it
+         * yet because the loop handling its I/O is busy */
+        VIR_DEBUG("Unread data from client %p, considering it alive",
+                  ka->client);
+        ka->countToDeath = ka->count;
+        ka->intervalStart = now;
+        virEventUpdateTimeout(ka->timer, ka->interval * 1000);
+        return false;
+    }
+
     timeval = now - ka->lastPacketReceived;
     PROBE(RPC_KEEPALIVE_TIMEOUT,
           "ka=%p client=%p countToDeath=%d idle=%d",
@@ -141,6 +190,11 @@ virKeepAliveTimerInternal(virKeepAlivePtr ka,
         ka->countToDeath--;
         ka->intervalStart = now;
         *msg = virKeepAliveMessage(ka, KEEPALIVE_PROC_PING);
+        if (*msg) {
+            ka->pings++;
+            if (ka->pingSent == 0)
+                ka->pingSent = g_get_monotonic_time();
+        }
         virEventUpdateTimeout(ka->timer, ka->interval * 1000);
         return false;
     }
@@ -152,14 +206,20 @@ virKeepAliveTimer(int timer G_GNUC_UNUSED, void *opaque)
 {
     virKeepAlivePtr ka = opaque;
     virNetMessagePtr msg = NULL;
+    bool active = false;
     bool dead;
-    void *client;
+    void *client = ka->client;
 
     virObjectRef(ka);
+
+    /* Must not be called with @ka locked, the callback locks the client
+     * which in turn calls us with the client locked */
+    if (ka->activeCB)
+        active = ka->activeCB(client);
+
     virObjectLock(ka);
 
-    client = ka->client;
-    dead = virKeepAliveTimerInternal(ka, &msg);
+    dead = virKeepAliveTimerInternal(ka, active, &msg);
 
     virObjectUnlock(ka);
 
@@ -277,8 +337,19 @@ virKeepAliveStart(virKeepAlivePtr ka,
     else
         timeout = ka->interval - delay;
     ka->intervalStart = now - (ka->interval - timeout);
-    ka->timer = virEventAddTimeout(timeout * 1000, virKeepAliveTimer,
-                                   ka, virObjectFreeCallback);
+    if (ka->activeCB) {
+        GMainContext *context;
+
+        if (!(context = virKeepAliveGetThreadContext()))
+            goto cleanup;
+
+        ka->timer = virEventGLibTimeoutAddContext(context, timeout * 1000,
+                                                  virKeepAliveTimer, ka,
+                                                  virObjectFreeCallback);
+    } else {
+        ka->timer = virEventAddTimeout(timeout * 1000, virKeepAliveTimer,
+                                       ka, virObjectFreeCallback);
+    }
     if (ka->timer < 0)
         goto cleanup;
 
@@ -351,7 +422,7 @@ virKeepAliveTrigger(virKeepAlivePtr ka,
         return false;
 
     virObjectLock(ka);
-    dead = virKeepAliveTimerInternal(ka, msg);
+    dead = virKeepAliveTimerInternal(ka, false, msg);
     virObjectUnlock(ka);
 
     return dead;
@@ -393,6 +464,13 @@ virKeepAliveCheckMessage(virKeepAlivePtr ka,
 
         case KEEPALIVE_PROC_PONG:
             VIR_DEBUG("Got keepalive response from client %p", ka->client);
+            if (ka->pingSent > 0) {
+                ka->rttLast = g_get_monotonic_time() - ka->pingSent;
+                ka->rttTotal += ka->rttLast;
+                ka->rttMax = MAX(ka->rttMax, ka->rttLast);
+                ka->pongs++;
+                ka->pingSent = 0;
+            }
             break;
 
         default:
@@ -408,3 +486,50 @@ virKeepAliveCheckMessage(virKeepAlivePtr ka,
 
     return ret;
 }
+
+
+/**
+ * virKeepAliveUseThread:
+ * @ka: keepalive object
+ * @activeCB: callback telling whether the peer sent data not read yet
+ *
+ * Makes the keepalive timer of @ka run in a thread shared by all such
+ * objects instead of the default main loop, so that a busy main loop
+ * delays neither keepalive requests nor the detection of dead peers.
+ * Since the main loop may still be too busy to read incoming messages,
+ * @activeCB is consulted before the peer is considered unresponsive.
+ * It is called without @ka locked. Must be called before
+ * virKeepAliveStart.
+ */
+void
+virKeepAliveUseThread(virKeepAlivePtr ka,
+                      virKeepAliveActiveFunc activeCB)
+{
+    virObjectLock(ka);
+    ka->activeCB = activeCB;
+    virObjectUnlock(ka);
+}
+
+
+/**
+ * virKeepAliveGetStats:
+ * @ka: keepalive object
+ * @stats: filled with the statistics
+ *
+ * Reports how many keepalive requests were sent to the peer, how many
+ * of them were answered and how long it took.
+ */
+void
+virKeepAliveGetStats(virKeepAlivePtr ka,
+                     virKeepAliveStatsPtr stats)
+{
+    virObjectLock(ka);
+
+    stats->pings = ka->pings;
+    stats->pongs = ka->pongs;
+    stats->rttLast = ka->rttLast;
+    stats->rttMax = ka->rttMax;
+    stats->rttAvg = ka->pongs ? ka->rttTotal / ka->pongs : 0;
+
+    virObjectUnlock(ka);
+}
@@ -26,10 +26,22 @@
 typedef int (*virKeepAliveSendFunc)(void *client, virNetMessagePtr msg);
 typedef void (*virKeepAliveDeadFunc)(void *client);
 typedef void (*virKeepAliveFreeFunc)(void *client);
+typedef bool (*virKeepAliveActiveFunc)(void *client);
 
 typedef struct _virKeepAlive virKeepAlive;
 typedef virKeepAlive *virKeepAlivePtr;
 
+/* Round trip times are in microseconds */
+typedef struct _virKeepAliveStats virKeepAliveStats;
+typedef virKeepAliveStats *virKeepAliveStatsPtr;
+struct _virKeepAliveStats {
+    unsigned long long pings;
+    unsigned long long pongs;
+    unsigned long long rttLast;
+    unsigned long long rttAvg;
+    unsigned long long rttMax;
+};
+
 
 virKeepAlivePtr virKeepAliveNew(int interval,
                                 unsigned int count,
@@ -51,3 +63,10 @@ bool virKeepAliveTrigger(virKeepAlivePtr ka,
 bool virKeepAliveCheckMessage(virKeepAlivePtr ka,
                               virNetMessagePtr msg,
                               virNetMessagePtr *response);
+
+void virKeepAliveUseThread(virKeepAlivePtr ka,
+                           virKeepAliveActiveFunc activeCB)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+void virKeepAliveGetStats(virKeepAlivePtr ka,
+                          virKeepAliveStatsPtr stats)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
@@ -58,6 +58,10 @@ struct _virNetClientCall {
     bool nonBlock;
     bool haveThread;
 
+    /* Completion callback of asynchronous calls */
+    virNetClientCallFunc func;
+    void *opaque;
+
     virCond cond;
 
     virNetClientCallPtr next;
@@ -90,9 +94,12 @@ struct _virNetClient {
      * List of calls currently waiting for dispatch
      * The calls should all have threads waiting for
      * them, except possibly the first call in the list
-     * which might be a partially sent non-blocking call.
+     * which might be a partially sent non-blocking call
+     * and asynchronous calls.
      */
     virNetClientCallPtr waitDispatch;
+    /* Finished asynchronous calls waiting for their callbacks */
+    virNetClientCallPtr asyncDone;
     /* True if a thread holds the buck */
     bool haveTheBuck;
 
@@ -100,6 +107,7 @@ struct _virNetClient {
     virNetClientStreamPtr *streams;
 
     virKeepAlivePtr keepalive;
+    bool traceContext; /* server accepts VIR_NET_CALL_WITH_TRACE */
     bool wantClose;
     int closeReason;
     virErrorPtr error;
@@ -237,6 +245,58 @@ static bool virNetClientCallMatchPredicate(virNetClientCallPtr head,
 }
 
 
+static void
+virNetClientCallAsyncFinish(virNetClientPtr client,
+                            virNetClientCallPtr call)
+{
+    int status = 0;
+
+    if (call->mode != VIR_NET_CLIENT_MODE_COMPLETE) {
+        virReportError(VIR_ERR_RPC, "%s",
+                       _("connection closed before the reply was received"));
+        status = -1;
+    }
+
+    call->func(client, call->msg, status, call->opaque);
+
+    virNetMessageFree(call->msg);
+    virCondDestroy(&call->cond);
+    VIR_FREE(call);
+    virObjectUnref(client);
+}
+
+
+/*
+ * Runs the callbacks of finished asynchronous calls. Must be called
+ * with the client locked, the lock is released while callbacks run so
+ * that they can issue new calls.
+ */
+static void
+virNetClientAsyncCallsDispatch(virNetClientPtr client)
+{
+    virNetClientCallPtr calls = client->asyncDone;
+
+    if (!calls)
+        return;
+
+    client->asyncDone = NULL;
+
+    virObjectRef(client);
+    virObjectUnlock(client);
+
+    while (calls) {
+        virNetClientCallPtr call = calls;
+
+        calls = call->next;
+        call->next = NULL;
+        virNetClientCallAsyncFinish(client, call);
+    }
+
+    virObjectLock(client);
+    virObjectUnref(client);
+}
+
+
 bool
 virNetClientKeepAliveIsSupported(virNetClientPtr client)
 {
@@ -796,6 +856,7 @@ static void virNetClientCloseInternal(virNetClientPtr client,
         virNetClientIOEventLoopPassTheBuck(client, NULL);
     }
 
+    virNetClientAsyncCallsDispatch(client);
     virObjectUnlock(client);
 }
 
@@ -818,6 +879,58 @@ void virNetClientSetSASLSession(virNetClientPtr client,
 #endif
 
 
+/**
+ * virNetClientSetCompression:
+ * @client: the client
+ * @level: zlib compression level, 1-9
+ *
+ * Compress all further data exchanged with the server. Must only be
+ * called once the server agreed to compress the connection too, with
+ * no other calls in flight.
+ *
+ * Returns 0 on success, -1 on error
+ */
+int virNetClientSetCompression(virNetClientPtr client,
+                               int level)
+{
+    int ret;
+
+    virObjectLock(client);
+    ret = virNetSocketSetCompression(client->sock, level);
+    virObjectUnlock(client);
+    return ret;
+}
+
+
+
+/**
+ * virNetClientSetTraceContext:
+ * @client: the client
+ * @enable: whether the server accepts trace contexts
+ *
+ * Lets calls made by threads which are part of a trace pass the trace
+ * context to the server, see virTraceContextGetCurrent.
+ */
+void virNetClientSetTraceContext(virNetClientPtr client,
+                                 bool enable)
+{
+    virObjectLock(client);
+    client->traceContext = enable;
+    virObjectUnlock(client);
+}
+
+
+bool virNetClientHasTraceContext(virNetClientPtr client)
+{
+    bool ret;
+
+    virObjectLock(client);
+    ret = client->traceContext;
+    virObjectUnlock(client);
+    return ret;
+}
+
+
 static gboolean
 virNetClientIOEventTLS(int fd,
                        GIOCondition ev,
@@ -1082,6 +1195,47 @@ int virNetClientGetTLSKeySize(virNetClientPtr client)
     return ret;
 }
 
+/*
+ * Appends the payload of @reply, a further part of a chunked reply,
+ * to the parts already collected in @thecall. The call completes
+ * once the last part arrives.
+ */
+static int
+virNetClientCallAppendReply(virNetClientCallPtr thecall,
+                            virNetMessagePtr reply)
+{
+    virNetMessagePtr msg = thecall->msg;
+    size_t offset = msg->bufferLength;
+    size_t len = reply->bufferLength - reply->bufferOffset;
+
+    if (offset + len > VIR_NET_MESSAGE_CHUNKED_MAX + VIR_NET_MESSAGE_LEN_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("chunked reply exceeds maximum size %d"),
+                       VIR_NET_MESSAGE_CHUNKED_MAX);
+        return -1;
+    }
+
+    /* Grow geometrically to avoid copying all collected data for
+     * each part */
+    if (offset + len > msg->bufferSize &&
+        virNetMessageResizeBuffer(msg, MAX(offset + len,
+                                           msg->bufferSize * 2)) < 0)
+        return -1;
+
+    memcpy(msg->buffer + offset, reply->buffer + reply->bufferOffset, len);
+    msg->bufferLength = offset + len;
+    msg->header.status = reply->header.status;
+
+    if (msg->header.status != VIR_NET_CONTINUE) {
+        VIR_DEBUG("Got last part of chunked reply to call %p, %zu bytes",
+                  thecall, msg->bufferLength);
+        thecall->mode = VIR_NET_CLIENT_MODE_COMPLETE;
+    }
+
+    return 0;
+}
+
+
 static int
 virNetClientCallDispatchReply(virNetClientPtr client)
 {
@@ -1103,7 +1257,14 @@ virNetClientCallDispatchReply(virNetClientPtr client)
         return -1;
     }
 
-    if (VIR_REALLOC_N(thecall->msg->buffer, client->msg.bufferLength) < 0)
+    /* Parts of a reply too large for a single message are collected
+     * in the call's message, whose request was sent already */
+    if (thecall->msg->header.type == VIR_NET_REPLY &&
+        thecall->msg->header.status == VIR_NET_CONTINUE &&
+        client->msg.header.status != VIR_NET_ERROR)
+        return virNetClientCallAppendReply(thecall, &client->msg);
+
+    if (virNetMessageResizeBuffer(thecall->msg, client->msg.bufferLength) < 0)
         return -1;
 
     memcpy(thecall->msg->buffer, client->msg.buffer, client->msg.bufferLength);
@@ -1116,30 +1277,90 @@ virNetClientCallDispatchReply(virNetClientPtr client)
     client->msg.nfds = 0;
     client->msg.fds = NULL;
 
+    if (thecall->msg->header.type == VIR_NET_REPLY &&
+        thecall->msg->header.status == VIR_NET_CONTINUE) {
+        VIR_DEBUG("Got first part of chunked reply to call %p", thecall);
+        return 0;
+    }
+
     thecall->mode = VIR_NET_CLIENT_MODE_COMPLETE;
 
     return 0;
 }
 
-static int virNetClientCallDispatchMessage(virNetClientPtr client)
+static int virNetClientCallDispatchMessage(virNetClientPtr client,
+                                           virNetMessagePtr msg)
 {
     size_t i;
     virNetClientProgramPtr prog = NULL;
 
     for (i = 0; i < client->nprograms; i++) {
-        if (virNetClientProgramMatches(client->programs[i],
-                                       &client->msg)) {
+        if (virNetClientProgramMatches(client->programs[i], msg)) {
             prog = client->programs[i];
             break;
         }
     }
     if (!prog) {
         VIR_DEBUG("No program found for event with prog=%d vers=%d",
-                  client->msg.header.prog, client->msg.header.vers);
+                  msg->header.prog, msg->header.vers);
         return -1;
     }
 
-    virNetClientProgramDispatch(prog, client, &client->msg);
+    virNetClientProgramDispatch(prog, client, msg);
+
+    return 0;
+}
+
+
+/*
+ * Dispatches the events joined in a VIR_NET_MESSAGE_BATCH one by one,
+ * decoding them in place from the buffer of the batch.
+ */
+static int virNetClientCallDispatchBatch(virNetClientPtr client)
+{
+    size_t offset = client->msg.bufferOffset;
+
+    while (offset < client->msg.bufferLength) {
+        virNetMessage event;
+        unsigned int len;
+        XDR xdr;
+
+        xdrmem_create(&xdr, client->msg.buffer + offset,
+                      client->msg.bufferLength - offset, XDR_DECODE);
+        if (!xdr_u_int(&xdr, &len)) {
+            xdr_destroy(&xdr);
+            virReportError(VIR_ERR_RPC, "%s",
+                           _("Unable to decode length of batched event"));
+            return -1;
+        }
+        xdr_destroy(&xdr);
+
+        if (len < VIR_NET_MESSAGE_LEN_MAX ||
+            len > client->msg.bufferLength - offset) {
+            virReportError(VIR_ERR_RPC,
+                           _("batched event length %u is invalid"), len);
+            return -1;
+        }
+
+        memset(&event, 0, sizeof(event));
+        event.buffer = client->msg.buffer + offset;
+        event.bufferLength = len;
+
+        if (virNetMessageDecodeHeader(&event) < 0)
+            return -1;
+
+        if (event.header.type != VIR_NET_MESSAGE) {
+            virReportError(VIR_ERR_RPC,
+                           _("unexpected message type %d in event batch"),
+                           event.header.type);
+            return -1;
+        }
+
+        if (virNetClientCallDispatchMessage(client, &event) < 0)
+            return -1;
+
+        offset += len;
+    }
 
     return 0;
 }
@@ -1279,7 +1500,10 @@ virNetClientCallDispatch(virNetClientPtr client)
         return virNetClientCallDispatchReply(client);
 
     case VIR_NET_MESSAGE: /* Async notifications */
-        return virNetClientCallDispatchMessage(client);
+        return virNetClientCallDispatchMessage(client, &client->msg);
+
+    case VIR_NET_MESSAGE_BATCH: /* Several async notifications */
+        return virNetClientCallDispatchBatch(client);
 
     case VIR_NET_STREAM: /* Stream protocol */
     case VIR_NET_STREAM_HOLE: /* Sparse stream protocol */
@@ -1287,6 +1511,7 @@ virNetClientCallDispatch(virNetClientPtr client)
 
     case VIR_NET_CALL:
     case VIR_NET_CALL_WITH_FDS:
+    case VIR_NET_CALL_WITH_TRACE:
     default:
         virReportError(VIR_ERR_RPC,
                        _("got unexpected RPC call prog %d vers %d proc %d type %d"),
@@ -1371,8 +1596,7 @@ virNetClientIOReadMessage(virNetClientPtr client)
 
     /* Start by reading length word */
     if (client->msg.bufferLength == 0) {
-        client->msg.bufferLength = 4;
-        if (VIR_ALLOC_N(client->msg.buffer, client->msg.bufferLength) < 0)
+        if (virNetMessageResizeBuffer(&client->msg, VIR_NET_MESSAGE_LEN_MAX) < 0)
             return -ENOMEM;
     }
 
@@ -1492,12 +1716,18 @@ static bool virNetClientIOEventLoopPollEvents(virNetClientCallPtr call,
 }
 
 
+struct virNetClientIORemoveData {
+    virNetClientPtr client;
+    virNetClientCallPtr thiscall;
+};
+
+
 static bool virNetClientIOEventLoopRemoveDone(virNetClientCallPtr call,
                                               void *opaque)
 {
-    virNetClientCallPtr thiscall = opaque;
+    struct virNetClientIORemoveData *data = opaque;
 
-    if (call == thiscall)
+    if (call == data->thiscall)
         return false;
 
     if (call->mode != VIR_NET_CLIENT_MODE_COMPLETE)
@@ -1516,6 +1746,9 @@ static bool virNetClientIOEventLoopRemoveDone(virNetClientCallPtr call,
     if (call->haveThread) {
         VIR_DEBUG("Waking up sleep %p", call);
         virCondSignal(&call->cond);
+    } else if (call->func) {
+        VIR_DEBUG("Completing asynchronous call %p", call);
+        virNetClientCallQueue(&data->client->asyncDone, call);
     } else {
         VIR_DEBUG("Removing completed call %p", call);
         if (call->expectReply)
@@ -1541,11 +1774,17 @@ static bool
 virNetClientIOEventLoopRemoveAll(virNetClientCallPtr call,
                                  void *opaque)
 {
-    virNetClientCallPtr thiscall = opaque;
+    struct virNetClientIORemoveData *data = opaque;
 
-    if (call == thiscall)
+    if (call == data->thiscall)
         return false;
 
+    if (call->func) {
+        VIR_DEBUG("Failing asynchronous call %p", call);
+        virNetClientCallQueue(&data->client->asyncDone, call);
+        return true;
+    }
+
     VIR_DEBUG("Removing call %p", call);
     virCondDestroy(&call->cond);
     VIR_FREE(call->msg);
@@ -1574,10 +1813,12 @@ virNetClientIOEventLoopPassTheBuck(virNetClientPtr client,
 
     VIR_DEBUG("No thread to pass the buck to");
     if (client->wantClose) {
+        struct virNetClientIORemoveData data = { client, thiscall };
+
         virNetClientCloseLocked(client);
         virNetClientCallRemovePredicate(&client->waitDispatch,
                                         virNetClientIOEventLoopRemoveAll,
-                                        thiscall);
+                                        &data);
     }
 }
 
@@ -1625,6 +1866,10 @@ static int virNetClientIOEventLoop(virNetClientPtr client,
             .client = client,
             .rev = 0,
         };
+        struct virNetClientIORemoveData removeData = {
+            .client = client,
+            .thiscall = thiscall,
+        };
 
         /* If we have existing SASL decoded data we don't want to sleep in
          * the poll(), just check if any other FDs are also ready.
@@ -1734,7 +1979,7 @@ static int virNetClientIOEventLoop(virNetClientPtr client,
          */
         virNetClientCallRemovePredicate(&client->waitDispatch,
                                         virNetClientIOEventLoopRemoveDone,
-                                        thiscall);
+                                        &removeData);
 
         /* Now see if *we* are done */
         if (thiscall->mode == VIR_NET_CLIENT_MODE_COMPLETE) {
@@ -1850,6 +2095,9 @@ static void virNetClientIOUpdateCallback(virNetClientPtr client,
  *   - waitDispatch == NULL,
  *   - waitDispatch != NULL, waitDispatch.nonBlock == true
  *
+ * Asynchronous calls (nonBlock == true with a completion callback)
+ * may be anywhere in the list, without threads, in any of the states.
+ *
  * The following input states are valid, if n threads are currently
  * executing
  *
@@ -1966,6 +2214,7 @@ void virNetClientIncomingEvent(virNetSocketPtr sock,
                                void *opaque)
 {
     virNetClientPtr client = opaque;
+    struct virNetClientIORemoveData removeData = { client, NULL };
     int closeReason;
 
     virObjectLock(client);
@@ -2005,7 +2254,7 @@ void virNetClientIncomingEvent(virNetSocketPtr sock,
     /* Remove completed calls or signal their threads. */
     virNetClientCallRemovePredicate(&client->waitDispatch,
                                     virNetClientIOEventLoopRemoveDone,
-                                    NULL);
+                                    &removeData);
     virNetClientIOUpdateCallback(client, true);
 
  done:
@@ -2013,8 +2262,9 @@ void virNetClientIncomingEvent(virNetSocketPtr sock,
         virNetClientCloseLocked(client);
         virNetClientCallRemovePredicate(&client->waitDispatch,
                                         virNetClientIOEventLoopRemoveAll,
-                                        NULL);
+                                        &removeData);
     }
+    virNetClientAsyncCallsDispatch(client);
     virObjectUnlock(client);
 }
 
@@ -2022,7 +2272,9 @@ void virNetClientIncomingEvent(virNetSocketPtr sock,
 static virNetClientCallPtr
 virNetClientCallNew(virNetMessagePtr msg,
                     bool expectReply,
-                    bool nonBlock)
+                    bool nonBlock,
+                    virNetClientCallFunc func,
+                    void *opaque)
 {
     virNetClientCallPtr call = NULL;
 
@@ -2035,7 +2287,7 @@ virNetClientCallNew(virNetMessagePtr msg,
         goto error;
     }
 
-    if (expectReply && nonBlock) {
+    if (expectReply && nonBlock && !func) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("Attempt to send a non-blocking message with"
                          " a synchronous reply"));
@@ -2059,9 +2311,11 @@ virNetClientCallNew(virNetMessagePtr msg,
     call->msg = msg;
     call->expectReply = expectReply;
     call->nonBlock = nonBlock;
+    call->func = func;
+    call->opaque = opaque;
 
-    VIR_DEBUG("New call %p: msg=%p, expectReply=%d, nonBlock=%d",
-              call, msg, expectReply, nonBlock);
+    VIR_DEBUG("New call %p: msg=%p, expectReply=%d, nonBlock=%d, func=%p",
+              call, msg, expectReply, nonBlock, func);
 
     return call;
 
@@ -2084,7 +2338,7 @@ virNetClientQueueNonBlocking(virNetClientPtr client,
           msg->header.prog, msg->header.vers, msg->header.proc,
           msg->header.type, msg->header.status, msg->header.serial);
 
-    if (!(call = virNetClientCallNew(msg, false, true)))
+    if (!(call = virNetClientCallNew(msg, false, true, NULL, NULL)))
         return -1;
 
     virNetClientCallQueue(&client->waitDispatch, call);
@@ -2116,7 +2370,7 @@ static int virNetClientSendInternal(virNetClientPtr client,
         return -1;
     }
 
-    if (!(call = virNetClientCallNew(msg, expectReply, nonBlock)))
+    if (!(call = virNetClientCallNew(msg, expectReply, nonBlock, NULL, NULL)))
         return -1;
 
     call->haveThread = true;
@@ -2149,6 +2403,7 @@ int virNetClientSendWithReply(virNetClientPtr client,
     int ret;
     virObjectLock(client);
     ret = virNetClientSendInternal(client, msg, true, false);
+    virNetClientAsyncCallsDispatch(client);
     virObjectUnlock(client);
     if (ret < 0)
         return -1;
@@ -2173,10 +2428,85 @@ int virNetClientSendNonBlock(virNetClientPtr client,
     int ret;
     virObjectLock(client);
     ret = virNetClientSendInternal(client, msg, false, true);
+    virNetClientAsyncCallsDispatch(client);
     virObjectUnlock(client);
     return ret;
 }
 
+/*
+ * @msg: a message allocated on the heap
+ * @func: callback to invoke once the reply arrives
+ * @opaque: data for @func
+ *
+ * Send a message and return without waiting for the reply, which lets
+ * a single thread keep many calls in flight on one connection. Once
+ * the reply arrives, or the connection is closed before it does,
+ * @func is called exactly once with @msg holding the reply (status 0),
+ * or with status -1 and an error set. The callback runs without the
+ * client lock held in whichever thread processed the reply, i.e. the
+ * event loop thread if asynchronous I/O was registered with
+ * virNetClientRegisterAsyncIO, or a thread waiting for another call.
+ *
+ * On success @msg is owned by the client and freed after @func
+ * returns, on failure @func is not called and the caller is
+ * responsible for free'ing @msg.
+ *
+ * Returns 0 on success, -1 on failure
+ */
+int virNetClientSendAsync(virNetClientPtr client,
+                          virNetMessagePtr msg,
+                          virNetClientCallFunc func,
+                          void *opaque)
+{
+    virNetClientCallPtr call;
+    int ret = -1;
+    int rv;
+
+    virObjectLock(client);
+
+    PROBE(RPC_CLIENT_MSG_TX_QUEUE,
+          "client=%p len=%zu prog=%u vers=%u proc=%u type=%u status=%u serial=%u",
+          client, msg->bufferLength,
+          msg->header.prog, msg->header.vers, msg->header.proc,
+          msg->header.type, msg->header.status, msg->header.serial);
+
+    if (!client->sock || client->wantClose) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("client socket is closed"));
+        goto cleanup;
+    }
+
+    if (!(call = virNetClientCallNew(msg, true, true, func, opaque)))
+        goto cleanup;
+
+    /* Released once the callback was called */
+    virObjectRef(client);
+
+    /* Try to send the call right away, the rest of it and the reply
+     * are processed by whoever holds the buck or by the event loop */
+    call->haveThread = true;
+    rv = virNetClientIO(client, call);
+
+    if (rv < 0) {
+        virObjectUnref(client);
+        virCondDestroy(&call->cond);
+        VIR_FREE(call);
+        goto cleanup;
+    }
+
+    /* The reply arrived already */
+    if (rv == 0)
+        virNetClientCallQueue(&client->asyncDone, call);
+
+    ret = 0;
+
+ cleanup:
+    virNetClientAsyncCallsDispatch(client);
+    virObjectUnlock(client);
+    return ret;
+}
+
+
 /*
  * @msg: a message allocated on heap or stack
  *
@@ -2216,6 +2546,7 @@ int virNetClientSendStream(virNetClientPtr client,
     ret = 0;
 
  cleanup:
+    virNetClientAsyncCallsDispatch(client);
     virObjectUnlock(client);
 
     return ret;
@@ -113,6 +113,16 @@ int virNetClientSendStream(virNetClientPtr client,
                            virNetMessagePtr msg,
                            virNetClientStreamPtr st);
 
+typedef void (*virNetClientCallFunc)(virNetClientPtr client,
+                                     virNetMessagePtr msg,
+                                     int status,
+                                     void *opaque);
+
+int virNetClientSendAsync(virNetClientPtr client,
+                          virNetMessagePtr msg,
+                          virNetClientCallFunc func,
+                          void *opaque);
+
 #ifdef WITH_SASL
 void virNetClientSetSASLSession(virNetClientPtr client,
                                 virNetSASLSessionPtr sasl);
@@ -121,6 +131,13 @@ void virNetClientSetSASLSession(virNetClientPtr client,
 int virNetClientSetTLSSession(virNetClientPtr client,
                               virNetTLSContextPtr tls);
 
+int virNetClientSetCompression(virNetClientPtr client,
+                               int level);
+
+void virNetClientSetTraceContext(virNetClientPtr client,
+                                 bool enable);
+bool virNetClientHasTraceContext(virNetClientPtr client);
+
 bool virNetClientIsEncrypted(virNetClientPtr client);
 bool virNetClientIsOpen(virNetClientPtr client);
 
@@ -263,32 +263,32 @@ int virNetClientProgramDispatch(virNetClientProgramPtr prog,
 }
 
 
-int virNetClientProgramCall(virNetClientProgramPtr prog,
-                            virNetClientPtr client,
-                            unsigned serial,
-                            int proc,
-                            size_t noutfds,
-                            int *outfds,
-                            size_t *ninfds,
-                            int **infds,
-                            xdrproc_t args_filter, void *args,
-                            xdrproc_t ret_filter, void *ret)
+static virNetMessagePtr
+virNetClientProgramNewCall(virNetClientProgramPtr prog,
+                           virNetClientPtr client,
+                           unsigned serial,
+                           int proc,
+                           size_t noutfds,
+                           int *outfds,
+                           xdrproc_t args_filter, void *args)
 {
     virNetMessagePtr msg;
     size_t i;
 
-    if (infds)
-        *infds = NULL;
-    if (ninfds)
-        *ninfds = 0;
-
     if (!(msg = virNetMessageNew(false)))
-        return -1;
+        return NULL;
 
     msg->header.prog = prog->program;
     msg->header.vers = prog->version;
     msg->header.status = VIR_NET_OK;
     msg->header.type = noutfds ? VIR_NET_CALL_WITH_FDS : VIR_NET_CALL;
+    /* Calls passing FDs have their own prefix, they are not traced */
+    if (!noutfds &&
+        virNetClientHasTraceContext(client) &&
+        virTraceContextGetCurrent(&msg->trace)) {
+        msg->header.type = VIR_NET_CALL_WITH_TRACE;
+        msg->hasTrace = true;
+    }
     msg->header.serial = serial;
     msg->header.proc = proc;
     if (VIR_ALLOC_N(msg->fds, noutfds) < 0)
@@ -318,12 +318,32 @@ int virNetClientProgramCall(virNetClientProgramPtr prog,
         virNetMessageEncodeNumFDs(msg) < 0)
         goto error;
 
-    if (virNetMessageEncodePayload(msg, args_filter, args) < 0)
+    if (msg->hasTrace &&
+        virNetMessageEncodeTrace(msg) < 0)
         goto error;
 
-    if (virNetClientSendWithReply(client, msg) < 0)
+    if (virNetMessageEncodePayload(msg, args_filter, args) < 0)
         goto error;
 
+    return msg;
+
+ error:
+    virNetMessageFree(msg);
+    return NULL;
+}
+
+
+static int
+virNetClientProgramCheckReply(virNetClientProgramPtr prog,
+                              virNetMessagePtr msg,
+                              unsigned serial,
+                              int proc,
+                              size_t *ninfds,
+                              int **infds,
+                              xdrproc_t ret_filter, void *ret)
+{
+    size_t i;
+
     /* None of these 3 should ever happen here, because
      * virNetClientSend should have validated the reply,
      * but it doesn't hurt to check again.
@@ -386,15 +406,130 @@ int virNetClientProgramCall(virNetClientProgramPtr prog,
         goto error;
     }
 
-    virNetMessageFree(msg);
-
     return 0;
 
  error:
-    virNetMessageFree(msg);
     if (infds && ninfds) {
         for (i = 0; i < *ninfds; i++)
             VIR_FORCE_CLOSE((*infds)[i]);
     }
     return -1;
 }
+
+
+int virNetClientProgramCall(virNetClientProgramPtr prog,
+                            virNetClientPtr client,
+                            unsigned serial,
+                            int proc,
+                            size_t noutfds,
+                            int *outfds,
+                            size_t *ninfds,
+                            int **infds,
+                            xdrproc_t args_filter, void *args,
+                            xdrproc_t ret_filter, void *ret)
+{
+    virNetMessagePtr msg;
+    int rv = -1;
+
+    if (infds)
+        *infds = NULL;
+    if (ninfds)
+        *ninfds = 0;
+
+    if (!(msg = virNetClientProgramNewCall(prog, client, serial, proc,
+                                           noutfds, outfds,
+                                           args_filter, args)))
+        return -1;
+
+    if (virNetClientSendWithReply(client, msg) < 0)
+        goto cleanup;
+
+    rv = virNetClientProgramCheckReply(prog, msg, serial, proc,
+                                       ninfds, infds, ret_filter, ret);
+
+ cleanup:
+    virNetMessageFree(msg);
+    return rv;
+}
+
+
+struct virNetClientProgramAsyncCall {
+    virNetClientProgramPtr prog;
+    unsigned serial;
+    int proc;
+    xdrproc_t ret_filter;
+    void *ret;
+    virNetClientProgramCallFunc func;
+    void *opaque;
+};
+
+
+static void
+virNetClientProgramCallAsyncDone(virNetClientPtr client,
+                                 virNetMessagePtr msg,
+                                 int status,
+                                 void *opaque)
+{
+    struct virNetClientProgramAsyncCall *call = opaque;
+
+    if (status == 0)
+        status = virNetClientProgramCheckReply(call->prog, msg,
+                                               call->serial, call->proc,
+                                               NULL, NULL,
+                                               call->ret_filter, call->ret);
+
+    call->func(call->prog, client, status, call->opaque);
+
+    virObjectUnref(call->prog);
+    g_free(call);
+}
+
+
+/**
+ * virNetClientProgramCallAsync:
+ *
+ * Like virNetClientProgramCall, but returns once the call was queued
+ * instead of waiting for the reply. When the reply arrives it is
+ * decoded into @ret, which must stay valid until then, and @func is
+ * called with 0 on success or -1 with an error set, see
+ * virNetClientSendAsync for the thread it runs in. Passing file
+ * descriptors is not supported.
+ *
+ * Returns 0 if the call was queued and @func is going to be called,
+ * -1 on error.
+ */
+int virNetClientProgramCallAsync(virNetClientProgramPtr prog,
+                                 virNetClientPtr client,
+                                 unsigned serial,
+                                 int proc,
+                                 xdrproc_t args_filter, void *args,
+                                 xdrproc_t ret_filter, void *ret,
+                                 virNetClientProgramCallFunc func,
+                                 void *opaque)
+{
+    struct virNetClientProgramAsyncCall *call;
+    virNetMessagePtr msg;
+
+    if (!(msg = virNetClientProgramNewCall(prog, client, serial, proc,
+                                           0, NULL, args_filter, args)))
+        return -1;
+
+    call = g_new0(struct virNetClientProgramAsyncCall, 1);
+    call->prog = virObjectRef(prog);
+    call->serial = serial;
+    call->proc = proc;
+    call->ret_filter = ret_filter;
+    call->ret = ret;
+    call->func = func;
+    call->opaque = opaque;
+
+    if (virNetClientSendAsync(client, msg,
+                              virNetClientProgramCallAsyncDone, call) < 0) {
+        virObjectUnref(call->prog);
+        g_free(call);
+        virNetMessageFree(msg);
+        return -1;
+    }
+
+    return 0;
+}
@@ -77,3 +77,17 @@ int virNetClientProgramCall(virNetClientProgramPtr prog,
                             int **infds,
                             xdrproc_t args_filter, void *args,
                             xdrproc_t ret_filter, void *ret);
+
+typedef void (*virNetClientProgramCallFunc)(virNetClientProgramPtr prog,
+                                            virNetClientPtr client,
+                                            int ret,
+                                            void *opaque);
+
+int virNetClientProgramCallAsync(virNetClientProgramPtr prog,
+                                 virNetClientPtr client,
+                                 unsigned serial,
+                                 int proc,
+                                 xdrproc_t args_filter, void *args,
+                                 xdrproc_t ret_filter, void *ret,
+                                 virNetClientProgramCallFunc func,
+                                 void *opaque);
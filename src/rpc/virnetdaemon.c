@@ -27,6 +27,7 @@
 #include "virlog.h"
 #include "viralloc.h"
 #include "virerror.h"
+#include "vireventthread.h"
 #include "virthread.h"
 #include "virthreadpool.h"
 #include "virutil.h"
@@ -821,6 +822,10 @@ virNetDaemonRun(virNetDaemonPtr dmn)
         goto cleanup;
     }
 
+    /* Measure how responsive the main loop is for
+     * virAdmServerGetStats */
+    virEventThreadStartDefaultLatencyProbe();
+
     /* We are accepting connections now. Notify systemd
      * so it can start dependent services. */
     virSystemdNotifyStartup();
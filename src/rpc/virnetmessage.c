@@ -29,11 +29,159 @@
 #include "virfile.h"
 #include "virutil.h"
 #include "virstring.h"
+#include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_RPC
 
 VIR_LOG_INIT("rpc.netmessage");
 
+/* Most messages fit into the initial buffer, stream data into the
+ * legacy payload size. Buffers of these sizes are recycled instead of
+ * being freed, larger ones are allocated for each message. */
+static const size_t virNetMessagePoolClasses[] = {
+    VIR_NET_MESSAGE_INITIAL + VIR_NET_MESSAGE_LEN_MAX,
+    VIR_NET_MESSAGE_INITIAL * 4 + VIR_NET_MESSAGE_LEN_MAX,
+};
+
+/* Maximum number of idle buffers kept per size class */
+#define VIR_NET_MESSAGE_POOL_MAX_IDLE 32
+
+typedef struct _virNetMessagePoolClass virNetMessagePoolClass;
+struct _virNetMessagePoolClass {
+    char *idle[VIR_NET_MESSAGE_POOL_MAX_IDLE];
+    size_t nidle;
+};
+
+static virMutex virNetMessagePoolLock = VIR_MUTEX_INITIALIZER;
+static virNetMessagePoolClass virNetMessagePool[G_N_ELEMENTS(virNetMessagePoolClasses)];
+static virNetMessagePoolStats virNetMessagePoolCounters;
+
+
+static char *
+virNetMessagePoolGet(size_t len,
+                     size_t *size)
+{
+    char *buf = NULL;
+    size_t i;
+
+    for (i = 0; i < G_N_ELEMENTS(virNetMessagePoolClasses); i++) {
+        if (len <= virNetMessagePoolClasses[i])
+            break;
+    }
+
+    if (i == G_N_ELEMENTS(virNetMessagePoolClasses)) {
+        *size = len;
+        return g_new(char, len);
+    }
+
+    *size = virNetMessagePoolClasses[i];
+
+    virMutexLock(&virNetMessagePoolLock);
+    if (virNetMessagePool[i].nidle > 0) {
+        buf = virNetMessagePool[i].idle[--virNetMessagePool[i].nidle];
+        virNetMessagePoolCounters.hits++;
+    } else {
+        virNetMessagePoolCounters.misses++;
+    }
+    virMutexUnlock(&virNetMessagePoolLock);
+
+    if (!buf)
+        buf = g_new(char, *size);
+
+    return buf;
+}
+
+
+static void
+virNetMessagePoolPut(char *buf,
+                     size_t size)
+{
+    size_t i;
+
+    if (!buf)
+        return;
+
+    for (i = 0; i < G_N_ELEMENTS(virNetMessagePoolClasses); i++) {
+        if (size == virNetMessagePoolClasses[i])
+            break;
+    }
+
+    if (i == G_N_ELEMENTS(virNetMessagePoolClasses)) {
+        g_free(buf);
+        return;
+    }
+
+    virMutexLock(&virNetMessagePoolLock);
+    if (virNetMessagePool[i].nidle < VIR_NET_MESSAGE_POOL_MAX_IDLE) {
+        virNetMessagePool[i].idle[virNetMessagePool[i].nidle++] = buf;
+        virNetMessagePoolCounters.recycled++;
+        buf = NULL;
+    } else {
+        virNetMessagePoolCounters.dropped++;
+    }
+    virMutexUnlock(&virNetMessagePoolLock);
+
+    g_free(buf);
+}
+
+
+/**
+ * virNetMessagePoolGetStats:
+ * @stats: filled in with the counters of the message buffer pool
+ *
+ * Reports how often message buffers were served from the pool of idle
+ * buffers (@hits) or had to be allocated (@misses), and how often
+ * released buffers were kept for reuse (@recycled) or freed because
+ * the pool was full (@dropped). @idle is the number of buffers
+ * currently kept in the pool.
+ */
+void
+virNetMessagePoolGetStats(virNetMessagePoolStatsPtr stats)
+{
+    size_t i;
+
+    virMutexLock(&virNetMessagePoolLock);
+    *stats = virNetMessagePoolCounters;
+    stats->idle = 0;
+    for (i = 0; i < G_N_ELEMENTS(virNetMessagePoolClasses); i++)
+        stats->idle += virNetMessagePool[i].nidle;
+    virMutexUnlock(&virNetMessagePoolLock);
+}
+
+
+/**
+ * virNetMessageResizeBuffer:
+ * @msg: the message
+ * @len: new length of the message buffer
+ *
+ * Sets the length of @msg's buffer to @len, preserving its current
+ * contents up to @len. The buffer is replaced only if its allocated
+ * size is too small, in which case a recycled one is used if possible.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNetMessageResizeBuffer(virNetMessagePtr msg,
+                          size_t len)
+{
+    char *buf;
+    size_t size;
+
+    if (len > msg->bufferSize) {
+        buf = virNetMessagePoolGet(len, &size);
+
+        if (msg->buffer)
+            memcpy(buf, msg->buffer, MIN(msg->bufferLength, len));
+
+        virNetMessagePoolPut(msg->buffer, msg->bufferSize);
+        msg->buffer = buf;
+        msg->bufferSize = size;
+    }
+
+    msg->bufferLength = len;
+    return 0;
+}
+
 virNetMessagePtr virNetMessageNew(bool tracked)
 {
     virNetMessagePtr msg;
@@ -60,9 +208,12 @@ virNetMessageClearPayload(virNetMessagePtr msg)
     msg->nfds = 0;
     VIR_FREE(msg->fds);
 
+    VIR_FREE(msg->eventKey);
+
+    virNetMessagePoolPut(g_steal_pointer(&msg->buffer), msg->bufferSize);
     msg->bufferOffset = 0;
     msg->bufferLength = 0;
-    VIR_FREE(msg->buffer);
+    msg->bufferSize = 0;
 }
 
 
@@ -152,8 +303,7 @@ int virNetMessageDecodeLength(virNetMessagePtr msg)
 
     /* Extend our declared buffer length and carry
        on reading the header + payload */
-    msg->bufferLength += len;
-    if (VIR_REALLOC_N(msg->buffer, msg->bufferLength) < 0)
+    if (virNetMessageResizeBuffer(msg, msg->bufferLength + len) < 0)
         goto cleanup;
 
     VIR_DEBUG("Got length, now need %zu total (%u more)",
@@ -229,8 +379,8 @@ int virNetMessageEncodeHeader(virNetMessagePtr msg)
     int ret = -1;
     unsigned int len = 0;
 
-    msg->bufferLength = VIR_NET_MESSAGE_INITIAL + VIR_NET_MESSAGE_LEN_MAX;
-    if (VIR_REALLOC_N(msg->buffer, msg->bufferLength) < 0)
+    if (virNetMessageResizeBuffer(msg, VIR_NET_MESSAGE_INITIAL +
+                                  VIR_NET_MESSAGE_LEN_MAX) < 0)
         return ret;
     msg->bufferOffset = 0;
 
@@ -344,9 +494,85 @@ int virNetMessageDecodeNumFDs(virNetMessagePtr msg)
 }
 
 
-int virNetMessageEncodePayload(virNetMessagePtr msg,
-                               xdrproc_t filter,
-                               void *data)
+/**
+ * virNetMessageEncodeTrace:
+ * @msg: message to encode the trace context of
+ *
+ * Appends @msg->trace to the message, which has to be a
+ * VIR_NET_CALL_WITH_TRACE whose header was already encoded.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int virNetMessageEncodeTrace(virNetMessagePtr msg)
+{
+    XDR xdr;
+    virNetMessageTraceContext ctx;
+    int ret = -1;
+
+    G_STATIC_ASSERT(sizeof(ctx.trace_id) == sizeof(msg->trace.traceID));
+    G_STATIC_ASSERT(sizeof(ctx.span_id) == sizeof(msg->trace.spanID));
+
+    memcpy(ctx.trace_id, msg->trace.traceID, sizeof(ctx.trace_id));
+    memcpy(ctx.span_id, msg->trace.spanID, sizeof(ctx.span_id));
+
+    xdrmem_create(&xdr, msg->buffer + msg->bufferOffset,
+                  msg->bufferLength - msg->bufferOffset, XDR_ENCODE);
+
+    if (!xdr_virNetMessageTraceContext(&xdr, &ctx)) {
+        virReportError(VIR_ERR_RPC, "%s", _("Unable to encode trace context"));
+        goto cleanup;
+    }
+    msg->bufferOffset += xdr_getpos(&xdr);
+
+    ret = 0;
+
+ cleanup:
+    xdr_destroy(&xdr);
+    return ret;
+}
+
+
+/**
+ * virNetMessageDecodeTrace:
+ * @msg: message to decode the trace context of
+ *
+ * Decodes the trace context following the header of a
+ * VIR_NET_CALL_WITH_TRACE into @msg->trace.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int virNetMessageDecodeTrace(virNetMessagePtr msg)
+{
+    XDR xdr;
+    virNetMessageTraceContext ctx;
+    int ret = -1;
+
+    xdrmem_create(&xdr, msg->buffer + msg->bufferOffset,
+                  msg->bufferLength - msg->bufferOffset, XDR_DECODE);
+
+    if (!xdr_virNetMessageTraceContext(&xdr, &ctx)) {
+        virReportError(VIR_ERR_RPC, "%s", _("Unable to decode trace context"));
+        goto cleanup;
+    }
+    msg->bufferOffset += xdr_getpos(&xdr);
+
+    memcpy(msg->trace.traceID, ctx.trace_id, sizeof(ctx.trace_id));
+    memcpy(msg->trace.spanID, ctx.span_id, sizeof(ctx.span_id));
+    msg->hasTrace = true;
+
+    ret = 0;
+
+ cleanup:
+    xdr_destroy(&xdr);
+    return ret;
+}
+
+
+static int
+virNetMessageEncodePayloadMax(virNetMessagePtr msg,
+                              xdrproc_t filter,
+                              void *data,
+                              size_t maxlen)
 {
     XDR xdr;
     unsigned int msglen;
@@ -362,16 +588,14 @@ int virNetMessageEncodePayload(virNetMessagePtr msg,
         unsigned int newlen = msg->bufferLength - VIR_NET_MESSAGE_LEN_MAX;
         newlen *= 2;
 
-        if (newlen > VIR_NET_MESSAGE_MAX) {
+        if (newlen > maxlen) {
             virReportError(VIR_ERR_RPC, "%s", _("Unable to encode message payload"));
             goto error;
         }
 
         xdr_destroy(&xdr);
 
-        msg->bufferLength = newlen + VIR_NET_MESSAGE_LEN_MAX;
-
-        if (VIR_REALLOC_N(msg->buffer, msg->bufferLength) < 0)
+        if (virNetMessageResizeBuffer(msg, newlen + VIR_NET_MESSAGE_LEN_MAX) < 0)
             goto error;
 
         xdrmem_create(&xdr, msg->buffer + msg->bufferOffset,
@@ -404,6 +628,88 @@ int virNetMessageEncodePayload(virNetMessagePtr msg,
 }
 
 
+int virNetMessageEncodePayload(virNetMessagePtr msg,
+                               xdrproc_t filter,
+                               void *data)
+{
+    return virNetMessageEncodePayloadMax(msg, filter, data,
+                                         VIR_NET_MESSAGE_MAX);
+}
+
+
+/**
+ * virNetMessageEncodePayloadChunked:
+ * @msg: the message, with header already encoded
+ * @filter: XDR filter of the payload
+ * @data: the payload
+ * @chunks: filled with a queue of leading parts of the payload
+ *
+ * Like virNetMessageEncodePayload, except that a payload too large
+ * for a single message, up to VIR_NET_MESSAGE_CHUNKED_MAX, is split
+ * into several messages. All but the last part are returned in
+ * @chunks as messages with the same header as @msg and status
+ * VIR_NET_CONTINUE, which the peer joins again in the order they
+ * were sent. @msg is left with the last part of the payload and
+ * must be sent after all of @chunks. @chunks is left NULL if the
+ * payload fits into @msg.
+ *
+ * Returns 0 on success, -1 on error
+ */
+int virNetMessageEncodePayloadChunked(virNetMessagePtr msg,
+                                      xdrproc_t filter,
+                                      void *data,
+                                      virNetMessagePtr *chunks)
+{
+    size_t hdrlen = msg->bufferOffset;
+    size_t chunklen = VIR_NET_MESSAGE_MAX + VIR_NET_MESSAGE_LEN_MAX - hdrlen;
+    size_t offset = hdrlen;
+    size_t lastlen;
+
+    *chunks = NULL;
+
+    if (virNetMessageEncodePayloadMax(msg, filter, data,
+                                      VIR_NET_MESSAGE_CHUNKED_MAX) < 0)
+        return -1;
+
+    if (msg->bufferLength <= VIR_NET_MESSAGE_MAX + VIR_NET_MESSAGE_LEN_MAX)
+        return 0;
+
+    while (msg->bufferLength - offset > chunklen) {
+        virNetMessagePtr chunk;
+
+        if (!(chunk = virNetMessageNew(false)))
+            goto error;
+
+        chunk->header = msg->header;
+        chunk->header.status = VIR_NET_CONTINUE;
+
+        if (virNetMessageEncodeHeader(chunk) < 0 ||
+            virNetMessageEncodePayloadRaw(chunk, msg->buffer + offset,
+                                          chunklen) < 0) {
+            virNetMessageFree(chunk);
+            goto error;
+        }
+
+        virNetMessageQueuePush(chunks, chunk);
+        offset += chunklen;
+    }
+
+    VIR_DEBUG("Split %zu bytes of payload in chunks of %zu bytes",
+              msg->bufferLength - hdrlen, chunklen);
+
+    /* Keep the last part in @msg, its header is unchanged */
+    lastlen = msg->bufferLength - offset;
+    memmove(msg->buffer + hdrlen, msg->buffer + offset, lastlen);
+    msg->bufferOffset = hdrlen;
+    return virNetMessageCommitPayloadRaw(msg, lastlen);
+
+ error:
+    while (*chunks)
+        virNetMessageFree(virNetMessageQueueServe(chunks));
+    return -1;
+}
+
+
 int virNetMessageDecodePayload(virNetMessagePtr msg,
                                xdrproc_t filter,
                                void *data)
@@ -432,13 +738,15 @@ int virNetMessageDecodePayload(virNetMessagePtr msg,
 }
 
 
-int virNetMessageEncodePayloadRaw(virNetMessagePtr msg,
-                                  const char *data,
-                                  size_t len)
+/*
+ * Makes room for @len bytes of raw stream data after the already encoded
+ * header and returns a pointer to it, so that producers can write the
+ * payload in place. virNetMessageCommitPayloadRaw must be called once
+ * the data is there.
+ */
+char *virNetMessageReservePayloadRaw(virNetMessagePtr msg,
+                                     size_t len)
 {
-    XDR xdr;
-    unsigned int msglen;
-
     /* If the message buffer is too small for the payload increase it accordingly. */
     if ((msg->bufferLength - msg->bufferOffset) < len) {
         if ((msg->bufferOffset + len) >
@@ -450,18 +758,37 @@ int virNetMessageEncodePayloadRaw(virNetMessagePtr msg,
                            VIR_NET_MESSAGE_MAX +
                            VIR_NET_MESSAGE_LEN_MAX -
                            msg->bufferOffset);
-            return -1;
+            return NULL;
         }
 
-        msg->bufferLength = msg->bufferOffset + len;
-
-        if (VIR_REALLOC_N(msg->buffer, msg->bufferLength) < 0)
-            return -1;
+        if (virNetMessageResizeBuffer(msg, msg->bufferOffset + len) < 0)
+            return NULL;
 
         VIR_DEBUG("Increased message buffer length = %zu", msg->bufferLength);
     }
 
-    memcpy(msg->buffer + msg->bufferOffset, data, len);
+    return msg->buffer + msg->bufferOffset;
+}
+
+
+/*
+ * Finishes a payload of @len bytes written into the space returned by
+ * virNetMessageReservePayloadRaw. @len may be smaller than the amount
+ * reserved.
+ */
+int virNetMessageCommitPayloadRaw(virNetMessagePtr msg,
+                                  size_t len)
+{
+    XDR xdr;
+    unsigned int msglen;
+
+    if (len > msg->bufferLength - msg->bufferOffset) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Stream data length %zu exceeds reserved space"),
+                       len);
+        return -1;
+    }
+
     msg->bufferOffset += len;
 
     /* Re-encode the length word. */
@@ -484,6 +811,80 @@ int virNetMessageEncodePayloadRaw(virNetMessagePtr msg,
 }
 
 
+int virNetMessageEncodePayloadRaw(virNetMessagePtr msg,
+                                  const char *data,
+                                  size_t len)
+{
+    char *payload;
+
+    if (!(payload = virNetMessageReservePayloadRaw(msg, len)))
+        return -1;
+
+    if (len)
+        memcpy(payload, data, len);
+
+    return virNetMessageCommitPayloadRaw(msg, len);
+}
+
+
+/**
+ * virNetMessageEncodePayloadRawChunked:
+ * @msg: the message, with header already encoded
+ * @data: encoded payload
+ * @len: length of @data
+ * @chunks: filled with a queue of leading parts of the payload
+ *
+ * Like virNetMessageEncodePayloadChunked, but for a payload which is
+ * already encoded, e.g. one received from another peer.
+ *
+ * Returns 0 on success, -1 on error
+ */
+int virNetMessageEncodePayloadRawChunked(virNetMessagePtr msg,
+                                         const char *data,
+                                         size_t len,
+                                         virNetMessagePtr *chunks)
+{
+    size_t chunklen = VIR_NET_MESSAGE_MAX + VIR_NET_MESSAGE_LEN_MAX -
+                      msg->bufferOffset;
+
+    *chunks = NULL;
+
+    if (len > VIR_NET_MESSAGE_CHUNKED_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("payload of %zu bytes exceeds maximum size %d"),
+                       len, VIR_NET_MESSAGE_CHUNKED_MAX);
+        return -1;
+    }
+
+    while (len > chunklen) {
+        virNetMessagePtr chunk;
+
+        if (!(chunk = virNetMessageNew(false)))
+            goto error;
+
+        chunk->header = msg->header;
+        chunk->header.status = VIR_NET_CONTINUE;
+
+        if (virNetMessageEncodeHeader(chunk) < 0 ||
+            virNetMessageEncodePayloadRaw(chunk, data, chunklen) < 0) {
+            virNetMessageFree(chunk);
+            goto error;
+        }
+
+        virNetMessageQueuePush(chunks, chunk);
+        data += chunklen;
+        len -= chunklen;
+    }
+
+    return virNetMessageEncodePayloadRaw(msg, data, len);
+
+ error:
+    while (*chunks)
+        virNetMessageFree(virNetMessageQueueServe(chunks));
+    return -1;
+}
+
+
 int virNetMessageEncodePayloadEmpty(virNetMessagePtr msg)
 {
     XDR xdr;
@@ -509,6 +910,61 @@ int virNetMessageEncodePayloadEmpty(virNetMessagePtr msg)
 }
 
 
+/*
+ * Creates an empty VIR_NET_MESSAGE_BATCH message, to which async
+ * messages are added by virNetMessageBatchAppend.
+ */
+virNetMessagePtr virNetMessageBatchNew(void)
+{
+    virNetMessagePtr batch;
+
+    if (!(batch = virNetMessageNew(false)))
+        return NULL;
+
+    batch->header.type = VIR_NET_MESSAGE_BATCH;
+    batch->header.status = VIR_NET_OK;
+
+    if (virNetMessageEncodeHeader(batch) < 0 ||
+        virNetMessageEncodePayloadEmpty(batch) < 0) {
+        virNetMessageFree(batch);
+        return NULL;
+    }
+
+    return batch;
+}
+
+
+/*
+ * Appends the complete, encoded async message @msg to @batch, length
+ * word included, so that the receiver can process it as if it was
+ * received on its own.
+ *
+ * Returns 0 on success, 1 if @batch has no room left for @msg, -1 on
+ * error
+ */
+int virNetMessageBatchAppend(virNetMessagePtr batch,
+                             virNetMessagePtr msg)
+{
+    char *payload;
+
+    if (batch->bufferLength + msg->bufferLength >
+        VIR_NET_MESSAGE_MAX + VIR_NET_MESSAGE_LEN_MAX)
+        return 1;
+
+    batch->bufferOffset = batch->bufferLength;
+    if (!(payload = virNetMessageReservePayloadRaw(batch, msg->bufferLength)))
+        return -1;
+
+    memcpy(payload, msg->buffer, msg->bufferLength);
+
+    if (virNetMessageCommitPayloadRaw(batch, msg->bufferLength) < 0)
+        return -1;
+
+    batch->nbatched++;
+    return 0;
+}
+
+
 void virNetMessageSaveError(virNetMessageErrorPtr rerr)
 {
     /* This func may be called several times & the first
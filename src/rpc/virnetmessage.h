@@ -21,6 +21,7 @@
 #pragma once
 
 #include "virnetprotocol.h"
+#include "virtrace.h"
 
 typedef struct virNetMessageHeader *virNetMessageHeaderPtr;
 typedef struct virNetMessageError *virNetMessageErrorPtr;
@@ -37,6 +38,7 @@ struct _virNetMessage {
                   /* Maximum   VIR_NET_MESSAGE_MAX     + VIR_NET_MESSAGE_LEN_MAX */
     size_t bufferLength;
     size_t bufferOffset;
+    size_t bufferSize; /* allocated size of @buffer, see virNetMessageResizeBuffer */
 
     virNetMessageHeader header;
 
@@ -47,12 +49,38 @@ struct _virNetMessage {
     int *fds;
     size_t donefds;
 
+    long long queued; /* monotonic time (us) when queued for dispatch */
+
+    bool hasTrace; /* @trace came with a VIR_NET_CALL_WITH_TRACE */
+    virTraceContext trace;
+
+    bool event; /* asynchronous event, see virNetServerClientSendEvent */
+    char *eventKey; /* events with equal keys supersede each other */
+    size_t nbatched; /* events carried by a VIR_NET_MESSAGE_BATCH */
+
     virNetMessagePtr next;
 };
 
+typedef struct _virNetMessagePoolStats virNetMessagePoolStats;
+typedef virNetMessagePoolStats *virNetMessagePoolStatsPtr;
+struct _virNetMessagePoolStats {
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long recycled;
+    unsigned long long dropped;
+    size_t idle;
+};
+
 
 virNetMessagePtr virNetMessageNew(bool tracked);
 
+int virNetMessageResizeBuffer(virNetMessagePtr msg,
+                              size_t len)
+    ATTRIBUTE_NONNULL(1) G_GNUC_WARN_UNUSED_RESULT;
+
+void virNetMessagePoolGetStats(virNetMessagePoolStatsPtr stats)
+    ATTRIBUTE_NONNULL(1);
+
 void virNetMessageClearPayload(virNetMessagePtr msg);
 
 void virNetMessageClear(virNetMessagePtr);
@@ -76,6 +104,11 @@ int virNetMessageEncodePayload(virNetMessagePtr msg,
                                xdrproc_t filter,
                                void *data)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(2) G_GNUC_WARN_UNUSED_RESULT;
+int virNetMessageEncodePayloadChunked(virNetMessagePtr msg,
+                                      xdrproc_t filter,
+                                      void *data,
+                                      virNetMessagePtr *chunks)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(4) G_GNUC_WARN_UNUSED_RESULT;
 int virNetMessageDecodePayload(virNetMessagePtr msg,
                                xdrproc_t filter,
                                void *data)
@@ -84,13 +117,34 @@ int virNetMessageDecodePayload(virNetMessagePtr msg,
 int virNetMessageEncodeNumFDs(virNetMessagePtr msg);
 int virNetMessageDecodeNumFDs(virNetMessagePtr msg);
 
+int virNetMessageEncodeTrace(virNetMessagePtr msg)
+    ATTRIBUTE_NONNULL(1) G_GNUC_WARN_UNUSED_RESULT;
+int virNetMessageDecodeTrace(virNetMessagePtr msg)
+    ATTRIBUTE_NONNULL(1) G_GNUC_WARN_UNUSED_RESULT;
+
 int virNetMessageEncodePayloadRaw(virNetMessagePtr msg,
                                   const char *buf,
                                   size_t len)
     ATTRIBUTE_NONNULL(1) G_GNUC_WARN_UNUSED_RESULT;
+char *virNetMessageReservePayloadRaw(virNetMessagePtr msg,
+                                     size_t len)
+    ATTRIBUTE_NONNULL(1) G_GNUC_WARN_UNUSED_RESULT;
+int virNetMessageCommitPayloadRaw(virNetMessagePtr msg,
+                                  size_t len)
+    ATTRIBUTE_NONNULL(1) G_GNUC_WARN_UNUSED_RESULT;
+int virNetMessageEncodePayloadRawChunked(virNetMessagePtr msg,
+                                         const char *data,
+                                         size_t len,
+                                         virNetMessagePtr *chunks)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(4) G_GNUC_WARN_UNUSED_RESULT;
 int virNetMessageEncodePayloadEmpty(virNetMessagePtr msg)
     ATTRIBUTE_NONNULL(1) G_GNUC_WARN_UNUSED_RESULT;
 
+virNetMessagePtr virNetMessageBatchNew(void);
+int virNetMessageBatchAppend(virNetMessagePtr batch,
+                             virNetMessagePtr msg)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) G_GNUC_WARN_UNUSED_RESULT;
+
 void virNetMessageSaveError(virNetMessageErrorPtr rerr)
     ATTRIBUTE_NONNULL(1);
 
@@ -40,6 +40,11 @@ const VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX = 262120;
 /* Maximum total message size (serialised). */
 const VIR_NET_MESSAGE_MAX = 33554432;
 
+/* Maximum total size of a reply (serialised) which is split
+ * into several messages, see VIR_NET_REPLY below.
+ */
+const VIR_NET_MESSAGE_CHUNKED_MAX = 268435456;
+
 /* Size of struct virNetMessageHeader (serialised)*/
 const VIR_NET_MESSAGE_HEADER_MAX = 24;
 
@@ -75,7 +80,7 @@ const VIR_NET_MESSAGE_NUM_FDS_MAX = 32;
  *
  * In header, the 'serial' field varies according to:
  *
- *  - type == VIR_NET_CALL
+ *  - type == VIR_NET_CALL or VIR_NET_CALL_WITH_TRACE
  *      * serial is set by client, incrementing by 1 each time
  *
  *  - type == VIR_NET_REPLY
@@ -84,6 +89,9 @@ const VIR_NET_MESSAGE_NUM_FDS_MAX = 32;
  *  - type == VIR_NET_MESSAGE
  *      * serial is always zero
  *
+ *  - type == VIR_NET_MESSAGE_BATCH
+ *      * serial is always zero
+ *
  *  - type == VIR_NET_STREAM
  *      * serial matches that from the corresponding VIR_NET_CALL
  *
@@ -95,10 +103,15 @@ const VIR_NET_MESSAGE_NUM_FDS_MAX = 32;
  *  - type == VIR_NET_REPLY
  *     * VIR_NET_OK if RPC finished successfully
  *     * VIR_NET_ERROR if something failed
+ *     * VIR_NET_CONTINUE if more parts of the reply are following
+ *       (only sent to clients which enabled chunked replies)
  *
  *  - type == VIR_NET_MESSAGE
  *     * VIR_NET_OK always
  *
+ *  - type == VIR_NET_MESSAGE_BATCH
+ *     * VIR_NET_OK always
+ *
  *  - type == VIR_NET_STREAM
  *     * VIR_NET_CONTINUE if more data is following
  *     * VIR_NET_OK if stream is complete
@@ -116,11 +129,25 @@ const VIR_NET_MESSAGE_NUM_FDS_MAX = 32;
  *          XXX_ret         for procedure
  *     * status == VIR_NET_ERROR
  *          remote_error    Error information
+ *     * status == VIR_NET_CONTINUE
+ *          byte[]          leading part of the serialised XXX_ret,
+ *                          the remainder follows in further
+ *                          VIR_NET_REPLY messages with the same
+ *                          serial, the last one with VIR_NET_OK
  *
  *  - type == VIR_NET_MESSAGE
  *     * status == VIR_NET_OK
  *          XXX_msg        for event information
  *
+ *  - type == VIR_NET_MESSAGE_BATCH
+ *     * status == VIR_NET_OK
+ *          byte[]         several complete VIR_NET_MESSAGE messages,
+ *                         each with its own length word and header,
+ *                         possibly of different programs. The
+ *                         program, version and procedure of the
+ *                         batch itself are zero. Only sent to
+ *                         clients which enabled event batches.
+ *
  *  - type == VIR_NET_STREAM
  *     * status == VIR_NET_CONTINUE
  *          byte[]       raw stream data
@@ -149,6 +176,12 @@ const VIR_NET_MESSAGE_NUM_FDS_MAX = 32;
  *     * status == VIR_NET_OK
  *          <empty>
  *
+ *  - type == VIR_NET_CALL_WITH_TRACE
+ *          virNetMessageTraceContext - span the call is part of
+ *          XXX_args  for procedure
+ *       Only sent to servers which support VIR_DRV_FEATURE_REMOTE_TRACE_CONTEXT.
+ *       The reply is a plain VIR_NET_REPLY.
+ *
  */
 enum virNetMessageType {
     /* client -> server. args from a method call */
@@ -164,7 +197,11 @@ enum virNetMessageType {
     /* server -> client. reply/error from a method call, with passed FDs */
     VIR_NET_REPLY_WITH_FDS = 5,
     /* either direction, stream hole data packet */
-    VIR_NET_STREAM_HOLE = 6
+    VIR_NET_STREAM_HOLE = 6,
+    /* server -> client. several async notifications */
+    VIR_NET_MESSAGE_BATCH = 7,
+    /* client -> server. args from a method call, with trace context */
+    VIR_NET_CALL_WITH_TRACE = 8
 };
 
 enum virNetMessageStatus {
@@ -195,6 +232,15 @@ struct virNetMessageHeader {
     virNetMessageStatus status;
 };
 
+/* Trace context of a VIR_NET_CALL_WITH_TRACE, as in a W3C traceparent */
+const VIR_NET_MESSAGE_TRACE_ID_LEN = 16;
+const VIR_NET_MESSAGE_TRACE_SPAN_ID_LEN = 8;
+
+struct virNetMessageTraceContext {
+    opaque trace_id[VIR_NET_MESSAGE_TRACE_ID_LEN];
+    opaque span_id[VIR_NET_MESSAGE_TRACE_SPAN_ID_LEN];
+};
+
 /* Error message. See <virterror.h> for explanation of fields. */
 
 /* Most of these don't really belong here. There are sadly needed
@@ -25,6 +25,7 @@
 #include "virlog.h"
 #include "viralloc.h"
 #include "virerror.h"
+#include "vireventthread.h"
 #include "virthread.h"
 #include "virthreadpool.h"
 #include "virstring.h"
@@ -68,6 +69,12 @@ struct _virNetServer {
     int keepaliveInterval;
     unsigned int keepaliveCount;
 
+    /* Threads dispatching I/O of clients, assigned round robin.
+     * Without any, client I/O is dispatched by the main loop */
+    size_t neventThreads;
+    virEventThread **eventThreads;
+    size_t nextEventThread;
+
     virNetTLSContextPtr tls;
 
     virNetServerClientPrivNew clientPrivNew;
@@ -116,7 +123,8 @@ static int virNetServerProcessMsg(virNetServerPtr srv,
          * must just log it & drop them
          */
         if (msg->header.type == VIR_NET_CALL ||
-            msg->header.type == VIR_NET_CALL_WITH_FDS) {
+            msg->header.type == VIR_NET_CALL_WITH_FDS ||
+            msg->header.type == VIR_NET_CALL_WITH_TRACE) {
             if (virNetServerProgramUnknownError(client,
                                                 msg,
                                                 &msg->header) < 0)
@@ -200,6 +208,8 @@ virNetServerDispatchNewMessage(virNetServerClientPtr client,
     VIR_DEBUG("server=%p client=%p message=%p",
               srv, client, msg);
 
+    msg->queued = g_get_monotonic_time();
+
     virObjectLock(srv);
     prog = virNetServerGetProgramLocked(srv, msg);
     /* we can unlock @srv since @prog can only become invalid in case
@@ -222,7 +232,10 @@ virNetServerDispatchNewMessage(virNetServerClientPtr client,
             priority = virNetServerProgramGetPriority(prog, msg->header.proc);
         }
 
-        if (virThreadPoolSendJob(srv->workers, priority, job) < 0) {
+        /* Jobs are grouped by client so that a client with many
+         * requests in progress doesn't starve the others */
+        if (virThreadPoolSendJobGroup(srv->workers, priority,
+                                      client, job) < 0) {
             virObjectUnref(client);
             VIR_FREE(job);
             virObjectUnref(prog);
@@ -288,6 +301,20 @@ int virNetServerAddClient(virNetServerPtr srv,
 {
     virObjectLock(srv);
 
+    /* The dispatcher must be in place before I/O is watched, which with
+     * event threads may be handled right away by another thread */
+    virNetServerClientSetDispatcher(client,
+                                    virNetServerDispatchNewMessage,
+                                    srv);
+
+    if (srv->neventThreads > 0) {
+        virEventThread *evt;
+
+        evt = srv->eventThreads[srv->nextEventThread++ % srv->neventThreads];
+        virNetServerClientSetEventContext(client,
+                                          virEventThreadGetContext(evt));
+    }
+
     if (virNetServerClientInit(client) < 0)
         goto error;
 
@@ -302,10 +329,6 @@ int virNetServerAddClient(virNetServerPtr srv,
 
     virNetServerCheckLimits(srv);
 
-    virNetServerClientSetDispatcher(client,
-                                    virNetServerDispatchNewMessage,
-                                    srv);
-
     if (virNetServerClientInitKeepAlive(client, srv->keepaliveInterval,
                                         srv->keepaliveCount) < 0)
         goto error;
@@ -925,6 +948,10 @@ void virNetServerDispose(void *obj)
     for (i = 0; i < srv->nclients; i++)
         virObjectUnref(srv->clients[i]);
     VIR_FREE(srv->clients);
+
+    for (i = 0; i < srv->neventThreads; i++)
+        g_object_unref(srv->eventThreads[i]);
+    VIR_FREE(srv->eventThreads);
 }
 
 void virNetServerClose(virNetServerPtr srv)
@@ -1024,7 +1051,8 @@ virNetServerGetThreadPoolParameters(virNetServerPtr srv,
                                     size_t *nWorkers,
                                     size_t *freeWorkers,
                                     size_t *nPrioWorkers,
-                                    size_t *jobQueueDepth)
+                                    size_t *jobQueueDepth,
+                                    size_t *maxClientWorkers)
 {
     virObjectLock(srv);
 
@@ -1034,27 +1062,162 @@ virNetServerGetThreadPoolParameters(virNetServerPtr srv,
     *nWorkers = virThreadPoolGetCurrentWorkers(srv->workers);
     *nPrioWorkers = virThreadPoolGetPriorityWorkers(srv->workers);
     *jobQueueDepth = virThreadPoolGetJobQueueDepth(srv->workers);
+    *maxClientWorkers = virThreadPoolGetMaxGroupWorkers(srv->workers);
 
     virObjectUnlock(srv);
     return 0;
 }
 
+/**
+ * virNetServerGetWorkerStats:
+ * @srv: the server
+ * @stats: filled with statistics of the worker pool of @srv
+ *
+ * The caller has to free @stats->name.
+ */
+void
+virNetServerGetWorkerStats(virNetServerPtr srv,
+                           virThreadPoolStatsPtr stats)
+{
+    virObjectLock(srv);
+    virThreadPoolGetStats(srv->workers, stats);
+    virObjectUnlock(srv);
+}
+
 int
 virNetServerSetThreadPoolParameters(virNetServerPtr srv,
                                     long long int minWorkers,
                                     long long int maxWorkers,
-                                    long long int prioWorkers)
+                                    long long int prioWorkers,
+                                    long long int maxClientWorkers)
 {
     int ret;
 
     virObjectLock(srv);
     ret = virThreadPoolSetParameters(srv->workers, minWorkers,
-                                     maxWorkers, prioWorkers);
+                                     maxWorkers, prioWorkers,
+                                     maxClientWorkers);
     virObjectUnlock(srv);
 
     return ret;
 }
 
+/**
+ * virNetServerSetThreadCPUs:
+ * @srv: the server
+ * @cpus: host CPUs to confine the threads to or NULL
+ *
+ * Confines the workers processing calls of @srv and its event threads
+ * to @cpus, e.g. to the housekeeping CPUs of the host so that they stay
+ * off CPUs dedicated to guests. Event threads started later are not
+ * confined. Passing NULL removes the confinement of workers.
+ */
+void
+virNetServerSetThreadCPUs(virNetServerPtr srv,
+                          virBitmapPtr cpus)
+{
+    size_t i;
+
+    virObjectLock(srv);
+    virThreadPoolSetCPUs(srv->workers, cpus);
+    for (i = 0; cpus && i < srv->neventThreads; i++)
+        virEventThreadSetAffinity(srv->eventThreads[i], cpus);
+    virObjectUnlock(srv);
+}
+
+
+/**
+ * virNetServerSetEventThreads:
+ * @srv: the server
+ * @nthreads: number of threads to start
+ *
+ * Starts @nthreads threads running their own event loop and distributes
+ * I/O of clients connecting from now on between them, so that a slow
+ * callback only delays clients sharing its thread instead of the whole
+ * daemon. The latency of every loop is measured and reported by
+ * virNetServerGetEventThreadLatency. Can only be called once.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNetServerSetEventThreads(virNetServerPtr srv,
+                            size_t nthreads)
+{
+    g_autofree virEventThread **threads = NULL;
+    size_t i;
+    int ret = -1;
+
+    if (nthreads == 0)
+        return 0;
+
+    virObjectLock(srv);
+
+    if (srv->neventThreads > 0) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("event threads are already running"));
+        goto cleanup;
+    }
+
+    threads = g_new0(virEventThread *, nthreads);
+
+    for (i = 0; i < nthreads; i++) {
+        g_autofree char *name = g_strdup_printf("rpc-io-%zu", i);
+
+        if (!(threads[i] = virEventThreadNew(name)))
+            goto cleanup;
+
+        virEventThreadStartLatencyProbe(threads[i]);
+    }
+
+    srv->eventThreads = g_steal_pointer(&threads);
+    srv->neventThreads = nthreads;
+    ret = 0;
+
+ cleanup:
+    if (threads) {
+        for (i = 0; i < nthreads && threads[i]; i++)
+            g_object_unref(threads[i]);
+    }
+    virObjectUnlock(srv);
+    return ret;
+}
+
+
+/**
+ * virNetServerGetEventThreadLatency:
+ * @srv: the server
+ * @latency: filled with an array of statistics, one per event thread
+ * @nlatency: filled with the number of entries in @latency
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNetServerGetEventThreadLatency(virNetServerPtr srv,
+                                  virEventThreadLatency **latency,
+                                  size_t *nlatency)
+{
+    g_autofree virEventThreadLatency *ret = NULL;
+    size_t i;
+
+    virObjectLock(srv);
+
+    ret = g_new0(virEventThreadLatency, srv->neventThreads);
+
+    for (i = 0; i < srv->neventThreads; i++) {
+        if (virEventThreadGetLatency(srv->eventThreads[i], &ret[i]) < 0) {
+            virObjectUnlock(srv);
+            return -1;
+        }
+    }
+
+    *nlatency = srv->neventThreads;
+    *latency = g_steal_pointer(&ret);
+
+    virObjectUnlock(srv);
+    return 0;
+}
+
+
 size_t
 virNetServerGetMaxClients(virNetServerPtr srv)
 {
@@ -1104,6 +1267,46 @@ virNetServerGetCurrentUnauthClients(virNetServerPtr srv)
 }
 
 
+/**
+ * virNetServerGetProcedureStats:
+ * @srv: server to get the statistics of
+ * @list: list to add the parameters to
+ *
+ * Adds the call counters and latency histograms of all procedures
+ * handled by @srv which were called at least once to @list.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNetServerGetProcedureStats(virNetServerPtr srv,
+                              virTypedParamListPtr list)
+{
+    size_t nprocs = 0;
+    size_t i;
+    int ret = -1;
+
+    virObjectLock(srv);
+
+    if (virNetServerProgramGetLatencyBuckets(list) < 0)
+        goto cleanup;
+
+    for (i = 0; i < srv->nprograms; i++) {
+        if (virNetServerProgramGetProcedureStats(srv->programs[i],
+                                                 list, &nprocs) < 0)
+            goto cleanup;
+    }
+
+    if (virTypedParamListAddUInt(list, nprocs, "procedure.count") < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    virObjectUnlock(srv);
+    return ret;
+}
+
+
 bool virNetServerNeedsAuth(virNetServerPtr srv,
                            int auth)
 {
@@ -28,6 +28,8 @@
 #include "virobject.h"
 #include "virjson.h"
 #include "virsystemd.h"
+#include "vireventthread.h"
+#include "virthreadpool.h"
 
 
 virNetServerPtr virNetServerNew(const char *name,
@@ -107,12 +109,27 @@ int virNetServerGetThreadPoolParameters(virNetServerPtr srv,
                                         size_t *nWorkers,
                                         size_t *freeWorkers,
                                         size_t *nPrioWorkers,
-                                        size_t *jobQueueDepth);
+                                        size_t *jobQueueDepth,
+                                        size_t *maxClientWorkers);
+
+void virNetServerGetWorkerStats(virNetServerPtr srv,
+                                virThreadPoolStatsPtr stats);
 
 int virNetServerSetThreadPoolParameters(virNetServerPtr srv,
                                         long long int minWorkers,
                                         long long int maxWorkers,
-                                        long long int prioWorkers);
+                                        long long int prioWorkers,
+                                        long long int maxClientWorkers);
+
+int virNetServerSetEventThreads(virNetServerPtr srv,
+                                size_t nthreads);
+
+void virNetServerSetThreadCPUs(virNetServerPtr srv,
+                               virBitmapPtr cpus);
+
+int virNetServerGetEventThreadLatency(virNetServerPtr srv,
+                                      virEventThreadLatency **latency,
+                                      size_t *nlatency);
 
 unsigned long long virNetServerNextClientID(virNetServerPtr srv);
 
@@ -130,6 +147,9 @@ size_t virNetServerGetCurrentClients(virNetServerPtr srv);
 size_t virNetServerGetMaxUnauthClients(virNetServerPtr srv);
 size_t virNetServerGetCurrentUnauthClients(virNetServerPtr srv);
 
+int virNetServerGetProcedureStats(virNetServerPtr srv,
+                                  virTypedParamListPtr list);
+
 int virNetServerSetClientLimits(virNetServerPtr srv,
                                 long long int maxClients,
                                 long long int maxClientsUnauth);
@@ -42,6 +42,9 @@
 
 VIR_LOG_INIT("rpc.netserverclient");
 
+/* Max number of queued messages written by a single call */
+#define VIR_NET_SERVER_CLIENT_WRITE_BATCH 32
+
 /* Allow for filtering of incoming messages to a custom
  * dispatch processing queue, instead of the workers.
  * This allows for certain types of messages to be handled
@@ -71,11 +74,14 @@ struct _virNetServerClient
     int auth;
     bool auth_pending;
     bool readonly;
+    bool chunkedReplies; /* client can join replies split in several messages */
+    bool eventBatches; /* client can unpack VIR_NET_MESSAGE_BATCH */
     virNetTLSContextPtr tlsCtxt;
     virNetTLSSessionPtr tls;
 #if WITH_SASL
     virNetSASLSessionPtr sasl;
 #endif
+    int compressionLevel; /* compression to enable after the next 'tx' */
     int sockTimer; /* Timer to be fired upon cached data,
                     * so we jump out from poll() immediately */
 
@@ -103,6 +109,23 @@ struct _virNetServerClient
      * back to client, including async events */
     virNetMessagePtr tx;
 
+    /* Traffic on the socket since the client connected */
+    unsigned long long bytesRx;
+    unsigned long long bytesTx;
+    unsigned long long messagesRx;
+    unsigned long long messagesTx;
+
+    /* Count of async events in the 'tx' queue and the
+     * policy limiting them, see virNetServerClientSendEvent */
+    size_t nevents;
+    size_t nevents_max;
+    bool eventCoalesce;
+    unsigned long long eventsLost; /* dropped since the last notice */
+    unsigned long long eventsDropped;
+    unsigned long long eventsCoalesced;
+    virNetServerClientEventsLostFunc eventsLostFunc;
+    void *eventsLostOpaque;
+
     /* Filters to capture messages that would otherwise
      * end up on the 'dx' queue */
     virNetServerClientFilterPtr filters;
@@ -139,6 +162,7 @@ static void virNetServerClientUpdateEvent(virNetServerClientPtr client);
 static virNetMessagePtr virNetServerClientDispatchRead(virNetServerClientPtr client);
 static int virNetServerClientSendMessageLocked(virNetServerClientPtr client,
                                                virNetMessagePtr msg);
+static void virNetServerClientQueueEventsLost(virNetServerClientPtr client);
 
 /*
  * @client: a locked client object
@@ -310,8 +334,7 @@ virNetServerClientCheckAccess(virNetServerClientPtr client)
      * indicate this (otherwise the socket is abruptly closed).
      * (NB. The '\1' byte is sent in an encrypted record).
      */
-    confirm->bufferLength = 1;
-    if (VIR_ALLOC_N(confirm->buffer, confirm->bufferLength) < 0) {
+    if (virNetMessageResizeBuffer(confirm, 1) < 0) {
         virNetMessageFree(confirm);
         return -1;
     }
@@ -413,8 +436,7 @@ virNetServerClientNewInternal(unsigned long long id,
     /* Prepare one for packet receive */
     if (!(client->rx = virNetMessageNew(true)))
         goto error;
-    client->rx->bufferLength = VIR_NET_MESSAGE_LEN_MAX;
-    if (VIR_ALLOC_N(client->rx->buffer, client->rx->bufferLength) < 0)
+    if (virNetMessageResizeBuffer(client->rx, VIR_NET_MESSAGE_LEN_MAX) < 0)
         goto error;
     client->nrequests = 1;
 
@@ -567,6 +589,22 @@ virNetServerClientPtr virNetServerClientNewPostExecRestart(virNetServerPtr srv,
     }
     virObjectUnref(sock);
 
+    if (virJSONValueObjectHasKey(object, "chunked_replies") &&
+        virJSONValueObjectGetBoolean(object, "chunked_replies",
+                                     &client->chunkedReplies) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Malformed chunked_replies field in JSON state document"));
+        goto error;
+    }
+
+    if (virJSONValueObjectHasKey(object, "event_batches") &&
+        virJSONValueObjectGetBoolean(object, "event_batches",
+                                     &client->eventBatches) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Malformed event_batches field in JSON state document"));
+        goto error;
+    }
+
     if (!(child = virJSONValueObjectGet(object, "privateData"))) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("Missing privateData field in JSON state document"));
@@ -607,6 +645,13 @@ virJSONValuePtr virNetServerClientPreExecRestart(virNetServerClientPtr client)
         goto error;
     if (virJSONValueObjectAppendNumberUint(object, "nrequests_max", client->nrequests_max) < 0)
         goto error;
+    if (client->chunkedReplies &&
+        virJSONValueObjectAppendBoolean(object, "chunked_replies", true) < 0)
+        goto error;
+
+    if (client->eventBatches &&
+        virJSONValueObjectAppendBoolean(object, "event_batches", true) < 0)
+        goto error;
 
     if (client->conn_time &&
         virJSONValueObjectAppendNumberLong(object, "conn_time",
@@ -677,6 +722,52 @@ virNetServerClientSetReadonly(virNetServerClientPtr client,
 }
 
 
+bool virNetServerClientGetChunkedReplies(virNetServerClientPtr client)
+{
+    bool chunked;
+    virObjectLock(client);
+    chunked = client->chunkedReplies;
+    virObjectUnlock(client);
+    return chunked;
+}
+
+
+/**
+ * virNetServerClientSetChunkedReplies:
+ * @client: the client
+ * @chunked: whether the client can handle chunked replies
+ *
+ * Allow sending replies larger than VIR_NET_MESSAGE_MAX to @client
+ * split into several messages.
+ */
+void
+virNetServerClientSetChunkedReplies(virNetServerClientPtr client,
+                                    bool chunked)
+{
+    virObjectLock(client);
+    client->chunkedReplies = chunked;
+    virObjectUnlock(client);
+}
+
+
+/**
+ * virNetServerClientSetEventBatches:
+ * @client: the client
+ * @batches: whether the client can handle event batches
+ *
+ * Allow joining events queued for @client into VIR_NET_MESSAGE_BATCH
+ * messages.
+ */
+void
+virNetServerClientSetEventBatches(virNetServerClientPtr client,
+                                  bool batches)
+{
+    virObjectLock(client);
+    client->eventBatches = batches;
+    virObjectUnlock(client);
+}
+
+
 unsigned long long virNetServerClientGetID(virNetServerClientPtr client)
 {
     return client->id;
@@ -716,6 +807,30 @@ int virNetServerClientGetTLSKeySize(virNetServerClientPtr client)
     return size;
 }
 
+
+/**
+ * virNetServerClientGetTLSHandshakeStats:
+ * @client: the client
+ * @usec: filled with the time the TLS handshake took in microseconds
+ * @resumed: filled with whether the client resumed a previous session
+ *
+ * Returns true if @client completed a TLS handshake and the statistics
+ * were filled in, false otherwise
+ */
+bool
+virNetServerClientGetTLSHandshakeStats(virNetServerClientPtr client,
+                                       unsigned long long *usec,
+                                       bool *resumed)
+{
+    bool ret = false;
+
+    virObjectLock(client);
+    if (client->tls)
+        ret = virNetTLSSessionGetHandshakeStats(client->tls, usec, resumed);
+    virObjectUnlock(client);
+    return ret;
+}
+
 int virNetServerClientGetFD(virNetServerClientPtr client)
 {
     int fd = -1;
@@ -909,6 +1024,175 @@ bool virNetServerClientHasSASLSession(virNetServerClientPtr client)
 #endif
 
 
+/**
+ * virNetServerClientSetCompression:
+ * @client: the client
+ * @level: zlib compression level, 1-9
+ *
+ * Schedule compression of all data exchanged with @client. Like with
+ * a SASL session, the switch happens only once the next 'tx' operation,
+ * ie. the reply to the request asking for compression, is completed.
+ *
+ * Returns 0 on success, -1 on error
+ */
+int virNetServerClientSetCompression(virNetServerClientPtr client,
+                                     int level)
+{
+    int ret = -1;
+
+    virObjectLock(client);
+
+    if (level < 1 || level > 9) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("invalid compression level %d"), level);
+        goto cleanup;
+    }
+
+    if (client->compressionLevel) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("compression is already enabled"));
+        goto cleanup;
+    }
+
+    /* SASL auth negotiates an SSF layer unless the connection is
+     * already protected by TLS or is local; encrypted data doesn't
+     * compress and the socket refuses to combine the two */
+    if (client->auth == VIR_NET_SERVER_SERVICE_AUTH_SASL &&
+        !client->tls && !virNetSocketIsLocal(client->sock)) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("compression cannot be used with a SASL SSF layer"));
+        goto cleanup;
+    }
+
+    client->compressionLevel = level;
+    ret = 0;
+
+ cleanup:
+    virObjectUnlock(client);
+    return ret;
+}
+
+
+bool virNetServerClientGetCompressionStats(virNetServerClientPtr client,
+                                           virNetSocketCompressionStatsPtr stats)
+{
+    bool ret = false;
+
+    virObjectLock(client);
+    if (client->sock)
+        ret = virNetSocketGetCompressionStats(client->sock, stats);
+    virObjectUnlock(client);
+    return ret;
+}
+
+
+/**
+ * virNetServerClientSetEventPolicy:
+ * @client: the client
+ * @maxEvents: maximum number of events queued for transmission, 0 for no limit
+ * @coalesce: whether queued events may be superseded by newer ones
+ * @lostFunc: builds the notice about dropped events
+ * @lostOpaque: data passed to @lostFunc
+ *
+ * Sets how virNetServerClientSendEvent treats events for a client
+ * which doesn't keep up with reading them.
+ */
+void
+virNetServerClientSetEventPolicy(virNetServerClientPtr client,
+                                 size_t maxEvents,
+                                 bool coalesce,
+                                 virNetServerClientEventsLostFunc lostFunc,
+                                 void *lostOpaque)
+{
+    virObjectLock(client);
+    client->nevents_max = maxEvents;
+    client->eventCoalesce = coalesce;
+    client->eventsLostFunc = lostFunc;
+    client->eventsLostOpaque = lostOpaque;
+    virObjectUnlock(client);
+}
+
+
+/**
+ * virNetServerClientGetEventStats:
+ * @client: the client
+ * @dropped: filled with the number of events dropped
+ * @coalesced: filled with the number of events superseded by newer ones
+ *
+ * Returns true if an event policy is in effect for @client and the
+ * counters were filled in, false otherwise
+ */
+bool
+virNetServerClientGetEventStats(virNetServerClientPtr client,
+                                unsigned long long *dropped,
+                                unsigned long long *coalesced)
+{
+    bool ret;
+
+    virObjectLock(client);
+    ret = client->nevents_max > 0 || client->eventCoalesce;
+    *dropped = client->eventsDropped;
+    *coalesced = client->eventsCoalesced;
+    virObjectUnlock(client);
+    return ret;
+}
+
+
+/**
+ * virNetServerClientGetKeepAliveStats:
+ * @client: the client
+ * @stats: filled with the keepalive statistics
+ *
+ * Returns true if @client has keepalive set up and @stats was filled
+ * in, false otherwise
+ */
+bool
+virNetServerClientGetKeepAliveStats(virNetServerClientPtr client,
+                                    virKeepAliveStatsPtr stats)
+{
+    virKeepAlivePtr ka;
+
+    virObjectLock(client);
+    ka = virObjectRef(client->keepalive);
+    virObjectUnlock(client);
+
+    if (!ka)
+        return false;
+
+    virKeepAliveGetStats(ka, stats);
+    virObjectUnref(ka);
+    return true;
+}
+
+
+/**
+ * virNetServerClientGetTrafficStats:
+ * @client: the client
+ * @bytesRx: filled with the number of bytes received
+ * @bytesTx: filled with the number of bytes sent
+ * @messagesRx: filled with the number of messages received
+ * @messagesTx: filled with the number of messages sent
+ *
+ * Reports the traffic of @client since it connected. Bytes are counted
+ * as they appear on the socket, that is before decompression and after
+ * encryption.
+ */
+void
+virNetServerClientGetTrafficStats(virNetServerClientPtr client,
+                                  unsigned long long *bytesRx,
+                                  unsigned long long *bytesTx,
+                                  unsigned long long *messagesRx,
+                                  unsigned long long *messagesTx)
+{
+    virObjectLock(client);
+    *bytesRx = client->bytesRx;
+    *bytesTx = client->bytesTx;
+    *messagesRx = client->messagesRx;
+    *messagesTx = client->messagesTx;
+    virObjectUnlock(client);
+}
+
+
 void *virNetServerClientGetPrivateData(virNetServerClientPtr client)
 {
     void *data;
@@ -944,6 +1228,20 @@ void virNetServerClientSetDispatcher(virNetServerClientPtr client,
 }
 
 
+/*
+ * Selects the context, typically of a virEventThread, which dispatches
+ * I/O of @client. Must be called before virNetServerClientInit.
+ */
+void virNetServerClientSetEventContext(virNetServerClientPtr client,
+                                       GMainContext *context)
+{
+    virObjectLock(client);
+    if (client->sock)
+        virNetSocketSetEventContext(client->sock, context);
+    virObjectUnlock(client);
+}
+
+
 const char *virNetServerClientLocalAddrStringSASL(virNetServerClientPtr client)
 {
     if (!client->sock)
@@ -1049,6 +1347,7 @@ virNetServerClientCloseLocked(virNetServerClientPtr client)
             = virNetMessageQueueServe(&client->tx);
         virNetMessageFree(msg);
     }
+    client->nevents = 0;
 
     if (client->sock) {
         virObjectUnref(client->sock);
@@ -1173,6 +1472,7 @@ static ssize_t virNetServerClientRead(virNetServerClientPtr client)
         return ret;
 
     client->rx->bufferOffset += ret;
+    client->bytesRx += ret;
     return ret;
 }
 
@@ -1227,6 +1527,14 @@ static virNetMessagePtr virNetServerClientDispatchRead(virNetServerClientPtr cli
             return NULL;
         }
 
+        if (msg->header.type == VIR_NET_CALL_WITH_TRACE &&
+            virNetMessageDecodeTrace(msg) < 0) {
+            virNetMessageQueueServe(&client->rx);
+            virNetMessageFree(msg);
+            client->wantClose = true;
+            return NULL;
+        }
+
         /* Now figure out if we need to read more data to get some
          * file descriptors */
         if (msg->header.type == VIR_NET_CALL_WITH_FDS) {
@@ -1264,6 +1572,7 @@ static virNetMessagePtr virNetServerClientDispatchRead(virNetServerClientPtr cli
 
         /* Definitely finished reading, so remove from queue */
         virNetMessageQueueServe(&client->rx);
+        client->messagesRx++;
         PROBE(RPC_SERVER_CLIENT_MSG_RX,
               "client=%p len=%zu prog=%u vers=%u proc=%u type=%u status=%u serial=%u",
               client, msg->bufferLength,
@@ -1305,9 +1614,8 @@ static virNetMessagePtr virNetServerClientDispatchRead(virNetServerClientPtr cli
             if (!(client->rx = virNetMessageNew(true))) {
                 client->wantClose = true;
             } else {
-                client->rx->bufferLength = VIR_NET_MESSAGE_LEN_MAX;
-                if (VIR_ALLOC_N(client->rx->buffer,
-                                client->rx->bufferLength) < 0) {
+                if (virNetMessageResizeBuffer(client->rx,
+                                              VIR_NET_MESSAGE_LEN_MAX) < 0) {
                     client->wantClose = true;
                 } else {
                     client->nrequests++;
@@ -1331,6 +1639,11 @@ static virNetMessagePtr virNetServerClientDispatchRead(virNetServerClientPtr cli
  */
 static ssize_t virNetServerClientWrite(virNetServerClientPtr client)
 {
+    const char *bufs[VIR_NET_SERVER_CLIENT_WRITE_BATCH];
+    size_t lens[VIR_NET_SERVER_CLIENT_WRITE_BATCH];
+    size_t nbufs = 0;
+    virNetMessagePtr msg;
+    size_t left;
     ssize_t ret;
 
     if (client->tx->bufferLength < client->tx->bufferOffset) {
@@ -1344,13 +1657,44 @@ static ssize_t virNetServerClientWrite(virNetServerClientPtr client)
     if (client->tx->bufferLength == client->tx->bufferOffset)
         return 1;
 
-    ret = virNetSocketWrite(client->sock,
-                            client->tx->buffer + client->tx->bufferOffset,
-                            client->tx->bufferLength - client->tx->bufferOffset);
+    /* Write as many queued messages at once as possible. File
+     * descriptors have to be sent right after the data of their
+     * message, and once a SASL session or compression is waiting
+     * to be enabled it must cover all data after the current
+     * message. */
+    for (msg = client->tx;
+         msg && nbufs < VIR_NET_SERVER_CLIENT_WRITE_BATCH;
+         msg = msg->next) {
+        if (msg->bufferOffset < msg->bufferLength) {
+            bufs[nbufs] = msg->buffer + msg->bufferOffset;
+            lens[nbufs] = msg->bufferLength - msg->bufferOffset;
+            nbufs++;
+        }
+
+        if (msg->nfds > 0)
+            break;
+#if WITH_SASL
+        if (client->sasl)
+            break;
+#endif
+        if (client->compressionLevel > 0)
+            break;
+    }
+
+    ret = virNetSocketWriteVector(client->sock, bufs, lens, nbufs);
     if (ret <= 0)
         return ret; /* -1 error, 0 = egain */
 
-    client->tx->bufferOffset += ret;
+    client->bytesTx += ret;
+
+    left = ret;
+    for (msg = client->tx; msg && left > 0; msg = msg->next) {
+        size_t done = MIN(left, msg->bufferLength - msg->bufferOffset);
+
+        msg->bufferOffset += done;
+        left -= done;
+    }
+
     return ret;
 }
 
@@ -1400,8 +1744,26 @@ virNetServerClientDispatchWrite(virNetServerClientPtr client)
             }
 #endif
 
+            /* Likewise all future rx/tx are compressed once the
+             * reply agreeing to it is out. The value stays negative
+             * so that compression can't be requested again. */
+            if (client->compressionLevel > 0) {
+                if (virNetSocketSetCompression(client->sock,
+                                               client->compressionLevel) < 0) {
+                    client->wantClose = true;
+                    return;
+                }
+                client->compressionLevel = -1;
+            }
+
             /* Get finished msg from head of tx queue */
             msg = virNetMessageQueueServe(&client->tx);
+            client->messagesTx++;
+
+            if (msg->event) {
+                client->nevents -= MAX(msg->nbatched, 1);
+                virNetServerClientQueueEventsLost(client);
+            }
 
             if (msg->tracked) {
                 client->nrequests--;
@@ -1410,8 +1772,7 @@ virNetServerClientDispatchWrite(virNetServerClientPtr client)
                     client->nrequests < client->nrequests_max) {
                     /* Ready to recv more messages */
                     virNetMessageClear(msg);
-                    msg->bufferLength = VIR_NET_MESSAGE_LEN_MAX;
-                    if (VIR_ALLOC_N(msg->buffer, msg->bufferLength) < 0) {
+                    if (virNetMessageResizeBuffer(msg, VIR_NET_MESSAGE_LEN_MAX) < 0) {
                         virNetMessageFree(msg);
                         return;
                     }
@@ -1538,6 +1899,176 @@ int virNetServerClientSendMessage(virNetServerClientPtr client,
 }
 
 
+static bool
+virNetServerClientHasEventRoom(virNetServerClientPtr client)
+{
+    return client->nevents_max == 0 ||
+        client->nevents < client->nevents_max;
+}
+
+
+/*
+ * Tells the client how many events it lost, once there is room
+ * for the notice in the 'tx' queue.
+ */
+static void
+virNetServerClientQueueEventsLost(virNetServerClientPtr client)
+{
+    virNetMessagePtr msg;
+
+    if (client->eventsLost == 0 ||
+        !client->eventsLostFunc ||
+        !virNetServerClientHasEventRoom(client))
+        return;
+
+    if (!(msg = client->eventsLostFunc(client, client->eventsLost,
+                                       client->eventsLostOpaque)))
+        return;
+
+    msg->event = true;
+    if (virNetServerClientSendMessageLocked(client, msg) < 0) {
+        virNetMessageFree(msg);
+        return;
+    }
+
+    client->nevents++;
+    client->eventsLost = 0;
+}
+
+
+/*
+ * Adds @msg to the message at the tail of the 'tx' queue if that is
+ * an event which didn't start to be sent yet, turning it into a batch
+ * first if needed. Returns 0 if @msg was consumed.
+ */
+static int
+virNetServerClientBatchEvent(virNetServerClientPtr client,
+                             virNetMessagePtr msg)
+{
+    virNetMessagePtr *tail = &client->tx;
+
+    if (!*tail)
+        return -1;
+
+    while ((*tail)->next)
+        tail = &(*tail)->next;
+
+    if (!(*tail)->event || (*tail)->bufferOffset > 0)
+        return -1;
+
+    if ((*tail)->header.type != VIR_NET_MESSAGE_BATCH) {
+        virNetMessagePtr batch;
+
+        if (!(batch = virNetMessageBatchNew()))
+            return -1;
+
+        if (virNetMessageBatchAppend(batch, *tail) != 0) {
+            virNetMessageFree(batch);
+            return -1;
+        }
+
+        batch->event = true;
+        virNetMessageFree(*tail);
+        *tail = batch;
+    }
+
+    if (virNetMessageBatchAppend(*tail, msg) != 0)
+        return -1;
+
+    VIR_DEBUG("Batched event proc=%d, %zu events in batch msg=%p",
+              msg->header.proc, (*tail)->nbatched, *tail);
+    virNetMessageFree(msg);
+    return 0;
+}
+
+
+/**
+ * virNetServerClientSendEvent:
+ * @client: the client
+ * @msg: the event message
+ * @key: identifies what the event reports on, or NULL
+ *
+ * Queues the asynchronous event @msg for transmission to @client,
+ * applying the event policy of the client. With coalescing enabled,
+ * an event with the same @key which is still waiting in the queue is
+ * superseded by @msg, which is queued at the tail to keep events in
+ * order. Once the queue holds the maximum number of events, further
+ * events are dropped and the client is told how many it lost as soon
+ * as the queue drains. Clients which enabled event batches get events
+ * which pile up in the queue joined into a single message.
+ *
+ * Returns 0 if @msg was consumed, -1 if the client is closing, in
+ * which case the caller has to free @msg
+ */
+int
+virNetServerClientSendEvent(virNetServerClientPtr client,
+                            virNetMessagePtr msg,
+                            const char *key)
+{
+    int ret = -1;
+
+    virObjectLock(client);
+
+    if (!client->sock || client->wantClose)
+        goto cleanup;
+
+    msg->event = true;
+
+    if (key && client->eventCoalesce) {
+        virNetMessagePtr *prev;
+
+        for (prev = &client->tx; *prev; prev = &(*prev)->next) {
+            virNetMessagePtr old = *prev;
+
+            /* Messages partially written out already must stay */
+            if (!old->event || !old->eventKey ||
+                old->bufferOffset > 0 ||
+                STRNEQ(old->eventKey, key))
+                continue;
+
+            VIR_DEBUG("Superseding event msg=%p key=%s", old, key);
+            *prev = old->next;
+            old->next = NULL;
+            virNetMessageFree(old);
+            client->nevents--;
+            client->eventsCoalesced++;
+            break;
+        }
+    }
+
+    virNetServerClientQueueEventsLost(client);
+
+    if (!virNetServerClientHasEventRoom(client)) {
+        VIR_DEBUG("Dropping event proc=%d, %zu events queued",
+                  msg->header.proc, client->nevents);
+        client->eventsLost++;
+        client->eventsDropped++;
+        virNetMessageFree(msg);
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (client->eventBatches &&
+        virNetServerClientBatchEvent(client, msg) == 0) {
+        client->nevents++;
+        ret = 0;
+        goto cleanup;
+    }
+
+    msg->eventKey = g_strdup(key);
+
+    if (virNetServerClientSendMessageLocked(client, msg) < 0)
+        goto cleanup;
+
+    client->nevents++;
+    ret = 0;
+
+ cleanup:
+    virObjectUnlock(client);
+    return ret;
+}
+
+
 bool
 virNetServerClientIsAuthenticated(virNetServerClientPtr client)
 {
@@ -1579,6 +2110,20 @@ virNetServerClientKeepAliveSendCB(void *opaque,
     return virNetServerClientSendMessage(opaque, msg);
 }
 
+static bool
+virNetServerClientKeepAliveActiveCB(void *opaque)
+{
+    virNetServerClientPtr client = opaque;
+    bool ret = false;
+
+    virObjectLock(client);
+    if (client->sock && !client->wantClose)
+        ret = virNetSocketHasUnreadData(client->sock);
+    virObjectUnlock(client);
+
+    return ret;
+}
+
 
 int
 virNetServerClientInitKeepAlive(virNetServerClientPtr client,
@@ -1598,6 +2143,9 @@ virNetServerClientInitKeepAlive(virNetServerClientPtr client,
     /* keepalive object has a reference to client */
     virObjectRef(client);
 
+    /* keep the timer running even if the loop doing our I/O is busy */
+    virKeepAliveUseThread(ka, virNetServerClientKeepAliveActiveCB);
+
     client->keepalive = ka;
     ret = 0;
  cleanup:
@@ -22,6 +22,7 @@
 #pragma once
 
 #include "viridentity.h"
+#include "virkeepalive.h"
 #include "virnetsocket.h"
 #include "virnetmessage.h"
 #include "virobject.h"
@@ -47,6 +48,14 @@ typedef int (*virNetServerClientFilterFunc)(virNetServerClientPtr client,
                                             virNetMessagePtr msg,
                                             void *opaque);
 
+/*
+ * @client is locked when this callback is called. Returns a message
+ * telling the client that @lost events were dropped, or NULL.
+ */
+typedef virNetMessagePtr (*virNetServerClientEventsLostFunc)(virNetServerClientPtr client,
+                                                             unsigned long long lost,
+                                                             void *opaque);
+
 /*
  * @data: value allocated by virNetServerClintPrivNew(PostExecRestart) callback
  */
@@ -98,12 +107,20 @@ int virNetServerClientGetAuth(virNetServerClientPtr client);
 void virNetServerClientSetAuthLocked(virNetServerClientPtr client, int auth);
 bool virNetServerClientGetReadonly(virNetServerClientPtr client);
 void virNetServerClientSetReadonly(virNetServerClientPtr client, bool readonly);
+bool virNetServerClientGetChunkedReplies(virNetServerClientPtr client);
+void virNetServerClientSetChunkedReplies(virNetServerClientPtr client,
+                                         bool chunked);
+void virNetServerClientSetEventBatches(virNetServerClientPtr client,
+                                       bool batches);
 unsigned long long virNetServerClientGetID(virNetServerClientPtr client);
 long long virNetServerClientGetTimestamp(virNetServerClientPtr client);
 
 bool virNetServerClientHasTLSSession(virNetServerClientPtr client);
 virNetTLSSessionPtr virNetServerClientGetTLSSession(virNetServerClientPtr client);
 int virNetServerClientGetTLSKeySize(virNetServerClientPtr client);
+bool virNetServerClientGetTLSHandshakeStats(virNetServerClientPtr client,
+                                            unsigned long long *usec,
+                                            bool *resumed);
 
 #ifdef WITH_SASL
 bool virNetServerClientHasSASLSession(virNetServerClientPtr client);
@@ -112,6 +129,27 @@ void virNetServerClientSetSASLSession(virNetServerClientPtr client,
 virNetSASLSessionPtr virNetServerClientGetSASLSession(virNetServerClientPtr client);
 #endif
 
+int virNetServerClientSetCompression(virNetServerClientPtr client,
+                                     int level);
+bool virNetServerClientGetCompressionStats(virNetServerClientPtr client,
+                                           virNetSocketCompressionStatsPtr stats);
+
+void virNetServerClientSetEventPolicy(virNetServerClientPtr client,
+                                      size_t maxEvents,
+                                      bool coalesce,
+                                      virNetServerClientEventsLostFunc lostFunc,
+                                      void *lostOpaque);
+bool virNetServerClientGetEventStats(virNetServerClientPtr client,
+                                     unsigned long long *dropped,
+                                     unsigned long long *coalesced);
+bool virNetServerClientGetKeepAliveStats(virNetServerClientPtr client,
+                                         virKeepAliveStatsPtr stats);
+void virNetServerClientGetTrafficStats(virNetServerClientPtr client,
+                                       unsigned long long *bytesRx,
+                                       unsigned long long *bytesTx,
+                                       unsigned long long *messagesRx,
+                                       unsigned long long *messagesTx);
+
 int virNetServerClientGetFD(virNetServerClientPtr client);
 
 bool virNetServerClientIsSecure(virNetServerClientPtr client);
@@ -139,6 +177,8 @@ void virNetServerClientSetCloseHook(virNetServerClientPtr client,
 void virNetServerClientSetDispatcher(virNetServerClientPtr client,
                                      virNetServerClientDispatchFunc func,
                                      void *opaque);
+void virNetServerClientSetEventContext(virNetServerClientPtr client,
+                                       GMainContext *context);
 void virNetServerClientClose(virNetServerClientPtr client);
 void virNetServerClientCloseLocked(virNetServerClientPtr client);
 bool virNetServerClientIsClosedLocked(virNetServerClientPtr client);
@@ -162,6 +202,9 @@ const char *virNetServerClientRemoteAddrStringURI(virNetServerClientPtr client);
 
 int virNetServerClientSendMessage(virNetServerClientPtr client,
                                   virNetMessagePtr msg);
+int virNetServerClientSendEvent(virNetServerClientPtr client,
+                                virNetMessagePtr msg,
+                                const char *key);
 
 bool virNetServerClientIsAuthenticated(virNetServerClientPtr client);
 bool virNetServerClientIsAuthPendingLocked(virNetServerClientPtr client);
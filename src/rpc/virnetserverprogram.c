@@ -28,19 +28,39 @@
 #include "virerror.h"
 #include "virlog.h"
 #include "virfile.h"
+#include "virhistogram.h"
 #include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_RPC
 
 VIR_LOG_INIT("rpc.netserverprogram");
 
+/* Size of the arguments and return value of a procedure which are
+ * kept on the stack of the dispatching thread */
+#define VIR_NET_SERVER_PROGRAM_INLINE_DATA 512
+
+typedef struct _virNetServerProgramProcStats virNetServerProgramProcStats;
+typedef virNetServerProgramProcStats *virNetServerProgramProcStatsPtr;
+struct _virNetServerProgramProcStats {
+    unsigned long long calls;
+    unsigned long long errors;
+    virHistogram wait; /* queued until picked by a worker */
+    virHistogram exec; /* picked by a worker until handled */
+};
+
 struct _virNetServerProgram {
-    virObject parent;
+    virObjectLockable parent;
 
     unsigned program;
     unsigned version;
     virNetServerProgramProcPtr procs;
     size_t nprocs;
+
+    /* Indexed the same way as @procs, guarded by the object lock */
+    virNetServerProgramProcStatsPtr stats;
+
+    virNetServerProgramForwardFunc forward;
+    void *forwardOpaque;
 };
 
 
@@ -49,7 +69,7 @@ static void virNetServerProgramDispose(void *obj);
 
 static int virNetServerProgramOnceInit(void)
 {
-    if (!VIR_CLASS_NEW(virNetServerProgram, virClassForObject()))
+    if (!VIR_CLASS_NEW(virNetServerProgram, virClassForObjectLockable()))
         return -1;
 
     return 0;
@@ -68,13 +88,14 @@ virNetServerProgramPtr virNetServerProgramNew(unsigned program,
     if (virNetServerProgramInitialize() < 0)
         return NULL;
 
-    if (!(prog = virObjectNew(virNetServerProgramClass)))
+    if (!(prog = virObjectLockableNew(virNetServerProgramClass)))
         return NULL;
 
     prog->program = program;
     prog->version = version;
     prog->procs = procs;
     prog->nprocs = nprocs;
+    prog->stats = g_new0(virNetServerProgramProcStats, nprocs);
 
     VIR_DEBUG("prog=%p", prog);
 
@@ -82,6 +103,26 @@ virNetServerProgramPtr virNetServerProgramNew(unsigned program,
 }
 
 
+/**
+ * virNetServerProgramSetForward:
+ * @prog: the program
+ * @func: callback deciding whether to forward a call
+ * @opaque: data for @func
+ *
+ * Lets @func handle calls of @prog, e.g. by passing them on to another
+ * daemon as they are, before their arguments are decoded. It's only
+ * offered calls from authenticated clients which don't carry any file
+ * descriptors. Must be called before the program is added to a server.
+ */
+void virNetServerProgramSetForward(virNetServerProgramPtr prog,
+                                   virNetServerProgramForwardFunc func,
+                                   void *opaque)
+{
+    prog->forward = func;
+    prog->forwardOpaque = opaque;
+}
+
+
 int virNetServerProgramGetID(virNetServerProgramPtr prog)
 {
     return prog->program;
@@ -134,6 +175,120 @@ virNetServerProgramGetPriority(virNetServerProgramPtr prog,
     return proc->priority;
 }
 
+static void
+virNetServerProgramUpdateStats(virNetServerProgramPtr prog,
+                               int procedure,
+                               unsigned long long wait,
+                               unsigned long long exec,
+                               bool failed)
+{
+    virNetServerProgramProcStatsPtr stats = &prog->stats[procedure];
+
+    virObjectLock(prog);
+    stats->calls++;
+    if (failed)
+        stats->errors++;
+    virHistogramRecord(&stats->wait, wait);
+    virHistogramRecord(&stats->exec, exec);
+    virObjectUnlock(prog);
+}
+
+
+static int
+virNetServerProgramLatencyFormat(virHistogramPtr latency,
+                                 virTypedParamListPtr list,
+                                 size_t idx,
+                                 const char *name)
+{
+    size_t i;
+
+    if (virTypedParamListAddULLong(list, latency->total,
+                                   "procedure.%zu.%s.total", idx, name) < 0 ||
+        virTypedParamListAddULLong(list, latency->max,
+                                   "procedure.%zu.%s.max", idx, name) < 0)
+        return -1;
+
+    for (i = 0; i < VIR_HISTOGRAM_BUCKETS; i++) {
+        if (virTypedParamListAddULLong(list, latency->buckets[i],
+                                       "procedure.%zu.%s.bucket.%zu",
+                                       idx, name, i) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * virNetServerProgramGetLatencyBuckets:
+ * @list: list to add the parameters to
+ *
+ * Adds the upper limits of the latency histogram buckets reported by
+ * virNetServerProgramGetProcedureStats to @list.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNetServerProgramGetLatencyBuckets(virTypedParamListPtr list)
+{
+    return virHistogramAddLimits(list, "");
+}
+
+
+/**
+ * virNetServerProgramGetProcedureStats:
+ * @prog: the program
+ * @list: list to add the parameters to
+ * @nprocs: number of procedures already in @list, updated on return
+ *
+ * Adds the call counters and latency histograms of every procedure
+ * of @prog which was called at least once to @list, numbering them
+ * from @nprocs on.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNetServerProgramGetProcedureStats(virNetServerProgramPtr prog,
+                                     virTypedParamListPtr list,
+                                     size_t *nprocs)
+{
+    int ret = -1;
+    size_t i;
+
+    virObjectLock(prog);
+
+    for (i = 0; i < prog->nprocs; i++) {
+        virNetServerProgramProcStatsPtr stats = &prog->stats[i];
+        size_t idx = *nprocs;
+
+        if (!stats->calls)
+            continue;
+
+        if (virTypedParamListAddUInt(list, prog->program,
+                                     "procedure.%zu.program", idx) < 0 ||
+            virTypedParamListAddInt(list, (int) i,
+                                    "procedure.%zu.number", idx) < 0 ||
+            virTypedParamListAddULLong(list, stats->calls,
+                                       "procedure.%zu.calls", idx) < 0 ||
+            virTypedParamListAddULLong(list, stats->errors,
+                                       "procedure.%zu.errors", idx) < 0 ||
+            virNetServerProgramLatencyFormat(&stats->wait, list,
+                                             idx, "wait") < 0 ||
+            virNetServerProgramLatencyFormat(&stats->exec, list,
+                                             idx, "exec") < 0)
+            goto cleanup;
+
+        (*nprocs)++;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virObjectUnlock(prog);
+    return ret;
+}
+
+
 static int
 virNetServerProgramSendError(unsigned program,
                              unsigned version,
@@ -299,6 +454,7 @@ int virNetServerProgramDispatch(virNetServerProgramPtr prog,
     switch (msg->header.type) {
     case VIR_NET_CALL:
     case VIR_NET_CALL_WITH_FDS:
+    case VIR_NET_CALL_WITH_TRACE:
         ret = virNetServerProgramDispatchCall(prog, server, client, msg);
         break;
 
@@ -321,6 +477,7 @@ int virNetServerProgramDispatch(virNetServerProgramPtr prog,
     case VIR_NET_REPLY_WITH_FDS:
     case VIR_NET_MESSAGE:
     case VIR_NET_STREAM_HOLE:
+    case VIR_NET_MESSAGE_BATCH:
     default:
         virReportError(VIR_ERR_RPC,
                        _("Unexpected message type %u"),
@@ -332,7 +489,8 @@ int virNetServerProgramDispatch(virNetServerProgramPtr prog,
 
  error:
     if (msg->header.type == VIR_NET_CALL ||
-        msg->header.type == VIR_NET_CALL_WITH_FDS) {
+        msg->header.type == VIR_NET_CALL_WITH_FDS ||
+        msg->header.type == VIR_NET_CALL_WITH_TRACE) {
         ret = virNetServerProgramSendReplyError(prog, client, msg, &rerr, &msg->header);
     } else {
         /* Send a dummy reply to free up 'msg' & unblock client rx */
@@ -365,13 +523,24 @@ virNetServerProgramDispatchCall(virNetServerProgramPtr prog,
                                 virNetServerClientPtr client,
                                 virNetMessagePtr msg)
 {
-    g_autofree char *arg = NULL;
-    g_autofree char *ret = NULL;
+    union {
+        char data[VIR_NET_SERVER_PROGRAM_INLINE_DATA];
+        long long align;
+        void *alignptr;
+    } inlineData;
+    g_autofree char *allocData = NULL;
+    char *arg = NULL;
+    char *ret = NULL;
+    size_t argSize;
     int rv = -1;
     virNetServerProgramProcPtr dispatcher;
     virNetMessageError rerr;
     size_t i;
     g_autoptr(virIdentity) identity = NULL;
+    virNetMessagePtr chunks = NULL;
+    long long start = g_get_monotonic_time();
+    long long end;
+    virTraceSpan span = { 0 };
 
     memset(&rerr, 0, sizeof(rerr));
 
@@ -403,10 +572,33 @@ virNetServerProgramDispatchCall(virNetServerProgramPtr prog,
         goto error;
     }
 
-    if (VIR_ALLOC_N(arg, dispatcher->arg_len) < 0)
-        goto error;
-    if (VIR_ALLOC_N(ret, dispatcher->ret_len) < 0)
-        goto error;
+    if (prog->forward && msg->header.type == VIR_NET_CALL) {
+        /* @msg may be gone as soon as it was taken over */
+        int proc = msg->header.proc;
+        long long wait = msg->queued ? MAX(start - msg->queued, 0) : 0;
+        int rc = prog->forward(prog, client, msg, prog->forwardOpaque);
+
+        if (rc != 0)
+            virNetServerProgramUpdateStats(prog, proc, wait,
+                                           g_get_monotonic_time() - start,
+                                           rc < 0);
+        if (rc > 0)
+            return 0;
+        if (rc < 0)
+            goto error;
+    }
+
+    /* Arguments and return values of most procedures are small enough
+     * not to need allocating on every call. Either way they share a
+     * single block, with the return value suitably aligned. */
+    argSize = VIR_ROUND_UP(dispatcher->arg_len, sizeof(inlineData.alignptr) * 2);
+    if (argSize + dispatcher->ret_len <= sizeof(inlineData)) {
+        memset(&inlineData, 0, sizeof(inlineData));
+        arg = inlineData.data;
+    } else {
+        arg = allocData = g_new0(char, argSize + dispatcher->ret_len);
+    }
+    ret = arg + argSize;
 
     if (virNetMessageDecodePayload(msg, dispatcher->arg_filter, arg) < 0)
         goto error;
@@ -427,8 +619,31 @@ virNetServerProgramDispatchCall(virNetServerProgramPtr prog,
      *
      *   'args and 'ret'
      */
+    if (msg->hasTrace && virTraceEnabled()) {
+        g_autofree char *detail = g_strdup_printf("prog=0x%x proc=%d",
+                                                  msg->header.prog,
+                                                  msg->header.proc);
+
+        /* Spans use real time, convert the monotonic time of queueing */
+        if (msg->queued) {
+            long long offset = g_get_real_time() - g_get_monotonic_time();
+
+            virTraceSpanEmit(&msg->trace, "rpc.queue", detail,
+                             msg->queued + offset, start + offset);
+        }
+
+        virTraceSpanBeginRemote(&span, &msg->trace, "rpc.dispatch", detail);
+    }
+
     rv = (dispatcher->func)(server, client, msg, &rerr, arg, ret);
 
+    virTraceSpanEnd(&span, rv < 0);
+
+    end = g_get_monotonic_time();
+    virNetServerProgramUpdateStats(prog, msg->header.proc,
+                                   msg->queued ? MAX(start - msg->queued, 0) : 0,
+                                   end - start, rv < 0);
+
     if (virIdentitySetCurrent(NULL) < 0)
         goto error;
 
@@ -473,13 +688,32 @@ virNetServerProgramDispatchCall(virNetServerProgramPtr prog,
         goto error;
     }
 
-    if (virNetMessageEncodePayload(msg, dispatcher->ret_filter, ret) < 0) {
-        xdr_free(dispatcher->ret_filter, ret);
-        goto error;
-    }
+    /* Replies too large for a single message can be split for
+     * clients which know how to join them again */
+    if (!msg->nfds && virNetServerClientGetChunkedReplies(client))
+        rv = virNetMessageEncodePayloadChunked(msg, dispatcher->ret_filter,
+                                               ret, &chunks);
+    else
+        rv = virNetMessageEncodePayload(msg, dispatcher->ret_filter, ret);
 
     xdr_free(dispatcher->ret_filter, ret);
 
+    if (rv < 0)
+        goto error;
+
+    /* Leading parts of a chunked reply go out first, the client
+     * is not told the call finished until @msg arrives */
+    while (chunks) {
+        virNetMessagePtr chunk = virNetMessageQueueServe(&chunks);
+
+        if (virNetServerClientSendMessage(client, chunk) < 0) {
+            virNetMessageFree(chunk);
+            while (chunks)
+                virNetMessageFree(virNetMessageQueueServe(&chunks));
+            return -1;
+        }
+    }
+
     /* Put reply on end of tx queue to send out  */
     return virNetServerClientSendMessage(client, msg);
 
@@ -534,6 +768,48 @@ int virNetServerProgramSendStreamData(virNetServerProgramPtr prog,
 }
 
 
+/*
+ * Encodes the header of a stream data message and returns a buffer for
+ * up to @len bytes of data inside @msg. The caller fills it in and then
+ * passes the number of bytes actually produced to
+ * virNetServerProgramSendPreparedStreamData, which avoids copying the
+ * data into the message from a separate buffer.
+ */
+char *virNetServerProgramPrepareStreamData(virNetServerProgramPtr prog,
+                                           virNetMessagePtr msg,
+                                           int procedure,
+                                           unsigned int serial,
+                                           size_t len)
+{
+    VIR_DEBUG("msg=%p len=%zu", msg, len);
+
+    msg->header.prog = prog->program;
+    msg->header.vers = prog->version;
+    msg->header.proc = procedure;
+    msg->header.type = VIR_NET_STREAM;
+    msg->header.serial = serial;
+    msg->header.status = VIR_NET_CONTINUE;
+
+    if (virNetMessageEncodeHeader(msg) < 0)
+        return NULL;
+
+    return virNetMessageReservePayloadRaw(msg, len);
+}
+
+
+int virNetServerProgramSendPreparedStreamData(virNetServerClientPtr client,
+                                              virNetMessagePtr msg,
+                                              size_t len)
+{
+    VIR_DEBUG("client=%p msg=%p len=%zu", client, msg, len);
+
+    if (virNetMessageCommitPayloadRaw(msg, len) < 0)
+        return -1;
+
+    return virNetServerClientSendMessage(client, msg);
+}
+
+
 int virNetServerProgramSendStreamHole(virNetServerProgramPtr prog,
                                       virNetServerClientPtr client,
                                       virNetMessagePtr msg,
@@ -569,6 +845,9 @@ int virNetServerProgramSendStreamHole(virNetServerProgramPtr prog,
 }
 
 
-void virNetServerProgramDispose(void *obj G_GNUC_UNUSED)
+void virNetServerProgramDispose(void *obj)
 {
+    virNetServerProgramPtr prog = obj;
+
+    g_free(prog->stats);
 }
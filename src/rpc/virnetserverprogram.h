@@ -24,6 +24,7 @@
 #include "virnetmessage.h"
 #include "virnetserverclient.h"
 #include "virobject.h"
+#include "virtypedparam.h"
 
 typedef struct _virNetDaemon virNetDaemon;
 typedef virNetDaemon *virNetDaemonPtr;
@@ -59,6 +60,21 @@ virNetServerProgramPtr virNetServerProgramNew(unsigned program,
                                               virNetServerProgramProcPtr procs,
                                               size_t nprocs);
 
+/*
+ * Returns 1 if the call in @msg was taken over, in which case the
+ * callback is responsible for sending the reply and releasing @msg,
+ * 0 if the call should be dispatched as usual and -1 with an error
+ * reported if the call failed.
+ */
+typedef int (*virNetServerProgramForwardFunc)(virNetServerProgramPtr prog,
+                                              virNetServerClientPtr client,
+                                              virNetMessagePtr msg,
+                                              void *opaque);
+
+void virNetServerProgramSetForward(virNetServerProgramPtr prog,
+                                   virNetServerProgramForwardFunc func,
+                                   void *opaque);
+
 int virNetServerProgramGetID(virNetServerProgramPtr prog);
 int virNetServerProgramGetVersion(virNetServerProgramPtr prog);
 
@@ -68,6 +84,12 @@ unsigned int virNetServerProgramGetPriority(virNetServerProgramPtr prog,
 int virNetServerProgramMatches(virNetServerProgramPtr prog,
                                virNetMessagePtr msg);
 
+int virNetServerProgramGetLatencyBuckets(virTypedParamListPtr list);
+
+int virNetServerProgramGetProcedureStats(virNetServerProgramPtr prog,
+                                         virTypedParamListPtr list,
+                                         size_t *nprocs);
+
 int virNetServerProgramDispatch(virNetServerProgramPtr prog,
                                 virNetServerPtr server,
                                 virNetServerClientPtr client,
@@ -98,6 +120,16 @@ int virNetServerProgramSendStreamData(virNetServerProgramPtr prog,
                                       const char *data,
                                       size_t len);
 
+char *virNetServerProgramPrepareStreamData(virNetServerProgramPtr prog,
+                                           virNetMessagePtr msg,
+                                           int procedure,
+                                           unsigned int serial,
+                                           size_t len);
+
+int virNetServerProgramSendPreparedStreamData(virNetServerClientPtr client,
+                                              virNetMessagePtr msg,
+                                              size_t len);
+
 int virNetServerProgramSendStreamHole(virNetServerProgramPtr prog,
                                       virNetServerClientPtr client,
                                       virNetMessagePtr msg,
@@ -33,15 +33,23 @@
 # include <sys/ucred.h>
 #endif
 
+#ifndef WIN32
+# include <poll.h>
+# include <sys/uio.h>
+#endif
+
 #ifdef WITH_SELINUX
 # include <selinux/selinux.h>
 #endif
 
+#include <gio/gio.h>
+
 #include "virsocket.h"
 #include "virnetsocket.h"
 #include "virutil.h"
 #include "viralloc.h"
 #include "virerror.h"
+#include "vireventglib.h"
 #include "virlog.h"
 #include "virfile.h"
 #include "virthread.h"
@@ -75,6 +83,7 @@ struct _virNetSocket {
     bool unlinkUNIX;
 
     /* Event callback fields */
+    GMainContext *context;
     virNetSocketIOFunc func;
     void *opaque;
     virFreeCallback ff;
@@ -89,6 +98,10 @@ struct _virNetSocket {
 #if WITH_SASL
     virNetSASLSessionPtr saslSession;
 
+    /* Encoded data read off the wire, kept for the whole session */
+    char *saslReadBuf;
+    size_t saslReadBufSize;
+
     const char *saslDecoded;
     size_t saslDecodedLength;
     size_t saslDecodedOffset;
@@ -104,8 +117,25 @@ struct _virNetSocket {
 #if WITH_LIBSSH
     virNetLibsshSessionPtr libsshSession;
 #endif
+
+    GConverter *compressor;
+    GConverter *decompressor;
+
+    char *compDecoded;
+    size_t compDecodedLength;
+    size_t compDecodedOffset;
+
+    char *compEncoded;
+    size_t compEncodedLength;
+    size_t compEncodedRawLength;
+    size_t compEncodedOffset;
+
+    virNetSocketCompressionStats compStats;
 };
 
+/* Amount of data compressed or decompressed at once */
+#define VIR_NET_SOCKET_COMPRESS_CHUNK (64 * 1024)
+
 
 static virClassPtr virNetSocketClass;
 static void virNetSocketDispose(void *obj);
@@ -1295,6 +1325,11 @@ virJSONValuePtr virNetSocketPreExecRestart(virNetSocketPtr sock)
         goto error;
     }
 #endif
+    if (sock->compressor) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("Unable to save socket state when compression is active"));
+        goto error;
+    }
     if (sock->tlsSession) {
         virReportError(VIR_ERR_OPERATION_INVALID, "%s",
                        _("Unable to save socket state when TLS session is active"));
@@ -1368,6 +1403,7 @@ void virNetSocketDispose(void *obj)
     virObjectUnref(sock->tlsSession);
 #if WITH_SASL
     virObjectUnref(sock->saslSession);
+    VIR_FREE(sock->saslReadBuf);
 #endif
 
 #if WITH_SSH2
@@ -1378,6 +1414,11 @@ void virNetSocketDispose(void *obj)
     virObjectUnref(sock->libsshSession);
 #endif
 
+    g_clear_object(&sock->compressor);
+    g_clear_object(&sock->decompressor);
+    VIR_FREE(sock->compDecoded);
+    VIR_FREE(sock->compEncoded);
+
     if (sock->ownsFd && sock->fd != -1) {
         closesocket(sock->fd);
         sock->fd = -1;
@@ -1389,6 +1430,9 @@ void virNetSocketDispose(void *obj)
     VIR_FREE(sock->localAddrStrSASL);
     VIR_FREE(sock->remoteAddrStrSASL);
     VIR_FREE(sock->remoteAddrStrURI);
+
+    if (sock->context)
+        g_main_context_unref(sock->context);
 }
 
 
@@ -1735,6 +1779,8 @@ bool virNetSocketHasCachedData(virNetSocketPtr sock G_GNUC_UNUSED)
     if (sock->saslDecoded)
         hasCached = true;
 #endif
+    if (sock->compDecoded)
+        hasCached = true;
     virObjectUnlock(sock);
     return hasCached;
 }
@@ -1771,6 +1817,32 @@ static ssize_t virNetSocketLibsshWrite(virNetSocketPtr sock,
 }
 #endif
 
+/*
+ * Returns true if the peer sent data which was not read yet, either
+ * still queued in the kernel or already decoded and cached
+ */
+bool virNetSocketHasUnreadData(virNetSocketPtr sock)
+{
+#ifndef WIN32
+    struct pollfd fd = { .events = POLLIN };
+
+    if (virNetSocketHasCachedData(sock))
+        return true;
+
+    virObjectLock(sock);
+    fd.fd = sock->fd;
+    virObjectUnlock(sock);
+
+    if (poll(&fd, 1, 0) > 0 && (fd.revents & POLLIN))
+        return true;
+
+    return false;
+#else
+    return virNetSocketHasCachedData(sock);
+#endif
+}
+
+
 bool virNetSocketHasPendingData(virNetSocketPtr sock G_GNUC_UNUSED)
 {
     bool hasPending = false;
@@ -1779,6 +1851,8 @@ bool virNetSocketHasPendingData(virNetSocketPtr sock G_GNUC_UNUSED)
     if (sock->saslEncoded)
         hasPending = true;
 #endif
+    if (sock->compEncoded)
+        hasPending = true;
     virObjectUnlock(sock);
     return hasPending;
 }
@@ -1900,47 +1974,60 @@ static ssize_t virNetSocketWriteWire(virNetSocketPtr sock, const char *buf, size
 #if WITH_SASL
 static ssize_t virNetSocketReadSASL(virNetSocketPtr sock, char *buf, size_t len)
 {
-    ssize_t got;
+    size_t got = 0;
 
-    /* Need to read some more data off the wire */
-    if (sock->saslDecoded == NULL) {
-        ssize_t encodedLen = virNetSASLSessionGetMaxBufSize(sock->saslSession);
-        char *encoded;
-        if (VIR_ALLOC_N(encoded, encodedLen) < 0)
-            return -1;
-        encodedLen = virNetSocketReadWire(sock, encoded, encodedLen);
+    /* Keep decoding packets while more data is waiting on the wire,
+     * so that a whole message is filled in by a single call rather
+     * than one SASL packet per trip through the event loop */
+    while (got < len) {
+        size_t avail;
 
-        if (encodedLen <= 0) {
-            VIR_FREE(encoded);
-            return encodedLen;
-        }
+        /* Need to read some more data off the wire */
+        if (sock->saslDecoded == NULL) {
+            ssize_t encodedLen;
 
-        if (virNetSASLSessionDecode(sock->saslSession,
-                                    encoded, encodedLen,
-                                    &sock->saslDecoded, &sock->saslDecodedLength) < 0) {
-            VIR_FREE(encoded);
-            return -1;
-        }
-        VIR_FREE(encoded);
+            if (!sock->saslReadBuf) {
+                sock->saslReadBufSize = virNetSASLSessionGetMaxBufSize(sock->saslSession);
+                sock->saslReadBuf = g_new(char, sock->saslReadBufSize);
+            }
 
-        sock->saslDecodedOffset = 0;
-    }
+            encodedLen = virNetSocketReadWire(sock, sock->saslReadBuf,
+                                              sock->saslReadBufSize);
+
+            if (encodedLen <= 0) {
+                /* Return what we have, an error is hit again
+                 * by the next read */
+                if (got > 0) {
+                    virResetLastError();
+                    break;
+                }
+                return encodedLen;
+            }
 
-    /* Some buffered decoded data to return now */
-    got = sock->saslDecodedLength - sock->saslDecodedOffset;
+            if (virNetSASLSessionDecode(sock->saslSession,
+                                        sock->saslReadBuf, encodedLen,
+                                        &sock->saslDecoded,
+                                        &sock->saslDecodedLength) < 0)
+                return -1;
 
-    if (len > got)
-        len = got;
+            sock->saslDecodedOffset = 0;
+        }
+
+        /* Some buffered decoded data to return now */
+        avail = MIN(sock->saslDecodedLength - sock->saslDecodedOffset,
+                    len - got);
 
-    memcpy(buf, sock->saslDecoded + sock->saslDecodedOffset, len);
-    sock->saslDecodedOffset += len;
+        memcpy(buf + got, sock->saslDecoded + sock->saslDecodedOffset, avail);
+        sock->saslDecodedOffset += avail;
+        got += avail;
 
-    if (sock->saslDecodedOffset == sock->saslDecodedLength) {
-        sock->saslDecoded = NULL;
-        sock->saslDecodedOffset = sock->saslDecodedLength = 0;
+        if (sock->saslDecodedOffset == sock->saslDecodedLength) {
+            sock->saslDecoded = NULL;
+            sock->saslDecodedOffset = sock->saslDecodedLength = 0;
+        }
     }
 
-    return len;
+    return got;
 }
 
 
@@ -2004,10 +2091,258 @@ static ssize_t virNetSocketWriteSASL(virNetSocketPtr sock, const char *buf, size
 }
 #endif
 
+
+/*
+ * Runs all of @in through @converter, flushing its output if @flags
+ * contains G_CONVERTER_FLUSH. The output is stored in a newly
+ * allocated @out buffer, which may be empty if the decompressor
+ * needs more input.
+ */
+static int
+virNetSocketConvert(GConverter *converter,
+                    const char *in,
+                    size_t inlen,
+                    GConverterFlags flags,
+                    char **out,
+                    size_t *outlen)
+{
+    g_autofree char *buf = NULL;
+    size_t alloc = MAX(inlen, 1024);
+    size_t have = 0;
+    size_t inpos = 0;
+
+    buf = g_new(char, alloc);
+
+    for (;;) {
+        g_autoptr(GError) err = NULL;
+        GConverterResult res;
+        gsize nread = 0;
+        gsize nwritten = 0;
+
+        res = g_converter_convert(converter,
+                                  in + inpos, inlen - inpos,
+                                  buf + have, alloc - have,
+                                  flags, &nread, &nwritten, &err);
+
+        if (res == G_CONVERTER_ERROR) {
+            if (g_error_matches(err, G_IO_ERROR, G_IO_ERROR_NO_SPACE)) {
+                alloc *= 2;
+                buf = g_renew(char, buf, alloc);
+                continue;
+            }
+
+            /* all input was consumed and the output is complete */
+            if (inpos == inlen &&
+                g_error_matches(err, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT))
+                break;
+
+            virReportError(VIR_ERR_RPC,
+                           _("Unable to convert compressed data: %s"),
+                           err->message);
+            return -1;
+        }
+
+        inpos += nread;
+        have += nwritten;
+
+        /* The converter might have more output pending if it filled
+         * the buffer, so call it again */
+        if (have == alloc) {
+            alloc *= 2;
+            buf = g_renew(char, buf, alloc);
+            continue;
+        }
+
+        if (res == G_CONVERTER_FINISHED ||
+            (inpos == inlen &&
+             (!(flags & G_CONVERTER_FLUSH) || res == G_CONVERTER_FLUSHED)))
+            break;
+    }
+
+    *out = g_steal_pointer(&buf);
+    *outlen = have;
+    return 0;
+}
+
+
+static ssize_t virNetSocketReadCompressed(virNetSocketPtr sock, char *buf, size_t len)
+{
+    ssize_t got;
+
+    /* Need to read some more data off the wire */
+    if (sock->compDecoded == NULL) {
+        g_autofree char *encoded = g_new(char, VIR_NET_SOCKET_COMPRESS_CHUNK);
+        ssize_t encodedLen;
+
+        encodedLen = virNetSocketReadWire(sock, encoded,
+                                          VIR_NET_SOCKET_COMPRESS_CHUNK);
+        if (encodedLen <= 0)
+            return encodedLen;
+
+        if (virNetSocketConvert(sock->decompressor,
+                                encoded, encodedLen, G_CONVERTER_NO_FLAGS,
+                                &sock->compDecoded,
+                                &sock->compDecodedLength) < 0)
+            return -1;
+
+        sock->compDecodedOffset = 0;
+        sock->compStats.rxWire += encodedLen;
+        sock->compStats.rxRaw += sock->compDecodedLength;
+
+        /* Not enough input to produce any output yet */
+        if (sock->compDecodedLength == 0) {
+            VIR_FREE(sock->compDecoded);
+            return 0;
+        }
+    }
+
+    /* Some buffered decompressed data to return now */
+    got = sock->compDecodedLength - sock->compDecodedOffset;
+
+    if (len > got)
+        len = got;
+
+    memcpy(buf, sock->compDecoded + sock->compDecodedOffset, len);
+    sock->compDecodedOffset += len;
+
+    if (sock->compDecodedOffset == sock->compDecodedLength) {
+        VIR_FREE(sock->compDecoded);
+        sock->compDecodedOffset = sock->compDecodedLength = 0;
+    }
+
+    return len;
+}
+
+
+static ssize_t virNetSocketWriteCompressed(virNetSocketPtr sock, const char *buf, size_t len)
+{
+    ssize_t ret;
+
+    /* Not got any pending compressed data, so compress raw stuff. Each
+     * chunk is flushed so that the peer can process it right away */
+    if (sock->compEncoded == NULL) {
+        size_t tosend = MIN(len, VIR_NET_SOCKET_COMPRESS_CHUNK);
+
+        if (virNetSocketConvert(sock->compressor,
+                                buf, tosend, G_CONVERTER_FLUSH,
+                                &sock->compEncoded,
+                                &sock->compEncodedLength) < 0)
+            return -1;
+
+        sock->compEncodedRawLength = tosend;
+        sock->compEncodedOffset = 0;
+        sock->compStats.txRaw += tosend;
+        sock->compStats.txWire += sock->compEncodedLength;
+    }
+
+    /* Send some of the compressed stuff out on the wire */
+    ret = virNetSocketWriteWire(sock,
+                                sock->compEncoded + sock->compEncodedOffset,
+                                sock->compEncodedLength - sock->compEncodedOffset);
+
+    if (ret <= 0)
+        return ret; /* -1 error, 0 == egain */
+
+    sock->compEncodedOffset += ret;
+
+    /* Same as with SASL, report the raw data as sent only once all of
+     * its compressed form was sent, until then the caller retries with
+     * the same buffer */
+    if (sock->compEncodedOffset == sock->compEncodedLength) {
+        ssize_t done = sock->compEncodedRawLength;
+
+        VIR_FREE(sock->compEncoded);
+        sock->compEncodedOffset = sock->compEncodedLength = sock->compEncodedRawLength = 0;
+        return done;
+    }
+
+    return 0;
+}
+
+
+/**
+ * virNetSocketSetCompression:
+ * @sock: socket
+ * @level: zlib compression level, 1 to 9
+ *
+ * Compresses all further data sent and decompresses all data
+ * received on @sock. The peer must enable compression at the same
+ * point in the data stream.
+ *
+ * Returns 0 on success, -1 on error
+ */
+int virNetSocketSetCompression(virNetSocketPtr sock,
+                               int level)
+{
+    int ret = -1;
+
+    virObjectLock(sock);
+
+    if (level < 1 || level > 9) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("invalid compression level %d"), level);
+        goto cleanup;
+    }
+
+    if (sock->compressor) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("compression is already enabled"));
+        goto cleanup;
+    }
+
+#if WITH_SASL
+    /* Data encrypted by SASL doesn't compress */
+    if (sock->saslSession) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("compression cannot be used with a SASL SSF layer"));
+        goto cleanup;
+    }
+#endif
+
+    sock->compressor = G_CONVERTER(g_zlib_compressor_new(G_ZLIB_COMPRESSOR_FORMAT_RAW,
+                                                         level));
+    sock->decompressor = G_CONVERTER(g_zlib_decompressor_new(G_ZLIB_COMPRESSOR_FORMAT_RAW));
+    memset(&sock->compStats, 0, sizeof(sock->compStats));
+
+    ret = 0;
+
+ cleanup:
+    virObjectUnlock(sock);
+    return ret;
+}
+
+
+/**
+ * virNetSocketGetCompressionStats:
+ * @sock: socket
+ * @stats: filled with the amount of data before and after compression
+ *
+ * Returns true if compression is enabled on @sock and @stats was
+ * filled, false otherwise.
+ */
+bool virNetSocketGetCompressionStats(virNetSocketPtr sock,
+                                     virNetSocketCompressionStatsPtr stats)
+{
+    bool ret = false;
+
+    virObjectLock(sock);
+    if (sock->compressor) {
+        *stats = sock->compStats;
+        ret = true;
+    }
+    virObjectUnlock(sock);
+
+    return ret;
+}
+
+
 ssize_t virNetSocketRead(virNetSocketPtr sock, char *buf, size_t len)
 {
     ssize_t ret;
     virObjectLock(sock);
+    if (sock->compressor)
+        ret = virNetSocketReadCompressed(sock, buf, len);
+    else
 #if WITH_SASL
     if (sock->saslSession)
         ret = virNetSocketReadSASL(sock, buf, len);
@@ -2023,6 +2358,9 @@ ssize_t virNetSocketWrite(virNetSocketPtr sock, const char *buf, size_t len)
     ssize_t ret;
 
     virObjectLock(sock);
+    if (sock->compressor)
+        ret = virNetSocketWriteCompressed(sock, buf, len);
+    else
 #if WITH_SASL
     if (sock->saslSession)
         ret = virNetSocketWriteSASL(sock, buf, len);
@@ -2034,6 +2372,82 @@ ssize_t virNetSocketWrite(virNetSocketPtr sock, const char *buf, size_t len)
 }
 
 
+/* Max number of buffers passed to a single writev() call */
+#define VIR_NET_SOCKET_WRITE_VECTOR_MAX 64
+
+/*
+ * Writes as much of the @nbufs buffers as possible in one go. On plain
+ * sockets all of them are passed to a single writev() call, when an
+ * encryption layer is active only the first buffer is written.
+ *
+ * Returns number of bytes written, 0 on EAGAIN, -1 on error
+ */
+ssize_t virNetSocketWriteVector(virNetSocketPtr sock,
+                                const char *const *bufs,
+                                const size_t *lens,
+                                size_t nbufs)
+{
+#ifndef WIN32
+    struct iovec iov[VIR_NET_SOCKET_WRITE_VECTOR_MAX];
+    ssize_t ret;
+    size_t i;
+#endif
+
+    if (nbufs == 0)
+        return 0;
+
+#ifndef WIN32
+    virObjectLock(sock);
+
+    if (nbufs == 1 ||
+        sock->tlsSession ||
+        sock->compressor ||
+# if WITH_SASL
+        sock->saslSession ||
+# endif
+# if WITH_SSH2
+        sock->sshSession ||
+# endif
+# if WITH_LIBSSH
+        sock->libsshSession ||
+# endif
+        false) {
+        virObjectUnlock(sock);
+        return virNetSocketWrite(sock, bufs[0], lens[0]);
+    }
+
+    nbufs = MIN(nbufs, G_N_ELEMENTS(iov));
+    for (i = 0; i < nbufs; i++) {
+        iov[i].iov_base = (void *)bufs[i];
+        iov[i].iov_len = lens[i];
+    }
+
+ rewrite:
+    ret = writev(sock->fd, iov, nbufs);
+
+    if (ret < 0) {
+        if (errno == EINTR)
+            goto rewrite;
+        if (errno == EAGAIN) {
+            ret = 0;
+        } else {
+            virReportSystemError(errno, "%s",
+                                 _("Cannot write data"));
+        }
+    } else if (ret == 0) {
+        virReportSystemError(EIO, "%s",
+                             _("End of file while writing data"));
+        ret = -1;
+    }
+
+    virObjectUnlock(sock);
+    return ret;
+#else /* WIN32 */
+    return virNetSocketWrite(sock, bufs[0], lens[0]);
+#endif /* WIN32 */
+}
+
+
 /*
  * Returns 1 if an FD was sent, 0 if it would block, -1 on error
  */
@@ -2201,6 +2615,25 @@ static void virNetSocketEventFree(void *opaque)
     virObjectUnref(sock);
 }
 
+/**
+ * virNetSocketSetEventContext:
+ * @sock: the socket
+ * @context: the context to dispatch I/O callbacks in, or NULL
+ *
+ * Makes the I/O callback added later by virNetSocketAddIOCallback run
+ * in the thread running @context rather than in the default event loop.
+ * Has no effect on a callback that is already registered.
+ */
+void virNetSocketSetEventContext(virNetSocketPtr sock,
+                                 GMainContext *context)
+{
+    virObjectLock(sock);
+    if (sock->context)
+        g_main_context_unref(sock->context);
+    sock->context = context ? g_main_context_ref(context) : NULL;
+    virObjectUnlock(sock);
+}
+
 int virNetSocketAddIOCallback(virNetSocketPtr sock,
                               int events,
                               virNetSocketIOFunc func,
@@ -2216,11 +2649,21 @@ int virNetSocketAddIOCallback(virNetSocketPtr sock,
         goto cleanup;
     }
 
-    if ((sock->watch = virEventAddHandle(sock->fd,
-                                         events,
-                                         virNetSocketEventHandle,
-                                         sock,
-                                         virNetSocketEventFree)) < 0) {
+    if (sock->context)
+        sock->watch = virEventGLibHandleAddContext(sock->context,
+                                                   sock->fd,
+                                                   events,
+                                                   virNetSocketEventHandle,
+                                                   sock,
+                                                   virNetSocketEventFree);
+    else
+        sock->watch = virEventAddHandle(sock->fd,
+                                        events,
+                                        virNetSocketEventHandle,
+                                        sock,
+                                        virNetSocketEventFree);
+
+    if (sock->watch < 0) {
         VIR_DEBUG("Failed to register watch on socket %p", sock);
         goto cleanup;
     }
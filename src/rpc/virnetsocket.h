@@ -34,6 +34,15 @@
 typedef struct _virNetSocket virNetSocket;
 typedef virNetSocket *virNetSocketPtr;
 
+typedef struct _virNetSocketCompressionStats virNetSocketCompressionStats;
+typedef virNetSocketCompressionStats *virNetSocketCompressionStatsPtr;
+struct _virNetSocketCompressionStats {
+    unsigned long long txRaw;   /* bytes sent before compression */
+    unsigned long long txWire;  /* bytes sent after compression */
+    unsigned long long rxWire;  /* bytes received before decompression */
+    unsigned long long rxRaw;   /* bytes received after decompression */
+};
+
 
 typedef void (*virNetSocketIOFunc)(virNetSocketPtr sock,
                                    int events,
@@ -146,6 +155,10 @@ void virNetSocketSetQuietEOF(virNetSocketPtr sock);
 
 ssize_t virNetSocketRead(virNetSocketPtr sock, char *buf, size_t len);
 ssize_t virNetSocketWrite(virNetSocketPtr sock, const char *buf, size_t len);
+ssize_t virNetSocketWriteVector(virNetSocketPtr sock,
+                                const char *const *bufs,
+                                const size_t *lens,
+                                size_t nbufs);
 
 int virNetSocketSendFD(virNetSocketPtr sock, int fd);
 int virNetSocketRecvFD(virNetSocketPtr sock, int *fd);
@@ -157,8 +170,13 @@ void virNetSocketSetTLSSession(virNetSocketPtr sock,
 void virNetSocketSetSASLSession(virNetSocketPtr sock,
                                 virNetSASLSessionPtr sess);
 #endif
+int virNetSocketSetCompression(virNetSocketPtr sock,
+                               int level);
+bool virNetSocketGetCompressionStats(virNetSocketPtr sock,
+                                     virNetSocketCompressionStatsPtr stats);
 bool virNetSocketHasCachedData(virNetSocketPtr sock);
 bool virNetSocketHasPendingData(virNetSocketPtr sock);
+bool virNetSocketHasUnreadData(virNetSocketPtr sock);
 
 const char *virNetSocketLocalAddrStringSASL(virNetSocketPtr sock);
 const char *virNetSocketRemoteAddrStringSASL(virNetSocketPtr sock);
@@ -168,6 +186,9 @@ int virNetSocketListen(virNetSocketPtr sock, int backlog);
 int virNetSocketAccept(virNetSocketPtr sock,
                        virNetSocketPtr *clientsock);
 
+void virNetSocketSetEventContext(virNetSocketPtr sock,
+                                 GMainContext *context);
+
 int virNetSocketAddIOCallback(virNetSocketPtr sock,
                               int events,
                               virNetSocketIOFunc func,
@@ -36,10 +36,16 @@
 #include "virlog.h"
 #include "virprobe.h"
 #include "virthread.h"
+#include "virhash.h"
 #include "configmake.h"
 
 #define DH_BITS 2048
 
+/* How long servers issue session tickets encrypted by the same key.
+ * Tickets encrypted by an older key are rejected, so clients holding
+ * them fall back to a full handshake. */
+#define VIR_NET_TLS_TICKET_KEY_LIFETIME (12 * 60 * 60 * G_USEC_PER_SEC)
+
 #define LIBVIRT_PKI_DIR SYSCONFDIR "/pki"
 #define LIBVIRT_CACERT LIBVIRT_PKI_DIR "/CA/cacert.pem"
 #define LIBVIRT_CACRL LIBVIRT_PKI_DIR "/CA/cacrl.pem"
@@ -62,6 +68,13 @@ struct _virNetTLSContext {
     bool requireValidCert;
     const char *const *x509dnACL;
     char *priority;
+
+    /* server only, key for encrypting session tickets */
+    gnutls_datum_t ticketKey;
+    gint64 ticketKeyCreated;
+
+    /* client only, identifies the credentials in the session cache */
+    char *cert;
 };
 
 struct _virNetTLSSession {
@@ -76,8 +89,21 @@ struct _virNetTLSSession {
     virNetTLSSessionReadFunc readFunc;
     void *opaque;
     char *x509dname;
+
+    /* client only, key under which the session can be cached for
+     * resumption, NULL if it can't */
+    char *cacheKey;
+
+    gint64 handshakeStart;
+    unsigned long long handshakeTime; /* microseconds */
 };
 
+/* Data of sessions for resuming them by the next connection to the same
+ * server with the same credentials, indexed by virNetTLSSession cacheKey.
+ * Every entry is used only once as TLS 1.3 tickets must not be reused. */
+static virHashTablePtr virNetTLSSessionCache;
+static virMutex virNetTLSSessionCacheLock = VIR_MUTEX_INITIALIZER;
+
 static virClassPtr virNetTLSContextClass;
 static virClassPtr virNetTLSSessionClass;
 static void virNetTLSContextDispose(void *obj);
@@ -98,6 +124,49 @@ static int virNetTLSContextOnceInit(void)
 VIR_ONCE_GLOBAL_INIT(virNetTLSContext);
 
 
+static void
+virNetTLSSessionDataFree(void *opaque)
+{
+    gnutls_datum_t *data = opaque;
+
+    if (!data)
+        return;
+
+    gnutls_free(data->data);
+    g_free(data);
+}
+
+
+/*
+ * Generates a new key for encrypting session tickets. Must be called
+ * with @ctxt locked.
+ */
+static int
+virNetTLSContextRotateTicketKey(virNetTLSContextPtr ctxt)
+{
+    gnutls_datum_t key = { NULL, 0 };
+    int err;
+
+    if ((err = gnutls_session_ticket_key_generate(&key)) < 0) {
+        virReportError(VIR_ERR_SYSTEM_ERROR,
+                       _("Unable to generate TLS session ticket key: %s"),
+                       gnutls_strerror(err));
+        return -1;
+    }
+
+    if (ctxt->ticketKey.data) {
+        memset(ctxt->ticketKey.data, 0, ctxt->ticketKey.size);
+        gnutls_free(ctxt->ticketKey.data);
+    }
+
+    ctxt->ticketKey = key;
+    ctxt->ticketKeyCreated = g_get_monotonic_time();
+
+    VIR_DEBUG("Generated new session ticket key for ctxt=%p", ctxt);
+    return 0;
+}
+
+
 static int
 virNetTLSContextCheckCertFile(const char *type, const char *file, bool allowMissing)
 {
@@ -737,6 +806,11 @@ static virNetTLSContextPtr virNetTLSContextNew(const char *cacert,
 
         gnutls_certificate_set_dh_params(ctxt->x509cred,
                                          ctxt->dhParams);
+
+        if (virNetTLSContextRotateTicketKey(ctxt) < 0)
+            goto error;
+    } else {
+        ctxt->cert = g_strdup(cert);
     }
 
     ctxt->requireValidCert = requireValidCert;
@@ -952,6 +1026,13 @@ int virNetTLSContextReloadForServer(virNetTLSContextPtr ctxt,
 
     gnutls_certificate_free_credentials(x509credBak);
 
+    /* sessions established with the old certificates must not be
+     * resumed */
+    virObjectLock(ctxt);
+    if (virNetTLSContextRotateTicketKey(ctxt) < 0)
+        VIR_WARN("%s", virGetLastErrorMessage());
+    virObjectUnlock(ctxt);
+
     return 0;
 
  error:
@@ -1149,6 +1230,11 @@ void virNetTLSContextDispose(void *obj)
           "ctxt=%p", ctxt);
 
     VIR_FREE(ctxt->priority);
+    VIR_FREE(ctxt->cert);
+    if (ctxt->ticketKey.data) {
+        memset(ctxt->ticketKey.data, 0, ctxt->ticketKey.size);
+        gnutls_free(ctxt->ticketKey.data);
+    }
     gnutls_dh_params_deinit(ctxt->dhParams);
     gnutls_certificate_free_credentials(ctxt->x509cred);
 }
@@ -1236,6 +1322,47 @@ virNetTLSSessionPtr virNetTLSSessionNew(virNetTLSContextPtr ctxt,
         gnutls_dh_set_prime_bits(sess->session, DH_BITS);
     }
 
+    /* Let clients resume their sessions by tickets, which saves the
+     * public key operations of a full handshake on both sides. The
+     * peer certificate is kept in the resumed session and checked by
+     * virNetTLSContextCheckCertificate as usual. TLS 1.3 early data
+     * is never enabled because it could be replayed. */
+    if (ctxt->isServer) {
+        virObjectLock(ctxt);
+        if (g_get_monotonic_time() - ctxt->ticketKeyCreated > VIR_NET_TLS_TICKET_KEY_LIFETIME &&
+            virNetTLSContextRotateTicketKey(ctxt) < 0)
+            VIR_WARN("%s", virGetLastErrorMessage());
+        err = gnutls_session_ticket_enable_server(sess->session,
+                                                  &ctxt->ticketKey);
+        virObjectUnlock(ctxt);
+
+        if (err != 0) {
+            virReportError(VIR_ERR_SYSTEM_ERROR,
+                           _("Failed to enable TLS session tickets: %s"),
+                           gnutls_strerror(err));
+            goto error;
+        }
+    } else if (hostname) {
+        gnutls_datum_t *data = NULL;
+
+        sess->cacheKey = g_strdup_printf("%s %s", hostname,
+                                         NULLSTR_EMPTY(ctxt->cert));
+
+        virMutexLock(&virNetTLSSessionCacheLock);
+        if (virNetTLSSessionCache)
+            data = virHashSteal(virNetTLSSessionCache, sess->cacheKey);
+        virMutexUnlock(&virNetTLSSessionCacheLock);
+
+        if (data) {
+            VIR_DEBUG("Trying to resume session to '%s'", hostname);
+            if ((err = gnutls_session_set_data(sess->session,
+                                               data->data, data->size)) != 0)
+                VIR_DEBUG("Unable to use cached session: %s",
+                          gnutls_strerror(err));
+            virNetTLSSessionDataFree(data);
+        }
+    }
+
     gnutls_transport_set_ptr(sess->session, sess);
     gnutls_transport_set_push_function(sess->session,
                                        virNetTLSSessionPush);
@@ -1337,11 +1464,16 @@ int virNetTLSSessionHandshake(virNetTLSSessionPtr sess)
     int ret;
     VIR_DEBUG("sess=%p", sess);
     virObjectLock(sess);
+    if (sess->handshakeStart == 0)
+        sess->handshakeStart = g_get_monotonic_time();
     ret = gnutls_handshake(sess->session);
     VIR_DEBUG("Ret=%d", ret);
     if (ret == 0) {
         sess->handshakeComplete = true;
-        VIR_DEBUG("Handshake is complete");
+        sess->handshakeTime = g_get_monotonic_time() - sess->handshakeStart;
+        VIR_DEBUG("Handshake is complete in %lluus, resumed=%d",
+                  sess->handshakeTime,
+                  gnutls_session_is_resumed(sess->session) != 0);
         goto cleanup;
     }
     if (ret == GNUTLS_E_INTERRUPTED || ret == GNUTLS_E_AGAIN) {
@@ -1397,6 +1529,35 @@ int virNetTLSSessionGetKeySize(virNetTLSSessionPtr sess)
     return ssf;
 }
 
+/**
+ * virNetTLSSessionGetHandshakeStats:
+ * @sess: the TLS session
+ * @usec: filled with the time the handshake took in microseconds
+ * @resumed: filled with whether a previous session was resumed
+ *
+ * The time includes waiting for the peer.
+ *
+ * Returns true if the handshake is complete and the statistics were
+ * filled in, false otherwise
+ */
+bool
+virNetTLSSessionGetHandshakeStats(virNetTLSSessionPtr sess,
+                                  unsigned long long *usec,
+                                  bool *resumed)
+{
+    bool ret;
+
+    virObjectLock(sess);
+    ret = sess->handshakeComplete;
+    if (ret) {
+        *usec = sess->handshakeTime;
+        *resumed = gnutls_session_is_resumed(sess->session) != 0;
+    }
+    virObjectUnlock(sess);
+
+    return ret;
+}
+
 const char *virNetTLSSessionGetX509DName(virNetTLSSessionPtr sess)
 {
     const char *ret = NULL;
@@ -1410,6 +1571,43 @@ const char *virNetTLSSessionGetX509DName(virNetTLSSessionPtr sess)
     return ret;
 }
 
+/*
+ * Remembers the data of a client session so that the next connection
+ * with the same credentials to the same server can resume it. By the
+ * time the session is disposed of the server had the chance to send
+ * a ticket, which in TLS 1.3 happens only after the handshake.
+ */
+static void
+virNetTLSSessionCacheStore(virNetTLSSessionPtr sess)
+{
+    g_autofree gnutls_datum_t *data = NULL;
+
+    if (!sess->cacheKey || !sess->handshakeComplete)
+        return;
+
+#if GNUTLS_VERSION_NUMBER >= 0x030603
+    if (!(gnutls_session_get_flags(sess->session) & GNUTLS_SFLAGS_SESSION_TICKET) &&
+        !gnutls_session_is_resumed(sess->session))
+        return;
+#endif
+
+    data = g_new0(gnutls_datum_t, 1);
+    if (gnutls_session_get_data2(sess->session, data) != 0)
+        return;
+
+    virMutexLock(&virNetTLSSessionCacheLock);
+    if (!virNetTLSSessionCache)
+        virNetTLSSessionCache = virHashNew(virNetTLSSessionDataFree);
+    if (!virNetTLSSessionCache ||
+        virHashUpdateEntry(virNetTLSSessionCache, sess->cacheKey, data) < 0) {
+        gnutls_free(data->data);
+        virResetLastError();
+    } else {
+        data = NULL;
+    }
+    virMutexUnlock(&virNetTLSSessionCacheLock);
+}
+
 void virNetTLSSessionDispose(void *obj)
 {
     virNetTLSSessionPtr sess = obj;
@@ -1417,6 +1615,9 @@ void virNetTLSSessionDispose(void *obj)
     PROBE(RPC_TLS_SESSION_DISPOSE,
           "sess=%p", sess);
 
+    virNetTLSSessionCacheStore(sess);
+
+    VIR_FREE(sess->cacheKey);
     VIR_FREE(sess->x509dname);
     VIR_FREE(sess->hostname);
     gnutls_deinit(sess->session);
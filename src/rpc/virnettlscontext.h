@@ -100,4 +100,8 @@ virNetTLSSessionGetHandshakeStatus(virNetTLSSessionPtr sess);
 
 int virNetTLSSessionGetKeySize(virNetTLSSessionPtr sess);
 
+bool virNetTLSSessionGetHandshakeStats(virNetTLSSessionPtr sess,
+                                       unsigned long long *usec,
+                                       bool *resumed);
+
 const char *virNetTLSSessionGetX509DName(virNetTLSSessionPtr sess);
@@ -388,6 +388,93 @@ secretGetValue(virSecretPtr secret,
 }
 
 
+static int
+secretConnectSecretGetValues(virConnectPtr conn,
+                             virSecretValueLookupPtr lookups,
+                             size_t nlookups,
+                             unsigned int flags,
+                             unsigned int internalFlags)
+{
+    virSecretObjPtr obj = NULL;
+    virSecretDefPtr def;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    size_t i;
+
+    virCheckFlags(0, -1);
+
+    for (i = 0; i < nlookups; i++) {
+        virSecretValueLookupPtr lookup = lookups + i;
+
+        switch ((virSecretLookupType) lookup->def.type) {
+        case VIR_SECRET_LOOKUP_TYPE_UUID:
+            virUUIDFormat(lookup->def.u.uuid, uuidstr);
+            if (!(obj = virSecretObjListFindByUUID(driver->secrets, uuidstr))) {
+                virReportError(VIR_ERR_NO_SECRET,
+                               _("no secret with matching uuid '%s'"), uuidstr);
+                goto error;
+            }
+            break;
+
+        case VIR_SECRET_LOOKUP_TYPE_USAGE:
+            if (!(obj = virSecretObjListFindByUsage(driver->secrets,
+                                                    lookup->usageType,
+                                                    lookup->def.u.usage))) {
+                virReportError(VIR_ERR_NO_SECRET,
+                               _("no secret with matching usage '%s'"),
+                               lookup->def.u.usage);
+                goto error;
+            }
+            break;
+
+        case VIR_SECRET_LOOKUP_TYPE_NONE:
+        case VIR_SECRET_LOOKUP_TYPE_LAST:
+        default:
+            virReportError(VIR_ERR_INVALID_ARG, "%s",
+                           _("secret lookup type not specified"));
+            goto error;
+        }
+
+        def = virSecretObjGetDef(obj);
+        if (virConnectSecretGetValuesEnsureACL(conn, def) < 0)
+            goto error;
+
+        /* same as virSecretGetSecretString */
+        if (def->usage_type != VIR_SECRET_USAGE_TYPE_NONE &&
+            def->usage_type != lookup->usageType) {
+            virUUIDFormat(def->uuid, uuidstr);
+            virReportError(VIR_ERR_INVALID_ARG,
+                           _("secret with uuid %s is of type '%s' not "
+                             "expected '%s' type"),
+                           uuidstr, virSecretUsageTypeToString(def->usage_type),
+                           virSecretUsageTypeToString(lookup->usageType));
+            goto error;
+        }
+
+        if ((internalFlags & VIR_SECRET_GET_VALUE_INTERNAL_CALL) == 0 &&
+            def->isprivate) {
+            virReportError(VIR_ERR_INVALID_SECRET, "%s",
+                           _("secret is private"));
+            goto error;
+        }
+
+        if (!(lookup->value = virSecretObjGetValue(obj)))
+            goto error;
+
+        lookup->value_size = virSecretObjGetValueSize(obj);
+
+        virSecretObjEndAPI(&obj);
+    }
+
+    return 0;
+
+ error:
+    virSecretObjEndAPI(&obj);
+    for (i = 0; i < nlookups; i++)
+        VIR_DISPOSE_N(lookups[i].value, lookups[i].value_size);
+    return -1;
+}
+
+
 static int
 secretUndefine(virSecretPtr secret)
 {
@@ -675,6 +762,7 @@ static virSecretDriver secretDriver = {
     .secretUndefine = secretUndefine, /* 0.7.1 */
     .connectSecretEventRegisterAny = secretConnectSecretEventRegisterAny, /* 3.0.0 */
     .connectSecretEventDeregisterAny = secretConnectSecretEventDeregisterAny, /* 3.0.0 */
+    .connectSecretGetValues = secretConnectSecretGetValues, /* 6.8.0 */
 };
 
 
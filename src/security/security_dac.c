@@ -201,6 +201,30 @@ static int virSecurityDACRestoreFileLabelInternal(virSecurityManagerPtr mgr,
                                                   const virStorageSource *src,
                                                   const char *path,
                                                   bool recall);
+static int
+virSecurityDACTransactionApply(size_t idx,
+                               void *opaque)
+{
+    virSecurityDACChownListPtr list = opaque;
+    virSecurityDACChownItemPtr item = list->items[idx];
+    const bool remember = item->remember && list->lock;
+
+    if (!item->restore) {
+        return virSecurityDACSetOwnership(list->manager,
+                                          item->src,
+                                          item->path,
+                                          item->uid,
+                                          item->gid,
+                                          remember);
+    }
+
+    return virSecurityDACRestoreFileLabelInternal(list->manager,
+                                                  item->src,
+                                                  item->path,
+                                                  remember);
+}
+
+
 /**
  * virSecurityDACTransactionRun:
  * @pid: process pid
@@ -208,8 +232,8 @@ static int virSecurityDACRestoreFileLabelInternal(virSecurityManagerPtr mgr,
  *
  * This is the callback that runs in the same namespace as the domain we are
  * relabelling. For given transaction (@opaque) it relabels all the paths on
- * the list. Depending on security manager configuration it might lock paths
- * we will relabel.
+ * the list, distinct paths in parallel. Depending on security manager
+ * configuration it might lock paths we will relabel.
  *
  * Returns: 0 on success
  *         -1 otherwise.
@@ -222,6 +246,8 @@ virSecurityDACTransactionRun(pid_t pid G_GNUC_UNUSED,
     virSecurityManagerMetadataLockStatePtr state;
     const char **paths = NULL;
     size_t npaths = 0;
+    g_autofree const char **itemPaths = NULL;
+    g_autofree bool *applied = NULL;
     size_t i;
     int rv = 0;
     int ret = -1;
@@ -256,32 +282,22 @@ virSecurityDACTransactionRun(pid_t pid G_GNUC_UNUSED,
         }
     }
 
-    for (i = 0; i < list->nItems; i++) {
-        virSecurityDACChownItemPtr item = list->items[i];
-        const bool remember = item->remember && list->lock;
-
-        if (!item->restore) {
-            rv = virSecurityDACSetOwnership(list->manager,
-                                            item->src,
-                                            item->path,
-                                            item->uid,
-                                            item->gid,
-                                            remember);
-        } else {
-            rv = virSecurityDACRestoreFileLabelInternal(list->manager,
-                                                        item->src,
-                                                        item->path,
-                                                        remember);
-        }
+    itemPaths = g_new0(const char *, list->nItems);
+    applied = g_new0(bool, list->nItems);
+    for (i = 0; i < list->nItems; i++)
+        itemPaths[i] = list->items[i]->path;
 
-        if (rv < 0)
-            break;
-    }
+    rv = virSecurityApplyParallel(itemPaths, list->nItems,
+                                  virSecurityDACTransactionApply,
+                                  list, applied);
 
-    for (; rv < 0 && i > 0; i--) {
+    for (i = list->nItems; rv < 0 && i > 0; i--) {
         virSecurityDACChownItemPtr item = list->items[i - 1];
         const bool remember = item->remember && list->lock;
 
+        if (!applied[i - 1])
+            continue;
+
         if (!item->restore) {
             virSecurityDACRestoreFileLabelInternal(list->manager,
                                                    item->src,
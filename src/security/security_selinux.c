@@ -88,6 +88,10 @@ struct _virSecuritySELinuxContextList {
     virSecuritySELinuxContextItemPtr *items;
     size_t nItems;
     bool lock;
+
+    /* Serializes restoring of labels while the transaction runs, lookups
+     * in label_handle are not guaranteed to be thread safe. */
+    virMutex restoreLock;
 };
 
 #define SECURITY_SELINUX_VOID_DOI       "0"
@@ -233,6 +237,32 @@ static int virSecuritySELinuxRestoreFileLabel(virSecurityManagerPtr mgr,
                                               bool recall);
 
 
+static int
+virSecuritySELinuxTransactionApply(size_t idx,
+                                   void *opaque)
+{
+    virSecuritySELinuxContextListPtr list = opaque;
+    virSecuritySELinuxContextItemPtr item = list->items[idx];
+    const bool remember = item->remember && list->lock;
+    int ret;
+
+    if (!item->restore) {
+        return virSecuritySELinuxSetFilecon(list->manager,
+                                            item->path,
+                                            item->tcon,
+                                            remember);
+    }
+
+    virMutexLock(&list->restoreLock);
+    ret = virSecuritySELinuxRestoreFileLabel(list->manager,
+                                             item->path,
+                                             remember);
+    virMutexUnlock(&list->restoreLock);
+
+    return ret;
+}
+
+
 /**
  * virSecuritySELinuxTransactionRun:
  * @pid: process pid
@@ -240,7 +270,7 @@ static int virSecuritySELinuxRestoreFileLabel(virSecurityManagerPtr mgr,
  *
  * This is the callback that runs in the same namespace as the domain we are
  * relabelling. For given transaction (@opaque) it relabels all the paths on
- * the list.
+ * the list, distinct paths in parallel.
  *
  * Returns: 0 on success
  *         -1 otherwise.
@@ -253,6 +283,8 @@ virSecuritySELinuxTransactionRun(pid_t pid G_GNUC_UNUSED,
     virSecurityManagerMetadataLockStatePtr state;
     const char **paths = NULL;
     size_t npaths = 0;
+    g_autofree const char **itemPaths = NULL;
+    g_autofree bool *applied = NULL;
     size_t i;
     int rv;
     int ret = -1;
@@ -287,30 +319,28 @@ virSecuritySELinuxTransactionRun(pid_t pid G_GNUC_UNUSED,
         }
     }
 
-    rv = 0;
-    for (i = 0; i < list->nItems; i++) {
-        virSecuritySELinuxContextItemPtr item = list->items[i];
-        const bool remember = item->remember && list->lock;
-
-        if (!item->restore) {
-            rv = virSecuritySELinuxSetFilecon(list->manager,
-                                              item->path,
-                                              item->tcon,
-                                              remember);
-        } else {
-            rv = virSecuritySELinuxRestoreFileLabel(list->manager,
-                                                    item->path,
-                                                    remember);
-        }
+    itemPaths = g_new0(const char *, list->nItems);
+    applied = g_new0(bool, list->nItems);
+    for (i = 0; i < list->nItems; i++)
+        itemPaths[i] = list->items[i]->path;
 
-        if (rv < 0)
-            break;
+    if (virMutexInit(&list->restoreLock) < 0) {
+        virReportSystemError(errno, "%s", _("unable to init mutex"));
+        rv = -1;
+    } else {
+        rv = virSecurityApplyParallel(itemPaths, list->nItems,
+                                      virSecuritySELinuxTransactionApply,
+                                      list, applied);
+        virMutexDestroy(&list->restoreLock);
     }
 
-    for (; rv < 0 && i > 0; i--) {
+    for (i = list->nItems; rv < 0 && i > 0; i--) {
         virSecuritySELinuxContextItemPtr item = list->items[i - 1];
         const bool remember = item->remember && list->lock;
 
+        if (!applied[i - 1])
+            continue;
+
         if (!item->restore) {
             virSecuritySELinuxRestoreFileLabel(list->manager,
                                                item->path,
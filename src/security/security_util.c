@@ -25,6 +25,7 @@
 #include "virlog.h"
 #include "viruuid.h"
 #include "virhostuptime.h"
+#include "virthread.h"
 
 #include "security_util.h"
 
@@ -525,3 +526,147 @@ virSecurityMoveRememberedLabel(const char *name,
 
     return 0;
 }
+
+
+/* Upper limit of threads relabelling paths of a single transaction */
+#define VIR_SECURITY_APPLY_THREADS 8
+
+typedef struct _virSecurityApplyData virSecurityApplyData;
+struct _virSecurityApplyData {
+    virMutex lock;
+    size_t npaths;
+    size_t *chains; /* index of the first item with the same path */
+    size_t *heads; /* indexes of items which start a chain */
+    size_t nheads;
+    size_t next; /* next chain to process */
+    bool failed;
+    virErrorPtr err;
+
+    virSecurityApplyCallback cb;
+    void *opaque;
+    bool *applied;
+};
+
+
+static void
+virSecurityApplyWorker(void *opaque)
+{
+    virSecurityApplyData *data = opaque;
+
+    while (true) {
+        size_t head;
+        size_t i;
+
+        virMutexLock(&data->lock);
+        if (data->failed || data->next == data->nheads) {
+            virMutexUnlock(&data->lock);
+            return;
+        }
+        head = data->heads[data->next++];
+        virMutexUnlock(&data->lock);
+
+        for (i = head; i < data->npaths; i++) {
+            if (data->chains[i] != head)
+                continue;
+
+            if (data->cb(i, data->opaque) < 0) {
+                virMutexLock(&data->lock);
+                if (!data->failed) {
+                    data->failed = true;
+                    virErrorPreserveLast(&data->err);
+                }
+                virMutexUnlock(&data->lock);
+                break;
+            }
+
+            data->applied[i] = true;
+        }
+    }
+}
+
+
+/**
+ * virSecurityApplyParallel:
+ * @paths: paths the items of a transaction relabel
+ * @npaths: number of items in @paths
+ * @cb: callback relabelling a single item
+ * @opaque: data passed to @cb
+ * @applied: array of @npaths elements, filled with whether @cb succeeded
+ *
+ * Calls @cb for each item of a transaction. Items with different paths
+ * are processed by up to VIR_SECURITY_APPLY_THREADS threads concurrently,
+ * items with the same path are processed in the order they were queued by
+ * one thread. Items with a NULL path are considered to have the same
+ * path. Once @cb fails no further item is started, the caller is expected
+ * to roll back the items marked in @applied.
+ *
+ * Returns 0 on success, -1 if @cb failed for any item.
+ */
+int
+virSecurityApplyParallel(const char *const *paths,
+                         size_t npaths,
+                         virSecurityApplyCallback cb,
+                         void *opaque,
+                         bool *applied)
+{
+    virSecurityApplyData data = { .npaths = npaths, .cb = cb,
+                                  .opaque = opaque, .applied = applied };
+    g_autofree size_t *chains = g_new0(size_t, npaths);
+    g_autofree size_t *heads = g_new0(size_t, npaths);
+    g_autofree virThread *threads = NULL;
+    size_t nthreads = 0;
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < npaths; i++) {
+        applied[i] = false;
+
+        for (j = 0; j < i; j++) {
+            if (STREQ_NULLABLE(paths[i], paths[j]))
+                break;
+        }
+
+        if (j < i) {
+            chains[i] = chains[j];
+        } else {
+            chains[i] = i;
+            heads[data.nheads++] = i;
+        }
+    }
+
+    data.chains = chains;
+    data.heads = heads;
+
+    if (virMutexInit(&data.lock) < 0) {
+        virReportSystemError(errno, "%s", _("unable to init mutex"));
+        return -1;
+    }
+
+    if (data.nheads > 1) {
+        size_t want = MIN(data.nheads, VIR_SECURITY_APPLY_THREADS) - 1;
+
+        threads = g_new0(virThread, want);
+        /* if not all threads can be started, the ones which were and
+         * this one do the work */
+        for (nthreads = 0; nthreads < want; nthreads++) {
+            if (virThreadCreateFull(&threads[nthreads], true,
+                                    virSecurityApplyWorker,
+                                    "sec-relabel", false, &data) < 0)
+                break;
+        }
+    }
+
+    virSecurityApplyWorker(&data);
+
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+
+    virMutexDestroy(&data.lock);
+
+    if (data.failed) {
+        virErrorRestore(&data.err);
+        return -1;
+    }
+
+    return 0;
+}
@@ -32,3 +32,13 @@ int
 virSecurityMoveRememberedLabel(const char *name,
                                const char *src,
                                const char *dst);
+
+typedef int (*virSecurityApplyCallback)(size_t idx,
+                                        void *opaque);
+
+int
+virSecurityApplyParallel(const char *const *paths,
+                         size_t npaths,
+                         virSecurityApplyCallback cb,
+                         void *opaque,
+                         bool *applied);
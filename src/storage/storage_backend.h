@@ -32,7 +32,29 @@ typedef int (*virStorageBackendStartPool)(virStoragePoolObjPtr pool);
 typedef int (*virStorageBackendBuildPool)(virStoragePoolObjPtr pool,
                                           unsigned int flags);
 typedef int (*virStorageBackendRefreshPool)(virStoragePoolObjPtr pool);
+
+/* Upon entering this callback passed @pool is unlocked and its volumes
+ * are left in place. However, the pool's asyncjobs counter has been
+ * incremented. The callback has to lock @pool to update its volumes or
+ * definition. */
+typedef int (*virStorageBackendRefreshPoolIncremental)(virStoragePoolObjPtr pool);
 typedef int (*virStorageBackendStopPool)(virStoragePoolObjPtr pool);
+
+/* Reports the fill level of @vol to the storage driver. Returns 1 if
+ * the backend should grow @vol, 0 if not and -1 on error. */
+typedef int (*virStorageBackendVolUsageFunc)(virStoragePoolObjPtr pool,
+                                             virStorageVolDefPtr vol,
+                                             unsigned long long used,
+                                             unsigned long long limit,
+                                             void *opaque);
+
+/* Updates the capacity, allocation and available values of @pool and
+ * reports the fill level of its volumes through @func, without
+ * rescanning the volume list. It's called periodically for pools with
+ * allocation watermarks so it must be cheap. Called with @pool locked. */
+typedef int (*virStorageBackendCheckUsage)(virStoragePoolObjPtr pool,
+                                           virStorageBackendVolUsageFunc func,
+                                           void *opaque);
 typedef int (*virStorageBackendDeletePool)(virStoragePoolObjPtr pool,
                                            unsigned int flags);
 
@@ -100,13 +122,19 @@ typedef virStorageBackend *virStorageBackendPtr;
 struct _virStorageBackend {
     int type;
 
+    /* checkPool, startPool and refreshPool may run for several pools at
+     * once when the driver brings up its pools */
+    bool parallelStart;
+
     virStorageBackendFindPoolSources findPoolSources;
     virStorageBackendCheckPool checkPool;
     virStorageBackendStartPool startPool;
     virStorageBackendBuildPool buildPool;
     virStorageBackendRefreshPool refreshPool; /* Must be non-NULL */
+    virStorageBackendRefreshPoolIncremental refreshPoolIncremental;
     virStorageBackendStopPool stopPool;
     virStorageBackendDeletePool deletePool;
+    virStorageBackendCheckUsage checkUsage;
 
     virStorageBackendBuildVol buildVol;
     virStorageBackendBuildVolFrom buildVolFrom;
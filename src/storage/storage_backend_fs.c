@@ -636,7 +636,9 @@ virStorageBackend virStorageBackendDirectory = {
     .buildPool = virStorageBackendFileSystemBuild,
     .checkPool = virStorageBackendFileSystemCheck,
     .refreshPool = virStorageBackendRefreshLocal,
+    .refreshPoolIncremental = virStorageBackendRefreshLocalIncremental,
     .deletePool = virStorageBackendDeleteLocal,
+    .checkUsage = virStorageBackendCheckUsageLocal,
     .buildVol = virStorageBackendVolBuildLocal,
     .buildVolFrom = virStorageBackendVolBuildFromLocal,
     .createVol = virStorageBackendVolCreateLocal,
@@ -656,8 +658,10 @@ virStorageBackend virStorageBackendFileSystem = {
     .checkPool = virStorageBackendFileSystemCheck,
     .startPool = virStorageBackendFileSystemStart,
     .refreshPool = virStorageBackendRefreshLocal,
+    .refreshPoolIncremental = virStorageBackendRefreshLocalIncremental,
     .stopPool = virStorageBackendFileSystemStop,
     .deletePool = virStorageBackendDeleteLocal,
+    .checkUsage = virStorageBackendCheckUsageLocal,
     .buildVol = virStorageBackendVolBuildLocal,
     .buildVolFrom = virStorageBackendVolBuildFromLocal,
     .createVol = virStorageBackendVolCreateLocal,
@@ -676,8 +680,10 @@ virStorageBackend virStorageBackendNetFileSystem = {
     .startPool = virStorageBackendFileSystemStart,
     .findPoolSources = virStorageBackendFileSystemNetFindPoolSources,
     .refreshPool = virStorageBackendRefreshLocal,
+    .refreshPoolIncremental = virStorageBackendRefreshLocalIncremental,
     .stopPool = virStorageBackendFileSystemStop,
     .deletePool = virStorageBackendDeleteLocal,
+    .checkUsage = virStorageBackendCheckUsageLocal,
     .buildVol = virStorageBackendVolBuildLocal,
     .buildVolFrom = virStorageBackendVolBuildFromLocal,
     .createVol = virStorageBackendVolCreateLocal,
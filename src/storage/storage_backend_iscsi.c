@@ -400,6 +400,7 @@ virStorageBackendISCSIStopPool(virStoragePoolObjPtr pool)
 
 virStorageBackend virStorageBackendISCSI = {
     .type = VIR_STORAGE_POOL_ISCSI,
+    .parallelStart = true,
 
     .checkPool = virStorageBackendISCSICheckPool,
     .startPool = virStorageBackendISCSIStartPool,
@@ -20,6 +20,7 @@
 
 #include <config.h>
 
+#include <poll.h>
 #include <iscsi/iscsi.h>
 #include <iscsi/scsi-lowlevel.h>
 
@@ -29,9 +30,11 @@
 #include "storage_util.h"
 #include "viralloc.h"
 #include "virerror.h"
+#include "virhash.h"
 #include "virlog.h"
 #include "virobject.h"
 #include "virstring.h"
+#include "virthread.h"
 #include "virtime.h"
 #include "viruuid.h"
 
@@ -41,6 +44,8 @@
 #define VIR_ISCSI_TEST_UNIT_TIMEOUT 30 * 1000
 #define BLOCK_PER_PACKET 128
 #define VOL_NAME_PREFIX "unit:0:0:"
+/* Number of LUNs queried at once over the session of a pool */
+#define VIR_ISCSI_DIRECT_LUN_QUERIES 32
 
 VIR_LOG_INIT("storage.storage_backend_iscsi_direct");
 
@@ -297,26 +302,19 @@ virISCSIDirectGetVolumeCapacity(struct iscsi_context *iscsi,
 
 static int
 virISCSIDirectRefreshVol(virStoragePoolObjPtr pool,
-                         struct iscsi_context *iscsi,
                          int lun,
+                         uint32_t block_size,
+                         uint64_t nb_block,
                          char *portal)
 {
     virStoragePoolDefPtr def = virStoragePoolObjGetDef(pool);
-    uint32_t block_size;
-    uint64_t nb_block;
     g_autoptr(virStorageVolDef) vol = NULL;
 
-    if (virISCSIDirectTestUnitReady(iscsi, lun) < 0)
-        return -1;
-
     if (VIR_ALLOC(vol) < 0)
         return -1;
 
     vol->type = VIR_STORAGE_VOL_NETWORK;
 
-    if (virISCSIDirectGetVolumeCapacity(iscsi, lun, &block_size, &nb_block) < 0)
-        return -1;
-
     vol->target.capacity = block_size * nb_block;
     vol->target.allocation = block_size * nb_block;
     def->capacity += vol->target.capacity;
@@ -332,6 +330,266 @@ virISCSIDirectRefreshVol(virStoragePoolObjPtr pool,
     return 0;
 }
 
+typedef enum {
+    VIR_ISCSI_DIRECT_LUN_TEST_UNIT_READY,
+    VIR_ISCSI_DIRECT_LUN_INQUIRY,
+    VIR_ISCSI_DIRECT_LUN_READ_CAPACITY,
+    VIR_ISCSI_DIRECT_LUN_DONE,
+    VIR_ISCSI_DIRECT_LUN_FAILED,
+} virISCSIDirectLunState;
+
+typedef struct _virISCSIDirectLunQueries virISCSIDirectLunQueries;
+
+typedef struct _virISCSIDirectLunQuery virISCSIDirectLunQuery;
+struct _virISCSIDirectLunQuery {
+    virISCSIDirectLunQueries *queries;
+    int lun;
+    virISCSIDirectLunState state;
+    unsigned long long deadline;
+    uint32_t block_size;
+    uint64_t nb_block;
+    char *error;
+};
+
+struct _virISCSIDirectLunQueries {
+    virISCSIDirectLunQuery *luns;
+    size_t nluns;
+    size_t next;      /* first LUN which wasn't queried yet */
+    size_t inflight;  /* commands waiting for their response */
+    bool failed;
+};
+
+
+static void
+virISCSIDirectLunQueryCb(struct iscsi_context *iscsi,
+                         int status,
+                         void *command_data,
+                         void *private_data);
+
+
+static void
+virISCSIDirectLunQueryFail(virISCSIDirectLunQuery *query,
+                           const char *msg,
+                           struct iscsi_context *iscsi)
+{
+    query->state = VIR_ISCSI_DIRECT_LUN_FAILED;
+    query->queries->failed = true;
+    if (!query->error)
+        query->error = g_strdup_printf("%s: %s", msg, iscsi_get_error(iscsi));
+}
+
+
+static void
+virISCSIDirectLunQuerySubmit(struct iscsi_context *iscsi,
+                             virISCSIDirectLunQuery *query)
+{
+    struct scsi_task *task = NULL;
+
+    switch (query->state) {
+    case VIR_ISCSI_DIRECT_LUN_TEST_UNIT_READY:
+        task = iscsi_testunitready_task(iscsi, query->lun,
+                                        virISCSIDirectLunQueryCb, query);
+        break;
+    case VIR_ISCSI_DIRECT_LUN_INQUIRY:
+        task = iscsi_inquiry_task(iscsi, query->lun, 0, 0, 64,
+                                  virISCSIDirectLunQueryCb, query);
+        break;
+    case VIR_ISCSI_DIRECT_LUN_READ_CAPACITY:
+        task = iscsi_readcapacity16_task(iscsi, query->lun,
+                                         virISCSIDirectLunQueryCb, query);
+        break;
+    case VIR_ISCSI_DIRECT_LUN_DONE:
+    case VIR_ISCSI_DIRECT_LUN_FAILED:
+        return;
+    }
+
+    if (!task) {
+        virISCSIDirectLunQueryFail(query, _("Failed to send command"), iscsi);
+        return;
+    }
+
+    query->queries->inflight++;
+}
+
+
+static void
+virISCSIDirectLunQueryCb(struct iscsi_context *iscsi,
+                         int status,
+                         void *command_data,
+                         void *private_data)
+{
+    virISCSIDirectLunQuery *query = private_data;
+    struct scsi_task *task = command_data;
+    unsigned long long now = 0;
+
+    query->queries->inflight--;
+
+    if (status == SCSI_STATUS_CANCELLED) {
+        virISCSIDirectLunQueryFail(query, _("Command cancelled"), iscsi);
+        goto cleanup;
+    }
+
+    switch (query->state) {
+    case VIR_ISCSI_DIRECT_LUN_TEST_UNIT_READY:
+        /* The first command after a bus reset reports it, try again */
+        if (status == SCSI_STATUS_CHECK_CONDITION &&
+            task->sense.key == SCSI_SENSE_UNIT_ATTENTION &&
+            task->sense.ascq == SCSI_SENSE_ASCQ_BUS_RESET &&
+            virTimeMillisNow(&now) == 0 &&
+            now < query->deadline)
+            break;
+
+        if (status != SCSI_STATUS_GOOD) {
+            virISCSIDirectLunQueryFail(query, _("Failed testunitready"), iscsi);
+            goto cleanup;
+        }
+
+        query->state = VIR_ISCSI_DIRECT_LUN_INQUIRY;
+        break;
+
+    case VIR_ISCSI_DIRECT_LUN_INQUIRY: {
+        struct scsi_inquiry_standard *inq;
+
+        if (status != SCSI_STATUS_GOOD) {
+            virISCSIDirectLunQueryFail(query, _("Failed to send inquiry command"),
+                                       iscsi);
+            goto cleanup;
+        }
+
+        if (!(inq = scsi_datain_unmarshall(task))) {
+            virISCSIDirectLunQueryFail(query, _("Failed to unmarshall reply"),
+                                       iscsi);
+            goto cleanup;
+        }
+
+        if (inq->device_type == SCSI_INQUIRY_PERIPHERAL_DEVICE_TYPE_DIRECT_ACCESS)
+            query->state = VIR_ISCSI_DIRECT_LUN_READ_CAPACITY;
+        else
+            query->state = VIR_ISCSI_DIRECT_LUN_DONE;
+        break;
+    }
+
+    case VIR_ISCSI_DIRECT_LUN_READ_CAPACITY: {
+        struct scsi_readcapacity16 *rc16;
+
+        if (status != SCSI_STATUS_GOOD) {
+            virISCSIDirectLunQueryFail(query, _("Failed to get capacity of lun"),
+                                       iscsi);
+            goto cleanup;
+        }
+
+        if (!(rc16 = scsi_datain_unmarshall(task))) {
+            virISCSIDirectLunQueryFail(query, _("Failed to unmarshall reply"),
+                                       iscsi);
+            goto cleanup;
+        }
+
+        query->block_size = rc16->block_length;
+        query->nb_block = rc16->returned_lba;
+        query->state = VIR_ISCSI_DIRECT_LUN_DONE;
+        break;
+    }
+
+    case VIR_ISCSI_DIRECT_LUN_DONE:
+    case VIR_ISCSI_DIRECT_LUN_FAILED:
+        goto cleanup;
+    }
+
+    if (!query->queries->failed)
+        virISCSIDirectLunQuerySubmit(iscsi, query);
+
+ cleanup:
+    scsi_free_scsi_task(task);
+}
+
+
+/*
+ * Finds out the capacity of all LUNs in @queries. Instead of waiting
+ * for each command, up to VIR_ISCSI_DIRECT_LUN_QUERIES LUNs are queried
+ * at once over the session, which saves a round trip to the target per
+ * command on targets with many LUNs.
+ *
+ * On failure the session is left in an undefined state and must not be
+ * used any longer; the caller has to destroy it before freeing @queries.
+ */
+static int
+virISCSIDirectQueryLuns(struct iscsi_context *iscsi,
+                        virISCSIDirectLunQueries *queries)
+{
+    size_t i;
+
+    while (queries->inflight > 0 ||
+           (queries->next < queries->nluns && !queries->failed)) {
+        struct pollfd pfd;
+        int rc;
+
+        while (queries->next < queries->nluns &&
+               queries->inflight < VIR_ISCSI_DIRECT_LUN_QUERIES &&
+               !queries->failed) {
+            virISCSIDirectLunQuery *query = &queries->luns[queries->next++];
+
+            if (virTimeMillisNow(&query->deadline) < 0)
+                return -1;
+            query->deadline += VIR_ISCSI_TEST_UNIT_TIMEOUT;
+            virISCSIDirectLunQuerySubmit(iscsi, query);
+        }
+
+        if (queries->inflight == 0)
+            continue;
+
+        pfd.fd = iscsi_get_fd(iscsi);
+        pfd.events = iscsi_which_events(iscsi);
+        pfd.revents = 0;
+
+        if ((rc = poll(&pfd, 1, VIR_ISCSI_TEST_UNIT_TIMEOUT)) < 0) {
+            if (errno == EINTR)
+                continue;
+            virReportSystemError(errno, "%s",
+                                 _("Failed to wait for iscsi session"));
+            return -1;
+        }
+
+        if (rc == 0) {
+            virReportError(VIR_ERR_OPERATION_TIMEOUT, "%s",
+                           _("Timed out waiting for iscsi target"));
+            return -1;
+        }
+
+        if (iscsi_service(iscsi, pfd.revents) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Failed to service iscsi session: %s"),
+                           iscsi_get_error(iscsi));
+            return -1;
+        }
+    }
+
+    for (i = 0; i < queries->nluns; i++) {
+        if (queries->luns[i].state == VIR_ISCSI_DIRECT_LUN_FAILED) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           queries->luns[i].error);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+static void
+virISCSIDirectLunQueriesClear(virISCSIDirectLunQueries *queries)
+{
+    size_t i;
+
+    for (i = 0; i < queries->nluns; i++)
+        g_free(queries->luns[i].error);
+    g_free(queries->luns);
+}
+
+
+/*
+ * Returns 0 on success, -1 on error and -2 if the session broke down,
+ * in which case @iscsi was destroyed already.
+ */
 static int
 virISCSIDirectReportLuns(virStoragePoolObjPtr pool,
                          struct iscsi_context *iscsi,
@@ -340,6 +598,7 @@ virISCSIDirectReportLuns(virStoragePoolObjPtr pool,
     virStoragePoolDefPtr def = virStoragePoolObjGetDef(pool);
     struct scsi_task *task = NULL;
     struct scsi_reportluns_list *list = NULL;
+    virISCSIDirectLunQueries queries = { 0 };
     int full_size;
     size_t i;
     int ret = -1;
@@ -370,15 +629,34 @@ virISCSIDirectReportLuns(virStoragePoolObjPtr pool,
         goto cleanup;
     }
 
+    queries.nluns = list->num;
+    queries.luns = g_new0(virISCSIDirectLunQuery, queries.nluns);
+    for (i = 0; i < queries.nluns; i++) {
+        queries.luns[i].queries = &queries;
+        queries.luns[i].lun = list->luns[i];
+    }
+
+    if (virISCSIDirectQueryLuns(iscsi, &queries) < 0) {
+        /* Commands may still be pending, so the session must go away
+         * before the queries do */
+        ret = -2;
+        goto cleanup;
+    }
+
     def->capacity = 0;
     def->allocation = 0;
-    for (i = 0; i < list->num; i++) {
-        if (virISCSIDirectRefreshVol(pool, iscsi, list->luns[i], portal) < 0)
+    for (i = 0; i < queries.nluns; i++) {
+        if (virISCSIDirectRefreshVol(pool, queries.luns[i].lun,
+                                     queries.luns[i].block_size,
+                                     queries.luns[i].nb_block, portal) < 0)
             goto cleanup;
     }
 
     ret = 0;
  cleanup:
+    if (ret == -2)
+        iscsi_destroy_context(iscsi);
+    virISCSIDirectLunQueriesClear(&queries);
     scsi_free_scsi_task(task);
     return ret;
 }
@@ -579,19 +857,178 @@ virStorageBackendISCSIDirectSetConnection(virStoragePoolObjPtr pool,
     return NULL;
 }
 
+/*
+ * Every active pool keeps its session to the target logged in between
+ * operations, so that refreshing the pool or wiping a volume doesn't
+ * have to connect and log in again. A libiscsi context must not be used
+ * by several threads at once though, so an operation which finds the
+ * session of its pool busy, e.g. with a long running wipe, gets a
+ * private session instead.
+ */
+typedef struct _virISCSIDirectSession virISCSIDirectSession;
+typedef virISCSIDirectSession *virISCSIDirectSessionPtr;
+struct _virISCSIDirectSession {
+    struct iscsi_context *iscsi;
+    char *portal;
+    bool cached;  /* owned by virISCSIDirectSessions */
+    bool inuse;
+    bool stale;   /* the pool was stopped while the session was in use */
+};
+
+static virMutex virISCSIDirectSessionsLock = VIR_MUTEX_INITIALIZER;
+static virHashTablePtr virISCSIDirectSessions;
+
+
+static void
+virISCSIDirectSessionClose(virISCSIDirectSessionPtr session)
+{
+    if (session->iscsi) {
+        if (iscsi_is_logged_in(session->iscsi))
+            ignore_value(virISCSIDirectDisconnect(session->iscsi));
+        iscsi_destroy_context(session->iscsi);
+        session->iscsi = NULL;
+    }
+    VIR_FREE(session->portal);
+}
+
+
+static void
+virISCSIDirectSessionFree(virISCSIDirectSessionPtr session)
+{
+    if (!session)
+        return;
+
+    virISCSIDirectSessionClose(session);
+    g_free(session);
+}
+
+
+static void
+virISCSIDirectSessionHashFree(void *payload)
+{
+    virISCSIDirectSessionPtr session = payload;
+
+    /* sessions in use are freed by virISCSIDirectSessionRelease */
+    if (session->inuse)
+        session->stale = true;
+    else
+        virISCSIDirectSessionFree(session);
+}
+
+
+/*
+ * Hands @session back. If @broken is true, the session is closed and
+ * the next operation logs in again.
+ */
+static void
+virISCSIDirectSessionRelease(virISCSIDirectSessionPtr session,
+                             bool broken)
+{
+    if (!session->cached) {
+        virISCSIDirectSessionFree(session);
+        return;
+    }
+
+    if (broken)
+        virISCSIDirectSessionClose(session);
+
+    virMutexLock(&virISCSIDirectSessionsLock);
+    session->inuse = false;
+    if (session->stale)
+        virISCSIDirectSessionFree(session);
+    virMutexUnlock(&virISCSIDirectSessionsLock);
+}
+
+
+/*
+ * Returns a logged in session to the target of @pool, which must be
+ * locked. The session has to be handed back with
+ * virISCSIDirectSessionRelease.
+ */
+static virISCSIDirectSessionPtr
+virISCSIDirectSessionAcquire(virStoragePoolObjPtr pool)
+{
+    virStoragePoolDefPtr def = virStoragePoolObjGetDef(pool);
+    virISCSIDirectSessionPtr session = NULL;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+
+    virUUIDFormat(def->uuid, uuidstr);
+
+    virMutexLock(&virISCSIDirectSessionsLock);
+    if (!virISCSIDirectSessions &&
+        !(virISCSIDirectSessions = virHashNew(virISCSIDirectSessionHashFree)))
+        goto error;
+
+    if (!(session = virHashLookup(virISCSIDirectSessions, uuidstr))) {
+        session = g_new0(virISCSIDirectSession, 1);
+        session->cached = true;
+        if (virHashAddEntry(virISCSIDirectSessions, uuidstr, session) < 0) {
+            g_free(session);
+            goto error;
+        }
+    }
+
+    if (session->inuse) {
+        VIR_DEBUG("Session of pool '%s' is busy", def->name);
+        session = g_new0(virISCSIDirectSession, 1);
+    } else {
+        session->inuse = true;
+    }
+    virMutexUnlock(&virISCSIDirectSessionsLock);
+
+    if (session->iscsi && !iscsi_is_logged_in(session->iscsi)) {
+        VIR_DEBUG("Session of pool '%s' was lost, logging in again",
+                  def->name);
+        virISCSIDirectSessionClose(session);
+    }
+
+    if (!session->iscsi &&
+        !(session->iscsi = virStorageBackendISCSIDirectSetConnection(pool,
+                                                                     &session->portal))) {
+        virISCSIDirectSessionRelease(session, true);
+        return NULL;
+    }
+
+    return session;
+
+ error:
+    virMutexUnlock(&virISCSIDirectSessionsLock);
+    return NULL;
+}
+
+
 static int
 virStorageBackendISCSIDirectRefreshPool(virStoragePoolObjPtr pool)
 {
-    struct iscsi_context *iscsi = NULL;
-    int ret = -1;
-    g_autofree char *portal = NULL;
+    virISCSIDirectSessionPtr session;
+    int rc;
 
-    if (!(iscsi = virStorageBackendISCSIDirectSetConnection(pool, &portal)))
+    if (!(session = virISCSIDirectSessionAcquire(pool)))
         return -1;
-    ret = virISCSIDirectReportLuns(pool, iscsi, portal);
-    virISCSIDirectDisconnect(iscsi);
-    iscsi_destroy_context(iscsi);
-    return ret;
+
+    if ((rc = virISCSIDirectReportLuns(pool, session->iscsi,
+                                       session->portal)) == -2)
+        session->iscsi = NULL;
+
+    virISCSIDirectSessionRelease(session, rc < 0);
+    return rc < 0 ? -1 : 0;
+}
+
+
+static int
+virStorageBackendISCSIDirectStopPool(virStoragePoolObjPtr pool)
+{
+    virStoragePoolDefPtr def = virStoragePoolObjGetDef(pool);
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+
+    virUUIDFormat(def->uuid, uuidstr);
+
+    virMutexLock(&virISCSIDirectSessionsLock);
+    if (virISCSIDirectSessions)
+        ignore_value(virHashRemoveEntry(virISCSIDirectSessions, uuidstr));
+    virMutexUnlock(&virISCSIDirectSessionsLock);
+
+    return 0;
 }
 
 static int
@@ -660,21 +1097,21 @@ virStorageBackenISCSIDirectWipeVol(virStoragePoolObjPtr pool,
                                    unsigned int algorithm,
                                    unsigned int flags)
 {
-    struct iscsi_context *iscsi = NULL;
+    virISCSIDirectSessionPtr session = NULL;
     int ret = -1;
 
     virCheckFlags(0, -1);
 
     virObjectLock(pool);
-    iscsi = virStorageBackendISCSIDirectSetConnection(pool, NULL);
+    session = virISCSIDirectSessionAcquire(pool);
     virObjectUnlock(pool);
 
-    if (!iscsi)
+    if (!session)
         return -1;
 
     switch ((virStorageVolWipeAlgorithm) algorithm) {
     case VIR_STORAGE_VOL_WIPE_ALG_ZERO:
-        if (virStorageBackendISCSIDirectVolWipeZero(vol, iscsi) < 0)
+        if (virStorageBackendISCSIDirectVolWipeZero(vol, session->iscsi) < 0)
             goto cleanup;
         break;
     case VIR_STORAGE_VOL_WIPE_ALG_TRIM:
@@ -694,8 +1131,7 @@ virStorageBackenISCSIDirectWipeVol(virStoragePoolObjPtr pool,
 
     ret = 0;
  cleanup:
-    virISCSIDirectDisconnect(iscsi);
-    iscsi_destroy_context(iscsi);
+    virISCSIDirectSessionRelease(session, false);
     return ret;
 }
 
@@ -706,6 +1142,7 @@ virStorageBackend virStorageBackendISCSIDirect = {
     .checkPool = virStorageBackendISCSIDirectCheckPool,
     .findPoolSources = virStorageBackendISCSIDirectFindPoolSources,
     .refreshPool = virStorageBackendISCSIDirectRefreshPool,
+    .stopPool = virStorageBackendISCSIDirectStopPool,
     .wipeVol = virStorageBackenISCSIDirectWipeVol,
 };
 
@@ -29,6 +29,7 @@
 #include "storage_backend_logical.h"
 #include "storage_conf.h"
 #include "vircommand.h"
+#include "vircoprocess.h"
 #include "viralloc.h"
 #include "virlog.h"
 #include "virfile.h"
@@ -40,6 +41,83 @@
 
 VIR_LOG_INIT("storage.storage_backend_logical");
 
+#ifdef LVM
+/* Long-lived 'lvm' shell answering the reporting commands */
+static virCoprocessPtr virStorageBackendLogicalShell;
+
+
+struct virStorageBackendLogicalRegexData {
+    virCommandRunRegexFunc func;
+    void *opaque;
+    size_t nmatches;
+};
+
+
+static int
+virStorageBackendLogicalRegexFunc(char **const groups,
+                                  void *opaque)
+{
+    struct virStorageBackendLogicalRegexData *data = opaque;
+
+    data->nmatches++;
+    return data->func(groups, data->opaque);
+}
+#endif /* LVM */
+
+
+/*
+ * Runs the LVM reporting command @cmd, @name being the name of the tool,
+ * and parses its output like virCommandRunRegex does. If possible the
+ * command is passed to the 'lvm' shell instead of spawning the tool,
+ * which saves a process start and LVM's initialization on every pool
+ * refresh. The shell doesn't report failures of commands though, so if
+ * its reply has no matching lines the tool is run anyway to either
+ * confirm the empty result or report the error.
+ */
+static int
+virStorageBackendLogicalRunRegex(virCommandPtr cmd,
+                                 const char *name,
+                                 int nregex,
+                                 const char **regex,
+                                 int *nvars,
+                                 virCommandRunRegexFunc func,
+                                 void *opaque)
+{
+#ifdef LVM
+    struct virStorageBackendLogicalRegexData data = {
+        .func = func, .opaque = opaque };
+    VIR_AUTOSTRINGLIST args = NULL;
+    size_t nargs;
+    g_autofree char *argstr = NULL;
+    g_autofree char *request = NULL;
+    g_autofree char *output = NULL;
+
+    if (virStorageBackendLogicalShell &&
+        virCommandGetArgList(cmd, &args, &nargs) == 0) {
+        argstr = g_strjoinv(" ", args);
+        request = g_strdup_printf("%s %s", name, argstr);
+
+        if (virCoprocessRun(virStorageBackendLogicalShell,
+                            request, &output) < 0) {
+            VIR_DEBUG("lvm shell failed, running %s: %s",
+                      name, virGetLastErrorMessage());
+            virResetLastError();
+        } else {
+            if (virCommandParseRegex(output, nregex, regex, nvars,
+                                     virStorageBackendLogicalRegexFunc,
+                                     &data, name) < 0)
+                return -1;
+
+            if (data.nmatches > 0)
+                return 0;
+        }
+    }
+#endif
+
+    return virCommandRunRegex(cmd, nregex, regex, nvars,
+                              func, opaque, name, NULL);
+}
+
 
 static int
 virStorageBackendLogicalSetActive(virStoragePoolObjPtr pool,
@@ -400,9 +478,9 @@ virStorageBackendLogicalFindLVs(virStoragePoolObjPtr pool,
                                "lv_name,origin,uuid,devices,segtype,stripes,seg_size,vg_extent_size,size,lv_attr",
                                def->source.name,
                                NULL);
-    return virCommandRunRegex(cmd, 1, regexes, vars,
-                              virStorageBackendLogicalMakeVol,
-                              &cbdata, "lvs", NULL);
+    return virStorageBackendLogicalRunRegex(cmd, "lvs", 1, regexes, vars,
+                                            virStorageBackendLogicalMakeVol,
+                                            &cbdata);
 }
 
 static int
@@ -714,7 +792,7 @@ virStorageBackendLogicalBuildPool(virStoragePoolObjPtr pool,
 
 
 static int
-virStorageBackendLogicalRefreshPool(virStoragePoolObjPtr pool)
+virStorageBackendLogicalRefreshPoolSize(virStoragePoolObjPtr pool)
 {
     /*
      *  # vgs --separator : --noheadings --units b --unbuffered --nosuffix --options "vg_size,vg_free" VGNAME
@@ -733,34 +811,168 @@ virStorageBackendLogicalRefreshPool(virStoragePoolObjPtr pool)
     virStoragePoolDefPtr def = virStoragePoolObjGetDef(pool);
     g_autoptr(virCommand) cmd = NULL;
 
+    cmd = virCommandNewArgList(VGS,
+                               "--separator", ":",
+                               "--noheadings",
+                               "--units", "b",
+                               "--unbuffered",
+                               "--nosuffix",
+                               "--options", "vg_size,vg_free",
+                               def->source.name,
+                               NULL);
+
+    /* Now get basic volgrp metadata */
+    if (virStorageBackendLogicalRunRegex(cmd,
+                                         "vgs",
+                                         1,
+                                         regexes,
+                                         vars,
+                                         virStorageBackendLogicalRefreshPoolFunc,
+                                         pool) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+virStorageBackendLogicalRefreshPool(virStoragePoolObjPtr pool)
+{
     virWaitForDevices();
 
     /* Get list of all logical volumes */
     if (virStorageBackendLogicalFindLVs(pool, NULL) < 0)
         return -1;
 
-    cmd = virCommandNewArgList(VGS,
-                               "--separator", ":",
+    return virStorageBackendLogicalRefreshPoolSize(pool);
+}
+
+
+struct virStorageBackendLogicalUsageData {
+    virStoragePoolObjPtr pool;
+    virStorageBackendVolUsageFunc func;
+    void *opaque;
+};
+
+
+/* Parses the "Data%" field of lvs into hundredths of a percent. It's
+ * formatted according to the locale of lvs, with two decimals. */
+static int
+virStorageBackendLogicalParseDataPercent(const char *str,
+                                         unsigned long long *hundredths)
+{
+    unsigned long long whole;
+    char *end;
+
+    if (virStrToLong_ull(str, &end, 10, &whole) < 0)
+        return -1;
+
+    *hundredths = whole * 100;
+    if ((*end == '.' || *end == ',') && g_ascii_isdigit(end[1])) {
+        *hundredths += (end[1] - '0') * 10;
+        if (g_ascii_isdigit(end[2]))
+            *hundredths += end[2] - '0';
+    }
+
+    return 0;
+}
+
+
+static int
+virStorageBackendLogicalCheckUsageFunc(char **const groups,
+                                       void *opaque)
+{
+    struct virStorageBackendLogicalUsageData *data = opaque;
+    virStoragePoolDefPtr def = virStoragePoolObjGetDef(data->pool);
+    virStorageVolDefPtr vol;
+    unsigned long long size;
+    unsigned long long hundredths;
+    unsigned long long used;
+    unsigned long long grow;
+    g_autoptr(virCommand) cmd = NULL;
+    int rc;
+
+    /* Only sparse volumes fill up, the rest is fully allocated */
+    if (groups[1][0] != 's' || STREQ(groups[3], ""))
+        return 0;
+
+    if (!(vol = virStorageVolDefFindByName(data->pool, groups[0])) ||
+        vol->building)
+        return 0;
+
+    if (virStrToLong_ull(groups[2], NULL, 10, &size) < 0 ||
+        virStorageBackendLogicalParseDataPercent(groups[3], &hundredths) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("malformed usage of logical volume '%s'"),
+                       vol->name);
+        return -1;
+    }
+
+    used = size / 10000 * hundredths + size % 10000 * hundredths / 10000;
+    vol->target.allocation = size;
+
+    if ((rc = data->func(data->pool, vol, used, size, data->opaque)) <= 0)
+        return rc;
+
+    grow = size / 100 * def->watermark->extend;
+    if (grow == 0)
+        return 0;
+
+    VIR_INFO("Extending sparse logical volume '%s' by %llu bytes",
+             vol->target.path, grow);
+
+    cmd = virCommandNewArgList(LVEXTEND, "-L", NULL);
+    virCommandAddArgFormat(cmd, "+%lluK", VIR_DIV_UP(grow, 1024));
+    virCommandAddArg(cmd, vol->target.path);
+
+    if (virCommandRun(cmd, NULL) < 0)
+        return -1;
+
+    vol->target.allocation += grow;
+    return 0;
+}
+
+
+static int
+virStorageBackendLogicalCheckUsage(virStoragePoolObjPtr pool,
+                                   virStorageBackendVolUsageFunc func,
+                                   void *opaque)
+{
+    /*
+     * # lvs --separator # --noheadings --units b --unbuffered --nosuffix \
+     *   --options "lv_name,lv_attr,size,data_percent" VGNAME
+     *
+     * Sparse#swi-a-s---#1073741824#12.50
+     * Thick#-wi-a-----#5234491392#
+     */
+    const char *regexes[] = {
+        "^\\s*(\\S+)#(\\S+)#([0-9]+)#([0-9.,]*)#?\\s*$"
+    };
+    int vars[] = {
+        4
+    };
+    virStoragePoolDefPtr def = virStoragePoolObjGetDef(pool);
+    struct virStorageBackendLogicalUsageData data = {
+        .pool = pool, .func = func, .opaque = opaque };
+    g_autoptr(virCommand) cmd = NULL;
+
+    cmd = virCommandNewArgList(LVS,
+                               "--separator", "#",
                                "--noheadings",
                                "--units", "b",
                                "--unbuffered",
                                "--nosuffix",
-                               "--options", "vg_size,vg_free",
+                               "--options", "lv_name,lv_attr,size,data_percent",
                                def->source.name,
                                NULL);
 
-    /* Now get basic volgrp metadata */
-    if (virCommandRunRegex(cmd,
-                           1,
-                           regexes,
-                           vars,
-                           virStorageBackendLogicalRefreshPoolFunc,
-                           pool,
-                           "vgs",
-                           NULL) < 0)
+    if (virStorageBackendLogicalRunRegex(cmd, "lvs", 1, regexes, vars,
+                                         virStorageBackendLogicalCheckUsageFunc,
+                                         &data) < 0)
         return -1;
 
-    return 0;
+    /* after growing volumes, the free space of the group is up to date */
+    return virStorageBackendLogicalRefreshPoolSize(pool);
 }
 
 /*
@@ -992,6 +1204,7 @@ virStorageBackend virStorageBackendLogical = {
     .refreshPool = virStorageBackendLogicalRefreshPool,
     .stopPool = virStorageBackendLogicalStopPool,
     .deletePool = virStorageBackendLogicalDeletePool,
+    .checkUsage = virStorageBackendLogicalCheckUsage,
     .buildVol = NULL,
     .buildVolFrom = virStorageBackendLogicalBuildVolFrom,
     .createVol = virStorageBackendLogicalCreateVol,
@@ -1005,5 +1218,12 @@ virStorageBackend virStorageBackendLogical = {
 int
 virStorageBackendLogicalRegister(void)
 {
+#ifdef LVM
+    const char *const lvmargv[] = { LVM, NULL };
+
+    if (!(virStorageBackendLogicalShell = virCoprocessNew(lvmargv, "lvm> ")))
+        return -1;
+#endif
+
     return virStorageBackendRegister(&virStorageBackendLogical);
 }
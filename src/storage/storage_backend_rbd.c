@@ -35,6 +35,7 @@
 #include "rbd/librbd.h"
 #include "virsecret.h"
 #include "storage_util.h"
+#include "virthreadpool.h"
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
 
@@ -672,15 +673,126 @@ virStorageBackendRBDGetVolNames(virStorageBackendRBDStatePtr ptr)
 #endif /* ! HAVE_RBD_LIST2 */
 
 
+/* Per image state of a pool refresh */
+typedef struct _virStorageBackendRBDRefreshData virStorageBackendRBDRefreshData;
+struct _virStorageBackendRBDRefreshData {
+    virStorageVolDefPtr vol;
+    int rc; /* result of volStorageBackendRBDRefreshVolInfo */
+    virErrorPtr err;
+};
+
+typedef struct _virStorageBackendRBDRefreshCtx virStorageBackendRBDRefreshCtx;
+struct _virStorageBackendRBDRefreshCtx {
+    virMutex lock;
+    virCond cond;
+    size_t pending;
+    virStoragePoolObjPtr pool;
+    virStorageBackendRBDStatePtr ptr;
+};
+
+/* Minimum number of images for which refreshing is spread over workers */
+#define VIR_STORAGE_BACKEND_RBD_REFRESH_PARALLEL_MIN 16
+
+/* Opening and stat-ing an image is mostly waiting for the OSDs holding its
+ * header, so the number of workers doesn't follow the host CPUs. It's
+ * bounded to not flood the cluster with requests. */
+#define VIR_STORAGE_BACKEND_RBD_REFRESH_WORKERS 16
+
+
+static void
+virStorageBackendRBDRefreshImage(virStorageBackendRBDRefreshCtx *ctx,
+                                 virStorageBackendRBDRefreshData *data)
+{
+    if ((data->rc = volStorageBackendRBDRefreshVolInfo(data->vol, ctx->pool,
+                                                       ctx->ptr)) < 0)
+        virErrorPreserveLast(&data->err);
+    else
+        virResetLastError();
+}
+
+
+static void
+virStorageBackendRBDRefreshWorker(void *jobdata,
+                                  void *opaque)
+{
+    virStorageBackendRBDRefreshCtx *ctx = opaque;
+
+    virStorageBackendRBDRefreshImage(ctx, jobdata);
+
+    virMutexLock(&ctx->lock);
+    if (--ctx->pending == 0)
+        virCondSignal(&ctx->cond);
+    virMutexUnlock(&ctx->lock);
+}
+
+
+/*
+ * Refreshes all images in @data. The librados connection is thread safe,
+ * so on pools with many images the images are opened and queried from a
+ * bounded pool of worker threads.
+ */
+static void
+virStorageBackendRBDRefreshImages(virStoragePoolObjPtr pool,
+                                  virStorageBackendRBDStatePtr ptr,
+                                  virStorageBackendRBDRefreshData *data,
+                                  size_t ndata)
+{
+    virStorageBackendRBDRefreshCtx ctx = { .pool = pool, .ptr = ptr };
+    virThreadPoolPtr workers = NULL;
+    size_t i = 0;
+
+    if (ndata < VIR_STORAGE_BACKEND_RBD_REFRESH_PARALLEL_MIN)
+        goto sequential;
+
+    if (virMutexInit(&ctx.lock) < 0)
+        goto sequential;
+
+    if (virCondInit(&ctx.cond) < 0) {
+        virMutexDestroy(&ctx.lock);
+        goto sequential;
+    }
+
+    if (!(workers = virThreadPoolNew(0, MIN(ndata, VIR_STORAGE_BACKEND_RBD_REFRESH_WORKERS),
+                                     0, virStorageBackendRBDRefreshWorker, &ctx))) {
+        virResetLastError();
+        virCondDestroy(&ctx.cond);
+        virMutexDestroy(&ctx.lock);
+        goto sequential;
+    }
+
+    virMutexLock(&ctx.lock);
+    for (; i < ndata; i++) {
+        if (virThreadPoolSendJob(workers, 0, &data[i]) < 0)
+            break;
+        ctx.pending++;
+    }
+
+    while (ctx.pending > 0)
+        ignore_value(virCondWait(&ctx.cond, &ctx.lock));
+    virMutexUnlock(&ctx.lock);
+
+    virThreadPoolFree(workers);
+    virCondDestroy(&ctx.cond);
+    virMutexDestroy(&ctx.lock);
+
+ sequential:
+    /* whatever couldn't be handed over to the workers */
+    for (; i < ndata; i++)
+        virStorageBackendRBDRefreshImage(&ctx, &data[i]);
+}
+
+
 static int
 virStorageBackendRBDRefreshPool(virStoragePoolObjPtr pool)
 {
-    int rc, ret = -1;
+    int ret = -1;
     virStoragePoolDefPtr def = virStoragePoolObjGetDef(pool);
     virStorageBackendRBDStatePtr ptr = NULL;
     struct rados_cluster_stat_t clusterstat;
     struct rados_pool_stat_t poolstat;
     char **names = NULL;
+    virStorageBackendRBDRefreshData *data = NULL;
+    size_t ndata = 0;
     size_t i;
 
     if (!(ptr = virStorageBackendRBDNewState(pool)))
@@ -709,16 +821,17 @@ virStorageBackendRBDRefreshPool(virStoragePoolObjPtr pool)
     if (!(names = virStorageBackendRBDGetVolNames(ptr)))
         goto cleanup;
 
-    for (i = 0; names[i] != NULL; i++) {
-        g_autoptr(virStorageVolDef) vol = NULL;
+    ndata = g_strv_length(names);
+    data = g_new0(virStorageBackendRBDRefreshData, ndata);
 
-        if (VIR_ALLOC(vol) < 0)
-            goto cleanup;
-
-        vol->name = g_steal_pointer(&names[i]);
+    for (i = 0; i < ndata; i++) {
+        data[i].vol = g_new0(virStorageVolDef, 1);
+        data[i].vol->name = g_steal_pointer(&names[i]);
+    }
 
-        rc = volStorageBackendRBDRefreshVolInfo(vol, pool, ptr);
+    virStorageBackendRBDRefreshImages(pool, ptr, data, ndata);
 
+    for (i = 0; i < ndata; i++) {
         /* It could be that a volume has been deleted through a different route
          * then libvirt and that will cause a -ENOENT to be returned.
          *
@@ -728,16 +841,17 @@ virStorageBackendRBDRefreshPool(virStoragePoolObjPtr pool)
          *
          * Do not error out and simply ignore the volume
          */
-        if (rc < 0) {
-            if (rc == -ENOENT || rc == -ETIMEDOUT)
+        if (data[i].rc < 0) {
+            if (data[i].rc == -ENOENT || data[i].rc == -ETIMEDOUT)
                 continue;
 
+            virErrorRestore(&data[i].err);
             goto cleanup;
         }
 
-        if (virStoragePoolObjAddVol(pool, vol) < 0)
+        if (virStoragePoolObjAddVol(pool, data[i].vol) < 0)
             goto cleanup;
-        vol = NULL;
+        data[i].vol = NULL;
     }
 
     VIR_DEBUG("Found %zu images in RBD pool %s",
@@ -746,6 +860,11 @@ virStorageBackendRBDRefreshPool(virStoragePoolObjPtr pool)
     ret = 0;
 
  cleanup:
+    for (i = 0; i < ndata; i++) {
+        virStorageVolDefFree(data[i].vol);
+        virFreeError(data[i].err);
+    }
+    VIR_FREE(data);
     g_strfreev(names);
     virStorageBackendRBDFreeState(&ptr);
     return ret;
@@ -826,12 +945,52 @@ virStorageBackendRBDCleanupSnapshots(rados_ioctx_t ioctx,
     return ret;
 }
 
+/* Forwards librbd progress reports of a long running operation to the
+ * volume job, if any */
+typedef struct _virStorageBackendRBDProgress virStorageBackendRBDProgress;
+struct _virStorageBackendRBDProgress {
+    virStorageVolJobPtr job;
+    unsigned long long reported;
+    bool aborted;
+};
+
+
+static int
+virStorageBackendRBDProgressCb(uint64_t offset,
+                               uint64_t total,
+                               void *opaque)
+{
+    virStorageBackendRBDProgress *progress = opaque;
+    unsigned long long done;
+
+    if (!progress->job || total == 0)
+        return 0;
+
+    /* librbd counts objects, the job counts bytes */
+    done = (double) offset / total * progress->job->total;
+    if (done < progress->reported)
+        done = progress->reported;
+
+    if (virStorageVolJobUpdate(progress->job, done - progress->reported) < 0) {
+        /* the error is reported again by the caller, this may be a librbd
+         * thread */
+        virResetLastError();
+        progress->aborted = true;
+        return -ECANCELED;
+    }
+
+    progress->reported = done;
+    return 0;
+}
+
+
 static int
 virStorageBackendRBDDeleteVol(virStoragePoolObjPtr pool,
                               virStorageVolDefPtr vol,
                               unsigned int flags)
 {
     int rc, ret = -1;
+    virStorageBackendRBDProgress progress = { .job = vol->job };
     virStoragePoolDefPtr def = virStoragePoolObjGetDef(pool);
     virStorageBackendRBDStatePtr ptr = NULL;
 
@@ -854,7 +1013,15 @@ virStorageBackendRBDDeleteVol(virStoragePoolObjPtr pool,
 
     VIR_DEBUG("Removing volume %s/%s", def->source.name, vol->name);
 
-    rc = rbd_remove(ptr->ioctx, vol->name);
+    rc = rbd_remove_with_progress(ptr->ioctx, vol->name,
+                                  virStorageBackendRBDProgressCb, &progress);
+    if (rc < 0 && progress.aborted) {
+        virReportError(VIR_ERR_OPERATION_ABORTED,
+                       _("removal of volume '%s/%s' was cancelled by client"),
+                       def->source.name, vol->name);
+        goto cleanup;
+    }
+
     if (rc < 0 && (-rc) != ENOENT) {
         virReportSystemError(errno, _("failed to remove volume '%s/%s'"),
                              def->source.name, vol->name);
@@ -1233,12 +1400,15 @@ virStorageBackendRBDBuildVolFrom(virStoragePoolObjPtr pool,
 {
     virStoragePoolDefPtr def = virStoragePoolObjGetDef(pool);
     virStorageBackendRBDStatePtr ptr = NULL;
+    virStorageBackendRBDProgress progress = { .job = newvol->job };
+    rbd_image_t image = NULL;
+    int rc;
     int ret = -1;
 
     VIR_DEBUG("Creating clone of RBD image %s/%s with name %s",
               def->source.name, origvol->name, newvol->name);
 
-    virCheckFlags(0, -1);
+    virCheckFlags(VIR_STORAGE_VOL_CREATE_FLATTEN, -1);
 
     if (!(ptr = virStorageBackendRBDNewState(pool)))
         goto cleanup;
@@ -1247,9 +1417,36 @@ virStorageBackendRBDBuildVolFrom(virStoragePoolObjPtr pool,
                                         newvol->name)) < 0)
         goto cleanup;
 
+    if (!(flags & VIR_STORAGE_VOL_CREATE_FLATTEN)) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    VIR_DEBUG("Flattening RBD image %s/%s", def->source.name, newvol->name);
+
+    if ((rc = rbd_open(ptr->ioctx, newvol->name, &image, NULL)) < 0) {
+        virReportSystemError(-rc, _("failed to open the RBD image %s"),
+                             newvol->name);
+        goto cleanup;
+    }
+
+    if ((rc = rbd_flatten_with_progress(image, virStorageBackendRBDProgressCb,
+                                        &progress)) < 0) {
+        if (progress.aborted)
+            virReportError(VIR_ERR_OPERATION_ABORTED,
+                           _("flattening of volume '%s/%s' was cancelled by client"),
+                           def->source.name, newvol->name);
+        else
+            virReportSystemError(-rc, _("failed to flatten RBD image %s/%s"),
+                                 def->source.name, newvol->name);
+        goto cleanup;
+    }
+
     ret = 0;
 
  cleanup:
+    if (image)
+        rbd_close(image);
     virStorageBackendRBDFreeState(&ptr);
     return ret;
 }
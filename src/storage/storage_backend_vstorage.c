@@ -160,7 +160,9 @@ virStorageBackend virStorageBackendVstorage = {
     .startPool = virStorageBackendVzPoolStart,
     .stopPool = virStorageBackendVzPoolStop,
     .deletePool = virStorageBackendDeleteLocal,
+    .checkUsage = virStorageBackendCheckUsageLocal,
     .refreshPool = virStorageBackendRefreshLocal,
+    .refreshPoolIncremental = virStorageBackendRefreshLocalIncremental,
     .checkPool = virStorageBackendVzCheck,
     .buildVol = virStorageBackendVolBuildLocal,
     .buildVolFrom = virStorageBackendVolBuildFromLocal,
@@ -50,6 +50,7 @@
 #include "viraccessapicheck.h"
 #include "storage_util.h"
 #include "virutil.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
 
@@ -58,6 +59,7 @@ VIR_LOG_INIT("storage.storage_driver");
 static virStorageDriverStatePtr driver;
 
 static int storageStateCleanup(void);
+static void storageVolJobWorker(void *jobdata, void *opaque);
 
 typedef struct _virStorageVolStreamInfo virStorageVolStreamInfo;
 typedef virStorageVolStreamInfo *virStorageVolStreamInfoPtr;
@@ -178,12 +180,147 @@ storagePoolUpdateStateCallback(virStoragePoolObjPtr obj,
 }
 
 
+/* Most of the time spent starting pools of backends which allow it,
+ * such as logging into iSCSI targets, is waiting on remote hosts */
+#define STORAGE_POOL_START_WORKERS 8
+
+typedef struct _storagePoolForEachCtx storagePoolForEachCtx;
+struct _storagePoolForEachCtx {
+    virStoragePoolObjListIterator iter;
+
+    virMutex lock;
+    virCond cond;
+    size_t pending;
+
+    virStoragePoolObjPtr *objs;
+    size_t nobjs;
+};
+
+
 static void
-storagePoolUpdateAllState(void)
+storagePoolForEachCollect(virStoragePoolObjPtr obj,
+                          const void *opaque)
 {
+    storagePoolForEachCtx *ctx = (storagePoolForEachCtx *) opaque;
+    virStoragePoolObjPtr tmp = virObjectRef(obj);
+
+    ignore_value(VIR_APPEND_ELEMENT(ctx->objs, ctx->nobjs, tmp));
+}
+
+
+static void
+storagePoolForEachRun(storagePoolForEachCtx *ctx,
+                      virStoragePoolObjPtr obj)
+{
+    virObjectLock(obj);
+    ctx->iter(obj, NULL);
+    virStoragePoolObjEndAPI(&obj);
+}
+
+
+static void
+storagePoolForEachWorker(void *jobdata,
+                         void *opaque)
+{
+    storagePoolForEachCtx *ctx = opaque;
+
+    storagePoolForEachRun(ctx, jobdata);
+
+    virMutexLock(&ctx->lock);
+    if (--ctx->pending == 0)
+        virCondSignal(&ctx->cond);
+    virMutexUnlock(&ctx->lock);
+}
+
+
+static bool
+storagePoolIsParallelStart(virStoragePoolObjPtr obj)
+{
+    virStoragePoolDefPtr def = virStoragePoolObjGetDef(obj);
+    virStorageBackendPtr backend;
+    bool ret;
+
+    virObjectLock(obj);
+    backend = virStorageBackendForType(def->type);
+    ret = backend && backend->parallelStart;
+    virObjectUnlock(obj);
+
+    if (!backend)
+        virResetLastError();
+
+    return ret;
+}
+
+
+/*
+ * Calls @iter for every pool. Pools of backends which allow it are
+ * handed over to a temporary pool of worker threads, the rest is
+ * processed in the calling thread meanwhile.
+ */
+static void
+storagePoolForEachParallel(virStoragePoolObjListIterator iter)
+{
+    storagePoolForEachCtx ctx = { .iter = iter };
+    virThreadPoolPtr workers = NULL;
+    size_t nparallel = 0;
+    size_t i;
+
     virStoragePoolObjListForEach(driver->pools,
-                                 storagePoolUpdateStateCallback,
-                                 NULL);
+                                 storagePoolForEachCollect,
+                                 &ctx);
+
+    for (i = 0; i < ctx.nobjs; i++) {
+        if (storagePoolIsParallelStart(ctx.objs[i]))
+            nparallel++;
+    }
+
+    if (nparallel > 1 &&
+        virMutexInit(&ctx.lock) == 0) {
+        if (virCondInit(&ctx.cond) < 0) {
+            virMutexDestroy(&ctx.lock);
+        } else if (!(workers = virThreadPoolNew(0, MIN(nparallel, STORAGE_POOL_START_WORKERS),
+                                                0, storagePoolForEachWorker, &ctx))) {
+            virResetLastError();
+            virCondDestroy(&ctx.cond);
+            virMutexDestroy(&ctx.lock);
+        }
+    }
+
+    for (i = 0; i < ctx.nobjs; i++) {
+        virStoragePoolObjPtr obj = g_steal_pointer(&ctx.objs[i]);
+
+        if (workers && storagePoolIsParallelStart(obj)) {
+            virMutexLock(&ctx.lock);
+            if (virThreadPoolSendJob(workers, 0, obj) == 0) {
+                ctx.pending++;
+                virMutexUnlock(&ctx.lock);
+                continue;
+            }
+            virMutexUnlock(&ctx.lock);
+        }
+
+        storagePoolForEachRun(&ctx, obj);
+    }
+
+    if (workers) {
+        virMutexLock(&ctx.lock);
+        while (ctx.pending > 0)
+            ignore_value(virCondWait(&ctx.cond, &ctx.lock));
+        virMutexUnlock(&ctx.lock);
+
+        virThreadPoolFree(workers);
+        virCondDestroy(&ctx.cond);
+        virMutexDestroy(&ctx.lock);
+    }
+
+    VIR_FREE(ctx.objs);
+}
+
+
+static void
+storagePoolUpdateAllState(void)
+{
+    storagePoolForEachParallel(storagePoolUpdateStateCallback);
 }
 
 
@@ -239,11 +376,174 @@ storageDriverAutostartCallback(virStoragePoolObjPtr obj,
 static void
 storageDriverAutostart(void)
 {
-    virStoragePoolObjListForEach(driver->pools,
-                                 storageDriverAutostartCallback,
-                                 NULL);
+    storagePoolForEachParallel(storageDriverAutostartCallback);
+}
+
+/* Period of the allocation watermark checks, in seconds */
+#define STORAGE_WATERMARK_INTERVAL 10
+
+/* @percent of @limit, without overflowing for huge volumes */
+static unsigned long long
+storageWatermarkThreshold(unsigned long long limit,
+                          unsigned int percent)
+{
+    return limit / 100 * percent + limit % 100 * percent / 100;
+}
+
+
+static int
+storageWatermarkCheckVol(virStoragePoolObjPtr obj,
+                         virStorageVolDefPtr vol,
+                         unsigned long long used,
+                         unsigned long long limit,
+                         void *opaque G_GNUC_UNUSED)
+{
+    virStoragePoolDefPtr def = virStoragePoolObjGetDef(obj);
+    virObjectEventPtr event;
+    unsigned long long threshold;
+
+    if (!def->watermark->volume || limit == 0)
+        return 0;
+
+    threshold = storageWatermarkThreshold(limit, def->watermark->volume);
+
+    if (used < threshold) {
+        vol->watermark = false;
+        return 0;
+    }
+
+    if (!vol->watermark) {
+        VIR_INFO("Volume '%s' in pool '%s' crossed its watermark: %llu of %llu bytes",
+                 vol->name, def->name, used, limit);
+
+        vol->watermark = true;
+        event = virStoragePoolEventThresholdNew(def->name, def->uuid,
+                                                vol->name, threshold,
+                                                used - threshold);
+        virObjectEventStateQueue(driver->storageEventState, event);
+    }
+
+    return def->watermark->extend ? 1 : 0;
+}
+
+
+static void
+storageWatermarkCheckPool(virStoragePoolObjPtr obj)
+{
+    virStoragePoolDefPtr def = virStoragePoolObjGetDef(obj);
+    virStorageBackendPtr backend;
+    virObjectEventPtr event;
+    unsigned long long threshold;
+
+    /* volume jobs and refreshes may be changing the volumes meanwhile */
+    if (!def->watermark ||
+        !virStoragePoolObjIsActive(obj) ||
+        virStoragePoolObjIsStarting(obj) ||
+        virStoragePoolObjGetAsyncjobs(obj) > 0)
+        return;
+
+    if (!(backend = virStorageBackendForType(def->type)) ||
+        !backend->checkUsage) {
+        virResetLastError();
+        return;
+    }
+
+    if (backend->checkUsage(obj, storageWatermarkCheckVol, NULL) < 0) {
+        VIR_WARN("Failed to check allocation of storage pool '%s': %s",
+                 def->name, virGetLastErrorMessage());
+        virResetLastError();
+        return;
+    }
+
+    if (!def->watermark->pool || def->capacity == 0)
+        return;
+
+    threshold = storageWatermarkThreshold(def->capacity, def->watermark->pool);
+
+    if (def->allocation < threshold) {
+        def->watermark->crossed = false;
+        return;
+    }
+
+    if (def->watermark->crossed)
+        return;
+
+    VIR_INFO("Pool '%s' crossed its watermark: %llu of %llu bytes",
+             def->name, def->allocation, def->capacity);
+
+    def->watermark->crossed = true;
+    event = virStoragePoolEventThresholdNew(def->name, def->uuid, NULL,
+                                            threshold,
+                                            def->allocation - threshold);
+    virObjectEventStateQueue(driver->storageEventState, event);
+}
+
+
+struct storageWatermarkPools {
+    virStoragePoolObjPtr *objs;
+    size_t nobjs;
+};
+
+
+static bool
+storageWatermarkCollect(virStoragePoolObjPtr obj,
+                        const void *opaque)
+{
+    struct storageWatermarkPools *pools = (struct storageWatermarkPools *)opaque;
+    virStoragePoolDefPtr def = virStoragePoolObjGetDef(obj);
+
+    if (def->watermark && virStoragePoolObjIsActive(obj)) {
+        virObjectRef(obj);
+        ignore_value(VIR_APPEND_ELEMENT(pools->objs, pools->nobjs, obj));
+    }
+
+    return false;
 }
 
+
+/*
+ * Checks the pools with allocation watermarks every
+ * STORAGE_WATERMARK_INTERVAL seconds. The pools are collected first so
+ * that the pool list isn't locked while the backends run their
+ * commands.
+ */
+static void
+storageWatermarkThread(void *opaque G_GNUC_UNUSED)
+{
+    storageDriverLock();
+    while (!driver->watermarkQuit) {
+        struct storageWatermarkPools pools = { 0 };
+        unsigned long long now;
+        size_t i;
+
+        if (virTimeMillisNow(&now) < 0)
+            break;
+
+        if (virCondWaitUntil(&driver->watermarkCond, &driver->lock,
+                             now + STORAGE_WATERMARK_INTERVAL * 1000) < 0 &&
+            errno != ETIMEDOUT)
+            break;
+
+        if (driver->watermarkQuit)
+            break;
+        storageDriverUnlock();
+
+        virStoragePoolObjListSearch(driver->pools, storageWatermarkCollect,
+                                    &pools);
+
+        for (i = 0; i < pools.nobjs; i++) {
+            virObjectLock(pools.objs[i]);
+            storageWatermarkCheckPool(pools.objs[i]);
+            virStoragePoolObjEndAPI(&pools.objs[i]);
+        }
+        VIR_FREE(pools.objs);
+
+        storageDriverLock();
+    }
+    storageDriverUnlock();
+}
+
+
 /**
  * virStorageStartup:
  *
@@ -323,6 +623,27 @@ storageStateInitialize(bool privileged,
 
     driver->storageEventState = virObjectEventStateNew();
 
+    if (!(driver->volJobPool = virThreadPoolNew(0, 4, 0,
+                                                storageVolJobWorker,
+                                                NULL)))
+        goto error;
+
+    if (virCondInit(&driver->watermarkCond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot initialize condition variable"));
+        goto error;
+    }
+
+    if (virThreadCreateFull(&driver->watermarkThread, true,
+                            storageWatermarkThread, "storage-watermark",
+                            false, NULL) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot create storage watermark thread"));
+        virCondDestroy(&driver->watermarkCond);
+        goto error;
+    }
+    driver->watermarkThreadActive = true;
+
     /* Only one load of storage driver plus backends exists. Unlike
      * domains where new binaries could change the capabilities. A
      * new/changed backend requires a reinitialization. */
@@ -375,6 +696,19 @@ storageStateCleanup(void)
     if (!driver)
         return -1;
 
+    /* waits for the running volume jobs */
+    virThreadPoolFree(driver->volJobPool);
+
+    if (driver->watermarkThreadActive) {
+        storageDriverLock();
+        driver->watermarkQuit = true;
+        virCondSignal(&driver->watermarkCond);
+        storageDriverUnlock();
+
+        virThreadJoin(&driver->watermarkThread);
+        virCondDestroy(&driver->watermarkCond);
+    }
+
     storageDriverLock();
 
     virObjectUnref(driver->caps);
@@ -718,6 +1052,30 @@ storagePoolIsPersistent(virStoragePoolPtr pool)
 }
 
 
+static int
+storagePoolDefValidateWatermark(virStorageBackendPtr backend,
+                                virStoragePoolDefPtr def)
+{
+    if (!def->watermark)
+        return 0;
+
+    if (!backend->checkUsage) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                       _("allocation watermarks are not supported by '%s' pools"),
+                       virStoragePoolTypeToString(def->type));
+        return -1;
+    }
+
+    if (def->watermark->extend && def->type != VIR_STORAGE_POOL_LOGICAL) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                       _("extending volumes is only supported by 'logical' pools"));
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static virStoragePoolPtr
 storagePoolCreateXML(virConnectPtr conn,
                      const char *xml,
@@ -748,6 +1106,9 @@ storagePoolCreateXML(virConnectPtr conn,
     if ((backend = virStorageBackendForType(newDef->type)) == NULL)
         goto cleanup;
 
+    if (storagePoolDefValidateWatermark(backend, newDef) < 0)
+        goto cleanup;
+
     if (!(obj = virStoragePoolObjListAdd(driver->pools, newDef,
                                          VIR_STORAGE_POOL_OBJ_LIST_ADD_LIVE |
                                          VIR_STORAGE_POOL_OBJ_LIST_ADD_CHECK_LIVE)))
@@ -816,6 +1177,7 @@ storagePoolDefineXML(virConnectPtr conn,
     virStoragePoolDefPtr def;
     virStoragePoolPtr pool = NULL;
     virObjectEventPtr event = NULL;
+    virStorageBackendPtr backend;
     g_autoptr(virStoragePoolDef) newDef = NULL;
 
     virCheckFlags(0, NULL);
@@ -829,7 +1191,10 @@ storagePoolDefineXML(virConnectPtr conn,
     if (virStoragePoolDefineXMLEnsureACL(conn, newDef) < 0)
         goto cleanup;
 
-    if (virStorageBackendForType(newDef->type) == NULL)
+    if ((backend = virStorageBackendForType(newDef->type)) == NULL)
+        goto cleanup;
+
+    if (storagePoolDefValidateWatermark(backend, newDef) < 0)
         goto cleanup;
 
     if (!(obj = virStoragePoolObjListAdd(driver->pools, newDef, 0)))
@@ -1223,9 +1588,10 @@ storagePoolRefresh(virStoragePoolPtr pool,
     virStorageBackendPtr backend;
     g_autofree char *stateFile = NULL;
     int ret = -1;
+    int rc;
     virObjectEventPtr event = NULL;
 
-    virCheckFlags(0, -1);
+    virCheckFlags(VIR_STORAGE_POOL_REFRESH_INCREMENTAL, -1);
 
     if (!(obj = storagePoolObjFindByUUID(pool->uuid, pool->name)))
         goto cleanup;
@@ -1258,7 +1624,23 @@ storagePoolRefresh(virStoragePoolPtr pool,
     }
 
     stateFile = virFileBuildPath(driver->stateDir, def->name, ".xml");
-    if (storagePoolRefreshImpl(backend, obj, stateFile) < 0) {
+
+    if ((flags & VIR_STORAGE_POOL_REFRESH_INCREMENTAL) &&
+        backend->refreshPoolIncremental) {
+        /* volume APIs keep using the current list meanwhile */
+        virStoragePoolObjIncrAsyncjobs(obj);
+        virObjectUnlock(obj);
+        rc = backend->refreshPoolIncremental(obj);
+        virObjectLock(obj);
+        virStoragePoolObjDecrAsyncjobs(obj);
+
+        if (rc < 0)
+            storagePoolRefreshFailCleanup(backend, obj, stateFile);
+    } else {
+        rc = storagePoolRefreshImpl(backend, obj, stateFile);
+    }
+
+    if (rc < 0) {
         event = virStoragePoolEventLifecycleNew(def->name,
                                                 def->uuid,
                                                 VIR_STORAGE_POOL_EVENT_STOPPED,
@@ -1843,6 +2225,299 @@ virStorageVolDefFromVol(virStorageVolPtr vol,
 }
 
 
+/* Accounts a newly built volume in the pool, the volume is deleted if
+ * it can't be refreshed. Called with the pool locked. */
+static int
+storageVolCreateComplete(virStoragePoolObjPtr obj,
+                         virStorageBackendPtr backend,
+                         virStorageVolDefPtr voldef)
+{
+    virStoragePoolDefPtr def = virStoragePoolObjGetDef(obj);
+
+    if (backend->refreshVol &&
+        backend->refreshVol(obj, voldef) < 0) {
+        storageVolDeleteInternal(backend, obj, voldef, 0, false);
+        return -1;
+    }
+
+    /* Update pool metadata ignoring the disk backend since
+     * it updates the pool values.
+     */
+    if (def->type != VIR_STORAGE_POOL_DISK) {
+        def->allocation += voldef->target.allocation;
+        def->available -= voldef->target.allocation;
+    }
+
+    return 0;
+}
+
+
+typedef struct _virStorageVolJobData virStorageVolJobData;
+typedef virStorageVolJobData *virStorageVolJobDataPtr;
+struct _virStorageVolJobData {
+    virStorageVolJobType type;
+    virStoragePoolObjPtr obj;
+    virStoragePoolObjPtr objsrc; /* pool of @voldefsrc if it's not @obj */
+    virStorageBackendPtr backend;
+    virStorageVolDefPtr voldef; /* owned by the pool */
+    virStorageVolDefPtr voldefsrc; /* source of a clone */
+    virStorageVolDefPtr buildvoldef; /* shallow copy of @voldef */
+    unsigned int algorithm;
+    unsigned int flags;
+};
+
+
+static void
+storageVolJobDataFree(virStorageVolJobDataPtr data)
+{
+    if (!data)
+        return;
+
+    VIR_FREE(data->buildvoldef);
+    virObjectUnref(data->objsrc);
+    virObjectUnref(data->obj);
+    VIR_FREE(data);
+}
+
+
+/**
+ * storageVolJobBegin:
+ *
+ * Marks @voldef as busy with a job of @type processing @total bytes,
+ * which also blocks changes to the pool(s) while the job runs with the
+ * pool lock dropped. Called with @obj and @objsrc locked.
+ */
+static virStorageVolJobDataPtr
+storageVolJobBegin(virStorageVolJobType type,
+                   virStoragePoolObjPtr obj,
+                   virStoragePoolObjPtr objsrc,
+                   virStorageBackendPtr backend,
+                   virStorageVolDefPtr voldef,
+                   virStorageVolDefPtr voldefsrc,
+                   unsigned long long total)
+{
+    virStorageVolJobDataPtr data;
+    virStorageVolJobPtr job;
+
+    if (!(job = virStorageVolJobNew(type, total)))
+        return NULL;
+
+    data = g_new0(virStorageVolJobData, 1);
+    data->type = type;
+    data->obj = virObjectRef(obj);
+    if (objsrc)
+        data->objsrc = virObjectRef(objsrc);
+    data->backend = backend;
+    data->voldef = voldef;
+    data->voldefsrc = voldefsrc;
+
+    voldef->job = job;
+
+    if (type == VIR_STORAGE_VOL_JOB_WIPE ||
+        type == VIR_STORAGE_VOL_JOB_DELETE) {
+        voldef->in_use++;
+    } else {
+        /* Make a shallow copy of the 'defined' volume definition, since
+         * the original allocation value will change as the user polls
+         * 'info', but we only need the initial requested values. */
+        data->buildvoldef = g_new0(virStorageVolDef, 1);
+        memcpy(data->buildvoldef, voldef, sizeof(*voldef));
+        voldef->building = true;
+    }
+
+    if (voldefsrc)
+        voldefsrc->in_use++;
+
+    virStoragePoolObjIncrAsyncjobs(obj);
+    if (objsrc)
+        virStoragePoolObjIncrAsyncjobs(objsrc);
+
+    return data;
+}
+
+
+/**
+ * storageVolJobEnd:
+ *
+ * Undoes storageVolJobBegin and finishes the operation according to
+ * its result @rc. A volume which failed to be built is removed from
+ * the pool. Called with the pool(s) locked, returns 0 on success and
+ * -1 on error.
+ */
+static int
+storageVolJobEnd(virStorageVolJobDataPtr data,
+                 int rc)
+{
+    virStorageVolDefPtr voldef = data->voldef;
+    virStorageBackendPtr backend = data->backend;
+    virStoragePoolDefPtr def;
+
+    virStorageVolJobFree(voldef->job);
+    voldef->job = NULL;
+
+    virStoragePoolObjDecrAsyncjobs(data->obj);
+    if (data->objsrc)
+        virStoragePoolObjDecrAsyncjobs(data->objsrc);
+
+    if (data->voldefsrc)
+        data->voldefsrc->in_use--;
+
+    switch (data->type) {
+    case VIR_STORAGE_VOL_JOB_CREATE:
+        voldef->building = false;
+        if (rc < 0) {
+            /* buildVol handles deleting volume on failure */
+            virStoragePoolObjRemoveVol(data->obj, voldef);
+            return -1;
+        }
+        return storageVolCreateComplete(data->obj, backend, voldef);
+
+    case VIR_STORAGE_VOL_JOB_CLONE:
+        voldef->building = false;
+        if (rc < 0) {
+            storageVolDeleteInternal(backend, data->obj, voldef, 0, false);
+            return -1;
+        }
+        return storageVolCreateComplete(data->obj, backend, voldef);
+
+    case VIR_STORAGE_VOL_JOB_WIPE:
+        voldef->in_use--;
+        if (rc < 0)
+            return -1;
+
+        /* For local volumes, Instead of using the refreshVol, since
+         * much changes on the target volume, let's update using the
+         * same function as refreshPool would use when it discovers a
+         * volume. The only failure to capture is -1, we can ignore
+         * -2. */
+        if ((backend->type == VIR_STORAGE_POOL_DIR ||
+             backend->type == VIR_STORAGE_POOL_FS ||
+             backend->type == VIR_STORAGE_POOL_NETFS ||
+             backend->type == VIR_STORAGE_POOL_VSTORAGE) &&
+            virStorageBackendRefreshVolTargetUpdate(voldef) == -1)
+            return -1;
+        return 0;
+
+    case VIR_STORAGE_VOL_JOB_DELETE:
+        voldef->in_use--;
+        if (rc < 0)
+            return -1;
+
+        def = virStoragePoolObjGetDef(data->obj);
+        def->allocation -= voldef->target.allocation;
+        def->available += voldef->target.allocation;
+        virStoragePoolObjRemoveVol(data->obj, voldef);
+        return 0;
+
+    case VIR_STORAGE_VOL_JOB_NONE:
+    case VIR_STORAGE_VOL_JOB_LAST:
+        break;
+    }
+
+    return -1;
+}
+
+
+/**
+ * storageVolJobRun:
+ *
+ * Performs the job set up by storageVolJobBegin. Called with the
+ * pool(s) unlocked, returns with them locked.
+ */
+static int
+storageVolJobRun(virStorageVolJobDataPtr data)
+{
+    virStorageBackendPtr backend = data->backend;
+    int rc = -1;
+
+    switch (data->type) {
+    case VIR_STORAGE_VOL_JOB_CREATE:
+        rc = backend->buildVol(data->obj, data->buildvoldef, data->flags);
+        break;
+
+    case VIR_STORAGE_VOL_JOB_CLONE:
+        rc = backend->buildVolFrom(data->obj, data->buildvoldef,
+                                   data->voldefsrc, data->flags);
+        break;
+
+    case VIR_STORAGE_VOL_JOB_WIPE:
+        rc = backend->wipeVol(data->obj, data->voldef,
+                              data->algorithm, data->flags);
+        break;
+
+    case VIR_STORAGE_VOL_JOB_DELETE:
+        rc = backend->deleteVol(data->obj, data->voldef, data->flags);
+        break;
+
+    case VIR_STORAGE_VOL_JOB_NONE:
+    case VIR_STORAGE_VOL_JOB_LAST:
+        break;
+    }
+
+    virObjectLock(data->obj);
+    if (data->objsrc)
+        virObjectLock(data->objsrc);
+
+    return storageVolJobEnd(data, rc);
+}
+
+
+static void
+storageVolJobWorker(void *jobdata,
+                    void *opaque G_GNUC_UNUSED)
+{
+    virStorageVolJobDataPtr data = jobdata;
+    virStoragePoolDefPtr def;
+    virObjectEventPtr event = NULL;
+    g_autofree char *name = g_strdup(data->voldef->name);
+    int rc;
+
+    rc = storageVolJobRun(data);
+    def = virStoragePoolObjGetDef(data->obj);
+
+    if (rc < 0) {
+        VIR_WARN("Job on volume '%s' in storage pool '%s' failed: %s",
+                 name, def->name, virGetLastErrorMessage());
+    } else {
+        VIR_INFO("Job on volume '%s' in storage pool '%s' finished",
+                 name, def->name);
+    }
+
+    event = virStoragePoolEventRefreshNew(def->name, def->uuid);
+
+    if (data->objsrc)
+        virObjectUnlock(data->objsrc);
+    virObjectUnlock(data->obj);
+    storageVolJobDataFree(data);
+
+    virObjectEventStateQueue(driver->storageEventState, event);
+}
+
+
+/**
+ * storageVolJobSubmit:
+ *
+ * Hands the job set up by storageVolJobBegin over to the job pool,
+ * the caller must not touch @data afterwards. If the job can't be
+ * started it is ended as failed. Called with the pool(s) locked.
+ */
+static int
+storageVolJobSubmit(virStorageVolJobDataPtr data)
+{
+    virErrorPtr orig_err;
+
+    if (virThreadPoolSendJob(driver->volJobPool, 0, data) == 0)
+        return 0;
+
+    virErrorPreserveLast(&orig_err);
+    storageVolJobEnd(data, -1);
+    virErrorRestore(&orig_err);
+    storageVolJobDataFree(data);
+
+    return -1;
+}
+
+
 static int
 storageVolDelete(virStorageVolPtr vol,
                  unsigned int flags)
@@ -1850,6 +2525,7 @@ storageVolDelete(virStorageVolPtr vol,
     virStoragePoolObjPtr obj;
     virStorageBackendPtr backend;
     virStorageVolDefPtr voldef = NULL;
+    virStorageVolJobDataPtr data = NULL;
     int ret = -1;
 
     if (!(voldef = virStorageVolDefFromVol(vol, &obj, &backend)))
@@ -1873,6 +2549,34 @@ storageVolDelete(virStorageVolPtr vol,
         goto cleanup;
     }
 
+    if (flags & VIR_STORAGE_VOL_DELETE_ASYNC) {
+        if (!backend->deleteVol) {
+            virReportError(VIR_ERR_NO_SUPPORT,
+                           "%s", _("storage pool does not support vol deletion"));
+            goto cleanup;
+        }
+
+        /* the disk backend rewrites the partition table and the pool
+         * while deleting, which can't be done with the pool unlocked */
+        if (backend->type == VIR_STORAGE_POOL_DISK) {
+            virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                           _("disk pools can't delete volumes asynchronously"));
+            goto cleanup;
+        }
+
+        if (!(data = storageVolJobBegin(VIR_STORAGE_VOL_JOB_DELETE, obj, NULL,
+                                        backend, voldef, NULL,
+                                        voldef->target.allocation)))
+            goto cleanup;
+        data->flags = flags & ~VIR_STORAGE_VOL_DELETE_ASYNC;
+
+        if (storageVolJobSubmit(g_steal_pointer(&data)) < 0)
+            goto cleanup;
+
+        ret = 0;
+        goto cleanup;
+    }
+
     if (storageVolDeleteInternal(backend, obj, voldef, flags, true) < 0)
         goto cleanup;
 
@@ -1894,8 +2598,11 @@ storageVolCreateXML(virStoragePoolPtr pool,
     virStorageBackendPtr backend;
     virStorageVolPtr vol = NULL, newvol = NULL;
     g_autoptr(virStorageVolDef) voldef = NULL;
+    virStorageVolDefPtr newdef;
+    virStorageVolJobDataPtr data = NULL;
 
-    virCheckFlags(VIR_STORAGE_VOL_CREATE_PREALLOC_METADATA, NULL);
+    virCheckFlags(VIR_STORAGE_VOL_CREATE_PREALLOC_METADATA |
+                  VIR_STORAGE_VOL_CREATE_ASYNC, NULL);
 
     if (!(obj = virStoragePoolObjFromStoragePool(pool)))
         return NULL;
@@ -1951,67 +2658,42 @@ storageVolCreateXML(virStoragePoolPtr pool,
     /* NB: Upon success voldef "owned" by storage pool for deletion purposes */
     if (virStoragePoolObjAddVol(obj, voldef) < 0)
         goto cleanup;
+    newdef = g_steal_pointer(&voldef);
 
     if (backend->buildVol) {
-        int buildret;
-        virStorageVolDefPtr buildvoldef = NULL;
-
-        if (VIR_ALLOC(buildvoldef) < 0) {
-            voldef = NULL;
+        if (!(data = storageVolJobBegin(VIR_STORAGE_VOL_JOB_CREATE, obj,
+                                        NULL, backend, newdef, NULL,
+                                        newdef->target.allocation))) {
+            virStoragePoolObjRemoveVol(obj, newdef);
             goto cleanup;
         }
+        data->flags = flags & ~VIR_STORAGE_VOL_CREATE_ASYNC;
 
-        /* Make a shallow copy of the 'defined' volume definition, since the
-         * original allocation value will change as the user polls 'info',
-         * but we only need the initial requested values
-         */
-        memcpy(buildvoldef, voldef, sizeof(*voldef));
-
-        /* Drop the pool lock during volume allocation */
-        virStoragePoolObjIncrAsyncjobs(obj);
-        voldef->building = true;
-        virObjectUnlock(obj);
-
-        buildret = backend->buildVol(obj, buildvoldef, flags);
-
-        VIR_FREE(buildvoldef);
-
-        virObjectLock(obj);
-
-        voldef->building = false;
-        virStoragePoolObjDecrAsyncjobs(obj);
+        if (flags & VIR_STORAGE_VOL_CREATE_ASYNC) {
+            if (storageVolJobSubmit(g_steal_pointer(&data)) < 0)
+                goto cleanup;
 
-        if (buildret < 0) {
-            /* buildVol handles deleting volume on failure */
-            virStoragePoolObjRemoveVol(obj, voldef);
-            voldef = NULL;
+            VIR_INFO("Started creating volume '%s' in storage pool '%s'",
+                     newvol->name, def->name);
+            vol = g_steal_pointer(&newvol);
             goto cleanup;
         }
 
-    }
+        /* Drop the pool lock during volume allocation */
+        virObjectUnlock(obj);
 
-    if (backend->refreshVol &&
-        backend->refreshVol(obj, voldef) < 0) {
-        storageVolDeleteInternal(backend, obj, voldef,
-                                 0, false);
-        voldef = NULL;
+        if (storageVolJobRun(data) < 0)
+            goto cleanup;
+    } else if (storageVolCreateComplete(obj, backend, newdef) < 0) {
         goto cleanup;
     }
 
-    /* Update pool metadata ignoring the disk backend since
-     * it updates the pool values.
-     */
-    if (def->type != VIR_STORAGE_POOL_DISK) {
-        def->allocation += voldef->target.allocation;
-        def->available -= voldef->target.allocation;
-    }
-
     VIR_INFO("Creating volume '%s' in storage pool '%s'",
              newvol->name, def->name);
     vol = g_steal_pointer(&newvol);
-    voldef = NULL;
 
  cleanup:
+    storageVolJobDataFree(data);
     virObjectUnref(newvol);
     virStoragePoolObjEndAPI(&obj);
     return vol;
@@ -2028,14 +2710,16 @@ storageVolCreateXMLFrom(virStoragePoolPtr pool,
     virStoragePoolObjPtr objsrc = NULL;
     virStorageBackendPtr backend;
     virStorageVolDefPtr voldefsrc = NULL;
-    virStorageVolDefPtr shadowvol = NULL;
     virStorageVolPtr newvol = NULL;
     virStorageVolPtr vol = NULL;
-    int buildret;
     g_autoptr(virStorageVolDef) voldef = NULL;
+    virStorageVolDefPtr newdef;
+    virStorageVolJobDataPtr data = NULL;
 
     virCheckFlags(VIR_STORAGE_VOL_CREATE_PREALLOC_METADATA |
-                  VIR_STORAGE_VOL_CREATE_REFLINK,
+                  VIR_STORAGE_VOL_CREATE_REFLINK |
+                  VIR_STORAGE_VOL_CREATE_ASYNC |
+                  VIR_STORAGE_VOL_CREATE_FLATTEN,
                   NULL);
 
     obj = virStoragePoolObjFindByUUID(driver->pools, pool->uuid);
@@ -2139,15 +2823,6 @@ storageVolCreateXMLFrom(virStoragePoolPtr pool,
     if (backend->createVol(obj, voldef) < 0)
         goto cleanup;
 
-    /* Make a shallow copy of the 'defined' volume definition, since the
-     * original allocation value will change as the user polls 'info',
-     * but we only need the initial requested values
-     */
-    if (VIR_ALLOC(shadowvol) < 0)
-        goto cleanup;
-
-    memcpy(shadowvol, voldef, sizeof(*voldef));
-
     if (!(newvol = virGetStorageVol(pool->conn, def->name, voldef->name,
                                     voldef->key, NULL, NULL)))
         goto cleanup;
@@ -2155,57 +2830,41 @@ storageVolCreateXMLFrom(virStoragePoolPtr pool,
     /* NB: Upon success voldef "owned" by storage pool for deletion purposes */
     if (virStoragePoolObjAddVol(obj, voldef) < 0)
         goto cleanup;
+    newdef = g_steal_pointer(&voldef);
 
-    /* Drop the pool lock during volume allocation */
-    virStoragePoolObjIncrAsyncjobs(obj);
-    voldef->building = true;
-    voldefsrc->in_use++;
-    virObjectUnlock(obj);
-
-    if (objsrc) {
-        virStoragePoolObjIncrAsyncjobs(objsrc);
-        virObjectUnlock(objsrc);
+    if (!(data = storageVolJobBegin(VIR_STORAGE_VOL_JOB_CLONE, obj, objsrc,
+                                    backend, newdef, voldefsrc,
+                                    voldefsrc->target.capacity))) {
+        virStoragePoolObjRemoveVol(obj, newdef);
+        goto cleanup;
     }
+    data->flags = flags & ~VIR_STORAGE_VOL_CREATE_ASYNC;
 
-    buildret = backend->buildVolFrom(obj, shadowvol, voldefsrc, flags);
-
-    virObjectLock(obj);
-    if (objsrc)
-        virObjectLock(objsrc);
-
-    voldefsrc->in_use--;
-    voldef->building = false;
-    virStoragePoolObjDecrAsyncjobs(obj);
-
-    if (objsrc) {
-        virStoragePoolObjDecrAsyncjobs(objsrc);
-        virStoragePoolObjEndAPI(&objsrc);
-    }
+    if (flags & VIR_STORAGE_VOL_CREATE_ASYNC) {
+        if (storageVolJobSubmit(g_steal_pointer(&data)) < 0)
+            goto cleanup;
 
-    if (buildret < 0 ||
-        (backend->refreshVol &&
-         backend->refreshVol(obj, voldef) < 0)) {
-        storageVolDeleteInternal(backend, obj, voldef, 0, false);
-        voldef = NULL;
+        VIR_INFO("Started cloning volume '%s' in storage pool '%s'",
+                 newvol->name, def->name);
+        vol = g_steal_pointer(&newvol);
         goto cleanup;
     }
 
-    /* Updating pool metadata ignoring the disk backend since
-     * it updates the pool values
-     */
-    if (def->type != VIR_STORAGE_POOL_DISK) {
-        def->allocation += voldef->target.allocation;
-        def->available -= voldef->target.allocation;
-    }
+    /* Drop the pool lock during volume allocation */
+    virObjectUnlock(obj);
+    if (objsrc)
+        virObjectUnlock(objsrc);
+
+    if (storageVolJobRun(data) < 0)
+        goto cleanup;
 
     VIR_INFO("Creating volume '%s' in storage pool '%s'",
              newvol->name, def->name);
     vol = g_steal_pointer(&newvol);
-    voldef = NULL;
 
  cleanup:
+    storageVolJobDataFree(data);
     virObjectUnref(newvol);
-    VIR_FREE(shadowvol);
     virStoragePoolObjEndAPI(&obj);
     virStoragePoolObjEndAPI(&objsrc);
     return vol;
@@ -2572,10 +3231,10 @@ storageVolWipePattern(virStorageVolPtr vol,
     virStorageBackendPtr backend;
     virStoragePoolObjPtr obj = NULL;
     virStorageVolDefPtr voldef = NULL;
-    int rc;
+    virStorageVolJobDataPtr data = NULL;
     int ret = -1;
 
-    virCheckFlags(0, -1);
+    virCheckFlags(VIR_STORAGE_VOL_WIPE_ASYNC, -1);
 
     if (algorithm >= VIR_STORAGE_VOL_WIPE_ALG_LAST) {
         virReportError(VIR_ERR_INVALID_ARG,
@@ -2612,34 +3271,30 @@ storageVolWipePattern(virStorageVolPtr vol,
         goto cleanup;
     }
 
-    virStoragePoolObjIncrAsyncjobs(obj);
-    voldef->in_use++;
-    virObjectUnlock(obj);
-
-    rc = backend->wipeVol(obj, voldef, algorithm, flags);
+    if (!(data = storageVolJobBegin(VIR_STORAGE_VOL_JOB_WIPE, obj, NULL,
+                                    backend, voldef, NULL,
+                                    voldef->target.allocation)))
+        goto cleanup;
+    data->algorithm = algorithm;
+    data->flags = flags & ~VIR_STORAGE_VOL_WIPE_ASYNC;
 
-    virObjectLock(obj);
-    voldef->in_use--;
-    virStoragePoolObjDecrAsyncjobs(obj);
+    if (flags & VIR_STORAGE_VOL_WIPE_ASYNC) {
+        if (storageVolJobSubmit(g_steal_pointer(&data)) < 0)
+            goto cleanup;
 
-    if (rc < 0)
+        ret = 0;
         goto cleanup;
+    }
 
-    /* For local volumes, Instead of using the refreshVol, since
-     * much changes on the target volume, let's update using the
-     * same function as refreshPool would use when it discovers a
-     * volume. The only failure to capture is -1, we can ignore
-     * -2. */
-    if ((backend->type == VIR_STORAGE_POOL_DIR ||
-         backend->type == VIR_STORAGE_POOL_FS ||
-         backend->type == VIR_STORAGE_POOL_NETFS ||
-         backend->type == VIR_STORAGE_POOL_VSTORAGE) &&
-        virStorageBackendRefreshVolTargetUpdate(voldef) == -1)
+    virObjectUnlock(obj);
+
+    if (storageVolJobRun(data) < 0)
         goto cleanup;
 
     ret = 0;
 
  cleanup:
+    storageVolJobDataFree(data);
     virStoragePoolObjEndAPI(&obj);
 
     return ret;
@@ -2700,6 +3355,68 @@ storageVolGetInfo(virStorageVolPtr vol,
 }
 
 
+static int
+storageVolGetJobInfo(virStorageVolPtr vol,
+                     virStorageVolJobInfoPtr info,
+                     unsigned int flags)
+{
+    virStoragePoolObjPtr obj;
+    virStorageVolDefPtr voldef;
+    int ret = -1;
+
+    virCheckFlags(0, -1);
+
+    if (!(voldef = virStorageVolDefFromVol(vol, &obj, NULL)))
+        return -1;
+
+    if (virStorageVolGetJobInfoEnsureACL(vol->conn,
+                                         virStoragePoolObjGetDef(obj),
+                                         voldef) < 0)
+        goto cleanup;
+
+    virStorageVolJobGetInfo(voldef->job, info);
+    ret = 0;
+
+ cleanup:
+    virStoragePoolObjEndAPI(&obj);
+    return ret;
+}
+
+
+static int
+storageVolAbortJob(virStorageVolPtr vol,
+                   unsigned int flags)
+{
+    virStoragePoolObjPtr obj;
+    virStorageVolDefPtr voldef;
+    int ret = -1;
+
+    virCheckFlags(0, -1);
+
+    if (!(voldef = virStorageVolDefFromVol(vol, &obj, NULL)))
+        return -1;
+
+    if (virStorageVolAbortJobEnsureACL(vol->conn,
+                                       virStoragePoolObjGetDef(obj),
+                                       voldef) < 0)
+        goto cleanup;
+
+    if (!voldef->job) {
+        virReportError(VIR_ERR_OPERATION_INVALID,
+                       _("no job is active on volume '%s'"),
+                       voldef->name);
+        goto cleanup;
+    }
+
+    virStorageVolJobAbort(voldef->job);
+    ret = 0;
+
+ cleanup:
+    virStoragePoolObjEndAPI(&obj);
+    return ret;
+}
+
+
 static char *
 storageVolGetXMLDesc(virStorageVolPtr vol,
                      unsigned int flags)
@@ -2893,6 +3610,8 @@ static virStorageDriver storageDriver = {
 
     .storagePoolIsActive = storagePoolIsActive, /* 0.7.3 */
     .storagePoolIsPersistent = storagePoolIsPersistent, /* 0.7.3 */
+    .storageVolGetJobInfo = storageVolGetJobInfo, /* 6.8.0 */
+    .storageVolAbortJob = storageVolAbortJob, /* 6.8.0 */
 };
 
 
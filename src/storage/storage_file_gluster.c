@@ -25,24 +25,198 @@
 
 #include "storage_file_gluster.h"
 #include "viralloc.h"
+#include "virbuffer.h"
 #include "virerror.h"
+#include "virhash.h"
 #include "virlog.h"
 #include "virstoragefilebackend.h"
 #include "virstring.h"
+#include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
 
 VIR_LOG_INIT("storage.storage_file_gluster");
 
+/* How long an unused connection to a gluster volume is kept open, so that
+ * the next access to the same volume doesn't need a new handshake */
+#define VIR_STORAGE_FILE_GLUSTER_CONN_IDLE_TIMEOUT (30 * 1000)
+
+
+typedef struct _virStorageFileBackendGlusterConn virStorageFileBackendGlusterConn;
+typedef virStorageFileBackendGlusterConn *virStorageFileBackendGlusterConnPtr;
+
+struct _virStorageFileBackendGlusterConn {
+    char *key;
+    glfs_t *vol;
+    size_t refs;
+    int timer; /* idle expiry timer, -1 while the connection is used */
+};
+
 
 typedef struct _virStorageFileBackendGlusterPriv virStorageFileBackendGlusterPriv;
 typedef virStorageFileBackendGlusterPriv *virStorageFileBackendGlusterPrivPtr;
 
 struct _virStorageFileBackendGlusterPriv {
+    virStorageFileBackendGlusterConnPtr conn;
     glfs_t *vol;
     char *canonpath;
 };
 
+
+/* Connections shared by all storage sources accessing the same volume
+ * through the same servers, keyed by virStorageFileBackendGlusterConnKey */
+static virMutex virStorageFileBackendGlusterConnLock = VIR_MUTEX_INITIALIZER;
+static virHashTablePtr virStorageFileBackendGlusterConns;
+
+
+static void
+virStorageFileBackendGlusterConnFree(virStorageFileBackendGlusterConnPtr conn)
+{
+    if (!conn)
+        return;
+
+    VIR_DEBUG("closing gluster connection %p (%s)", conn, conn->key);
+
+    if (conn->vol)
+        glfs_fini(conn->vol);
+    g_free(conn->key);
+    g_free(conn);
+}
+
+
+static char *
+virStorageFileBackendGlusterConnKey(virStorageSourcePtr src)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    size_t i;
+
+    /* gluster has no authentication, the volume and the servers
+     * identify the connection */
+    virBufferAsprintf(&buf, "%s", src->volume);
+
+    for (i = 0; i < src->nhosts; i++) {
+        virStorageNetHostDefPtr host = src->hosts + i;
+
+        virBufferAsprintf(&buf, "|%s:%s:%u:%s",
+                          virStorageNetHostTransportTypeToString(host->transport),
+                          NULLSTR_EMPTY(host->name), host->port,
+                          NULLSTR_EMPTY(host->socket));
+    }
+
+    return virBufferContentAndReset(&buf);
+}
+
+
+static void
+virStorageFileBackendGlusterConnExpire(int timer,
+                                       void *opaque)
+{
+    virStorageFileBackendGlusterConnPtr conn = opaque;
+
+    virMutexLock(&virStorageFileBackendGlusterConnLock);
+
+    /* the connection was picked up again since the timer fired */
+    if (conn->timer != timer || conn->refs > 0) {
+        virMutexUnlock(&virStorageFileBackendGlusterConnLock);
+        return;
+    }
+
+    virEventRemoveTimeout(conn->timer);
+    conn->timer = -1;
+    virHashSteal(virStorageFileBackendGlusterConns, conn->key);
+
+    virMutexUnlock(&virStorageFileBackendGlusterConnLock);
+
+    virStorageFileBackendGlusterConnFree(conn);
+}
+
+
+/* Returns a cached connection for @key with an extra reference or NULL */
+static virStorageFileBackendGlusterConnPtr
+virStorageFileBackendGlusterConnLookup(const char *key)
+{
+    virStorageFileBackendGlusterConnPtr conn;
+
+    if (!virStorageFileBackendGlusterConns ||
+        !(conn = virHashLookup(virStorageFileBackendGlusterConns, key)))
+        return NULL;
+
+    if (conn->timer != -1) {
+        virEventRemoveTimeout(conn->timer);
+        conn->timer = -1;
+    }
+
+    conn->refs++;
+    return conn;
+}
+
+
+/* Adds @conn to the cache, unless a connection for the same volume was
+ * added in the meantime in which case that one is returned instead */
+static virStorageFileBackendGlusterConnPtr
+virStorageFileBackendGlusterConnAdd(virStorageFileBackendGlusterConnPtr conn)
+{
+    virStorageFileBackendGlusterConnPtr cached;
+
+    virMutexLock(&virStorageFileBackendGlusterConnLock);
+
+    if ((cached = virStorageFileBackendGlusterConnLookup(conn->key))) {
+        virMutexUnlock(&virStorageFileBackendGlusterConnLock);
+        virStorageFileBackendGlusterConnFree(conn);
+        return cached;
+    }
+
+    if (!virStorageFileBackendGlusterConns)
+        virStorageFileBackendGlusterConns = virHashNew(NULL);
+
+    if (virHashAddEntry(virStorageFileBackendGlusterConns, conn->key, conn) == 0)
+        conn->refs++;
+
+    virMutexUnlock(&virStorageFileBackendGlusterConnLock);
+
+    /* in the unlikely case the connection can't be cached it's simply
+     * used by this storage source only */
+    if (conn->refs == 0)
+        virResetLastError();
+
+    return conn;
+}
+
+
+static void
+virStorageFileBackendGlusterConnRelease(virStorageFileBackendGlusterConnPtr conn)
+{
+    virMutexLock(&virStorageFileBackendGlusterConnLock);
+
+    /* not cached, see virStorageFileBackendGlusterConnAdd */
+    if (conn->refs == 0) {
+        virMutexUnlock(&virStorageFileBackendGlusterConnLock);
+        virStorageFileBackendGlusterConnFree(conn);
+        return;
+    }
+
+    if (--conn->refs > 0) {
+        virMutexUnlock(&virStorageFileBackendGlusterConnLock);
+        return;
+    }
+
+    /* Keep the connection around for a while. Without an event loop there's
+     * no way to expire it later, so it's closed right away. */
+    conn->timer = virEventAddTimeout(VIR_STORAGE_FILE_GLUSTER_CONN_IDLE_TIMEOUT,
+                                     virStorageFileBackendGlusterConnExpire,
+                                     conn, NULL);
+    if (conn->timer < 0) {
+        conn->timer = -1;
+        virHashSteal(virStorageFileBackendGlusterConns, conn->key);
+        virMutexUnlock(&virStorageFileBackendGlusterConnLock);
+        virStorageFileBackendGlusterConnFree(conn);
+        return;
+    }
+
+    virMutexUnlock(&virStorageFileBackendGlusterConnLock);
+}
+
+
 static void
 virStorageFileBackendGlusterDeinit(virStorageSourcePtr src)
 {
@@ -51,8 +225,8 @@ virStorageFileBackendGlusterDeinit(virStorageSourcePtr src)
     VIR_DEBUG("deinitializing gluster storage file %p (gluster://%s:%u/%s%s)",
               src, src->hosts->name, src->hosts->port, src->volume, src->path);
 
-    if (priv->vol)
-        glfs_fini(priv->vol);
+    if (priv->conn)
+        virStorageFileBackendGlusterConnRelease(priv->conn);
     VIR_FREE(priv->canonpath);
 
     VIR_FREE(priv);
@@ -60,7 +234,7 @@ virStorageFileBackendGlusterDeinit(virStorageSourcePtr src)
 }
 
 static int
-virStorageFileBackendGlusterInitServer(virStorageFileBackendGlusterPrivPtr priv,
+virStorageFileBackendGlusterInitServer(virStorageFileBackendGlusterConnPtr conn,
                                        virStorageNetHostDefPtr host)
 {
     const char *transport = virStorageNetHostTransportTypeToString(host->transport);
@@ -83,9 +257,9 @@ virStorageFileBackendGlusterInitServer(virStorageFileBackendGlusterPrivPtr priv,
     }
 
     VIR_DEBUG("adding gluster host for %p: transport=%s host=%s port=%d",
-              priv, transport, hoststr, port);
+              conn, transport, hoststr, port);
 
-    if (glfs_set_volfile_server(priv->vol, transport, hoststr, port) < 0) {
+    if (glfs_set_volfile_server(conn->vol, transport, hoststr, port) < 0) {
         virReportSystemError(errno,
                              _("failed to set gluster volfile server '%s'"),
                              hoststr);
@@ -96,11 +270,49 @@ virStorageFileBackendGlusterInitServer(virStorageFileBackendGlusterPrivPtr priv,
 }
 
 
+static virStorageFileBackendGlusterConnPtr
+virStorageFileBackendGlusterConnNew(virStorageSourcePtr src,
+                                    char *key)
+{
+    virStorageFileBackendGlusterConnPtr conn = g_new0(virStorageFileBackendGlusterConn, 1);
+    size_t i;
+
+    conn->key = key;
+    conn->timer = -1;
+
+    VIR_DEBUG("opening gluster connection %p (%s)", conn, conn->key);
+
+    if (!(conn->vol = glfs_new(src->volume))) {
+        virReportOOMError();
+        goto error;
+    }
+
+    for (i = 0; i < src->nhosts; i++) {
+        if (virStorageFileBackendGlusterInitServer(conn, src->hosts + i) < 0)
+            goto error;
+    }
+
+    if (glfs_init(conn->vol) < 0) {
+        virReportSystemError(errno,
+                             _("failed to initialize gluster connection "
+                               "(src=%p conn=%p)"), src, conn);
+        goto error;
+    }
+
+    return conn;
+
+ error:
+    virStorageFileBackendGlusterConnFree(conn);
+    return NULL;
+}
+
+
 static int
 virStorageFileBackendGlusterInit(virStorageSourcePtr src)
 {
     virStorageFileBackendGlusterPrivPtr priv = NULL;
-    size_t i;
+    virStorageFileBackendGlusterConnPtr conn;
+    g_autofree char *key = NULL;
 
     if (!src->volume) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
@@ -117,33 +329,28 @@ virStorageFileBackendGlusterInit(virStorageSourcePtr src)
               src, priv, src->volume, src->path,
               (unsigned int)src->drv->uid, (unsigned int)src->drv->gid);
 
-    if (!(priv->vol = glfs_new(src->volume))) {
-        virReportOOMError();
-        goto error;
-    }
+    key = virStorageFileBackendGlusterConnKey(src);
 
-    for (i = 0; i < src->nhosts; i++) {
-        if (virStorageFileBackendGlusterInitServer(priv, src->hosts + i) < 0)
-            goto error;
-    }
+    virMutexLock(&virStorageFileBackendGlusterConnLock);
+    conn = virStorageFileBackendGlusterConnLookup(key);
+    virMutexUnlock(&virStorageFileBackendGlusterConnLock);
 
-    if (glfs_init(priv->vol) < 0) {
-        virReportSystemError(errno,
-                             _("failed to initialize gluster connection "
-                               "(src=%p priv=%p)"), src, priv);
-        goto error;
+    /* the handshake with the servers is done without holding the lock so
+     * that slow servers don't block access to other volumes */
+    if (!conn) {
+        if (!(conn = virStorageFileBackendGlusterConnNew(src, g_steal_pointer(&key)))) {
+            VIR_FREE(priv);
+            return -1;
+        }
+
+        conn = virStorageFileBackendGlusterConnAdd(conn);
     }
 
+    priv->conn = conn;
+    priv->vol = conn->vol;
     src->drv->priv = priv;
 
     return 0;
-
- error:
-    if (priv->vol)
-        glfs_fini(priv->vol);
-    VIR_FREE(priv);
-
-    return -1;
 }
 
 
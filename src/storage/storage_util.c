@@ -71,6 +71,7 @@
 #include "virxml.h"
 #include "virfdstream.h"
 #include "virutil.h"
+#include "virthreadpool.h"
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
 
@@ -118,14 +119,312 @@ reflinkCloneFile(int dest_fd G_GNUC_UNUSED,
 }
 #endif
 
+/*
+ * Clone @len bytes at @offset of @src_fd into the same offset of
+ * @dest_fd, sharing the extents. The range has to be aligned to the
+ * filesystem block size unless it ends at the end of the source file.
+ * Upon success, return 0.  Otherwise, return -1 and set errno.
+ */
+#ifdef FICLONERANGE
+static inline int
+reflinkCloneRange(int dest_fd, int src_fd,
+                  off_t offset, off_t len)
+{
+    struct file_clone_range range = {
+        .src_fd = src_fd,
+        .src_offset = offset,
+        .src_length = len,
+        .dest_offset = offset,
+    };
+
+    return ioctl(dest_fd, FICLONERANGE, &range);
+}
+#else
+static inline int
+reflinkCloneRange(int dest_fd G_GNUC_UNUSED,
+                  int src_fd G_GNUC_UNUSED,
+                  off_t offset G_GNUC_UNUSED,
+                  off_t len G_GNUC_UNUSED)
+{
+    errno = ENOTSUP;
+    return -1;
+}
+#endif
+
+/*
+ * Copy up to @len bytes at @offset of @src_fd into the same offset of
+ * @dest_fd inside the kernel. Returns the number of bytes copied, or
+ * -1 with errno set.
+ */
+#if HAVE_COPY_FILE_RANGE
+static inline ssize_t
+kernelCopyRange(int dest_fd, int src_fd,
+                off_t offset, size_t len)
+{
+    off_t inoff = offset;
+    off_t outoff = offset;
+
+    return copy_file_range(src_fd, &inoff, dest_fd, &outoff, len, 0);
+}
+#else
+static inline ssize_t
+kernelCopyRange(int dest_fd G_GNUC_UNUSED,
+                int src_fd G_GNUC_UNUSED,
+                off_t offset G_GNUC_UNUSED,
+                size_t len G_GNUC_UNUSED)
+{
+    errno = ENOSYS;
+    return -1;
+}
+#endif
+
+
+/* Errors meaning the operation is not possible for this pair of files
+ * rather than that it failed */
+static bool
+virStorageBackendCopyUnsupported(int err)
+{
+    return err == ENOSYS || err == ENOTSUP || err == EOPNOTSUPP ||
+        err == ENOTTY || err == EXDEV || err == EINVAL;
+}
+
+
+/* Ordered from the cheapest to the most expensive method */
+typedef enum {
+    VIR_STORAGE_BACKEND_COPY_NONE = 0, /* only holes, nothing to copy */
+    VIR_STORAGE_BACKEND_COPY_REFLINK, /* whole file cloned */
+    VIR_STORAGE_BACKEND_COPY_CLONE_RANGE, /* extents cloned */
+    VIR_STORAGE_BACKEND_COPY_FILE_RANGE, /* copied in the kernel */
+    VIR_STORAGE_BACKEND_COPY_READ_WRITE, /* copied through userspace */
+
+    VIR_STORAGE_BACKEND_COPY_LAST
+} virStorageBackendCopyMethod;
+
+VIR_ENUM_DECL(virStorageBackendCopyMethod);
+VIR_ENUM_IMPL(virStorageBackendCopyMethod,
+              VIR_STORAGE_BACKEND_COPY_LAST,
+              "none", "reflink", "clone-range", "copy-range", "read-write",
+);
+
+/* Bounds the time between progress updates of the volume job */
+#define COPY_RANGE_CHUNK (64 * 1024 * 1024)
+
+struct virStorageBackendCopyState {
+    int inputfd;
+    int fd;
+    const char *inputpath;
+    const char *path;
+    virStorageVolJobPtr job;
+    off_t blksize;
+    off_t inputsize;
+    bool noclone;
+    virStorageBackendCopyMethod method;
+};
+
+
+static void
+virStorageBackendCopyStateUse(struct virStorageBackendCopyState *state,
+                              virStorageBackendCopyMethod method)
+{
+    if (method > state->method)
+        state->method = method;
+}
+
+
+/*
+ * Copies the data extent [@offset, @offset + @len) without passing it
+ * through userspace. The block aligned part is reflinked when the
+ * filesystem allows it and the rest is copied with copy_file_range.
+ *
+ * Returns 0 on success, 1 if the kernel can't copy the remaining data
+ * (which starts at *@done bytes into the extent), -errno on error.
+ */
+static int
+virStorageBackendCopyExtent(struct virStorageBackendCopyState *state,
+                            off_t offset,
+                            off_t len,
+                            off_t *done)
+{
+    *done = 0;
+
+    if (!state->noclone && offset % state->blksize == 0) {
+        off_t clonelen = len;
+
+        if (offset + len != state->inputsize)
+            clonelen -= len % state->blksize;
+
+        if (clonelen > 0) {
+            if (reflinkCloneRange(state->fd, state->inputfd,
+                                  offset, clonelen) == 0) {
+                virStorageBackendCopyStateUse(state,
+                                              VIR_STORAGE_BACKEND_COPY_CLONE_RANGE);
+                *done = clonelen;
+
+                if (virStorageVolJobUpdate(state->job, clonelen) < 0)
+                    return -ECANCELED;
+            } else if (virStorageBackendCopyUnsupported(errno)) {
+                VIR_DEBUG("cannot clone extents of '%s': %s",
+                          state->inputpath, g_strerror(errno));
+                state->noclone = true;
+            } else {
+                int ret = -errno;
+                virReportSystemError(errno,
+                                     _("failed to clone extent of '%s'"),
+                                     state->inputpath);
+                return ret;
+            }
+        }
+    }
+
+    while (*done < len) {
+        ssize_t amt = kernelCopyRange(state->fd, state->inputfd,
+                                      offset + *done,
+                                      MIN(len - *done, COPY_RANGE_CHUNK));
+
+        if (amt < 0) {
+            int ret = -errno;
+
+            if (errno == EINTR)
+                continue;
+
+            if (virStorageBackendCopyUnsupported(errno)) {
+                VIR_DEBUG("cannot copy range of '%s' in kernel: %s",
+                          state->inputpath, g_strerror(errno));
+                return 1;
+            }
+
+            virReportSystemError(errno,
+                                 _("failed copying data from '%s' to '%s'"),
+                                 state->inputpath, state->path);
+            return ret;
+        }
+
+        /* The source shrank under us, let the generic loop handle it */
+        if (amt == 0)
+            return 1;
+
+        virStorageBackendCopyStateUse(state,
+                                      VIR_STORAGE_BACKEND_COPY_FILE_RANGE);
+        *done += amt;
+
+        if (virStorageVolJobUpdate(state->job, amt) < 0)
+            return -ECANCELED;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Walks the data extents of the input file with SEEK_DATA/SEEK_HOLE and
+ * copies them with virStorageBackendCopyExtent. Holes are skipped if
+ * @want_sparse, and zeroed otherwise. Both files have to be regular
+ * files.
+ *
+ * Returns 0 if the whole input was copied, 1 if the caller has to copy
+ * the rest by reading and writing from the current position of both
+ * descriptors, -errno on error. *@total is decreased by the amount of
+ * data processed.
+ */
+static int
+virStorageBackendCopyExtents(struct virStorageBackendCopyState *state,
+                             unsigned long long *total,
+                             bool want_sparse)
+{
+    off_t pos = 0;
+    off_t end = state->inputsize;
+    int rc;
+
+    if (*total < (unsigned long long) end)
+        end = *total;
+
+    while (pos < end) {
+        off_t data;
+        off_t hole;
+        off_t done;
+
+        if ((data = lseek(state->inputfd, pos, SEEK_DATA)) < 0) {
+            if (errno == ENXIO) {
+                /* trailing hole */
+                data = end;
+            } else if (errno == EINVAL) {
+                /* SEEK_DATA is not supported, everything is data */
+                data = pos;
+            } else {
+                rc = -errno;
+                virReportSystemError(errno,
+                                     _("unable to seek in file '%s'"),
+                                     state->inputpath);
+                return rc;
+            }
+        }
+        data = MIN(data, end);
+
+        if (data > pos) {
+            if (!want_sparse &&
+                safezero(state->fd, pos, data - pos) < 0) {
+                rc = -errno;
+                virReportSystemError(errno, _("cannot fill file '%s'"),
+                                     state->path);
+                return rc;
+            }
+            *total -= data - pos;
+
+            if (virStorageVolJobUpdate(state->job, data - pos) < 0)
+                return -ECANCELED;
 
+            pos = data;
+        }
+
+        if (pos == end)
+            break;
+
+        if ((hole = lseek(state->inputfd, pos, SEEK_HOLE)) < 0)
+            hole = end;
+        hole = MIN(hole, end);
+
+        rc = virStorageBackendCopyExtent(state, pos, hole - pos, &done);
+        if (rc < 0)
+            return rc;
+
+        *total -= done;
+        pos += done;
+
+        if (rc == 1)
+            break;
+    }
+
+    if (pos == end)
+        return 0;
+
+    if (lseek(state->inputfd, pos, SEEK_SET) < 0 ||
+        lseek(state->fd, pos, SEEK_SET) < 0) {
+        rc = -errno;
+        virReportSystemError(errno,
+                             _("unable to seek in file '%s'"),
+                             state->path);
+        return rc;
+    }
+
+    return 1;
+}
+
+
+/*
+ * Copies the data of @inputvol into @fd. Unless @reflink_copy requires
+ * the whole file to be cloned, data extents of regular files are first
+ * reflinked and then copied in the kernel with copy_file_range, and
+ * only what neither can handle goes through a read/write loop. The
+ * slowest method used is stored in @method.
+ */
 static int ATTRIBUTE_NONNULL(2)
 virStorageBackendCopyToFD(virStorageVolDefPtr vol,
                           virStorageVolDefPtr inputvol,
                           int fd,
                           unsigned long long *total,
                           bool want_sparse,
-                          bool reflink_copy)
+                          bool reflink_copy,
+                          virStorageBackendCopyMethod *method)
 {
     int amtread = -1;
     int ret = 0;
@@ -133,10 +432,13 @@ virStorageBackendCopyToFD(virStorageVolDefPtr vol,
     int wbytes = 0;
     int interval;
     struct stat st;
+    struct stat inputst;
     g_autofree char *zerobuf = NULL;
     g_autofree char *buf = NULL;
     VIR_AUTOCLOSE inputfd = -1;
 
+    *method = VIR_STORAGE_BACKEND_COPY_NONE;
+
     if ((inputfd = open(inputvol->target.path, O_RDONLY)) < 0) {
         ret = -errno;
         virReportSystemError(errno,
@@ -169,10 +471,38 @@ virStorageBackendCopyToFD(virStorageVolDefPtr vol,
             return ret;
         } else {
             VIR_DEBUG("btrfs clone finished.");
+            *method = VIR_STORAGE_BACKEND_COPY_REFLINK;
             return 0;
         }
     }
 
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+        fstat(inputfd, &inputst) == 0 && S_ISREG(inputst.st_mode)) {
+        struct virStorageBackendCopyState state = {
+            .inputfd = inputfd,
+            .fd = fd,
+            .inputpath = inputvol->target.path,
+            .path = vol->target.path,
+            .job = vol->job,
+            .blksize = MAX(st.st_blksize, 1),
+            .inputsize = inputst.st_size,
+        };
+
+        if ((ret = virStorageBackendCopyExtents(&state, total,
+                                                want_sparse)) < 0)
+            return ret;
+
+        *method = state.method;
+
+        /* everything was copied, skip the read/write loop */
+        if (ret == 0)
+            amtread = 0;
+        ret = 0;
+    }
+
+    if (amtread != 0)
+        *method = VIR_STORAGE_BACKEND_COPY_READ_WRITE;
+
     while (amtread != 0) {
         int amtleft;
 
@@ -188,6 +518,9 @@ virStorageBackendCopyToFD(virStorageVolDefPtr vol,
         }
         *total -= amtread;
 
+        if (virStorageVolJobUpdate(vol->job, amtread) < 0)
+            return -ECANCELED;
+
         /* Loop over amt read in 512 byte increments, looking for sparse
          * blocks */
         amtleft = amtread;
@@ -270,9 +603,15 @@ storageBackendCreateBlockFrom(virStoragePoolObjPtr pool G_GNUC_UNUSED,
     remain = vol->target.capacity;
 
     if (inputvol) {
+        virStorageBackendCopyMethod method;
+
         if (virStorageBackendCopyToFD(vol, inputvol, fd, &remain,
-                                      false, reflink_copy) < 0)
+                                      false, reflink_copy, &method) < 0)
             return -1;
+
+        VIR_INFO("copied '%s' to '%s' using %s",
+                 inputvol->target.path, vol->target.path,
+                 virStorageBackendCopyMethodTypeToString(method));
     }
 
     if (fstat(fd, &st) == -1) {
@@ -360,13 +699,20 @@ createRawFile(int fd, virStorageVolDefPtr vol,
 
     if (inputvol) {
         unsigned long long remain = inputvol->target.capacity;
+        virStorageBackendCopyMethod method;
+
         /* allow zero blocks to be skipped if we've requested sparse
          * allocation (allocation < capacity) or we have already
          * been able to allocate the required space. */
         if ((ret = virStorageBackendCopyToFD(vol, inputvol, fd, &remain,
-                                             !need_alloc, reflink_copy)) < 0)
+                                             !need_alloc, reflink_copy,
+                                             &method)) < 0)
             return ret;
 
+        VIR_INFO("copied '%s' to '%s' using %s",
+                 inputvol->target.path, vol->target.path,
+                 virStorageBackendCopyMethodTypeToString(method));
+
         /* If the new allocation is greater than the original capacity,
          * but fallocate failed, fill the rest with zeroes.
          */
@@ -2478,30 +2824,319 @@ storageBackendVolZeroSparseFileLocal(const char *path,
 }
 
 
+/* Ordered from the cheapest to the most expensive method */
+typedef enum {
+    VIR_STORAGE_BACKEND_WIPE_DISCARD = 0, /* discarded, device reads back zeroes */
+    VIR_STORAGE_BACKEND_WIPE_ZERO_RANGE, /* zeroed by the filesystem */
+    VIR_STORAGE_BACKEND_WIPE_PUNCH_HOLE, /* deallocated, or zeroed by the device */
+    VIR_STORAGE_BACKEND_WIPE_ZEROOUT, /* zeroed in the kernel */
+    VIR_STORAGE_BACKEND_WIPE_WRITE, /* written through userspace */
+
+    VIR_STORAGE_BACKEND_WIPE_LAST
+} virStorageBackendWipeMethod;
+
+VIR_ENUM_DECL(virStorageBackendWipeMethod);
+VIR_ENUM_IMPL(virStorageBackendWipeMethod,
+              VIR_STORAGE_BACKEND_WIPE_LAST,
+              "discard", "zero-range", "punch-hole", "zeroout", "write",
+);
+
+/* Bounds the time between progress updates of the volume job while the
+ * zeroing is offloaded */
+#define WIPE_OFFLOAD_CHUNK (1024 * 1024 * 1024)
+
+/* Block devices are written from several threads once the wipe is
+ * bigger than WIPE_PARALLEL_MIN, to keep the device queues busy */
+#define WIPE_PARALLEL_MIN (1024 * 1024 * 1024)
+#define WIPE_PARALLEL_THREADS 8
+
+
+/*
+ * Zeroes @len bytes at @offset of @fd using @method without writing
+ * the zeroes from userspace. Returns 0 on success, or -1 with errno set.
+ */
+static int
+storageBackendWipeOffloadRange(int fd,
+                               virStorageBackendWipeMethod method,
+                               off_t offset,
+                               unsigned long long len)
+{
+#if defined(BLKDISCARD) || defined(BLKZEROOUT)
+    uint64_t range[2] = { offset, len };
+#endif
+
+    switch (method) {
+    case VIR_STORAGE_BACKEND_WIPE_DISCARD:
+#ifdef BLKDISCARD
+        return ioctl(fd, BLKDISCARD, range);
+#else
+        break;
+#endif
+    case VIR_STORAGE_BACKEND_WIPE_ZERO_RANGE:
+#if HAVE_FALLOCATE - 0 && defined(FALLOC_FL_ZERO_RANGE)
+        return fallocate(fd, FALLOC_FL_ZERO_RANGE | FALLOC_FL_KEEP_SIZE,
+                         offset, len);
+#else
+        break;
+#endif
+    case VIR_STORAGE_BACKEND_WIPE_PUNCH_HOLE:
+#if HAVE_FALLOCATE - 0 && defined(FALLOC_FL_PUNCH_HOLE)
+        return fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                         offset, len);
+#else
+        break;
+#endif
+    case VIR_STORAGE_BACKEND_WIPE_ZEROOUT:
+#ifdef BLKZEROOUT
+        return ioctl(fd, BLKZEROOUT, range);
+#else
+        break;
+#endif
+    case VIR_STORAGE_BACKEND_WIPE_WRITE:
+    case VIR_STORAGE_BACKEND_WIPE_LAST:
+        break;
+    }
+
+    errno = ENOSYS;
+    return -1;
+}
+
+
+/*
+ * Returns whether a discard of a range of the block device @fd is
+ * guaranteed to read back as zeroes.
+ */
+static bool
+storageBackendWipeDiscardZeroes(int fd G_GNUC_UNUSED)
+{
+#ifdef BLKDISCARDZEROES
+    unsigned int zeroes = 0;
+
+    if (ioctl(fd, BLKDISCARDZEROES, &zeroes) == 0)
+        return zeroes != 0;
+#endif
+    return false;
+}
+
+
+/*
+ * Tries to have the kernel, the filesystem or the device zero @len bytes
+ * at @offset of @fd, trying the methods from the cheapest one. A method
+ * is only given up on if it fails for the first chunk; once a method has
+ * zeroed some data, its failures are real errors.
+ *
+ * Returns 0 if the range was zeroed, 1 if no method is supported and the
+ * zeroes have to be written, or -1 on error.
+ */
+static int
+storageBackendWipeOffload(const char *path,
+                          int fd,
+                          bool isblk,
+                          off_t offset,
+                          unsigned long long len,
+                          virStorageVolJobPtr job)
+{
+    virStorageBackendWipeMethod method;
+
+    for (method = 0; method < VIR_STORAGE_BACKEND_WIPE_WRITE; method++) {
+        unsigned long long remaining = len;
+        off_t pos = offset;
+
+        if (isblk) {
+            if (method == VIR_STORAGE_BACKEND_WIPE_ZERO_RANGE)
+                continue;
+            if (method == VIR_STORAGE_BACKEND_WIPE_DISCARD &&
+                !storageBackendWipeDiscardZeroes(fd))
+                continue;
+        } else {
+            if (method == VIR_STORAGE_BACKEND_WIPE_DISCARD ||
+                method == VIR_STORAGE_BACKEND_WIPE_ZEROOUT)
+                continue;
+        }
+
+        while (remaining > 0) {
+            unsigned long long chunk = MIN(remaining, WIPE_OFFLOAD_CHUNK);
+
+            if (storageBackendWipeOffloadRange(fd, method, pos, chunk) < 0) {
+                if (remaining == len && virStorageBackendCopyUnsupported(errno))
+                    break;
+
+                virReportSystemError(errno,
+                                     _("Failed to zero %llu bytes at offset %llu "
+                                       "of storage volume with path '%s' "
+                                       "using %s"),
+                                     chunk, (unsigned long long) pos, path,
+                                     virStorageBackendWipeMethodTypeToString(method));
+                return -1;
+            }
+
+            pos += chunk;
+            remaining -= chunk;
+
+            if (virStorageVolJobUpdate(job, chunk) < 0)
+                return -1;
+        }
+
+        if (remaining == 0) {
+            VIR_DEBUG("zeroed %llu bytes of '%s' using %s", len, path,
+                      virStorageBackendWipeMethodTypeToString(method));
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
+typedef struct _virStorageBackendWipeRange virStorageBackendWipeRange;
+struct _virStorageBackendWipeRange {
+    const char *path;
+    int fd;
+    off_t offset;
+    unsigned long long len;
+    size_t buflen;
+    virStorageVolJobPtr job;
+    int *stop; /* shared by all ranges, set once one of them fails */
+    int rc;
+    virErrorPtr err;
+};
+
+
+/*
+ * Writes zeroes over @range. Returns 0 on success, 1 if another range
+ * failed first, or -1 on error.
+ */
+static int
+storageBackendWipeWriteRange(virStorageBackendWipeRange *range)
+{
+    g_autofree char *writebuf = g_new0(char, range->buflen);
+    unsigned long long remaining = range->len;
+    off_t pos = range->offset;
+
+    while (remaining > 0) {
+        size_t write_size = MIN(range->buflen, remaining);
+        ssize_t written;
+
+        if (range->stop && g_atomic_int_get(range->stop))
+            return 1;
+
+        written = pwrite(range->fd, writebuf, write_size, pos);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            virReportSystemError(errno,
+                                 _("Failed to write %zu bytes to "
+                                   "storage volume with path '%s'"),
+                                 write_size, range->path);
+            return -1;
+        }
+
+        pos += written;
+        remaining -= written;
+
+        if (virStorageVolJobUpdate(range->job, written) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static void
+storageBackendWipeWriteWorker(void *opaque)
+{
+    virStorageBackendWipeRange *range = opaque;
+
+    if ((range->rc = storageBackendWipeWriteRange(range)) < 0) {
+        virErrorPreserveLast(&range->err);
+        g_atomic_int_set(range->stop, 1);
+    }
+}
+
+
+/*
+ * Writes zeroes over @len bytes at @offset of the block device @fd. The
+ * range is split into as many pieces as there are writer threads; each
+ * thread writes its own piece.
+ */
+static int
+storageBackendWipeWriteParallel(const char *path,
+                                int fd,
+                                off_t offset,
+                                unsigned long long len,
+                                size_t buflen,
+                                virStorageVolJobPtr job)
+{
+    virStorageBackendWipeRange ranges[WIPE_PARALLEL_THREADS] = { 0 };
+    virThread threads[WIPE_PARALLEL_THREADS];
+    unsigned long long piece;
+    size_t nthreads = 0;
+    bool reported = false;
+    int stop = 0;
+    int ret = 0;
+    size_t i;
+
+    /* keep the pieces aligned to the write size */
+    piece = VIR_DIV_UP(len, WIPE_PARALLEL_THREADS);
+    piece = VIR_ROUND_UP(piece, buflen);
+
+    for (i = 0; i < WIPE_PARALLEL_THREADS; i++) {
+        unsigned long long start = i * piece;
+
+        if (start >= len)
+            break;
+
+        ranges[i].path = path;
+        ranges[i].fd = fd;
+        ranges[i].offset = offset + start;
+        ranges[i].len = MIN(piece, len - start);
+        ranges[i].buflen = buflen;
+        ranges[i].job = job;
+        ranges[i].stop = &stop;
+    }
+
+    for (nthreads = 0; nthreads < i; nthreads++) {
+        if (virThreadCreate(&threads[nthreads], true,
+                            storageBackendWipeWriteWorker,
+                            &ranges[nthreads]) < 0)
+            break;
+    }
+
+    /* the pieces no thread could be started for are written from here */
+    for (i = nthreads; i < G_N_ELEMENTS(ranges) && ranges[i].len; i++)
+        storageBackendWipeWriteWorker(&ranges[i]);
+
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+
+    for (i = 0; i < G_N_ELEMENTS(ranges); i++) {
+        if (ranges[i].rc != 0 && ret == 0)
+            ret = -1;
+        if (ranges[i].err && !reported) {
+            virErrorRestore(&ranges[i].err);
+            reported = true;
+        }
+        virFreeError(ranges[i].err);
+    }
+
+    return ret;
+}
+
+
 static int
 storageBackendWipeLocal(const char *path,
                         int fd,
+                        bool isblk,
                         unsigned long long wipe_len,
                         size_t writebuf_length,
-                        bool zero_end)
+                        bool zero_end,
+                        virStorageVolJobPtr job)
 {
-    int written = 0;
-    unsigned long long remaining = 0;
     off_t size;
-    size_t write_size = 0;
-    g_autofree char *writebuf = NULL;
-
-    if (VIR_ALLOC_N(writebuf, writebuf_length) < 0)
-        return -1;
+    int rc;
 
     if (!zero_end) {
-        if ((size = lseek(fd, 0, SEEK_SET)) < 0) {
-            virReportSystemError(errno,
-                                 _("Failed to seek to the start in volume "
-                                   "with path '%s'"),
-                                 path);
-            return -1;
-        }
+        size = 0;
     } else {
         if ((size = lseek(fd, -wipe_len, SEEK_END)) < 0) {
             virReportSystemError(errno,
@@ -2514,21 +3149,25 @@ storageBackendWipeLocal(const char *path,
 
     VIR_DEBUG("wiping start: %zd len: %llu", (ssize_t)size, wipe_len);
 
-    remaining = wipe_len;
-    while (remaining > 0) {
+    if ((rc = storageBackendWipeOffload(path, fd, isblk, size,
+                                        wipe_len, job)) < 0)
+        return -1;
 
-        write_size = (writebuf_length < remaining) ? writebuf_length : remaining;
-        written = safewrite(fd, writebuf, write_size);
-        if (written < 0) {
-            virReportSystemError(errno,
-                                 _("Failed to write %zu bytes to "
-                                   "storage volume with path '%s'"),
-                                 write_size, path);
+    if (rc > 0) {
+        if (isblk && wipe_len >= WIPE_PARALLEL_MIN) {
+            rc = storageBackendWipeWriteParallel(path, fd, size, wipe_len,
+                                                 writebuf_length, job);
+        } else {
+            virStorageBackendWipeRange range = {
+                .path = path, .fd = fd, .offset = size, .len = wipe_len,
+                .buflen = writebuf_length, .job = job,
+            };
 
-            return -1;
+            rc = storageBackendWipeWriteRange(&range);
         }
 
-        remaining -= written;
+        if (rc < 0)
+            return -1;
     }
 
     if (virFileDataSync(fd) < 0) {
@@ -2548,7 +3187,8 @@ static int
 storageBackendVolWipeLocalFile(const char *path,
                                unsigned int algorithm,
                                unsigned long long allocation,
-                               bool zero_end)
+                               bool zero_end,
+                               virStorageVolJobPtr job)
 {
     const char *alg_char = NULL;
     struct stat st;
@@ -2621,8 +3261,8 @@ storageBackendVolWipeLocalFile(const char *path,
     if (S_ISREG(st.st_mode) && st.st_blocks < (st.st_size / DEV_BSIZE))
         return storageBackendVolZeroSparseFileLocal(path, st.st_size, fd);
 
-    return storageBackendWipeLocal(path, fd, allocation, st.st_blksize,
-                                   zero_end);
+    return storageBackendWipeLocal(path, fd, S_ISBLK(st.st_mode), allocation,
+                                   st.st_blksize, zero_end, job);
 }
 
 
@@ -2647,7 +3287,8 @@ storageBackendVolWipePloop(virStorageVolDefPtr vol,
     disk_desc = g_strdup_printf("%s/DiskDescriptor.xml", vol->target.path);
 
     if (storageBackendVolWipeLocalFile(target_path, algorithm,
-                                       vol->target.allocation, false) < 0)
+                                       vol->target.allocation, false,
+                                       vol->job) < 0)
         return -1;
 
     if (virFileRemove(disk_desc, 0, 0) < 0) {
@@ -2688,7 +3329,8 @@ virStorageBackendVolWipeLocal(virStoragePoolObjPtr pool G_GNUC_UNUSED,
         ret = storageBackendVolWipePloop(vol, algorithm);
     } else {
         ret = storageBackendVolWipeLocalFile(vol->target.path, algorithm,
-                                             vol->target.allocation, false);
+                                             vol->target.allocation, false,
+                                             vol->job);
     }
 
     return ret;
@@ -3471,12 +4113,242 @@ virStorageBackendRefreshVolTargetUpdate(virStorageVolDefPtr vol)
 }
 
 
+/* Per file state of a local pool refresh */
+typedef struct _virStorageBackendRefreshData virStorageBackendRefreshData;
+struct _virStorageBackendRefreshData {
+    virStorageVolDefPtr vol;
+    bool probe; /* false if the volume already known is up to date */
+    int rc; /* result of virStorageBackendRefreshVolTargetUpdate */
+    virErrorPtr err;
+};
+
+typedef struct _virStorageBackendRefreshCtx virStorageBackendRefreshCtx;
+struct _virStorageBackendRefreshCtx {
+    virMutex lock;
+    virCond cond;
+    size_t pending;
+};
+
+/* Minimum number of files for which probing is spread over worker threads */
+#define VIR_STORAGE_BACKEND_REFRESH_PARALLEL_MIN 16
+
+/* Probing is mostly waiting for I/O, so don't tie the workers to the
+ * number of host CPUs */
+#define VIR_STORAGE_BACKEND_REFRESH_WORKERS 16
+
+
+static void
+virStorageBackendRefreshStamp(virStorageVolStampPtr stamp,
+                              const struct stat *sb)
+{
+    stamp->dev = sb->st_dev;
+    stamp->ino = sb->st_ino;
+    stamp->size = sb->st_size;
+#ifdef __APPLE__
+    stamp->mtime = sb->st_mtimespec;
+    stamp->ctime = sb->st_ctimespec;
+#else /* ! __APPLE__ */
+    stamp->mtime = sb->st_mtim;
+    stamp->ctime = sb->st_ctim;
+#endif /* ! __APPLE__ */
+}
+
+
+static bool
+virStorageBackendRefreshStampEqual(const virStorageVolStamp *a,
+                                   const virStorageVolStamp *b)
+{
+    return a->dev == b->dev &&
+        a->ino == b->ino &&
+        a->size == b->size &&
+        a->mtime.tv_sec == b->mtime.tv_sec &&
+        a->mtime.tv_nsec == b->mtime.tv_nsec &&
+        a->ctime.tv_sec == b->ctime.tv_sec &&
+        a->ctime.tv_nsec == b->ctime.tv_nsec;
+}
+
+
+static void
+virStorageBackendRefreshProbe(virStorageBackendRefreshData *data)
+{
+    struct stat sb;
+
+    /* Stamp the file before probing it so that changes made meanwhile
+     * are caught by the next refresh */
+    if (stat(data->vol->target.path, &sb) == 0)
+        virStorageBackendRefreshStamp(&data->vol->stamp, &sb);
+
+    if ((data->rc = virStorageBackendRefreshVolTargetUpdate(data->vol)) == -1)
+        virErrorPreserveLast(&data->err);
+    else
+        virResetLastError();
+}
+
+
+static void
+virStorageBackendRefreshWorker(void *jobdata,
+                               void *opaque)
+{
+    virStorageBackendRefreshCtx *ctx = opaque;
+
+    virStorageBackendRefreshProbe(jobdata);
+
+    virMutexLock(&ctx->lock);
+    if (--ctx->pending == 0)
+        virCondSignal(&ctx->cond);
+    virMutexUnlock(&ctx->lock);
+}
+
+
+/*
+ * Probes the volumes in @data which need it. Opening each file and
+ * parsing its header is slow on network filesystems, so if there are
+ * enough files it's spread over a pool of worker threads.
+ */
+static void
+virStorageBackendRefreshProbeAll(virStorageBackendRefreshData *data,
+                                 size_t ndata)
+{
+    virStorageBackendRefreshCtx ctx = { 0 };
+    virThreadPoolPtr workers = NULL;
+    size_t nprobe = 0;
+    size_t i = 0;
+
+    for (i = 0; i < ndata; i++) {
+        if (data[i].probe)
+            nprobe++;
+    }
+
+    i = 0;
+    if (nprobe < VIR_STORAGE_BACKEND_REFRESH_PARALLEL_MIN)
+        goto sequential;
+
+    if (virMutexInit(&ctx.lock) < 0)
+        goto sequential;
+
+    if (virCondInit(&ctx.cond) < 0) {
+        virMutexDestroy(&ctx.lock);
+        goto sequential;
+    }
+
+    if (!(workers = virThreadPoolNew(0, MIN(nprobe, VIR_STORAGE_BACKEND_REFRESH_WORKERS),
+                                     0, virStorageBackendRefreshWorker, &ctx))) {
+        virResetLastError();
+        virCondDestroy(&ctx.cond);
+        virMutexDestroy(&ctx.lock);
+        goto sequential;
+    }
+
+    virMutexLock(&ctx.lock);
+    for (; i < ndata; i++) {
+        if (!data[i].probe)
+            continue;
+        if (virThreadPoolSendJob(workers, 0, &data[i]) < 0)
+            break;
+        ctx.pending++;
+    }
+
+    while (ctx.pending > 0)
+        ignore_value(virCondWait(&ctx.cond, &ctx.lock));
+    virMutexUnlock(&ctx.lock);
+
+    virThreadPoolFree(workers);
+    virCondDestroy(&ctx.cond);
+    virMutexDestroy(&ctx.lock);
+
+ sequential:
+    /* whatever couldn't be handed over to the workers */
+    for (; i < ndata; i++) {
+        if (data[i].probe)
+            virStorageBackendRefreshProbe(&data[i]);
+    }
+}
+
+
+struct virStorageBackendRefreshGoneData {
+    virHashTablePtr seen;
+    char **gone;
+};
+
+
+static int
+virStorageBackendRefreshCollectGone(virStorageVolDefPtr voldef,
+                                    const void *opaque)
+{
+    struct virStorageBackendRefreshGoneData *data = (void *) opaque;
+
+    if (!virHashHasEntry(data->seen, voldef->name))
+        return virStringListAdd(&data->gone, voldef->name);
+
+    return 0;
+}
+
+
+/*
+ * Replaces the volumes of @pool by those in @data. Volumes which are
+ * being built or used by an API are left untouched, and so are volumes
+ * whose file appeared or disappeared while the pool was unlocked.
+ */
+static int
+virStorageBackendRefreshSwap(virStoragePoolObjPtr pool,
+                             virStorageBackendRefreshData *data,
+                             size_t ndata,
+                             virHashTablePtr seen)
+{
+    struct virStorageBackendRefreshGoneData gone = { .seen = seen };
+    size_t i;
+
+    for (i = 0; i < ndata; i++) {
+        virStorageVolDefPtr old;
+
+        if (!data[i].probe || !data[i].vol)
+            continue;
+
+        if ((old = virStorageVolDefFindByName(pool, data[i].vol->name))) {
+            if (old->building || old->in_use)
+                continue;
+            virStoragePoolObjRemoveVol(pool, old);
+        } else if (!virFileExists(data[i].vol->target.path)) {
+            continue;
+        }
+
+        if (virStoragePoolObjAddVol(pool, data[i].vol) < 0)
+            return -1;
+        data[i].vol = NULL;
+    }
+
+    /* volumes which weren't found in the directory */
+    virStoragePoolObjForEachVolume(pool, virStorageBackendRefreshCollectGone,
+                                   &gone);
+
+    for (i = 0; gone.gone && gone.gone[i]; i++) {
+        virStorageVolDefPtr old;
+
+        if (!(old = virStorageVolDefFindByName(pool, gone.gone[i])) ||
+            old->building || old->in_use ||
+            virFileExists(old->target.path))
+            continue;
+
+        virStoragePoolObjRemoveVol(pool, old);
+    }
+
+    virStringListFree(gone.gone);
+    return 0;
+}
+
+
 /**
  * Iterate over the pool's directory and enumerate all disk images
  * within it. This is non-recursive.
+ *
+ * With @incremental the pool is unlocked on entry and its volumes are
+ * kept. Files which didn't change since they were last probed are not
+ * probed again and the previous volume list stays visible until the
+ * new one is swapped in.
  */
-int
-virStorageBackendRefreshLocal(virStoragePoolObjPtr pool)
+static int
+virStorageBackendRefreshLocalImpl(virStoragePoolObjPtr pool,
+                                  bool incremental)
 {
     virStoragePoolDefPtr def = virStoragePoolObjGetDef(pool);
     DIR *dir;
@@ -3485,15 +4357,18 @@ virStorageBackendRefreshLocal(virStoragePoolObjPtr pool)
     struct stat statbuf;
     int direrr;
     int ret = -1;
-    g_autoptr(virStorageVolDef) vol = NULL;
+    virStorageBackendRefreshData *data = NULL;
+    size_t ndata = 0;
+    size_t i;
     VIR_AUTOCLOSE fd = -1;
     g_autoptr(virStorageSource) target = NULL;
+    g_autoptr(virHashTable) seen = virHashNew(NULL);
 
     if (virDirOpen(&dir, def->target.path) < 0)
         goto cleanup;
 
     while ((direrr = virDirRead(dir, &ent, def->target.path)) > 0) {
-        int err;
+        virStorageBackendRefreshData item = { 0 };
 
         if (virStringHasControlChars(ent->d_name)) {
             VIR_WARN("Ignoring file '%s' with control characters under '%s'",
@@ -3501,35 +4376,64 @@ virStorageBackendRefreshLocal(virStoragePoolObjPtr pool)
             continue;
         }
 
-        if (VIR_ALLOC(vol) < 0)
+        if (VIR_ALLOC(item.vol) < 0)
             goto cleanup;
 
-        vol->name = g_strdup(ent->d_name);
+        item.vol->name = g_strdup(ent->d_name);
 
-        vol->type = VIR_STORAGE_VOL_FILE;
-        vol->target.path = g_strdup_printf("%s/%s", def->target.path, vol->name);
+        item.vol->type = VIR_STORAGE_VOL_FILE;
+        item.vol->target.path = g_strdup_printf("%s/%s", def->target.path,
+                                                item.vol->name);
 
-        vol->key = g_strdup(vol->target.path);
+        item.vol->key = g_strdup(item.vol->target.path);
+        item.probe = true;
 
-        if ((err = virStorageBackendRefreshVolTargetUpdate(vol)) < 0) {
-            if (err == -2) {
-                /* Silently ignore non-regular files,
-                 * eg 'lost+found', dangling symbolic link */
-                virStorageVolDefFree(vol);
-                vol = NULL;
-                continue;
-            }
+        if (virHashAddEntry(seen, item.vol->name, seen) < 0) {
+            virStorageVolDefFree(item.vol);
             goto cleanup;
         }
 
-        if (virStoragePoolObjAddVol(pool, vol) < 0)
+        if (VIR_APPEND_ELEMENT(data, ndata, item) < 0) {
+            virStorageVolDefFree(item.vol);
             goto cleanup;
-        vol = NULL;
+        }
     }
     if (direrr < 0)
         goto cleanup;
     VIR_DIR_CLOSE(dir);
 
+    if (incremental) {
+        virObjectLock(pool);
+        for (i = 0; i < ndata; i++) {
+            virStorageVolDefPtr old;
+            virStorageVolStamp stamp;
+
+            if (!(old = virStorageVolDefFindByName(pool, data[i].vol->name)) ||
+                old->building ||
+                stat(data[i].vol->target.path, &statbuf) < 0)
+                continue;
+
+            virStorageBackendRefreshStamp(&stamp, &statbuf);
+            if (virStorageBackendRefreshStampEqual(&stamp, &old->stamp))
+                data[i].probe = false;
+        }
+        virObjectUnlock(pool);
+    }
+
+    virStorageBackendRefreshProbeAll(data, ndata);
+
+    for (i = 0; i < ndata; i++) {
+        if (data[i].rc == -2) {
+            /* Silently ignore non-regular files,
+             * eg 'lost+found', dangling symbolic link */
+            virStorageVolDefFree(data[i].vol);
+            data[i].vol = NULL;
+        } else if (data[i].rc < 0) {
+            virErrorRestore(&data[i].err);
+            goto cleanup;
+        }
+    }
+
     if (!(target = virStorageSourceNew()))
         goto cleanup;
 
@@ -3558,6 +4462,15 @@ virStorageBackendRefreshLocal(virStoragePoolObjPtr pool)
         goto cleanup;
     }
 
+    if (incremental)
+        virObjectLock(pool);
+
+    if (virStorageBackendRefreshSwap(pool, data, ndata, seen) < 0) {
+        if (incremental)
+            virObjectUnlock(pool);
+        goto cleanup;
+    }
+
     def->capacity = ((unsigned long long)sb.f_frsize *
                      (unsigned long long)sb.f_blocks);
     def->available = ((unsigned long long)sb.f_bfree *
@@ -3570,9 +4483,110 @@ virStorageBackendRefreshLocal(virStoragePoolObjPtr pool)
     VIR_FREE(def->target.perms.label);
     def->target.perms.label = g_strdup(target->perms->label);
 
+    if (incremental)
+        virObjectUnlock(pool);
+
     ret = 0;
  cleanup:
     VIR_DIR_CLOSE(dir);
+    for (i = 0; i < ndata; i++) {
+        virStorageVolDefFree(data[i].vol);
+        virFreeError(data[i].err);
+    }
+    VIR_FREE(data);
+    return ret;
+}
+
+
+int
+virStorageBackendRefreshLocal(virStoragePoolObjPtr pool)
+{
+    return virStorageBackendRefreshLocalImpl(pool, false);
+}
+
+
+int
+virStorageBackendRefreshLocalIncremental(virStoragePoolObjPtr pool)
+{
+    return virStorageBackendRefreshLocalImpl(pool, true);
+}
+
+
+struct virStorageBackendCheckUsageData {
+    virStoragePoolObjPtr pool;
+    virStorageBackendVolUsageFunc func;
+    void *opaque;
+    int *ret;
+};
+
+
+static int
+virStorageBackendCheckUsageLocalVol(virStorageVolDefPtr vol,
+                                    const void *opaque)
+{
+    const struct virStorageBackendCheckUsageData *data = opaque;
+    struct stat sb;
+
+    if (*data->ret < 0 ||
+        vol->type != VIR_STORAGE_VOL_FILE ||
+        vol->target.capacity == 0)
+        return 0;
+
+    /* a file removed behind our back is dropped by the next refresh */
+    if (stat(vol->target.path, &sb) < 0)
+        return 0;
+
+#ifndef WIN32
+    vol->target.allocation = (unsigned long long)sb.st_blocks *
+        (unsigned long long)DEV_BSIZE;
+#else
+    vol->target.allocation = sb.st_size;
+#endif
+
+    /* files can't be grown ahead of time, ignore the request */
+    if (data->func(data->pool, vol, vol->target.allocation,
+                   vol->target.capacity, data->opaque) < 0) {
+        *data->ret = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * virStorageBackendCheckUsageLocal:
+ *
+ * Updates the pool sizes using statvfs() and the allocation of the file
+ * volumes using stat(), without probing the volume formats again.
+ */
+int
+virStorageBackendCheckUsageLocal(virStoragePoolObjPtr pool,
+                                 virStorageBackendVolUsageFunc func,
+                                 void *opaque)
+{
+    virStoragePoolDefPtr def = virStoragePoolObjGetDef(pool);
+    struct statvfs sb;
+    int ret = 0;
+    struct virStorageBackendCheckUsageData data = {
+        .pool = pool, .func = func, .opaque = opaque, .ret = &ret };
+
+    if (statvfs(def->target.path, &sb) < 0) {
+        virReportSystemError(errno,
+                             _("cannot statvfs path '%s'"),
+                             def->target.path);
+        return -1;
+    }
+
+    def->capacity = ((unsigned long long)sb.f_frsize *
+                     (unsigned long long)sb.f_blocks);
+    def->available = ((unsigned long long)sb.f_bfree *
+                      (unsigned long long)sb.f_frsize);
+    def->allocation = def->capacity - def->available;
+
+    virStoragePoolObjForEachVolume(pool, virStorageBackendCheckUsageLocalVol,
+                                   &data);
+
     return ret;
 }
 
@@ -4004,11 +5018,11 @@ virStorageBackendZeroPartitionTable(const char *path,
                                     unsigned long long size)
 {
     if (storageBackendVolWipeLocalFile(path, VIR_STORAGE_VOL_WIPE_ALG_ZERO,
-                                       size, false) < 0)
+                                       size, false, NULL) < 0)
         return -1;
 
     return storageBackendVolWipeLocalFile(path, VIR_STORAGE_VOL_WIPE_ALG_ZERO,
-                                          size, true);
+                                          size, true, NULL);
 }
 
 
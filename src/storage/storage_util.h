@@ -104,6 +104,10 @@ int
 virStorageBackendRefreshVolTargetUpdate(virStorageVolDefPtr vol);
 
 int virStorageBackendRefreshLocal(virStoragePoolObjPtr pool);
+int virStorageBackendRefreshLocalIncremental(virStoragePoolObjPtr pool);
+int virStorageBackendCheckUsageLocal(virStoragePoolObjPtr pool,
+                                     virStorageBackendVolUsageFunc func,
+                                     void *opaque);
 
 int virStorageUtilGlusterExtractPoolSources(const char *host,
                                             const char *xml,
@@ -90,6 +90,13 @@ struct _testAuth {
 typedef struct _testAuth testAuth;
 typedef struct _testAuth *testAuthPtr;
 
+struct _testLatency {
+    char *api; /* NULL for all APIs */
+    unsigned int ms;
+};
+typedef struct _testLatency testLatency;
+typedef struct _testLatency *testLatencyPtr;
+
 struct _testDriver {
     virObjectLockable parent;
 
@@ -104,6 +111,10 @@ struct _testDriver {
     size_t numAuths;
     testAuthPtr auths;
 
+    /* immutable after the driver is opened */
+    size_t nlatencies;
+    testLatencyPtr latencies;
+
     /* g_atomic access only */
     volatile int nextDomID;
 
@@ -171,6 +182,9 @@ testDriverDispose(void *obj)
     }
     g_free(driver->cells);
     g_free(driver->auths);
+    for (i = 0; i < driver->nlatencies; i++)
+        g_free(driver->latencies[i].api);
+    g_free(driver->latencies);
 
     testDriverDisposed = true;
 }
@@ -661,6 +675,34 @@ testDomObjFromDomain(virDomainPtr domain)
     return vm;
 }
 
+/*
+ * Delays the calling API by the latency configured for it using
+ * <latency api='...' ms='...'/> or, if there is none, by the one
+ * configured for all APIs using <latency ms='...'/>. Must not be called
+ * with any lock held so that concurrent calls are delayed in parallel.
+ */
+static void
+testDriverSimulateLatency(testDriverPtr privconn,
+                          const char *api)
+{
+    unsigned int ms = 0;
+    size_t i;
+
+    for (i = 0; i < privconn->nlatencies; i++) {
+        testLatencyPtr latency = &privconn->latencies[i];
+
+        if (!latency->api) {
+            ms = latency->ms;
+        } else if (STREQ(latency->api, api)) {
+            ms = latency->ms;
+            break;
+        }
+    }
+
+    if (ms > 0)
+        g_usleep(ms * 1000ull);
+}
+
 static char *
 testDomainGenerateIfname(virDomainDefPtr domdef)
 {
@@ -726,7 +768,8 @@ testDomainStartState(testDriverPtr privconn,
     int ret = -1;
 
     virDomainObjSetState(dom, VIR_DOMAIN_RUNNING, reason);
-    dom->def->id = g_atomic_int_add(&privconn->nextDomID, 1);
+    virDomainObjListSetID(privconn->domains, dom,
+                          g_atomic_int_add(&privconn->nextDomID, 1));
 
     if (virDomainObjSetDefTransient(privconn->xmlopt,
                                     dom, NULL) < 0) {
@@ -1254,6 +1297,121 @@ testParseAuthUsers(testDriverPtr privconn,
     return 0;
 }
 
+static int
+testParseLatencies(testDriverPtr privconn,
+                   xmlXPathContextPtr ctxt)
+{
+    int num;
+    size_t i;
+    g_autofree xmlNodePtr *nodes = NULL;
+
+    num = virXPathNodeSet("/node/latency", ctxt, &nodes);
+    if (num < 0)
+        return -1;
+
+    privconn->nlatencies = num;
+    privconn->latencies = g_new0(testLatency, num);
+
+    for (i = 0; i < num; i++) {
+        g_autofree char *ms = virXMLPropString(nodes[i], "ms");
+
+        if (!ms ||
+            virStrToLong_uip(ms, NULL, 10, &privconn->latencies[i].ms) < 0) {
+            virReportError(VIR_ERR_XML_ERROR, "%s",
+                           _("missing or invalid ms attribute in /node/latency"));
+            return -1;
+        }
+
+        privconn->latencies[i].api = virXMLPropString(nodes[i], "api");
+    }
+
+    return 0;
+}
+
+/* Template of domains created by <generate/>, it has a disk and an
+ * interface so that all kinds of statistics can be reported for it. */
+#define TEST_GENERATED_DOMAIN_XML \
+    "<domain type='test'>" \
+    "  <name>generated-%zu</name>" \
+    "  <memory>1048576</memory>" \
+    "  <vcpu>2</vcpu>" \
+    "  <os>" \
+    "    <type>hvm</type>" \
+    "  </os>" \
+    "  <devices>" \
+    "    <disk type='file' device='disk'>" \
+    "      <source file='/guest/generated-%zu.img'/>" \
+    "      <target dev='vda' bus='virtio'/>" \
+    "    </disk>" \
+    "    <interface type='network'>" \
+    "      <source network='default'/>" \
+    "    </interface>" \
+    "  </devices>" \
+    "</domain>"
+
+static int
+testParseGenerate(testDriverPtr privconn,
+                  xmlXPathContextPtr ctxt)
+{
+    unsigned int ndomains = 0;
+    unsigned int nrunning;
+    size_t i;
+    int rc;
+
+    if ((rc = virXPathUInt("string(/node/generate/@domains)", ctxt,
+                           &ndomains)) == -2) {
+        virReportError(VIR_ERR_XML_ERROR, "%s",
+                       _("invalid domains attribute in /node/generate"));
+        return -1;
+    }
+
+    if (rc < 0)
+        return 0;
+
+    if ((rc = virXPathUInt("string(/node/generate/@running)", ctxt,
+                           &nrunning)) == -2) {
+        virReportError(VIR_ERR_XML_ERROR, "%s",
+                       _("invalid running attribute in /node/generate"));
+        return -1;
+    }
+
+    if (rc < 0 || nrunning > ndomains)
+        nrunning = ndomains;
+
+    for (i = 0; i < ndomains; i++) {
+        g_autofree char *xml = g_strdup_printf(TEST_GENERATED_DOMAIN_XML, i, i);
+        virDomainDefPtr def;
+        virDomainObjPtr obj;
+
+        if (!(def = virDomainDefParseString(xml, privconn->xmlopt, NULL,
+                                            VIR_DOMAIN_DEF_PARSE_INACTIVE)))
+            return -1;
+
+        if (testDomainGenerateIfnames(def) < 0 ||
+            !(obj = virDomainObjListAdd(privconn->domains, def,
+                                        privconn->xmlopt, 0, NULL))) {
+            virDomainDefFree(def);
+            return -1;
+        }
+
+        obj->persistent = 1;
+
+        if (i < nrunning) {
+            if (testDomainStartState(privconn, obj,
+                                     VIR_DOMAIN_RUNNING_BOOTED) < 0) {
+                virDomainObjEndAPI(&obj);
+                return -1;
+            }
+        } else {
+            testDomainShutdownState(NULL, obj, 0);
+        }
+
+        virDomainObjEndAPI(&obj);
+    }
+
+    return 0;
+}
+
 static int
 testOpenParse(testDriverPtr privconn,
               const char *file,
@@ -1279,6 +1437,10 @@ testOpenParse(testDriverPtr privconn,
         return -1;
     if (testParseAuthUsers(privconn, ctxt) < 0)
         return -1;
+    if (testParseLatencies(privconn, ctxt) < 0)
+        return -1;
+    if (testParseGenerate(privconn, ctxt) < 0)
+        return -1;
 
     return 0;
 }
@@ -1572,20 +1734,17 @@ static int testNodeGetInfo(virConnectPtr conn,
                            virNodeInfoPtr info)
 {
     testDriverPtr privconn = conn->privateData;
-    virObjectLock(privconn);
+
+    /* nodeInfo doesn't change once the driver is opened */
     memcpy(info, &privconn->nodeInfo, sizeof(virNodeInfo));
-    virObjectUnlock(privconn);
     return 0;
 }
 
 static char *testConnectGetCapabilities(virConnectPtr conn)
 {
     testDriverPtr privconn = conn->privateData;
-    char *xml;
-    virObjectLock(privconn);
-    xml = virCapabilitiesFormatXML(privconn->caps);
-    virObjectUnlock(privconn);
-    return xml;
+
+    return virCapabilitiesFormatXML(privconn->caps);
 }
 
 static char *
@@ -1635,7 +1794,10 @@ testConnectSupportsFeature(virConnectPtr conn G_GNUC_UNUSED,
     case VIR_DRV_FEATURE_PROGRAM_KEEPALIVE:
     case VIR_DRV_FEATURE_REMOTE:
     case VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK:
+    case VIR_DRV_FEATURE_REMOTE_COMPACT_STATS:
     case VIR_DRV_FEATURE_REMOTE_EVENT_CALLBACK:
+    case VIR_DRV_FEATURE_REMOTE_SECRET_GET_VALUES:
+    case VIR_DRV_FEATURE_REMOTE_TRACE_CONTEXT:
     default:
         return 0;
     }
@@ -1645,13 +1807,10 @@ testConnectSupportsFeature(virConnectPtr conn G_GNUC_UNUSED,
 static int testConnectNumOfDomains(virConnectPtr conn)
 {
     testDriverPtr privconn = conn->privateData;
-    int count;
 
-    virObjectLock(privconn);
-    count = virDomainObjListNumOfDomains(privconn->domains, true, NULL, NULL);
-    virObjectUnlock(privconn);
+    testDriverSimulateLatency(privconn, "virConnectNumOfDomains");
 
-    return count;
+    return virDomainObjListNumOfDomains(privconn->domains, true, NULL, NULL);
 }
 
 static int testDomainIsActive(virDomainPtr dom)
@@ -1702,7 +1861,8 @@ testDomainCreateXML(virConnectPtr conn, const char *xml,
     if (flags & VIR_DOMAIN_START_VALIDATE)
         parse_flags |= VIR_DOMAIN_DEF_PARSE_VALIDATE_SCHEMA;
 
-    virObjectLock(privconn);
+    testDriverSimulateLatency(privconn, "virDomainCreateXML");
+
     if ((def = virDomainDefParseString(xml, privconn->xmlopt,
                                        NULL, parse_flags)) == NULL)
         goto cleanup;
@@ -1734,7 +1894,6 @@ testDomainCreateXML(virConnectPtr conn, const char *xml,
     virDomainObjEndAPI(&dom);
     virObjectEventStateQueue(privconn->eventState, event);
     virDomainDefFree(def);
-    virObjectUnlock(privconn);
     return ret;
 }
 
@@ -1757,6 +1916,8 @@ static virDomainPtr testDomainLookupByID(virConnectPtr conn,
     virDomainPtr ret = NULL;
     virDomainObjPtr dom;
 
+    testDriverSimulateLatency(privconn, "virDomainLookupByID");
+
     if (!(dom = virDomainObjListFindByID(privconn->domains, id))) {
         virReportError(VIR_ERR_NO_DOMAIN, NULL);
         return NULL;
@@ -1775,6 +1936,8 @@ static virDomainPtr testDomainLookupByUUID(virConnectPtr conn,
     virDomainPtr ret = NULL;
     virDomainObjPtr dom;
 
+    testDriverSimulateLatency(privconn, "virDomainLookupByUUID");
+
     if (!(dom = virDomainObjListFindByUUID(privconn->domains, uuid))) {
         virReportError(VIR_ERR_NO_DOMAIN, NULL);
         return NULL;
@@ -1793,6 +1956,8 @@ static virDomainPtr testDomainLookupByName(virConnectPtr conn,
     virDomainPtr ret = NULL;
     virDomainObjPtr dom;
 
+    testDriverSimulateLatency(privconn, "virDomainLookupByName");
+
     if (!(dom = virDomainObjListFindByName(privconn->domains, name))) {
         virReportError(VIR_ERR_NO_DOMAIN, NULL);
         goto cleanup;
@@ -1825,6 +1990,8 @@ static int testDomainDestroyFlags(virDomainPtr domain,
 
     virCheckFlags(VIR_DOMAIN_DESTROY_GRACEFUL, -1);
 
+    testDriverSimulateLatency(privconn, "virDomainDestroyFlags");
+
     if (!(privdom = testDomObjFromDomain(domain)))
         goto cleanup;
 
@@ -1858,6 +2025,8 @@ static int testDomainResume(virDomainPtr domain)
     virObjectEventPtr event = NULL;
     int ret = -1;
 
+    testDriverSimulateLatency(privconn, "virDomainResume");
+
     if (!(privdom = testDomObjFromDomain(domain)))
         return -1;
 
@@ -1888,6 +2057,8 @@ static int testDomainSuspend(virDomainPtr domain)
     int ret = -1;
     int state;
 
+    testDriverSimulateLatency(privconn, "virDomainSuspend");
+
     if (!(privdom = testDomObjFromDomain(domain)))
         return -1;
 
@@ -1954,6 +2125,7 @@ static int testDomainShutdownFlags(virDomainPtr domain,
 
     virCheckFlags(0, -1);
 
+    testDriverSimulateLatency(privconn, "virDomainShutdownFlags");
 
     if (!(privdom = testDomObjFromDomain(domain)))
         goto cleanup;
@@ -2004,6 +2176,8 @@ static int testDomainReboot(virDomainPtr domain,
                   VIR_DOMAIN_REBOOT_SIGNAL |
                   VIR_DOMAIN_REBOOT_PARAVIRT, -1);
 
+    testDriverSimulateLatency(privconn, "virDomainReboot");
+
     if (!(privdom = testDomObjFromDomain(domain)))
         goto cleanup;
 
@@ -2080,6 +2254,8 @@ static int testDomainGetInfo(virDomainPtr domain,
 {
     virDomainObjPtr privdom;
 
+    testDriverSimulateLatency(domain->conn->privateData, "virDomainGetInfo");
+
     if (!(privdom = testDomObjFromDomain(domain)))
         return -1;
 
@@ -2103,6 +2279,8 @@ testDomainGetState(virDomainPtr domain,
 
     virCheckFlags(0, -1);
 
+    testDriverSimulateLatency(domain->conn->privateData, "virDomainGetState");
+
     if (!(privdom = testDomObjFromDomain(domain)))
         return -1;
 
@@ -3186,6 +3364,8 @@ static char *testDomainGetXMLDesc(virDomainPtr domain, unsigned int flags)
 
     virCheckFlags(VIR_DOMAIN_XML_COMMON_FLAGS, NULL);
 
+    testDriverSimulateLatency(privconn, "virDomainGetXMLDesc");
+
     if (!(privdom = testDomObjFromDomain(domain)))
         return NULL;
 
@@ -4001,6 +4181,8 @@ static virDomainPtr testDomainDefineXMLFlags(virConnectPtr conn,
     if (flags & VIR_DOMAIN_DEFINE_VALIDATE)
         parse_flags |= VIR_DOMAIN_DEF_PARSE_VALIDATE_SCHEMA;
 
+    testDriverSimulateLatency(privconn, "virDomainDefineXMLFlags");
+
     if ((def = virDomainDefParseString(xml, privconn->xmlopt,
                                        NULL, parse_flags)) == NULL)
         goto cleanup;
@@ -4378,7 +4560,7 @@ static int testDomainCreateWithFlags(virDomainPtr domain, unsigned int flags)
 
     virCheckFlags(0, -1);
 
-    virObjectLock(privconn);
+    testDriverSimulateLatency(privconn, "virDomainCreateWithFlags");
 
     if (!(privdom = testDomObjFromDomain(domain)))
         goto cleanup;
@@ -4402,7 +4584,6 @@ static int testDomainCreateWithFlags(virDomainPtr domain, unsigned int flags)
  cleanup:
     virDomainObjEndAPI(&privdom);
     virObjectEventStateQueue(privconn->eventState, event);
-    virObjectUnlock(privconn);
     return ret;
 }
 
@@ -4433,6 +4614,7 @@ static int testDomainUndefineFlags(virDomainPtr domain,
     virCheckFlags(VIR_DOMAIN_UNDEFINE_MANAGED_SAVE |
                   VIR_DOMAIN_UNDEFINE_SNAPSHOTS_METADATA, -1);
 
+    testDriverSimulateLatency(privconn, "virDomainUndefineFlags");
 
     if (!(privdom = testDomObjFromDomain(domain)))
         goto cleanup;
@@ -4971,12 +5153,41 @@ testDomainSetSchedulerParameters(virDomainPtr domain,
     return testDomainSetSchedulerParametersFlags(domain, params, nparams, 0);
 }
 
+/* No significance to these numbers, just enough to mix it up */
+static void
+testDomainFillBlockStats(virDomainBlockStatsPtr stats)
+{
+    unsigned long long statbase = g_get_real_time();
+
+    stats->rd_req = statbase / 10;
+    stats->rd_bytes = statbase / 20;
+    stats->wr_req = statbase / 30;
+    stats->wr_bytes = statbase / 40;
+    stats->errs = statbase / (1000LL * 1000LL * 2);
+}
+
+
+static void
+testDomainFillInterfaceStats(virDomainInterfaceStatsPtr stats)
+{
+    unsigned long long statbase = g_get_real_time();
+
+    stats->rx_bytes = statbase / 10;
+    stats->rx_packets = statbase / 100;
+    stats->rx_errs = statbase / (1000LL * 1000LL * 1);
+    stats->rx_drop = statbase / (1000LL * 1000LL * 2);
+    stats->tx_bytes = statbase / 20;
+    stats->tx_packets = statbase / 110;
+    stats->tx_errs = statbase / (1000LL * 1000LL * 3);
+    stats->tx_drop = statbase / (1000LL * 1000LL * 4);
+}
+
+
 static int testDomainBlockStats(virDomainPtr domain,
                                 const char *path,
                                 virDomainBlockStatsPtr stats)
 {
     virDomainObjPtr privdom;
-    unsigned long long statbase;
     int ret = -1;
 
     if (!*path) {
@@ -4997,13 +5208,7 @@ static int testDomainBlockStats(virDomainPtr domain,
         goto error;
     }
 
-    /* No significance to these numbers, just enough to mix it up */
-    statbase = g_get_real_time();
-    stats->rd_req = statbase / 10;
-    stats->rd_bytes = statbase / 20;
-    stats->wr_req = statbase / 30;
-    stats->wr_bytes = statbase / 40;
-    stats->errs = statbase / (1000LL * 1000LL * 2);
+    testDomainFillBlockStats(stats);
 
     ret = 0;
  error:
@@ -5142,11 +5347,9 @@ testDomainInterfaceStats(virDomainPtr domain,
                          virDomainInterfaceStatsPtr stats)
 {
     virDomainObjPtr privdom;
-    unsigned long long statbase;
     virDomainNetDefPtr net = NULL;
     int ret = -1;
 
-
     if (!(privdom = testDomObjFromDomain(domain)))
         return -1;
 
@@ -5156,16 +5359,7 @@ testDomainInterfaceStats(virDomainPtr domain,
     if (!(net = virDomainNetFind(privdom->def, device)))
         goto error;
 
-    /* No significance to these numbers, just enough to mix it up */
-    statbase = g_get_real_time();
-    stats->rx_bytes = statbase / 10;
-    stats->rx_packets = statbase / 100;
-    stats->rx_errs = statbase / (1000LL * 1000LL * 1);
-    stats->rx_drop = statbase / (1000LL * 1000LL * 2);
-    stats->tx_bytes = statbase / 20;
-    stats->tx_packets = statbase / 110;
-    stats->tx_errs = statbase / (1000LL * 1000LL * 3);
-    stats->tx_drop = statbase / (1000LL * 1000LL * 4);
+    testDomainFillInterfaceStats(stats);
 
     ret = 0;
  error:
@@ -7737,10 +7931,221 @@ static int testConnectListAllDomains(virConnectPtr conn,
 
     virCheckFlags(VIR_CONNECT_LIST_DOMAINS_FILTERS_ALL, -1);
 
+    testDriverSimulateLatency(privconn, "virConnectListAllDomains");
+
     return virDomainObjListExport(privconn->domains, conn, domains,
                                   NULL, flags);
 }
 
+
+#define TEST_DOMAIN_STATS_SUPPORTED \
+    (VIR_DOMAIN_STATS_STATE | \
+     VIR_DOMAIN_STATS_CPU_TOTAL | \
+     VIR_DOMAIN_STATS_BALLOON | \
+     VIR_DOMAIN_STATS_VCPU | \
+     VIR_DOMAIN_STATS_INTERFACE | \
+     VIR_DOMAIN_STATS_BLOCK)
+
+static int
+testDomainGetStatsParams(virDomainObjPtr dom,
+                         unsigned int stats,
+                         virTypedParamListPtr params)
+{
+    int state;
+    int reason;
+    size_t i;
+
+    if (stats & VIR_DOMAIN_STATS_STATE) {
+        state = virDomainObjGetState(dom, &reason);
+
+        if (virTypedParamListAddInt(params, state, "state.state") < 0 ||
+            virTypedParamListAddInt(params, reason, "state.reason") < 0)
+            return -1;
+    }
+
+    if (!virDomainObjIsActive(dom))
+        return 0;
+
+    /* the test driver has no real domains, make up the numbers the
+     * same way testDomainGetInfo does */
+    if (stats & VIR_DOMAIN_STATS_CPU_TOTAL) {
+        if (virTypedParamListAddULLong(params, g_get_real_time() * 1000,
+                                       "cpu.time") < 0)
+            return -1;
+    }
+
+    if (stats & VIR_DOMAIN_STATS_BALLOON) {
+        if (virTypedParamListAddULLong(params, dom->def->mem.cur_balloon,
+                                       "balloon.current") < 0 ||
+            virTypedParamListAddULLong(params,
+                                       virDomainDefGetMemoryTotal(dom->def),
+                                       "balloon.maximum") < 0)
+            return -1;
+    }
+
+    if (stats & VIR_DOMAIN_STATS_VCPU) {
+        if (virTypedParamListAddUInt(params, virDomainDefGetVcpus(dom->def),
+                                     "vcpu.current") < 0 ||
+            virTypedParamListAddUInt(params, virDomainDefGetVcpusMax(dom->def),
+                                     "vcpu.maximum") < 0)
+            return -1;
+
+        for (i = 0; i < virDomainDefGetVcpus(dom->def); i++) {
+            if (virTypedParamListAddInt(params, VIR_VCPU_RUNNING,
+                                        "vcpu.%zu.state", i) < 0)
+                return -1;
+        }
+    }
+
+    if (stats & VIR_DOMAIN_STATS_INTERFACE) {
+        if (virTypedParamListAddUInt(params, dom->def->nnets, "net.count") < 0)
+            return -1;
+
+        for (i = 0; i < dom->def->nnets; i++) {
+            virDomainInterfaceStatsStruct net;
+
+            testDomainFillInterfaceStats(&net);
+
+            if (virTypedParamListAddString(params, dom->def->nets[i]->ifname,
+                                           "net.%zu.name", i) < 0 ||
+                virTypedParamListAddULLong(params, net.rx_bytes,
+                                           "net.%zu.rx.bytes", i) < 0 ||
+                virTypedParamListAddULLong(params, net.rx_packets,
+                                           "net.%zu.rx.pkts", i) < 0 ||
+                virTypedParamListAddULLong(params, net.rx_errs,
+                                           "net.%zu.rx.errs", i) < 0 ||
+                virTypedParamListAddULLong(params, net.rx_drop,
+                                           "net.%zu.rx.drop", i) < 0 ||
+                virTypedParamListAddULLong(params, net.tx_bytes,
+                                           "net.%zu.tx.bytes", i) < 0 ||
+                virTypedParamListAddULLong(params, net.tx_packets,
+                                           "net.%zu.tx.pkts", i) < 0 ||
+                virTypedParamListAddULLong(params, net.tx_errs,
+                                           "net.%zu.tx.errs", i) < 0 ||
+                virTypedParamListAddULLong(params, net.tx_drop,
+                                           "net.%zu.tx.drop", i) < 0)
+                return -1;
+        }
+    }
+
+    if (stats & VIR_DOMAIN_STATS_BLOCK) {
+        if (virTypedParamListAddUInt(params, dom->def->ndisks, "block.count") < 0)
+            return -1;
+
+        for (i = 0; i < dom->def->ndisks; i++) {
+            virDomainDiskDefPtr disk = dom->def->disks[i];
+            const char *path = virDomainDiskGetSource(disk);
+            virDomainBlockStatsStruct block;
+
+            testDomainFillBlockStats(&block);
+
+            if (virTypedParamListAddString(params, disk->dst,
+                                           "block.%zu.name", i) < 0)
+                return -1;
+
+            if (path &&
+                virTypedParamListAddString(params, path,
+                                           "block.%zu.path", i) < 0)
+                return -1;
+
+            if (virTypedParamListAddULLong(params, block.rd_req,
+                                           "block.%zu.rd.reqs", i) < 0 ||
+                virTypedParamListAddULLong(params, block.rd_bytes,
+                                           "block.%zu.rd.bytes", i) < 0 ||
+                virTypedParamListAddULLong(params, block.wr_req,
+                                           "block.%zu.wr.reqs", i) < 0 ||
+                virTypedParamListAddULLong(params, block.wr_bytes,
+                                           "block.%zu.wr.bytes", i) < 0)
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+static int
+testConnectGetAllDomainStats(virConnectPtr conn,
+                             virDomainPtr *doms,
+                             unsigned int ndoms,
+                             unsigned int stats,
+                             virDomainStatsRecordPtr **retStats,
+                             unsigned int flags)
+{
+    testDriverPtr privconn = conn->privateData;
+    virDomainObjPtr *vms = NULL;
+    size_t nvms = 0;
+    virDomainStatsRecordPtr *tmpstats = NULL;
+    int nstats = 0;
+    size_t i;
+    int ret = -1;
+    unsigned int lflags = flags & (VIR_CONNECT_LIST_DOMAINS_FILTERS_ACTIVE |
+                                   VIR_CONNECT_LIST_DOMAINS_FILTERS_PERSISTENT |
+                                   VIR_CONNECT_LIST_DOMAINS_FILTERS_STATE);
+
+    virCheckFlags(VIR_CONNECT_LIST_DOMAINS_FILTERS_ACTIVE |
+                  VIR_CONNECT_LIST_DOMAINS_FILTERS_PERSISTENT |
+                  VIR_CONNECT_LIST_DOMAINS_FILTERS_STATE |
+                  VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT |
+                  VIR_CONNECT_GET_ALL_DOMAINS_STATS_CACHED |
+                  VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING |
+                  VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS, -1);
+
+    testDriverSimulateLatency(privconn, "virConnectGetAllDomainStats");
+
+    if (stats == 0) {
+        stats = TEST_DOMAIN_STATS_SUPPORTED;
+    } else if (stats & ~TEST_DOMAIN_STATS_SUPPORTED) {
+        if (flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS) {
+            virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED,
+                           _("Stats types bits 0x%x are not supported by this daemon"),
+                           stats & ~TEST_DOMAIN_STATS_SUPPORTED);
+            return -1;
+        }
+        stats &= TEST_DOMAIN_STATS_SUPPORTED;
+    }
+
+    if (ndoms) {
+        if (virDomainObjListConvert(privconn->domains, conn, doms, ndoms,
+                                    &vms, &nvms, NULL, lflags, true) < 0)
+            return -1;
+    } else {
+        if (virDomainObjListCollect(privconn->domains, conn, &vms, &nvms,
+                                    NULL, lflags) < 0)
+            return -1;
+    }
+
+    tmpstats = g_new0(virDomainStatsRecordPtr, nvms + 1);
+
+    for (i = 0; i < nvms; i++) {
+        virDomainObjPtr vm = vms[i];
+        g_autoptr(virTypedParamList) params = g_new0(virTypedParamList, 1);
+        g_autofree virDomainStatsRecordPtr tmp = g_new0(virDomainStatsRecord, 1);
+        int rc;
+
+        virObjectLock(vm);
+        rc = testDomainGetStatsParams(vm, stats, params);
+        if (rc == 0)
+            tmp->dom = virGetDomain(conn, vm->def->name, vm->def->uuid,
+                                    vm->def->id);
+        virObjectUnlock(vm);
+
+        if (rc < 0 || !tmp->dom)
+            goto cleanup;
+
+        tmp->nparams = virTypedParamListStealParams(params, &tmp->params);
+        tmpstats[nstats++] = g_steal_pointer(&tmp);
+    }
+
+    *retStats = g_steal_pointer(&tmpstats);
+    ret = nstats;
+
+ cleanup:
+    virDomainStatsRecordListFree(tmpstats);
+    virObjectListFreeCount(vms, nvms);
+    return ret;
+}
+
 static int
 testNodeGetCPUMap(virConnectPtr conn G_GNUC_UNUSED,
                   unsigned char **cpumap,
@@ -9307,6 +9712,7 @@ static virHypervisorDriver testHypervisorDriver = {
     .connectListDomains = testConnectListDomains, /* 0.1.1 */
     .connectNumOfDomains = testConnectNumOfDomains, /* 0.1.1 */
     .connectListAllDomains = testConnectListAllDomains, /* 0.9.13 */
+    .connectGetAllDomainStats = testConnectGetAllDomainStats, /* 6.8.0 */
     .domainCreateXML = testDomainCreateXML, /* 0.1.4 */
     .domainCreateXMLWithFiles = testDomainCreateXMLWithFiles, /* 5.7.0 */
     .domainLookupByID = testDomainLookupByID, /* 0.1.1 */
@@ -27,6 +27,16 @@
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/stat.h>
+
+#if WITH_LIBURING
+# include <sys/uio.h>
+# include <liburing.h>
+#endif
+
+#if WITH_ZSTD
+# include <zstd.h>
+#endif
 
 #include "virthread.h"
 #include "virfile.h"
@@ -42,13 +52,382 @@
 # define O_DIRECT 0
 #endif
 
+#define IO_BUFLEN (1024 * 1024)
+#define IO_ALIGN (64 * 1024)
+
+/* Number of requests kept in flight on the file by the io_uring engine,
+ * 0 selects the synchronous loop */
+#define IO_QUEUE_DEPTH_DEFAULT 4
+#define IO_QUEUE_DEPTH_MAX 64
+
+#if WITH_LIBURING
+typedef struct _runIOUringState runIOUringState;
+struct _runIOUringState {
+    struct io_uring ring;
+    bool ringInit;
+    bool fixed; /* buffers are registered with the ring */
+    unsigned int depth;
+    void *base; /* depth * IO_BUFLEN aligned bytes */
+    struct iovec *iov; /* buffer of each slot */
+    off_t *offset; /* file offset of each slot */
+    ssize_t *result; /* result of the last completed request */
+    bool *busy; /* request is in flight */
+    bool *pending; /* result of the request wasn't checked yet */
+};
+
+
+static int
+runIOUringSubmit(runIOUringState *state,
+                 int fd,
+                 bool reading,
+                 unsigned int slot,
+                 size_t len,
+                 off_t offset)
+{
+    struct io_uring_sqe *sqe;
+    int rc;
+
+    /* at most @depth requests are in flight, so there's always room */
+    if (!(sqe = io_uring_get_sqe(&state->ring))) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    state->iov[slot].iov_len = len;
+
+    if (state->fixed && reading)
+        io_uring_prep_read_fixed(sqe, fd, state->iov[slot].iov_base,
+                                 len, offset, slot);
+    else if (state->fixed)
+        io_uring_prep_write_fixed(sqe, fd, state->iov[slot].iov_base,
+                                  len, offset, slot);
+    else if (reading)
+        io_uring_prep_readv(sqe, fd, &state->iov[slot], 1, offset);
+    else
+        io_uring_prep_writev(sqe, fd, &state->iov[slot], 1, offset);
+
+    io_uring_sqe_set_data(sqe, (void *)(uintptr_t) slot);
+
+    state->offset[slot] = offset;
+    state->busy[slot] = true;
+    state->pending[slot] = true;
+
+    if ((rc = io_uring_submit(&state->ring)) < 0) {
+        errno = -rc;
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Waits for the request of @slot to complete, recording the results of
+ * the other requests completing meanwhile */
+static int
+runIOUringWait(runIOUringState *state,
+               unsigned int slot)
+{
+    while (state->busy[slot]) {
+        struct io_uring_cqe *cqe;
+        unsigned int done;
+        int rc;
+
+        if ((rc = io_uring_wait_cqe(&state->ring, &cqe)) < 0) {
+            if (rc == -EINTR)
+                continue;
+            errno = -rc;
+            return -1;
+        }
+
+        done = (uintptr_t) io_uring_cqe_get_data(cqe);
+        state->result[done] = cqe->res;
+        state->busy[done] = false;
+        io_uring_cqe_seen(&state->ring, cqe);
+    }
+
+    return 0;
+}
+
+
+static void
+runIOUringStateClear(runIOUringState *state)
+{
+    size_t i;
+
+    /* don't free buffers the kernel might still access */
+    for (i = 0; state->busy && i < state->depth; i++)
+        ignore_value(runIOUringWait(state, i));
+
+    if (state->ringInit)
+        io_uring_queue_exit(&state->ring);
+    g_free(state->base);
+    g_free(state->iov);
+    g_free(state->offset);
+    g_free(state->result);
+    g_free(state->busy);
+    g_free(state->pending);
+}
+
+
+/* Reads @fd at the current position into the pipe, with up to @depth
+ * reads of consecutive chunks in flight. The chunks are written out in
+ * file order as they complete. */
+static int
+runIOUringRead(runIOUringState *state,
+               const char *path,
+               int fd,
+               bool direct,
+               off_t next)
+{
+    unsigned int slot;
+    unsigned int head = 0;
+    unsigned int inflight = 0;
+    bool eof = false;
+
+    for (slot = 0; slot < state->depth; slot++) {
+        if (runIOUringSubmit(state, fd, true, slot, IO_BUFLEN, next) < 0) {
+            virReportSystemError(errno, _("Unable to read %s"), path);
+            return -1;
+        }
+        next += IO_BUFLEN;
+        inflight++;
+    }
+
+    while (inflight > 0) {
+        char *buf = state->iov[head].iov_base;
+        ssize_t got;
+
+        if (runIOUringWait(state, head) < 0) {
+            virReportSystemError(errno, _("Unable to read %s"), path);
+            return -1;
+        }
+        inflight--;
+
+        if ((got = state->result[head]) < 0) {
+            virReportSystemError(-got, _("Unable to read %s"), path);
+            return -1;
+        }
+
+        if (!eof) {
+            /* Short reads only happen at the end of the file with
+             * O_DIRECT, otherwise complete the chunk by hand */
+            while (!direct && got > 0 && got < IO_BUFLEN) {
+                ssize_t more = pread(fd, buf + got, IO_BUFLEN - got,
+                                     state->offset[head] + got);
+
+                if (more < 0 && errno == EINTR)
+                    continue;
+                if (more < 0) {
+                    virReportSystemError(errno, _("Unable to read %s"), path);
+                    return -1;
+                }
+                if (more == 0)
+                    break;
+                got += more;
+            }
+
+            if (got > 0 && safewrite(STDOUT_FILENO, buf, got) < 0) {
+                virReportSystemError(errno, _("Unable to write %s"), "stdout");
+                return -1;
+            }
+
+            if (got < IO_BUFLEN) {
+                eof = true;
+            } else {
+                if (runIOUringSubmit(state, fd, true, head,
+                                     IO_BUFLEN, next) < 0) {
+                    virReportSystemError(errno, _("Unable to read %s"), path);
+                    return -1;
+                }
+                next += IO_BUFLEN;
+                inflight++;
+            }
+        }
+
+        head = (head + 1) % state->depth;
+    }
+
+    return 0;
+}
+
+
+static int
+runIOUringCheckWrite(runIOUringState *state,
+                     const char *path,
+                     int fd,
+                     unsigned int slot)
+{
+    char *buf = state->iov[slot].iov_base;
+    size_t len = state->iov[slot].iov_len;
+    ssize_t done;
+
+    if (!state->pending[slot])
+        return 0;
+    state->pending[slot] = false;
+
+    if (runIOUringWait(state, slot) < 0) {
+        virReportSystemError(errno, _("Unable to write %s"), path);
+        return -1;
+    }
+
+    if ((done = state->result[slot]) < 0) {
+        virReportSystemError(-done, _("Unable to write %s"), path);
+        return -1;
+    }
+
+    /* finish a short write by hand */
+    while ((size_t) done < len) {
+        ssize_t more = pwrite(fd, buf + done, len - done,
+                              state->offset[slot] + done);
+
+        if (more < 0 && errno == EINTR)
+            continue;
+        if (more <= 0) {
+            virReportSystemError(more < 0 ? errno : EIO,
+                                 _("Unable to write %s"), path);
+            return -1;
+        }
+        done += more;
+    }
+
+    return 0;
+}
+
+
+/* Writes the pipe to @fd at the current position, with up to @depth
+ * writes in flight */
 static int
-runIO(const char *path, int fd, int oflags)
+runIOUringWrite(runIOUringState *state,
+                const char *path,
+                int fd,
+                bool direct,
+                off_t next)
+{
+    unsigned int slot = 0;
+    unsigned long long total = 0;
+    bool padded = false;
+
+    while (!padded) {
+        char *buf = state->iov[slot].iov_base;
+        ssize_t got;
+        size_t len;
+
+        if (runIOUringCheckWrite(state, path, fd, slot) < 0)
+            return -1;
+
+        if ((got = saferead(STDIN_FILENO, buf, IO_BUFLEN)) < 0) {
+            virReportSystemError(errno, _("Unable to read %s"), "stdin");
+            return -1;
+        }
+        if (got == 0)
+            break;
+
+        total += got;
+        len = got;
+
+        /* handle last write size align in direct case */
+        if (got < IO_BUFLEN && direct) {
+            len = (got + IO_ALIGN - 1) & ~(IO_ALIGN - 1);
+            memset(buf + got, 0, len - got);
+            padded = true;
+        }
+
+        if (runIOUringSubmit(state, fd, false, slot, len, next) < 0) {
+            virReportSystemError(errno, _("Unable to write %s"), path);
+            return -1;
+        }
+        next += len;
+
+        slot = (slot + 1) % state->depth;
+    }
+
+    for (slot = 0; slot < state->depth; slot++) {
+        if (runIOUringCheckWrite(state, path, fd, slot) < 0)
+            return -1;
+    }
+
+    if (padded && ftruncate(fd, total) < 0) {
+        virReportSystemError(errno, _("Unable to truncate %s"), path);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * runIOUring:
+ *
+ * Copies data between @fd and the pipe on the other end with io_uring,
+ * keeping several requests in flight on @fd. The pipe is served
+ * synchronously so that the stream stays in order.
+ *
+ * Returns 0 on success, -1 on error, 1 if io_uring can't be used for
+ * @fd and nothing was transferred.
+ */
+static int
+runIOUring(const char *path,
+           int fd,
+           bool reading,
+           bool direct,
+           unsigned int depth)
+{
+    runIOUringState state = { .depth = depth };
+    struct stat sb;
+    off_t start;
+    size_t i;
+    int ret = -1;
+
+    /* concurrent requests need explicit offsets */
+    if (fstat(fd, &sb) < 0 ||
+        !(S_ISREG(sb.st_mode) || S_ISBLK(sb.st_mode)) ||
+        (fcntl(fd, F_GETFL) & O_APPEND) ||
+        (start = lseek(fd, 0, SEEK_CUR)) < 0)
+        return 1;
+
+    if (io_uring_queue_init(depth, &state.ring, 0) < 0)
+        return 1;
+    state.ringInit = true;
+
+    if (posix_memalign(&state.base, IO_ALIGN, (size_t) depth * IO_BUFLEN)) {
+        virReportOOMError();
+        goto cleanup;
+    }
+
+    state.iov = g_new0(struct iovec, depth);
+    state.offset = g_new0(off_t, depth);
+    state.result = g_new0(ssize_t, depth);
+    state.busy = g_new0(bool, depth);
+    state.pending = g_new0(bool, depth);
+
+    for (i = 0; i < depth; i++) {
+        state.iov[i].iov_base = (char *) state.base + i * IO_BUFLEN;
+        state.iov[i].iov_len = IO_BUFLEN;
+    }
+
+    /* Registering needs locked memory, plain requests work without */
+    state.fixed = io_uring_register_buffers(&state.ring, state.iov,
+                                            depth) == 0;
+
+    if (reading)
+        ret = runIOUringRead(&state, path, fd, direct, start);
+    else
+        ret = runIOUringWrite(&state, path, fd, direct, start);
+
+ cleanup:
+    runIOUringStateClear(&state);
+    return ret;
+}
+#endif /* WITH_LIBURING */
+
+
+static int
+runIO(const char *path, int fd, int oflags, unsigned int depth)
 {
     g_autofree void *base = NULL; /* Location to be freed */
     char *buf = NULL; /* Aligned location within base */
-    size_t buflen = 1024*1024;
-    intptr_t alignMask = 64*1024 - 1;
+    size_t buflen = IO_BUFLEN;
+    intptr_t alignMask = IO_ALIGN - 1;
     int ret = -1;
     int fdin, fdout;
     const char *fdinname, *fdoutname;
@@ -56,19 +435,6 @@ runIO(const char *path, int fd, int oflags)
     bool direct = O_DIRECT && ((oflags & O_DIRECT) != 0);
     off_t end = 0;
 
-#if HAVE_POSIX_MEMALIGN
-    if (posix_memalign(&base, alignMask + 1, buflen)) {
-        virReportOOMError();
-        goto cleanup;
-    }
-    buf = base;
-#else
-    if (VIR_ALLOC_N(buf, buflen + alignMask) < 0)
-        goto cleanup;
-    base = buf;
-    buf = (char *) (((intptr_t) base + alignMask) & ~alignMask);
-#endif
-
     switch (oflags & O_ACCMODE) {
     case O_RDONLY:
         fdin = fd;
@@ -105,6 +471,32 @@ runIO(const char *path, int fd, int oflags)
         goto cleanup;
     }
 
+#if WITH_LIBURING
+    if (depth > 0) {
+        int rc = runIOUring(path, fd, fdin == fd, direct, depth);
+
+        if (rc < 0)
+            goto cleanup;
+        if (rc == 0)
+            goto sync;
+    }
+#else
+    (void) depth;
+#endif
+
+#if HAVE_POSIX_MEMALIGN
+    if (posix_memalign(&base, alignMask + 1, buflen)) {
+        virReportOOMError();
+        goto cleanup;
+    }
+    buf = base;
+#else
+    if (VIR_ALLOC_N(buf, buflen + alignMask) < 0)
+        goto cleanup;
+    base = buf;
+    buf = (char *) (((intptr_t) base + alignMask) & ~alignMask);
+#endif
+
     while (1) {
         ssize_t got;
 
@@ -156,6 +548,9 @@ runIO(const char *path, int fd, int oflags)
         }
     }
 
+#if WITH_LIBURING
+ sync:
+#endif
     /* Ensure all data is written */
     if (virFileDataSync(fdout) < 0) {
         if (errno != EINVAL && errno != EROFS) {
@@ -176,6 +571,337 @@ runIO(const char *path, int fd, int oflags)
     return ret;
 }
 
+#if WITH_ZSTD
+/*
+ * Chunked zstd stream used for saved domain images. The input is split
+ * into chunks which are compressed independently, so that both
+ * compression and decompression can run on several threads. Each chunk
+ * is stored as a header of two little endian 32 bit integers, the raw
+ * and compressed length, followed by a zstd frame. A header with zero
+ * raw length ends the stream.
+ */
+# define IO_ZSTD_CHUNK (4 * 1024 * 1024)
+# define IO_ZSTD_LEVEL 3
+# define IO_ZSTD_THREADS_MAX 64
+
+typedef enum {
+    IO_ZSTD_SLOT_FREE = 0,
+    IO_ZSTD_SLOT_FILLED, /* input read, waiting for a worker */
+    IO_ZSTD_SLOT_BUSY, /* worker is processing the chunk */
+    IO_ZSTD_SLOT_DONE, /* output ready to be written */
+} runZstdSlotState;
+
+typedef struct _runZstdSlot runZstdSlot;
+struct _runZstdSlot {
+    runZstdSlotState state;
+    char *in;
+    size_t inlen;
+    char *out;
+    size_t outlen;
+    size_t rawlen; /* expected size of decompressed chunk */
+};
+
+typedef struct _runZstdState runZstdState;
+struct _runZstdState {
+    virMutex lock;
+    virCond cond;
+    bool compress;
+    bool eof; /* reader has queued the last chunk */
+    int err; /* errno of the first failure */
+    const char *errmsg;
+    size_t nslots;
+    runZstdSlot *slots;
+    unsigned long long nread; /* chunks queued by reader */
+    unsigned long long nwork; /* chunks picked up by workers */
+    unsigned long long nwritten; /* chunks written out */
+};
+
+
+static void
+runZstdFail(runZstdState *zs,
+            int err,
+            const char *errmsg)
+{
+    if (!zs->errmsg) {
+        zs->err = err;
+        zs->errmsg = errmsg;
+    }
+    virCondBroadcast(&zs->cond);
+}
+
+
+static void
+runZstdWorker(void *opaque)
+{
+    runZstdState *zs = opaque;
+    ZSTD_CCtx *cctx = NULL;
+    ZSTD_DCtx *dctx = NULL;
+
+    if (zs->compress)
+        cctx = ZSTD_createCCtx();
+    else
+        dctx = ZSTD_createDCtx();
+
+    virMutexLock(&zs->lock);
+    if (!cctx && !dctx)
+        runZstdFail(zs, ENOMEM, _("Unable to create zstd context"));
+
+    while (!zs->errmsg) {
+        runZstdSlot *slot;
+        size_t rc;
+
+        if (zs->nwork == zs->nread) {
+            if (zs->eof)
+                break;
+            virCondWait(&zs->cond, &zs->lock);
+            continue;
+        }
+
+        slot = &zs->slots[zs->nwork++ % zs->nslots];
+        slot->state = IO_ZSTD_SLOT_BUSY;
+        virMutexUnlock(&zs->lock);
+
+        if (zs->compress)
+            rc = ZSTD_compressCCtx(cctx, slot->out, ZSTD_compressBound(IO_ZSTD_CHUNK),
+                                   slot->in, slot->inlen, IO_ZSTD_LEVEL);
+        else
+            rc = ZSTD_decompressDCtx(dctx, slot->out, IO_ZSTD_CHUNK,
+                                     slot->in, slot->inlen);
+
+        virMutexLock(&zs->lock);
+        if (ZSTD_isError(rc) || (!zs->compress && rc != slot->rawlen)) {
+            runZstdFail(zs, EINVAL,
+                        zs->compress ? _("Unable to compress chunk")
+                                     : _("Corrupted compressed chunk"));
+            break;
+        }
+
+        slot->outlen = rc;
+        slot->state = IO_ZSTD_SLOT_DONE;
+        virCondBroadcast(&zs->cond);
+    }
+    virMutexUnlock(&zs->lock);
+
+    ZSTD_freeCCtx(cctx);
+    ZSTD_freeDCtx(dctx);
+}
+
+
+/* Writes finished chunks to stdout in the order they were read */
+static void
+runZstdWriter(void *opaque)
+{
+    runZstdState *zs = opaque;
+
+    virMutexLock(&zs->lock);
+    while (!zs->errmsg) {
+        runZstdSlot *slot = &zs->slots[zs->nwritten % zs->nslots];
+        uint32_t hdr[2];
+        bool failed;
+
+        if (zs->nwritten == zs->nread && zs->eof)
+            break;
+
+        if (zs->nwritten == zs->nread || slot->state != IO_ZSTD_SLOT_DONE) {
+            virCondWait(&zs->cond, &zs->lock);
+            continue;
+        }
+        virMutexUnlock(&zs->lock);
+
+        if (zs->compress) {
+            hdr[0] = GUINT32_TO_LE(slot->inlen);
+            hdr[1] = GUINT32_TO_LE(slot->outlen);
+            failed = safewrite(STDOUT_FILENO, hdr, sizeof(hdr)) < 0 ||
+                     safewrite(STDOUT_FILENO, slot->out, slot->outlen) < 0;
+        } else {
+            failed = safewrite(STDOUT_FILENO, slot->out, slot->outlen) < 0;
+        }
+
+        virMutexLock(&zs->lock);
+        if (failed) {
+            runZstdFail(zs, errno, _("Unable to write stdout"));
+            break;
+        }
+
+        slot->state = IO_ZSTD_SLOT_FREE;
+        zs->nwritten++;
+        virCondBroadcast(&zs->cond);
+    }
+    virMutexUnlock(&zs->lock);
+}
+
+
+/* Reads the next chunk from stdin into @slot. Returns 1 on success,
+ * 0 at the end of the stream and -1 on error with errno set. */
+static int
+runZstdRead(runZstdState *zs,
+            runZstdSlot *slot)
+{
+    uint32_t hdr[2];
+    ssize_t got;
+
+    if (zs->compress) {
+        if ((got = saferead(STDIN_FILENO, slot->in, IO_ZSTD_CHUNK)) < 0)
+            return -1;
+        slot->inlen = got;
+        return got > 0;
+    }
+
+    if ((got = saferead(STDIN_FILENO, hdr, sizeof(hdr))) < 0)
+        return -1;
+    if (got != sizeof(hdr)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    slot->rawlen = GUINT32_FROM_LE(hdr[0]);
+    slot->inlen = GUINT32_FROM_LE(hdr[1]);
+    if (slot->rawlen == 0)
+        return 0;
+
+    if (slot->rawlen > IO_ZSTD_CHUNK ||
+        slot->inlen > ZSTD_compressBound(IO_ZSTD_CHUNK)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if ((got = saferead(STDIN_FILENO, slot->in, slot->inlen)) < 0)
+        return -1;
+    if ((size_t) got != slot->inlen) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return 1;
+}
+
+
+/**
+ * runZstd:
+ * @compress: direction of the conversion
+ * @nthreads: number of worker threads, 0 to use one per CPU
+ *
+ * Converts stdin to stdout between the raw and the chunked zstd stream.
+ * The main thread reads, workers compress or decompress the chunks and
+ * a writer thread outputs them in the original order.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int
+runZstd(bool compress,
+        unsigned int nthreads)
+{
+    runZstdState zs = { .compress = compress };
+    g_autofree virThread *workers = NULL;
+    virThread writer;
+    bool writerStarted = false;
+    size_t nworkers = 0;
+    size_t i;
+    int ret = -1;
+
+    if (nthreads == 0)
+        nthreads = MIN(g_get_num_processors(), IO_ZSTD_THREADS_MAX);
+
+    if (virMutexInit(&zs.lock) < 0) {
+        virReportSystemError(errno, "%s", _("Unable to init mutex"));
+        return -1;
+    }
+    if (virCondInit(&zs.cond) < 0) {
+        virReportSystemError(errno, "%s", _("Unable to init cond"));
+        virMutexDestroy(&zs.lock);
+        return -1;
+    }
+
+    /* keep the workers busy while the writer catches up */
+    zs.nslots = nthreads * 2;
+    zs.slots = g_new0(runZstdSlot, zs.nslots);
+    for (i = 0; i < zs.nslots; i++) {
+        zs.slots[i].in = g_new0(char, ZSTD_compressBound(IO_ZSTD_CHUNK));
+        zs.slots[i].out = g_new0(char, ZSTD_compressBound(IO_ZSTD_CHUNK));
+    }
+
+    workers = g_new0(virThread, nthreads);
+    for (nworkers = 0; nworkers < nthreads; nworkers++) {
+        if (virThreadCreate(&workers[nworkers], true, runZstdWorker, &zs) < 0) {
+            virReportSystemError(errno, "%s", _("Unable to create worker thread"));
+            goto cleanup;
+        }
+    }
+    if (virThreadCreate(&writer, true, runZstdWriter, &zs) < 0) {
+        virReportSystemError(errno, "%s", _("Unable to create writer thread"));
+        goto cleanup;
+    }
+    writerStarted = true;
+
+    virMutexLock(&zs.lock);
+    while (!zs.errmsg) {
+        runZstdSlot *slot = &zs.slots[zs.nread % zs.nslots];
+        int rc;
+
+        if (slot->state != IO_ZSTD_SLOT_FREE) {
+            virCondWait(&zs.cond, &zs.lock);
+            continue;
+        }
+        virMutexUnlock(&zs.lock);
+
+        rc = runZstdRead(&zs, slot);
+
+        virMutexLock(&zs.lock);
+        if (rc < 0) {
+            runZstdFail(&zs, errno,
+                        compress ? _("Unable to read stdin")
+                                 : _("Unable to read compressed chunk"));
+            break;
+        }
+        if (rc == 0)
+            break;
+
+        slot->state = IO_ZSTD_SLOT_FILLED;
+        zs.nread++;
+        virCondBroadcast(&zs.cond);
+    }
+    zs.eof = true;
+    virCondBroadcast(&zs.cond);
+    virMutexUnlock(&zs.lock);
+
+ cleanup:
+    if (!writerStarted) {
+        virMutexLock(&zs.lock);
+        runZstdFail(&zs, errno, _("Unable to start threads"));
+        virMutexUnlock(&zs.lock);
+    }
+
+    for (i = 0; i < nworkers; i++)
+        virThreadJoin(&workers[i]);
+    if (writerStarted)
+        virThreadJoin(&writer);
+
+    if (zs.errmsg) {
+        if (writerStarted)
+            virReportSystemError(zs.err, "%s", zs.errmsg);
+    } else if (compress) {
+        uint32_t trailer[2] = { 0, 0 };
+
+        if (safewrite(STDOUT_FILENO, trailer, sizeof(trailer)) < 0)
+            virReportSystemError(errno, "%s", _("Unable to write stdout"));
+        else
+            ret = 0;
+    } else {
+        ret = 0;
+    }
+
+    for (i = 0; i < zs.nslots; i++) {
+        g_free(zs.slots[i].in);
+        g_free(zs.slots[i].out);
+    }
+    g_free(zs.slots);
+    virCondDestroy(&zs.cond);
+    virMutexDestroy(&zs.lock);
+    return ret;
+}
+#endif /* WITH_ZSTD */
+
+
 static const char *program_name;
 
 G_GNUC_NORETURN static void
@@ -184,7 +910,9 @@ usage(int status)
     if (status) {
         fprintf(stderr, _("%s: try --help for more details"), program_name);
     } else {
-        printf(_("Usage: %s FILENAME FD"), program_name);
+        printf(_("Usage: %s FILENAME FD [QUEUE-DEPTH]\n"
+                 "       %s --zstd-compress|--zstd-decompress [THREADS]"),
+               program_name, program_name);
     }
     exit(status);
 }
@@ -195,6 +923,7 @@ main(int argc, char **argv)
     const char *path;
     int oflags = -1;
     int fd = -1;
+    unsigned int depth = IO_QUEUE_DEPTH_DEFAULT;
 
     program_name = argv[0];
 
@@ -208,7 +937,34 @@ main(int argc, char **argv)
 
     if (argc > 1 && STREQ(argv[1], "--help"))
         usage(EXIT_SUCCESS);
-    if (argc == 3) { /* FILENAME FD */
+    if (argc > 1 &&
+        (STREQ(argv[1], "--zstd-compress") ||
+         STREQ(argv[1], "--zstd-decompress"))) {
+#if WITH_ZSTD
+        unsigned int nthreads = 0;
+
+        if (argc > 3)
+            usage(EXIT_FAILURE);
+        if (argc == 3 &&
+            (virStrToLong_ui(argv[2], NULL, 10, &nthreads) < 0 ||
+             nthreads > IO_ZSTD_THREADS_MAX)) {
+            fprintf(stderr, _("%s: malformed thread count %s"),
+                    program_name, argv[2]);
+            exit(EXIT_FAILURE);
+        }
+
+        path = "stdin";
+        if (runZstd(STREQ(argv[1], "--zstd-compress"), nthreads) < 0)
+            goto error;
+
+        return 0;
+#else
+        fprintf(stderr, _("%s: zstd support is not compiled in"),
+                program_name);
+        exit(EXIT_FAILURE);
+#endif
+    }
+    if (argc == 3 || argc == 4) { /* FILENAME FD [QUEUE-DEPTH] */
         if (virStrToLong_i(argv[2], NULL, 10, &fd) < 0) {
             fprintf(stderr, _("%s: malformed fd %s"),
                     program_name, argv[3]);
@@ -228,11 +984,18 @@ main(int argc, char **argv)
                     program_name, fd);
             exit(EXIT_FAILURE);
         }
+        if (argc == 4 &&
+            (virStrToLong_ui(argv[3], NULL, 10, &depth) < 0 ||
+             depth > IO_QUEUE_DEPTH_MAX)) {
+            fprintf(stderr, _("%s: malformed queue depth %s"),
+                    program_name, argv[3]);
+            exit(EXIT_FAILURE);
+        }
     } else { /* unknown argc pattern */
         usage(EXIT_FAILURE);
     }
 
-    if (fd < 0 || runIO(path, fd, oflags) < 0)
+    if (fd < 0 || runIO(path, fd, oflags, depth) < 0)
         goto error;
 
     return 0;
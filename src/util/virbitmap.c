@@ -48,6 +48,134 @@ struct _virBitmap {
 #define VIR_BITMAP_BIT_OFFSET(b)  ((b) % VIR_BITMAP_BITS_PER_UNIT)
 #define VIR_BITMAP_BIT(b)         (1UL << VIR_BITMAP_BIT_OFFSET(b))
 
+/* Number of words the loops below look at in one step. The inner loop
+ * over a block has no early exit so that the compiler can vectorize it. */
+#define VIR_BITMAP_BLOCK 4
+
+/* On x86_64 the word loops are additionally built for AVX2 and POPCNT,
+ * the dynamic loader then binds the variant matching the host CPU.
+ * Other architectures rely on the vectorizer for their baseline ISA,
+ * e.g. NEON on aarch64. */
+#if defined(__x86_64__) && defined(__GLIBC__) && defined(__has_attribute)
+# if __has_attribute(target_clones)
+#  define VIR_BITMAP_CLONES_SIMD \
+    __attribute__((target_clones("avx2", "default")))
+#  define VIR_BITMAP_CLONES_POPCNT \
+    __attribute__((target_clones("popcnt", "default")))
+# endif
+#endif
+
+#ifndef VIR_BITMAP_CLONES_SIMD
+# define VIR_BITMAP_CLONES_SIMD
+# define VIR_BITMAP_CLONES_POPCNT
+#endif
+
+
+static size_t VIR_BITMAP_CLONES_POPCNT
+virBitmapWordsCount(const unsigned long *map,
+                    size_t len)
+{
+    size_t ret = 0;
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        ret += __builtin_popcountl(map[i]);
+
+    return ret;
+}
+
+
+/* Returns the index of the first non-zero word at or after @from,
+ * or @len if there is none. */
+static size_t VIR_BITMAP_CLONES_SIMD
+virBitmapWordsNextNonZero(const unsigned long *map,
+                          size_t from,
+                          size_t len)
+{
+    size_t i = from;
+    size_t j;
+
+    for (; i + VIR_BITMAP_BLOCK <= len; i += VIR_BITMAP_BLOCK) {
+        unsigned long acc = 0;
+
+        for (j = 0; j < VIR_BITMAP_BLOCK; j++)
+            acc |= map[i + j];
+
+        if (acc != 0)
+            break;
+    }
+
+    for (; i < len; i++) {
+        if (map[i] != 0)
+            break;
+    }
+
+    return i;
+}
+
+
+static bool VIR_BITMAP_CLONES_SIMD
+virBitmapWordsOverlap(const unsigned long *a,
+                      const unsigned long *b,
+                      size_t len)
+{
+    size_t i = 0;
+    size_t j;
+
+    for (; i + VIR_BITMAP_BLOCK <= len; i += VIR_BITMAP_BLOCK) {
+        unsigned long acc = 0;
+
+        for (j = 0; j < VIR_BITMAP_BLOCK; j++)
+            acc |= a[i + j] & b[i + j];
+
+        if (acc != 0)
+            return true;
+    }
+
+    for (; i < len; i++) {
+        if (a[i] & b[i])
+            return true;
+    }
+
+    return false;
+}
+
+
+static void VIR_BITMAP_CLONES_SIMD
+virBitmapWordsAnd(unsigned long *dst,
+                  const unsigned long *src,
+                  size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        dst[i] &= src[i];
+}
+
+
+static void VIR_BITMAP_CLONES_SIMD
+virBitmapWordsAndNot(unsigned long *dst,
+                     const unsigned long *src,
+                     size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        dst[i] &= ~src[i];
+}
+
+
+static void VIR_BITMAP_CLONES_SIMD
+virBitmapWordsOr(unsigned long *dst,
+                 const unsigned long *src,
+                 size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        dst[i] |= src[i];
+}
+
 
 /**
  * virBitmapNewQuiet:
@@ -1004,11 +1132,13 @@ virBitmapNextSetBit(virBitmapPtr bitmap,
 
     bits = bitmap->map[nl] & ~((1UL << nb) - 1);
 
-    while (bits == 0 && ++nl < bitmap->map_len)
-        bits = bitmap->map[nl];
+    if (bits == 0) {
+        nl = virBitmapWordsNextNonZero(bitmap->map, nl + 1, bitmap->map_len);
+        if (nl == bitmap->map_len)
+            return -1;
 
-    if (bits == 0)
-        return -1;
+        bits = bitmap->map[nl];
+    }
 
     return __builtin_ffsl(bits) - 1 + nl * VIR_BITMAP_BITS_PER_UNIT;
 }
@@ -1122,13 +1252,7 @@ virBitmapNextClearBit(virBitmapPtr bitmap,
 size_t
 virBitmapCountBits(virBitmapPtr bitmap)
 {
-    size_t i;
-    size_t ret = 0;
-
-    for (i = 0; i < bitmap->map_len; i++)
-        ret += __builtin_popcountl(bitmap->map[i]);
-
-    return ret;
+    return virBitmapWordsCount(bitmap->map, bitmap->map_len);
 }
 
 
@@ -1203,20 +1327,13 @@ bool
 virBitmapOverlaps(virBitmapPtr b1,
                   virBitmapPtr b2)
 {
-    size_t i;
-
     if (b1->nbits > b2->nbits) {
         virBitmapPtr tmp = b1;
         b1 = b2;
         b2 = tmp;
     }
 
-    for (i = 0; i < b1->map_len; i++) {
-        if (b1->map[i] & b2->map[i])
-            return true;
-    }
-
-    return false;
+    return virBitmapWordsOverlap(b1->map, b2->map, b1->map_len);
 }
 
 
@@ -1231,14 +1348,12 @@ void
 virBitmapIntersect(virBitmapPtr a,
                    virBitmapPtr b)
 {
-    size_t i;
     size_t max = a->map_len;
 
     if (max > b->map_len)
         max = b->map_len;
 
-    for (i = 0; i < max; i++)
-        a->map[i] &= b->map[i];
+    virBitmapWordsAnd(a->map, b->map, max);
 }
 
 
@@ -1255,15 +1370,12 @@ int
 virBitmapUnion(virBitmapPtr a,
                const virBitmap *b)
 {
-    size_t i;
-
     if (a->nbits < b->nbits &&
         virBitmapExpand(a, b->nbits - 1) < 0) {
         return -1;
     }
 
-    for (i = 0; i < b->map_len; i++)
-        a->map[i] |= b->map[i];
+    virBitmapWordsOr(a->map, b->map, b->map_len);
 
     return 0;
 }
@@ -1280,14 +1392,12 @@ void
 virBitmapSubtract(virBitmapPtr a,
                   virBitmapPtr b)
 {
-    size_t i;
     size_t max = a->map_len;
 
     if (max > b->map_len)
         max = b->map_len;
 
-    for (i = 0; i < max; i++)
-        a->map[i] &= ~b->map[i];
+    virBitmapWordsAndNot(a->map, b->map, max);
 }
 
 
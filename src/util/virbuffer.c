@@ -329,6 +329,60 @@ virBufferVasprintf(virBufferPtr buf, const char *format, va_list argptr)
 }
 
 
+/* Characters which are replaced by an entity or dropped when escaping
+ * strings for XML */
+static const char virBufferXMLSpecialChars[] = {
+    0x01,   0x02,   0x03,   0x04,   0x05,   0x06,   0x07,   0x08,
+    /*\t*/  /*\n*/  0x0B,   0x0C,   /*\r*/  0x0E,   0x0F,   0x10,
+    0x11,   0x12,   0x13,   0x14,   0x15,   0x16,   0x17,   0x18,
+    0x19,   '"',    '&',    '\'',   '<',    '>',
+    '\0'
+};
+
+
+/*
+ * Append @str to @out escaped for use in XML. Runs of characters which
+ * need no escaping are located with strcspn, which the C library
+ * implements with vector instructions, and copied in one go.
+ */
+static void
+virBufferEscapeXMLAppend(GString *out,
+                         const char *str)
+{
+    while (*str) {
+        size_t len = strcspn(str, virBufferXMLSpecialChars);
+
+        g_string_append_len(out, str, len);
+        str += len;
+
+        switch (*str) {
+        case '\0':
+            return;
+        case '<':
+            g_string_append_len(out, "&lt;", 4);
+            break;
+        case '>':
+            g_string_append_len(out, "&gt;", 4);
+            break;
+        case '&':
+            g_string_append_len(out, "&amp;", 5);
+            break;
+        case '"':
+            g_string_append_len(out, "&quot;", 6);
+            break;
+        case '\'':
+            g_string_append_len(out, "&apos;", 6);
+            break;
+        default:
+            /* silently ignore control characters */
+            break;
+        }
+
+        str++;
+    }
+}
+
+
 /**
  * virBufferEscapeString:
  * @buf: the buffer to append to
@@ -343,78 +397,209 @@ virBufferVasprintf(virBufferPtr buf, const char *format, va_list argptr)
 void
 virBufferEscapeString(virBufferPtr buf, const char *format, const char *str)
 {
-    int len;
-    g_autofree char *escaped = NULL;
-    char *out;
-    const char *cur;
-    const char forbidden_characters[] = {
-        0x01,   0x02,   0x03,   0x04,   0x05,   0x06,   0x07,   0x08,
-        /*\t*/  /*\n*/  0x0B,   0x0C,   /*\r*/  0x0E,   0x0F,   0x10,
-        0x11,   0x12,   0x13,   0x14,   0x15,   0x16,   0x17,   0x18,
-        0x19,   '"',    '&',    '\'',   '<',    '>',
-        '\0'
-    };
+    const char *conv;
+    GString *escaped;
 
     if ((format == NULL) || (buf == NULL) || (str == NULL))
         return;
 
-    len = strlen(str);
-    if (strcspn(str, forbidden_characters) == len) {
-        virBufferAsprintf(buf, format, str);
+    /* The format is almost always some text around a single %s which
+     * can be copied verbatim instead of being interpreted by printf */
+    if ((conv = strchr(format, '%')) && conv[1] == 's' &&
+        !strchr(conv + 2, '%')) {
+        virBufferInitialize(buf);
+        virBufferApplyIndent(buf);
+
+        g_string_append_len(buf->str, format, conv - format);
+        virBufferEscapeXMLAppend(buf->str, str);
+        g_string_append(buf->str, conv + 2);
         return;
     }
 
-    escaped = g_malloc0_n(len + 1, 6);
+    escaped = g_string_sized_new(strlen(str));
+    virBufferEscapeXMLAppend(escaped, str);
+    virBufferAsprintf(buf, format, escaped->str);
+    g_string_free(escaped, true);
+}
 
-    cur = str;
-    out = escaped;
-    while (*cur != 0) {
-        if (*cur == '<') {
-            *out++ = '&';
-            *out++ = 'l';
-            *out++ = 't';
-            *out++ = ';';
-        } else if (*cur == '>') {
-            *out++ = '&';
-            *out++ = 'g';
-            *out++ = 't';
-            *out++ = ';';
-        } else if (*cur == '&') {
-            *out++ = '&';
-            *out++ = 'a';
-            *out++ = 'm';
-            *out++ = 'p';
-            *out++ = ';';
-        } else if (*cur == '"') {
-            *out++ = '&';
-            *out++ = 'q';
-            *out++ = 'u';
-            *out++ = 'o';
-            *out++ = 't';
-            *out++ = ';';
-        } else if (*cur == '\'') {
-            *out++ = '&';
-            *out++ = 'a';
-            *out++ = 'p';
-            *out++ = 'o';
-            *out++ = 's';
-            *out++ = ';';
-        } else if (!strchr(forbidden_characters, *cur)) {
-            /*
-             * default case, just copy !
-             * Note that character over 0x80 are likely to give problem
-             * with UTF-8 XML, but since our string don't have an encoding
-             * it's hard to handle properly we have to assume it's UTF-8 too
-             */
-            *out++ = *cur;
-        } else {
-            /* silently ignore control characters */
-        }
-        cur++;
-    }
-    *out = 0;
 
-    virBufferAsprintf(buf, format, escaped);
+/*
+ * Enough for the digits of any 64-bit integer including the sign.
+ */
+#define VIR_BUFFER_INT_BUFLEN 21
+
+static void
+virBufferAppendInteger(GString *out,
+                       unsigned long long val,
+                       bool negative)
+{
+    char digits[VIR_BUFFER_INT_BUFLEN];
+    char *cur = digits + sizeof(digits);
+
+    do {
+        *--cur = '0' + val % 10;
+        val /= 10;
+    } while (val);
+
+    if (negative)
+        *--cur = '-';
+
+    g_string_append_len(out, cur, digits + sizeof(digits) - cur);
+}
+
+
+static void
+virBufferAppendAttrName(virBufferPtr buf,
+                        const char *name)
+{
+    virBufferInitialize(buf);
+    virBufferApplyIndent(buf);
+
+    g_string_append_c(buf->str, ' ');
+    g_string_append(buf->str, name);
+    g_string_append_len(buf->str, "='", 2);
+}
+
+
+/**
+ * virBufferAddULLong:
+ * @buf: the buffer to append to
+ * @val: the number
+ *
+ * Append the decimal representation of @val, without going through
+ * printf.  Auto indentation may be applied.
+ */
+void
+virBufferAddULLong(virBufferPtr buf,
+                   unsigned long long val)
+{
+    if (!buf)
+        return;
+
+    virBufferInitialize(buf);
+    virBufferApplyIndent(buf);
+    virBufferAppendInteger(buf->str, val, false);
+}
+
+
+/**
+ * virBufferAddLLong:
+ * @buf: the buffer to append to
+ * @val: the number
+ *
+ * Append the decimal representation of @val, without going through
+ * printf.  Auto indentation may be applied.
+ */
+void
+virBufferAddLLong(virBufferPtr buf,
+                  long long val)
+{
+    if (!buf)
+        return;
+
+    virBufferInitialize(buf);
+    virBufferApplyIndent(buf);
+
+    if (val < 0)
+        virBufferAppendInteger(buf->str, 0ULL - (unsigned long long) val, true);
+    else
+        virBufferAppendInteger(buf->str, val, false);
+}
+
+
+/**
+ * virBufferAddAttr:
+ * @buf: the buffer to append to
+ * @name: name of the attribute
+ * @value: value of the attribute
+ *
+ * Append " @name='@value'" to @buf. The value is added verbatim, use
+ * virBufferEscapeAttr for values which may need escaping. Nothing is
+ * added if @value is NULL.  Auto indentation may be applied.
+ */
+void
+virBufferAddAttr(virBufferPtr buf,
+                 const char *name,
+                 const char *value)
+{
+    if (!buf || !value)
+        return;
+
+    virBufferAppendAttrName(buf, name);
+    g_string_append(buf->str, value);
+    g_string_append_c(buf->str, '\'');
+}
+
+
+/**
+ * virBufferEscapeAttr:
+ * @buf: the buffer to append to
+ * @name: name of the attribute
+ * @value: value of the attribute
+ *
+ * Append " @name='@value'" to @buf with @value escaped for use in XML.
+ * Nothing is added if @value is NULL.  Auto indentation may be applied.
+ */
+void
+virBufferEscapeAttr(virBufferPtr buf,
+                    const char *name,
+                    const char *value)
+{
+    if (!buf || !value)
+        return;
+
+    virBufferAppendAttrName(buf, name);
+    virBufferEscapeXMLAppend(buf->str, value);
+    g_string_append_c(buf->str, '\'');
+}
+
+
+/**
+ * virBufferAddAttrULLong:
+ * @buf: the buffer to append to
+ * @name: name of the attribute
+ * @val: value of the attribute
+ *
+ * Append " @name='@val'" to @buf with @val in decimal.  Auto
+ * indentation may be applied.
+ */
+void
+virBufferAddAttrULLong(virBufferPtr buf,
+                       const char *name,
+                       unsigned long long val)
+{
+    if (!buf)
+        return;
+
+    virBufferAppendAttrName(buf, name);
+    virBufferAppendInteger(buf->str, val, false);
+    g_string_append_c(buf->str, '\'');
+}
+
+
+/**
+ * virBufferAddAttrLLong:
+ * @buf: the buffer to append to
+ * @name: name of the attribute
+ * @val: value of the attribute
+ *
+ * Append " @name='@val'" to @buf with @val in decimal.  Auto
+ * indentation may be applied.
+ */
+void
+virBufferAddAttrLLong(virBufferPtr buf,
+                      const char *name,
+                      long long val)
+{
+    if (!buf)
+        return;
+
+    virBufferAppendAttrName(buf, name);
+    if (val < 0)
+        virBufferAppendInteger(buf->str, 0ULL - (unsigned long long) val, true);
+    else
+        virBufferAppendInteger(buf->str, val, false);
+    g_string_append_c(buf->str, '\'');
 }
 
 /**
@@ -82,6 +82,18 @@ void virBufferEscapeSQL(virBufferPtr buf,
 void virBufferEscapeShell(virBufferPtr buf, const char *str);
 void virBufferURIEncodeString(virBufferPtr buf, const char *str);
 
+void virBufferAddULLong(virBufferPtr buf, unsigned long long val);
+void virBufferAddLLong(virBufferPtr buf, long long val);
+void virBufferAddAttr(virBufferPtr buf, const char *name, const char *value)
+    ATTRIBUTE_NONNULL(2);
+void virBufferEscapeAttr(virBufferPtr buf, const char *name, const char *value)
+    ATTRIBUTE_NONNULL(2);
+void virBufferAddAttrULLong(virBufferPtr buf, const char *name,
+                            unsigned long long val)
+    ATTRIBUTE_NONNULL(2);
+void virBufferAddAttrLLong(virBufferPtr buf, const char *name, long long val)
+    ATTRIBUTE_NONNULL(2);
+
 #define virBufferAddLit(buf_, literal_string_) \
     virBufferAdd(buf_, "" literal_string_ "", sizeof(literal_string_) - 1)
 
@@ -63,6 +63,11 @@ VIR_ENUM_IMPL(virCgroupController,
               "name=systemd",
 );
 
+VIR_ENUM_IMPL(virCgroupPressureResource,
+              VIR_CGROUP_PRESSURE_LAST,
+              "cpu", "memory", "io",
+);
+
 
 /**
  * virCgroupGetDevicePermsString:
@@ -619,6 +624,157 @@ virCgroupGetValueU64(virCgroupPtr group,
 }
 
 
+/* Initial size of the buffer for reading a statistics file */
+#define VIR_CGROUP_STATS_BUF_SIZE 4096
+
+static int
+virCgroupStatsFileRead(virCgroupStatsFilePtr file,
+                       char **value)
+{
+    g_autofree char *buf = NULL;
+    size_t alloc = MAX(file->size + 1, VIR_CGROUP_STATS_BUF_SIZE);
+    size_t len = 0;
+    ssize_t got;
+
+    buf = g_new0(char, alloc);
+
+    while (true) {
+        if (alloc - len == 1) {
+            alloc *= 2;
+            buf = g_renew(char, buf, alloc);
+        }
+
+        if ((got = pread(file->fd, buf + len, alloc - len - 1, len)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        len += got;
+
+        /* A short read means the end of the file was reached, which saves
+         * the extra call returning 0 in the common case */
+        if (got == 0 || len < alloc - 1)
+            break;
+    }
+
+    buf[len] = '\0';
+    file->size = len;
+
+    /* Terminated with '\n' has sometimes harmful effects to the caller */
+    if (len > 0 && buf[len - 1] == '\n')
+        buf[len - 1] = '\0';
+
+    *value = g_steal_pointer(&buf);
+    return 0;
+}
+
+
+static virCgroupStatsFilePtr
+virCgroupStatsSessionGetFile(virCgroupPtr group,
+                             int controller,
+                             const char *key)
+{
+    virCgroupStatsSessionPtr stats = group->stats;
+    virCgroupStatsFile file = { .controller = controller, .fd = -1 };
+    g_autofree char *keypath = NULL;
+    size_t i;
+
+    for (i = 0; i < stats->nfiles; i++) {
+        if (stats->files[i].controller == controller &&
+            STREQ(stats->files[i].key, key))
+            return &stats->files[i];
+    }
+
+    if (virCgroupPathOfController(group, controller, key, &keypath) < 0)
+        return NULL;
+
+    if ((file.fd = open(keypath, O_RDONLY | O_CLOEXEC)) < 0) {
+        virReportSystemError(errno, _("Unable to open '%s'"), keypath);
+        return NULL;
+    }
+
+    file.key = g_strdup(key);
+
+    if (VIR_APPEND_ELEMENT(stats->files, stats->nfiles, file) < 0) {
+        VIR_FORCE_CLOSE(file.fd);
+        g_free(file.key);
+        return NULL;
+    }
+
+    return &stats->files[stats->nfiles - 1];
+}
+
+
+/**
+ * virCgroupGetStatsValueStr:
+ *
+ * Same as virCgroupGetValueStr, but meant for statistics files which are
+ * read repeatedly. If a stats session was started on @group, the file is
+ * kept open and re-read, saving the path lookup and the open and close
+ * calls on every read.
+ */
+int
+virCgroupGetStatsValueStr(virCgroupPtr group,
+                          int controller,
+                          const char *key,
+                          char **value)
+{
+    virCgroupStatsSessionPtr stats = group->stats;
+    virCgroupStatsFilePtr file;
+    int ret = -1;
+
+    if (!stats)
+        return virCgroupGetValueStr(group, controller, key, value);
+
+    *value = NULL;
+
+    virMutexLock(&stats->lock);
+
+    if (!(file = virCgroupStatsSessionGetFile(group, controller, key)))
+        goto cleanup;
+
+    if (virCgroupStatsFileRead(file, value) < 0) {
+        virReportSystemError(errno, _("Unable to read from '%s'"), key);
+
+        /* don't keep a file which cannot be read, the next attempt will
+         * open it again */
+        VIR_FORCE_CLOSE(file->fd);
+        g_free(file->key);
+        VIR_DELETE_ELEMENT(stats->files, file - stats->files, stats->nfiles);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&stats->lock);
+    return ret;
+}
+
+
+int
+virCgroupGetStatsValueU64(virCgroupPtr group,
+                          int controller,
+                          const char *key,
+                          unsigned long long int *value)
+{
+    g_autofree char *strval = NULL;
+
+    if (virCgroupGetStatsValueStr(group, controller, key, &strval) < 0)
+        return -1;
+
+    if (virStrToLong_ull(strval, NULL, 10, value) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unable to parse '%s' as an integer"),
+                       strval);
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 virCgroupMakeGroup(virCgroupPtr parent,
                    virCgroupPtr group,
@@ -966,6 +1122,9 @@ virCgroupNewThread(virCgroupPtr domain,
     case VIR_CGROUP_THREAD_IOTHREAD:
         name = g_strdup_printf("iothread%d", id);
         break;
+    case VIR_CGROUP_THREAD_HELPER:
+        name = g_strdup("helper");
+        break;
     case VIR_CGROUP_THREAD_LAST:
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("unexpected name value %d"), nameval);
@@ -1641,6 +1800,74 @@ virCgroupGetMemoryUsage(virCgroupPtr group, unsigned long *kb)
 }
 
 
+/**
+ * virCgroupParseNumaStatNodes:
+ * @str: one line of memory.numa_stat without the leading counter name
+ * @nodes: array of per node values to add to
+ * @nnodes: number of items in @nodes
+ *
+ * Parses the "N0=123 N1=456" per node counters and adds the values to
+ * @nodes, which is indexed by the host NUMA node and grown as needed.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virCgroupParseNumaStatNodes(const char *str,
+                            unsigned long long **nodes,
+                            size_t *nnodes)
+{
+    VIR_AUTOSTRINGLIST tokens = NULL;
+    size_t i;
+
+    tokens = virStringSplit(str, " ", 0);
+
+    for (i = 0; tokens[i]; i++) {
+        unsigned int node;
+        unsigned long long value;
+        char *end;
+
+        if (tokens[i][0] != 'N')
+            continue;
+
+        if (virStrToLong_ui(tokens[i] + 1, &end, 10, &node) < 0 ||
+            *end != '=' ||
+            virStrToLong_ullp(end + 1, NULL, 10, &value) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Cannot parse NUMA statistics '%s'"), tokens[i]);
+            return -1;
+        }
+
+        if (node >= *nnodes &&
+            VIR_EXPAND_N(*nodes, *nnodes, node + 1 - *nnodes) < 0)
+            return -1;
+
+        (*nodes)[node] += value;
+    }
+
+    return 0;
+}
+
+
+/**
+ * virCgroupGetMemoryNumaStat:
+ *
+ * @group: The cgroup to get memory statistics for
+ * @nodes: filled with the memory in KiB charged to @group on each host
+ *         NUMA node, indexed by the node
+ * @nnodes: number of items in @nodes
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int
+virCgroupGetMemoryNumaStat(virCgroupPtr group,
+                           unsigned long long **nodes,
+                           size_t *nnodes)
+{
+    VIR_CGROUP_BACKEND_CALL(group, VIR_CGROUP_CONTROLLER_MEMORY,
+                            getMemoryNumaStat, -1, nodes, nnodes);
+}
+
+
 /**
  * virCgroupSetMemoryHardLimit:
  *
@@ -2013,6 +2240,18 @@ virCgroupDenyDevicePath(virCgroupPtr group,
 }
 
 
+/* Like virCgroupGetCpuacctPercpuUsage but reads the usage of the
+ * sub-group @child of @group without having to look it up first */
+static int
+virCgroupGetCpuacctPercpuUsageChild(virCgroupPtr group,
+                                    const char *child,
+                                    char **usage)
+{
+    VIR_CGROUP_BACKEND_CALL(group, VIR_CGROUP_CONTROLLER_CPUACCT,
+                            getCpuacctPercpuUsage, -1, child, usage);
+}
+
+
 /* This function gets the sums of cpu time consumed by all vcpus.
  * For example, if there are 4 physical cpus, and 2 vcpus in a domain,
  * then for each vcpu, the cpuacct.usage_percpu looks like this:
@@ -2026,6 +2265,9 @@ virCgroupDenyDevicePath(virCgroupPtr group,
  *   s1 = t01 + t11
  *   s2 = t02 + t12
  *   s3 = t03 + t13
+ *
+ * The vcpu sub-groups are read directly through @group rather than
+ * looked up one by one, which would re-detect every controller.
  */
 static int
 virCgroupGetPercpuVcpuSum(virCgroupPtr group,
@@ -2034,22 +2276,17 @@ virCgroupGetPercpuVcpuSum(virCgroupPtr group,
                           size_t nsum,
                           virBitmapPtr cpumap)
 {
-    int ret = -1;
     ssize_t i = -1;
-    virCgroupPtr group_vcpu = NULL;
 
     while ((i = virBitmapNextSetBit(guestvcpus, i)) >= 0) {
+        g_autofree char *child = g_strdup_printf("vcpu%zd", i);
         g_autofree char *buf = NULL;
         char *pos;
         unsigned long long tmp;
         ssize_t j;
 
-        if (virCgroupNewThread(group, VIR_CGROUP_THREAD_VCPU, i,
-                               false, &group_vcpu) < 0)
-            goto cleanup;
-
-        if (virCgroupGetCpuacctPercpuUsage(group_vcpu, &buf) < 0)
-            goto cleanup;
+        if (virCgroupGetCpuacctPercpuUsageChild(group, child, &buf) < 0)
+            return -1;
 
         pos = buf;
         for (j = virBitmapNextSetBit(cpumap, -1);
@@ -2058,18 +2295,13 @@ virCgroupGetPercpuVcpuSum(virCgroupPtr group,
             if (virStrToLong_ull(pos, &pos, 10, &tmp) < 0) {
                 virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                                _("cpuacct parse error"));
-                goto cleanup;
+                return -1;
             }
             sum_cpu_time[j] += tmp;
         }
-
-        virCgroupFree(&group_vcpu);
     }
 
-    ret = 0;
- cleanup:
-    virCgroupFree(&group_vcpu);
-    return ret;
+    return 0;
 }
 
 
@@ -2314,7 +2546,7 @@ int
 virCgroupGetCpuacctPercpuUsage(virCgroupPtr group, char **usage)
 {
     VIR_CGROUP_BACKEND_CALL(group, VIR_CGROUP_CONTROLLER_CPUACCT,
-                            getCpuacctPercpuUsage, -1, usage);
+                            getCpuacctPercpuUsage, -1, NULL, usage);
 }
 
 
@@ -2681,6 +2913,53 @@ virCgroupGetCpuacctStat(virCgroupPtr group, unsigned long long *user,
 }
 
 
+int
+virCgroupPressureResourceController(virCgroupPressureResource resource)
+{
+    switch (resource) {
+    case VIR_CGROUP_PRESSURE_CPU:
+        return VIR_CGROUP_CONTROLLER_CPU;
+    case VIR_CGROUP_PRESSURE_MEMORY:
+        return VIR_CGROUP_CONTROLLER_MEMORY;
+    case VIR_CGROUP_PRESSURE_IO:
+        return VIR_CGROUP_CONTROLLER_BLKIO;
+    case VIR_CGROUP_PRESSURE_LAST:
+        break;
+    }
+
+    return -1;
+}
+
+
+/**
+ * virCgroupGetPressure:
+ * @group: the cgroup
+ * @resource: the resource to report pressure stall information of
+ * @pressure: filled with the stall information
+ *
+ * Reads the pressure stall information (PSI) of @resource accounted to
+ * @group. The "full" line is not reported for CPU by older kernels, so
+ * callers need to check @pressure->hasFull.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virCgroupGetPressure(virCgroupPtr group,
+                     virCgroupPressureResource resource,
+                     virCgroupPressurePtr pressure)
+{
+    int controller = virCgroupPressureResourceController(resource);
+
+    if (controller < 0) {
+        virReportEnumRangeError(virCgroupPressureResource, resource);
+        return -1;
+    }
+
+    VIR_CGROUP_BACKEND_CALL(group, controller, getPressure, -1,
+                            resource, pressure);
+}
+
+
 int
 virCgroupSetFreezerState(virCgroupPtr group, const char *state)
 {
@@ -3125,6 +3404,17 @@ virCgroupGetMemoryUsage(virCgroupPtr group G_GNUC_UNUSED,
 }
 
 
+int
+virCgroupGetMemoryNumaStat(virCgroupPtr group G_GNUC_UNUSED,
+                           unsigned long long **nodes G_GNUC_UNUSED,
+                           size_t *nnodes G_GNUC_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("Control groups not supported on this platform"));
+    return -1;
+}
+
+
 int
 virCgroupSetMemoryHardLimit(virCgroupPtr group G_GNUC_UNUSED,
                             unsigned long long kb G_GNUC_UNUSED)
@@ -3441,6 +3731,17 @@ virCgroupGetCpuacctStat(virCgroupPtr group G_GNUC_UNUSED,
 }
 
 
+int
+virCgroupGetPressure(virCgroupPtr group G_GNUC_UNUSED,
+                     virCgroupPressureResource resource G_GNUC_UNUSED,
+                     virCgroupPressurePtr pressure G_GNUC_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("Control groups not supported on this platform"));
+    return -1;
+}
+
+
 int
 virCgroupGetDomainTotalCpuStats(virCgroupPtr group G_GNUC_UNUSED,
                                 virTypedParameterPtr params G_GNUC_UNUSED,
@@ -3538,6 +3839,67 @@ virCgroupControllerAvailable(int controller G_GNUC_UNUSED)
  *
  * @group: The group structure to free
  */
+/**
+ * virCgroupStatsSessionStart:
+ * @group: the cgroup
+ *
+ * Makes the statistics files of @group (such as cpu.stat, memory.stat,
+ * io.stat or cpuacct.usage_percpu) stay open once they were read so that
+ * polling statistics doesn't have to resolve the path of each file and
+ * open and close it every time. The files are closed by
+ * virCgroupStatsSessionStop or virCgroupFree.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virCgroupStatsSessionStart(virCgroupPtr group)
+{
+    g_autofree virCgroupStatsSessionPtr stats = NULL;
+
+    if (group->stats)
+        return 0;
+
+    stats = g_new0(virCgroupStatsSession, 1);
+
+    if (virMutexInit(&stats->lock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to initialize mutex"));
+        return -1;
+    }
+
+    group->stats = g_steal_pointer(&stats);
+    return 0;
+}
+
+
+/**
+ * virCgroupStatsSessionStop:
+ * @group: the cgroup
+ *
+ * Closes all statistics files kept open since virCgroupStatsSessionStart.
+ * The caller must make sure no statistics of @group are being read.
+ */
+void
+virCgroupStatsSessionStop(virCgroupPtr group)
+{
+    virCgroupStatsSessionPtr stats = group->stats;
+    size_t i;
+
+    if (!stats)
+        return;
+
+    for (i = 0; i < stats->nfiles; i++) {
+        VIR_FORCE_CLOSE(stats->files[i].fd);
+        g_free(stats->files[i].key);
+    }
+    g_free(stats->files);
+
+    virMutexDestroy(&stats->lock);
+    g_free(stats);
+    group->stats = NULL;
+}
+
+
 void
 virCgroupFree(virCgroupPtr *group)
 {
@@ -3546,6 +3908,8 @@ virCgroupFree(virCgroupPtr *group)
     if (*group == NULL)
         return;
 
+    virCgroupStatsSessionStop(*group);
+
     for (i = 0; i < VIR_CGROUP_CONTROLLER_LAST; i++) {
         VIR_FREE((*group)->legacy[i].mountPoint);
         VIR_FREE((*group)->legacy[i].linkPoint);
@@ -54,10 +54,38 @@ typedef enum {
     VIR_CGROUP_THREAD_VCPU = 0,
     VIR_CGROUP_THREAD_EMULATOR,
     VIR_CGROUP_THREAD_IOTHREAD,
+    VIR_CGROUP_THREAD_HELPER,
 
     VIR_CGROUP_THREAD_LAST
 } virCgroupThreadName;
 
+typedef enum {
+    VIR_CGROUP_PRESSURE_CPU = 0,
+    VIR_CGROUP_PRESSURE_MEMORY,
+    VIR_CGROUP_PRESSURE_IO,
+
+    VIR_CGROUP_PRESSURE_LAST
+} virCgroupPressureResource;
+
+VIR_ENUM_DECL(virCgroupPressureResource);
+
+typedef struct _virCgroupPressureStat virCgroupPressureStat;
+struct _virCgroupPressureStat {
+    double avg10; /* percentage of time stalled in the last 10 seconds */
+    double avg60;
+    double avg300;
+    unsigned long long total; /* total stall time in microseconds */
+};
+
+typedef struct _virCgroupPressure virCgroupPressure;
+typedef virCgroupPressure *virCgroupPressurePtr;
+struct _virCgroupPressure {
+    bool hasSome;
+    virCgroupPressureStat some; /* at least one task stalled */
+    bool hasFull;
+    virCgroupPressureStat full; /* all non-idle tasks stalled at once */
+};
+
 bool virCgroupAvailable(void);
 
 int virCgroupNewSelf(virCgroupPtr *group)
@@ -109,6 +137,9 @@ bool virCgroupNewIgnoreError(void);
 
 void virCgroupFree(virCgroupPtr *group);
 
+int virCgroupStatsSessionStart(virCgroupPtr group);
+void virCgroupStatsSessionStop(virCgroupPtr group);
+
 bool virCgroupHasController(virCgroupPtr cgroup, int controller);
 int virCgroupPathOfController(virCgroupPtr group,
                               unsigned int controller,
@@ -163,6 +194,9 @@ int virCgroupGetMemoryStat(virCgroupPtr group,
                            unsigned long long *inactiveFile,
                            unsigned long long *unevictable);
 int virCgroupGetMemoryUsage(virCgroupPtr group, unsigned long *kb);
+int virCgroupGetMemoryNumaStat(virCgroupPtr group,
+                               unsigned long long **nodes,
+                               size_t *nnodes);
 
 int virCgroupSetMemoryHardLimit(virCgroupPtr group, unsigned long long kb);
 int virCgroupGetMemoryHardLimit(virCgroupPtr group, unsigned long long *kb);
@@ -239,6 +273,10 @@ int virCgroupGetCpuacctPercpuUsage(virCgroupPtr group, char **usage);
 int virCgroupGetCpuacctStat(virCgroupPtr group, unsigned long long *user,
                             unsigned long long *sys);
 
+int virCgroupGetPressure(virCgroupPtr group,
+                         virCgroupPressureResource resource,
+                         virCgroupPressurePtr pressure);
+
 int virCgroupSetFreezerState(virCgroupPtr group, const char *state);
 int virCgroupGetFreezerState(virCgroupPtr group, char **state);
 
@@ -239,6 +239,11 @@ typedef int
 (*virCgroupGetMemoryUsageCB)(virCgroupPtr group,
                              unsigned long *kb);
 
+typedef int
+(*virCgroupGetMemoryNumaStatCB)(virCgroupPtr group,
+                                unsigned long long **nodes,
+                                size_t *nnodes);
+
 typedef int
 (*virCgroupSetMemoryHardLimitCB)(virCgroupPtr group,
                                  unsigned long long kb);
@@ -321,6 +326,7 @@ typedef int
 
 typedef int
 (*virCgroupGetCpuacctPercpuUsageCB)(virCgroupPtr group,
+                                    const char *child,
                                     char **usage);
 
 typedef int
@@ -328,6 +334,11 @@ typedef int
                              unsigned long long *user,
                              unsigned long long *sys);
 
+typedef int
+(*virCgroupGetPressureCB)(virCgroupPtr group,
+                          virCgroupPressureResource resource,
+                          virCgroupPressurePtr pressure);
+
 typedef int
 (*virCgroupSetFreezerStateCB)(virCgroupPtr group,
                               const char *state);
@@ -403,6 +414,7 @@ struct _virCgroupBackend {
     virCgroupSetMemoryCB setMemory;
     virCgroupGetMemoryStatCB getMemoryStat;
     virCgroupGetMemoryUsageCB getMemoryUsage;
+    virCgroupGetMemoryNumaStatCB getMemoryNumaStat;
     virCgroupSetMemoryHardLimitCB setMemoryHardLimit;
     virCgroupGetMemoryHardLimitCB getMemoryHardLimit;
     virCgroupSetMemorySoftLimitCB setMemorySoftLimit;
@@ -428,6 +440,8 @@ struct _virCgroupBackend {
     virCgroupGetCpuacctPercpuUsageCB getCpuacctPercpuUsage;
     virCgroupGetCpuacctStatCB getCpuacctStat;
 
+    virCgroupGetPressureCB getPressure;
+
     virCgroupSetFreezerStateCB setFreezerState;
     virCgroupGetFreezerStateCB getFreezerState;
 
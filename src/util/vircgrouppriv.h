@@ -59,6 +59,23 @@ struct _virCgroupV2Controller {
 typedef struct _virCgroupV2Controller virCgroupV2Controller;
 typedef virCgroupV2Controller *virCgroupV2ControllerPtr;
 
+struct _virCgroupStatsFile {
+    int controller;
+    char *key;
+    int fd;
+    size_t size; /* length of the last content read from @fd */
+};
+typedef struct _virCgroupStatsFile virCgroupStatsFile;
+typedef virCgroupStatsFile *virCgroupStatsFilePtr;
+
+struct _virCgroupStatsSession {
+    virMutex lock;
+    virCgroupStatsFilePtr files;
+    size_t nfiles;
+};
+typedef struct _virCgroupStatsSession virCgroupStatsSession;
+typedef virCgroupStatsSession *virCgroupStatsSessionPtr;
+
 struct _virCgroup {
     char *path;
 
@@ -66,6 +83,9 @@ struct _virCgroup {
 
     virCgroupV1Controller legacy[VIR_CGROUP_CONTROLLER_LAST];
     virCgroupV2Controller unified;
+
+    /* NULL unless virCgroupStatsSessionStart was called */
+    virCgroupStatsSessionPtr stats;
 };
 
 int virCgroupSetValueRaw(const char *path,
@@ -104,6 +124,22 @@ int virCgroupGetValueI64(virCgroupPtr group,
                          const char *key,
                          long long int *value);
 
+int virCgroupGetStatsValueStr(virCgroupPtr group,
+                              int controller,
+                              const char *key,
+                              char **value);
+
+int virCgroupGetStatsValueU64(virCgroupPtr group,
+                              int controller,
+                              const char *key,
+                              unsigned long long int *value);
+
+int virCgroupPressureResourceController(virCgroupPressureResource resource);
+
+int virCgroupParseNumaStatNodes(const char *str,
+                                unsigned long long **nodes,
+                                size_t *nnodes);
+
 int virCgroupPartitionEscape(char **path);
 
 char *virCgroupGetBlockDevString(const char *path);
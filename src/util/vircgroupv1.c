@@ -40,6 +40,7 @@
 #include "virstring.h"
 #include "virsystemd.h"
 #include "virerror.h"
+#include "virutil.h"
 #include "viralloc.h"
 
 VIR_LOG_INIT("util.cgroup");
@@ -1033,14 +1034,14 @@ virCgroupV1GetBlkioIoServiced(virCgroupPtr group,
     *requests_read = 0;
     *requests_write = 0;
 
-    if (virCgroupGetValueStr(group,
-                             VIR_CGROUP_CONTROLLER_BLKIO,
-                             "blkio.throttle.io_service_bytes", &str1) < 0)
+    if (virCgroupGetStatsValueStr(group,
+                                  VIR_CGROUP_CONTROLLER_BLKIO,
+                                  "blkio.throttle.io_service_bytes", &str1) < 0)
         return -1;
 
-    if (virCgroupGetValueStr(group,
-                             VIR_CGROUP_CONTROLLER_BLKIO,
-                             "blkio.throttle.io_serviced", &str2) < 0)
+    if (virCgroupGetStatsValueStr(group,
+                                  VIR_CGROUP_CONTROLLER_BLKIO,
+                                  "blkio.throttle.io_serviced", &str2) < 0)
         return -1;
 
     /* sum up all entries of the same kind, from all devices */
@@ -1123,14 +1124,14 @@ virCgroupV1GetBlkioIoDeviceServiced(virCgroupPtr group,
         requests_write
     };
 
-    if (virCgroupGetValueStr(group,
-                             VIR_CGROUP_CONTROLLER_BLKIO,
-                             "blkio.throttle.io_service_bytes", &str1) < 0)
+    if (virCgroupGetStatsValueStr(group,
+                                  VIR_CGROUP_CONTROLLER_BLKIO,
+                                  "blkio.throttle.io_service_bytes", &str1) < 0)
         return -1;
 
-    if (virCgroupGetValueStr(group,
-                             VIR_CGROUP_CONTROLLER_BLKIO,
-                             "blkio.throttle.io_serviced", &str2) < 0)
+    if (virCgroupGetStatsValueStr(group,
+                                  VIR_CGROUP_CONTROLLER_BLKIO,
+                                  "blkio.throttle.io_serviced", &str2) < 0)
         return -1;
 
     if (!(str3 = virCgroupGetBlockDevString(path)))
@@ -1546,10 +1547,10 @@ virCgroupV1GetMemoryStat(virCgroupPtr group,
     unsigned long long inactiveFileVal = 0;
     unsigned long long unevictableVal = 0;
 
-    if (virCgroupGetValueStr(group,
-                             VIR_CGROUP_CONTROLLER_MEMORY,
-                             "memory.stat",
-                             &stat) < 0) {
+    if (virCgroupGetStatsValueStr(group,
+                                  VIR_CGROUP_CONTROLLER_MEMORY,
+                                  "memory.stat",
+                                  &stat) < 0) {
         return -1;
     }
 
@@ -1622,6 +1623,63 @@ virCgroupV1GetMemoryUsage(virCgroupPtr group,
 }
 
 
+static int
+virCgroupV1GetMemoryNumaStat(virCgroupPtr group,
+                             unsigned long long **nodes,
+                             size_t *nnodes)
+{
+    g_autofree char *str = NULL;
+    g_autofree unsigned long long *total = NULL;
+    g_autofree unsigned long long *hierarchical = NULL;
+    size_t ntotal = 0;
+    size_t nhierarchical = 0;
+    VIR_AUTOSTRINGLIST lines = NULL;
+    unsigned long long pagesize = virGetSystemPageSizeKB();
+    size_t i;
+
+    if (virCgroupGetStatsValueStr(group,
+                                  VIR_CGROUP_CONTROLLER_MEMORY,
+                                  "memory.numa_stat", &str) < 0)
+        return -1;
+
+    lines = virStringSplit(str, "\n", 0);
+
+    for (i = 0; lines[i]; i++) {
+        const char *tmp;
+
+        if ((tmp = STRSKIP(lines[i], "hierarchical_total="))) {
+            if (virCgroupParseNumaStatNodes(tmp, &hierarchical,
+                                            &nhierarchical) < 0)
+                return -1;
+        } else if ((tmp = STRSKIP(lines[i], "total="))) {
+            if (virCgroupParseNumaStatNodes(tmp, &total, &ntotal) < 0)
+                return -1;
+        }
+    }
+
+    /* older kernels don't account child groups in the node counters */
+    if (hierarchical) {
+        g_free(total);
+        total = g_steal_pointer(&hierarchical);
+        ntotal = nhierarchical;
+    }
+
+    if (!total) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Cannot parse 'memory.numa_stat' cgroup file."));
+        return -1;
+    }
+
+    /* the counters are in pages */
+    for (i = 0; i < ntotal; i++)
+        total[i] *= pagesize;
+
+    *nodes = g_steal_pointer(&total);
+    *nnodes = ntotal;
+    return 0;
+}
+
+
 static int
 virCgroupV1SetMemoryHardLimit(virCgroupPtr group,
                               unsigned long long kb)
@@ -1948,18 +2006,25 @@ static int
 virCgroupV1GetCpuacctUsage(virCgroupPtr group,
                            unsigned long long *usage)
 {
-    return virCgroupGetValueU64(group,
-                                VIR_CGROUP_CONTROLLER_CPUACCT,
-                                "cpuacct.usage", usage);
+    return virCgroupGetStatsValueU64(group,
+                                     VIR_CGROUP_CONTROLLER_CPUACCT,
+                                     "cpuacct.usage", usage);
 }
 
 
 static int
 virCgroupV1GetCpuacctPercpuUsage(virCgroupPtr group,
+                                 const char *child,
                                  char **usage)
 {
-    return virCgroupGetValueStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
-                                "cpuacct.usage_percpu", usage);
+    g_autofree char *key = NULL;
+
+    if (child)
+        key = g_strdup_printf("%s/cpuacct.usage_percpu", child);
+
+    return virCgroupGetStatsValueStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
+                                     key ? key : "cpuacct.usage_percpu",
+                                     usage);
 }
 
 
@@ -1972,8 +2037,8 @@ virCgroupV1GetCpuacctStat(virCgroupPtr group,
     char *p;
     static double scale = -1.0;
 
-    if (virCgroupGetValueStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
-                             "cpuacct.stat", &str) < 0)
+    if (virCgroupGetStatsValueStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
+                                  "cpuacct.stat", &str) < 0)
         return -1;
 
     if (!(p = STRSKIP(str, "user ")) ||
@@ -2139,6 +2204,7 @@ virCgroupBackend virCgroupV1Backend = {
     .setMemory = virCgroupV1SetMemory,
     .getMemoryStat = virCgroupV1GetMemoryStat,
     .getMemoryUsage = virCgroupV1GetMemoryUsage,
+    .getMemoryNumaStat = virCgroupV1GetMemoryNumaStat,
     .setMemoryHardLimit = virCgroupV1SetMemoryHardLimit,
     .getMemoryHardLimit = virCgroupV1GetMemoryHardLimit,
     .setMemorySoftLimit = virCgroupV1SetMemorySoftLimit,
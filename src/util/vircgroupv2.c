@@ -709,9 +709,9 @@ virCgroupV2GetBlkioIoServiced(virCgroupPtr group,
     *requests_read = 0;
     *requests_write = 0;
 
-    if (virCgroupGetValueStr(group,
-                             VIR_CGROUP_CONTROLLER_BLKIO,
-                             "io.stat", &str1) < 0) {
+    if (virCgroupGetStatsValueStr(group,
+                                  VIR_CGROUP_CONTROLLER_BLKIO,
+                                  "io.stat", &str1) < 0) {
         return -1;
     }
 
@@ -769,9 +769,9 @@ virCgroupV2GetBlkioIoDeviceServiced(virCgroupPtr group,
         requests_write
     };
 
-    if (virCgroupGetValueStr(group,
-                             VIR_CGROUP_CONTROLLER_BLKIO,
-                             "io.stat", &str1) < 0) {
+    if (virCgroupGetStatsValueStr(group,
+                                  VIR_CGROUP_CONTROLLER_BLKIO,
+                                  "io.stat", &str1) < 0) {
         return -1;
     }
 
@@ -1196,10 +1196,10 @@ virCgroupV2GetMemoryStat(virCgroupPtr group,
     unsigned long long inactiveFileVal = 0;
     unsigned long long unevictableVal = 0;
 
-    if (virCgroupGetValueStr(group,
-                             VIR_CGROUP_CONTROLLER_MEMORY,
-                             "memory.stat",
-                             &stat) < 0) {
+    if (virCgroupGetStatsValueStr(group,
+                                  VIR_CGROUP_CONTROLLER_MEMORY,
+                                  "memory.stat",
+                                  &stat) < 0) {
         return -1;
     }
 
@@ -1271,6 +1271,54 @@ virCgroupV2GetMemoryUsage(virCgroupPtr group,
 }
 
 
+static int
+virCgroupV2GetMemoryNumaStat(virCgroupPtr group,
+                             unsigned long long **nodes,
+                             size_t *nnodes)
+{
+    g_autofree char *str = NULL;
+    g_autofree unsigned long long *tmp = NULL;
+    size_t ntmp = 0;
+    VIR_AUTOSTRINGLIST lines = NULL;
+    bool found = false;
+    size_t i;
+
+    if (virCgroupGetStatsValueStr(group,
+                                  VIR_CGROUP_CONTROLLER_MEMORY,
+                                  "memory.numa_stat", &str) < 0)
+        return -1;
+
+    lines = virStringSplit(str, "\n", 0);
+
+    /* "file" includes shared memory, so together with "anon" this covers
+     * the guest RAM regardless of the memory backend */
+    for (i = 0; lines[i]; i++) {
+        const char *val;
+
+        if (!(val = STRSKIP(lines[i], "anon ")) &&
+            !(val = STRSKIP(lines[i], "file ")))
+            continue;
+
+        if (virCgroupParseNumaStatNodes(val, &tmp, &ntmp) < 0)
+            return -1;
+        found = true;
+    }
+
+    if (!found) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Cannot parse 'memory.numa_stat' cgroup file."));
+        return -1;
+    }
+
+    for (i = 0; i < ntmp; i++)
+        tmp[i] >>= 10;
+
+    *nodes = g_steal_pointer(&tmp);
+    *nnodes = ntmp;
+    return 0;
+}
+
+
 static int
 virCgroupV2SetMemoryHardLimit(virCgroupPtr group,
                               unsigned long long kb)
@@ -1606,8 +1654,8 @@ virCgroupV2GetCpuacctUsage(virCgroupPtr group,
     g_autofree char *str = NULL;
     char *tmp;
 
-    if (virCgroupGetValueStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
-                             "cpu.stat", &str) < 0) {
+    if (virCgroupGetStatsValueStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
+                                  "cpu.stat", &str) < 0) {
         return -1;
     }
 
@@ -1640,8 +1688,8 @@ virCgroupV2GetCpuacctStat(virCgroupPtr group,
     unsigned long long userVal = 0;
     unsigned long long sysVal = 0;
 
-    if (virCgroupGetValueStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
-                             "cpu.stat", &str) < 0) {
+    if (virCgroupGetStatsValueStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
+                                  "cpu.stat", &str) < 0) {
         return -1;
     }
 
@@ -1678,6 +1726,91 @@ virCgroupV2GetCpuacctStat(virCgroupPtr group,
 }
 
 
+/* Parses "avg10=0.00 avg60=0.00 avg300=0.00 total=0" */
+static int
+virCgroupV2ParsePressureStat(const char *str,
+                             virCgroupPressureStat *stat)
+{
+    VIR_AUTOSTRINGLIST tokens = NULL;
+    size_t i;
+
+    tokens = virStringSplit(str, " ", 0);
+
+    for (i = 0; tokens[i]; i++) {
+        char *value;
+        int rc = 0;
+
+        if (!(value = strchr(tokens[i], '=')))
+            continue;
+        *value++ = '\0';
+
+        if (STREQ(tokens[i], "avg10"))
+            rc = virStrToDouble(value, NULL, &stat->avg10);
+        else if (STREQ(tokens[i], "avg60"))
+            rc = virStrToDouble(value, NULL, &stat->avg60);
+        else if (STREQ(tokens[i], "avg300"))
+            rc = virStrToDouble(value, NULL, &stat->avg300);
+        else if (STREQ(tokens[i], "total"))
+            rc = virStrToLong_ull(value, NULL, 10, &stat->total);
+
+        if (rc < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Failed to parse pressure value '%s' of '%s'"),
+                           value, tokens[i]);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+static int
+virCgroupV2GetPressure(virCgroupPtr group,
+                       virCgroupPressureResource resource,
+                       virCgroupPressurePtr pressure)
+{
+    g_autofree char *key = NULL;
+    g_autofree char *str = NULL;
+    VIR_AUTOSTRINGLIST lines = NULL;
+    size_t i;
+
+    key = g_strdup_printf("%s.pressure",
+                          virCgroupPressureResourceTypeToString(resource));
+
+    if (virCgroupGetStatsValueStr(group,
+                                  virCgroupPressureResourceController(resource),
+                                  key, &str) < 0)
+        return -1;
+
+    memset(pressure, 0, sizeof(*pressure));
+
+    lines = virStringSplit(str, "\n", 0);
+
+    for (i = 0; lines[i]; i++) {
+        const char *tmp;
+
+        if ((tmp = STRSKIP(lines[i], "some "))) {
+            if (virCgroupV2ParsePressureStat(tmp, &pressure->some) < 0)
+                return -1;
+            pressure->hasSome = true;
+        } else if ((tmp = STRSKIP(lines[i], "full "))) {
+            if (virCgroupV2ParsePressureStat(tmp, &pressure->full) < 0)
+                return -1;
+            pressure->hasFull = true;
+        }
+    }
+
+    if (!pressure->hasSome) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("cannot parse pressure stall information '%s'"), str);
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 virCgroupV2SetCpusetMems(virCgroupPtr group,
                          const char *mems)
@@ -1876,6 +2009,7 @@ virCgroupBackend virCgroupV2Backend = {
     .setMemory = virCgroupV2SetMemory,
     .getMemoryStat = virCgroupV2GetMemoryStat,
     .getMemoryUsage = virCgroupV2GetMemoryUsage,
+    .getMemoryNumaStat = virCgroupV2GetMemoryNumaStat,
     .setMemoryHardLimit = virCgroupV2SetMemoryHardLimit,
     .getMemoryHardLimit = virCgroupV2GetMemoryHardLimit,
     .setMemorySoftLimit = virCgroupV2SetMemorySoftLimit,
@@ -1900,6 +2034,8 @@ virCgroupBackend virCgroupV2Backend = {
     .getCpuacctUsage = virCgroupV2GetCpuacctUsage,
     .getCpuacctStat = virCgroupV2GetCpuacctStat,
 
+    .getPressure = virCgroupV2GetPressure,
+
     .setCpusetMems = virCgroupV2SetCpusetMems,
     .getCpusetMems = virCgroupV2GetCpusetMems,
     .setCpusetMemoryMigrate = virCgroupV2SetCpusetMemoryMigrate,
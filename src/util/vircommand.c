@@ -32,6 +32,9 @@
 #endif
 #include <fcntl.h>
 #include <unistd.h>
+#ifdef HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP
+# include <spawn.h>
+#endif
 
 #if WITH_CAPNG
 # include <cap-ng.h>
@@ -56,6 +59,7 @@
 #include "virbuffer.h"
 #include "virthread.h"
 #include "virstring.h"
+#include "virtrace.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -131,6 +135,7 @@ struct _virCommand {
     char *pidfile;
     bool reap;
     bool rawStatus;
+    bool spawned;
 
     unsigned long long maxMemLock;
     unsigned int maxProcesses;
@@ -548,6 +553,71 @@ virCommandMassClose(virCommandPtr cmd,
 
 # else /* ! __FreeBSD__ */
 
+#  if defined(__linux__) && defined(HAVE_CLOSE_RANGE)
+/* With close_range() we can close all the gaps between the FDs we
+ * want to keep without finding out which FDs are open first.
+ *
+ * Returns 0 on success, 1 if close_range() is not supported by the
+ * kernel and -1 on other errors. */
+static int
+virCommandMassCloseRange(virCommandPtr cmd,
+                         int childin,
+                         int childout,
+                         int childerr)
+{
+    int from = STDERR_FILENO + 1;
+    size_t i;
+
+    while (true) {
+        /* lowest FD at or above @from that is to be kept */
+        int next = -1;
+
+        if (childin >= from)
+            next = childin;
+        if (childout >= from && (next < 0 || childout < next))
+            next = childout;
+        if (childerr >= from && (next < 0 || childerr < next))
+            next = childerr;
+        for (i = 0; i < cmd->npassfd; i++) {
+            int fd = cmd->passfd[i].fd;
+
+            if (fd >= from && (next < 0 || fd < next))
+                next = fd;
+        }
+
+        if (next < 0)
+            break;
+
+        if (next > from && close_range(from, next - 1, 0) < 0)
+            goto error;
+
+        from = next + 1;
+    }
+
+    if (close_range(from, ~0U, 0) < 0)
+        goto error;
+
+    for (i = 0; i < cmd->npassfd; i++) {
+        int fd = cmd->passfd[i].fd;
+
+        if (virSetInherit(fd, true) < 0) {
+            virReportSystemError(errno, _("failed to preserve fd %d"), fd);
+            return -1;
+        }
+    }
+
+    return 0;
+
+ error:
+    /* kernels older than 5.9 lack close_range() */
+    if (errno == ENOSYS)
+        return 1;
+
+    virReportSystemError(errno, "%s", _("failed to close file descriptors"));
+    return -1;
+}
+#  endif /* __linux__ && HAVE_CLOSE_RANGE */
+
 static int
 virCommandMassClose(virCommandPtr cmd,
                     int childin,
@@ -555,9 +625,16 @@ virCommandMassClose(virCommandPtr cmd,
                     int childerr)
 {
     g_autoptr(virBitmap) fds = NULL;
-    int openmax = sysconf(_SC_OPEN_MAX);
+    int openmax;
     int fd = -1;
 
+#  if defined(__linux__) && defined(HAVE_CLOSE_RANGE)
+    int rc;
+
+    if ((rc = virCommandMassCloseRange(cmd, childin, childout, childerr)) <= 0)
+        return rc;
+#  endif
+
     /* In general, it is not safe to call malloc() between fork() and exec()
      * because the child might have forked at the worst possible time, i.e.
      * when another thread was in malloc() and thus held its lock. That is to
@@ -566,7 +643,7 @@ virCommandMassClose(virCommandPtr cmd,
      * Therefore we can safely allocate memory here (and transitively call
      * opendir/readdir) without a deadlock. */
 
-    if (openmax < 0) {
+    if ((openmax = sysconf(_SC_OPEN_MAX)) < 0) {
         virReportSystemError(errno, "%s", _("sysconf(_SC_OPEN_MAX) failed"));
         return -1;
     }
@@ -600,6 +677,112 @@ virCommandMassClose(virCommandPtr cmd,
 
 # endif /* ! __FreeBSD__ */
 
+# ifdef HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP
+extern char **environ;
+
+/*
+ * Commands which need nothing to be done between fork and exec other
+ * than setting up stdio can be started with posix_spawn(). The C
+ * library implements it with clone(CLONE_VM|CLONE_VFORK), so the page
+ * tables of the daemon are not copied, and closes the remaining FDs
+ * with close_range().
+ */
+static bool
+virExecCanSpawn(virCommandPtr cmd)
+{
+    if (cmd->hook || cmd->handshake || cmd->pidfile || cmd->pwd ||
+        cmd->mask || cmd->npassfd > 0 ||
+        (cmd->flags & (VIR_EXEC_DAEMON | VIR_EXEC_CLEAR_CAPS)))
+        return false;
+
+    if (cmd->uid != (uid_t)-1 || cmd->gid != (gid_t)-1 ||
+        cmd->capabilities)
+        return false;
+
+    if (cmd->maxMemLock || cmd->maxProcesses || cmd->maxFiles ||
+        cmd->setMaxCore)
+        return false;
+
+#  if defined(WITH_SECDRIVER_SELINUX)
+    if (cmd->seLinuxLabel)
+        return false;
+#  endif
+#  if defined(WITH_SECDRIVER_APPARMOR)
+    if (cmd->appArmorProfile)
+        return false;
+#  endif
+
+    return true;
+}
+
+
+/*
+ * virExecSpawn:
+ *
+ * Start @binary with posix_spawn(). Signal handlers and the signal mask
+ * are reset the same way virFork() does it.
+ *
+ * Returns the PID of the child, or -1 if it could not be started, in
+ * which case the caller should fall back to virFork() which reports
+ * the failure the usual way (e.g. through the exit status for a
+ * binary which cannot be executed).
+ */
+static pid_t
+virExecSpawn(virCommandPtr cmd,
+             const char *binary,
+             int childin,
+             int childout,
+             int childerr)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t mask;
+    pid_t pid = -1;
+    int rc;
+
+    if (posix_spawn_file_actions_init(&actions) != 0)
+        return -1;
+
+    if (posix_spawnattr_init(&attr) != 0) {
+        posix_spawn_file_actions_destroy(&actions);
+        return -1;
+    }
+
+    rc = posix_spawn_file_actions_adddup2(&actions, childin, STDIN_FILENO);
+    if (rc == 0 && childout > 0)
+        rc = posix_spawn_file_actions_adddup2(&actions, childout, STDOUT_FILENO);
+    if (rc == 0 && childerr > 0)
+        rc = posix_spawn_file_actions_adddup2(&actions, childerr, STDERR_FILENO);
+    if (rc == 0)
+        rc = posix_spawn_file_actions_addclosefrom_np(&actions,
+                                                      STDERR_FILENO + 1);
+
+    sigemptyset(&mask);
+    if (rc == 0)
+        rc = posix_spawnattr_setsigmask(&attr, &mask);
+    sigfillset(&mask);
+    if (rc == 0)
+        rc = posix_spawnattr_setsigdefault(&attr, &mask);
+    if (rc == 0)
+        rc = posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK |
+                                             POSIX_SPAWN_SETSIGDEF);
+
+    if (rc == 0)
+        rc = posix_spawn(&pid, binary, &actions, &attr, cmd->args,
+                         cmd->env ? cmd->env : environ);
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (rc != 0) {
+        VIR_DEBUG("Unable to spawn %s: %s", binary, g_strerror(rc));
+        return -1;
+    }
+
+    return pid;
+}
+# endif /* HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP */
+
 /*
  * virExec:
  * @cmd virCommandPtr containing all information about the program to
@@ -620,7 +803,7 @@ virExec(virCommandPtr cmd)
     const char *binary = NULL;
     int ret;
     g_autofree gid_t *groups = NULL;
-    int ngroups;
+    int ngroups = 0;
 
     if (cmd->args[0][0] != '/') {
         if (!(binary = binarystr = virFindFileInPath(cmd->args[0]))) {
@@ -685,13 +868,23 @@ virExec(virCommandPtr cmd)
         childerr = null;
     }
 
-    if ((ngroups = virGetGroupList(cmd->uid, cmd->gid, &groups)) < 0)
-        goto cleanup;
+    pid = -1;
+    cmd->spawned = false;
+# ifdef HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP
+    if (virExecCanSpawn(cmd) &&
+        (pid = virExecSpawn(cmd, binary, childin, childout, childerr)) > 0)
+        cmd->spawned = true;
+# endif
+
+    if (pid < 0) {
+        if ((ngroups = virGetGroupList(cmd->uid, cmd->gid, &groups)) < 0)
+            goto cleanup;
 
-    pid = virFork();
+        pid = virFork();
 
-    if (pid < 0)
-        goto cleanup;
+        if (pid < 0)
+            goto cleanup;
+    }
 
     if (pid) { /* parent */
         VIR_FORCE_CLOSE(null);
@@ -2375,6 +2568,7 @@ virCommandRun(virCommandPtr cmd, int *exitstatus)
     bool async_io = false;
     char *str;
     int tmpfd;
+    virTraceSpan span;
 
     if (!cmd ||cmd->has_error == ENOMEM) {
         virReportOOMError();
@@ -2440,9 +2634,13 @@ virCommandRun(virCommandPtr cmd, int *exitstatus)
         }
     }
 
+    /* Only the binary is recorded, arguments may contain secrets */
+    virTraceSpanBegin(&span, "command.run", cmd->args[0]);
+
     cmd->flags |= VIR_EXEC_RUN_SYNC;
     if (virCommandRunAsync(cmd, NULL) < 0) {
         cmd->has_error = -1;
+        virTraceSpanEnd(&span, true);
         return -1;
     }
 
@@ -2454,6 +2652,8 @@ virCommandRun(virCommandPtr cmd, int *exitstatus)
     if (virCommandWait(cmd, exitstatus) < 0)
         ret = -1;
 
+    virTraceSpanEnd(&span, ret < 0);
+
     str = (exitstatus ? virProcessTranslateStatus(*exitstatus)
            : (char *) "status 0");
     VIR_DEBUG("Result %s, stdout: '%s' stderr: '%s'",
@@ -3150,10 +3350,25 @@ virCommandSetDryRun(virBufferPtr buf,
     dryRunOpaque = opaque;
 }
 
+
+/**
+ * virCommandIsSpawned:
+ * @cmd: the command
+ *
+ * Returns true if the child of the last run of @cmd was started with
+ * posix_spawn() rather than virFork(). Meant for test suites which need
+ * to check both ways of starting a command.
+ */
+bool
+virCommandIsSpawned(virCommandPtr cmd)
+{
+    return cmd->spawned;
+}
+
 #ifndef WIN32
 /**
- * virCommandRunRegex:
- * @cmd: command to run
+ * virCommandParseRegex:
+ * @output: output of a program to parse, may be NULL
  * @nregex: number of regexes to apply
  * @regex: array of regexes to apply
  * @nvars: array of numbers of variables each regex will produce
@@ -3161,35 +3376,36 @@ virCommandSetDryRun(virBufferPtr buf,
  * needs to return 0 on success
  * @data: additional data that will be passed to the callback function
  * @prefix: prefix that will be skipped at the beginning of each line
- * @exitstatus: allows the caller to handle command run exit failures
  *
- * Run an external program.
- *
- * Read its output and apply a series of regexes to each line
- * When the entire set of regexes has matched consecutively
- * then run a callback passing in all the matches on the current line.
+ * Apply a series of regexes to each line of @output. When the entire
+ * set of regexes has matched consecutively then run a callback passing
+ * in all the matches on the current line. This is the parsing half of
+ * virCommandRunRegex, for output which was obtained by other means.
  *
- * Returns: 0 on success, -1 on memory allocation error, virCommandRun
- * error or callback function error
+ * Returns: 0 on success, -1 on regex compilation error or callback
+ * function error
  */
 int
-virCommandRunRegex(virCommandPtr cmd,
-                   int nregex,
-                   const char **regex,
-                   int *nvars,
-                   virCommandRunRegexFunc func,
-                   void *data,
-                   const char *prefix,
-                   int *exitstatus)
+virCommandParseRegex(const char *output,
+                     int nregex,
+                     const char **regex,
+                     int *nvars,
+                     virCommandRunRegexFunc func,
+                     void *data,
+                     const char *prefix)
 {
     GRegex **reg = NULL;
     size_t i, j, k;
     int totgroups = 0, ngroup = 0;
     char **groups;
-    g_autofree char *outbuf = NULL;
     VIR_AUTOSTRINGLIST lines = NULL;
     int ret = -1;
 
+    if (!output) {
+        /* no output */
+        return 0;
+    }
+
     /* Compile all regular expressions */
     if (VIR_ALLOC_N(reg, nregex) < 0)
         return -1;
@@ -3213,17 +3429,7 @@ virCommandRunRegex(virCommandPtr cmd,
     if (VIR_ALLOC_N(groups, totgroups) < 0)
         goto cleanup;
 
-    virCommandSetOutputBuffer(cmd, &outbuf);
-    if (virCommandRun(cmd, exitstatus) < 0)
-        goto cleanup;
-
-    if (!outbuf) {
-        /* no output */
-        ret = 0;
-        goto cleanup;
-    }
-
-    if (!(lines = virStringSplit(outbuf, "\n", 0)))
+    if (!(lines = virStringSplit(output, "\n", 0)))
         goto cleanup;
 
     for (k = 0; lines[k]; k++) {
@@ -3270,6 +3476,47 @@ virCommandRunRegex(virCommandPtr cmd,
     return ret;
 }
 
+/**
+ * virCommandRunRegex:
+ * @cmd: command to run
+ * @nregex: number of regexes to apply
+ * @regex: array of regexes to apply
+ * @nvars: array of numbers of variables each regex will produce
+ * @func: callback function that is called for every line of output,
+ * needs to return 0 on success
+ * @data: additional data that will be passed to the callback function
+ * @prefix: prefix that will be skipped at the beginning of each line
+ * @exitstatus: allows the caller to handle command run exit failures
+ *
+ * Run an external program.
+ *
+ * Read its output and apply a series of regexes to each line
+ * When the entire set of regexes has matched consecutively
+ * then run a callback passing in all the matches on the current line.
+ *
+ * Returns: 0 on success, -1 on memory allocation error, virCommandRun
+ * error or callback function error
+ */
+int
+virCommandRunRegex(virCommandPtr cmd,
+                   int nregex,
+                   const char **regex,
+                   int *nvars,
+                   virCommandRunRegexFunc func,
+                   void *data,
+                   const char *prefix,
+                   int *exitstatus)
+{
+    g_autofree char *outbuf = NULL;
+
+    virCommandSetOutputBuffer(cmd, &outbuf);
+    if (virCommandRun(cmd, exitstatus) < 0)
+        return -1;
+
+    return virCommandParseRegex(outbuf, nregex, regex, nvars,
+                                func, data, prefix);
+}
+
 /*
  * Run an external program and read from its standard output
  * a stream of tokens from IN_STREAM, applying FUNC to
@@ -3356,6 +3603,20 @@ virCommandRunNul(virCommandPtr cmd,
 
 #else /* WIN32 */
 
+int
+virCommandParseRegex(const char *output G_GNUC_UNUSED,
+                     int nregex G_GNUC_UNUSED,
+                     const char **regex G_GNUC_UNUSED,
+                     int *nvars G_GNUC_UNUSED,
+                     virCommandRunRegexFunc func G_GNUC_UNUSED,
+                     void *data G_GNUC_UNUSED,
+                     const char *prefix G_GNUC_UNUSED)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR,
+                   _("%s not implemented on Win32"), __FUNCTION__);
+    return -1;
+}
+
 int
 virCommandRunRegex(virCommandPtr cmd G_GNUC_UNUSED,
                    int nregex G_GNUC_UNUSED,
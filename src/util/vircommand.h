@@ -202,6 +202,14 @@ typedef int (*virCommandRunNulFunc)(size_t n_tokens,
                                     char **const groups,
                                     void *data);
 
+int virCommandParseRegex(const char *output,
+                         int nregex,
+                         const char **regex,
+                         int *nvars,
+                         virCommandRunRegexFunc func,
+                         void *data,
+                         const char *cmd_to_ignore);
+
 int virCommandRunRegex(virCommandPtr cmd,
                        int nregex,
                        const char **regex,
@@ -38,3 +38,5 @@ typedef void (*virCommandDryRunCallback)(const char *const*args,
 void virCommandSetDryRun(virBufferPtr buf,
                          virCommandDryRunCallback cb,
                          void *opaque);
+
+bool virCommandIsSpawned(virCommandPtr cmd);
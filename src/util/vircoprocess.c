@@ -0,0 +1,321 @@
+/*
+ * vircoprocess.c: long-lived helper processes driven over pipes
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#ifndef WIN32
+# include <poll.h>
+#endif
+#include <unistd.h>
+
+#include "internal.h"
+
+#include "viralloc.h"
+#include "vircommand.h"
+#include "vircoprocess.h"
+#include "virerror.h"
+#include "virfile.h"
+#include "virlog.h"
+#include "virstring.h"
+#include "virutil.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("util.coprocess");
+
+/* How long to wait for the helper to answer a single request */
+#define VIR_COPROCESS_TIMEOUT (30 * 1000)
+
+/*
+ * A co-process is a helper program which is started once and then fed
+ * with requests, one per line, on its stdin. Its reply to each request
+ * is everything it writes on stdout until it prints @prompt again, which
+ * is how interactive shells like 'lvm' signal they are ready for more.
+ * Compared to running the program once per request this saves the cost
+ * of spawning it and of its start-up work.
+ *
+ * The helper is started lazily on the first request and restarted on the
+ * next one after any failure, so callers only have to handle errors of
+ * the request at hand, typically by falling back to running the program
+ * the usual way.
+ */
+struct _virCoprocess {
+    virObjectLockable parent;
+
+    char **argv;
+    char *prompt;
+
+    /* NULL while the helper is not running */
+    virCommandPtr cmd;
+    int infd;
+    int outfd;
+};
+
+
+static virClassPtr virCoprocessClass;
+
+
+#ifndef WIN32
+/*
+ * Stops the helper if it is running. The next request starts it again.
+ */
+static void
+virCoprocessStop(virCoprocessPtr co)
+{
+    if (!co->cmd)
+        return;
+
+    /* closing stdin lets the helper exit on its own */
+    VIR_FORCE_CLOSE(co->infd);
+    VIR_FORCE_CLOSE(co->outfd);
+
+    virCommandAbort(co->cmd);
+    virCommandFree(co->cmd);
+    co->cmd = NULL;
+}
+#else /* WIN32 */
+static void
+virCoprocessStop(virCoprocessPtr co G_GNUC_UNUSED)
+{
+}
+#endif /* WIN32 */
+
+
+static void
+virCoprocessDispose(void *obj)
+{
+    virCoprocessPtr co = obj;
+
+    virCoprocessStop(co);
+
+    g_strfreev(co->argv);
+    VIR_FREE(co->prompt);
+}
+
+
+static int
+virCoprocessOnceInit(void)
+{
+    if (!VIR_CLASS_NEW(virCoprocess, virClassForObjectLockable()))
+        return -1;
+
+    return 0;
+}
+
+
+VIR_ONCE_GLOBAL_INIT(virCoprocess);
+
+
+/**
+ * virCoprocessNew:
+ * @argv: NULL terminated argument list of the helper program
+ * @prompt: string the helper prints when it is ready for a request
+ *
+ * Creates a co-process object. The helper program is not started until
+ * the first call to virCoprocessRun.
+ *
+ * Returns a new object or NULL on error.
+ */
+virCoprocessPtr
+virCoprocessNew(const char *const *argv,
+                const char *prompt)
+{
+    virCoprocessPtr co;
+
+    if (virCoprocessInitialize() < 0)
+        return NULL;
+
+    if (!(co = virObjectLockableNew(virCoprocessClass)))
+        return NULL;
+
+    co->argv = g_strdupv((char **) argv);
+    co->prompt = g_strdup(prompt);
+    co->infd = -1;
+    co->outfd = -1;
+
+    return co;
+}
+
+
+#ifndef WIN32
+/*
+ * Reads output of the helper until it prints the prompt. The output
+ * preceding the prompt is stored into @output if it is non-NULL.
+ */
+static int
+virCoprocessReadReply(virCoprocessPtr co,
+                      char **output)
+{
+    g_autoptr(GString) reply = g_string_new(NULL);
+    size_t promptlen = strlen(co->prompt);
+
+    while (1) {
+        struct pollfd fd = { .fd = co->outfd, .events = POLLIN };
+        char buf[4096];
+        ssize_t got;
+        int rc;
+
+        if ((rc = poll(&fd, 1, VIR_COPROCESS_TIMEOUT)) < 0) {
+            if (errno == EINTR)
+                continue;
+            virReportSystemError(errno, "%s",
+                                 _("unable to poll helper process output"));
+            return -1;
+        }
+
+        if (rc == 0) {
+            virReportError(VIR_ERR_OPERATION_TIMEOUT,
+                           _("timed out waiting for '%s'"), co->argv[0]);
+            return -1;
+        }
+
+        if ((got = read(co->outfd, buf, sizeof(buf))) < 0) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            virReportSystemError(errno,
+                                 _("unable to read output of '%s'"),
+                                 co->argv[0]);
+            return -1;
+        }
+
+        if (got == 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("helper process '%s' exited unexpectedly"),
+                           co->argv[0]);
+            return -1;
+        }
+
+        g_string_append_len(reply, buf, got);
+
+        if (reply->len >= promptlen &&
+            memcmp(reply->str + reply->len - promptlen,
+                   co->prompt, promptlen) == 0) {
+            g_string_truncate(reply, reply->len - promptlen);
+            break;
+        }
+    }
+
+    if (output)
+        *output = g_string_free(g_steal_pointer(&reply), FALSE);
+
+    return 0;
+}
+
+
+static int
+virCoprocessStart(virCoprocessPtr co)
+{
+    g_autoptr(virCommand) cmd = virCommandNewArgs((const char **) co->argv);
+    int inpipe[2] = { -1, -1 };
+    int outfd = -1;
+
+    if (virPipe(inpipe) < 0)
+        return -1;
+
+    /* keep interactive shells from emitting terminal control sequences
+     * and from localizing their output */
+    virCommandAddEnvPassCommon(cmd);
+    virCommandAddEnvPair(cmd, "TERM", "dumb");
+    virCommandSetInputFD(cmd, inpipe[0]);
+    virCommandSetOutputFD(cmd, &outfd);
+
+    if (virCommandRunAsync(cmd, NULL) < 0) {
+        VIR_FORCE_CLOSE(inpipe[0]);
+        VIR_FORCE_CLOSE(inpipe[1]);
+        return -1;
+    }
+
+    VIR_FORCE_CLOSE(inpipe[0]);
+    co->infd = inpipe[1];
+    co->outfd = outfd;
+    co->cmd = g_steal_pointer(&cmd);
+
+    VIR_DEBUG("started helper process '%s'", co->argv[0]);
+
+    /* whatever is printed before the first prompt is a banner */
+    if (virCoprocessReadReply(co, NULL) < 0) {
+        virCoprocessStop(co);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * virCoprocessRun:
+ * @co: co-process object
+ * @request: request to send, without the trailing newline
+ * @output: filled with the reply of the helper
+ *
+ * Sends @request to the helper, starting it first if needed, and waits
+ * for its reply. Nothing but the output of the helper is available,
+ * callers have to recognize failed requests from their reply. On error
+ * the helper is stopped and will be restarted by the next request.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virCoprocessRun(virCoprocessPtr co,
+                const char *request,
+                char **output)
+{
+    int ret = -1;
+
+    virObjectLock(co);
+
+    if (!co->cmd && virCoprocessStart(co) < 0)
+        goto cleanup;
+
+    VIR_DEBUG("request for '%s': %s", co->argv[0], request);
+
+    if (safewrite(co->infd, request, strlen(request)) < 0 ||
+        safewrite(co->infd, "\n", 1) < 0) {
+        virReportSystemError(errno,
+                             _("unable to send request to '%s'"),
+                             co->argv[0]);
+        virCoprocessStop(co);
+        goto cleanup;
+    }
+
+    if (virCoprocessReadReply(co, output) < 0) {
+        virCoprocessStop(co);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virObjectUnlock(co);
+    return ret;
+}
+
+#else /* WIN32 */
+
+int
+virCoprocessRun(virCoprocessPtr co G_GNUC_UNUSED,
+                const char *request G_GNUC_UNUSED,
+                char **output G_GNUC_UNUSED)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR,
+                   _("%s not implemented on Win32"), __FUNCTION__);
+    return -1;
+}
+
+#endif /* WIN32 */
@@ -41,12 +41,15 @@
 #include "virlog.h"
 #include "virfile.h"
 #include "virstring.h"
+#include "vircrypto.h"
+#include "virhash.h"
 
 #define VIR_FROM_THIS VIR_FROM_NETWORK
 
 VIR_LOG_INIT("util.dnsmasq");
 
 #define DNSMASQ_HOSTSFILE_SUFFIX "hostsfile"
+#define DNSMASQ_HOSTSDIR_SUFFIX "hostsdir"
 #define DNSMASQ_ADDNHOSTSFILE_SUFFIX "addnhosts"
 
 static void
@@ -282,6 +285,7 @@ hostsfileFree(dnsmasqHostsfile *hostsfile)
     }
 
     VIR_FREE(hostsfile->path);
+    VIR_FREE(hostsfile->dirpath);
 
     VIR_FREE(hostsfile);
 }
@@ -355,6 +359,13 @@ hostsfileNew(const char *name,
 
     if (!(hostsfile->path = virBufferContentAndReset(&buf)))
         goto error;
+
+    virBufferAsprintf(&buf, "%s", config_dir);
+    virBufferEscapeString(&buf, "/%s", name);
+    virBufferAsprintf(&buf, ".%s", DNSMASQ_HOSTSDIR_SUFFIX);
+
+    if (!(hostsfile->dirpath = virBufferContentAndReset(&buf)))
+        goto error;
     return hostsfile;
 
  error:
@@ -431,6 +442,111 @@ hostsfileSave(dnsmasqHostsfile *hostsfile)
     return 0;
 }
 
+/*
+ * Write every host into a file of its own in the hosts directory and
+ * remove the files of hosts that are gone. A file is named after the
+ * hash of its contents, so files of unchanged hosts are left alone and
+ * dnsmasq only reads new ones.
+ *
+ * @removed: set to true if the file of any host was removed
+ */
+static int
+hostsdirSave(dnsmasqHostsfile *hostsfile,
+             bool *removed)
+{
+    g_autoptr(virHashTable) names = NULL;
+    DIR *dir = NULL;
+    struct dirent *ent;
+    size_t i;
+    int rc;
+    int ret = -1;
+
+    *removed = false;
+
+    if (!(names = virHashNew(NULL)))
+        return -1;
+
+    if (virFileMakePathWithMode(hostsfile->dirpath, 0755) < 0) {
+        virReportSystemError(errno, _("cannot create directory '%s'"),
+                             hostsfile->dirpath);
+        return -1;
+    }
+
+    for (i = 0; i < hostsfile->nhosts; i++) {
+        g_autofree char *name = NULL;
+        g_autofree char *path = NULL;
+        g_autofree char *tmp = NULL;
+        g_autofree char *content = NULL;
+
+        if (virCryptoHashString(VIR_CRYPTO_HASH_SHA256,
+                                hostsfile->hosts[i].host, &name) < 0)
+            goto cleanup;
+
+        path = g_strdup_printf("%s/%s", hostsfile->dirpath, name);
+
+        if (!virFileExists(path)) {
+            /* dnsmasq ignores files starting with a dot, so it won't
+             * read the host before the file is complete */
+            tmp = g_strdup_printf("%s/.%s", hostsfile->dirpath, name);
+            content = g_strdup_printf("%s\n", hostsfile->hosts[i].host);
+
+            if (virFileWriteStr(tmp, content, 0644) < 0) {
+                virReportSystemError(errno, _("cannot write config file '%s'"),
+                                     tmp);
+                unlink(tmp);
+                goto cleanup;
+            }
+
+            if (rename(tmp, path) < 0) {
+                virReportSystemError(errno, _("cannot rename '%s' to '%s'"),
+                                     tmp, path);
+                unlink(tmp);
+                goto cleanup;
+            }
+        }
+
+        if (virHashUpdateEntry(names, name, (void *)0x1) < 0)
+            goto cleanup;
+    }
+
+    if (virDirOpen(&dir, hostsfile->dirpath) < 0)
+        goto cleanup;
+
+    while ((rc = virDirRead(dir, &ent, hostsfile->dirpath)) > 0) {
+        g_autofree char *path = NULL;
+
+        if (virHashLookup(names, ent->d_name))
+            continue;
+
+        path = g_strdup_printf("%s/%s", hostsfile->dirpath, ent->d_name);
+        if (unlink(path) < 0 && errno != ENOENT) {
+            virReportSystemError(errno, _("cannot remove config file '%s'"),
+                                 path);
+            goto cleanup;
+        }
+
+        if (ent->d_name[0] != '.')
+            *removed = true;
+    }
+    if (rc < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    VIR_DIR_CLOSE(dir);
+    return ret;
+}
+
+static int
+hostsdirDelete(const char *dirpath)
+{
+    if (!virFileExists(dirpath))
+        return 0;
+
+    return virFileDeleteTree(dirpath);
+}
+
 /**
  * dnsmasqContextNew:
  *
@@ -538,8 +654,15 @@ dnsmasqSave(const dnsmasqContext *ctx)
         return -1;
     }
 
-    if (ctx->hostsfile)
-        ret = hostsfileSave(ctx->hostsfile);
+    if (ctx->hostsfile) {
+        if (ctx->hostsdir) {
+            bool removed;
+
+            ret = hostsdirSave(ctx->hostsfile, &removed);
+        } else {
+            ret = hostsfileSave(ctx->hostsfile);
+        }
+    }
     if (ret == 0) {
         if (ctx->addnhostsfile)
             ret = addnhostsSave(ctx->addnhostsfile);
@@ -549,6 +672,39 @@ dnsmasqSave(const dnsmasqContext *ctx)
 }
 
 
+/**
+ * dnsmasqSaveDhcpHosts:
+ * @ctx: pointer to the dnsmasq context for each network
+ * @needReload: set to true if dnsmasq has to be signalled to pick up
+ *              the changes
+ *
+ * Saves only the DHCP hosts of a context to disk. With a hosts
+ * directory only the files of changed hosts are touched and dnsmasq
+ * reads new ones on its own; it still has to be told to reload if
+ * a host went away.
+ */
+int
+dnsmasqSaveDhcpHosts(const dnsmasqContext *ctx,
+                     bool *needReload)
+{
+    *needReload = true;
+
+    if (!ctx->hostsfile)
+        return 0;
+
+    if (virFileMakePath(ctx->config_dir) < 0) {
+        virReportSystemError(errno, _("cannot create config directory '%s'"),
+                             ctx->config_dir);
+        return -1;
+    }
+
+    if (ctx->hostsdir)
+        return hostsdirSave(ctx->hostsfile, needReload);
+
+    return hostsfileSave(ctx->hostsfile);
+}
+
+
 /**
  * dnsmasqDelete:
  * @ctx: pointer to the dnsmasq context for each network
@@ -560,8 +716,11 @@ dnsmasqDelete(const dnsmasqContext *ctx)
 {
     int ret = 0;
 
-    if (ctx->hostsfile)
+    if (ctx->hostsfile) {
         ret = genericFileDelete(ctx->hostsfile->path);
+        if (hostsdirDelete(ctx->hostsfile->dirpath) < 0)
+            ret = -1;
+    }
     if (ctx->addnhostsfile)
         ret = genericFileDelete(ctx->addnhostsfile->path);
 
@@ -664,13 +823,18 @@ dnsmasqCapsSetFromBuffer(dnsmasqCapsPtr caps, const char *buf)
     if (strstr(buf, "--ra-param"))
         dnsmasqCapsSet(caps, DNSMASQ_CAPS_RA_PARAM);
 
+    if (strstr(buf, "--dhcp-hostsdir"))
+        dnsmasqCapsSet(caps, DNSMASQ_CAPS_DHCP_HOSTSDIR);
+
     VIR_INFO("dnsmasq version is %d.%d, --bind-dynamic is %spresent, "
-             "SO_BINDTODEVICE is %sin use, --ra-param is %spresent",
+             "SO_BINDTODEVICE is %sin use, --ra-param is %spresent, "
+             "--dhcp-hostsdir is %spresent",
              (int)caps->version / 1000000,
              (int)(caps->version % 1000000) / 1000,
              dnsmasqCapsGet(caps, DNSMASQ_CAPS_BIND_DYNAMIC) ? "" : "NOT ",
              dnsmasqCapsGet(caps, DNSMASQ_CAPS_BINDTODEVICE) ? "" : "NOT ",
-             dnsmasqCapsGet(caps, DNSMASQ_CAPS_RA_PARAM) ? "" : "NOT ");
+             dnsmasqCapsGet(caps, DNSMASQ_CAPS_RA_PARAM) ? "" : "NOT ",
+             dnsmasqCapsGet(caps, DNSMASQ_CAPS_DHCP_HOSTSDIR) ? "" : "NOT ");
     return 0;
 
  fail:
@@ -42,6 +42,7 @@ typedef struct
     dnsmasqDhcpHost *hosts;
 
     char            *path;  /* Absolute path of dnsmasq's hostsfile. */
+    char            *dirpath; /* Absolute path of dnsmasq's hostsdir. */
 } dnsmasqHostsfile;
 
 typedef struct
@@ -65,12 +66,14 @@ typedef struct
     char                 *config_dir;
     dnsmasqHostsfile     *hostsfile;
     dnsmasqAddnHostsfile *addnhostsfile;
+    bool                  hostsdir; /* save DHCP hosts in hostsfile->dirpath */
 } dnsmasqContext;
 
 typedef enum {
    DNSMASQ_CAPS_BIND_DYNAMIC = 0, /* support for --bind-dynamic */
    DNSMASQ_CAPS_BINDTODEVICE = 1, /* uses SO_BINDTODEVICE for --bind-interfaces */
    DNSMASQ_CAPS_RA_PARAM = 2,     /* support for --ra-param */
+   DNSMASQ_CAPS_DHCP_HOSTSDIR = 3, /* support for --dhcp-hostsdir */
 
    DNSMASQ_CAPS_LAST,             /* this must always be the last item */
 } dnsmasqCapsFlags;
@@ -97,6 +100,8 @@ int              dnsmasqAddHost(dnsmasqContext *ctx,
                                 virSocketAddr *ip,
                                 const char *name);
 int              dnsmasqSave(const dnsmasqContext *ctx);
+int              dnsmasqSaveDhcpHosts(const dnsmasqContext *ctx,
+                                      bool *needReload);
 int              dnsmasqDelete(const dnsmasqContext *ctx);
 int              dnsmasqReload(pid_t pid);
 
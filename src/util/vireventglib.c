@@ -46,6 +46,7 @@ struct virEventGLibHandle
     int events;
     int removed;
     GSource *source;
+    GMainContext *context;
     virEventHandleCallback cb;
     void *opaque;
     virFreeCallback ff;
@@ -57,6 +58,7 @@ struct virEventGLibTimeout
     int interval;
     int removed;
     GSource *source;
+    GMainContext *context;
     virEventTimeoutCallback cb;
     void *opaque;
     virFreeCallback ff;
@@ -124,11 +126,12 @@ virEventGLibHandleDispatch(int fd G_GNUC_UNUSED,
 
 
 static int
-virEventGLibHandleAdd(int fd,
-                      int events,
-                      virEventHandleCallback cb,
-                      void *opaque,
-                      virFreeCallback ff)
+virEventGLibHandleAddInternal(GMainContext *context,
+                              int fd,
+                              int events,
+                              virEventHandleCallback cb,
+                              void *opaque,
+                              virFreeCallback ff)
 {
     struct virEventGLibHandle *data;
     GIOCondition cond = virEventGLibEventsToCondition(events);
@@ -144,13 +147,15 @@ virEventGLibHandleAdd(int fd,
     data->cb = cb;
     data->opaque = opaque;
     data->ff = ff;
+    if (context)
+        data->context = g_main_context_ref(context);
 
-    VIR_DEBUG("Add handle data=%p watch=%d fd=%d events=%d opaque=%p",
-              data, data->watch, data->fd, events, data->opaque);
+    VIR_DEBUG("Add handle data=%p watch=%d fd=%d events=%d opaque=%p context=%p",
+              data, data->watch, data->fd, events, data->opaque, context);
 
     if (events != 0) {
         data->source = virEventGLibAddSocketWatch(
-            fd, cond, NULL, virEventGLibHandleDispatch, data, NULL);
+            fd, cond, data->context, virEventGLibHandleDispatch, data, NULL);
     }
 
     g_ptr_array_add(handles, data);
@@ -165,6 +170,86 @@ virEventGLibHandleAdd(int fd,
     return ret;
 }
 
+
+static int
+virEventGLibHandleAdd(int fd,
+                      int events,
+                      virEventHandleCallback cb,
+                      void *opaque,
+                      virFreeCallback ff)
+{
+    return virEventGLibHandleAddInternal(NULL, fd, events, cb, opaque, ff);
+}
+
+
+/**
+ * virEventGLibHandleAddContext:
+ * @context: the context to dispatch the handle in
+ * @fd: file handle to monitor for events
+ * @events: bitset of events to watch from virEventHandleType constants
+ * @cb: callback to invoke when an event occurs
+ * @opaque: user data to pass to callback
+ * @ff: callback to free opaque when handle is removed
+ *
+ * Like virEventAddHandle, but @cb is invoked by whichever thread runs
+ * @context instead of the default main loop, for example one of
+ * virEventThread. The returned watch is updated and removed using the
+ * usual virEventUpdateHandle and virEventRemoveHandle, @ff is called
+ * from @context as well.
+ *
+ * Returns -1 if the GLib event loop is not in use, or a handle watch
+ * number to be used for updating and unregistering for events.
+ */
+int
+virEventGLibHandleAddContext(GMainContext *context,
+                             int fd,
+                             int events,
+                             virEventHandleCallback cb,
+                             void *opaque,
+                             virFreeCallback ff)
+{
+    if (!eventlock) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("GLib event loop is not registered"));
+        return -1;
+    }
+
+    return virEventGLibHandleAddInternal(context, fd, events, cb, opaque, ff);
+}
+
+
+/*
+ * Schedules @func to run in @context, or the default main loop if it
+ * is NULL, so that releasing a handle or timeout can't race with a
+ * dispatch running in another thread.
+ */
+static void
+virEventGLibIdleAddContext(GMainContext *context,
+                           GSourceFunc func,
+                           gpointer opaque)
+{
+    GSource *idle;
+
+    if (!context) {
+        g_idle_add(func, opaque);
+        return;
+    }
+
+    idle = g_idle_source_new();
+    g_source_set_callback(idle, func, opaque, NULL);
+    g_source_attach(idle, context);
+    g_source_unref(idle);
+}
+
+
+static void
+virEventGLibHandleIdleAdd(struct virEventGLibHandle *data,
+                          GSourceFunc func,
+                          gpointer opaque)
+{
+    virEventGLibIdleAddContext(data->context, func, opaque);
+}
+
 static struct virEventGLibHandle *
 virEventGLibHandleFind(int watch)
 {
@@ -231,11 +316,11 @@ virEventGLibHandleUpdate(int watch,
         if (data->source != NULL) {
             VIR_DEBUG("Removed old handle source=%p", data->source);
             g_source_destroy(data->source);
-            g_idle_add(virEventGLibSourceUnrefIdle, data->source);
+            virEventGLibHandleIdleAdd(data, virEventGLibSourceUnrefIdle, data->source);
         }
 
         data->source = virEventGLibAddSocketWatch(
-            data->fd, cond, NULL, virEventGLibHandleDispatch, data, NULL);
+            data->fd, cond, data->context, virEventGLibHandleDispatch, data, NULL);
 
         data->events = events;
         VIR_DEBUG("Added new handle source=%p", data->source);
@@ -245,7 +330,7 @@ virEventGLibHandleUpdate(int watch,
 
         VIR_DEBUG("Removed old handle source=%p", data->source);
         g_source_destroy(data->source);
-        g_idle_add(virEventGLibSourceUnrefIdle, data->source);
+        virEventGLibHandleIdleAdd(data, virEventGLibSourceUnrefIdle, data->source);
         data->source = NULL;
         data->events = 0;
     }
@@ -265,6 +350,9 @@ virEventGLibHandleRemoveIdle(gpointer data)
     if (h->ff)
         (h->ff)(h->opaque);
 
+    if (h->context)
+        g_main_context_unref(h->context);
+
     g_mutex_lock(eventlock);
     g_ptr_array_remove_fast(handles, h);
     g_mutex_unlock(eventlock);
@@ -294,7 +382,7 @@ virEventGLibHandleRemove(int watch)
 
     if (data->source != NULL) {
         g_source_destroy(data->source);
-        g_idle_add(virEventGLibSourceUnrefIdle, data->source);
+        virEventGLibHandleIdleAdd(data, virEventGLibSourceUnrefIdle, data->source);
         data->source = NULL;
         data->events = 0;
     }
@@ -304,7 +392,7 @@ virEventGLibHandleRemove(int watch)
      * 'removed' to prevent reuse
      */
     data->removed = TRUE;
-    g_idle_add(virEventGLibHandleRemoveIdle, data);
+    virEventGLibHandleIdleAdd(data, virEventGLibHandleRemoveIdle, data);
 
     ret = 0;
 
@@ -340,17 +428,18 @@ virEventGLibTimeoutCreate(int interval,
     g_source_set_callback(source,
                           virEventGLibTimeoutDispatch,
                           data, NULL);
-    g_source_attach(source, NULL);
+    g_source_attach(source, data->context);
 
     return source;
 }
 
 
 static int
-virEventGLibTimeoutAdd(int interval,
-                       virEventTimeoutCallback cb,
-                       void *opaque,
-                       virFreeCallback ff)
+virEventGLibTimeoutAddInternal(GMainContext *context,
+                               int interval,
+                               virEventTimeoutCallback cb,
+                               void *opaque,
+                               virFreeCallback ff)
 {
     struct virEventGLibTimeout *data;
     int ret;
@@ -363,6 +452,8 @@ virEventGLibTimeoutAdd(int interval,
     data->cb = cb;
     data->opaque = opaque;
     data->ff = ff;
+    if (context)
+        data->context = g_main_context_ref(context);
     if (interval >= 0)
         data->source = virEventGLibTimeoutCreate(interval, data);
 
@@ -382,6 +473,49 @@ virEventGLibTimeoutAdd(int interval,
 }
 
 
+static int
+virEventGLibTimeoutAdd(int interval,
+                       virEventTimeoutCallback cb,
+                       void *opaque,
+                       virFreeCallback ff)
+{
+    return virEventGLibTimeoutAddInternal(NULL, interval, cb, opaque, ff);
+}
+
+
+/**
+ * virEventGLibTimeoutAddContext:
+ * @context: the context to dispatch the timeout in
+ * @interval: timeout in milliseconds, or -1 to start disabled
+ * @cb: callback to invoke when the timeout expires
+ * @opaque: user data to pass to callback
+ * @ff: callback to free opaque when timeout is removed
+ *
+ * Like virEventAddTimeout, but @cb is invoked by whichever thread runs
+ * @context instead of the default main loop. The returned timer is
+ * updated and removed using the usual virEventUpdateTimeout and
+ * virEventRemoveTimeout, @ff is called from @context as well.
+ *
+ * Returns -1 if the GLib event loop is not in use, or a timer number to
+ * be used for updating and unregistering the timeout.
+ */
+int
+virEventGLibTimeoutAddContext(GMainContext *context,
+                              int interval,
+                              virEventTimeoutCallback cb,
+                              void *opaque,
+                              virFreeCallback ff)
+{
+    if (!eventlock) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("GLib event loop is not registered"));
+        return -1;
+    }
+
+    return virEventGLibTimeoutAddInternal(context, interval, cb, opaque, ff);
+}
+
+
 static struct virEventGLibTimeout *
 virEventGLibTimeoutFind(int timer)
 {
@@ -427,7 +561,9 @@ virEventGLibTimeoutUpdate(int timer,
     if (interval >= 0) {
         if (data->source != NULL) {
             g_source_destroy(data->source);
-            g_idle_add(virEventGLibSourceUnrefIdle, data->source);
+            virEventGLibIdleAddContext(data->context,
+                                       virEventGLibSourceUnrefIdle,
+                                       data->source);
         }
 
         data->interval = interval;
@@ -437,7 +573,9 @@ virEventGLibTimeoutUpdate(int timer,
             goto cleanup;
 
         g_source_destroy(data->source);
-        g_idle_add(virEventGLibSourceUnrefIdle, data->source);
+        virEventGLibIdleAddContext(data->context,
+                                   virEventGLibSourceUnrefIdle,
+                                   data->source);
         data->source = NULL;
     }
 
@@ -457,6 +595,9 @@ virEventGLibTimeoutRemoveIdle(gpointer data)
     if (t->ff)
         (t->ff)(t->opaque);
 
+    if (t->context)
+        g_main_context_unref(t->context);
+
     g_mutex_lock(eventlock);
     g_ptr_array_remove_fast(timeouts, t);
     g_mutex_unlock(eventlock);
@@ -486,7 +627,9 @@ virEventGLibTimeoutRemove(int timer)
 
     if (data->source != NULL) {
         g_source_destroy(data->source);
-        g_idle_add(virEventGLibSourceUnrefIdle, data->source);
+        virEventGLibIdleAddContext(data->context,
+                                   virEventGLibSourceUnrefIdle,
+                                   data->source);
         data->source = NULL;
     }
 
@@ -495,7 +638,8 @@ virEventGLibTimeoutRemove(int timer)
      * 'removed' to prevent reuse
      */
     data->removed = TRUE;
-    g_idle_add(virEventGLibTimeoutRemoveIdle, data);
+    virEventGLibIdleAddContext(data->context,
+                               virEventGLibTimeoutRemoveIdle, data);
 
     ret = 0;
 
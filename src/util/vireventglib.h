@@ -26,3 +26,16 @@
 void virEventGLibRegister(void);
 
 int virEventGLibRunOnce(void);
+
+int virEventGLibHandleAddContext(GMainContext *context,
+                                 int fd,
+                                 int events,
+                                 virEventHandleCallback cb,
+                                 void *opaque,
+                                 virFreeCallback ff);
+
+int virEventGLibTimeoutAddContext(GMainContext *context,
+                                  int interval,
+                                  virEventTimeoutCallback cb,
+                                  void *opaque,
+                                  virFreeCallback ff);
@@ -23,6 +23,19 @@
 #include "vireventthread.h"
 #include "virthread.h"
 #include "virerror.h"
+#include "virlog.h"
+#include "virprocess.h"
+
+/* How often the latency probe is due, in milliseconds */
+#define VIR_EVENT_THREAD_PROBE_INTERVAL 1000
+
+typedef struct {
+    GMutex lock;
+    gint64 due;
+    unsigned long long samples;
+    unsigned long long total;
+    unsigned long long max;
+} virEventThreadProbe;
 
 struct _virEventThread {
     GObject parent;
@@ -30,17 +43,27 @@ struct _virEventThread {
     GThread *thread;
     GMainContext *context;
     GMainLoop *loop;
+
+    GSource *probe;
+    virEventThreadProbe *probeData;
 };
 
 G_DEFINE_TYPE(virEventThread, vir_event_thread, G_TYPE_OBJECT)
 
 #define VIR_FROM_THIS VIR_FROM_EVENT
 
+VIR_LOG_INIT("util.eventthread");
+
 static void
 vir_event_thread_finalize(GObject *object)
 {
     virEventThread *evt = VIR_EVENT_THREAD(object);
 
+    if (evt->probe) {
+        g_source_destroy(evt->probe);
+        g_source_unref(evt->probe);
+    }
+
     if (evt->thread) {
         g_main_loop_quit(evt->loop);
         g_thread_unref(evt->thread);
@@ -193,3 +216,230 @@ virEventThreadGetContext(virEventThread *evt)
 {
     return evt->context;
 }
+
+
+static gboolean
+virEventThreadSetAffinityDispatch(void *opaque)
+{
+    virBitmapPtr cpus = opaque;
+
+    if (virProcessSetAffinity(0, cpus) < 0) {
+        VIR_WARN("Unable to set affinity of event thread: %s",
+                 virGetLastErrorMessage());
+        virResetLastError();
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+
+/**
+ * virEventThreadSetAffinity:
+ * @evt: the event thread
+ * @cpus: host CPUs to run the thread on
+ *
+ * Binds the thread of @evt to @cpus. The thread applies the binding
+ * itself once it gets to it, failures are only logged.
+ */
+void
+virEventThreadSetAffinity(virEventThread *evt,
+                          virBitmapPtr cpus)
+{
+    g_main_context_invoke_full(evt->context, G_PRIORITY_HIGH,
+                               virEventThreadSetAffinityDispatch,
+                               virBitmapNewCopy(cpus),
+                               (GDestroyNotify) virBitmapFree);
+}
+
+
+static void
+virEventThreadProbeFree(void *opaque)
+{
+    virEventThreadProbe *probe = opaque;
+
+    g_mutex_clear(&probe->lock);
+    g_free(probe);
+}
+
+
+static gboolean
+virEventThreadProbeDispatch(void *opaque)
+{
+    virEventThreadProbe *probe = opaque;
+    gint64 now = g_get_monotonic_time();
+    unsigned long long delay = 0;
+
+    g_mutex_lock(&probe->lock);
+    if (now > probe->due)
+        delay = now - probe->due;
+    probe->samples++;
+    probe->total += delay;
+    probe->max = MAX(probe->max, delay);
+    probe->due = now + VIR_EVENT_THREAD_PROBE_INTERVAL * 1000;
+    g_mutex_unlock(&probe->lock);
+
+    return G_SOURCE_CONTINUE;
+}
+
+
+static GSource *
+virEventThreadProbeAttach(GMainContext *context,
+                          virEventThreadProbe **data)
+{
+    virEventThreadProbe *probe;
+    GSource *source;
+
+    probe = g_new0(virEventThreadProbe, 1);
+    g_mutex_init(&probe->lock);
+    probe->due = g_get_monotonic_time() + VIR_EVENT_THREAD_PROBE_INTERVAL * 1000;
+
+    source = g_timeout_source_new(VIR_EVENT_THREAD_PROBE_INTERVAL);
+    g_source_set_callback(source, virEventThreadProbeDispatch,
+                          probe, virEventThreadProbeFree);
+    g_source_attach(source, context);
+
+    *data = probe;
+    return source;
+}
+
+
+static void
+virEventThreadProbeRead(virEventThreadProbe *probe,
+                        virEventThreadLatency *latency)
+{
+    g_mutex_lock(&probe->lock);
+    latency->samples = probe->samples;
+    latency->avg = probe->samples ? probe->total / probe->samples : 0;
+    latency->max = probe->max;
+    g_mutex_unlock(&probe->lock);
+}
+
+
+/**
+ * virEventThreadStartLatencyProbe:
+ * @evt: the event thread
+ *
+ * Starts measuring how late the loop of @evt dispatches events, which
+ * is the time a ready file descriptor may wait because callbacks of
+ * other sources are running. A timer is armed periodically and the
+ * delay between its expiry and its dispatch is recorded.
+ */
+void
+virEventThreadStartLatencyProbe(virEventThread *evt)
+{
+    if (evt->probe)
+        return;
+
+    evt->probe = virEventThreadProbeAttach(evt->context, &evt->probeData);
+}
+
+
+/**
+ * virEventThreadGetLatency:
+ * @evt: the event thread
+ * @latency: filled with the statistics
+ *
+ * Reports the dispatch delays measured since
+ * virEventThreadStartLatencyProbe was called, in microseconds.
+ *
+ * Returns 0 on success, -1 if the probe wasn't started.
+ */
+int
+virEventThreadGetLatency(virEventThread *evt,
+                         virEventThreadLatency *latency)
+{
+    virEventThreadProbe *probe = evt->probeData;
+
+    if (!probe) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Event thread latency is not measured"));
+        return -1;
+    }
+
+    virEventThreadProbeRead(probe, latency);
+
+    return 0;
+}
+
+
+/**
+ * virEventThreadGetStall:
+ * @evt: the event thread
+ *
+ * Reports how long the latency probe of @evt is overdue, which for a
+ * loop blocked in a callback is roughly how long it has been blocked.
+ *
+ * Returns the delay in microseconds, 0 if the probe isn't overdue or
+ * wasn't started.
+ */
+unsigned long long
+virEventThreadGetStall(virEventThread *evt)
+{
+    virEventThreadProbe *probe = evt->probeData;
+    gint64 now = g_get_monotonic_time();
+    unsigned long long ret = 0;
+
+    if (!probe)
+        return 0;
+
+    g_mutex_lock(&probe->lock);
+    if (now > probe->due)
+        ret = now - probe->due;
+    g_mutex_unlock(&probe->lock);
+
+    return ret;
+}
+
+
+static virMutex defaultProbeLock = VIR_MUTEX_INITIALIZER;
+static virEventThreadProbe *defaultProbe;
+
+
+/**
+ * virEventThreadStartDefaultLatencyProbe:
+ *
+ * Like virEventThreadStartLatencyProbe, but measures the default main
+ * loop, the one run by virEventRunDefaultImpl.
+ */
+void
+virEventThreadStartDefaultLatencyProbe(void)
+{
+    virMutexLock(&defaultProbeLock);
+    if (!defaultProbe) {
+        GSource *source = virEventThreadProbeAttach(g_main_context_default(),
+                                                    &defaultProbe);
+        /* the probe lives as long as the process */
+        g_source_unref(source);
+    }
+    virMutexUnlock(&defaultProbeLock);
+}
+
+
+/**
+ * virEventThreadGetDefaultLatency:
+ * @latency: filled with the statistics
+ *
+ * Reports the dispatch delays of the default main loop measured since
+ * virEventThreadStartDefaultLatencyProbe was called, in microseconds.
+ *
+ * Returns 0 on success, -1 if the probe wasn't started.
+ */
+int
+virEventThreadGetDefaultLatency(virEventThreadLatency *latency)
+{
+    int ret = -1;
+
+    virMutexLock(&defaultProbeLock);
+    if (!defaultProbe) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Main loop latency is not measured"));
+        goto cleanup;
+    }
+
+    virEventThreadProbeRead(defaultProbe, latency);
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&defaultProbeLock);
+    return ret;
+}
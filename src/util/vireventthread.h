@@ -21,6 +21,7 @@
 #pragma once
 
 #include "internal.h"
+#include "virbitmap.h"
 #include <glib-object.h>
 
 #define VIR_TYPE_EVENT_THREAD vir_event_thread_get_type()
@@ -29,3 +30,24 @@ G_DECLARE_FINAL_TYPE(virEventThread, vir_event_thread, VIR, EVENT_THREAD, GObjec
 virEventThread *virEventThreadNew(const char *name);
 
 GMainContext *virEventThreadGetContext(virEventThread *evt);
+
+void virEventThreadSetAffinity(virEventThread *evt,
+                               virBitmapPtr cpus);
+
+typedef struct _virEventThreadLatency virEventThreadLatency;
+struct _virEventThreadLatency {
+    unsigned long long samples;
+    unsigned long long avg; /* in microseconds */
+    unsigned long long max; /* in microseconds */
+};
+
+void virEventThreadStartLatencyProbe(virEventThread *evt);
+
+int virEventThreadGetLatency(virEventThread *evt,
+                             virEventThreadLatency *latency);
+
+unsigned long long virEventThreadGetStall(virEventThread *evt);
+
+void virEventThreadStartDefaultLatencyProbe(void);
+
+int virEventThreadGetDefaultLatency(virEventThreadLatency *latency);
@@ -47,6 +47,15 @@
 VIR_LOG_INIT("fdstream");
 
 #ifndef WIN32
+/* Size of the data messages queued by the reading thread */
+# define VIR_FDSTREAM_BUFLEN (1024 * 1024)
+
+/* Number of messages the reading thread queues ahead of the consumer */
+# define VIR_FDSTREAM_QUEUE_MAX 4
+
+/* Number of sections looked up at once in sparse files */
+# define VIR_FDSTREAM_EXTENTS_MAX 64
+
 typedef enum {
     VIR_FDSTREAM_MSG_TYPE_DATA,
     VIR_FDSTREAM_MSG_TYPE_HOLE,
@@ -109,6 +118,7 @@ struct virFDStreamData {
     bool threadAbort;
     bool threadDoRead;
     virFDStreamMsgPtr msg;
+    size_t nmsgs;
 };
 
 static virClassPtr virFDStreamDataClass;
@@ -151,6 +161,7 @@ virFDStreamMsgQueuePush(virFDStreamDataPtr fdst,
         tmp = &(*tmp)->next;
 
     *tmp = msg;
+    fdst->nmsgs++;
     virCondSignal(&fdst->threadCond);
 
     if (safewrite(fd, &c, sizeof(c)) != sizeof(c)) {
@@ -175,6 +186,7 @@ virFDStreamMsgQueuePop(virFDStreamDataPtr fdst,
     if (tmp) {
         fdst->msg = tmp->next;
         tmp->next = NULL;
+        fdst->nmsgs--;
     }
 
     virCondSignal(&fdst->threadCond);
@@ -403,6 +415,25 @@ struct _virFDStreamThreadData {
 };
 
 
+typedef struct _virFDStreamExtent virFDStreamExtent;
+struct _virFDStreamExtent {
+    bool data;
+    long long len;
+};
+
+/* Data and hole sections following the current position of a sparse
+ * file, looked up in batches so that streams of large sparse files don't
+ * have to seek back and forth around every section. */
+typedef struct _virFDStreamExtentMap virFDStreamExtentMap;
+typedef virFDStreamExtentMap *virFDStreamExtentMapPtr;
+struct _virFDStreamExtentMap {
+    virFDStreamExtent extents[VIR_FDSTREAM_EXTENTS_MAX];
+    size_t nextents;
+    size_t next;
+    bool eof; /* the last extent ends at EOF */
+};
+
+
 static void
 virFDStreamThreadDataFree(virFDStreamThreadDataPtr data)
 {
@@ -416,6 +447,147 @@ virFDStreamThreadDataFree(virFDStreamThreadDataPtr data)
 }
 
 
+# if HAVE_DECL_SEEK_HOLE
+/**
+ * virFDStreamExtentMapFill:
+ * @map: extent map to fill
+ * @fd: file to examine
+ * @fdname: name of @fd for error messages
+ *
+ * Looks up the sections of @fd following its current position, up to
+ * VIR_FDSTREAM_EXTENTS_MAX of them. Like virFileInData, the position
+ * in @fd is left unchanged.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int
+virFDStreamExtentMapFill(virFDStreamExtentMapPtr map,
+                         int fd,
+                         const char *fdname)
+{
+    off_t cur;
+    off_t pos;
+    int ret = -1;
+
+    map->nextents = 0;
+    map->next = 0;
+
+    if ((cur = lseek(fd, 0, SEEK_CUR)) == (off_t) -1) {
+        virReportSystemError(errno,
+                             _("unable to get current position in %s"),
+                             fdname);
+        return -1;
+    }
+
+    pos = cur;
+    while (map->nextents < VIR_FDSTREAM_EXTENTS_MAX - 1) {
+        off_t data;
+        off_t hole;
+
+        if ((data = lseek(fd, pos, SEEK_DATA)) == (off_t) -1) {
+            off_t end;
+
+            if (errno != ENXIO) {
+                virReportSystemError(errno,
+                                     _("unable to seek to data in %s"),
+                                     fdname);
+                goto cleanup;
+            }
+
+            /* trailing hole, or nothing at all at EOF */
+            if ((end = lseek(fd, 0, SEEK_END)) == (off_t) -1) {
+                virReportSystemError(errno,
+                                     _("unable to seek to EOF in %s"),
+                                     fdname);
+                goto cleanup;
+            }
+
+            if (end > pos) {
+                map->extents[map->nextents].data = false;
+                map->extents[map->nextents++].len = end - pos;
+            }
+            map->eof = true;
+            break;
+        }
+
+        if (data > pos) {
+            map->extents[map->nextents].data = false;
+            map->extents[map->nextents++].len = data - pos;
+        }
+
+        if ((hole = lseek(fd, data, SEEK_HOLE)) == (off_t) -1 ||
+            hole == data) {
+            virReportSystemError(errno,
+                                 _("unable to seek to hole in %s"),
+                                 fdname);
+            goto cleanup;
+        }
+
+        map->extents[map->nextents].data = true;
+        map->extents[map->nextents++].len = hole - data;
+        pos = hole;
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (lseek(fd, cur, SEEK_SET) == (off_t) -1) {
+        virReportSystemError(errno,
+                             _("unable to restore position in %s"),
+                             fdname);
+        ret = -1;
+    }
+    return ret;
+}
+
+# else /* !HAVE_DECL_SEEK_HOLE */
+
+static int
+virFDStreamExtentMapFill(virFDStreamExtentMapPtr map G_GNUC_UNUSED,
+                         int fd G_GNUC_UNUSED,
+                         const char *fdname G_GNUC_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("sparse files not supported"));
+    return -1;
+}
+# endif /* !HAVE_DECL_SEEK_HOLE */
+
+
+/* Returns the section starting at the current position of @fd, the
+ * same way virFileInData does. */
+static int
+virFDStreamExtentMapNext(virFDStreamExtentMapPtr map,
+                         int fd,
+                         const char *fdname,
+                         int *inData,
+                         long long *length)
+{
+    if (map->next == map->nextents) {
+        if (map->eof) {
+            /* implicit hole at EOF */
+            *inData = 0;
+            *length = 0;
+            return 0;
+        }
+
+        if (virFDStreamExtentMapFill(map, fd, fdname) < 0)
+            return -1;
+
+        if (map->nextents == 0) {
+            *inData = 0;
+            *length = 0;
+            return 0;
+        }
+    }
+
+    *inData = map->extents[map->next].data;
+    *length = map->extents[map->next].len;
+    map->next++;
+    return 0;
+}
+
+
 static ssize_t
 virFDStreamThreadDoRead(virFDStreamDataPtr fdst,
                         bool sparse,
@@ -425,6 +597,7 @@ virFDStreamThreadDoRead(virFDStreamDataPtr fdst,
                         const char *fdoutname,
                         size_t length,
                         size_t total,
+                        virFDStreamExtentMapPtr extents,
                         size_t *dataLen,
                         size_t buflen)
 {
@@ -435,7 +608,8 @@ virFDStreamThreadDoRead(virFDStreamDataPtr fdst,
     ssize_t got;
 
     if (sparse && *dataLen == 0) {
-        if (virFileInData(fdin, &inData, &sectionLen) < 0)
+        if (virFDStreamExtentMapNext(extents, fdin, fdinname,
+                                     &inData, &sectionLen) < 0)
             goto error;
 
         if (length &&
@@ -581,9 +755,10 @@ virFDStreamThread(void *opaque)
     char *fdoutname = data->fdoutname;
     virFDStreamDataPtr fdst = st->privateData;
     bool doRead = fdst->threadDoRead;
-    size_t buflen = 256 * 1024;
+    size_t buflen = VIR_FDSTREAM_BUFLEN;
     size_t total = 0;
     size_t dataLen = 0;
+    virFDStreamExtentMap extents = { .nextents = 0 };
 
     virObjectRef(fdst);
     virObjectLock(fdst);
@@ -591,7 +766,10 @@ virFDStreamThread(void *opaque)
     while (1) {
         ssize_t got;
 
-        while (doRead == (fdst->msg != NULL) &&
+        /* When reading, keep a few messages queued ahead so that the
+         * consumer doesn't have to wait for each read */
+        while ((doRead ? fdst->nmsgs >= VIR_FDSTREAM_QUEUE_MAX :
+                         fdst->msg == NULL) &&
                !fdst->threadQuit) {
             if (virCondWait(&fdst->threadCond, &fdst->parent.lock)) {
                 virReportSystemError(errno, "%s",
@@ -615,7 +793,7 @@ virFDStreamThread(void *opaque)
                                           fdin, fdout,
                                           fdinname, fdoutname,
                                           length, total,
-                                          &dataLen, buflen);
+                                          &extents, &dataLen, buflen);
         else
             got = virFDStreamThreadDoWrite(fdst, sparse,
                                            fdin, fdout,
@@ -34,6 +34,7 @@
 #include "virlog.h"
 #include "virobject.h"
 #include "virstring.h"
+#include "virthread.h"
 
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -55,6 +56,19 @@ struct _virFileCache {
     void *priv;
 
     virFileCacheHandlers handlers;
+
+    /* names of data which are being recreated by a background thread,
+     * see virFileCacheSetRefreshAsync() */
+    bool refreshAsync;
+    virHashTablePtr refreshing;
+};
+
+
+typedef struct _virFileCacheRefreshData virFileCacheRefreshData;
+typedef virFileCacheRefreshData *virFileCacheRefreshDataPtr;
+struct _virFileCacheRefreshData {
+    virFileCachePtr cache;
+    char *name;
 };
 
 
@@ -78,6 +92,7 @@ virFileCacheDispose(void *obj)
     VIR_FREE(cache->suffix);
 
     virHashFree(cache->table);
+    virHashFree(cache->refreshing);
 
     virFileCachePrivFree(cache);
 }
@@ -245,6 +260,9 @@ virFileCacheNew(const char *dir,
     if (!(cache->table = virHashCreate(10, virObjectFreeHashData)))
         goto cleanup;
 
+    if (!(cache->refreshing = virHashCreate(10, NULL)))
+        goto cleanup;
+
     cache->dir = g_strdup(dir);
 
     cache->suffix = g_strdup(suffix);
@@ -259,12 +277,99 @@ virFileCacheNew(const char *dir,
 }
 
 
+static void
+virFileCacheRefreshThread(void *opaque)
+{
+    virFileCacheRefreshDataPtr refresh = opaque;
+    virFileCachePtr cache = refresh->cache;
+    void *data;
+
+    VIR_DEBUG("Refreshing data for '%s'", refresh->name);
+
+    /* The cached file is at least as old as the data in memory which were
+     * found invalid, there's no point in loading it. */
+    if ((data = cache->handlers.newData(refresh->name, cache->priv)) &&
+        virFileCacheSave(cache, refresh->name, data) < 0) {
+        virObjectUnref(data);
+        data = NULL;
+    }
+
+    virObjectLock(cache);
+
+    if (data) {
+        VIR_DEBUG("Caching refreshed data '%p' for '%s'", data, refresh->name);
+        if (virHashUpdateEntry(cache->table, refresh->name, data) < 0)
+            virObjectUnref(data);
+    } else {
+        /* Drop the stale data so that the next lookup creates them
+         * synchronously and reports the error to its caller. */
+        VIR_WARN("Failed to refresh data for '%s': %s",
+                 refresh->name, virGetLastErrorMessage());
+        virResetLastError();
+        virHashRemoveEntry(cache->table, refresh->name);
+    }
+
+    virHashRemoveEntry(cache->refreshing, refresh->name);
+
+    virObjectUnlock(cache);
+
+    virObjectUnref(cache);
+    g_free(refresh->name);
+    g_free(refresh);
+}
+
+
+/*
+ * Starts recreating data for @name in a background thread unless it is
+ * already being done. Returns 0 when the data is (being) refreshed, -1
+ * if the caller has to recreate the data itself.
+ */
+static int
+virFileCacheRefresh(virFileCachePtr cache,
+                    const char *name)
+{
+    virFileCacheRefreshDataPtr refresh;
+    virThread thread;
+
+    if (virHashLookup(cache->refreshing, name))
+        return 0;
+
+    if (virHashAddEntry(cache->refreshing, name, (void *)1) < 0) {
+        virResetLastError();
+        return -1;
+    }
+
+    refresh = g_new0(virFileCacheRefreshData, 1);
+    refresh->cache = virObjectRef(cache);
+    refresh->name = g_strdup(name);
+
+    if (virThreadCreateFull(&thread, false, virFileCacheRefreshThread,
+                            "filecache-refresh", false, refresh) < 0) {
+        VIR_WARN("Failed to create thread refreshing data for '%s'", name);
+        virHashRemoveEntry(cache->refreshing, name);
+        virObjectUnref(cache);
+        g_free(refresh->name);
+        g_free(refresh);
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static void
 virFileCacheValidate(virFileCachePtr cache,
                      const char *name,
                      void **data)
 {
     if (*data && !cache->handlers.isValid(*data, cache->priv)) {
+        if (name && cache->refreshAsync &&
+            virFileCacheRefresh(cache, name) == 0) {
+            VIR_DEBUG("Using outdated data '%p' for '%s' until refreshed",
+                      *data, name);
+            return;
+        }
+
         VIR_DEBUG("Cached data '%p' no longer valid for '%s'",
                   *data, NULLSTR(name));
         if (name)
@@ -390,6 +495,31 @@ virFileCacheSetPriv(virFileCachePtr cache,
 }
 
 
+/**
+ * virFileCacheSetRefreshAsync:
+ * @cache: existing cache object
+ * @enable: whether to refresh outdated data in the background
+ *
+ * By default a lookup which finds outdated data in @cache recreates
+ * them before returning. With @enable set, the lookup returns the
+ * outdated data instead and a background thread recreates them. Data
+ * which are not in @cache yet are always created by the lookup itself.
+ *
+ * The background thread calls newData() and saveFile() without holding
+ * the lock of @cache, these handlers must not modify @priv.
+ */
+void
+virFileCacheSetRefreshAsync(virFileCachePtr cache,
+                            bool enable)
+{
+    virObjectLock(cache);
+
+    cache->refreshAsync = enable;
+
+    virObjectUnlock(cache);
+}
+
+
 /**
  * virFileCacheInsertData:
  * @cache: existing cache object
@@ -133,6 +133,10 @@ void
 virFileCacheSetPriv(virFileCachePtr cache,
                     void *priv);
 
+void
+virFileCacheSetRefreshAsync(virFileCachePtr cache,
+                            bool enable);
+
 int
 virFileCacheInsertData(virFileCachePtr cache,
                        const char *name,
@@ -48,6 +48,14 @@ VIR_ENUM_IMPL(virFirewallLayerCommand,
               IP6TABLES_PATH,
 );
 
+VIR_ENUM_DECL(virFirewallLayerRestoreCommand);
+VIR_ENUM_IMPL(virFirewallLayerRestoreCommand,
+              VIR_FIREWALL_LAYER_LAST,
+              EBTABLES_RESTORE_PATH,
+              IPTABLES_RESTORE_PATH,
+              IP6TABLES_RESTORE_PATH,
+);
+
 struct _virFirewallRule {
     virFirewallLayer layer;
 
@@ -100,6 +108,7 @@ static bool iptablesUseLock;
 static bool ip6tablesUseLock;
 static bool ebtablesUseLock;
 static bool lockOverride; /* true to avoid lock probes */
+static bool restoreUsable[VIR_FIREWALL_LAYER_LAST];
 
 void
 virFirewallSetLockOverride(bool avoid)
@@ -143,9 +152,60 @@ virFirewallCheckUpdateLocking(void)
                                ebtablesArgs);
 }
 
+/*
+ * Checks which layers can be changed with a single *-restore
+ * invocation. Returns true if any of them can.
+ */
+static bool
+virFirewallCheckUpdateRestore(void)
+{
+    bool useLock[VIR_FIREWALL_LAYER_LAST] = {
+        [VIR_FIREWALL_LAYER_ETHERNET] = false,
+        [VIR_FIREWALL_LAYER_IPV4] = iptablesUseLock,
+        [VIR_FIREWALL_LAYER_IPV6] = ip6tablesUseLock,
+    };
+    bool any = false;
+    size_t i;
+
+    for (i = 0; i < VIR_FIREWALL_LAYER_LAST; i++) {
+        const char *bin = virFirewallLayerRestoreCommandTypeToString(i);
+        g_autoptr(virCommand) cmd = NULL;
+        int status;
+
+        restoreUsable[i] = false;
+
+        if (!virFileIsExecutable(bin))
+            continue;
+
+        /* tests request the batching backend explicitly */
+        if (lockOverride) {
+            restoreUsable[i] = any = true;
+            continue;
+        }
+
+        /* the legacy ebtables-restore doesn't understand the input
+         * format used by virFirewallApplyRulesRestore */
+        cmd = virCommandNewArgList(bin, "--noflush", NULL);
+        if (useLock[i])
+            virCommandAddArg(cmd, "-w");
+        virCommandSetInputBuffer(cmd, "*filter\nCOMMIT\n");
+        if (virCommandRun(cmd, &status) < 0 || status) {
+            VIR_INFO("%s cannot be used to batch rules", bin);
+            continue;
+        }
+
+        VIR_INFO("batching rules with %s", bin);
+        restoreUsable[i] = any = true;
+    }
+
+    return any;
+}
+
 static int
 virFirewallValidateBackend(virFirewallBackend backend)
 {
+    bool tryRestore = backend == VIR_FIREWALL_BACKEND_DIRECT_RESTORE;
+
     VIR_DEBUG("Validating backend %d", backend);
     if (backend == VIR_FIREWALL_BACKEND_AUTOMATIC ||
         backend == VIR_FIREWALL_BACKEND_FIREWALLD) {
@@ -161,6 +221,8 @@ virFirewallValidateBackend(virFirewallBackend backend)
                 } else {
                     VIR_DEBUG("firewalld service not running, trying direct backend");
                     backend = VIR_FIREWALL_BACKEND_DIRECT;
+                    /* lock probes are avoided in tests, so is batching */
+                    tryRestore = !lockOverride;
                 }
             } else {
                 return -1;
@@ -171,7 +233,8 @@ virFirewallValidateBackend(virFirewallBackend backend)
         }
     }
 
-    if (backend == VIR_FIREWALL_BACKEND_DIRECT) {
+    if (backend == VIR_FIREWALL_BACKEND_DIRECT ||
+        backend == VIR_FIREWALL_BACKEND_DIRECT_RESTORE) {
         const char *commands[] = {
             IPTABLES_PATH, IP6TABLES_PATH, EBTABLES_PATH
         };
@@ -192,6 +255,15 @@ virFirewallValidateBackend(virFirewallBackend backend)
 
     virFirewallCheckUpdateLocking();
 
+    if (tryRestore) {
+        if (virFirewallCheckUpdateRestore()) {
+            currentBackend = VIR_FIREWALL_BACKEND_DIRECT_RESTORE;
+        } else {
+            VIR_DEBUG("no usable *-restore tools, not batching rules");
+            currentBackend = VIR_FIREWALL_BACKEND_DIRECT;
+        }
+    }
+
     return 0;
 }
 
@@ -723,6 +795,7 @@ virFirewallApplyRule(virFirewallPtr firewall,
 
     switch (currentBackend) {
     case VIR_FIREWALL_BACKEND_DIRECT:
+    case VIR_FIREWALL_BACKEND_DIRECT_RESTORE:
         if (virFirewallApplyRuleDirect(rule, ignoreErrors, &output) < 0)
             return -1;
         break;
@@ -761,6 +834,141 @@ virFirewallApplyRule(virFirewallPtr firewall,
     return 0;
 }
 
+/*
+ * Looks up the table @rule changes and the position of the arguments
+ * naming it. Returns false if the rule cannot be fed to *-restore:
+ * the restore tools stop at the first failing line, so rules whose
+ * failure is ignored or whose output is needed are run on their own.
+ */
+static bool
+virFirewallRuleCanRestore(virFirewallRulePtr rule,
+                          bool ignoreErrors,
+                          const char **table,
+                          ssize_t *tableArg)
+{
+    size_t i;
+
+    if (ignoreErrors || rule->ignoreErrors || rule->queryCB ||
+        !restoreUsable[rule->layer])
+        return false;
+
+    *table = "filter";
+    *tableArg = -1;
+
+    for (i = 0; i < rule->argsLen; i++) {
+        const char *arg = rule->args[i];
+
+        if (STREQ(arg, "--table") || STREQ(arg, "-t")) {
+            if (i + 1 == rule->argsLen || *tableArg >= 0)
+                return false;
+            *tableArg = i;
+            *table = rule->args[++i];
+            continue;
+        }
+
+        /* these are only understood on the command line */
+        if (STREQ(arg, "-L") || STREQ(arg, "--list") ||
+            STREQ(arg, "-S") || STREQ(arg, "--list-rules"))
+            return false;
+
+        /* arguments with spaces need quoting, which ebtables-restore
+         * doesn't support and iptables-restore only without quotes
+         * inside the argument */
+        if (strpbrk(arg, " \t")) {
+            if (rule->layer == VIR_FIREWALL_LAYER_ETHERNET ||
+                strpbrk(arg, "\"'"))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+
+/*
+ * Applies the @nrules rules starting at @rules, all of them of the
+ * same layer, with a single invocation of the matching restore tool.
+ */
+static int
+virFirewallApplyRulesRestore(virFirewallRulePtr *rules,
+                             size_t nrules)
+{
+    virFirewallLayer layer = rules[0]->layer;
+    const char *bin = virFirewallLayerRestoreCommandTypeToString(layer);
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autoptr(virCommand) cmd = NULL;
+    g_autofree char *input = NULL;
+    g_autofree char *error = NULL;
+    const char *curTable = NULL;
+    const char *sep;
+    int status;
+    size_t i, j;
+
+    for (i = 0; i < nrules; i++) {
+        virFirewallRulePtr rule = rules[i];
+        const char *table;
+        ssize_t tableArg;
+
+        ignore_value(virFirewallRuleCanRestore(rule, false, &table, &tableArg));
+
+        if (!curTable || STRNEQ(curTable, table)) {
+            if (curTable)
+                virBufferAddLit(&buf, "COMMIT\n");
+            virBufferAsprintf(&buf, "*%s\n", table);
+            curTable = table;
+        }
+
+        for (j = 0, sep = ""; j < rule->argsLen; j++) {
+            const char *arg = rule->args[j];
+
+            if ((ssize_t)j == tableArg) {
+                j++;
+                continue;
+            }
+
+            /* the lock is taken by the restore tool itself */
+            if (j == 0 &&
+                (STREQ(arg, "-w") || STREQ(arg, "--concurrent")))
+                continue;
+
+            virBufferAdd(&buf, sep, -1);
+            sep = " ";
+
+            if (strpbrk(arg, " \t"))
+                virBufferAsprintf(&buf, "\"%s\"", arg);
+            else
+                virBufferAdd(&buf, arg, -1);
+        }
+        virBufferAddChar(&buf, '\n');
+    }
+    virBufferAddLit(&buf, "COMMIT\n");
+
+    input = virBufferContentAndReset(&buf);
+    VIR_INFO("Applying %zu rules with %s", nrules, bin);
+    VIR_DEBUG("Rules:\n%s", input);
+
+    cmd = virCommandNewArgList(bin, "--noflush", NULL);
+    if ((layer == VIR_FIREWALL_LAYER_IPV4 && iptablesUseLock) ||
+        (layer == VIR_FIREWALL_LAYER_IPV6 && ip6tablesUseLock))
+        virCommandAddArg(cmd, "-w");
+
+    virCommandSetInputBuffer(cmd, input);
+    virCommandSetErrorBuffer(cmd, &error);
+
+    if (virCommandRun(cmd, &status) < 0)
+        return -1;
+
+    if (status != 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Failed to apply firewall rules %s: %s"),
+                       input, NULLSTR(error));
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 virFirewallApplyGroup(virFirewallPtr firewall,
                       size_t idx)
@@ -774,6 +982,29 @@ virFirewallApplyGroup(virFirewallPtr firewall,
     firewall->currentGroup = idx;
     group->addingRollback = false;
     for (i = 0; i < group->naction; i++) {
+        const char *table;
+        ssize_t tableArg;
+
+        if (currentBackend == VIR_FIREWALL_BACKEND_DIRECT_RESTORE &&
+            virFirewallRuleCanRestore(group->action[i], ignoreErrors,
+                                      &table, &tableArg)) {
+            size_t n = 1;
+
+            /* batch all following rules of the same layer, keeping
+             * the order with respect to the others */
+            while (i + n < group->naction &&
+                   group->action[i + n]->layer == group->action[i]->layer &&
+                   virFirewallRuleCanRestore(group->action[i + n], ignoreErrors,
+                                             &table, &tableArg))
+                n++;
+
+            if (virFirewallApplyRulesRestore(group->action + i, n) < 0)
+                return -1;
+
+            i += n - 1;
+            continue;
+        }
+
         if (virFirewallApplyRule(firewall,
                                  group->action[i],
                                  ignoreErrors) < 0)
@@ -30,6 +30,7 @@ typedef enum {
     VIR_FIREWALL_BACKEND_AUTOMATIC,
     VIR_FIREWALL_BACKEND_DIRECT,
     VIR_FIREWALL_BACKEND_FIREWALLD,
+    VIR_FIREWALL_BACKEND_DIRECT_RESTORE, /* direct, batched via *-restore */
 
     VIR_FIREWALL_BACKEND_LAST,
 } virFirewallBackend;
@@ -1,7 +1,8 @@
 /*
- * virhash.c: chained hash tables
+ * virhash.c: chained and open addressing hash tables
  *
  * Reference: Your favorite introductory book on algorithms
+ *            Celis, "Robin Hood Hashing", 1986
  *
  * Copyright (C) 2005-2014 Red Hat, Inc.
  * Copyright (C) 2000 Bjorn Reese and Daniel Veillard.
@@ -47,11 +48,30 @@ struct _virHashEntry {
     void *payload;
 };
 
+/*
+ * A slot of an open addressing hash table. The hash code of the key
+ * is kept inline so that probing rarely needs to look at the key
+ * itself.
+ */
+typedef struct _virHashSlot virHashSlot;
+typedef virHashSlot *virHashSlotPtr;
+struct _virHashSlot {
+    uint32_t code;
+    uint32_t dist; /* 1 + distance from the home slot, 0 if empty */
+    void *name;
+    void *payload;
+};
+
+/* Open addressing tables are grown once they are 7/8 full */
+#define VIR_HASH_OPEN_LOAD_NUM 7
+#define VIR_HASH_OPEN_LOAD_DEN 8
+
 /*
  * The entire hash table
  */
 struct _virHashTable {
     virHashEntryPtr *table;
+    virHashSlotPtr slots; /* used instead of @table for open addressing */
     uint32_t seed;
     size_t size;
     size_t nbElems;
@@ -125,6 +145,48 @@ virHashComputeKey(const virHashTable *table, const void *name)
     return value % table->size;
 }
 
+static virHashTablePtr
+virHashCreateInternal(ssize_t size,
+                      unsigned int flags,
+                      virHashDataFree dataFree,
+                      virHashKeyCode keyCode,
+                      virHashKeyEqual keyEqual,
+                      virHashKeyCopy keyCopy,
+                      virHashKeyPrintHuman keyPrint,
+                      virHashKeyFree keyFree)
+{
+    virHashTablePtr table = NULL;
+
+    if (size <= 0)
+        size = 256;
+
+    table = g_new0(virHashTable, 1);
+
+    table->seed = virRandomBits(32);
+    table->size = size;
+    table->nbElems = 0;
+    table->dataFree = dataFree;
+    table->keyCode = keyCode;
+    table->keyEqual = keyEqual;
+    table->keyCopy = keyCopy;
+    table->keyPrint = keyPrint;
+    table->keyFree = keyFree;
+
+    if (flags & VIR_HASH_OPEN_ADDRESSING) {
+        /* probing relies on the size being a power of two */
+        table->size = 8;
+        while (table->size < (size_t) size)
+            table->size <<= 1;
+
+        table->slots = g_new0(virHashSlot, table->size);
+    } else {
+        table->table = g_new0(virHashEntryPtr, table->size);
+    }
+
+    return table;
+}
+
+
 /**
  * virHashCreateFull:
  * @size: the size of the hash table
@@ -146,26 +208,8 @@ virHashTablePtr virHashCreateFull(ssize_t size,
                                   virHashKeyPrintHuman keyPrint,
                                   virHashKeyFree keyFree)
 {
-    virHashTablePtr table = NULL;
-
-    if (size <= 0)
-        size = 256;
-
-    table = g_new0(virHashTable, 1);
-
-    table->seed = virRandomBits(32);
-    table->size = size;
-    table->nbElems = 0;
-    table->dataFree = dataFree;
-    table->keyCode = keyCode;
-    table->keyEqual = keyEqual;
-    table->keyCopy = keyCopy;
-    table->keyPrint = keyPrint;
-    table->keyFree = keyFree;
-
-    table->table = g_new0(virHashEntryPtr, table->size);
-
-    return table;
+    return virHashCreateInternal(size, 0, dataFree, keyCode, keyEqual,
+                                 keyCopy, keyPrint, keyFree);
 }
 
 
@@ -190,6 +234,36 @@ virHashNew(virHashDataFree dataFree)
 }
 
 
+/**
+ * virHashNewFlags:
+ * @dataFree: callback to free data
+ * @flags: bitwise-OR of virHashFlags
+ *
+ * Create a new virHashTablePtr keyed by strings. With
+ * VIR_HASH_OPEN_ADDRESSING the entries are stored inline in a single
+ * array probed with Robin Hood hashing, which avoids an allocation per
+ * entry and keeps lookups and iteration within contiguous memory. The
+ * table behaves the same as one returned by virHashNew otherwise.
+ *
+ * Returns the newly created object or NULL on error.
+ */
+virHashTablePtr
+virHashNewFlags(virHashDataFree dataFree,
+                unsigned int flags)
+{
+    virCheckFlags(VIR_HASH_OPEN_ADDRESSING, NULL);
+
+    return virHashCreateInternal(32,
+                                 flags,
+                                 dataFree,
+                                 virHashStrCode,
+                                 virHashStrEqual,
+                                 virHashStrCopy,
+                                 virHashStrPrintHuman,
+                                 virHashStrFree);
+}
+
+
 /**
  * virHashCreate:
  * @size: the size of the hash table
@@ -303,6 +377,168 @@ virHashGrow(virHashTablePtr table, size_t size)
     return 0;
 }
 
+
+/*
+ * Open addressing tables keep the Robin Hood invariant: an entry is
+ * never further from its home slot than the entry preceding it is from
+ * that entry's home slot plus one. Lookups can therefore stop as soon
+ * as they meet an entry closer to home than the probe, and removal
+ * shifts the following run of displaced entries one slot back instead
+ * of leaving tombstones.
+ */
+static void
+virHashOpenInsert(virHashTablePtr table,
+                  virHashSlot entry)
+{
+    size_t mask = table->size - 1;
+    size_t i = entry.code & mask;
+
+    entry.dist = 1;
+
+    while (table->slots[i].dist != 0) {
+        if (table->slots[i].dist < entry.dist) {
+            virHashSlot tmp = table->slots[i];
+
+            table->slots[i] = entry;
+            entry = tmp;
+        }
+
+        i = (i + 1) & mask;
+        entry.dist++;
+    }
+
+    table->slots[i] = entry;
+}
+
+
+static void
+virHashOpenGrow(virHashTablePtr table)
+{
+    virHashSlotPtr oldslots = table->slots;
+    size_t oldsize = table->size;
+    size_t i;
+
+    table->size = oldsize * 2;
+    table->slots = g_new0(virHashSlot, table->size);
+
+    for (i = 0; i < oldsize; i++) {
+        if (oldslots[i].dist != 0)
+            virHashOpenInsert(table, oldslots[i]);
+    }
+
+    g_free(oldslots);
+}
+
+
+static virHashSlotPtr
+virHashOpenGetSlot(const virHashTable *table,
+                   const void *name)
+{
+    uint32_t code = table->keyCode(name, table->seed);
+    size_t mask = table->size - 1;
+    size_t i = code & mask;
+    uint32_t dist = 1;
+
+    while (table->slots[i].dist >= dist) {
+        virHashSlotPtr slot = table->slots + i;
+
+        if (slot->code == code &&
+            table->keyEqual(slot->name, name))
+            return slot;
+
+        i = (i + 1) & mask;
+        dist++;
+    }
+
+    return NULL;
+}
+
+
+static void
+virHashOpenRemoveSlot(virHashTablePtr table,
+                      size_t i)
+{
+    size_t mask = table->size - 1;
+
+    if (table->dataFree)
+        table->dataFree(table->slots[i].payload);
+    if (table->keyFree)
+        table->keyFree(table->slots[i].name);
+
+    while (table->slots[(i + 1) & mask].dist > 1) {
+        size_t next = (i + 1) & mask;
+
+        table->slots[i] = table->slots[next];
+        table->slots[i].dist--;
+        i = next;
+    }
+
+    memset(table->slots + i, 0, sizeof(table->slots[i]));
+    table->nbElems--;
+}
+
+
+/*
+ * Iteration starts right after an empty slot. Removing an entry then
+ * only ever shifts entries which were not visited yet into its place,
+ * because the shifted run ends before the next empty slot.
+ */
+static size_t
+virHashOpenIterStart(const virHashTable *table)
+{
+    size_t i;
+
+    for (i = 0; i < table->size; i++) {
+        if (table->slots[i].dist == 0)
+            break;
+    }
+
+    return i;
+}
+
+
+static int
+virHashOpenAddOrUpdateEntry(virHashTablePtr table,
+                            const void *name,
+                            void *userdata,
+                            bool is_update)
+{
+    virHashSlotPtr slot;
+    virHashSlot entry = { 0 };
+
+    if ((slot = virHashOpenGetSlot(table, name))) {
+        if (is_update) {
+            if (table->dataFree)
+                table->dataFree(slot->payload);
+            slot->payload = userdata;
+            return 0;
+        } else {
+            g_autofree char *keystr = NULL;
+
+            if (table->keyPrint)
+                keystr = table->keyPrint(name);
+
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Duplicate hash table key '%s'"), NULLSTR(keystr));
+            return -1;
+        }
+    }
+
+    if ((table->nbElems + 1) * VIR_HASH_OPEN_LOAD_DEN >
+        table->size * VIR_HASH_OPEN_LOAD_NUM)
+        virHashOpenGrow(table);
+
+    entry.code = table->keyCode(name, table->seed);
+    entry.name = table->keyCopy(name);
+    entry.payload = userdata;
+
+    virHashOpenInsert(table, entry);
+    table->nbElems++;
+
+    return 0;
+}
+
+
 /**
  * virHashFree:
  * @table: the hash table
@@ -318,6 +554,22 @@ virHashFree(virHashTablePtr table)
     if (table == NULL)
         return;
 
+    if (table->slots) {
+        for (i = 0; i < table->size; i++) {
+            if (table->slots[i].dist == 0)
+                continue;
+
+            if (table->dataFree)
+                table->dataFree(table->slots[i].payload);
+            if (table->keyFree)
+                table->keyFree(table->slots[i].name);
+        }
+
+        VIR_FREE(table->slots);
+        VIR_FREE(table);
+        return;
+    }
+
     for (i = 0; i < table->size; i++) {
         virHashEntryPtr iter = table->table[i];
         while (iter) {
@@ -348,6 +600,9 @@ virHashAddOrUpdateEntry(virHashTablePtr table, const void *name,
     if ((table == NULL) || (name == NULL))
         return -1;
 
+    if (table->slots)
+        return virHashOpenAddOrUpdateEntry(table, name, userdata, is_update);
+
     key = virHashComputeKey(table, name);
 
     /* Check for duplicate entry */
@@ -473,7 +728,15 @@ virHashGetEntry(const virHashTable *table,
 void *
 virHashLookup(const virHashTable *table, const void *name)
 {
-    virHashEntryPtr entry = virHashGetEntry(table, name);
+    virHashEntryPtr entry;
+
+    if (table && name && table->slots) {
+        virHashSlotPtr slot = virHashOpenGetSlot(table, name);
+
+        return slot ? slot->payload : NULL;
+    }
+
+    entry = virHashGetEntry(table, name);
 
     if (!entry)
         return NULL;
@@ -495,6 +758,9 @@ bool
 virHashHasEntry(const virHashTable *table,
                 const void *name)
 {
+    if (table && name && table->slots)
+        return !!virHashOpenGetSlot(table, name);
+
     return !!virHashGetEntry(table, name);
 }
 
@@ -590,6 +856,16 @@ virHashRemoveEntry(virHashTablePtr table, const void *name)
     if (table == NULL || name == NULL)
         return -1;
 
+    if (table->slots) {
+        virHashSlotPtr slot = virHashOpenGetSlot(table, name);
+
+        if (!slot)
+            return -1;
+
+        virHashOpenRemoveSlot(table, slot - table->slots);
+        return 0;
+    }
+
     nextptr = table->table + virHashComputeKey(table, name);
     for (entry = *nextptr; entry; entry = entry->next) {
         if (table->keyEqual(entry->name, name)) {
@@ -632,6 +908,31 @@ virHashForEach(virHashTablePtr table, virHashIterator iter, void *data)
     if (table == NULL || iter == NULL)
         return -1;
 
+    if (table->slots) {
+        size_t mask = table->size - 1;
+        size_t start = virHashOpenIterStart(table);
+
+        for (i = 1; i <= table->size; i++) {
+            virHashSlotPtr slot = table->slots + ((start + i) & mask);
+
+            /* visit the slot again if @iter removed its entry and an
+             * unvisited one was shifted in its place */
+            while (slot->dist != 0) {
+                void *name = slot->name;
+
+                ret = iter(slot->payload, name, data);
+
+                if (ret < 0)
+                    return ret;
+
+                if (slot->name == name)
+                    break;
+            }
+        }
+
+        return 0;
+    }
+
     for (i = 0; i < table->size; i++) {
         virHashEntryPtr entry = table->table[i];
         while (entry) {
@@ -672,6 +973,24 @@ virHashRemoveSet(virHashTablePtr table,
     if (table == NULL || iter == NULL)
         return -1;
 
+    if (table->slots) {
+        size_t mask = table->size - 1;
+        size_t start = virHashOpenIterStart(table);
+
+        for (i = 1; i <= table->size; i++) {
+            size_t pos = (start + i) & mask;
+
+            while (table->slots[pos].dist != 0 &&
+                   iter(table->slots[pos].payload,
+                        table->slots[pos].name, data)) {
+                count++;
+                virHashOpenRemoveSlot(table, pos);
+            }
+        }
+
+        return count;
+    }
+
     for (i = 0; i < table->size; i++) {
         virHashEntryPtr *nextptr = table->table + i;
 
@@ -746,6 +1065,21 @@ void *virHashSearch(const virHashTable *ctable,
     if (table == NULL || iter == NULL)
         return NULL;
 
+    if (table->slots) {
+        for (i = 0; i < table->size; i++) {
+            virHashSlotPtr slot = table->slots + i;
+
+            if (slot->dist != 0 &&
+                iter(slot->payload, slot->name, data)) {
+                if (name)
+                    *name = table->keyCopy(slot->name);
+                return slot->payload;
+            }
+        }
+
+        return NULL;
+    }
+
     for (i = 0; i < table->size; i++) {
         virHashEntryPtr entry;
         for (entry = table->table[i]; entry; entry = entry->next) {
@@ -108,10 +108,18 @@ typedef char *(*virHashKeyPrintHuman) (const void *name);
  */
 typedef void (*virHashKeyFree)(void *name);
 
+typedef enum {
+    /* Store entries in a flat open addressing table instead of
+     * chaining them in per-bucket lists */
+    VIR_HASH_OPEN_ADDRESSING = 1 << 0,
+} virHashFlags;
+
 /*
  * Constructor and destructor.
  */
 virHashTablePtr virHashNew(virHashDataFree dataFree);
+virHashTablePtr virHashNewFlags(virHashDataFree dataFree,
+                                unsigned int flags);
 virHashTablePtr virHashCreate(ssize_t size,
                               virHashDataFree dataFree);
 virHashAtomicPtr virHashAtomicNew(ssize_t size,
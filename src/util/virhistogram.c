@@ -0,0 +1,91 @@
+/*
+ * virhistogram.c: histograms of durations
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include "virhistogram.h"
+
+/* Upper limits in microseconds of the buckets, the last bucket counts
+ * everything longer. All histograms share them so that the latencies
+ * reported by different APIs are comparable. */
+static const unsigned long long virHistogramLimits[] = {
+    100, 250, 500,
+    1000, 2500, 5000,
+    10000, 25000, 50000,
+    100000, 250000, 500000,
+    1000000, 2500000, 5000000,
+    10000000,
+};
+G_STATIC_ASSERT(G_N_ELEMENTS(virHistogramLimits) + 1 == VIR_HISTOGRAM_BUCKETS);
+
+
+/**
+ * virHistogramRecord:
+ * @hist: histogram
+ * @usec: duration in microseconds
+ *
+ * Adds @usec to the bucket it falls into and to the total and maximum
+ * of @hist.
+ */
+void
+virHistogramRecord(virHistogramPtr hist,
+                   unsigned long long usec)
+{
+    size_t i;
+
+    for (i = 0; i < G_N_ELEMENTS(virHistogramLimits); i++) {
+        if (usec <= virHistogramLimits[i])
+            break;
+    }
+
+    hist->buckets[i]++;
+    hist->total += usec;
+    hist->max = MAX(hist->max, usec);
+}
+
+
+/**
+ * virHistogramAddLimits:
+ * @list: list to add the parameters to
+ * @prefix: prefix of the names of the parameters
+ *
+ * Adds the number of buckets as "<prefix>bucket.count" and their upper
+ * limits in microseconds as "<prefix>bucket.<num>.limit" to @list. The
+ * last bucket has no limit.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virHistogramAddLimits(virTypedParamListPtr list,
+                      const char *prefix)
+{
+    size_t i;
+
+    if (virTypedParamListAddUInt(list, VIR_HISTOGRAM_BUCKETS,
+                                 "%sbucket.count", prefix) < 0)
+        return -1;
+
+    for (i = 0; i < G_N_ELEMENTS(virHistogramLimits); i++) {
+        if (virTypedParamListAddULLong(list, virHistogramLimits[i],
+                                       "%sbucket.%zu.limit", prefix, i) < 0)
+            return -1;
+    }
+
+    return 0;
+}
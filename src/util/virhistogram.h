@@ -0,0 +1,43 @@
+/*
+ * virhistogram.h: histograms of durations
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include "internal.h"
+#include "virtypedparam.h"
+
+#define VIR_HISTOGRAM_BUCKETS 17
+
+/* Durations in microseconds counted in buckets with the limits reported
+ * by virHistogramAddLimits. The caller provides locking. */
+typedef struct _virHistogram virHistogram;
+typedef virHistogram *virHistogramPtr;
+struct _virHistogram {
+    unsigned long long total;
+    unsigned long long max;
+    unsigned long long buckets[VIR_HISTOGRAM_BUCKETS];
+};
+
+void virHistogramRecord(virHistogramPtr hist,
+                        unsigned long long usec)
+    ATTRIBUTE_NONNULL(1);
+
+int virHistogramAddLimits(virTypedParamListPtr list,
+                          const char *prefix)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
@@ -33,7 +33,10 @@
 #include "virfile.h"
 #include "configmake.h"
 #include "vircommand.h"
+#include "virhash.h"
 #include "virstring.h"
+#include "virthread.h"
+#include "virthreadpool.h"
 
 #define VIR_FROM_THIS VIR_FROM_HOOK
 
@@ -41,6 +44,9 @@ VIR_LOG_INIT("util.hook");
 
 #define LIBVIRT_HOOK_DIR SYSCONFDIR "/libvirt/hooks"
 
+/* Maximum number of hook scripts run at once by virHookCallAsync */
+#define VIR_HOOK_ASYNC_WORKERS 4
+
 VIR_ENUM_DECL(virHookDriver);
 VIR_ENUM_DECL(virHookDaemonOp);
 VIR_ENUM_DECL(virHookSubop);
@@ -306,39 +312,17 @@ virRunScript(const char *path,
     return ret;
 }
 
-/**
- * virHookCall:
- * @driver: the driver number (from virHookDriver enum)
- * @id: an id for the object '-' if non available for example on daemon hooks
- * @op: the operation on the id e.g. VIR_HOOK_QEMU_OP_START
- * @sub_op: a sub_operation, currently unused
- * @extra: optional string information
- * @input: extra input given to the script on stdin
- * @output: optional address of variable to store malloced result buffer
- *
- * Implement a hook call, where the external scripts for the driver are
- * called with the given information. This is a synchronous call, we wait for
- * execution completion. If @output is non-NULL, *output is guaranteed to be
- * allocated after successful virHookCall, and is best-effort allocated after
- * failed virHookCall; the caller is responsible for freeing *output.
- *
- * The script from LIBVIRT_HOOK_DIR is executed the first, followed by scripts
- * found under "$driver.d/" directory (sorted alphabetically. If output from
- * the hook script is expected, then the output produced by LIBVIRT_HOOK_DIR
- * script is fed as input to the first script from the "$driver.d/" directory
- * and its output is fed as input to the second and so on.
- *
- * Returns: 0 if the execution succeeded, 1 if the script was not found or
- *          invalid parameters, and -1 if script returned an error
+/*
+ * Runs the scripts of @driver right away, see virHookCall.
  */
-int
-virHookCall(int driver,
-            const char *id,
-            int op,
-            int sub_op,
-            const char *extra,
-            const char *input,
-            char **output)
+static int
+virHookCallInternal(int driver,
+                    const char *id,
+                    int op,
+                    int sub_op,
+                    const char *extra,
+                    const char *input,
+                    char **output)
 {
     int ret, script_ret;
     DIR *dir;
@@ -472,3 +456,263 @@ virHookCall(int driver,
 
     return script_ret;
 }
+
+
+/*
+ * Asynchronous hook calls are queued per object identified by the driver
+ * and @id. Calls of one object are run in the order they were queued and
+ * any synchronous call waits until all calls queued for its object are
+ * done, so that the scripts always see the operations in the same order
+ * as if they were all synchronous.
+ */
+typedef struct _virHookAsyncObject virHookAsyncObject;
+typedef virHookAsyncObject *virHookAsyncObjectPtr;
+struct _virHookAsyncObject {
+    size_t ncalls; /* queued or running calls */
+};
+
+typedef struct _virHookAsyncCall virHookAsyncCall;
+typedef virHookAsyncCall *virHookAsyncCallPtr;
+struct _virHookAsyncCall {
+    int driver;
+    char *id;
+    int op;
+    int sub_op;
+    char *extra;
+    char *input;
+    char *key;
+};
+
+static virMutex virHookAsyncLock = VIR_MUTEX_INITIALIZER;
+static virCond virHookAsyncCond;
+static virHashTablePtr virHookAsyncObjects;
+static virThreadPoolPtr virHookAsyncPool;
+
+static void virHookAsyncWorker(void *jobdata, void *opaque);
+
+static int
+virHookAsyncOnceInit(void)
+{
+    if (virCondInit(&virHookAsyncCond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot initialize condition variable"));
+        return -1;
+    }
+
+    virHookAsyncObjects = virHashNew(g_free);
+
+    if (!(virHookAsyncPool = virThreadPoolNew(0, VIR_HOOK_ASYNC_WORKERS, 0,
+                                              virHookAsyncWorker, NULL)))
+        return -1;
+
+    /* one call per object at a time keeps the calls of an object ordered */
+    if (virThreadPoolSetParameters(virHookAsyncPool, -1, -1, -1, 1) < 0)
+        return -1;
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virHookAsync);
+
+
+static char *
+virHookAsyncKey(int driver,
+                const char *id)
+{
+    return g_strdup_printf("%d:%s", driver, id);
+}
+
+
+static void
+virHookAsyncCallFree(virHookAsyncCallPtr call)
+{
+    if (!call)
+        return;
+
+    g_free(call->id);
+    g_free(call->extra);
+    g_free(call->input);
+    g_free(call->key);
+    g_free(call);
+}
+
+
+/*
+ * Waits until all asynchronous calls queued for the object @id of
+ * @driver or, if @id is NULL, all queued calls are done.
+ */
+static void
+virHookAsyncWait(int driver,
+                 const char *id)
+{
+    g_autofree char *key = NULL;
+
+    /* nothing was ever queued */
+    if (!virHookAsyncPool)
+        return;
+
+    if (id)
+        key = virHookAsyncKey(driver, id);
+
+    virMutexLock(&virHookAsyncLock);
+    while (key ? !!virHashLookup(virHookAsyncObjects, key) :
+                 virHashSize(virHookAsyncObjects) > 0) {
+        if (virCondWait(&virHookAsyncCond, &virHookAsyncLock) < 0) {
+            VIR_WARN("Failed to wait for asynchronous hook calls");
+            break;
+        }
+    }
+    virMutexUnlock(&virHookAsyncLock);
+}
+
+
+static void
+virHookAsyncWorker(void *jobdata,
+                   void *opaque G_GNUC_UNUSED)
+{
+    virHookAsyncCallPtr call = jobdata;
+    virHookAsyncObjectPtr obj;
+
+    if (virHookCallInternal(call->driver, call->id, call->op, call->sub_op,
+                            call->extra, call->input, NULL) < 0) {
+        VIR_WARN("Asynchronous hook call for %s failed: %s",
+                 call->id, virGetLastErrorMessage());
+        virResetLastError();
+    }
+
+    virMutexLock(&virHookAsyncLock);
+    if ((obj = virHashLookup(virHookAsyncObjects, call->key)) &&
+        --obj->ncalls == 0) {
+        virHashRemoveEntry(virHookAsyncObjects, call->key);
+        virCondBroadcast(&virHookAsyncCond);
+    }
+    virMutexUnlock(&virHookAsyncLock);
+
+    virHookAsyncCallFree(call);
+}
+
+
+/**
+ * virHookCallAsync:
+ * @driver: the driver number (from virHookDriver enum)
+ * @id: an id for the object '-' if non available for example on daemon hooks
+ * @op: the operation on the id e.g. VIR_HOOK_QEMU_OP_STARTED
+ * @sub_op: a sub_operation, currently unused
+ * @extra: optional string information
+ * @input: extra input given to the script on stdin
+ *
+ * Like virHookCall, but the scripts are run in a background thread and the
+ * function returns without waiting for them. This is meant for operations
+ * which can't be stopped by the script anyway. Calls for one object are run
+ * in the order they were queued and a later virHookCall for the same object
+ * waits until they are all done. Failures of the scripts are only logged.
+ *
+ * Returns: 0 if the call was queued, 1 if the script was not found or
+ *          invalid parameters, and -1 in case of an error
+ */
+int
+virHookCallAsync(int driver,
+                 const char *id,
+                 int op,
+                 int sub_op,
+                 const char *extra,
+                 const char *input)
+{
+    virHookAsyncCallPtr call = NULL;
+    virHookAsyncObjectPtr obj;
+
+    if ((driver < VIR_HOOK_DRIVER_DAEMON) ||
+        (driver >= VIR_HOOK_DRIVER_LAST))
+        return 1;
+
+    if (virHooksFound == -1)
+        virHookInitialize();
+
+    if ((virHooksFound & (1 << driver)) == 0)
+        return 1;
+
+    if (virHookAsyncInitialize() < 0)
+        return -1;
+
+    call = g_new0(virHookAsyncCall, 1);
+    call->driver = driver;
+    call->id = g_strdup(id);
+    call->op = op;
+    call->sub_op = sub_op;
+    call->extra = g_strdup(extra);
+    call->input = g_strdup(input);
+    call->key = virHookAsyncKey(driver, id);
+
+    virMutexLock(&virHookAsyncLock);
+    if (!(obj = virHashLookup(virHookAsyncObjects, call->key))) {
+        obj = g_new0(virHookAsyncObject, 1);
+        if (virHashAddEntry(virHookAsyncObjects, call->key, obj) < 0) {
+            g_free(obj);
+            goto error;
+        }
+    }
+
+    /* the object entry doubles as the job group of the thread pool */
+    if (virThreadPoolSendJobGroup(virHookAsyncPool, 0, obj, call) < 0) {
+        if (obj->ncalls == 0)
+            virHashRemoveEntry(virHookAsyncObjects, call->key);
+        goto error;
+    }
+    obj->ncalls++;
+    virMutexUnlock(&virHookAsyncLock);
+
+    return 0;
+
+ error:
+    virMutexUnlock(&virHookAsyncLock);
+    virHookAsyncCallFree(call);
+    return -1;
+}
+
+
+/**
+ * virHookCall:
+ * @driver: the driver number (from virHookDriver enum)
+ * @id: an id for the object '-' if non available for example on daemon hooks
+ * @op: the operation on the id e.g. VIR_HOOK_QEMU_OP_START
+ * @sub_op: a sub_operation, currently unused
+ * @extra: optional string information
+ * @input: extra input given to the script on stdin
+ * @output: optional address of variable to store malloced result buffer
+ *
+ * Implement a hook call, where the external scripts for the driver are
+ * called with the given information. This is a synchronous call, we wait for
+ * execution completion. If @output is non-NULL, *output is guaranteed to be
+ * allocated after successful virHookCall, and is best-effort allocated after
+ * failed virHookCall; the caller is responsible for freeing *output.
+ *
+ * The script from LIBVIRT_HOOK_DIR is executed the first, followed by scripts
+ * found under "$driver.d/" directory (sorted alphabetically. If output from
+ * the hook script is expected, then the output produced by LIBVIRT_HOOK_DIR
+ * script is fed as input to the first script from the "$driver.d/" directory
+ * and its output is fed as input to the second and so on.
+ *
+ * Asynchronous calls for the same object queued by virHookCallAsync are
+ * waited for first, a call of the daemon shutdown hook waits for all of
+ * them.
+ *
+ * Returns: 0 if the execution succeeded, 1 if the script was not found or
+ *          invalid parameters, and -1 if script returned an error
+ */
+int
+virHookCall(int driver,
+            const char *id,
+            int op,
+            int sub_op,
+            const char *extra,
+            const char *input,
+            char **output)
+{
+    if (driver == VIR_HOOK_DRIVER_DAEMON &&
+        op == VIR_HOOK_DAEMON_OP_SHUTDOWN)
+        virHookAsyncWait(driver, NULL);
+    else
+        virHookAsyncWait(driver, id);
+
+    return virHookCallInternal(driver, id, op, sub_op, extra, input, output);
+}
@@ -856,6 +856,132 @@ virHostCPUGetStatsLinux(FILE *procstat,
 }
 
 
+static int
+virHostCPUGetAllStatsSysfsLinux(int cpu,
+                                virTypedParamListPtr params,
+                                unsigned int flags)
+{
+    size_t i;
+    int rc;
+
+    if (flags & VIR_NODE_GET_ALL_CPU_STATS_FREQUENCY) {
+        unsigned long long freq;
+
+        rc = virFileReadValueUllong(&freq,
+                                    "%s/cpu/cpu%d/cpufreq/scaling_cur_freq",
+                                    SYSFS_SYSTEM_PATH, cpu);
+        if (rc == -1)
+            return -1;
+
+        /* no cpufreq driver */
+        if (rc == 0 &&
+            virTypedParamListAddULLong(params, freq,
+                                       "cpu.%d.frequency", cpu) < 0)
+            return -1;
+    }
+
+    if (flags & VIR_NODE_GET_ALL_CPU_STATS_IDLE_STATES) {
+        for (i = 0; ; i++) {
+            g_autofree char *name = NULL;
+            unsigned long long time;
+            unsigned long long usage;
+
+            rc = virFileReadValueString(&name,
+                                        "%s/cpu/cpu%d/cpuidle/state%zu/name",
+                                        SYSFS_SYSTEM_PATH, cpu, i);
+            if (rc == -2)
+                break;
+            if (rc < 0)
+                return -1;
+
+            if (virFileReadValueUllong(&time,
+                                       "%s/cpu/cpu%d/cpuidle/state%zu/time",
+                                       SYSFS_SYSTEM_PATH, cpu, i) < 0 ||
+                virFileReadValueUllong(&usage,
+                                       "%s/cpu/cpu%d/cpuidle/state%zu/usage",
+                                       SYSFS_SYSTEM_PATH, cpu, i) < 0)
+                return -1;
+
+            if (virTypedParamListAddString(params, name,
+                                           "cpu.%d.idle.%zu.name",
+                                           cpu, i) < 0 ||
+                virTypedParamListAddULLong(params, time * 1000,
+                                           "cpu.%d.idle.%zu.time",
+                                           cpu, i) < 0 ||
+                virTypedParamListAddULLong(params, usage,
+                                           "cpu.%d.idle.%zu.usage",
+                                           cpu, i) < 0)
+                return -1;
+        }
+
+        if (virTypedParamListAddUInt(params, i, "cpu.%d.idle.count", cpu) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/* Parses the times of the whole host and of each CPU from a single pass
+ * over @procstat, unlike virHostCPUGetStatsLinux which has to be called
+ * once per CPU. */
+int
+virHostCPUGetAllStatsLinux(FILE *procstat,
+                           virTypedParamListPtr params,
+                           unsigned int flags)
+{
+    char line[1024];
+    unsigned long long usr, ni, sys, idle, iowait;
+    unsigned long long irq, softirq, steal, guest, guest_nice;
+
+    while (fgets(line, sizeof(line), procstat) != NULL) {
+        g_autofree char *prefix = NULL;
+        char *tmp;
+        int cpu = -1;
+
+        if (!STRPREFIX(line, "cpu"))
+            continue;
+
+        if (line[3] != ' ' &&
+            (virStrToLong_i(line + 3, &tmp, 10, &cpu) < 0 || *tmp != ' '))
+            continue;
+
+        if (sscanf(line,
+                   "%*s %llu %llu %llu %llu %llu" /* user ~ iowait */
+                   "%llu %llu %llu %llu %llu",    /* irq  ~ guest_nice */
+                   &usr, &ni, &sys, &idle, &iowait,
+                   &irq, &softirq, &steal, &guest, &guest_nice) < 4)
+            continue;
+
+        if (cpu < 0)
+            prefix = g_strdup("cpu.total");
+        else
+            prefix = g_strdup_printf("cpu.%d", cpu);
+
+        if (virTypedParamListAddULLong(params,
+                                       (sys + irq + softirq) * TICK_TO_NSEC,
+                                       "%s." VIR_NODE_CPU_STATS_KERNEL,
+                                       prefix) < 0 ||
+            virTypedParamListAddULLong(params, (usr + ni) * TICK_TO_NSEC,
+                                       "%s." VIR_NODE_CPU_STATS_USER,
+                                       prefix) < 0 ||
+            virTypedParamListAddULLong(params, idle * TICK_TO_NSEC,
+                                       "%s." VIR_NODE_CPU_STATS_IDLE,
+                                       prefix) < 0 ||
+            virTypedParamListAddULLong(params, iowait * TICK_TO_NSEC,
+                                       "%s." VIR_NODE_CPU_STATS_IOWAIT,
+                                       prefix) < 0)
+            return -1;
+
+        if (cpu >= 0 && flags &&
+            virHostCPUGetAllStatsSysfsLinux(cpu, params, flags) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
 /* Determine the number of CPUs (maximum CPU id + 1) present in
  * the host. */
 static int
@@ -1011,6 +1137,42 @@ virHostCPUGetStats(int cpuNum G_GNUC_UNUSED,
 }
 
 
+int
+virHostCPUGetAllStats(virTypedParameterPtr *params,
+                      int *nparams,
+                      unsigned int flags)
+{
+    virCheckFlags(VIR_NODE_GET_ALL_CPU_STATS_FREQUENCY |
+                  VIR_NODE_GET_ALL_CPU_STATS_IDLE_STATES, -1);
+
+#ifdef __linux__
+    {
+        g_autoptr(virTypedParamList) list = g_new0(virTypedParamList, 1);
+        FILE *procstat = fopen(PROCSTAT_PATH, "r");
+        int ret;
+
+        if (!procstat) {
+            virReportSystemError(errno,
+                                 _("cannot open %s"), PROCSTAT_PATH);
+            return -1;
+        }
+        ret = virHostCPUGetAllStatsLinux(procstat, list, flags);
+        VIR_FORCE_FCLOSE(procstat);
+
+        if (ret < 0)
+            return -1;
+
+        *nparams = virTypedParamListStealParams(list, params);
+        return 0;
+    }
+#else
+    virReportError(VIR_ERR_NO_SUPPORT, "%s",
+                   _("node CPU stats not implemented on this platform"));
+    return -1;
+#endif
+}
+
+
 int
 virHostCPUGetCount(void)
 {
@@ -1067,6 +1229,34 @@ virHostCPUGetOnlineBitmap(void)
 #endif
 }
 
+/**
+ * virHostCPUGetIsolatedBitmap:
+ *
+ * Returns the map of host CPUs isolated from the general scheduler
+ * (isolcpus=), which is empty if there are none, or NULL on error.
+ */
+virBitmapPtr
+virHostCPUGetIsolatedBitmap(void)
+{
+#ifdef __linux__
+    g_autofree char *str = NULL;
+    int rc;
+
+    if ((rc = virFileReadValueString(&str, "%s/cpu/isolated",
+                                     SYSFS_SYSTEM_PATH)) == -1)
+        return NULL;
+
+    if (rc == -2 || !*str)
+        return virBitmapNewEmpty();
+
+    return virBitmapParseUnlimited(str);
+#else
+    virReportError(VIR_ERR_NO_SUPPORT, "%s",
+                   _("node isolated CPU map not implemented on this platform"));
+    return NULL;
+#endif
+}
+
 
 int
 virHostCPUGetMap(unsigned char **cpumap,
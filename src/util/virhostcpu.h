@@ -40,9 +40,14 @@ int virHostCPUGetStats(int cpuNum,
                        int *nparams,
                        unsigned int flags);
 
+int virHostCPUGetAllStats(virTypedParameterPtr *params,
+                          int *nparams,
+                          unsigned int flags);
+
 bool virHostCPUHasBitmap(void);
 virBitmapPtr virHostCPUGetPresentBitmap(void);
 virBitmapPtr virHostCPUGetOnlineBitmap(void);
+virBitmapPtr virHostCPUGetIsolatedBitmap(void);
 virBitmapPtr virHostCPUGetAvailableCPUsBitmap(void);
 
 int virHostCPUGetCount(void);
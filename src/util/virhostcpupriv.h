@@ -26,6 +26,7 @@
 #pragma once
 
 #include "virhostcpu.h"
+#include "virtypedparam.h"
 
 #ifdef __linux__
 int virHostCPUGetInfoPopulateLinux(FILE *cpuinfo,
@@ -41,6 +42,10 @@ int virHostCPUGetStatsLinux(FILE *procstat,
                             int cpuNum,
                             virNodeCPUStatsPtr params,
                             int *nparams);
+
+int virHostCPUGetAllStatsLinux(FILE *procstat,
+                               virTypedParamListPtr params,
+                               unsigned int flags);
 #endif
 
 int virHostCPUReadSignature(virArch arch,
@@ -45,6 +45,8 @@
 #include "virstring.h"
 #include "virnuma.h"
 #include "virlog.h"
+#include "virthread.h"
+#include "virutil.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -907,3 +909,280 @@ virHostMemAllocPages(unsigned int npages,
 
     return ncounts;
 }
+
+
+/* How many times a node is compacted when it can't fit the huge pages */
+#define VIR_HOST_MEM_COMPACT_RETRIES 3
+
+typedef struct _virHostMemPagesLayoutEntry virHostMemPagesLayoutEntry;
+struct _virHostMemPagesLayoutEntry {
+    unsigned int pageSize; /* in KiB */
+    unsigned long long count; /* requested pages */
+    unsigned long long achieved; /* pages in the pool afterwards */
+};
+
+typedef struct _virHostMemPagesLayoutNode virHostMemPagesLayoutNode;
+typedef virHostMemPagesLayoutNode *virHostMemPagesLayoutNodePtr;
+struct _virHostMemPagesLayoutNode {
+    unsigned int node;
+    virHostMemPagesLayoutEntry *entries;
+    size_t nentries;
+    virThread thread;
+    virErrorPtr err;
+};
+
+
+/* Parses "cell.<node>.page.<size>.count" */
+static int
+virHostMemParsePagesLayoutField(const char *field,
+                                unsigned int *node,
+                                unsigned int *pageSize)
+{
+    const char *tmp;
+    char *end;
+
+    if (!(tmp = STRSKIP(field, "cell.")) ||
+        virStrToLong_ui(tmp, &end, 10, node) < 0 ||
+        !(tmp = STRSKIP(end, ".page.")) ||
+        virStrToLong_ui(tmp, &end, 10, pageSize) < 0 ||
+        STRNEQ(end, ".count")) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("invalid page layout field '%s'"), field);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+virHostMemPagesLayoutEntryCompare(const void *a,
+                                  const void *b)
+{
+    const virHostMemPagesLayoutEntry *ea = a;
+    const virHostMemPagesLayoutEntry *eb = b;
+
+    /* larger pages first, they need more contiguous memory */
+    if (ea->pageSize > eb->pageSize)
+        return -1;
+    if (ea->pageSize < eb->pageSize)
+        return 1;
+    return 0;
+}
+
+
+static int
+virHostMemSetPagePoolSize(unsigned int node,
+                          virHostMemPagesLayoutEntry *entry)
+{
+    size_t retries = 0;
+
+    while (virNumaSetPagePoolSize(node, entry->pageSize,
+                                  entry->count, false) < 0) {
+        if (retries++ == VIR_HOST_MEM_COMPACT_RETRIES)
+            break;
+
+        VIR_DEBUG("Unable to allocate %llu pages of %u KiB on node %u: %s",
+                  entry->count, entry->pageSize, node,
+                  virGetLastErrorMessage());
+
+        /* a fragmented node might fit more huge pages once compacted */
+        if (virNumaCompactNode(node) < 0)
+            break;
+    }
+
+    /* the achieved state is reported even if the pool was not fully
+     * resized, callers decide whether that's an error */
+    virResetLastError();
+
+    return virNumaGetPageInfo(node, entry->pageSize, 0,
+                              &entry->achieved, NULL);
+}
+
+
+static void
+virHostMemSetPagesLayoutThread(void *opaque)
+{
+    virHostMemPagesLayoutNodePtr data = opaque;
+    size_t i;
+
+    /* shrink the pools first so that the memory can be reused */
+    for (i = 0; i < data->nentries; i++) {
+        virHostMemPagesLayoutEntry *entry = &data->entries[i];
+        unsigned long long current;
+
+        if (virNumaGetPageInfo(data->node, entry->pageSize, 0,
+                               &current, NULL) < 0)
+            goto error;
+
+        if (current > entry->count &&
+            virHostMemSetPagePoolSize(data->node, entry) < 0)
+            goto error;
+    }
+
+    for (i = 0; i < data->nentries; i++) {
+        virHostMemPagesLayoutEntry *entry = &data->entries[i];
+
+        if (virHostMemSetPagePoolSize(data->node, entry) < 0)
+            goto error;
+    }
+
+    return;
+
+ error:
+    virErrorPreserveLast(&data->err);
+}
+
+
+/**
+ * virHostMemSetPagesLayout:
+ * @params: requested layout
+ * @nparams: number of items in @params
+ * @result: filled with the achieved layout, may be NULL
+ * @nresult: number of items in @result
+ * @strict: fail if the layout was not fully achieved
+ *
+ * Resizes the huge page pools of the host NUMA nodes to the counts given
+ * by VIR_NODE_PAGES_LAYOUT_COUNT fields in @params. The nodes are
+ * processed in parallel. Pools of one node are shrunk first and then
+ * grown from the largest page size down, compacting the node's memory
+ * when it is too fragmented to fit the pages.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virHostMemSetPagesLayout(virTypedParameterPtr params,
+                         int nparams,
+                         virTypedParameterPtr *result,
+                         int *nresult,
+                         bool strict)
+{
+    virHostMemPagesLayoutNodePtr nodes = NULL;
+    size_t nnodes = 0;
+    size_t nthreads = 0;
+    g_autoptr(virTypedParamList) list = NULL;
+    virErrorPtr err = NULL;
+    size_t i;
+    size_t j;
+    int ret = -1;
+
+    for (i = 0; i < nparams; i++) {
+        virHostMemPagesLayoutEntry entry = { 0 };
+        unsigned int node;
+
+        if (virHostMemParsePagesLayoutField(params[i].field, &node,
+                                            &entry.pageSize) < 0)
+            goto cleanup;
+
+        if (params[i].type != VIR_TYPED_PARAM_ULLONG) {
+            virReportError(VIR_ERR_INVALID_ARG,
+                           _("invalid type for page layout field '%s'"),
+                           params[i].field);
+            goto cleanup;
+        }
+        entry.count = params[i].value.ul;
+
+        if (entry.pageSize == virGetSystemPageSizeKB()) {
+            virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                           _("system pages pool can't be modified"));
+            goto cleanup;
+        }
+
+        for (j = 0; j < nnodes; j++) {
+            if (nodes[j].node == node)
+                break;
+        }
+
+        if (j == nnodes) {
+            virHostMemPagesLayoutNode tmp = { .node = node };
+
+            if (!virNumaNodeIsAvailable(node)) {
+                virReportError(VIR_ERR_INVALID_ARG,
+                               _("NUMA node %u is not available"), node);
+                goto cleanup;
+            }
+
+            if (VIR_APPEND_ELEMENT(nodes, nnodes, tmp) < 0)
+                goto cleanup;
+        }
+
+        if (VIR_APPEND_ELEMENT(nodes[j].entries, nodes[j].nentries, entry) < 0)
+            goto cleanup;
+    }
+
+    for (i = 0; i < nnodes; i++) {
+        qsort(nodes[i].entries, nodes[i].nentries, sizeof(*nodes[i].entries),
+              virHostMemPagesLayoutEntryCompare);
+
+        if (virThreadCreateFull(&nodes[i].thread, true,
+                                virHostMemSetPagesLayoutThread,
+                                "pages-layout", false, &nodes[i]) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("unable to create page layout thread"));
+            goto cleanup;
+        }
+        nthreads++;
+    }
+
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < nthreads; i++) {
+        virThreadJoin(&nodes[i].thread);
+
+        if (!nodes[i].err)
+            continue;
+
+        if (ret == 0) {
+            err = g_steal_pointer(&nodes[i].err);
+            ret = -1;
+        } else {
+            virFreeError(nodes[i].err);
+        }
+    }
+    virErrorRestore(&err);
+
+    if (ret == 0 && strict) {
+        for (i = 0; i < nnodes && ret == 0; i++) {
+            for (j = 0; j < nodes[i].nentries; j++) {
+                virHostMemPagesLayoutEntry *entry = &nodes[i].entries[j];
+
+                if (entry->achieved != entry->count) {
+                    virReportError(VIR_ERR_OPERATION_FAILED,
+                                   _("Unable to allocate %llu pages of %u KiB "
+                                     "on node %u. Allocated only %llu"),
+                                   entry->count, entry->pageSize,
+                                   nodes[i].node, entry->achieved);
+                    ret = -1;
+                    break;
+                }
+            }
+        }
+    }
+
+    if (ret == 0 && result) {
+        list = g_new0(virTypedParamList, 1);
+
+        for (i = 0; i < nnodes && ret == 0; i++) {
+            for (j = 0; j < nodes[i].nentries; j++) {
+                virHostMemPagesLayoutEntry *entry = &nodes[i].entries[j];
+
+                if (virTypedParamListAddULLong(list, entry->achieved,
+                                               VIR_NODE_PAGES_LAYOUT_COUNT,
+                                               nodes[i].node,
+                                               entry->pageSize) < 0) {
+                    ret = -1;
+                    break;
+                }
+            }
+        }
+
+        if (ret == 0)
+            *nresult = virTypedParamListStealParams(list, result);
+    }
+
+    for (i = 0; i < nnodes; i++)
+        g_free(nodes[i].entries);
+    g_free(nodes);
+    return ret;
+}
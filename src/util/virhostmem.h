@@ -53,3 +53,9 @@ int virHostMemAllocPages(unsigned int npages,
                          int startCell,
                          unsigned int cellCount,
                          bool add);
+
+int virHostMemSetPagesLayout(virTypedParameterPtr params,
+                             int nparams,
+                             virTypedParameterPtr *result,
+                             int *nresult,
+                             bool strict);
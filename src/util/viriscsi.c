@@ -36,6 +36,10 @@
 
 VIR_LOG_INIT("util.iscsi");
 
+/* Serializes looking up and creating the iSCSI interface for an initiator
+ * IQN, so that pools started at the same time don't both create one */
+static virMutex virISCSIIfaceLock = VIR_MUTEX_INITIALIZER;
+
 
 static int
 virISCSIScanTargetsInternal(const char *portal,
@@ -288,13 +292,17 @@ virISCSIConnection(const char *portal,
     virCommandAddArgSet(cmd, extraargv);
 
     if (initiatoriqn) {
+        int rc = -1;
+
+        virMutexLock(&virISCSIIfaceLock);
         switch (virStorageBackendIQNFound(initiatoriqn, &ifacename)) {
         case IQN_FOUND:
             VIR_DEBUG("ifacename: '%s'", ifacename);
+            rc = 0;
             break;
         case IQN_MISSING:
             if (virStorageBackendCreateIfaceIQN(initiatoriqn, &ifacename) != 0)
-                return -1;
+                break;
             /*
              * iscsiadm doesn't let you send commands to the Interface IQN,
              * unless you've first issued a 'sendtargets' command to the
@@ -305,13 +313,19 @@ virISCSIConnection(const char *portal,
              */
             if (virISCSIScanTargetsInternal(portal, ifacename,
                                             true, NULL, NULL) < 0)
-                return -1;
+                break;
 
+            rc = 0;
             break;
         case IQN_ERROR:
         default:
-            return -1;
+            break;
         }
+        virMutexUnlock(&virISCSIIfaceLock);
+
+        if (rc < 0)
+            return -1;
+
         virCommandAddArgList(cmd, "--interface", ifacename, NULL);
     }
 
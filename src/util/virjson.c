@@ -68,8 +68,15 @@ struct _virJSONArray {
     virJSONValuePtr *values;
 };
 
+typedef enum {
+    VIR_JSON_ALLOC_HEAP = 0,
+    VIR_JSON_ALLOC_ARENA,       /* member of an arena backed tree */
+    VIR_JSON_ALLOC_ARENA_ROOT,  /* root of an arena backed tree */
+} virJSONValueAlloc;
+
 struct _virJSONValue {
     int type; /* enum virJSONType */
+    int alloc; /* enum virJSONValueAlloc */
 
     union {
         virJSONObject object;
@@ -81,11 +88,113 @@ struct _virJSONValue {
 };
 
 
+/* Values parsed by virJSONValueFromStringArena are carved out of large
+ * chunks which are all released together with the root value. */
+#define VIR_JSON_ARENA_CHUNK_SIZE (64 * 1024)
+
+typedef struct _virJSONArena virJSONArena;
+typedef virJSONArena *virJSONArenaPtr;
+struct _virJSONArena {
+    char **chunks;
+    size_t nchunks;
+    char *next;    /* free space in the current chunk */
+    size_t avail;
+};
+
+typedef struct _virJSONArenaRoot virJSONArenaRoot;
+typedef virJSONArenaRoot *virJSONArenaRootPtr;
+struct _virJSONArenaRoot {
+    virJSONValue value; /* must be first */
+    virJSONArena arena;
+};
+
+
+#if WITH_YAJL
+static void *
+virJSONArenaAlloc(virJSONArenaPtr arena,
+                  size_t size)
+{
+    void *ret;
+
+    size = VIR_ROUND_UP(size, sizeof(void *));
+
+    if (size > arena->avail) {
+        size_t chunksize = MAX(size, VIR_JSON_ARENA_CHUNK_SIZE);
+        char *chunk = g_malloc(chunksize);
+
+        ignore_value(VIR_APPEND_ELEMENT_QUIET(arena->chunks, arena->nchunks, chunk));
+        arena->next = chunk;
+        arena->avail = chunksize;
+    }
+
+    ret = arena->next;
+    arena->next += size;
+    arena->avail -= size;
+
+    memset(ret, 0, size);
+    return ret;
+}
+
+
+static char *
+virJSONArenaStrndup(virJSONArenaPtr arena,
+                    const char *str,
+                    size_t len)
+{
+    char *ret = virJSONArenaAlloc(arena, len + 1);
+
+    memcpy(ret, str, len);
+    return ret;
+}
+#endif /* WITH_YAJL */
+
+
+static void
+virJSONArenaRootFree(virJSONArenaRootPtr root)
+{
+    size_t i;
+
+    for (i = 0; i < root->arena.nchunks; i++)
+        g_free(root->arena.chunks[i]);
+    g_free(root->arena.chunks);
+    g_free(root);
+}
+
+
+/* Arena backed containers can't grow */
+static int
+virJSONValueCheckModifiable(virJSONValuePtr value)
+{
+    if (value->alloc != VIR_JSON_ALLOC_HEAP) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("cannot modify arena allocated JSON value"));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Values stolen from an arena backed tree must be copied as they can't
+ * outlive the arena */
+static virJSONValuePtr
+virJSONValueStealMember(virJSONValuePtr container,
+                        virJSONValuePtr value)
+{
+    if (!value || container->alloc == VIR_JSON_ALLOC_HEAP)
+        return value;
+
+    return virJSONValueCopy(value);
+}
+
+
 typedef struct _virJSONParserState virJSONParserState;
 typedef virJSONParserState *virJSONParserStatePtr;
 struct _virJSONParserState {
     virJSONValuePtr value;
     char *key;
+    char *path; /* dotted path of @value, only tracked with a filter */
+    size_t scratch; /* first member on the scratch stack (arena mode) */
 };
 
 typedef struct _virJSONParser virJSONParser;
@@ -95,6 +204,19 @@ struct _virJSONParser {
     virJSONParserStatePtr state;
     size_t nstate;
     int wrap;
+
+    /* NULL terminated list of dotted paths of the members to keep */
+    const char *const *filter;
+    /* nesting depth of a container which is being skipped */
+    size_t skip;
+
+    /* arena mode: the root value, its arena and the stack of members
+     * of containers which are not complete yet */
+    virJSONArenaRootPtr root;
+    virJSONArenaPtr arena;
+    bool rootUsed;
+    virJSONObjectPairPtr scratch;
+    size_t nscratch;
 };
 
 
@@ -395,6 +517,13 @@ virJSONValueFree(virJSONValuePtr value)
     if (!value)
         return;
 
+    /* Members of arena backed trees are released with the root */
+    if (value->alloc != VIR_JSON_ALLOC_HEAP) {
+        if (value->alloc == VIR_JSON_ALLOC_ARENA_ROOT)
+            virJSONArenaRootFree((virJSONArenaRootPtr) value);
+        return;
+    }
+
     switch ((virJSONType) value->type) {
     case VIR_JSON_TYPE_OBJECT:
         for (i = 0; i < value->data.object.npairs; i++) {
@@ -594,6 +723,9 @@ virJSONValueObjectInsert(virJSONValuePtr object,
         return -1;
     }
 
+    if (virJSONValueCheckModifiable(object) < 0)
+        return -1;
+
     if (virJSONValueObjectHasKey(object, key)) {
         virReportError(VIR_ERR_INTERNAL_ERROR, _("duplicate key '%s'"), key);
         return -1;
@@ -795,6 +927,9 @@ virJSONValueArrayAppend(virJSONValuePtr array,
         return -1;
     }
 
+    if (virJSONValueCheckModifiable(array) < 0)
+        return -1;
+
     if (VIR_REALLOC_N(array->data.array.values,
                       array->data.array.nvalues + 1) < 0)
         return -1;
@@ -840,6 +975,10 @@ virJSONValueArrayConcat(virJSONValuePtr a,
         return -1;
     }
 
+    if (virJSONValueCheckModifiable(a) < 0 ||
+        virJSONValueCheckModifiable(c) < 0)
+        return -1;
+
     a->data.array.values = g_renew(virJSONValuePtr, a->data.array.values,
                                    a->data.array.nvalues + c->data.array.nvalues);
 
@@ -888,6 +1027,26 @@ virJSONValueObjectGet(virJSONValuePtr object,
 }
 
 
+/* Removes the @i-th pair of @object. The value must have been stolen
+ * or freed by the caller. */
+static void
+virJSONValueObjectDeletePair(virJSONValuePtr object,
+                             size_t i)
+{
+    virJSONObjectPtr obj = &object->data.object;
+
+    if (object->alloc != VIR_JSON_ALLOC_HEAP) {
+        memmove(obj->pairs + i, obj->pairs + i + 1,
+                sizeof(*obj->pairs) * (obj->npairs - i - 1));
+        obj->npairs--;
+        return;
+    }
+
+    VIR_FREE(obj->pairs[i].key);
+    VIR_DELETE_ELEMENT(obj->pairs, i, obj->npairs);
+}
+
+
 static virJSONValuePtr
 virJSONValueObjectSteal(virJSONValuePtr object,
                         const char *key)
@@ -900,10 +1059,9 @@ virJSONValueObjectSteal(virJSONValuePtr object,
 
     for (i = 0; i < object->data.object.npairs; i++) {
         if (STREQ(object->data.object.pairs[i].key, key)) {
-            obj = g_steal_pointer(&object->data.object.pairs[i].value);
-            VIR_FREE(object->data.object.pairs[i].key);
-            VIR_DELETE_ELEMENT(object->data.object.pairs, i,
-                               object->data.object.npairs);
+            obj = virJSONValueStealMember(object,
+                                          object->data.object.pairs[i].value);
+            virJSONValueObjectDeletePair(object, i);
             break;
         }
     }
@@ -985,13 +1143,12 @@ virJSONValueObjectRemoveKey(virJSONValuePtr object,
     for (i = 0; i < object->data.object.npairs; i++) {
         if (STREQ(object->data.object.pairs[i].key, key)) {
             if (value) {
-                *value = object->data.object.pairs[i].value;
+                *value = virJSONValueStealMember(object,
+                                                 object->data.object.pairs[i].value);
                 object->data.object.pairs[i].value = NULL;
             }
-            VIR_FREE(object->data.object.pairs[i].key);
             virJSONValueFree(object->data.object.pairs[i].value);
-            VIR_DELETE_ELEMENT(object->data.object.pairs, i,
-                               object->data.object.npairs);
+            virJSONValueObjectDeletePair(object, i);
             return 1;
         }
     }
@@ -1064,11 +1221,18 @@ virJSONValueArraySteal(virJSONValuePtr array,
     if (element >= array->data.array.nvalues)
         return NULL;
 
-    ret = array->data.array.values[element];
+    ret = virJSONValueStealMember(array, array->data.array.values[element]);
 
-    VIR_DELETE_ELEMENT(array->data.array.values,
-                       element,
-                       array->data.array.nvalues);
+    if (array->alloc != VIR_JSON_ALLOC_HEAP) {
+        memmove(array->data.array.values + element,
+                array->data.array.values + element + 1,
+                sizeof(virJSONValuePtr) * (array->data.array.nvalues - element - 1));
+        array->data.array.nvalues--;
+    } else {
+        VIR_DELETE_ELEMENT(array->data.array.values,
+                           element,
+                           array->data.array.nvalues);
+    }
 
     return ret;
 }
@@ -1106,13 +1270,23 @@ virJSONValueArrayForeachSteal(virJSONValuePtr array,
         return -1;
 
     for (i = 0; i < array->data.array.nvalues; i++) {
-        if ((rc = cb(i, array->data.array.values[i], opaque)) < 0) {
+        virJSONValuePtr value = array->data.array.values[i];
+        g_autoptr(virJSONValue) copy = NULL;
+
+        /* the callback may take ownership, so arena members are handed
+         * over as copies */
+        if (array->alloc != VIR_JSON_ALLOC_HEAP)
+            value = copy = virJSONValueCopy(value);
+
+        if ((rc = cb(i, value, opaque)) < 0) {
             ret = -1;
             break;
         }
 
-        if (rc == 0)
+        if (rc == 0) {
             array->data.array.values[i] = NULL;
+            copy = NULL;
+        }
     }
 
     /* condense the remaining entries at the beginning */
@@ -1564,6 +1738,53 @@ virJSONValueCopy(const virJSONValue *in)
 
 
 #if WITH_YAJL
+/* Allocates a new value of @type for the parser. In arena mode the
+ * very first value is the arena root, all other values live in the
+ * arena. */
+static virJSONValuePtr
+virJSONParserNewValue(virJSONParserPtr parser,
+                      virJSONType type)
+{
+    virJSONValuePtr value;
+
+    if (!parser->arena) {
+        value = g_new0(virJSONValue, 1);
+    } else if (!parser->head && !parser->rootUsed) {
+        value = &parser->root->value;
+        value->alloc = VIR_JSON_ALLOC_ARENA_ROOT;
+        parser->rootUsed = true;
+    } else {
+        value = virJSONArenaAlloc(parser->arena, sizeof(*value));
+        value->alloc = VIR_JSON_ALLOC_ARENA;
+    }
+
+    value->type = type;
+    return value;
+}
+
+
+static char *
+virJSONParserStrndup(virJSONParserPtr parser,
+                     const char *str,
+                     size_t len)
+{
+    if (parser->arena)
+        return virJSONArenaStrndup(parser->arena, str, len);
+
+    return g_strndup(str, len);
+}
+
+
+static void
+virJSONParserDropKey(virJSONParserPtr parser,
+                     virJSONParserStatePtr state)
+{
+    if (!parser->arena)
+        g_free(state->key);
+    state->key = NULL;
+}
+
+
 static int
 virJSONParserInsertValue(virJSONParserPtr parser,
                          virJSONValuePtr value)
@@ -1586,12 +1807,21 @@ virJSONParserInsertValue(virJSONParserPtr parser,
                 return -1;
             }
 
-            if (virJSONValueObjectAppend(state->value,
-                                         state->key,
-                                         value) < 0)
+            if (parser->arena) {
+                /* members of arena containers are collected on the
+                 * scratch stack until the container is complete */
+                virJSONObjectPair pair = { state->key, value };
+
+                if (VIR_APPEND_ELEMENT(parser->scratch, parser->nscratch,
+                                       pair) < 0)
+                    return -1;
+            } else if (virJSONValueObjectAppend(state->value,
+                                                state->key,
+                                                value) < 0) {
                 return -1;
+            }
 
-            VIR_FREE(state->key);
+            virJSONParserDropKey(parser, state);
         }   break;
 
         case VIR_JSON_TYPE_ARRAY: {
@@ -1600,9 +1830,16 @@ virJSONParserInsertValue(virJSONParserPtr parser,
                 return -1;
             }
 
-            if (virJSONValueArrayAppend(state->value,
-                                        value) < 0)
+            if (parser->arena) {
+                virJSONObjectPair pair = { NULL, value };
+
+                if (VIR_APPEND_ELEMENT(parser->scratch, parser->nscratch,
+                                       pair) < 0)
+                    return -1;
+            } else if (virJSONValueArrayAppend(state->value,
+                                               value) < 0) {
                 return -1;
+            }
         }   break;
 
         default:
@@ -1615,16 +1852,128 @@ virJSONParserInsertValue(virJSONParserPtr parser,
 }
 
 
+/* Moves the members of the arena container described by @state from the
+ * scratch stack into the arena. */
+static void
+virJSONParserArenaFinishContainer(virJSONParserPtr parser,
+                                  virJSONParserStatePtr state)
+{
+    virJSONValuePtr value = state->value;
+    size_t n = parser->nscratch - state->scratch;
+    size_t i;
+
+    if (n == 0)
+        return;
+
+    if (value->type == VIR_JSON_TYPE_OBJECT) {
+        value->data.object.pairs = virJSONArenaAlloc(parser->arena,
+                                                     n * sizeof(virJSONObjectPair));
+        memcpy(value->data.object.pairs, parser->scratch + state->scratch,
+               n * sizeof(virJSONObjectPair));
+        value->data.object.npairs = n;
+    } else {
+        value->data.array.values = virJSONArenaAlloc(parser->arena,
+                                                     n * sizeof(virJSONValuePtr));
+        for (i = 0; i < n; i++)
+            value->data.array.values[i] = parser->scratch[state->scratch + i].value;
+        value->data.array.nvalues = n;
+    }
+
+    parser->nscratch = state->scratch;
+}
+
+
+/* Returns the dotted path of the value which is about to be inserted.
+ * Array members share the path of the array. */
+static char *
+virJSONParserValuePath(virJSONParserPtr parser)
+{
+    virJSONParserStatePtr state;
+
+    if (!parser->nstate)
+        return g_strdup("");
+
+    state = &parser->state[parser->nstate - 1];
+
+    if (!state->key)
+        return g_strdup(state->path);
+
+    if (!*state->path)
+        return g_strdup(state->key);
+
+    return g_strdup_printf("%s.%s", state->path, state->key);
+}
+
+
+/* A value is wanted if it is one of the members listed in @filter, a
+ * (possibly indirect) member of one of them, or a container which
+ * leads to one of them. */
+static bool
+virJSONParserFilterMatch(const char *const *filter,
+                         const char *path)
+{
+    size_t len = strlen(path);
+
+    if (len == 0)
+        return true;
+
+    for (; *filter; filter++) {
+        const char *want = *filter;
+        size_t wantlen = strlen(want);
+
+        if (wantlen >= len && STREQLEN(want, path, len) &&
+            (want[len] == '\0' || want[len] == '.'))
+            return true;
+
+        if (len > wantlen && STREQLEN(want, path, wantlen) &&
+            path[wantlen] == '.')
+            return true;
+    }
+
+    return false;
+}
+
+
+/* Checks whether the value which is about to be inserted passes the
+ * parser filter. If it does not, the pending key of the parent object
+ * is dropped and true is returned. Otherwise @path is filled with the
+ * path of the value (if requested and a filter is used). */
+static bool
+virJSONParserSkipValue(virJSONParserPtr parser,
+                       char **path)
+{
+    g_autofree char *valuepath = NULL;
+
+    if (!parser->filter)
+        return false;
+
+    valuepath = virJSONParserValuePath(parser);
+
+    if (!virJSONParserFilterMatch(parser->filter, valuepath)) {
+        if (parser->nstate)
+            virJSONParserDropKey(parser, &parser->state[parser->nstate - 1]);
+        return true;
+    }
+
+    if (path)
+        *path = g_steal_pointer(&valuepath);
+
+    return false;
+}
+
+
 static int
 virJSONParserHandleNull(void *ctx)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewNull();
+    virJSONValuePtr value;
 
     VIR_DEBUG("parser=%p", parser);
 
-    if (!value)
-        return 0;
+    if (parser->skip || virJSONParserSkipValue(parser, NULL))
+        return 1;
+
+    value = virJSONParserNewValue(parser, VIR_JSON_TYPE_NULL);
 
     if (virJSONParserInsertValue(parser, value) < 0) {
         virJSONValueFree(value);
@@ -1640,12 +1989,15 @@ virJSONParserHandleBoolean(void *ctx,
                            int boolean_)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewBoolean(boolean_);
+    virJSONValuePtr value;
 
     VIR_DEBUG("parser=%p boolean=%d", parser, boolean_);
 
-    if (!value)
-        return 0;
+    if (parser->skip || virJSONParserSkipValue(parser, NULL))
+        return 1;
+
+    value = virJSONParserNewValue(parser, VIR_JSON_TYPE_BOOLEAN);
+    value->data.boolean = boolean_;
 
     if (virJSONParserInsertValue(parser, value) < 0) {
         virJSONValueFree(value);
@@ -1662,17 +2014,15 @@ virJSONParserHandleNumber(void *ctx,
                           size_t l)
 {
     virJSONParserPtr parser = ctx;
-    char *str;
     virJSONValuePtr value;
 
-    str = g_strndup(s, l);
-    value = virJSONValueNewNumber(str);
-    VIR_FREE(str);
+    if (parser->skip || virJSONParserSkipValue(parser, NULL))
+        return 1;
 
-    VIR_DEBUG("parser=%p str=%s", parser, str);
+    value = virJSONParserNewValue(parser, VIR_JSON_TYPE_NUMBER);
+    value->data.number = virJSONParserStrndup(parser, s, l);
 
-    if (!value)
-        return 0;
+    VIR_DEBUG("parser=%p str=%s", parser, value->data.number);
 
     if (virJSONParserInsertValue(parser, value) < 0) {
         virJSONValueFree(value);
@@ -1689,13 +2039,16 @@ virJSONParserHandleString(void *ctx,
                           size_t stringLen)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewStringLen((const char *)stringVal,
-                                                     stringLen);
+    virJSONValuePtr value;
 
     VIR_DEBUG("parser=%p str=%p", parser, (const char *)stringVal);
 
-    if (!value)
-        return 0;
+    if (parser->skip || virJSONParserSkipValue(parser, NULL))
+        return 1;
+
+    value = virJSONParserNewValue(parser, VIR_JSON_TYPE_STRING);
+    value->data.string = virJSONParserStrndup(parser, (const char *)stringVal,
+                                              stringLen);
 
     if (virJSONParserInsertValue(parser, value) < 0) {
         virJSONValueFree(value);
@@ -1716,25 +2069,37 @@ virJSONParserHandleMapKey(void *ctx,
 
     VIR_DEBUG("parser=%p key=%p", parser, (const char *)stringVal);
 
+    if (parser->skip)
+        return 1;
+
     if (!parser->nstate)
         return 0;
 
     state = &parser->state[parser->nstate-1];
     if (state->key)
         return 0;
-    state->key = g_strndup((const char *)stringVal, stringLen);
+    state->key = virJSONParserStrndup(parser, (const char *)stringVal,
+                                      stringLen);
     return 1;
 }
 
 
 static int
-virJSONParserHandleStartMap(void *ctx)
+virJSONParserHandleStartContainer(virJSONParserPtr parser,
+                                  virJSONType type)
 {
-    virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewObject();
+    virJSONValuePtr value;
+    g_autofree char *path = NULL;
 
     VIR_DEBUG("parser=%p", parser);
 
+    if (parser->skip || virJSONParserSkipValue(parser, &path)) {
+        parser->skip++;
+        return 1;
+    }
+
+    value = virJSONParserNewValue(parser, type);
+
     if (virJSONParserInsertValue(parser, value) < 0) {
         virJSONValueFree(value);
         return 0;
@@ -1747,6 +2112,8 @@ virJSONParserHandleStartMap(void *ctx)
 
     parser->state[parser->nstate].value = value;
     parser->state[parser->nstate].key = NULL;
+    parser->state[parser->nstate].path = g_steal_pointer(&path);
+    parser->state[parser->nstate].scratch = parser->nscratch;
     parser->nstate++;
 
     return 1;
@@ -1754,22 +2121,30 @@ virJSONParserHandleStartMap(void *ctx)
 
 
 static int
-virJSONParserHandleEndMap(void *ctx)
+virJSONParserHandleEndContainer(virJSONParserPtr parser)
 {
-    virJSONParserPtr parser = ctx;
     virJSONParserStatePtr state;
 
     VIR_DEBUG("parser=%p", parser);
 
-    if (!parser->nstate)
+    if (parser->skip) {
+        parser->skip--;
+        return 1;
+    }
+
+    if (!(parser->nstate - parser->wrap))
         return 0;
 
     state = &(parser->state[parser->nstate-1]);
     if (state->key) {
-        VIR_FREE(state->key);
+        virJSONParserDropKey(parser, state);
         return 0;
     }
 
+    if (parser->arena)
+        virJSONParserArenaFinishContainer(parser, state);
+
+    VIR_FREE(state->path);
     VIR_DELETE_ELEMENT(parser->state, parser->nstate - 1, parser->nstate);
 
     return 1;
@@ -1777,50 +2152,30 @@ virJSONParserHandleEndMap(void *ctx)
 
 
 static int
-virJSONParserHandleStartArray(void *ctx)
+virJSONParserHandleStartMap(void *ctx)
 {
-    virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewArray();
-
-    VIR_DEBUG("parser=%p", parser);
+    return virJSONParserHandleStartContainer(ctx, VIR_JSON_TYPE_OBJECT);
+}
 
-    if (virJSONParserInsertValue(parser, value) < 0) {
-        virJSONValueFree(value);
-        return 0;
-    }
 
-    if (VIR_REALLOC_N(parser->state,
-                      parser->nstate + 1) < 0)
-        return 0;
+static int
+virJSONParserHandleEndMap(void *ctx)
+{
+    return virJSONParserHandleEndContainer(ctx);
+}
 
-    parser->state[parser->nstate].value = value;
-    parser->state[parser->nstate].key = NULL;
-    parser->nstate++;
 
-    return 1;
+static int
+virJSONParserHandleStartArray(void *ctx)
+{
+    return virJSONParserHandleStartContainer(ctx, VIR_JSON_TYPE_ARRAY);
 }
 
 
 static int
 virJSONParserHandleEndArray(void *ctx)
 {
-    virJSONParserPtr parser = ctx;
-    virJSONParserStatePtr state;
-
-    VIR_DEBUG("parser=%p", parser);
-
-    if (!(parser->nstate - parser->wrap))
-        return 0;
-
-    state = &(parser->state[parser->nstate-1]);
-    if (state->key) {
-        VIR_FREE(state->key);
-        return 0;
-    }
-
-    VIR_DELETE_ELEMENT(parser->state, parser->nstate - 1, parser->nstate);
-
-    return 1;
+    return virJSONParserHandleEndContainer(ctx);
 }
 
 
@@ -1839,23 +2194,30 @@ static const yajl_callbacks parserCallbacks = {
 };
 
 
-/* XXX add an incremental streaming parser - yajl trivially supports it */
-virJSONValuePtr
-virJSONValueFromString(const char *jsonstring)
+static virJSONValuePtr
+virJSONValueFromStringInternal(const char *jsonstring,
+                               const char *const *filter,
+                               bool arena)
 {
     yajl_handle hand;
-    virJSONParser parser = { NULL, NULL, 0, 0 };
+    virJSONParser parser = { 0 };
     virJSONValuePtr ret = NULL;
     int rc;
     size_t len = strlen(jsonstring);
 
     VIR_DEBUG("string=%s", jsonstring);
 
+    parser.filter = filter;
+    if (arena) {
+        parser.root = g_new0(virJSONArenaRoot, 1);
+        parser.arena = &parser.root->arena;
+    }
+
     hand = yajl_alloc(&parserCallbacks, NULL, &parser);
     if (!hand) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("Unable to create JSON parser"));
-        return NULL;
+        goto cleanup;
     }
 
     /* Yajl 2 is nice enough to default to rejecting trailing garbage. */
@@ -1870,7 +2232,6 @@ virJSONValueFromString(const char *jsonstring)
                        _("cannot parse json %s: %s"),
                        jsonstring, (const char*) errstr);
         yajl_free_error(hand, errstr);
-        virJSONValueFree(parser.head);
         goto cleanup;
     }
 
@@ -1878,20 +2239,31 @@ virJSONValueFromString(const char *jsonstring)
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("cannot parse json %s: unterminated string/map/array"),
                        jsonstring);
-        virJSONValueFree(parser.head);
-    } else {
-        ret = parser.head;
+        goto cleanup;
     }
 
+    ret = g_steal_pointer(&parser.head);
+
  cleanup:
-    yajl_free(hand);
+    if (hand)
+        yajl_free(hand);
 
     if (parser.nstate) {
         size_t i;
-        for (i = 0; i < parser.nstate; i++)
-            VIR_FREE(parser.state[i].key);
+        for (i = 0; i < parser.nstate; i++) {
+            virJSONParserDropKey(&parser, &parser.state[i]);
+            VIR_FREE(parser.state[i].path);
+        }
         VIR_FREE(parser.state);
     }
+    VIR_FREE(parser.scratch);
+
+    /* In arena mode the head is the arena root, freeing it releases the
+     * whole arena */
+    if (parser.head)
+        virJSONValueFree(parser.head);
+    else if (parser.root && !ret)
+        virJSONArenaRootFree(parser.root);
 
     VIR_DEBUG("result=%p", ret);
 
@@ -1899,6 +2271,58 @@ virJSONValueFromString(const char *jsonstring)
 }
 
 
+virJSONValuePtr
+virJSONValueFromString(const char *jsonstring)
+{
+    return virJSONValueFromStringInternal(jsonstring, NULL, false);
+}
+
+
+/**
+ * virJSONValueFromStringFiltered:
+ * @jsonstring: JSON document
+ * @filter: NULL terminated list of members to keep
+ *
+ * Parses @jsonstring, but creates only the parts of the JSON value tree
+ * which are needed to hold the members listed in @filter. Members are
+ * given as dotted paths of object keys from the top level object, e.g.
+ * "return.image.virtual-size". Members of arrays are not addressed
+ * separately; the filter applies to every array member. Anything else
+ * is skipped while parsing and never allocated.
+ *
+ * Returns the parsed (and possibly pruned) object or NULL on error.
+ */
+virJSONValuePtr
+virJSONValueFromStringFiltered(const char *jsonstring,
+                               const char *const *filter)
+{
+    return virJSONValueFromStringInternal(jsonstring, filter, false);
+}
+
+
+/**
+ * virJSONValueFromStringArena:
+ * @jsonstring: JSON document
+ * @filter: optional NULL terminated list of members to keep
+ *
+ * Same as virJSONValueFromStringFiltered (or virJSONValueFromString if
+ * @filter is NULL), but all nodes, keys and strings of the result are
+ * allocated from a single arena which is released at once by
+ * virJSONValueFree on the returned value.
+ *
+ * The result is meant for read-only use. Members can't be added to its
+ * containers, and stealing a member returns a heap allocated copy.
+ *
+ * Returns the parsed object or NULL on error.
+ */
+virJSONValuePtr
+virJSONValueFromStringArena(const char *jsonstring,
+                            const char *const *filter)
+{
+    return virJSONValueFromStringInternal(jsonstring, filter, true);
+}
+
+
 static int
 virJSONValueToStringOne(virJSONValuePtr object,
                         yajl_gen g)
@@ -2016,6 +2440,26 @@ virJSONValueFromString(const char *jsonstring G_GNUC_UNUSED)
 }
 
 
+virJSONValuePtr
+virJSONValueFromStringFiltered(const char *jsonstring G_GNUC_UNUSED,
+                               const char *const *filter G_GNUC_UNUSED)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("No JSON parser implementation is available"));
+    return NULL;
+}
+
+
+virJSONValuePtr
+virJSONValueFromStringArena(const char *jsonstring G_GNUC_UNUSED,
+                            const char *const *filter G_GNUC_UNUSED)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("No JSON parser implementation is available"));
+    return NULL;
+}
+
+
 int
 virJSONValueToBuffer(virJSONValuePtr object G_GNUC_UNUSED,
                      virBufferPtr buf G_GNUC_UNUSED,
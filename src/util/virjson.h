@@ -145,6 +145,11 @@ int virJSONValueObjectRemoveKey(virJSONValuePtr object, const char *key,
 int virJSONValueArrayAppendString(virJSONValuePtr object, const char *value);
 
 virJSONValuePtr virJSONValueFromString(const char *jsonstring);
+virJSONValuePtr virJSONValueFromStringFiltered(const char *jsonstring,
+                                               const char *const *filter)
+    ATTRIBUTE_NONNULL(2);
+virJSONValuePtr virJSONValueFromStringArena(const char *jsonstring,
+                                            const char *const *filter);
 char *virJSONValueToString(virJSONValuePtr object,
                            bool pretty);
 int virJSONValueToBuffer(virJSONValuePtr object,
@@ -25,8 +25,11 @@
 #include "virlease.h"
 
 #include <time.h>
+#include <sys/stat.h>
 
 #include "virfile.h"
+#include "virleaseindex.h"
+#include "virsocketaddr.h"
 #include "virstring.h"
 #include "virerror.h"
 #include "viralloc.h"
@@ -259,3 +262,102 @@ virLeaseNew(virJSONValuePtr *lease_ret,
     lease_new = NULL;
     return 0;
 }
+
+
+typedef struct _virLeaseIndexData virLeaseIndexData;
+struct _virLeaseIndexData {
+    virLeaseIndexHeader header;
+    virLeaseIndexEntry *entries;
+};
+
+
+static int
+virLeaseWriteIndexHelper(int fd, const void *opaque)
+{
+    const virLeaseIndexData *data = opaque;
+
+    if (safewrite(fd, &data->header, sizeof(data->header)) < 0 ||
+        safewrite(fd, data->entries,
+                  sizeof(*data->entries) * data->header.nentries) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+/**
+ * virLeaseWriteIndex:
+ * @leases_array: leases as stored in @custom_lease_file
+ * @custom_lease_file: path to the lease status file
+ * @index_file: path to the index file to write
+ *
+ * Writes the binary index of @leases_array (see virleaseindex.h) which
+ * lets the NSS module look leases up without parsing JSON. The index is
+ * tied to the current @custom_lease_file which therefore has to be
+ * written before calling this function.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virLeaseWriteIndex(virJSONValuePtr leases_array,
+                   const char *custom_lease_file,
+                   const char *index_file)
+{
+    size_t nleases = virJSONValueArraySize(leases_array);
+    g_autofree virLeaseIndexEntry *entries = g_new0(virLeaseIndexEntry, nleases);
+    virLeaseIndexData data = { .entries = entries };
+    struct stat sb;
+    size_t nentries = 0;
+    size_t i;
+
+    for (i = 0; i < nleases; i++) {
+        virJSONValuePtr lease = virJSONValueArrayGet(leases_array, i);
+        virLeaseIndexEntry *entry = entries + nentries;
+        const char *ip = virJSONValueObjectGetString(lease, "ip-address");
+        const char *mac = virJSONValueObjectGetString(lease, "mac-address");
+        const char *hostname = virJSONValueObjectGetString(lease, "hostname");
+        long long expirytime = 0;
+        virSocketAddr addr;
+
+        /* leases without an address can't be looked up anyway */
+        if (!ip || virSocketAddrParse(&addr, ip, AF_UNSPEC) < 0)
+            continue;
+
+        memset(entry, 0, sizeof(*entry));
+        ignore_value(virJSONValueObjectGetNumberLong(lease, "expiry-time",
+                                                     &expirytime));
+
+        entry->expirytime = expirytime;
+        entry->af = VIR_SOCKET_ADDR_FAMILY(&addr);
+        if (entry->af == AF_INET)
+            memcpy(entry->addr, &addr.data.inet4.sin_addr,
+                   sizeof(addr.data.inet4.sin_addr));
+        else
+            memcpy(entry->addr, &addr.data.inet6.sin6_addr,
+                   sizeof(addr.data.inet6.sin6_addr));
+
+        if (mac && virStrcpyStatic(entry->mac, mac) < 0)
+            continue;
+
+        /* an overly long hostname is never going to be looked up */
+        if (hostname)
+            ignore_value(virStrcpyStatic(entry->hostname, hostname));
+
+        nentries++;
+    }
+
+    if (stat(custom_lease_file, &sb) < 0) {
+        virReportSystemError(errno, _("cannot stat file '%s'"),
+                             custom_lease_file);
+        return -1;
+    }
+
+    memcpy(data.header.magic, VIR_LEASE_INDEX_MAGIC, VIR_LEASE_INDEX_MAGIC_LEN);
+    data.header.nentries = nentries;
+    data.header.entrysize = sizeof(virLeaseIndexEntry);
+    data.header.statusino = sb.st_ino;
+    data.header.statussize = sb.st_size;
+    data.header.statusmtime = sb.st_mtime;
+
+    return virFileRewrite(index_file, 0644, virLeaseWriteIndexHelper, &data);
+}
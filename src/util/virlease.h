@@ -40,3 +40,7 @@ int virLeaseNew(virJSONValuePtr *lease_ret,
                 const char *hostname,
                 const char *iaid,
                 const char *server_duid);
+
+int virLeaseWriteIndex(virJSONValuePtr leases_array,
+                       const char *custom_lease_file,
+                       const char *index_file);
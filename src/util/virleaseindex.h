@@ -0,0 +1,65 @@
+/*
+ * virleaseindex.h: binary index of DHCP leases
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+/* This header is shared with the NSS module which doesn't link with
+ * libvirt, so it must not depend on anything but the C library. */
+
+#include <stdint.h>
+
+/*
+ * Next to every $bridge.status lease file written by the leases helper
+ * there is a $bridge.index file holding the same leases as an array of
+ * fixed size records which can be mapped into memory and scanned without
+ * any parsing.
+ *
+ * The index is valid only as long as the status file it was built from
+ * is in place. Since the status file is always replaced by renaming a
+ * new file over it, comparing its inode, size and modification time is
+ * enough to detect a stale index. Readers have to fall back to parsing
+ * the status file whenever the index is missing, malformed or stale.
+ */
+
+#define VIR_LEASE_INDEX_MAGIC "LVLIDX01"
+#define VIR_LEASE_INDEX_MAGIC_LEN 8
+
+#define VIR_LEASE_INDEX_MAC_LEN 20
+#define VIR_LEASE_INDEX_HOSTNAME_LEN 256
+
+typedef struct _virLeaseIndexHeader virLeaseIndexHeader;
+struct _virLeaseIndexHeader {
+    char magic[VIR_LEASE_INDEX_MAGIC_LEN];
+    uint32_t nentries;
+    uint32_t entrysize; /* sizeof(virLeaseIndexEntry) */
+
+    /* identity of the status file the index was built from */
+    uint64_t statusino;
+    uint64_t statussize;
+    int64_t statusmtime;
+};
+
+typedef struct _virLeaseIndexEntry virLeaseIndexEntry;
+struct _virLeaseIndexEntry {
+    int64_t expirytime;
+    uint8_t addr[16];  /* in network byte order */
+    uint32_t af;       /* AF_INET or AF_INET6 */
+    char mac[VIR_LEASE_INDEX_MAC_LEN];  /* empty if unknown */
+    char hostname[VIR_LEASE_INDEX_HOSTNAME_LEN];  /* empty if unknown */
+};
@@ -41,6 +41,9 @@ VIR_LOG_INIT("util.lockspace");
 
 #define VIR_LOCKSPACE_TABLE_SIZE 10
 
+/* Number of independently locked parts resources are spread over */
+#define VIR_LOCKSPACE_SHARDS 16
+
 typedef struct _virLockSpaceResource virLockSpaceResource;
 typedef virLockSpaceResource *virLockSpaceResourcePtr;
 
@@ -54,11 +57,28 @@ struct _virLockSpaceResource {
     pid_t *owners;
 };
 
+typedef struct _virLockSpaceShard virLockSpaceShard;
+typedef virLockSpaceShard *virLockSpaceShardPtr;
+
+struct _virLockSpaceShard {
+    virMutex lock;
+    virHashTablePtr resources;
+};
+
+/*
+ * Resources are spread over shards by a hash of their name, each with
+ * its own mutex, so that operations on different resources, which
+ * may have to wait for I/O on shared storage, run in parallel.
+ *
+ * @lock is held for reading by anything working with a single
+ * shard and for writing by anything needing a consistent view of
+ * all of them.
+ */
 struct _virLockSpace {
     char *dir;
-    virMutex lock;
+    virRWLock lock;
 
-    virHashTablePtr resources;
+    virLockSpaceShard shards[VIR_LOCKSPACE_SHARDS];
 };
 
 
@@ -235,27 +255,88 @@ static void virLockSpaceResourceDataFree(void *opaque)
 }
 
 
-virLockSpacePtr virLockSpaceNew(const char *directory)
+static virLockSpacePtr virLockSpaceAlloc(void)
 {
     virLockSpacePtr lockspace;
-
-    VIR_DEBUG("directory=%s", NULLSTR(directory));
+    size_t i;
 
     if (VIR_ALLOC(lockspace) < 0)
         return NULL;
 
-    if (virMutexInit(&lockspace->lock) < 0) {
+    if (virRWLockInit(&lockspace->lock) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("Unable to initialize lockspace mutex"));
         VIR_FREE(lockspace);
         return NULL;
     }
 
-    lockspace->dir = g_strdup(directory);
+    for (i = 0; i < VIR_LOCKSPACE_SHARDS; i++) {
+        virLockSpaceShardPtr shard = &lockspace->shards[i];
 
-    if (!(lockspace->resources = virHashCreate(VIR_LOCKSPACE_TABLE_SIZE,
+        if (virMutexInit(&shard->lock) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("Unable to initialize lockspace mutex"));
+            goto error;
+        }
+
+        if (!(shard->resources = virHashCreate(VIR_LOCKSPACE_TABLE_SIZE,
                                                virLockSpaceResourceDataFree)))
-        goto error;
+            goto error;
+    }
+
+    return lockspace;
+
+ error:
+    virLockSpaceFree(lockspace);
+    return NULL;
+}
+
+
+static virLockSpaceShardPtr
+virLockSpaceGetShard(virLockSpacePtr lockspace,
+                     const char *resname)
+{
+    return &lockspace->shards[g_str_hash(resname) % VIR_LOCKSPACE_SHARDS];
+}
+
+
+/*
+ * Returns the locked shard of @lockspace holding @resname. The caller
+ * has to release it with virLockSpaceShardUnlock.
+ */
+static virLockSpaceShardPtr
+virLockSpaceShardLock(virLockSpacePtr lockspace,
+                      const char *resname)
+{
+    virLockSpaceShardPtr shard;
+
+    virRWLockRead(&lockspace->lock);
+    shard = virLockSpaceGetShard(lockspace, resname);
+    virMutexLock(&shard->lock);
+
+    return shard;
+}
+
+
+static void
+virLockSpaceShardUnlock(virLockSpacePtr lockspace,
+                        virLockSpaceShardPtr shard)
+{
+    virMutexUnlock(&shard->lock);
+    virRWLockUnlock(&lockspace->lock);
+}
+
+
+virLockSpacePtr virLockSpaceNew(const char *directory)
+{
+    virLockSpacePtr lockspace;
+
+    VIR_DEBUG("directory=%s", NULLSTR(directory));
+
+    if (!(lockspace = virLockSpaceAlloc()))
+        return NULL;
+
+    lockspace->dir = g_strdup(directory);
 
     if (directory) {
         if (virFileExists(directory)) {
@@ -292,20 +373,9 @@ virLockSpacePtr virLockSpaceNewPostExecRestart(virJSONValuePtr object)
 
     VIR_DEBUG("object=%p", object);
 
-    if (VIR_ALLOC(lockspace) < 0)
+    if (!(lockspace = virLockSpaceAlloc()))
         return NULL;
 
-    if (virMutexInit(&lockspace->lock) < 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("Unable to initialize lockspace mutex"));
-        VIR_FREE(lockspace);
-        return NULL;
-    }
-
-    if (!(lockspace->resources = virHashCreate(VIR_LOCKSPACE_TABLE_SIZE,
-                                               virLockSpaceResourceDataFree)))
-        goto error;
-
     if (virJSONValueObjectHasKey(object, "directory")) {
         const char *dir = virJSONValueObjectGetString(object, "directory");
         lockspace->dir = g_strdup(dir);
@@ -326,6 +396,7 @@ virLockSpacePtr virLockSpaceNewPostExecRestart(virJSONValuePtr object)
     for (i = 0; i < virJSONValueArraySize(resources); i++) {
         virJSONValuePtr child = virJSONValueArrayGet(resources, i);
         virLockSpaceResourcePtr res;
+        virLockSpaceShardPtr shard;
         const char *tmp;
         virJSONValuePtr owners;
         size_t j;
@@ -411,7 +482,8 @@ virLockSpacePtr virLockSpaceNewPostExecRestart(virJSONValuePtr object)
             res->owners[j] = (pid_t)owner;
         }
 
-        if (virHashAddEntry(lockspace->resources, res->name, res) < 0) {
+        shard = virLockSpaceGetShard(lockspace, res->name);
+        if (virHashAddEntry(shard->resources, res->name, res) < 0) {
             virLockSpaceResourceFree(res);
             goto error;
         }
@@ -425,13 +497,62 @@ virLockSpacePtr virLockSpaceNewPostExecRestart(virJSONValuePtr object)
 }
 
 
+static int
+virLockSpaceResourcePreExecRestart(virLockSpaceResourcePtr res,
+                                   virJSONValuePtr resources)
+{
+    virJSONValuePtr child = virJSONValueNewObject();
+    virJSONValuePtr owners = NULL;
+    size_t i;
+
+    if (virJSONValueArrayAppend(resources, child) < 0) {
+        virJSONValueFree(child);
+        return -1;
+    }
+
+    if (virJSONValueObjectAppendString(child, "name", res->name) < 0 ||
+        virJSONValueObjectAppendString(child, "path", res->path) < 0 ||
+        virJSONValueObjectAppendNumberInt(child, "fd", res->fd) < 0 ||
+        virJSONValueObjectAppendBoolean(child, "lockHeld", res->lockHeld) < 0 ||
+        virJSONValueObjectAppendNumberUint(child, "flags", res->flags) < 0)
+        return -1;
+
+    if (virSetInherit(res->fd, true) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Cannot disable close-on-exec flag"));
+        return -1;
+    }
+
+    owners = virJSONValueNewArray();
+
+    if (virJSONValueObjectAppend(child, "owners", owners) < 0) {
+        virJSONValueFree(owners);
+        return -1;
+    }
+
+    for (i = 0; i < res->nOwners; i++) {
+        virJSONValuePtr owner = virJSONValueNewNumberUlong(res->owners[i]);
+        if (!owner)
+            return -1;
+
+        if (virJSONValueArrayAppend(owners, owner) < 0) {
+            virJSONValueFree(owner);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
 virJSONValuePtr virLockSpacePreExecRestart(virLockSpacePtr lockspace)
 {
     virJSONValuePtr object = virJSONValueNewObject();
     virJSONValuePtr resources;
     virHashKeyValuePairPtr pairs = NULL, tmp;
+    size_t i;
 
-    virMutexLock(&lockspace->lock);
+    virRWLockWrite(&lockspace->lock);
 
     if (lockspace->dir &&
         virJSONValueObjectAppendString(object, "directory", lockspace->dir) < 0)
@@ -444,72 +565,43 @@ virJSONValuePtr virLockSpacePreExecRestart(virLockSpacePtr lockspace)
         goto error;
     }
 
-    tmp = pairs = virHashGetItems(lockspace->resources, NULL);
-    while (tmp && tmp->value) {
-        virLockSpaceResourcePtr res = (virLockSpaceResourcePtr)tmp->value;
-        virJSONValuePtr child = virJSONValueNewObject();
-        virJSONValuePtr owners = NULL;
-        size_t i;
-
-        if (virJSONValueArrayAppend(resources, child) < 0) {
-            virJSONValueFree(child);
-            goto error;
-        }
-
-        if (virJSONValueObjectAppendString(child, "name", res->name) < 0 ||
-            virJSONValueObjectAppendString(child, "path", res->path) < 0 ||
-            virJSONValueObjectAppendNumberInt(child, "fd", res->fd) < 0 ||
-            virJSONValueObjectAppendBoolean(child, "lockHeld", res->lockHeld) < 0 ||
-            virJSONValueObjectAppendNumberUint(child, "flags", res->flags) < 0)
-            goto error;
-
-        if (virSetInherit(res->fd, true) < 0) {
-            virReportSystemError(errno, "%s",
-                                 _("Cannot disable close-on-exec flag"));
-            goto error;
-        }
-
-        owners = virJSONValueNewArray();
-
-        if (virJSONValueObjectAppend(child, "owners", owners) < 0) {
-            virJSONValueFree(owners);
-            goto error;
-        }
+    for (i = 0; i < VIR_LOCKSPACE_SHARDS; i++) {
+        tmp = pairs = virHashGetItems(lockspace->shards[i].resources, NULL);
+        while (tmp && tmp->value) {
+            virLockSpaceResourcePtr res = (virLockSpaceResourcePtr)tmp->value;
 
-        for (i = 0; i < res->nOwners; i++) {
-            virJSONValuePtr owner = virJSONValueNewNumberUlong(res->owners[i]);
-            if (!owner)
+            if (virLockSpaceResourcePreExecRestart(res, resources) < 0)
                 goto error;
 
-            if (virJSONValueArrayAppend(owners, owner) < 0) {
-                virJSONValueFree(owner);
-                goto error;
-            }
+            tmp++;
         }
-
-        tmp++;
+        VIR_FREE(pairs);
     }
-    VIR_FREE(pairs);
 
-    virMutexUnlock(&lockspace->lock);
+    virRWLockUnlock(&lockspace->lock);
     return object;
 
  error:
     VIR_FREE(pairs);
     virJSONValueFree(object);
-    virMutexUnlock(&lockspace->lock);
+    virRWLockUnlock(&lockspace->lock);
     return NULL;
 }
 
 
 void virLockSpaceFree(virLockSpacePtr lockspace)
 {
+    size_t i;
+
     if (!lockspace)
         return;
 
-    virHashFree(lockspace->resources);
+    for (i = 0; i < VIR_LOCKSPACE_SHARDS; i++) {
+        virHashFree(lockspace->shards[i].resources);
+        virMutexDestroy(&lockspace->shards[i].lock);
+    }
     VIR_FREE(lockspace->dir);
-    virMutexDestroy(&lockspace->lock);
+    virRWLockDestroy(&lockspace->lock);
     VIR_FREE(lockspace);
 }
 
@@ -525,12 +617,13 @@ int virLockSpaceCreateResource(virLockSpacePtr lockspace,
 {
     int ret = -1;
     char *respath = NULL;
+    virLockSpaceShardPtr shard;
 
     VIR_DEBUG("lockspace=%p resname=%s", lockspace, resname);
 
-    virMutexLock(&lockspace->lock);
+    shard = virLockSpaceShardLock(lockspace, resname);
 
-    if (virHashLookup(lockspace->resources, resname) != NULL) {
+    if (virHashLookup(shard->resources, resname) != NULL) {
         virReportError(VIR_ERR_RESOURCE_BUSY,
                        _("Lockspace resource '%s' is locked"),
                        resname);
@@ -546,7 +639,7 @@ int virLockSpaceCreateResource(virLockSpacePtr lockspace,
     ret = 0;
 
  cleanup:
-    virMutexUnlock(&lockspace->lock);
+    virLockSpaceShardUnlock(lockspace, shard);
     VIR_FREE(respath);
     return ret;
 }
@@ -557,12 +650,13 @@ int virLockSpaceDeleteResource(virLockSpacePtr lockspace,
 {
     int ret = -1;
     char *respath = NULL;
+    virLockSpaceShardPtr shard;
 
     VIR_DEBUG("lockspace=%p resname=%s", lockspace, resname);
 
-    virMutexLock(&lockspace->lock);
+    shard = virLockSpaceShardLock(lockspace, resname);
 
-    if (virHashLookup(lockspace->resources, resname) != NULL) {
+    if (virHashLookup(shard->resources, resname) != NULL) {
         virReportError(VIR_ERR_RESOURCE_BUSY,
                        _("Lockspace resource '%s' is locked"),
                        resname);
@@ -583,7 +677,7 @@ int virLockSpaceDeleteResource(virLockSpacePtr lockspace,
     ret = 0;
 
  cleanup:
-    virMutexUnlock(&lockspace->lock);
+    virLockSpaceShardUnlock(lockspace, shard);
     VIR_FREE(respath);
     return ret;
 }
@@ -596,6 +690,7 @@ int virLockSpaceAcquireResource(virLockSpacePtr lockspace,
 {
     int ret = -1;
     virLockSpaceResourcePtr res;
+    virLockSpaceShardPtr shard;
 
     VIR_DEBUG("lockspace=%p resname=%s flags=0x%x owner=%lld",
               lockspace, resname, flags, (unsigned long long)owner);
@@ -603,9 +698,9 @@ int virLockSpaceAcquireResource(virLockSpacePtr lockspace,
     virCheckFlags(VIR_LOCK_SPACE_ACQUIRE_SHARED |
                   VIR_LOCK_SPACE_ACQUIRE_AUTOCREATE, -1);
 
-    virMutexLock(&lockspace->lock);
+    shard = virLockSpaceShardLock(lockspace, resname);
 
-    if ((res = virHashLookup(lockspace->resources, resname))) {
+    if ((res = virHashLookup(shard->resources, resname))) {
         if ((res->flags & VIR_LOCK_SPACE_ACQUIRE_SHARED) &&
             (flags & VIR_LOCK_SPACE_ACQUIRE_SHARED)) {
 
@@ -624,7 +719,7 @@ int virLockSpaceAcquireResource(virLockSpacePtr lockspace,
     if (!(res = virLockSpaceResourceNew(lockspace, resname, flags, owner)))
         goto cleanup;
 
-    if (virHashAddEntry(lockspace->resources, resname, res) < 0) {
+    if (virHashAddEntry(shard->resources, resname, res) < 0) {
         virLockSpaceResourceFree(res);
         goto cleanup;
     }
@@ -633,7 +728,7 @@ int virLockSpaceAcquireResource(virLockSpacePtr lockspace,
     ret = 0;
 
  cleanup:
-    virMutexUnlock(&lockspace->lock);
+    virLockSpaceShardUnlock(lockspace, shard);
     return ret;
 }
 
@@ -644,14 +739,15 @@ int virLockSpaceReleaseResource(virLockSpacePtr lockspace,
 {
     int ret = -1;
     virLockSpaceResourcePtr res;
+    virLockSpaceShardPtr shard;
     size_t i;
 
     VIR_DEBUG("lockspace=%p resname=%s owner=%lld",
               lockspace, resname, (unsigned long long)owner);
 
-    virMutexLock(&lockspace->lock);
+    shard = virLockSpaceShardLock(lockspace, resname);
 
-    if (!(res = virHashLookup(lockspace->resources, resname))) {
+    if (!(res = virHashLookup(shard->resources, resname))) {
         virReportError(VIR_ERR_RESOURCE_BUSY,
                        _("Lockspace resource '%s' is not locked"),
                        resname);
@@ -673,13 +769,13 @@ int virLockSpaceReleaseResource(virLockSpacePtr lockspace,
     VIR_DELETE_ELEMENT(res->owners, i, res->nOwners);
 
     if ((res->nOwners == 0) &&
-        virHashRemoveEntry(lockspace->resources, resname) < 0)
+        virHashRemoveEntry(shard->resources, resname) < 0)
         goto cleanup;
 
     ret = 0;
 
  cleanup:
-    virMutexUnlock(&lockspace->lock);
+    virLockSpaceShardUnlock(lockspace, shard);
     return ret;
 }
 
@@ -726,26 +822,31 @@ virLockSpaceRemoveResourcesForOwner(const void *payload,
 int virLockSpaceReleaseResourcesForOwner(virLockSpacePtr lockspace,
                                          pid_t owner)
 {
-    int ret = 0;
     struct virLockSpaceRemoveData data = {
         owner, 0
     };
+    size_t i;
 
     VIR_DEBUG("lockspace=%p owner=%lld", lockspace, (unsigned long long)owner);
 
-    virMutexLock(&lockspace->lock);
+    virRWLockRead(&lockspace->lock);
 
-    if (virHashRemoveSet(lockspace->resources,
-                         virLockSpaceRemoveResourcesForOwner,
-                         &data) < 0)
-        goto error;
+    for (i = 0; i < VIR_LOCKSPACE_SHARDS; i++) {
+        virLockSpaceShardPtr shard = &lockspace->shards[i];
+        int rc;
 
-    ret = data.count;
+        virMutexLock(&shard->lock);
+        rc = virHashRemoveSet(shard->resources,
+                              virLockSpaceRemoveResourcesForOwner,
+                              &data);
+        virMutexUnlock(&shard->lock);
 
-    virMutexUnlock(&lockspace->lock);
-    return ret;
+        if (rc < 0) {
+            virRWLockUnlock(&lockspace->lock);
+            return -1;
+        }
+    }
 
- error:
-    virMutexUnlock(&lockspace->lock);
-    return -1;
+    virRWLockUnlock(&lockspace->lock);
+    return data.count;
 }
@@ -72,6 +72,11 @@ VIR_ENUM_IMPL(virLogDestination,
               "stderr", "syslog", "file", "journald",
 );
 
+VIR_ENUM_IMPL(virLogOverflow,
+              VIR_LOG_OVERFLOW_LAST,
+              "drop", "block",
+);
+
 /*
  * Filters are used to refine the rules on what to keep or drop
  * based on a matching pattern (currently a substring)
@@ -82,6 +87,8 @@ struct _virLogFilter {
 };
 
 static int virLogFiltersSerial = 1;
+/* sources whose priority was resolved at least once, under virLogLock */
+static virLogSourcePtr virLogSources;
 static virLogFilterPtr *virLogFilters;
 static size_t virLogNbFilters;
 
@@ -110,6 +117,7 @@ static virLogPriority virLogDefaultPriority = VIR_LOG_DEFAULT;
 
 static void virLogResetFilters(void);
 static void virLogResetOutputs(void);
+static void virLogAsyncStop(void);
 static void virLogOutputToFd(virLogSourcePtr src,
                              virLogPriority priority,
                              const char *filename,
@@ -270,6 +278,22 @@ virLogOnceInit(void)
 VIR_ONCE_GLOBAL_INIT(virLog);
 
 
+/*
+ * Makes all sources match the filters again before their next message.
+ * Must be called with virLogLock held.
+ */
+static void
+virLogSourcesInvalidate(void)
+{
+    virLogSourcePtr source;
+
+    virLogFiltersSerial++;
+
+    for (source = virLogSources; source; source = source->next)
+        source->priority = 0;
+}
+
+
 /**
  * virLogReset:
  *
@@ -283,6 +307,8 @@ virLogReset(void)
     if (virLogInitialize() < 0)
         return -1;
 
+    virLogAsyncStop();
+
     virLogLock();
     virLogResetFilters();
     virLogResetOutputs();
@@ -313,7 +339,10 @@ virLogSetDefaultPriority(virLogPriority priority)
     if (virLogInitialize() < 0)
         return -1;
 
+    virLogLock();
     virLogDefaultPriority = priority;
+    virLogSourcesInvalidate();
+    virLogUnlock();
     return 0;
 }
 
@@ -329,7 +358,7 @@ virLogResetFilters(void)
     virLogFilterListFree(virLogFilters, virLogNbFilters);
     virLogFilters = NULL;
     virLogNbFilters = 0;
-    virLogFiltersSerial++;
+    virLogSourcesInvalidate();
 }
 
 
@@ -416,6 +445,7 @@ virLogOutputListFree(virLogOutputPtr *list, int count)
 
 static void
 virLogFormatString(char **msg,
+                   unsigned long long threadid,
                    int linenr,
                    const char *funcname,
                    virLogPriority priority,
@@ -423,11 +453,11 @@ virLogFormatString(char **msg,
 {
     if ((funcname != NULL)) {
         *msg = g_strdup_printf("%llu: %s : %s:%d : %s\n",
-                               virThreadSelfID(), virLogPriorityString(priority),
+                               threadid, virLogPriorityString(priority),
                                funcname, linenr, str);
     } else {
         *msg = g_strdup_printf("%llu: %s : %s\n",
-                               virThreadSelfID(), virLogPriorityString(priority),
+                               threadid, virLogPriorityString(priority),
                                str);
     }
 }
@@ -438,7 +468,8 @@ virLogVersionString(const char **rawmsg,
                     char **msg)
 {
     *rawmsg = VIR_LOG_VERSION_STRING;
-    virLogFormatString(msg, 0, NULL, VIR_LOG_INFO, VIR_LOG_VERSION_STRING);
+    virLogFormatString(msg, virThreadSelfID(), 0, NULL, VIR_LOG_INFO,
+                       VIR_LOG_VERSION_STRING);
 }
 
 /* Similar to virGetHostname() but avoids use of error
@@ -452,7 +483,7 @@ virLogHostnameString(char **rawmsg,
 
     hoststr = g_strdup_printf("hostname: %s", g_get_host_name());
 
-    virLogFormatString(msg, 0, NULL, VIR_LOG_INFO, hoststr);
+    virLogFormatString(msg, virThreadSelfID(), 0, NULL, VIR_LOG_INFO, hoststr);
     *rawmsg = hoststr;
 }
 
@@ -472,6 +503,13 @@ virLogSourceUpdate(virLogSourcePtr source)
             }
         }
 
+        /* remember the source so that its cached priority can be
+         * invalidated, sources are static so they are never removed */
+        if (source->serial == 0) {
+            source->next = virLogSources;
+            virLogSources = source;
+        }
+
         source->priority = priority;
         source->serial = virLogFiltersSerial;
     }
@@ -479,73 +517,27 @@ virLogSourceUpdate(virLogSourcePtr source)
 }
 
 
-/**
- * virLogVMessage:
- * @source: where is that message coming from
- * @priority: the priority level
- * @filename: file where the message was emitted
- * @linenr: line where the message was emitted
- * @funcname: the function emitting the (debug) message
- * @metadata: NULL or metadata array, terminated by an item with NULL key
- * @fmt: the string format
- * @vargs: format args
- *
- * Call the libvirt logger with some information. Based on the configuration
- * the message may be stored, sent to output or just discarded
+/*
+ * Pushes a formatted message to the outputs defined, if none exist then
+ * to stderr. Called either directly by the thread logging the message or
+ * by the asynchronous writer thread.
  */
 static void
-G_GNUC_PRINTF(7, 0)
-virLogVMessage(virLogSourcePtr source,
+virLogDispatch(virLogSourcePtr source,
                virLogPriority priority,
                const char *filename,
                int linenr,
                const char *funcname,
+               const char *timestamp,
                virLogMetadataPtr metadata,
-               const char *fmt,
-               va_list vargs)
+               const char *str,
+               const char *msg)
 {
     static bool logInitMessageStderr = true;
-    char *str = NULL;
-    char *msg = NULL;
-    char timestamp[VIR_TIME_STRING_BUFLEN];
     size_t i;
-    int saved_errno = errno;
-
-    if (virLogInitialize() < 0)
-        return;
-
-    if (fmt == NULL)
-        return;
-
-    /*
-     * 3 intentionally non-thread safe variable reads.
-     * Since writes to the variable are serialized on
-     * virLogLock, worst case result is a log message
-     * is accidentally dropped or emitted, if another
-     * thread is updating log filter list concurrently
-     * with a log message emission.
-     */
-    if (source->serial < virLogFiltersSerial)
-        virLogSourceUpdate(source);
-    if (priority < source->priority)
-        goto cleanup;
-
-    /*
-     * serialize the error message, add level and timestamp
-     */
-    str = g_strdup_vprintf(fmt, vargs);
-
-    virLogFormatString(&msg, linenr, funcname, priority, str);
-
-    if (virTimeStringNowRaw(timestamp) < 0)
-        timestamp[0] = '\0';
 
     virLogLock();
 
-    /*
-     * Push the message to the outputs defined, if none exist then
-     * use stderr.
-     */
     for (i = 0; i < virLogNbOutputs; i++) {
         if (priority >= virLogOutputs[i]->priority) {
             if (virLogOutputs[i]->logInitMessage) {
@@ -601,6 +593,574 @@ virLogVMessage(virLogSourcePtr source,
                          str, msg, (void *) STDERR_FILENO);
     }
     virLogUnlock();
+}
+
+
+/*
+ * Asynchronous logging
+ *
+ * Once enabled by virLogSetAsync, threads logging a message only format
+ * the message text and push it into a bounded ring buffer, everything
+ * else, i.e. formatting of the timestamp and the message line and
+ * feeding all the outputs, is done by a dedicated writer thread.
+ *
+ * The ring buffer is the classic bounded queue by Dmitry Vyukov: every
+ * cell carries a sequence number telling producers and the consumer
+ * whether it is free or filled for the current lap of the ring, so
+ * producers only contend on a single compare-and-exchange of the head
+ * position and never take a lock. The writer thread is the only
+ * consumer. Locks are only taken to wake up the writer when it went to
+ * sleep on an empty buffer, and by threads waiting for the writer to
+ * catch up, either in virLogFlush or in the 'block' overflow policy.
+ *
+ * Source, file and function names of messages are expected to be
+ * static strings, as they are when coming from the VIR_LOG_INIT and
+ * VIR_DEBUG family of macros, and are not copied.
+ */
+typedef struct _virLogRecord virLogRecord;
+typedef virLogRecord *virLogRecordPtr;
+struct _virLogRecord {
+    virLogSourcePtr source;
+    virLogPriority priority;
+    const char *filename;
+    int linenr;
+    const char *funcname;
+    virLogMetadataPtr metadata;
+    char *str;
+    unsigned long long threadid;
+    unsigned long long when;
+};
+
+typedef struct _virLogRingCell virLogRingCell;
+struct _virLogRingCell {
+    int seq;
+    virLogRecordPtr record;
+};
+
+typedef struct _virLogAsyncState virLogAsyncState;
+typedef virLogAsyncState *virLogAsyncStatePtr;
+struct _virLogAsyncState {
+    virLogRingCell *cells;
+    unsigned int mask;
+    virLogOverflow overflow;
+
+    unsigned int head; /* next position to fill, advanced by producers */
+    unsigned int tail; /* next position to consume, writer only */
+
+    virThread thread;
+    unsigned long long threadid;
+    pid_t pid;
+
+    virMutex lock;
+    virCond wake; /* signalled to wake up a sleeping writer */
+    virCond done; /* broadcasted when the writer consumed messages */
+    int sleeping;
+    bool quit;
+    unsigned int written; /* positions consumed so far, under @lock */
+    unsigned int dropped; /* virLogAsyncDropped when the writer started */
+};
+
+static virLogAsyncStatePtr virLogAsync;
+/* number of threads which may be using virLogAsync at the moment */
+static int virLogAsyncUsers;
+static unsigned int virLogAsyncDropped;
+
+
+static void
+virLogRecordFree(virLogRecordPtr record)
+{
+    size_t i;
+
+    if (!record)
+        return;
+
+    if (record->metadata) {
+        for (i = 0; record->metadata[i].key; i++) {
+            g_free((char *) record->metadata[i].key);
+            g_free((char *) record->metadata[i].s);
+        }
+        g_free(record->metadata);
+    }
+
+    g_free(record->str);
+    g_free(record);
+}
+
+
+static bool
+virLogRingPush(virLogAsyncStatePtr state,
+               virLogRecordPtr record)
+{
+    unsigned int pos = g_atomic_int_get(&state->head);
+    virLogRingCell *cell;
+
+    while (true) {
+        int diff;
+
+        cell = &state->cells[pos & state->mask];
+        diff = g_atomic_int_get(&cell->seq) - (int) pos;
+
+        if (diff == 0) {
+            if (g_atomic_int_compare_and_exchange((int *) &state->head,
+                                                  pos, pos + 1))
+                break;
+            pos = g_atomic_int_get(&state->head);
+        } else if (diff < 0) {
+            /* the cell still holds a message from the previous lap */
+            return false;
+        } else {
+            pos = g_atomic_int_get(&state->head);
+        }
+    }
+
+    cell->record = record;
+    g_atomic_int_set(&cell->seq, pos + 1);
+    return true;
+}
+
+
+static virLogRecordPtr
+virLogRingPop(virLogAsyncStatePtr state)
+{
+    unsigned int pos = state->tail;
+    virLogRingCell *cell = &state->cells[pos & state->mask];
+    virLogRecordPtr record;
+
+    if (g_atomic_int_get(&cell->seq) - (int) (pos + 1) < 0)
+        return NULL;
+
+    record = cell->record;
+    cell->record = NULL;
+    g_atomic_int_set(&cell->seq, pos + state->mask + 1);
+    state->tail = pos + 1;
+    return record;
+}
+
+
+static void
+virLogAsyncWrite(virLogRecordPtr record)
+{
+    g_autofree char *msg = NULL;
+    char timestamp[VIR_TIME_STRING_BUFLEN];
+
+    virLogFormatString(&msg, record->threadid, record->linenr,
+                       record->funcname, record->priority, record->str);
+
+    if (virTimeStringThenRaw(record->when, timestamp) < 0)
+        timestamp[0] = '\0';
+
+    virLogDispatch(record->source, record->priority,
+                   record->filename, record->linenr, record->funcname,
+                   timestamp, record->metadata, record->str, msg);
+}
+
+
+static void
+virLogAsyncReportDropped(unsigned int dropped)
+{
+    virLogRecord record = {
+        .source = &virLogSelf,
+        .priority = VIR_LOG_WARN,
+        .filename = __FILE__,
+        .linenr = __LINE__,
+        .funcname = __func__,
+        .threadid = virThreadSelfID(),
+    };
+    g_autofree char *str = NULL;
+
+    str = g_strdup_printf("%u log messages were dropped, the log buffer was full",
+                          dropped);
+    record.str = str;
+
+    if (virTimeMillisNowRaw(&record.when) < 0)
+        record.when = 0;
+
+    virLogAsyncWrite(&record);
+}
+
+
+static void
+virLogAsyncWorker(void *opaque)
+{
+    virLogAsyncStatePtr state = opaque;
+    unsigned int reported = state->dropped;
+
+    state->threadid = virThreadSelfID();
+
+    while (true) {
+        virLogRecordPtr record;
+        unsigned int dropped;
+        unsigned int n = 0;
+
+        while ((record = virLogRingPop(state))) {
+            virLogAsyncWrite(record);
+            virLogRecordFree(record);
+            n++;
+        }
+
+        dropped = g_atomic_int_get(&virLogAsyncDropped);
+        if (dropped != reported) {
+            virLogAsyncReportDropped(dropped - reported);
+            reported = dropped;
+        }
+
+        virMutexLock(&state->lock);
+
+        if (n > 0) {
+            state->written += n;
+            virCondBroadcast(&state->done);
+            virMutexUnlock(&state->lock);
+            continue;
+        }
+
+        if (state->quit) {
+            virMutexUnlock(&state->lock);
+            break;
+        }
+
+        /* Producers check the flag after publishing their message, so
+         * either they see it set and signal us, or we see their
+         * message when checking the buffer once more. */
+        g_atomic_int_set(&state->sleeping, 1);
+        if (g_atomic_int_get(&state->cells[state->tail & state->mask].seq) -
+            (int) (state->tail + 1) < 0)
+            ignore_value(virCondWait(&state->wake, &state->lock));
+        g_atomic_int_set(&state->sleeping, 0);
+
+        virMutexUnlock(&state->lock);
+    }
+}
+
+
+static void
+virLogAsyncWakeWriter(virLogAsyncStatePtr state)
+{
+    if (!g_atomic_int_get(&state->sleeping))
+        return;
+
+    virMutexLock(&state->lock);
+    virCondSignal(&state->wake);
+    virMutexUnlock(&state->lock);
+}
+
+
+/*
+ * Hands the message over to the asynchronous writer, if there is one.
+ * On success @str is stolen and true returned, otherwise the message
+ * has to be written by the caller.
+ */
+static bool
+virLogAsyncPush(virLogSourcePtr source,
+                virLogPriority priority,
+                const char *filename,
+                int linenr,
+                const char *funcname,
+                virLogMetadataPtr metadata,
+                char **str)
+{
+    virLogAsyncStatePtr state;
+    virLogRecordPtr record;
+    unsigned long long threadid;
+    bool ret = false;
+
+    if (!g_atomic_pointer_get(&virLogAsync))
+        return false;
+
+    g_atomic_int_inc(&virLogAsyncUsers);
+
+    if (!(state = g_atomic_pointer_get(&virLogAsync)))
+        goto cleanup;
+
+    /* The writer thread may log too, e.g. from within the outputs, and
+     * must never wait for itself */
+    threadid = virThreadSelfID();
+    if (threadid == state->threadid)
+        goto cleanup;
+
+    record = g_new0(virLogRecord, 1);
+    record->source = source;
+    record->priority = priority;
+    record->filename = filename;
+    record->linenr = linenr;
+    record->funcname = funcname;
+    record->threadid = threadid;
+    if (virTimeMillisNowRaw(&record->when) < 0)
+        record->when = 0;
+
+    if (metadata) {
+        size_t nmetadata = 0;
+        size_t i;
+
+        while (metadata[nmetadata].key)
+            nmetadata++;
+
+        record->metadata = g_new0(virLogMetadata, nmetadata + 1);
+        for (i = 0; i < nmetadata; i++) {
+            record->metadata[i].key = g_strdup(metadata[i].key);
+            record->metadata[i].s = g_strdup(metadata[i].s);
+            record->metadata[i].iv = metadata[i].iv;
+        }
+    }
+
+    record->str = *str;
+
+    if (!virLogRingPush(state, record)) {
+        if (state->overflow == VIR_LOG_OVERFLOW_DROP) {
+            record->str = NULL;
+            virLogRecordFree(record);
+            g_atomic_int_inc(&virLogAsyncDropped);
+            /* the message is accounted for, nothing left to write */
+            VIR_FREE(*str);
+            ret = true;
+            goto cleanup;
+        }
+
+        /* The writer does not sleep while the buffer is full, so just
+         * wait for it to consume something and retry */
+        virMutexLock(&state->lock);
+        while (!virLogRingPush(state, record))
+            ignore_value(virCondWait(&state->done, &state->lock));
+        virMutexUnlock(&state->lock);
+    }
+
+    *str = NULL;
+    virLogAsyncWakeWriter(state);
+    ret = true;
+
+ cleanup:
+    g_atomic_int_add(&virLogAsyncUsers, -1);
+    return ret;
+}
+
+
+/*
+ * Stops the writer thread after it wrote all pending messages and frees
+ * the asynchronous logging state. Messages logged afterwards are written
+ * synchronously again.
+ */
+static void
+virLogAsyncStop(void)
+{
+    virLogAsyncStatePtr state;
+
+    if (!(state = g_atomic_pointer_get(&virLogAsync)))
+        return;
+
+    g_atomic_pointer_set(&virLogAsync, NULL);
+
+    /* In a child process created by fork() the writer thread does not
+     * exist, there is nothing we could wait for. Leak the state, the
+     * child is going to exec or exit anyway. */
+    if (state->pid != getpid())
+        return;
+
+    /* wait for threads which picked up the state before it was cleared */
+    while (g_atomic_int_get(&virLogAsyncUsers) > 0)
+        g_thread_yield();
+
+    virMutexLock(&state->lock);
+    state->quit = true;
+    virCondSignal(&state->wake);
+    virMutexUnlock(&state->lock);
+
+    virThreadJoin(&state->thread);
+
+    virCondDestroy(&state->done);
+    virCondDestroy(&state->wake);
+    virMutexDestroy(&state->lock);
+    g_free(state->cells);
+    g_free(state);
+}
+
+
+/**
+ * virLogSetAsync:
+ * @size: number of messages which can be buffered, 0 to disable
+ * @overflow: what to do with messages if the buffer is full
+ *
+ * Moves formatting and writing of log messages to a dedicated thread, so
+ * that threads logging a message only have to format its text and queue
+ * it. Only messages passing the filters are queued. If more than @size
+ * messages are pending, messages are either dropped, which is counted
+ * and reported by the writer thread later, or the logging threads wait
+ * for the writer to catch up, according to @overflow. @size is rounded
+ * up to a power of two.
+ *
+ * Any previous writer thread is stopped after writing out all of its
+ * pending messages. Calling this with @size of 0 at exit makes sure no
+ * messages are lost.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virLogSetAsync(size_t size,
+               virLogOverflow overflow)
+{
+    virLogAsyncStatePtr state;
+    size_t i;
+
+    if (virLogInitialize() < 0)
+        return -1;
+
+    virLogAsyncStop();
+
+    if (size == 0)
+        return 0;
+
+    if (size > (1U << 24)) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("log buffer size %zu is too large"), size);
+        return -1;
+    }
+
+    state = g_new0(virLogAsyncState, 1);
+    state->mask = 1;
+    while (state->mask < size)
+        state->mask <<= 1;
+    state->cells = g_new0(virLogRingCell, state->mask);
+    for (i = 0; i < state->mask; i++)
+        state->cells[i].seq = i;
+    state->mask--;
+    state->overflow = overflow;
+    state->pid = getpid();
+    state->dropped = g_atomic_int_get(&virLogAsyncDropped);
+
+    if (virMutexInit(&state->lock) < 0) {
+        virReportSystemError(errno, "%s", _("unable to init mutex"));
+        goto error;
+    }
+
+    if (virCondInit(&state->wake) < 0 ||
+        virCondInit(&state->done) < 0) {
+        virReportSystemError(errno, "%s", _("unable to init condition"));
+        goto error;
+    }
+
+    if (virThreadCreateFull(&state->thread, true, virLogAsyncWorker,
+                            "log-writer", false, state) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to create log writer thread"));
+        goto error;
+    }
+
+    g_atomic_pointer_set(&virLogAsync, state);
+    return 0;
+
+ error:
+    g_free(state->cells);
+    g_free(state);
+    return -1;
+}
+
+
+/**
+ * virLogFlush:
+ *
+ * Waits until the asynchronous writer, if enabled, wrote all messages
+ * logged before this call.
+ */
+void
+virLogFlush(void)
+{
+    virLogAsyncStatePtr state;
+    unsigned int target;
+
+    g_atomic_int_inc(&virLogAsyncUsers);
+
+    if (!(state = g_atomic_pointer_get(&virLogAsync)) ||
+        state->threadid == virThreadSelfID())
+        goto cleanup;
+
+    target = g_atomic_int_get(&state->head);
+
+    virMutexLock(&state->lock);
+    while ((int) (state->written - target) < 0)
+        ignore_value(virCondWait(&state->done, &state->lock));
+    virMutexUnlock(&state->lock);
+
+ cleanup:
+    g_atomic_int_add(&virLogAsyncUsers, -1);
+}
+
+
+/**
+ * virLogGetDropped:
+ *
+ * Returns the number of messages dropped by the asynchronous writer
+ * because its buffer was full.
+ */
+unsigned int
+virLogGetDropped(void)
+{
+    return g_atomic_int_get(&virLogAsyncDropped);
+}
+
+
+/**
+ * virLogVMessage:
+ * @source: where is that message coming from
+ * @priority: the priority level
+ * @filename: file where the message was emitted
+ * @linenr: line where the message was emitted
+ * @funcname: the function emitting the (debug) message
+ * @metadata: NULL or metadata array, terminated by an item with NULL key
+ * @fmt: the string format
+ * @vargs: format args
+ *
+ * Call the libvirt logger with some information. Based on the configuration
+ * the message may be stored, sent to output or just discarded
+ */
+static void
+G_GNUC_PRINTF(7, 0)
+virLogVMessage(virLogSourcePtr source,
+               virLogPriority priority,
+               const char *filename,
+               int linenr,
+               const char *funcname,
+               virLogMetadataPtr metadata,
+               const char *fmt,
+               va_list vargs)
+{
+    char *str = NULL;
+    char *msg = NULL;
+    char timestamp[VIR_TIME_STRING_BUFLEN];
+    int saved_errno = errno;
+
+    if (virLogInitialize() < 0)
+        return;
+
+    if (fmt == NULL)
+        return;
+
+    /*
+     * 3 intentionally non-thread safe variable reads.
+     * Since writes to the variable are serialized on
+     * virLogLock, worst case result is a log message
+     * is accidentally dropped or emitted, if another
+     * thread is updating log filter list concurrently
+     * with a log message emission.
+     */
+    if (source->serial < virLogFiltersSerial)
+        virLogSourceUpdate(source);
+    if (priority < source->priority)
+        goto cleanup;
+
+    /*
+     * serialize the error message, add level and timestamp
+     */
+    str = g_strdup_vprintf(fmt, vargs);
+
+    if (virLogAsyncPush(source, priority, filename, linenr, funcname,
+                        metadata, &str))
+        goto cleanup;
+
+    virLogFormatString(&msg, virThreadSelfID(), linenr, funcname, priority, str);
+
+    if (virTimeStringNowRaw(timestamp) < 0)
+        timestamp[0] = '\0';
+
+    virLogDispatch(source, priority, filename, linenr, funcname,
+                   timestamp, metadata, str, msg);
 
  cleanup:
     VIR_FREE(str);
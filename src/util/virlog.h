@@ -22,6 +22,7 @@
 #pragma once
 
 #include "internal.h"
+#include "virenum.h"
 
 #ifdef PACKAGER_VERSION
 # ifdef PACKAGER
@@ -56,13 +57,32 @@ typedef enum {
     VIR_LOG_TO_OUTPUT_LAST,
 } virLogDestination;
 
+/* What to do with messages logged while the buffer of the asynchronous
+ * writer is full */
+typedef enum {
+    VIR_LOG_OVERFLOW_DROP = 0, /* discard the message and count it */
+    VIR_LOG_OVERFLOW_BLOCK,    /* wait until the writer makes space */
+
+    VIR_LOG_OVERFLOW_LAST
+} virLogOverflow;
+
+VIR_ENUM_DECL(virLogOverflow);
+
 typedef struct _virLogSource virLogSource;
 typedef virLogSource *virLogSourcePtr;
 
+/*
+ * @priority caches the minimal priority of messages from the source
+ * which pass the filters. It is 0 until the filters were matched against
+ * the source and is reset to 0 whenever the filters or the default
+ * priority change, so that checking it is all that is needed to reject
+ * a message, see VIR_LOG_SOURCE_ENABLED.
+ */
 struct _virLogSource {
     const char *name;
     unsigned int priority;
     unsigned int serial;
+    virLogSourcePtr next;
 };
 
 /*
@@ -73,18 +93,44 @@ struct _virLogSource {
 #define VIR_LOG_INIT(n) \
     static G_GNUC_UNUSED virLogSource virLogSelf = { \
         .name = "" n "", \
-        .priority = VIR_LOG_ERROR, \
+        .priority = 0, \
         .serial = 0, \
+        .next = NULL, \
     }
 
+/*
+ * Whether a message of priority @prio from @src may pass the filters.
+ * A false result is final, a true one may still be refined by
+ * virLogMessage once the filters were matched against @src. This is
+ * checked before the arguments of a message are even evaluated.
+ */
+#define VIR_LOG_SOURCE_ENABLED(src, prio) \
+    ((unsigned int) (prio) >= (src)->priority)
+
+#define VIR_LOG_INT(src, prio, filename, linenr, funcname, ...) \
+    do { \
+        if (VIR_LOG_SOURCE_ENABLED(src, prio)) \
+            virLogMessage(src, prio, filename, linenr, funcname, \
+                          NULL, __VA_ARGS__); \
+    } while (0)
+
+/* Debug and info messages are filtered out in the common case */
 #define VIR_DEBUG_INT(src, filename, linenr, funcname, ...) \
-    virLogMessage(src, VIR_LOG_DEBUG, filename, linenr, funcname, NULL, __VA_ARGS__)
+    do { \
+        if (G_UNLIKELY(VIR_LOG_SOURCE_ENABLED(src, VIR_LOG_DEBUG))) \
+            virLogMessage(src, VIR_LOG_DEBUG, filename, linenr, funcname, \
+                          NULL, __VA_ARGS__); \
+    } while (0)
 #define VIR_INFO_INT(src, filename, linenr, funcname, ...) \
-    virLogMessage(src, VIR_LOG_INFO, filename, linenr, funcname, NULL, __VA_ARGS__)
+    do { \
+        if (G_UNLIKELY(VIR_LOG_SOURCE_ENABLED(src, VIR_LOG_INFO))) \
+            virLogMessage(src, VIR_LOG_INFO, filename, linenr, funcname, \
+                          NULL, __VA_ARGS__); \
+    } while (0)
 #define VIR_WARN_INT(src, filename, linenr, funcname, ...) \
-    virLogMessage(src, VIR_LOG_WARN, filename, linenr, funcname, NULL, __VA_ARGS__)
+    VIR_LOG_INT(src, VIR_LOG_WARN, filename, linenr, funcname, __VA_ARGS__)
 #define VIR_ERROR_INT(src, filename, linenr, funcname, ...) \
-    virLogMessage(src, VIR_LOG_ERROR, filename, linenr, funcname, NULL, __VA_ARGS__)
+    VIR_LOG_INT(src, VIR_LOG_ERROR, filename, linenr, funcname, __VA_ARGS__)
 
 #define VIR_DEBUG(...) \
     VIR_DEBUG_INT(&virLogSelf, __FILE__, __LINE__, __func__, __VA_ARGS__)
@@ -168,6 +214,9 @@ void virLogSetDefaultOutput(const char *fname, bool godaemon, bool privileged);
 void virLogLock(void);
 void virLogUnlock(void);
 int virLogReset(void);
+int virLogSetAsync(size_t size, virLogOverflow overflow);
+void virLogFlush(void);
+unsigned int virLogGetDropped(void);
 int virLogParseDefaultPriority(const char *priority);
 int virLogPriorityFromSyslog(int priority);
 void virLogMessage(virLogSourcePtr source,
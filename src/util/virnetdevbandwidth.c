@@ -40,8 +40,8 @@ virNetDevBandwidthFree(virNetDevBandwidthPtr def)
 }
 
 static void
-virNetDevBandwidthCmdAddOptimalQuantum(virCommandPtr cmd,
-                                       const virNetDevBandwidthRate *rate)
+virNetDevBandwidthAddOptimalQuantum(virBufferPtr batch,
+                                    const virNetDevBandwidthRate *rate)
 {
     const unsigned long long mtu = 1500;
     unsigned long long r2q;
@@ -58,18 +58,52 @@ virNetDevBandwidthCmdAddOptimalQuantum(virCommandPtr cmd,
     if (!r2q)
         r2q = 1;
 
-    virCommandAddArg(cmd, "quantum");
-    virCommandAddArgFormat(cmd, "%llu", r2q);
+    virBufferAsprintf(batch, " quantum %llu", r2q);
 }
 
+
+/**
+ * virNetDevBandwidthRunBatch:
+ * @batch: tc commands, one per line
+ * @ignoreErrors: whether to run all commands regardless of failures
+ *
+ * Setting up QoS on a single interface takes a handful of tc commands.
+ * Rather than spawning tc for each of them, they are collected in
+ * @batch and fed to a single tc process. Unless @ignoreErrors is set,
+ * tc stops at the first failing command and the failure is reported.
+ * @batch is emptied.
+ *
+ * Returns: 0 on success,
+ *         -1 otherwise (with error reported).
+ */
+static int
+virNetDevBandwidthRunBatch(virBufferPtr batch,
+                           bool ignoreErrors)
+{
+    g_autoptr(virCommand) cmd = NULL;
+    g_autofree char *input = NULL;
+    int status;
+
+    if (!(input = virBufferContentAndReset(batch)))
+        return 0;
+
+    cmd = virCommandNew(TC);
+    if (ignoreErrors)
+        virCommandAddArg(cmd, "-force");
+    virCommandAddArgList(cmd, "-batch", "-", NULL);
+    virCommandSetInputBuffer(cmd, input);
+
+    return virCommandRun(cmd, ignoreErrors ? &status : NULL);
+}
+
+
 /**
- * virNetDevBandwidthManipulateFilter:
+ * virNetDevBandwidthBatchFilterAdd:
+ * @batch: tc commands to append to
  * @ifname: interface to operate on
  * @ifmac_ptr: MAC of the interface to create filter over
  * @id: filter ID
  * @class_id: where to place traffic
- * @remove_old: whether to remove the filter
- * @create_new: whether to create the filter
  *
  * TC filters are as crucial for traffic shaping as QDiscs. While
  * QDiscs act like black boxes deciding which packets should be
@@ -86,80 +120,47 @@ virNetDevBandwidthCmdAddOptimalQuantum(virCommandPtr cmd,
  * an @id which should be unique (per @ifname). And @class_id
  * tells into which QDisc should filter place the traffic.
  *
- * This function can be used for both, removing stale filter
- * (@remove_old set to true) and creating new one (@create_new
- * set to true). Both at once for the same price!
- *
- * Returns: 0 on success,
- *         -1 otherwise (with error reported).
+ * A stale filter with the same @id can be removed with
+ * virNetDevBandwidthBatchFilterDel().
  */
-static int ATTRIBUTE_NONNULL(1)
-virNetDevBandwidthManipulateFilter(const char *ifname,
-                                   const virMacAddr *ifmac_ptr,
-                                   unsigned int id,
-                                   const char *class_id,
-                                   bool remove_old,
-                                   bool create_new)
+static void
+virNetDevBandwidthBatchFilterAdd(virBufferPtr batch,
+                                 const char *ifname,
+                                 const virMacAddr *ifmac_ptr,
+                                 unsigned int id,
+                                 const char *class_id)
 {
-    int ret = -1;
-    char *filter_id = NULL;
-    virCommandPtr cmd = NULL;
     unsigned char ifmac[VIR_MAC_BUFLEN];
-    char *mac[2] = {NULL, NULL};
 
-    if (!(remove_old || create_new)) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("filter creation API error"));
-        goto cleanup;
-    }
+    virMacAddrGetRaw(ifmac_ptr, ifmac);
 
+    /* Okay, this not nice. But since libvirt does not necessarily track
+     * interface IP address(es), and tc fw filter simply refuse to use
+     * ebtables marks, we need to use u32 selector to match MAC address.
+     * If libvirt will ever know something, remove this FIXME
+     */
     /* u32 filters must have 800:: prefix. Don't ask. */
-    filter_id = g_strdup_printf("800::%u", id);
-
-    if (remove_old) {
-        int cmd_ret = 0;
-
-        cmd = virCommandNew(TC);
-        virCommandAddArgList(cmd, "filter", "del", "dev", ifname,
-                             "prio", "2", "handle",  filter_id, "u32", NULL);
-
-        if (virCommandRun(cmd, &cmd_ret) < 0)
-            goto cleanup;
-
-    }
-
-    if (create_new) {
-        virMacAddrGetRaw(ifmac_ptr, ifmac);
-
-        mac[0] = g_strdup_printf("0x%02x%02x%02x%02x", ifmac[2],
-                                 ifmac[3], ifmac[4], ifmac[5]);
-        mac[1] = g_strdup_printf("0x%02x%02x", ifmac[0], ifmac[1]);
+    virBufferAsprintf(batch,
+                      "filter add dev %s protocol ip prio 2 handle 800::%u u32 "
+                      "match u16 0x0800 0xffff at -2 "
+                      "match u32 0x%02x%02x%02x%02x 0xffffffff at -12 "
+                      "match u16 0x%02x%02x 0xffff at -14 "
+                      "flowid %s\n",
+                      ifname, id,
+                      ifmac[2], ifmac[3], ifmac[4], ifmac[5],
+                      ifmac[0], ifmac[1],
+                      class_id);
+}
 
-        virCommandFree(cmd);
-        cmd = virCommandNew(TC);
-        /* Okay, this not nice. But since libvirt does not necessarily track
-         * interface IP address(es), and tc fw filter simply refuse to use
-         * ebtables marks, we need to use u32 selector to match MAC address.
-         * If libvirt will ever know something, remove this FIXME
-         */
-        virCommandAddArgList(cmd, "filter", "add", "dev", ifname, "protocol", "ip",
-                             "prio", "2", "handle", filter_id, "u32",
-                             "match", "u16", "0x0800", "0xffff", "at", "-2",
-                             "match", "u32", mac[0], "0xffffffff", "at", "-12",
-                             "match", "u16", mac[1], "0xffff", "at", "-14",
-                             "flowid", class_id, NULL);
-
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
-    }
 
-    ret = 0;
- cleanup:
-    VIR_FREE(mac[1]);
-    VIR_FREE(mac[0]);
-    VIR_FREE(filter_id);
-    virCommandFree(cmd);
-    return ret;
+static void
+virNetDevBandwidthBatchFilterDel(virBufferPtr batch,
+                                 const char *ifname,
+                                 unsigned int id)
+{
+    virBufferAsprintf(batch,
+                      "filter del dev %s prio 2 handle 800::%u u32\n",
+                      ifname, id);
 }
 
 
@@ -192,17 +193,12 @@ virNetDevBandwidthSet(const char *ifname,
                       bool hierarchical_class,
                       bool swapped)
 {
-    int ret = -1;
     virNetDevBandwidthRatePtr rx = NULL, tx = NULL; /* From domain POV */
-    virCommandPtr cmd = NULL;
-    char *average = NULL;
-    char *peak = NULL;
-    char *burst = NULL;
+    g_auto(virBuffer) batch = VIR_BUFFER_INITIALIZER;
 
     if (!bandwidth) {
         /* nothing to be enabled */
-        ret = 0;
-        goto cleanup;
+        return 0;
     }
 
     if (geteuid() != 0) {
@@ -230,18 +226,8 @@ virNetDevBandwidthSet(const char *ifname,
     virNetDevBandwidthClear(ifname);
 
     if (tx && tx->average) {
-        average = g_strdup_printf("%llukbps", tx->average);
-        if (tx->peak)
-            peak = g_strdup_printf("%llukbps", tx->peak);
-        if (tx->burst)
-            burst = g_strdup_printf("%llukb", tx->burst);
-
-        cmd = virCommandNew(TC);
-        virCommandAddArgList(cmd, "qdisc", "add", "dev", ifname, "root",
-                             "handle", "1:", "htb", "default",
-                             hierarchical_class ? "2" : "1", NULL);
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
+        virBufferAsprintf(&batch, "qdisc add dev %s root handle 1: htb default %s\n",
+                          ifname, hierarchical_class ? "2" : "1");
 
         /* If we are creating a hierarchical class, all non guaranteed traffic
          * goes to the 1:2 class which will adjust 'rate' dynamically as NICs
@@ -307,88 +293,52 @@ virNetDevBandwidthSet(const char *ifname,
          * it before you dig into the code.
          */
         if (hierarchical_class) {
-            virCommandFree(cmd);
-            cmd = virCommandNew(TC);
-            virCommandAddArgList(cmd, "class", "add", "dev", ifname, "parent",
-                                 "1:", "classid", "1:1", "htb", "rate", average,
-                                 "ceil", peak ? peak : average, NULL);
-            virNetDevBandwidthCmdAddOptimalQuantum(cmd, tx);
-            if (virCommandRun(cmd, NULL) < 0)
-                goto cleanup;
+            virBufferAsprintf(&batch,
+                              "class add dev %s parent 1: classid 1:1 htb "
+                              "rate %llukbps ceil %llukbps",
+                              ifname, tx->average,
+                              tx->peak ? tx->peak : tx->average);
+            virNetDevBandwidthAddOptimalQuantum(&batch, tx);
+            virBufferAddLit(&batch, "\n");
         }
-        virCommandFree(cmd);
-        cmd = virCommandNew(TC);
-        virCommandAddArgList(cmd, "class", "add", "dev", ifname, "parent",
-                             hierarchical_class ? "1:1" : "1:", "classid",
-                             hierarchical_class ? "1:2" : "1:1", "htb",
-                             "rate", average, NULL);
-
-        if (peak)
-            virCommandAddArgList(cmd, "ceil", peak, NULL);
-        if (burst)
-            virCommandAddArgList(cmd, "burst", burst, NULL);
-
-        virNetDevBandwidthCmdAddOptimalQuantum(cmd, tx);
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
-
-        virCommandFree(cmd);
-        cmd = virCommandNew(TC);
-        virCommandAddArgList(cmd, "qdisc", "add", "dev", ifname, "parent",
-                             hierarchical_class ? "1:2" : "1:1",
-                             "handle", "2:", "sfq", "perturb",
-                             "10", NULL);
+        virBufferAsprintf(&batch,
+                          "class add dev %s parent %s classid %s htb rate %llukbps",
+                          ifname,
+                          hierarchical_class ? "1:1" : "1:",
+                          hierarchical_class ? "1:2" : "1:1",
+                          tx->average);
 
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
+        if (tx->peak)
+            virBufferAsprintf(&batch, " ceil %llukbps", tx->peak);
+        if (tx->burst)
+            virBufferAsprintf(&batch, " burst %llukb", tx->burst);
 
-        virCommandFree(cmd);
-        cmd = virCommandNew(TC);
-        virCommandAddArgList(cmd, "filter", "add", "dev", ifname, "parent",
-                             "1:0", "protocol", "all", "prio", "1", "handle",
-                             "1", "fw", "flowid", "1", NULL);
+        virNetDevBandwidthAddOptimalQuantum(&batch, tx);
+        virBufferAddLit(&batch, "\n");
 
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
+        virBufferAsprintf(&batch,
+                          "qdisc add dev %s parent %s handle 2: sfq perturb 10\n",
+                          ifname, hierarchical_class ? "1:2" : "1:1");
 
-        VIR_FREE(average);
-        VIR_FREE(peak);
-        VIR_FREE(burst);
+        virBufferAsprintf(&batch,
+                          "filter add dev %s parent 1:0 protocol all prio 1 "
+                          "handle 1 fw flowid 1\n",
+                          ifname);
     }
 
     if (rx) {
-        average = g_strdup_printf("%llukbps", rx->average);
-        burst = g_strdup_printf("%llukb", rx->burst ? rx->burst : rx->average);
-
-        virCommandFree(cmd);
-        cmd = virCommandNew(TC);
-            virCommandAddArgList(cmd, "qdisc", "add", "dev", ifname,
-                                 "ingress", NULL);
-
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
+        virBufferAsprintf(&batch, "qdisc add dev %s ingress\n", ifname);
 
-        virCommandFree(cmd);
-        cmd = virCommandNew(TC);
         /* Set filter to match all ingress traffic */
-        virCommandAddArgList(cmd, "filter", "add", "dev", ifname, "parent",
-                             "ffff:", "protocol", "all", "u32", "match", "u32",
-                             "0", "0", "police", "rate", average,
-                             "burst", burst, "mtu", "64kb", "drop", "flowid",
-                             ":1", NULL);
-
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
+        virBufferAsprintf(&batch,
+                          "filter add dev %s parent ffff: protocol all u32 "
+                          "match u32 0 0 police rate %llukbps burst %llukb "
+                          "mtu 64kb drop flowid :1\n",
+                          ifname, rx->average,
+                          rx->burst ? rx->burst : rx->average);
     }
 
-    ret = 0;
-
- cleanup:
-    virCommandFree(cmd);
-    VIR_FREE(average);
-    VIR_FREE(peak);
-    VIR_FREE(burst);
-    return ret;
+    return virNetDevBandwidthRunBatch(&batch, false);
 }
 
 /**
@@ -404,30 +354,15 @@ virNetDevBandwidthSet(const char *ifname,
 int
 virNetDevBandwidthClear(const char *ifname)
 {
-    int ret = 0;
-    int dummy; /* for ignoring the exit status */
-    virCommandPtr cmd = NULL;
+    g_auto(virBuffer) batch = VIR_BUFFER_INITIALIZER;
 
     if (!ifname)
        return 0;
 
-    cmd = virCommandNew(TC);
-    virCommandAddArgList(cmd, "qdisc", "del", "dev", ifname, "root", NULL);
-
-    if (virCommandRun(cmd, &dummy) < 0)
-        ret = -1;
-
-    virCommandFree(cmd);
-
-    cmd = virCommandNew(TC);
-    virCommandAddArgList(cmd, "qdisc",  "del", "dev", ifname, "ingress", NULL);
+    virBufferAsprintf(&batch, "qdisc del dev %s root\n", ifname);
+    virBufferAsprintf(&batch, "qdisc del dev %s ingress\n", ifname);
 
-    if (virCommandRun(cmd, &dummy) < 0)
-        ret = -1;
-
-    virCommandFree(cmd);
-
-    return ret;
+    return virNetDevBandwidthRunBatch(&batch, true);
 }
 
 /*
@@ -545,12 +480,8 @@ virNetDevBandwidthPlug(const char *brname,
                        virNetDevBandwidthPtr bandwidth,
                        unsigned int id)
 {
-    int ret = -1;
-    virCommandPtr cmd = NULL;
-    char *class_id = NULL;
-    char *qdisc_id = NULL;
-    char *floor = NULL;
-    char *ceil = NULL;
+    g_auto(virBuffer) batch = VIR_BUFFER_INITIALIZER;
+    g_autofree char *class_id = NULL;
     char ifmacStr[VIR_MAC_STRING_BUFLEN];
 
     if (id <= 2) {
@@ -569,43 +500,24 @@ virNetDevBandwidthPlug(const char *brname,
     }
 
     class_id = g_strdup_printf("1:%x", id);
-    qdisc_id = g_strdup_printf("%x:", id);
-    floor = g_strdup_printf("%llukbps", bandwidth->in->floor);
-    ceil = g_strdup_printf("%llukbps", net_bandwidth->in->peak ?
-                           net_bandwidth->in->peak :
-                           net_bandwidth->in->average);
 
-    cmd = virCommandNew(TC);
-    virCommandAddArgList(cmd, "class", "add", "dev", brname, "parent", "1:1",
-                         "classid", class_id, "htb", "rate", floor,
-                         "ceil", ceil, NULL);
-    virNetDevBandwidthCmdAddOptimalQuantum(cmd, bandwidth->in);
+    virBufferAsprintf(&batch,
+                      "class add dev %s parent 1:1 classid %s htb "
+                      "rate %llukbps ceil %llukbps",
+                      brname, class_id, bandwidth->in->floor,
+                      net_bandwidth->in->peak ?
+                      net_bandwidth->in->peak :
+                      net_bandwidth->in->average);
+    virNetDevBandwidthAddOptimalQuantum(&batch, bandwidth->in);
+    virBufferAddLit(&batch, "\n");
 
-    if (virCommandRun(cmd, NULL) < 0)
-        goto cleanup;
+    virBufferAsprintf(&batch,
+                      "qdisc add dev %s parent %s handle %x: sfq perturb 10\n",
+                      brname, class_id, id);
 
-    virCommandFree(cmd);
-    cmd = virCommandNew(TC);
-    virCommandAddArgList(cmd, "qdisc", "add", "dev", brname, "parent",
-                         class_id, "handle", qdisc_id, "sfq", "perturb",
-                         "10", NULL);
+    virNetDevBandwidthBatchFilterAdd(&batch, brname, ifmac_ptr, id, class_id);
 
-    if (virCommandRun(cmd, NULL) < 0)
-        goto cleanup;
-
-    if (virNetDevBandwidthManipulateFilter(brname, ifmac_ptr, id,
-                                           class_id, false, true) < 0)
-        goto cleanup;
-
-    ret = 0;
-
- cleanup:
-    VIR_FREE(ceil);
-    VIR_FREE(floor);
-    VIR_FREE(qdisc_id);
-    VIR_FREE(class_id);
-    virCommandFree(cmd);
-    return ret;
+    return virNetDevBandwidthRunBatch(&batch, false);
 }
 
 /*
@@ -621,48 +533,20 @@ int
 virNetDevBandwidthUnplug(const char *brname,
                          unsigned int id)
 {
-    int ret = -1;
-    int cmd_ret = 0;
-    virCommandPtr cmd = NULL;
-    char *class_id = NULL;
-    char *qdisc_id = NULL;
+    g_auto(virBuffer) batch = VIR_BUFFER_INITIALIZER;
 
     if (id <= 2) {
         virReportError(VIR_ERR_INTERNAL_ERROR, _("Invalid class ID %d"), id);
         return -1;
     }
 
-    class_id = g_strdup_printf("1:%x", id);
-    qdisc_id = g_strdup_printf("%x:", id);
-
-    cmd = virCommandNew(TC);
-    virCommandAddArgList(cmd, "qdisc", "del", "dev", brname,
-                         "handle", qdisc_id, NULL);
+    virBufferAsprintf(&batch, "qdisc del dev %s handle %x:\n", brname, id);
+    virNetDevBandwidthBatchFilterDel(&batch, brname, id);
+    virBufferAsprintf(&batch, "class del dev %s classid 1:%x\n", brname, id);
 
     /* Don't threat tc errors as fatal, but
      * try to remove as much as possible */
-    if (virCommandRun(cmd, &cmd_ret) < 0)
-        goto cleanup;
-
-    if (virNetDevBandwidthManipulateFilter(brname, NULL, id,
-                                           NULL, true, false) < 0)
-        goto cleanup;
-
-    virCommandFree(cmd);
-    cmd = virCommandNew(TC);
-    virCommandAddArgList(cmd, "class", "del", "dev", brname,
-                         "classid", class_id, NULL);
-
-    if (virCommandRun(cmd, &cmd_ret) < 0)
-        goto cleanup;
-
-    ret = 0;
-
- cleanup:
-    VIR_FREE(qdisc_id);
-    VIR_FREE(class_id);
-    virCommandFree(cmd);
-    return ret;
+    return virNetDevBandwidthRunBatch(&batch, true);
 }
 
 /**
@@ -685,35 +569,19 @@ virNetDevBandwidthUpdateRate(const char *ifname,
                              virNetDevBandwidthPtr bandwidth,
                              unsigned long long new_rate)
 {
-    int ret = -1;
-    virCommandPtr cmd = NULL;
-    char *class_id = NULL;
-    char *rate = NULL;
-    char *ceil = NULL;
-
-    class_id = g_strdup_printf("1:%x", id);
-    rate = g_strdup_printf("%llukbps", new_rate);
-    ceil = g_strdup_printf("%llukbps", bandwidth->in->peak ?
-                           bandwidth->in->peak :
-                           bandwidth->in->average);
-
-    cmd = virCommandNew(TC);
-    virCommandAddArgList(cmd, "class", "change", "dev", ifname,
-                         "classid", class_id, "htb", "rate", rate,
-                         "ceil", ceil, NULL);
-    virNetDevBandwidthCmdAddOptimalQuantum(cmd, bandwidth->in);
-
-    if (virCommandRun(cmd, NULL) < 0)
-        goto cleanup;
-
-    ret = 0;
-
- cleanup:
-    virCommandFree(cmd);
-    VIR_FREE(class_id);
-    VIR_FREE(rate);
-    VIR_FREE(ceil);
-    return ret;
+    g_auto(virBuffer) batch = VIR_BUFFER_INITIALIZER;
+
+    virBufferAsprintf(&batch,
+                      "class change dev %s classid 1:%x htb "
+                      "rate %llukbps ceil %llukbps",
+                      ifname, id, new_rate,
+                      bandwidth->in->peak ?
+                      bandwidth->in->peak :
+                      bandwidth->in->average);
+    virNetDevBandwidthAddOptimalQuantum(&batch, bandwidth->in);
+    virBufferAddLit(&batch, "\n");
+
+    return virNetDevBandwidthRunBatch(&batch, false);
 }
 
 /**
@@ -738,17 +606,16 @@ virNetDevBandwidthUpdateFilter(const char *ifname,
                                const virMacAddr *ifmac_ptr,
                                unsigned int id)
 {
-    int ret = -1;
-    char *class_id = NULL;
+    g_auto(virBuffer) batch = VIR_BUFFER_INITIALIZER;
+    g_autofree char *class_id = NULL;
 
     class_id = g_strdup_printf("1:%x", id);
 
-    if (virNetDevBandwidthManipulateFilter(ifname, ifmac_ptr, id,
-                                           class_id, true, true) < 0)
-        goto cleanup;
+    virNetDevBandwidthBatchFilterDel(&batch, ifname, id);
+    if (virNetDevBandwidthRunBatch(&batch, true) < 0)
+        return -1;
 
-    ret = 0;
- cleanup:
-    VIR_FREE(class_id);
-    return ret;
+    virNetDevBandwidthBatchFilterAdd(&batch, ifname, ifmac_ptr, id, class_id);
+
+    return virNetDevBandwidthRunBatch(&batch, false);
 }
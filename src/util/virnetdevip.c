@@ -1052,6 +1052,40 @@ virNetDevIPInfoClear(virNetDevIPInfoPtr ip)
 }
 
 
+/**
+ * virNetDevIPInfoCopy:
+ * @dst: IP info to fill, must be empty
+ * @src: IP info to copy
+ *
+ * Deep-copies all addresses and routes of @src into @dst.
+ */
+void
+virNetDevIPInfoCopy(virNetDevIPInfoPtr dst,
+                    const virNetDevIPInfo *src)
+{
+    size_t i;
+
+    if (src->nips) {
+        dst->ips = g_new0(virNetDevIPAddrPtr, src->nips);
+        for (i = 0; i < src->nips; i++) {
+            dst->ips[i] = g_new0(virNetDevIPAddr, 1);
+            *dst->ips[i] = *src->ips[i];
+        }
+        dst->nips = src->nips;
+    }
+
+    if (src->nroutes) {
+        dst->routes = g_new0(virNetDevIPRoutePtr, src->nroutes);
+        for (i = 0; i < src->nroutes; i++) {
+            dst->routes[i] = g_new0(virNetDevIPRoute, 1);
+            *dst->routes[i] = *src->routes[i];
+            dst->routes[i]->family = g_strdup(src->routes[i]->family);
+        }
+        dst->nroutes = src->nroutes;
+    }
+}
+
+
 /**
  * virNetDevIPInfoAddToDev:
  * @ifname: name of device to operate on
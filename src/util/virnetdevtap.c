@@ -24,6 +24,7 @@
 #include "virnetdevbridge.h"
 #include "virnetdevmidonet.h"
 #include "virnetdevopenvswitch.h"
+#include "virnetlink.h"
 #include "virerror.h"
 #include "virfile.h"
 #include "viralloc.h"
@@ -631,6 +632,99 @@ virNetDevTapReattachBridge(const char *tapname,
 }
 
 
+#if defined(__linux__) && defined(HAVE_LIBNL)
+/**
+ * virNetDevTapAttachBridgeBatch:
+ * @tapname: the tap interface name
+ * @brname: the bridge name
+ * @tapmac: MAC address of the tap device
+ * @virtPortProfile: bridge/port specific configuration
+ * @isolatedPort: whether the port should be isolated
+ * @mtu: requested MTU for port (or 0 for "default")
+ * @actualMTU: MTU actually set for port (after accounting for bridge's MTU)
+ * @online: whether to bring the tap device up
+ *
+ * Sets the MAC address and MTU of a new tap device, attaches it to a
+ * Linux host bridge and changes its link state with a single netlink
+ * message instead of an ioctl for each step. Devices attached through
+ * a port profile are left to the caller.
+ *
+ * Returns 1 if the device wasn't set up, 0 on success, -1 on error.
+ */
+static int
+virNetDevTapAttachBridgeBatch(const char *tapname,
+                              const char *brname,
+                              const virMacAddr *tapmac,
+                              const virNetDevVPortProfile *virtPortProfile,
+                              virTristateBool isolatedPort,
+                              unsigned int mtu,
+                              unsigned int *actualMTU,
+                              bool online)
+{
+    virNetlinkSetLinkData data = {
+        .mac = tapmac,
+        .mtu = &mtu,
+        .online = &online,
+    };
+    int master;
+    int error = 0;
+
+    if (virtPortProfile)
+        return 1;
+
+    if (virNetDevGetIndex(brname, &master) < 0)
+        return -1;
+    data.master = &master;
+
+    /* see virNetDevTapAttachBridge() */
+    if (mtu == 0) {
+        int brMTU = virNetDevGetMTU(brname);
+
+        if (brMTU < 0)
+            return -1;
+        mtu = brMTU;
+    }
+
+    if (virNetlinkSetLink(tapname, &data, &error) < 0) {
+        if (error != 0) {
+            virReportSystemError(-error,
+                                 _("Unable to attach %s to bridge %s"),
+                                 tapname, brname);
+        }
+        return -1;
+    }
+
+    if (actualMTU)
+        *actualMTU = mtu;
+
+    if (isolatedPort == VIR_TRISTATE_BOOL_YES &&
+        virNetDevBridgePortSetIsolated(brname, tapname, true) < 0) {
+        virErrorPtr err;
+
+        virErrorPreserveLast(&err);
+        ignore_value(virNetDevBridgeRemovePort(brname, tapname));
+        virErrorRestore(&err);
+        return -1;
+    }
+
+    return 0;
+}
+#else /* ! (defined(__linux__) && defined(HAVE_LIBNL)) */
+static int
+virNetDevTapAttachBridgeBatch(const char *tapname G_GNUC_UNUSED,
+                              const char *brname G_GNUC_UNUSED,
+                              const virMacAddr *tapmac G_GNUC_UNUSED,
+                              const virNetDevVPortProfile *virtPortProfile G_GNUC_UNUSED,
+                              virTristateBool isolatedPort G_GNUC_UNUSED,
+                              unsigned int mtu G_GNUC_UNUSED,
+                              unsigned int *actualMTU G_GNUC_UNUSED,
+                              bool online G_GNUC_UNUSED)
+{
+    return 1;
+}
+#endif /* ! (defined(__linux__) && defined(HAVE_LIBNL)) */
+
+
 /**
  * virNetDevTapCreateInBridgePort:
  * @brname: the bridge name
@@ -681,6 +775,7 @@ int virNetDevTapCreateInBridgePort(const char *brname,
 {
     virMacAddr tapmac;
     size_t i;
+    int rc;
 
     if (virNetDevTapCreate(ifname, tunpath, tapfd, tapfdSize, flags) < 0)
         return -1;
@@ -707,17 +802,25 @@ int virNetDevTapCreateInBridgePort(const char *brname,
             tapmac.addr[0] = 0xFE;
     }
 
-    if (virNetDevSetMAC(*ifname, &tapmac) < 0)
+    if ((rc = virNetDevTapAttachBridgeBatch(*ifname, brname, &tapmac,
+                                            virtPortProfile, isolatedPort,
+                                            mtu, actualMTU,
+                                            !!(flags & VIR_NETDEV_TAP_CREATE_IFUP))) < 0)
         goto error;
 
-    if (virNetDevTapAttachBridge(*ifname, brname, macaddr, vmuuid,
-                                 virtPortProfile, virtVlan,
-                                 isolatedPort, mtu, actualMTU) < 0) {
-        goto error;
-    }
+    if (rc > 0) {
+        if (virNetDevSetMAC(*ifname, &tapmac) < 0)
+            goto error;
 
-    if (virNetDevSetOnline(*ifname, !!(flags & VIR_NETDEV_TAP_CREATE_IFUP)) < 0)
-        goto error;
+        if (virNetDevTapAttachBridge(*ifname, brname, macaddr, vmuuid,
+                                     virtPortProfile, virtVlan,
+                                     isolatedPort, mtu, actualMTU) < 0) {
+            goto error;
+        }
+
+        if (virNetDevSetOnline(*ifname, !!(flags & VIR_NETDEV_TAP_CREATE_IFUP)) < 0)
+            goto error;
+    }
 
     if (virNetDevSetCoalesce(*ifname, coalesce, false) < 0)
         goto error;
@@ -914,3 +1017,147 @@ virNetDevTapInterfaceStats(const char *ifname G_GNUC_UNUSED,
 }
 
 #endif /* __linux__ */
+
+
+#if defined(__linux__) && defined(HAVE_LIBNL)
+static int
+virNetDevTapInterfaceStatsAllCallback(struct nlmsghdr *resp,
+                                      void *opaque)
+{
+    virHashTablePtr all = opaque;
+    struct nlattr *tb[IFLA_MAX + 1] = { NULL };
+    struct rtnl_link_stats64 link = { 0 };
+    g_autofree virDomainInterfaceStatsPtr stats = NULL;
+
+    if (resp->nlmsg_type != RTM_NEWLINK)
+        return 0;
+
+    if (nlmsg_parse(resp, sizeof(struct ifinfomsg), tb, IFLA_MAX, NULL) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("malformed netlink response message"));
+        return -1;
+    }
+
+    if (!tb[IFLA_IFNAME] || !tb[IFLA_STATS64])
+        return 0;
+
+    memcpy(&link, nla_data(tb[IFLA_STATS64]),
+           MIN(nla_len(tb[IFLA_STATS64]), sizeof(link)));
+
+    /* same as the columns of /proc/net/dev */
+    stats = g_new0(struct _virDomainInterfaceStats, 1);
+    stats->rx_bytes = link.rx_bytes;
+    stats->rx_packets = link.rx_packets;
+    stats->rx_errs = link.rx_errors;
+    stats->rx_drop = link.rx_dropped + link.rx_missed_errors;
+    stats->tx_bytes = link.tx_bytes;
+    stats->tx_packets = link.tx_packets;
+    stats->tx_errs = link.tx_errors;
+    stats->tx_drop = link.tx_dropped;
+
+    if (virHashUpdateEntry(all, nla_data(tb[IFLA_IFNAME]), stats) < 0)
+        return -1;
+
+    stats = NULL;
+    return 0;
+}
+
+
+/**
+ * virNetDevTapInterfaceStatsAll:
+ *
+ * Fetch RX/TX statistics of all host interfaces with a single netlink
+ * dump. This is cheaper than calling virNetDevTapInterfaceStats() for
+ * each of many interfaces, which reads the statistics of all of them
+ * every time. Look up the statistics of an interface with
+ * virNetDevTapInterfaceStatsLookup().
+ *
+ * Returns a hash table keyed by interface names, NULL on error (with
+ * error reported).
+ */
+virHashTablePtr
+virNetDevTapInterfaceStatsAll(void)
+{
+    struct ifinfomsg ifinfo = { .ifi_family = AF_UNSPEC };
+    g_autoptr(virNetlinkMsg) nl_msg = NULL;
+    g_autoptr(virHashTable) all = NULL;
+
+    if (!(all = virHashNew(g_free)))
+        return NULL;
+
+    if (!(nl_msg = nlmsg_alloc_simple(RTM_GETLINK,
+                                      NLM_F_REQUEST | NLM_F_DUMP))) {
+        virReportOOMError();
+        return NULL;
+    }
+
+    if (nlmsg_append(nl_msg, &ifinfo, sizeof(ifinfo), NLMSG_ALIGNTO) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("allocated netlink buffer is too small"));
+        return NULL;
+    }
+
+    if (virNetlinkDumpCommand(nl_msg, virNetDevTapInterfaceStatsAllCallback,
+                              0, 0, NETLINK_ROUTE, 0, all) < 0)
+        return NULL;
+
+    return g_steal_pointer(&all);
+}
+#else /* ! (defined(__linux__) && defined(HAVE_LIBNL)) */
+virHashTablePtr
+virNetDevTapInterfaceStatsAll(void)
+{
+    virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                   _("interface stats not implemented on this platform"));
+    return NULL;
+}
+#endif /* ! (defined(__linux__) && defined(HAVE_LIBNL)) */
+
+
+/**
+ * virNetDevTapInterfaceStatsLookup:
+ * @all: statistics returned by virNetDevTapInterfaceStatsAll()
+ * @ifname: interface
+ * @stats: where to store statistics
+ * @swapped: whether to swap RX/TX fields
+ *
+ * Same as virNetDevTapInterfaceStats(), but takes the statistics of
+ * @ifname from @all.
+ *
+ * Returns 0 on success, -1 otherwise (with error reported).
+ */
+int
+virNetDevTapInterfaceStatsLookup(virHashTablePtr all,
+                                 const char *ifname,
+                                 virDomainInterfaceStatsPtr stats,
+                                 bool swapped)
+{
+    virDomainInterfaceStatsPtr found;
+
+    if (!ifname) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Interface name not provided"));
+        return -1;
+    }
+
+    if (!(found = virHashLookup(all, ifname))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Interface not found"));
+        return -1;
+    }
+
+    if (swapped) {
+        stats->rx_bytes = found->tx_bytes;
+        stats->rx_packets = found->tx_packets;
+        stats->rx_errs = found->tx_errs;
+        stats->rx_drop = found->tx_drop;
+        stats->tx_bytes = found->rx_bytes;
+        stats->tx_packets = found->rx_packets;
+        stats->tx_errs = found->rx_errs;
+        stats->tx_drop = found->rx_drop;
+    } else {
+        *stats = *found;
+    }
+
+    return 0;
+}
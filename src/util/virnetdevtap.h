@@ -22,6 +22,7 @@
 #include "virnetdev.h"
 #include "virnetdevvportprofile.h"
 #include "virnetdevvlan.h"
+#include "virhash.h"
 
 #ifdef __FreeBSD__
 /* This should be defined on OSes that don't automatically
@@ -105,3 +106,11 @@ int virNetDevTapInterfaceStats(const char *ifname,
                                virDomainInterfaceStatsPtr stats,
                                bool swapped)
     G_GNUC_WARN_UNUSED_RESULT;
+
+virHashTablePtr virNetDevTapInterfaceStatsAll(void);
+
+int virNetDevTapInterfaceStatsLookup(virHashTablePtr all,
+                                     const char *ifname,
+                                     virDomainInterfaceStatsPtr stats,
+                                     bool swapped)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(3) G_GNUC_WARN_UNUSED_RESULT;
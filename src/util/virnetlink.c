@@ -41,6 +41,8 @@ VIR_LOG_INIT("util.netlink");
 #define NETLINK_ACK_TIMEOUT_S  (2*1000)
 
 #if defined(__linux__) && defined(HAVE_LIBNL)
+# include <linux/veth.h>
+
 /* State for a single netlink event handle */
 struct virNetlinkEventHandle {
     int watch;
@@ -475,7 +477,7 @@ virNetlinkDumpLink(const char *ifname, int ifindex,
  * virNetlinkNewLink:
  *
  * @ifname: name of the link
- * @type: the type of the device, i.e. "bridge", "macvtap", "macvlan"
+ * @type: the type of the device, i.e. "bridge", "macvtap", "macvlan", "veth"
  * @extra_args: the extra args for creating the netlink interface
  * @error: netlink error code
  *
@@ -495,6 +497,7 @@ virNetlinkNewLink(const char *ifname,
     struct nlmsgerr *err;
     struct nlattr *linkinfo = NULL;
     struct nlattr *infodata = NULL;
+    struct nlattr *infopeer = NULL;
     unsigned int buflen;
     struct ifinfomsg ifinfo = { .ifi_family = AF_UNSPEC };
     g_autoptr(virNetlinkMsg) nl_msg = NULL;
@@ -535,6 +538,23 @@ virNetlinkNewLink(const char *ifname,
         NETLINK_MSG_NEST_END(nl_msg, infodata);
     }
 
+    /* Both ends of a veth pair are created by a single request */
+    if (STREQ(type, "veth") &&
+        extra_args &&
+        extra_args->veth_peer) {
+        NETLINK_MSG_NEST_START(nl_msg, infodata, IFLA_INFO_DATA);
+        NETLINK_MSG_NEST_START(nl_msg, infopeer, VETH_INFO_PEER);
+
+        if (nlmsg_append(nl_msg, &ifinfo, sizeof(ifinfo), NLMSG_ALIGNTO) < 0)
+            goto buffer_too_small;
+
+        NETLINK_MSG_PUT(nl_msg, IFLA_IFNAME,
+                        (strlen(extra_args->veth_peer) + 1),
+                        extra_args->veth_peer);
+        NETLINK_MSG_NEST_END(nl_msg, infopeer);
+        NETLINK_MSG_NEST_END(nl_msg, infodata);
+    }
+
     NETLINK_MSG_NEST_END(nl_msg, linkinfo);
 
     if (extra_args) {
@@ -587,6 +607,107 @@ virNetlinkNewLink(const char *ifname,
 }
 
 
+/**
+ * virNetlinkSetLink:
+ *
+ * @ifname: name of the link
+ * @data: the attributes to change
+ * @error: netlink error code
+ *
+ * Changes all attributes of an existing network link requested by
+ * @data in a single RTM_SETLINK message, instead of issuing a separate
+ * ioctl for each of them. The kernel applies the MAC address and the
+ * MTU before changing the link state and enslaving the link to its
+ * master device.
+ *
+ * Returns 0 on success, -1 on error. Additionally, if the @error is
+ * non-zero, then a failure occurred during virNetlinkCommand, but
+ * no error message is generated leaving it up to the caller to handle
+ * the condition.
+ */
+int
+virNetlinkSetLink(const char *ifname,
+                  virNetlinkSetLinkDataPtr data,
+                  int *error)
+{
+    struct nlmsgerr *err;
+    unsigned int buflen;
+    struct ifinfomsg ifinfo = { .ifi_family = AF_UNSPEC };
+    g_autoptr(virNetlinkMsg) nl_msg = NULL;
+    g_autofree struct nlmsghdr *resp = NULL;
+
+    *error = 0;
+
+    VIR_DEBUG("Setting attributes of interface '%s'", ifname);
+
+    if (data->online) {
+        ifinfo.ifi_change = IFF_UP;
+        ifinfo.ifi_flags = *data->online ? IFF_UP : 0;
+    }
+
+    nl_msg = nlmsg_alloc_simple(RTM_SETLINK, NLM_F_REQUEST);
+    if (!nl_msg) {
+        virReportOOMError();
+        return -1;
+    }
+
+    if (nlmsg_append(nl_msg,  &ifinfo, sizeof(ifinfo), NLMSG_ALIGNTO) < 0)
+        goto buffer_too_small;
+
+    NETLINK_MSG_PUT(nl_msg, IFLA_IFNAME, (strlen(ifname) + 1), ifname);
+
+    if (data->mac) {
+        NETLINK_MSG_PUT(nl_msg, IFLA_ADDRESS,
+                        VIR_MAC_BUFLEN, data->mac);
+    }
+    if (data->mtu) {
+        NETLINK_MSG_PUT(nl_msg, IFLA_MTU,
+                        sizeof(uint32_t), data->mtu);
+    }
+    if (data->master) {
+        NETLINK_MSG_PUT(nl_msg, IFLA_MASTER,
+                        sizeof(uint32_t), data->master);
+    }
+
+    if (virNetlinkCommand(nl_msg, &resp, &buflen, 0, 0, NETLINK_ROUTE, 0) < 0)
+        return -1;
+
+    if (buflen < NLMSG_LENGTH(0) || resp == NULL)
+        goto malformed_resp;
+
+    switch (resp->nlmsg_type) {
+    case NLMSG_ERROR:
+        err = (struct nlmsgerr *)NLMSG_DATA(resp);
+        if (resp->nlmsg_len < NLMSG_LENGTH(sizeof(*err)))
+            goto malformed_resp;
+
+        if (err->error < 0) {
+            *error = err->error;
+            return -1;
+        }
+        break;
+
+    case NLMSG_DONE:
+        break;
+
+    default:
+        goto malformed_resp;
+    }
+
+    return 0;
+
+ malformed_resp:
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("malformed netlink response message"));
+    return -1;
+
+ buffer_too_small:
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("allocated netlink buffer is too small"));
+    return -1;
+}
+
+
 /**
  * virNetlinkDelLink:
  *
@@ -1292,6 +1413,16 @@ virNetlinkNewLink(const char *ifname G_GNUC_UNUSED,
 }
 
 
+int
+virNetlinkSetLink(const char *ifname G_GNUC_UNUSED,
+                  virNetlinkSetLinkDataPtr data G_GNUC_UNUSED,
+                  int *error G_GNUC_UNUSED)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _(unsupported));
+    return -1;
+}
+
+
 int
 virNetlinkGetNeighbor(void **nlData G_GNUC_UNUSED,
                       uint32_t src_pid G_GNUC_UNUSED,
@@ -84,6 +84,7 @@ struct _virNetlinkNewLinkData {
     const int *ifindex;             /* The index for the 'link' device */
     const virMacAddr *mac;          /* The MAC address of the device */
     const uint32_t *macvlan_mode;   /* The mode of macvlan */
+    const char *veth_peer;          /* The peer name for veth */
 };
 
 int virNetlinkNewLink(const char *ifname,
@@ -91,6 +92,19 @@ int virNetlinkNewLink(const char *ifname,
                       virNetlinkNewLinkDataPtr data,
                       int *error);
 
+typedef struct _virNetlinkSetLinkData virNetlinkSetLinkData;
+typedef virNetlinkSetLinkData *virNetlinkSetLinkDataPtr;
+struct _virNetlinkSetLinkData {
+    const virMacAddr *mac;          /* The MAC address of the device */
+    const unsigned int *mtu;        /* The MTU of the device */
+    const int *master;              /* The index of the master device */
+    const bool *online;             /* Whether to bring the device up */
+};
+
+int virNetlinkSetLink(const char *ifname,
+                      virNetlinkSetLinkDataPtr data,
+                      int *error);
+
 typedef int (*virNetlinkDelLinkFallback)(const char *ifname);
 
 int virNetlinkDelLink(const char *ifname, virNetlinkDelLinkFallback fallback);
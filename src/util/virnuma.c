@@ -520,6 +520,30 @@ virNumaGetDistances(int node G_GNUC_UNUSED,
 #endif /* !(WITH_NUMACTL && HAVE_NUMA_BITMASK_ISBITSET) */
 
 
+static void
+virNumaMapClear(virNumaMapPtr map)
+{
+    g_clear_pointer(&map->file, g_free);
+    g_clear_pointer(&map->nodes, g_free);
+    map->nnodes = 0;
+}
+
+
+void
+virNumaMapsFree(virNumaMapPtr maps,
+                size_t nmaps)
+{
+    size_t i;
+
+    if (!maps)
+        return;
+
+    for (i = 0; i < nmaps; i++)
+        virNumaMapClear(&maps[i]);
+    g_free(maps);
+}
+
+
 /* currently all the huge page stuff below is linux only */
 #ifdef __linux__
 
@@ -950,6 +974,143 @@ virNumaSetPagePoolSize(int node,
     return 0;
 }
 
+/**
+ * virNumaCompactNode:
+ * @node: NUMA node to compact
+ *
+ * Asks the kernel to compact the memory of @node, which makes it more
+ * likely that huge pages can be allocated on a fragmented node. The
+ * kernel has to be built with CONFIG_COMPACTION.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNumaCompactNode(int node)
+{
+    g_autofree char *path = NULL;
+
+    path = g_strdup_printf(HUGEPAGES_NUMA_PREFIX "node%d/compact", node);
+
+    if (virFileWriteStr(path, "1", 0) < 0) {
+        virReportSystemError(errno,
+                             _("Unable to compact memory of NUMA node %d"),
+                             node);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* numa_maps can be long for processes with many mappings */
+# define NUMA_MAPS_MAX_LEN (16 * 1024 * 1024)
+
+static int
+virNumaParseMapsLine(char *line,
+                     virNumaMapPtr map)
+{
+    VIR_AUTOSTRINGLIST tokens = NULL;
+    unsigned long long pagesize = virGetSystemPageSizeKB();
+    size_t i;
+
+    tokens = virStringSplit(line, " ", 0);
+
+    for (i = 0; tokens[i]; i++) {
+        const char *tmp;
+        char *end;
+        unsigned int node;
+        unsigned long long pages;
+
+        if ((tmp = STRSKIP(tokens[i], "file="))) {
+            map->file = g_strdup(tmp);
+        } else if ((tmp = STRSKIP(tokens[i], "kernelpagesize_kB="))) {
+            if (virStrToLong_ullp(tmp, NULL, 10, &pagesize) < 0)
+                goto error;
+        } else if (tokens[i][0] == 'N' &&
+                   virStrToLong_ui(tokens[i] + 1, &end, 10, &node) == 0 &&
+                   *end == '=') {
+            if (virStrToLong_ullp(end + 1, NULL, 10, &pages) < 0)
+                goto error;
+
+            if (node >= map->nnodes &&
+                VIR_EXPAND_N(map->nodes, map->nnodes,
+                             node + 1 - map->nnodes) < 0)
+                return -1;
+
+            map->nodes[node] = pages;
+        }
+    }
+
+    /* the page size is printed after the per node counts */
+    for (i = 0; i < map->nnodes; i++)
+        map->nodes[i] *= pagesize;
+
+    return 0;
+
+ error:
+    virReportError(VIR_ERR_INTERNAL_ERROR,
+                   _("cannot parse numa_maps entry '%s'"), tokens[i]);
+    return -1;
+}
+
+
+/**
+ * virNumaGetProcessMaps:
+ * @pid: process to query
+ * @maps: filled with the memory mappings of @pid
+ * @nmaps: number of items in @maps
+ *
+ * Parses /proc/@pid/numa_maps and returns the amount of memory each
+ * mapping of the process has resident on the individual host NUMA
+ * nodes. Mappings without any resident memory are left out. Note that
+ * the kernel has to walk the page tables of the process to produce the
+ * file, so reading it is not cheap for processes with a lot of memory
+ * backed by small pages.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNumaGetProcessMaps(pid_t pid,
+                      virNumaMapPtr *maps,
+                      size_t *nmaps)
+{
+    g_autofree char *path = NULL;
+    g_autofree char *buf = NULL;
+    VIR_AUTOSTRINGLIST lines = NULL;
+    virNumaMapPtr tmp = NULL;
+    size_t ntmp = 0;
+    size_t i;
+
+    path = g_strdup_printf("/proc/%lld/numa_maps", (long long) pid);
+
+    if (virFileReadAll(path, NUMA_MAPS_MAX_LEN, &buf) < 0)
+        return -1;
+
+    lines = virStringSplit(buf, "\n", 0);
+
+    for (i = 0; lines[i]; i++) {
+        virNumaMap map = { 0 };
+
+        if (!*lines[i])
+            continue;
+
+        if (virNumaParseMapsLine(lines[i], &map) < 0 ||
+            (map.nnodes > 0 &&
+             VIR_APPEND_ELEMENT(tmp, ntmp, map) < 0)) {
+            virNumaMapClear(&map);
+            virNumaMapsFree(tmp, ntmp);
+            return -1;
+        }
+
+        /* no-op unless the mapping had nothing resident */
+        virNumaMapClear(&map);
+    }
+
+    *maps = g_steal_pointer(&tmp);
+    *nmaps = ntmp;
+    return 0;
+}
+
 
 #else /* #ifdef __linux__ */
 int
@@ -988,8 +1149,28 @@ virNumaSetPagePoolSize(int node G_GNUC_UNUSED,
                    _("page pool allocation is not supported on this platform"));
     return -1;
 }
+
+int
+virNumaCompactNode(int node G_GNUC_UNUSED)
+{
+    virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                   _("memory compaction is not supported on this platform"));
+    return -1;
+}
+
+
+int
+virNumaGetProcessMaps(pid_t pid G_GNUC_UNUSED,
+                      virNumaMapPtr *maps G_GNUC_UNUSED,
+                      size_t *nmaps G_GNUC_UNUSED)
+{
+    virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                   _("NUMA memory maps are not supported on this platform"));
+    return -1;
+}
 #endif /* #ifdef __linux__ */
 
+
 bool
 virNumaNodesetIsAvailable(virBitmapPtr nodeset)
 {
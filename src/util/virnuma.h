@@ -64,3 +64,17 @@ int virNumaSetPagePoolSize(int node,
                            unsigned int page_size,
                            unsigned long long page_count,
                            bool add);
+int virNumaCompactNode(int node);
+
+typedef struct _virNumaMap virNumaMap;
+typedef virNumaMap *virNumaMapPtr;
+struct _virNumaMap {
+    char *file; /* backing file, NULL for anonymous memory */
+    unsigned long long *nodes; /* resident memory in KiB indexed by node */
+    size_t nnodes;
+};
+
+void virNumaMapsFree(virNumaMapPtr maps, size_t nmaps);
+int virNumaGetProcessMaps(pid_t pid,
+                          virNumaMapPtr *maps,
+                          size_t *nmaps);
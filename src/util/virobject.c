@@ -45,6 +45,17 @@ struct _virClass {
     size_t objectSize;
 
     virObjectDisposeCallback dispose;
+
+    /* number of instances of exactly this class in use */
+    int live;
+
+    /* Disposed instances kept for reuse, see virClassEnablePool */
+    virMutex poolLock;
+    virObjectPtr *pool;
+    size_t npool;
+    size_t poolReserved; /* slots claimed by instances being disposed */
+    size_t poolMax;
+    unsigned long long reused;
 };
 
 typedef struct _virObjectPrivate virObjectPrivate;
@@ -68,6 +79,10 @@ G_DEFINE_TYPE_WITH_PRIVATE(virObject, vir_object, G_TYPE_OBJECT)
     } while (0)
 
 
+static virMutex virClassListLock = VIR_MUTEX_INITIALIZER;
+static virClassPtr *virClassList;
+static size_t virClassListCount;
+
 static virClassPtr virObjectClassImpl;
 static virClassPtr virObjectLockableClass;
 static virClassPtr virObjectRWLockableClass;
@@ -190,6 +205,11 @@ virClassNew(virClassPtr parent,
     }
 
     klass = g_new0(virClass, 1);
+    if (virMutexInit(&klass->poolLock) < 0) {
+        virReportSystemError(errno, "%s", _("Unable to initialize mutex"));
+        g_free(klass);
+        return NULL;
+    }
     klass->parent = parent;
     klass->magic = g_atomic_int_add(&magicCounter, 1);
     klass->name = g_strdup(name);
@@ -208,10 +228,95 @@ virClassNew(virClassPtr parent,
     }
     klass->dispose = dispose;
 
+    virMutexLock(&virClassListLock);
+    ignore_value(VIR_APPEND_ELEMENT_COPY(virClassList, virClassListCount, klass));
+    virMutexUnlock(&virClassListLock);
+
     return klass;
 }
 
 
+/**
+ * virClassEnablePool:
+ * @klass: the class
+ * @size: maximum number of instances to keep
+ *
+ * Lets @klass keep up to @size instances whose last reference was
+ * released for reuse by virObjectNew, instead of freeing them. This
+ * is meant for small classes whose instances are created and freed
+ * at high rates, like events. The dispose callbacks still run when
+ * the last reference is released and reused instances are zeroed,
+ * so the class does not have to care about pooling otherwise.
+ *
+ * Must be called before the first instance of @klass is created.
+ */
+void
+virClassEnablePool(virClassPtr klass,
+                   size_t size)
+{
+    virMutexLock(&klass->poolLock);
+    klass->pool = g_new0(virObjectPtr, size);
+    klass->poolMax = size;
+    virMutexUnlock(&klass->poolLock);
+}
+
+
+/**
+ * virClassGetStats:
+ * @stats: filled with the statistics, one entry per class
+ *
+ * Reports the number of live and pooled instances of every class
+ * registered so far. The caller has to free @stats using
+ * virClassStatsFree.
+ *
+ * Returns the number of entries in @stats
+ */
+size_t
+virClassGetStats(virClassStatsPtr *stats)
+{
+    size_t nstats;
+    size_t i;
+
+    virMutexLock(&virClassListLock);
+
+    nstats = virClassListCount;
+    *stats = g_new0(virClassStats, nstats);
+
+    for (i = 0; i < nstats; i++) {
+        virClassPtr klass = virClassList[i];
+        virClassStatsPtr entry = &(*stats)[i];
+
+        entry->name = g_strdup(klass->name);
+        entry->live = MAX(g_atomic_int_get(&klass->live), 0);
+
+        virMutexLock(&klass->poolLock);
+        entry->pooled = klass->npool;
+        entry->poolMax = klass->poolMax;
+        entry->reused = klass->reused;
+        virMutexUnlock(&klass->poolLock);
+    }
+
+    virMutexUnlock(&virClassListLock);
+
+    return nstats;
+}
+
+
+void
+virClassStatsFree(virClassStatsPtr stats,
+                  size_t nstats)
+{
+    size_t i;
+
+    if (!stats)
+        return;
+
+    for (i = 0; i < nstats; i++)
+        g_free(stats[i].name);
+    g_free(stats);
+}
+
+
 /**
  * virClassIsDerivedFrom:
  * @klass: the klass to check
@@ -252,10 +357,22 @@ virObjectNew(virClassPtr klass)
     virObjectPtr obj = NULL;
     virObjectPrivate *priv;
 
-    obj = g_object_new(klass->type, NULL);
+    if (klass->poolMax > 0) {
+        virMutexLock(&klass->poolLock);
+        if (klass->npool > 0) {
+            obj = klass->pool[--klass->npool];
+            klass->pool[klass->npool] = NULL;
+            klass->reused++;
+        }
+        virMutexUnlock(&klass->poolLock);
+    }
+
+    if (!obj)
+        obj = g_object_new(klass->type, NULL);
 
     priv = vir_object_get_instance_private(obj);
     priv->klass = klass;
+    g_atomic_int_inc(&klass->live);
     PROBE(OBJECT_NEW, "obj=%p classname=%s", obj, priv->klass->name);
 
     return obj;
@@ -313,18 +430,76 @@ virObjectRWLockableNew(virClassPtr klass)
     return obj;
 }
 
-static void vir_object_finalize(GObject *gobj)
+static void
+virObjectDispose(virObjectPtr obj,
+                 virClassPtr klass)
 {
-    PROBE(OBJECT_DISPOSE, "obj=%p", gobj);
-    virObjectPtr obj = VIR_OBJECT(gobj);
-    virObjectPrivate *priv = vir_object_get_instance_private(obj);
-
-    virClassPtr klass = priv->klass;
     while (klass) {
         if (klass->dispose)
             klass->dispose(obj);
         klass = klass->parent;
     }
+}
+
+
+/*
+ * Disposes @obj and puts it into the pool of its class if the class
+ * has a pool with free space and @obj holds its last reference.
+ * Returns true if @obj was pooled.
+ */
+static bool
+virObjectPoolPut(virObjectPtr obj)
+{
+    virObjectPrivate *priv = vir_object_get_instance_private(obj);
+    virClassPtr klass = priv->klass;
+    bool reserved = false;
+
+    if (klass->poolMax == 0)
+        return false;
+
+    /* Nobody else can take a reference while the caller holds the
+     * only one, so the check is not racy. */
+    if (g_atomic_int_get(&G_OBJECT(obj)->ref_count) != 1)
+        return false;
+
+    virMutexLock(&klass->poolLock);
+    if (klass->npool + klass->poolReserved < klass->poolMax) {
+        klass->poolReserved++;
+        reserved = true;
+    }
+    virMutexUnlock(&klass->poolLock);
+
+    if (!reserved)
+        return false;
+
+    PROBE(OBJECT_DISPOSE, "obj=%p", obj);
+
+    /* The dispose callbacks may release objects of the same class,
+     * so they must not run with the pool locked */
+    virObjectDispose(obj, klass);
+    g_atomic_int_add(&klass->live, -1);
+
+    /* Instances are handed out zeroed, as by g_object_new */
+    memset((char *) obj + sizeof(virObject), 0,
+           klass->objectSize - sizeof(virObject));
+
+    virMutexLock(&klass->poolLock);
+    klass->poolReserved--;
+    klass->pool[klass->npool++] = obj;
+    virMutexUnlock(&klass->poolLock);
+
+    return true;
+}
+
+
+static void vir_object_finalize(GObject *gobj)
+{
+    PROBE(OBJECT_DISPOSE, "obj=%p", gobj);
+    virObjectPtr obj = VIR_OBJECT(gobj);
+    virObjectPrivate *priv = vir_object_get_instance_private(obj);
+
+    virObjectDispose(obj, priv->klass);
+    g_atomic_int_add(&priv->klass->live, -1);
 
     G_OBJECT_CLASS(vir_object_parent_class)->finalize(gobj);
 }
@@ -366,7 +541,7 @@ virObjectRWLockableDispose(void *anyobj)
  * Decrement the reference count on @anyobj and if
  * it hits zero, runs the "dispose" callbacks associated
  * with the object class and its parents before freeing
- * @anyobj.
+ * @anyobj, or keeping it for reuse if its class has a pool.
  */
 void
 virObjectUnref(void *anyobj)
@@ -376,7 +551,8 @@ virObjectUnref(void *anyobj)
     if (VIR_OBJECT_NOTVALID(obj))
         return;
 
-    g_object_unref(anyobj);
+    if (!virObjectPoolPut(obj))
+        g_object_unref(anyobj);
     PROBE(OBJECT_UNREF, "obj=%p", obj);
 }
 
@@ -442,11 +618,15 @@ void
 virObjectLock(void *anyobj)
 {
     virObjectLockablePtr obj = virObjectGetLockableObj(anyobj);
+    virObjectPrivate *priv;
 
     if (!obj)
         return;
 
-    virMutexLock(&obj->lock);
+    /* lock profiling reports the lock by class and caller */
+    priv = vir_object_get_instance_private(&obj->parent);
+    virMutexLockSite(&obj->lock, priv->klass->name,
+                     __builtin_return_address(0));
 }
 
 
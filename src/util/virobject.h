@@ -88,6 +88,29 @@ const char *
 virClassName(virClassPtr klass)
     ATTRIBUTE_NONNULL(1);
 
+void
+virClassEnablePool(virClassPtr klass,
+                   size_t size)
+    ATTRIBUTE_NONNULL(1);
+
+typedef struct _virClassStats virClassStats;
+typedef virClassStats *virClassStatsPtr;
+struct _virClassStats {
+    char *name;
+    unsigned long long live;    /* instances in use */
+    unsigned long long pooled;  /* instances kept for reuse */
+    unsigned long long poolMax; /* 0 if the class has no pool */
+    unsigned long long reused;  /* instances taken from the pool */
+};
+
+size_t
+virClassGetStats(virClassStatsPtr *stats)
+    ATTRIBUTE_NONNULL(1);
+
+void
+virClassStatsFree(virClassStatsPtr stats,
+                  size_t nstats);
+
 bool
 virClassIsDerivedFrom(virClassPtr klass,
                       virClassPtr parent)
@@ -36,6 +36,7 @@
 #include "virfile.h"
 #include "virkmod.h"
 #include "virstring.h"
+#include "virthread.h"
 #include "viralloc.h"
 
 VIR_LOG_INIT("util.pci");
@@ -206,6 +207,103 @@ static int virPCIOnceInit(void)
 VIR_ONCE_GLOBAL_INIT(virPCI);
 
 
+/*
+ * Host PCI topology cache
+ *
+ * Checking whether a device is assignable or how it can be reset walks
+ * config spaces of the device and all its upstream bridges and finding
+ * a parent bridge means reading config space of every device on the
+ * host. Since none of this changes unless devices are added or removed,
+ * the results are cached per device. The node device driver invalidates
+ * the cache whenever udev reports such a change. Daemons which don't run
+ * the node device driver only rely on entries expiring after a while and
+ * on checking the vendor and product IDs of the device which are read
+ * anyway whenever a device object is created.
+ */
+#define VIR_PCI_TOPOLOGY_TTL (60 * G_USEC_PER_SEC)
+
+typedef struct _virPCITopologyEntry virPCITopologyEntry;
+struct _virPCITopologyEntry {
+    gint64 expires;
+    char id[PCI_ID_LEN];
+
+    bool capsKnown;
+    unsigned int pcie_cap_pos;
+    unsigned int pci_pm_cap_pos;
+    bool has_flr;
+    bool has_pm_reset;
+
+    bool parentKnown;
+    bool hasParent;
+    virPCIDeviceAddress parent;
+
+    int lacksACS; /* -1 if not known yet */
+
+    bool iommuGroupKnown;
+    int iommuGroup;
+};
+
+static virMutex virPCITopologyLock = VIR_MUTEX_INITIALIZER;
+static GHashTable *virPCITopology;
+
+
+/*
+ * Returns the entry for device @name, creating an empty one if there's
+ * none or if it is stale. @id is NULL if it's not known to the caller.
+ * Must be called with virPCITopologyLock held.
+ */
+static virPCITopologyEntry *
+virPCITopologyGet(const char *name,
+                  const char *id)
+{
+    virPCITopologyEntry *entry;
+    gint64 now = g_get_monotonic_time();
+
+    if (!virPCITopology)
+        virPCITopology = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                               g_free, g_free);
+
+    entry = g_hash_table_lookup(virPCITopology, name);
+
+    if (entry &&
+        (entry->expires < now ||
+         (id && *id && *entry->id && STRNEQ(id, entry->id)))) {
+        g_hash_table_remove(virPCITopology, name);
+        entry = NULL;
+    }
+
+    if (!entry) {
+        entry = g_new0(virPCITopologyEntry, 1);
+        entry->expires = now + VIR_PCI_TOPOLOGY_TTL;
+        entry->lacksACS = -1;
+        g_hash_table_insert(virPCITopology, g_strdup(name), entry);
+    }
+
+    if (id && *id && !*entry->id)
+        ignore_value(virStrcpyStatic(entry->id, id));
+
+    return entry;
+}
+
+
+/**
+ * virPCITopologyInvalidate:
+ *
+ * Drops everything cached about the host PCI devices. To be called when
+ * devices are added to or removed from the host.
+ */
+void
+virPCITopologyInvalidate(void)
+{
+    virMutexLock(&virPCITopologyLock);
+    if (virPCITopology && g_hash_table_size(virPCITopology) > 0) {
+        VIR_DEBUG("Invalidating cached PCI topology");
+        g_hash_table_remove_all(virPCITopology);
+    }
+    virMutexUnlock(&virPCITopologyLock);
+}
+
+
 static char *
 virPCIDriverDir(const char *driver)
 {
@@ -755,14 +853,49 @@ static int
 virPCIDeviceGetParent(virPCIDevicePtr dev, virPCIDevicePtr *parent)
 {
     virPCIDevicePtr best = NULL;
+    virPCITopologyEntry *entry;
+    virPCIDeviceAddress addr;
+    bool known;
+    bool hasParent;
     int ret;
 
     *parent = NULL;
+
+    virMutexLock(&virPCITopologyLock);
+    entry = virPCITopologyGet(dev->name, dev->id);
+    known = entry->parentKnown;
+    hasParent = entry->hasParent;
+    addr = entry->parent;
+    virMutexUnlock(&virPCITopologyLock);
+
+    if (known) {
+        if (!hasParent)
+            return 0;
+
+        if ((*parent = virPCIDeviceNew(addr.domain, addr.bus,
+                                       addr.slot, addr.function)))
+            return 0;
+
+        /* the parent is gone, look again */
+        virResetLastError();
+    }
+
     ret = virPCIDeviceIterDevices(virPCIDeviceIsParent, dev, parent, &best);
     if (ret == 1)
         virPCIDeviceFree(best);
     else if (ret == 0)
         *parent = best;
+
+    if (ret >= 0) {
+        virMutexLock(&virPCITopologyLock);
+        entry = virPCITopologyGet(dev->name, dev->id);
+        entry->parentKnown = true;
+        entry->hasParent = !!*parent;
+        if (*parent)
+            entry->parent = (*parent)->address;
+        virMutexUnlock(&virPCITopologyLock);
+    }
+
     return ret;
 }
 
@@ -893,8 +1026,21 @@ virPCIDeviceTryPowerManagementReset(virPCIDevicePtr dev, int cfgfd)
 static int
 virPCIDeviceInit(virPCIDevicePtr dev, int cfgfd)
 {
+    virPCITopologyEntry *entry;
     int flr;
 
+    virMutexLock(&virPCITopologyLock);
+    entry = virPCITopologyGet(dev->name, dev->id);
+    if (entry->capsKnown) {
+        dev->pcie_cap_pos = entry->pcie_cap_pos;
+        dev->pci_pm_cap_pos = entry->pci_pm_cap_pos;
+        dev->has_flr = entry->has_flr;
+        dev->has_pm_reset = entry->has_pm_reset;
+        virMutexUnlock(&virPCITopologyLock);
+        return 0;
+    }
+    virMutexUnlock(&virPCITopologyLock);
+
     dev->pcie_cap_pos   = virPCIDeviceFindCapabilityOffset(dev, cfgfd, PCI_CAP_ID_EXP);
     dev->pci_pm_cap_pos = virPCIDeviceFindCapabilityOffset(dev, cfgfd, PCI_CAP_ID_PM);
     flr = virPCIDeviceDetectFunctionLevelReset(dev, cfgfd);
@@ -903,6 +1049,15 @@ virPCIDeviceInit(virPCIDevicePtr dev, int cfgfd)
     dev->has_flr        = !!flr;
     dev->has_pm_reset   = !!virPCIDeviceDetectPowerManagementReset(dev, cfgfd);
 
+    virMutexLock(&virPCITopologyLock);
+    entry = virPCITopologyGet(dev->name, dev->id);
+    entry->capsKnown = true;
+    entry->pcie_cap_pos = dev->pcie_cap_pos;
+    entry->pci_pm_cap_pos = dev->pci_pm_cap_pos;
+    entry->has_flr = dev->has_flr;
+    entry->has_pm_reset = dev->has_pm_reset;
+    virMutexUnlock(&virPCITopologyLock);
+
     return 0;
 }
 
@@ -1915,6 +2070,20 @@ virPCIDeviceAddressGetIOMMUGroupAddresses(virPCIDeviceAddressPtr devAddr,
  * this PCI device's iommu_group, or -2 if there is no iommu_group for
  * the device (or -1 if there was any other error)
  */
+static void
+virPCITopologySetIOMMUGroup(const char *devName,
+                            int groupNum)
+{
+    virPCITopologyEntry *entry;
+
+    virMutexLock(&virPCITopologyLock);
+    entry = virPCITopologyGet(devName, NULL);
+    entry->iommuGroupKnown = true;
+    entry->iommuGroup = groupNum;
+    virMutexUnlock(&virPCITopologyLock);
+}
+
+
 int
 virPCIDeviceAddressGetIOMMUGroupNum(virPCIDeviceAddressPtr addr)
 {
@@ -1922,15 +2091,28 @@ virPCIDeviceAddressGetIOMMUGroupNum(virPCIDeviceAddressPtr addr)
     g_autofree char *devPath = NULL;
     g_autofree char *groupPath = NULL;
     g_autofree char *groupNumStr = NULL;
+    virPCITopologyEntry *entry;
     unsigned int groupNum;
+    int ret = -1;
 
     devName = g_strdup_printf(VIR_PCI_DEVICE_ADDRESS_FMT, addr->domain, addr->bus,
                               addr->slot, addr->function);
 
+    virMutexLock(&virPCITopologyLock);
+    entry = virPCITopologyGet(devName, NULL);
+    if (entry->iommuGroupKnown)
+        ret = entry->iommuGroup;
+    virMutexUnlock(&virPCITopologyLock);
+
+    if (ret != -1)
+        return ret;
+
     if (!(devPath = virPCIFile(devName, "iommu_group")))
         return -1;
-    if (virFileIsLink(devPath) != 1)
+    if (virFileIsLink(devPath) != 1) {
+        virPCITopologySetIOMMUGroup(devName, -2);
         return -2;
+    }
     if (virFileResolveLink(devPath, &groupPath) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("Unable to resolve device %s iommu_group symlink %s"),
@@ -1947,6 +2129,8 @@ virPCIDeviceAddressGetIOMMUGroupNum(virPCIDeviceAddressPtr addr)
         return -1;
     }
 
+    virPCITopologySetIOMMUGroup(devName, groupNum);
+
     return groupNum;
 }
 
@@ -1998,6 +2182,7 @@ virPCIDeviceGetIOMMUGroupDev(virPCIDevicePtr dev)
 static int
 virPCIDeviceDownstreamLacksACS(virPCIDevicePtr dev)
 {
+    virPCITopologyEntry *entry;
     uint16_t flags;
     uint16_t ctrl;
     unsigned int pos;
@@ -2005,6 +2190,16 @@ virPCIDeviceDownstreamLacksACS(virPCIDevicePtr dev)
     int ret = 0;
     uint16_t device_class;
 
+    virMutexLock(&virPCITopologyLock);
+    entry = virPCITopologyGet(dev->name, dev->id);
+    ret = entry->lacksACS;
+    virMutexUnlock(&virPCITopologyLock);
+
+    if (ret >= 0)
+        return ret;
+
+    ret = 0;
+
     if ((fd = virPCIDeviceConfigOpen(dev)) < 0)
         return -1;
 
@@ -2041,6 +2236,14 @@ virPCIDeviceDownstreamLacksACS(virPCIDevicePtr dev)
 
  cleanup:
     virPCIDeviceConfigClose(dev, fd);
+
+    if (ret >= 0) {
+        virMutexLock(&virPCITopologyLock);
+        entry = virPCITopologyGet(dev->name, dev->id);
+        entry->lacksACS = ret;
+        virMutexUnlock(&virPCITopologyLock);
+    }
+
     return ret;
 }
 
@@ -2572,9 +2775,9 @@ virPCIGetVirtualFunctionInfo(const char *vf_sysfs_device_path,
 }
 
 
-ssize_t
-virPCIGetMdevTypes(const char *sysfspath,
-                   virMediatedDeviceTypePtr **types)
+static ssize_t
+virPCIReadMdevTypes(const char *sysfspath,
+                    virMediatedDeviceTypePtr **types)
 {
     ssize_t ret = -1;
     int dirret = -1;
@@ -2622,6 +2825,123 @@ virPCIGetMdevTypes(const char *sysfspath,
     return ret;
 }
 
+
+/*
+ * Reading the mdev types of a parent device means reading several sysfs
+ * attributes per type, which adds up when the XML of devices is queried
+ * while many mediated devices are being created. The types are cached per
+ * parent device until the node device driver sees a change of the parent
+ * or of one of its mediated devices, or until they expire like the rest
+ * of the PCI topology cache.
+ */
+typedef struct _virPCIMdevTypesEntry virPCIMdevTypesEntry;
+struct _virPCIMdevTypesEntry {
+    gint64 expires;
+    virMediatedDeviceTypePtr *types;
+    size_t ntypes;
+};
+
+static GHashTable *virPCIMdevTypesCache;
+
+
+static void
+virPCIMdevTypesEntryFree(void *opaque)
+{
+    virPCIMdevTypesEntry *entry = opaque;
+    size_t i;
+
+    for (i = 0; i < entry->ntypes; i++)
+        virMediatedDeviceTypeFree(entry->types[i]);
+    g_free(entry->types);
+    g_free(entry);
+}
+
+
+static virMediatedDeviceTypePtr *
+virPCIMdevTypesCopy(virMediatedDeviceTypePtr *types,
+                    size_t ntypes)
+{
+    virMediatedDeviceTypePtr *copy = g_new0(virMediatedDeviceTypePtr, ntypes);
+    size_t i;
+
+    for (i = 0; i < ntypes; i++) {
+        copy[i] = g_new0(virMediatedDeviceType, 1);
+        copy[i]->id = g_strdup(types[i]->id);
+        copy[i]->name = g_strdup(types[i]->name);
+        copy[i]->device_api = g_strdup(types[i]->device_api);
+        copy[i]->available_instances = types[i]->available_instances;
+    }
+
+    return copy;
+}
+
+
+ssize_t
+virPCIGetMdevTypes(const char *sysfspath,
+                   virMediatedDeviceTypePtr **types)
+{
+    virPCIMdevTypesEntry *entry;
+    virMediatedDeviceTypePtr *newtypes = NULL;
+    ssize_t ret = -1;
+
+    virMutexLock(&virPCITopologyLock);
+    if (virPCIMdevTypesCache &&
+        (entry = g_hash_table_lookup(virPCIMdevTypesCache, sysfspath)) &&
+        entry->expires >= g_get_monotonic_time()) {
+        if (entry->ntypes > 0)
+            *types = virPCIMdevTypesCopy(entry->types, entry->ntypes);
+        ret = entry->ntypes;
+    }
+    virMutexUnlock(&virPCITopologyLock);
+
+    if (ret >= 0)
+        return ret;
+
+    if ((ret = virPCIReadMdevTypes(sysfspath, &newtypes)) < 0)
+        return -1;
+
+    entry = g_new0(virPCIMdevTypesEntry, 1);
+    entry->expires = g_get_monotonic_time() + VIR_PCI_TOPOLOGY_TTL;
+    entry->ntypes = ret;
+    if (ret > 0)
+        entry->types = virPCIMdevTypesCopy(newtypes, ret);
+
+    virMutexLock(&virPCITopologyLock);
+    if (!virPCIMdevTypesCache)
+        virPCIMdevTypesCache = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                     g_free,
+                                                     virPCIMdevTypesEntryFree);
+    g_hash_table_replace(virPCIMdevTypesCache, g_strdup(sysfspath), entry);
+    virMutexUnlock(&virPCITopologyLock);
+
+    if (ret > 0)
+        *types = newtypes;
+
+    return ret;
+}
+
+
+/**
+ * virPCIMdevTypesInvalidate:
+ * @sysfspath: sysfs path of the parent device, or NULL for all devices
+ *
+ * Drops the cached mdev types of @sysfspath. To be called whenever the
+ * types of a device may have changed, e.g. when a mediated device was
+ * created or removed.
+ */
+void
+virPCIMdevTypesInvalidate(const char *sysfspath)
+{
+    virMutexLock(&virPCITopologyLock);
+    if (virPCIMdevTypesCache) {
+        if (sysfspath)
+            g_hash_table_remove(virPCIMdevTypesCache, sysfspath);
+        else
+            g_hash_table_remove_all(virPCIMdevTypesCache);
+    }
+    virMutexUnlock(&virPCITopologyLock);
+}
+
 #else
 static const char *unsupported = N_("not supported on non-linux platforms");
 
@@ -2712,6 +3032,12 @@ virPCIGetMdevTypes(const char *sysfspath G_GNUC_UNUSED,
     virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _(unsupported));
     return -1;
 }
+
+
+void
+virPCIMdevTypesInvalidate(const char *sysfspath G_GNUC_UNUSED)
+{
+}
 #endif /* __linux__ */
 
 int
@@ -209,6 +209,8 @@ char *virPCIDeviceGetIOMMUGroupDev(virPCIDevicePtr dev);
 int virPCIDeviceIsAssignable(virPCIDevicePtr dev,
                              int strict_acs_check);
 
+void virPCITopologyInvalidate(void);
+
 virPCIDeviceAddressPtr
 virPCIGetDeviceAddressFromSysfsLink(const char *device_link);
 
@@ -281,6 +283,7 @@ void virPCIEDeviceInfoFree(virPCIEDeviceInfoPtr dev);
 
 ssize_t virPCIGetMdevTypes(const char *sysfspath,
                            virMediatedDeviceType ***types);
+void virPCIMdevTypesInvalidate(const char *sysfspath);
 
 void virPCIDeviceAddressFree(virPCIDeviceAddressPtr address);
 
@@ -67,6 +67,14 @@ struct _virPerf {
     struct virPerfEvent events[VIR_PERF_EVENT_LAST];
 };
 
+/* Events of a single thread which are scheduled on the PMU together and
+ * read with one syscall through the group leader. */
+struct _virPerfGroup {
+    int *fds;   /* fds[0] is the group leader */
+    size_t nfds;
+};
+
+
 #if defined(__linux__) && defined(HAVE_SYS_SYSCALL_H)
 
 # include <linux/perf_event.h>
@@ -202,21 +210,79 @@ virPerfRdtAttrInit(void)
 }
 
 
+/* The kernel multiplexes events when there are more of them than
+ * hardware counters, scale the count to the whole time the event was
+ * enabled. */
+static uint64_t
+virPerfScale(uint64_t value,
+             uint64_t enabled,
+             uint64_t running)
+{
+    if (running == 0)
+        return 0;
+
+    if (running >= enabled)
+        return value;
+
+    return (uint64_t) ((double) value * enabled / running);
+}
+
+
+static bool
+virPerfEventIsRdt(virPerfEventType type)
+{
+    return type == VIR_PERF_EVENT_CMT ||
+           type == VIR_PERF_EVENT_MBMT ||
+           type == VIR_PERF_EVENT_MBML;
+}
+
+
+static int
+virPerfEventOpen(virPerfEventType type,
+                 pid_t pid,
+                 bool inherit,
+                 int group_fd,
+                 uint64_t read_format)
+{
+    struct perf_event_attr attr;
+    virPerfEventAttrPtr event_attr = &attrs[type];
+    int fd;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.inherit = inherit;
+    /* group members follow the state of the leader */
+    attr.disabled = group_fd < 0;
+    attr.enable_on_exec = 0;
+    attr.type = event_attr->attrType;
+    attr.config = event_attr->attrConfig;
+    attr.read_format = read_format;
+
+    fd = syscall(__NR_perf_event_open, &attr, pid, -1, group_fd, 0);
+    if (fd < 0) {
+        virReportSystemError(errno,
+                             _("unable to open host cpu perf event for %s"),
+                             virPerfEventTypeToString(type));
+        return -1;
+    }
+
+    return fd;
+}
+
+
 int
 virPerfEventEnable(virPerfPtr perf,
                    virPerfEventType type,
                    pid_t pid)
 {
-    struct perf_event_attr attr;
     virPerfEventPtr event = &(perf->events[type]);
     virPerfEventAttrPtr event_attr = &attrs[type];
+    uint64_t read_format = 0;
 
     if (event->enabled)
         return 0;
 
-    if (event_attr->attrType == 0 && (type == VIR_PERF_EVENT_CMT ||
-                                      type == VIR_PERF_EVENT_MBMT ||
-                                      type == VIR_PERF_EVENT_MBML)) {
+    if (event_attr->attrType == 0 && virPerfEventIsRdt(type)) {
         virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED,
                        _("unable to enable host cpu perf event for %s"),
                        virPerfEventTypeToString(type));
@@ -237,21 +303,13 @@ virPerfEventEnable(virPerfPtr perf,
         }
     }
 
-    memset(&attr, 0, sizeof(attr));
-    attr.size = sizeof(attr);
-    attr.inherit = 1;
-    attr.disabled = 1;
-    attr.enable_on_exec = 0;
-    attr.type = event_attr->attrType;
-    attr.config = event_attr->attrConfig;
+    /* RDT events are not multiplexed, everything else is scaled */
+    if (!virPerfEventIsRdt(type))
+        read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                      PERF_FORMAT_TOTAL_TIME_RUNNING;
 
-    event->fd = syscall(__NR_perf_event_open, &attr, pid, -1, -1, 0);
-    if (event->fd < 0) {
-        virReportSystemError(errno,
-                             _("unable to open host cpu perf event for %s"),
-                             virPerfEventTypeToString(type));
+    if ((event->fd = virPerfEventOpen(type, pid, true, -1, read_format)) < 0)
         goto error;
-    }
 
     if (ioctl(event->fd, PERF_EVENT_IOC_ENABLE) < 0) {
         virReportSystemError(errno,
@@ -301,17 +359,123 @@ virPerfReadEvent(virPerfPtr perf,
                  uint64_t *value)
 {
     virPerfEventPtr event = &perf->events[type];
+    /* value, time enabled and time running */
+    uint64_t buf[3] = { 0 };
+    size_t len = virPerfEventIsRdt(type) ? sizeof(buf[0]) : sizeof(buf);
+
     if (!event->enabled)
         return -1;
 
-    if (saferead(event->fd, value, sizeof(uint64_t)) < 0) {
+    if (saferead(event->fd, buf, len) != (ssize_t) len) {
         virReportSystemError(errno, "%s",
                              _("Unable to read cache data"));
         return -1;
     }
 
     if (type == VIR_PERF_EVENT_CMT)
-        *value *= event->efields.cmt.scale;
+        *value = buf[0] * event->efields.cmt.scale;
+    else if (virPerfEventIsRdt(type))
+        *value = buf[0];
+    else
+        *value = virPerfScale(buf[0], buf[1], buf[2]);
+
+    return 0;
+}
+
+
+/**
+ * virPerfGroupNew:
+ * @tid: thread to count the events of
+ * @types: events to count
+ * @ntypes: number of @types
+ *
+ * Open a group of counters for the single thread @tid (not inherited
+ * by its children) so that they can be read in one go with
+ * virPerfGroupRead. Only hardware and software events can be grouped.
+ *
+ * Returns the group on success, NULL with error reported otherwise.
+ */
+virPerfGroupPtr
+virPerfGroupNew(pid_t tid,
+                const virPerfEventType *types,
+                size_t ntypes)
+{
+    g_autoptr(virPerfGroup) group = NULL;
+    uint64_t read_format = PERF_FORMAT_GROUP |
+                           PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+    size_t i;
+
+    if (ntypes == 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("no events to group"));
+        return NULL;
+    }
+
+    group = g_new0(virPerfGroup, 1);
+    group->fds = g_new0(int, ntypes);
+
+    for (i = 0; i < ntypes; i++) {
+        int fd;
+
+        if (virPerfEventIsRdt(types[i])) {
+            virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED,
+                           _("perf event %s can't be counted per thread"),
+                           virPerfEventTypeToString(types[i]));
+            return NULL;
+        }
+
+        fd = virPerfEventOpen(types[i], tid, false,
+                              i == 0 ? -1 : group->fds[0], read_format);
+        if (fd < 0)
+            return NULL;
+
+        group->fds[group->nfds++] = fd;
+    }
+
+    if (ioctl(group->fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) < 0) {
+        virReportSystemError(errno,
+                             _("unable to enable perf events of thread %lld"),
+                             (long long) tid);
+        return NULL;
+    }
+
+    return g_steal_pointer(&group);
+}
+
+
+/**
+ * virPerfGroupRead:
+ * @group: group of counters
+ * @values: filled with the counts in the order of the types passed
+ *          to virPerfGroupNew
+ *
+ * Returns 0 on success, -1 with error reported otherwise.
+ */
+int
+virPerfGroupRead(virPerfGroupPtr group,
+                 uint64_t *values)
+{
+    /* nr, time enabled, time running and the values */
+    g_autofree uint64_t *buf = g_new0(uint64_t, group->nfds + 3);
+    size_t len = sizeof(uint64_t) * (group->nfds + 3);
+    size_t i;
+
+    if (saferead(group->fds[0], buf, len) != (ssize_t) len) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to read perf event group"));
+        return -1;
+    }
+
+    if (buf[0] != group->nfds) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("perf event group has %llu events, expected %zu"),
+                       (unsigned long long) buf[0], group->nfds);
+        return -1;
+    }
+
+    for (i = 0; i < group->nfds; i++)
+        values[i] = virPerfScale(buf[i + 3], buf[1], buf[2]);
 
     return 0;
 }
@@ -360,6 +524,25 @@ virPerfReadEvent(virPerfPtr perf G_GNUC_UNUSED,
     return -1;
 }
 
+virPerfGroupPtr
+virPerfGroupNew(pid_t tid G_GNUC_UNUSED,
+                const virPerfEventType *types G_GNUC_UNUSED,
+                size_t ntypes G_GNUC_UNUSED)
+{
+    virReportSystemError(ENXIO, "%s",
+                         _("Perf not supported on this platform"));
+    return NULL;
+}
+
+int
+virPerfGroupRead(virPerfGroupPtr group G_GNUC_UNUSED,
+                 uint64_t *values G_GNUC_UNUSED)
+{
+    virReportSystemError(ENXIO, "%s",
+                         _("Perf not supported on this platform"));
+    return -1;
+}
+
 #endif
 
 virPerfPtr
@@ -397,3 +580,18 @@ virPerfFree(virPerfPtr perf)
 
     VIR_FREE(perf);
 }
+
+void
+virPerfGroupFree(virPerfGroupPtr group)
+{
+    size_t i;
+
+    if (!group)
+        return;
+
+    for (i = 0; i < group->nfds; i++)
+        VIR_FORCE_CLOSE(group->fds[i]);
+
+    g_free(group->fds);
+    g_free(group);
+}
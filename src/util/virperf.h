@@ -81,3 +81,17 @@ int virPerfReadEvent(virPerfPtr perf,
                      uint64_t *value);
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(virPerf, virPerfFree);
+
+typedef struct _virPerfGroup virPerfGroup;
+typedef virPerfGroup *virPerfGroupPtr;
+
+virPerfGroupPtr virPerfGroupNew(pid_t tid,
+                                const virPerfEventType *types,
+                                size_t ntypes);
+
+void virPerfGroupFree(virPerfGroupPtr group);
+
+int virPerfGroupRead(virPerfGroupPtr group,
+                     uint64_t *values);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(virPerfGroup, virPerfGroupFree);
@@ -37,11 +37,17 @@
 
 #define VIR_PORT_ALLOCATOR_NUM_PORTS 65536
 
+/* How long ports found in use by someone else on the host are skipped
+ * without probing them again, in microseconds */
+#define VIR_PORT_ALLOCATOR_BUSY_TIMEOUT (5 * G_USEC_PER_SEC)
+
 typedef struct _virPortAllocator virPortAllocator;
 typedef virPortAllocator *virPortAllocatorPtr;
 struct _virPortAllocator {
     virObjectLockable parent;
-    virBitmapPtr bitmap;
+    virBitmapPtr bitmap; /* ports reserved by us */
+    virBitmapPtr busy; /* ports in use by someone else on the host */
+    gint64 busyExpiry; /* when to forget the content of @busy */
 };
 
 struct _virPortAllocatorRange {
@@ -60,6 +66,7 @@ virPortAllocatorDispose(void *obj)
     virPortAllocatorPtr pa = obj;
 
     virBitmapFree(pa->bitmap);
+    virBitmapFree(pa->busy);
 }
 
 static virPortAllocatorPtr
@@ -70,7 +77,8 @@ virPortAllocatorNew(void)
     if (!(pa = virObjectLockableNew(virPortAllocatorClass)))
         return NULL;
 
-    if (!(pa->bitmap = virBitmapNew(VIR_PORT_ALLOCATOR_NUM_PORTS)))
+    if (!(pa->bitmap = virBitmapNew(VIR_PORT_ALLOCATOR_NUM_PORTS)) ||
+        !(pa->busy = virBitmapNew(VIR_PORT_ALLOCATOR_NUM_PORTS)))
         goto error;
 
     return pa;
@@ -206,12 +214,51 @@ virPortAllocatorGet(void)
     return virPortAllocatorInstance;
 }
 
+/*
+ * Returns the lowest port of @range after @port (or the first one if
+ * @port is 0) which is neither reserved nor, unless @probeBusy is set,
+ * known to be in use on the host. Returns 0 if there's no such port.
+ */
+static unsigned short
+virPortAllocatorNextCandidate(virPortAllocatorPtr pa,
+                              const virPortAllocatorRange *range,
+                              unsigned short port,
+                              bool probeBusy)
+{
+    ssize_t i = port ? port : range->start - 1;
+
+    while ((i = virBitmapNextClearBit(pa->bitmap, i)) >= 0 &&
+           i <= range->end) {
+        if (probeBusy || !virBitmapIsBitSet(pa->busy, i))
+            return i;
+    }
+
+    return 0;
+}
+
+
+/**
+ * virPortAllocatorAcquire:
+ * @range: range to pick the port from
+ * @port: filled with the acquired port
+ *
+ * Reserves the lowest port of @range which is not reserved yet and
+ * which is not in use on the host. Whether a port is in use is probed
+ * by binding to it without holding the allocator lock, so that
+ * concurrent acquisitions don't wait for each other's probes. Ports
+ * found in use are remembered for a while and skipped without
+ * probing, unless all other ports of @range are taken.
+ *
+ * Returns 0 on success, -1 on error (with error reported).
+ */
 int
 virPortAllocatorAcquire(const virPortAllocatorRange *range,
                         unsigned short *port)
 {
     int ret = -1;
-    size_t i;
+    unsigned short i = 0;
+    bool probeBusy = false;
+    gint64 now = g_get_monotonic_time();
     virPortAllocatorPtr pa = virPortAllocatorGet();
 
     *port = 0;
@@ -221,26 +268,44 @@ virPortAllocatorAcquire(const virPortAllocatorRange *range,
 
     virObjectLock(pa);
 
-    for (i = range->start; i <= range->end && !*port; i++) {
+    if (now >= pa->busyExpiry) {
+        virBitmapClearAll(pa->busy);
+        pa->busyExpiry = now + VIR_PORT_ALLOCATOR_BUSY_TIMEOUT;
+    }
+
+    while (!*port) {
         bool used = false, v6used = false;
+        int rc;
 
-        if (virBitmapIsBitSet(pa->bitmap, i))
+        if (!(i = virPortAllocatorNextCandidate(pa, range, i, probeBusy))) {
+            /* the ports in use may have been freed in the meantime */
+            if (probeBusy)
+                break;
+            probeBusy = true;
             continue;
+        }
 
-        if (virPortAllocatorBindToPort(&v6used, i, AF_INET6) < 0 ||
-            virPortAllocatorBindToPort(&used, i, AF_INET) < 0)
-            goto cleanup;
+        /* keep the port reserved while probing it */
+        ignore_value(virBitmapSetBit(pa->bitmap, i));
+        virObjectUnlock(pa);
 
-        if (!used && !v6used) {
-            /* Add port to bitmap of reserved ports */
-            if (virBitmapSetBit(pa->bitmap, i) < 0) {
-                virReportError(VIR_ERR_INTERNAL_ERROR,
-                               _("Failed to reserve port %zu"), i);
+        rc = virPortAllocatorBindToPort(&v6used, i, AF_INET6);
+        if (rc == 0)
+            rc = virPortAllocatorBindToPort(&used, i, AF_INET);
+
+        virObjectLock(pa);
+
+        if (rc < 0 || used || v6used) {
+            ignore_value(virBitmapClearBit(pa->bitmap, i));
+            if (rc < 0)
                 goto cleanup;
-            }
-            *port = i;
-            ret = 0;
+            ignore_value(virBitmapSetBit(pa->busy, i));
+            continue;
         }
+
+        ignore_value(virBitmapClearBit(pa->busy, i));
+        *port = i;
+        ret = 0;
     }
 
     if (*port == 0) {
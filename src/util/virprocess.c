@@ -1057,6 +1057,213 @@ int virProcessGetStartTime(pid_t pid,
 #endif
 
 
+#ifdef __linux__
+/**
+ * virProcessGetSchedStats:
+ * @pid: process ID
+ * @tids: thread IDs of threads of @pid
+ * @ntids: number of items in @tids
+ * @runtime: filled with the time each thread spent on a CPU
+ * @waittime: filled with the time each thread spent waiting on a runqueue
+ *
+ * Reads the scheduler statistics of all @tids in one pass over
+ * /proc/@pid/task, which is considerably cheaper than parsing the
+ * 'stat' and 'sched' files of every thread separately. Both @runtime
+ * and @waittime are optional and must have room for @ntids items,
+ * the values are in nanoseconds.
+ *
+ * Returns 0 on success, -1 on error (e.g. if the kernel was built
+ * without CONFIG_SCHEDSTATS).
+ */
+int
+virProcessGetSchedStats(pid_t pid,
+                        pid_t *tids,
+                        size_t ntids,
+                        unsigned long long *runtime,
+                        unsigned long long *waittime)
+{
+    g_autofree char *taskdir = NULL;
+    VIR_AUTOCLOSE taskfd = -1;
+    size_t i;
+
+    taskdir = g_strdup_printf("/proc/%lld/task", (long long) pid);
+
+    if ((taskfd = open(taskdir, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0) {
+        virReportSystemError(errno, _("unable to open %s"), taskdir);
+        return -1;
+    }
+
+    for (i = 0; i < ntids; i++) {
+        char name[64];
+        char buf[128];
+        VIR_AUTOCLOSE fd = -1;
+        unsigned long long runns;
+        unsigned long long waitns;
+        ssize_t len;
+        char *end;
+
+        g_snprintf(name, sizeof(name), "%lld/schedstat", (long long) tids[i]);
+
+        if ((fd = openat(taskfd, name, O_RDONLY | O_CLOEXEC)) < 0) {
+            virReportSystemError(errno, _("unable to open %s/%s"),
+                                 taskdir, name);
+            return -1;
+        }
+
+        if ((len = saferead(fd, buf, sizeof(buf) - 1)) < 0) {
+            virReportSystemError(errno, _("unable to read %s/%s"),
+                                 taskdir, name);
+            return -1;
+        }
+        buf[len] = '\0';
+
+        /* The format is "<run ns> <wait ns> <timeslices>" */
+        if (virStrToLong_ull(buf, &end, 10, &runns) < 0 ||
+            virStrToLong_ull(end, &end, 10, &waitns) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("cannot parse '%s' from %s/%s"),
+                           buf, taskdir, name);
+            return -1;
+        }
+
+        if (runtime)
+            runtime[i] = runns;
+        if (waittime)
+            waittime[i] = waitns;
+    }
+
+    return 0;
+}
+#else
+int
+virProcessGetSchedStats(pid_t pid G_GNUC_UNUSED,
+                        pid_t *tids G_GNUC_UNUSED,
+                        size_t ntids G_GNUC_UNUSED,
+                        unsigned long long *runtime G_GNUC_UNUSED,
+                        unsigned long long *waittime G_GNUC_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("Process scheduler statistics are not supported on this platform"));
+    return -1;
+}
+#endif
+
+
+#ifdef __linux__
+/*
+ * Parses lines in the "<key>[:] <value>[ kB]" format of /proc files.
+ * Values of @keys found in @buf are stored into @values and the matching
+ * bits of the returned mask are set.
+ */
+static unsigned int
+virProcessParseKeyValues(const char *buf,
+                         const char *const *keys,
+                         long long *values)
+{
+    g_auto(GStrv) lines = g_strsplit(buf, "\n", 0);
+    unsigned int found = 0;
+    size_t i;
+    size_t j;
+
+    for (i = 0; lines[i]; i++) {
+        for (j = 0; keys[j]; j++) {
+            size_t len = strlen(keys[j]);
+            char *end;
+
+            if (!STRPREFIX(lines[i], keys[j]) ||
+                (lines[i][len] != ':' && lines[i][len] != ' '))
+                continue;
+
+            if (virStrToLong_ll(lines[i] + len + 1, &end, 10, &values[j]) == 0)
+                found |= 1U << j;
+            break;
+        }
+    }
+
+    return found;
+}
+
+
+/**
+ * virProcessGetMemoryStats:
+ * @pid: process ID
+ * @stats: filled with the statistics
+ *
+ * Reads how the memory of @pid is backed on the host from
+ * /proc/@pid/smaps_rollup and how much of it KSM merged from
+ * /proc/@pid/ksm_stat. The latter is only available since Linux 6.1,
+ * @stats->ksm tells whether the KSM statistics were filled in.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virProcessGetMemoryStats(pid_t pid,
+                         virProcessMemoryStatsPtr stats)
+{
+    const char *smapsKeys[] = { "Rss", "AnonHugePages", "Shared_Hugetlb",
+                                "Private_Hugetlb", NULL };
+    const char *ksmKeys[] = { "ksm_rmap_items", "ksm_merging_pages",
+                              "ksm_zero_pages", "ksm_process_profit", NULL };
+    long long smaps[G_N_ELEMENTS(smapsKeys)] = { 0 };
+    long long ksm[G_N_ELEMENTS(ksmKeys)] = { 0 };
+    g_autofree char *path = NULL;
+    g_autofree char *buf = NULL;
+    unsigned int found;
+
+    memset(stats, 0, sizeof(*stats));
+
+    path = g_strdup_printf("/proc/%lld/smaps_rollup", (long long) pid);
+    if (virFileReadAll(path, 64 * 1024, &buf) < 0)
+        return -1;
+
+    virProcessParseKeyValues(buf, smapsKeys, smaps);
+    stats->rss = smaps[0];
+    stats->anonHugePages = smaps[1];
+    stats->hugetlb = smaps[2] + smaps[3];
+
+    g_free(path);
+    VIR_FREE(buf);
+    path = g_strdup_printf("/proc/%lld/ksm_stat", (long long) pid);
+
+    /* older kernels or kernels without KSM */
+    if (virFileReadAllQuiet(path, 4096, &buf) < 0)
+        return 0;
+
+    found = virProcessParseKeyValues(buf, ksmKeys, ksm);
+    stats->ksm = true;
+    stats->ksmRmapItems = ksm[0];
+    stats->ksmZeroPages = ksm[2];
+    stats->ksmProfit = ksm[3];
+
+    if (found & (1U << 1)) {
+        stats->ksmMergingPages = ksm[1];
+    } else {
+        /* older kernels report the merged pages in a file of their own */
+        long long pages;
+
+        g_free(path);
+        VIR_FREE(buf);
+        path = g_strdup_printf("/proc/%lld/ksm_merging_pages", (long long) pid);
+
+        if (virFileReadAllQuiet(path, 64, &buf) >= 0 &&
+            virStrToLong_ll(g_strstrip(buf), NULL, 10, &pages) == 0)
+            stats->ksmMergingPages = pages;
+    }
+
+    return 0;
+}
+#else
+int
+virProcessGetMemoryStats(pid_t pid G_GNUC_UNUSED,
+                         virProcessMemoryStatsPtr stats G_GNUC_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("Process memory statistics are not supported on this platform"));
+    return -1;
+}
+#endif
+
+
 #ifdef __linux__
 typedef struct _virProcessNamespaceHelperData virProcessNamespaceHelperData;
 struct _virProcessNamespaceHelperData {
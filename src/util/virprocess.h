@@ -67,6 +67,31 @@ int virProcessGetPids(pid_t pid, size_t *npids, pid_t **pids);
 int virProcessGetStartTime(pid_t pid,
                            unsigned long long *timestamp);
 
+int virProcessGetSchedStats(pid_t pid,
+                            pid_t *tids,
+                            size_t ntids,
+                            unsigned long long *runtime,
+                            unsigned long long *waittime);
+
+typedef struct _virProcessMemoryStats virProcessMemoryStats;
+typedef virProcessMemoryStats *virProcessMemoryStatsPtr;
+struct _virProcessMemoryStats {
+    /* in KiB */
+    unsigned long long rss;
+    unsigned long long anonHugePages;
+    unsigned long long hugetlb;
+
+    /* the following are filled only if @ksm is true */
+    bool ksm;
+    unsigned long long ksmRmapItems;
+    unsigned long long ksmMergingPages;
+    unsigned long long ksmZeroPages;
+    long long ksmProfit; /* in bytes, may be negative */
+};
+
+int virProcessGetMemoryStats(pid_t pid,
+                             virProcessMemoryStatsPtr stats);
+
 int virProcessGetNamespaces(pid_t pid,
                             size_t *nfdlist,
                             int **fdlist);
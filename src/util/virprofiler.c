@@ -0,0 +1,362 @@
+/*
+ * virprofiler.c: sampling profiler of the running process
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#if defined(__linux__) && defined(HAVE_EXECINFO_H)
+# include <execinfo.h>
+# include <signal.h>
+# include <sys/prctl.h>
+# include <sys/time.h>
+# ifdef HAVE_DLFCN_H
+#  include <dlfcn.h>
+# endif
+#endif
+
+#include "virprofiler.h"
+#include "viralloc.h"
+#include "virerror.h"
+#include "virfile.h"
+#include "virlog.h"
+#include "virthread.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("util.profiler");
+
+#if defined(__linux__) && defined(HAVE_EXECINFO_H)
+
+/*
+ * The profiler arms ITIMER_PROF, which makes the kernel send SIGPROF to
+ * the thread consuming CPU time each time the process used another
+ * 1/VIR_PROFILER_FREQUENCY second of it. The signal handler records
+ * the name of the interrupted thread, as set by virThreadCreateFull,
+ * and its stack into a preallocated buffer. Once the run is over a
+ * separate thread symbolizes the stacks and writes them folded, i.e.
+ * one line per distinct stack with frames separated by ';' followed
+ * by the number of samples, which is what flame graph tools consume.
+ *
+ * The handler stays installed and the buffer allocated once the first
+ * run started, so that a signal which is still being delivered after
+ * the run ended never finds the default action, which would terminate
+ * the daemon, or freed memory.
+ */
+
+/* Odd, so that sampling doesn't align with periodic timers */
+# define VIR_PROFILER_FREQUENCY 99
+# define VIR_PROFILER_SAMPLES_MAX 8192
+# define VIR_PROFILER_FRAMES_MAX 48
+/* Frames of the signal handler and the signal trampoline */
+# define VIR_PROFILER_FRAMES_SKIP 2
+
+typedef struct _virProfilerSample virProfilerSample;
+struct _virProfilerSample {
+    int complete;
+    int nframes;
+    char thread[16];
+    void *frames[VIR_PROFILER_FRAMES_MAX];
+};
+
+static virMutex virProfilerLock = VIR_MUTEX_INITIALIZER;
+static bool virProfilerRunning;
+static virProfilerSample *virProfilerSamples;
+static int virProfilerActive;
+static int virProfilerNext;
+static int virProfilerDropped;
+
+typedef struct _virProfilerRun virProfilerRun;
+struct _virProfilerRun {
+    char *path;
+    unsigned int duration;
+};
+
+
+/* Only async-signal-safe functions may be called from here. backtrace()
+ * is not formally one, but is safe once libgcc was loaded by an earlier
+ * call, which virProfilerStart takes care of. */
+static void
+virProfilerHandler(int sig G_GNUC_UNUSED)
+{
+    int saved_errno = errno;
+    virProfilerSample *sample;
+    int idx;
+
+    if (!g_atomic_int_get(&virProfilerActive))
+        goto cleanup;
+
+    idx = g_atomic_int_add(&virProfilerNext, 1);
+    if (idx >= VIR_PROFILER_SAMPLES_MAX) {
+        g_atomic_int_inc(&virProfilerDropped);
+        goto cleanup;
+    }
+
+    sample = &virProfilerSamples[idx];
+    if (prctl(PR_GET_NAME, sample->thread) < 0)
+        sample->thread[0] = '\0';
+    sample->nframes = backtrace(sample->frames, VIR_PROFILER_FRAMES_MAX);
+    g_atomic_int_set(&sample->complete, 1);
+
+ cleanup:
+    errno = saved_errno;
+}
+
+
+static char *
+virProfilerSymbolize(void *addr)
+{
+# ifdef HAVE_DLFCN_H
+    Dl_info info;
+
+    if (dladdr(addr, &info) != 0) {
+        if (info.dli_sname)
+            return g_strdup(info.dli_sname);
+        if (info.dli_fname) {
+            g_autofree char *base = g_path_get_basename(info.dli_fname);
+
+            return g_strdup_printf("%s+0x%zx", base,
+                                   (size_t)((char *)addr - (char *)info.dli_fbase));
+        }
+    }
+# endif /* HAVE_DLFCN_H */
+
+    return g_strdup_printf("%p", addr);
+}
+
+
+static char *
+virProfilerFormat(size_t nsamples,
+                  size_t *nstacks)
+{
+    g_autoptr(GHashTable) stacks = g_hash_table_new_full(g_str_hash,
+                                                         g_str_equal,
+                                                         g_free, NULL);
+    g_autoptr(GHashTable) symbols = g_hash_table_new_full(g_direct_hash,
+                                                          g_direct_equal,
+                                                          NULL, g_free);
+    GString *buf = g_string_new(NULL);
+    GHashTableIter iter;
+    void *key;
+    void *value;
+    size_t i;
+
+    for (i = 0; i < nsamples; i++) {
+        virProfilerSample *sample = &virProfilerSamples[i];
+        GString *stack;
+        int j;
+
+        if (!g_atomic_int_get(&sample->complete))
+            continue;
+
+        stack = g_string_new(sample->thread[0] ? sample->thread : "unnamed");
+
+        /* folded stacks start with the outermost frame */
+        for (j = sample->nframes - 1; j >= VIR_PROFILER_FRAMES_SKIP; j--) {
+            const char *symbol = g_hash_table_lookup(symbols, sample->frames[j]);
+
+            if (!symbol) {
+                char *tmp = virProfilerSymbolize(sample->frames[j]);
+
+                g_hash_table_insert(symbols, sample->frames[j], tmp);
+                symbol = tmp;
+            }
+
+            g_string_append_printf(stack, ";%s", symbol);
+        }
+
+        value = g_hash_table_lookup(stacks, stack->str);
+        g_hash_table_insert(stacks, g_string_free(stack, FALSE),
+                            GUINT_TO_POINTER(GPOINTER_TO_UINT(value) + 1));
+    }
+
+    g_hash_table_iter_init(&iter, stacks);
+    while (g_hash_table_iter_next(&iter, &key, &value))
+        g_string_append_printf(buf, "%s %u\n",
+                               (const char *)key, GPOINTER_TO_UINT(value));
+
+    *nstacks = g_hash_table_size(stacks);
+    return g_string_free(buf, FALSE);
+}
+
+
+static void
+virProfilerWorker(void *opaque)
+{
+    virProfilerRun *run = opaque;
+    struct itimerval timer = { { 0, 0 }, { 0, 0 } };
+    g_autofree char *output = NULL;
+    size_t nsamples;
+    size_t nstacks = 0;
+
+    g_usleep(run->duration * G_USEC_PER_SEC);
+
+    ignore_value(setitimer(ITIMER_PROF, &timer, NULL));
+    g_atomic_int_set(&virProfilerActive, 0);
+
+    /* let handlers which are still running on other CPUs finish */
+    g_usleep(100 * 1000);
+
+    nsamples = MIN(g_atomic_int_get(&virProfilerNext), VIR_PROFILER_SAMPLES_MAX);
+    output = virProfilerFormat(nsamples, &nstacks);
+
+    if (virFileWriteStr(run->path, output, 0600) < 0) {
+        VIR_WARN("Unable to write profile to %s: %s",
+                 run->path, g_strerror(errno));
+    } else {
+        VIR_INFO("Wrote %zu samples in %zu stacks to %s, %d samples dropped",
+                 nsamples, nstacks, run->path,
+                 g_atomic_int_get(&virProfilerDropped));
+    }
+
+    virMutexLock(&virProfilerLock);
+    virProfilerRunning = false;
+    virMutexUnlock(&virProfilerLock);
+
+    g_free(run->path);
+    g_free(run);
+}
+
+
+/**
+ * virProfilerStart:
+ * @dir: directory to write the profile to
+ * @duration: how long to profile, in seconds
+ * @path: filled with the path of the profile
+ *
+ * Starts sampling the stacks of all threads of the process consuming
+ * CPU time for @duration seconds. The samples are written to a new
+ * file in @dir once the run is over, @path tells which one. Only one
+ * run can be in progress at a time.
+ *
+ * While the profiler runs, system calls of the process may fail with
+ * EINTR more often than usual.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virProfilerStart(const char *dir,
+                 unsigned int duration,
+                 char **path)
+{
+    struct itimerval timer = {
+        { 0, G_USEC_PER_SEC / VIR_PROFILER_FREQUENCY },
+        { 0, G_USEC_PER_SEC / VIR_PROFILER_FREQUENCY },
+    };
+    static bool installed;
+    virProfilerRun *run = NULL;
+    virThread thread;
+    void *dummy[1];
+    int ret = -1;
+
+    if (duration == 0 || duration > VIR_PROFILER_DURATION_MAX) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("profiling duration must be between 1 and %d seconds"),
+                       VIR_PROFILER_DURATION_MAX);
+        return -1;
+    }
+
+    virMutexLock(&virProfilerLock);
+
+    if (virProfilerRunning) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("profiler is already running"));
+        goto cleanup;
+    }
+
+    if (virFileMakePathWithMode(dir, 0700) < 0) {
+        virReportSystemError(errno, _("unable to create directory %s"), dir);
+        goto cleanup;
+    }
+
+    run = g_new0(virProfilerRun, 1);
+    run->path = g_strdup_printf("%s/profile-%lld.folded", dir,
+                                (long long)(g_get_real_time() / G_USEC_PER_SEC));
+    run->duration = duration;
+
+    if (!installed) {
+        struct sigaction sa = { 0 };
+
+        /* loads libgcc, which must not happen in the signal handler */
+        ignore_value(backtrace(dummy, G_N_ELEMENTS(dummy)));
+
+        virProfilerSamples = g_new0(virProfilerSample, VIR_PROFILER_SAMPLES_MAX);
+
+        sa.sa_handler = virProfilerHandler;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        if (sigaction(SIGPROF, &sa, NULL) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("unable to install SIGPROF handler"));
+            goto cleanup;
+        }
+        installed = true;
+    }
+
+    memset(virProfilerSamples, 0,
+           sizeof(*virProfilerSamples) * VIR_PROFILER_SAMPLES_MAX);
+    g_atomic_int_set(&virProfilerNext, 0);
+    g_atomic_int_set(&virProfilerDropped, 0);
+    g_atomic_int_set(&virProfilerActive, 1);
+
+    if (setitimer(ITIMER_PROF, &timer, NULL) < 0) {
+        virReportSystemError(errno, "%s", _("unable to arm profiling timer"));
+        g_atomic_int_set(&virProfilerActive, 0);
+        goto cleanup;
+    }
+
+    *path = g_strdup(run->path);
+
+    if (virThreadCreateFull(&thread, false, virProfilerWorker,
+                            "profiler", false, run) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to create profiler thread"));
+        memset(&timer, 0, sizeof(timer));
+        ignore_value(setitimer(ITIMER_PROF, &timer, NULL));
+        g_atomic_int_set(&virProfilerActive, 0);
+        g_clear_pointer(path, g_free);
+        goto cleanup;
+    }
+
+    VIR_DEBUG("Profiling for %u seconds into %s", duration, run->path);
+
+    run = NULL;
+    virProfilerRunning = true;
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&virProfilerLock);
+    if (run) {
+        g_free(run->path);
+        g_free(run);
+    }
+    return ret;
+}
+
+#else /* !(defined(__linux__) && defined(HAVE_EXECINFO_H)) */
+
+int
+virProfilerStart(const char *dir G_GNUC_UNUSED,
+                 unsigned int duration G_GNUC_UNUSED,
+                 char **path G_GNUC_UNUSED)
+{
+    virReportError(VIR_ERR_NO_SUPPORT, "%s",
+                   _("profiling is not supported on this platform"));
+    return -1;
+}
+
+#endif /* !(defined(__linux__) && defined(HAVE_EXECINFO_H)) */
@@ -158,9 +158,7 @@ virQEMUBuildCommandLineJSONIterate(const char *key,
         return 0;
 
     if (data->prefix) {
-        g_autofree char *tmpkey = NULL;
-
-        tmpkey = g_strdup_printf("%s.%s", data->prefix, key);
+        g_autofree char *tmpkey = g_strconcat(data->prefix, ".", key, NULL);
 
         return virQEMUBuildCommandLineJSONRecurse(tmpkey, value, data->buf,
                                                   data->skipKey, data->onOff,
@@ -194,31 +192,30 @@ virQEMUBuildCommandLineJSONRecurse(const char *key,
         return -1;
     }
 
+    /* this is called for every property of every object on the command
+     * line, so avoid the printf machinery for the simple cases */
     switch (type) {
     case VIR_JSON_TYPE_STRING:
-        virBufferAsprintf(buf, "%s=", key);
+        virBufferAdd(buf, key, -1);
+        virBufferAddChar(buf, '=');
         virQEMUBuildBufferEscapeComma(buf, virJSONValueGetString(value));
-        virBufferAddLit(buf, ",");
+        virBufferAddChar(buf, ',');
         break;
 
     case VIR_JSON_TYPE_NUMBER:
-        virBufferAsprintf(buf, "%s=%s,", key, virJSONValueGetNumberString(value));
+        virBufferAdd(buf, key, -1);
+        virBufferAddChar(buf, '=');
+        virBufferAdd(buf, virJSONValueGetNumberString(value), -1);
+        virBufferAddChar(buf, ',');
         break;
 
     case VIR_JSON_TYPE_BOOLEAN:
         virJSONValueGetBoolean(value, &tmp);
-        if (onOff) {
-            if (tmp)
-                virBufferAsprintf(buf, "%s=on,", key);
-            else
-                virBufferAsprintf(buf, "%s=off,", key);
-        } else {
-            if (tmp)
-                virBufferAsprintf(buf, "%s=yes,", key);
-            else
-                virBufferAsprintf(buf, "%s=no,", key);
-        }
-
+        virBufferAdd(buf, key, -1);
+        if (onOff)
+            virBufferAdd(buf, tmp ? "=on," : "=off,", -1);
+        else
+            virBufferAdd(buf, tmp ? "=yes," : "=no,", -1);
         break;
 
     case VIR_JSON_TYPE_ARRAY:
@@ -381,7 +378,20 @@ virQEMUBuildDriveCommandlineFromJSON(virJSONValuePtr srcdef)
 void
 virQEMUBuildBufferEscapeComma(virBufferPtr buf, const char *str)
 {
-    virBufferEscape(buf, ',', ",", "%s", str);
+    const char *comma;
+
+    if (!str)
+        return;
+
+    /* copy the string in chunks ending with a comma instead of building
+     * an escaped copy first as virBufferEscape does */
+    while ((comma = strchr(str, ','))) {
+        virBufferAdd(buf, str, comma - str + 1);
+        virBufferAddChar(buf, ',');
+        str = comma + 1;
+    }
+
+    virBufferAdd(buf, str, -1);
 }
 
 
@@ -0,0 +1,220 @@
+/*
+ * virreplycache.c: cache of string replies expiring after a time
+ *
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include "virreplycache.h"
+#include "virerror.h"
+#include "virhash.h"
+#include "virlog.h"
+#include "virtime.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("util.replycache");
+
+typedef struct _virReplyCacheEntry virReplyCacheEntry;
+typedef virReplyCacheEntry *virReplyCacheEntryPtr;
+struct _virReplyCacheEntry {
+    char *value;
+    unsigned long long expiry; /* milliseconds */
+};
+
+/*
+ * The cache is not locked, callers are expected to serialize access
+ * to it, usually with the lock of the object embedding it.
+ */
+struct _virReplyCache {
+    unsigned long long ttl; /* milliseconds */
+    size_t maxEntries;
+    virHashTablePtr entries;
+};
+
+
+static void
+virReplyCacheEntryFree(void *opaque)
+{
+    virReplyCacheEntryPtr entry = opaque;
+
+    if (!entry)
+        return;
+
+    g_free(entry->value);
+    g_free(entry);
+}
+
+
+/**
+ * virReplyCacheNew:
+ * @ttl: number of seconds a reply is kept for
+ * @maxEntries: maximum number of cached replies
+ *
+ * Creates a cache of string replies. When it is full, storing a reply
+ * evicts the one expiring first.
+ *
+ * Returns the new cache.
+ */
+virReplyCachePtr
+virReplyCacheNew(unsigned int ttl,
+                 size_t maxEntries)
+{
+    virReplyCachePtr cache = g_new0(virReplyCache, 1);
+
+    cache->ttl = ttl * 1000ULL;
+    cache->maxEntries = MAX(maxEntries, 1);
+    cache->entries = virHashNew(virReplyCacheEntryFree);
+
+    return cache;
+}
+
+
+void
+virReplyCacheFree(virReplyCachePtr cache)
+{
+    if (!cache)
+        return;
+
+    virHashFree(cache->entries);
+    g_free(cache);
+}
+
+
+/**
+ * virReplyCacheLookup:
+ * @cache: the cache
+ * @key: key of the reply
+ *
+ * Returns a copy of the reply cached under @key or NULL if there is
+ * none or it expired.
+ */
+char *
+virReplyCacheLookup(virReplyCachePtr cache,
+                    const char *key)
+{
+    virReplyCacheEntryPtr entry;
+    unsigned long long now;
+
+    if (!(entry = virHashLookup(cache->entries, key)))
+        return NULL;
+
+    if (virTimeMillisNow(&now) < 0) {
+        virResetLastError();
+        return NULL;
+    }
+
+    if (entry->expiry <= now) {
+        virHashRemoveEntry(cache->entries, key);
+        return NULL;
+    }
+
+    VIR_DEBUG("Using cached reply for '%s'", key);
+    return g_strdup(entry->value);
+}
+
+
+struct virReplyCacheFirstExpiryData {
+    const char *key;
+    unsigned long long expiry;
+};
+
+
+static int
+virReplyCacheFindFirstExpiry(void *payload,
+                             const void *name,
+                             void *opaque)
+{
+    virReplyCacheEntryPtr entry = payload;
+    struct virReplyCacheFirstExpiryData *data = opaque;
+
+    if (!data->key || entry->expiry < data->expiry) {
+        data->key = name;
+        data->expiry = entry->expiry;
+    }
+
+    return 0;
+}
+
+
+/**
+ * virReplyCacheStore:
+ * @cache: the cache
+ * @key: key of the reply
+ * @value: the reply
+ *
+ * Caches a copy of @value under @key, replacing any reply cached under
+ * the same key.
+ */
+void
+virReplyCacheStore(virReplyCachePtr cache,
+                   const char *key,
+                   const char *value)
+{
+    virReplyCacheEntryPtr entry;
+    unsigned long long now;
+
+    if (virTimeMillisNow(&now) < 0) {
+        virResetLastError();
+        return;
+    }
+
+    if (!virHashHasEntry(cache->entries, key) &&
+        (size_t) virHashSize(cache->entries) >= cache->maxEntries) {
+        struct virReplyCacheFirstExpiryData data = { NULL, 0 };
+
+        virHashForEach(cache->entries, virReplyCacheFindFirstExpiry, &data);
+        if (data.key) {
+            VIR_DEBUG("Evicting cached reply for '%s'", data.key);
+            virHashRemoveEntry(cache->entries, data.key);
+        }
+    }
+
+    entry = g_new0(virReplyCacheEntry, 1);
+    entry->value = g_strdup(value);
+    entry->expiry = now + cache->ttl;
+
+    if (virHashUpdateEntry(cache->entries, key, entry) < 0) {
+        virReplyCacheEntryFree(entry);
+        virResetLastError();
+    }
+}
+
+
+/**
+ * virReplyCacheInvalidate:
+ * @cache: the cache
+ *
+ * Drops all cached replies, for example because the state they were
+ * built from changed.
+ */
+void
+virReplyCacheInvalidate(virReplyCachePtr cache)
+{
+    VIR_DEBUG("Invalidating %zd cached replies",
+              virHashSize(cache->entries));
+    virHashRemoveAll(cache->entries);
+}
+
+
+size_t
+virReplyCacheSize(virReplyCachePtr cache)
+{
+    return virHashSize(cache->entries);
+}
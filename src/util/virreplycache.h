@@ -0,0 +1,49 @@
+/*
+ * virreplycache.h: cache of string replies expiring after a time
+ *
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include "internal.h"
+
+typedef struct _virReplyCache virReplyCache;
+typedef virReplyCache *virReplyCachePtr;
+
+virReplyCachePtr virReplyCacheNew(unsigned int ttl,
+                                  size_t maxEntries);
+
+void virReplyCacheFree(virReplyCachePtr cache);
+
+char *virReplyCacheLookup(virReplyCachePtr cache,
+                          const char *key)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+
+void virReplyCacheStore(virReplyCachePtr cache,
+                        const char *key,
+                        const char *value)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(3);
+
+void virReplyCacheInvalidate(virReplyCachePtr cache)
+    ATTRIBUTE_NONNULL(1);
+
+size_t virReplyCacheSize(virReplyCachePtr cache)
+    ATTRIBUTE_NONNULL(1);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(virReplyCache, virReplyCacheFree);
@@ -1361,6 +1361,31 @@ virResctrlAllocSetMemoryBandwidth(virResctrlAllocPtr alloc,
 }
 
 
+/* virResctrlAllocGetMemoryBandwidth
+ * @alloc: Pointer to an allocation
+ * @id: memory bandwidth controller id
+ * @memory_bandwidth: filled with the bandwidth limit in percent
+ *
+ * Returns 0 on success, -1 if no limit is defined for node @id.
+ */
+int
+virResctrlAllocGetMemoryBandwidth(virResctrlAllocPtr alloc,
+                                  unsigned int id,
+                                  unsigned int *memory_bandwidth)
+{
+    virResctrlAllocMemBWPtr mem_bw = alloc->mem_bw;
+
+    if (!mem_bw || id >= mem_bw->nbandwidths || !mem_bw->bandwidths[id]) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Memory Bandwidth not defined for node %u"), id);
+        return -1;
+    }
+
+    *memory_bandwidth = *(mem_bw->bandwidths[id]);
+    return 0;
+}
+
+
 /* virResctrlAllocForeachMemory
  * @alloc: Pointer to an active allocation
  * @cb: Callback function
@@ -2450,6 +2475,91 @@ virResctrlAllocCreate(virResctrlInfoPtr resctrl,
 }
 
 
+/*
+ * virResctrlAllocUpdateMemoryBandwidth:
+ * @resctrl: Host resctrl information
+ * @alloc: Pointer to an allocation created by virResctrlAllocCreate
+ * @id: memory bandwidth controller id
+ * @memory_bandwidth: new bandwidth limit in percent
+ *
+ * Change the memory bandwidth limit of an already defined node of a live
+ * allocation. The value is rounded down to the granularity of the host
+ * and clamped to the minimum it supports. Only the memory bandwidth line
+ * of the schemata is rewritten, cache masks are left untouched.
+ *
+ * Returns 0 on success, -1 on failure with error message set.
+ */
+int
+virResctrlAllocUpdateMemoryBandwidth(virResctrlInfoPtr resctrl,
+                                     virResctrlAllocPtr alloc,
+                                     unsigned int id,
+                                     unsigned int memory_bandwidth)
+{
+    virResctrlInfoMemBWPtr mem_bw_info = resctrl->membw_info;
+    virResctrlAllocMemBWPtr mem_bw = alloc->mem_bw;
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autofree char *alloc_str = NULL;
+    g_autofree char *schemata_path = NULL;
+    unsigned int old;
+    int lockfd = -1;
+    int ret = -1;
+
+    if (!mem_bw_info) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                       _("RDT Memory Bandwidth allocation unsupported"));
+        return -1;
+    }
+
+    if (!alloc->path || STREQ(alloc->path, SYSFS_RESCTRL_PATH)) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Resctrl allocation has not been created"));
+        return -1;
+    }
+
+    if (!mem_bw || id >= mem_bw->nbandwidths || !mem_bw->bandwidths[id]) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Memory Bandwidth not defined for node %u"), id);
+        return -1;
+    }
+
+    if (mem_bw_info->bandwidth_granularity)
+        memory_bandwidth -= memory_bandwidth % mem_bw_info->bandwidth_granularity;
+    memory_bandwidth = MAX(memory_bandwidth, mem_bw_info->min_bandwidth);
+    memory_bandwidth = MIN(memory_bandwidth, 100);
+
+    old = *(mem_bw->bandwidths[id]);
+    if (old == memory_bandwidth)
+        return 0;
+
+    lockfd = virResctrlLock();
+    if (lockfd < 0)
+        return -1;
+
+    *(mem_bw->bandwidths[id]) = memory_bandwidth;
+
+    if (virResctrlAllocMemoryBandwidthFormat(alloc, &buf) < 0) {
+        *(mem_bw->bandwidths[id]) = old;
+        goto cleanup;
+    }
+    alloc_str = virBufferContentAndReset(&buf);
+    schemata_path = g_strdup_printf("%s/schemata", alloc->path);
+
+    VIR_DEBUG("Writing resctrl schemata '%s' into '%s'", alloc_str, schemata_path);
+    if (virFileWriteStr(schemata_path, alloc_str, 0) < 0) {
+        virReportSystemError(errno,
+                             _("Cannot write into schemata file '%s'"),
+                             schemata_path);
+        *(mem_bw->bandwidths[id]) = old;
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virResctrlUnlock(lockfd);
+    return ret;
+}
+
+
 static int
 virResctrlAddPID(const char *path,
                  pid_t pid)
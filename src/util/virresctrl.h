@@ -150,6 +150,11 @@ virResctrlAllocSetMemoryBandwidth(virResctrlAllocPtr alloc,
                                   unsigned int id,
                                   unsigned int memory_bandwidth);
 
+int
+virResctrlAllocGetMemoryBandwidth(virResctrlAllocPtr alloc,
+                                  unsigned int id,
+                                  unsigned int *memory_bandwidth);
+
 int
 virResctrlAllocForeachMemory(virResctrlAllocPtr alloc,
                              virResctrlAllocForeachMemoryCallback cb,
@@ -173,6 +178,12 @@ virResctrlAllocCreate(virResctrlInfoPtr r_info,
                       virResctrlAllocPtr alloc,
                       const char *machinename);
 
+int
+virResctrlAllocUpdateMemoryBandwidth(virResctrlInfoPtr resctrl,
+                                     virResctrlAllocPtr alloc,
+                                     unsigned int id,
+                                     unsigned int memory_bandwidth);
+
 int
 virResctrlAllocAddPID(virResctrlAllocPtr alloc,
                       pid_t pid);
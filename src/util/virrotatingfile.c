@@ -24,13 +24,21 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#ifdef HAVE_SYS_IOCTL_H
+# include <sys/ioctl.h>
+#endif
+#if WITH_ZSTD
+# include <zstd.h>
+#endif
 
 #include "virrotatingfile.h"
 #include "viralloc.h"
 #include "virerror.h"
+#include "virendian.h"
 #include "virstring.h"
 #include "virfile.h"
 #include "virlog.h"
+#include "virthread.h"
 
 VIR_LOG_INIT("util.rotatingfile");
 
@@ -38,6 +46,21 @@ VIR_LOG_INIT("util.rotatingfile");
 
 #define VIR_MAX_MAX_BACKUP 32
 
+/* Largest amount of data moved from a pipe at once */
+#define VIR_ROTATING_FILE_CHUNK (64 * 1024)
+
+/*
+ * Backup files can be compressed with zstd, which renames them from
+ * 'path.N' to 'path.N.zst'. The compressed data is preceded by a zstd
+ * skippable frame holding the inode of the original file as 64 bit
+ * little endian integer, so that readers can still seek to positions
+ * obtained before the file was compressed.
+ */
+#define VIR_ROTATING_FILE_ZSTD_SUFFIX ".zst"
+#define VIR_ROTATING_FILE_ZSTD_LEVEL 3
+#define VIR_ROTATING_FILE_ZSTD_MAGIC 0x184D2A50
+#define VIR_ROTATING_FILE_ZSTD_HEADER 16
+
 typedef struct virRotatingFileWriterEntry virRotatingFileWriterEntry;
 typedef virRotatingFileWriterEntry *virRotatingFileWriterEntryPtr;
 
@@ -57,13 +80,40 @@ struct virRotatingFileWriter {
     size_t maxbackup;
     mode_t mode;
     size_t maxlen;
+    bool nosplice; /* splice() failed on this file */
+
+    /* Whether to compress backup files and the thread doing so */
+    bool compress;
+    bool compressing;
+    virThread compressThread;
+
+    /* Protected by virRotatingFileWriterListLock */
+    unsigned long long bytes;
+    unsigned long long writes;
+    unsigned long long spliced;
+    unsigned long long backlog;
+    unsigned long long backlogMax;
 };
 
+/* All writers, for reporting their statistics */
+static virMutex virRotatingFileWriterListLock = VIR_MUTEX_INITIALIZER;
+static virRotatingFileWriterPtr *virRotatingFileWriterList;
+static size_t virRotatingFileWriterListCount;
+
 
 struct virRotatingFileReaderEntry {
     char *path;
     int fd;
     off_t inode;
+
+    /* Set if the file is compressed, @path then includes the suffix */
+    bool compressed;
+#if WITH_ZSTD
+    ZSTD_DStream *dstream;
+    char *inbuf;
+    ZSTD_inBuffer in;
+    size_t skip; /* decompressed bytes to drop to reach the seek offset */
+#endif
 };
 
 struct virRotatingFileReader {
@@ -92,6 +142,10 @@ virRotatingFileReaderEntryFree(virRotatingFileReaderEntryPtr entry)
 
     VIR_FREE(entry->path);
     VIR_FORCE_CLOSE(entry->fd);
+#if WITH_ZSTD
+    ZSTD_freeDStream(entry->dstream);
+    g_free(entry->inbuf);
+#endif
     VIR_FREE(entry);
 }
 
@@ -108,7 +162,10 @@ virRotatingFileWriterEntryNew(const char *path,
     if (VIR_ALLOC(entry) < 0)
         return NULL;
 
-    if ((entry->fd = open(path, O_CREAT|O_APPEND|O_WRONLY|O_CLOEXEC, mode)) < 0) {
+    /* Not O_APPEND, which splice() refuses to write to. We are the only
+     * writer and start at the end of the file, so data is appended
+     * anyway. */
+    if ((entry->fd = open(path, O_CREAT|O_WRONLY|O_CLOEXEC, mode)) < 0) {
         virReportSystemError(errno,
                              _("Unable to open file: %s"), path);
         goto error;
@@ -140,6 +197,131 @@ virRotatingFileWriterEntryNew(const char *path,
 }
 
 
+#if WITH_ZSTD
+/*
+ * Opens the compressed variant of @entry if it exists, reading the inode
+ * of the original file from its header.
+ */
+static int
+virRotatingFileReaderEntryOpenCompressed(virRotatingFileReaderEntryPtr entry)
+{
+    g_autofree char *path = g_strdup_printf("%s%s", entry->path,
+                                            VIR_ROTATING_FILE_ZSTD_SUFFIX);
+    unsigned char header[VIR_ROTATING_FILE_ZSTD_HEADER];
+
+    if ((entry->fd = open(path, O_RDONLY|O_CLOEXEC)) < 0) {
+        if (errno == ENOENT)
+            return 0;
+        virReportSystemError(errno,
+                             _("Unable to open file: %s"), path);
+        return -1;
+    }
+
+    VIR_FREE(entry->path);
+    entry->path = g_steal_pointer(&path);
+    entry->compressed = true;
+
+    if (saferead(entry->fd, header, sizeof(header)) != sizeof(header) ||
+        virReadBufInt32LE(header) != VIR_ROTATING_FILE_ZSTD_MAGIC ||
+        virReadBufInt32LE(header + 4) != sizeof(header) - 8) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Missing header in compressed file %s"),
+                       entry->path);
+        return -1;
+    }
+
+    entry->inode = virReadBufInt64LE(header + 8);
+
+    if (!(entry->dstream = ZSTD_createDStream())) {
+        virReportOOMError();
+        return -1;
+    }
+    ZSTD_initDStream(entry->dstream);
+    entry->inbuf = g_new0(char, ZSTD_DStreamInSize());
+
+    return 0;
+}
+
+
+/*
+ * Like saferead(), but returns data decompressed from @entry.
+ */
+static ssize_t
+virRotatingFileReaderEntryReadCompressed(virRotatingFileReaderEntryPtr entry,
+                                         char *buf,
+                                         size_t len)
+{
+    while (1) {
+        ZSTD_outBuffer out = { buf, len, 0 };
+        size_t rc;
+        ssize_t got;
+
+        rc = ZSTD_decompressStream(entry->dstream, &out, &entry->in);
+        if (ZSTD_isError(rc)) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Unable to decompress file %s: %s"),
+                           entry->path, ZSTD_getErrorName(rc));
+            return -1;
+        }
+
+        if (out.pos > 0) {
+            size_t skip = MIN(entry->skip, out.pos);
+
+            if (skip) {
+                memmove(buf, buf + skip, out.pos - skip);
+                out.pos -= skip;
+                entry->skip -= skip;
+            }
+
+            if (out.pos > 0)
+                return out.pos;
+            continue;
+        }
+
+        if (entry->in.pos < entry->in.size)
+            continue;
+
+        if ((got = saferead(entry->fd, entry->inbuf,
+                            ZSTD_DStreamInSize())) <= 0)
+            return got;
+
+        entry->in.src = entry->inbuf;
+        entry->in.size = got;
+        entry->in.pos = 0;
+    }
+}
+#endif /* WITH_ZSTD */
+
+
+/*
+ * Positions @entry at @offset of its data, which for compressed files
+ * means decompressing from the start again and dropping data up to
+ * @offset while reading.
+ */
+static off_t
+virRotatingFileReaderEntrySeek(virRotatingFileReaderEntryPtr entry,
+                               off_t offset)
+{
+#if WITH_ZSTD
+    if (entry->compressed) {
+        off_t ret;
+
+        if ((ret = lseek(entry->fd, VIR_ROTATING_FILE_ZSTD_HEADER,
+                         SEEK_SET)) == (off_t)-1)
+            return ret;
+
+        ZSTD_initDStream(entry->dstream);
+        entry->in.size = 0;
+        entry->in.pos = 0;
+        entry->skip = offset;
+        return offset;
+    }
+#endif /* WITH_ZSTD */
+
+    return lseek(entry->fd, offset, SEEK_SET);
+}
+
+
 static virRotatingFileReaderEntryPtr
 virRotatingFileReaderEntryNew(const char *path)
 {
@@ -151,6 +333,8 @@ virRotatingFileReaderEntryNew(const char *path)
     if (VIR_ALLOC(entry) < 0)
         return NULL;
 
+    entry->path = g_strdup(path);
+
     if ((entry->fd = open(path, O_RDONLY|O_CLOEXEC)) < 0) {
         if (errno != ENOENT) {
             virReportSystemError(errno,
@@ -170,7 +354,11 @@ virRotatingFileReaderEntryNew(const char *path)
         entry->inode = sb.st_ino;
     }
 
-    entry->path = g_strdup(path);
+#if WITH_ZSTD
+    if (entry->fd == -1 &&
+        virRotatingFileReaderEntryOpenCompressed(entry) < 0)
+        goto error;
+#endif
 
     return entry;
 
@@ -206,6 +394,18 @@ virRotatingFileWriterDelete(virRotatingFileWriterPtr file)
             return -1;
         }
         VIR_FREE(oldpath);
+
+        oldpath = g_strdup_printf("%s.%zu%s", file->basepath, i,
+                                  VIR_ROTATING_FILE_ZSTD_SUFFIX);
+        if (unlink(oldpath) < 0 &&
+            errno != ENOENT) {
+            virReportSystemError(errno,
+                                 _("Unable to delete file %s"),
+                                 oldpath);
+            VIR_FREE(oldpath);
+            return -1;
+        }
+        VIR_FREE(oldpath);
     }
 
     return 0;
@@ -262,6 +462,12 @@ virRotatingFileWriterNew(const char *path,
                                                       mode)))
         goto error;
 
+    virMutexLock(&virRotatingFileWriterListLock);
+    ignore_value(VIR_APPEND_ELEMENT_COPY(virRotatingFileWriterList,
+                                         virRotatingFileWriterListCount,
+                                         file));
+    virMutexUnlock(&virRotatingFileWriterListLock);
+
     return file;
 
  error:
@@ -362,6 +568,329 @@ virRotatingFileWriterGetOffset(virRotatingFileWriterPtr file)
 }
 
 
+/**
+ * virRotatingFileWriterSetCompress:
+ * @file: the file context
+ * @compress: whether to compress backup files
+ *
+ * Makes the rollover compress the newest backup file with zstd
+ * in a separate thread, renaming it to carry the '.zst' suffix.
+ * virRotatingFileReader reads compressed files transparently.
+ *
+ * Returns 0 on success, -1 if compression is not supported
+ */
+int
+virRotatingFileWriterSetCompress(virRotatingFileWriterPtr file,
+                                 bool compress)
+{
+#if WITH_ZSTD
+    file->compress = compress;
+    return 0;
+#else /* !WITH_ZSTD */
+    if (!compress)
+        return 0;
+
+    virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                   _("compression of log files is not supported by this build"));
+    return -1;
+#endif /* !WITH_ZSTD */
+}
+
+
+static void
+virRotatingFileWriterAccount(virRotatingFileWriterPtr file,
+                             size_t bytes,
+                             size_t writes,
+                             size_t spliced)
+{
+    virMutexLock(&virRotatingFileWriterListLock);
+    file->bytes += bytes;
+    file->writes += writes;
+    file->spliced += spliced;
+    virMutexUnlock(&virRotatingFileWriterListLock);
+}
+
+
+/**
+ * virRotatingFileWriterGetStats:
+ * @stats: filled with the statistics, one entry per file
+ *
+ * Reports how much data was written to each file currently open
+ * for writing, and how much was waiting to be appended from a pipe
+ * by virRotatingFileWriterAppendFD. The caller has to free @stats
+ * using virRotatingFileWriterStatsFree.
+ *
+ * Returns the number of entries in @stats
+ */
+size_t
+virRotatingFileWriterGetStats(virRotatingFileWriterStatsPtr *stats)
+{
+    size_t nstats;
+    size_t i;
+
+    virMutexLock(&virRotatingFileWriterListLock);
+
+    nstats = virRotatingFileWriterListCount;
+    *stats = g_new0(virRotatingFileWriterStats, nstats);
+
+    for (i = 0; i < nstats; i++) {
+        virRotatingFileWriterPtr file = virRotatingFileWriterList[i];
+        virRotatingFileWriterStatsPtr entry = &(*stats)[i];
+
+        entry->path = g_strdup(file->basepath);
+        entry->bytes = file->bytes;
+        entry->writes = file->writes;
+        entry->spliced = file->spliced;
+        entry->backlog = file->backlog;
+        entry->backlogMax = file->backlogMax;
+    }
+
+    virMutexUnlock(&virRotatingFileWriterListLock);
+
+    return nstats;
+}
+
+
+void
+virRotatingFileWriterStatsFree(virRotatingFileWriterStatsPtr stats,
+                               size_t nstats)
+{
+    size_t i;
+
+    if (!stats)
+        return;
+
+    for (i = 0; i < nstats; i++)
+        g_free(stats[i].path);
+    g_free(stats);
+}
+
+
+/*
+ * Renames backup file @from to @to, along with its compressed variant.
+ * Whichever variant of @to is not replaced would be stale, so it gets
+ * removed.
+ */
+static int
+virRotatingFileWriterRename(const char *from,
+                            const char *to)
+{
+    g_autofree char *zfrom = g_strdup_printf("%s%s", from,
+                                             VIR_ROTATING_FILE_ZSTD_SUFFIX);
+    g_autofree char *zto = g_strdup_printf("%s%s", to,
+                                           VIR_ROTATING_FILE_ZSTD_SUFFIX);
+    bool plain = true;
+    bool compressed = true;
+
+    if (rename(from, to) < 0) {
+        if (errno != ENOENT) {
+            virReportSystemError(errno,
+                                 _("Unable to rename %s to %s"),
+                                 from, to);
+            return -1;
+        }
+        plain = false;
+    }
+
+    if (rename(zfrom, zto) < 0) {
+        if (errno != ENOENT) {
+            virReportSystemError(errno,
+                                 _("Unable to rename %s to %s"),
+                                 zfrom, zto);
+            return -1;
+        }
+        compressed = false;
+    }
+
+    if (plain && !compressed)
+        unlink(zto);
+    else if (compressed && !plain)
+        unlink(to);
+
+    return 0;
+}
+
+
+#if WITH_ZSTD
+/*
+ * Compresses @path into 'path.zst' and removes it.
+ */
+static int
+virRotatingFileCompress(const char *path)
+{
+    g_autofree char *zpath = g_strdup_printf("%s%s", path,
+                                             VIR_ROTATING_FILE_ZSTD_SUFFIX);
+    g_autofree char *tmppath = g_strdup_printf("%s.tmp", zpath);
+    g_autofree char *inbuf = g_new0(char, ZSTD_CStreamInSize());
+    g_autofree char *outbuf = g_new0(char, ZSTD_CStreamOutSize());
+    unsigned char header[VIR_ROTATING_FILE_ZSTD_HEADER];
+    unsigned long long inode;
+    ZSTD_CStream *cstream = NULL;
+    VIR_AUTOCLOSE infd = -1;
+    int outfd = -1;
+    struct stat sb;
+    size_t i;
+    int ret = -1;
+
+    if ((infd = open(path, O_RDONLY|O_CLOEXEC)) < 0 ||
+        fstat(infd, &sb) < 0) {
+        virReportSystemError(errno, _("Unable to open file: %s"), path);
+        return -1;
+    }
+
+    if ((outfd = open(tmppath, O_CREAT|O_TRUNC|O_WRONLY|O_CLOEXEC,
+                      sb.st_mode & 0777)) < 0) {
+        virReportSystemError(errno, _("Unable to open file: %s"), tmppath);
+        return -1;
+    }
+
+    /* Skippable frame with the inode of @path */
+    inode = sb.st_ino;
+    header[0] = VIR_ROTATING_FILE_ZSTD_MAGIC & 0xff;
+    header[1] = (VIR_ROTATING_FILE_ZSTD_MAGIC >> 8) & 0xff;
+    header[2] = (VIR_ROTATING_FILE_ZSTD_MAGIC >> 16) & 0xff;
+    header[3] = (VIR_ROTATING_FILE_ZSTD_MAGIC >> 24) & 0xff;
+    header[4] = sizeof(header) - 8;
+    header[5] = header[6] = header[7] = 0;
+    for (i = 0; i < 8; i++)
+        header[8 + i] = (inode >> (i * 8)) & 0xff;
+
+    if (safewrite(outfd, header, sizeof(header)) < 0) {
+        virReportSystemError(errno, _("Unable to write to file %s"), tmppath);
+        goto cleanup;
+    }
+
+    if (!(cstream = ZSTD_createCStream())) {
+        virReportOOMError();
+        goto cleanup;
+    }
+    ZSTD_initCStream(cstream, VIR_ROTATING_FILE_ZSTD_LEVEL);
+
+    while (1) {
+        ZSTD_inBuffer in = { inbuf, 0, 0 };
+        ssize_t got;
+        size_t rc;
+
+        if ((got = saferead(infd, inbuf, ZSTD_CStreamInSize())) < 0) {
+            virReportSystemError(errno, _("Unable to read from file %s"), path);
+            goto cleanup;
+        }
+        in.size = got;
+
+        do {
+            ZSTD_outBuffer out = { outbuf, ZSTD_CStreamOutSize(), 0 };
+
+            if (got == 0)
+                rc = ZSTD_endStream(cstream, &out);
+            else
+                rc = ZSTD_compressStream(cstream, &out, &in);
+
+            if (ZSTD_isError(rc)) {
+                virReportError(VIR_ERR_INTERNAL_ERROR,
+                               _("Unable to compress file %s: %s"),
+                               path, ZSTD_getErrorName(rc));
+                goto cleanup;
+            }
+
+            if (safewrite(outfd, outbuf, out.pos) < 0) {
+                virReportSystemError(errno,
+                                     _("Unable to write to file %s"),
+                                     tmppath);
+                goto cleanup;
+            }
+        } while (got == 0 ? rc != 0 : in.pos < in.size);
+
+        if (got == 0)
+            break;
+    }
+
+    if (VIR_CLOSE(outfd) < 0) {
+        virReportSystemError(errno, _("Unable to close file %s"), tmppath);
+        goto cleanup;
+    }
+
+    if (rename(tmppath, zpath) < 0) {
+        virReportSystemError(errno,
+                             _("Unable to rename %s to %s"),
+                             tmppath, zpath);
+        goto cleanup;
+    }
+
+    if (unlink(path) < 0) {
+        virReportSystemError(errno, _("Unable to delete file %s"), path);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (outfd != -1) {
+        VIR_FORCE_CLOSE(outfd);
+        unlink(tmppath);
+    }
+    ZSTD_freeCStream(cstream);
+    return ret;
+}
+
+
+static void
+virRotatingFileWriterCompressWorker(void *opaque)
+{
+    g_autofree char *path = opaque;
+
+    VIR_DEBUG("Compressing %s", path);
+
+    if (virRotatingFileCompress(path) < 0)
+        VIR_WARN("Unable to compress %s: %s", path, virGetLastErrorMessage());
+}
+
+
+/*
+ * Starts compressing the newest backup file once it was rolled over.
+ * A failure leaves the backup uncompressed, which readers cope with.
+ */
+static void
+virRotatingFileWriterCompressStart(virRotatingFileWriterPtr file)
+{
+    char *path;
+
+    if (!file->compress || file->maxbackup == 0)
+        return;
+
+    path = g_strdup_printf("%s.0", file->basepath);
+    if (virThreadCreateFull(&file->compressThread, true,
+                            virRotatingFileWriterCompressWorker,
+                            "rotfile-zstd", false, path) < 0) {
+        VIR_WARN("Unable to start thread compressing %s", path);
+        g_free(path);
+        return;
+    }
+
+    file->compressing = true;
+}
+#else /* !WITH_ZSTD */
+static void
+virRotatingFileWriterCompressStart(virRotatingFileWriterPtr file G_GNUC_UNUSED)
+{
+}
+#endif /* !WITH_ZSTD */
+
+
+/*
+ * Waits for compression of a backup file to finish, which has to
+ * happen before backups are renamed again.
+ */
+static void
+virRotatingFileWriterCompressWait(virRotatingFileWriterPtr file)
+{
+    if (!file->compressing)
+        return;
+
+    virThreadJoin(&file->compressThread);
+    file->compressing = false;
+}
+
+
 static int
 virRotatingFileWriterRollover(virRotatingFileWriterPtr file)
 {
@@ -390,13 +919,8 @@ virRotatingFileWriterRollover(virRotatingFileWriterPtr file)
             }
             VIR_DEBUG("Rollover %s -> %s", thispath, nextpath);
 
-            if (rename(thispath, nextpath) < 0 &&
-                errno != ENOENT) {
-                virReportSystemError(errno,
-                                     _("Unable to rename %s to %s"),
-                                     thispath, nextpath);
+            if (virRotatingFileWriterRename(thispath, nextpath) < 0)
                 goto cleanup;
-            }
 
             VIR_FREE(nextpath);
             nextpath = g_steal_pointer(&thispath);
@@ -430,6 +954,7 @@ virRotatingFileWriterAppend(virRotatingFileWriterPtr file,
                             size_t len)
 {
     ssize_t ret = 0;
+    size_t writes = 0;
     size_t i;
     while (len) {
         size_t towrite = len;
@@ -465,6 +990,7 @@ virRotatingFileWriterAppend(virRotatingFileWriterPtr file,
                                      file->basepath);
                 return -1;
             }
+            writes++;
 
             len -= towrite;
             buf += towrite;
@@ -479,6 +1005,8 @@ virRotatingFileWriterAppend(virRotatingFileWriterPtr file,
             VIR_DEBUG("Hit max size %zu on %s (force=%d)",
                       file->maxlen, file->basepath, forceRollover);
 
+            virRotatingFileWriterCompressWait(file);
+
             if (virRotatingFileWriterRollover(file) < 0)
                 return -1;
 
@@ -488,13 +1016,101 @@ virRotatingFileWriterAppend(virRotatingFileWriterPtr file,
 
             virRotatingFileWriterEntryFree(file->entry);
             file->entry = tmp;
+
+            virRotatingFileWriterCompressStart(file);
         }
     }
 
+    virRotatingFileWriterAccount(file, ret, writes, 0);
+
     return ret;
 }
 
 
+/**
+ * virRotatingFileWriterAppendFD:
+ * @file: the file context
+ * @fd: the pipe to read data from
+ *
+ * Append data available on @fd to the file, like
+ * virRotatingFileWriterAppend does. As long as the data can't
+ * reach the size limit of the current file it is moved by splice()
+ * without copying it through a buffer, otherwise it is read in
+ * chunks as large as possible and appended.
+ *
+ * Returns the number of bytes appended, 0 if @fd reached EOF or
+ * has no data available, or -1 on error
+ */
+ssize_t
+virRotatingFileWriterAppendFD(virRotatingFileWriterPtr file,
+                              int fd)
+{
+    g_autofree char *buf = NULL;
+    ssize_t got;
+#ifdef FIONREAD
+    int avail;
+
+    if (ioctl(fd, FIONREAD, &avail) == 0 && avail >= 0) {
+        virMutexLock(&virRotatingFileWriterListLock);
+        file->backlog = avail;
+        file->backlogMax = MAX(file->backlogMax, file->backlog);
+        virMutexUnlock(&virRotatingFileWriterListLock);
+    }
+#endif /* FIONREAD */
+
+#ifdef HAVE_SPLICE
+    /* The rollover has to happen at a line break if possible,
+     * which requires looking at the data */
+    if (!file->nosplice &&
+        file->entry->pos + VIR_ROTATING_FILE_CHUNK <= file->maxlen) {
+        do {
+            got = splice(fd, NULL, file->entry->fd, NULL,
+                         VIR_ROTATING_FILE_CHUNK,
+                         SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        } while (got < 0 && errno == EINTR);
+
+        if (got >= 0) {
+            file->entry->pos += got;
+            file->entry->len += got;
+            virRotatingFileWriterAccount(file, got, 1, got);
+            return got;
+        }
+
+        if (errno == EAGAIN)
+            return 0;
+
+        /* Not supported for this file or pipe, copy the data instead */
+        VIR_DEBUG("Unable to splice data to %s: %s",
+                  file->basepath, g_strerror(errno));
+        file->nosplice = true;
+    }
+#endif /* HAVE_SPLICE */
+
+    buf = g_new0(char, VIR_ROTATING_FILE_CHUNK);
+
+    do {
+        got = read(fd, buf, VIR_ROTATING_FILE_CHUNK);
+    } while (got < 0 && errno == EINTR);
+
+    if (got < 0) {
+        if (errno == EAGAIN)
+            return 0;
+        virReportSystemError(errno,
+                             _("Unable to read data for file %s"),
+                             file->basepath);
+        return -1;
+    }
+
+    if (got == 0)
+        return 0;
+
+    if (virRotatingFileWriterAppend(file, buf, got) != got)
+        return -1;
+
+    return got;
+}
+
+
 /**
  * virRotatingFileReaderSeek
  * @file: the file context
@@ -521,7 +1137,7 @@ virRotatingFileReaderSeek(virRotatingFileReaderPtr file,
             entry->fd == -1)
             continue;
 
-        ret = lseek(entry->fd, offset, SEEK_SET);
+        ret = virRotatingFileReaderEntrySeek(entry, offset);
         if (ret == (off_t)-1) {
             virReportSystemError(errno,
                                  _("Unable to seek to inode %llu offset %llu"),
@@ -534,7 +1150,7 @@ virRotatingFileReaderSeek(virRotatingFileReaderPtr file,
     }
 
     file->current = 0;
-    ret = lseek(file->entries[0]->fd, offset, SEEK_SET);
+    ret = virRotatingFileReaderEntrySeek(file->entries[0], offset);
     if (ret == (off_t)-1) {
         virReportSystemError(errno,
                              _("Unable to seek to inode %llu offset %llu"),
@@ -577,7 +1193,12 @@ virRotatingFileReaderConsume(virRotatingFileReaderPtr file,
             continue;
         }
 
-        got = saferead(entry->fd, buf + ret, len);
+#if WITH_ZSTD
+        if (entry->compressed)
+            got = virRotatingFileReaderEntryReadCompressed(entry, buf + ret, len);
+        else
+#endif /* WITH_ZSTD */
+            got = saferead(entry->fd, buf + ret, len);
         if (got < 0) {
             virReportSystemError(errno,
                                  _("Unable to read from file %s"),
@@ -607,9 +1228,23 @@ virRotatingFileReaderConsume(virRotatingFileReaderPtr file,
 void
 virRotatingFileWriterFree(virRotatingFileWriterPtr file)
 {
+    size_t i;
+
     if (!file)
         return;
 
+    virMutexLock(&virRotatingFileWriterListLock);
+    for (i = 0; i < virRotatingFileWriterListCount; i++) {
+        if (virRotatingFileWriterList[i] == file) {
+            VIR_DELETE_ELEMENT(virRotatingFileWriterList, i,
+                               virRotatingFileWriterListCount);
+            break;
+        }
+    }
+    virMutexUnlock(&virRotatingFileWriterListLock);
+
+    virRotatingFileWriterCompressWait(file);
+
     virRotatingFileWriterEntryFree(file->entry);
     VIR_FREE(file->basepath);
     VIR_FREE(file);
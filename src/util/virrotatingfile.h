@@ -43,9 +43,30 @@ const char *virRotatingFileWriterGetPath(virRotatingFileWriterPtr file);
 ino_t virRotatingFileWriterGetINode(virRotatingFileWriterPtr file);
 off_t virRotatingFileWriterGetOffset(virRotatingFileWriterPtr file);
 
+int virRotatingFileWriterSetCompress(virRotatingFileWriterPtr file,
+                                     bool compress);
+
 ssize_t virRotatingFileWriterAppend(virRotatingFileWriterPtr file,
                                     const char *buf,
                                     size_t len);
+ssize_t virRotatingFileWriterAppendFD(virRotatingFileWriterPtr file,
+                                      int fd);
+
+typedef struct _virRotatingFileWriterStats virRotatingFileWriterStats;
+typedef virRotatingFileWriterStats *virRotatingFileWriterStatsPtr;
+struct _virRotatingFileWriterStats {
+    char *path;
+    unsigned long long bytes;       /* written in total */
+    unsigned long long writes;      /* write or splice calls */
+    unsigned long long spliced;     /* bytes moved without copying */
+    unsigned long long backlog;     /* bytes waiting in the pipe last time */
+    unsigned long long backlogMax;  /* largest backlog seen */
+};
+
+size_t virRotatingFileWriterGetStats(virRotatingFileWriterStatsPtr *stats)
+    ATTRIBUTE_NONNULL(1);
+void virRotatingFileWriterStatsFree(virRotatingFileWriterStatsPtr stats,
+                                    size_t nstats);
 
 int virRotatingFileReaderSeek(virRotatingFileReaderPtr file,
                               ino_t inode,
@@ -193,3 +193,63 @@ virSecretGetSecretString(virConnectPtr conn,
     virObjectUnref(sec);
     return ret;
 }
+
+
+void
+virSecretValueLookupClear(virSecretValueLookupPtr lookup)
+{
+    VIR_DISPOSE_N(lookup->value, lookup->value_size);
+    virSecretLookupDefClear(&lookup->def);
+}
+
+
+/* virSecretGetSecretStrings:
+ * @conn: Pointer to the connection driver to make secret driver call
+ * @lookups: secrets to look up
+ * @nlookups: number of items in @lookups
+ *
+ * Same as virSecretGetSecretString, except that values of all the secrets
+ * described by @lookups are fetched at once. If the secret driver supports
+ * it, that's a single driver call and thus a single RPC call with split
+ * daemons. Otherwise the secrets are looked up one by one.
+ *
+ * Returns 0 on success, -1 on failure. On success value of every item of
+ * @lookups is filled in and needs to be cleared by virSecretValueLookupClear
+ * after usage. On failure none of the values is filled in.
+ */
+int
+virSecretGetSecretStrings(virConnectPtr conn,
+                          virSecretValueLookupPtr lookups,
+                          size_t nlookups)
+{
+    size_t i;
+
+    if (nlookups == 0)
+        return 0;
+
+    if (conn->secretDriver->connectSecretGetValues) {
+        if (conn->secretDriver->connectSecretGetValues(conn, lookups, nlookups, 0,
+                                                       VIR_SECRET_GET_VALUE_INTERNAL_CALL) == 0)
+            return 0;
+
+        if (virGetLastErrorCode() != VIR_ERR_NO_SUPPORT)
+            return -1;
+
+        VIR_DEBUG("bulk secret lookup not supported, falling back to one by one");
+        virResetLastError();
+    }
+
+    for (i = 0; i < nlookups; i++) {
+        if (virSecretGetSecretString(conn, &lookups[i].def, lookups[i].usageType,
+                                     &lookups[i].value,
+                                     &lookups[i].value_size) < 0)
+            goto error;
+    }
+
+    return 0;
+
+ error:
+    for (i = 0; i < nlookups; i++)
+        VIR_DISPOSE_N(lookups[i].value, lookups[i].value_size);
+    return -1;
+}
@@ -63,3 +63,21 @@ int virSecretGetSecretString(virConnectPtr conn,
                              size_t *ret_secret_size)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(4)
     ATTRIBUTE_NONNULL(5) G_GNUC_WARN_UNUSED_RESULT;
+
+typedef struct _virSecretValueLookup virSecretValueLookup;
+typedef virSecretValueLookup *virSecretValueLookupPtr;
+struct _virSecretValueLookup {
+    virSecretLookupTypeDef def;
+    virSecretUsageType usageType; /* expected usage of the secret */
+
+    /* filled in by the lookup */
+    uint8_t *value;
+    size_t value_size;
+};
+
+void virSecretValueLookupClear(virSecretValueLookupPtr lookup);
+
+int virSecretGetSecretStrings(virConnectPtr conn,
+                              virSecretValueLookupPtr lookups,
+                              size_t nlookups)
+    ATTRIBUTE_NONNULL(1) G_GNUC_WARN_UNUSED_RESULT;
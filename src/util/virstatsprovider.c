@@ -0,0 +1,132 @@
+/*
+ * virstatsprovider.c: registry of statistics reported by drivers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include "virstatsprovider.h"
+#include "viralloc.h"
+#include "virlog.h"
+#include "virthread.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("util.statsprovider");
+
+/*
+ * Drivers loaded into a daemon keep counters the daemon itself knows
+ * nothing about, e.g. how long QEMU monitor commands take. They
+ * register a callback here which adds the counters to a typed
+ * parameter list, so that management APIs of the daemon can report
+ * them without depending on the driver.
+ */
+typedef struct _virStatsProvider virStatsProvider;
+struct _virStatsProvider {
+    char *name;
+    virStatsProviderFunc func;
+    void *opaque;
+};
+
+static virMutex virStatsProviderLock = VIR_MUTEX_INITIALIZER;
+static virStatsProvider *virStatsProviders;
+static size_t virStatsProviderCount;
+
+
+/**
+ * virStatsProviderRegister:
+ * @name: name of the provider, typically the driver name
+ * @func: callback reporting the statistics
+ * @opaque: data passed to @func
+ *
+ * Registers @func to be called by virStatsProviderCollect. A provider
+ * registered under the same @name before is replaced.
+ */
+void
+virStatsProviderRegister(const char *name,
+                         virStatsProviderFunc func,
+                         void *opaque)
+{
+    virStatsProvider provider = { g_strdup(name), func, opaque };
+
+    VIR_DEBUG("name=%s", name);
+
+    virStatsProviderUnregister(name);
+
+    virMutexLock(&virStatsProviderLock);
+    ignore_value(VIR_APPEND_ELEMENT(virStatsProviders,
+                                    virStatsProviderCount, provider));
+    virMutexUnlock(&virStatsProviderLock);
+}
+
+
+/**
+ * virStatsProviderUnregister:
+ * @name: name of the provider
+ *
+ * Removes the provider registered under @name, if any. Once this
+ * returns, its callback is not running and won't be called again.
+ */
+void
+virStatsProviderUnregister(const char *name)
+{
+    size_t i;
+
+    virMutexLock(&virStatsProviderLock);
+    for (i = 0; i < virStatsProviderCount; i++) {
+        if (STREQ(virStatsProviders[i].name, name)) {
+            g_free(virStatsProviders[i].name);
+            VIR_DELETE_ELEMENT(virStatsProviders, i, virStatsProviderCount);
+            break;
+        }
+    }
+    virMutexUnlock(&virStatsProviderLock);
+}
+
+
+/**
+ * virStatsProviderCollect:
+ * @params: list to add the statistics to
+ * @prefix: prefix of all the parameters added
+ *
+ * Calls every registered provider. The parameters of a provider are
+ * named "@prefix<name>.", followed by whatever the provider chooses.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virStatsProviderCollect(virTypedParamListPtr params,
+                        const char *prefix)
+{
+    size_t i;
+    int ret = -1;
+
+    virMutexLock(&virStatsProviderLock);
+    for (i = 0; i < virStatsProviderCount; i++) {
+        virStatsProvider *provider = &virStatsProviders[i];
+        g_autofree char *name = g_strdup_printf("%s%s.", prefix, provider->name);
+
+        if (provider->func(params, name, provider->opaque) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&virStatsProviderLock);
+    return ret;
+}
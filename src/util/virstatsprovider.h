@@ -0,0 +1,47 @@
+/*
+ * virstatsprovider.h: registry of statistics reported by drivers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include "internal.h"
+#include "virtypedparam.h"
+
+/**
+ * virStatsProviderFunc:
+ * @params: list to add the statistics to
+ * @prefix: prefix of the name of every parameter added
+ * @opaque: data passed to virStatsProviderRegister
+ *
+ * Returns 0 on success, -1 on error.
+ */
+typedef int (*virStatsProviderFunc)(virTypedParamListPtr params,
+                                    const char *prefix,
+                                    void *opaque);
+
+void virStatsProviderRegister(const char *name,
+                              virStatsProviderFunc func,
+                              void *opaque)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+
+void virStatsProviderUnregister(const char *name)
+    ATTRIBUTE_NONNULL(1);
+
+int virStatsProviderCollect(virTypedParamListPtr params,
+                            const char *prefix)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
@@ -34,6 +34,7 @@
 #include "virhash.h"
 #include "virendian.h"
 #include "virstring.h"
+#include "virstringintern.h"
 #include "viruri.h"
 #include "virbuffer.h"
 #include "virjson.h"
@@ -2308,7 +2309,7 @@ virStorageSourcePoolDefCopy(const virStorageSourcePoolDef *src)
     ret->actualtype = src->actualtype;
     ret->mode = src->mode;
 
-    ret->pool = g_strdup(src->pool);
+    ret->pool = virStringIntern(src->pool);
     ret->volume = g_strdup(src->volume);
 
     return ret;
@@ -2545,7 +2546,7 @@ virStorageSourcePoolDefFree(virStorageSourcePoolDefPtr def)
     if (!def)
         return;
 
-    VIR_FREE(def->pool);
+    virStringInternRelease(def->pool);
     VIR_FREE(def->volume);
 
     VIR_FREE(def);
@@ -2720,6 +2721,10 @@ virStorageSourceOnceInit(void)
     if (!VIR_CLASS_NEW(virStorageSource, virClassForObject()))
         return -1;
 
+    /* Storage sources are copied and freed often while handling
+     * backing chains and block jobs */
+    virClassEnablePool(virStorageSourceClass, 128);
+
     return 0;
 }
 
@@ -5178,6 +5183,190 @@ virStorageFileReportBrokenChain(int errcode,
 }
 
 
+/*
+ * Image headers read while probing backing chains are cached daemon-wide,
+ * keyed by the unique identifier of the image. An entry is used only
+ * while the file is unchanged, i.e. the identity, size and timestamps
+ * reported by stat() are the same, which allows many domains sharing a
+ * base image to be started without re-reading it every time. Only
+ * regular files are cached as block devices don't update timestamps when
+ * written to.
+ */
+#define VIR_STORAGE_FILE_HEADER_CACHE_MAX 1024
+
+/* Files modified recently are not cached as filesystems with coarse
+ * timestamps could hide another modification within the same tick */
+#define VIR_STORAGE_FILE_HEADER_CACHE_SETTLE 2
+
+typedef struct _virStorageFileHeaderCacheEntry virStorageFileHeaderCacheEntry;
+typedef virStorageFileHeaderCacheEntry *virStorageFileHeaderCacheEntryPtr;
+struct _virStorageFileHeaderCacheEntry {
+    char *path; /* path of the source the entry was filled from */
+    uid_t uid;
+    gid_t gid;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    struct timespec ctime;
+
+    char *buf;
+    size_t len;
+};
+
+static virMutex virStorageFileHeaderCacheLock = VIR_MUTEX_INITIALIZER;
+static virHashTablePtr virStorageFileHeaderCache;
+
+
+static void
+virStorageFileHeaderCacheEntryFree(void *opaque)
+{
+    virStorageFileHeaderCacheEntryPtr entry = opaque;
+
+    if (!entry)
+        return;
+
+    g_free(entry->path);
+    g_free(entry->buf);
+    g_free(entry);
+}
+
+
+static void
+virStorageFileHeaderCacheStamp(virStorageFileHeaderCacheEntryPtr entry,
+                               const struct stat *sb,
+                               uid_t uid,
+                               gid_t gid)
+{
+    entry->uid = uid;
+    entry->gid = gid;
+    entry->dev = sb->st_dev;
+    entry->ino = sb->st_ino;
+    entry->size = sb->st_size;
+#ifdef __APPLE__
+    entry->mtime = sb->st_mtimespec;
+    entry->ctime = sb->st_ctimespec;
+#else /* ! __APPLE__ */
+    entry->mtime = sb->st_mtim;
+    entry->ctime = sb->st_ctim;
+#endif /* ! __APPLE__ */
+}
+
+
+static bool
+virStorageFileHeaderCacheStampEqual(const virStorageFileHeaderCacheEntry *a,
+                                    const virStorageFileHeaderCacheEntry *b)
+{
+    return a->uid == b->uid &&
+           a->gid == b->gid &&
+           a->dev == b->dev &&
+           a->ino == b->ino &&
+           a->size == b->size &&
+           a->mtime.tv_sec == b->mtime.tv_sec &&
+           a->mtime.tv_nsec == b->mtime.tv_nsec &&
+           a->ctime.tv_sec == b->ctime.tv_sec &&
+           a->ctime.tv_nsec == b->ctime.tv_nsec;
+}
+
+
+/* Returns true and fills @buf and @len if @name has a valid entry */
+static bool
+virStorageFileHeaderCacheLookup(const char *name,
+                                const virStorageFileHeaderCacheEntry *stamp,
+                                char **buf,
+                                size_t *len)
+{
+    virStorageFileHeaderCacheEntryPtr entry;
+    bool found = false;
+
+    virMutexLock(&virStorageFileHeaderCacheLock);
+    if (virStorageFileHeaderCache &&
+        (entry = virHashLookup(virStorageFileHeaderCache, name)) &&
+        virStorageFileHeaderCacheStampEqual(entry, stamp)) {
+        *buf = g_memdup(entry->buf, entry->len);
+        *len = entry->len;
+        found = true;
+    }
+    virMutexUnlock(&virStorageFileHeaderCacheLock);
+
+    return found;
+}
+
+
+static void
+virStorageFileHeaderCacheStore(const char *name,
+                               const char *path,
+                               const virStorageFileHeaderCacheEntry *stamp,
+                               const char *buf,
+                               size_t len)
+{
+    virStorageFileHeaderCacheEntryPtr entry;
+    time_t now = time(NULL);
+
+    if (now - stamp->mtime.tv_sec < VIR_STORAGE_FILE_HEADER_CACHE_SETTLE ||
+        now - stamp->ctime.tv_sec < VIR_STORAGE_FILE_HEADER_CACHE_SETTLE)
+        return;
+
+    entry = g_new0(virStorageFileHeaderCacheEntry, 1);
+    *entry = *stamp;
+    entry->path = g_strdup(path);
+    entry->buf = g_memdup(buf, len);
+    entry->len = len;
+
+    virMutexLock(&virStorageFileHeaderCacheLock);
+    if (!virStorageFileHeaderCache)
+        virStorageFileHeaderCache = virHashNew(virStorageFileHeaderCacheEntryFree);
+
+    /* Starting over is good enough, the working set of base images
+     * is much smaller than the limit */
+    if (virHashSize(virStorageFileHeaderCache) >= VIR_STORAGE_FILE_HEADER_CACHE_MAX)
+        virHashRemoveAll(virStorageFileHeaderCache);
+
+    if (virHashUpdateEntry(virStorageFileHeaderCache, name, entry) < 0) {
+        virStorageFileHeaderCacheEntryFree(entry);
+        virResetLastError();
+    }
+    virMutexUnlock(&virStorageFileHeaderCacheLock);
+}
+
+
+static int
+virStorageFileHeaderCacheMatchPath(const void *payload,
+                                   const void *name G_GNUC_UNUSED,
+                                   const void *opaque)
+{
+    const virStorageFileHeaderCacheEntry *entry = payload;
+
+    return STREQ_NULLABLE(entry->path, opaque);
+}
+
+
+/**
+ * virStorageFileHeaderCacheInvalidate:
+ * @src: top of a backing chain
+ *
+ * Drops the cached headers of all images in the backing chain of @src.
+ * Needs to be called when the images may have been modified without
+ * their timestamps being updated, e.g. by a block job.
+ */
+void
+virStorageFileHeaderCacheInvalidate(virStorageSourcePtr src)
+{
+    virStorageSourcePtr n;
+
+    virMutexLock(&virStorageFileHeaderCacheLock);
+    if (virStorageFileHeaderCache) {
+        for (n = src; virStorageSourceIsBacking(n); n = n->backingStore) {
+            if (n->path)
+                virHashRemoveSet(virStorageFileHeaderCache,
+                                 virStorageFileHeaderCacheMatchPath,
+                                 n->path);
+        }
+    }
+    virMutexUnlock(&virStorageFileHeaderCacheLock);
+}
+
+
 static int
 virStorageFileGetMetadataRecurseReadHeader(virStorageSourcePtr src,
                                            virStorageSourcePtr parent,
@@ -5189,6 +5378,9 @@ virStorageFileGetMetadataRecurseReadHeader(virStorageSourcePtr src,
 {
     int ret = -1;
     const char *uniqueName;
+    virStorageFileHeaderCacheEntry stamp = { 0 };
+    bool cacheable = false;
+    struct stat sb;
     ssize_t len;
 
     if (virStorageFileInitAs(src, uid, gid) < 0)
@@ -5212,9 +5404,23 @@ virStorageFileGetMetadataRecurseReadHeader(virStorageSourcePtr src,
     if (virHashAddEntry(cycle, uniqueName, NULL) < 0)
         goto cleanup;
 
+    if (virStorageFileStat(src, &sb) == 0 && S_ISREG(sb.st_mode)) {
+        virStorageFileHeaderCacheStamp(&stamp, &sb, uid, gid);
+        cacheable = true;
+
+        if (virStorageFileHeaderCacheLookup(uniqueName, &stamp, buf, headerLen)) {
+            VIR_DEBUG("using cached header of '%s'", uniqueName);
+            ret = 0;
+            goto cleanup;
+        }
+    }
+
     if ((len = virStorageFileRead(src, 0, VIR_STORAGE_MAX_HEADER, buf)) < 0)
         goto cleanup;
 
+    if (cacheable)
+        virStorageFileHeaderCacheStore(uniqueName, src->path, &stamp, *buf, len);
+
     *headerLen = len;
     ret = 0;
 
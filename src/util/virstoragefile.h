@@ -198,7 +198,7 @@ VIR_ENUM_DECL(virStorageSourcePoolMode);
 
 typedef struct _virStorageSourcePoolDef virStorageSourcePoolDef;
 struct _virStorageSourcePoolDef {
-    char *pool; /* pool name */
+    char *pool; /* pool name, interned, see virStringIntern */
     char *volume; /* volume name */
     int voltype; /* virStorageVolType, internal only */
     int pooltype; /* virStoragePoolType from storage_conf.h, internal only */
@@ -588,6 +588,8 @@ int virStorageFileGetMetadata(virStorageSourcePtr src,
                               bool report_broken)
     ATTRIBUTE_NONNULL(1);
 
+void virStorageFileHeaderCacheInvalidate(virStorageSourcePtr src);
+
 int virStorageFileGetBackingStoreStr(virStorageSourcePtr src,
                                      char **backing)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
@@ -0,0 +1,149 @@
+/*
+ * virstringintern.c: shared copies of frequently repeated strings
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include <stddef.h>
+
+#include "virstringintern.h"
+#include "virthread.h"
+
+/*
+ * Strings such as emulator paths or machine types are the same in most
+ * domain definitions. Instead of keeping a copy per definition, such
+ * fields can point to a single reference counted copy from the table.
+ *
+ * The reference count lives right in front of the characters so that
+ * the string handed out is a plain 'char *' which fits the existing
+ * structure members. Such a string must never be modified or passed to
+ * g_free(); virStringInternRelease() has to be used instead.
+ */
+typedef struct _virStringInternEntry virStringInternEntry;
+struct _virStringInternEntry {
+    size_t refs;
+    char str[];
+};
+
+static virMutex virStringInternLock = VIR_MUTEX_INITIALIZER;
+static GHashTable *virStringInternTable;
+
+
+static virStringInternEntry *
+virStringInternEntryFromString(char *str)
+{
+    return (virStringInternEntry *)(str - offsetof(virStringInternEntry, str));
+}
+
+
+/**
+ * virStringIntern:
+ * @str: string to intern
+ *
+ * Returns the shared copy of @str, which has to be released using
+ * virStringInternRelease(), or NULL if @str is NULL.
+ */
+char *
+virStringIntern(const char *str)
+{
+    virStringInternEntry *entry;
+    size_t len;
+
+    if (!str)
+        return NULL;
+
+    virMutexLock(&virStringInternLock);
+
+    if (!virStringInternTable)
+        virStringInternTable = g_hash_table_new(g_str_hash, g_str_equal);
+
+    if (!(entry = g_hash_table_lookup(virStringInternTable, str))) {
+        len = strlen(str);
+        entry = g_malloc(sizeof(*entry) + len + 1);
+        entry->refs = 0;
+        memcpy(entry->str, str, len + 1);
+        g_hash_table_insert(virStringInternTable, entry->str, entry);
+    }
+    entry->refs++;
+
+    virMutexUnlock(&virStringInternLock);
+
+    return entry->str;
+}
+
+
+/**
+ * virStringInternTake:
+ * @str: allocated string
+ *
+ * Like virStringIntern(), but also frees @str. Useful for strings
+ * returned by parsers.
+ */
+char *
+virStringInternTake(char *str)
+{
+    char *ret = virStringIntern(str);
+
+    g_free(str);
+    return ret;
+}
+
+
+/**
+ * virStringInternRelease:
+ * @str: string returned by virStringIntern() or NULL
+ *
+ * Releases a reference to @str, the shared copy is freed once the last
+ * reference is gone.
+ */
+void
+virStringInternRelease(char *str)
+{
+    virStringInternEntry *entry;
+
+    if (!str)
+        return;
+
+    entry = virStringInternEntryFromString(str);
+
+    virMutexLock(&virStringInternLock);
+    if (--entry->refs == 0) {
+        g_hash_table_remove(virStringInternTable, entry->str);
+        g_free(entry);
+    }
+    virMutexUnlock(&virStringInternLock);
+}
+
+
+/**
+ * virStringInternCount:
+ *
+ * Returns the number of distinct strings in the table.
+ */
+size_t
+virStringInternCount(void)
+{
+    size_t ret = 0;
+
+    virMutexLock(&virStringInternLock);
+    if (virStringInternTable)
+        ret = g_hash_table_size(virStringInternTable);
+    virMutexUnlock(&virStringInternLock);
+
+    return ret;
+}
@@ -23,6 +23,7 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/utsname.h>
 #include <unistd.h>
 
 #include "virerror.h"
@@ -52,6 +53,9 @@ static const char *sysinfoCpuinfo = "/proc/cpuinfo";
 #define SYSINFO sysinfoSysinfo
 #define CPUINFO sysinfoCpuinfo
 #define CPUINFO_FILE_LEN (1024*1024)    /* 1MB limit for /proc/cpuinfo file */
+#define DMI_CACHE_FILE_LEN (1024*1024)
+
+#define SYSINFO_BOOT_ID "/proc/sys/kernel/random/boot_id"
 
 
 void
@@ -1225,17 +1229,21 @@ virSysinfoParseX86Memory(const char *base, virSysinfoDefPtr ret)
     return 0;
 }
 
-virSysinfoDefPtr
-virSysinfoReadDMI(void)
+static int
+virSysinfoRunDMIDecode(char **outbuf)
 {
-    g_auto(virSysinfoDefPtr) ret = NULL;
-    g_autofree char *outbuf = NULL;
     g_autoptr(virCommand) cmd = NULL;
 
     cmd = virCommandNewArgList(DMIDECODE, "-q", "-t", "0,1,2,3,4,11,17", NULL);
-    virCommandSetOutputBuffer(cmd, &outbuf);
-    if (virCommandRun(cmd, NULL) < 0)
-        return NULL;
+    virCommandSetOutputBuffer(cmd, outbuf);
+    return virCommandRun(cmd, NULL);
+}
+
+
+static virSysinfoDefPtr
+virSysinfoParseDMI(const char *outbuf)
+{
+    g_auto(virSysinfoDefPtr) ret = NULL;
 
     if (VIR_ALLOC(ret) < 0)
         return NULL;
@@ -1271,6 +1279,81 @@ virSysinfoReadDMI(void)
 }
 
 
+virSysinfoDefPtr
+virSysinfoReadDMI(void)
+{
+    g_autofree char *outbuf = NULL;
+
+    if (virSysinfoRunDMIDecode(&outbuf) < 0)
+        return NULL;
+
+    return virSysinfoParseDMI(outbuf);
+}
+
+
+/* The DMI tables don't change while the host is running, so the output of
+ * dmidecode stays valid until the next boot. The kernel is part of the key
+ * too as it is what exposes the tables to dmidecode. */
+static char *
+virSysinfoDMICacheKey(void)
+{
+    g_autofree char *bootid = NULL;
+    struct utsname ut;
+
+    if (virFileReadValueString(&bootid, "%s", SYSINFO_BOOT_ID) < 0)
+        return NULL;
+
+    uname(&ut);
+
+    return g_strdup_printf("%s %s %s", bootid, ut.release, ut.version);
+}
+
+
+virSysinfoDefPtr
+virSysinfoReadDMICached(const char *cachefile)
+{
+    g_autofree char *key = NULL;
+    g_autofree char *cached = NULL;
+    g_autofree char *outbuf = NULL;
+    g_autofree char *content = NULL;
+    char *eol;
+
+    if (!(key = virSysinfoDMICacheKey())) {
+        VIR_DEBUG("Cannot identify the running kernel, not caching DMI data");
+        virResetLastError();
+        return virSysinfoReadDMI();
+    }
+
+    if (virFileExists(cachefile)) {
+        if (virFileReadAll(cachefile, DMI_CACHE_FILE_LEN, &cached) < 0) {
+            VIR_WARN("Failed to read DMI cache %s: %s",
+                     cachefile, virGetLastErrorMessage());
+            virResetLastError();
+        } else if ((eol = strchr(cached, '\n'))) {
+            *eol = '\0';
+
+            if (STREQ(cached, key)) {
+                VIR_DEBUG("Using DMI data cached in %s", cachefile);
+                return virSysinfoParseDMI(eol + 1);
+            }
+        }
+    }
+
+    if (virSysinfoRunDMIDecode(&outbuf) < 0)
+        return NULL;
+
+    content = g_strdup_printf("%s\n%s", key, outbuf);
+
+    if (virFileRewriteStr(cachefile, S_IRUSR | S_IWUSR, content) < 0) {
+        VIR_WARN("Failed to write DMI cache %s: %s",
+                 cachefile, virGetLastErrorMessage());
+        virResetLastError();
+    }
+
+    return virSysinfoParseDMI(outbuf);
+}
+
+
 /**
  * virSysinfoRead:
  *
@@ -1304,6 +1387,30 @@ virSysinfoRead(void)
 }
 
 
+/**
+ * virSysinfoReadCached:
+ * @cachefile: path of the file to cache the raw host data in
+ *
+ * Like virSysinfoRead, but on hosts where the SMBIOS information is
+ * obtained by running dmidecode its output is kept in @cachefile and
+ * reused until the host is rebooted or boots another kernel.
+ *
+ * Returns: a filled up sysinfo structure or NULL in case of error
+ */
+virSysinfoDefPtr
+virSysinfoReadCached(const char *cachefile)
+{
+#if !defined(WIN32) && \
+    (defined(__x86_64__) || \
+     defined(__i386__) || \
+     defined(__amd64__))
+    return virSysinfoReadDMICached(cachefile);
+#else
+    return virSysinfoRead();
+#endif
+}
+
+
 static void
 virSysinfoBIOSFormat(virBufferPtr buf, virSysinfoBIOSDefPtr def)
 {
@@ -149,6 +149,7 @@ struct _virSysinfoDef {
 };
 
 virSysinfoDefPtr virSysinfoRead(void);
+virSysinfoDefPtr virSysinfoReadCached(const char *cachefile);
 
 void virSysinfoBIOSDefFree(virSysinfoBIOSDefPtr def);
 void virSysinfoSystemDefFree(virSysinfoSystemDefPtr def);
@@ -38,3 +38,6 @@ virSysinfoReadS390(void);
 
 virSysinfoDefPtr
 virSysinfoReadDMI(void);
+
+virSysinfoDefPtr
+virSysinfoReadDMICached(const char *cachefile);
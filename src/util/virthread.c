@@ -29,9 +29,13 @@
 
 #include <unistd.h>
 #include <inttypes.h>
+#include <time.h>
 #if HAVE_SYS_SYSCALL_H
 # include <sys/syscall.h>
 #endif
+#ifdef HAVE_DLFCN_H
+# include <dlfcn.h>
+#endif
 
 #include "viralloc.h"
 #include "virthreadjob.h"
@@ -50,6 +54,7 @@ int virMutexInit(virMutexPtr m)
     pthread_mutexattr_init(&attr);
     pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_NORMAL);
     ret = pthread_mutex_init(&m->lock, &attr);
+    m->lockedAt = 0;
     pthread_mutexattr_destroy(&attr);
     if (ret != 0) {
         errno = ret;
@@ -65,6 +70,7 @@ int virMutexInitRecursive(virMutexPtr m)
     pthread_mutexattr_init(&attr);
     pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
     ret = pthread_mutex_init(&m->lock, &attr);
+    m->lockedAt = 0;
     pthread_mutexattr_destroy(&attr);
     if (ret != 0) {
         errno = ret;
@@ -78,13 +84,262 @@ void virMutexDestroy(virMutexPtr m)
     pthread_mutex_destroy(&m->lock);
 }
 
-void virMutexLock(virMutexPtr m)
+/*
+ * Lock profiling. When enabled, every acquisition of a virMutex records
+ * whether it had to wait for the lock, how long it waited and how long
+ * the lock was then held. The numbers are aggregated per lock class,
+ * which is the class name for virObjectLock and a generic name for
+ * other mutexes, and per call site, which is the return address of the
+ * locking function. The statistics are kept in a fixed size table
+ * protected by a plain pthread mutex, so that recording them doesn't
+ * recurse into the code being measured.
+ */
+#define VIR_MUTEX_PROFILE_SLOTS 4096
+#define VIR_MUTEX_PROFILE_GENERIC "virMutex"
+
+typedef struct {
+    const char *name;
+    const void *site;
+    unsigned long long acquisitions;
+    unsigned long long contended;
+    unsigned long long waitTotal;
+    unsigned long long waitMax;
+    unsigned long long holdTotal;
+    unsigned long long holdMax;
+} virMutexProfileSlot;
+
+static int mutexProfileEnabled;
+static pthread_mutex_t mutexProfileLock = PTHREAD_MUTEX_INITIALIZER;
+static virMutexProfileSlot mutexProfileSlots[VIR_MUTEX_PROFILE_SLOTS];
+
+
+static unsigned long long
+virMutexProfileNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+/* Must be called with mutexProfileLock held. Returns NULL if the table
+ * is full, acquisitions from new sites are not recorded then. */
+static virMutexProfileSlot *
+virMutexProfileFindLocked(const char *name,
+                          const void *site)
+{
+    uintptr_t hash = ((uintptr_t) site >> 2) ^ ((uintptr_t) name >> 4);
+    size_t i;
+
+    for (i = 0; i < VIR_MUTEX_PROFILE_SLOTS; i++) {
+        virMutexProfileSlot *slot;
+
+        slot = &mutexProfileSlots[(hash + i) % VIR_MUTEX_PROFILE_SLOTS];
+
+        if (!slot->site) {
+            slot->name = name;
+            slot->site = site;
+            return slot;
+        }
+
+        if (slot->site == site && slot->name == name)
+            return slot;
+    }
+
+    return NULL;
+}
+
+
+static void
+virMutexProfileAcquired(virMutexPtr m,
+                        const char *name,
+                        const void *site,
+                        bool contended,
+                        unsigned long long wait)
+{
+    virMutexProfileSlot *slot;
+
+    m->lockedAt = virMutexProfileNow();
+    m->lockName = name;
+    m->lockSite = site;
+
+    pthread_mutex_lock(&mutexProfileLock);
+    if ((slot = virMutexProfileFindLocked(name, site))) {
+        slot->acquisitions++;
+        if (contended) {
+            slot->contended++;
+            slot->waitTotal += wait;
+            slot->waitMax = MAX(slot->waitMax, wait);
+        }
+    }
+    pthread_mutex_unlock(&mutexProfileLock);
+}
+
+
+/* Must be called while @m is still held */
+static void
+virMutexProfileReleased(virMutexPtr m)
+{
+    unsigned long long hold = virMutexProfileNow() - m->lockedAt;
+    virMutexProfileSlot *slot;
+
+    m->lockedAt = 0;
+
+    pthread_mutex_lock(&mutexProfileLock);
+    if ((slot = virMutexProfileFindLocked(m->lockName, m->lockSite))) {
+        slot->holdTotal += hold;
+        slot->holdMax = MAX(slot->holdMax, hold);
+    }
+    pthread_mutex_unlock(&mutexProfileLock);
+}
+
+
+/**
+ * virMutexProfileEnable:
+ * @enable: whether to profile locks
+ *
+ * Turns lock profiling on or off. Statistics gathered so far are kept.
+ */
+void virMutexProfileEnable(bool enable)
+{
+    g_atomic_int_set(&mutexProfileEnabled, enable ? 1 : 0);
+}
+
+
+static char *
+virMutexProfileFormatSite(const void *site)
 {
+#ifdef HAVE_DLFCN_H
+    Dl_info info;
+
+    if (dladdr(site, &info) != 0) {
+        if (info.dli_sname && info.dli_saddr)
+            return g_strdup_printf("%s+0x%tx", info.dli_sname,
+                                   (const char *) site -
+                                   (const char *) info.dli_saddr);
+        if (info.dli_fname && info.dli_fbase)
+            return g_strdup_printf("%s+0x%tx", info.dli_fname,
+                                   (const char *) site -
+                                   (const char *) info.dli_fbase);
+    }
+#endif
+
+    return g_strdup_printf("%p", site);
+}
+
+
+/**
+ * virMutexProfileGet:
+ * @entries: filled with statistics of locks acquired while profiling
+ *
+ * Returns the number of entries stored in @entries, which the caller
+ * has to free using virMutexProfileEntriesFree.
+ */
+size_t virMutexProfileGet(virMutexProfileEntryPtr *entries)
+{
+    g_autofree virMutexProfileSlot *slots = NULL;
+    size_t nentries = 0;
+    size_t i;
+
+    slots = g_new0(virMutexProfileSlot, VIR_MUTEX_PROFILE_SLOTS);
+
+    pthread_mutex_lock(&mutexProfileLock);
+    memcpy(slots, mutexProfileSlots, sizeof(mutexProfileSlots));
+    pthread_mutex_unlock(&mutexProfileLock);
+
+    *entries = g_new0(virMutexProfileEntry, VIR_MUTEX_PROFILE_SLOTS);
+
+    for (i = 0; i < VIR_MUTEX_PROFILE_SLOTS; i++) {
+        virMutexProfileEntryPtr entry = &(*entries)[nentries];
+
+        if (!slots[i].site)
+            continue;
+
+        entry->name = g_strdup(slots[i].name);
+        entry->site = virMutexProfileFormatSite(slots[i].site);
+        entry->acquisitions = slots[i].acquisitions;
+        entry->contended = slots[i].contended;
+        entry->waitTotal = slots[i].waitTotal;
+        entry->waitMax = slots[i].waitMax;
+        entry->holdTotal = slots[i].holdTotal;
+        entry->holdMax = slots[i].holdMax;
+        nentries++;
+    }
+
+    return nentries;
+}
+
+
+void virMutexProfileEntriesFree(virMutexProfileEntryPtr entries,
+                                size_t nentries)
+{
+    size_t i;
+
+    if (!entries)
+        return;
+
+    for (i = 0; i < nentries; i++) {
+        g_free(entries[i].name);
+        g_free(entries[i].site);
+    }
+    g_free(entries);
+}
+
+
+static void
+virMutexLockProfiled(virMutexPtr m,
+                     const char *name,
+                     const void *site)
+{
+    unsigned long long start;
+
+    if (pthread_mutex_trylock(&m->lock) == 0) {
+        virMutexProfileAcquired(m, name, site, false, 0);
+        return;
+    }
+
+    start = virMutexProfileNow();
     pthread_mutex_lock(&m->lock);
+    virMutexProfileAcquired(m, name, site, true,
+                            virMutexProfileNow() - start);
+}
+
+
+/**
+ * virMutexLockSite:
+ * @m: the mutex
+ * @name: name of the lock class, for lock profiling
+ * @site: address the lock is acquired from, for lock profiling
+ *
+ * Like virMutexLock, but lets wrappers such as virObjectLock attribute
+ * the acquisition to their own caller and a meaningful lock class.
+ */
+void virMutexLockSite(virMutexPtr m,
+                      const char *name,
+                      const void *site)
+{
+    if (G_UNLIKELY(g_atomic_int_get(&mutexProfileEnabled))) {
+        virMutexLockProfiled(m, name, site);
+        return;
+    }
+
+    pthread_mutex_lock(&m->lock);
+}
+
+void virMutexLock(virMutexPtr m)
+{
+    virMutexLockSite(m, VIR_MUTEX_PROFILE_GENERIC,
+                     __builtin_return_address(0));
 }
 
 void virMutexUnlock(virMutexPtr m)
 {
+    /* checked separately from the enabled flag, which may have been
+     * switched while the lock was held */
+    if (G_UNLIKELY(m->lockedAt))
+        virMutexProfileReleased(m);
+
     pthread_mutex_unlock(&m->lock);
 }
 
@@ -142,10 +397,48 @@ int virCondDestroy(virCondPtr c)
     return 0;
 }
 
+/*
+ * Waiting on a condition releases the mutex, so the time spent waiting
+ * must not count as holding it. These account for the release and the
+ * reacquisition, the latter without counting a new acquisition.
+ */
+static bool
+virCondProfileRelease(virMutexPtr m,
+                      const char **name,
+                      const void **site)
+{
+    if (!m->lockedAt)
+        return false;
+
+    *name = m->lockName;
+    *site = m->lockSite;
+    virMutexProfileReleased(m);
+    return true;
+}
+
+static void
+virCondProfileReacquire(virMutexPtr m,
+                        const char *name,
+                        const void *site)
+{
+    m->lockedAt = virMutexProfileNow();
+    m->lockName = name;
+    m->lockSite = site;
+}
+
 int virCondWait(virCondPtr c, virMutexPtr m)
 {
+    const char *name = NULL;
+    const void *site = NULL;
+    bool profiled = virCondProfileRelease(m, &name, &site);
     int ret;
-    if ((ret = pthread_cond_wait(&c->cond, &m->lock)) != 0) {
+
+    ret = pthread_cond_wait(&c->cond, &m->lock);
+
+    if (profiled)
+        virCondProfileReacquire(m, name, site);
+
+    if (ret != 0) {
         errno = ret;
         return -1;
     }
@@ -156,11 +449,21 @@ int virCondWaitUntil(virCondPtr c, virMutexPtr m, unsigned long long whenms)
 {
     int ret;
     struct timespec ts;
+    const char *name = NULL;
+    const void *site = NULL;
+    bool profiled;
 
     ts.tv_sec = whenms / 1000;
     ts.tv_nsec = (whenms % 1000) * 1000000;
 
-    if ((ret = pthread_cond_timedwait(&c->cond, &m->lock, &ts)) != 0) {
+    profiled = virCondProfileRelease(m, &name, &site);
+
+    ret = pthread_cond_timedwait(&c->cond, &m->lock, &ts);
+
+    if (profiled)
+        virCondProfileReacquire(m, name, site);
+
+    if (ret != 0) {
         errno = ret;
         return -1;
     }
@@ -31,6 +31,11 @@ typedef virMutex *virMutexPtr;
 
 struct virMutex {
     pthread_mutex_t lock;
+
+    /* Only used while lock profiling is enabled, protected by @lock */
+    unsigned long long lockedAt;
+    const char *lockName;
+    const void *lockSite;
 };
 
 typedef struct virRWLock virRWLock;
@@ -130,8 +135,30 @@ int virMutexInitRecursive(virMutexPtr m) G_GNUC_WARN_UNUSED_RESULT;
 void virMutexDestroy(virMutexPtr m);
 
 void virMutexLock(virMutexPtr m);
+void virMutexLockSite(virMutexPtr m, const char *name, const void *site);
 void virMutexUnlock(virMutexPtr m);
 
+typedef struct _virMutexProfileEntry virMutexProfileEntry;
+typedef virMutexProfileEntry *virMutexProfileEntryPtr;
+
+/* Statistics of one lock class acquired from one call site,
+ * times are in nanoseconds */
+struct _virMutexProfileEntry {
+    char *name;
+    char *site;
+    unsigned long long acquisitions;
+    unsigned long long contended;
+    unsigned long long waitTotal;
+    unsigned long long waitMax;
+    unsigned long long holdTotal;
+    unsigned long long holdMax;
+};
+
+void virMutexProfileEnable(bool enable);
+size_t virMutexProfileGet(virMutexProfileEntryPtr *entries);
+void virMutexProfileEntriesFree(virMutexProfileEntryPtr entries,
+                                size_t nentries);
+
 
 int virRWLockInit(virRWLockPtr m) G_GNUC_WARN_UNUSED_RESULT;
 void virRWLockDestroy(virRWLockPtr m);
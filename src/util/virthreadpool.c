@@ -26,9 +26,16 @@
 #include "viralloc.h"
 #include "virthread.h"
 #include "virerror.h"
+#include "virbitmap.h"
+#include "virhostcpu.h"
+#include "virlog.h"
+#include "virnuma.h"
+#include "virprocess.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
+VIR_LOG_INIT("util.threadpool");
+
 typedef struct _virThreadPoolJob virThreadPoolJob;
 typedef virThreadPoolJob *virThreadPoolJobPtr;
 
@@ -36,6 +43,8 @@ struct _virThreadPoolJob {
     virThreadPoolJobPtr prev;
     virThreadPoolJobPtr next;
     unsigned int priority;
+    const void *group;
+    unsigned long long queued; /* monotonic time in microseconds */
 
     void *data;
 };
@@ -49,6 +58,13 @@ struct _virThreadPoolJobList {
     virThreadPoolJobPtr firstPrio;
 };
 
+/* Number of jobs of one group being processed by workers */
+typedef struct _virThreadPoolGroup virThreadPoolGroup;
+struct _virThreadPoolGroup {
+    const void *group;
+    size_t running;
+};
+
 
 struct _virThreadPool {
     bool quit;
@@ -59,6 +75,12 @@ struct _virThreadPool {
     virThreadPoolJobList jobList;
     size_t jobQueueDepth;
 
+    /* Jobs picked up by workers and how long they were queued, in
+     * microseconds */
+    unsigned long long jobsStarted;
+    unsigned long long jobWaitTotal;
+    unsigned long long jobWaitMax;
+
     virMutex mutex;
     virCond cond;
     virCond quit_cond;
@@ -73,14 +95,34 @@ struct _virThreadPool {
     size_t nPrioWorkers;
     virThreadPtr prioWorkers;
     virCond prioCond;
+
+    /* Groups with running jobs; at most one entry per worker */
+    virThreadPoolGroup *groups;
+    size_t ngroups;
+    size_t maxGroupWorkers;
+
+    /* NUMA nodes workers are spread across, NULL if not bound */
+    virBitmapPtr numaNodes;
+    /* CPUs workers are confined to, NULL if not confined */
+    virBitmapPtr cpus;
+    /* bumped whenever workers have to update their binding */
+    unsigned int bindGeneration;
+    size_t nextWorkerIndex;
 };
 
 struct virThreadPoolWorkerData {
     virThreadPoolPtr pool;
     virCondPtr cond;
     bool priority;
+    size_t index;
 };
 
+/* All existing pools, so that their statistics can be reported without
+ * knowing who created them */
+static virMutex virThreadPoolListLock = VIR_MUTEX_INITIALIZER;
+static virThreadPoolPtr *virThreadPoolList;
+static size_t virThreadPoolListCount;
+
 /* Test whether the worker needs to quit if the current number of workers @count
  * is greater than @limit actually allows.
  */
@@ -89,6 +131,144 @@ static inline bool virThreadPoolWorkerQuitHelper(size_t count, size_t limit)
     return count > limit;
 }
 
+static virThreadPoolGroup *
+virThreadPoolGroupFind(virThreadPoolPtr pool,
+                       const void *group)
+{
+    size_t i;
+
+    for (i = 0; i < pool->ngroups; i++) {
+        if (pool->groups[i].group == group)
+            return &pool->groups[i];
+    }
+
+    return NULL;
+}
+
+
+/* Picks the next job to process. Jobs of groups with the fewest jobs
+ * being processed are preferred and jobs of groups which already have
+ * maxGroupWorkers jobs running are skipped, unless they are high
+ * priority. Among equal candidates the oldest job wins. Jobs without a
+ * group are processed in order. */
+static virThreadPoolJobPtr
+virThreadPoolJobPick(virThreadPoolPtr pool,
+                     bool priority)
+{
+    virThreadPoolJobPtr job;
+    virThreadPoolJobPtr best = NULL;
+    size_t bestRunning = 0;
+
+    job = priority ? pool->jobList.firstPrio : pool->jobList.head;
+
+    for (; job; job = job->next) {
+        virThreadPoolGroup *group;
+        size_t running;
+
+        if (priority && !job->priority)
+            continue;
+
+        if (!job->group || !(group = virThreadPoolGroupFind(pool, job->group)))
+            return job;
+
+        running = group->running;
+
+        if (!job->priority &&
+            pool->maxGroupWorkers > 0 &&
+            running >= pool->maxGroupWorkers)
+            continue;
+
+        if (!best || running < bestRunning) {
+            best = job;
+            bestRunning = running;
+        }
+    }
+
+    return best;
+}
+
+
+static void
+virThreadPoolGroupAddJob(virThreadPoolPtr pool,
+                         const void *group)
+{
+    virThreadPoolGroup *entry;
+    virThreadPoolGroup add = { .group = group, .running = 1 };
+
+    if (!group)
+        return;
+
+    if ((entry = virThreadPoolGroupFind(pool, group))) {
+        entry->running++;
+        return;
+    }
+
+    ignore_value(VIR_APPEND_ELEMENT_COPY(pool->groups, pool->ngroups, add));
+}
+
+
+static void
+virThreadPoolGroupRemoveJob(virThreadPoolPtr pool,
+                            const void *group)
+{
+    virThreadPoolGroup *entry;
+
+    if (!group || !(entry = virThreadPoolGroupFind(pool, group)))
+        return;
+
+    if (--entry->running == 0)
+        VIR_DELETE_ELEMENT(pool->groups, entry - pool->groups, pool->ngroups);
+}
+
+
+/* Binds the calling worker to the CPUs of one of pool->numaNodes,
+ * picked by the worker's @index, which are also in pool->cpus, or to
+ * all of pool->cpus if the node has none of them. Without either, the
+ * worker is bound to all online CPUs again. Must be called with the
+ * pool locked. */
+static void
+virThreadPoolWorkerBind(virThreadPoolPtr pool,
+                        size_t index)
+{
+    g_autoptr(virBitmap) cpus = NULL;
+    ssize_t node = -1;
+    size_t count;
+    size_t i;
+
+    if (pool->numaNodes && (count = virBitmapCountBits(pool->numaNodes)) > 0) {
+        for (i = 0; i <= index % count; i++)
+            node = virBitmapNextSetBit(pool->numaNodes, node);
+
+        if (virNumaGetNodeCPUs(node, &cpus) < 0) {
+            VIR_WARN("Unable to get CPUs of NUMA node %zd: %s",
+                     node, virGetLastErrorMessage());
+            virResetLastError();
+            return;
+        }
+
+        if (pool->cpus) {
+            virBitmapIntersect(cpus, pool->cpus);
+            if (virBitmapIsAllClear(cpus)) {
+                virBitmapFree(cpus);
+                cpus = virBitmapNewCopy(pool->cpus);
+            }
+        }
+    } else if (pool->cpus) {
+        cpus = virBitmapNewCopy(pool->cpus);
+    } else if (!(cpus = virHostCPUGetOnlineBitmap())) {
+        /* the binding was removed */
+        virResetLastError();
+        return;
+    }
+
+    if (virProcessSetAffinity(0, cpus) < 0) {
+        VIR_WARN("Unable to bind worker of pool '%s': %s",
+                 pool->jobName, virGetLastErrorMessage());
+        virResetLastError();
+    }
+}
+
+
 static void virThreadPoolWorker(void *opaque)
 {
     struct virThreadPoolWorkerData *data = opaque;
@@ -98,12 +278,22 @@ static void virThreadPoolWorker(void *opaque)
     size_t *curWorkers = priority ? &pool->nPrioWorkers : &pool->nWorkers;
     size_t *maxLimit = priority ? &pool->maxPrioWorkers : &pool->maxWorkers;
     virThreadPoolJobPtr job = NULL;
+    const void *group;
+    size_t index = data->index;
+    unsigned int bindGeneration = 0;
+    unsigned long long now;
+    unsigned long long wait;
 
     VIR_FREE(data);
 
     virMutexLock(&pool->mutex);
 
     while (1) {
+        if (bindGeneration != pool->bindGeneration) {
+            bindGeneration = pool->bindGeneration;
+            virThreadPoolWorkerBind(pool, index);
+        }
+
         /* In order to support async worker termination, we need ensure that
          * both busy and free workers know if they need to terminated. Thus,
          * busy workers need to check for this fact before they start waiting for
@@ -113,8 +303,7 @@ static void virThreadPoolWorker(void *opaque)
         if (virThreadPoolWorkerQuitHelper(*curWorkers, *maxLimit))
             goto out;
         while (!pool->quit &&
-               ((!priority && !pool->jobList.head) ||
-                (priority && !pool->jobList.firstPrio))) {
+               !(job = virThreadPoolJobPick(pool, priority))) {
             if (!priority)
                 pool->freeWorkers++;
             if (virCondWait(cond, &pool->mutex) < 0) {
@@ -127,17 +316,16 @@ static void virThreadPoolWorker(void *opaque)
 
             if (virThreadPoolWorkerQuitHelper(*curWorkers, *maxLimit))
                 goto out;
+
+            if (bindGeneration != pool->bindGeneration) {
+                bindGeneration = pool->bindGeneration;
+                virThreadPoolWorkerBind(pool, index);
+            }
         }
 
         if (pool->quit)
             break;
 
-        if (priority) {
-            job = pool->jobList.firstPrio;
-        } else {
-            job = pool->jobList.head;
-        }
-
         if (job == pool->jobList.firstPrio) {
             virThreadPoolJobPtr tmp = job->next;
             while (tmp) {
@@ -158,11 +346,23 @@ static void virThreadPoolWorker(void *opaque)
             pool->jobList.tail = job->prev;
 
         pool->jobQueueDepth--;
+        virThreadPoolGroupAddJob(pool, job->group);
+
+        now = g_get_monotonic_time();
+        wait = now > job->queued ? now - job->queued : 0;
+        pool->jobsStarted++;
+        pool->jobWaitTotal += wait;
+        pool->jobWaitMax = MAX(pool->jobWaitMax, wait);
 
         virMutexUnlock(&pool->mutex);
         (pool->jobFunc)(job->data, pool->jobOpaque);
+        group = job->group;
         VIR_FREE(job);
         virMutexLock(&pool->mutex);
+
+        /* Jobs of this group skipped so far might be eligible now, but
+         * this worker is going to pick one itself */
+        virThreadPoolGroupRemoveJob(pool, group);
     }
 
  out:
@@ -194,6 +394,7 @@ virThreadPoolExpand(virThreadPoolPtr pool, size_t gain, bool priority)
         data->pool = pool;
         data->cond = priority ? &pool->prioCond : &pool->cond;
         data->priority = priority;
+        data->index = pool->nextWorkerIndex++;
 
         if (priority)
             name = g_strdup_printf("prio-%s", pool->jobName);
@@ -263,6 +464,11 @@ virThreadPoolNewFull(size_t minWorkers,
             goto error;
     }
 
+    virMutexLock(&virThreadPoolListLock);
+    ignore_value(VIR_APPEND_ELEMENT(virThreadPoolList,
+                                    virThreadPoolListCount, pool));
+    virMutexUnlock(&virThreadPoolListLock);
+
     return pool;
 
  error:
@@ -275,10 +481,20 @@ void virThreadPoolFree(virThreadPoolPtr pool)
 {
     virThreadPoolJobPtr job;
     bool priority = false;
+    size_t i;
 
     if (!pool)
         return;
 
+    virMutexLock(&virThreadPoolListLock);
+    for (i = 0; i < virThreadPoolListCount; i++) {
+        if (virThreadPoolList[i] == pool) {
+            VIR_DELETE_ELEMENT(virThreadPoolList, i, virThreadPoolListCount);
+            break;
+        }
+    }
+    virMutexUnlock(&virThreadPoolListLock);
+
     virMutexLock(&pool->mutex);
     pool->quit = true;
     if (pool->nWorkers > 0)
@@ -297,6 +513,9 @@ void virThreadPoolFree(virThreadPoolPtr pool)
     }
 
     VIR_FREE(pool->workers);
+    VIR_FREE(pool->groups);
+    virBitmapFree(pool->numaNodes);
+    virBitmapFree(pool->cpus);
     virMutexUnlock(&pool->mutex);
     virMutexDestroy(&pool->mutex);
     virCondDestroy(&pool->quit_cond);
@@ -364,6 +583,67 @@ size_t virThreadPoolGetFreeWorkers(virThreadPoolPtr pool)
     return ret;
 }
 
+/**
+ * virThreadPoolSetNUMANodes:
+ * @pool: thread pool
+ * @nodes: NUMA nodes to bind workers to or NULL
+ *
+ * Spreads the workers of @pool evenly across @nodes and binds each of
+ * them to the CPUs of its node, so that the memory it allocates while
+ * processing jobs is local. Passing NULL removes the binding. Busy
+ * workers apply the change once they finish their current job.
+ */
+void
+virThreadPoolSetNUMANodes(virThreadPoolPtr pool,
+                          virBitmapPtr nodes)
+{
+    virMutexLock(&pool->mutex);
+    virBitmapFree(pool->numaNodes);
+    pool->numaNodes = nodes ? virBitmapNewCopy(nodes) : NULL;
+    pool->bindGeneration++;
+    virCondBroadcast(&pool->cond);
+    if (pool->maxPrioWorkers > 0)
+        virCondBroadcast(&pool->prioCond);
+    virMutexUnlock(&pool->mutex);
+}
+
+
+/**
+ * virThreadPoolSetCPUs:
+ * @pool: thread pool
+ * @cpus: host CPUs to confine workers to or NULL
+ *
+ * Confines the workers of @pool to @cpus, e.g. to keep them off CPUs
+ * dedicated to guests. If the pool is bound to NUMA nodes as well, each
+ * worker runs on those of @cpus which belong to its node. Passing NULL
+ * removes the confinement. Busy workers apply the change once they
+ * finish their current job.
+ */
+void
+virThreadPoolSetCPUs(virThreadPoolPtr pool,
+                     virBitmapPtr cpus)
+{
+    virMutexLock(&pool->mutex);
+    virBitmapFree(pool->cpus);
+    pool->cpus = cpus ? virBitmapNewCopy(cpus) : NULL;
+    pool->bindGeneration++;
+    virCondBroadcast(&pool->cond);
+    if (pool->maxPrioWorkers > 0)
+        virCondBroadcast(&pool->prioCond);
+    virMutexUnlock(&pool->mutex);
+}
+
+size_t virThreadPoolGetMaxGroupWorkers(virThreadPoolPtr pool)
+{
+    size_t ret;
+
+    virMutexLock(&pool->mutex);
+    ret = pool->maxGroupWorkers;
+    virMutexUnlock(&pool->mutex);
+
+    return ret;
+}
+
 size_t virThreadPoolGetJobQueueDepth(virThreadPoolPtr pool)
 {
     size_t ret;
@@ -375,6 +655,64 @@ size_t virThreadPoolGetJobQueueDepth(virThreadPoolPtr pool)
     return ret;
 }
 
+/*
+ * @stats - filled with the current statistics of @pool
+ *
+ * The name in @stats has to be freed by the caller, or with
+ * virThreadPoolStatsFree.
+ */
+void virThreadPoolGetStats(virThreadPoolPtr pool,
+                           virThreadPoolStatsPtr stats)
+{
+    virMutexLock(&pool->mutex);
+    stats->name = g_strdup(pool->jobName);
+    stats->jobQueueDepth = pool->jobQueueDepth;
+    stats->workers = pool->nWorkers;
+    stats->freeWorkers = pool->freeWorkers;
+    stats->jobs = pool->jobsStarted;
+    stats->jobWaitAvg = pool->jobsStarted ?
+        pool->jobWaitTotal / pool->jobsStarted : 0;
+    stats->jobWaitMax = pool->jobWaitMax;
+    virMutexUnlock(&pool->mutex);
+}
+
+/*
+ * @stats - filled with an array of statistics, one per existing pool
+ *
+ * Reports pools of every driver running in the process, which are
+ * named after their job function. Free @stats with
+ * virThreadPoolStatsFree.
+ *
+ * Return: the number of entries in @stats
+ */
+size_t virThreadPoolGetAllStats(virThreadPoolStatsPtr *stats)
+{
+    size_t nstats;
+    size_t i;
+
+    virMutexLock(&virThreadPoolListLock);
+    nstats = virThreadPoolListCount;
+    *stats = g_new0(virThreadPoolStats, nstats);
+    for (i = 0; i < nstats; i++)
+        virThreadPoolGetStats(virThreadPoolList[i], &(*stats)[i]);
+    virMutexUnlock(&virThreadPoolListLock);
+
+    return nstats;
+}
+
+void virThreadPoolStatsFree(virThreadPoolStatsPtr stats,
+                            size_t nstats)
+{
+    size_t i;
+
+    if (!stats)
+        return;
+
+    for (i = 0; i < nstats; i++)
+        g_free(stats[i].name);
+    g_free(stats);
+}
+
 /*
  * @priority - job priority
  * Return: 0 on success, -1 otherwise
@@ -383,23 +721,41 @@ int virThreadPoolSendJob(virThreadPoolPtr pool,
                          unsigned int priority,
                          void *jobData)
 {
-    virThreadPoolJobPtr job;
+    return virThreadPoolSendJobGroup(pool, priority, NULL, jobData);
+}
+
+/*
+ * @priority - job priority
+ * @group - identifies the originator of the job or NULL
+ *
+ * Like virThreadPoolSendJob, but jobs of groups with fewer jobs being
+ * processed are preferred over jobs of busier groups, so that a single
+ * group can't monopolize the workers. See also
+ * virThreadPoolSetParameters.
+ *
+ * Return: 0 on success, -1 otherwise
+ */
+int virThreadPoolSendJobGroup(virThreadPoolPtr pool,
+                              unsigned int priority,
+                              const void *group,
+                              void *jobData)
+{
+    virThreadPoolJobPtr job = g_new0(virThreadPoolJob, 1);
+
+    job->data = jobData;
+    job->priority = priority;
+    job->group = group;
+    job->queued = g_get_monotonic_time();
 
     virMutexLock(&pool->mutex);
     if (pool->quit)
         goto error;
 
-    if (pool->freeWorkers - pool->jobQueueDepth <= 0 &&
+    if (pool->freeWorkers <= pool->jobQueueDepth &&
         pool->nWorkers < pool->maxWorkers &&
         virThreadPoolExpand(pool, 1, false) < 0)
         goto error;
 
-    if (VIR_ALLOC(job) < 0)
-        goto error;
-
-    job->data = jobData;
-    job->priority = priority;
-
     job->prev = pool->jobList.tail;
     if (pool->jobList.tail)
         pool->jobList.tail->next = job;
@@ -413,7 +769,10 @@ int virThreadPoolSendJob(virThreadPoolPtr pool,
 
     pool->jobQueueDepth++;
 
-    virCondSignal(&pool->cond);
+    /* Busy workers pick up queued jobs once they're done, so only
+     * wake up a worker if there's an idle one */
+    if (pool->freeWorkers > 0)
+        virCondSignal(&pool->cond);
     if (priority)
         virCondSignal(&pool->prioCond);
 
@@ -422,6 +781,7 @@ int virThreadPoolSendJob(virThreadPoolPtr pool,
 
  error:
     virMutexUnlock(&pool->mutex);
+    g_free(job);
     return -1;
 }
 
@@ -429,7 +789,8 @@ int
 virThreadPoolSetParameters(virThreadPoolPtr pool,
                            long long int minWorkers,
                            long long int maxWorkers,
-                           long long int prioWorkers)
+                           long long int prioWorkers,
+                           long long int maxGroupWorkers)
 {
     size_t max;
     size_t min;
@@ -476,6 +837,11 @@ virThreadPoolSetParameters(virThreadPoolPtr pool,
         pool->maxPrioWorkers = prioWorkers;
     }
 
+    if (maxGroupWorkers >= 0) {
+        pool->maxGroupWorkers = maxGroupWorkers;
+        virCondBroadcast(&pool->cond);
+    }
+
     virMutexUnlock(&pool->mutex);
     return 0;
 
@@ -22,6 +22,7 @@
 #pragma once
 
 #include "internal.h"
+#include "virbitmap.h"
 
 typedef struct _virThreadPool virThreadPool;
 typedef virThreadPool *virThreadPoolPtr;
@@ -44,6 +45,31 @@ size_t virThreadPoolGetPriorityWorkers(virThreadPoolPtr pool);
 size_t virThreadPoolGetCurrentWorkers(virThreadPoolPtr pool);
 size_t virThreadPoolGetFreeWorkers(virThreadPoolPtr pool);
 size_t virThreadPoolGetJobQueueDepth(virThreadPoolPtr pool);
+size_t virThreadPoolGetMaxGroupWorkers(virThreadPoolPtr pool);
+
+typedef struct _virThreadPoolStats virThreadPoolStats;
+typedef virThreadPoolStats *virThreadPoolStatsPtr;
+struct _virThreadPoolStats {
+    char *name;
+    size_t jobQueueDepth;
+    size_t workers;
+    size_t freeWorkers;
+    unsigned long long jobs; /* jobs picked up by workers */
+    unsigned long long jobWaitAvg; /* in microseconds */
+    unsigned long long jobWaitMax; /* in microseconds */
+};
+
+void virThreadPoolGetStats(virThreadPoolPtr pool,
+                           virThreadPoolStatsPtr stats);
+size_t virThreadPoolGetAllStats(virThreadPoolStatsPtr *stats)
+    ATTRIBUTE_NONNULL(1);
+void virThreadPoolStatsFree(virThreadPoolStatsPtr stats,
+                            size_t nstats);
+
+void virThreadPoolSetNUMANodes(virThreadPoolPtr pool,
+                               virBitmapPtr nodes);
+void virThreadPoolSetCPUs(virThreadPoolPtr pool,
+                          virBitmapPtr cpus);
 
 void virThreadPoolFree(virThreadPoolPtr pool);
 
@@ -52,7 +78,14 @@ int virThreadPoolSendJob(virThreadPoolPtr pool,
                          void *jobdata) ATTRIBUTE_NONNULL(1)
                                         G_GNUC_WARN_UNUSED_RESULT;
 
+int virThreadPoolSendJobGroup(virThreadPoolPtr pool,
+                              unsigned int priority,
+                              const void *group,
+                              void *jobdata) ATTRIBUTE_NONNULL(1)
+                                             G_GNUC_WARN_UNUSED_RESULT;
+
 int virThreadPoolSetParameters(virThreadPoolPtr pool,
                                long long int minWorkers,
                                long long int maxWorkers,
-                               long long int prioWorkers);
+                               long long int prioWorkers,
+                               long long int maxGroupWorkers);
@@ -52,7 +52,7 @@ int virTimeStringThenRaw(unsigned long long when, char *buf)
  * raising a libvirt error on failure
  */
 int virTimeMillisNow(unsigned long long *now)
-    ATTRIBUTE_NONNULL(1) G_GNUC_WARN_UNUSED_RESULT;
+    ATTRIBUTE_NONNULL(1) G_GNUC_WARN_UNUSED_RESULT G_GNUC_NO_INLINE;
 int virTimeFieldsNow(struct tm *fields)
     ATTRIBUTE_NONNULL(1) G_GNUC_WARN_UNUSED_RESULT;
 char *virTimeStringNow(void);
@@ -0,0 +1,392 @@
+/*
+ * virtrace.c: spans for tracing operations across threads and daemons
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <fcntl.h>
+
+#include "virtrace.h"
+#include "virerror.h"
+#include "virfile.h"
+#include "virjson.h"
+#include "virlog.h"
+#include "virstring.h"
+#include "virthread.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("util.trace");
+
+/* Spans are only recorded for operations which are part of a trace started
+ * by a client. The trace context of a client is taken from this environment
+ * variable, in the W3C traceparent format, unless the calling thread is
+ * already within a span. */
+#define VIR_TRACE_PARENT_ENV "LIBVIRT_TRACEPARENT"
+
+static virMutex virTraceLock = VIR_MUTEX_INITIALIZER;
+static int virTraceFD = -1;
+static int virTraceOn;
+
+static virThreadLocal virTraceCurrent;
+
+
+static int
+virTraceOnceInit(void)
+{
+    return virThreadLocalInit(&virTraceCurrent, NULL);
+}
+
+VIR_ONCE_GLOBAL_INIT(virTrace);
+
+
+/**
+ * virTraceSetOutput:
+ * @path: file to append the spans to, NULL to disable tracing
+ *
+ * Spans are written as JSON records, one per line, using the field names
+ * of the OpenTelemetry protocol so that they can be fed to a collector.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virTraceSetOutput(const char *path)
+{
+    int fd = -1;
+    int oldfd;
+
+    if (virTraceInitialize() < 0)
+        return -1;
+
+    if (path &&
+        (fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,
+                   S_IRUSR | S_IWUSR)) < 0) {
+        virReportSystemError(errno, _("failed to open trace file '%s'"), path);
+        return -1;
+    }
+
+    virMutexLock(&virTraceLock);
+    oldfd = virTraceFD;
+    virTraceFD = fd;
+    g_atomic_int_set(&virTraceOn, fd >= 0);
+    virMutexUnlock(&virTraceLock);
+
+    VIR_FORCE_CLOSE(oldfd);
+    return 0;
+}
+
+
+bool
+virTraceEnabled(void)
+{
+    return g_atomic_int_get(&virTraceOn) != 0;
+}
+
+
+static bool
+virTraceIDIsValid(const unsigned char *id,
+                  size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        if (id[i] != 0)
+            return true;
+    }
+
+    return false;
+}
+
+
+static bool
+virTraceParseHex(const char *str,
+                 unsigned char *id,
+                 size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        if (!g_ascii_isxdigit(str[2 * i]) || !g_ascii_isxdigit(str[2 * i + 1]))
+            return false;
+
+        id[i] = (g_ascii_xdigit_value(str[2 * i]) << 4) |
+                g_ascii_xdigit_value(str[2 * i + 1]);
+    }
+
+    return virTraceIDIsValid(id, len);
+}
+
+
+static char *
+virTraceFormatHex(const unsigned char *id,
+                  size_t len)
+{
+    char *ret = g_new0(char, 2 * len + 1);
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        g_snprintf(ret + 2 * i, 3, "%02x", id[i]);
+
+    return ret;
+}
+
+
+/**
+ * virTraceContextParse:
+ * @traceparent: context in the "00-<trace-id>-<parent-id>-<flags>" format
+ * @ctx: filled with the parsed context
+ *
+ * Returns true if @traceparent is a valid context.
+ */
+bool
+virTraceContextParse(const char *traceparent,
+                     virTraceContextPtr ctx)
+{
+    const char *p = traceparent;
+
+    if (!p || !STRPREFIX(p, "00-"))
+        return false;
+    p += 3;
+
+    if (!virTraceParseHex(p, ctx->traceID, VIR_TRACE_ID_LEN))
+        return false;
+    p += 2 * VIR_TRACE_ID_LEN;
+
+    if (*p++ != '-' ||
+        !virTraceParseHex(p, ctx->spanID, VIR_TRACE_SPAN_ID_LEN))
+        return false;
+    p += 2 * VIR_TRACE_SPAN_ID_LEN;
+
+    return *p == '-';
+}
+
+
+/**
+ * virTraceContextGetCurrent:
+ * @ctx: filled with the context of the calling thread
+ *
+ * Returns the context a remote call made by the calling thread belongs
+ * to, which is either the span the thread is in, or the context supplied
+ * by the LIBVIRT_TRACEPARENT environment variable.
+ *
+ * Returns true if there is a context.
+ */
+bool
+virTraceContextGetCurrent(virTraceContextPtr ctx)
+{
+    virTraceSpanPtr span;
+
+    if (virTraceInitialize() < 0)
+        return false;
+
+    if ((span = virThreadLocalGet(&virTraceCurrent))) {
+        *ctx = span->ctx;
+        return true;
+    }
+
+    return virTraceContextParse(getenv(VIR_TRACE_PARENT_ENV), ctx);
+}
+
+
+static void
+virTraceNewSpanID(unsigned char *id)
+{
+    do {
+        guint32 r1 = g_random_int();
+        guint32 r2 = g_random_int();
+
+        memcpy(id, &r1, sizeof(r1));
+        memcpy(id + sizeof(r1), &r2, sizeof(r2));
+    } while (!virTraceIDIsValid(id, VIR_TRACE_SPAN_ID_LEN));
+}
+
+
+static void
+virTraceWrite(const virTraceContext *ctx,
+              const unsigned char *parentID,
+              const char *name,
+              const char *detail,
+              long long start,
+              long long end,
+              bool failed)
+{
+    g_autoptr(virJSONValue) record = NULL;
+    g_autoptr(virJSONValue) attrs = virJSONValueNewArray();
+    g_autoptr(virJSONValue) status = NULL;
+    g_autofree char *traceID = virTraceFormatHex(ctx->traceID, VIR_TRACE_ID_LEN);
+    g_autofree char *spanID = virTraceFormatHex(ctx->spanID, VIR_TRACE_SPAN_ID_LEN);
+    g_autofree char *parent = virTraceFormatHex(parentID, VIR_TRACE_SPAN_ID_LEN);
+    g_autofree char *startNano = g_strdup_printf("%lld000", start);
+    g_autofree char *endNano = g_strdup_printf("%lld000", end);
+    g_autofree char *line = NULL;
+
+    if (detail) {
+        g_autoptr(virJSONValue) attr = NULL;
+        g_autoptr(virJSONValue) value = NULL;
+
+        if (virJSONValueObjectCreate(&value, "s:stringValue", detail, NULL) < 0 ||
+            virJSONValueObjectCreate(&attr,
+                                     "s:key", "libvirt.detail",
+                                     "a:value", &value,
+                                     NULL) < 0 ||
+            virJSONValueArrayAppend(attrs, attr) < 0)
+            goto error;
+        attr = NULL;
+    }
+
+    /* STATUS_CODE_OK is 1, STATUS_CODE_ERROR is 2 */
+    if (virJSONValueObjectCreate(&status, "i:code", failed ? 2 : 1, NULL) < 0 ||
+        virJSONValueObjectCreate(&record,
+                                 "s:traceId", traceID,
+                                 "s:spanId", spanID,
+                                 "s:parentSpanId", parent,
+                                 "s:name", name,
+                                 "s:startTimeUnixNano", startNano,
+                                 "s:endTimeUnixNano", endNano,
+                                 "a:attributes", &attrs,
+                                 "a:status", &status,
+                                 NULL) < 0)
+        goto error;
+
+    if (!(line = virJSONValueToString(record, false)))
+        goto error;
+
+    virMutexLock(&virTraceLock);
+    if (virTraceFD >= 0 &&
+        (safewrite(virTraceFD, line, strlen(line)) < 0 ||
+         safewrite(virTraceFD, "\n", 1) < 0))
+        VIR_WARN("failed to write trace span: %s", g_strerror(errno));
+    virMutexUnlock(&virTraceLock);
+    return;
+
+ error:
+    VIR_WARN("failed to format trace span %s", name);
+    virResetLastError();
+}
+
+
+/**
+ * virTraceSpanBeginRemote:
+ * @span: span to begin
+ * @parent: context of the caller, may be NULL
+ * @name: name of the operation
+ * @detail: additional information on the operation, may be NULL
+ *
+ * Begins @span as a child of @parent received from another process and
+ * makes it the current span of the calling thread. Without @parent, or
+ * when tracing is disabled, @span is inactive and ending it does nothing.
+ */
+void
+virTraceSpanBeginRemote(virTraceSpanPtr span,
+                        const virTraceContext *parent,
+                        const char *name,
+                        const char *detail)
+{
+    memset(span, 0, sizeof(*span));
+
+    if (!parent || !virTraceEnabled() || virTraceInitialize() < 0)
+        return;
+
+    span->active = true;
+    span->name = name;
+    span->detail = g_strdup(detail);
+    span->start = g_get_real_time();
+    memcpy(span->ctx.traceID, parent->traceID, VIR_TRACE_ID_LEN);
+    memcpy(span->parentID, parent->spanID, VIR_TRACE_SPAN_ID_LEN);
+    virTraceNewSpanID(span->ctx.spanID);
+
+    span->outer = virThreadLocalGet(&virTraceCurrent);
+    ignore_value(virThreadLocalSet(&virTraceCurrent, span));
+}
+
+
+/**
+ * virTraceSpanBegin:
+ * @span: span to begin
+ * @name: name of the operation
+ * @detail: additional information on the operation, may be NULL
+ *
+ * Begins @span as a child of the current span of the calling thread. If
+ * the thread is not within a span, @span is inactive.
+ */
+void
+virTraceSpanBegin(virTraceSpanPtr span,
+                  const char *name,
+                  const char *detail)
+{
+    virTraceSpanPtr current = NULL;
+
+    if (virTraceEnabled() && virTraceInitialize() == 0)
+        current = virThreadLocalGet(&virTraceCurrent);
+
+    virTraceSpanBeginRemote(span, current ? &current->ctx : NULL, name, detail);
+}
+
+
+/**
+ * virTraceSpanEnd:
+ * @span: span to end
+ * @failed: whether the operation failed
+ *
+ * Ends @span, records it and makes the span which was current when @span
+ * began current again.
+ */
+void
+virTraceSpanEnd(virTraceSpanPtr span,
+                bool failed)
+{
+    if (!span->active)
+        return;
+
+    ignore_value(virThreadLocalSet(&virTraceCurrent, span->outer));
+
+    virTraceWrite(&span->ctx, span->parentID, span->name, span->detail,
+                  span->start, g_get_real_time(), failed);
+
+    g_free(span->detail);
+    memset(span, 0, sizeof(*span));
+}
+
+
+/**
+ * virTraceSpanEmit:
+ * @parent: context of the span's parent
+ * @name: name of the operation
+ * @detail: additional information on the operation, may be NULL
+ * @start: real time when the operation started, in microseconds
+ * @end: real time when the operation ended, in microseconds
+ *
+ * Records a span of an operation which already finished, e.g. the time a
+ * call waited in a queue.
+ */
+void
+virTraceSpanEmit(const virTraceContext *parent,
+                 const char *name,
+                 const char *detail,
+                 long long start,
+                 long long end)
+{
+    virTraceContext ctx;
+
+    if (!virTraceEnabled())
+        return;
+
+    memcpy(ctx.traceID, parent->traceID, VIR_TRACE_ID_LEN);
+    virTraceNewSpanID(ctx.spanID);
+
+    virTraceWrite(&ctx, parent->spanID, name, detail, start, end, false);
+}
@@ -0,0 +1,74 @@
+/*
+ * virtrace.h: spans for tracing operations across threads and daemons
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "internal.h"
+
+#define VIR_TRACE_ID_LEN 16
+#define VIR_TRACE_SPAN_ID_LEN 8
+
+/* Identifies the span an operation belongs to, compatible with the
+ * trace-id and parent-id of a W3C traceparent */
+typedef struct _virTraceContext virTraceContext;
+typedef virTraceContext *virTraceContextPtr;
+struct _virTraceContext {
+    unsigned char traceID[VIR_TRACE_ID_LEN];
+    unsigned char spanID[VIR_TRACE_SPAN_ID_LEN];
+};
+
+typedef struct _virTraceSpan virTraceSpan;
+typedef virTraceSpan *virTraceSpanPtr;
+struct _virTraceSpan {
+    bool active;
+    virTraceContext ctx;
+    unsigned char parentID[VIR_TRACE_SPAN_ID_LEN];
+    const char *name;
+    char *detail;
+    long long start; /* real time in microseconds */
+    virTraceSpanPtr outer; /* span which was current when this one began */
+};
+
+int virTraceSetOutput(const char *path);
+bool virTraceEnabled(void);
+
+bool virTraceContextParse(const char *traceparent,
+                          virTraceContextPtr ctx)
+    ATTRIBUTE_NONNULL(2);
+bool virTraceContextGetCurrent(virTraceContextPtr ctx)
+    ATTRIBUTE_NONNULL(1);
+
+void virTraceSpanBeginRemote(virTraceSpanPtr span,
+                             const virTraceContext *parent,
+                             const char *name,
+                             const char *detail)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(3);
+void virTraceSpanBegin(virTraceSpanPtr span,
+                       const char *name,
+                       const char *detail)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+void virTraceSpanEnd(virTraceSpanPtr span,
+                     bool failed)
+    ATTRIBUTE_NONNULL(1);
+
+void virTraceSpanEmit(const virTraceContext *parent,
+                      const char *name,
+                      const char *detail,
+                      long long start,
+                      long long end)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
@@ -497,6 +497,102 @@ virTypedParamsRemoteFree(virTypedParameterRemotePtr remote_params_val,
 }
 
 
+/**
+ * virTypedParamDeserializeValue:
+ * @val: remote representation of a parameter value
+ * @param: parameter to fill in
+ *
+ * Copies type and value of @val into @param. The name of @param is
+ * left untouched.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virTypedParamDeserializeValue(virTypedParameterRemoteValue *val,
+                              virTypedParameterPtr param)
+{
+    param->type = val->type;
+    switch (param->type) {
+    case VIR_TYPED_PARAM_INT:
+        param->value.i = val->remote_typed_param_value.i;
+        break;
+    case VIR_TYPED_PARAM_UINT:
+        param->value.ui = val->remote_typed_param_value.ui;
+        break;
+    case VIR_TYPED_PARAM_LLONG:
+        param->value.l = val->remote_typed_param_value.l;
+        break;
+    case VIR_TYPED_PARAM_ULLONG:
+        param->value.ul = val->remote_typed_param_value.ul;
+        break;
+    case VIR_TYPED_PARAM_DOUBLE:
+        param->value.d = val->remote_typed_param_value.d;
+        break;
+    case VIR_TYPED_PARAM_BOOLEAN:
+        param->value.b = val->remote_typed_param_value.b;
+        break;
+    case VIR_TYPED_PARAM_STRING:
+        param->value.s = g_strdup(val->remote_typed_param_value.s);
+        break;
+    default:
+        virReportError(VIR_ERR_RPC, _("unknown parameter type: %d"),
+                       param->type);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * virTypedParamSerializeValue:
+ * @param: parameter whose value is to be serialized
+ * @val: remote representation of the value to fill in
+ * @steal: move string value from @param instead of copying it
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virTypedParamSerializeValue(virTypedParameterPtr param,
+                            virTypedParameterRemoteValue *val,
+                            bool steal)
+{
+    val->type = param->type;
+    switch (param->type) {
+    case VIR_TYPED_PARAM_INT:
+        val->remote_typed_param_value.i = param->value.i;
+        break;
+    case VIR_TYPED_PARAM_UINT:
+        val->remote_typed_param_value.ui = param->value.ui;
+        break;
+    case VIR_TYPED_PARAM_LLONG:
+        val->remote_typed_param_value.l = param->value.l;
+        break;
+    case VIR_TYPED_PARAM_ULLONG:
+        val->remote_typed_param_value.ul = param->value.ul;
+        break;
+    case VIR_TYPED_PARAM_DOUBLE:
+        val->remote_typed_param_value.d = param->value.d;
+        break;
+    case VIR_TYPED_PARAM_BOOLEAN:
+        val->remote_typed_param_value.b = param->value.b;
+        break;
+    case VIR_TYPED_PARAM_STRING:
+        if (steal)
+            val->remote_typed_param_value.s = g_steal_pointer(&param->value.s);
+        else
+            val->remote_typed_param_value.s = g_strdup(param->value.s);
+        break;
+    default:
+        virReportError(VIR_ERR_RPC, _("unknown parameter type: %d"),
+                       param->type);
+        return -1;
+    }
+
+    return 0;
+}
+
+
 /**
  * virTypedParamsDeserialize:
  * @remote_params: protocol data to be deserialized (obtained from remote side)
@@ -569,40 +665,8 @@ virTypedParamsDeserialize(virTypedParameterRemotePtr remote_params,
             goto cleanup;
         }
 
-        param->type = remote_param->value.type;
-        switch (param->type) {
-        case VIR_TYPED_PARAM_INT:
-            param->value.i =
-                remote_param->value.remote_typed_param_value.i;
-            break;
-        case VIR_TYPED_PARAM_UINT:
-            param->value.ui =
-                remote_param->value.remote_typed_param_value.ui;
-            break;
-        case VIR_TYPED_PARAM_LLONG:
-            param->value.l =
-                remote_param->value.remote_typed_param_value.l;
-            break;
-        case VIR_TYPED_PARAM_ULLONG:
-            param->value.ul =
-                remote_param->value.remote_typed_param_value.ul;
-            break;
-        case VIR_TYPED_PARAM_DOUBLE:
-            param->value.d =
-                remote_param->value.remote_typed_param_value.d;
-            break;
-        case VIR_TYPED_PARAM_BOOLEAN:
-            param->value.b =
-                remote_param->value.remote_typed_param_value.b;
-            break;
-        case VIR_TYPED_PARAM_STRING:
-            param->value.s = g_strdup(remote_param->value.remote_typed_param_value.s);
-            break;
-        default:
-            virReportError(VIR_ERR_RPC, _("unknown parameter type: %d"),
-                           param->type);
+        if (virTypedParamDeserializeValue(&remote_param->value, param) < 0)
             goto cleanup;
-        }
     }
 
     rv = 0;
@@ -621,6 +685,16 @@ virTypedParamsDeserialize(virTypedParameterRemotePtr remote_params,
 }
 
 
+static int
+virTypedParamsSerializeInternal(virTypedParameterPtr params,
+                                int nparams,
+                                int limit,
+                                virTypedParameterRemotePtr *remote_params_val,
+                                unsigned int *remote_params_len,
+                                unsigned int flags,
+                                bool steal);
+
+
 /**
  * virTypedParamsSerialize:
  * @params: array of parameters to be serialized and later sent to remote side
@@ -648,6 +722,47 @@ virTypedParamsSerialize(virTypedParameterPtr params,
                         virTypedParameterRemotePtr *remote_params_val,
                         unsigned int *remote_params_len,
                         unsigned int flags)
+{
+    return virTypedParamsSerializeInternal(params, nparams, limit,
+                                           remote_params_val,
+                                           remote_params_len,
+                                           flags, false);
+}
+
+
+/**
+ * virTypedParamsSerializeSteal:
+ *
+ * Like virTypedParamsSerialize, except that string values are moved
+ * from @params into @remote_params_val instead of being copied. The
+ * strings in @params are left NULL, so this is meant for callers which
+ * free @params right after serializing them.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virTypedParamsSerializeSteal(virTypedParameterPtr params,
+                             int nparams,
+                             int limit,
+                             virTypedParameterRemotePtr *remote_params_val,
+                             unsigned int *remote_params_len,
+                             unsigned int flags)
+{
+    return virTypedParamsSerializeInternal(params, nparams, limit,
+                                           remote_params_val,
+                                           remote_params_len,
+                                           flags, true);
+}
+
+
+static int
+virTypedParamsSerializeInternal(virTypedParameterPtr params,
+                                int nparams,
+                                int limit,
+                                virTypedParameterRemotePtr *remote_params_val,
+                                unsigned int *remote_params_len,
+                                unsigned int flags,
+                                bool steal)
 {
     size_t i;
     size_t j;
@@ -681,34 +796,8 @@ virTypedParamsSerialize(virTypedParameterPtr params,
         /* This will be either freed by virNetServerDispatchCall or call(),
          * depending on the calling side, i.e. server or client */
         val->field = g_strdup(param->field);
-        val->value.type = param->type;
-        switch (param->type) {
-        case VIR_TYPED_PARAM_INT:
-            val->value.remote_typed_param_value.i = param->value.i;
-            break;
-        case VIR_TYPED_PARAM_UINT:
-            val->value.remote_typed_param_value.ui = param->value.ui;
-            break;
-        case VIR_TYPED_PARAM_LLONG:
-            val->value.remote_typed_param_value.l = param->value.l;
-            break;
-        case VIR_TYPED_PARAM_ULLONG:
-            val->value.remote_typed_param_value.ul = param->value.ul;
-            break;
-        case VIR_TYPED_PARAM_DOUBLE:
-            val->value.remote_typed_param_value.d = param->value.d;
-            break;
-        case VIR_TYPED_PARAM_BOOLEAN:
-            val->value.remote_typed_param_value.b = param->value.b;
-            break;
-        case VIR_TYPED_PARAM_STRING:
-            val->value.remote_typed_param_value.s = g_strdup(param->value.s);
-            break;
-        default:
-            virReportError(VIR_ERR_RPC, _("unknown parameter type: %d"),
-                           param->type);
+        if (virTypedParamSerializeValue(param, &val->value, steal) < 0)
             goto cleanup;
-        }
         j++;
     }
 
@@ -762,6 +851,23 @@ virTypedParamSetNameVPrintf(virTypedParameterPtr par,
 }
 
 
+/**
+ * virTypedParamListReserve:
+ * @list: list of typed parameters
+ * @count: number of parameters about to be added
+ *
+ * Makes room for @count more parameters in @list, so that callers
+ * which know roughly how many parameters they are going to add can
+ * avoid growing the list repeatedly.
+ */
+void
+virTypedParamListReserve(virTypedParamListPtr list,
+                         size_t count)
+{
+    ignore_value(VIR_RESIZE_N(list->par, list->par_alloc, list->npar, count));
+}
+
+
 static virTypedParameterPtr
 virTypedParamListExtend(virTypedParamListPtr list)
 {
@@ -926,3 +1032,35 @@ virTypedParamListAddDouble(virTypedParamListPtr list,
 
     return ret;
 }
+
+
+/**
+ * virTypedParamListAddCopy:
+ * @list: list to append to
+ * @params: typed parameters to copy
+ * @nparams: number of parameters in @params
+ *
+ * Appends copies of all the parameters in @params to @list.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virTypedParamListAddCopy(virTypedParamListPtr list,
+                         virTypedParameterPtr params,
+                         size_t nparams)
+{
+    size_t i;
+
+    if (VIR_RESIZE_N(list->par, list->par_alloc, list->npar, nparams) < 0)
+        return -1;
+
+    for (i = 0; i < nparams; i++) {
+        virTypedParameterPtr par = list->par + list->npar++;
+
+        *par = params[i];
+        if (params[i].type == VIR_TYPED_PARAM_STRING)
+            par->value.s = g_strdup(params[i].value.s);
+    }
+
+    return 0;
+}
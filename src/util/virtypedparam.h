@@ -98,6 +98,13 @@ char *virTypedParameterToString(virTypedParameterPtr param);
 void virTypedParamsRemoteFree(virTypedParameterRemotePtr remote_params_val,
                               unsigned int remote_params_len);
 
+int virTypedParamDeserializeValue(virTypedParameterRemoteValue *val,
+                                  virTypedParameterPtr param);
+
+int virTypedParamSerializeValue(virTypedParameterPtr param,
+                                virTypedParameterRemoteValue *val,
+                                bool steal);
+
 int virTypedParamsDeserialize(virTypedParameterRemotePtr remote_params,
                               unsigned int remote_params_len,
                               int limit,
@@ -111,6 +118,13 @@ int virTypedParamsSerialize(virTypedParameterPtr params,
                             unsigned int *remote_params_len,
                             unsigned int flags);
 
+int virTypedParamsSerializeSteal(virTypedParameterPtr params,
+                                 int nparams,
+                                 int limit,
+                                 virTypedParameterRemotePtr *remote_params_val,
+                                 unsigned int *remote_params_len,
+                                 unsigned int flags);
+
 VIR_ENUM_DECL(virTypedParameter);
 
 #define VIR_TYPED_PARAMS_DEBUG(params, nparams) \
@@ -143,6 +157,9 @@ G_DEFINE_AUTOPTR_CLEANUP_FUNC(virTypedParamList, virTypedParamListFree);
 size_t virTypedParamListStealParams(virTypedParamListPtr list,
                                     virTypedParameterPtr *params);
 
+void virTypedParamListReserve(virTypedParamListPtr list,
+                              size_t count);
+
 int virTypedParamListAddInt(virTypedParamListPtr list,
                             int value,
                             const char *namefmt,
@@ -178,3 +195,7 @@ int virTypedParamListAddDouble(virTypedParamListPtr list,
                                const char *namefmt,
                                ...)
     G_GNUC_PRINTF(3, 4) G_GNUC_WARN_UNUSED_RESULT;
+int virTypedParamListAddCopy(virTypedParamListPtr list,
+                             virTypedParameterPtr params,
+                             size_t nparams)
+    G_GNUC_WARN_UNUSED_RESULT;
@@ -33,6 +33,8 @@
 #include "virfile.h"
 #include "virstring.h"
 #include "virutil.h"
+#include "virhash.h"
+#include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_XML
 
@@ -46,6 +48,84 @@ struct virParserData {
 };
 
 
+/* Upper bound of cached compiled XPath expressions. Most expressions are
+ * string literals, the limit only guards against expressions formatted
+ * at runtime filling up the cache. */
+#define VIR_XPATH_CACHE_MAX 4096
+
+static virMutex virXPathCacheLock = VIR_MUTEX_INITIALIZER;
+static virHashTablePtr virXPathCache;
+
+
+static void
+virXPathCacheDataFree(void *payload)
+{
+    xmlXPathFreeCompExpr(payload);
+}
+
+
+static int
+virXPathCacheOnceInit(void)
+{
+    if (!(virXPathCache = virHashNew(virXPathCacheDataFree)))
+        return -1;
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virXPathCache);
+
+
+/**
+ * virXPathEval:
+ * @xpath: the XPath string to evaluate
+ * @ctxt: an XPath context
+ *
+ * Evaluates @xpath in @ctxt. The expression is compiled only the first
+ * time it is seen and the compiled form is shared by all later callers,
+ * which saves reparsing the same few hundred expressions for every parsed
+ * domain. Evaluating a compiled expression doesn't modify it, so it can
+ * be used from several threads at once.
+ *
+ * Returns the resulting object or NULL on failure.
+ */
+static xmlXPathObjectPtr
+virXPathEval(const char *xpath,
+             xmlXPathContextPtr ctxt)
+{
+    xmlXPathCompExprPtr comp;
+    xmlXPathObjectPtr obj;
+    bool cached = false;
+
+    if (virXPathCacheInitialize() < 0)
+        return xmlXPathEval(BAD_CAST xpath, ctxt);
+
+    virMutexLock(&virXPathCacheLock);
+    comp = virHashLookup(virXPathCache, xpath);
+    virMutexUnlock(&virXPathCacheLock);
+
+    if (comp)
+        return xmlXPathCompiledEval(comp, ctxt);
+
+    if (!(comp = xmlXPathCompile(BAD_CAST xpath)))
+        return xmlXPathEval(BAD_CAST xpath, ctxt);
+
+    virMutexLock(&virXPathCacheLock);
+    if (virHashSize(virXPathCache) < VIR_XPATH_CACHE_MAX &&
+        !virHashLookup(virXPathCache, xpath) &&
+        virHashAddEntry(virXPathCache, xpath, comp) == 0)
+        cached = true;
+    virMutexUnlock(&virXPathCacheLock);
+
+    obj = xmlXPathCompiledEval(comp, ctxt);
+
+    if (!cached)
+        xmlXPathFreeCompExpr(comp);
+
+    return obj;
+}
+
+
 xmlXPathContextPtr
 virXMLXPathContextNew(xmlDocPtr xml)
 {
@@ -56,6 +136,10 @@ virXMLXPathContextNew(xmlDocPtr xml)
         return NULL;
     }
 
+    /* Reuse XPath result objects across evaluations in this context
+     * instead of allocating a new one for every expression. */
+    ignore_value(xmlXPathContextSetCache(ctxt, 1, -1, 0));
+
     return ctxt;
 }
 
@@ -82,7 +166,7 @@ virXPathString(const char *xpath,
                        "%s", _("Invalid parameter to virXPathString()"));
         return NULL;
     }
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     if ((obj == NULL) || (obj->type != XPATH_STRING) ||
         (obj->stringval == NULL) || (obj->stringval[0] == 0)) {
         xmlXPathFreeObject(obj);
@@ -156,7 +240,7 @@ virXPathNumber(const char *xpath,
                        "%s", _("Invalid parameter to virXPathNumber()"));
         return -1;
     }
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     if ((obj == NULL) || (obj->type != XPATH_NUMBER) ||
         (isnan(obj->floatval))) {
         xmlXPathFreeObject(obj);
@@ -182,7 +266,7 @@ virXPathLongBase(const char *xpath,
                        "%s", _("Invalid parameter to virXPathLong()"));
         return -1;
     }
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
         if (virStrToLong_l((char *) obj->stringval, NULL, base, value) < 0)
@@ -284,7 +368,7 @@ virXPathULongBase(const char *xpath,
                        "%s", _("Invalid parameter to virXPathULong()"));
         return -1;
     }
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
         if (virStrToLong_ul((char *) obj->stringval, NULL, base, value) < 0)
@@ -397,7 +481,7 @@ virXPathULongLong(const char *xpath,
                        "%s", _("Invalid parameter to virXPathULong()"));
         return -1;
     }
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
         if (virStrToLong_ull((char *) obj->stringval, NULL, 10, value) < 0)
@@ -440,7 +524,7 @@ virXPathLongLong(const char *xpath,
                        "%s", _("Invalid parameter to virXPathLongLong()"));
         return -1;
     }
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
         if (virStrToLong_ll((char *) obj->stringval, NULL, 10, value) < 0)
@@ -579,7 +663,7 @@ virXPathBoolean(const char *xpath,
                        "%s", _("Invalid parameter to virXPathBoolean()"));
         return -1;
     }
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     if ((obj == NULL) || (obj->type != XPATH_BOOLEAN) ||
         (obj->boolval < 0) || (obj->boolval > 1)) {
         xmlXPathFreeObject(obj);
@@ -613,7 +697,7 @@ virXPathNode(const char *xpath,
                        "%s", _("Invalid parameter to virXPathNode()"));
         return NULL;
     }
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     if ((obj == NULL) || (obj->type != XPATH_NODESET) ||
         (obj->nodesetval == NULL) || (obj->nodesetval->nodeNr <= 0) ||
         (obj->nodesetval->nodeTab == NULL)) {
@@ -654,7 +738,7 @@ virXPathNodeSet(const char *xpath,
     if (list != NULL)
         *list = NULL;
 
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     if (obj == NULL)
         return 0;
 
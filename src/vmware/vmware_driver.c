@@ -327,7 +327,7 @@ vmwareUpdateVMStatus(struct vmware_driver *driver, virDomainObjPtr vm)
     }
 
     if (!found) {
-        vm->def->id = -1;
+        virDomainObjListSetID(driver->domains, vm, -1);
         newState = VIR_DOMAIN_SHUTOFF;
     }
 
@@ -355,7 +355,7 @@ vmwareStopVM(struct vmware_driver *driver,
     if (virCommandRun(cmd, NULL) < 0)
         return -1;
 
-    vm->def->id = -1;
+    virDomainObjListSetID(driver->domains, vm, -1);
     virDomainObjSetState(vm, VIR_DOMAIN_SHUTOFF, reason);
 
     return 0;
@@ -382,7 +382,8 @@ vmwareStartVM(struct vmware_driver *driver, virDomainObjPtr vm)
     if (virCommandRun(cmd, NULL) < 0)
         return -1;
 
-    if ((vm->def->id = vmwareExtractPid(vmxPath)) < 0) {
+    virDomainObjListSetID(driver->domains, vm, vmwareExtractPid(vmxPath));
+    if (vm->def->id < 0) {
         vmwareStopVM(driver, vm, VIR_DOMAIN_SHUTOFF_FAILED);
         return -1;
     }
@@ -26,6 +26,7 @@
 #include "virerror.h"
 #include "viralloc.h"
 #include "virstring.h"
+#include "virstringintern.h"
 #include "virlog.h"
 #include "datatypes.h"
 #include "domain_conf.h"
@@ -775,7 +776,7 @@ prlsdkGetFSInfo(PRL_HANDLE prldisk,
         fs->type = VIR_DOMAIN_FS_TYPE_VOLUME;
         if (VIR_ALLOC(fs->src->srcpool) < 0)
             goto cleanup;
-        fs->src->srcpool->pool = g_strdup(matches[1]);
+        fs->src->srcpool->pool = virStringIntern(matches[1]);
         fs->src->srcpool->volume = g_strdup(matches[2]);
         VIR_FREE(buf);
     } else {
@@ -1374,7 +1375,8 @@ prlsdkAddVNCInfo(PRL_HANDLE sdkdom, virDomainDefPtr def)
 }
 
 static void
-prlsdkConvertDomainState(VIRTUAL_MACHINE_STATE domainState,
+prlsdkConvertDomainState(vzDriverPtr driver,
+                         VIRTUAL_MACHINE_STATE domainState,
                          PRL_UINT32 envId,
                          virDomainObjPtr dom)
 {
@@ -1383,7 +1385,7 @@ prlsdkConvertDomainState(VIRTUAL_MACHINE_STATE domainState,
     case VMS_MOUNTED:
         virDomainObjSetState(dom, VIR_DOMAIN_SHUTOFF,
                              VIR_DOMAIN_SHUTOFF_SHUTDOWN);
-        dom->def->id = -1;
+        virDomainObjListSetID(driver->domains, dom, -1);
         break;
     case VMS_STARTING:
     case VMS_COMPACTING:
@@ -1393,60 +1395,60 @@ prlsdkConvertDomainState(VIRTUAL_MACHINE_STATE domainState,
     case VMS_RUNNING:
         virDomainObjSetState(dom, VIR_DOMAIN_RUNNING,
                              VIR_DOMAIN_RUNNING_BOOTED);
-        dom->def->id = envId;
+        virDomainObjListSetID(driver->domains, dom, envId);
         break;
     case VMS_PAUSED:
         virDomainObjSetState(dom, VIR_DOMAIN_PAUSED,
                              VIR_DOMAIN_PAUSED_USER);
-        dom->def->id = envId;
+        virDomainObjListSetID(driver->domains, dom, envId);
         break;
     case VMS_SUSPENDED:
     case VMS_DELETING_STATE:
     case VMS_SUSPENDING_SYNC:
         virDomainObjSetState(dom, VIR_DOMAIN_SHUTOFF,
                              VIR_DOMAIN_SHUTOFF_SAVED);
-        dom->def->id = -1;
+        virDomainObjListSetID(driver->domains, dom, -1);
         break;
     case VMS_STOPPING:
         virDomainObjSetState(dom, VIR_DOMAIN_SHUTDOWN,
                              VIR_DOMAIN_SHUTDOWN_USER);
-        dom->def->id = envId;
+        virDomainObjListSetID(driver->domains, dom, envId);
         break;
     case VMS_SNAPSHOTING:
         virDomainObjSetState(dom, VIR_DOMAIN_PAUSED,
                              VIR_DOMAIN_PAUSED_SNAPSHOT);
-        dom->def->id = envId;
+        virDomainObjListSetID(driver->domains, dom, envId);
         break;
     case VMS_MIGRATING:
         virDomainObjSetState(dom, VIR_DOMAIN_PAUSED,
                              VIR_DOMAIN_PAUSED_MIGRATION);
-        dom->def->id = envId;
+        virDomainObjListSetID(driver->domains, dom, envId);
         break;
     case VMS_SUSPENDING:
         virDomainObjSetState(dom, VIR_DOMAIN_PAUSED,
                              VIR_DOMAIN_PAUSED_SAVE);
-        dom->def->id = envId;
+        virDomainObjListSetID(driver->domains, dom, envId);
         break;
     case VMS_RESTORING:
         virDomainObjSetState(dom, VIR_DOMAIN_RUNNING,
                              VIR_DOMAIN_RUNNING_RESTORED);
-        dom->def->id = envId;
+        virDomainObjListSetID(driver->domains, dom, envId);
         break;
     case VMS_CONTINUING:
         virDomainObjSetState(dom, VIR_DOMAIN_RUNNING,
                              VIR_DOMAIN_RUNNING_UNPAUSED);
-        dom->def->id = envId;
+        virDomainObjListSetID(driver->domains, dom, envId);
         break;
     case VMS_RESUMING:
         virDomainObjSetState(dom, VIR_DOMAIN_RUNNING,
                              VIR_DOMAIN_RUNNING_RESTORED);
-        dom->def->id = envId;
+        virDomainObjListSetID(driver->domains, dom, envId);
         break;
     case VMS_UNKNOWN:
     default:
         virDomainObjSetState(dom, VIR_DOMAIN_NOSTATE,
                              VIR_DOMAIN_NOSTATE_UNKNOWN);
-        dom->def->id = -1;
+        virDomainObjListSetID(driver->domains, dom, -1);
         break;
     }
 }
@@ -1955,7 +1957,7 @@ prlsdkLoadDomain(vzDriverPtr driver,
     pdom = dom->privateData;
     pdom->id = envId;
 
-    prlsdkConvertDomainState(domainState, envId, dom);
+    prlsdkConvertDomainState(driver, domainState, envId, dom);
 
     if (autostart == PAO_VM_START_ON_LOAD)
         dom->autostart = 1;
@@ -2125,7 +2127,7 @@ prlsdkHandleVmStateEvent(vzDriverPtr driver,
 
     pdom = dom->privateData;
 
-    prlsdkConvertDomainState(domainState, pdom->id, dom);
+    prlsdkConvertDomainState(driver, domainState, pdom->id, dom);
 
     prlsdkNewStateToEvent(domainState,
                           &lvEventType,
@@ -40,6 +40,9 @@
 #include "virprocess.h"
 #include "virutil.h"
 
+#define LIBVIRT_VIRCOMMANDPRIV_H_ALLOW
+#include "vircommandpriv.h"
+
 #define VIR_FROM_THIS VIR_FROM_NONE
 
 #ifdef WIN32
@@ -1183,6 +1186,122 @@ test28(const void *unused G_GNUC_UNUSED)
 }
 
 
+static int
+test29Hook(void *data G_GNUC_UNUSED)
+{
+    return 0;
+}
+
+
+/*
+ * Run program with a custom environment, keep CWD, with stdin/out/err
+ * buffers and a leaked FD which must be closed in the child. Commands
+ * which need no setup in the child are started with posix_spawn() if
+ * possible, a pre-exec hook makes them go through virFork() instead.
+ * Either way the child has to see the same process state.
+ */
+static int
+test29Run(bool spawn)
+{
+    g_autoptr(virCommand) cmd = NULL;
+    g_autoptr(virCommand) failcmd = NULL;
+    g_autofree char *outactual = NULL;
+    g_autofree char *erractual = NULL;
+    const char *outexpect = "BEGIN STDOUT\nHello\nEND STDOUT\n";
+    const char *errexpect = "BEGIN STDERR\nHello\nEND STDERR\n";
+    int leaked = -1;
+    int status = -1;
+    int ret = -1;
+
+    if ((leaked = open("/dev/null", O_RDONLY)) < 0) {
+        printf("Cannot open /dev/null: %s\n", g_strerror(errno));
+        goto cleanup;
+    }
+
+    cmd = virCommandNew(abs_builddir "/commandhelper");
+    virCommandAddEnvPass(cmd, "HOME");
+    virCommandAddEnvPair(cmd, "TEST29", "yes");
+    virCommandSetInputBuffer(cmd, "Hello\n");
+    virCommandSetOutputBuffer(cmd, &outactual);
+    virCommandSetErrorBuffer(cmd, &erractual);
+    if (!spawn)
+        virCommandSetPreExecHook(cmd, test29Hook, NULL);
+
+    if (virCommandRun(cmd, &status) < 0) {
+        printf("Cannot run child %s\n", virGetLastErrorMessage());
+        goto cleanup;
+    }
+
+    if (virCommandIsSpawned(cmd) != spawn) {
+        printf("Child was %s spawned\n", spawn ? "not" : "unexpectedly");
+        goto cleanup;
+    }
+
+    if (status != 0) {
+        printf("Unexpected status %d\n", status);
+        goto cleanup;
+    }
+
+    if (STRNEQ_NULLABLE(outactual, outexpect)) {
+        virTestDifference(stderr, outexpect, NULLSTR(outactual));
+        goto cleanup;
+    }
+    if (STRNEQ_NULLABLE(erractual, errexpect)) {
+        virTestDifference(stderr, errexpect, NULLSTR(erractual));
+        goto cleanup;
+    }
+
+    if (checkoutput("test29") < 0)
+        goto cleanup;
+
+    /* commandhelper fails to parse the fd and exits with EXIT_FAILURE */
+    failcmd = virCommandNewArgList(abs_builddir "/commandhelper",
+                                   "--readfd", "bogus", NULL);
+    if (!spawn)
+        virCommandSetPreExecHook(failcmd, test29Hook, NULL);
+
+    if (virCommandRun(failcmd, &status) < 0) {
+        printf("Cannot run child %s\n", virGetLastErrorMessage());
+        goto cleanup;
+    }
+
+    if (virCommandIsSpawned(failcmd) != spawn) {
+        printf("Child was %s spawned\n", spawn ? "not" : "unexpectedly");
+        goto cleanup;
+    }
+
+    if (status != EXIT_FAILURE) {
+        printf("Expected status %d, got %d\n", EXIT_FAILURE, status);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    unlink(abs_builddir "/commandhelper.log");
+    VIR_FORCE_CLOSE(leaked);
+    return ret;
+}
+
+
+static int
+test29(const void *unused G_GNUC_UNUSED)
+{
+    return test29Run(false);
+}
+
+
+static int
+test30(const void *unused G_GNUC_UNUSED)
+{
+# ifdef HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP
+    return test29Run(true);
+# else
+    return EXIT_AM_SKIP;
+# endif
+}
+
+
 static int
 mymain(void)
 {
@@ -1281,6 +1400,8 @@ mymain(void)
     DO_TEST(test26);
     DO_TEST(test27);
     DO_TEST(test28);
+    DO_TEST(test29);
+    DO_TEST(test30);
 
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
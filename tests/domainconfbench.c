@@ -0,0 +1,181 @@
+/*
+ * domainconfbench.c: benchmarks of domain XML handling
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "testutilsbench.h"
+#include "virerror.h"
+#include "virfile.h"
+#include "virstring.h"
+
+#include "domain_conf.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+#define TEST_BENCH_SUITE "domainconf"
+
+static virDomainXMLOptionPtr xmlopt;
+
+typedef struct {
+    char **xmls;
+    size_t nxmls;
+    virDomainDefPtr *defs; /* of the files the generic parser accepts */
+    size_t ndefs;
+} testBenchData;
+
+
+static int
+testBenchLoadDir(testBenchData *data,
+                 const char *dirname)
+{
+    g_autofree char *path = g_strdup_printf("%s/%s", abs_srcdir, dirname);
+    DIR *dir = NULL;
+    struct dirent *ent;
+    int rc;
+
+    if (virDirOpen(&dir, path) < 0)
+        return -1;
+
+    while ((rc = virDirRead(dir, &ent, path)) > 0) {
+        g_autofree char *filename = NULL;
+        char *xml = NULL;
+
+        if (!virStringHasSuffix(ent->d_name, ".xml"))
+            continue;
+
+        filename = g_strdup_printf("%s/%s", path, ent->d_name);
+        if (virFileReadAll(filename, 1024 * 1024, &xml) < 0) {
+            rc = -1;
+            break;
+        }
+
+        data->xmls = g_renew(char *, data->xmls, data->nxmls + 2);
+        data->xmls[data->nxmls++] = xml;
+        data->xmls[data->nxmls] = NULL;
+    }
+
+    VIR_DIR_CLOSE(dir);
+    return rc;
+}
+
+
+/*
+ * Parsing of the whole corpus, as happens when the daemon loads all
+ * persistent configs at startup. Files the generic parser can't handle
+ * count as well, they fail late enough to exercise most of the parser.
+ */
+static int
+testBenchParse(const void *opaque,
+               size_t iterations)
+{
+    const testBenchData *data = opaque;
+    size_t i;
+
+    for (i = 0; i < iterations; i++) {
+        virDomainDefPtr def;
+
+        def = virDomainDefParseString(data->xmls[i % data->nxmls],
+                                      xmlopt, NULL, 0);
+        virDomainDefFree(def);
+    }
+
+    virResetLastError();
+    return 0;
+}
+
+
+/*
+ * Copies of all disks and interfaces of a definition, as made by
+ * virDomainDeviceDefCopy for hotplug and device updates.
+ */
+static int
+testBenchDeviceCopy(const void *opaque,
+                    size_t iterations)
+{
+    const testBenchData *data = opaque;
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < iterations; i++) {
+        virDomainDefPtr def = data->defs[i % data->ndefs];
+
+        for (j = 0; j < def->ndisks + def->nnets; j++) {
+            virDomainDeviceDef dev = { 0 };
+            virDomainDeviceDefPtr copy;
+
+            if (j < def->ndisks) {
+                dev.type = VIR_DOMAIN_DEVICE_DISK;
+                dev.data.disk = def->disks[j];
+            } else {
+                dev.type = VIR_DOMAIN_DEVICE_NET;
+                dev.data.net = def->nets[j - def->ndisks];
+            }
+
+            if (!(copy = virDomainDeviceDefCopy(&dev, def, xmlopt, NULL)))
+                return -1;
+            virDomainDeviceDefFree(copy);
+        }
+    }
+
+    return 0;
+}
+
+
+static int
+mymain(void)
+{
+    testBenchData data = { 0 };
+    size_t i;
+    int ret = -1;
+
+    if (!(xmlopt = virTestGenericDomainXMLConfInit()))
+        return EXIT_FAILURE;
+
+    if (testBenchLoadDir(&data, "qemuxml2argvdata") < 0 || !data.nxmls)
+        goto cleanup;
+
+    for (i = 0; i < data.nxmls; i++) {
+        virDomainDefPtr def;
+
+        if (!(def = virDomainDefParseString(data.xmls[i], xmlopt, NULL, 0)))
+            continue;
+
+        data.defs = g_renew(virDomainDefPtr, data.defs, data.ndefs + 1);
+        data.defs[data.ndefs++] = def;
+    }
+    virResetLastError();
+
+    if (testBenchRun(TEST_BENCH_SUITE, "parse", testBenchParse,
+                     &data, 10 * data.nxmls) < 0 ||
+        testBenchRun(TEST_BENCH_SUITE, "device-copy", testBenchDeviceCopy,
+                     &data, 10 * data.ndefs) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < data.ndefs; i++)
+        virDomainDefFree(data.defs[i]);
+    g_free(data.defs);
+    g_strfreev(data.xmls);
+    virObjectUnref(xmlopt);
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
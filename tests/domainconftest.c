@@ -22,6 +22,8 @@
 #include "virerror.h"
 #include "viralloc.h"
 #include "virlog.h"
+#include "virfile.h"
+#include "virstring.h"
 
 #include "domain_conf.h"
 
@@ -76,6 +78,96 @@ static int testGetFilesystem(const void *opaque)
     return ret;
 }
 
+
+/*
+ * Checks that the structural device copies match what a round-trip
+ * through the inactive XML produces, by replacing the devices in
+ * a round-trip copy of the definition and comparing the results.
+ */
+static int
+testDeviceCopy(const void *opaque)
+{
+    const char *filename = opaque;
+    g_autoptr(virDomainDef) def = NULL;
+    g_autoptr(virDomainDef) expect = NULL;
+    g_autoptr(virDomainDef) actual = NULL;
+    g_autofree char *expectXML = NULL;
+    g_autofree char *actualXML = NULL;
+    unsigned int flags = VIR_DOMAIN_DEF_FORMAT_INACTIVE |
+                         VIR_DOMAIN_DEF_FORMAT_SECURE;
+    size_t i;
+
+    /* Not every file can be handled by the generic parser */
+    if (!(def = virDomainDefParseFile(filename, xmlopt, NULL, 0)) ||
+        !(expect = virDomainDefCopy(def, xmlopt, NULL, false)) ||
+        !(actual = virDomainDefCopy(def, xmlopt, NULL, false))) {
+        VIR_TEST_DEBUG("skipping: %s", virGetLastErrorMessage());
+        return EXIT_AM_SKIP;
+    }
+
+    for (i = 0; i < actual->ndisks; i++) {
+        virDomainDiskDefFree(actual->disks[i]);
+        if (!(actual->disks[i] = virDomainDiskDefCopy(def->disks[i], xmlopt)))
+            return -1;
+    }
+
+    for (i = 0; i < actual->nnets; i++) {
+        /* the hostdev is shared with def->hostdevs */
+        if (def->nets[i]->type == VIR_DOMAIN_NET_TYPE_HOSTDEV)
+            continue;
+
+        virDomainNetDefFree(actual->nets[i]);
+        if (!(actual->nets[i] = virDomainNetDefCopy(def->nets[i], xmlopt)))
+            return -1;
+    }
+
+    if (!(expectXML = virDomainDefFormat(expect, xmlopt, flags)) ||
+        !(actualXML = virDomainDefFormat(actual, xmlopt, flags)))
+        return -1;
+
+    if (STRNEQ(expectXML, actualXML)) {
+        virTestDifference(stderr, expectXML, actualXML);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testDeviceCopyDir(const char *dirname)
+{
+    g_autofree char *path = g_strdup_printf("%s/%s", abs_srcdir, dirname);
+    DIR *dir = NULL;
+    struct dirent *ent;
+    int ret = 0;
+    int rc;
+
+    if (virDirOpen(&dir, path) < 0)
+        return -1;
+
+    while ((rc = virDirRead(dir, &ent, path)) > 0) {
+        g_autofree char *filename = NULL;
+        g_autofree char *name = NULL;
+
+        if (!virStringHasSuffix(ent->d_name, ".xml"))
+            continue;
+
+        filename = g_strdup_printf("%s/%s", path, ent->d_name);
+        name = g_strdup_printf("Device copy %s", ent->d_name);
+
+        if (virTestRun(name, testDeviceCopy, filename) < 0)
+            ret = -1;
+    }
+
+    if (rc < 0)
+        ret = -1;
+
+    VIR_DIR_CLOSE(dir);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -103,6 +195,9 @@ mymain(void)
     DO_TEST_GET_FS("/dev/pts", false);
     DO_TEST_GET_FS("/doesnotexist", false);
 
+    if (testDeviceCopyDir("qemuxml2argvdata") < 0)
+        ret = -1;
+
     virObjectUnref(caps);
     virObjectUnref(xmlopt);
 
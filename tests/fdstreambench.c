@@ -0,0 +1,270 @@
+/*
+ * fdstreambench.c: benchmarks of sparse file streams
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <fcntl.h>
+
+#include "testutils.h"
+#include "testutilsbench.h"
+
+#include "virfdstream.h"
+#include "datatypes.h"
+#include "virerror.h"
+#include "virfile.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+#define TEST_BENCH_SUITE "fdstream"
+
+#if HAVE_DECL_SEEK_HOLE
+
+/* 256 MiB of data spread over 1.25 GiB */
+# define SPARSE_SECTIONS 1024
+# define SPARSE_DATA_LEN (256 * 1024)
+# define SPARSE_HOLE_LEN (1024 * 1024)
+
+typedef struct {
+    virConnectPtr conn;
+    char *src;
+    char *dst;
+} testBenchData;
+
+
+/* Creates @file with @nsections data sections, each preceded by a hole,
+ * followed by a trailing hole */
+static int
+testFDStreamSparseCreate(const char *file,
+                         size_t nsections,
+                         size_t datalen,
+                         size_t holelen)
+{
+    g_autofree char *buf = g_new0(char, datalen);
+    int fd;
+    size_t i;
+
+    memset(buf, 'x', datalen);
+
+    if ((fd = open(file, O_CREAT|O_WRONLY|O_TRUNC, 0600)) < 0)
+        return -1;
+
+    for (i = 0; i < nsections; i++) {
+        if (lseek(fd, holelen, SEEK_CUR) < 0 ||
+            safewrite(fd, buf, datalen) != (ssize_t) datalen) {
+            VIR_FORCE_CLOSE(fd);
+            return -1;
+        }
+    }
+
+    if (ftruncate(fd, nsections * (holelen + datalen) + holelen) < 0) {
+        VIR_FORCE_CLOSE(fd);
+        return -1;
+    }
+
+    return VIR_CLOSE(fd);
+}
+
+
+static int
+testFDStreamSparseRecv(virConnectPtr conn,
+                       const char *file,
+                       unsigned long long *data,
+                       unsigned long long *holes)
+{
+    size_t buflen = 256 * 1024;
+    g_autofree char *buf = g_new0(char, buflen);
+    virStreamPtr st = NULL;
+    int ret = -1;
+
+    *data = *holes = 0;
+
+    if (!(st = virStreamNew(conn, VIR_STREAM_NONBLOCK)))
+        return -1;
+
+    if (virFDStreamOpenBlockDevice(st, file, 0, 0, true, O_RDONLY) < 0)
+        goto cleanup;
+
+    while (true) {
+        int inData;
+        long long len;
+
+        if (st->driver->streamInData(st, &inData, &len) < 0)
+            goto cleanup;
+
+        if (!inData && len == 0)
+            break;
+
+        if (inData) {
+            int got = st->driver->streamRecv(st, buf,
+                                             MIN(len, (long long) buflen));
+
+            if (got <= 0)
+                goto cleanup;
+            *data += got;
+        } else {
+            if (st->driver->streamSendHole(st, len, 0) < 0)
+                goto cleanup;
+            *holes += len;
+        }
+    }
+
+    if (st->driver->streamFinish(st) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    if (ret < 0)
+        fprintf(stderr, "Failed to receive sparse stream: %s\n",
+                virGetLastErrorMessage());
+    virStreamFree(st);
+    return ret;
+}
+
+
+static int
+testFDStreamSparseSend(virConnectPtr conn,
+                       const char *file,
+                       size_t nsections,
+                       size_t datalen,
+                       size_t holelen)
+{
+    g_autofree char *buf = g_new0(char, datalen);
+    virStreamPtr st = NULL;
+    size_t i;
+    int fd;
+    int ret = -1;
+
+    memset(buf, 'x', datalen);
+
+    if ((fd = open(file, O_CREAT|O_WRONLY|O_TRUNC, 0600)) < 0 ||
+        VIR_CLOSE(fd) < 0)
+        return -1;
+
+    if (!(st = virStreamNew(conn, VIR_STREAM_NONBLOCK)))
+        return -1;
+
+    if (virFDStreamOpenBlockDevice(st, file, 0, 0, true, O_WRONLY) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nsections; i++) {
+        if (st->driver->streamSendHole(st, holelen, 0) < 0 ||
+            st->driver->streamSend(st, buf, datalen) != (int) datalen)
+            goto cleanup;
+    }
+
+    if (st->driver->streamSendHole(st, holelen, 0) < 0 ||
+        st->driver->streamFinish(st) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    if (ret < 0)
+        fprintf(stderr, "Failed to send sparse stream: %s\n",
+                virGetLastErrorMessage());
+    virStreamFree(st);
+    return ret;
+}
+
+
+/* Downloads of the whole sparse file */
+static int
+testBenchSparseRecv(const void *opaque,
+                    size_t iterations)
+{
+    const testBenchData *data = opaque;
+    unsigned long long len;
+    unsigned long long holes;
+    size_t i;
+
+    for (i = 0; i < iterations; i++) {
+        if (testFDStreamSparseRecv(data->conn, data->src, &len, &holes) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/* Uploads of the whole sparse file */
+static int
+testBenchSparseSend(const void *opaque,
+                    size_t iterations)
+{
+    const testBenchData *data = opaque;
+    size_t i;
+
+    for (i = 0; i < iterations; i++) {
+        if (testFDStreamSparseSend(data->conn, data->dst, SPARSE_SECTIONS,
+                                   SPARSE_DATA_LEN, SPARSE_HOLE_LEN) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+# define SCRATCHDIRTEMPLATE abs_builddir "/fdstreambenchdir-XXXXXX"
+
+static int
+mymain(void)
+{
+    char scratchdir[] = SCRATCHDIRTEMPLATE;
+    testBenchData data = { 0 };
+    int ret = -1;
+
+    if (!g_mkdtemp(scratchdir)) {
+        fprintf(stderr, "Cannot create fdstreambenchdir");
+        return EXIT_FAILURE;
+    }
+
+    data.src = g_strdup_printf("%s/sparse-src.data", scratchdir);
+    data.dst = g_strdup_printf("%s/sparse-dst.data", scratchdir);
+
+    if (!(data.conn = virConnectOpen("test:///default")))
+        goto cleanup;
+
+    if (testFDStreamSparseCreate(data.src, SPARSE_SECTIONS,
+                                 SPARSE_DATA_LEN, SPARSE_HOLE_LEN) < 0)
+        goto cleanup;
+
+    if (testBenchRun(TEST_BENCH_SUITE, "sparse-download",
+                     testBenchSparseRecv, &data, 4) < 0 ||
+        testBenchRun(TEST_BENCH_SUITE, "sparse-upload",
+                     testBenchSparseSend, &data, 4) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    virConnectClose(data.conn);
+    g_free(data.src);
+    g_free(data.dst);
+    virFileDeleteTree(scratchdir);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
+
+#else /* !HAVE_DECL_SEEK_HOLE */
+int
+main(void)
+{
+    return EXIT_AM_SKIP;
+}
+#endif /* !HAVE_DECL_SEEK_HOLE */
@@ -19,6 +19,7 @@
 #include <config.h>
 
 #include <fcntl.h>
+#include <sys/stat.h>
 
 #include "testutils.h"
 
@@ -310,6 +311,200 @@ static int testFDStreamWriteNonblock(const void *data)
     return testFDStreamWriteCommon(data, false);
 }
 
+
+#if HAVE_DECL_SEEK_HOLE
+/* Creates @file with @nsections data sections, each preceded by a hole,
+ * followed by a trailing hole */
+static int
+testFDStreamSparseCreate(const char *file,
+                         size_t nsections,
+                         size_t datalen,
+                         size_t holelen)
+{
+    g_autofree char *buf = g_new0(char, datalen);
+    int fd;
+    size_t i;
+
+    memset(buf, 'x', datalen);
+
+    if ((fd = open(file, O_CREAT|O_WRONLY|O_TRUNC, 0600)) < 0)
+        return -1;
+
+    for (i = 0; i < nsections; i++) {
+        if (lseek(fd, holelen, SEEK_CUR) < 0 ||
+            safewrite(fd, buf, datalen) != (ssize_t) datalen) {
+            VIR_FORCE_CLOSE(fd);
+            return -1;
+        }
+    }
+
+    if (ftruncate(fd, nsections * (holelen + datalen) + holelen) < 0) {
+        VIR_FORCE_CLOSE(fd);
+        return -1;
+    }
+
+    return VIR_CLOSE(fd);
+}
+
+
+static int
+testFDStreamSparseRecv(virConnectPtr conn,
+                       const char *file,
+                       unsigned long long *data,
+                       unsigned long long *holes)
+{
+    size_t buflen = 256 * 1024;
+    g_autofree char *buf = g_new0(char, buflen);
+    virStreamPtr st = NULL;
+    int ret = -1;
+
+    *data = *holes = 0;
+
+    if (!(st = virStreamNew(conn, VIR_STREAM_NONBLOCK)))
+        return -1;
+
+    if (virFDStreamOpenBlockDevice(st, file, 0, 0, true, O_RDONLY) < 0)
+        goto cleanup;
+
+    while (true) {
+        int inData;
+        long long len;
+
+        if (st->driver->streamInData(st, &inData, &len) < 0)
+            goto cleanup;
+
+        if (!inData && len == 0)
+            break;
+
+        if (inData) {
+            int got = st->driver->streamRecv(st, buf,
+                                             MIN(len, (long long) buflen));
+
+            if (got <= 0)
+                goto cleanup;
+            *data += got;
+        } else {
+            if (st->driver->streamSendHole(st, len, 0) < 0)
+                goto cleanup;
+            *holes += len;
+        }
+    }
+
+    if (st->driver->streamFinish(st) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    if (ret < 0)
+        fprintf(stderr, "Failed to receive sparse stream: %s\n",
+                virGetLastErrorMessage());
+    virStreamFree(st);
+    return ret;
+}
+
+
+static int
+testFDStreamSparseSend(virConnectPtr conn,
+                       const char *file,
+                       size_t nsections,
+                       size_t datalen,
+                       size_t holelen)
+{
+    g_autofree char *buf = g_new0(char, datalen);
+    virStreamPtr st = NULL;
+    size_t i;
+    int fd;
+    int ret = -1;
+
+    memset(buf, 'x', datalen);
+
+    if ((fd = open(file, O_CREAT|O_WRONLY|O_TRUNC, 0600)) < 0 ||
+        VIR_CLOSE(fd) < 0)
+        return -1;
+
+    if (!(st = virStreamNew(conn, VIR_STREAM_NONBLOCK)))
+        return -1;
+
+    if (virFDStreamOpenBlockDevice(st, file, 0, 0, true, O_WRONLY) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nsections; i++) {
+        if (st->driver->streamSendHole(st, holelen, 0) < 0 ||
+            st->driver->streamSend(st, buf, datalen) != (int) datalen)
+            goto cleanup;
+    }
+
+    if (st->driver->streamSendHole(st, holelen, 0) < 0 ||
+        st->driver->streamFinish(st) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    if (ret < 0)
+        fprintf(stderr, "Failed to send sparse stream: %s\n",
+                virGetLastErrorMessage());
+    virStreamFree(st);
+    return ret;
+}
+
+
+#define SPARSE_SECTIONS 16
+#define SPARSE_DATA_LEN (64 * 1024)
+#define SPARSE_HOLE_LEN (1024 * 1024)
+
+static int
+testFDStreamSparse(const void *opaque)
+{
+    const char *scratchdir = opaque;
+    g_autofree char *src = g_strdup_printf("%s/sparse-src.data", scratchdir);
+    g_autofree char *dst = g_strdup_printf("%s/sparse-dst.data", scratchdir);
+    unsigned long long data;
+    unsigned long long holes;
+    virConnectPtr conn = NULL;
+    struct stat sb;
+    int ret = -1;
+
+    if (!(conn = virConnectOpen("test:///default")))
+        return -1;
+
+    if (testFDStreamSparseCreate(src, SPARSE_SECTIONS,
+                                 SPARSE_DATA_LEN, SPARSE_HOLE_LEN) < 0)
+        goto cleanup;
+
+    if (testFDStreamSparseRecv(conn, src, &data, &holes) < 0)
+        goto cleanup;
+
+    /* the file system might not support holes, but nothing is lost */
+    if (data + holes != SPARSE_SECTIONS * (SPARSE_DATA_LEN + SPARSE_HOLE_LEN) +
+                        SPARSE_HOLE_LEN ||
+        data < SPARSE_SECTIONS * SPARSE_DATA_LEN) {
+        fprintf(stderr, "Unexpected sparse stream: data=%llu holes=%llu\n",
+                data, holes);
+        goto cleanup;
+    }
+
+    if (testFDStreamSparseSend(conn, dst, SPARSE_SECTIONS,
+                               SPARSE_DATA_LEN, SPARSE_HOLE_LEN) < 0)
+        goto cleanup;
+
+    if (stat(dst, &sb) < 0 ||
+        (unsigned long long) sb.st_size != SPARSE_SECTIONS * (SPARSE_DATA_LEN + SPARSE_HOLE_LEN) +
+                      SPARSE_HOLE_LEN) {
+        fprintf(stderr, "Unexpected size of uploaded sparse file\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    unlink(src);
+    unlink(dst);
+    virConnectClose(conn);
+    return ret;
+}
+
+
+#endif /* HAVE_DECL_SEEK_HOLE */
+
 #define SCRATCHDIRTEMPLATE abs_builddir "/fdstreamdir-XXXXXX"
 
 static int
@@ -331,6 +526,10 @@ mymain(void)
         ret = -1;
     if (virTestRun("Stream write non-blocking ", testFDStreamWriteNonblock, scratchdir) < 0)
         ret = -1;
+#if HAVE_DECL_SEEK_HOLE
+    if (virTestRun("Stream sparse ", testFDStreamSparse, scratchdir) < 0)
+        ret = -1;
+#endif
 
     if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
         virFileDeleteTree(scratchdir);
@@ -178,6 +178,9 @@ mymain(void)
 
     DO_TEST("vcpus-individual");
     DO_TEST("disk-network-http");
+    DO_TEST("disk-latency-histogram");
+    DO_TEST_FULL("disk-latency-histogram-unordered", 0, false,
+                 TEST_COMPARE_DOM_XML2XML_RESULT_FAIL_PARSE);
 
     DO_TEST("cpu-cache-emulate");
     DO_TEST("cpu-cache-passthrough");
@@ -227,12 +230,16 @@ mymain(void)
                  TEST_COMPARE_DOM_XML2XML_RESULT_FAIL_PARSE);
     DO_TEST_FULL("memorytune-colliding-cachetune", false, true,
                  TEST_COMPARE_DOM_XML2XML_RESULT_FAIL_PARSE);
+    DO_TEST_DIFFERENT("memorytune-target");
+    DO_TEST_FULL("memorytune-target-no-monitor", false, true,
+                 TEST_COMPARE_DOM_XML2XML_RESULT_FAIL_PARSE);
 
     DO_TEST("tseg");
 
     DO_TEST("launch-security-sev");
 
     DO_TEST_DIFFERENT("cputune");
+    DO_TEST("vcpu-placement-topology");
 
 #define DO_TEST_BACKUP_FULL(name, intrnl) \
     do { \
@@ -254,6 +261,7 @@ mymain(void)
     DO_TEST_BACKUP("backup-push-encrypted");
 
     DO_TEST_BACKUP_FULL("backup-pull-internal-invalid", true);
+    DO_TEST_BACKUP_FULL("backup-push-internal-queued", true);
 
 
     virObjectUnref(caps);
@@ -128,6 +128,9 @@ mymain(void)
         = dnsmasqCapsNewFromBuffer("Dnsmasq version 2.63\n--bind-dynamic", DNSMASQ);
     dnsmasqCapsPtr dhcpv6
         = dnsmasqCapsNewFromBuffer("Dnsmasq version 2.64\n--bind-dynamic", DNSMASQ);
+    dnsmasqCapsPtr hostsdir
+        = dnsmasqCapsNewFromBuffer("Dnsmasq version 2.73\n--bind-dynamic\n"
+                                   "--dhcp-hostsdir", DNSMASQ);
 
 #define DO_TEST(xname, xcaps) \
     do { \
@@ -167,7 +170,9 @@ mymain(void)
     DO_TEST("leasetime-minutes", full);
     DO_TEST("leasetime-hours", full);
     DO_TEST("leasetime-infinite", full);
+    DO_TEST("nat-network-hostsdir", hostsdir);
 
+    virObjectUnref(hostsdir);
     virObjectUnref(dhcpv6);
     virObjectUnref(full);
     virObjectUnref(restricted);
@@ -55,8 +55,13 @@ getrealpath(char **newpath,
             const char *path)
 {
     if (STRPREFIX(path, LEASEDIR)) {
-        *newpath = g_strdup_printf("%s/nssdata/%s",
-                                   abs_srcdir,
+        const char *datadir = getenv("LIBVIRT_FAKE_LEASE_DIR");
+
+        if (!datadir)
+            datadir = abs_srcdir "/nssdata";
+
+        *newpath = g_strdup_printf("%s/%s",
+                                   datadir,
                                    path + strlen(LEASEDIR));
     } else {
         *newpath = g_strdup(path);
@@ -127,6 +132,18 @@ access(const char *path, int mode)
     free(newpath);
     return ret;
 }
+
+# include "virmockstathelpers.c"
+
+static int
+virMockStatRedirect(const char *path, char **newpath)
+{
+    if (STRPREFIX(path, LEASEDIR) &&
+        getrealpath(newpath, path) < 0)
+        return -1;
+
+    return 0;
+}
 #else
 /* Nothing to override if NSS plugin is not enabled */
 #endif
@@ -22,7 +22,12 @@
 
 #ifdef WITH_NSS
 
+# include <sys/time.h>
+
 # include "libvirt_nss.h"
+# include "virfile.h"
+# include "virjson.h"
+# include "virlease.h"
 # include "virsocket.h"
 
 # define VIR_FROM_THIS VIR_FROM_NONE
@@ -157,8 +162,71 @@ testGetHostByName(const void *opaque)
     return 0;
 }
 
+/*
+ * Copies the lease files from nssdata into @dir and writes a lease index
+ * next to every status file, the way leaseshelper does. The status files
+ * are then blanked while keeping the size, inode and mtime the index was
+ * written for, so that the lookups can only succeed through the index.
+ */
 static int
-mymain(void)
+testNSSIndexLeases(const char *dir)
+{
+    const char *srcdir = abs_srcdir "/nssdata";
+    DIR *dirp = NULL;
+    struct dirent *ent;
+    int ret = -1;
+    int rc;
+
+    if (virDirOpen(&dirp, srcdir) < 0)
+        return -1;
+
+    while ((rc = virDirRead(dirp, &ent, srcdir)) > 0) {
+        g_autofree char *src = g_strdup_printf("%s/%s", srcdir, ent->d_name);
+        g_autofree char *dst = g_strdup_printf("%s/%s", dir, ent->d_name);
+        g_autofree char *indexFile = NULL;
+        g_autofree char *data = NULL;
+        g_autofree char *blank = NULL;
+        g_autoptr(virJSONValue) leases = NULL;
+        struct timeval times[2];
+        struct stat sb;
+
+        if (virFileReadAll(src, 1024 * 1024, &data) < 0 ||
+            virFileWriteStr(dst, data, 0644) < 0)
+            goto cleanup;
+
+        if (!virStringHasSuffix(ent->d_name, ".status"))
+            continue;
+
+        indexFile = g_strdup_printf("%s/%.*s.index", dir,
+                                    (int)(strlen(ent->d_name) - strlen(".status")),
+                                    ent->d_name);
+
+        if (!(leases = virJSONValueFromString(data)) ||
+            virLeaseWriteIndex(leases, dst, indexFile) < 0 ||
+            stat(dst, &sb) < 0)
+            goto cleanup;
+
+        blank = g_strnfill(sb.st_size, ' ');
+        times[0].tv_sec = sb.st_atime;
+        times[0].tv_usec = 0;
+        times[1].tv_sec = sb.st_mtime;
+        times[1].tv_usec = 0;
+
+        if (virFileWriteStr(dst, blank, 0) < 0 ||
+            utimes(dst, times) < 0)
+            goto cleanup;
+    }
+
+    if (rc == 0)
+        ret = 0;
+
+ cleanup:
+    VIR_DIR_CLOSE(dirp);
+    return ret;
+}
+
+static int
+testNSSLookups(void)
 {
     int ret = 0;
 
@@ -183,6 +251,44 @@ mymain(void)
     DO_TEST("suse", AF_INET, "192.168.122.3");
 # endif /* defined(LIBVIRT_NSS_GUEST) */
 
+    return ret;
+}
+
+# define SCRATCHDIRTEMPLATE abs_builddir "/nssdir-XXXXXX"
+
+static int
+mymain(void)
+{
+    char scratchdir[] = SCRATCHDIRTEMPLATE;
+    int ret = 0;
+
+    /* parse the lease status files */
+    if (testNSSLookups() < 0)
+        ret = -1;
+
+    /* the same lookups have to give the same results using the index */
+    if (!g_mkdtemp(scratchdir)) {
+        fprintf(stderr, "Cannot create nssdir");
+        abort();
+    }
+
+    if (testNSSIndexLeases(scratchdir) < 0) {
+        fprintf(stderr, "Cannot index leases in %s\n", scratchdir);
+        ret = -1;
+        goto cleanup;
+    }
+
+    g_setenv("LIBVIRT_FAKE_LEASE_DIR", scratchdir, TRUE);
+
+    if (testNSSLookups() < 0)
+        ret = -1;
+
+    g_unsetenv("LIBVIRT_FAKE_LEASE_DIR");
+
+ cleanup:
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(scratchdir);
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
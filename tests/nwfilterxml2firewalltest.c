@@ -25,6 +25,7 @@
 
 # include "testutils.h"
 # include "nwfilter/nwfilter_ebiptables_driver.h"
+# include "nwfilter/nwfilter_nftables_driver.h"
 # include "virbuffer.h"
 
 # define LIBVIRT_VIRFIREWALLPRIV_H_ALLOW
@@ -33,6 +34,9 @@
 # define LIBVIRT_VIRCOMMANDPRIV_H_ALLOW
 # include "vircommandpriv.h"
 
+# define LIBVIRT_NWFILTER_NFTABLES_DRIVERPRIV_H_ALLOW
+# include "nwfilter/nwfilter_nftables_driverpriv.h"
+
 # define VIR_FROM_THIS VIR_FROM_NONE
 
 # ifdef __linux__
@@ -409,6 +413,50 @@ static int testCompareXMLToArgvFiles(const char *xml,
     return ret;
 }
 
+static int testCompareXMLToNftFiles(const char *xml,
+                                    const char *rulesfile)
+{
+    g_autofree char *actual = NULL;
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_auto(virBuffer) teardown = VIR_BUFFER_INITIALIZER;
+    virHashTablePtr vars = virNWFilterHashTableCreate(0);
+    virNWFilterInst inst;
+    int ret = -1;
+
+    memset(&inst, 0, sizeof(inst));
+
+    if (!vars)
+        goto cleanup;
+
+    if (testSetDefaultParameters(vars) < 0)
+        goto cleanup;
+
+    if (virNWFilterDefToInst(xml, vars, &inst) < 0)
+        goto cleanup;
+
+    nftablesDriverSetDryRun(&buf);
+    if (nftables_driver.applyNewRules("vnet0", inst.rules, inst.nrules) < 0)
+        goto cleanup;
+
+    /* forget about the interface for the next test */
+    nftablesDriverSetDryRun(&teardown);
+    if (nftables_driver.allTeardown("vnet0") < 0)
+        goto cleanup;
+
+    actual = virBufferContentAndReset(&buf);
+
+    if (virTestCompareToFile(actual, rulesfile) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    nftablesDriverSetDryRun(NULL);
+    virNWFilterInstReset(&inst);
+    virHashFree(vars);
+    return ret;
+}
+
 struct testInfo {
     const char *name;
 };
@@ -434,6 +482,21 @@ testCompareXMLToIPTablesHelper(const void *data)
     return result;
 }
 
+static int
+testCompareXMLToNftHelper(const void *data)
+{
+    const struct testInfo *info = data;
+    g_autofree char *xml = NULL;
+    g_autofree char *rules = NULL;
+
+    xml = g_strdup_printf("%s/nwfilterxml2firewalldata/%s.xml",
+                          abs_srcdir, info->name);
+    rules = g_strdup_printf("%s/nwfilterxml2firewalldata/%s-nft.rules",
+                            abs_srcdir, info->name);
+
+    return testCompareXMLToNftFiles(xml, rules);
+}
+
 static bool
 hasNetfilterTools(void)
 {
@@ -458,6 +521,19 @@ mymain(void)
             ret = -1; \
     } while (0)
 
+# define DO_TEST_NFT(name) \
+    do { \
+        static struct testInfo info = { \
+            name, \
+        }; \
+        if (virTestRun("NWFilter XML-2-nftables " name, \
+                       testCompareXMLToNftHelper, &info) < 0) \
+            ret = -1; \
+    } while (0)
+
+    /* the nftables rules are generated without any tools */
+    DO_TEST_NFT("mac");
+
     virFirewallSetLockOverride(true);
 
     if (virFirewallSetBackend(VIR_FIREWALL_BACKEND_DIRECT) < 0) {
@@ -23,7 +23,11 @@
 
 #include "testutils.h"
 
+#include "datatypes.h"
+#include "domain_event.h"
+#include "object_event.h"
 #include "virerror.h"
+#include "virtime.h"
 #include "virxml.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
@@ -825,6 +829,107 @@ testNodeDeviceCreateXML(const void *data)
     return ret;
 }
 
+/* Number of per-domain callbacks registered by the dispatch benchmark
+ * and the number of events dispatched to them */
+#define TEST_BENCH_CALLBACKS 10000
+#define TEST_BENCH_EVENTS 1000
+
+static int
+benchLifecycleCb(virConnectPtr conn G_GNUC_UNUSED,
+                 virDomainPtr dom G_GNUC_UNUSED,
+                 int event G_GNUC_UNUSED,
+                 int detail G_GNUC_UNUSED,
+                 void *opaque)
+{
+    size_t *count = opaque;
+
+    (*count)++;
+    return 0;
+}
+
+static void
+benchUUID(unsigned char *uuid,
+          size_t i)
+{
+    memset(uuid, 0x42, VIR_UUID_BUFLEN);
+    uuid[0] = (i >> 24) & 0xff;
+    uuid[1] = (i >> 16) & 0xff;
+    uuid[2] = (i >> 8) & 0xff;
+    uuid[3] = i & 0xff;
+}
+
+static int
+testDomainEventDispatchBench(const void *data)
+{
+    const objecteventTest *test = data;
+    virObjectEventStatePtr state;
+    g_autofree int *ids = g_new0(int, TEST_BENCH_CALLBACKS);
+    size_t ncallbacks = 0;
+    size_t count = 0;
+    unsigned long long start;
+    unsigned long long end;
+    size_t i;
+    int ret = -1;
+
+    if (!(state = virObjectEventStateNew()))
+        return -1;
+
+    for (i = 0; i < TEST_BENCH_CALLBACKS; i++) {
+        g_autofree char *name = g_strdup_printf("bench-%zu", i);
+        unsigned char uuid[VIR_UUID_BUFLEN];
+        virDomainPtr dom;
+        int rc;
+
+        benchUUID(uuid, i);
+        if (!(dom = virGetDomain(test->conn, name, uuid, -1)))
+            goto cleanup;
+
+        rc = virDomainEventStateRegisterID(test->conn, state, dom,
+                                           VIR_DOMAIN_EVENT_ID_LIFECYCLE,
+                                           VIR_DOMAIN_EVENT_CALLBACK(benchLifecycleCb),
+                                           &count, NULL, &ids[ncallbacks]);
+        virObjectUnref(dom);
+        if (rc < 0)
+            goto cleanup;
+        ncallbacks++;
+    }
+
+    if (virTimeMillisNow(&start) < 0)
+        goto cleanup;
+
+    for (i = 0; i < TEST_BENCH_EVENTS; i++) {
+        unsigned char uuid[VIR_UUID_BUFLEN];
+        virObjectEventPtr event;
+
+        benchUUID(uuid, (i * 7919) % TEST_BENCH_CALLBACKS);
+        if (!(event = virDomainEventLifecycleNew(-1, "bench", uuid,
+                                                 VIR_DOMAIN_EVENT_STARTED, 0)))
+            goto cleanup;
+        virObjectEventStateQueue(state, event);
+    }
+
+    /* Each event matches exactly one callback */
+    while (count < TEST_BENCH_EVENTS) {
+        if (virEventRunDefaultImpl() < 0)
+            goto cleanup;
+    }
+
+    if (count != TEST_BENCH_EVENTS)
+        goto cleanup;
+
+    if (virTimeMillisNow(&end) == 0)
+        VIR_TEST_DEBUG("dispatched %d events with %d callbacks in %llu ms",
+                       TEST_BENCH_EVENTS, TEST_BENCH_CALLBACKS, end - start);
+
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < ncallbacks; i++)
+        virObjectEventStateDeregisterID(test->conn, state, ids[i], true);
+    virObjectUnref(state);
+    return ret;
+}
+
 static void
 timeout(int id G_GNUC_UNUSED, void *opaque G_GNUC_UNUSED)
 {
@@ -864,6 +969,10 @@ mymain(void)
         ret = EXIT_FAILURE;
     if (virTestRun("Domain start stop events", testDomainStartStopEvent, &test) < 0)
         ret = EXIT_FAILURE;
+    if (virTestGetExpensive() &&
+        virTestRun("Domain event dispatch benchmark",
+                   testDomainEventDispatchBench, &test) < 0)
+        ret = EXIT_FAILURE;
 
     /* Network event tests */
     /* Tests requiring the test network not to be set up */
@@ -0,0 +1,396 @@
+/*
+ * qemubench.c: benchmarks of QEMU driver hot paths
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+
+#ifdef WITH_QEMU
+
+# include "testutilsbench.h"
+# include "testutilsqemu.h"
+# include "qemumonitortestutils.h"
+# include "qemu/qemu_domain_address.h"
+# include "qemu/qemu_monitor.h"
+# include "virjson.h"
+
+# define VIR_FROM_THIS VIR_FROM_NONE
+
+# define TEST_BENCH_SUITE "qemu"
+
+static virQEMUDriver driver;
+
+/* Domain XMLs and monitor replies everything is measured on */
+typedef struct {
+    char **xmls;
+    virDomainDefPtr *defs;
+    size_t nxmls;
+
+    char **replies;
+    size_t nreplies;
+} testBenchCorpus;
+
+
+static int
+testBenchMonitorStatus(const void *opaque G_GNUC_UNUSED,
+                       size_t iterations)
+{
+    g_autoptr(qemuMonitorTest) test = NULL;
+    size_t i;
+
+    if (!(test = qemuMonitorTestNewSimple(driver.xmlopt)))
+        return -1;
+
+    for (i = 0; i < iterations; i++) {
+        if (qemuMonitorTestAddItem(test, "query-status",
+                                   "{\"return\": {\"status\": \"running\", "
+                                   "\"singlestep\": false, \"running\": true}}") < 0)
+            return -1;
+    }
+
+    for (i = 0; i < iterations; i++) {
+        bool running;
+        virDomainPausedReason reason;
+
+        if (qemuMonitorGetStatus(qemuMonitorTestGetMonitor(test),
+                                 &running, &reason) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testBenchXMLParse(const void *opaque,
+                  size_t iterations)
+{
+    const testBenchCorpus *corpus = opaque;
+    unsigned int flags = VIR_DOMAIN_DEF_PARSE_INACTIVE |
+                         VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE;
+    size_t i;
+
+    for (i = 0; i < iterations; i++) {
+        virDomainDefPtr def;
+
+        if (!(def = virDomainDefParseString(corpus->xmls[i % corpus->nxmls],
+                                            driver.xmlopt, NULL, flags)))
+            return -1;
+        virDomainDefFree(def);
+    }
+
+    return 0;
+}
+
+
+static int
+testBenchXMLFormat(const void *opaque,
+                   size_t iterations)
+{
+    const testBenchCorpus *corpus = opaque;
+    size_t i;
+
+    for (i = 0; i < iterations; i++) {
+        g_autofree char *xml = NULL;
+
+        if (!(xml = virDomainDefFormat(corpus->defs[i % corpus->nxmls],
+                                       driver.xmlopt,
+                                       VIR_DOMAIN_DEF_FORMAT_SECURE)))
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testBenchJSONParse(const void *opaque,
+                   size_t iterations)
+{
+    const testBenchCorpus *corpus = opaque;
+    size_t i;
+
+    for (i = 0; i < iterations; i++) {
+        g_autoptr(virJSONValue) reply = NULL;
+
+        if (!(reply = virJSONValueFromString(corpus->replies[i % corpus->nreplies])))
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/* Copies of one domain without any device addresses, each iteration
+ * assigns addresses to one of them */
+typedef struct {
+    virQEMUCapsPtr qemuCaps;
+    virDomainDefPtr *defs;
+    size_t ndefs;
+} testBenchAddressData;
+
+
+static int
+testBenchAddressAssign(const void *opaque,
+                       size_t iterations)
+{
+    const testBenchAddressData *data = opaque;
+    size_t i;
+
+    for (i = 0; i < iterations && i < data->ndefs; i++) {
+        if (qemuDomainAssignAddresses(data->defs[i], data->qemuCaps,
+                                      &driver, NULL, true) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/* Measures assigning addresses to the devices of the domain in @file,
+ * optionally switched to the @machine type */
+static int
+testBenchRunAddressAssign(const char *name,
+                          const char *file,
+                          const char *machine,
+                          virQEMUCapsPtr qemuCaps,
+                          size_t iterations)
+{
+    testBenchAddressData data = { .qemuCaps = qemuCaps };
+    g_autofree char *path = NULL;
+    g_autofree char *xml = NULL;
+    unsigned int flags = VIR_DOMAIN_DEF_PARSE_INACTIVE |
+                         VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE;
+    int ret = -1;
+    size_t i;
+
+    path = g_strdup_printf("%s/qemuxml2argvdata/%s.xml", abs_srcdir, file);
+    if (virTestLoadFile(path, &xml) < 0)
+        return -1;
+
+    if (machine) {
+        g_autofree char *orig = g_steal_pointer(&xml);
+        g_autofree char *attr = g_strdup_printf("machine='%s'", machine);
+        g_autoptr(GRegex) regex = g_regex_new("machine='[^']*'", 0, 0, NULL);
+
+        if (!(xml = g_regex_replace_literal(regex, orig, -1, 0, attr, 0, NULL)))
+            return -1;
+    }
+
+    /* parsing is not what is measured */
+    for (i = 0; i < iterations; i++) {
+        virDomainDefPtr def;
+
+        if (!(def = virDomainDefParseString(xml, driver.xmlopt, NULL, flags)))
+            goto cleanup;
+
+        if (VIR_APPEND_ELEMENT(data.defs, data.ndefs, def) < 0)
+            goto cleanup;
+    }
+
+    ret = testBenchRun(TEST_BENCH_SUITE, name, testBenchAddressAssign,
+                       &data, iterations);
+
+ cleanup:
+    for (i = 0; i < data.ndefs; i++)
+        virDomainDefFree(data.defs[i]);
+    g_free(data.defs);
+    return ret;
+}
+
+
+/* Loads the domain XMLs the QEMU driver is able to parse */
+static int
+testBenchLoadXMLs(testBenchCorpus *corpus)
+{
+    g_autoptr(DIR) dir = NULL;
+    struct dirent *ent;
+    const char *path = abs_srcdir "/qemuxml2argvdata";
+    unsigned int flags = VIR_DOMAIN_DEF_PARSE_INACTIVE |
+                         VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE;
+    int rc;
+
+    if (virDirOpen(&dir, path) < 0)
+        return -1;
+
+    while ((rc = virDirRead(dir, &ent, path)) > 0) {
+        g_autofree char *file = NULL;
+        g_autofree char *xml = NULL;
+        virDomainDefPtr def;
+        size_t ndefs = corpus->nxmls;
+
+        if (!virStringHasSuffix(ent->d_name, ".xml"))
+            continue;
+
+        file = g_strdup_printf("%s/%s", path, ent->d_name);
+        if (virTestLoadFile(file, &xml) < 0)
+            return -1;
+
+        /* the corpus contains invalid XMLs on purpose */
+        if (!(def = virDomainDefParseString(xml, driver.xmlopt, NULL, flags)))
+            continue;
+
+        if (VIR_APPEND_ELEMENT(corpus->defs, ndefs, def) < 0 ||
+            VIR_APPEND_ELEMENT(corpus->xmls, corpus->nxmls, xml) < 0)
+            return -1;
+    }
+
+    virResetLastError();
+    return rc < 0 || corpus->nxmls == 0 ? -1 : 0;
+}
+
+
+/* Loads QMP replies recorded from real QEMU binaries. Entries in
+ * .replies files are separated by empty lines. */
+static int
+testBenchLoadReplies(testBenchCorpus *corpus)
+{
+    g_autoptr(DIR) dir = NULL;
+    struct dirent *ent;
+    const char *path = abs_srcdir "/qemucapabilitiesdata";
+    int rc;
+
+    if (virDirOpen(&dir, path) < 0)
+        return -1;
+
+    while ((rc = virDirRead(dir, &ent, path)) > 0) {
+        g_autofree char *file = NULL;
+        g_autofree char *content = NULL;
+        g_auto(GStrv) entries = NULL;
+        size_t i;
+
+        if (!virStringHasSuffix(ent->d_name, ".replies"))
+            continue;
+
+        file = g_strdup_printf("%s/%s", path, ent->d_name);
+        if (virTestLoadFile(file, &content) < 0)
+            return -1;
+
+        entries = g_strsplit(content, "\n\n", 0);
+        for (i = 0; entries[i]; i++) {
+            g_autoptr(virJSONValue) reply = NULL;
+            char *entry = NULL;
+
+            /* skip commands sent to QEMU, only replies are interesting */
+            if (!(reply = virJSONValueFromString(entries[i])) ||
+                !(virJSONValueObjectHasKey(reply, "return") ||
+                  virJSONValueObjectHasKey(reply, "error") ||
+                  virJSONValueObjectHasKey(reply, "event")))
+                continue;
+
+            entry = g_strdup(entries[i]);
+            if (VIR_APPEND_ELEMENT(corpus->replies, corpus->nreplies, entry) < 0)
+                return -1;
+        }
+    }
+
+    virResetLastError();
+    return rc < 0 || corpus->nreplies == 0 ? -1 : 0;
+}
+
+
+static void
+testBenchCorpusClear(testBenchCorpus *corpus)
+{
+    size_t i;
+
+    for (i = 0; i < corpus->nxmls; i++) {
+        g_free(corpus->xmls[i]);
+        virDomainDefFree(corpus->defs[i]);
+    }
+    g_free(corpus->xmls);
+    g_free(corpus->defs);
+
+    for (i = 0; i < corpus->nreplies; i++)
+        g_free(corpus->replies[i]);
+    g_free(corpus->replies);
+}
+
+
+static int
+mymain(void)
+{
+    testBenchCorpus corpus = { 0 };
+    g_autofree char *capsFile = NULL;
+    g_autoptr(virQEMUCaps) qemuCaps = NULL;
+    int ret = 0;
+
+    if (qemuTestDriverInit(&driver) < 0)
+        return EXIT_FAILURE;
+
+    virEventRegisterDefaultImpl();
+
+    if (qemuTestCapsCacheInsert(driver.qemuCapsCache, NULL) < 0) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    virTestQuiesceLibvirtErrors(true);
+
+    if (testBenchLoadXMLs(&corpus) < 0 ||
+        testBenchLoadReplies(&corpus) < 0) {
+        VIR_TEST_VERBOSE("failed to load the corpus");
+        ret = -1;
+        goto cleanup;
+    }
+
+    if (!(capsFile = testQemuGetLatestCapsForArch("x86_64", "xml")) ||
+        !(qemuCaps = qemuTestParseCapabilitiesArch(VIR_ARCH_X86_64, capsFile))) {
+        ret = -1;
+        goto cleanup;
+    }
+
+# define DO_BENCH(name, func, iterations) \
+    do { \
+        if (testBenchRun(TEST_BENCH_SUITE, name, func, &corpus, iterations) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_BENCH("monitor-query-status", testBenchMonitorStatus, 10000);
+    DO_BENCH("xml-parse", testBenchXMLParse, corpus.nxmls * 10);
+    DO_BENCH("xml-format", testBenchXMLFormat, corpus.nxmls * 10);
+    DO_BENCH("json-parse", testBenchJSONParse, corpus.nreplies * 10);
+
+    /* 100 virtio disks, on q35 each of them needs a pcie-root-port */
+    if (testBenchRunAddressAssign("address-assign-pci",
+                                  "pci-bridge-many-disks", NULL,
+                                  qemuCaps, 100) < 0 ||
+        testBenchRunAddressAssign("address-assign-pcie",
+                                  "pci-bridge-many-disks", "q35",
+                                  qemuCaps, 100) < 0)
+        ret = -1;
+
+# undef DO_BENCH
+
+ cleanup:
+    testBenchCorpusClear(&corpus);
+    qemuTestDriverFree(&driver);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
+
+#else
+
+int main(void)
+{
+    return EXIT_AM_SKIP;
+}
+
+#endif /* WITH_QEMU */
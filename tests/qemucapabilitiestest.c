@@ -19,6 +19,8 @@
 
 #include <config.h>
 
+#include <unistd.h>
+
 #include "testutils.h"
 #include "testutilsqemu.h"
 #include "qemumonitortestutils.h"
@@ -168,6 +170,49 @@ testQemuCapsCopy(const void *opaque)
 }
 
 
+static int
+testQemuCapsBinary(const void *opaque)
+{
+    const testQemuData *data = opaque;
+    g_autofree char *capsFile = NULL;
+    g_autofree char *binFile = NULL;
+    g_autoptr(virQEMUCaps) orig = NULL;
+    g_autoptr(virQEMUCaps) loaded = NULL;
+    g_autofree char *actual = NULL;
+    virArch arch = virArchFromString(data->archName);
+    int ret = -1;
+
+    capsFile = g_strdup_printf("%s/%s_%s.%s.xml",
+                               data->outputDir, data->prefix, data->version,
+                               data->archName);
+    binFile = g_strdup_printf("%s/qemucapabilitiestest-%s.%s.bin",
+                              abs_builddir, data->version, data->archName);
+
+    if (!(orig = qemuTestParseCapabilitiesArch(arch, capsFile)))
+        return -1;
+
+    if (virQEMUCapsSaveBinaryCache(orig, binFile, NULL) < 0)
+        goto cleanup;
+
+    if (!(loaded = virQEMUCapsNewBinary(virQEMUCapsGetBinary(orig))))
+        goto cleanup;
+
+    if (virQEMUCapsLoadBinaryCache(arch, loaded, binFile, NULL, true) != 0)
+        goto cleanup;
+
+    if (!(actual = virQEMUCapsFormatCache(loaded)))
+        goto cleanup;
+
+    if (virTestCompareToFile(actual, capsFile) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    unlink(binFile);
+    return ret;
+}
+
+
 static int
 doCapsTest(const char *inputDir,
            const char *prefix,
@@ -179,9 +224,11 @@ doCapsTest(const char *inputDir,
     testQemuDataPtr data = (testQemuDataPtr) opaque;
     g_autofree char *title = NULL;
     g_autofree char *copyTitle = NULL;
+    g_autofree char *binaryTitle = NULL;
 
     title = g_strdup_printf("%s (%s)", version, archName);
     copyTitle = g_strdup_printf("copy %s (%s)", version, archName);
+    binaryTitle = g_strdup_printf("binary %s (%s)", version, archName);
 
     data->inputDir = inputDir;
     data->prefix = prefix;
@@ -195,6 +242,9 @@ doCapsTest(const char *inputDir,
     if (virTestRun(copyTitle, testQemuCapsCopy, data) < 0)
         data->ret = -1;
 
+    if (virTestRun(binaryTitle, testQemuCapsBinary, data) < 0)
+        data->ret = -1;
+
     return 0;
 }
 
@@ -1334,6 +1334,8 @@ GEN_TEST_FUNC(qemuMonitorJSONBlockdevMediumInsert, "foodev", "newnode")
 GEN_TEST_FUNC(qemuMonitorJSONJobDismiss, "jobname")
 GEN_TEST_FUNC(qemuMonitorJSONJobCancel, "jobname", false)
 GEN_TEST_FUNC(qemuMonitorJSONJobComplete, "jobname")
+GEN_TEST_FUNC(qemuMonitorJSONJobPause, "jobname")
+GEN_TEST_FUNC(qemuMonitorJSONJobResume, "jobname")
 
 static int
 testQemuMonitorJSONqemuMonitorJSONNBDServerStart(const void *opaque)
@@ -1877,6 +1879,85 @@ testQemuMonitorJSONqemuMonitorJSONGetAllBlockStatsInfo(const void *opaque)
 }
 
 
+static int
+testQemuMonitorJSONqemuMonitorJSONGetAllBlockStatsInfoBlockdev(const void *opaque)
+{
+    const testGenericData *data = opaque;
+    virDomainXMLOptionPtr xmlopt = data->xmlopt;
+    g_autoptr(qemuMonitorTest) test = NULL;
+    virHashTablePtr blockstats = NULL;
+    qemuBlockStatsPtr stats;
+    int ret = -1;
+
+    const char *blockstatsreply =
+        "{"
+        "    \"return\": ["
+        "        {"
+        "            \"device\": \"\","
+        "            \"node-name\": \"libvirt-1-format\","
+        "            \"qdev\": \"/machine/peripheral/virtio-disk0/virtio-backend\","
+        "            \"stats\": {"
+        "                \"flush_total_time_ns\": 0,"
+        "                \"wr_highest_offset\": 0,"
+        "                \"wr_total_time_ns\": 0,"
+        "                \"wr_bytes\": 0,"
+        "                \"rd_total_time_ns\": 1004952,"
+        "                \"flush_operations\": 0,"
+        "                \"wr_operations\": 0,"
+        "                \"rd_bytes\": 49250,"
+        "                \"rd_operations\": 16"
+        "            }"
+        "        }"
+        "    ]"
+        "}";
+
+    const char *nodesreply =
+        "{"
+        "    \"return\": ["
+        "        {"
+        "            \"node-name\": \"libvirt-1-format\","
+        "            \"write_threshold\": 1024,"
+        "            \"image\": {"
+        "                \"virtual-size\": 10737418240,"
+        "                \"actual-size\": 200704"
+        "            }"
+        "        }"
+        "    ]"
+        "}";
+
+    if (!(test = qemuMonitorTestNewSchema(xmlopt, data->schema)))
+        return -1;
+
+    if (qemuMonitorTestAddItem(test, "query-blockstats", blockstatsreply) < 0 ||
+        qemuMonitorTestAddItem(test, "query-named-block-nodes", nodesreply) < 0)
+        return -1;
+
+    if (qemuMonitorGetAllBlockStatsInfoBlockdev(qemuMonitorTestGetMonitor(test),
+                                                &blockstats, false) < 0)
+        goto cleanup;
+
+    if (!(stats = virHashLookup(blockstats, "libvirt-1-format"))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       "block stats for node 'libvirt-1-format' are missing");
+        goto cleanup;
+    }
+
+    if (stats->rd_req != 16 || stats->rd_bytes != 49250 ||
+        stats->capacity != 10737418240ULL || stats->physical != 200704 ||
+        stats->write_threshold != 1024) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       "unexpected block stats for node 'libvirt-1-format'");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virHashFree(blockstats);
+    return ret;
+}
+
+
 static int
 testQemuMonitorJSONqemuMonitorJSONGetMigrationCacheSize(const void *opaque)
 {
@@ -3243,9 +3324,12 @@ mymain(void)
     DO_TEST_GEN(qemuMonitorJSONJobDismiss);
     DO_TEST_GEN(qemuMonitorJSONJobCancel);
     DO_TEST_GEN(qemuMonitorJSONJobComplete);
+    DO_TEST_GEN(qemuMonitorJSONJobPause);
+    DO_TEST_GEN(qemuMonitorJSONJobResume);
     DO_TEST(qemuMonitorJSONGetBalloonInfo);
     DO_TEST(qemuMonitorJSONGetBlockInfo);
     DO_TEST(qemuMonitorJSONGetAllBlockStatsInfo);
+    DO_TEST(qemuMonitorJSONGetAllBlockStatsInfoBlockdev);
     DO_TEST(qemuMonitorJSONGetMigrationCacheSize);
     DO_TEST(qemuMonitorJSONGetMigrationStats);
     DO_TEST(qemuMonitorJSONGetChardevInfo);
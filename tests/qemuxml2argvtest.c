@@ -1427,6 +1427,12 @@ mymain(void)
             QEMU_CAPS_VIRTIO_NET_FAILOVER,
             QEMU_CAPS_DEVICE_VFIO_PCI);
     DO_TEST_PARSE_ERROR("net-virtio-teaming", NONE);
+    DO_TEST("net-virtio-rss",
+            QEMU_CAPS_VHOSTUSER_MULTIQUEUE,
+            QEMU_CAPS_VIRTIO_NET_RSS,
+            QEMU_CAPS_VIRTIO_NET_HASH_REPORT);
+    DO_TEST_PARSE_ERROR("net-virtio-rss",
+                        QEMU_CAPS_VHOSTUSER_MULTIQUEUE);
     DO_TEST("net-eth", NONE);
     DO_TEST("net-eth-ifname", NONE);
     DO_TEST("net-eth-names", NONE);
@@ -1700,6 +1706,8 @@ mymain(void)
             QEMU_CAPS_VIRTIO_BALLOON_AUTODEFLATE);
     DO_TEST("balloon-device-auto", NONE);
     DO_TEST("balloon-device-period", NONE);
+    DO_TEST("balloon-device-free-page-reporting",
+            QEMU_CAPS_VIRTIO_BALLOON_FREE_PAGE_REPORTING);
     DO_TEST("sound", NONE);
     DO_TEST("sound-device",
             QEMU_CAPS_HDA_DUPLEX, QEMU_CAPS_HDA_MICRO,
@@ -3229,6 +3237,7 @@ mymain(void)
             QEMU_CAPS_KVM);
 
     DO_TEST_CAPS_LATEST("memfd-memory-numa");
+    DO_TEST_CAPS_LATEST("memfd-memory-numa-prealloc-threads");
     DO_TEST_CAPS_LATEST("memfd-memory-default-hugepage");
 
     DO_TEST("cpu-check-none", QEMU_CAPS_KVM);
@@ -475,6 +475,9 @@ mymain(void)
     DO_TEST("net-virtio-teaming-network",
             QEMU_CAPS_VIRTIO_NET_FAILOVER,
             QEMU_CAPS_DEVICE_VFIO_PCI);
+    DO_TEST("net-virtio-rss",
+            QEMU_CAPS_VIRTIO_NET_RSS,
+            QEMU_CAPS_VIRTIO_NET_HASH_REPORT);
     DO_TEST_CAPS_LATEST("net-isolated-port");
     DO_TEST("net-hostdev", NONE);
     DO_TEST("net-hostdev-bootorder", NONE);
@@ -569,6 +572,7 @@ mymain(void)
     DO_TEST("blkiotune-device", NONE);
     DO_TEST("cputune", NONE);
     DO_TEST("cputune-zero-shares", NONE);
+    DO_TEST("cputune-helperpin", NONE);
     DO_TEST("cputune-iothreadsched", NONE);
     DO_TEST("cputune-iothreadsched-zeropriority", NONE);
     DO_TEST("cputune-numatune", NONE);
@@ -770,6 +774,7 @@ mymain(void)
 
     DO_TEST("balloon-device-auto", NONE);
     DO_TEST("balloon-device-period", NONE);
+    DO_TEST("balloon-device-overcommit", NONE);
     DO_TEST("channel-virtio-auto", NONE);
     DO_TEST("console-compat-auto", NONE);
     DO_TEST("disk-scsi-device-auto",
@@ -1314,6 +1319,11 @@ mymain(void)
             QEMU_CAPS_OBJECT_MEMORY_MEMFD,
             QEMU_CAPS_OBJECT_MEMORY_MEMFD_HUGETLB,
             QEMU_CAPS_OBJECT_MEMORY_FILE);
+    DO_TEST("memfd-memory-numa-prealloc-threads",
+            QEMU_CAPS_OBJECT_MEMORY_MEMFD,
+            QEMU_CAPS_OBJECT_MEMORY_MEMFD_HUGETLB,
+            QEMU_CAPS_OBJECT_MEMORY_FILE,
+            QEMU_CAPS_OBJECT_MEMORY_PREALLOC_THREADS);
     DO_TEST("memfd-memory-default-hugepage",
             QEMU_CAPS_OBJECT_MEMORY_MEMFD,
             QEMU_CAPS_OBJECT_MEMORY_MEMFD_HUGETLB,
@@ -68,6 +68,7 @@ mymain(void)
     DO_TEST("pool-logical-nopath");
     DO_TEST("pool-logical-create");
     DO_TEST("pool-logical-noname");
+    DO_TEST("pool-logical-watermark");
     DO_TEST("pool-disk");
     DO_TEST("pool-disk-device-nopartsep");
     DO_TEST("pool-iscsi");
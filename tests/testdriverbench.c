@@ -0,0 +1,283 @@
+/*
+ * testdriverbench.c: benchmarks of public APIs using the test driver
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "testutilsbench.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+#define TEST_BENCH_SUITE "testdriver"
+
+static const char domainDefFmt[] =
+"<domain type='test'>"
+"  <name>bench-%zu</name>"
+"  <memory>1048576</memory>"
+"  <vcpu>2</vcpu>"
+"  <os>"
+"    <type>hvm</type>"
+"  </os>"
+"</domain>";
+
+typedef struct {
+    virConnectPtr conn;
+    virDomainPtr dom;
+} testBenchData;
+
+
+static int
+testBenchNumOfDomains(const void *opaque,
+                      size_t iterations)
+{
+    const testBenchData *data = opaque;
+    size_t i;
+
+    for (i = 0; i < iterations; i++) {
+        if (virConnectNumOfDomains(data->conn) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testBenchListAllDomains(const void *opaque,
+                        size_t iterations)
+{
+    const testBenchData *data = opaque;
+    size_t i;
+
+    for (i = 0; i < iterations; i++) {
+        virDomainPtr *doms = NULL;
+        int ndoms;
+        int j;
+
+        if ((ndoms = virConnectListAllDomains(data->conn, &doms, 0)) < 0)
+            return -1;
+
+        for (j = 0; j < ndoms; j++)
+            virDomainFree(doms[j]);
+        g_free(doms);
+    }
+
+    return 0;
+}
+
+
+static int
+testBenchLookupByName(const void *opaque,
+                      size_t iterations)
+{
+    const testBenchData *data = opaque;
+    size_t i;
+
+    for (i = 0; i < iterations; i++) {
+        virDomainPtr dom;
+
+        if (!(dom = virDomainLookupByName(data->conn, "test")))
+            return -1;
+        virDomainFree(dom);
+    }
+
+    return 0;
+}
+
+
+static int
+testBenchGetInfo(const void *opaque,
+                 size_t iterations)
+{
+    const testBenchData *data = opaque;
+    virDomainInfo info;
+    size_t i;
+
+    for (i = 0; i < iterations; i++) {
+        if (virDomainGetInfo(data->dom, &info) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testBenchGetXMLDesc(const void *opaque,
+                    size_t iterations)
+{
+    const testBenchData *data = opaque;
+    size_t i;
+
+    for (i = 0; i < iterations; i++) {
+        g_autofree char *xml = NULL;
+
+        if (!(xml = virDomainGetXMLDesc(data->dom, 0)))
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testBenchGetAllDomainStats(const void *opaque,
+                           size_t iterations)
+{
+    const testBenchData *data = opaque;
+    size_t i;
+
+    for (i = 0; i < iterations; i++) {
+        virDomainStatsRecordPtr *records = NULL;
+
+        if (virConnectGetAllDomainStats(data->conn, 0, &records, 0) < 0)
+            return -1;
+        virDomainStatsRecordListFree(records);
+    }
+
+    return 0;
+}
+
+
+static int
+testBenchLifecycleCb(virConnectPtr conn G_GNUC_UNUSED,
+                     virDomainPtr dom G_GNUC_UNUSED,
+                     int event G_GNUC_UNUSED,
+                     int detail G_GNUC_UNUSED,
+                     void *opaque)
+{
+    size_t *count = opaque;
+
+    (*count)++;
+    return 0;
+}
+
+
+/* Each iteration generates two events, one for suspending the domain
+ * and one for resuming it, and waits until both are delivered. */
+static int
+testBenchEvents(const void *opaque,
+                size_t iterations)
+{
+    const testBenchData *data = opaque;
+    size_t count = 0;
+    size_t i;
+    int id;
+    int ret = -1;
+
+    if ((id = virConnectDomainEventRegisterAny(data->conn, data->dom,
+                                               VIR_DOMAIN_EVENT_ID_LIFECYCLE,
+                                               VIR_DOMAIN_EVENT_CALLBACK(testBenchLifecycleCb),
+                                               &count, NULL)) < 0)
+        return -1;
+
+    for (i = 0; i < iterations; i++) {
+        if (virDomainSuspend(data->dom) < 0 ||
+            virDomainResume(data->dom) < 0)
+            goto cleanup;
+
+        while (count < (i + 1) * 2) {
+            if (virEventRunDefaultImpl() < 0)
+                goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    virConnectDomainEventDeregisterAny(data->conn, id);
+    return ret;
+}
+
+
+/* Starts transient domains until there are @ndoms running */
+static int
+testBenchAddDomains(virConnectPtr conn,
+                    size_t ndoms)
+{
+    int running;
+    size_t i;
+
+    if ((running = virConnectNumOfDomains(conn)) < 0)
+        return -1;
+
+    for (i = running; i < ndoms; i++) {
+        g_autofree char *xml = g_strdup_printf(domainDefFmt, i);
+        virDomainPtr dom;
+
+        if (!(dom = virDomainCreateXML(conn, xml, 0)))
+            return -1;
+        virDomainFree(dom);
+    }
+
+    return 0;
+}
+
+
+static int
+mymain(void)
+{
+    testBenchData data = { 0 };
+    size_t sizes[] = { 10, 100, 1000 };
+    size_t i;
+    int ret = 0;
+
+    virEventRegisterDefaultImpl();
+
+    if (!(data.conn = virConnectOpen("test:///default")))
+        return EXIT_FAILURE;
+
+    if (!(data.dom = virDomainLookupByName(data.conn, "test"))) {
+        virConnectClose(data.conn);
+        return EXIT_FAILURE;
+    }
+
+#define DO_BENCH(name, func, iterations) \
+    do { \
+        if (testBenchRun(TEST_BENCH_SUITE, name, func, &data, iterations) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_BENCH("virConnectNumOfDomains", testBenchNumOfDomains, 100000);
+    DO_BENCH("virConnectListAllDomains", testBenchListAllDomains, 100000);
+    DO_BENCH("virDomainLookupByName", testBenchLookupByName, 100000);
+    DO_BENCH("virDomainGetInfo", testBenchGetInfo, 100000);
+    DO_BENCH("virDomainGetXMLDesc", testBenchGetXMLDesc, 10000);
+    DO_BENCH("events", testBenchEvents, 10000);
+
+    for (i = 0; i < G_N_ELEMENTS(sizes); i++) {
+        g_autofree char *name = g_strdup_printf("virConnectGetAllDomainStats-%zu",
+                                                sizes[i]);
+
+        if (testBenchAddDomains(data.conn, sizes[i]) < 0) {
+            ret = -1;
+            break;
+        }
+
+        DO_BENCH(name, testBenchGetAllDomainStats, 100000 / sizes[i]);
+    }
+
+#undef DO_BENCH
+
+    virDomainFree(data.dom);
+    virConnectClose(data.conn);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
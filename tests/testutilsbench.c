@@ -0,0 +1,132 @@
+/*
+ * testutilsbench.c: helpers for benchmarks
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+
+#include "testutils.h"
+#include "testutilsbench.h"
+
+/*
+ * Results are printed as one JSON object per line so that runs of
+ * different versions can be compared by scripts:
+ *
+ *   {"suite":"testdriver","name":"virDomainGetInfo","iterations":100000,
+ *    "usec":81234,"ops_per_sec":1231011.7}
+ *
+ * They go to stdout unless VIR_BENCH_OUTPUT names a file to append them
+ * to. VIR_BENCH_SCALE multiplies the number of iterations of every
+ * benchmark, e.g. to get more stable numbers on noisy machines.
+ */
+
+struct testBenchData {
+    testBenchFunc func;
+    const void *opaque;
+    size_t iterations;
+    long long usec;
+};
+
+
+static int
+testBenchRunHelper(const void *opaque)
+{
+    struct testBenchData *data = (struct testBenchData *) opaque;
+    long long start = g_get_monotonic_time();
+
+    if (data->func(data->opaque, data->iterations) < 0)
+        return -1;
+
+    data->usec = g_get_monotonic_time() - start;
+    return 0;
+}
+
+
+static size_t
+testBenchScale(size_t iterations)
+{
+    const char *scale = getenv("VIR_BENCH_SCALE");
+    unsigned int factor;
+
+    if (!scale || virStrToLong_ui(scale, NULL, 10, &factor) < 0 || !factor)
+        return iterations;
+
+    return iterations * factor;
+}
+
+
+static void
+testBenchReport(const char *suite,
+                const char *name,
+                size_t iterations,
+                long long usec)
+{
+    const char *path = getenv("VIR_BENCH_OUTPUT");
+    FILE *fp = stdout;
+    double rate = usec > 0 ? iterations * 1e6 / usec : 0;
+
+    if (path && !(fp = fopen(path, "a"))) {
+        fprintf(stderr, "cannot open %s: %s\n", path, g_strerror(errno));
+        fp = stdout;
+    }
+
+    fprintf(fp,
+            "{\"suite\":\"%s\",\"name\":\"%s\",\"iterations\":%zu,"
+            "\"usec\":%lld,\"ops_per_sec\":%.1f}\n",
+            suite, name, iterations, usec, rate);
+
+    if (fp != stdout)
+        fclose(fp);
+    else
+        fflush(fp);
+}
+
+
+/**
+ * testBenchRun:
+ * @suite: name of the group of benchmarks
+ * @name: name of the benchmark within @suite
+ * @func: function running the measured operation
+ * @opaque: data for @func
+ * @iterations: number of times @func should repeat the operation
+ *
+ * Runs @func as a test case and reports how long it took. The names
+ * must not need escaping in JSON.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+testBenchRun(const char *suite,
+             const char *name,
+             testBenchFunc func,
+             const void *opaque,
+             size_t iterations)
+{
+    struct testBenchData data = {
+        .func = func,
+        .opaque = opaque,
+        .iterations = testBenchScale(iterations),
+    };
+    g_autofree char *title = g_strdup_printf("%s %s", suite, name);
+
+    if (virTestRun(title, testBenchRunHelper, &data) < 0)
+        return -1;
+
+    testBenchReport(suite, name, data.iterations, data.usec);
+    return 0;
+}
@@ -0,0 +1,40 @@
+/*
+ * testutilsbench.h: helpers for benchmarks
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "internal.h"
+
+/**
+ * testBenchFunc:
+ * @opaque: data passed to testBenchRun
+ * @iterations: how many times to repeat the measured operation
+ *
+ * Runs the measured operation @iterations times. Any setup which should
+ * not be measured has to be done beforehand.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+typedef int (*testBenchFunc)(const void *opaque,
+                             size_t iterations);
+
+int testBenchRun(const char *suite,
+                 const char *name,
+                 testBenchFunc func,
+                 const void *opaque,
+                 size_t iterations);
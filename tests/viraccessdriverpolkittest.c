@@ -0,0 +1,354 @@
+/*
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+
+#if defined(__ELF__)
+
+# include <dbus/dbus.h>
+
+# include "access/viraccessmanager.h"
+# include "virdbus.h"
+# include "viridentity.h"
+# include "virlog.h"
+# include "virmock.h"
+# include "virtime.h"
+
+# define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("tests.accessdriverpolkittest");
+
+# define THE_PID 1458
+# define THE_TIME 11011000001
+# define THE_UID 1729
+
+/* the decision cache of the polkit access driver keeps decisions for
+ * this many milliseconds */
+# define CACHE_TTL (5 * 1000)
+
+static size_t polkitCalls;
+static unsigned long long fakeNow = 1000000;
+static DBusHandleMessageFunction polkitFilter;
+static void *polkitFilterData;
+
+
+int
+virTimeMillisNow(unsigned long long *now)
+{
+    *now = fakeNow;
+    return 0;
+}
+
+
+VIR_MOCK_WRAP_RET_ARGS(dbus_connection_add_filter,
+                       dbus_bool_t,
+                       DBusConnection *, connection,
+                       DBusHandleMessageFunction, function,
+                       void *, user_data,
+                       DBusFreeFunction, free_data_function)
+{
+    polkitFilter = function;
+    polkitFilterData = user_data;
+    return TRUE;
+}
+
+
+VIR_MOCK_WRAP_VOID_ARGS(dbus_connection_remove_filter,
+                        DBusConnection *, connection,
+                        DBusHandleMessageFunction, function,
+                        void *, user_data)
+{
+    polkitFilter = NULL;
+    polkitFilterData = NULL;
+}
+
+
+/* Only connect.getattr is allowed, everything else is plainly denied */
+VIR_MOCK_WRAP_RET_ARGS(dbus_connection_send_with_reply_and_block,
+                       DBusMessage *,
+                       DBusConnection *, connection,
+                       DBusMessage *, message,
+                       int, timeout_milliseconds,
+                       DBusError *, error)
+{
+    DBusMessage *reply = NULL;
+    const char *service = dbus_message_get_destination(message);
+    const char *member = dbus_message_get_member(message);
+
+    VIR_MOCK_REAL_INIT(dbus_connection_send_with_reply_and_block);
+
+    if (STREQ(service, "org.freedesktop.PolicyKit1") &&
+        STREQ(member, "CheckAuthorization")) {
+        g_autofree char *type = NULL;
+        g_autofree char *pidkey = NULL;
+        unsigned int pidval;
+        g_autofree char *timekey = NULL;
+        unsigned long long timeval;
+        g_autofree char *uidkey = NULL;
+        int uidval;
+        g_autofree char *actionid = NULL;
+        char **details = NULL;
+        size_t detailslen = 0;
+        int allowInteraction;
+        g_autofree char *cancellationId = NULL;
+        int is_authorized;
+
+        if (virDBusMessageDecode(message,
+                                 "(sa{sv})sa&{ss}us",
+                                 &type,
+                                 3,
+                                 &pidkey, "u", &pidval,
+                                 &timekey, "t", &timeval,
+                                 &uidkey, "i", &uidval,
+                                 &actionid,
+                                 &detailslen,
+                                 &details,
+                                 &allowInteraction,
+                                 &cancellationId) < 0)
+            return NULL;
+
+        virStringListFreeCount(details, detailslen);
+
+        polkitCalls++;
+        is_authorized = STREQ(actionid, "org.libvirt.api.connect.getattr");
+
+        if (virDBusCreateReply(&reply,
+                               "(bba&{ss})",
+                               is_authorized,
+                               0,
+                               0,
+                               NULL) < 0)
+            return NULL;
+    } else {
+        reply = dbus_message_new(DBUS_MESSAGE_TYPE_METHOD_RETURN);
+    }
+
+    return reply;
+}
+
+
+static int
+testSetCaller(pid_t pid)
+{
+    g_autoptr(virIdentity) identity = virIdentityNew();
+
+    if (virIdentitySetProcessID(identity, pid) < 0 ||
+        virIdentitySetProcessTime(identity, THE_TIME) < 0 ||
+        virIdentitySetUNIXUserID(identity, THE_UID) < 0 ||
+        virIdentitySetCurrent(identity) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+/*
+ * Checks @perm and expects @allowed as the result, and that polkitd
+ * was asked @calls times in total since the test started.
+ */
+static int
+testCheck(virAccessManagerPtr mgr,
+          virAccessPermConnect perm,
+          bool allowed,
+          size_t calls)
+{
+    int rv = virAccessManagerCheckConnect(mgr, "QEMU", perm);
+
+    virResetLastError();
+
+    if (rv < 0) {
+        fprintf(stderr, "Access check of %s failed\n",
+                virAccessPermConnectTypeToString(perm));
+        return -1;
+    }
+
+    if (rv != (allowed ? 1 : 0)) {
+        fprintf(stderr, "Expected %s to be %s\n",
+                virAccessPermConnectTypeToString(perm),
+                allowed ? "allowed" : "denied");
+        return -1;
+    }
+
+    if (polkitCalls != calls) {
+        fprintf(stderr, "Expected %zu calls of polkitd, got %zu\n",
+                calls, polkitCalls);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static virAccessManagerPtr
+testSetup(void)
+{
+    virAccessManagerPtr mgr;
+
+    polkitCalls = 0;
+
+    if (testSetCaller(THE_PID) < 0 ||
+        !(mgr = virAccessManagerNew("polkit")))
+        return NULL;
+
+    if (!polkitFilter) {
+        fprintf(stderr, "Changes of polkit are not watched\n");
+        virObjectUnref(mgr);
+        return NULL;
+    }
+
+    return mgr;
+}
+
+
+static int
+testCacheHit(const void *opaque G_GNUC_UNUSED)
+{
+    virAccessManagerPtr mgr = testSetup();
+    int ret = -1;
+
+    if (!mgr)
+        return -1;
+
+    if (testCheck(mgr, VIR_ACCESS_PERM_CONNECT_GETATTR, true, 1) < 0 ||
+        testCheck(mgr, VIR_ACCESS_PERM_CONNECT_GETATTR, true, 1) < 0 ||
+        testCheck(mgr, VIR_ACCESS_PERM_CONNECT_WRITE, false, 2) < 0 ||
+        testCheck(mgr, VIR_ACCESS_PERM_CONNECT_WRITE, false, 2) < 0)
+        goto cleanup;
+
+    /* decisions are not shared between callers */
+    if (testSetCaller(THE_PID + 1) < 0 ||
+        testCheck(mgr, VIR_ACCESS_PERM_CONNECT_GETATTR, true, 3) < 0 ||
+        testCheck(mgr, VIR_ACCESS_PERM_CONNECT_GETATTR, true, 3) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virObjectUnref(mgr);
+    return ret;
+}
+
+
+static int
+testCacheExpiry(const void *opaque G_GNUC_UNUSED)
+{
+    virAccessManagerPtr mgr = testSetup();
+    int ret = -1;
+
+    if (!mgr)
+        return -1;
+
+    if (testCheck(mgr, VIR_ACCESS_PERM_CONNECT_GETATTR, true, 1) < 0 ||
+        testCheck(mgr, VIR_ACCESS_PERM_CONNECT_WRITE, false, 2) < 0)
+        goto cleanup;
+
+    fakeNow += CACHE_TTL - 1;
+
+    if (testCheck(mgr, VIR_ACCESS_PERM_CONNECT_GETATTR, true, 2) < 0 ||
+        testCheck(mgr, VIR_ACCESS_PERM_CONNECT_WRITE, false, 2) < 0)
+        goto cleanup;
+
+    fakeNow += 1;
+
+    if (testCheck(mgr, VIR_ACCESS_PERM_CONNECT_GETATTR, true, 3) < 0 ||
+        testCheck(mgr, VIR_ACCESS_PERM_CONNECT_WRITE, false, 4) < 0 ||
+        testCheck(mgr, VIR_ACCESS_PERM_CONNECT_GETATTR, true, 4) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virObjectUnref(mgr);
+    return ret;
+}
+
+
+static int
+testCacheInvalidate(const void *opaque G_GNUC_UNUSED)
+{
+    virAccessManagerPtr mgr = testSetup();
+    DBusMessage *msg;
+    const char *name = "org.freedesktop.PolicyKit1";
+    const char *oldOwner = ":1.4";
+    const char *newOwner = ":1.42";
+    int ret = -1;
+
+    if (!mgr)
+        return -1;
+
+    if (testCheck(mgr, VIR_ACCESS_PERM_CONNECT_GETATTR, true, 1) < 0)
+        goto cleanup;
+
+    /* polkitd announces a change of its policy */
+    msg = dbus_message_new_signal("/org/freedesktop/PolicyKit1/Authority",
+                                  "org.freedesktop.PolicyKit1.Authority",
+                                  "Changed");
+    polkitFilter(NULL, msg, polkitFilterData);
+    virDBusMessageUnref(msg);
+
+    if (testCheck(mgr, VIR_ACCESS_PERM_CONNECT_GETATTR, true, 2) < 0 ||
+        testCheck(mgr, VIR_ACCESS_PERM_CONNECT_GETATTR, true, 2) < 0)
+        goto cleanup;
+
+    /* polkitd is restarted */
+    msg = dbus_message_new_signal(DBUS_PATH_DBUS,
+                                  DBUS_INTERFACE_DBUS,
+                                  "NameOwnerChanged");
+    dbus_message_append_args(msg,
+                             DBUS_TYPE_STRING, &name,
+                             DBUS_TYPE_STRING, &oldOwner,
+                             DBUS_TYPE_STRING, &newOwner,
+                             DBUS_TYPE_INVALID);
+    polkitFilter(NULL, msg, polkitFilterData);
+    virDBusMessageUnref(msg);
+
+    if (testCheck(mgr, VIR_ACCESS_PERM_CONNECT_GETATTR, true, 3) < 0 ||
+        testCheck(mgr, VIR_ACCESS_PERM_CONNECT_GETATTR, true, 3) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virObjectUnref(mgr);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (virTestRun("Polkit cache hit", testCacheHit, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Polkit cache expiry", testCacheExpiry, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Polkit cache invalidate", testCacheInvalidate, NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN_PRELOAD(mymain, VIR_TEST_MOCK("virdbus"))
+
+#else /* ! __ELF__ */
+int
+main(void)
+{
+    return EXIT_AM_SKIP;
+}
+#endif /* ! __ELF__ */
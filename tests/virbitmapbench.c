@@ -0,0 +1,169 @@
+/*
+ * virbitmapbench.c: benchmarks of bitmap operations
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "testutilsbench.h"
+#include "virbitmap.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+#define TEST_BENCH_SUITE "bitmap"
+
+/* Bitmaps sized for CPU affinity and NUMA nodesets of large hosts */
+#define TEST_BENCH_BITS 4096
+
+typedef struct {
+    virBitmapPtr a;
+    virBitmapPtr b;
+    virBitmapPtr sparse;
+} testBenchData;
+
+/* results are summed up here so that the loops are not optimized out */
+static volatile size_t testBenchSink;
+
+
+static virBitmapPtr
+testBenchBitmapRandom(size_t size,
+                      int density)
+{
+    virBitmapPtr map = virBitmapNew(size);
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        if (rand() % 100 < density)
+            ignore_value(virBitmapSetBit(map, i));
+    }
+
+    return map;
+}
+
+
+static int
+testBenchCountBits(const void *opaque,
+                   size_t iterations)
+{
+    const testBenchData *data = opaque;
+    size_t sum = 0;
+    size_t i;
+
+    for (i = 0; i < iterations; i++)
+        sum += virBitmapCountBits(data->a);
+
+    testBenchSink = sum;
+    return 0;
+}
+
+
+static int
+testBenchNextSetBit(const void *opaque,
+                    size_t iterations)
+{
+    const testBenchData *data = opaque;
+    size_t sum = 0;
+    size_t i;
+
+    for (i = 0; i < iterations; i++)
+        sum += virBitmapNextSetBit(data->sparse, -1);
+
+    testBenchSink = sum;
+    return 0;
+}
+
+
+static int
+testBenchOverlaps(const void *opaque,
+                  size_t iterations)
+{
+    const testBenchData *data = opaque;
+    size_t sum = 0;
+    size_t i;
+
+    for (i = 0; i < iterations; i++)
+        sum += virBitmapOverlaps(data->sparse, data->sparse);
+
+    testBenchSink = sum;
+    return 0;
+}
+
+
+static int
+testBenchIntersect(const void *opaque,
+                   size_t iterations)
+{
+    const testBenchData *data = opaque;
+    size_t i;
+
+    for (i = 0; i < iterations; i++)
+        virBitmapIntersect(data->a, data->b);
+
+    return 0;
+}
+
+
+static int
+testBenchUnion(const void *opaque,
+               size_t iterations)
+{
+    const testBenchData *data = opaque;
+    size_t i;
+
+    for (i = 0; i < iterations; i++) {
+        if (virBitmapUnion(data->a, data->b) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+mymain(void)
+{
+    testBenchData data;
+    size_t iterations = 1000000;
+    int ret = 0;
+
+    /* seed the generator so that every run measures the same bitmaps */
+    srand(4242);
+    data.a = testBenchBitmapRandom(TEST_BENCH_BITS, 50);
+    data.b = testBenchBitmapRandom(TEST_BENCH_BITS, 50);
+    data.sparse = virBitmapNew(TEST_BENCH_BITS);
+    ignore_value(virBitmapSetBit(data.sparse, TEST_BENCH_BITS - 1));
+
+    if (testBenchRun(TEST_BENCH_SUITE, "count-bits", testBenchCountBits,
+                     &data, iterations) < 0 ||
+        testBenchRun(TEST_BENCH_SUITE, "next-set-bit", testBenchNextSetBit,
+                     &data, iterations) < 0 ||
+        testBenchRun(TEST_BENCH_SUITE, "overlaps", testBenchOverlaps,
+                     &data, iterations) < 0 ||
+        testBenchRun(TEST_BENCH_SUITE, "intersect", testBenchIntersect,
+                     &data, iterations) < 0 ||
+        testBenchRun(TEST_BENCH_SUITE, "union", testBenchUnion,
+                     &data, iterations) < 0)
+        ret = -1;
+
+    virBitmapFree(data.a);
+    virBitmapFree(data.b);
+    virBitmapFree(data.sparse);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
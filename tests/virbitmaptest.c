@@ -767,6 +767,92 @@ test15(const void *opaque)
 }
 
 
+static virBitmapPtr
+testBitmapRandom(size_t size,
+                 int density)
+{
+    virBitmapPtr map = virBitmapNew(size);
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        if (rand() % 100 < density)
+            ignore_value(virBitmapSetBit(map, i));
+    }
+
+    return map;
+}
+
+
+/* word-wise operations against a bit by bit reference */
+static int
+test16(const void *opaque G_GNUC_UNUSED)
+{
+    size_t sizes[] = { 1, 63, 64, 65, 255, 256, 257, 511, 512, 1000 };
+    int densities[] = { 0, 1, 10, 50 };
+    size_t i;
+    size_t j;
+    size_t k;
+
+    /* seed the generator so that rand() provides reproducible sequence */
+    srand(4242);
+
+    for (i = 0; i < G_N_ELEMENTS(sizes); i++) {
+        for (j = 0; j < G_N_ELEMENTS(densities); j++) {
+            g_autoptr(virBitmap) a = testBitmapRandom(sizes[i], densities[j]);
+            g_autoptr(virBitmap) b = testBitmapRandom(sizes[i] / 2 + 1,
+                                                      densities[j]);
+            g_autoptr(virBitmap) inter = virBitmapNewCopy(a);
+            g_autoptr(virBitmap) uni = virBitmapNewCopy(a);
+            g_autoptr(virBitmap) sub = virBitmapNewCopy(a);
+            size_t count = 0;
+            bool overlap = false;
+            ssize_t next = -1;
+
+            virBitmapIntersect(inter, b);
+            virBitmapSubtract(sub, b);
+            if (virBitmapUnion(uni, b) < 0)
+                return -1;
+
+            for (k = 0; k < sizes[i]; k++) {
+                bool inA = virBitmapIsBitSet(a, k);
+                bool inB = virBitmapIsBitSet(b, k);
+
+                if (inA) {
+                    if (virBitmapNextSetBit(a, next) != (ssize_t) k) {
+                        fprintf(stderr, "\nnext set bit after %zd is not %zu\n",
+                                next, k);
+                        return -1;
+                    }
+                    next = k;
+                    count++;
+                }
+
+                overlap |= inA && inB;
+
+                if (virBitmapIsBitSet(inter, k) != (inA && inB) ||
+                    virBitmapIsBitSet(uni, k) != (inA || inB) ||
+                    virBitmapIsBitSet(sub, k) != (inA && !inB)) {
+                    fprintf(stderr, "\nbinary operation mismatch at bit %zu\n",
+                            k);
+                    return -1;
+                }
+            }
+
+            if (virBitmapNextSetBit(a, next) != -1 ||
+                virBitmapCountBits(a) != count ||
+                virBitmapOverlaps(a, b) != overlap ||
+                virBitmapOverlaps(b, a) != overlap) {
+                fprintf(stderr, "\nmismatch for size %zu density %d\n",
+                        sizes[i], densities[j]);
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+
 #define TESTBINARYOP(A, B, RES, FUNC) \
     testBinaryOpData.a = A; \
     testBinaryOpData.b = B; \
@@ -834,6 +920,9 @@ mymain(void)
     TESTBINARYOP("12345", "0,^0", "12345", test15);
     TESTBINARYOP("0,^0", "0,^0", "0,^0", test15);
 
+    if (virTestRun("test16", test16, NULL) < 0)
+        ret = -1;
+
     return ret;
 }
 
@@ -357,6 +357,55 @@ testBufSetIndent(const void *opaque G_GNUC_UNUSED)
 }
 
 
+static int
+testBufAddAttr(const void *opaque G_GNUC_UNUSED)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autofree char *actual = NULL;
+    const char *expected =
+        "<c>\n"
+        "  <el a='b' c='&lt;&amp;&apos;&quot;&gt;' d='0' e='-1'"
+        " f='18446744073709551615' g='-9223372036854775808'/>\n"
+        "  <num>1234567890</num>\n"
+        "  <num>-42</num>\n"
+        "  <el x='&amp;' y='100%'/>\n"
+        "</c>";
+
+    virBufferAddLit(&buf, "<c>\n");
+    virBufferAdjustIndent(&buf, 2);
+    virBufferAddLit(&buf, "<el");
+    virBufferAddAttr(&buf, "a", "b");
+    virBufferAddAttr(&buf, "skipped", NULL);
+    virBufferEscapeAttr(&buf, "c", "<&'\">");
+    virBufferEscapeAttr(&buf, "skipped", NULL);
+    virBufferAddAttrULLong(&buf, "d", 0);
+    virBufferAddAttrLLong(&buf, "e", -1);
+    virBufferAddAttrULLong(&buf, "f", ULLONG_MAX);
+    virBufferAddAttrLLong(&buf, "g", LLONG_MIN);
+    virBufferAddLit(&buf, "/>\n");
+    virBufferAddLit(&buf, "<num>");
+    virBufferAddULLong(&buf, 1234567890);
+    virBufferAddLit(&buf, "</num>\n");
+    virBufferAddLit(&buf, "<num>");
+    virBufferAddLLong(&buf, -42);
+    virBufferAddLit(&buf, "</num>\n");
+    /* formats with other conversions go through printf */
+    virBufferEscapeString(&buf, "<el x='%s' y='100%%'/>\n", "&");
+    virBufferAdjustIndent(&buf, -2);
+    virBufferAddLit(&buf, "</c>");
+
+    if (!(actual = virBufferContentAndReset(&buf)))
+        return -1;
+
+    if (STRNEQ(actual, expected)) {
+        virTestDifference(stderr, expected, actual);
+        return -1;
+    }
+
+    return 0;
+}
+
+
 /* Result of this shows up only in valgrind or similar */
 static int
 testBufferAutoclean(const void *opaque G_GNUC_UNUSED)
@@ -385,6 +434,7 @@ mymain(void)
     DO_TEST("AddBuffer", testBufAddBuffer);
     DO_TEST("set indent", testBufSetIndent);
     DO_TEST("autoclean", testBufferAutoclean);
+    DO_TEST("AddAttr", testBufAddAttr);
 
 #define DO_TEST_ADD_STR(_data, _expect) \
     do { \
@@ -151,6 +151,15 @@ static int make_controller_v1(const char *path, mode_t mode)
         MAKE_FILE("memory.limit_in_bytes", "9223372036854775807\n");
         MAKE_FILE("memory.memsw.limit_in_bytes", ""); /* Not supported */
         MAKE_FILE("memory.memsw.usage_in_bytes", ""); /* Not supported */
+        MAKE_FILE("memory.numa_stat",
+                  "total=1000 N0=600 N1=400\n"
+                  "file=300 N0=200 N1=100\n"
+                  "anon=700 N0=400 N1=300\n"
+                  "unevictable=0 N0=0 N1=0\n"
+                  "hierarchical_total=3000 N0=1000 N1=2000\n"
+                  "hierarchical_file=300 N0=200 N1=100\n"
+                  "hierarchical_anon=2700 N0=800 N1=1900\n"
+                  "hierarchical_unevictable=0 N0=0 N1=0\n");
         MAKE_FILE("memory.soft_limit_in_bytes", "9223372036854775807\n");
         MAKE_FILE("memory.stat",
                   "cache 1336619008\n"
@@ -247,6 +256,8 @@ static int make_controller_v2(const char *path, mode_t mode)
     MAKE_FILE("cgroup.subtree_control", "");
     MAKE_FILE("cgroup.type", "domain\n");
     MAKE_FILE("cpu.max", "max 100000\n");
+    MAKE_FILE("cpu.pressure",
+              "some avg10=1.25 avg60=0.50 avg300=0.10 total=7418903\n");
     MAKE_FILE("cpu.stat",
               "usage_usec 0\n"
               "user_usec 0\n"
@@ -258,6 +269,15 @@ static int make_controller_v2(const char *path, mode_t mode)
     MAKE_FILE("memory.current", "1455321088\n");
     MAKE_FILE("memory.high", "max\n");
     MAKE_FILE("memory.max", "max\n");
+    MAKE_FILE("memory.numa_stat",
+              "anon N0=1048576 N1=2097152\n"
+              "file N0=1048576 N1=0\n"
+              "kernel_stack N0=16384 N1=0\n"
+              "shmem N0=1048576 N1=0\n"
+              "file_mapped N0=1048576 N1=0\n");
+    MAKE_FILE("memory.pressure",
+              "some avg10=12.34 avg60=5.67 avg300=1.00 total=98765\n"
+              "full avg10=3.21 avg60=1.23 avg300=0.01 total=4321\n");
     MAKE_FILE("memory.stat",
               "anon 0\n"
               "file 0\n"
@@ -291,6 +311,9 @@ static int make_controller_v2(const char *path, mode_t mode)
     MAKE_FILE("memory.swap.max", "max\n");
     MAKE_FILE("io.stat", "8:0 rbytes=26828800 wbytes=77062144 rios=2256 wios=7849 dbytes=0 dios=0\n");
     MAKE_FILE("io.max", "");
+    MAKE_FILE("io.pressure",
+              "some avg10=0.00 avg60=0.00 avg300=0.00 total=42\n"
+              "full avg10=0.00 avg60=0.00 avg300=0.00 total=21\n");
     MAKE_FILE("io.weight", "default 100\n");
 
 # undef MAKE_FILE
@@ -32,6 +32,7 @@
 # include "virbuffer.h"
 # include "testutilslxc.h"
 # include "virhostcpu.h"
+# include "virutil.h"
 
 # define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -635,6 +636,61 @@ static int testCgroupNewForSelfHybrid(const void *args G_GNUC_UNUSED)
 }
 
 
+static int
+testCgroupGetPressure(const void *args G_GNUC_UNUSED)
+{
+    virCgroupPtr cgroup = NULL;
+    virCgroupPressure pressure;
+    int ret = -1;
+
+    if (virCgroupNewSelf(&cgroup) < 0) {
+        fprintf(stderr, "Cannot create cgroup for self\n");
+        goto cleanup;
+    }
+
+    if (virCgroupGetPressure(cgroup, VIR_CGROUP_PRESSURE_CPU, &pressure) < 0) {
+        fprintf(stderr, "Could not get cpu pressure\n");
+        goto cleanup;
+    }
+
+    if (!pressure.hasSome || pressure.hasFull ||
+        pressure.some.total != 7418903ULL ||
+        pressure.some.avg10 < 1.24 || pressure.some.avg10 > 1.26) {
+        fprintf(stderr, "Wrong cpu pressure values\n");
+        goto cleanup;
+    }
+
+    if (virCgroupGetPressure(cgroup, VIR_CGROUP_PRESSURE_MEMORY, &pressure) < 0) {
+        fprintf(stderr, "Could not get memory pressure\n");
+        goto cleanup;
+    }
+
+    if (!pressure.hasSome || !pressure.hasFull ||
+        pressure.some.total != 98765ULL ||
+        pressure.full.total != 4321ULL ||
+        pressure.full.avg60 < 1.22 || pressure.full.avg60 > 1.24) {
+        fprintf(stderr, "Wrong memory pressure values\n");
+        goto cleanup;
+    }
+
+    if (virCgroupGetPressure(cgroup, VIR_CGROUP_PRESSURE_IO, &pressure) < 0) {
+        fprintf(stderr, "Could not get io pressure\n");
+        goto cleanup;
+    }
+
+    if (pressure.some.total != 42ULL || pressure.full.total != 21ULL) {
+        fprintf(stderr, "Wrong io pressure values\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virCgroupFree(&cgroup);
+    return ret;
+}
+
+
 static int testCgroupAvailable(const void *args)
 {
     bool got = virCgroupAvailable();
@@ -855,6 +911,60 @@ testCgroupGetMemoryStat(const void *args G_GNUC_UNUSED)
 }
 
 
+struct testCgroupNumaStatData {
+    const char *partition;
+    unsigned long long expected[2]; /* in KiB */
+};
+
+static int
+testCgroupGetMemoryNumaStat(const void *args)
+{
+    const struct testCgroupNumaStatData *data = args;
+    virCgroupPtr cgroup = NULL;
+    g_autofree unsigned long long *nodes = NULL;
+    size_t nnodes = 0;
+    size_t i;
+    int ret = -1;
+
+    if (data->partition) {
+        if (virCgroupNewPartition(data->partition, true,
+                                  (1 << VIR_CGROUP_CONTROLLER_MEMORY),
+                                  &cgroup) < 0) {
+            fprintf(stderr, "Could not create %s cgroup\n", data->partition);
+            goto cleanup;
+        }
+    } else if (virCgroupNewSelf(&cgroup) < 0) {
+        fprintf(stderr, "Cannot create cgroup for self\n");
+        goto cleanup;
+    }
+
+    if (virCgroupGetMemoryNumaStat(cgroup, &nodes, &nnodes) < 0) {
+        fprintf(stderr, "Could not get memory NUMA statistics\n");
+        goto cleanup;
+    }
+
+    if (nnodes != G_N_ELEMENTS(data->expected)) {
+        fprintf(stderr, "Wrong number of nodes %zu\n", nnodes);
+        goto cleanup;
+    }
+
+    for (i = 0; i < nnodes; i++) {
+        if (nodes[i] != data->expected[i]) {
+            fprintf(stderr,
+                    "Wrong value (%llu) for node %zu (expected %llu)\n",
+                    nodes[i], i, data->expected[i]);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    virCgroupFree(&cgroup);
+    return ret;
+}
+
+
 static int testCgroupGetBlkioIoServiced(const void *args G_GNUC_UNUSED)
 {
     virCgroupPtr cgroup = NULL;
@@ -905,6 +1015,63 @@ static int testCgroupGetBlkioIoServiced(const void *args G_GNUC_UNUSED)
     return ret;
 }
 
+static int
+testCgroupStatsSession(const void *args G_GNUC_UNUSED)
+{
+    virCgroupPtr cgroup = NULL;
+    size_t i;
+    int rv, ret = -1;
+    long long values[4];
+    unsigned long long memvalues[6];
+
+    if ((rv = virCgroupNewPartition("/virtualmachines", true,
+                                    (1 << VIR_CGROUP_CONTROLLER_BLKIO) |
+                                    (1 << VIR_CGROUP_CONTROLLER_MEMORY),
+                                    &cgroup)) < 0) {
+        fprintf(stderr, "Could not create /virtualmachines cgroup: %d\n", -rv);
+        goto cleanup;
+    }
+
+    if (virCgroupStatsSessionStart(cgroup) < 0)
+        goto cleanup;
+
+    /* the second round is served from the files opened by the first one */
+    for (i = 0; i < 2; i++) {
+        if (virCgroupGetBlkioIoServiced(cgroup, values, &values[1],
+                                        &values[2], &values[3]) < 0 ||
+            virCgroupGetMemoryStat(cgroup, &memvalues[0], &memvalues[1],
+                                   &memvalues[2], &memvalues[3],
+                                   &memvalues[4], &memvalues[5]) < 0) {
+            fprintf(stderr, "Could not read stats in round %zu\n", i);
+            goto cleanup;
+        }
+
+        if (values[0] != 119084214273LL || values[3] != 73283807 ||
+            memvalues[0] != (1336619008ULL >> 10)) {
+            fprintf(stderr, "Wrong stats values in round %zu\n", i);
+            goto cleanup;
+        }
+    }
+
+    if (cgroup->stats->nfiles != 3) {
+        fprintf(stderr, "Expected 3 open stats files, got %zu\n",
+                cgroup->stats->nfiles);
+        goto cleanup;
+    }
+
+    virCgroupStatsSessionStop(cgroup);
+    if (cgroup->stats) {
+        fprintf(stderr, "Stats session was not stopped\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virCgroupFree(&cgroup);
+    return ret;
+}
+
 static int testCgroupGetBlkioIoDeviceServiced(const void *args G_GNUC_UNUSED)
 {
     virCgroupPtr cgroup = NULL;
@@ -1021,6 +1188,7 @@ mymain(void)
 {
     int ret = 0;
     char *fakerootdir;
+    struct testCgroupNumaStatData numaStat = { 0 };
 
 # define DETECT_MOUNTS_FULL(file, fail) \
     do { \
@@ -1088,8 +1256,19 @@ mymain(void)
     if (virTestRun("virCgroupGetMemoryStat works", testCgroupGetMemoryStat, NULL) < 0)
         ret = -1;
 
+    /* the hierarchical counters are used, in pages */
+    numaStat.partition = "/virtualmachines";
+    numaStat.expected[0] = 1000 * virGetSystemPageSizeKB();
+    numaStat.expected[1] = 2000 * virGetSystemPageSizeKB();
+    if (virTestRun("virCgroupGetMemoryNumaStat works",
+                   testCgroupGetMemoryNumaStat, &numaStat) < 0)
+        ret = -1;
+
     if (virTestRun("virCgroupGetPercpuStats works", testCgroupGetPercpuStats, NULL) < 0)
         ret = -1;
+
+    if (virTestRun("Cgroup stats session", testCgroupStatsSession, NULL) < 0)
+        ret = -1;
     cleanupFakeFS(fakerootdir);
 
     fakerootdir = initFakeFS(NULL, "all-in-one");
@@ -1113,6 +1292,16 @@ mymain(void)
         ret = -1;
     if (virTestRun("Cgroup available (unified)", testCgroupAvailable, (void*)0x1) < 0)
         ret = -1;
+    if (virTestRun("virCgroupGetPressure works", testCgroupGetPressure, NULL) < 0)
+        ret = -1;
+
+    /* anon and file, in bytes */
+    numaStat.partition = NULL;
+    numaStat.expected[0] = 2048;
+    numaStat.expected[1] = 2048;
+    if (virTestRun("virCgroupGetMemoryNumaStat works (unified)",
+                   testCgroupGetMemoryNumaStat, &numaStat) < 0)
+        ret = -1;
     cleanupFakeFS(fakerootdir);
 
     /* cgroup hybrid */
@@ -52,6 +52,24 @@ VIR_MOCK_STUB_RET_ARGS(dbus_message_set_reply_serial,
                        dbus_uint32_t, serial)
 
 
+VIR_MOCK_STUB_VOID_ARGS(dbus_bus_add_match,
+                        DBusConnection *, connection,
+                        const char *, rule,
+                        DBusError *, error)
+
+
+VIR_MOCK_LINK_RET_ARGS(dbus_connection_add_filter,
+                       dbus_bool_t,
+                       DBusConnection *, connection,
+                       DBusHandleMessageFunction, function,
+                       void *, user_data,
+                       DBusFreeFunction, free_data_function)
+
+VIR_MOCK_LINK_VOID_ARGS(dbus_connection_remove_filter,
+                        DBusConnection *, connection,
+                        DBusHandleMessageFunction, function,
+                        void *, user_data)
+
 VIR_MOCK_LINK_RET_ARGS(dbus_connection_send_with_reply_and_block,
                        DBusMessage *,
                        DBusConnection *, connection,
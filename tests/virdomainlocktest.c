@@ -0,0 +1,281 @@
+/*
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <unistd.h>
+
+#include "testutils.h"
+#include "locking/domain_lock.h"
+#include "virfile.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+static virDomainXMLOptionPtr xmlopt;
+static virLockManagerPluginPtr plugin;
+
+
+static virDomainObjPtr
+testDomainNew(size_t idx)
+{
+    virDomainDefPtr def;
+    virDomainObjPtr vm;
+
+    if (!(def = virDomainDefNew()))
+        return NULL;
+
+    def->id = idx + 1;
+    def->name = g_strdup_printf("dom%zu", idx);
+    memset(def->uuid, 0, VIR_UUID_BUFLEN);
+    memcpy(def->uuid, &idx, sizeof(idx));
+
+    if (!(vm = virDomainObjNew(xmlopt))) {
+        virDomainDefFree(def);
+        return NULL;
+    }
+
+    vm->def = def;
+    vm->pid = getpid();
+
+    return vm;
+}
+
+
+/*
+ * Fetches the totals of the nop lock driver into @stats. Returns 1 if
+ * the driver is registered, 0 if not and -1 if it's listed more than
+ * once.
+ */
+static int
+testGetDriverStats(virDomainLockStatsPtr stats)
+{
+    virDomainLockDriverStatsPtr list = NULL;
+    size_t nlist = virDomainLockGetStats(&list);
+    size_t i;
+    int ret = 0;
+
+    memset(stats, 0, sizeof(*stats));
+
+    for (i = 0; i < nlist; i++) {
+        if (STRNEQ(list[i].driver, "nop"))
+            continue;
+
+        if (ret == 1) {
+            fprintf(stderr, "Lock driver 'nop' is registered twice\n");
+            ret = -1;
+            break;
+        }
+
+        *stats = list[i].stats;
+        ret = 1;
+    }
+
+    virDomainLockDriverStatsFree(list, nlist);
+    return ret;
+}
+
+
+static int
+testCheckStats(const char *what,
+               virDomainLockStatsPtr stats,
+               unsigned long long acquires,
+               unsigned long long releases)
+{
+    if (stats->acquires != acquires || stats->releases != releases) {
+        fprintf(stderr,
+                "Expected %s acquires=%llu releases=%llu, "
+                "got acquires=%llu releases=%llu\n",
+                what, acquires, releases, stats->acquires, stats->releases);
+        return -1;
+    }
+
+    if (stats->acquireFailed || stats->acquireBusy || stats->releaseFailed) {
+        fprintf(stderr, "Unexpected failures in %s\n", what);
+        return -1;
+    }
+
+    if (stats->acquireTimeMax > stats->acquireTime ||
+        stats->releaseTimeMax > stats->releaseTime) {
+        fprintf(stderr, "Maximum time in %s exceeds the total\n", what);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testCheckDriverStats(virDomainLockStatsPtr base,
+                     unsigned long long acquires,
+                     unsigned long long releases)
+{
+    virDomainLockStats stats;
+
+    if (testGetDriverStats(&stats) != 1) {
+        fprintf(stderr, "Lock driver 'nop' is not registered once\n");
+        return -1;
+    }
+
+    return testCheckStats("driver",
+                          &stats,
+                          base->acquires + acquires,
+                          base->releases + releases);
+}
+
+
+static int
+testDomainLockRegister(const void *opaque G_GNUC_UNUSED)
+{
+    virDomainObjPtr vm = NULL;
+    virDomainLockStats base;
+    int fd = -1;
+    g_autofree char *state = NULL;
+    int ret = -1;
+
+    if (testGetDriverStats(&base) != 0) {
+        fprintf(stderr, "Lock driver 'nop' is registered before use\n");
+        return -1;
+    }
+
+    if (!(vm = testDomainNew(0)))
+        return -1;
+
+    /* merely registering a paused process takes no leases */
+    if (virDomainLockProcessStart(plugin, "qemu:///system", vm, true, &fd) < 0 ||
+        virDomainLockProcessInquire(plugin, vm, &state) < 0)
+        goto cleanup;
+
+    if (testGetDriverStats(&base) != 0) {
+        fprintf(stderr, "Lock driver 'nop' is registered without requests\n");
+        goto cleanup;
+    }
+
+    if (virDomainLockProcessResume(plugin, "qemu:///system", vm, NULL) < 0)
+        goto cleanup;
+
+    if (testCheckStats("domain", &vm->lockStats, 1, 0) < 0 ||
+        testCheckDriverStats(&base, 1, 0) < 0)
+        goto cleanup;
+
+    VIR_FREE(state);
+    if (virDomainLockProcessPause(plugin, vm, &state) < 0 ||
+        virDomainLockProcessResume(plugin, "qemu:///system", vm, state) < 0)
+        goto cleanup;
+
+    if (testCheckStats("domain", &vm->lockStats, 2, 1) < 0 ||
+        testCheckDriverStats(&base, 2, 1) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    VIR_FORCE_CLOSE(fd);
+    virObjectUnref(vm);
+    return ret;
+}
+
+
+static int
+testDomainLockRemove(const void *opaque G_GNUC_UNUSED)
+{
+    virDomainObjPtr vm1 = NULL;
+    virDomainObjPtr vm2 = NULL;
+    virDomainLockStats base;
+    g_autofree char *state = NULL;
+    int ret = -1;
+
+    if (testGetDriverStats(&base) < 0)
+        return -1;
+
+    if (!(vm1 = testDomainNew(1)) ||
+        !(vm2 = testDomainNew(2)))
+        goto cleanup;
+
+    if (virDomainLockProcessResume(plugin, "qemu:///system", vm1, NULL) < 0 ||
+        virDomainLockProcessResume(plugin, "qemu:///system", vm2, NULL) < 0 ||
+        virDomainLockProcessPause(plugin, vm2, &state) < 0)
+        goto cleanup;
+
+    if (testCheckStats("domain 1", &vm1->lockStats, 1, 0) < 0 ||
+        testCheckStats("domain 2", &vm2->lockStats, 1, 1) < 0 ||
+        testCheckDriverStats(&base, 2, 1) < 0)
+        goto cleanup;
+
+    /* the statistics of a domain go away with it, the totals of the
+     * driver keep what it did and stay registered */
+    virObjectUnref(vm2);
+    vm2 = NULL;
+
+    if (testCheckStats("domain 1", &vm1->lockStats, 1, 0) < 0 ||
+        testCheckDriverStats(&base, 2, 1) < 0)
+        goto cleanup;
+
+    VIR_FREE(state);
+    if (virDomainLockProcessPause(plugin, vm1, &state) < 0)
+        goto cleanup;
+
+    virObjectUnref(vm1);
+    vm1 = NULL;
+
+    if (testCheckDriverStats(&base, 2, 2) < 0)
+        goto cleanup;
+
+    /* a domain which comes back starts from scratch */
+    if (!(vm2 = testDomainNew(2)))
+        goto cleanup;
+
+    if (testCheckStats("new domain 2", &vm2->lockStats, 0, 0) < 0 ||
+        virDomainLockProcessResume(plugin, "qemu:///system", vm2, NULL) < 0 ||
+        testCheckStats("new domain 2", &vm2->lockStats, 1, 0) < 0 ||
+        testCheckDriverStats(&base, 3, 2) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virObjectUnref(vm1);
+    virObjectUnref(vm2);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (!(xmlopt = virDomainXMLOptionNew(NULL, NULL, NULL, NULL, NULL)))
+        return EXIT_FAILURE;
+
+    if (!(plugin = virLockManagerPluginNew("nop", "qemu", abs_srcdir, 0))) {
+        virObjectUnref(xmlopt);
+        return EXIT_FAILURE;
+    }
+
+    if (virTestRun("Lock statistics registration",
+                   testDomainLockRegister, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Lock statistics removal",
+                   testDomainLockRemove, NULL) < 0)
+        ret = -1;
+
+    virLockManagerPluginUnref(plugin);
+    virObjectUnref(xmlopt);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
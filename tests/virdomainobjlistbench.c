@@ -0,0 +1,192 @@
+/*
+ * virdomainobjlistbench.c: benchmarks of the domain object list
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "testutilsbench.h"
+#include "virdomainobjlist.h"
+#include "virthread.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+#define TEST_BENCH_SUITE "domainobjlist"
+#define TEST_BENCH_NDOMS 1000
+#define TEST_BENCH_READERS 4
+
+static virDomainXMLOptionPtr xmlopt;
+
+typedef struct {
+    virDomainObjListPtr doms;
+    size_t next;
+} testBenchData;
+
+typedef struct {
+    virDomainObjListPtr doms;
+    int quit;
+    bool failed;
+} testBenchReader;
+
+
+static virDomainObjPtr
+testBenchAddDomain(virDomainObjListPtr doms,
+                   size_t idx)
+{
+    virDomainDefPtr def;
+    virDomainObjPtr vm;
+
+    if (!(def = virDomainDefNew()))
+        return NULL;
+
+    def->id = -1;
+    def->name = g_strdup_printf("dom%zu", idx);
+    memset(def->uuid, 0, VIR_UUID_BUFLEN);
+    memcpy(def->uuid, &idx, sizeof(idx));
+
+    if (!(vm = virDomainObjListAdd(doms, def, xmlopt, 0, NULL))) {
+        virDomainDefFree(def);
+        return NULL;
+    }
+
+    return vm;
+}
+
+
+static int
+testBenchCollectOnce(virDomainObjListPtr doms)
+{
+    virDomainObjPtr *vms = NULL;
+    size_t nvms = 0;
+
+    if (virDomainObjListCollect(doms, NULL, &vms, &nvms, NULL,
+                                VIR_CONNECT_LIST_DOMAINS_INACTIVE) < 0)
+        return -1;
+
+    virObjectListFreeCount(vms, nvms);
+    return 0;
+}
+
+
+/* Bulk listing as done by virConnectListAllDomains */
+static int
+testBenchCollect(const void *opaque,
+                 size_t iterations)
+{
+    const testBenchData *data = opaque;
+    size_t i;
+
+    for (i = 0; i < iterations; i++) {
+        if (testBenchCollectOnce(data->doms) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static void
+testBenchReaderFunc(void *opaque)
+{
+    testBenchReader *reader = opaque;
+
+    while (!g_atomic_int_get(&reader->quit)) {
+        if (testBenchCollectOnce(reader->doms) < 0) {
+            reader->failed = true;
+            return;
+        }
+    }
+}
+
+
+/* Defining and undefining domains while others list them */
+static int
+testBenchDefineUndefine(const void *opaque,
+                        size_t iterations)
+{
+    testBenchData *data = (testBenchData *) opaque;
+    testBenchReader readers[TEST_BENCH_READERS] = { 0 };
+    virThread threads[TEST_BENCH_READERS];
+    size_t nthreads = 0;
+    size_t i;
+    int ret = -1;
+
+    for (nthreads = 0; nthreads < TEST_BENCH_READERS; nthreads++) {
+        readers[nthreads].doms = data->doms;
+        if (virThreadCreate(&threads[nthreads], true,
+                            testBenchReaderFunc, &readers[nthreads]) < 0)
+            goto cleanup;
+    }
+
+    for (i = 0; i < iterations; i++) {
+        virDomainObjPtr vm;
+
+        if (!(vm = testBenchAddDomain(data->doms, data->next++)))
+            goto cleanup;
+
+        virDomainObjListRemove(data->doms, vm);
+        virDomainObjEndAPI(&vm);
+    }
+
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < nthreads; i++) {
+        g_atomic_int_set(&readers[i].quit, 1);
+        virThreadJoin(&threads[i]);
+        if (readers[i].failed)
+            ret = -1;
+    }
+
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    testBenchData data = { 0 };
+    int ret = 0;
+
+    if (!(xmlopt = virDomainXMLOptionNew(NULL, NULL, NULL, NULL, NULL)) ||
+        !(data.doms = virDomainObjListNew()))
+        return EXIT_FAILURE;
+
+    for (data.next = 0; data.next < TEST_BENCH_NDOMS; data.next++) {
+        virDomainObjPtr vm;
+
+        if (!(vm = testBenchAddDomain(data.doms, data.next))) {
+            ret = -1;
+            goto cleanup;
+        }
+        virDomainObjEndAPI(&vm);
+    }
+
+    if (testBenchRun(TEST_BENCH_SUITE, "collect", testBenchCollect,
+                     &data, 10000) < 0 ||
+        testBenchRun(TEST_BENCH_SUITE, "define-undefine-with-readers",
+                     testBenchDefineUndefine, &data, TEST_BENCH_NDOMS) < 0)
+        ret = -1;
+
+ cleanup:
+    virObjectUnref(data.doms);
+    virObjectUnref(xmlopt);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
@@ -0,0 +1,235 @@
+/*
+ * virdomainobjlisttest.c: Test domain object list
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "virdomainobjlist.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+#define TEST_NDOMS 100
+
+static virDomainXMLOptionPtr xmlopt;
+
+
+static virDomainObjPtr
+testAddDomain(virDomainObjListPtr doms,
+              size_t idx,
+              int id)
+{
+    virDomainDefPtr def;
+    virDomainObjPtr vm;
+
+    if (!(def = virDomainDefNew()))
+        return NULL;
+
+    def->id = id;
+    def->name = g_strdup_printf("dom%zu", idx);
+    memset(def->uuid, 0, VIR_UUID_BUFLEN);
+    memcpy(def->uuid, &idx, sizeof(idx));
+
+    if (!(vm = virDomainObjListAdd(doms, def, xmlopt, 0, NULL))) {
+        virDomainDefFree(def);
+        return NULL;
+    }
+
+    return vm;
+}
+
+
+static virDomainObjListPtr
+testCreateList(size_t ndoms)
+{
+    virDomainObjListPtr doms;
+    size_t i;
+
+    if (!(doms = virDomainObjListNew()))
+        return NULL;
+
+    for (i = 0; i < ndoms; i++) {
+        virDomainObjPtr vm;
+
+        if (!(vm = testAddDomain(doms, i, -1))) {
+            virObjectUnref(doms);
+            return NULL;
+        }
+        virDomainObjEndAPI(&vm);
+    }
+
+    return doms;
+}
+
+
+static int
+testCollectCount(virDomainObjListPtr doms,
+                 size_t expect)
+{
+    virDomainObjPtr *vms = NULL;
+    size_t nvms = 0;
+
+    if (virDomainObjListCollect(doms, NULL, &vms, &nvms, NULL, 0) < 0)
+        return -1;
+
+    virObjectListFreeCount(vms, nvms);
+
+    if (nvms != expect) {
+        VIR_TEST_VERBOSE("expected %zu domains, got %zu", expect, nvms);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testCollect(const void *opaque G_GNUC_UNUSED)
+{
+    virDomainObjListPtr doms;
+    virDomainObjPtr vm = NULL;
+    int ret = -1;
+
+    if (!(doms = testCreateList(TEST_NDOMS)))
+        return -1;
+
+    /* the second call is served from the snapshot */
+    if (testCollectCount(doms, TEST_NDOMS) < 0 ||
+        testCollectCount(doms, TEST_NDOMS) < 0)
+        goto cleanup;
+
+    if (!(vm = testAddDomain(doms, TEST_NDOMS, -1)))
+        goto cleanup;
+
+    if (testCollectCount(doms, TEST_NDOMS + 1) < 0)
+        goto cleanup;
+
+    virDomainObjListRemove(doms, vm);
+
+    if (testCollectCount(doms, TEST_NDOMS) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    virObjectUnref(doms);
+    return ret;
+}
+
+
+static int
+testFindByID(const void *opaque G_GNUC_UNUSED)
+{
+    virDomainObjListPtr doms;
+    virDomainObjPtr vm = NULL;
+    virDomainObjPtr found = NULL;
+    int ret = -1;
+
+    if (!(doms = testCreateList(TEST_NDOMS)))
+        return -1;
+
+    if (!(vm = testAddDomain(doms, TEST_NDOMS, -1)))
+        goto cleanup;
+    virObjectUnlock(vm);
+
+    if ((found = virDomainObjListFindByID(doms, 42)))
+        goto cleanup;
+
+    /* start */
+    virObjectLock(vm);
+    virDomainObjListSetID(doms, vm, 42);
+    virDomainObjSetState(vm, VIR_DOMAIN_RUNNING, VIR_DOMAIN_RUNNING_BOOTED);
+    virObjectUnlock(vm);
+
+    if ((found = virDomainObjListFindByID(doms, 42)) != vm)
+        goto cleanup;
+    virDomainObjEndAPI(&found);
+
+    if ((found = virDomainObjListFindByID(doms, 43)))
+        goto cleanup;
+
+    /* stop */
+    virObjectLock(vm);
+    virDomainObjListSetID(doms, vm, -1);
+    virDomainObjSetState(vm, VIR_DOMAIN_SHUTOFF, VIR_DOMAIN_SHUTOFF_SHUTDOWN);
+    virObjectUnlock(vm);
+
+    if ((found = virDomainObjListFindByID(doms, 42)))
+        goto cleanup;
+
+    /* start again with a new ID */
+    virObjectLock(vm);
+    virDomainObjListSetID(doms, vm, 43);
+    virDomainObjSetState(vm, VIR_DOMAIN_RUNNING, VIR_DOMAIN_RUNNING_BOOTED);
+    virObjectUnlock(vm);
+
+    if ((found = virDomainObjListFindByID(doms, 42)))
+        goto cleanup;
+
+    if ((found = virDomainObjListFindByID(doms, 43)) != vm)
+        goto cleanup;
+    virDomainObjEndAPI(&found);
+
+    /* removal of a running domain */
+    virObjectLock(vm);
+    virDomainObjListRemove(doms, vm);
+    virObjectUnlock(vm);
+
+    if ((found = virDomainObjListFindByID(doms, 43)))
+        goto cleanup;
+
+    /* a domain added with a live definition is found right away */
+    virObjectUnref(vm);
+    if (!(vm = testAddDomain(doms, TEST_NDOMS + 1, 44)))
+        goto cleanup;
+    virObjectUnlock(vm);
+
+    if ((found = virDomainObjListFindByID(doms, 44)) != vm)
+        goto cleanup;
+    virDomainObjEndAPI(&found);
+
+    ret = 0;
+
+ cleanup:
+    virDomainObjEndAPI(&found);
+    virObjectUnref(vm);
+    virObjectUnref(doms);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (!(xmlopt = virDomainXMLOptionNew(NULL, NULL, NULL, NULL, NULL)))
+        return EXIT_FAILURE;
+
+    if (virTestRun("Collect", testCollect, NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("Find by ID", testFindByID, NULL) < 0)
+        ret = -1;
+
+    virObjectUnref(xmlopt);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
@@ -196,6 +196,61 @@ testFileCache(const void *opaque)
 }
 
 
+static int
+testFileCacheRefreshAsync(const void *opaque)
+{
+    int ret = -1;
+    virFileCachePtr cache = (virFileCachePtr) opaque;
+    testFileCachePrivPtr testPriv = virFileCacheGetPriv(cache);
+    testFileCacheObjPtr obj = NULL;
+    size_t i;
+
+    testPriv->dataSaved = false;
+    testPriv->newData = "new\n";
+    testPriv->expectData = "new\n";
+
+    if (!(obj = testFileCacheObjNew("old\n")) ||
+        virFileCacheInsertData(cache, "cacheRefreshAsync", obj) < 0)
+        goto cleanup;
+    obj = NULL;
+
+    virFileCacheSetRefreshAsync(cache, true);
+
+    if (!(obj = virFileCacheLookup(cache, "cacheRefreshAsync"))) {
+        fprintf(stderr, "Getting cached data failed.\n");
+        goto cleanup;
+    }
+
+    /* the outdated data is returned or it was already refreshed */
+    if (STRNEQ(obj->data, "old\n") && STRNEQ(obj->data, "new\n")) {
+        fprintf(stderr, "Unexpected data '%s'.\n", obj->data);
+        goto cleanup;
+    }
+
+    for (i = 0; i < 500 && STRNEQ(obj->data, "new\n"); i++) {
+        g_usleep(10 * 1000);
+        virObjectUnref(obj);
+        if (!(obj = virFileCacheLookup(cache, "cacheRefreshAsync"))) {
+            fprintf(stderr, "Getting cached data failed.\n");
+            goto cleanup;
+        }
+    }
+
+    if (STRNEQ(obj->data, "new\n")) {
+        fprintf(stderr, "Data was not refreshed, loaded data '%s'.\n",
+                obj->data);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virFileCacheSetRefreshAsync(cache, false);
+    virObjectUnref(obj);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -224,6 +279,9 @@ mymain(void)
     TEST_RUN("cacheInvalid", "bbb\n", "bbb\n", true);
     TEST_RUN("cacheMissing", "ccc\n", "ccc\n", true);
 
+    if (virTestRun("cacheRefreshAsync", testFileCacheRefreshAsync, cache) < 0)
+        ret = -1;
+
     virObjectUnref(cache);
 
     return ret != 0 ? EXIT_FAILURE : EXIT_SUCCESS;
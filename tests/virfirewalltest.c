@@ -1040,6 +1040,107 @@ testFirewallQuery(const void *opaque G_GNUC_UNUSED)
     return ret;
 }
 
+static void
+testFirewallRestoreHook(const char *const*args G_GNUC_UNUSED,
+                        const char *const*env G_GNUC_UNUSED,
+                        const char *input,
+                        char **output G_GNUC_UNUSED,
+                        char **error G_GNUC_UNUSED,
+                        int *status G_GNUC_UNUSED,
+                        void *opaque)
+{
+    virBufferPtr inbuf = opaque;
+
+    virBufferAdd(inbuf, NULLSTR_EMPTY(input), -1);
+}
+
+static int
+testFirewallRestore(const void *opaque G_GNUC_UNUSED)
+{
+    g_auto(virBuffer) cmdbuf = VIR_BUFFER_INITIALIZER;
+    g_auto(virBuffer) inbuf = VIR_BUFFER_INITIALIZER;
+    g_autoptr(virFirewall) fw = NULL;
+    int ret = -1;
+    const char *actual = NULL;
+    const char *expected =
+        IPTABLES_RESTORE_PATH " --noflush\n"
+        IPTABLES_PATH " -A INPUT --source-host 192.168.122.255 --jump REJECT\n"
+        IPTABLES_RESTORE_PATH " --noflush\n";
+    const char *expectedInput =
+        "*filter\n"
+        "-A INPUT --source-host 192.168.122.1 --jump ACCEPT\n"
+        "-A INPUT -m comment --comment \"libvirt rule\" --jump ACCEPT\n"
+        "COMMIT\n"
+        "*nat\n"
+        "-A POSTROUTING --jump MASQUERADE\n"
+        "COMMIT\n"
+        "*filter\n"
+        "-A OUTPUT --jump DROP\n"
+        "COMMIT\n";
+
+    if (!virFileIsExecutable(IPTABLES_RESTORE_PATH))
+        return EXIT_AM_SKIP;
+
+    fwDisabled = true;
+    if (virFirewallSetBackend(VIR_FIREWALL_BACKEND_DIRECT_RESTORE) < 0)
+        goto cleanup;
+
+    virCommandSetDryRun(&cmdbuf, testFirewallRestoreHook, &inbuf);
+
+    fw = virFirewallNew();
+    virFirewallStartTransaction(fw, 0);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-A", "INPUT",
+                       "--source-host", "192.168.122.1",
+                       "--jump", "ACCEPT", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-A", "INPUT",
+                       "-m", "comment", "--comment", "libvirt rule",
+                       "--jump", "ACCEPT", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "--table", "nat",
+                       "-A", "POSTROUTING",
+                       "--jump", "MASQUERADE", NULL);
+
+    /* must not abort the batch, so it is run on its own */
+    virFirewallAddRuleFull(fw, VIR_FIREWALL_LAYER_IPV4,
+                           true, NULL, NULL,
+                           "-A", "INPUT",
+                           "--source-host", "192.168.122.255",
+                           "--jump", "REJECT", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-A", "OUTPUT",
+                       "--jump", "DROP", NULL);
+
+    if (virFirewallApply(fw) < 0)
+        goto cleanup;
+
+    actual = virBufferCurrentContent(&cmdbuf);
+
+    if (STRNEQ_NULLABLE(expected, actual)) {
+        fprintf(stderr, "Unexpected command execution\n");
+        virTestDifference(stderr, expected, actual);
+        goto cleanup;
+    }
+
+    actual = virBufferCurrentContent(&inbuf);
+
+    if (STRNEQ_NULLABLE(expectedInput, actual)) {
+        fprintf(stderr, "Unexpected restore input\n");
+        virTestDifference(stderr, expectedInput, actual);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virCommandSetDryRun(NULL, NULL, NULL);
+    return ret;
+}
+
 static bool
 hasNetfilterTools(void)
 {
@@ -1110,6 +1211,9 @@ mymain(void)
     RUN_TEST("chained rollback", testFirewallChainedRollback);
     RUN_TEST("query transaction", testFirewallQuery);
 
+    if (virTestRun("restore batching", testFirewallRestore, NULL) < 0)
+        ret = -1;
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
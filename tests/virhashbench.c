@@ -0,0 +1,160 @@
+/*
+ * virhashbench.c: benchmarks of hash table backends
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "testutilsbench.h"
+#include "virhash.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+#define TEST_BENCH_SUITE "hash"
+#define TEST_BENCH_NKEYS 100000
+
+typedef struct {
+    unsigned int flags;
+    char **keys;
+    virHashTablePtr hash;
+} testBenchData;
+
+
+static int
+testBenchInsert(const void *opaque,
+                size_t iterations)
+{
+    testBenchData *data = (testBenchData *) opaque;
+    size_t i;
+
+    for (i = 0; i < iterations; i++) {
+        const char *key = data->keys[i % TEST_BENCH_NKEYS];
+
+        if (i % TEST_BENCH_NKEYS == 0) {
+            virHashFree(data->hash);
+            if (!(data->hash = virHashNewFlags(NULL, data->flags)))
+                return -1;
+        }
+
+        if (virHashAddEntry(data->hash, key, (void *) key) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testBenchLookup(const void *opaque,
+                size_t iterations)
+{
+    const testBenchData *data = opaque;
+    size_t i;
+
+    for (i = 0; i < iterations; i++) {
+        const char *key = data->keys[i % TEST_BENCH_NKEYS];
+
+        if (virHashLookup(data->hash, key) != key) {
+            fprintf(stderr, "entry \"%s\" could not be found\n", key);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+static int
+testBenchIterateCb(void *payload G_GNUC_UNUSED,
+                   const void *name G_GNUC_UNUSED,
+                   void *opaque)
+{
+    size_t *count = opaque;
+
+    (*count)++;
+    return 0;
+}
+
+
+static int
+testBenchIterate(const void *opaque,
+                 size_t iterations)
+{
+    const testBenchData *data = opaque;
+    size_t count = 0;
+    size_t i;
+
+    for (i = 0; i < iterations; i++)
+        virHashForEach(data->hash, testBenchIterateCb, &count);
+
+    if (count != iterations * (size_t) virHashSize(data->hash)) {
+        fprintf(stderr, "iteration found %zu entries\n", count);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testBenchBackend(const char *backend,
+                 unsigned int flags,
+                 char **keys)
+{
+    testBenchData data = { .flags = flags, .keys = keys };
+    g_autofree char *insertName = g_strdup_printf("insert-%s", backend);
+    g_autofree char *lookupName = g_strdup_printf("lookup-%s", backend);
+    g_autofree char *iterateName = g_strdup_printf("iterate-%s", backend);
+    int ret = -1;
+
+    /* inserting a full round of keys leaves the table for the others */
+    if (testBenchRun(TEST_BENCH_SUITE, insertName, testBenchInsert,
+                     &data, TEST_BENCH_NKEYS) < 0 ||
+        testBenchRun(TEST_BENCH_SUITE, lookupName, testBenchLookup,
+                     &data, 20 * TEST_BENCH_NKEYS) < 0 ||
+        testBenchRun(TEST_BENCH_SUITE, iterateName, testBenchIterate,
+                     &data, 20) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    virHashFree(data.hash);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    g_auto(GStrv) keys = g_new0(char *, TEST_BENCH_NKEYS + 1);
+    size_t i;
+    int ret = 0;
+
+    for (i = 0; i < TEST_BENCH_NKEYS; i++)
+        keys[i] = g_strdup_printf("%08zx-%04zx-instance", i * 2654435761U, i);
+
+    if (testBenchBackend("chained", 0, keys) < 0)
+        ret = -1;
+
+    if (testBenchBackend("open-addressing", VIR_HASH_OPEN_ADDRESSING, keys) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
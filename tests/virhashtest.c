@@ -14,13 +14,25 @@
 
 VIR_LOG_INIT("tests.hashtest");
 
+/* virHashFlags of the backend under test */
+static unsigned int testHashFlags;
+
+static virHashTablePtr
+testHashCreate(int size)
+{
+    if (testHashFlags)
+        return virHashNewFlags(NULL, testHashFlags);
+
+    return virHashCreate(size, NULL);
+}
+
 static virHashTablePtr
 testHashInit(int size)
 {
     virHashTablePtr hash;
     ssize_t i;
 
-    if (!(hash = virHashCreate(size, NULL)))
+    if (!(hash = testHashCreate(size)))
         return NULL;
 
     /* entries are added in reverse order so that they will be linked in
@@ -395,7 +407,7 @@ testHashGetItems(const void *data G_GNUC_UNUSED)
     char value2[] = "2";
     char value3[] = "3";
 
-    if (!(hash = virHashCreate(0, NULL)) ||
+    if (!(hash = testHashCreate(0)) ||
         virHashAddEntry(hash, keya, value3) < 0 ||
         virHashAddEntry(hash, keyc, value1) < 0 ||
         virHashAddEntry(hash, keyb, value2) < 0) {
@@ -465,8 +477,8 @@ testHashEqual(const void *data G_GNUC_UNUSED)
     char value3_u[] = "O";
     char value4_u[] = "P";
 
-    if (!(hash1 = virHashCreate(0, NULL)) ||
-        !(hash2 = virHashCreate(0, NULL)) ||
+    if (!(hash1 = testHashCreate(0)) ||
+        !(hash2 = testHashCreate(0)) ||
         virHashAddEntry(hash1, keya, value1_l) < 0 ||
         virHashAddEntry(hash1, keyb, value2_l) < 0 ||
         virHashAddEntry(hash1, keyc, value3_l) < 0 ||
@@ -515,7 +527,7 @@ testHashDuplicate(const void *data G_GNUC_UNUSED)
 {
     g_autoptr(virHashTable) hash = NULL;
 
-    if (!(hash = virHashCreate(0, NULL)))
+    if (!(hash = testHashCreate(0)))
         return -1;
 
     if (virHashAddEntry(hash, "a", NULL) < 0) {
@@ -535,12 +547,17 @@ testHashDuplicate(const void *data G_GNUC_UNUSED)
 static int
 mymain(void)
 {
+    unsigned int flags[] = { 0, VIR_HASH_OPEN_ADDRESSING };
+    size_t i;
     int ret = 0;
 
 #define DO_TEST_FULL(name, cmd, data, count) \
     do { \
         struct testInfo info = { data, count }; \
-        if (virTestRun(name, testHash ## cmd, &info) < 0) \
+        g_autofree char *testname = NULL; \
+        testname = g_strdup_printf("%s%s", name, \
+                                   testHashFlags ? " (open addressing)" : ""); \
+        if (virTestRun(testname, testHash ## cmd, &info) < 0) \
             ret = -1; \
     } while (0)
 
@@ -556,19 +573,23 @@ mymain(void)
 #define DO_TEST(name, cmd) \
     DO_TEST_FULL(name, cmd, NULL, -1)
 
-    DO_TEST_COUNT("Grow", Grow, 1);
-    DO_TEST_COUNT("Grow", Grow, 10);
-    DO_TEST_COUNT("Grow", Grow, 42);
-    DO_TEST("Update", Update);
-    DO_TEST("Remove", Remove);
-    DO_TEST_DATA("Remove in ForEach", RemoveForEach, Some);
-    DO_TEST_DATA("Remove in ForEach", RemoveForEach, All);
-    DO_TEST("Steal", Steal);
-    DO_TEST("RemoveSet", RemoveSet);
-    DO_TEST("Search", Search);
-    DO_TEST("GetItems", GetItems);
-    DO_TEST("Equal", Equal);
-    DO_TEST("Duplicate entry", Duplicate);
+    for (i = 0; i < G_N_ELEMENTS(flags); i++) {
+        testHashFlags = flags[i];
+
+        DO_TEST_COUNT("Grow", Grow, 1);
+        DO_TEST_COUNT("Grow", Grow, 10);
+        DO_TEST_COUNT("Grow", Grow, 42);
+        DO_TEST("Update", Update);
+        DO_TEST("Remove", Remove);
+        DO_TEST_DATA("Remove in ForEach", RemoveForEach, Some);
+        DO_TEST_DATA("Remove in ForEach", RemoveForEach, All);
+        DO_TEST("Steal", Steal);
+        DO_TEST("RemoveSet", RemoveSet);
+        DO_TEST("Search", Search);
+        DO_TEST("GetItems", GetItems);
+        DO_TEST("Equal", Equal);
+        DO_TEST("Duplicate entry", Duplicate);
+    }
 
     return (ret == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -160,6 +160,75 @@ linuxCPUStatsCompareFiles(const char *cpustatfile,
 }
 
 
+/* Formats the statistics gathered by virHostCPUGetAllStatsLinux
+ * in the same shape as linuxCPUStatsToBuf so that the output of
+ * both can be checked against the same file */
+static int
+linuxAllCPUStatsCompareFiles(const char *cpustatfile,
+                             const char *outfile)
+{
+    g_autoptr(virTypedParamList) list = g_new0(virTypedParamList, 1);
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autofree char *actualData = NULL;
+    g_autofree char *prev = NULL;
+    unsigned long long tick_to_nsec;
+    long long sc_clk_tck;
+    FILE *cpustat = NULL;
+    size_t i;
+    int ret = -1;
+
+    if ((sc_clk_tck = sysconf(_SC_CLK_TCK)) < 0) {
+        fprintf(stderr, "sysconf(_SC_CLK_TCK) fails : %s\n",
+                g_strerror(errno));
+        return -1;
+    }
+    tick_to_nsec = (1000ull * 1000ull * 1000ull) / sc_clk_tck;
+
+    if (!(cpustat = fopen(cpustatfile, "r"))) {
+        virReportSystemError(errno, "failed to open '%s': ", cpustatfile);
+        return -1;
+    }
+
+    if (virHostCPUGetAllStatsLinux(cpustat, list, 0) < 0)
+        goto cleanup;
+
+    for (i = 0; i < list->npar; i++) {
+        virTypedParameterPtr param = &list->par[i];
+        const char *field = strrchr(param->field, '.');
+        g_autofree char *prefix = g_strndup(param->field,
+                                            field - param->field);
+
+        if (STRNEQ_NULLABLE(prefix, prev)) {
+            if (prev)
+                virBufferAddChar(&buf, '\n');
+
+            if (STREQ(prefix, "cpu.total"))
+                virBufferAddLit(&buf, "cpu:\n");
+            else
+                virBufferAsprintf(&buf, "cpu%s:\n", prefix + strlen("cpu."));
+
+            g_free(prev);
+            prev = g_steal_pointer(&prefix);
+        }
+
+        virBufferAsprintf(&buf, "%s: %llu\n", field + 1,
+                          param->value.ul / tick_to_nsec);
+    }
+    virBufferAddChar(&buf, '\n');
+
+    actualData = virBufferContentAndReset(&buf);
+
+    if (virTestCompareToFile(actualData, outfile) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    VIR_FORCE_FCLOSE(cpustat);
+    return ret;
+}
+
+
 struct linuxTestHostCPUData {
     const char *testName;
     virArch arch;
@@ -266,6 +335,22 @@ linuxTestNodeCPUStats(const void *data)
 }
 
 
+static int
+linuxTestNodeAllCPUStats(const void *data)
+{
+    const char *name = data;
+    g_autofree char *cpustatfile = NULL;
+    g_autofree char *outfile = NULL;
+
+    cpustatfile = g_strdup_printf("%s/virhostcpudata/linux-cpustat-%s.stat",
+                                  abs_srcdir, name);
+    outfile = g_strdup_printf("%s/virhostcpudata/linux-cpustat-%s.out",
+                              abs_srcdir, name);
+
+    return linuxAllCPUStatsCompareFiles(cpustatfile, outfile);
+}
+
+
 static int
 mymain(void)
 {
@@ -321,6 +406,9 @@ mymain(void)
     DO_TEST_CPU_STATS("24cpu", 24, false);
     DO_TEST_CPU_STATS("24cpu", 25, true);
 
+    if (virTestRun("All CPU stats 24cpu", linuxTestNodeAllCPUStats, "24cpu") < 0)
+        ret = -1;
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
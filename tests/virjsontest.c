@@ -470,6 +470,85 @@ testJSONObjectFormatSteal(const void *opaque G_GNUC_UNUSED)
 }
 
 
+static int
+testJSONFromStringFiltered(const void *data)
+{
+    const struct testInfo *info = data;
+    const char *filter[] = { "return.node-name", "return.image.virtual-size",
+                             "id", NULL };
+    g_autoptr(virJSONValue) json = NULL;
+    g_autofree char *actual = NULL;
+
+    if (!(json = virJSONValueFromStringFiltered(info->doc, filter))) {
+        VIR_TEST_VERBOSE("Failed to parse %s", info->doc);
+        return -1;
+    }
+
+    if (!(actual = virJSONValueToString(json, false)))
+        return -1;
+
+    if (STRNEQ(info->expect, actual)) {
+        virTestDifference(stderr, info->expect, actual);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testJSONFromStringArena(const void *data)
+{
+    const struct testInfo *info = data;
+    g_autoptr(virJSONValue) json = NULL;
+    g_autoptr(virJSONValue) stolen = NULL;
+    g_autoptr(virJSONValue) extra = virJSONValueNewNull();
+    g_autofree char *actual = NULL;
+    g_autofree char *expect = NULL;
+    g_autofree char *stolenstr = NULL;
+    virJSONValuePtr array;
+
+    if (!(json = virJSONValueFromStringArena(info->doc, NULL))) {
+        VIR_TEST_VERBOSE("Failed to parse %s", info->doc);
+        return -1;
+    }
+
+    if (!(actual = virJSONValueToString(json, false)))
+        return -1;
+
+    if (STRNEQ(info->expect, actual)) {
+        virTestDifference(stderr, info->expect, actual);
+        return -1;
+    }
+
+    /* arena trees can't be extended */
+    if (!(array = virJSONValueObjectGetArray(json, "return")) ||
+        virJSONValueArrayAppend(array, extra) == 0) {
+        VIR_TEST_VERBOSE("appending to arena allocated array succeeded");
+        extra = NULL;
+        return -1;
+    }
+    virResetLastError();
+
+    /* stealing hands out a copy which outlives the arena */
+    if (!(expect = virJSONValueToString(virJSONValueArrayGet(array, 0), false)) ||
+        !(stolen = virJSONValueArraySteal(array, 0)))
+        return -1;
+
+    g_clear_pointer(&json, virJSONValueFree);
+
+    if (!(stolenstr = virJSONValueToString(stolen, false)))
+        return -1;
+
+    if (STRNEQ(expect, stolenstr)) {
+        virTestDifference(stderr, expect, stolenstr);
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 mymain(void)
 {
@@ -506,6 +585,29 @@ mymain(void)
     DO_TEST_PARSE_FILE("Harder");
     DO_TEST_PARSE_FILE("VeryHard");
 
+    DO_TEST_FULL("filtered", FromStringFiltered,
+                 "{\"return\": [{\"node-name\": \"node1\", \"ro\": false,"
+                 "\"image\": {\"virtual-size\": 1024, \"filename\": \"/a\","
+                 "\"backing-image\": {\"virtual-size\": 512}}},"
+                 "{\"node-name\": \"node2\", \"cache\": {\"direct\": true},"
+                 "\"image\": {\"virtual-size\": 2048, \"format\": \"raw\"}}],"
+                 "\"id\": \"libvirt-1\"}",
+                 "{\"return\":[{\"node-name\":\"node1\","
+                 "\"image\":{\"virtual-size\":1024}},"
+                 "{\"node-name\":\"node2\","
+                 "\"image\":{\"virtual-size\":2048}}],"
+                 "\"id\":\"libvirt-1\"}", true);
+
+    DO_TEST_FULL("arena", FromStringArena,
+                 "{\"return\": [{\"node-name\": \"node1\", \"ro\": false,"
+                 "\"image\": {\"virtual-size\": 1024, \"filename\": \"/a\"}},"
+                 "null, \"str\", 1.5],"
+                 "\"id\": \"libvirt-1\"}",
+                 "{\"return\":[{\"node-name\":\"node1\",\"ro\":false,"
+                 "\"image\":{\"virtual-size\":1024,\"filename\":\"/a\"}},"
+                 "null,\"str\",1.5],"
+                 "\"id\":\"libvirt-1\"}", true);
+
     DO_TEST_FULL("success", AddRemove, NULL, NULL, true);
     DO_TEST_FULL("failure", AddRemove, NULL, NULL, false);
 
@@ -0,0 +1,287 @@
+/*
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+
+#ifdef WITH_NSS
+
+# include <arpa/inet.h>
+# include <fcntl.h>
+# include <sys/time.h>
+# include <unistd.h>
+
+# include "libvirt_nss_leases.h"
+# include "virfile.h"
+# include "virjson.h"
+# include "virlease.h"
+# include "virleaseindex.h"
+
+# define VIR_FROM_THIS VIR_FROM_NONE
+
+/* The index is written from a copy of the leases in which every hostname
+ * carries this prefix. Looking up a prefixed name therefore only succeeds
+ * when the index was used, an unprefixed one only when the status file
+ * was parsed instead. */
+# define INDEX_HOST_PREFIX "idx-"
+
+typedef enum {
+    TEST_INDEX_VALID,
+    TEST_INDEX_MISSING,
+    TEST_INDEX_TRUNCATED,
+    TEST_INDEX_BAD_MAGIC,
+    TEST_INDEX_STALE,
+} testIndexState;
+
+struct testLeaseIndexData {
+    testIndexState state;
+    const char *hostname;
+    const char *mac;
+    time_t now;
+    const char *const *ipAddr;
+};
+
+static char *statusFile;
+static char *indexFile;
+static char *statusData;
+static virJSONValuePtr indexLeases;
+
+
+static int
+testLeaseIndexPrepare(testIndexState state)
+{
+    VIR_AUTOCLOSE fd = -1;
+    struct stat sb;
+    struct timeval times[2];
+
+    if (virFileWriteStr(statusFile, statusData, 0644) < 0 ||
+        virLeaseWriteIndex(indexLeases, statusFile, indexFile) < 0)
+        return -1;
+
+    switch (state) {
+    case TEST_INDEX_VALID:
+        break;
+
+    case TEST_INDEX_MISSING:
+        if (unlink(indexFile) < 0)
+            return -1;
+        break;
+
+    case TEST_INDEX_TRUNCATED:
+        if (truncate(indexFile, sizeof(virLeaseIndexHeader) +
+                                sizeof(virLeaseIndexEntry) / 2) < 0)
+            return -1;
+        break;
+
+    case TEST_INDEX_BAD_MAGIC:
+        if ((fd = open(indexFile, O_WRONLY)) < 0 ||
+            safewrite(fd, "XXXXXXXX", VIR_LEASE_INDEX_MAGIC_LEN) < 0)
+            return -1;
+        break;
+
+    case TEST_INDEX_STALE:
+        /* rewriting the status file within the same second may keep its
+         * inode, size and mtime, so move the mtime explicitly */
+        if (stat(statusFile, &sb) < 0)
+            return -1;
+        times[0].tv_sec = sb.st_atime;
+        times[0].tv_usec = 0;
+        times[1].tv_sec = sb.st_mtime + 10;
+        times[1].tv_usec = 0;
+        if (utimes(statusFile, times) < 0)
+            return -1;
+        break;
+    }
+
+    return 0;
+}
+
+
+static int
+testLeaseIndexLookup(const void *opaque)
+{
+    const struct testLeaseIndexData *data = opaque;
+    char *macs[] = { (char *) data->mac };
+    leaseAddress *addrs = NULL;
+    size_t naddrs = 0;
+    bool found = false;
+    size_t nexpected = 0;
+    size_t i;
+    int ret = -1;
+
+    if (testLeaseIndexPrepare(data->state) < 0) {
+        fprintf(stderr, "Unable to prepare lease index: %s\n",
+                g_strerror(errno));
+        return -1;
+    }
+
+    if (findLeases(statusFile, data->hostname,
+                   macs, data->mac ? 1 : 0,
+                   AF_UNSPEC, data->now,
+                   &addrs, &naddrs, &found) < 0) {
+        fprintf(stderr, "Lease lookup failed\n");
+        goto cleanup;
+    }
+
+    while (data->ipAddr && data->ipAddr[nexpected])
+        nexpected++;
+
+    if (found != (nexpected > 0)) {
+        fprintf(stderr, "Expected found=%d, got %d\n", nexpected > 0, found);
+        goto cleanup;
+    }
+
+    if (naddrs != nexpected) {
+        fprintf(stderr, "Expected %zu addresses, got %zu\n", nexpected, naddrs);
+        goto cleanup;
+    }
+
+    for (i = 0; i < naddrs; i++) {
+        char ipAddr[INET6_ADDRSTRLEN];
+
+        if (!inet_ntop(addrs[i].af, addrs[i].addr, ipAddr, sizeof(ipAddr))) {
+            fprintf(stderr, "Unable to format address %zu\n", i);
+            goto cleanup;
+        }
+
+        if (STRNEQ(ipAddr, data->ipAddr[i])) {
+            fprintf(stderr, "Expected address %s, got %s\n",
+                    data->ipAddr[i], ipAddr);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+ cleanup:
+    free(addrs);
+    return ret;
+}
+
+
+static virJSONValuePtr
+testLeaseIndexLeases(virJSONValuePtr leases)
+{
+    g_autoptr(virJSONValue) ret = virJSONValueCopy(leases);
+    size_t i;
+
+    for (i = 0; i < virJSONValueArraySize(ret); i++) {
+        virJSONValuePtr lease = virJSONValueArrayGet(ret, i);
+        g_autoptr(virJSONValue) hostname = NULL;
+        g_autofree char *newHostname = NULL;
+
+        if (virJSONValueObjectRemoveKey(lease, "hostname", &hostname) <= 0)
+            continue;
+
+        newHostname = g_strdup_printf(INDEX_HOST_PREFIX "%s",
+                                      virJSONValueGetString(hostname));
+        if (virJSONValueObjectAppendString(lease, "hostname", newHostname) < 0)
+            return NULL;
+    }
+
+    return g_steal_pointer(&ret);
+}
+
+
+# define SCRATCHDIRTEMPLATE abs_builddir "/virleaseindexdir-XXXXXX"
+
+static int
+mymain(void)
+{
+    char scratchdir[] = SCRATCHDIRTEMPLATE;
+    g_autoptr(virJSONValue) leases = NULL;
+    int ret = 0;
+
+    if (!g_mkdtemp(scratchdir)) {
+        fprintf(stderr, "Cannot create virleaseindexdir");
+        abort();
+    }
+
+    statusFile = g_strdup_printf("%s/virbr0.status", scratchdir);
+    indexFile = g_strdup_printf("%s/virbr0.index", scratchdir);
+
+    if (virFileReadAll(abs_srcdir "/nssdata/virbr0.status",
+                       1024 * 1024, &statusData) < 0 ||
+        !(leases = virJSONValueFromString(statusData)) ||
+        !(indexLeases = testLeaseIndexLeases(leases))) {
+        ret = -1;
+        goto cleanup;
+    }
+
+# define DO_TEST(desc, st, name, macaddr, when, ...) \
+    do { \
+        const char *const addr[] = { __VA_ARGS__, NULL }; \
+        struct testLeaseIndexData data = { \
+            .state = st, .hostname = name, .mac = macaddr, \
+            .now = when, .ipAddr = addr, \
+        }; \
+        if (virTestRun(desc, testLeaseIndexLookup, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+# define NOW 1800000000
+
+    /* lookups answered by the index */
+    DO_TEST("index hit", TEST_INDEX_VALID, INDEX_HOST_PREFIX "fedora", NULL, NOW,
+            "192.168.122.197", "192.168.122.198");
+    DO_TEST("index hit expired", TEST_INDEX_VALID,
+            INDEX_HOST_PREFIX "fedora", NULL, 1900000002,
+            "192.168.122.197");
+    DO_TEST("index hit mac", TEST_INDEX_VALID, NULL, "52:54:00:3a:b5:0c", NOW,
+            "192.168.122.254");
+    DO_TEST("index miss", TEST_INDEX_VALID,
+            INDEX_HOST_PREFIX "nonexistent", NULL, NOW, NULL);
+    DO_TEST("index miss status", TEST_INDEX_VALID, "fedora", NULL, NOW, NULL);
+    DO_TEST("index miss no hostname", TEST_INDEX_VALID, "", NULL, NOW, NULL);
+
+    /* lookups falling back to the status file */
+    DO_TEST("missing index", TEST_INDEX_MISSING, "fedora", NULL, NOW,
+            "192.168.122.197", "192.168.122.198");
+    DO_TEST("truncated index", TEST_INDEX_TRUNCATED, "fedora", NULL, NOW,
+            "192.168.122.197", "192.168.122.198");
+    DO_TEST("truncated index miss", TEST_INDEX_TRUNCATED,
+            INDEX_HOST_PREFIX "fedora", NULL, NOW, NULL);
+    DO_TEST("corrupt index", TEST_INDEX_BAD_MAGIC, "gentoo", NULL, NOW,
+            "192.168.122.254");
+    DO_TEST("corrupt index miss", TEST_INDEX_BAD_MAGIC,
+            INDEX_HOST_PREFIX "gentoo", NULL, NOW, NULL);
+    DO_TEST("stale index", TEST_INDEX_STALE, "fedora", NULL, NOW,
+            "192.168.122.197", "192.168.122.198");
+    DO_TEST("stale index miss", TEST_INDEX_STALE,
+            INDEX_HOST_PREFIX "fedora", NULL, NOW, NULL);
+
+ cleanup:
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(scratchdir);
+
+    virJSONValueFree(indexLeases);
+    VIR_FREE(statusData);
+    VIR_FREE(statusFile);
+    VIR_FREE(indexFile);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
+#else
+int
+main(void)
+{
+    return EXIT_AM_SKIP;
+}
+#endif
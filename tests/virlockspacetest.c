@@ -337,6 +337,44 @@ static int testLockSpaceResourceLockPath(const void *args G_GNUC_UNUSED)
 }
 
 
+static int testLockSpaceResourceLockMany(const void *args G_GNUC_UNUSED)
+{
+    virLockSpacePtr lockspace;
+    int ret = -1;
+    size_t i;
+
+    rmdir(LOCKSPACE_DIR);
+
+    if (!(lockspace = virLockSpaceNew(LOCKSPACE_DIR)))
+        goto cleanup;
+
+    /* enough resources to end up in each of the lockspace's shards */
+    for (i = 0; i < 64; i++) {
+        g_autofree char *name = g_strdup_printf("res%zu", i);
+
+        if (virLockSpaceAcquireResource(lockspace, name, geteuid(),
+                                        VIR_LOCK_SPACE_ACQUIRE_AUTOCREATE) < 0)
+            goto cleanup;
+    }
+
+    if (virLockSpaceAcquireResource(lockspace, "res42", geteuid(),
+                                    VIR_LOCK_SPACE_ACQUIRE_AUTOCREATE) == 0)
+        goto cleanup;
+
+    if (virLockSpaceReleaseResourcesForOwner(lockspace, geteuid()) != 64)
+        goto cleanup;
+
+    if (virFileExists(LOCKSPACE_DIR "/res42"))
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    virLockSpaceFree(lockspace);
+    rmdir(LOCKSPACE_DIR);
+    return ret;
+}
+
 
 static int
 mymain(void)
@@ -368,6 +406,9 @@ mymain(void)
     if (virTestRun("Lockspace res full path", testLockSpaceResourceLockPath, NULL) < 0)
         ret = -1;
 
+    if (virTestRun("Lockspace res lock many", testLockSpaceResourceLockMany, NULL) < 0)
+        ret = -1;
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -22,6 +22,9 @@
 #include "testutils.h"
 
 #include "virlog.h"
+#include "virthread.h"
+
+VIR_LOG_INIT("tests.logtest");
 
 struct testLogData {
     const char *str;
@@ -107,6 +110,229 @@ testLogParseFilters(const void *opaque)
     return ret;
 }
 
+
+struct testLogAsyncData {
+    virMutex lock;
+    virCond cond;
+    bool block;    /* the output waits while this is set */
+    bool blocked;  /* the output is waiting */
+    size_t nmessages;
+    virBuffer buf;
+};
+
+static struct testLogAsyncData testLogAsync = { .buf = VIR_BUFFER_INITIALIZER };
+
+
+static void
+testLogAsyncOutput(virLogSourcePtr source G_GNUC_UNUSED,
+                   virLogPriority priority G_GNUC_UNUSED,
+                   const char *filename G_GNUC_UNUSED,
+                   int linenr G_GNUC_UNUSED,
+                   const char *funcname G_GNUC_UNUSED,
+                   const char *timestamp G_GNUC_UNUSED,
+                   virLogMetadataPtr metadata G_GNUC_UNUSED,
+                   const char *rawstr,
+                   const char *str G_GNUC_UNUSED,
+                   void *opaque)
+{
+    struct testLogAsyncData *data = opaque;
+
+    virMutexLock(&data->lock);
+    virBufferAsprintf(&data->buf, "%s\n", rawstr);
+    data->nmessages++;
+
+    while (data->block) {
+        data->blocked = true;
+        virCondBroadcast(&data->cond);
+        ignore_value(virCondWait(&data->cond, &data->lock));
+    }
+    data->blocked = false;
+    virMutexUnlock(&data->lock);
+}
+
+
+/*
+ * Enables the asynchronous writer with a buffer of @size messages and
+ * makes all messages end up in testLogAsync.
+ */
+static int
+testLogAsyncSetup(size_t size,
+                  virLogOverflow overflow)
+{
+    virLogOutputPtr output = NULL;
+    virLogOutputPtr *outputs = NULL;
+    size_t noutputs = 0;
+
+    testLogAsync.nmessages = 0;
+    virBufferFreeAndReset(&testLogAsync.buf);
+
+    if (!(output = virLogOutputNew(testLogAsyncOutput, NULL, &testLogAsync,
+                                   VIR_LOG_DEBUG, VIR_LOG_TO_STDERR, NULL)) ||
+        VIR_APPEND_ELEMENT(outputs, noutputs, output) < 0 ||
+        virLogDefineOutputs(outputs, noutputs) < 0) {
+        virLogOutputFree(output);
+        virLogOutputListFree(outputs, noutputs);
+        return -1;
+    }
+
+    return virLogSetAsync(size, overflow);
+}
+
+
+static int
+testLogAsyncCheck(size_t nmessages,
+                  const char *expect)
+{
+    g_autofree char *actual = NULL;
+    size_t actualcount;
+
+    virLogFlush();
+
+    virMutexLock(&testLogAsync.lock);
+    actual = virBufferContentAndReset(&testLogAsync.buf);
+    actualcount = testLogAsync.nmessages;
+    testLogAsync.nmessages = 0;
+    virMutexUnlock(&testLogAsync.lock);
+
+    if (actualcount != nmessages) {
+        VIR_TEST_DEBUG("Expected %zu messages, got %zu",
+                       nmessages, actualcount);
+        return -1;
+    }
+
+    if (STRNEQ_NULLABLE(expect, actual)) {
+        virTestDifference(stderr, NULLSTR(expect), NULLSTR(actual));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Many more messages than the buffer holds, which has to wrap around
+ * without losing or reordering any of them */
+static int
+testLogAsyncWrapAround(const void *opaque G_GNUC_UNUSED)
+{
+    g_auto(virBuffer) expect = VIR_BUFFER_INITIALIZER;
+    g_autofree char *expectstr = NULL;
+    unsigned int dropped = virLogGetDropped();
+    size_t i;
+    int ret = -1;
+
+    if (testLogAsyncSetup(4, VIR_LOG_OVERFLOW_BLOCK) < 0)
+        return -1;
+
+    for (i = 0; i < 100; i++) {
+        virLogMessage(&virLogSelf, VIR_LOG_ERROR, __FILE__, __LINE__,
+                      __func__, NULL, "message %zu", i);
+        virBufferAsprintf(&expect, "message %zu\n", i);
+    }
+
+    expectstr = virBufferContentAndReset(&expect);
+    if (testLogAsyncCheck(100, expectstr) < 0)
+        goto cleanup;
+
+    if (virLogGetDropped() != dropped) {
+        VIR_TEST_DEBUG("Messages were dropped");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    ignore_value(virLogSetAsync(0, VIR_LOG_OVERFLOW_DROP));
+    return ret;
+}
+
+
+/* With the writer stuck in an output, messages exceeding the buffer are
+ * dropped and reported once the writer catches up */
+static int
+testLogAsyncOverflow(const void *opaque G_GNUC_UNUSED)
+{
+    unsigned int dropped = virLogGetDropped();
+    size_t i;
+    int ret = -1;
+
+    if (testLogAsyncSetup(4, VIR_LOG_OVERFLOW_DROP) < 0)
+        return -1;
+
+    virMutexLock(&testLogAsync.lock);
+    testLogAsync.block = true;
+    virMutexUnlock(&testLogAsync.lock);
+
+    virLogMessage(&virLogSelf, VIR_LOG_ERROR, __FILE__, __LINE__,
+                  __func__, NULL, "message 0");
+
+    /* wait for the writer to take the message out of the buffer */
+    virMutexLock(&testLogAsync.lock);
+    while (!testLogAsync.blocked)
+        ignore_value(virCondWait(&testLogAsync.cond, &testLogAsync.lock));
+    virMutexUnlock(&testLogAsync.lock);
+
+    /* four messages fill the buffer, the rest has to be dropped */
+    for (i = 1; i < 8; i++)
+        virLogMessage(&virLogSelf, VIR_LOG_ERROR, __FILE__, __LINE__,
+                      __func__, NULL, "message %zu", i);
+
+    if (virLogGetDropped() - dropped != 3) {
+        VIR_TEST_DEBUG("Expected 3 dropped messages, got %u",
+                       virLogGetDropped() - dropped);
+        goto cleanup;
+    }
+
+    virMutexLock(&testLogAsync.lock);
+    testLogAsync.block = false;
+    virCondBroadcast(&testLogAsync.cond);
+    virMutexUnlock(&testLogAsync.lock);
+
+    if (testLogAsyncCheck(6,
+                          "message 0\n"
+                          "message 1\n"
+                          "message 2\n"
+                          "message 3\n"
+                          "message 4\n"
+                          "3 log messages were dropped, the log buffer was full\n") < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virMutexLock(&testLogAsync.lock);
+    testLogAsync.block = false;
+    virCondBroadcast(&testLogAsync.cond);
+    virMutexUnlock(&testLogAsync.lock);
+    ignore_value(virLogSetAsync(0, VIR_LOG_OVERFLOW_DROP));
+    return ret;
+}
+
+
+/* Flushing an empty buffer must not wait, and a new writer must not
+ * report messages dropped by a previous one */
+static int
+testLogAsyncEmpty(const void *opaque G_GNUC_UNUSED)
+{
+    int ret = -1;
+
+    if (testLogAsyncSetup(4, VIR_LOG_OVERFLOW_DROP) < 0)
+        return -1;
+
+    if (testLogAsyncCheck(0, NULL) < 0)
+        goto cleanup;
+
+    virLogMessage(&virLogSelf, VIR_LOG_ERROR, __FILE__, __LINE__,
+                  __func__, NULL, "message");
+
+    if (testLogAsyncCheck(1, "message\n") < 0 ||
+        testLogAsyncCheck(0, NULL) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    ignore_value(virLogSetAsync(0, VIR_LOG_OVERFLOW_DROP));
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -151,6 +377,17 @@ mymain(void)
     TEST_PARSE_FILTERS_FAIL(":foo", 1);
     TEST_PARSE_FILTERS_FAIL("1:+", 1);
 
+    if (virMutexInit(&testLogAsync.lock) < 0 ||
+        virCondInit(&testLogAsync.cond) < 0)
+        return EXIT_FAILURE;
+
+    if (virTestRun("testLogAsyncWrapAround", testLogAsyncWrapAround, NULL) < 0)
+        ret = -1;
+    if (virTestRun("testLogAsyncOverflow", testLogAsyncOverflow, NULL) < 0)
+        ret = -1;
+    if (virTestRun("testLogAsyncEmpty", testLogAsyncEmpty, NULL) < 0)
+        ret = -1;
+
     return ret;
 }
 
@@ -0,0 +1,165 @@
+/*
+ * virnetmessagebench.c: benchmarks of RPC message encoding and decoding
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "testutilsbench.h"
+#include "rpc/virnetmessage.h"
+
+#define VIR_FROM_THIS VIR_FROM_RPC
+
+#define TEST_BENCH_SUITE "netmessage"
+
+/* virNetMessageError has a bit of everything the generated XDR code
+ * deals with: integers, strings and optional pointers */
+typedef struct {
+    virNetMessageError err;
+    virNetMessagePtr msg;
+} testBenchData;
+
+
+static int
+testBenchEncodeMessage(virNetMessagePtr msg,
+                       virNetMessageErrorPtr err)
+{
+    msg->header.prog = 0x11223344;
+    msg->header.vers = 0x01;
+    msg->header.proc = 0x666;
+    msg->header.type = VIR_NET_REPLY;
+    msg->header.serial = 0x99;
+    msg->header.status = VIR_NET_ERROR;
+
+    if (virNetMessageEncodeHeader(msg) < 0 ||
+        virNetMessageEncodePayload(msg, (xdrproc_t)xdr_virNetMessageError, err) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+testBenchEncode(const void *opaque,
+                size_t iterations)
+{
+    const testBenchData *data = opaque;
+    size_t i;
+
+    for (i = 0; i < iterations; i++) {
+        virNetMessagePtr msg;
+        int rc;
+
+        if (!(msg = virNetMessageNew(false)))
+            return -1;
+
+        rc = testBenchEncodeMessage(msg, (virNetMessageErrorPtr) &data->err);
+        virNetMessageFree(msg);
+
+        if (rc < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testBenchDecode(const void *opaque,
+                size_t iterations)
+{
+    const testBenchData *data = opaque;
+    size_t len = data->msg->bufferLength;
+    size_t i;
+
+    for (i = 0; i < iterations; i++) {
+        virNetMessageError err;
+
+        memset(&err, 0, sizeof(err));
+        data->msg->bufferLength = len;
+
+        if (virNetMessageDecodeHeader(data->msg) < 0 ||
+            virNetMessageDecodePayload(data->msg,
+                                       (xdrproc_t)xdr_virNetMessageError,
+                                       &err) < 0)
+            return -1;
+
+        xdr_free((xdrproc_t)xdr_virNetMessageError, (void *)&err);
+    }
+
+    data->msg->bufferLength = len;
+    return 0;
+}
+
+
+static int
+testBenchRunMessage(const char *name,
+                    size_t msglen,
+                    size_t iterations)
+{
+    testBenchData data = { 0 };
+    g_autofree char *encodeName = g_strdup_printf("encode-%s", name);
+    g_autofree char *decodeName = g_strdup_printf("decode-%s", name);
+    int ret = -1;
+
+    data.err.code = VIR_ERR_INTERNAL_ERROR;
+    data.err.domain = VIR_FROM_RPC;
+    data.err.level = VIR_ERR_ERROR;
+    data.err.message = g_new0(char *, 1);
+    data.err.str1 = g_new0(char *, 1);
+    data.err.str2 = g_new0(char *, 1);
+    *data.err.message = g_strnfill(msglen, 'x');
+    *data.err.str1 = g_strdup("One");
+    *data.err.str2 = g_strdup("Two");
+    data.err.int1 = 1;
+    data.err.int2 = 2;
+
+    if (!(data.msg = virNetMessageNew(false)) ||
+        testBenchEncodeMessage(data.msg, &data.err) < 0)
+        goto cleanup;
+
+    if (testBenchRun(TEST_BENCH_SUITE, encodeName, testBenchEncode,
+                     &data, iterations) < 0 ||
+        testBenchRun(TEST_BENCH_SUITE, decodeName, testBenchDecode,
+                     &data, iterations) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    xdr_free((xdrproc_t)xdr_virNetMessageError, (void *)&data.err);
+    virNetMessageFree(data.msg);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (testBenchRunMessage("small", 64, 100000) < 0)
+        ret = -1;
+
+    /* larger than VIR_NET_MESSAGE_INITIAL, so the buffer has to grow */
+    if (testBenchRunMessage("large", 1024 * 1024, 100) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
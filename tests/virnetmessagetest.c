@@ -519,6 +519,260 @@ static int testMessagePayloadStreamEncode(const void *args G_GNUC_UNUSED)
     return ret;
 }
 
+static int testMessageBatch(const void *args G_GNUC_UNUSED)
+{
+    static const char *const payloads[] = { "abcd", "efgh" };
+    virNetMessagePtr batch = NULL;
+    virNetMessagePtr msg = NULL;
+    static const char expect[] = {
+        0x00, 0x00, 0x00, 0x5c,  /* Length */
+        0x00, 0x00, 0x00, 0x00,  /* Program */
+        0x00, 0x00, 0x00, 0x00,  /* Version */
+        0x00, 0x00, 0x00, 0x00,  /* Procedure */
+        0x00, 0x00, 0x00, 0x07,  /* Type */
+        0x00, 0x00, 0x00, 0x00,  /* Serial */
+        0x00, 0x00, 0x00, 0x00,  /* Status */
+
+        0x00, 0x00, 0x00, 0x20,  /* Length */
+        0x11, 0x22, 0x33, 0x44,  /* Program */
+        0x00, 0x00, 0x00, 0x01,  /* Version */
+        0x00, 0x00, 0x06, 0x66,  /* Procedure */
+        0x00, 0x00, 0x00, 0x02,  /* Type */
+        0x00, 0x00, 0x00, 0x00,  /* Serial */
+        0x00, 0x00, 0x00, 0x00,  /* Status */
+        'a', 'b', 'c', 'd',
+
+        0x00, 0x00, 0x00, 0x20,  /* Length */
+        0x11, 0x22, 0x33, 0x44,  /* Program */
+        0x00, 0x00, 0x00, 0x01,  /* Version */
+        0x00, 0x00, 0x06, 0x66,  /* Procedure */
+        0x00, 0x00, 0x00, 0x02,  /* Type */
+        0x00, 0x00, 0x00, 0x00,  /* Serial */
+        0x00, 0x00, 0x00, 0x00,  /* Status */
+        'e', 'f', 'g', 'h',
+    };
+    size_t i;
+    int ret = -1;
+
+    if (!(batch = virNetMessageBatchNew()))
+        return -1;
+
+    for (i = 0; i < G_N_ELEMENTS(payloads); i++) {
+        if (!(msg = virNetMessageNew(false)))
+            goto cleanup;
+
+        msg->header.prog = 0x11223344;
+        msg->header.vers = 0x01;
+        msg->header.proc = 0x666;
+        msg->header.type = VIR_NET_MESSAGE;
+        msg->header.status = VIR_NET_OK;
+
+        if (virNetMessageEncodeHeader(msg) < 0 ||
+            virNetMessageEncodePayloadRaw(msg, payloads[i],
+                                          strlen(payloads[i])) < 0)
+            goto cleanup;
+
+        if (virNetMessageBatchAppend(batch, msg) != 0)
+            goto cleanup;
+
+        virNetMessageFree(msg);
+        msg = NULL;
+    }
+
+    if (batch->nbatched != 2) {
+        VIR_DEBUG("Expect 2 batched messages got %zu", batch->nbatched);
+        goto cleanup;
+    }
+
+    if (G_N_ELEMENTS(expect) != batch->bufferLength) {
+        VIR_DEBUG("Expect message length %zu got %zu",
+                  sizeof(expect), batch->bufferLength);
+        goto cleanup;
+    }
+
+    if (batch->bufferOffset != 0) {
+        VIR_DEBUG("Expect message offset 0 got %zu",
+                  batch->bufferOffset);
+        goto cleanup;
+    }
+
+    if (memcmp(expect, batch->buffer, sizeof(expect)) != 0) {
+        virTestDifferenceBin(stderr, expect, batch->buffer, sizeof(expect));
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virNetMessageFree(msg);
+    virNetMessageFree(batch);
+    return ret;
+}
+
+static int testMessageBufferPool(const void *args G_GNUC_UNUSED)
+{
+    virNetMessagePtr msg = NULL;
+    virNetMessagePoolStats before;
+    virNetMessagePoolStats after;
+    char *buffer;
+    int ret = -1;
+
+    if (!(msg = virNetMessageNew(true)))
+        return -1;
+
+    if (virNetMessageEncodeHeader(msg) < 0)
+        goto cleanup;
+
+    /* the buffer must be kept when the length shrinks and grows again */
+    buffer = msg->buffer;
+    if (virNetMessageResizeBuffer(msg, VIR_NET_MESSAGE_LEN_MAX) < 0 ||
+        virNetMessageResizeBuffer(msg, VIR_NET_MESSAGE_INITIAL) < 0)
+        goto cleanup;
+
+    if (msg->buffer != buffer ||
+        msg->bufferLength != VIR_NET_MESSAGE_INITIAL) {
+        VIR_DEBUG("Expected buffer %p of length %d, got %p of length %zu",
+                  buffer, VIR_NET_MESSAGE_INITIAL,
+                  msg->buffer, msg->bufferLength);
+        goto cleanup;
+    }
+
+    virNetMessagePoolGetStats(&before);
+    virNetMessageClear(msg);
+    virNetMessagePoolGetStats(&after);
+
+    if (after.recycled != before.recycled + 1) {
+        VIR_DEBUG("Expected released buffer to be recycled");
+        goto cleanup;
+    }
+
+    if (virNetMessageEncodeHeader(msg) < 0)
+        goto cleanup;
+
+    virNetMessagePoolGetStats(&before);
+
+    if (before.hits != after.hits + 1 || msg->buffer != buffer) {
+        VIR_DEBUG("Expected recycled buffer to be reused");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virNetMessageFree(msg);
+    return ret;
+}
+
+
+/* Larger than a single message can carry */
+#define TEST_CHUNKED_LEN (VIR_NET_MESSAGE_MAX + VIR_NET_MESSAGE_MAX / 4)
+
+static bool_t
+testMessageChunkedFilter(XDR *xdrs,
+                         char **data)
+{
+    u_int len = TEST_CHUNKED_LEN;
+
+    return xdr_bytes(xdrs, data, &len, TEST_CHUNKED_LEN);
+}
+
+static int testMessagePayloadChunked(const void *args G_GNUC_UNUSED)
+{
+    virNetMessagePtr msg = NULL;
+    virNetMessagePtr chunks = NULL;
+    virNetMessagePtr joined = NULL;
+    virNetMessagePtr chunk;
+    g_autofree char *data = g_new(char, TEST_CHUNKED_LEN);
+    char *decoded = NULL;
+    size_t hdrlen;
+    size_t nchunks = 0;
+    size_t len;
+    size_t i;
+    int ret = -1;
+
+    for (i = 0; i < TEST_CHUNKED_LEN; i++)
+        data[i] = i % 251;
+
+    if (!(msg = virNetMessageNew(true)) ||
+        !(joined = virNetMessageNew(false)))
+        goto cleanup;
+
+    msg->header.prog = 0x11223344;
+    msg->header.vers = 0x01;
+    msg->header.proc = 0x666;
+    msg->header.type = VIR_NET_REPLY;
+    msg->header.serial = 0x99;
+    msg->header.status = VIR_NET_OK;
+
+    if (virNetMessageEncodeHeader(msg) < 0)
+        goto cleanup;
+    hdrlen = msg->bufferOffset;
+
+    /* A plain encoding must fail, chunked one succeed */
+    if (virNetMessageEncodePayload(msg, (xdrproc_t) testMessageChunkedFilter,
+                                   &data) == 0) {
+        VIR_DEBUG("Expected too large payload to be rejected");
+        goto cleanup;
+    }
+    virResetLastError();
+
+    if (virNetMessageEncodeHeader(msg) < 0 ||
+        virNetMessageEncodePayloadChunked(msg, (xdrproc_t) testMessageChunkedFilter,
+                                          &data, &chunks) < 0)
+        goto cleanup;
+
+    /* Join the parts again, as the client does */
+    if (virNetMessageResizeBuffer(joined, hdrlen) < 0)
+        goto cleanup;
+    memcpy(joined->buffer, msg->buffer, hdrlen);
+
+    for (chunk = chunks; chunk; chunk = chunk->next) {
+        if (chunk->header.status != VIR_NET_CONTINUE ||
+            chunk->header.serial != msg->header.serial ||
+            chunk->bufferLength > VIR_NET_MESSAGE_MAX + VIR_NET_MESSAGE_LEN_MAX) {
+            VIR_DEBUG("Unexpected chunk status %d serial %u length %zu",
+                      chunk->header.status, chunk->header.serial,
+                      chunk->bufferLength);
+            goto cleanup;
+        }
+
+        len = joined->bufferLength;
+        if (virNetMessageResizeBuffer(joined, len + chunk->bufferLength - hdrlen) < 0)
+            goto cleanup;
+        memcpy(joined->buffer + len, chunk->buffer + hdrlen,
+               chunk->bufferLength - hdrlen);
+        nchunks++;
+    }
+
+    if (nchunks != 1 || msg->header.status != VIR_NET_OK) {
+        VIR_DEBUG("Expected one chunk and final part, got %zu chunks and status %d",
+                  nchunks, msg->header.status);
+        goto cleanup;
+    }
+
+    len = joined->bufferLength;
+    if (virNetMessageResizeBuffer(joined, len + msg->bufferLength - hdrlen) < 0)
+        goto cleanup;
+    memcpy(joined->buffer + len, msg->buffer + hdrlen, msg->bufferLength - hdrlen);
+    joined->bufferOffset = hdrlen;
+
+    if (virNetMessageDecodePayload(joined, (xdrproc_t) testMessageChunkedFilter,
+                                   &decoded) < 0)
+        goto cleanup;
+
+    if (memcmp(data, decoded, TEST_CHUNKED_LEN) != 0) {
+        VIR_DEBUG("Joined payload differs from the original");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    while (chunks)
+        virNetMessageFree(virNetMessageQueueServe(&chunks));
+    virNetMessageFree(joined);
+    virNetMessageFree(msg);
+    g_free(decoded);
+    return ret;
+}
+
 
 static int
 mymain(void)
@@ -544,6 +798,15 @@ mymain(void)
     if (virTestRun("Message Payload Stream Encode", testMessagePayloadStreamEncode, NULL) < 0)
         ret = -1;
 
+    if (virTestRun("Message Batch", testMessageBatch, NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("Message Buffer Pool", testMessageBufferPool, NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("Message Payload Chunked", testMessagePayloadChunked, NULL) < 0)
+        ret = -1;
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -0,0 +1,179 @@
+/*
+ * virnetsocketbench.c: helpers for benchmarking RPC transports
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <poll.h>
+#include <signal.h>
+
+#include "testutils.h"
+#include "virnetsocketbench.h"
+#include "virthread.h"
+#include "virtime.h"
+
+#define VIR_FROM_THIS VIR_FROM_RPC
+
+/* Size of each message including its length word, and how many
+ * of them are sent */
+#define TEST_BENCH_MSG_LEN (256 * 1024)
+#define TEST_BENCH_NMSGS 1024
+
+struct testSocketBenchWriter {
+    virNetSocketPtr sock;
+    bool failed;
+};
+
+
+static int
+testSocketBenchWait(virNetSocketPtr sock,
+                    short events)
+{
+    struct pollfd fd = { .fd = virNetSocketGetFD(sock), .events = events };
+
+    if (poll(&fd, 1, -1) < 0 && errno != EINTR)
+        return -1;
+
+    return 0;
+}
+
+
+static void
+testSocketBenchWriterFunc(void *opaque)
+{
+    struct testSocketBenchWriter *data = opaque;
+    g_autofree char *msg = g_new0(char, TEST_BENCH_MSG_LEN);
+    size_t i;
+
+    /* Framed like RPC messages, with a big endian length word
+     * that includes itself */
+    msg[0] = (TEST_BENCH_MSG_LEN >> 24) & 0xff;
+    msg[1] = (TEST_BENCH_MSG_LEN >> 16) & 0xff;
+    msg[2] = (TEST_BENCH_MSG_LEN >> 8) & 0xff;
+    msg[3] = TEST_BENCH_MSG_LEN & 0xff;
+
+    for (i = 0; i < TEST_BENCH_NMSGS; i++) {
+        size_t done = 0;
+
+        while (done < TEST_BENCH_MSG_LEN) {
+            ssize_t rv = virNetSocketWrite(data->sock, msg + done,
+                                           TEST_BENCH_MSG_LEN - done);
+
+            if (rv < 0 ||
+                (rv == 0 && testSocketBenchWait(data->sock, POLLOUT) < 0)) {
+                data->failed = true;
+                return;
+            }
+            done += rv;
+        }
+    }
+}
+
+
+/* Reads @len bytes the same way as the RPC client and server do */
+static int
+testSocketBenchRead(virNetSocketPtr sock,
+                    char *buf,
+                    size_t len)
+{
+    size_t done = 0;
+
+    while (done < len) {
+        ssize_t rv = virNetSocketRead(sock, buf + done, len - done);
+
+        if (rv < 0 ||
+            (rv == 0 && testSocketBenchWait(sock, POLLIN) < 0))
+            return -1;
+        done += rv;
+    }
+
+    return 0;
+}
+
+
+/**
+ * testSocketBenchRun:
+ * @reader: socket to read messages from
+ * @writer: connected peer of @reader
+ * @transport: name of the transport for the results
+ *
+ * Measures how fast message sized chunks of data are read off
+ * @reader, first the length word and then the rest of each
+ * message. Results are printed with VIR_TEST_DEBUG=1.
+ *
+ * Returns 0 on success, -1 on error
+ */
+int
+testSocketBenchRun(virNetSocketPtr reader,
+                   virNetSocketPtr writer,
+                   const char *transport)
+{
+    struct testSocketBenchWriter data = { .sock = writer };
+    g_autofree char *buf = g_new(char, TEST_BENCH_MSG_LEN);
+    unsigned long long start;
+    unsigned long long end;
+    virThread thread;
+    size_t i;
+    int ret = -1;
+
+    /* The writer must not be killed if reading fails */
+    signal(SIGPIPE, SIG_IGN);
+
+    if (virTimeMillisNow(&start) < 0)
+        return -1;
+
+    if (virThreadCreate(&thread, true, testSocketBenchWriterFunc, &data) < 0)
+        return -1;
+
+    for (i = 0; i < TEST_BENCH_NMSGS; i++) {
+        size_t len;
+
+        if (testSocketBenchRead(reader, buf, 4) < 0)
+            goto cleanup;
+
+        len = ((size_t)(unsigned char)buf[0] << 24) |
+              ((size_t)(unsigned char)buf[1] << 16) |
+              ((size_t)(unsigned char)buf[2] << 8) |
+              (size_t)(unsigned char)buf[3];
+
+        if (len != TEST_BENCH_MSG_LEN) {
+            VIR_TEST_VERBOSE("unexpected message length %zu", len);
+            goto cleanup;
+        }
+
+        if (testSocketBenchRead(reader, buf + 4, len - 4) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    /* Unblock the writer if reading failed */
+    if (ret < 0)
+        virNetSocketClose(reader);
+    virThreadJoin(&thread);
+
+    if (data.failed)
+        ret = -1;
+
+    if (ret == 0 && virTimeMillisNow(&end) == 0)
+        VIR_TEST_DEBUG("%s: read %d messages of %d bytes in %llu ms",
+                       transport, TEST_BENCH_NMSGS, TEST_BENCH_MSG_LEN,
+                       end - start);
+
+    return ret;
+}
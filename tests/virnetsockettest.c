@@ -32,6 +32,7 @@
 #include "virstring.h"
 
 #include "rpc/virnetsocket.h"
+#include "virnetsocketbench.h"
 
 #define VIR_FROM_THIS VIR_FROM_RPC
 
@@ -515,6 +516,57 @@ static int testSocketSSH(const void *opaque)
     return ret;
 }
 
+
+struct testSocketBenchData {
+    const char *transport;
+    const char *filters;
+};
+
+
+static int testSocketBenchPlain(const void *opaque)
+{
+    const struct testSocketBenchData *data = opaque;
+    g_autofree char *oldFilters = NULL;
+    virNetSocketPtr ssock = NULL;
+    virNetSocketPtr csock = NULL;
+    int fd[2];
+    int ret = -1;
+
+    /* Debug logging enabled for some unrelated subsystem must not
+     * slow down the RPC code */
+    if (data->filters) {
+        oldFilters = virLogGetFilters();
+        if (virLogSetFilters(data->filters) < 0)
+            return -1;
+    }
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fd) < 0) {
+        virReportSystemError(errno, "%s", "Unable to create socketpair");
+        goto cleanup;
+    }
+
+    if (virNetSocketNewConnectSockFD(fd[0], &ssock) < 0) {
+        VIR_FORCE_CLOSE(fd[0]);
+        VIR_FORCE_CLOSE(fd[1]);
+        goto cleanup;
+    }
+
+    if (virNetSocketNewConnectSockFD(fd[1], &csock) < 0) {
+        VIR_FORCE_CLOSE(fd[1]);
+        goto cleanup;
+    }
+
+    ret = testSocketBenchRun(ssock, csock, data->transport);
+
+ cleanup:
+    virObjectUnref(ssock);
+    virObjectUnref(csock);
+    if (data->filters &&
+        virLogSetFilters(oldFilters) < 0)
+        ret = -1;
+    return ret;
+}
+
 #endif
 
 
@@ -678,6 +730,22 @@ mymain(void)
     if (virTestRun("SSH test 7", testSocketSSH, &sshData7) < 0)
         ret = -1;
 
+    if (virTestGetExpensive()) {
+        struct testSocketBenchData benchData = {
+            .transport = "plain",
+        };
+        struct testSocketBenchData benchFilteredData = {
+            .transport = "plain, debug filters",
+            .filters = "1:util.nonexistent 1:qemu",
+        };
+
+        if (virTestRun("Socket read benchmark",
+                       testSocketBenchPlain, &benchData) < 0)
+            ret = -1;
+        if (virTestRun("Socket read benchmark with debug filters",
+                       testSocketBenchPlain, &benchFilteredData) < 0)
+            ret = -1;
+    }
 #endif
 
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
@@ -22,6 +22,7 @@
 
 #include "testutils.h"
 #include "virnettlshelpers.h"
+#include "virnetsocketbench.h"
 #include "virutil.h"
 #include "virerror.h"
 #include "viralloc.h"
@@ -233,6 +234,91 @@ static int testTLSSessionInit(const void *opaque)
 }
 
 
+static int testTLSSessionBench(const void *opaque)
+{
+    struct testTLSSessionData *data = (struct testTLSSessionData *)opaque;
+    virNetTLSContextPtr clientCtxt = NULL;
+    virNetTLSContextPtr serverCtxt = NULL;
+    virNetTLSSessionPtr clientSess = NULL;
+    virNetTLSSessionPtr serverSess = NULL;
+    virNetSocketPtr serverSock = NULL;
+    virNetSocketPtr clientSock = NULL;
+    int ret = -1;
+    int channel[2];
+    bool clientShake = false;
+    bool serverShake = false;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, channel) < 0)
+        abort();
+
+    if (virNetSocketNewConnectSockFD(channel[0], &serverSock) < 0) {
+        VIR_FORCE_CLOSE(channel[0]);
+        VIR_FORCE_CLOSE(channel[1]);
+        return -1;
+    }
+
+    if (virNetSocketNewConnectSockFD(channel[1], &clientSock) < 0) {
+        VIR_FORCE_CLOSE(channel[1]);
+        goto cleanup;
+    }
+
+    if (!(serverCtxt = virNetTLSContextNewServer(data->servercacrt,
+                                                 NULL,
+                                                 data->servercrt,
+                                                 KEYFILE,
+                                                 data->wildcards,
+                                                 "NORMAL",
+                                                 false,
+                                                 true)) ||
+        !(clientCtxt = virNetTLSContextNewClient(data->clientcacrt,
+                                                 NULL,
+                                                 data->clientcrt,
+                                                 KEYFILE,
+                                                 "NORMAL",
+                                                 false,
+                                                 true)))
+        goto cleanup;
+
+    if (!(serverSess = virNetTLSSessionNew(serverCtxt, NULL)) ||
+        !(clientSess = virNetTLSSessionNew(clientCtxt, data->hostname)))
+        goto cleanup;
+
+    /* This time the sessions talk through the sockets, which are
+     * non-blocking, so the same handshake loop works */
+    virNetSocketSetTLSSession(serverSock, serverSess);
+    virNetSocketSetTLSSession(clientSock, clientSess);
+
+    do {
+        int rv;
+        if (!serverShake) {
+            rv = virNetTLSSessionHandshake(serverSess);
+            if (rv < 0)
+                goto cleanup;
+            if (rv == VIR_NET_TLS_HANDSHAKE_COMPLETE)
+                serverShake = true;
+        }
+        if (!clientShake) {
+            rv = virNetTLSSessionHandshake(clientSess);
+            if (rv < 0)
+                goto cleanup;
+            if (rv == VIR_NET_TLS_HANDSHAKE_COMPLETE)
+                clientShake = true;
+        }
+    } while (!clientShake || !serverShake);
+
+    ret = testSocketBenchRun(serverSock, clientSock, "TLS");
+
+ cleanup:
+    virObjectUnref(serverSock);
+    virObjectUnref(clientSock);
+    virObjectUnref(serverCtxt);
+    virObjectUnref(clientCtxt);
+    virObjectUnref(serverSess);
+    virObjectUnref(clientSess);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -336,6 +422,20 @@ mymain(void)
 
     DO_SESS_TEST(cacertreq.filename, servercertreq.filename, clientcertreq.filename,
                  false, false, "libvirt.org", NULL);
+
+    if (virTestGetExpensive()) {
+        struct testTLSSessionData benchData = {
+            .servercacrt = cacertreq.filename,
+            .clientcacrt = cacertreq.filename,
+            .servercrt = servercertreq.filename,
+            .clientcrt = clientcertreq.filename,
+            .hostname = "libvirt.org",
+        };
+        if (virTestRun("TLS Session read benchmark",
+                       testTLSSessionBench, &benchData) < 0)
+            ret = -1;
+    }
+
     DO_SESS_TEST_EXT(cacertreq.filename, altcacertreq.filename, servercertreq.filename,
                      clientcertaltreq.filename, true, true, "libvirt.org", NULL);
 
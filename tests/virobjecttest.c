@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "virobject.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+typedef struct _testPoolReuse testPoolReuse;
+struct _testPoolReuse {
+    virObject parent;
+
+    int value;
+    char *data;
+};
+
+typedef struct _testPoolLimit testPoolLimit;
+struct _testPoolLimit {
+    virObject parent;
+
+    int value;
+};
+
+static virClassPtr testPoolReuseClass;
+static virClassPtr testPoolLimitClass;
+static size_t ndisposed;
+
+
+static void
+testPoolReuseDispose(void *obj)
+{
+    testPoolReuse *reuse = obj;
+
+    g_free(reuse->data);
+    ndisposed++;
+}
+
+
+static void
+testPoolLimitDispose(void *obj G_GNUC_UNUSED)
+{
+    ndisposed++;
+}
+
+
+static int
+testPoolGetStats(virClassPtr klass,
+                 virClassStats *ret)
+{
+    virClassStatsPtr stats = NULL;
+    size_t nstats = virClassGetStats(&stats);
+    size_t i;
+
+    for (i = 0; i < nstats; i++) {
+        if (STRNEQ(stats[i].name, virClassName(klass)))
+            continue;
+
+        *ret = stats[i];
+        ret->name = NULL;
+        virClassStatsFree(stats, nstats);
+        return 0;
+    }
+
+    fprintf(stderr, "No statistics for class %s\n", virClassName(klass));
+    virClassStatsFree(stats, nstats);
+    return -1;
+}
+
+
+static int
+testPoolCheckStats(virClassPtr klass,
+                   unsigned long long live,
+                   unsigned long long pooled,
+                   unsigned long long reused)
+{
+    virClassStats stats;
+
+    if (testPoolGetStats(klass, &stats) < 0)
+        return -1;
+
+    if (stats.live != live || stats.pooled != pooled ||
+        stats.reused != reused) {
+        fprintf(stderr,
+                "Expected live=%llu pooled=%llu reused=%llu, "
+                "got live=%llu pooled=%llu reused=%llu\n",
+                live, pooled, reused,
+                stats.live, stats.pooled, stats.reused);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testPoolReuseInstance(const void *opaque G_GNUC_UNUSED)
+{
+    testPoolReuse *obj;
+    testPoolReuse *reused;
+    const char *fields;
+    size_t i;
+
+    ndisposed = 0;
+
+    if (!(obj = virObjectNew(testPoolReuseClass)))
+        return -1;
+
+    obj->value = 42;
+    obj->data = g_strdup("data");
+
+    /* an extra reference keeps the instance out of the pool */
+    virObjectRef(obj);
+    virObjectUnref(obj);
+
+    if (ndisposed != 0 ||
+        testPoolCheckStats(testPoolReuseClass, 1, 0, 0) < 0)
+        return -1;
+
+    virObjectUnref(obj);
+
+    if (ndisposed != 1) {
+        fprintf(stderr, "Instance was not disposed\n");
+        return -1;
+    }
+
+    if (testPoolCheckStats(testPoolReuseClass, 0, 1, 0) < 0)
+        return -1;
+
+    if (!(reused = virObjectNew(testPoolReuseClass)))
+        return -1;
+
+    if (reused != obj) {
+        fprintf(stderr, "Instance was not taken from the pool\n");
+        return -1;
+    }
+
+    fields = (const char *) reused + sizeof(virObject);
+    for (i = 0; i < sizeof(testPoolReuse) - sizeof(virObject); i++) {
+        if (fields[i] != 0) {
+            fprintf(stderr, "Byte %zu of the reused instance is not zero\n",
+                    sizeof(virObject) + i);
+            return -1;
+        }
+    }
+
+    if (G_OBJECT(reused)->ref_count != 1) {
+        fprintf(stderr, "Reused instance has %u references\n",
+                G_OBJECT(reused)->ref_count);
+        return -1;
+    }
+
+    if (!virObjectIsClass(reused, testPoolReuseClass) ||
+        testPoolCheckStats(testPoolReuseClass, 1, 0, 1) < 0)
+        return -1;
+
+    virObjectUnref(reused);
+
+    return testPoolCheckStats(testPoolReuseClass, 0, 1, 1);
+}
+
+
+static int
+testPoolSizeLimit(const void *opaque G_GNUC_UNUSED)
+{
+    testPoolLimit *objs[3];
+    testPoolLimit *reused[3];
+    size_t i;
+
+    ndisposed = 0;
+
+    for (i = 0; i < G_N_ELEMENTS(objs); i++) {
+        if (!(objs[i] = virObjectNew(testPoolLimitClass)))
+            return -1;
+        objs[i]->value = i + 1;
+    }
+
+    for (i = 0; i < G_N_ELEMENTS(objs); i++)
+        virObjectUnref(objs[i]);
+
+    /* all are disposed, but only two fit into the pool */
+    if (ndisposed != G_N_ELEMENTS(objs)) {
+        fprintf(stderr, "Expected %zu disposed instances, got %zu\n",
+                G_N_ELEMENTS(objs), ndisposed);
+        return -1;
+    }
+
+    if (testPoolCheckStats(testPoolLimitClass, 0, 2, 0) < 0)
+        return -1;
+
+    for (i = 0; i < G_N_ELEMENTS(reused); i++) {
+        if (!(reused[i] = virObjectNew(testPoolLimitClass)))
+            return -1;
+
+        if (reused[i]->value != 0) {
+            fprintf(stderr, "Instance %zu is not zeroed\n", i);
+            return -1;
+        }
+    }
+
+    if (testPoolCheckStats(testPoolLimitClass, 3, 0, 2) < 0)
+        return -1;
+
+    for (i = 0; i < G_N_ELEMENTS(reused); i++)
+        virObjectUnref(reused[i]);
+
+    return testPoolCheckStats(testPoolLimitClass, 0, 2, 2);
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (!VIR_CLASS_NEW(testPoolReuse, virClassForObject()) ||
+        !VIR_CLASS_NEW(testPoolLimit, virClassForObject()))
+        return EXIT_FAILURE;
+
+    virClassEnablePool(testPoolReuseClass, 4);
+    virClassEnablePool(testPoolLimitClass, 2);
+
+    if (virTestRun("Pool reuse", testPoolReuseInstance, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Pool size limit", testPoolSizeLimit, NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
@@ -0,0 +1,127 @@
+/*
+ * virportallocatorbench.c: benchmarks of the port allocator
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "testutilsbench.h"
+
+#if HAVE_DLFCN_H
+# include <dlfcn.h>
+#endif
+
+#if defined(__linux__) && defined(RTLD_NEXT)
+
+# include "virportallocator.h"
+# include "virthread.h"
+
+# define VIR_FROM_THIS VIR_FROM_NONE
+
+# define TEST_BENCH_SUITE "portallocator"
+# define TEST_BENCH_NTHREADS 8
+# define TEST_BENCH_NPORTS 32
+
+typedef struct {
+    virPortAllocatorRangePtr range;
+    size_t rounds;
+    bool failed;
+} testBenchData;
+
+
+static void
+testBenchThreadFunc(void *opaque)
+{
+    testBenchData *data = opaque;
+    unsigned short ports[TEST_BENCH_NPORTS];
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < data->rounds; i++) {
+        for (j = 0; j < TEST_BENCH_NPORTS; j++) {
+            if (virPortAllocatorAcquire(data->range, &ports[j]) < 0) {
+                data->failed = true;
+                return;
+            }
+        }
+
+        for (j = 0; j < TEST_BENCH_NPORTS; j++)
+            virPortAllocatorRelease(ports[j]);
+    }
+}
+
+
+/*
+ * Acquiring and releasing ports from many threads at once, as done
+ * when many domains are started or migrated concurrently.
+ */
+static int
+testBenchAllocThreads(const void *opaque G_GNUC_UNUSED,
+                      size_t iterations)
+{
+    testBenchData data = { 0 };
+    virThread threads[TEST_BENCH_NTHREADS];
+    size_t nthreads = 0;
+    size_t i;
+    int ret = -1;
+
+    if (!(data.range = virPortAllocatorRangeNew("test", 5900, 65535)))
+        return -1;
+
+    data.rounds = iterations / (TEST_BENCH_NTHREADS * TEST_BENCH_NPORTS);
+
+    for (nthreads = 0; nthreads < TEST_BENCH_NTHREADS; nthreads++) {
+        if (virThreadCreate(&threads[nthreads], true,
+                            testBenchThreadFunc, &data) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+
+    if (data.failed)
+        ret = -1;
+
+    virPortAllocatorRangeFree(data.range);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (testBenchRun(TEST_BENCH_SUITE, "acquire-release-threads",
+                     testBenchAllocThreads, NULL,
+                     1000 * TEST_BENCH_NTHREADS * TEST_BENCH_NPORTS) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN_PRELOAD(mymain, VIR_TEST_MOCK("virportallocator"))
+#else /* defined(__linux__) && defined(RTLD_NEXT) */
+int
+main(void)
+{
+    return EXIT_AM_SKIP;
+}
+#endif
@@ -31,6 +31,7 @@
 # include "virlog.h"
 # include "virportallocator.h"
 # include "virstring.h"
+# include "virthread.h"
 
 # define VIR_FROM_THIS VIR_FROM_RPC
 
@@ -158,6 +159,118 @@ static int testAllocReuse(const void *args G_GNUC_UNUSED)
     return ret;
 }
 
+# define TEST_NTHREADS 8
+# define TEST_NPORTS 32
+
+struct testConcurrentData {
+    virPortAllocatorRangePtr range;
+    size_t rounds;
+    unsigned short ports[TEST_NTHREADS][TEST_NPORTS];
+    bool failed;
+};
+
+struct testConcurrentThread {
+    struct testConcurrentData *data;
+    size_t idx;
+};
+
+
+static void
+testConcurrentThreadFunc(void *opaque)
+{
+    struct testConcurrentThread *thread = opaque;
+    struct testConcurrentData *data = thread->data;
+    unsigned short *ports = data->ports[thread->idx];
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < data->rounds; i++) {
+        for (j = 0; j < TEST_NPORTS; j++) {
+            if (virPortAllocatorAcquire(data->range, &ports[j]) < 0) {
+                data->failed = true;
+                return;
+            }
+        }
+
+        /* keep the ports of the last round for the caller to check */
+        if (i + 1 == data->rounds)
+            break;
+
+        for (j = 0; j < TEST_NPORTS; j++)
+            virPortAllocatorRelease(ports[j]);
+    }
+}
+
+
+static int
+testAllocConcurrent(struct testConcurrentData *data)
+{
+    virThread threads[TEST_NTHREADS];
+    struct testConcurrentThread args[TEST_NTHREADS];
+    g_autoptr(virBitmap) seen = virBitmapNew(65536);
+    size_t nthreads = 0;
+    size_t i;
+    size_t j;
+    int ret = -1;
+
+    for (i = 0; i < TEST_NTHREADS; i++) {
+        args[i].data = data;
+        args[i].idx = i;
+        if (virThreadCreate(&threads[i], true,
+                            testConcurrentThreadFunc, &args[i]) < 0)
+            break;
+        nthreads++;
+    }
+
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+
+    if (nthreads < TEST_NTHREADS || data->failed)
+        goto release;
+
+    /* no port may have been handed out twice */
+    for (i = 0; i < TEST_NTHREADS; i++) {
+        for (j = 0; j < TEST_NPORTS; j++) {
+            unsigned short port = data->ports[i][j];
+
+            if (virBitmapIsBitSet(seen, port)) {
+                VIR_TEST_DEBUG("Port %d acquired twice", port);
+                goto release;
+            }
+            ignore_value(virBitmapSetBit(seen, port));
+        }
+    }
+
+    ret = 0;
+
+ release:
+    for (i = 0; i < TEST_NTHREADS; i++) {
+        for (j = 0; j < TEST_NPORTS; j++)
+            virPortAllocatorRelease(data->ports[i][j]);
+    }
+
+    return ret;
+}
+
+
+static int testAllocThreads(const void *args G_GNUC_UNUSED)
+{
+    struct testConcurrentData data = { 0 };
+    int ret;
+
+    /* 5900 and 5904-5906 are in use, the range has no spare port */
+    if (!(data.range = virPortAllocatorRangeNew("test", 5900,
+                                                5903 + TEST_NTHREADS * TEST_NPORTS)))
+        return -1;
+
+    data.rounds = 10;
+
+    ret = testAllocConcurrent(&data);
+
+    virPortAllocatorRangeFree(data.range);
+    return ret;
+}
+
 
 static int
 mymain(void)
@@ -170,6 +283,9 @@ mymain(void)
     if (virTestRun("Test alloc reuse", testAllocReuse, NULL) < 0)
         ret = -1;
 
+    if (virTestRun("Test alloc threads", testAllocThreads, NULL) < 0)
+        ret = -1;
+
     g_setenv("LIBVIRT_TEST_IPV4ONLY", "really", TRUE);
 
     if (virTestRun("Test IPv4-only alloc all", testAllocAll, NULL) < 0)
@@ -0,0 +1,168 @@
+/*
+ * virprocessbench.c: benchmarks of process helpers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <unistd.h>
+
+#include "testutils.h"
+#include "testutilsbench.h"
+#include "virprocess.h"
+#include "virthread.h"
+#include "virfile.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+#define TEST_BENCH_SUITE "process"
+#define TEST_BENCH_NTHREADS 4
+
+typedef struct {
+    virMutex lock;
+    virCond cond;
+    pid_t tids[TEST_BENCH_NTHREADS];
+    size_t ntids;
+    bool quit;
+} testBenchData;
+
+
+/* Stands for a vCPU thread, waits until the benchmark is over */
+static void
+testBenchThreadFunc(void *opaque)
+{
+    testBenchData *data = opaque;
+
+    virMutexLock(&data->lock);
+    data->tids[data->ntids++] = (pid_t) virThreadSelfID();
+    virCondBroadcast(&data->cond);
+    while (!data->quit)
+        ignore_value(virCondWait(&data->cond, &data->lock));
+    virMutexUnlock(&data->lock);
+}
+
+
+/* Times of all threads read in one pass, as done for vCPU statistics */
+static int
+testBenchSchedStatsBulk(const void *opaque,
+                        size_t iterations)
+{
+    const testBenchData *data = opaque;
+    unsigned long long runtime[TEST_BENCH_NTHREADS];
+    size_t i;
+
+    for (i = 0; i < iterations; i++) {
+        if (virProcessGetSchedStats(getpid(), data->tids, data->ntids,
+                                    runtime, NULL) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/* Parsing the 'stat' and 'sched' files of each thread separately */
+static int
+testBenchSchedStatsPerThread(const void *opaque,
+                             size_t iterations)
+{
+    const testBenchData *data = opaque;
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < iterations; i++) {
+        for (j = 0; j < data->ntids; j++) {
+            g_autofree char *stat = NULL;
+            g_autofree char *sched = NULL;
+            g_autofree char *buf = NULL;
+            g_autofree char *buf2 = NULL;
+
+            stat = g_strdup_printf("/proc/%lld/task/%lld/stat",
+                                   (long long) getpid(),
+                                   (long long) data->tids[j]);
+            sched = g_strdup_printf("/proc/%lld/task/%lld/sched",
+                                    (long long) getpid(),
+                                    (long long) data->tids[j]);
+
+            if (virFileReadAll(stat, 1024, &buf) < 0)
+                return -1;
+
+            /* needs CONFIG_SCHED_DEBUG */
+            if (access(sched, R_OK) == 0 &&
+                virFileReadAll(sched, 1 << 16, &buf2) < 0)
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+static int
+mymain(void)
+{
+    g_autofree char *path = NULL;
+    testBenchData data = { 0 };
+    virThread threads[TEST_BENCH_NTHREADS];
+    size_t nthreads = 0;
+    size_t i;
+    int ret = -1;
+
+    path = g_strdup_printf("/proc/%lld/schedstat", (long long) getpid());
+
+    /* the kernel might be built without CONFIG_SCHEDSTATS */
+    if (!virFileExists(path))
+        return EXIT_AM_SKIP;
+
+    if (virMutexInit(&data.lock) < 0 ||
+        virCondInit(&data.cond) < 0)
+        return EXIT_FAILURE;
+
+    for (nthreads = 0; nthreads < TEST_BENCH_NTHREADS; nthreads++) {
+        if (virThreadCreate(&threads[nthreads], true,
+                            testBenchThreadFunc, &data) < 0)
+            goto cleanup;
+    }
+
+    virMutexLock(&data.lock);
+    while (data.ntids < TEST_BENCH_NTHREADS)
+        ignore_value(virCondWait(&data.cond, &data.lock));
+    virMutexUnlock(&data.lock);
+
+    if (testBenchRun(TEST_BENCH_SUITE, "sched-stats-bulk",
+                     testBenchSchedStatsBulk, &data, 10000) < 0 ||
+        testBenchRun(TEST_BENCH_SUITE, "sched-stats-per-thread",
+                     testBenchSchedStatsPerThread, &data, 10000) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    virMutexLock(&data.lock);
+    data.quit = true;
+    virCondBroadcast(&data.cond);
+    virMutexUnlock(&data.lock);
+
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+
+    virCondDestroy(&data.cond);
+    virMutexDestroy(&data.lock);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
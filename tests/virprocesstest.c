@@ -0,0 +1,161 @@
+/*
+ * virprocesstest.c: Test process helpers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <unistd.h>
+
+#include "testutils.h"
+#include "virprocess.h"
+#include "virthread.h"
+#include "virfile.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+#define TEST_NTHREADS 4
+
+struct testThreadData {
+    virMutex lock;
+    virCond cond;
+    pid_t tids[TEST_NTHREADS];
+    size_t ntids;
+    int quit;
+};
+
+
+static void
+testThreadFunc(void *opaque)
+{
+    struct testThreadData *data = opaque;
+    volatile unsigned long long spin = 0;
+
+    virMutexLock(&data->lock);
+    data->tids[data->ntids++] = (pid_t) virThreadSelfID();
+    virCondBroadcast(&data->cond);
+    virMutexUnlock(&data->lock);
+
+    /* burn some CPU so that the run time is non-zero */
+    while (!g_atomic_int_get(&data->quit))
+        spin++;
+}
+
+
+static int
+testThreadsStart(struct testThreadData *data,
+                 virThread *threads)
+{
+    size_t i;
+
+    memset(data, 0, sizeof(*data));
+
+    if (virMutexInit(&data->lock) < 0 ||
+        virCondInit(&data->cond) < 0)
+        return -1;
+
+    for (i = 0; i < TEST_NTHREADS; i++) {
+        if (virThreadCreate(&threads[i], true, testThreadFunc, data) < 0)
+            return -1;
+    }
+
+    virMutexLock(&data->lock);
+    while (data->ntids < TEST_NTHREADS)
+        virCondWait(&data->cond, &data->lock);
+    virMutexUnlock(&data->lock);
+
+    return 0;
+}
+
+
+static void
+testThreadsStop(struct testThreadData *data,
+                virThread *threads)
+{
+    size_t i;
+
+    g_atomic_int_set(&data->quit, 1);
+
+    for (i = 0; i < TEST_NTHREADS; i++)
+        virThreadJoin(&threads[i]);
+
+    virCondDestroy(&data->cond);
+    virMutexDestroy(&data->lock);
+}
+
+
+static int
+testSchedStats(const void *opaque G_GNUC_UNUSED)
+{
+    struct testThreadData data;
+    virThread threads[TEST_NTHREADS];
+    unsigned long long runtime[TEST_NTHREADS] = { 0 };
+    unsigned long long waittime[TEST_NTHREADS] = { 0 };
+    size_t i;
+    int ret = -1;
+
+    if (testThreadsStart(&data, threads) < 0)
+        return -1;
+
+    g_usleep(100 * 1000);
+
+    if (virProcessGetSchedStats(getpid(), data.tids, data.ntids,
+                                runtime, waittime) < 0)
+        goto cleanup;
+
+    for (i = 0; i < data.ntids; i++) {
+        if (runtime[i] == 0) {
+            VIR_TEST_VERBOSE("thread %lld reports no run time",
+                             (long long) data.tids[i]);
+            goto cleanup;
+        }
+    }
+
+    /* a thread which doesn't belong to the process must be rejected */
+    data.tids[0] = -1;
+    if (virProcessGetSchedStats(getpid(), data.tids, data.ntids,
+                                runtime, NULL) == 0) {
+        VIR_TEST_VERBOSE("reading stats of a bogus thread succeeded");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    testThreadsStop(&data, threads);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    g_autofree char *path = NULL;
+    int ret = 0;
+
+    path = g_strdup_printf("/proc/%lld/schedstat", (long long) getpid());
+
+    /* the kernel might be built without CONFIG_SCHEDSTATS */
+    if (!virFileExists(path))
+        return EXIT_AM_SKIP;
+
+    if (virTestRun("Sched stats", testSchedStats, NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
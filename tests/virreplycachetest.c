@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+
+#if defined(__ELF__)
+
+# include "virreplycache.h"
+# include "virtime.h"
+
+# define VIR_FROM_THIS VIR_FROM_NONE
+
+static unsigned long long fakeNow = 1000000;
+
+
+int
+virTimeMillisNow(unsigned long long *now)
+{
+    *now = fakeNow;
+    return 0;
+}
+
+
+/* Expects the reply cached under @key to be @value, or none if @value
+ * is NULL */
+static int
+testReplyCacheCheck(virReplyCachePtr cache,
+                    const char *key,
+                    const char *value)
+{
+    g_autofree char *cached = virReplyCacheLookup(cache, key);
+
+    if (STRNEQ_NULLABLE(cached, value)) {
+        fprintf(stderr, "Expected '%s' cached under '%s', got '%s'\n",
+                NULLSTR(value), key, NULLSTR(cached));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testReplyCacheCheckSize(virReplyCachePtr cache,
+                        size_t size)
+{
+    if (virReplyCacheSize(cache) != size) {
+        fprintf(stderr, "Expected %zu cached replies, got %zu\n",
+                size, virReplyCacheSize(cache));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testReplyCacheHit(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(virReplyCache) cache = virReplyCacheNew(10, 4);
+
+    if (testReplyCacheCheck(cache, "capabilities", NULL) < 0)
+        return -1;
+
+    virReplyCacheStore(cache, "capabilities", "<capabilities/>");
+    virReplyCacheStore(cache, "hostname", "example.com");
+
+    if (testReplyCacheCheck(cache, "capabilities", "<capabilities/>") < 0 ||
+        testReplyCacheCheck(cache, "capabilities", "<capabilities/>") < 0 ||
+        testReplyCacheCheck(cache, "hostname", "example.com") < 0 ||
+        testReplyCacheCheck(cache, "version", NULL) < 0)
+        return -1;
+
+    /* a newer reply replaces the cached one */
+    virReplyCacheStore(cache, "hostname", "example.org");
+
+    if (testReplyCacheCheck(cache, "hostname", "example.org") < 0 ||
+        testReplyCacheCheckSize(cache, 2) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+testReplyCacheExpiry(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(virReplyCache) cache = virReplyCacheNew(10, 4);
+
+    virReplyCacheStore(cache, "capabilities", "<capabilities/>");
+    fakeNow += 5 * 1000;
+    virReplyCacheStore(cache, "hostname", "example.com");
+    fakeNow += 5 * 1000 - 1;
+
+    if (testReplyCacheCheck(cache, "capabilities", "<capabilities/>") < 0)
+        return -1;
+
+    fakeNow += 1;
+
+    if (testReplyCacheCheck(cache, "capabilities", NULL) < 0 ||
+        testReplyCacheCheck(cache, "hostname", "example.com") < 0 ||
+        testReplyCacheCheckSize(cache, 1) < 0)
+        return -1;
+
+    fakeNow += 5 * 1000;
+
+    if (testReplyCacheCheck(cache, "hostname", NULL) < 0 ||
+        testReplyCacheCheckSize(cache, 0) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+testReplyCacheEviction(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(virReplyCache) cache = virReplyCacheNew(10, 3);
+
+    virReplyCacheStore(cache, "domcaps-1", "1");
+    fakeNow++;
+    virReplyCacheStore(cache, "domcaps-2", "2");
+    fakeNow++;
+    virReplyCacheStore(cache, "domcaps-3", "3");
+    fakeNow++;
+
+    /* refreshing a reply neither evicts anything nor counts twice */
+    virReplyCacheStore(cache, "domcaps-1", "1");
+    fakeNow++;
+
+    if (testReplyCacheCheckSize(cache, 3) < 0)
+        return -1;
+
+    /* the reply expiring first goes */
+    virReplyCacheStore(cache, "domcaps-4", "4");
+
+    if (testReplyCacheCheckSize(cache, 3) < 0 ||
+        testReplyCacheCheck(cache, "domcaps-1", "1") < 0 ||
+        testReplyCacheCheck(cache, "domcaps-2", NULL) < 0 ||
+        testReplyCacheCheck(cache, "domcaps-3", "3") < 0 ||
+        testReplyCacheCheck(cache, "domcaps-4", "4") < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+testReplyCacheInvalidate(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(virReplyCache) cache = virReplyCacheNew(10, 4);
+
+    virReplyCacheStore(cache, "capabilities", "<capabilities/>");
+    virReplyCacheStore(cache, "hostname", "example.com");
+
+    virReplyCacheInvalidate(cache);
+
+    if (testReplyCacheCheckSize(cache, 0) < 0 ||
+        testReplyCacheCheck(cache, "capabilities", NULL) < 0 ||
+        testReplyCacheCheck(cache, "hostname", NULL) < 0)
+        return -1;
+
+    /* the cache stays usable */
+    virReplyCacheStore(cache, "capabilities",
+                       "<capabilities><host/></capabilities>");
+
+    if (testReplyCacheCheck(cache, "capabilities",
+                            "<capabilities><host/></capabilities>") < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (virTestRun("Reply cache hit", testReplyCacheHit, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Reply cache expiry", testReplyCacheExpiry, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Reply cache eviction", testReplyCacheEviction, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Reply cache invalidate", testReplyCacheInvalidate, NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
+
+#else /* ! __ELF__ */
+int
+main(void)
+{
+    return EXIT_AM_SKIP;
+}
+#endif /* ! __ELF__ */
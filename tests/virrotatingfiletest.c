@@ -22,6 +22,7 @@
 #include <fcntl.h>
 
 #include "virrotatingfile.h"
+#include "virfile.h"
 #include "virlog.h"
 #include "testutils.h"
 
@@ -32,6 +33,7 @@ VIR_LOG_INIT("tests.rotatingfiletest");
 #define FILENAME "virrotatingfiledata.txt"
 #define FILENAME0 "virrotatingfiledata.txt.0"
 #define FILENAME1 "virrotatingfiledata.txt.1"
+#define FILENAME0ZST "virrotatingfiledata.txt.0.zst"
 
 #define FILEBYTE 0xde
 #define FILEBYTE0 0xad
@@ -691,6 +693,86 @@ static int testRotatingFileReaderSeek(const void *data G_GNUC_UNUSED)
     return ret;
 }
 
+#if WITH_ZSTD
+static int testRotatingFileCompress(const void *data G_GNUC_UNUSED)
+{
+    virRotatingFileWriterPtr writer = NULL;
+    virRotatingFileReaderPtr reader = NULL;
+    int ret = -1;
+    char buf[600];
+    char byte = 0x5e;
+    ssize_t got;
+    ssize_t i;
+    struct stat sb;
+
+    if (testRotatingFileInitFiles(256, 256, 256) < 0)
+        return -1;
+
+    if (stat(FILENAME, &sb) < 0) {
+        virReportSystemError(errno, "Cannot stat %s", FILENAME);
+        goto cleanup;
+    }
+
+    writer = virRotatingFileWriterNew(FILENAME, 256, 2, false, 0700);
+    if (!writer)
+        goto cleanup;
+
+    if (virRotatingFileWriterSetCompress(writer, true) < 0)
+        goto cleanup;
+
+    if (virRotatingFileWriterAppend(writer, &byte, 1) != 1)
+        goto cleanup;
+
+    /* waits for the compression to finish */
+    virRotatingFileWriterFree(writer);
+    writer = NULL;
+
+    if (testRotatingFileWriterAssertFileSizes(1, (off_t)-1, 256) < 0)
+        goto cleanup;
+
+    if (!virFileExists(FILENAME0ZST)) {
+        fprintf(stderr, "File %s does not exist\n", FILENAME0ZST);
+        goto cleanup;
+    }
+
+    /* seek into the file which got compressed meanwhile */
+    reader = virRotatingFileReaderNew(FILENAME, 2);
+    if (!reader)
+        goto cleanup;
+
+    if (virRotatingFileReaderSeek(reader, sb.st_ino, 100) < 0)
+        goto cleanup;
+
+    if ((got = virRotatingFileReaderConsume(reader, buf, sizeof(buf))) < 0)
+        goto cleanup;
+
+    if (got != 157) {
+        fprintf(stderr, "Expected 157 bytes not %zd\n", got);
+        goto cleanup;
+    }
+
+    for (i = 0; i < got; i++) {
+        char want = i < 156 ? (char)FILEBYTE : byte;
+
+        if (buf[i] != want) {
+            fprintf(stderr, "Expected '0x%x' but got '0x%x' at byte %zd\n",
+                    want & 0xff, buf[i] & 0xff, i);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+ cleanup:
+    virRotatingFileWriterFree(writer);
+    virRotatingFileReaderFree(reader);
+    unlink(FILENAME);
+    unlink(FILENAME0);
+    unlink(FILENAME0ZST);
+    unlink(FILENAME1);
+    return ret;
+}
+#endif /* WITH_ZSTD */
+
 static int
 mymain(void)
 {
@@ -735,6 +817,11 @@ mymain(void)
     if (virTestRun("Rotating file read seek", testRotatingFileReaderSeek, NULL) < 0)
         ret = -1;
 
+#if WITH_ZSTD
+    if (virTestRun("Rotating file compress", testRotatingFileCompress, NULL) < 0)
+        ret = -1;
+#endif /* WITH_ZSTD */
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
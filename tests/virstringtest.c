@@ -25,6 +25,7 @@
 #include "virfile.h"
 #include "virlog.h"
 #include "virstring.h"
+#include "virstringintern.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -569,6 +570,67 @@ testVirStringListFreeCount(const void *opaque G_GNUC_UNUSED)
 }
 
 
+static int
+testStringIntern(const void *opaque G_GNUC_UNUSED)
+{
+    g_autofree char *copy = g_strdup("/usr/bin/qemu-system-x86_64");
+    size_t count = virStringInternCount();
+    char *a = NULL;
+    char *b = NULL;
+    char *c = NULL;
+    int ret = -1;
+
+    if (virStringIntern(NULL) || virStringInternTake(NULL)) {
+        fprintf(stderr, "NULL should not be interned\n");
+        goto cleanup;
+    }
+
+    a = virStringIntern("/usr/bin/qemu-system-x86_64");
+    b = virStringInternTake(g_steal_pointer(&copy));
+    c = virStringIntern("pc-q35-5.1");
+
+    if (STRNEQ(a, "/usr/bin/qemu-system-x86_64") ||
+        STRNEQ(c, "pc-q35-5.1")) {
+        fprintf(stderr, "interned strings don't match the originals\n");
+        goto cleanup;
+    }
+
+    if (a != b || a == c) {
+        fprintf(stderr, "equal strings should share a copy\n");
+        goto cleanup;
+    }
+
+    if (virStringInternCount() != count + 2) {
+        fprintf(stderr, "expected %zu interned strings, got %zu\n",
+                count + 2, virStringInternCount());
+        goto cleanup;
+    }
+
+    virStringInternRelease(g_steal_pointer(&b));
+    if (virStringInternCount() != count + 2 ||
+        STRNEQ(a, "/usr/bin/qemu-system-x86_64")) {
+        fprintf(stderr, "string released while still referenced\n");
+        goto cleanup;
+    }
+
+    virStringInternRelease(g_steal_pointer(&a));
+    virStringInternRelease(g_steal_pointer(&c));
+    if (virStringInternCount() != count) {
+        fprintf(stderr, "expected %zu interned strings, got %zu\n",
+                count, virStringInternCount());
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virStringInternRelease(a);
+    virStringInternRelease(b);
+    virStringInternRelease(c);
+    return ret;
+}
+
+
 struct testStripData {
     const char *string;
     const char *result;
@@ -926,6 +988,9 @@ mymain(void)
                    NULL) < 0)
         ret = -1;
 
+    if (virTestRun("virStringIntern", testStringIntern, NULL) < 0)
+        ret = -1;
+
 #define TEST_STRIP_IPV6_BRACKETS(str, res) \
     do { \
         struct testStripData stripData = { \
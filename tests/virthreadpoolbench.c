@@ -0,0 +1,149 @@
+/*
+ * virthreadpoolbench.c: benchmarks of the thread pool
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "testutilsbench.h"
+#include "virthreadpool.h"
+#include "virthread.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+#define TEST_BENCH_SUITE "threadpool"
+#define TEST_BENCH_PRODUCERS 4
+
+typedef struct {
+    virMutex lock;
+    virCond cond;
+    size_t expect;
+    int ndone;
+    bool done;
+} testBenchData;
+
+typedef struct {
+    virThreadPoolPtr pool;
+    size_t njobs;
+    bool failed;
+} testBenchProducer;
+
+
+static void
+testBenchJobFunc(void *jobdata G_GNUC_UNUSED,
+                 void *opaque)
+{
+    testBenchData *data = opaque;
+
+    if ((size_t) g_atomic_int_add(&data->ndone, 1) + 1 != data->expect)
+        return;
+
+    virMutexLock(&data->lock);
+    data->done = true;
+    virCondBroadcast(&data->cond);
+    virMutexUnlock(&data->lock);
+}
+
+
+static void
+testBenchProducerFunc(void *opaque)
+{
+    testBenchProducer *producer = opaque;
+    size_t i;
+
+    for (i = 0; i < producer->njobs; i++) {
+        if (virThreadPoolSendJobGroup(producer->pool, 0, producer, NULL) < 0) {
+            producer->failed = true;
+            return;
+        }
+    }
+}
+
+
+/*
+ * Short jobs submitted by several producers at once, as with RPC calls
+ * of several clients, until all of them ran.
+ */
+static int
+testBenchJobs(const void *opaque G_GNUC_UNUSED,
+              size_t iterations)
+{
+    testBenchProducer producers[TEST_BENCH_PRODUCERS] = { 0 };
+    virThread threads[TEST_BENCH_PRODUCERS];
+    testBenchData data = { 0 };
+    virThreadPoolPtr pool = NULL;
+    size_t njobs = iterations / TEST_BENCH_PRODUCERS;
+    size_t nthreads = 0;
+    size_t i;
+    int ret = -1;
+
+    if (virMutexInit(&data.lock) < 0)
+        return -1;
+    if (virCondInit(&data.cond) < 0) {
+        virMutexDestroy(&data.lock);
+        return -1;
+    }
+
+    data.expect = njobs * TEST_BENCH_PRODUCERS;
+
+    if (!(pool = virThreadPoolNew(4, 16, 0, testBenchJobFunc, &data)))
+        goto cleanup;
+
+    for (nthreads = 0; nthreads < TEST_BENCH_PRODUCERS; nthreads++) {
+        producers[nthreads].pool = pool;
+        producers[nthreads].njobs = njobs;
+        if (virThreadCreate(&threads[nthreads], true,
+                            testBenchProducerFunc, &producers[nthreads]) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < nthreads; i++) {
+        virThreadJoin(&threads[i]);
+        if (producers[i].failed)
+            ret = -1;
+    }
+
+    if (ret == 0 && nthreads == TEST_BENCH_PRODUCERS) {
+        virMutexLock(&data.lock);
+        while (!data.done)
+            ignore_value(virCondWait(&data.cond, &data.lock));
+        virMutexUnlock(&data.lock);
+    }
+
+    virThreadPoolFree(pool);
+    virCondDestroy(&data.cond);
+    virMutexDestroy(&data.lock);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (testBenchRun(TEST_BENCH_SUITE, "jobs", testBenchJobs,
+                     NULL, 400000) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
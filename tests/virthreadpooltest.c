@@ -0,0 +1,226 @@
+/*
+ * virthreadpooltest.c: Test thread pool
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "virthreadpool.h"
+#include "virthread.h"
+#include "virtime.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+/* how long to wait for jobs before declaring the pool stuck */
+#define TEST_TIMEOUT_MS 10000
+
+struct testPoolData {
+    virMutex lock;
+    virCond cond;
+    size_t expect;
+    size_t done;
+    bool release;
+    int order[8];
+    size_t norder;
+};
+
+struct testPoolJob {
+    int id;
+    bool block;
+};
+
+
+static void
+testPoolJobFunc(void *jobdata,
+                void *opaque)
+{
+    struct testPoolJob *job = jobdata;
+    struct testPoolData *data = opaque;
+
+    virMutexLock(&data->lock);
+
+    if (job && data->norder < G_N_ELEMENTS(data->order))
+        data->order[data->norder++] = job->id;
+
+    data->done++;
+    virCondBroadcast(&data->cond);
+
+    while (job && job->block && !data->release)
+        virCondWait(&data->cond, &data->lock);
+
+    virMutexUnlock(&data->lock);
+}
+
+
+static int
+testPoolDataInit(struct testPoolData *data)
+{
+    memset(data, 0, sizeof(*data));
+
+    if (virMutexInit(&data->lock) < 0)
+        return -1;
+
+    if (virCondInit(&data->cond) < 0) {
+        virMutexDestroy(&data->lock);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static void
+testPoolDataClear(struct testPoolData *data)
+{
+    virCondDestroy(&data->cond);
+    virMutexDestroy(&data->lock);
+}
+
+
+/* Waits until @count jobs finished, @data must be locked */
+static int
+testPoolWaitDone(struct testPoolData *data,
+                 size_t count)
+{
+    unsigned long long deadline;
+
+    if (virTimeMillisNow(&deadline) < 0)
+        return -1;
+    deadline += TEST_TIMEOUT_MS;
+
+    while (data->done < count) {
+        if (virCondWaitUntil(&data->cond, &data->lock, deadline) < 0) {
+            VIR_TEST_VERBOSE("only %zu out of %zu jobs finished",
+                             data->done, count);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+static int
+testRunAll(const void *opaque G_GNUC_UNUSED)
+{
+    struct testPoolData data;
+    virThreadPoolPtr pool = NULL;
+    const int groups[] = { 1, 2, 3 };
+    size_t i;
+    int ret = -1;
+
+    if (testPoolDataInit(&data) < 0)
+        return -1;
+
+    if (!(pool = virThreadPoolNew(1, 4, 1, testPoolJobFunc, &data)))
+        goto cleanup;
+
+    virMutexLock(&data.lock);
+
+    for (i = 0; i < 1000; i++) {
+        if (virThreadPoolSendJobGroup(pool, i % 10 == 0,
+                                      &groups[i % G_N_ELEMENTS(groups)],
+                                      NULL) < 0) {
+            virMutexUnlock(&data.lock);
+            goto cleanup;
+        }
+    }
+
+    ret = testPoolWaitDone(&data, 1000);
+    virMutexUnlock(&data.lock);
+
+ cleanup:
+    virThreadPoolFree(pool);
+    testPoolDataClear(&data);
+    return ret;
+}
+
+
+static int
+testGroupLimit(const void *opaque G_GNUC_UNUSED)
+{
+    struct testPoolData data;
+    virThreadPoolPtr pool = NULL;
+    struct testPoolJob jobs[] = {
+        { .id = 1, .block = true },
+        { .id = 2 },
+        { .id = 3 },
+    };
+    const int groups[2] = { 0 };
+    int ret = -1;
+
+    if (testPoolDataInit(&data) < 0)
+        return -1;
+
+    if (!(pool = virThreadPoolNew(0, 2, 0, testPoolJobFunc, &data)) ||
+        virThreadPoolSetParameters(pool, -1, -1, -1, 1) < 0)
+        goto cleanup;
+
+    virMutexLock(&data.lock);
+
+    if (virThreadPoolSendJobGroup(pool, 0, &groups[0], &jobs[0]) < 0 ||
+        testPoolWaitDone(&data, 1) < 0)
+        goto unlock;
+
+    /* The second job of the first group must wait for the first one,
+     * which doesn't finish until released, so the job of the second
+     * group overtakes it */
+    if (virThreadPoolSendJobGroup(pool, 0, &groups[0], &jobs[1]) < 0 ||
+        virThreadPoolSendJobGroup(pool, 0, &groups[1], &jobs[2]) < 0 ||
+        testPoolWaitDone(&data, 2) < 0)
+        goto unlock;
+
+    data.release = true;
+    virCondBroadcast(&data.cond);
+
+    if (testPoolWaitDone(&data, 3) < 0)
+        goto unlock;
+
+    if (data.order[0] != 1 || data.order[1] != 3 || data.order[2] != 2) {
+        VIR_TEST_VERBOSE("unexpected job order %d %d %d",
+                         data.order[0], data.order[1], data.order[2]);
+        goto unlock;
+    }
+
+    ret = 0;
+
+ unlock:
+    data.release = true;
+    virCondBroadcast(&data.cond);
+    virMutexUnlock(&data.lock);
+ cleanup:
+    virThreadPoolFree(pool);
+    testPoolDataClear(&data);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (virTestRun("Run all jobs", testRunAll, NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("Group limit", testGroupLimit, NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
@@ -150,6 +150,79 @@ testTypedParamsAddStringList(const void *opaque G_GNUC_UNUSED)
     return rv;
 }
 
+static int
+testTypedParamListAddCopy(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(virTypedParamList) list = g_new0(virTypedParamList, 1);
+    size_t i;
+
+    virTypedParameter params[] = {
+        { .field = "foo", .type = VIR_TYPED_PARAM_INT, .value = { .i = 3 } },
+        { .field = "bar", .type = VIR_TYPED_PARAM_STRING,
+          .value = { .s = (char*)"bar1"} },
+    };
+
+    if (virTypedParamListAddInt(list, 1, "first") < 0 ||
+        virTypedParamListAddCopy(list, params, G_N_ELEMENTS(params)) < 0)
+        return -1;
+
+    if (list->npar != G_N_ELEMENTS(params) + 1 ||
+        STRNEQ(list->par[0].field, "first"))
+        return -1;
+
+    for (i = 0; i < G_N_ELEMENTS(params); i++) {
+        virTypedParameterPtr par = list->par + i + 1;
+
+        if (STRNEQ(par->field, params[i].field) ||
+            par->type != params[i].type)
+            return -1;
+    }
+
+    if (list->par[1].value.i != 3 ||
+        STRNEQ(list->par[2].value.s, "bar1") ||
+        list->par[2].value.s == params[1].value.s)
+        return -1;
+
+    return 0;
+}
+
+static int
+testTypedParamsSerializeSteal(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(virTypedParamList) list = g_new0(virTypedParamList, 1);
+    virTypedParameterRemotePtr remote = NULL;
+    unsigned int nremote = 0;
+    int ret = -1;
+
+    virTypedParamListReserve(list, 100);
+
+    if (list->par_alloc < 100 || list->npar != 0)
+        return -1;
+
+    if (virTypedParamListAddInt(list, 1, "foo") < 0 ||
+        virTypedParamListAddString(list, "bar1", "bar") < 0)
+        return -1;
+
+    if (virTypedParamsSerializeSteal(list->par, list->npar, 10,
+                                     &remote, &nremote,
+                                     VIR_TYPED_PARAM_STRING_OKAY) < 0)
+        return -1;
+
+    if (nremote != 2 ||
+        STRNEQ(remote[0].field, "foo") ||
+        remote[0].value.remote_typed_param_value.i != 1 ||
+        STRNEQ(remote[1].field, "bar") ||
+        STRNEQ(remote[1].value.remote_typed_param_value.s, "bar1") ||
+        list->par[1].value.s)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    virTypedParamsRemoteFree(remote, nremote);
+    return ret;
+}
+
 static int
 testTypedParamsGetStringList(const void *opaque G_GNUC_UNUSED)
 {
@@ -301,6 +374,12 @@ mymain(void)
     if (virTestRun("Add string list", testTypedParamsAddStringList, NULL) < 0)
         rv = -1;
 
+    if (virTestRun("List add copy", testTypedParamListAddCopy, NULL) < 0)
+        rv = -1;
+
+    if (virTestRun("Serialize steal", testTypedParamsSerializeSteal, NULL) < 0)
+        rv = -1;
+
     if (rv < 0)
         return EXIT_FAILURE;
     return EXIT_SUCCESS;
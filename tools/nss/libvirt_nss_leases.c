@@ -21,16 +21,20 @@
 #include <config.h>
 
 #include <unistd.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <yajl/yajl_gen.h>
 #include <yajl/yajl_parse.h>
 
 #include "libvirt_nss_leases.h"
 #include "libvirt_nss.h"
+#include "virleaseindex.h"
 
 enum {
     FIND_LEASES_STATE_START,
@@ -60,6 +64,46 @@ typedef struct {
 } findLeasesParser;
 
 
+static int
+appendAddrRaw(leaseAddress **tmpAddress,
+              size_t *ntmpAddress,
+              int family,
+              const unsigned char *addr,
+              long long expirytime,
+              int af)
+{
+    size_t alen = family == AF_INET6 ? 16 : 4;
+    size_t i;
+    leaseAddress *newAddr;
+
+    if (af != AF_UNSPEC && af != family) {
+        DEBUG("Skipping address which family is %d, %d requested", family, af);
+        return 0;
+    }
+
+    for (i = 0; i < *ntmpAddress; i++) {
+        if ((*tmpAddress)[i].af == family &&
+            memcmp((*tmpAddress)[i].addr, addr, alen) == 0) {
+            DEBUG("IP address already in the list");
+            return 0;
+        }
+    }
+
+    newAddr = realloc(*tmpAddress, sizeof(*newAddr) * (*ntmpAddress + 1));
+    if (!newAddr) {
+        ERROR("Out of memory");
+        return -1;
+    }
+    *tmpAddress = newAddr;
+
+    (*tmpAddress)[*ntmpAddress].expirytime = expirytime;
+    (*tmpAddress)[*ntmpAddress].af = family;
+    memcpy((*tmpAddress)[*ntmpAddress].addr, addr, alen);
+    (*ntmpAddress)++;
+    return 0;
+}
+
+
 static int
 appendAddr(const char *name __attribute__((unused)),
            leaseAddress **tmpAddress,
@@ -69,7 +113,6 @@ appendAddr(const char *name __attribute__((unused)),
            int af)
 {
     int family;
-    size_t i;
     struct addrinfo hints = {0};
     struct addrinfo *res = NULL;
     union {
@@ -79,7 +122,6 @@ appendAddr(const char *name __attribute__((unused)),
     } sa;
     unsigned char addr[16];
     int err;
-    leaseAddress *newAddr;
 
     DEBUG("IP address: %s", ipAddr);
 
@@ -109,50 +151,7 @@ appendAddr(const char *name __attribute__((unused)),
         return 0;
     }
 
-    if (af != AF_UNSPEC && af != family) {
-        DEBUG("Skipping address which family is %d, %d requested", family, af);
-        return 0;
-    }
-
-    for (i = 0; i < *ntmpAddress; i++) {
-        if (family == AF_INET) {
-            if ((*tmpAddress)[i].af == AF_INET &&
-                memcmp((*tmpAddress)[i].addr,
-                       &sa.sin.sin_addr,
-                       sizeof(sa.sin.sin_addr)) == 0) {
-                DEBUG("IP address already in the list");
-                return 0;
-            }
-        } else {
-            if ((*tmpAddress)[i].af == AF_INET6 &&
-                memcmp((*tmpAddress)[i].addr,
-                       &sa.sin6.sin6_addr,
-                       sizeof(sa.sin6.sin6_addr)) == 0) {
-                DEBUG("IP address already in the list");
-                return 0;
-            }
-        }
-    }
-
-    newAddr = realloc(*tmpAddress, sizeof(*newAddr) * (*ntmpAddress + 1));
-    if (!newAddr) {
-        ERROR("Out of memory");
-        return -1;
-    }
-    *tmpAddress = newAddr;
-
-    (*tmpAddress)[*ntmpAddress].expirytime = expirytime;
-    (*tmpAddress)[*ntmpAddress].af = family;
-    if (family == AF_INET)
-        memcpy((*tmpAddress)[*ntmpAddress].addr,
-               &sa.sin.sin_addr,
-               sizeof(sa.sin.sin_addr));
-    else
-        memcpy((*tmpAddress)[*ntmpAddress].addr,
-               &sa.sin6.sin6_addr,
-               sizeof(sa.sin6.sin6_addr));
-    (*ntmpAddress)++;
-    return 0;
+    return appendAddrRaw(tmpAddress, ntmpAddress, family, addr, expirytime, af);
 }
 
 
@@ -341,6 +340,117 @@ findLeasesParserEndArray(void *ctx)
 }
 
 
+/*
+ * Looks leases up in the index written by the leases helper next to the
+ * status @file, which avoids parsing the JSON in it. Returns 1 if the
+ * index was used, 0 if it is missing, malformed or out of date and the
+ * status file has to be parsed instead, -1 on error.
+ */
+static int
+findLeasesIndex(const char *file,
+                const char *name,
+                char **macs,
+                size_t nmacs,
+                int af,
+                time_t now,
+                leaseAddress **addrs,
+                size_t *naddrs,
+                bool *found)
+{
+    char *indexFile = NULL;
+    size_t len = strlen(file);
+    struct stat statusSb;
+    struct stat indexSb;
+    const virLeaseIndexHeader *header;
+    const virLeaseIndexEntry *entries;
+    void *map = MAP_FAILED;
+    int fd = -1;
+    int ret = 0;
+    size_t i, j;
+
+    /* $bridge.status -> $bridge.index */
+    if (len < 7 || strcmp(file + len - 7, ".status"))
+        return 0;
+
+    if (asprintf(&indexFile, "%.*s.index", (int)(len - 7), file) < 0)
+        return -1;
+
+    if ((fd = open(indexFile, O_RDONLY)) < 0) {
+        DEBUG("No lease index %s", indexFile);
+        goto cleanup;
+    }
+
+    if (fstat(fd, &indexSb) < 0 ||
+        stat(file, &statusSb) < 0 ||
+        indexSb.st_size < (off_t)sizeof(*header))
+        goto cleanup;
+
+    map = mmap(NULL, indexSb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+        goto cleanup;
+
+    header = map;
+    entries = (const virLeaseIndexEntry *)(header + 1);
+
+    if (memcmp(header->magic, VIR_LEASE_INDEX_MAGIC,
+               VIR_LEASE_INDEX_MAGIC_LEN) != 0 ||
+        header->entrysize != sizeof(*entries) ||
+        indexSb.st_size != (off_t)sizeof(*header) +
+                           (off_t)header->nentries * (off_t)sizeof(*entries)) {
+        DEBUG("Malformed lease index %s", indexFile);
+        goto cleanup;
+    }
+
+    /* the status file is replaced on every update */
+    if (header->statusino != (uint64_t)statusSb.st_ino ||
+        header->statussize != (uint64_t)statusSb.st_size ||
+        header->statusmtime != statusSb.st_mtime) {
+        DEBUG("Lease index %s is out of date", indexFile);
+        goto cleanup;
+    }
+
+    for (i = 0; i < header->nentries; i++) {
+        const virLeaseIndexEntry *entry = entries + i;
+        bool match = false;
+
+        if (nmacs) {
+            for (j = 0; j < nmacs && !match; j++) {
+                if (entry->mac[0] &&
+                    !strncmp(macs[j], entry->mac, sizeof(entry->mac)))
+                    match = true;
+            }
+        } else {
+            match = entry->hostname[0] &&
+                    !strncmp(name, entry->hostname, sizeof(entry->hostname));
+        }
+
+        if (!match ||
+            entry->expirytime < now ||
+            (entry->af != AF_INET && entry->af != AF_INET6))
+            continue;
+
+        *found = true;
+
+        if (appendAddrRaw(addrs, naddrs, entry->af, entry->addr,
+                          entry->expirytime, af) < 0) {
+            ret = -1;
+            goto cleanup;
+        }
+    }
+
+    DEBUG("Used lease index %s", indexFile);
+    ret = 1;
+
+ cleanup:
+    if (map != MAP_FAILED)
+        munmap(map, indexSb.st_size);
+    if (fd != -1)
+        close(fd);
+    free(indexFile);
+    return ret;
+}
+
+
 int
 findLeases(const char *file,
            const char *name,
@@ -382,6 +492,15 @@ findLeases(const char *file,
     ssize_t nreadTotal = 0;
     int rv;
 
+    if ((rv = findLeasesIndex(file, name, macs, nmacs, af, now,
+                              addrs, naddrs, found)) < 0)
+        goto cleanup;
+
+    if (rv > 0) {
+        ret = 0;
+        goto cleanup;
+    }
+
     if ((fd = open(file, O_RDONLY)) < 0) {
         ERROR("Cannot open %s", file);
         goto cleanup;
@@ -22,12 +22,14 @@
 #include "virsh-domain-monitor.h"
 #include "virsh-util.h"
 
+#include <unistd.h>
 #include <libxml/parser.h>
 #include <libxml/xpath.h>
 
 #include "internal.h"
 #include "conf/virdomainobjlist.h"
 #include "viralloc.h"
+#include "virjson.h"
 #include "virmacaddr.h"
 #include "virxml.h"
 #include "virstring.h"
@@ -2127,6 +2129,26 @@ static const vshCmdOptDef opts_domstats[] = {
      .type = VSH_OT_BOOL,
      .help = N_("report domain memory usage"),
     },
+    {.name = "dirtyrate",
+     .type = VSH_OT_BOOL,
+     .help = N_("report domain dirty rate information"),
+    },
+    {.name = "pressure",
+     .type = VSH_OT_BOOL,
+     .help = N_("report domain pressure stall information"),
+    },
+    {.name = "numa",
+     .type = VSH_OT_BOOL,
+     .help = N_("report domain memory residency on host NUMA nodes"),
+    },
+    {.name = "memory-host",
+     .type = VSH_OT_BOOL,
+     .help = N_("report host backing of domain memory"),
+    },
+    {.name = "monitor",
+     .type = VSH_OT_BOOL,
+     .help = N_("report latency of hypervisor monitor commands"),
+    },
     {.name = "list-active",
      .type = VSH_OT_BOOL,
      .help = N_("list only active domains"),
@@ -2175,17 +2197,134 @@ static const vshCmdOptDef opts_domstats[] = {
      .type = VSH_OT_BOOL,
      .help = N_("report only stats that are accessible instantly"),
     },
+    {.name = "cached",
+     .type = VSH_OT_BOOL,
+     .help = N_("allow stats cached by the daemon"),
+    },
+    {.name = "interval",
+     .type = VSH_OT_INT,
+     .help = N_("repeat every given number of seconds, reporting rates of counters"),
+    },
+    {.name = "count",
+     .type = VSH_OT_INT,
+     .help = N_("number of times to report statistics with --interval"),
+    },
+    {.name = "json",
+     .type = VSH_OT_BOOL,
+     .help = N_("print statistics of each domain as one line of JSON"),
+    },
     VIRSH_COMMON_OPT_DOMAIN_OT_ARGV(N_("list of domains to get stats for"), 0),
     {.name = NULL}
 };
 
 
+/* Suffixes of cumulative counters whose rate is reported with --interval */
+static const char *virshDomainStatsCounters[] = {
+    ".rd.reqs", ".rd.bytes", ".wr.reqs", ".wr.bytes", ".fl.reqs",
+    ".rx.bytes", ".rx.pkts", ".rx.errs", ".rx.drop",
+    ".tx.bytes", ".tx.pkts", ".tx.errs", ".tx.drop",
+    NULL
+};
+
+
+static bool
+virshDomainStatsIsCounter(const char *field)
+{
+    size_t i;
+
+    if (STREQ(field, "cpu.time") ||
+        STREQ(field, "cpu.user") ||
+        STREQ(field, "cpu.system"))
+        return true;
+
+    for (i = 0; virshDomainStatsCounters[i]; i++) {
+        if (virStringHasSuffix(field, virshDomainStatsCounters[i]))
+            return true;
+    }
+
+    return false;
+}
+
+
+static virDomainStatsRecordPtr
+virshDomainStatsFindRecord(virDomainStatsRecordPtr *records,
+                           virDomainPtr dom)
+{
+    unsigned char uuid[VIR_UUID_BUFLEN];
+    unsigned char other[VIR_UUID_BUFLEN];
+
+    if (!records || virDomainGetUUID(dom, uuid) < 0)
+        return NULL;
+
+    for (; *records; records++) {
+        if (virDomainGetUUID((*records)->dom, other) == 0 &&
+            memcmp(uuid, other, VIR_UUID_BUFLEN) == 0)
+            return *records;
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Computes the per second rate of @param from its value in the @prev
+ * record taken @elapsed microseconds ago. Returns false if @param is not
+ * a counter or there is nothing to compare to.
+ */
+static bool
+virshDomainStatsGetRate(virTypedParameterPtr param,
+                        virDomainStatsRecordPtr prev,
+                        long long elapsed,
+                        unsigned long long *rate)
+{
+    virTypedParameterPtr old;
+    unsigned long long cur;
+    unsigned long long was;
+
+    if (!prev || elapsed <= 0 || !virshDomainStatsIsCounter(param->field))
+        return false;
+
+    if (!(old = virTypedParamsGet(prev->params, prev->nparams, param->field)) ||
+        old->type != param->type)
+        return false;
+
+    switch ((virTypedParameterType) param->type) {
+    case VIR_TYPED_PARAM_UINT:
+        cur = param->value.ui;
+        was = old->value.ui;
+        break;
+    case VIR_TYPED_PARAM_ULLONG:
+        cur = param->value.ul;
+        was = old->value.ul;
+        break;
+    case VIR_TYPED_PARAM_INT:
+    case VIR_TYPED_PARAM_LLONG:
+    case VIR_TYPED_PARAM_DOUBLE:
+    case VIR_TYPED_PARAM_BOOLEAN:
+    case VIR_TYPED_PARAM_STRING:
+    case VIR_TYPED_PARAM_LAST:
+    default:
+        return false;
+    }
+
+    /* the counter was reset, e.g. the domain was restarted */
+    if (cur < was)
+        return false;
+
+    *rate = (double) (cur - was) * G_USEC_PER_SEC / elapsed;
+    return true;
+}
+
+
 static bool
 virshDomainStatsPrintRecord(vshControl *ctl G_GNUC_UNUSED,
                             virDomainStatsRecordPtr record,
+                            virDomainStatsRecordPtr prev,
+                            long long elapsed,
                             bool raw G_GNUC_UNUSED)
 {
     char *param;
+    unsigned long long rate;
     size_t i;
 
     vshPrint(ctl, "Domain: '%s'\n", virDomainGetName(record->dom));
@@ -2198,12 +2337,99 @@ virshDomainStatsPrintRecord(vshControl *ctl G_GNUC_UNUSED,
 
         vshPrint(ctl, "  %s=%s\n", record->params[i].field, param);
 
+        if (virshDomainStatsGetRate(record->params + i, prev, elapsed, &rate))
+            vshPrint(ctl, "  %s.rate=%llu\n", record->params[i].field, rate);
+
         VIR_FREE(param);
     }
 
     return true;
 }
 
+
+static int
+virshDomainStatsParamToJSON(virJSONValuePtr obj,
+                            virTypedParameterPtr param)
+{
+    switch ((virTypedParameterType) param->type) {
+    case VIR_TYPED_PARAM_INT:
+        return virJSONValueObjectAppendNumberInt(obj, param->field,
+                                                 param->value.i);
+    case VIR_TYPED_PARAM_UINT:
+        return virJSONValueObjectAppendNumberUint(obj, param->field,
+                                                  param->value.ui);
+    case VIR_TYPED_PARAM_LLONG:
+        return virJSONValueObjectAppendNumberLong(obj, param->field,
+                                                  param->value.l);
+    case VIR_TYPED_PARAM_ULLONG:
+        return virJSONValueObjectAppendNumberUlong(obj, param->field,
+                                                   param->value.ul);
+    case VIR_TYPED_PARAM_DOUBLE:
+        return virJSONValueObjectAppendNumberDouble(obj, param->field,
+                                                    param->value.d);
+    case VIR_TYPED_PARAM_BOOLEAN:
+        return virJSONValueObjectAppendBoolean(obj, param->field,
+                                               param->value.b);
+    case VIR_TYPED_PARAM_STRING:
+        return virJSONValueObjectAppendString(obj, param->field,
+                                              param->value.s);
+    case VIR_TYPED_PARAM_LAST:
+    default:
+        break;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Prints @record as a single line JSON object:
+ *
+ *   {"domain":"name","timestamp":1600000000000,"stats":{"state.state":1,...}}
+ *
+ * The timestamp is in milliseconds since the epoch.
+ */
+static bool
+virshDomainStatsPrintRecordJSON(vshControl *ctl,
+                                virDomainStatsRecordPtr record,
+                                virDomainStatsRecordPtr prev,
+                                long long elapsed,
+                                long long timestamp)
+{
+    g_autoptr(virJSONValue) obj = virJSONValueNewObject();
+    g_autoptr(virJSONValue) stats = virJSONValueNewObject();
+    g_autofree char *str = NULL;
+    unsigned long long rate;
+    size_t i;
+
+    for (i = 0; i < record->nparams; i++) {
+        virTypedParameterPtr param = record->params + i;
+
+        if (virshDomainStatsParamToJSON(stats, param) < 0)
+            return false;
+
+        if (virshDomainStatsGetRate(param, prev, elapsed, &rate)) {
+            g_autofree char *field = g_strdup_printf("%s.rate", param->field);
+
+            if (virJSONValueObjectAppendNumberUlong(stats, field, rate) < 0)
+                return false;
+        }
+    }
+
+    if (virJSONValueObjectAppendString(obj, "domain",
+                                       virDomainGetName(record->dom)) < 0 ||
+        virJSONValueObjectAppendNumberLong(obj, "timestamp", timestamp) < 0 ||
+        virJSONValueObjectAppend(obj, "stats", stats) < 0)
+        return false;
+    stats = NULL;
+
+    if (!(str = virJSONValueToString(obj, false)))
+        return false;
+
+    vshPrint(ctl, "%s\n", str);
+    return true;
+}
+
 static bool
 cmdDomstats(vshControl *ctl, const vshCmd *cmd)
 {
@@ -2212,13 +2438,40 @@ cmdDomstats(vshControl *ctl, const vshCmd *cmd)
     virDomainPtr dom;
     size_t ndoms = 0;
     virDomainStatsRecordPtr *records = NULL;
+    virDomainStatsRecordPtr *prev = NULL;
     virDomainStatsRecordPtr *next;
     bool raw = vshCommandOptBool(cmd, "raw");
+    bool json = vshCommandOptBool(cmd, "json");
     int flags = 0;
+    int interval = 0;
+    int count = 0;
+    int rv;
+    long long now;
+    long long then = 0;
     const vshCmdOpt *opt = NULL;
+    bool watch = false;
     bool ret = false;
     virshControlPtr priv = ctl->privData;
 
+    VSH_REQUIRE_OPTION("count", "interval");
+
+    if ((rv = vshCommandOptInt(ctl, cmd, "interval", &interval)) < 0)
+        return false;
+    if (rv > 0) {
+        if (interval <= 0) {
+            vshError(ctl, "%s", _("interval must be positive"));
+            return false;
+        }
+        watch = true;
+    }
+
+    if (vshCommandOptInt(ctl, cmd, "count", &count) < 0)
+        return false;
+    if (count < 0) {
+        vshError(ctl, "%s", _("count must not be negative"));
+        return false;
+    }
+
     if (vshCommandOptBool(cmd, "state"))
         stats |= VIR_DOMAIN_STATS_STATE;
 
@@ -2246,6 +2499,21 @@ cmdDomstats(vshControl *ctl, const vshCmd *cmd)
     if (vshCommandOptBool(cmd, "memory"))
         stats |= VIR_DOMAIN_STATS_MEMORY;
 
+    if (vshCommandOptBool(cmd, "dirtyrate"))
+        stats |= VIR_DOMAIN_STATS_DIRTYRATE;
+
+    if (vshCommandOptBool(cmd, "pressure"))
+        stats |= VIR_DOMAIN_STATS_PRESSURE;
+
+    if (vshCommandOptBool(cmd, "numa"))
+        stats |= VIR_DOMAIN_STATS_NUMA;
+
+    if (vshCommandOptBool(cmd, "memory-host"))
+        stats |= VIR_DOMAIN_STATS_MEMORY_HOST;
+
+    if (vshCommandOptBool(cmd, "monitor"))
+        stats |= VIR_DOMAIN_STATS_MONITOR;
+
     if (vshCommandOptBool(cmd, "list-active"))
         flags |= VIR_CONNECT_GET_ALL_DOMAINS_STATS_ACTIVE;
 
@@ -2279,6 +2547,9 @@ cmdDomstats(vshControl *ctl, const vshCmd *cmd)
     if (vshCommandOptBool(cmd, "nowait"))
         flags |= VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT;
 
+    if (vshCommandOptBool(cmd, "cached"))
+        flags |= VIR_CONNECT_GET_ALL_DOMAINS_STATS_CACHED;
+
     if (vshCommandOptBool(cmd, "domain")) {
         if (VIR_ALLOC_N(domlist, 1) < 0)
             goto cleanup;
@@ -2293,31 +2564,69 @@ cmdDomstats(vshControl *ctl, const vshCmd *cmd)
             if (VIR_INSERT_ELEMENT(domlist, ndoms - 1, ndoms, dom) < 0)
                 goto cleanup;
         }
-
-        if (virDomainListGetStats(domlist,
-                                  stats,
-                                  &records,
-                                  flags) < 0)
-            goto cleanup;
-    } else {
-       if ((virConnectGetAllDomainStats(priv->conn,
-                                        stats,
-                                        &records,
-                                        flags)) < 0)
-           goto cleanup;
     }
 
-    next = records;
-    while (*next) {
-        if (!virshDomainStatsPrintRecord(ctl, *next, raw))
-            goto cleanup;
+    /* In watch mode the same connection is reused for all samples and
+     * rates of counters are computed from consecutive samples. */
+    if (watch && vshEventStart(ctl, interval * 1000) < 0)
+        goto cleanup;
 
-        if (*(++next))
+    while (true) {
+        if (domlist) {
+            if (virDomainListGetStats(domlist,
+                                      stats,
+                                      &records,
+                                      flags) < 0)
+                goto cleanup;
+        } else {
+           if ((virConnectGetAllDomainStats(priv->conn,
+                                            stats,
+                                            &records,
+                                            flags)) < 0)
+               goto cleanup;
+        }
+
+        now = g_get_monotonic_time();
+
+        next = records;
+        while (*next) {
+            virDomainStatsRecordPtr old = virshDomainStatsFindRecord(prev, (*next)->dom);
+
+            if (json) {
+                if (!virshDomainStatsPrintRecordJSON(ctl, *next, old, now - then,
+                                                     g_get_real_time() / 1000))
+                    goto cleanup;
+                next++;
+                continue;
+            }
+
+            if (!virshDomainStatsPrintRecord(ctl, *next, old, now - then, raw))
+                goto cleanup;
+
+            if (*(++next))
+                vshPrint(ctl, "\n");
+        }
+
+        if (!watch || (count > 0 && --count == 0))
+            break;
+
+        if (!json)
             vshPrint(ctl, "\n");
+        fflush(stdout);
+
+        virDomainStatsRecordListFree(prev);
+        prev = g_steal_pointer(&records);
+        then = now;
+
+        if (vshEventWait(ctl) != VSH_EVENT_TIMEOUT)
+            break;
     }
 
     ret = true;
  cleanup:
+    if (watch)
+        vshEventCleanup(ctl);
+    virDomainStatsRecordListFree(prev);
     virDomainStatsRecordListFree(records);
     virObjectListFree(domlist);
 
@@ -2457,6 +2766,388 @@ cmdDomIfAddr(vshControl *ctl, const vshCmd *cmd)
     return ret;
 }
 
+/*
+ * "top" command
+ */
+static const vshCmdInfo info_top[] = {
+    {.name = "help",
+     .data = N_("display a live view of resource usage of running domains")
+    },
+    {.name = "desc",
+     .data = N_("Periodically displays CPU, memory, disk and network usage "
+                "of running domains, sorted by one of them.")
+    },
+    {.name = NULL}
+};
+
+static const vshCmdOptDef opts_top[] = {
+    {.name = "interval",
+     .type = VSH_OT_INT,
+     .help = N_("number of seconds between updates, 2 by default"),
+    },
+    {.name = "count",
+     .type = VSH_OT_INT,
+     .help = N_("number of updates to display before exiting"),
+    },
+    {.name = "sort",
+     .type = VSH_OT_STRING,
+     .help = N_("column to sort by: cpu (default), steal, memory, read, "
+                "write, rx, tx, name or id"),
+    },
+    {.name = NULL}
+};
+
+
+typedef enum {
+    VIRSH_TOP_COUNTER_CPU,
+    VIRSH_TOP_COUNTER_STEAL,
+    VIRSH_TOP_COUNTER_READ,
+    VIRSH_TOP_COUNTER_WRITE,
+    VIRSH_TOP_COUNTER_RX,
+    VIRSH_TOP_COUNTER_TX,
+
+    VIRSH_TOP_COUNTER_LAST
+} virshTopCounter;
+
+/* columns to sort by, those with rates share values with the counters */
+typedef enum {
+    VIRSH_TOP_SORT_CPU = VIRSH_TOP_COUNTER_CPU,
+    VIRSH_TOP_SORT_STEAL = VIRSH_TOP_COUNTER_STEAL,
+    VIRSH_TOP_SORT_READ = VIRSH_TOP_COUNTER_READ,
+    VIRSH_TOP_SORT_WRITE = VIRSH_TOP_COUNTER_WRITE,
+    VIRSH_TOP_SORT_RX = VIRSH_TOP_COUNTER_RX,
+    VIRSH_TOP_SORT_TX = VIRSH_TOP_COUNTER_TX,
+    VIRSH_TOP_SORT_MEMORY = VIRSH_TOP_COUNTER_LAST,
+    VIRSH_TOP_SORT_NAME,
+    VIRSH_TOP_SORT_ID,
+
+    VIRSH_TOP_SORT_LAST
+} virshTopSortType;
+
+VIR_ENUM_DECL(virshTopSort);
+VIR_ENUM_IMPL(virshTopSort,
+              VIRSH_TOP_SORT_LAST,
+              "cpu",
+              "steal",
+              "read",
+              "write",
+              "rx",
+              "tx",
+              "memory",
+              "name",
+              "id");
+
+typedef struct _virshTopDomain virshTopDomain;
+struct _virshTopDomain {
+    unsigned char uuid[VIR_UUID_BUFLEN];
+    char *name;
+    int id;
+    unsigned long long memory; /* KiB */
+
+    /* cumulative counters as reported by the daemon, cpu time and vcpu
+     * wait time are in nanoseconds, disk and network traffic in bytes */
+    unsigned long long counters[VIRSH_TOP_COUNTER_LAST];
+
+    /* increase of the counters per second since the previous update */
+    double rates[VIRSH_TOP_COUNTER_LAST];
+};
+
+
+static void
+virshTopDomainListFree(virshTopDomain *doms,
+                       size_t ndoms)
+{
+    size_t i;
+
+    for (i = 0; i < ndoms; i++)
+        g_free(doms[i].name);
+    g_free(doms);
+}
+
+
+static void
+virshTopDomainParse(virshTopDomain *dom,
+                    virDomainStatsRecordPtr record)
+{
+    size_t i;
+
+    ignore_value(virDomainGetUUID(record->dom, dom->uuid));
+    dom->name = g_strdup(virDomainGetName(record->dom));
+    dom->id = virDomainGetID(record->dom);
+
+    for (i = 0; i < record->nparams; i++) {
+        virTypedParameterPtr param = record->params + i;
+        const char *field = param->field;
+        int counter = -1;
+
+        if (param->type != VIR_TYPED_PARAM_ULLONG)
+            continue;
+
+        if (STREQ(field, "balloon.current")) {
+            dom->memory = param->value.ul;
+        } else if (STREQ(field, "cpu.time")) {
+            counter = VIRSH_TOP_COUNTER_CPU;
+        } else if (STRPREFIX(field, "vcpu.")) {
+            if (virStringHasSuffix(field, ".wait"))
+                counter = VIRSH_TOP_COUNTER_STEAL;
+        } else if (STRPREFIX(field, "block.")) {
+            if (virStringHasSuffix(field, ".rd.bytes"))
+                counter = VIRSH_TOP_COUNTER_READ;
+            else if (virStringHasSuffix(field, ".wr.bytes"))
+                counter = VIRSH_TOP_COUNTER_WRITE;
+        } else if (STRPREFIX(field, "net.")) {
+            if (virStringHasSuffix(field, ".rx.bytes"))
+                counter = VIRSH_TOP_COUNTER_RX;
+            else if (virStringHasSuffix(field, ".tx.bytes"))
+                counter = VIRSH_TOP_COUNTER_TX;
+        }
+
+        if (counter >= 0)
+            dom->counters[counter] += param->value.ul;
+    }
+}
+
+
+/*
+ * Gathers statistics of all running domains with a single call.
+ */
+static int
+virshTopSample(vshControl *ctl,
+               virshTopDomain **doms,
+               size_t *ndoms)
+{
+    virshControlPtr priv = ctl->privData;
+    virDomainStatsRecordPtr *records = NULL;
+    unsigned int stats = VIR_DOMAIN_STATS_CPU_TOTAL |
+                         VIR_DOMAIN_STATS_VCPU |
+                         VIR_DOMAIN_STATS_BALLOON |
+                         VIR_DOMAIN_STATS_BLOCK |
+                         VIR_DOMAIN_STATS_INTERFACE;
+    int nrecords;
+    size_t i;
+
+    if ((nrecords = virConnectGetAllDomainStats(priv->conn, stats, &records,
+                                                VIR_CONNECT_GET_ALL_DOMAINS_STATS_ACTIVE)) < 0)
+        return -1;
+
+    *doms = g_new0(virshTopDomain, nrecords);
+    *ndoms = nrecords;
+
+    for (i = 0; i < *ndoms; i++)
+        virshTopDomainParse(*doms + i, records[i]);
+
+    virDomainStatsRecordListFree(records);
+    return 0;
+}
+
+
+static void
+virshTopComputeRates(virshTopDomain *doms,
+                     size_t ndoms,
+                     virshTopDomain *prev,
+                     size_t nprev,
+                     long long elapsed)
+{
+    size_t i, j, k;
+
+    for (i = 0; i < ndoms; i++) {
+        virshTopDomain *old = NULL;
+
+        for (j = 0; j < nprev && !old; j++) {
+            if (memcmp(doms[i].uuid, prev[j].uuid, VIR_UUID_BUFLEN) == 0 &&
+                doms[i].id == prev[j].id)
+                old = prev + j;
+        }
+
+        /* a domain started since the previous update has no rates yet */
+        if (!old || elapsed <= 0)
+            continue;
+
+        for (k = 0; k < VIRSH_TOP_COUNTER_LAST; k++) {
+            if (doms[i].counters[k] < old->counters[k])
+                continue;
+
+            doms[i].rates[k] = (double) (doms[i].counters[k] - old->counters[k]) *
+                               G_USEC_PER_SEC / elapsed;
+        }
+    }
+}
+
+
+static int
+virshTopCompare(const void *a,
+                const void *b,
+                void *opaque)
+{
+    const virshTopDomain *da = a;
+    const virshTopDomain *db = b;
+    int sort = *(int *) opaque;
+
+    switch ((virshTopSortType) sort) {
+    case VIRSH_TOP_SORT_CPU:
+    case VIRSH_TOP_SORT_STEAL:
+    case VIRSH_TOP_SORT_READ:
+    case VIRSH_TOP_SORT_WRITE:
+    case VIRSH_TOP_SORT_RX:
+    case VIRSH_TOP_SORT_TX:
+        if (da->rates[sort] != db->rates[sort])
+            return da->rates[sort] < db->rates[sort] ? 1 : -1;
+        break;
+    case VIRSH_TOP_SORT_MEMORY:
+        if (da->memory != db->memory)
+            return da->memory < db->memory ? 1 : -1;
+        break;
+    case VIRSH_TOP_SORT_ID:
+        if (da->id != db->id)
+            return da->id < db->id ? -1 : 1;
+        break;
+    case VIRSH_TOP_SORT_NAME:
+    case VIRSH_TOP_SORT_LAST:
+        break;
+    }
+
+    return strcmp(da->name, db->name);
+}
+
+
+static char *
+virshTopFormatBytes(double bytes)
+{
+    const char *unit;
+    double val = vshPrettyCapacity(bytes, &unit);
+
+    return g_strdup_printf("%.1lf %s", val, unit);
+}
+
+
+static int
+virshTopPrint(vshControl *ctl,
+              virshTopDomain *doms,
+              size_t ndoms,
+              int interval)
+{
+    vshTablePtr table = NULL;
+    size_t i;
+    int ret = -1;
+
+    table = vshTableNew(_("Id"), _("Name"), _("CPU%"), _("Steal%"),
+                        _("Memory"), _("Read/s"), _("Write/s"),
+                        _("RX/s"), _("TX/s"), NULL);
+    if (!table)
+        goto cleanup;
+
+    for (i = 0; i < ndoms; i++) {
+        virshTopDomain *dom = doms + i;
+        g_autofree char *id = g_strdup_printf("%d", dom->id);
+        /* time in nanoseconds per second makes percents when divided by
+         * 10^7, CPU% may exceed 100 for domains with more vCPUs */
+        g_autofree char *cpu = g_strdup_printf("%.1lf", dom->rates[VIRSH_TOP_COUNTER_CPU] / 1e7);
+        g_autofree char *steal = g_strdup_printf("%.1lf", dom->rates[VIRSH_TOP_COUNTER_STEAL] / 1e7);
+        g_autofree char *memory = virshTopFormatBytes(dom->memory * 1024.0);
+        g_autofree char *rd = virshTopFormatBytes(dom->rates[VIRSH_TOP_COUNTER_READ]);
+        g_autofree char *wr = virshTopFormatBytes(dom->rates[VIRSH_TOP_COUNTER_WRITE]);
+        g_autofree char *rx = virshTopFormatBytes(dom->rates[VIRSH_TOP_COUNTER_RX]);
+        g_autofree char *tx = virshTopFormatBytes(dom->rates[VIRSH_TOP_COUNTER_TX]);
+
+        if (vshTableRowAppend(table, id, dom->name, cpu, steal, memory,
+                              rd, wr, rx, tx, NULL) < 0)
+            goto cleanup;
+    }
+
+    /* redraw the screen rather than scrolling when run interactively */
+    if (isatty(STDOUT_FILENO))
+        vshPrint(ctl, "\033[H\033[2J");
+
+    vshPrint(ctl, _("%zu running domains, updated every %d seconds\n\n"),
+             ndoms, interval);
+    vshTablePrintToStdout(table, ctl);
+    fflush(stdout);
+
+    ret = 0;
+
+ cleanup:
+    vshTableFree(table);
+    return ret;
+}
+
+
+static bool
+cmdTop(vshControl *ctl, const vshCmd *cmd)
+{
+    virshTopDomain *doms = NULL;
+    size_t ndoms = 0;
+    virshTopDomain *prev = NULL;
+    size_t nprev = 0;
+    const char *sortStr = NULL;
+    int sort = VIRSH_TOP_SORT_CPU;
+    int interval = 2;
+    int count = 0;
+    long long then;
+    long long now;
+    int rv;
+    bool ret = false;
+
+    if (vshCommandOptInt(ctl, cmd, "interval", &interval) < 0 ||
+        vshCommandOptInt(ctl, cmd, "count", &count) < 0 ||
+        vshCommandOptStringReq(ctl, cmd, "sort", &sortStr) < 0)
+        return false;
+
+    if (interval <= 0) {
+        vshError(ctl, "%s", _("interval must be positive"));
+        return false;
+    }
+
+    if (count < 0) {
+        vshError(ctl, "%s", _("count must not be negative"));
+        return false;
+    }
+
+    if (sortStr && (sort = virshTopSortTypeFromString(sortStr)) < 0) {
+        vshError(ctl, _("unknown column to sort by '%s'"), sortStr);
+        return false;
+    }
+
+    if (vshEventStart(ctl, interval * 1000) < 0)
+        return false;
+
+    /* rates need two samples, the first one is taken right away */
+    if (virshTopSample(ctl, &prev, &nprev) < 0)
+        goto cleanup;
+    then = g_get_monotonic_time();
+
+    while ((rv = vshEventWait(ctl)) == VSH_EVENT_TIMEOUT) {
+        if (virshTopSample(ctl, &doms, &ndoms) < 0)
+            goto cleanup;
+        now = g_get_monotonic_time();
+
+        virshTopComputeRates(doms, ndoms, prev, nprev, now - then);
+        g_qsort_with_data(doms, ndoms, sizeof(*doms), virshTopCompare, &sort);
+
+        if (virshTopPrint(ctl, doms, ndoms, interval) < 0)
+            goto cleanup;
+
+        virshTopDomainListFree(prev, nprev);
+        prev = g_steal_pointer(&doms);
+        nprev = ndoms;
+        ndoms = 0;
+        then = now;
+
+        if (count > 0 && --count == 0)
+            break;
+    }
+
+    if (rv < 0)
+        goto cleanup;
+
+    ret = true;
+
+ cleanup:
+    vshEventCleanup(ctl);
+    virshTopDomainListFree(doms, ndoms);
+    virshTopDomainListFree(prev, nprev);
+    return ret;
+}
+
 const vshCmdDef domMonitoringCmds[] = {
     {.name = "domblkerror",
      .handler = cmdDomBlkError,
@@ -2548,5 +3239,11 @@ const vshCmdDef domMonitoringCmds[] = {
      .info = info_list,
      .flags = 0
     },
+    {.name = "top",
+     .handler = cmdTop,
+     .opts = opts_top,
+     .info = info_top,
+     .flags = 0
+    },
     {.name = NULL}
 };
@@ -204,6 +204,90 @@ cmdAttachDevice(vshControl *ctl, const vshCmd *cmd)
     return ret;
 }
 
+/*
+ * "attach-devices" command
+ */
+static const vshCmdInfo info_attach_devices[] = {
+    {.name = "help",
+     .data = N_("attach devices from XML files")
+    },
+    {.name = "desc",
+     .data = N_("Attach devices from XML <file>s at once.")
+    },
+    {.name = NULL}
+};
+
+static const vshCmdOptDef opts_attach_devices[] = {
+    VIRSH_COMMON_OPT_DOMAIN_FULL(0),
+    VIRSH_COMMON_OPT_DOMAIN_PERSISTENT,
+    VIRSH_COMMON_OPT_DOMAIN_CONFIG,
+    VIRSH_COMMON_OPT_DOMAIN_LIVE,
+    VIRSH_COMMON_OPT_DOMAIN_CURRENT,
+    {.name = "file",
+     .type = VSH_OT_ARGV,
+     .flags = VSH_OFLAG_REQ,
+     .help = N_("XML files")
+    },
+    {.name = NULL}
+};
+
+static bool
+cmdAttachDevices(vshControl *ctl, const vshCmd *cmd)
+{
+    virDomainPtr dom;
+    const vshCmdOpt *opt = NULL;
+    VIR_AUTOSTRINGLIST xmls = NULL;
+    size_t nxmls = 0;
+    bool ret = false;
+    unsigned int flags = VIR_DOMAIN_AFFECT_CURRENT;
+    bool current = vshCommandOptBool(cmd, "current");
+    bool config = vshCommandOptBool(cmd, "config");
+    bool live = vshCommandOptBool(cmd, "live");
+    bool persistent = vshCommandOptBool(cmd, "persistent");
+
+    VSH_EXCLUSIVE_OPTIONS_VAR(persistent, current);
+
+    VSH_EXCLUSIVE_OPTIONS_VAR(current, live);
+    VSH_EXCLUSIVE_OPTIONS_VAR(current, config);
+
+    if (config || persistent)
+        flags |= VIR_DOMAIN_AFFECT_CONFIG;
+    if (live)
+        flags |= VIR_DOMAIN_AFFECT_LIVE;
+
+    if (!(dom = virshCommandOptDomain(ctl, cmd, NULL)))
+        return false;
+
+    if (persistent &&
+        virDomainIsActive(dom) == 1)
+        flags |= VIR_DOMAIN_AFFECT_LIVE;
+
+    while ((opt = vshCommandOptArgv(ctl, cmd, opt))) {
+        char *buffer = NULL;
+
+        if (virFileReadAll(opt->data, VSH_MAX_XML_FILE, &buffer) < 0) {
+            vshReportError(ctl);
+            goto cleanup;
+        }
+
+        xmls = g_renew(char *, xmls, nxmls + 2);
+        xmls[nxmls++] = buffer;
+        xmls[nxmls] = NULL;
+    }
+
+    if (virDomainAttachDevices(dom, (const char **)xmls, nxmls, flags) < 0) {
+        vshError(ctl, "%s", _("Failed to attach devices"));
+        goto cleanup;
+    }
+
+    vshPrintExtra(ctl, "%s", _("Devices attached successfully\n"));
+    ret = true;
+
+ cleanup:
+    virshDomainFree(dom);
+    return ret;
+}
+
 /*
  * "attach-disk" command
  */
@@ -2538,6 +2622,11 @@ static const vshCmdOptDef opts_blockjob[] = {
      .type = VSH_OT_INT,
      .help = N_("set the bandwidth limit in MiB/s")
     },
+    {.name = "adaptive",
+     .type = VSH_OT_BOOL,
+     .help = N_("implies bandwidth; adapt the speed to guest I/O latency "
+                "up to the bandwidth limit")
+    },
     {.name = NULL}
 };
 
@@ -2645,13 +2734,16 @@ virshBlockJobSetSpeed(vshControl *ctl,
                       const vshCmd *cmd,
                       virDomainPtr dom,
                       const char *path,
-                      bool bytes)
+                      bool bytes,
+                      bool adaptive)
 {
     unsigned long bandwidth;
     unsigned int flags = 0;
 
     if (bytes)
         flags |= VIR_DOMAIN_BLOCK_JOB_SPEED_BANDWIDTH_BYTES;
+    if (adaptive)
+        flags |= VIR_DOMAIN_BLOCK_JOB_SPEED_ADAPTIVE;
 
     if (vshBlockJobOptionBandwidth(ctl, cmd, bytes, &bandwidth) < 0)
         return false;
@@ -2693,7 +2785,8 @@ cmdBlockjob(vshControl *ctl, const vshCmd *cmd)
     bool pivot = vshCommandOptBool(cmd, "pivot");
     bool async = vshCommandOptBool(cmd, "async");
     bool info = vshCommandOptBool(cmd, "info");
-    bool bandwidth = vshCommandOptBool(cmd, "bandwidth");
+    bool adaptive = vshCommandOptBool(cmd, "adaptive");
+    bool bandwidth = vshCommandOptBool(cmd, "bandwidth") || adaptive;
     virDomainPtr dom = NULL;
     const char *path;
 
@@ -2707,6 +2800,10 @@ cmdBlockjob(vshControl *ctl, const vshCmd *cmd)
     VSH_EXCLUSIVE_OPTIONS_VAR(info, async);
     VSH_EXCLUSIVE_OPTIONS_VAR(info, bandwidth);
 
+    VSH_EXCLUSIVE_OPTIONS_VAR(abortMode, adaptive);
+    VSH_EXCLUSIVE_OPTIONS_VAR(pivot, adaptive);
+    VSH_EXCLUSIVE_OPTIONS_VAR(async, adaptive);
+
     VSH_EXCLUSIVE_OPTIONS("bytes", "abort");
     VSH_EXCLUSIVE_OPTIONS_VAR(bytes, pivot);
     VSH_EXCLUSIVE_OPTIONS_VAR(bytes, async);
@@ -2719,7 +2816,7 @@ cmdBlockjob(vshControl *ctl, const vshCmd *cmd)
         goto cleanup;
 
     if (bandwidth)
-        ret = virshBlockJobSetSpeed(ctl, cmd, dom, path, bytes);
+        ret = virshBlockJobSetSpeed(ctl, cmd, dom, path, bytes, adaptive);
     else if (abortMode || pivot || async)
         ret = virshBlockJobAbort(dom, path, pivot, async);
     else
@@ -6170,6 +6267,26 @@ virshDomainJobOperationToString(int op)
     return str ? _(str) : _("unknown");
 }
 
+static const struct {
+    const char *field;
+    const char *label;
+} virshDomainJobStartPhases[] = {
+    { VIR_DOMAIN_JOB_START_TIME_INIT, N_("Start init:") },
+    { VIR_DOMAIN_JOB_START_TIME_PREPARE, N_("Start prepare:") },
+    { VIR_DOMAIN_JOB_START_TIME_HOST, N_("Start host:") },
+    { VIR_DOMAIN_JOB_START_TIME_NETWORK, N_("Start network:") },
+    { VIR_DOMAIN_JOB_START_TIME_STORAGE, N_("Start storage:") },
+    { VIR_DOMAIN_JOB_START_TIME_EXT_DEVICES, N_("Start helpers:") },
+    { VIR_DOMAIN_JOB_START_TIME_CMDLINE, N_("Start cmdline:") },
+    { VIR_DOMAIN_JOB_START_TIME_EXEC, N_("Start exec:") },
+    { VIR_DOMAIN_JOB_START_TIME_CGROUP, N_("Start cgroup:") },
+    { VIR_DOMAIN_JOB_START_TIME_SECURITY, N_("Start security:") },
+    { VIR_DOMAIN_JOB_START_TIME_MONITOR, N_("Start monitor:") },
+    { VIR_DOMAIN_JOB_START_TIME_PREALLOC, N_("Start prealloc:") },
+    { VIR_DOMAIN_JOB_START_TIME_QMP_INIT, N_("Start QMP init:") },
+    { VIR_DOMAIN_JOB_START_TIME_FINISH, N_("Start finish:") },
+};
+
 
 static int
 virshDomainJobStatsToDomainJobInfo(virTypedParameterPtr params,
@@ -6223,6 +6340,7 @@ cmdDomjobinfo(vshControl *ctl, const vshCmd *cmd)
     int op;
     int rc;
     size_t i;
+    unsigned int count = 0;
     bool rawstats = vshCommandOptBool(cmd, "rawstats");
 
     VSH_REQUIRE_OPTION("keep-completed", "completed");
@@ -6364,6 +6482,101 @@ cmdDomjobinfo(vshControl *ctl, const vshCmd *cmd)
         } else if (rc) {
             vshPrint(ctl, "%-17s %-12llu\n", _("Postcopy requests:"), value);
         }
+
+        if ((rc = virTypedParamsGetInt(params, nparams,
+                                       VIR_DOMAIN_JOB_MEMORY_PARALLEL_CONNECTIONS,
+                                       &ivalue)) < 0) {
+            goto save_error;
+        } else if (rc) {
+            vshPrint(ctl, "%-17s %-12d\n", _("Connections:"), ivalue);
+        }
+
+        if ((rc = virTypedParamsGetULLong(params, nparams,
+                                          VIR_DOMAIN_JOB_MEMORY_PARALLEL_BYTES,
+                                          &value)) < 0) {
+            goto save_error;
+        } else if (rc) {
+            val = vshPrettyCapacity(value, &unit);
+            vshPrint(ctl, "%-17s %-.3lf %s\n", _("Parallel data:"), val, unit);
+        }
+    }
+
+    if ((rc = virTypedParamsGetULLong(params, nparams,
+                                      VIR_DOMAIN_JOB_TUNNEL_RAW,
+                                      &value)) < 0) {
+        goto save_error;
+    } else if (rc) {
+        val = vshPrettyCapacity(value, &unit);
+        vshPrint(ctl, "%-17s %-.3lf %s\n", _("Tunnel data:"), val, unit);
+    }
+
+    if ((rc = virTypedParamsGetULLong(params, nparams,
+                                      VIR_DOMAIN_JOB_TUNNEL_SENT,
+                                      &value)) < 0) {
+        goto save_error;
+    } else if (rc) {
+        val = vshPrettyCapacity(value, &unit);
+        vshPrint(ctl, "%-17s %-.3lf %s\n", _("Tunnel sent:"), val, unit);
+    }
+
+    if ((rc = virTypedParamsGetULLong(params, nparams,
+                                      VIR_DOMAIN_JOB_TUNNEL_BPS,
+                                      &value)) < 0) {
+        goto save_error;
+    } else if (rc) {
+        val = vshPrettyCapacity(value, &unit);
+        vshPrint(ctl, "%-17s %-.3lf %s/s\n", _("Tunnel bandwidth:"), val, unit);
+    }
+
+    if ((rc = virTypedParamsGetULLong(params, nparams,
+                                      VIR_DOMAIN_JOB_LOCK_ACQUIRES,
+                                      &value)) < 0) {
+        goto save_error;
+    } else if (rc) {
+        vshPrint(ctl, "%-17s %-12llu\n", _("Lock acquires:"), value);
+    }
+
+    if ((rc = virTypedParamsGetULLong(params, nparams,
+                                      VIR_DOMAIN_JOB_LOCK_ACQUIRE_FAILED,
+                                      &value)) < 0) {
+        goto save_error;
+    } else if (rc && value) {
+        vshPrint(ctl, "%-17s %-12llu\n", _("Lock failures:"), value);
+    }
+
+    if ((rc = virTypedParamsGetULLong(params, nparams,
+                                      VIR_DOMAIN_JOB_LOCK_ACQUIRE_BUSY,
+                                      &value)) < 0) {
+        goto save_error;
+    } else if (rc && value) {
+        vshPrint(ctl, "%-17s %-12llu\n", _("Lock contention:"), value);
+    }
+
+    if ((rc = virTypedParamsGetULLong(params, nparams,
+                                      VIR_DOMAIN_JOB_LOCK_ACQUIRE_TIME,
+                                      &value)) < 0) {
+        goto save_error;
+    } else if (rc) {
+        vshPrint(ctl, "%-17s %-12llu us\n", _("Lock acquire time:"), value);
+    }
+
+    if ((rc = virTypedParamsGetULLong(params, nparams,
+                                      VIR_DOMAIN_JOB_LOCK_RELEASE_TIME,
+                                      &value)) < 0) {
+        goto save_error;
+    } else if (rc) {
+        vshPrint(ctl, "%-17s %-12llu us\n", _("Lock release time:"), value);
+    }
+
+    for (i = 0; i < G_N_ELEMENTS(virshDomainJobStartPhases); i++) {
+        if ((rc = virTypedParamsGetULLong(params, nparams,
+                                          virshDomainJobStartPhases[i].field,
+                                          &value)) < 0) {
+            goto save_error;
+        } else if (rc) {
+            vshPrint(ctl, "%-17s %-12llu us\n",
+                     _(virshDomainJobStartPhases[i].label), value);
+        }
     }
 
     if (info.fileTotal || info.fileRemaining || info.fileProcessed) {
@@ -6383,6 +6596,46 @@ cmdDomjobinfo(vshControl *ctl, const vshCmd *cmd)
             vshPrint(ctl, "%-17s %-.3lf %s/s\n",
                      _("File bandwidth:"), val, unit);
         }
+
+        if ((rc = virTypedParamsGetUInt(params, nparams,
+                                        VIR_DOMAIN_JOB_MIRROR_COUNT,
+                                        &count)) < 0)
+            goto save_error;
+
+        for (i = 0; rc && i < count; i++) {
+            const char *name = NULL;
+            unsigned long long total = 0;
+            char field[VIR_TYPED_PARAM_FIELD_LENGTH];
+            const char *totalUnit;
+            double totalVal;
+
+            g_snprintf(field, sizeof(field), "%s%zu%s",
+                       VIR_DOMAIN_JOB_MIRROR_PREFIX, i,
+                       VIR_DOMAIN_JOB_MIRROR_SUFFIX_NAME);
+            if (virTypedParamsGetString(params, nparams, field, &name) < 0)
+                goto save_error;
+
+            g_snprintf(field, sizeof(field), "%s%zu%s",
+                       VIR_DOMAIN_JOB_MIRROR_PREFIX, i,
+                       VIR_DOMAIN_JOB_MIRROR_SUFFIX_PROCESSED);
+            value = 0;
+            if (virTypedParamsGetULLong(params, nparams, field, &value) < 0)
+                goto save_error;
+
+            g_snprintf(field, sizeof(field), "%s%zu%s",
+                       VIR_DOMAIN_JOB_MIRROR_PREFIX, i,
+                       VIR_DOMAIN_JOB_MIRROR_SUFFIX_TOTAL);
+            if (virTypedParamsGetULLong(params, nparams, field, &total) < 0)
+                goto save_error;
+
+            if (!name)
+                continue;
+
+            val = vshPrettyCapacity(value, &unit);
+            totalVal = vshPrettyCapacity(total, &totalUnit);
+            vshPrint(ctl, "%-17s %-.3lf %s / %-.3lf %s\n",
+                     name, val, unit, totalVal, totalUnit);
+        }
     }
 
     if ((rc = virTypedParamsGetULLong(params, nparams,
@@ -9162,6 +9415,10 @@ static const vshCmdOptDef opts_memtune[] = {
      .type = VSH_OT_INT,
      .help = N_("Min guaranteed memory, as scaled integer (default KiB)")
     },
+    {.name = "share-pages",
+     .type = VSH_OT_STRING,
+     .help = N_("allow merging of identical memory pages (on/off)")
+    },
     VIRSH_COMMON_OPT_DOMAIN_CONFIG,
     VIRSH_COMMON_OPT_DOMAIN_LIVE,
     VIRSH_COMMON_OPT_DOMAIN_CURRENT,
@@ -9214,6 +9471,7 @@ cmdMemtune(vshControl *ctl, const vshCmd *cmd)
 {
     virDomainPtr dom;
     long long tmpVal;
+    const char *sharePages = NULL;
     int nparams = 0;
     int maxparams = 0;
     int rc;
@@ -9255,6 +9513,21 @@ cmdMemtune(vshControl *ctl, const vshCmd *cmd)
 
 #undef PARSE_MEMTUNE_PARAM
 
+    if (vshCommandOptStringReq(ctl, cmd, "share-pages", &sharePages) < 0)
+        goto cleanup;
+
+    if (sharePages) {
+        if (STRNEQ(sharePages, "on") && STRNEQ(sharePages, "off")) {
+            vshError(ctl, _("Invalid value '%s' for --share-pages"), sharePages);
+            goto cleanup;
+        }
+
+        if (virTypedParamsAddBoolean(&params, &nparams, &maxparams,
+                                     VIR_DOMAIN_MEMORY_SHARE_PAGES,
+                                     STREQ(sharePages, "on")) < 0)
+            goto save_error;
+    }
+
     if (nparams == 0) {
         /* get the number of memory parameters */
         if (virDomainGetMemoryParameters(dom, NULL, &nparams, flags) != 0) {
@@ -10639,6 +10912,10 @@ static const vshCmdOptDef opts_migrate[] = {
      .type = VSH_OT_INT,
      .help = N_("port to use by target server for incoming disks migration")
     },
+    {.name = "disks-concurrency",
+     .type = VSH_OT_INT,
+     .help = N_("maximum number of disks copied at the same time")
+    },
     {.name = "comp-methods",
      .type = VSH_OT_STRING,
      .help = N_("comma separated list of compression methods to be used")
@@ -10695,6 +10972,19 @@ static const vshCmdOptDef opts_migrate[] = {
      .type = VSH_OT_STRING,
      .help = N_("override the destination host name used for TLS verification")
     },
+    {.name = "downtime-target",
+     .type = VSH_OT_INT,
+     .help = N_("downtime in milliseconds the migration should finish with")
+    },
+    {.name = "downtime-iterations",
+     .type = VSH_OT_INT,
+     .help = N_("iterations above downtime target before acting on it")
+    },
+    {.name = "prealloc-threads",
+     .type = VSH_OT_INT,
+     .help = N_("number of threads preallocating memory on destination, "
+                "0 to derive it from host NUMA nodes")
+    },
     {.name = NULL}
 };
 
@@ -10759,6 +11049,15 @@ doMigrate(void *opaque)
                              VIR_MIGRATE_PARAM_DISKS_PORT, disksPort) < 0)
         goto save_error;
 
+    if ((rv = vshCommandOptInt(ctl, cmd, "disks-concurrency", &intOpt)) < 0) {
+        goto out;
+    } else if (rv > 0) {
+        if (virTypedParamsAddInt(&params, &nparams, &maxparams,
+                                 VIR_MIGRATE_PARAM_DISKS_CONCURRENCY,
+                                 intOpt) < 0)
+            goto save_error;
+    }
+
     if (vshCommandOptStringReq(ctl, cmd, "dname", &opt) < 0)
         goto out;
     if (opt &&
@@ -10926,6 +11225,33 @@ doMigrate(void *opaque)
                                 VIR_MIGRATE_PARAM_TLS_DESTINATION, opt) < 0)
         goto save_error;
 
+    if ((rv = vshCommandOptULongLong(ctl, cmd, "downtime-target", &ullOpt)) < 0) {
+        goto out;
+    } else if (rv > 0) {
+        if (virTypedParamsAddULLong(&params, &nparams, &maxparams,
+                                    VIR_MIGRATE_PARAM_DOWNTIME_TARGET,
+                                    ullOpt) < 0)
+            goto save_error;
+    }
+
+    if ((rv = vshCommandOptInt(ctl, cmd, "downtime-iterations", &intOpt)) < 0) {
+        goto out;
+    } else if (rv > 0) {
+        if (virTypedParamsAddInt(&params, &nparams, &maxparams,
+                                 VIR_MIGRATE_PARAM_DOWNTIME_ITERATIONS,
+                                 intOpt) < 0)
+            goto save_error;
+    }
+
+    if ((rv = vshCommandOptInt(ctl, cmd, "prealloc-threads", &intOpt)) < 0) {
+        goto out;
+    } else if (rv > 0) {
+        if (virTypedParamsAddInt(&params, &nparams, &maxparams,
+                                 VIR_MIGRATE_PARAM_PREALLOC_THREADS,
+                                 intOpt) < 0)
+            goto save_error;
+    }
+
     if (vshCommandOptBool(cmd, "live"))
         flags |= VIR_MIGRATE_LIVE;
     if (vshCommandOptBool(cmd, "p2p"))
@@ -11080,6 +11406,7 @@ cmdMigrate(vshControl *ctl, const vshCmd *cmd)
     VSH_REQUIRE_OPTION("timeout-postcopy", "postcopy");
     VSH_REQUIRE_OPTION("persistent-xml", "persistent");
     VSH_REQUIRE_OPTION("tls-destination", "tls");
+    VSH_REQUIRE_OPTION("downtime-iterations", "downtime-target");
 
     if (!(dom = virshCommandOptDomain(ctl, cmd, NULL)))
         return false;
@@ -12042,6 +12369,10 @@ static const vshCmdOptDef opts_detach_device[] = {
     VIRSH_COMMON_OPT_DOMAIN_CONFIG,
     VIRSH_COMMON_OPT_DOMAIN_LIVE,
     VIRSH_COMMON_OPT_DOMAIN_CURRENT,
+    {.name = "async",
+     .type = VSH_OT_BOOL,
+     .help = N_("don't wait for the guest to release the device")
+    },
     {.name = NULL}
 };
 
@@ -12057,6 +12388,7 @@ cmdDetachDevice(vshControl *ctl, const vshCmd *cmd)
     bool config = vshCommandOptBool(cmd, "config");
     bool live = vshCommandOptBool(cmd, "live");
     bool persistent = vshCommandOptBool(cmd, "persistent");
+    bool async = vshCommandOptBool(cmd, "async");
     unsigned int flags = VIR_DOMAIN_AFFECT_CURRENT;
 
     VSH_EXCLUSIVE_OPTIONS_VAR(persistent, current);
@@ -12068,6 +12400,8 @@ cmdDetachDevice(vshControl *ctl, const vshCmd *cmd)
         flags |= VIR_DOMAIN_AFFECT_CONFIG;
     if (live)
         flags |= VIR_DOMAIN_AFFECT_LIVE;
+    if (async)
+        flags |= VIR_DOMAIN_DEVICE_MODIFY_ASYNC;
 
     if (!(dom = virshCommandOptDomain(ctl, cmd, NULL)))
         return false;
@@ -12094,7 +12428,10 @@ cmdDetachDevice(vshControl *ctl, const vshCmd *cmd)
         goto cleanup;
     }
 
-    vshPrintExtra(ctl, "%s", _("Device detached successfully\n"));
+    if (async)
+        vshPrintExtra(ctl, "%s", _("Device detach request sent successfully\n"));
+    else
+        vshPrintExtra(ctl, "%s", _("Device detached successfully\n"));
     funcRet = true;
 
  cleanup:
@@ -13565,6 +13902,22 @@ virshEventBlockThresholdPrint(virConnectPtr conn G_GNUC_UNUSED,
 }
 
 
+static void
+virshEventMonitorSlowPrint(virConnectPtr conn G_GNUC_UNUSED,
+                           virDomainPtr dom,
+                           const char *command,
+                           unsigned long long elapsed,
+                           void *opaque)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+
+    virBufferAsprintf(&buf, _("event 'monitor-slow' for domain %s: "
+                              "command %s waiting for %llu ms\n"),
+                      virDomainGetName(dom), command, elapsed);
+    virshEventPrint(opaque, &buf);
+}
+
+
 virshDomainEventCallback virshDomainEventCallbacks[] = {
     { "lifecycle",
       VIR_DOMAIN_EVENT_CALLBACK(virshEventLifecyclePrint), },
@@ -13614,6 +13967,8 @@ virshDomainEventCallback virshDomainEventCallbacks[] = {
       VIR_DOMAIN_EVENT_CALLBACK(virshEventMetadataChangePrint), },
     { "block-threshold",
       VIR_DOMAIN_EVENT_CALLBACK(virshEventBlockThresholdPrint), },
+    { "monitor-slow",
+      VIR_DOMAIN_EVENT_CALLBACK(virshEventMonitorSlowPrint), },
 };
 G_STATIC_ASSERT(VIR_DOMAIN_EVENT_ID_LAST == G_N_ELEMENTS(virshDomainEventCallbacks));
 
@@ -14306,6 +14661,57 @@ cmdGuestInfo(vshControl *ctl, const vshCmd *cmd)
     return ret;
 }
 
+/*
+ * "domdirtyrate-calc" command
+ */
+static const vshCmdInfo info_domdirtyrate_calc[] = {
+    {.name = "help",
+     .data = N_("Calculate a vm's memory dirty rate")
+    },
+    {.name = "desc",
+     .data = N_("Calculate memory dirty rate of a domain in order to "
+                "decide whether it's proper to be migrated out or not.\n"
+                "The calculated dirty rate information is available by "
+                "calling 'domstats --dirtyrate'.")
+    },
+    {.name = NULL}
+};
+
+static const vshCmdOptDef opts_domdirtyrate_calc[] = {
+    VIRSH_COMMON_OPT_DOMAIN_FULL(VIR_CONNECT_LIST_DOMAINS_ACTIVE),
+    {.name = "seconds",
+     .type = VSH_OT_INT,
+     .help = N_("calculate memory dirty rate within specified seconds, "
+                "the supported value range from 1 to 60, default to 1.")
+    },
+    {.name = NULL}
+};
+
+static bool
+cmdDomDirtyRateCalc(vshControl *ctl, const vshCmd *cmd)
+{
+    virDomainPtr dom = NULL;
+    int seconds = 1; /* the default value is 1 */
+    bool ret = false;
+
+    if (!(dom = virshCommandOptDomain(ctl, cmd, NULL)))
+        return false;
+
+    if (vshCommandOptInt(ctl, cmd, "seconds", &seconds) < 0)
+        goto cleanup;
+
+    if (virDomainStartDirtyRateCalc(dom, seconds, 0) < 0)
+        goto cleanup;
+
+    vshPrintExtra(ctl, _("Start to calculate domain's memory "
+                         "dirty rate successfully.\n"));
+    ret = true;
+
+ cleanup:
+    virshDomainFree(dom);
+    return ret;
+}
+
 const vshCmdDef domManagementCmds[] = {
     {.name = "attach-device",
      .handler = cmdAttachDevice,
@@ -14313,6 +14719,12 @@ const vshCmdDef domManagementCmds[] = {
      .info = info_attach_device,
      .flags = 0
     },
+    {.name = "attach-devices",
+     .handler = cmdAttachDevices,
+     .opts = opts_attach_devices,
+     .info = info_attach_devices,
+     .flags = 0
+    },
     {.name = "attach-disk",
      .handler = cmdAttachDisk,
      .opts = opts_attach_disk,
@@ -14933,5 +15345,11 @@ const vshCmdDef domManagementCmds[] = {
      .info = info_guestinfo,
      .flags = 0
     },
+    {.name = "domdirtyrate-calc",
+     .handler = cmdDomDirtyRateCalc,
+     .opts = opts_domdirtyrate_calc,
+     .info = info_domdirtyrate_calc,
+     .flags = 0
+    },
     {.name = NULL}
 };
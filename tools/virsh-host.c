@@ -32,6 +32,7 @@
 #include "virstring.h"
 #include "virfile.h"
 #include "virenum.h"
+#include "virutil.h"
 
 /*
  * "capabilities" command
@@ -468,13 +469,11 @@ static const vshCmdInfo info_allocpages[] = {
 static const vshCmdOptDef opts_allocpages[] = {
     {.name = "pagesize",
      .type = VSH_OT_INT,
-     .flags = VSH_OFLAG_REQ,
      .completer = virshAllocpagesPagesizeCompleter,
      .help = N_("page size (in kibibytes)")
     },
     {.name = "pagecount",
      .type = VSH_OT_INT,
-     .flags = VSH_OFLAG_REQ,
      .help = N_("page count")
     },
     {.name = "cellno",
@@ -490,9 +489,110 @@ static const vshCmdOptDef opts_allocpages[] = {
      .type = VSH_OT_BOOL,
      .help = N_("set on all NUMA cells")
     },
+    {.name = "layout",
+     .type = VSH_OT_STRING,
+     .flags = VSH_OFLAG_REQ_OPT,
+     .help = N_("pool sizes to set, as cell:pagesize=pagecount[,...]")
+    },
+    {.name = "strict",
+     .type = VSH_OT_BOOL,
+     .help = N_("fail unless the whole layout could be allocated")
+    },
     {.name = NULL}
 };
 
+/* Parses "cell:pagesize=pagecount[,...]" */
+static int
+virshAllocpagesParseLayout(vshControl *ctl,
+                           const char *layout,
+                           virTypedParameterPtr *params,
+                           int *nparams)
+{
+    VIR_AUTOSTRINGLIST items = NULL;
+    int maxparams = 0;
+    size_t i;
+
+    items = virStringSplit(layout, ",", 0);
+
+    for (i = 0; items[i]; i++) {
+        g_autofree char *field = NULL;
+        g_autofree char *unit = NULL;
+        unsigned int cell;
+        unsigned long long size;
+        unsigned long long count;
+        char *end;
+
+        if (virStrToLong_ui(items[i], &end, 10, &cell) < 0 || *end != ':' ||
+            virStrToLong_ullp(end + 1, &end, 10, &size) < 0)
+            goto error;
+
+        /* the page size may have a unit, kibibytes by default */
+        unit = g_strndup(end, strcspn(end, "="));
+        end += strlen(unit);
+        if (*end != '=' ||
+            virScaleInteger(&size, unit, 1024, UINT_MAX) < 0)
+            goto error;
+
+        if (virStrToLong_ullp(end + 1, NULL, 10, &count) < 0)
+            goto error;
+
+        field = g_strdup_printf(VIR_NODE_PAGES_LAYOUT_COUNT, cell,
+                                (unsigned int) VIR_DIV_UP(size, 1024));
+
+        if (virTypedParamsAddULLong(params, nparams, &maxparams,
+                                    field, count) < 0)
+            return -1;
+    }
+
+    return 0;
+
+ error:
+    vshError(ctl, _("invalid page layout '%s'"), items[i]);
+    return -1;
+}
+
+
+static bool
+cmdAllocpagesLayout(vshControl *ctl,
+                    const char *layout,
+                    unsigned int flags)
+{
+    virshControlPtr priv = ctl->privData;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    virTypedParameterPtr result = NULL;
+    int nresult = 0;
+    bool ret = false;
+    size_t i;
+
+    if (virshAllocpagesParseLayout(ctl, layout, &params, &nparams) < 0)
+        goto cleanup;
+
+    if (virNodeSetPagesLayout(priv->conn, params, nparams,
+                              &result, &nresult, flags) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nresult; i++) {
+        unsigned long long requested = 0;
+
+        ignore_value(virTypedParamsGetULLong(params, nparams,
+                                             result[i].field, &requested));
+
+        vshPrint(ctl, "%s: %llu", result[i].field, result[i].value.ul);
+        if (result[i].value.ul != requested)
+            vshPrint(ctl, _(" (requested %llu)"), requested);
+        vshPrint(ctl, "\n");
+    }
+
+    ret = true;
+
+ cleanup:
+    virTypedParamsFree(params, nparams);
+    virTypedParamsFree(result, nresult);
+    return ret;
+}
+
+
 static bool
 cmdAllocpages(vshControl *ctl, const vshCmd *cmd)
 {
@@ -509,9 +609,32 @@ cmdAllocpages(vshControl *ctl, const vshCmd *cmd)
     xmlDocPtr xml = NULL;
     xmlXPathContextPtr ctxt = NULL;
     xmlNodePtr *nodes = NULL;
+    const char *layout = NULL;
     virshControlPtr priv = ctl->privData;
 
     VSH_EXCLUSIVE_OPTIONS_VAR(all, cellno);
+    VSH_EXCLUSIVE_OPTIONS("layout", "pagesize");
+    VSH_EXCLUSIVE_OPTIONS("layout", "pagecount");
+    VSH_EXCLUSIVE_OPTIONS("layout", "cellno");
+    VSH_EXCLUSIVE_OPTIONS("layout", "all");
+    VSH_EXCLUSIVE_OPTIONS("layout", "add");
+    VSH_REQUIRE_OPTION("strict", "layout");
+
+    if (vshCommandOptStringReq(ctl, cmd, "layout", &layout) < 0)
+        return false;
+
+    if (layout) {
+        if (vshCommandOptBool(cmd, "strict"))
+            flags |= VIR_NODE_SET_PAGES_LAYOUT_STRICT;
+
+        return cmdAllocpagesLayout(ctl, layout, flags);
+    }
+
+    if (!vshCommandOptBool(cmd, "pagesize") ||
+        !vshCommandOptBool(cmd, "pagecount")) {
+        vshError(ctl, "%s", _("both --pagesize and --pagecount are required"));
+        return false;
+    }
 
     if (cellno && vshCommandOptInt(ctl, cmd, "cellno", &startCell) < 0)
         return false;
@@ -757,6 +880,18 @@ static const vshCmdOptDef opts_node_cpustats[] = {
      .type = VSH_OT_BOOL,
      .help = N_("prints by percentage during 1 second.")
     },
+    {.name = "all",
+     .type = VSH_OT_BOOL,
+     .help = N_("prints statistics of all cpus at once.")
+    },
+    {.name = "frequency",
+     .type = VSH_OT_BOOL,
+     .help = N_("include current frequency of each cpu (requires --all).")
+    },
+    {.name = "idle-states",
+     .type = VSH_OT_BOOL,
+     .help = N_("include idle state residency of each cpu (requires --all).")
+    },
     {.name = NULL}
 };
 
@@ -789,6 +924,34 @@ const char *virshCPUOutput[] = {
     N_("usage:")
 };
 
+static bool
+cmdNodeCpuStatsAll(vshControl *ctl, const vshCmd *cmd)
+{
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    unsigned int flags = 0;
+    size_t i;
+    virshControlPtr priv = ctl->privData;
+
+    if (vshCommandOptBool(cmd, "frequency"))
+        flags |= VIR_NODE_GET_ALL_CPU_STATS_FREQUENCY;
+    if (vshCommandOptBool(cmd, "idle-states"))
+        flags |= VIR_NODE_GET_ALL_CPU_STATS_IDLE_STATES;
+
+    if (virNodeGetAllCPUStats(priv->conn, &params, &nparams, flags) < 0) {
+        vshError(ctl, "%s", _("Unable to get node cpu stats"));
+        return false;
+    }
+
+    for (i = 0; i < nparams; i++) {
+        g_autofree char *str = vshGetTypedParamValue(ctl, &params[i]);
+        vshPrint(ctl, "%s=%s\n", params[i].field, str);
+    }
+
+    virTypedParamsFree(params, nparams);
+    return true;
+}
+
 static bool
 cmdNodeCpuStats(vshControl *ctl, const vshCmd *cmd)
 {
@@ -802,6 +965,14 @@ cmdNodeCpuStats(vshControl *ctl, const vshCmd *cmd)
     bool present[VIRSH_CPU_LAST] = { false };
     virshControlPtr priv = ctl->privData;
 
+    VSH_EXCLUSIVE_OPTIONS("all", "cpu");
+    VSH_EXCLUSIVE_OPTIONS("all", "percent");
+    VSH_REQUIRE_OPTION("frequency", "all");
+    VSH_REQUIRE_OPTION("idle-states", "all");
+
+    if (vshCommandOptBool(cmd, "all"))
+        return cmdNodeCpuStatsAll(ctl, cmd);
+
     if (vshCommandOptInt(ctl, cmd, "cpu", &cpuNum) < 0)
         return false;
 
@@ -731,6 +731,10 @@ static const vshCmdInfo info_pool_refresh[] = {
 static const vshCmdOptDef opts_pool_refresh[] = {
     VIRSH_COMMON_OPT_POOL_FULL(VIR_CONNECT_LIST_STORAGE_POOLS_ACTIVE),
 
+    {.name = "incremental",
+     .type = VSH_OT_BOOL,
+     .help = N_("only probe volumes which changed since the last refresh")
+    },
     {.name = NULL}
 };
 
@@ -740,11 +744,15 @@ cmdPoolRefresh(vshControl *ctl, const vshCmd *cmd)
     virStoragePoolPtr pool;
     bool ret = true;
     const char *name;
+    unsigned int flags = 0;
+
+    if (vshCommandOptBool(cmd, "incremental"))
+        flags |= VIR_STORAGE_POOL_REFRESH_INCREMENTAL;
 
     if (!(pool = virshCommandOptPool(ctl, cmd, "pool", &name)))
         return false;
 
-    if (virStoragePoolRefresh(pool, 0) == 0) {
+    if (virStoragePoolRefresh(pool, flags) == 0) {
         vshPrintExtra(ctl, _("Pool %s refreshed\n"), name);
     } else {
         vshError(ctl, _("Failed to refresh pool %s"), name);
@@ -1964,10 +1972,48 @@ vshEventGenericPrint(virConnectPtr conn G_GNUC_UNUSED,
         vshEventDone(data->ctl);
 }
 
+static void
+vshEventThresholdPrint(virConnectPtr conn G_GNUC_UNUSED,
+                       virStoragePoolPtr pool,
+                       const char *volume,
+                       unsigned long long threshold,
+                       unsigned long long excess,
+                       void *opaque)
+{
+    virshPoolEventData *data = opaque;
+
+    if (!data->loop && data->count)
+        return;
+
+    if (data->timestamp) {
+        char timestamp[VIR_TIME_STRING_BUFLEN];
+
+        if (virTimeStringNowRaw(timestamp) < 0)
+            timestamp[0] = '\0';
+
+        vshPrint(data->ctl, _("%s: event 'threshold' for storage pool %s: "
+                              "volume: %s %llu %llu\n"),
+                 timestamp,
+                 virStoragePoolGetName(pool),
+                 NULLSTR(volume), threshold, excess);
+    } else {
+        vshPrint(data->ctl, _("event 'threshold' for storage pool %s: "
+                              "volume: %s %llu %llu\n"),
+                 virStoragePoolGetName(pool),
+                 NULLSTR(volume), threshold, excess);
+    }
+
+    data->count++;
+    if (!data->loop)
+        vshEventDone(data->ctl);
+}
+
 virshPoolEventCallback virshPoolEventCallbacks[] = {
     { "lifecycle",
       VIR_STORAGE_POOL_EVENT_CALLBACK(vshEventLifecyclePrint), },
-    { "refresh", vshEventGenericPrint, }
+    { "refresh", vshEventGenericPrint, },
+    { "threshold",
+      VIR_STORAGE_POOL_EVENT_CALLBACK(vshEventThresholdPrint), },
 };
 G_STATIC_ASSERT(VIR_STORAGE_POOL_EVENT_ID_LAST == G_N_ELEMENTS(virshPoolEventCallbacks));
 
@@ -381,6 +381,10 @@ static const vshCmdOptDef opts_vol_create[] = {
      .type = VSH_OT_BOOL,
      .help = N_("preallocate metadata (for qcow2 instead of full allocation)")
     },
+    {.name = "async",
+     .type = VSH_OT_BOOL,
+     .help = N_("return once the volume job started, see vol-jobinfo")
+    },
     {.name = NULL}
 };
 
@@ -397,6 +401,9 @@ cmdVolCreate(vshControl *ctl, const vshCmd *cmd)
     if (vshCommandOptBool(cmd, "prealloc-metadata"))
         flags |= VIR_STORAGE_VOL_CREATE_PREALLOC_METADATA;
 
+    if (vshCommandOptBool(cmd, "async"))
+        flags |= VIR_STORAGE_VOL_CREATE_ASYNC;
+
     if (!(pool = virshCommandOptPool(ctl, cmd, "pool", NULL)))
         return false;
 
@@ -452,6 +459,14 @@ static const vshCmdOptDef opts_vol_create_from[] = {
      .type = VSH_OT_BOOL,
      .help = N_("use btrfs COW lightweight copy")
     },
+    {.name = "flatten",
+     .type = VSH_OT_BOOL,
+     .help = N_("detach a copy-on-write clone from the input volume")
+    },
+    {.name = "async",
+     .type = VSH_OT_BOOL,
+     .help = N_("return once the volume job started, see vol-jobinfo")
+    },
     {.name = NULL}
 };
 
@@ -474,6 +489,12 @@ cmdVolCreateFrom(vshControl *ctl, const vshCmd *cmd)
     if (vshCommandOptBool(cmd, "reflink"))
         flags |= VIR_STORAGE_VOL_CREATE_REFLINK;
 
+    if (vshCommandOptBool(cmd, "flatten"))
+        flags |= VIR_STORAGE_VOL_CREATE_FLATTEN;
+
+    if (vshCommandOptBool(cmd, "async"))
+        flags |= VIR_STORAGE_VOL_CREATE_ASYNC;
+
     if (vshCommandOptStringReq(ctl, cmd, "file", &from) < 0)
         goto cleanup;
 
@@ -564,6 +585,14 @@ static const vshCmdOptDef opts_vol_clone[] = {
      .type = VSH_OT_BOOL,
      .help = N_("use btrfs COW lightweight copy")
     },
+    {.name = "flatten",
+     .type = VSH_OT_BOOL,
+     .help = N_("detach a copy-on-write clone from the original volume")
+    },
+    {.name = "async",
+     .type = VSH_OT_BOOL,
+     .help = N_("return once the volume job started, see vol-jobinfo")
+    },
     {.name = NULL}
 };
 
@@ -587,6 +616,12 @@ cmdVolClone(vshControl *ctl, const vshCmd *cmd)
     if (vshCommandOptBool(cmd, "reflink"))
         flags |= VIR_STORAGE_VOL_CREATE_REFLINK;
 
+    if (vshCommandOptBool(cmd, "flatten"))
+        flags |= VIR_STORAGE_VOL_CREATE_FLATTEN;
+
+    if (vshCommandOptBool(cmd, "async"))
+        flags |= VIR_STORAGE_VOL_CREATE_ASYNC;
+
     origpool = virStoragePoolLookupByVolume(origvol);
     if (!origpool) {
         vshError(ctl, "%s", _("failed to get parent pool"));
@@ -877,6 +912,10 @@ static const vshCmdOptDef opts_vol_delete[] = {
      .help = N_("delete snapshots associated with volume (must be "
                 "supported by storage driver)")
     },
+    {.name = "async",
+     .type = VSH_OT_BOOL,
+     .help = N_("return once the volume job started, see vol-jobinfo")
+    },
     {.name = NULL}
 };
 
@@ -895,8 +934,14 @@ cmdVolDelete(vshControl *ctl, const vshCmd *cmd)
     if (delete_snapshots)
         flags |= VIR_STORAGE_VOL_DELETE_WITH_SNAPSHOTS;
 
+    if (vshCommandOptBool(cmd, "async"))
+        flags |= VIR_STORAGE_VOL_DELETE_ASYNC;
+
     if (virStorageVolDelete(vol, flags) == 0) {
-        vshPrintExtra(ctl, _("Vol %s deleted\n"), name);
+        if (flags & VIR_STORAGE_VOL_DELETE_ASYNC)
+            vshPrintExtra(ctl, _("Deleting vol %s\n"), name);
+        else
+            vshPrintExtra(ctl, _("Vol %s deleted\n"), name);
     } else {
         vshError(ctl, _("Failed to delete vol %s"), name);
         ret = false;
@@ -926,6 +971,10 @@ static const vshCmdOptDef opts_vol_wipe[] = {
      .type = VSH_OT_STRING,
      .help = N_("perform selected wiping algorithm")
     },
+    {.name = "async",
+     .type = VSH_OT_BOOL,
+     .help = N_("return once the volume job started, see vol-jobinfo")
+    },
     {.name = NULL}
 };
 
@@ -944,6 +993,10 @@ cmdVolWipe(vshControl *ctl, const vshCmd *cmd)
     const char *algorithm_str = NULL;
     int algorithm = VIR_STORAGE_VOL_WIPE_ALG_ZERO;
     int funcRet;
+    unsigned int flags = 0;
+
+    if (vshCommandOptBool(cmd, "async"))
+        flags |= VIR_STORAGE_VOL_WIPE_ASYNC;
 
     if (!(vol = virshCommandOptVol(ctl, cmd, "vol", "pool", &name)))
         return false;
@@ -957,10 +1010,10 @@ cmdVolWipe(vshControl *ctl, const vshCmd *cmd)
         goto out;
     }
 
-    if ((funcRet = virStorageVolWipePattern(vol, algorithm, 0)) < 0) {
+    if ((funcRet = virStorageVolWipePattern(vol, algorithm, flags)) < 0) {
         if (last_error->code == VIR_ERR_NO_SUPPORT &&
             algorithm == VIR_STORAGE_VOL_WIPE_ALG_ZERO)
-            funcRet = virStorageVolWipe(vol, 0);
+            funcRet = virStorageVolWipe(vol, flags);
     }
 
     if (funcRet < 0) {
@@ -968,7 +1021,10 @@ cmdVolWipe(vshControl *ctl, const vshCmd *cmd)
         goto out;
     }
 
-    vshPrintExtra(ctl, _("Vol %s wiped\n"), name);
+    if (flags & VIR_STORAGE_VOL_WIPE_ASYNC)
+        vshPrintExtra(ctl, _("Wiping vol %s started\n"), name);
+    else
+        vshPrintExtra(ctl, _("Vol %s wiped\n"), name);
     ret = true;
  out:
     virStorageVolFree(vol);
@@ -1082,6 +1138,116 @@ cmdVolInfo(vshControl *ctl, const vshCmd *cmd)
     return ret;
 }
 
+VIR_ENUM_DECL(virshStorageVolJob);
+VIR_ENUM_IMPL(virshStorageVolJob,
+              VIR_STORAGE_VOL_JOB_LAST,
+              N_("None"),
+              N_("Create"),
+              N_("Clone"),
+              N_("Wipe"),
+              N_("Delete"));
+
+/*
+ * "vol-jobinfo" command
+ */
+static const vshCmdInfo info_vol_jobinfo[] = {
+    {.name = "help",
+     .data = N_("storage vol job information")
+    },
+    {.name = "desc",
+     .data = N_("Returns the progress of the job running on the storage vol.")
+    },
+    {.name = NULL}
+};
+
+static const vshCmdOptDef opts_vol_jobinfo[] = {
+    VIRSH_COMMON_OPT_VOLUME_VOL,
+    VIRSH_COMMON_OPT_POOL_OPTIONAL,
+    {.name = "bytes",
+     .type = VSH_OT_BOOL,
+     .help = N_("sizes are represented in bytes rather than pretty units")
+    },
+    {.name = NULL}
+};
+
+static bool
+cmdVolJobInfo(vshControl *ctl, const vshCmd *cmd)
+{
+    virStorageVolJobInfo info;
+    virStorageVolPtr vol;
+    bool bytes = vshCommandOptBool(cmd, "bytes");
+    const char *type;
+    bool ret = false;
+
+    if (!(vol = virshCommandOptVol(ctl, cmd, "vol", "pool", NULL)))
+        return false;
+
+    if (virStorageVolGetJobInfo(vol, &info, 0) < 0)
+        goto cleanup;
+
+    if (!(type = virshStorageVolJobTypeToString(info.type)))
+        type = N_("unknown");
+    vshPrint(ctl, "%-17s %-12s\n", _("Job type:"), _(type));
+
+    if (info.type != VIR_STORAGE_VOL_JOB_NONE) {
+        if (bytes) {
+            vshPrint(ctl, "%-17s %llu %s\n", _("Data processed:"),
+                     info.done, _("bytes"));
+            vshPrint(ctl, "%-17s %llu %s\n", _("Data total:"),
+                     info.total, _("bytes"));
+        } else {
+            double val;
+            const char *unit;
+
+            val = vshPrettyCapacity(info.done, &unit);
+            vshPrint(ctl, "%-17s %-.3lf %s\n", _("Data processed:"), val, unit);
+            val = vshPrettyCapacity(info.total, &unit);
+            vshPrint(ctl, "%-17s %-.3lf %s\n", _("Data total:"), val, unit);
+        }
+    }
+
+    ret = true;
+
+ cleanup:
+    virStorageVolFree(vol);
+    return ret;
+}
+
+/*
+ * "vol-jobabort" command
+ */
+static const vshCmdInfo info_vol_jobabort[] = {
+    {.name = "help",
+     .data = N_("abort active storage vol job")
+    },
+    {.name = "desc",
+     .data = N_("Aborts the currently running storage vol job")
+    },
+    {.name = NULL}
+};
+
+static const vshCmdOptDef opts_vol_jobabort[] = {
+    VIRSH_COMMON_OPT_VOLUME_VOL,
+    VIRSH_COMMON_OPT_POOL_OPTIONAL,
+    {.name = NULL}
+};
+
+static bool
+cmdVolJobAbort(vshControl *ctl, const vshCmd *cmd)
+{
+    virStorageVolPtr vol;
+    bool ret = true;
+
+    if (!(vol = virshCommandOptVol(ctl, cmd, "vol", "pool", NULL)))
+        return false;
+
+    if (virStorageVolAbortJob(vol, 0) < 0)
+        ret = false;
+
+    virStorageVolFree(vol);
+    return ret;
+}
+
 /*
  * "vol-resize" command
  */
@@ -1733,6 +1899,18 @@ const vshCmdDef storageVolCmds[] = {
      .info = info_vol_info,
      .flags = 0
     },
+    {.name = "vol-jobabort",
+     .handler = cmdVolJobAbort,
+     .opts = opts_vol_jobabort,
+     .info = info_vol_jobabort,
+     .flags = 0
+    },
+    {.name = "vol-jobinfo",
+     .handler = cmdVolJobInfo,
+     .opts = opts_vol_jobinfo,
+     .info = info_vol_jobinfo,
+     .flags = 0
+    },
     {.name = "vol-key",
      .handler = cmdVolKey,
      .opts = opts_vol_key,
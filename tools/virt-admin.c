@@ -475,6 +475,10 @@ static const vshCmdOptDef opts_srv_threadpool_set[] = {
      .type = VSH_OT_INT,
      .help = N_("Change the current number of priority workers"),
     },
+    {.name = "max-client-workers",
+     .type = VSH_OT_INT,
+     .help = N_("Change upper limit to number of workers serving one client."),
+    },
     {.name = NULL}
 };
 
@@ -507,13 +511,14 @@ cmdSrvThreadpoolSet(vshControl *ctl, const vshCmd *cmd)
     PARSE_CMD_TYPED_PARAM("max-workers", VIR_THREADPOOL_WORKERS_MAX);
     PARSE_CMD_TYPED_PARAM("min-workers", VIR_THREADPOOL_WORKERS_MIN);
     PARSE_CMD_TYPED_PARAM("priority-workers", VIR_THREADPOOL_WORKERS_PRIORITY);
+    PARSE_CMD_TYPED_PARAM("max-client-workers", VIR_THREADPOOL_CLIENT_WORKERS_MAX);
 
 #undef PARSE_CMD_TYPED_PARAM
 
     if (!nparams) {
         vshError(ctl, "%s",
                  _("At least one of options --min-workers, --max-workers, "
-                   "--priority-workers is mandatory "));
+                   "--priority-workers, --max-client-workers is mandatory "));
             goto cleanup;
     }
 
@@ -851,6 +856,684 @@ cmdSrvClientsInfo(vshControl *ctl, const vshCmd *cmd)
     return ret;
 }
 
+/* ------------------------------
+ * Command server-procedure-stats
+ * ------------------------------
+ */
+
+static const vshCmdInfo info_srv_procedure_stats[] = {
+    {.name = "help",
+     .data = N_("get server's per-procedure RPC statistics")
+    },
+    {.name = "desc",
+     .data = N_("Retrieve call counts and latencies of RPC procedures "
+                "handled by <server>. Times are in microseconds, the "
+                "99th percentile is the upper limit of the histogram "
+                "bucket it falls into.")
+    },
+    {.name = NULL}
+};
+
+static const vshCmdOptDef opts_srv_procedure_stats[] = {
+    {.name = "server",
+     .type = VSH_OT_DATA,
+     .flags = VSH_OFLAG_REQ,
+     .completer = vshAdmServerCompleter,
+     .help = N_("Server to retrieve the procedure statistics from."),
+    },
+    {.name = NULL}
+};
+
+static unsigned long long
+vshAdmProcedureStatsGet(virTypedParameterPtr params,
+                        int nparams,
+                        size_t proc,
+                        const char *name)
+{
+    g_autofree char *field = g_strdup_printf("procedure.%zu.%s", proc, name);
+    unsigned long long value = 0;
+
+    ignore_value(virTypedParamsGetULLong(params, nparams, field, &value));
+    return value;
+}
+
+/* Formats the upper limit of the histogram bucket which the 99th
+ * percentile of @what of procedure @proc falls into */
+static char *
+vshAdmProcedureStatsP99(virTypedParameterPtr params,
+                        int nparams,
+                        size_t proc,
+                        const char *what,
+                        unsigned long long calls)
+{
+    unsigned int nbuckets = 0;
+    unsigned long long sum = 0;
+    size_t i;
+
+    ignore_value(virTypedParamsGetUInt(params, nparams,
+                                       "bucket.count", &nbuckets));
+
+    for (i = 0; i < nbuckets; i++) {
+        g_autofree char *bucket = g_strdup_printf("%s.bucket.%zu", what, i);
+        g_autofree char *limit = g_strdup_printf("bucket.%zu.limit", i);
+        unsigned long long value;
+
+        sum += vshAdmProcedureStatsGet(params, nparams, proc, bucket);
+        if (sum * 100 < calls * 99)
+            continue;
+
+        if (virTypedParamsGetULLong(params, nparams, limit, &value) == 1)
+            return g_strdup_printf("%llu", value);
+        break;
+    }
+
+    return g_strdup("-");
+}
+
+static bool
+cmdSrvProcedureStats(vshControl *ctl, const vshCmd *cmd)
+{
+    bool ret = false;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    unsigned int nprocs = 0;
+    size_t i;
+    const char *srvname = NULL;
+    virAdmServerPtr srv = NULL;
+    vshAdmControlPtr priv = ctl->privData;
+    vshTablePtr table = NULL;
+
+    if (vshCommandOptStringReq(ctl, cmd, "server", &srvname) < 0)
+        return false;
+
+    if (!(srv = virAdmConnectLookupServer(priv->conn, srvname, 0)))
+        goto cleanup;
+
+    if (virAdmServerGetProcedureStats(srv, &params, &nparams, 0) < 0) {
+        vshError(ctl, "%s", _("Unable to retrieve procedure statistics"));
+        goto cleanup;
+    }
+
+    ignore_value(virTypedParamsGetUInt(params, nparams,
+                                       "procedure.count", &nprocs));
+
+    table = vshTableNew(_("Program"), _("Procedure"), _("Calls"), _("Errors"),
+                        _("Wait avg"), _("Wait p99"), _("Wait max"),
+                        _("Exec avg"), _("Exec p99"), _("Exec max"), NULL);
+    if (!table)
+        goto cleanup;
+
+    for (i = 0; i < nprocs; i++) {
+        g_autofree char *field = g_strdup_printf("procedure.%zu.program", i);
+        g_autofree char *progStr = NULL;
+        g_autofree char *procStr = NULL;
+        g_autofree char *callsStr = NULL;
+        g_autofree char *errorsStr = NULL;
+        g_autofree char *waitAvg = NULL;
+        g_autofree char *waitP99 = NULL;
+        g_autofree char *waitMax = NULL;
+        g_autofree char *execAvg = NULL;
+        g_autofree char *execP99 = NULL;
+        g_autofree char *execMax = NULL;
+        unsigned int program = 0;
+        int number = 0;
+        unsigned long long calls;
+
+        ignore_value(virTypedParamsGetUInt(params, nparams, field, &program));
+        g_free(field);
+        field = g_strdup_printf("procedure.%zu.number", i);
+        ignore_value(virTypedParamsGetInt(params, nparams, field, &number));
+
+        if (!(calls = vshAdmProcedureStatsGet(params, nparams, i, "calls")))
+            continue;
+
+        progStr = g_strdup_printf("0x%x", program);
+        procStr = g_strdup_printf("%d", number);
+        callsStr = g_strdup_printf("%llu", calls);
+        errorsStr = g_strdup_printf("%llu",
+                                    vshAdmProcedureStatsGet(params, nparams,
+                                                            i, "errors"));
+        waitAvg = g_strdup_printf("%llu",
+                                  vshAdmProcedureStatsGet(params, nparams,
+                                                          i, "wait.total") / calls);
+        waitP99 = vshAdmProcedureStatsP99(params, nparams, i, "wait", calls);
+        waitMax = g_strdup_printf("%llu",
+                                  vshAdmProcedureStatsGet(params, nparams,
+                                                          i, "wait.max"));
+        execAvg = g_strdup_printf("%llu",
+                                  vshAdmProcedureStatsGet(params, nparams,
+                                                          i, "exec.total") / calls);
+        execP99 = vshAdmProcedureStatsP99(params, nparams, i, "exec", calls);
+        execMax = g_strdup_printf("%llu",
+                                  vshAdmProcedureStatsGet(params, nparams,
+                                                          i, "exec.max"));
+
+        if (vshTableRowAppend(table, progStr, procStr, callsStr, errorsStr,
+                              waitAvg, waitP99, waitMax,
+                              execAvg, execP99, execMax, NULL) < 0)
+            goto cleanup;
+    }
+
+    vshTablePrintToStdout(table, ctl);
+
+    ret = true;
+
+ cleanup:
+    vshTableFree(table);
+    virTypedParamsFree(params, nparams);
+    virAdmServerFree(srv);
+    return ret;
+}
+
+/* --------------------
+ * Command server-stats
+ * --------------------
+ */
+
+static const vshCmdInfo info_srv_stats[] = {
+    {.name = "help",
+     .data = N_("get server's performance counters")
+    },
+    {.name = "desc",
+     .data = N_("Retrieve event loop latency, worker queue wait, "
+                "per-client traffic, thread pool, memory allocator and "
+                "driver statistics of the daemon running <server>. "
+                "Times are in microseconds.")
+    },
+    {.name = NULL}
+};
+
+static const vshCmdOptDef opts_srv_stats[] = {
+    {.name = "server",
+     .type = VSH_OT_DATA,
+     .flags = VSH_OFLAG_REQ,
+     .completer = vshAdmServerCompleter,
+     .help = N_("Server to retrieve the statistics from."),
+    },
+    {.name = NULL}
+};
+
+static bool
+cmdSrvStats(vshControl *ctl, const vshCmd *cmd)
+{
+    bool ret = false;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    size_t i;
+    const char *srvname = NULL;
+    virAdmServerPtr srv = NULL;
+    vshAdmControlPtr priv = ctl->privData;
+
+    if (vshCommandOptStringReq(ctl, cmd, "server", &srvname) < 0)
+        return false;
+
+    if (!(srv = virAdmConnectLookupServer(priv->conn, srvname, 0)))
+        goto cleanup;
+
+    if (virAdmServerGetStats(srv, &params, &nparams, 0) < 0) {
+        vshError(ctl, "%s", _("Unable to retrieve server statistics"));
+        goto cleanup;
+    }
+
+    for (i = 0; i < nparams; i++) {
+        g_autofree char *value = vshGetTypedParamValue(ctl, &params[i]);
+
+        vshPrint(ctl, "%-32s: %s\n", params[i].field, value);
+    }
+
+    ret = true;
+
+ cleanup:
+    virTypedParamsFree(params, nparams);
+    virAdmServerFree(srv);
+    return ret;
+}
+
+/* -------------------------
+ * Command daemon-lock-stats
+ * -------------------------
+ */
+
+static const vshCmdInfo info_daemon_lock_stats[] = {
+    {.name = "help",
+     .data = N_("get daemon's lock contention statistics")
+    },
+    {.name = "desc",
+     .data = N_("Retrieve how often and for how long locks of the daemon "
+                "were waited for and held, per lock class and call site. "
+                "Times are in nanoseconds. Statistics are only gathered "
+                "when 'lock_profiling' is enabled in the daemon's "
+                "configuration.")
+    },
+    {.name = NULL}
+};
+
+static unsigned long long
+vshAdmLockStatsGet(virTypedParameterPtr params,
+                   int nparams,
+                   size_t lock,
+                   const char *name)
+{
+    g_autofree char *field = g_strdup_printf("lock.%zu.%s", lock, name);
+    unsigned long long value = 0;
+
+    ignore_value(virTypedParamsGetULLong(params, nparams, field, &value));
+    return value;
+}
+
+static bool
+cmdDaemonLockStats(vshControl *ctl, const vshCmd *cmd G_GNUC_UNUSED)
+{
+    bool ret = false;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    unsigned int nlocks = 0;
+    size_t i;
+    vshAdmControlPtr priv = ctl->privData;
+    vshTablePtr table = NULL;
+
+    if (virAdmConnectGetLockStats(priv->conn, &params, &nparams, 0) < 0) {
+        vshError(ctl, "%s", _("Unable to retrieve lock statistics"));
+        goto cleanup;
+    }
+
+    ignore_value(virTypedParamsGetUInt(params, nparams,
+                                       "lock.count", &nlocks));
+
+    if (nlocks == 0) {
+        vshPrintExtra(ctl, "%s\n",
+                      _("No lock statistics, is lock_profiling enabled?"));
+        ret = true;
+        goto cleanup;
+    }
+
+    table = vshTableNew(_("Class"), _("Site"), _("Acquisitions"),
+                        _("Contended"), _("Wait avg"), _("Wait max"),
+                        _("Hold avg"), _("Hold max"), NULL);
+    if (!table)
+        goto cleanup;
+
+    for (i = 0; i < nlocks; i++) {
+        g_autofree char *classField = g_strdup_printf("lock.%zu.class", i);
+        g_autofree char *siteField = g_strdup_printf("lock.%zu.site", i);
+        g_autofree char *acquisitionsStr = NULL;
+        g_autofree char *contendedStr = NULL;
+        g_autofree char *waitAvg = NULL;
+        g_autofree char *waitMax = NULL;
+        g_autofree char *holdAvg = NULL;
+        g_autofree char *holdMax = NULL;
+        const char *klass = "-";
+        const char *site = "-";
+        unsigned long long acquisitions;
+        unsigned long long contended;
+
+        ignore_value(virTypedParamsGetString(params, nparams,
+                                             classField, &klass));
+        ignore_value(virTypedParamsGetString(params, nparams,
+                                             siteField, &site));
+
+        if (!(acquisitions = vshAdmLockStatsGet(params, nparams,
+                                                i, "acquisitions")))
+            continue;
+
+        contended = vshAdmLockStatsGet(params, nparams, i, "contended");
+
+        acquisitionsStr = g_strdup_printf("%llu", acquisitions);
+        contendedStr = g_strdup_printf("%llu", contended);
+        waitAvg = g_strdup_printf("%llu",
+                                  contended ?
+                                  vshAdmLockStatsGet(params, nparams,
+                                                     i, "wait.total") / contended :
+                                  0);
+        waitMax = g_strdup_printf("%llu",
+                                  vshAdmLockStatsGet(params, nparams,
+                                                     i, "wait.max"));
+        holdAvg = g_strdup_printf("%llu",
+                                  vshAdmLockStatsGet(params, nparams,
+                                                     i, "hold.total") / acquisitions);
+        holdMax = g_strdup_printf("%llu",
+                                  vshAdmLockStatsGet(params, nparams,
+                                                     i, "hold.max"));
+
+        if (vshTableRowAppend(table, klass, site, acquisitionsStr,
+                              contendedStr, waitAvg, waitMax,
+                              holdAvg, holdMax, NULL) < 0)
+            goto cleanup;
+    }
+
+    vshTablePrintToStdout(table, ctl);
+
+    ret = true;
+
+ cleanup:
+    vshTableFree(table);
+    virTypedParamsFree(params, nparams);
+    return ret;
+}
+
+/* ---------------------------
+ * Command daemon-object-stats
+ * ---------------------------
+ */
+
+static const vshCmdInfo info_daemon_object_stats[] = {
+    {.name = "help",
+     .data = N_("get daemon's object instance statistics")
+    },
+    {.name = "desc",
+     .data = N_("Retrieve the number of object instances in use per object "
+                "class, and for classes pooling instances for reuse, the "
+                "number of pooled and reused instances.")
+    },
+    {.name = NULL}
+};
+
+static char *
+vshAdmObjectStatsGet(virTypedParameterPtr params,
+                     int nparams,
+                     size_t klass,
+                     const char *name)
+{
+    g_autofree char *field = g_strdup_printf("class.%zu.%s", klass, name);
+    unsigned long long value = 0;
+
+    ignore_value(virTypedParamsGetULLong(params, nparams, field, &value));
+    return g_strdup_printf("%llu", value);
+}
+
+static bool
+cmdDaemonObjectStats(vshControl *ctl, const vshCmd *cmd G_GNUC_UNUSED)
+{
+    bool ret = false;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    unsigned int nclasses = 0;
+    size_t i;
+    vshAdmControlPtr priv = ctl->privData;
+    vshTablePtr table = NULL;
+
+    if (virAdmConnectGetObjectStats(priv->conn, &params, &nparams, 0) < 0) {
+        vshError(ctl, "%s", _("Unable to retrieve object statistics"));
+        goto cleanup;
+    }
+
+    ignore_value(virTypedParamsGetUInt(params, nparams,
+                                       "class.count", &nclasses));
+
+    table = vshTableNew(_("Class"), _("Live"), _("Pooled"),
+                        _("Pool max"), _("Reused"), NULL);
+    if (!table)
+        goto cleanup;
+
+    for (i = 0; i < nclasses; i++) {
+        g_autofree char *nameField = g_strdup_printf("class.%zu.name", i);
+        g_autofree char *liveStr = NULL;
+        g_autofree char *pooledStr = NULL;
+        g_autofree char *poolMaxStr = NULL;
+        g_autofree char *reusedStr = NULL;
+        const char *name = "-";
+
+        ignore_value(virTypedParamsGetString(params, nparams,
+                                             nameField, &name));
+
+        liveStr = vshAdmObjectStatsGet(params, nparams, i, "live");
+        pooledStr = vshAdmObjectStatsGet(params, nparams, i, "pooled");
+        poolMaxStr = vshAdmObjectStatsGet(params, nparams, i, "pool.max");
+        reusedStr = vshAdmObjectStatsGet(params, nparams, i, "reused");
+
+        if (vshTableRowAppend(table, name, liveStr, pooledStr,
+                              poolMaxStr, reusedStr, NULL) < 0)
+            goto cleanup;
+    }
+
+    vshTablePrintToStdout(table, ctl);
+
+    ret = true;
+
+ cleanup:
+    vshTableFree(table);
+    virTypedParamsFree(params, nparams);
+    return ret;
+}
+
+/* -----------------------------
+ * Command daemon-log-file-stats
+ * -----------------------------
+ */
+
+static const vshCmdInfo info_daemon_log_file_stats[] = {
+    {.name = "help",
+     .data = N_("get daemon's log file statistics")
+    },
+    {.name = "desc",
+     .data = N_("Retrieve the amount of data written to each log file "
+                "the daemon manages and how much of it is still waiting "
+                "to be written.")
+    },
+    {.name = NULL}
+};
+
+static char *
+vshAdmLogFileStatsGet(virTypedParameterPtr params,
+                      int nparams,
+                      size_t file,
+                      const char *name)
+{
+    g_autofree char *field = g_strdup_printf("file.%zu.%s", file, name);
+    unsigned long long value = 0;
+
+    ignore_value(virTypedParamsGetULLong(params, nparams, field, &value));
+    return g_strdup_printf("%llu", value);
+}
+
+static bool
+cmdDaemonLogFileStats(vshControl *ctl, const vshCmd *cmd G_GNUC_UNUSED)
+{
+    bool ret = false;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    unsigned int nfiles = 0;
+    size_t i;
+    vshAdmControlPtr priv = ctl->privData;
+    vshTablePtr table = NULL;
+
+    if (virAdmConnectGetLogFileStats(priv->conn, &params, &nparams, 0) < 0) {
+        vshError(ctl, "%s", _("Unable to retrieve log file statistics"));
+        goto cleanup;
+    }
+
+    ignore_value(virTypedParamsGetUInt(params, nparams,
+                                       "file.count", &nfiles));
+
+    table = vshTableNew(_("Path"), _("Bytes"), _("Writes"), _("Spliced"),
+                        _("Backlog"), _("Max backlog"), NULL);
+    if (!table)
+        goto cleanup;
+
+    for (i = 0; i < nfiles; i++) {
+        g_autofree char *pathField = g_strdup_printf("file.%zu.path", i);
+        g_autofree char *bytesStr = NULL;
+        g_autofree char *writesStr = NULL;
+        g_autofree char *splicedStr = NULL;
+        g_autofree char *backlogStr = NULL;
+        g_autofree char *backlogMaxStr = NULL;
+        const char *path = "-";
+
+        ignore_value(virTypedParamsGetString(params, nparams,
+                                             pathField, &path));
+
+        bytesStr = vshAdmLogFileStatsGet(params, nparams, i, "bytes");
+        writesStr = vshAdmLogFileStatsGet(params, nparams, i, "writes");
+        splicedStr = vshAdmLogFileStatsGet(params, nparams, i, "spliced");
+        backlogStr = vshAdmLogFileStatsGet(params, nparams, i, "backlog");
+        backlogMaxStr = vshAdmLogFileStatsGet(params, nparams, i,
+                                              "backlog.max");
+
+        if (vshTableRowAppend(table, path, bytesStr, writesStr, splicedStr,
+                              backlogStr, backlogMaxStr, NULL) < 0)
+            goto cleanup;
+    }
+
+    vshTablePrintToStdout(table, ctl);
+
+    ret = true;
+
+ cleanup:
+    vshTableFree(table);
+    virTypedParamsFree(params, nparams);
+    return ret;
+}
+
+/* --------------------------
+ * Command daemon-lease-stats
+ * --------------------------
+ */
+
+static const vshCmdInfo info_daemon_lease_stats[] = {
+    {.name = "help",
+     .data = N_("get daemon's lease statistics")
+    },
+    {.name = "desc",
+     .data = N_("Retrieve how often and how long domains of the daemon "
+                "waited for their lock manager to acquire and release "
+                "leases.")
+    },
+    {.name = NULL}
+};
+
+static char *
+vshAdmLeaseStatsGet(virTypedParameterPtr params,
+                    int nparams,
+                    size_t driver,
+                    const char *name)
+{
+    g_autofree char *field = g_strdup_printf("driver.%zu.%s", driver, name);
+    unsigned long long value = 0;
+
+    ignore_value(virTypedParamsGetULLong(params, nparams, field, &value));
+    return g_strdup_printf("%llu", value);
+}
+
+static bool
+cmdDaemonLeaseStats(vshControl *ctl, const vshCmd *cmd G_GNUC_UNUSED)
+{
+    bool ret = false;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    unsigned int ndrivers = 0;
+    size_t i;
+    vshAdmControlPtr priv = ctl->privData;
+    vshTablePtr table = NULL;
+
+    if (virAdmConnectGetLeaseStats(priv->conn, &params, &nparams, 0) < 0) {
+        vshError(ctl, "%s", _("Unable to retrieve lease statistics"));
+        goto cleanup;
+    }
+
+    ignore_value(virTypedParamsGetUInt(params, nparams,
+                                       "driver.count", &ndrivers));
+
+    table = vshTableNew(_("Driver"), _("Acquires"), _("Failed"), _("Busy"),
+                        _("Time (us)"), _("Max (us)"), _("Releases"),
+                        _("Failed"), _("Time (us)"), _("Max (us)"), NULL);
+    if (!table)
+        goto cleanup;
+
+    for (i = 0; i < ndrivers; i++) {
+        g_autofree char *nameField = g_strdup_printf("driver.%zu.name", i);
+        g_autofree char *acquiresStr = NULL;
+        g_autofree char *acquireFailedStr = NULL;
+        g_autofree char *acquireBusyStr = NULL;
+        g_autofree char *acquireTimeStr = NULL;
+        g_autofree char *acquireTimeMaxStr = NULL;
+        g_autofree char *releasesStr = NULL;
+        g_autofree char *releaseFailedStr = NULL;
+        g_autofree char *releaseTimeStr = NULL;
+        g_autofree char *releaseTimeMaxStr = NULL;
+        const char *name = "-";
+
+        ignore_value(virTypedParamsGetString(params, nparams,
+                                             nameField, &name));
+
+        acquiresStr = vshAdmLeaseStatsGet(params, nparams, i, "acquires");
+        acquireFailedStr = vshAdmLeaseStatsGet(params, nparams, i,
+                                               "acquire.failed");
+        acquireBusyStr = vshAdmLeaseStatsGet(params, nparams, i,
+                                             "acquire.busy");
+        acquireTimeStr = vshAdmLeaseStatsGet(params, nparams, i,
+                                             "acquire.time");
+        acquireTimeMaxStr = vshAdmLeaseStatsGet(params, nparams, i,
+                                                "acquire.time.max");
+        releasesStr = vshAdmLeaseStatsGet(params, nparams, i, "releases");
+        releaseFailedStr = vshAdmLeaseStatsGet(params, nparams, i,
+                                               "release.failed");
+        releaseTimeStr = vshAdmLeaseStatsGet(params, nparams, i,
+                                             "release.time");
+        releaseTimeMaxStr = vshAdmLeaseStatsGet(params, nparams, i,
+                                                "release.time.max");
+
+        if (vshTableRowAppend(table, name, acquiresStr, acquireFailedStr,
+                              acquireBusyStr, acquireTimeStr,
+                              acquireTimeMaxStr, releasesStr,
+                              releaseFailedStr, releaseTimeStr,
+                              releaseTimeMaxStr, NULL) < 0)
+            goto cleanup;
+    }
+
+    vshTablePrintToStdout(table, ctl);
+
+    ret = true;
+
+ cleanup:
+    vshTableFree(table);
+    virTypedParamsFree(params, nparams);
+    return ret;
+}
+
+/* ----------------------
+ * Command daemon-profile
+ * ----------------------
+ */
+
+static const vshCmdInfo info_daemon_profile[] = {
+    {.name = "help",
+     .data = N_("profile the daemon")
+    },
+    {.name = "desc",
+     .data = N_("Sample the stacks of the daemon's threads for a while and "
+                "write them to a file on the daemon's host.")
+    },
+    {.name = NULL}
+};
+
+static const vshCmdOptDef opts_daemon_profile[] = {
+    {.name = "duration",
+     .type = VSH_OT_INT,
+     .help = N_("how long to profile, in seconds (default 30)"),
+    },
+    {.name = NULL}
+};
+
+static bool
+cmdDaemonProfile(vshControl *ctl, const vshCmd *cmd)
+{
+    unsigned int duration = 30;
+    g_autofree char *file = NULL;
+    vshAdmControlPtr priv = ctl->privData;
+
+    if (vshCommandOptUInt(ctl, cmd, "duration", &duration) < 0)
+        return false;
+
+    if (virAdmConnectStartProfiler(priv->conn, duration, &file, 0) < 0) {
+        vshError(ctl, "%s", _("Unable to start the profiler"));
+        return false;
+    }
+
+    vshPrint(ctl, _("Profiling for %u seconds, the profile will be written "
+                    "to '%s'\n"), duration, file);
+    return true;
+}
+
 /* --------------------------
  * Command server-clients-set
  * --------------------------
@@ -1454,6 +2137,56 @@ static const vshCmdDef monitoringCmds[] = {
      .info = info_srv_clients_info,
      .flags = 0
     },
+    {.name = "srv-procedure-stats",
+     .flags = VSH_CMD_FLAG_ALIAS,
+     .alias = "server-procedure-stats"
+    },
+    {.name = "server-procedure-stats",
+     .handler = cmdSrvProcedureStats,
+     .opts = opts_srv_procedure_stats,
+     .info = info_srv_procedure_stats,
+     .flags = 0
+    },
+    {.name = "srv-stats",
+     .flags = VSH_CMD_FLAG_ALIAS,
+     .alias = "server-stats"
+    },
+    {.name = "server-stats",
+     .handler = cmdSrvStats,
+     .opts = opts_srv_stats,
+     .info = info_srv_stats,
+     .flags = 0
+    },
+    {.name = "daemon-lock-stats",
+     .handler = cmdDaemonLockStats,
+     .opts = NULL,
+     .info = info_daemon_lock_stats,
+     .flags = 0
+    },
+    {.name = "daemon-object-stats",
+     .handler = cmdDaemonObjectStats,
+     .opts = NULL,
+     .info = info_daemon_object_stats,
+     .flags = 0
+    },
+    {.name = "daemon-log-file-stats",
+     .handler = cmdDaemonLogFileStats,
+     .opts = NULL,
+     .info = info_daemon_log_file_stats,
+     .flags = 0
+    },
+    {.name = "daemon-lease-stats",
+     .handler = cmdDaemonLeaseStats,
+     .opts = NULL,
+     .info = info_daemon_lease_stats,
+     .flags = 0
+    },
+    {.name = "daemon-profile",
+     .handler = cmdDaemonProfile,
+     .opts = opts_daemon_profile,
+     .info = info_daemon_profile,
+     .flags = 0
+    },
     {.name = NULL}
 };
 
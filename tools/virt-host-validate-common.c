@@ -92,6 +92,25 @@ void virHostMsgPass(void)
         fprintf(stdout, "%s\n", _("PASS"));
 }
 
+void virHostMsgPassDetail(const char *format,
+                          ...)
+{
+    va_list args;
+    g_autofree char *msg = NULL;
+
+    if (quiet)
+        return;
+
+    va_start(args, format);
+    msg = g_strdup_vprintf(format, args);
+    va_end(args);
+
+    if (virHostMsgWantEscape())
+        fprintf(stdout, "\033[32m%s\033[0m (%s)\n", _("PASS"), msg);
+    else
+        fprintf(stdout, "%s (%s)\n", _("PASS"), msg);
+}
+
 
 static const char * failMessages[] = {
     N_("FAIL"),
@@ -527,3 +546,522 @@ int virHostValidateSecureGuests(const char *hvname,
 
     return 0;
 }
+
+
+#define SYSFS_CPU_PATH "/sys/devices/system/cpu"
+#define SYSFS_NODE_PATH "/sys/devices/system/node"
+
+/* Idle states which take longer to exit from are reported as deep */
+#define VIR_HOST_VALIDATE_IDLE_LATENCY_MAX 20
+
+
+/*
+ * Reads a list of CPUs or NUMA nodes such as '0-3,8' from @path.
+ * @list is set to NULL if the list is empty, which the kernel
+ * denotes either by an empty file or by '(null)'.
+ *
+ * Returns 0 on success, -2 if @path doesn't exist, -1 on error.
+ */
+static int
+virHostValidateReadList(const char *path,
+                        virBitmapPtr *list)
+{
+    g_autofree char *str = NULL;
+    int rc;
+
+    *list = NULL;
+
+    if ((rc = virFileReadValueString(&str, "%s", path)) < 0)
+        return rc;
+
+    if (!*str || STREQ(str, "(null)"))
+        return 0;
+
+    if (!(*list = virBitmapParseUnlimited(str)))
+        return -1;
+
+    return 0;
+}
+
+
+int virHostValidateHugepages(const char *hvname,
+                             virHostValidateLevel level)
+{
+    g_autoptr(virBitmap) nodes = NULL;
+    ssize_t node = -1;
+    int ret = 0;
+
+    if (virHostValidateReadList(SYSFS_NODE_PATH "/online", &nodes) < 0 ||
+        !nodes)
+        return 0;
+
+    while ((node = virBitmapNextSetBit(nodes, node)) >= 0) {
+        g_autofree char *path = NULL;
+        g_autoptr(GString) avail = g_string_new(NULL);
+        struct dirent *ent;
+        DIR *dir;
+        bool allocated = false;
+
+        path = g_strdup_printf(SYSFS_NODE_PATH "/node%zd/hugepages", node);
+
+        virHostMsgCheck(hvname, _("for hugepages on NUMA node %zd"), node);
+
+        if (virDirOpenIfExists(&dir, path) <= 0) {
+            virHostMsgFail(level, "%s",
+                           _("Hugepages are not supported by the kernel"));
+            return -1;
+        }
+
+        while (virDirRead(dir, &ent, path) > 0) {
+            unsigned int total;
+            unsigned int free;
+
+            if (!STRPREFIX(ent->d_name, "hugepages-"))
+                continue;
+
+            if (virFileReadValueUint(&total, "%s/%s/nr_hugepages",
+                                     path, ent->d_name) < 0 ||
+                virFileReadValueUint(&free, "%s/%s/free_hugepages",
+                                     path, ent->d_name) < 0 ||
+                total == 0)
+                continue;
+
+            if (allocated)
+                g_string_append(avail, ", ");
+            g_string_append_printf(avail, _("%u of %u %s free"),
+                                   free, total,
+                                   ent->d_name + strlen("hugepages-"));
+            allocated = true;
+        }
+        VIR_DIR_CLOSE(dir);
+
+        if (!allocated) {
+            virHostMsgFail(level, "%s",
+                           _("No hugepages are allocated, guests backed by "
+                             "hugepages can't use memory of this node"));
+            ret = -1;
+        } else {
+            virHostMsgPassDetail("%s", avail->str);
+        }
+    }
+
+    return ret;
+}
+
+
+int virHostValidateCPUGovernor(const char *hvname,
+                               virHostValidateLevel level)
+{
+    g_autoptr(virBitmap) cpus = NULL;
+    g_autoptr(virBitmap) slow = NULL;
+    g_autofree char *slowGovernor = NULL;
+    g_autofree char *slowStr = NULL;
+    ssize_t cpu = -1;
+    bool scaled = false;
+
+    if (virHostValidateReadList(SYSFS_CPU_PATH "/online", &cpus) < 0 ||
+        !cpus)
+        return 0;
+
+    slow = virBitmapNewEmpty();
+
+    while ((cpu = virBitmapNextSetBit(cpus, cpu)) >= 0) {
+        g_autofree char *governor = NULL;
+
+        if (virFileReadValueString(&governor,
+                                   SYSFS_CPU_PATH "/cpu%zd/cpufreq/scaling_governor",
+                                   cpu) < 0)
+            continue;
+
+        scaled = true;
+
+        if (STREQ(governor, "performance"))
+            continue;
+
+        ignore_value(virBitmapSetBitExpand(slow, cpu));
+        if (!slowGovernor)
+            slowGovernor = g_steal_pointer(&governor);
+    }
+
+    /* no frequency scaling, e.g. inside a VM */
+    if (!scaled)
+        return 0;
+
+    virHostMsgCheck(hvname, "%s", _("for CPU frequency governor"));
+
+    if (virBitmapIsAllClear(slow)) {
+        virHostMsgPass();
+        return 0;
+    }
+
+    slowStr = virBitmapFormat(slow);
+    virHostMsgFail(level,
+                   _("CPUs %s use the '%s' governor, switch them to "
+                     "'performance' to avoid latency of frequency changes"),
+                   slowStr, slowGovernor);
+    return -1;
+}
+
+
+int virHostValidateCPUIdle(const char *hvname,
+                           virHostValidateLevel level)
+{
+    g_autoptr(virBitmap) cpus = NULL;
+    g_autoptr(virBitmap) deep = NULL;
+    g_autofree char *deepState = NULL;
+    g_autofree char *deepStr = NULL;
+    unsigned int deepLatency = 0;
+    ssize_t cpu = -1;
+    bool idle = false;
+
+    if (virHostValidateReadList(SYSFS_CPU_PATH "/online", &cpus) < 0 ||
+        !cpus)
+        return 0;
+
+    deep = virBitmapNewEmpty();
+
+    while ((cpu = virBitmapNextSetBit(cpus, cpu)) >= 0) {
+        size_t state;
+
+        for (state = 0; ; state++) {
+            g_autofree char *name = NULL;
+            unsigned int latency;
+            unsigned int disabled = 0;
+
+            if (virFileReadValueUint(&latency,
+                                     SYSFS_CPU_PATH "/cpu%zd/cpuidle/state%zu/latency",
+                                     cpu, state) < 0)
+                break;
+
+            idle = true;
+
+            ignore_value(virFileReadValueUint(&disabled,
+                                              SYSFS_CPU_PATH "/cpu%zd/cpuidle/state%zu/disable",
+                                              cpu, state));
+
+            if (disabled || latency <= VIR_HOST_VALIDATE_IDLE_LATENCY_MAX)
+                continue;
+
+            ignore_value(virBitmapSetBitExpand(deep, cpu));
+
+            if (latency > deepLatency &&
+                virFileReadValueString(&name,
+                                       SYSFS_CPU_PATH "/cpu%zd/cpuidle/state%zu/name",
+                                       cpu, state) == 0) {
+                g_free(deepState);
+                deepState = g_steal_pointer(&name);
+                deepLatency = latency;
+            }
+        }
+    }
+
+    /* no cpuidle driver, the CPUs only ever halt */
+    if (!idle)
+        return 0;
+
+    virHostMsgCheck(hvname, "%s", _("for deep CPU idle states"));
+
+    if (virBitmapIsAllClear(deep)) {
+        virHostMsgPass();
+        return 0;
+    }
+
+    deepStr = virBitmapFormat(deep);
+    virHostMsgFail(level,
+                   _("CPUs %s may enter idle state %s which takes %uus to "
+                     "exit, limit idle states for latency sensitive guests"),
+                   deepStr, NULLSTR(deepState), deepLatency);
+    return -1;
+}
+
+
+int virHostValidateTHP(const char *hvname,
+                       virHostValidateLevel level)
+{
+    g_autofree char *enabled = NULL;
+    char *mode;
+    char *end;
+
+    if (virFileReadValueString(&enabled,
+                               "/sys/kernel/mm/transparent_hugepage/enabled") < 0)
+        return 0;
+
+    /* the active mode is enclosed in brackets: always [madvise] never */
+    if (!(mode = strchr(enabled, '[')) || !(end = strchr(mode, ']')))
+        return 0;
+    mode++;
+    *end = '\0';
+
+    virHostMsgCheck(hvname, "%s", _("for transparent hugepages"));
+
+    if (STREQ(mode, "never")) {
+        virHostMsgFail(level, "%s",
+                       _("Transparent hugepages are disabled, guest memory "
+                         "not backed by hugepages suffers more TLB misses"));
+        return -1;
+    }
+
+    virHostMsgPassDetail("%s", mode);
+    return 0;
+}
+
+
+/**
+ * virHostValidateIsolatedCPUs:
+ * @hvname: name of the hypervisor
+ * @pinned: host CPUs guest vCPUs are pinned to, or NULL if unknown
+ * @level: level of failures
+ *
+ * Checks that the CPUs excluded from running timer ticks (nohz_full=)
+ * are also isolated from the scheduler (isolcpus=) and that guests pin
+ * their vCPUs to the isolated CPUs.
+ */
+int virHostValidateIsolatedCPUs(const char *hvname,
+                                virBitmapPtr pinned,
+                                virHostValidateLevel level)
+{
+    g_autoptr(virBitmap) isolated = NULL;
+    g_autoptr(virBitmap) nohz = NULL;
+    int ret = 0;
+
+    if (virHostValidateReadList(SYSFS_CPU_PATH "/isolated", &isolated) < 0 ||
+        virHostValidateReadList(SYSFS_CPU_PATH "/nohz_full", &nohz) < 0)
+        virResetLastError();
+
+    if (nohz) {
+        virHostMsgCheck(hvname, "%s", _("if nohz_full CPUs are isolated"));
+
+        if (isolated)
+            virBitmapSubtract(nohz, isolated);
+
+        if (virBitmapIsAllClear(nohz)) {
+            virHostMsgPass();
+        } else {
+            g_autofree char *nohzStr = virBitmapFormat(nohz);
+
+            virHostMsgFail(level,
+                           _("CPUs %s run without timer ticks but other "
+                             "tasks may run on them, add them to isolcpus="),
+                           nohzStr);
+            ret = -1;
+        }
+    }
+
+    if (!pinned)
+        return ret;
+
+    virHostMsgCheck(hvname, "%s", _("if pinned vCPUs use isolated CPUs"));
+
+    if (virBitmapIsAllClear(pinned)) {
+        if (isolated) {
+            g_autofree char *isolatedStr = virBitmapFormat(isolated);
+
+            virHostMsgFail(level,
+                           _("CPUs %s are isolated but no guest pins its "
+                             "vCPUs to them"),
+                           isolatedStr);
+            return -1;
+        }
+    } else if (!isolated) {
+        virHostMsgFail(level, "%s",
+                       _("Guest vCPUs are pinned but no CPUs are isolated, "
+                         "use isolcpus= to keep host tasks off the pinned "
+                         "CPUs"));
+        return -1;
+    } else {
+        g_autoptr(virBitmap) shared = virBitmapNewCopy(pinned);
+
+        virBitmapSubtract(shared, isolated);
+
+        if (!virBitmapIsAllClear(shared)) {
+            g_autofree char *sharedStr = virBitmapFormat(shared);
+
+            virHostMsgFail(level,
+                           _("Guest vCPUs are pinned to CPUs %s which are not "
+                             "isolated"),
+                           sharedStr);
+            return -1;
+        }
+    }
+
+    virHostMsgPass();
+    return ret;
+}
+
+
+/*
+ * Calls @cb for every MSI interrupt of the PCI device at @devpath.
+ * Devices without MSI interrupts are skipped.
+ */
+static int
+virHostValidateCheckDeviceIRQs(const char *devpath,
+                               bool (*cb)(virBitmapPtr affinity,
+                                          void *opaque),
+                               void *opaque)
+{
+    g_autofree char *irqpath = g_strdup_printf("%s/msi_irqs", devpath);
+    struct dirent *ent;
+    DIR *dir;
+    bool ok = true;
+
+    if (virDirOpenIfExists(&dir, irqpath) <= 0)
+        return 0;
+
+    while (ok && virDirRead(dir, &ent, irqpath) > 0) {
+        g_autofree char *affpath = NULL;
+        g_autoptr(virBitmap) affinity = NULL;
+
+        affpath = g_strdup_printf("/proc/irq/%s/smp_affinity_list",
+                                  ent->d_name);
+
+        if (virHostValidateReadList(affpath, &affinity) < 0 || !affinity)
+            continue;
+
+        ok = cb(affinity, opaque);
+    }
+    VIR_DIR_CLOSE(dir);
+
+    return ok ? 0 : -1;
+}
+
+
+static bool
+virHostValidateIRQAvoids(virBitmapPtr affinity,
+                         void *opaque)
+{
+    virBitmapPtr isolated = opaque;
+
+    return !virBitmapOverlaps(affinity, isolated);
+}
+
+
+static bool
+virHostValidateIRQWithin(virBitmapPtr affinity,
+                         void *opaque)
+{
+    virBitmapPtr local = opaque;
+
+    return virBitmapOverlaps(affinity, local);
+}
+
+
+/**
+ * virHostValidateIRQAffinity:
+ * @hvname: name of the hypervisor
+ * @level: level of failures
+ *
+ * Checks that interrupts of devices assigned to guests are handled by
+ * CPUs local to the device and that interrupts of host network devices
+ * don't disturb isolated CPUs.
+ */
+int virHostValidateIRQAffinity(const char *hvname,
+                               virHostValidateLevel level)
+{
+    const char *vfiopath = "/sys/bus/pci/drivers/vfio-pci";
+    const char *netpath = "/sys/class/net";
+    g_autoptr(virBitmap) isolated = NULL;
+    g_autoptr(GString) bad = g_string_new(NULL);
+    struct dirent *ent;
+    DIR *dir;
+    bool checked = false;
+    int ret = 0;
+
+    if (virDirOpenIfExists(&dir, vfiopath) > 0) {
+        while (virDirRead(dir, &ent, vfiopath) > 0) {
+            g_autofree char *devpath = NULL;
+            g_autofree char *localpath = NULL;
+            g_autoptr(virBitmap) local = NULL;
+
+            /* only PCI addresses, the rest are driver attributes */
+            if (!strchr(ent->d_name, ':'))
+                continue;
+
+            devpath = g_strdup_printf("%s/%s", vfiopath, ent->d_name);
+            localpath = g_strdup_printf("%s/local_cpulist", devpath);
+
+            if (virHostValidateReadList(localpath, &local) < 0 || !local) {
+                virResetLastError();
+                continue;
+            }
+
+            checked = true;
+            if (virHostValidateCheckDeviceIRQs(devpath,
+                                               virHostValidateIRQWithin,
+                                               local) < 0)
+                g_string_append_printf(bad, " %s", ent->d_name);
+        }
+        VIR_DIR_CLOSE(dir);
+    }
+
+    if (checked) {
+        virHostMsgCheck(hvname, "%s", _("for IRQ affinity of assigned devices"));
+        if (bad->len == 0) {
+            virHostMsgPass();
+        } else {
+            virHostMsgFail(level,
+                           _("Interrupts of devices%s are handled by CPUs "
+                             "of a different NUMA node"),
+                           bad->str);
+            ret = -1;
+        }
+    }
+
+    if (virHostValidateReadList(SYSFS_CPU_PATH "/isolated", &isolated) < 0)
+        virResetLastError();
+
+    if (!isolated)
+        return ret;
+
+    g_string_truncate(bad, 0);
+
+    if (virDirOpenIfExists(&dir, netpath) > 0) {
+        while (virDirRead(dir, &ent, netpath) > 0) {
+            g_autofree char *devpath = NULL;
+
+            devpath = g_strdup_printf("%s/%s/device", netpath, ent->d_name);
+            if (virHostValidateCheckDeviceIRQs(devpath,
+                                               virHostValidateIRQAvoids,
+                                               isolated) < 0)
+                g_string_append_printf(bad, " %s", ent->d_name);
+        }
+        VIR_DIR_CLOSE(dir);
+    }
+
+    virHostMsgCheck(hvname, "%s", _("for IRQ affinity of network devices"));
+    if (bad->len == 0) {
+        virHostMsgPass();
+    } else {
+        g_autofree char *isolatedStr = virBitmapFormat(isolated);
+
+        virHostMsgFail(level,
+                       _("Interrupts of network devices%s may be handled by "
+                         "isolated CPUs %s"),
+                       bad->str, isolatedStr);
+        ret = -1;
+    }
+
+    return ret;
+}
+
+
+int virHostValidateKSM(const char *hvname,
+                       virHostValidateLevel level)
+{
+    unsigned int run;
+
+    if (virFileReadValueUint(&run, "/sys/kernel/mm/ksm/run") < 0)
+        return 0;
+
+    virHostMsgCheck(hvname, "%s", _("if KSM is disabled"));
+
+    /* 0 stops merging, 2 unmerges all pages */
+    if (run == 1) {
+        virHostMsgFail(level, "%s",
+                       _("Kernel same page merging costs CPU time and slows "
+                         "down writes to merged pages"));
+        return -1;
+    }
+
+    virHostMsgPass();
+    return 0;
+}
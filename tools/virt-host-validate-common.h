@@ -52,6 +52,8 @@ void virHostMsgCheck(const char *prefix,
                      ...) G_GNUC_PRINTF(2, 3);
 
 void virHostMsgPass(void);
+void virHostMsgPassDetail(const char *format,
+                          ...) G_GNUC_PRINTF(1, 2);
 void virHostMsgFail(virHostValidateLevel level,
                     const char *format,
                     ...) G_GNUC_PRINTF(2, 3);
@@ -89,3 +91,25 @@ int virHostValidateSecureGuests(const char *hvname,
                                 virHostValidateLevel level);
 
 bool virHostKernelModuleIsLoaded(const char *module);
+
+int virHostValidateHugepages(const char *hvname,
+                             virHostValidateLevel level);
+
+int virHostValidateCPUGovernor(const char *hvname,
+                               virHostValidateLevel level);
+
+int virHostValidateCPUIdle(const char *hvname,
+                           virHostValidateLevel level);
+
+int virHostValidateTHP(const char *hvname,
+                       virHostValidateLevel level);
+
+int virHostValidateIsolatedCPUs(const char *hvname,
+                                virBitmapPtr pinned,
+                                virHostValidateLevel level);
+
+int virHostValidateIRQAffinity(const char *hvname,
+                               virHostValidateLevel level);
+
+int virHostValidateKSM(const char *hvname,
+                       virHostValidateLevel level);
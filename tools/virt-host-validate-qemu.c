@@ -26,6 +26,7 @@
 #include "virarch.h"
 #include "virbitmap.h"
 #include "vircgroup.h"
+#include "virerror.h"
 
 int virHostValidateQEMU(void)
 {
@@ -132,3 +133,129 @@ int virHostValidateQEMU(void)
 
     return ret;
 }
+
+
+static void
+virHostValidateQEMUIgnoreError(void *opaque G_GNUC_UNUSED,
+                               virErrorPtr err G_GNUC_UNUSED)
+{
+}
+
+
+/*
+ * Collects host CPUs the vCPUs of QEMU domains are pinned to, either
+ * in the live or in the persistent definition, whichever is current.
+ * vCPUs allowed to run on all online CPUs are not considered pinned.
+ *
+ * Returns NULL if the domains can't be inspected, e.g. when the
+ * daemon is not running.
+ */
+static virBitmapPtr
+virHostValidateQEMUGetPinnedCPUs(void)
+{
+    virConnectPtr conn;
+    virDomainPtr *doms = NULL;
+    g_autoptr(virBitmap) online = NULL;
+    unsigned char *onlinemap = NULL;
+    virBitmapPtr pinned = NULL;
+    int ncpus;
+    int ndoms = 0;
+    size_t maplen;
+    size_t i;
+
+    virSetErrorFunc(NULL, virHostValidateQEMUIgnoreError);
+
+    if (!(conn = virConnectOpenReadOnly("qemu:///system")))
+        goto cleanup;
+
+    if ((ncpus = virNodeGetCPUMap(conn, &onlinemap, NULL, 0)) < 0)
+        goto cleanup;
+
+    if ((ndoms = virConnectListAllDomains(conn, &doms, 0)) < 0) {
+        ndoms = 0;
+        goto cleanup;
+    }
+
+    maplen = VIR_CPU_MAPLEN(ncpus);
+    online = virBitmapNewData(onlinemap, maplen);
+    pinned = virBitmapNew(ncpus);
+
+    for (i = 0; i < ndoms; i++) {
+        g_autofree unsigned char *cpumaps = NULL;
+        int nvcpus;
+        int vcpu;
+
+        if ((nvcpus = virDomainGetVcpusFlags(doms[i],
+                                             VIR_DOMAIN_VCPU_MAXIMUM)) <= 0)
+            continue;
+
+        cpumaps = g_new0(unsigned char, nvcpus * maplen);
+
+        if ((nvcpus = virDomainGetVcpuPinInfo(doms[i], nvcpus, cpumaps,
+                                              maplen, 0)) < 0)
+            continue;
+
+        for (vcpu = 0; vcpu < nvcpus; vcpu++) {
+            g_autoptr(virBitmap) map = NULL;
+            g_autoptr(virBitmap) unused = NULL;
+
+            map = virBitmapNewData(VIR_GET_CPUMAP(cpumaps, maplen, vcpu),
+                                   maplen);
+            unused = virBitmapNewCopy(online);
+            virBitmapSubtract(unused, map);
+
+            if (!virBitmapIsAllClear(unused))
+                ignore_value(virBitmapUnion(pinned, map));
+        }
+    }
+
+ cleanup:
+    for (i = 0; i < ndoms; i++)
+        virDomainFree(doms[i]);
+    VIR_FREE(doms);
+    VIR_FREE(onlinemap);
+    if (conn)
+        virConnectClose(conn);
+    virResetLastError();
+    virSetErrorFunc(NULL, NULL);
+    return pinned;
+}
+
+
+/**
+ * virHostValidateQEMUPerformance:
+ *
+ * Checks host settings which don't prevent running QEMU guests but
+ * affect their performance.
+ *
+ * Returns 0 if all checks pass, -1 otherwise
+ */
+int virHostValidateQEMUPerformance(void)
+{
+    g_autoptr(virBitmap) pinned = virHostValidateQEMUGetPinnedCPUs();
+    int ret = 0;
+
+    if (virHostValidateHugepages("QEMU", VIR_HOST_VALIDATE_WARN) < 0)
+        ret = -1;
+
+    if (virHostValidateTHP("QEMU", VIR_HOST_VALIDATE_WARN) < 0)
+        ret = -1;
+
+    if (virHostValidateCPUGovernor("QEMU", VIR_HOST_VALIDATE_WARN) < 0)
+        ret = -1;
+
+    /* idle states and KSM trade performance for power and memory,
+     * report them without failing */
+    ignore_value(virHostValidateCPUIdle("QEMU", VIR_HOST_VALIDATE_NOTE));
+
+    if (virHostValidateIsolatedCPUs("QEMU", pinned,
+                                    VIR_HOST_VALIDATE_WARN) < 0)
+        ret = -1;
+
+    if (virHostValidateIRQAffinity("QEMU", VIR_HOST_VALIDATE_WARN) < 0)
+        ret = -1;
+
+    ignore_value(virHostValidateKSM("QEMU", VIR_HOST_VALIDATE_NOTE));
+
+    return ret;
+}
@@ -22,3 +22,4 @@
 #pragma once
 
 int virHostValidateQEMU(void);
+int virHostValidateQEMUPerformance(void);
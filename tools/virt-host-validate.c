@@ -54,9 +54,10 @@ show_help(FILE *out, const char *argv0)
               "   - bhyve\n"
               "\n"
               " Options:\n"
-              "   -h, --help     Display command line help\n"
-              "   -v, --version  Display command version\n"
-              "   -q, --quiet    Don't display progress information\n"
+              "   -h, --help         Display command line help\n"
+              "   -v, --version      Display command version\n"
+              "   -q, --quiet        Don't display progress information\n"
+              "   -p, --performance  Check also settings affecting performance\n"
               "\n"),
             argv0);
 }
@@ -71,6 +72,7 @@ static const struct option argOptions[] = {
     { "help", 0, NULL, 'h', },
     { "version", 0, NULL, 'v', },
     { "quiet", 0, NULL, 'q', },
+    { "performance", 0, NULL, 'p', },
     { NULL, 0, NULL, '\0', }
 };
 
@@ -81,12 +83,13 @@ main(int argc, char **argv)
     int c;
     int ret = EXIT_SUCCESS;
     bool quiet = false;
+    bool performance = false;
     bool usedHvname = false;
 
     if (virGettextInitialize() < 0)
         return EXIT_FAILURE;
 
-    while ((c = getopt_long(argc, argv, "hvq", argOptions, NULL)) != -1) {
+    while ((c = getopt_long(argc, argv, "hvqp", argOptions, NULL)) != -1) {
         switch (c) {
         case 'v':
             show_version(stdout, argv[0]);
@@ -100,6 +103,10 @@ main(int argc, char **argv)
             quiet = true;
             break;
 
+        case 'p':
+            performance = true;
+            break;
+
         case '?':
         default:
             show_help(stderr, argv[0]);
@@ -123,6 +130,8 @@ main(int argc, char **argv)
         usedHvname = true;
         if (virHostValidateQEMU() < 0)
             ret = EXIT_FAILURE;
+        if (performance && virHostValidateQEMUPerformance() < 0)
+            ret = EXIT_FAILURE;
     }
 #endif
 
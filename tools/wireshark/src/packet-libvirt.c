@@ -109,6 +109,8 @@ enum vir_net_message_type {
     VIR_NET_CALL_WITH_FDS  = 4,
     VIR_NET_REPLY_WITH_FDS = 5,
     VIR_NET_STREAM_HOLE    = 6,
+    VIR_NET_MESSAGE_BATCH  = 7,
+    VIR_NET_CALL_WITH_TRACE = 8,
 };
 
 enum vir_net_message_status {
@@ -133,6 +135,8 @@ static const value_string type_strings[] = {
     { VIR_NET_CALL_WITH_FDS,  "CALL_WITH_FDS"  },
     { VIR_NET_REPLY_WITH_FDS, "REPLY_WITH_FDS" },
     { VIR_NET_STREAM_HOLE,    "STREAM_HOLE"    },
+    { VIR_NET_MESSAGE_BATCH,  "MESSAGE_BATCH"  },
+    { VIR_NET_CALL_WITH_TRACE, "CALL_WITH_TRACE" },
     { -1, NULL }
 };
 
@@ -322,6 +326,7 @@ find_payload_dissector(guint32 proc, guint32 type,
     switch (type) {
     case VIR_NET_CALL:
     case VIR_NET_CALL_WITH_FDS:
+    case VIR_NET_CALL_WITH_TRACE:
         return pd->args;
     case VIR_NET_REPLY:
     case VIR_NET_REPLY_WITH_FDS:
@@ -373,6 +378,12 @@ dissect_libvirt_payload_xdr_data(tvbuff_t *tvb, proto_tree *tree, gint payload_l
         payload_length -= 4;
     }
 
+    /* Skip the trace context, a 16 byte trace ID and 8 byte span ID */
+    if (status == VIR_NET_CALL_WITH_TRACE) {
+        start += 24;
+        payload_length -= 24;
+    }
+
     payload_tvb = tvb_new_subset_remaining(tvb, start);
     payload_data = (caddr_t)tvb_memdup(NULL, payload_tvb, 0, payload_length);
     xdrmem_create(&xdrs, payload_data, payload_length, XDR_DECODE);